@@ -48,6 +48,9 @@
 #define IVSZ	8
 #define BLOCKSZ	64
 #define RSBUFSZ	(16*BLOCKSZ)
+#ifndef RSTBUFSZ
+#define RSTBUFSZ	(64*BLOCKSZ)	/* per-thread keystream buffer */
+#endif
 
 /* Marked MAP_INHERIT_ZERO, so zero'd out in fork children. */
 static struct _rs {
@@ -65,6 +68,22 @@ static inline int _rs_allocate(struct _rs **, struct _rsx **);
 static inline void _rs_forkdetect(void);
 #include "arc4random.h"
 
+#ifdef _RS_THREADS
+/*
+ * Per-thread generators, keyed from the process-wide one, so that threads
+ * do not all serialise on _ARC4_LOCK(). A thread that finds the generator
+ * for its ID in use falls back to the process-wide one.
+ * Marked MAP_INHERIT_ZERO, so zero'd out and rekeyed in fork children.
+ */
+static struct _rst {
+	_RS_THREAD_LOCK_T rst_lock;
+	size_t		rst_have;	/* valid bytes at end of rst_buf */
+	size_t		rst_count;	/* bytes till rekey from rs */
+	chacha_ctx	rst_chacha;	/* chacha context for random keystream */
+	u_char		rst_buf[RSTBUFSZ];	/* keystream blocks */
+} *rst;
+#endif
+
 static inline void _rs_rekey(u_char *dat, size_t datlen);
 
 static inline void
@@ -176,10 +195,120 @@ _rs_random_u32(uint32_t *val)
 	rs->rs_have -= sizeof(*val);
 }
 
+#ifdef _RS_THREADS
+static inline void
+_rst_init(struct _rst *t, u_char *buf)
+{
+	chacha_keysetup(&t->rst_chacha, buf, KEYSZ * 8, 0);
+	chacha_ivsetup(&t->rst_chacha, buf + KEYSZ);
+}
+
+static void
+_rst_stir(struct _rst *t)
+{
+	u_char rnd[KEYSZ + IVSZ];
+
+	_ARC4_LOCK();
+	_rs_random_buf(rnd, sizeof(rnd));
+	_ARC4_UNLOCK();
+
+	_rst_init(t, rnd);
+	explicit_bzero(rnd, sizeof(rnd));
+
+	/* invalidate rst_buf */
+	t->rst_have = 0;
+	memset(t->rst_buf, 0, sizeof(t->rst_buf));
+
+	t->rst_count = 1600000;
+}
+
+static inline void
+_rst_rekey(struct _rst *t)
+{
+	/* fill rst_buf with the keystream */
+	chacha_encrypt_bytes(&t->rst_chacha, t->rst_buf,
+	    t->rst_buf, sizeof(t->rst_buf));
+	/* immediately reinit for backtracking resistance */
+	_rst_init(t, t->rst_buf);
+	memset(t->rst_buf, 0, KEYSZ + IVSZ);
+	t->rst_have = sizeof(t->rst_buf) - KEYSZ - IVSZ;
+}
+
+/*
+ * Return the calling thread's generator, locked, or NULL if the
+ * process-wide one is to be used.
+ */
+static struct _rst *
+_rst_get(void)
+{
+	struct _rst *t;
+	int i;
+
+	if (!__isthreaded)
+		return (NULL);
+	if (rst == NULL) {
+		_ARC4_LOCK();
+		if (rst == NULL && (t = _rs_allocate_threads(
+		    _RS_THREADS * sizeof(*t))) != NULL) {
+			for (i = 0; i < _RS_THREADS; i++)
+				t[i].rst_lock = _RS_THREAD_UNLOCKED;
+			rst = t;
+		}
+		_ARC4_UNLOCK();
+		if (rst == NULL)
+			return (NULL);
+	}
+
+	t = &rst[_rs_thread_id() % _RS_THREADS];
+	if (!_rs_thread_trylock(&t->rst_lock))
+		return (NULL);
+	return (t);
+}
+
+static void
+_rst_random_buf(struct _rst *t, void *_buf, size_t n)
+{
+	u_char *buf = (u_char *)_buf;
+	u_char *keystream;
+	size_t m;
+
+	if (t->rst_count <= n)
+		_rst_stir(t);
+	if (t->rst_count <= n)
+		t->rst_count = 0;
+	else
+		t->rst_count -= n;
+
+	while (n > 0) {
+		if (t->rst_have > 0) {
+			m = minimum(n, t->rst_have);
+			keystream = t->rst_buf + sizeof(t->rst_buf)
+			    - t->rst_have;
+			memcpy(buf, keystream, m);
+			memset(keystream, 0, m);
+			buf += m;
+			n -= m;
+			t->rst_have -= m;
+		}
+		if (t->rst_have == 0)
+			_rst_rekey(t);
+	}
+}
+#endif
+
 uint32_t
 arc4random(void)
 {
 	uint32_t val;
+#ifdef _RS_THREADS
+	struct _rst *t;
+
+	if ((t = _rst_get()) != NULL) {
+		_rst_random_buf(t, &val, sizeof(val));
+		_rs_thread_unlock(&t->rst_lock);
+		return val;
+	}
+#endif
 
 	_ARC4_LOCK();
 	_rs_random_u32(&val);
@@ -191,6 +320,16 @@ DEF_WEAK(arc4random);
 void
 arc4random_buf(void *buf, size_t n)
 {
+#ifdef _RS_THREADS
+	struct _rst *t;
+
+	if ((t = _rst_get()) != NULL) {
+		_rst_random_buf(t, buf, n);
+		_rs_thread_unlock(&t->rst_lock);
+		return;
+	}
+#endif
+
 	_ARC4_LOCK();
 	_rs_random_buf(buf, n);
 	_ARC4_UNLOCK();
@@ -59,3 +59,30 @@ static inline void
 _rs_forkdetect(void)
 {
 }
+
+/*
+ * Threaded processes also get per-thread generators, picked by thread ID.
+ */
+#include <tib.h>
+
+#define _RS_THREADS		16
+#define _RS_THREAD_LOCK_T	_atomic_lock_t
+#define _RS_THREAD_UNLOCKED	_SPINLOCK_UNLOCKED
+#define _rs_thread_id()		(TIB_GET()->tib_tid)
+#define _rs_thread_trylock(l)	_spinlocktry(l)
+#define _rs_thread_unlock(l)	_spinunlock(l)
+
+static inline void *
+_rs_allocate_threads(size_t len)
+{
+	void *p;
+
+	if ((p = mmap(NULL, len, PROT_READ|PROT_WRITE,
+	    MAP_ANON|MAP_PRIVATE, -1, 0)) == MAP_FAILED)
+		return (NULL);
+	if (minherit(p, len, MAP_INHERIT_ZERO) == -1) {
+		munmap(p, len);
+		return (NULL);
+	}
+	return (p);
+}
@@ -85,25 +85,22 @@ bcrypt_initsalt(int log_rounds, uint8_t *salt, size_t saltbuflen)
 	return 0;
 }
 
-/*
- * the core bcrypt function
- */
-static int
-bcrypt_hashpass(const char *key, const char *salt, char *encrypted,
-    size_t encryptedlen)
-{
+struct bcrypt_hash {
 	blf_ctx state;
-	u_int32_t rounds, i, k;
-	u_int16_t j;
+	const u_int8_t *key;
 	size_t key_len;
-	u_int8_t salt_len, logr, minor;
-	u_int8_t ciphertext[4 * BCRYPT_WORDS] = "OrpheanBeholderScryDoubt";
+	u_int32_t rounds;
 	u_int8_t csalt[BCRYPT_MAXSALT];
-	u_int32_t cdata[BCRYPT_WORDS];
-
-	if (encryptedlen < BCRYPT_HASHSPACE)
-		goto inval;
+	u_int8_t logr;
+	u_int8_t minor;
+};
 
+/*
+ * Parse the salt and set up the initial state.
+ */
+static int
+bcrypt_setup(struct bcrypt_hash *h, const char *key, const char *salt)
+{
 	/* Check and discard "$" identifier */
 	if (salt[0] != '$')
 		goto inval;
@@ -113,19 +110,19 @@ bcrypt_hashpass(const char *key, const char *salt, char *encrypted,
 		goto inval;
 
 	/* Check for minor versions */
-	switch ((minor = salt[1])) {
+	switch ((h->minor = salt[1])) {
 	case 'a':
-		key_len = (u_int8_t)(strlen(key) + 1);
+		h->key_len = (u_int8_t)(strlen(key) + 1);
 		break;
 	case 'b':
 		/* strlen() returns a size_t, but the function calls
 		 * below result in implicit casts to a narrower integer
 		 * type, so cap key_len at the actual maximum supported
 		 * length here to avoid integer wraparound */
-		key_len = strlen(key);
-		if (key_len > 72)
-			key_len = 72;
-		key_len++; /* include the NUL */
+		h->key_len = strlen(key);
+		if (h->key_len > 72)
+			h->key_len = 72;
+		h->key_len++; /* include the NUL */
 		break;
 	default:
 		 goto inval;
@@ -139,11 +136,11 @@ bcrypt_hashpass(const char *key, const char *salt, char *encrypted,
 	if (!isdigit((unsigned char)salt[0]) ||
 	    !isdigit((unsigned char)salt[1]) || salt[2] != '$')
 		goto inval;
-	logr = (salt[1] - '0') + ((salt[0] - '0') * 10);
-	if (logr < BCRYPT_MINLOGROUNDS || logr > 31)
+	h->logr = (salt[1] - '0') + ((salt[0] - '0') * 10);
+	if (h->logr < BCRYPT_MINLOGROUNDS || h->logr > 31)
 		goto inval;
 	/* Computer power doesn't increase linearly, 2^x should be fine */
-	rounds = 1U << logr;
+	h->rounds = 1U << h->logr;
 
 	/* Discard num rounds + "$" identifier */
 	salt += 3;
@@ -152,18 +149,32 @@ bcrypt_hashpass(const char *key, const char *salt, char *encrypted,
 		goto inval;
 
 	/* We dont want the base64 salt but the raw data */
-	if (decode_base64(csalt, BCRYPT_MAXSALT, salt))
+	if (decode_base64(h->csalt, BCRYPT_MAXSALT, salt))
 		goto inval;
-	salt_len = BCRYPT_MAXSALT;
+
+	h->key = (const u_int8_t *)key;
 
 	/* Setting up S-Boxes and Subkeys */
-	Blowfish_initstate(&state);
-	Blowfish_expandstate(&state, csalt, salt_len,
-	    (u_int8_t *) key, key_len);
-	for (k = 0; k < rounds; k++) {
-		Blowfish_expand0state(&state, (u_int8_t *) key, key_len);
-		Blowfish_expand0state(&state, csalt, salt_len);
-	}
+	Blowfish_initstate(&h->state);
+	Blowfish_expandstate(&h->state, h->csalt, BCRYPT_MAXSALT,
+	    h->key, h->key_len);
+	return 0;
+
+inval:
+	errno = EINVAL;
+	return -1;
+}
+
+/*
+ * Encrypt the magic text with the expanded state and encode the result.
+ */
+static void
+bcrypt_finish(struct bcrypt_hash *h, char *encrypted)
+{
+	u_int32_t i, k;
+	u_int16_t j;
+	u_int8_t ciphertext[4 * BCRYPT_WORDS] = "OrpheanBeholderScryDoubt";
+	u_int32_t cdata[BCRYPT_WORDS];
 
 	/* This can be precomputed later */
 	j = 0;
@@ -172,7 +183,7 @@ bcrypt_hashpass(const char *key, const char *salt, char *encrypted,
 
 	/* Now do the encryption */
 	for (k = 0; k < 64; k++)
-		blf_enc(&state, cdata, BCRYPT_WORDS / 2);
+		blf_enc(&h->state, cdata, BCRYPT_WORDS / 2);
 
 	for (i = 0; i < BCRYPT_WORDS; i++) {
 		ciphertext[4 * i + 3] = cdata[i] & 0xff;
@@ -185,18 +196,165 @@ bcrypt_hashpass(const char *key, const char *salt, char *encrypted,
 	}
 
 
-	snprintf(encrypted, 8, "$2%c$%2.2u$", minor, logr);
-	encode_base64(encrypted + 7, csalt, BCRYPT_MAXSALT);
+	snprintf(encrypted, 8, "$2%c$%2.2u$", h->minor, h->logr);
+	encode_base64(encrypted + 7, h->csalt, BCRYPT_MAXSALT);
 	encode_base64(encrypted + 7 + 22, ciphertext, 4 * BCRYPT_WORDS - 1);
-	explicit_bzero(&state, sizeof(state));
+	explicit_bzero(h, sizeof(*h));
 	explicit_bzero(ciphertext, sizeof(ciphertext));
-	explicit_bzero(csalt, sizeof(csalt));
 	explicit_bzero(cdata, sizeof(cdata));
+}
+
+/*
+ * the core bcrypt function
+ */
+static int
+bcrypt_hashpass(const char *key, const char *salt, char *encrypted,
+    size_t encryptedlen)
+{
+	struct bcrypt_hash h;
+	u_int32_t k;
+
+	if (encryptedlen < BCRYPT_HASHSPACE) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (bcrypt_setup(&h, key, salt) != 0)
+		return -1;
+
+	for (k = 0; k < h.rounds; k++) {
+		Blowfish_expand0state(&h.state, h.key, h.key_len);
+		Blowfish_expand0state(&h.state, h.csalt, BCRYPT_MAXSALT);
+	}
+
+	bcrypt_finish(&h, encrypted);
 	return 0;
+}
 
-inval:
-	errno = EINVAL;
-	return -1;
+/*
+ * Several independent hashes are expanded in lock step, one Blowfish
+ * round of each in turn.  A single Blowfish encryption is a long chain
+ * of dependent S-box loads; interleaving the lanes lets the loads of
+ * one hash overlap those of the others.  Each hash does exactly the
+ * work it would do alone.
+ */
+#define BCRYPT_LANES 4
+
+#define BCRYPT_F(s, x) ((((s)[0][((x) >> 24) & 0xff] + \
+			  (s)[1][((x) >> 16) & 0xff]) ^ \
+			  (s)[2][((x) >> 8) & 0xff]) + \
+			  (s)[3][(x) & 0xff])
+
+#define BCRYPT_ROUND(i, j, n) do {					\
+	for (l = 0; l < BCRYPT_LANES; l++)				\
+		i[l] ^= BCRYPT_F(c[l]->S, j[l]) ^ c[l]->P[n];		\
+} while (0)
+
+static void
+bcrypt_encipher_lanes(blf_ctx *c[BCRYPT_LANES], u_int32_t xl[BCRYPT_LANES],
+    u_int32_t xr[BCRYPT_LANES])
+{
+	u_int32_t t;
+	int i, l;
+
+	for (l = 0; l < BCRYPT_LANES; l++)
+		xl[l] ^= c[l]->P[0];
+	for (i = 1; i <= BLF_N; i += 2) {
+		BCRYPT_ROUND(xr, xl, i);
+		BCRYPT_ROUND(xl, xr, i + 1);
+	}
+	for (l = 0; l < BCRYPT_LANES; l++) {
+		t = xl[l];
+		xl[l] = xr[l] ^ c[l]->P[BLF_N + 1];
+		xr[l] = t;
+	}
+}
+
+/*
+ * Blowfish_expand0state() on each lane, with either the key or the salt.
+ */
+static void
+bcrypt_expand0_lanes(struct bcrypt_hash *h, int salt)
+{
+	blf_ctx *c[BCRYPT_LANES];
+	u_int32_t datal[BCRYPT_LANES], datar[BCRYPT_LANES];
+	const u_int8_t *data;
+	u_int16_t databytes;
+	u_int16_t i, j, k;
+	int l;
+
+	for (l = 0; l < BCRYPT_LANES; l++) {
+		c[l] = &h[l].state;
+		data = salt ? h[l].csalt : h[l].key;
+		databytes = salt ? BCRYPT_MAXSALT : h[l].key_len;
+		j = 0;
+		for (i = 0; i < BLF_N + 2; i++)
+			c[l]->P[i] ^= Blowfish_stream2word(data, databytes, &j);
+		datal[l] = 0;
+		datar[l] = 0;
+	}
+
+	for (i = 0; i < BLF_N + 2; i += 2) {
+		bcrypt_encipher_lanes(c, datal, datar);
+		for (l = 0; l < BCRYPT_LANES; l++) {
+			c[l]->P[i] = datal[l];
+			c[l]->P[i + 1] = datar[l];
+		}
+	}
+
+	for (i = 0; i < 4; i++) {
+		for (k = 0; k < 256; k += 2) {
+			bcrypt_encipher_lanes(c, datal, datar);
+			for (l = 0; l < BCRYPT_LANES; l++) {
+				c[l]->S[i][k] = datal[l];
+				c[l]->S[i][k + 1] = datar[l];
+			}
+		}
+	}
+}
+
+static int
+bcrypt_compare(const char *hash, const char *goodhash)
+{
+	if (strlen(hash) != strlen(goodhash) ||
+	    timingsafe_bcmp(hash, goodhash, strlen(goodhash)) != 0)
+		return EACCES;
+	return 0;
+}
+
+/*
+ * Finish a group of up to BCRYPT_LANES hashes with the same number of
+ * rounds.  A short group is expanded one hash at a time.
+ */
+static void
+bcrypt_checkpass_lanes(struct bcrypt_hash *h, const size_t *idx, int n,
+    const char * const *goodhash, int *errors)
+{
+	char hash[BCRYPT_HASHSPACE];
+	u_int32_t k;
+	int l;
+
+	if (n == BCRYPT_LANES) {
+		for (k = 0; k < h[0].rounds; k++) {
+			bcrypt_expand0_lanes(h, 0);
+			bcrypt_expand0_lanes(h, 1);
+		}
+	} else {
+		for (l = 0; l < n; l++) {
+			for (k = 0; k < h[l].rounds; k++) {
+				Blowfish_expand0state(&h[l].state, h[l].key,
+				    h[l].key_len);
+				Blowfish_expand0state(&h[l].state, h[l].csalt,
+				    BCRYPT_MAXSALT);
+			}
+		}
+	}
+
+	for (l = 0; l < n; l++) {
+		bcrypt_finish(&h[l], hash);
+		errors[idx[l]] = bcrypt_compare(hash, goodhash[idx[l]]);
+	}
+	explicit_bzero(hash, sizeof(hash));
 }
 
 /*
@@ -225,8 +383,7 @@ bcrypt_checkpass(const char *pass, const char *goodhash)
 
 	if (bcrypt_hashpass(pass, goodhash, hash, sizeof(hash)) != 0)
 		return -1;
-	if (strlen(hash) != strlen(goodhash) ||
-	    timingsafe_bcmp(hash, goodhash, strlen(goodhash)) != 0) {
+	if (bcrypt_compare(hash, goodhash) != 0) {
 		errno = EACCES;
 		return -1;
 	}
@@ -236,6 +393,46 @@ bcrypt_checkpass(const char *pass, const char *goodhash)
 }
 DEF_WEAK(bcrypt_checkpass);
 
+int
+bcrypt_checkpass_batch(const char * const *pass, const char * const *goodhash,
+    int *errors, size_t count)
+{
+	struct bcrypt_hash h[BCRYPT_LANES];
+	size_t idx[BCRYPT_LANES];
+	size_t i;
+	int n = 0;
+
+	for (i = 0; i < count; i++) {
+		if (bcrypt_setup(&h[n], pass[i], goodhash[i]) != 0) {
+			errors[i] = EINVAL;
+			continue;
+		}
+		/* Lanes run in lock step, so they must have the same cost. */
+		if (n > 0 && h[n].rounds != h[0].rounds) {
+			bcrypt_checkpass_lanes(h, idx, n, goodhash, errors);
+			h[0] = h[n];
+			explicit_bzero(&h[n], sizeof(h[n]));
+			n = 0;
+		}
+		idx[n++] = i;
+		if (n == BCRYPT_LANES) {
+			bcrypt_checkpass_lanes(h, idx, n, goodhash, errors);
+			n = 0;
+		}
+	}
+	if (n > 0)
+		bcrypt_checkpass_lanes(h, idx, n, goodhash, errors);
+
+	for (i = 0; i < count; i++) {
+		if (errors[i] != 0) {
+			errno = errors[i];
+			return -1;
+		}
+	}
+	return 0;
+}
+DEF_WEAK(bcrypt_checkpass_batch);
+
 /*
  * Measure this system's performance by measuring the time for 8 rounds.
  * We are aiming for something that takes around 0.1s, but not too much over.
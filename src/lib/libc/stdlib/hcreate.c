@@ -45,6 +45,17 @@
  *
  * I tried to look at Knuth (as cited by the Solaris manual page), but
  * nobody had a copy in the office, so...
+ *
+ * The table uses open addressing with linear probing, and doubles in size
+ * whenever it becomes half full. Each slot holds the hash of its key next
+ * to a pointer to the entry, so that a probe only follows the pointer
+ * when the hashes match. The entries themselves are allocated one at a
+ * time so that the pointers handed out by hsearch() stay valid when the
+ * table grows.
+ *
+ * hcreate_r() / hsearch_r() / hdestroy_r() work on a table supplied by the
+ * caller, so several tables can be used at once; the traditional
+ * functions use a single static one.
  */
 
 #include <assert.h>
@@ -53,7 +64,6 @@
 #include <search.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/queue.h>
 
 #include <db.h>		/* for __default_hash */
 
@@ -62,128 +72,208 @@
 #endif
 
 /*
- * DO NOT MAKE THIS STRUCTURE LARGER THAN 32 BYTES (4 ptrs on 64-bit
+ * DO NOT MAKE THIS STRUCTURE LARGER THAN 16 BYTES (2 ptrs on 64-bit
  * ptr machine) without adjusting MAX_BUCKETS_LG2 below.
  */
-struct internal_entry {
-	SLIST_ENTRY(internal_entry) link;
-	ENTRY ent;
+struct internal_slot {
+	uint32_t hash;
+	ENTRY *ent;
 };
-SLIST_HEAD(internal_head, internal_entry);
 
 #define	MIN_BUCKETS_LG2	4
 #define	MIN_BUCKETS	(1 << MIN_BUCKETS_LG2)
 
 /*
- * max * sizeof internal_entry must fit into size_t.
- * assumes internal_entry is <= 32 (2^5) bytes.
+ * max * sizeof internal_slot must fit into size_t.
+ * assumes internal_slot is <= 16 (2^4) bytes.
  */
-#define	MAX_BUCKETS_LG2	(sizeof (size_t) * 8 - 1 - 5)
+#define	MAX_BUCKETS_LG2	(sizeof (size_t) * 8 - 1 - 4)
 #define	MAX_BUCKETS	((size_t)1 << MAX_BUCKETS_LG2)
 
-static struct internal_head *htable;
-static size_t htablesize;
+static struct hsearch_data htab;
 
 int
-hcreate(size_t nel)
+hcreate_r(size_t nel, struct hsearch_data *table)
 {
-	size_t idx;
-	unsigned int p2;
+	size_t size;
 
-	/* Make sure this isn't called when a table already exists. */
-	_DIAGASSERT(htable == NULL);
-	if (htable != NULL) {
-		errno = EINVAL;
-		return 0;
-	}
+	_DIAGASSERT(table != NULL);
+
+	/* Keep the table at most half full with nel entries. */
+	if (nel > MAX_BUCKETS / 2)
+		nel = MAX_BUCKETS / 2;
+	nel *= 2;
 
 	/* If nel is too small, make it min sized. */
 	if (nel < MIN_BUCKETS)
 		nel = MIN_BUCKETS;
 
-	/* If it's too large, cap it. */
-	if (nel > MAX_BUCKETS)
-		nel = MAX_BUCKETS;
-
 	/* If it's is not a power of two in size, round up. */
-	if ((nel & (nel - 1)) != 0) {
-		for (p2 = 0; nel != 0; p2++)
-			nel >>= 1;
-		_DIAGASSERT(p2 <= MAX_BUCKETS_LG2);
-		nel = 1 << p2;
-	}
-	
+	for (size = MIN_BUCKETS; size < nel; size <<= 1)
+		;
+
 	/* Allocate the table. */
-	htablesize = nel;
-	htable = calloc(htablesize, sizeof htable[0]);
-	if (htable == NULL) {
+	table->table = calloc(size, sizeof(struct internal_slot));
+	if (table->table == NULL) {
 		errno = ENOMEM;
 		return 0;
 	}
-
-	/* Initialize it. */
-	for (idx = 0; idx < htablesize; idx++)
-		SLIST_INIT(&htable[idx]);
+	table->size = size;
+	table->filled = 0;
 
 	return 1;
 }
 
 void
-hdestroy(void)
+hdestroy_r(struct hsearch_data *table)
 {
-	struct internal_entry *ie;
+	struct internal_slot *slots;
 	size_t idx;
 
-	_DIAGASSERT(htable != NULL);
-	if (htable == NULL)
+	_DIAGASSERT(table != NULL);
+	if ((slots = table->table) == NULL)
 		return;
 
-	for (idx = 0; idx < htablesize; idx++) {
-		while (!SLIST_EMPTY(&htable[idx])) {
-			ie = SLIST_FIRST(&htable[idx]);
-			SLIST_REMOVE_HEAD(&htable[idx], link);
-			free(ie->ent.key);
-			free(ie);
+	for (idx = 0; idx < table->size; idx++) {
+		if (slots[idx].ent != NULL) {
+			free(slots[idx].ent->key);
+			free(slots[idx].ent);
 		}
 	}
-	free(htable);
-	htable = NULL;
+	free(slots);
+	table->table = NULL;
+	table->size = 0;
+	table->filled = 0;
 }
 
-ENTRY *
-hsearch(ENTRY item, ACTION action)
+/*
+ * Double the size of a table. The hashes are kept in the slots, so the
+ * keys do not need to be hashed again.
+ */
+static int
+hgrow(struct hsearch_data *table)
 {
-	struct internal_head *head;
-	struct internal_entry *ie;
+	struct internal_slot *old = table->table, *new;
+	size_t idx, i, mask, size;
+
+	if (table->size >= MAX_BUCKETS)
+		return 0;
+	size = table->size * 2;
+	mask = size - 1;
+
+	if ((new = calloc(size, sizeof(*new))) == NULL)
+		return 0;
+	for (idx = 0; idx < table->size; idx++) {
+		if (old[idx].ent == NULL)
+			continue;
+		for (i = old[idx].hash & mask; new[i].ent != NULL;
+		    i = (i + 1) & mask)
+			;
+		new[i] = old[idx];
+	}
+	free(old);
+
+	table->table = new;
+	table->size = size;
+
+	return 1;
+}
+
+int
+hsearch_r(ENTRY item, ACTION action, ENTRY **retval,
+    struct hsearch_data *table)
+{
+	struct internal_slot *slots;
+	ENTRY *ent;
 	uint32_t hashval;
-	size_t len;
+	size_t i, mask;
 
-	_DIAGASSERT(htable != NULL);
+	_DIAGASSERT(table != NULL && table->table != NULL);
 	_DIAGASSERT(item.key != NULL);
 	_DIAGASSERT(action == ENTER || action == FIND);
 
-	len = strlen(item.key);
-	hashval = __default_hash(item.key, len);
+	hashval = __default_hash(item.key, strlen(item.key));
 
-	head = &htable[hashval & (htablesize - 1)];
-	ie = SLIST_FIRST(head);
-	while (ie != NULL) {
-		if (strcmp(ie->ent.key, item.key) == 0)
-			break;
-		ie = SLIST_NEXT(ie, link);
+	slots = table->table;
+	mask = table->size - 1;
+	for (i = hashval & mask; slots[i].ent != NULL; i = (i + 1) & mask) {
+		if (slots[i].hash == hashval &&
+		    strcmp(slots[i].ent->key, item.key) == 0) {
+			*retval = slots[i].ent;
+			return 1;
+		}
 	}
 
-	if (ie != NULL)
-		return &ie->ent;
-	else if (action == FIND)
-		return NULL;
+	if (action == FIND) {
+		*retval = NULL;
+		errno = ESRCH;
+		return 0;
+	}
 
-	ie = malloc(sizeof *ie);
-	if (ie == NULL)
-		return NULL;
-	ie->ent.key = item.key;
-	ie->ent.data = item.data;
+	/*
+	 * Grow the table once it is half full. If that fails, carry on
+	 * in the current table while it still has a free slot to keep the
+	 * probes finite.
+	 */
+	if (table->filled + 1 > table->size / 2) {
+		if (hgrow(table)) {
+			slots = table->table;
+			mask = table->size - 1;
+			for (i = hashval & mask; slots[i].ent != NULL;
+			    i = (i + 1) & mask)
+				;
+		} else if (table->filled + 1 >= table->size) {
+			*retval = NULL;
+			errno = ENOMEM;
+			return 0;
+		}
+	}
 
-	SLIST_INSERT_HEAD(head, ie, link);
-	return &ie->ent;
+	if ((ent = malloc(sizeof(*ent))) == NULL) {
+		*retval = NULL;
+		errno = ENOMEM;
+		return 0;
+	}
+	ent->key = item.key;
+	ent->data = item.data;
+
+	slots[i].hash = hashval;
+	slots[i].ent = ent;
+	table->filled++;
+
+	*retval = ent;
+	return 1;
+}
+
+int
+hcreate(size_t nel)
+{
+	/* Make sure this isn't called when a table already exists. */
+	_DIAGASSERT(htab.table == NULL);
+	if (htab.table != NULL) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	return hcreate_r(nel, &htab);
+}
+
+void
+hdestroy(void)
+{
+	_DIAGASSERT(htab.table != NULL);
+	if (htab.table == NULL)
+		return;
+
+	hdestroy_r(&htab);
+}
+
+ENTRY *
+hsearch(ENTRY item, ACTION action)
+{
+	ENTRY *ent;
+
+	if (hsearch_r(item, action, &ent, &htab) == 0)
+		return NULL;
+	return ent;
 }
@@ -35,6 +35,12 @@
 #include <errno.h>
 #include <stdlib.h>
 
+#ifdef I_AM_QSORT_R
+#define COMPAR(a, b)	compar((a), (b), thunk)
+#else
+#define COMPAR(a, b)	compar((a), (b))
+#endif
+
 /*
  * Swap two areas of size number of bytes.  Although qsort(3) permits random
  * blocks of memory to be sorted, sorting pointers is almost certainly the
@@ -72,12 +78,12 @@
 	for (par_i = initval; (child_i = par_i * 2) <= nmemb; \
 	    par_i = child_i) { \
 		child = base + child_i * size; \
-		if (child_i < nmemb && compar(child, child + size) < 0) { \
+		if (child_i < nmemb && COMPAR(child, child + size) < 0) { \
 			child += size; \
 			++child_i; \
 		} \
 		par = base + par_i * size; \
-		if (compar(child, par) <= 0) \
+		if (COMPAR(child, par) <= 0) \
 			break; \
 		SWAP(par, child, count, size, tmp); \
 	} \
@@ -103,7 +109,7 @@
 #define SELECT(par_i, child_i, nmemb, par, child, size, k, count, tmp1, tmp2) { \
 	for (par_i = 1; (child_i = par_i * 2) <= nmemb; par_i = child_i) { \
 		child = base + child_i * size; \
-		if (child_i < nmemb && compar(child, child + size) < 0) { \
+		if (child_i < nmemb && COMPAR(child, child + size) < 0) { \
 			child += size; \
 			++child_i; \
 		} \
@@ -115,7 +121,7 @@
 		par_i = child_i / 2; \
 		child = base + child_i * size; \
 		par = base + par_i * size; \
-		if (child_i == 1 || compar(k, par) < 0) { \
+		if (child_i == 1 || COMPAR(k, par) < 0) { \
 			COPY(child, k, count, size, tmp1, tmp2); \
 			break; \
 		} \
@@ -129,10 +135,19 @@
  * the BSD quicksort does median selection so that the chance of finding
  * a data set that will trigger the worst case is nonexistent.  Heapsort's
  * only advantage over quicksort is that it requires little additional memory.
+ *
+ * qsort_r.c includes this file with I_AM_QSORT_R defined to get a private
+ * heapsort_r() for its introsort fallback.
  */
+#ifdef I_AM_QSORT_R
+static int
+heapsort_r(void *vbase, size_t nmemb, size_t size,
+    int (*compar)(const void *, const void *, void *), void *thunk)
+#else
 int
 heapsort(void *vbase, size_t nmemb, size_t size,
     int (*compar)(const void *, const void *))
+#endif
 {
 	size_t cnt, i, j, l;
 	char tmp, *tmp1, *tmp2;
@@ -172,4 +187,6 @@ heapsort(void *vbase, size_t nmemb, size_t size,
 	free(k);
 	return (0);
 }
+#ifndef I_AM_QSORT_R
 DEF_WEAK(heapsort);
+#endif
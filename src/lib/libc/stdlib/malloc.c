@@ -65,6 +65,7 @@
 #endif
 #define MALLOC_DEFAULT_CACHE	64
 #define MALLOC_CHUNK_LISTS	4
+#define MALLOC_CHUNK_BATCH	16
 #define CHUNK_CHECK_LENGTH	32
 
 /*
@@ -140,6 +141,13 @@ struct dir_info {
 	u_char rbytes[32];		/* random bytes */
 					/* free pages cache */
 	struct cache cache[MAX_CACHEABLE_SIZE];
+					/* counters for malloc_stats() */
+	size_t bytes_used;		/* bytes in allocations */
+	size_t chunk_pages[MALLOC_MAXSHIFT + 1]; /* pages of chunks */
+	size_t cache_hits;		/* pages taken from the cache */
+	size_t cache_misses;		/* cacheable pages not in cache */
+	size_t mmaps;			/* calls to mmap */
+	size_t munmaps;			/* calls to munmap */
 #ifdef MALLOC_STATS
 	size_t inserts;
 	size_t insert_collisions;
@@ -187,9 +195,42 @@ struct chunk_info {
 	u_short free;			/* how many free chunks */
 	u_short total;			/* how many chunks */
 	u_short offset;			/* requested size table offset */
+	u_short nbatch;			/* how many chunks in batch */
+	u_short batch[MALLOC_CHUNK_BATCH]; /* free chunks, shuffled */
 	u_short bits[1];		/* which chunks are free */
 };
 
+/*
+ * Per-thread caches of freed chunks.
+ *
+ * In multi-threaded mode chunks leaving the delayed free list are kept in
+ * a cache picked by thread ID, from which malloc() can hand them out again
+ * without taking the pool mutex. The chunks stay allocated as far as their
+ * pool is concerned. Each cache only holds chunks of the pool its threads
+ * use, and is returned to that pool half at a time once it fills up.
+ * A cache is claimed with a try-lock: a thread that finds it busy falls
+ * back to its pool.
+ */
+#define MALLOC_TCACHE_MAX	16
+#define MALLOC_TCACHE_POOLS	4	/* caches per pool */
+#define MALLOC_TCACHE_LEN(shift)				\
+	(MALLOC_TCACHE_MAX < (MALLOC_PAGESIZE >> (shift)) ?	\
+	    MALLOC_TCACHE_MAX : (MALLOC_PAGESIZE >> (shift)))
+
+struct tcache_chunk {
+	void *p;
+	struct chunk_info *info;
+};
+
+struct tcache {
+	_atomic_lock_t lock;
+	struct dir_info *pool;		/* pool of the cached chunks */
+	size_t rbytesused;		/* random bytes used */
+	u_char rbytes[32];		/* random bytes */
+	u_short length[MALLOC_MAXSHIFT + 1];
+	struct tcache_chunk chunks[MALLOC_MAXSHIFT + 1][MALLOC_TCACHE_MAX];
+};
+
 struct malloc_readonly {
 					/* Main bookkeeping information */
 	struct dir_info *malloc_pool[_MALLOC_MUTEXES];
@@ -203,6 +244,8 @@ struct malloc_readonly {
 	u_int	chunk_canaries;		/* use canaries after chunks? */
 	int	internal_funcs;		/* use better recallocarray/freezero? */
 	u_int	def_maxcache;		/* free pages we cache */
+	struct tcache *malloc_tcache;	/* per-thread chunk caches */
+	u_int	malloc_tcaches;		/* how many of them? */
 	size_t	malloc_guard;		/* use guard pages after allocations? */
 #ifdef MALLOC_STATS
 	int	malloc_stats;		/* dump statistics at end */
@@ -222,6 +265,9 @@ char		*malloc_options;	/* compile-time options */
 static __dead void wrterror(struct dir_info *d, char *msg, ...)
     __attribute__((__format__ (printf, 2, 3)));
 
+void malloc_stats(int);
+PROTO_NORMAL(malloc_stats);
+
 #ifdef MALLOC_STATS
 void malloc_dump(int, int, struct dir_info *);
 PROTO_NORMAL(malloc_dump);
@@ -284,6 +330,15 @@ getpool(void)
 		    (mopts.malloc_mutexes - 1)];
 }
 
+static inline struct tcache *
+gettcache(void)
+{
+	if (mopts.malloc_tcache == NULL)
+		return NULL;
+	/* maps to the cache of the pool getpool() returns */
+	return &mopts.malloc_tcache[TIB_GET()->tib_tid % mopts.malloc_tcaches];
+}
+
 static __dead void
 wrterror(struct dir_info *d, char *msg, ...)
 {
@@ -542,6 +597,7 @@ omalloc_grow(struct dir_info *d)
 
 	/* Don't use cache here, we don't want user uaf touch this */
 	p = MMAP(newsize, d->mmap_flag);
+	d->mmaps++;
 	if (p == MAP_FAILED)
 		return 1;
 
@@ -600,6 +656,9 @@ insert(struct dir_info *d, void *p, size_t sz, void *f)
 	d->r[index].f = f;
 #endif
 	d->regions_free--;
+	/* chunk pages are accounted for by their chunks */
+	if (((uintptr_t)p & MALLOC_PAGEMASK) == 0)
+		d->bytes_used += PAGEROUND(sz);
 	return 0;
 }
 
@@ -632,10 +691,13 @@ delete(struct dir_info *d, struct region_info *ri)
 {
 	/* algorithm R, Knuth Vol III section 6.4 */
 	size_t mask = d->regions_total - 1;
-	size_t i, j, r;
+	size_t i, j, r, sz;
 
 	if (d->regions_total & (d->regions_total - 1))
 		wrterror(d, "regions_total not 2^x");
+	REALSIZE(sz, ri);
+	if (sz > MALLOC_MAXCHUNK)
+		d->bytes_used -= PAGEROUND(sz);
 	d->regions_free++;
 	STATS_INC(d->deletes);
 
@@ -720,6 +782,7 @@ unmap(struct dir_info *d, void *p, size_t sz, size_t clear)
 		wrterror(d, "munmap round");
 
 	if (psz > MAX_CACHEABLE_SIZE || d->cache[psz - 1].max == 0) {
+		d->munmaps++;
 		if (munmap(p, sz))
 			wrterror(d, "munmap %p", p);
 		STATS_SUB(d->malloc_used, sz);
@@ -732,6 +795,7 @@ unmap(struct dir_info *d, void *p, size_t sz, size_t clear)
 		r = cache->pages[i];
 		if (!mopts.malloc_freeunmap)
 			validate_junk(d, r, sz);
+		d->munmaps++;
 		if (munmap(r, sz))
 			wrterror(d, "munmap %p", r);
 		STATS_SUB(d->malloc_used, sz);
@@ -767,6 +831,7 @@ map(struct dir_info *d, size_t sz, int zero_fill)
 	if (psz <= MAX_CACHEABLE_SIZE && d->cache[psz - 1].max > 0) {
 		cache = &d->cache[psz - 1];
 		if (cache->length > 0) {
+			d->cache_hits++;
 			if (cache->length == 1)
 				p = cache->pages[--cache->length];
 			else {
@@ -784,10 +849,12 @@ map(struct dir_info *d, size_t sz, int zero_fill)
 				junk_free(d->malloc_junk, p, sz);
 			return p;
 		}
+		d->cache_misses++;
 		if (psz <= 1) {
 			_MALLOC_LEAVE(d);
 			p = MMAP(cache->max * sz, d->mmap_flag);
 			_MALLOC_ENTER(d);
+			d->mmaps++;
 			if (p != MAP_FAILED) {
 				STATS_ADD(d->malloc_used, cache->max * sz);
 				cache->length = cache->max - 1;
@@ -809,6 +876,7 @@ map(struct dir_info *d, size_t sz, int zero_fill)
 	_MALLOC_LEAVE(d);
 	p = MMAP(sz, d->mmap_flag);
 	_MALLOC_ENTER(d);
+	d->mmaps++;
 	if (p != MAP_FAILED)
 		STATS_ADD(d->malloc_used, sz);
 	/* zero fill not needed */
@@ -832,6 +900,7 @@ init_chunk_info(struct dir_info *d, struct chunk_info *p, int bits)
 		p->offset = howmany(p->total, MALLOC_BITS);
 	}
 	p->canary = (u_short)d->canary1;
+	p->nbatch = 0;
 
 	/* set all valid bits in the bitmap */
  	i = p->total - 1;	
@@ -861,6 +930,7 @@ alloc_chunk_info(struct dir_info *d, int bits)
 
 		/* Don't use cache here, we don't want user uaf touch this */
 		q = MMAP(MALLOC_PAGESIZE, d->mmap_flag);
+		d->mmaps++;
 		if (q == MAP_FAILED)
 			return NULL;
 		STATS_ADD(d->malloc_used, MALLOC_PAGESIZE);
@@ -905,6 +975,7 @@ omalloc_make_chunks(struct dir_info *d, int bits, int listnum)
 	    NULL))
 		goto err;
 	LIST_INSERT_HEAD(&d->chunk_dir[bits][listnum], bp, entries);
+	d->chunk_pages[bits]++;
 	return bp;
 
 err:
@@ -941,13 +1012,41 @@ fill_canary(char *ptr, size_t sz, size_t allocated)
 	memset(ptr + sz, mopts.chunk_canaries, check_sz);
 }
 
+/*
+ * Refill the batch of a page that has free chunks: a random selection of
+ * them in random order, so that handing out the next chunk is a matter of
+ * taking the last one. The chunks stay free in the bitmap until then.
+ */
+static void
+fill_chunk_batch(struct dir_info *d, struct chunk_info *bp)
+{
+	u_short chunks[MALLOC_PAGESIZE / MALLOC_MINSIZE];
+	u_int i, j, n, r, w;
+
+	n = 0;
+	for (i = 0; i < howmany(bp->total, MALLOC_BITS); i++) {
+		for (w = bp->bits[i]; w != 0; w &= w - 1)
+			chunks[n++] = i * MALLOC_BITS + ffs(w) - 1;
+	}
+	if (n == 0 || n != bp->free)
+		wrterror(d, "chunk info corrupted");
+
+	/* partial Fisher-Yates shuffle */
+	for (i = 0; i < n && i < MALLOC_CHUNK_BATCH; i++) {
+		r = ((u_int)getrbyte(d) << 8) | getrbyte(d);
+		j = i + r % (n - i);
+		bp->batch[i] = chunks[j];
+		chunks[j] = chunks[i];
+	}
+	bp->nbatch = i;
+}
+
 /*
  * Allocate a chunk
  */
 static void *
 malloc_bytes(struct dir_info *d, size_t size, void *f)
 {
-	u_int i, r;
 	int j, listnum;
 	size_t k;
 	u_short	*lp;
@@ -960,8 +1059,7 @@ malloc_bytes(struct dir_info *d, size_t size, void *f)
 
 	j = find_chunksize(size);
 
-	r = ((u_int)getrbyte(d) << 8) | getrbyte(d);
-	listnum = r % MALLOC_CHUNK_LISTS;
+	listnum = getrbyte(d) % MALLOC_CHUNK_LISTS;
 	/* If it's empty, make a page more of that size chunks */
 	if ((bp = LIST_FIRST(&d->chunk_dir[j][listnum])) == NULL) {
 		bp = omalloc_make_chunks(d, j, listnum);
@@ -972,48 +1070,29 @@ malloc_bytes(struct dir_info *d, size_t size, void *f)
 	if (bp->canary != (u_short)d->canary1)
 		wrterror(d, "chunk info corrupted");
 
-	i = (r / MALLOC_CHUNK_LISTS) & (bp->total - 1);
+	if (bp->nbatch == 0)
+		fill_chunk_batch(d, bp);
+	k = bp->batch[--bp->nbatch];
+	lp = &bp->bits[k / MALLOC_BITS];
+	if ((*lp & (1U << (k % MALLOC_BITS))) == 0)
+		wrterror(d, "chunk info corrupted");
 
-	/* start somewhere in a short */
-	lp = &bp->bits[i / MALLOC_BITS];
-	if (*lp) {
-		j = i % MALLOC_BITS;
-		k = ffs(*lp >> j);
-		if (k != 0) {
-			k += j - 1;
-			goto found;
-		}
-	}
-	/* no bit halfway, go to next full short */
-	i /= MALLOC_BITS;
-	for (;;) {
-		if (++i >= bp->total / MALLOC_BITS)
-			i = 0;
-		lp = &bp->bits[i];
-		if (*lp) {
-			k = ffs(*lp) - 1;
-			break;
-		}
-	}
-found:
 #ifdef MALLOC_STATS
-	if (i == 0 && k == 0) {
+	if (k == 0) {
 		struct region_info *r = find(d, bp->page);
 		r->f = f;
 	}
 #endif
 
-	*lp ^= 1 << k;
+	*lp ^= 1 << (k % MALLOC_BITS);
 
 	/* If there are no more free, remove from free-list */
 	if (--bp->free == 0)
 		LIST_REMOVE(bp, entries);
 
-	/* Adjust to the real offset of that chunk */
-	k += (lp - bp->bits) * MALLOC_BITS;
-
 	if (mopts.chunk_canaries && size > 0)
 		bp->bits[bp->offset + k] = size;
+	d->bytes_used += bp->size;
 
 	k <<= bp->shift;
 
@@ -1087,6 +1166,7 @@ free_bytes(struct dir_info *d, struct region_info *r, void *ptr)
 
 	info->bits[chunknum / MALLOC_BITS] |= 1U << (chunknum % MALLOC_BITS);
 	info->free++;
+	d->bytes_used -= info->size;
 
 	if (info->free == 1) {
 		/* Page became non-full */
@@ -1110,6 +1190,8 @@ free_bytes(struct dir_info *d, struct region_info *r, void *ptr)
 	unmap(d, info->page, MALLOC_PAGESIZE, 0);
 
 	delete(d, r);
+	info->nbatch = 0;
+	d->chunk_pages[info->size != 0 ? info->shift : 0]--;
 	if (info->size != 0)
 		mp = &d->chunk_info_list[info->shift];
 	else
@@ -1117,7 +1199,108 @@ free_bytes(struct dir_info *d, struct region_info *r, void *ptr)
 	LIST_INSERT_HEAD(mp, info, entries);
 }
 
+static inline u_char
+tcache_rbyte(struct tcache *tc)
+{
+	if (tc->rbytesused >= sizeof(tc->rbytes)) {
+		arc4random_buf(tc->rbytes, sizeof(tc->rbytes));
+		tc->rbytesused = 0;
+	}
+	return tc->rbytes[tc->rbytesused++];
+}
+
+/*
+ * Take a chunk from the calling thread's cache, picked at random among
+ * those of the right size. The pool is not locked.
+ */
+static void *
+tcache_get(size_t size, int zero_fill)
+{
+	struct tcache *tc;
+	struct chunk_info *info = NULL;
+	uint32_t chunknum;
+	void *p = NULL;
+	u_int i, n;
+	int j;
+
+	if (size == 0 || size > MALLOC_MAXCHUNK || (tc = gettcache()) == NULL)
+		return NULL;
+	j = find_chunksize(size);
+
+	if (!_spinlocktry(&tc->lock))
+		return NULL;
+	if ((n = tc->length[j]) > 0) {
+		i = tcache_rbyte(tc) % n;
+		p = tc->chunks[j][i].p;
+		info = tc->chunks[j][i].info;
+		tc->chunks[j][i] = tc->chunks[j][n - 1];
+		tc->length[j] = n - 1;
+	}
+	_spinunlock(&tc->lock);
+	if (p == NULL)
+		return NULL;
+
+	if (info->canary != (u_short)tc->pool->canary1)
+		wrterror(tc->pool, "chunk info corrupted");
+	validate_junk(tc->pool, p, info->size);
+
+	/* as malloc_bytes() does; the chunk is ours, so is its size slot */
+	if (mopts.chunk_canaries) {
+		chunknum = ((uintptr_t)p & MALLOC_PAGEMASK) >> info->shift;
+		info->bits[info->offset + chunknum] = size;
+	}
+	if (tc->pool->malloc_junk == 2)
+		memset(p, SOME_JUNK, info->size);
+	else if (mopts.chunk_canaries)
+		fill_canary(p, size, info->size);
+	if (zero_fill)
+		memset(p, 0, size);
+	return p;
+}
+
+/*
+ * Keep a freed chunk of pool, which is locked, in the calling thread's
+ * cache. If the cache for its size is full, the older half of it is
+ * returned to the pool first. Returns 0 if the chunk was not cached.
+ */
+static int
+tcache_put(struct dir_info *pool, struct region_info *r, void *p)
+{
+	struct chunk_info *info = (struct chunk_info *)r->size;
+	struct tcache *tc;
+	u_int i, n, len;
+	int j;
+
+	if (info->size == 0 || (tc = gettcache()) == NULL || tc->pool != pool)
+		return 0;
+	if (!_spinlocktry(&tc->lock))
+		return 0;
+
+	j = info->shift;
+	n = tc->length[j];
+	for (i = 0; i < n; i++) {
+		if (tc->chunks[j][i].p == p)
+			wrterror(pool, "double free %p", p);
+	}
+	len = MALLOC_TCACHE_LEN(j);
+	if (n >= len) {
+		for (i = 0; i < len / 2; i++) {
+			void *q = tc->chunks[j][i].p;
 
+			if ((r = find(pool, q)) == NULL)
+				wrterror(pool, "bogus pointer %p", q);
+			free_bytes(pool, r, q);
+		}
+		n -= len / 2;
+		memmove(&tc->chunks[j][0], &tc->chunks[j][len / 2],
+		    n * sizeof(tc->chunks[j][0]));
+	}
+	tc->chunks[j][n].p = p;
+	tc->chunks[j][n].info = info;
+	tc->length[j] = n + 1;
+	_spinunlock(&tc->lock);
+	return 1;
+}
 
 static void *
 omalloc(struct dir_info *pool, size_t sz, int zero_fill, void *f)
@@ -1200,6 +1383,28 @@ malloc_recurse(struct dir_info *d)
 	errno = EDEADLK;
 }
 
+static void
+tcache_init(void)
+{
+	struct tcache *tc;
+	u_int i, npools, ntcaches;
+	size_t sz;
+
+	npools = mopts.malloc_mutexes - 1;
+	ntcaches = npools * MALLOC_TCACHE_POOLS;
+	sz = PAGEROUND(ntcaches * sizeof(*tc));
+	/* the caches are an optimisation, run without them if need be */
+	if ((tc = MMAP(sz, 0)) == MAP_FAILED)
+		return;
+	for (i = 0; i < ntcaches; i++) {
+		tc[i].lock = _SPINLOCK_UNLOCKED;
+		tc[i].pool = mopts.malloc_pool[1 + i % npools];
+		tc[i].rbytesused = sizeof(tc[i].rbytes);
+	}
+	mopts.malloc_tcache = tc;
+	mopts.malloc_tcaches = ntcaches;
+}
+
 void
 _malloc_init(int from_rthreads)
 {
@@ -1236,9 +1441,12 @@ _malloc_init(int from_rthreads)
 		mopts.malloc_pool[i] = d;
 	}
 
-	if (from_rthreads)
+	if (from_rthreads) {
+		/* extensive free checking wants every free to reach the pool */
+		if (mopts.malloc_tcache == NULL && !mopts.malloc_freecheck)
+			tcache_init();
 		mopts.malloc_mt = 1;
-	else
+	} else
 		mopts.internal_funcs = 1;
 
 	/*
@@ -1279,6 +1487,9 @@ malloc(size_t size)
 	struct dir_info *d;
 	int saved_errno = errno;
 
+	if ((r = tcache_get(size, 0)) != NULL)
+		return r;
+
 	PROLOGUE(getpool(), "malloc")
 	r = omalloc(d, size, 0, CALLER);
 	EPILOGUE()
@@ -1438,7 +1649,8 @@ ofree(struct dir_info **argpool, void *p, int clear, int check, size_t argsz)
 			if (r == NULL)
 				wrterror(pool,
 				    "bogus pointer (double free?) %p", p);
-			free_bytes(pool, r, p);
+			if (clear || !tcache_put(pool, r, p))
+				free_bytes(pool, r, p);
 		}
 	}
 
@@ -1574,12 +1786,14 @@ orealloc(struct dir_info **argpool, void *p, size_t newsz, void *f)
 
 				STATS_INC(pool->cheap_realloc_tries);
 				q = MQUERY(hint, needed, pool->mmap_flag);
-				if (q == hint)
+				if (q == hint) {
 					q = MMAPA(hint, needed, pool->mmap_flag);
-				else
+					pool->mmaps++;
+				} else
 					q = MAP_FAILED;
 				if (q == hint) {
 					STATS_ADD(pool->malloc_used, needed);
+					pool->bytes_used += needed;
 					if (pool->malloc_junk == 2)
 						memset(q, SOME_JUNK, needed);
 					r->size = gnewsz;
@@ -1596,6 +1810,7 @@ orealloc(struct dir_info **argpool, void *p, size_t newsz, void *f)
 					ret = p;
 					goto done;
 				} else if (q != MAP_FAILED) {
+					pool->munmaps++;
 					if (munmap(q, needed))
 						wrterror(pool, "munmap %p", q);
 				}
@@ -1608,9 +1823,11 @@ orealloc(struct dir_info **argpool, void *p, size_t newsz, void *f)
 				    PROT_NONE))
 					wrterror(pool, "mprotect");
 			}
+			pool->munmaps++;
 			if (munmap((char *)r->p + rnewsz, roldsz - rnewsz))
 				wrterror(pool, "munmap %p", (char *)r->p + rnewsz);
 			STATS_SUB(d->malloc_used, roldsz - rnewsz);
+			pool->bytes_used -= roldsz - rnewsz;
 			r->size = gnewsz;
 			if (MALLOC_MOVE_COND(gnewsz)) {
 				void *pp = MALLOC_MOVE(r->p, gnewsz);
@@ -1710,6 +1927,10 @@ calloc(size_t nmemb, size_t size)
 	void *r;
 	int saved_errno = errno;
 
+	if (nmemb < MUL_NO_OVERFLOW && size < MUL_NO_OVERFLOW &&
+	    (r = tcache_get(nmemb * size, 1)) != NULL)
+		return r;
+
 	PROLOGUE(getpool(), "calloc")
 	if ((nmemb >= MUL_NO_OVERFLOW || size >= MUL_NO_OVERFLOW) &&
 	    nmemb > 0 && SIZE_MAX / nmemb < size) {
@@ -1924,9 +2145,11 @@ mapalign(struct dir_info *d, size_t alignment, size_t sz, int zero_fill)
 		return MAP_FAILED;
 	q = (char *)(((uintptr_t)p + alignment - 1) & ~(alignment - 1));
 	if (q != p) {
+		d->munmaps++;
 		if (munmap(p, q - p))
 			wrterror(d, "munmap %p", p);
 	}
+	d->munmaps++;
 	if (munmap(q + sz, alignment - (q - p)))
 		wrterror(d, "munmap %p", q + sz);
 	STATS_SUB(d->malloc_used, alignment);
@@ -2063,6 +2286,64 @@ aligned_alloc(size_t alignment, size_t size)
 }
 /*DEF_STRONG(aligned_alloc);*/
 
+/*
+ * Print the counters of each pool. Unlike malloc_dump(), this is always
+ * available and may be called at any time, each pool is locked while its
+ * counters are collected.
+ */
+void
+malloc_stats(int fd)
+{
+	struct dir_info *d;
+	struct chunk_info *bp;
+	size_t chunk_pages[MALLOC_MAXSHIFT + 1];
+	size_t free_chunks[MALLOC_MAXSHIFT + 1];
+	size_t bytes_used, cached, hits, misses, mmaps, munmaps;
+	u_int i, j, k, nmutexes;
+	int saved_errno = errno;
+
+	nmutexes = mopts.malloc_mt ? mopts.malloc_mutexes : 2;
+	for (i = 0; i < nmutexes; i++) {
+		if ((d = mopts.malloc_pool[i]) == NULL)
+			continue;
+
+		_MALLOC_LOCK(d->mutex);
+		bytes_used = d->bytes_used;
+		hits = d->cache_hits;
+		misses = d->cache_misses;
+		mmaps = d->mmaps;
+		munmaps = d->munmaps;
+		cached = 0;
+		for (j = 0; j < MAX_CACHEABLE_SIZE; j++)
+			cached += d->cache[j].length * (j + 1);
+		for (j = 0; j <= MALLOC_MAXSHIFT; j++) {
+			chunk_pages[j] = d->chunk_pages[j];
+			free_chunks[j] = 0;
+			for (k = 0; k < MALLOC_CHUNK_LISTS; k++) {
+				LIST_FOREACH(bp, &d->chunk_dir[j][k], entries)
+					free_chunks[j] += bp->free;
+			}
+		}
+		_MALLOC_UNLOCK(d->mutex);
+
+		/* do not hold up other threads while writing */
+		dprintf(fd, "Malloc stats of %s pool %u\n", __progname, i);
+		dprintf(fd, "In use %zu\n", bytes_used);
+		dprintf(fd, "Free pages cached %zu\n", cached);
+		dprintf(fd, "Cache hits %zu/%zu\n", hits, hits + misses);
+		dprintf(fd, "mmap %zu munmap %zu\n", mmaps, munmaps);
+		for (j = 0; j <= MALLOC_MAXSHIFT; j++) {
+			if (chunk_pages[j] == 0)
+				continue;
+			dprintf(fd, "Chunks of %zu: %zu pages, %zu free\n",
+			    j == 0 ? 0 : (size_t)1 << j, chunk_pages[j],
+			    free_chunks[j]);
+		}
+	}
+	errno = saved_errno;
+}
+DEF_WEAK(malloc_stats);
+
 #ifdef MALLOC_STATS
 
 struct malloc_leak {
@@ -31,7 +31,15 @@
 #include <sys/types.h>
 #include <stdlib.h>
 
-static __inline char	*med3(char *, char *, char *, int (*)(const void *, const void *));
+#ifdef I_AM_QSORT_R
+typedef int	cmp_t(const void *, const void *, void *);
+#define CMP(t, x, y)	(cmp((x), (y), (t)))
+#else
+typedef int	cmp_t(const void *, const void *);
+#define CMP(t, x, y)	(cmp((x), (y)))
+#endif
+
+static __inline char	*med3(char *, char *, char *, cmp_t *, void *);
 static __inline void	 swapfunc(char *, char *, size_t, int);
 
 #define min(a, b)	(a) < (b) ? a : b
@@ -53,6 +61,10 @@ static __inline void	 swapfunc(char *, char *, size_t, int);
  *
  *   4. Tail recursion is eliminated when sorting the larger of two
  *	subpartitions to save stack space.
+ *
+ * When compiled with I_AM_QSORT_R defined, as by qsort_r.c, it builds
+ * qsort_r(3) instead, which passes an extra argument to the comparison
+ * function.
  */
 #define SWAPTYPE_BYTEV	1
 #define SWAPTYPE_INTV	2
@@ -114,16 +126,16 @@ swapfunc(char *a, char *b, size_t n, int swaptype)
 #define vecswap(a, b, n) 	if ((n) > 0) swapfunc(a, b, n, swaptype)
 
 static __inline char *
-med3(char *a, char *b, char *c, int (*cmp)(const void *, const void *))
+med3(char *a, char *b, char *c, cmp_t *cmp, void *thunk)
 {
-	return cmp(a, b) < 0 ?
-	       (cmp(b, c) < 0 ? b : (cmp(a, c) < 0 ? c : a ))
-              :(cmp(b, c) > 0 ? b : (cmp(a, c) < 0 ? a : c ));
+	return CMP(thunk, a, b) < 0 ?
+	       (CMP(thunk, b, c) < 0 ? b : (CMP(thunk, a, c) < 0 ? c : a ))
+              :(CMP(thunk, b, c) > 0 ? b : (CMP(thunk, a, c) < 0 ? a : c ));
 }
 
 static void
 introsort(char *a, size_t n, size_t es, size_t maxdepth, int swaptype,
-    int (*cmp)(const void *, const void *))
+    cmp_t *cmp, void *thunk)
 {
 	char *pa, *pb, *pc, *pd, *pl, *pm, *pn;
 	int cmp_result;
@@ -131,14 +143,19 @@ introsort(char *a, size_t n, size_t es, size_t maxdepth, int swaptype,
 
 loop:	if (n < 7) {
 		for (pm = a + es; pm < a + n * es; pm += es)
-			for (pl = pm; pl > a && cmp(pl - es, pl) > 0;
+			for (pl = pm; pl > a && CMP(thunk, pl - es, pl) > 0;
 			     pl -= es)
 				swap(pl, pl - es);
 		return;
 	}
 	if (maxdepth == 0) {
+#ifdef I_AM_QSORT_R
+		if (heapsort_r(a, n, es, cmp, thunk) == 0)
+			return;
+#else
 		if (heapsort(a, n, es, cmp) == 0)
 			return;
+#endif
 	}
 	maxdepth--;
 	pm = a + (n / 2) * es;
@@ -147,24 +164,24 @@ loop:	if (n < 7) {
 		pn = a + (n - 1) * es;
 		if (n > 40) {
 			s = (n / 8) * es;
-			pl = med3(pl, pl + s, pl + 2 * s, cmp);
-			pm = med3(pm - s, pm, pm + s, cmp);
-			pn = med3(pn - 2 * s, pn - s, pn, cmp);
+			pl = med3(pl, pl + s, pl + 2 * s, cmp, thunk);
+			pm = med3(pm - s, pm, pm + s, cmp, thunk);
+			pn = med3(pn - 2 * s, pn - s, pn, cmp, thunk);
 		}
-		pm = med3(pl, pm, pn, cmp);
+		pm = med3(pl, pm, pn, cmp, thunk);
 	}
 	swap(a, pm);
 	pa = pb = a + es;
 	pc = pd = a + (n - 1) * es;
 	for (;;) {
-		while (pb <= pc && (cmp_result = cmp(pb, a)) <= 0) {
+		while (pb <= pc && (cmp_result = CMP(thunk, pb, a)) <= 0) {
 			if (cmp_result == 0) {
 				swap(pa, pb);
 				pa += es;
 			}
 			pb += es;
 		}
-		while (pb <= pc && (cmp_result = cmp(pc, a)) >= 0) {
+		while (pb <= pc && (cmp_result = CMP(thunk, pc, a)) >= 0) {
 			if (cmp_result == 0) {
 				swap(pc, pd);
 				pd -= es;
@@ -194,7 +211,7 @@ loop:	if (n < 7) {
 		if (s > es) {
 			if (r > es) {
 				introsort(a, r / es, es, maxdepth,
-				    swaptype, cmp);
+				    swaptype, cmp, thunk);
 			}
 			a = pn - s;
 			n = s / es;
@@ -205,7 +222,7 @@ loop:	if (n < 7) {
 		if (r > es) {
 			if (s > es) {
 				introsort(pn - s, s / es, es, maxdepth,
-				    swaptype, cmp);
+				    swaptype, cmp, thunk);
 			}
 			n = r / es;
 			goto loop;
@@ -213,8 +230,14 @@ loop:	if (n < 7) {
 	}
 }
 
+#ifdef I_AM_QSORT_R
+void
+qsort_r(void *a, size_t n, size_t es, cmp_t *cmp, void *thunk)
+#else
+#define thunk NULL
 void
-qsort(void *a, size_t n, size_t es, int (*cmp)(const void *, const void *))
+qsort(void *a, size_t n, size_t es, cmp_t *cmp)
+#endif
 {
 	size_t i, maxdepth = 0;
 	int swaptype;
@@ -231,8 +254,12 @@ qsort(void *a, size_t n, size_t es, int (*cmp)(const void *, const void *))
 	else
 		swaptype = SWAPTYPE_BYTEV;
 
-	introsort(a, n, es, maxdepth, swaptype, cmp);
+	introsort(a, n, es, maxdepth, swaptype, cmp, thunk);
 
 }
 
+#ifdef I_AM_QSORT_R
+DEF_WEAK(qsort_r);
+#else
 DEF_STRONG(qsort);
+#endif
@@ -0,0 +1,115 @@
+/*	$OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/types.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Sort by a fixed width key prefix with radixsort(3), then sort each run
+ * of elements whose prefixes are equal with qsort(3).
+ *
+ * radixsort() sorts strings ended by a terminating byte, while the
+ * prefixes may hold any byte value. Each prefix is therefore spread out
+ * into seven bit groups, most significant first, stored as the bytes 1 to
+ * 128; this keeps the order of the prefixes and leaves 0 free as the end
+ * byte.
+ */
+int
+qsort_key(void *base, size_t nmemb, size_t size, size_t keylen,
+    void (*key)(const void *, u_char *),
+    int (*compar)(const void *, const void *))
+{
+	const u_char **sorted = NULL;
+	u_char *keys = NULL, *rawkey = NULL, *k;
+	char *a = base, *tmp = NULL;
+	size_t enclen, reclen, i, j, n;
+	u_int bits;
+	int nbits, ret = -1;
+
+	if (nmemb <= 1)
+		return (0);
+	if (size == 0) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	enclen = (keylen / 7) * 8 + ((keylen % 7) * 8 + 6) / 7;
+	reclen = enclen + 1;
+
+	/* Small arrays, and ones radixsort() cannot take, skip the prefix. */
+	if (nmemb < 64 || keylen == 0 || nmemb > INT_MAX) {
+		qsort(base, nmemb, size, compar);
+		return (0);
+	}
+
+	if ((rawkey = malloc(keylen)) == NULL ||
+	    (keys = reallocarray(NULL, nmemb, reclen)) == NULL ||
+	    (sorted = reallocarray(NULL, nmemb, sizeof(*sorted))) == NULL ||
+	    (tmp = reallocarray(NULL, nmemb, size)) == NULL)
+		goto done;
+
+	for (i = 0; i < nmemb; i++) {
+		key(a + i * size, rawkey);
+		k = keys + i * reclen;
+		bits = 0;
+		nbits = 0;
+		for (j = 0; j < keylen; j++) {
+			bits = (bits << 8) | rawkey[j];
+			nbits += 8;
+			while (nbits >= 7) {
+				nbits -= 7;
+				*k++ = ((bits >> nbits) & 0x7f) + 1;
+			}
+		}
+		if (nbits > 0)
+			*k++ = ((bits << (7 - nbits)) & 0x7f) + 1;
+		*k = '\0';
+		sorted[i] = keys + i * reclen;
+	}
+
+	if (radixsort(sorted, nmemb, NULL, '\0') != 0)
+		goto done;
+
+	for (i = 0; i < nmemb; i++) {
+		j = (sorted[i] - keys) / reclen;
+		memcpy(tmp + i * size, a + j * size, size);
+	}
+	memcpy(a, tmp, nmemb * size);
+
+	for (i = 0; i < nmemb; i = j) {
+		for (j = i + 1; j < nmemb; j++) {
+			if (memcmp(sorted[i], sorted[j], enclen) != 0)
+				break;
+		}
+		if ((n = j - i) > 1)
+			qsort(a + i * size, n, size, compar);
+	}
+
+	ret = 0;
+
+ done:
+	free(rawkey);
+	free(keys);
+	free(sorted);
+	free(tmp);
+
+	return (ret);
+}
+DEF_WEAK(qsort_key);
@@ -33,6 +33,9 @@
 #include <limits.h>
 #include <stdlib.h>
 
+/* Decimal digits that always fit, floor(log10(LONG_MAX)). */
+#define SAFE_DIGITS	((sizeof(long) * CHAR_BIT - 1) * 3 / 10)
+
 /*
  * Convert a string to a long integer.
  *
@@ -45,7 +48,7 @@ strtol(const char *nptr, char **endptr, int base)
 	const char *s;
 	long acc, cutoff;
 	int c;
-	int neg, any, cutlim;
+	int neg, any, cutlim, n;
 
 	/*
 	 * Ensure that base is between 2 and 36 inclusive, or the special
@@ -111,7 +114,28 @@ strtol(const char *nptr, char **endptr, int base)
 		}
 		cutlim = -cutlim;
 	}
-	for (acc = 0, any = 0;; c = (unsigned char) *s++) {
+	acc = 0;
+	any = 0;
+
+	/*
+	 * Decimal fast path: no number of up to SAFE_DIGITS digits
+	 * can overflow, so accumulate those without the checks below.
+	 * The general loop picks up from the first character not taken.
+	 */
+	if (base == 10) {
+		for (n = 0; n < SAFE_DIGITS &&
+		    (unsigned int)(c - '0') < 10; n++) {
+			acc = acc * 10 + (c - '0');
+			c = (unsigned char) *s++;
+		}
+		if (n > 0) {
+			any = 1;
+			if (neg)
+				acc = -acc;
+		}
+	}
+
+	for (;; c = (unsigned char) *s++) {
 		if (isdigit(c))
 			c -= '0';
 		else if (isalpha(c))
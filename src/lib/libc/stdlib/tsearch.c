@@ -4,7 +4,14 @@
  * Tree search generalized from Knuth (6.2.2) Algorithm T just like
  * the AT&T man page says.
  *
- * The node_t structure is for internal use only
+ * The tree is kept balanced as a red-black tree, so that searches,
+ * insertions and deletions take O(lg N) time even when the keys arrive
+ * in sorted order.  Nodes have no parent pointers; the links followed
+ * from the root are recorded instead, and the tree depth is bounded by
+ * 2 lg(N + 1).
+ *
+ * The node_t structure is for internal use only; its first three members
+ * must match the node_t of tfind.c.
  *
  * Written by reading the System V Interface Definition, not the code.
  *
@@ -17,34 +24,89 @@
 typedef struct node_t {
     char	  *key;
     struct node_t *left, *right;
+    int		   red;
 } node;
 
+/* Room for the links of the deepest possible tree, plus a rotation. */
+#define MAXDEPTH	(2 * sizeof(size_t) * 8 + 2)
+
+#define ISRED(n)	((n) != (node *)0 && (n)->red)
+
+static void
+rotate_left(node **rootp)
+{
+    node *n = *rootp, *r = n->right;
+
+    n->right = r->left;
+    r->left = n;
+    *rootp = r;
+}
+
+static void
+rotate_right(node **rootp)
+{
+    node *n = *rootp, *l = n->left;
+
+    n->left = l->right;
+    l->right = n;
+    *rootp = l;
+}
+
 /* find or insert datum into search tree */
 void *
 tsearch(const void *vkey, void **vrootp,
     int (*compar)(const void *, const void *))
 {
-    node *q;
+    node **path[MAXDEPTH];
+    node *q, *p, *g, *u;
     char *key = (char *)vkey;
-    node **rootp = (node **)vrootp;
+    int d = 0;
 
-    if (rootp == (struct node_t **)0)
+    if (vrootp == (void **)0)
 	return ((void *)0);
-    while (*rootp != (struct node_t *)0) {	/* Knuth's T1: */
+    path[0] = (node **)vrootp;
+    while (*path[d] != (struct node_t *)0) {	/* Knuth's T1: */
 	int r;
 
-	if ((r = (*compar)(key, (*rootp)->key)) == 0)	/* T2: */
-	    return ((void *)*rootp);		/* we found it! */
-	rootp = (r < 0) ?
-	    &(*rootp)->left :		/* T3: follow left branch */
-	    &(*rootp)->right;		/* T4: follow right branch */
+	if ((r = (*compar)(key, (*path[d])->key)) == 0)	/* T2: */
+	    return ((void *)*path[d]);		/* we found it! */
+	path[d + 1] = (r < 0) ?
+	    &(*path[d])->left :		/* T3: follow left branch */
+	    &(*path[d])->right;		/* T4: follow right branch */
+	d++;
     }
     q = malloc(sizeof(node));	/* T5: key not found */
-    if (q != (struct node_t *)0) {	/* make new node */
-	*rootp = q;			/* link new node to old */
-	q->key = key;			/* initialize new node */
-	q->left = q->right = (struct node_t *)0;
+    if (q == (struct node_t *)0)
+	return ((void *)0);
+    *path[d] = q;			/* link new node to old */
+    q->key = key;			/* initialize new node */
+    q->left = q->right = (struct node_t *)0;
+    q->red = 1;
+
+    /* Restore the red-black properties, walking back up the path. */
+    while (d >= 2 && (p = *path[d - 1])->red) {
+	g = *path[d - 2];
+	u = (g->left == p) ? g->right : g->left;
+	if (ISRED(u)) {
+	    p->red = u->red = 0;
+	    g->red = 1;
+	    d -= 2;
+	    continue;
+	}
+	if (g->left == p) {
+	    if (p->right == *path[d])
+		rotate_left(path[d - 1]);
+	    rotate_right(path[d - 2]);
+	} else {
+	    if (p->left == *path[d])
+		rotate_right(path[d - 1]);
+	    rotate_left(path[d - 2]);
+	}
+	(*path[d - 2])->red = 0;
+	g->red = 1;
+	break;
     }
+    (*path[0])->red = 0;
     return ((void *)q);
 }
 
@@ -53,41 +115,132 @@ void *
 tdelete(const void *vkey, void **vrootp,
     int (*compar)(const void *, const void *))
 {
-    node **rootp = (node **)vrootp;
+    node **path[MAXDEPTH];
     char *key = (char *)vkey;
     node *p = (node *)1;
-    node *q;
-    node *r;
-    int cmp;
+    node *q, *r, *s, *x, *w, *t;
+    int cmp, d = 0, k, red;
 
-    if (rootp == (struct node_t **)0 || *rootp == (struct node_t *)0)
+    if (vrootp == (void **)0 || *vrootp == (void *)0)
 	return ((struct node_t *)0);
-    while ((cmp = (*compar)(key, (*rootp)->key)) != 0) {
-	p = *rootp;
-	rootp = (cmp < 0) ?
-	    &(*rootp)->left :		/* follow left branch */
-	    &(*rootp)->right;		/* follow right branch */
-	if (*rootp == (struct node_t *)0)
+    path[0] = (node **)vrootp;
+    while ((cmp = (*compar)(key, (*path[d])->key)) != 0) {
+	p = *path[d];
+	path[d + 1] = (cmp < 0) ?
+	    &(*path[d])->left :		/* follow left branch */
+	    &(*path[d])->right;		/* follow right branch */
+	d++;
+	if (*path[d] == (struct node_t *)0)
 	    return ((void *)0);		/* key not found */
     }
-    r = (*rootp)->right;			/* D1: */
-    if ((q = (*rootp)->left) == (struct node_t *)0)	/* Left (struct node_t *)0? */
-	q = r;
-    else if (r != (struct node_t *)0) {		/* Right link is null? */
-	if (r->left == (struct node_t *)0) {	/* D2: Find successor */
-	    r->left = q;
-	    q = r;
-	} else {			/* D3: Find (struct node_t *)0 link */
-	    for (q = r->left; q->left != (struct node_t *)0; q = r->left)
-		r = q;
-	    r->left = q->right;
-	    q->left = (*rootp)->left;
-	    q->right = (*rootp)->right;
+    q = *path[d];
+
+    /*
+     * A node with two children trades places with its successor, which
+     * has no left child, so that the node to unlink has at most one
+     * child.  The nodes are relinked rather than their keys swapped, as
+     * callers may hold on to the nodes.
+     */
+    if (q->left != (struct node_t *)0 && q->right != (struct node_t *)0) {
+	k = d + 1;
+	path[k] = &q->right;
+	while ((*path[k])->left != (struct node_t *)0) {
+	    path[k + 1] = &(*path[k])->left;
+	    k++;
+	}
+	s = *path[k];
+	t = s->right;
+	s->left = q->left;
+	if (k == d + 1) {
+	    s->right = q;
+	} else {
+	    s->right = q->right;
+	    *path[k] = q;
+	}
+	q->left = (struct node_t *)0;
+	q->right = t;
+	*path[d] = s;
+	path[d + 1] = &s->right;
+	red = s->red;
+	s->red = q->red;
+	q->red = red;
+	d = k;
+    }
+
+    x = (q->left != (struct node_t *)0) ? q->left : q->right;
+    *path[d] = x;
+    red = q->red;
+    free((struct node_t *)q);		/* D4: Free node */
+    if (red)
+	return (p);
+
+    /*
+     * A black node was removed, leaving the subtree at path[d] one black
+     * node short.  Move the shortfall up the tree until it can be fixed.
+     */
+    while (d > 0 && !ISRED(x)) {
+	r = *path[d - 1];
+	if (path[d] == &r->left) {
+	    w = r->right;
+	    if (w->red) {
+		w->red = 0;
+		r->red = 1;
+		rotate_left(path[d - 1]);
+		path[d] = &w->left;
+		path[d + 1] = &r->left;
+		d++;
+		w = r->right;
+	    }
+	    if (!ISRED(w->left) && !ISRED(w->right)) {
+		w->red = 1;
+		x = r;
+		d--;
+		continue;
+	    }
+	    if (!ISRED(w->right)) {
+		w->left->red = 0;
+		w->red = 1;
+		rotate_right(&r->right);
+		w = r->right;
+	    }
+	    w->red = r->red;
+	    r->red = 0;
+	    w->right->red = 0;
+	    rotate_left(path[d - 1]);
+	} else {
+	    w = r->left;
+	    if (w->red) {
+		w->red = 0;
+		r->red = 1;
+		rotate_right(path[d - 1]);
+		path[d] = &w->right;
+		path[d + 1] = &r->right;
+		d++;
+		w = r->left;
+	    }
+	    if (!ISRED(w->left) && !ISRED(w->right)) {
+		w->red = 1;
+		x = r;
+		d--;
+		continue;
+	    }
+	    if (!ISRED(w->left)) {
+		w->right->red = 0;
+		w->red = 1;
+		rotate_left(&r->left);
+		w = r->left;
+	    }
+	    w->red = r->red;
+	    r->red = 0;
+	    w->left->red = 0;
+	    rotate_right(path[d - 1]);
 	}
+	x = (struct node_t *)0;
+	break;
     }
-    free((struct node_t *) *rootp);	/* D4: Free node */
-    *rootp = q;				/* link parent to new node */
-    return(p);
+    if (x != (struct node_t *)0)
+	x->red = 0;
+    return (p);
 }
 
 /* Walk the nodes of a tree */
@@ -31,18 +31,45 @@
  * SUCH DAMAGE.
  */
 
+#include <limits.h>
+#include <stdint.h>
 #include <string.h>
 
+/*
+ * Scan a word at a time: HASZERO(x) is non-zero if any byte of x is zero,
+ * so HASZERO(x ^ k) finds a byte equal to c when k holds c in every byte.
+ */
+typedef size_t __attribute__((__may_alias__)) word;
+
+#define WALIGN		(sizeof(word) - 1)
+#define ONES		((word)-1 / UCHAR_MAX)
+#define HIGHS		(ONES * (UCHAR_MAX / 2 + 1))
+#define HASZERO(x)	(((x) - ONES) & ~(x) & HIGHS)
+
 void *
 memchr(const void *s, int c, size_t n)
 {
-	if (n != 0) {
-		const unsigned char *p = s;
+	const unsigned char *p = s;
+	const word *w;
+	word k;
 
-		do {
-			if (*p++ == (unsigned char)c)
-				return ((void *)(p - 1));
-		} while (--n != 0);
+	c = (unsigned char)c;
+	for (; ((uintptr_t)p & WALIGN) && n != 0; p++, n--) {
+		if (*p == c)
+			return ((void *)p);
+	}
+	if (n >= sizeof(word)) {
+		k = ONES * c;
+		for (w = (const word *)p; n >= sizeof(word); w++) {
+			if (HASZERO(*w ^ k))
+				break;
+			n -= sizeof(word);
+		}
+		p = (const unsigned char *)w;
+	}
+	for (; n != 0; p++, n--) {
+		if (*p == c)
+			return ((void *)p);
 	}
 	return (NULL);
 }
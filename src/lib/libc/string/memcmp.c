@@ -31,17 +31,37 @@
  * SUCH DAMAGE.
  */
 
+#include <stdint.h>
 #include <string.h>
 
+typedef size_t __attribute__((__may_alias__)) word;
+
+#define WALIGN		(sizeof(word) - 1)
+
 /*
  * Compare memory regions.
+ *
+ * If both have the same alignment, equal words are skipped first and the
+ * byte loop is left to find the first difference.
  */
 int
 memcmp(const void *s1, const void *s2, size_t n)
 {
-	if (n != 0) {
-		const unsigned char *p1 = s1, *p2 = s2;
+	const unsigned char *p1 = s1, *p2 = s2;
 
+	if ((((uintptr_t)p1 ^ (uintptr_t)p2) & WALIGN) == 0) {
+		for (; ((uintptr_t)p1 & WALIGN) && n != 0; p1++, p2++, n--) {
+			if (*p1 != *p2)
+				return (*p1 - *p2);
+		}
+		for (; n >= sizeof(word); n -= sizeof(word)) {
+			if (*(const word *)p1 != *(const word *)p2)
+				break;
+			p1 += sizeof(word);
+			p2 += sizeof(word);
+		}
+	}
+	if (n != 0) {
 		do {
 			if (*p1++ != *p2++)
 				return (*--p1 - *--p2);
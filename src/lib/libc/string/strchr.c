@@ -28,14 +28,42 @@
  * SUCH DAMAGE.
  */
 
+#include <limits.h>
+#include <stdint.h>
 #include <string.h>
 
+/*
+ * Scan a word at a time: HASZERO(x) is non-zero if any byte of x is zero,
+ * so HASZERO(x ^ k) finds a byte equal to ch when k holds ch in every byte.
+ * Aligned words never straddle a page boundary, so reading past the end
+ * of the string within one is safe.
+ */
+typedef size_t __attribute__((__may_alias__)) word;
+
+#define WALIGN		(sizeof(word) - 1)
+#define ONES		((word)-1 / UCHAR_MAX)
+#define HIGHS		(ONES * (UCHAR_MAX / 2 + 1))
+#define HASZERO(x)	(((x) - ONES) & ~(x) & HIGHS)
+
 __weak_alias(index, strchr);
 
 char *
 strchr(const char *p, int ch)
 {
-	for (;; ++p) {
+	const word *w;
+	word k;
+
+	for (; (uintptr_t)p & WALIGN; ++p) {
+		if (*p == (char) ch)
+			return((char *)p);
+		if (!*p)
+			return((char *)NULL);
+	}
+	/* skip words that hold neither the NUL nor ch */
+	k = ONES * (unsigned char)ch;
+	for (w = (const word *)p; !HASZERO(*w) && !HASZERO(*w ^ k); ++w)
+		;
+	for (p = (const char *)w;; ++p) {
 		if (*p == (char) ch)
 			return((char *)p);
 		if (!*p)
@@ -29,14 +29,35 @@
  * SUCH DAMAGE.
  */
 
+#include <limits.h>
+#include <stdint.h>
 #include <string.h>
 
+/*
+ * Scan a word at a time: HASZERO(x) is non-zero if any byte of x is zero.
+ * Aligned words never straddle a page boundary, so reading past the end
+ * of the string within one is safe.
+ */
+typedef size_t __attribute__((__may_alias__)) word;
+
+#define WALIGN		(sizeof(word) - 1)
+#define ONES		((word)-1 / UCHAR_MAX)
+#define HIGHS		(ONES * (UCHAR_MAX / 2 + 1))
+#define HASZERO(x)	(((x) - ONES) & ~(x) & HIGHS)
+
 size_t
 strlen(const char *str)
 {
 	const char *s;
+	const word *w;
 
-	for (s = str; *s; ++s)
+	for (s = str; (uintptr_t)s & WALIGN; ++s) {
+		if (*s == '\0')
+			return (s - str);
+	}
+	for (w = (const word *)s; !HASZERO(*w); ++w)
+		;
+	for (s = (const char *)w; *s; ++s)
 		;
 	return (s - str);
 }
@@ -15,17 +15,45 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <endian.h>
 #include <limits.h>
+#include <stdint.h>
 #include <string.h>
 
+/* 1 if a < b, else 0, without branching. */
+#define LT64(a, b)	((((~(a) & (b)) | (~((a) ^ (b)) & ((a) - (b)))) >> 63))
+
 int
 timingsafe_memcmp(const void *b1, const void *b2, size_t len)
 {
         const unsigned char *p1 = b1, *p2 = b2;
-        size_t i;
+        uint64_t w1, w2;
+        size_t i = 0;
         int res = 0, done = 0;
 
-        for (i = 0; i < len; i++) {
+        /*
+         * Compare eight bytes at a time by loading them big endian, so that
+         * comparing the words as integers orders them like the bytes.
+         */
+        for (; len - i >= sizeof(w1); i += sizeof(w1)) {
+                int lt, gt;
+
+                memcpy(&w1, p1 + i, sizeof(w1));
+                memcpy(&w2, p2 + i, sizeof(w2));
+                w1 = be64toh(w1);
+                w2 = be64toh(w2);
+
+                /* lt is -1 if w1 < w2; else 0. */
+                lt = -(int)LT64(w1, w2);
+
+                /* gt is -1 if w1 > w2; else 0. */
+                gt = -(int)LT64(w2, w1);
+
+                res |= (lt - gt) & ~done;
+                done |= lt | gt;
+        }
+
+        for (; i < len; i++) {
                 /* lt is -1 if p1[i] < p2[i]; else 0. */
                 int lt = (p1[i] - p2[i]) >> CHAR_BIT;
 
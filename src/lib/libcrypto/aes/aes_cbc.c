@@ -52,6 +52,8 @@
 #include <openssl/aes.h>
 #include <openssl/modes.h>
 
+#include "aes_locl.h"
+
 void
 AES_cbc_encrypt(const unsigned char *in, unsigned char *out,
     size_t len, const AES_KEY *key, unsigned char *ivec, const int enc)
@@ -59,7 +61,17 @@ AES_cbc_encrypt(const unsigned char *in, unsigned char *out,
 	if (enc)
 		CRYPTO_cbc128_encrypt(in, out, len, key, ivec,
 		    (block128_f)AES_encrypt);
-	else
+	else {
+#ifndef AES_ASM
+		size_t blocks = len / AES_BLOCK_SIZE;
+
+		/* Decryption is parallel, so do most of it in bulk. */
+		aes_ct_cbc_decrypt(in, out, blocks, key, ivec);
+		in += blocks * AES_BLOCK_SIZE;
+		out += blocks * AES_BLOCK_SIZE;
+		len -= blocks * AES_BLOCK_SIZE;
+#endif
 		CRYPTO_cbc128_decrypt(in, out, len, key, ivec,
 		    (block128_f)AES_decrypt);
+	}
 }
@@ -52,11 +52,18 @@
 #include <openssl/aes.h>
 #include <openssl/modes.h>
 
+#include "aes_locl.h"
+
 void
 AES_ctr128_encrypt(const unsigned char *in, unsigned char *out,
     size_t length, const AES_KEY *key, unsigned char ivec[AES_BLOCK_SIZE],
     unsigned char ecount_buf[AES_BLOCK_SIZE], unsigned int *num)
 {
+#ifndef AES_ASM
+	CRYPTO_ctr128_encrypt_ctr32(in, out, length, key, ivec, ecount_buf,
+	    num, (ctr128_f)aes_ct_ctr32_encrypt_blocks);
+#else
 	CRYPTO_ctr128_encrypt(in, out, length, key, ivec, ecount_buf, num,
 	    (block128_f)AES_encrypt);
+#endif
 }
@@ -75,6 +75,17 @@ typedef unsigned char u8;
 #define MAXKB   (256/8)
 #define MAXNR   14
 
+#ifndef AES_ASM
+/* Multiple block functions of the bitsliced implementation in aes_core.c. */
+void aes_ct_ecb_encrypt(const unsigned char *in, unsigned char *out,
+    size_t blocks, const AES_KEY *key, int enc);
+void aes_ct_cbc_decrypt(const unsigned char *in, unsigned char *out,
+    size_t blocks, const AES_KEY *key, unsigned char ivec[AES_BLOCK_SIZE]);
+void aes_ct_ctr32_encrypt_blocks(const unsigned char *in, unsigned char *out,
+    size_t blocks, const AES_KEY *key,
+    const unsigned char ivec[AES_BLOCK_SIZE]);
+#endif
+
 /* This controls loop-unrolling in aes_core.c */
 #undef FULL_UNROLL
 
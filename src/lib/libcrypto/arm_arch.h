@@ -50,6 +50,25 @@ extern unsigned int OPENSSL_armcap_P;
 #define ARMV8_SHA1	(1<<2)
 #define ARMV8_SHA256	(1<<3)
 #define ARMV8_PMULL	(1<<4)
+#define ARMV8_SHA512	(1<<5)
+
+/*
+ * The ARMv8 Crypto Extensions code is written with compiler intrinsics.
+ * The instructions are only enabled for the functions that use them, which
+ * are called after checking OPENSSL_armcap_P, so that the library still runs
+ * on processors without the extensions.
+ */
+#if defined(__aarch64__) && defined(__AARCH64EL__) && \
+    defined(OPENSSL_CPUID_OBJ) && \
+    ((defined(__clang__) && __clang_major__ >= 16) || \
+    (!defined(__clang__) && defined(__GNUC__) && __GNUC__ >= 8))
+#define ARMV8_CE
+#if defined(__clang__)
+#define ARMV8_TARGET(f)	__attribute__((__target__(#f)))
+#else
+#define ARMV8_TARGET(f)	__attribute__((__target__("+" #f)))
+#endif
+#endif
 #endif
 
 #if defined(__OpenBSD__)
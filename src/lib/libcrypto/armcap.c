@@ -26,6 +26,9 @@ void _armv8_aes_probe(void);
 void _armv8_sha1_probe(void);
 void _armv8_sha256_probe(void);
 void _armv8_pmull_probe(void);
+#ifdef __aarch64__
+void _armv8_sha512_probe(void);
+#endif
 #endif
 
 #if defined(__GNUC__) && __GNUC__>=2
@@ -80,6 +83,12 @@ OPENSSL_cpuid_setup(void)
 			_armv8_sha256_probe();
 			OPENSSL_armcap_P |= ARMV8_SHA256;
 		}
+#ifdef __aarch64__
+		if (sigsetjmp(ill_jmp, 1) == 0) {
+			_armv8_sha512_probe();
+			OPENSSL_armcap_P |= ARMV8_SHA512;
+		}
+#endif
 	}
 
 	sigaction (SIGILL, &ill_oact, NULL);
@@ -66,6 +66,8 @@
 #include <openssl/buffer.h>
 #include <openssl/objects.h>
 
+#include "asn1_locl.h"
+
 int
 i2d_ASN1_OBJECT(const ASN1_OBJECT *a, unsigned char **pp)
 {
@@ -304,6 +306,20 @@ c2i_ASN1_OBJECT(ASN1_OBJECT **a, const unsigned char **pp, long len)
 		}
 	}
 
+	/*
+	 * Hand out the shared object for known OIDs. This saves two
+	 * allocations for most objects in a certificate and makes later
+	 * NID lookups free.
+	 */
+	if ((ret = (ASN1_OBJECT *)obj_bsearch_builtin(*pp, length)) != NULL) {
+		if (a != NULL) {
+			ASN1_OBJECT_free(*a);
+			*a = ret;
+		}
+		*pp += length;
+		return (ret);
+	}
+
 	if ((a == NULL) || ((*a) == NULL) ||
 	    !((*a)->flags & ASN1_OBJECT_FLAG_DYNAMIC)) {
 		if ((ret = ASN1_OBJECT_new()) == NULL)
@@ -65,18 +65,20 @@
 #include <openssl/err.h>
 #include <openssl/asn1.h>
 
+#include "cryptlib.h"
+
 /* BEGIN ERROR CODES */
 #ifndef OPENSSL_NO_ERR
 
 #define ERR_FUNC(func) ERR_PACK(ERR_LIB_ASN1,func,0)
 #define ERR_REASON(reason) ERR_PACK(ERR_LIB_ASN1,0,reason)
 
-static ERR_STRING_DATA ASN1_str_functs[] = {
+static const ERR_STRING_DATA ASN1_str_functs[] = {
 	{ERR_FUNC(0xfff), "CRYPTO_internal"},
 	{0, NULL}
 };
 
-static ERR_STRING_DATA ASN1_str_reasons[] = {
+static const ERR_STRING_DATA ASN1_str_reasons[] = {
 	{ERR_REASON(ASN1_R_ADDING_OBJECT)        , "adding object"},
 	{ERR_REASON(ASN1_R_ASN1_PARSE_ERROR)     , "asn1 parse error"},
 	{ERR_REASON(ASN1_R_ASN1_SIG_PARSE_ERROR) , "asn1 sig parse error"},
@@ -208,8 +210,8 @@ ERR_load_ASN1_strings(void)
 {
 #ifndef OPENSSL_NO_ERR
 	if (ERR_func_error_string(ASN1_str_functs[0].error) == NULL) {
-		ERR_load_strings(0, ASN1_str_functs);
-		ERR_load_strings(0, ASN1_str_reasons);
+		ERR_load_const_strings(ASN1_str_functs);
+		ERR_load_const_strings(ASN1_str_reasons);
 	}
 #endif
 }
@@ -63,6 +63,8 @@
 #include <openssl/asn1.h>
 #include <openssl/err.h>
 
+#include "asn1_locl.h"
+
 static int asn1_get_length(const unsigned char **pp, int *inf, long *rl, int max);
 static void asn1_put_length(unsigned char **pp, int length);
 
@@ -153,6 +155,30 @@ err:
 	return (0x80);
 }
 
+/*
+ * Read a definite length TLV from [*p, end). On success *p is moved past
+ * the header and *content_end to the end of the content.
+ */
+int
+asn1_get_tlv(const unsigned char **p, const unsigned char *end, int *tag,
+    int *xclass, int *constructed, const unsigned char **content_end)
+{
+	const unsigned char *q = *p;
+	long len;
+	int ret;
+
+	if (*p >= end)
+		return 0;
+	ret = ASN1_get_object(&q, &len, tag, xclass, end - *p);
+	if ((ret & 0x80) != 0 || (ret & 0x01) != 0)
+		return 0;
+	*constructed = (ret & V_ASN1_CONSTRUCTED) != 0;
+	*p = q;
+	*content_end = q + len;
+
+	return 1;
+}
+
 static int
 asn1_get_length(const unsigned char **pp, int *inf, long *rl, int max)
 {
@@ -155,4 +155,13 @@ struct x509_crl_method_st {
 int UTF8_getc(const unsigned char *str, int len, unsigned long *val);
 int UTF8_putc(unsigned char *str, int len, unsigned long value);
 
+int asn1_get_tlv(const unsigned char **p, const unsigned char *end, int *tag,
+    int *xclass, int *constructed, const unsigned char **content_end);
+
+int x509_lazy_load_extensions(const X509 *x);
+int x509_name_get_canon(X509_NAME *a, const unsigned char **canon_enc,
+    int *canon_enclen);
+
+const ASN1_OBJECT *obj_bsearch_builtin(const unsigned char *data, int length);
+
 __END_HIDDEN_DECLS
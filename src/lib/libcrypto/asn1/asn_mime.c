@@ -103,6 +103,7 @@ static int mime_param_cmp(const MIME_PARAM * const *a,
 static void mime_param_free(MIME_PARAM *param);
 static int mime_bound_check(char *line, int linelen, char *bound, int blen);
 static int multi_split(BIO *bio, char *bound, STACK_OF(BIO) **ret);
+static int multi_split_stream(BIO *bio, char *bound, STACK_OF(BIO) **ret);
 static int strip_eol(char *linebuf, int *plen);
 static MIME_HEADER *mime_hdr_find(STACK_OF(MIME_HEADER) *hdrs, char *name);
 static MIME_PARAM *mime_param_find(MIME_HEADER *hdr, char *name);
@@ -423,8 +424,8 @@ asn1_output_data(BIO *out, BIO *data, ASN1_VALUE *val, int flags,
  * pointed to by "bcont". In opaque this is set to NULL
  */
 
-ASN1_VALUE *
-SMIME_read_ASN1(BIO *bio, BIO **bcont, const ASN1_ITEM *it)
+static ASN1_VALUE *
+smime_read_asn1(BIO *bio, BIO **bcont, const ASN1_ITEM *it, int stream)
 {
 	BIO *asnin;
 	STACK_OF(MIME_HEADER) *headers = NULL;
@@ -458,7 +459,10 @@ SMIME_read_ASN1(BIO *bio, BIO **bcont, const ASN1_ITEM *it)
 			ASN1error(ASN1_R_NO_MULTIPART_BOUNDARY);
 			return NULL;
 		}
-		ret = multi_split(bio, prm->param_value, &parts);
+		if (stream && bcont != NULL)
+			ret = multi_split_stream(bio, prm->param_value, &parts);
+		else
+			ret = multi_split(bio, prm->param_value, &parts);
 		sk_MIME_HEADER_pop_free(headers, mime_hdr_free);
 		if (!ret || (sk_BIO_num(parts) != 2) ) {
 			ASN1error(ASN1_R_NO_MULTIPART_BODY_FAILURE);
@@ -528,6 +532,24 @@ SMIME_read_ASN1(BIO *bio, BIO **bcont, const ASN1_ITEM *it)
 	return val;
 }
 
+ASN1_VALUE *
+SMIME_read_ASN1(BIO *bio, BIO **bcont, const ASN1_ITEM *it)
+{
+	return smime_read_asn1(bio, bcont, it, 0);
+}
+
+/*
+ * Like SMIME_read_ASN1(), but if the input can be seeked, the content of a
+ * multipart/signed message is not read into memory. The BIO returned in
+ * bcont reads it from the input instead, which must remain open until the
+ * content has been read.
+ */
+ASN1_VALUE *
+SMIME_read_ASN1_stream(BIO *bio, BIO **bcont, const ASN1_ITEM *it)
+{
+	return smime_read_asn1(bio, bcont, it, 1);
+}
+
 /* Copy text from one BIO to another making the output CRLF at EOL */
 int
 SMIME_crlf_copy(BIO *in, BIO *out, int flags)
@@ -652,6 +674,254 @@ multi_split(BIO *bio, char *bound, STACK_OF(BIO) **ret)
 	return 0;
 }
 
+/*
+ * The content part of a multipart/signed message, read from the message
+ * as it is needed. It gives the same canonical form that multi_split()
+ * collects in memory.
+ */
+struct mime_part {
+	BIO *bio;
+	char *bound;
+	int blen;
+	char first;
+	char eol;
+	char done;
+	char buf[MAX_SMLEN + 2];	/* Pending output */
+	int off;
+	int len;
+};
+
+static int mime_part_read(BIO *b, char *out, int outl);
+static int mime_part_gets(BIO *b, char *out, int size);
+static long mime_part_ctrl(BIO *b, int cmd, long num, void *ptr);
+static int mime_part_free(BIO *b);
+
+static const BIO_METHOD methods_mime_part = {
+	.type = BIO_TYPE_NONE,
+	.name = "MIME part",
+	.bread = mime_part_read,
+	.bgets = mime_part_gets,
+	.ctrl = mime_part_ctrl,
+	.destroy = mime_part_free,
+};
+
+static int
+mime_part_free(BIO *b)
+{
+	struct mime_part *mp = b->ptr;
+
+	if (mp == NULL)
+		return 0;
+	free(mp->bound);
+	free(mp);
+	b->ptr = NULL;
+	b->init = 0;
+	return 1;
+}
+
+/* Canonicalise the next line of the content, or return 0 at its end. */
+static int
+mime_part_fill(struct mime_part *mp)
+{
+	char linebuf[MAX_SMLEN];
+	int len, next_eol;
+
+	mp->off = mp->len = 0;
+	if (mp->done)
+		return 0;
+	if ((len = BIO_gets(mp->bio, linebuf, MAX_SMLEN)) <= 0) {
+		mp->done = 1;
+		return -1;
+	}
+	if (mime_bound_check(linebuf, len, mp->bound, mp->blen) != 0) {
+		mp->done = 1;
+		return 0;
+	}
+	next_eol = strip_eol(linebuf, &len);
+	if (!mp->first && mp->eol) {
+		memcpy(mp->buf, "\r\n", 2);
+		mp->len = 2;
+	}
+	mp->first = 0;
+	mp->eol = next_eol;
+	memcpy(mp->buf + mp->len, linebuf, len);
+	mp->len += len;
+
+	return 1;
+}
+
+static int
+mime_part_read(BIO *b, char *out, int outl)
+{
+	struct mime_part *mp = b->ptr;
+	int n, ret = 0;
+
+	while (ret < outl) {
+		if (mp->off == mp->len) {
+			if ((n = mime_part_fill(mp)) < 0 && ret == 0)
+				return -1;
+			if (n <= 0)
+				break;
+			continue;
+		}
+		n = mp->len - mp->off;
+		if (n > outl - ret)
+			n = outl - ret;
+		memcpy(out + ret, mp->buf + mp->off, n);
+		mp->off += n;
+		ret += n;
+	}
+	return ret;
+}
+
+static int
+mime_part_gets(BIO *b, char *out, int size)
+{
+	struct mime_part *mp = b->ptr;
+	int n = 0, r;
+	char c;
+
+	if (size <= 0)
+		return 0;
+	while (n < size - 1) {
+		if (mp->off == mp->len) {
+			if ((r = mime_part_fill(mp)) < 0 && n == 0)
+				return -1;
+			if (r <= 0)
+				break;
+			continue;
+		}
+		c = mp->buf[mp->off++];
+		out[n++] = c;
+		if (c == '\n')
+			break;
+	}
+	out[n] = '\0';
+	return n;
+}
+
+static long
+mime_part_ctrl(BIO *b, int cmd, long num, void *ptr)
+{
+	struct mime_part *mp = b->ptr;
+
+	switch (cmd) {
+	case BIO_CTRL_EOF:
+		return mp->done && mp->off == mp->len;
+	case BIO_CTRL_PENDING:
+		return mp->len - mp->off;
+	case BIO_CTRL_FLUSH:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Split a multipart/signed message body like multi_split() does, but
+ * instead of reading the content into memory, skip over it and return a
+ * BIO that reads it from the input afterwards. Fall back to multi_split()
+ * if the input cannot be seeked.
+ */
+static int
+multi_split_stream(BIO *bio, char *bound, STACK_OF(BIO) **ret)
+{
+	char linebuf[MAX_SMLEN];
+	struct mime_part *mp = NULL;
+	STACK_OF(BIO) *parts;
+	BIO *bcont = NULL, *bpart = NULL;
+	long start = -1, pos;
+	int len, blen, state, content = 0, part = 0;
+	int eol = 0, next_eol, first = 1;
+
+	/* BIO_tell() and BIO_seek() truncate the offset to an int. */
+	if ((BIO_method_type(bio) != BIO_TYPE_FILE &&
+	    BIO_method_type(bio) != BIO_TYPE_FD) ||
+	    (pos = BIO_ctrl(bio, BIO_C_FILE_TELL, 0, NULL)) < 0 ||
+	    BIO_ctrl(bio, BIO_C_FILE_SEEK, pos, NULL) < 0)
+		return multi_split(bio, bound, ret);
+
+	blen = strlen(bound);
+	if ((parts = sk_BIO_new_null()) == NULL)
+		return 0;
+	*ret = parts;
+
+	/*
+	 * As in multi_split(), a part starts at its first line, so the content
+	 * is the first part that has one and it starts after the boundary.
+	 */
+	while ((len = BIO_gets(bio, linebuf, MAX_SMLEN)) > 0) {
+		state = mime_bound_check(linebuf, len, bound, blen);
+		if (state == 1) {
+			if (!content && (start = BIO_ctrl(bio,
+			    BIO_C_FILE_TELL, 0, NULL)) < 0)
+				goto err;
+			first = 1;
+			part++;
+		} else if (state == 2) {
+			break;
+		} else if (part && !content) {
+			content = 1;
+			first = 0;
+		} else if (part && content == 1 && !first) {
+			/* Skip the rest of the content. */
+		} else if (part) {
+			/* The remaining parts, collected as by multi_split(). */
+			next_eol = strip_eol(linebuf, &len);
+			if (first) {
+				first = 0;
+				content = 2;
+				if (bpart != NULL) {
+					if (sk_BIO_push(parts, bpart) == 0)
+						goto err;
+					bpart = NULL;
+				}
+				if ((bpart = BIO_new(BIO_s_mem())) == NULL)
+					goto err;
+				BIO_set_mem_eof_return(bpart, 0);
+			} else if (eol)
+				BIO_write(bpart, "\r\n", 2);
+			eol = next_eol;
+			if (len)
+				BIO_write(bpart, linebuf, len);
+		}
+	}
+	if (len <= 0 || !content)
+		goto err;
+
+	if (BIO_ctrl(bio, BIO_C_FILE_SEEK, start, NULL) < 0)
+		goto err;
+	if ((bcont = BIO_new(&methods_mime_part)) == NULL)
+		goto err;
+	if ((mp = calloc(1, sizeof(*mp))) == NULL)
+		goto err;
+	if ((mp->bound = strdup(bound)) == NULL)
+		goto err;
+	mp->bio = bio;
+	mp->blen = blen;
+	mp->first = 1;
+	bcont->ptr = mp;
+	bcont->init = 1;
+	mp = NULL;
+
+	if (bpart != NULL) {
+		if (sk_BIO_push(parts, bpart) == 0)
+			goto err;
+		bpart = NULL;
+	}
+	if (sk_BIO_insert(parts, bcont, 0) == 0)
+		goto err;
+	return 1;
+
+ err:
+	if (mp != NULL)
+		free(mp->bound);
+	free(mp);
+	BIO_free(bcont);
+	BIO_free(bpart);
+	return 0;
+}
+
 /* This is the big one: parse MIME header lines up to message body */
 
 #define MIME_INVALID	0
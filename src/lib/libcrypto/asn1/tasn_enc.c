@@ -56,7 +56,9 @@
  *
  */
 
+#include <limits.h>
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <openssl/asn1.h>
@@ -64,17 +66,134 @@
 #include <openssl/err.h>
 #include <openssl/objects.h>
 
+/*
+ * Content lengths of the constructed values of an item, recorded in the
+ * order in which they are visited while the item is sized. Writing the
+ * item out visits them in the same order and takes their lengths from
+ * here, rather than sizing each value again for every value that encloses
+ * it. Should anything go wrong the lengths are simply computed as before.
+ */
+#define ASN1_ENC_LENS_INLINE	32
+
+struct asn1_enc_lens {
+	int *lens;
+	size_t num;
+	size_t max;
+	size_t pos;
+	int writing;
+	int failed;
+	int inline_lens[ASN1_ENC_LENS_INLINE];
+};
+
+static int asn1_item_ex_i2d_lens(ASN1_VALUE **pval, unsigned char **out,
+    const ASN1_ITEM *it, int tag, int aclass, struct asn1_enc_lens *el);
 static int asn1_i2d_ex_primitive(ASN1_VALUE **pval, unsigned char **out,
     const ASN1_ITEM *it, int tag, int aclass);
 static int asn1_set_seq_out(STACK_OF(ASN1_VALUE) *sk, unsigned char **out,
-    int skcontlen, const ASN1_ITEM *item, int do_sort, int iclass);
+    int skcontlen, const ASN1_ITEM *item, int do_sort, int iclass,
+    struct asn1_enc_lens *el);
 static int asn1_template_ex_i2d(ASN1_VALUE **pval, unsigned char **out,
-    const ASN1_TEMPLATE *tt, int tag, int aclass);
+    const ASN1_TEMPLATE *tt, int tag, int aclass, struct asn1_enc_lens *el);
 static int asn1_item_flags_i2d(ASN1_VALUE *val, unsigned char **out,
     const ASN1_ITEM *it, int flags);
 static int asn1_ex_i2c(ASN1_VALUE **pval, unsigned char *cout, int *putype,
     const ASN1_ITEM *it);
 
+static void
+asn1_enc_lens_init(struct asn1_enc_lens *el)
+{
+	memset(el, 0, sizeof(*el));
+	el->lens = el->inline_lens;
+	el->max = ASN1_ENC_LENS_INLINE;
+}
+
+static void
+asn1_enc_lens_cleanup(struct asn1_enc_lens *el)
+{
+	if (el->lens != el->inline_lens)
+		free(el->lens);
+	el->lens = NULL;
+}
+
+/* Switch from sizing the item to writing it out. */
+static void
+asn1_enc_lens_rewind(struct asn1_enc_lens *el)
+{
+	el->writing = 1;
+	el->pos = 0;
+}
+
+/*
+ * Reserve a slot for the content length of a constructed value that is
+ * about to be sized, returning its index or -1.
+ */
+static int
+asn1_enc_lens_reserve(struct asn1_enc_lens *el)
+{
+	int *lens;
+
+	if (el == NULL || el->writing || el->failed)
+		return -1;
+	if (el->num == el->max) {
+		if (el->max > INT_MAX / 2) {
+			el->failed = 1;
+			return -1;
+		}
+		if (el->lens == el->inline_lens) {
+			if ((lens = reallocarray(NULL, el->max * 2,
+			    sizeof(*lens))) != NULL)
+				memcpy(lens, el->lens,
+				    el->num * sizeof(*lens));
+		} else
+			lens = reallocarray(el->lens, el->max * 2,
+			    sizeof(*lens));
+		if (lens == NULL) {
+			el->failed = 1;
+			return -1;
+		}
+		el->lens = lens;
+		el->max *= 2;
+	}
+
+	return el->num++;
+}
+
+static void
+asn1_enc_lens_set(struct asn1_enc_lens *el, int idx, int len)
+{
+	if (idx >= 0)
+		el->lens[idx] = len;
+}
+
+/* Fetch the content length of the constructed value about to be written. */
+static int
+asn1_enc_lens_next(struct asn1_enc_lens *el, int *len)
+{
+	if (el == NULL || !el->writing || el->failed)
+		return 0;
+	if (el->pos >= el->num) {
+		el->failed = 1;
+		return 0;
+	}
+	*len = el->lens[el->pos++];
+
+	return 1;
+}
+
+/*
+ * The lengths to use when sizing the content of a constructed value:
+ * while writing, its length has not been found above, and the content is
+ * sized without them.
+ */
+static struct asn1_enc_lens *
+asn1_enc_lens_sizing(struct asn1_enc_lens *el)
+{
+	if (el != NULL && el->writing)
+		return NULL;
+
+	return el;
+}
+
 /* Top level i2d equivalents: the 'ndef' variant instructs the encoder
  * to use indefinite length constructed encoding, where appropriate
  */
@@ -105,16 +224,25 @@ asn1_item_flags_i2d(ASN1_VALUE *val, unsigned char **out, const ASN1_ITEM *it,
     int flags)
 {
 	if (out && !*out) {
+		struct asn1_enc_lens el;
 		unsigned char *p, *buf;
 		int len;
-		len = ASN1_item_ex_i2d(&val, NULL, it, -1, flags);
-		if (len <= 0)
+
+		asn1_enc_lens_init(&el);
+		len = asn1_item_ex_i2d_lens(&val, NULL, it, -1, flags, &el);
+		if (len <= 0) {
+			asn1_enc_lens_cleanup(&el);
 			return len;
+		}
 		buf = malloc(len);
-		if (!buf)
+		if (!buf) {
+			asn1_enc_lens_cleanup(&el);
 			return -1;
+		}
 		p = buf;
-		ASN1_item_ex_i2d(&val, &p, it, -1, flags);
+		asn1_enc_lens_rewind(&el);
+		asn1_item_ex_i2d_lens(&val, &p, it, -1, flags, &el);
+		asn1_enc_lens_cleanup(&el);
 		*out = buf;
 		return len;
 	}
@@ -130,9 +258,28 @@ asn1_item_flags_i2d(ASN1_VALUE *val, unsigned char **out, const ASN1_ITEM *it,
 int
 ASN1_item_ex_i2d(ASN1_VALUE **pval, unsigned char **out, const ASN1_ITEM *it,
     int tag, int aclass)
+{
+	struct asn1_enc_lens el;
+	int ret;
+
+	if (out == NULL)
+		return asn1_item_ex_i2d_lens(pval, NULL, it, tag, aclass, NULL);
+
+	asn1_enc_lens_init(&el);
+	asn1_item_ex_i2d_lens(pval, NULL, it, tag, aclass, &el);
+	asn1_enc_lens_rewind(&el);
+	ret = asn1_item_ex_i2d_lens(pval, out, it, tag, aclass, &el);
+	asn1_enc_lens_cleanup(&el);
+
+	return ret;
+}
+
+static int
+asn1_item_ex_i2d_lens(ASN1_VALUE **pval, unsigned char **out,
+    const ASN1_ITEM *it, int tag, int aclass, struct asn1_enc_lens *el)
 {
 	const ASN1_TEMPLATE *tt = NULL;
-	int i, seqcontlen, seqlen, ndef = 1;
+	int i, idx, seqcontlen, seqlen, ndef = 1;
 	const ASN1_EXTERN_FUNCS *ef;
 	const ASN1_AUX *aux = it->funcs;
 	ASN1_aux_cb *asn1_cb = NULL;
@@ -148,7 +295,7 @@ ASN1_item_ex_i2d(ASN1_VALUE **pval, unsigned char **out, const ASN1_ITEM *it,
 	case ASN1_ITYPE_PRIMITIVE:
 		if (it->templates)
 			return asn1_template_ex_i2d(pval, out, it->templates,
-			    tag, aclass);
+			    tag, aclass, el);
 		return asn1_i2d_ex_primitive(pval, out, it, tag, aclass);
 		break;
 
@@ -183,7 +330,7 @@ ASN1_item_ex_i2d(ASN1_VALUE **pval, unsigned char **out, const ASN1_ITEM *it,
 			chtt = it->templates + i;
 			pchval = asn1_get_field_ptr(pval, chtt);
 			return asn1_template_ex_i2d(pchval, out, chtt,
-			    -1, aclass);
+			    -1, aclass, el);
 		}
 		/* Fixme: error condition if selector out of range */
 		if (asn1_cb && !asn1_cb(ASN1_OP_I2D_POST, pval, it, NULL))
@@ -221,16 +368,22 @@ ASN1_item_ex_i2d(ASN1_VALUE **pval, unsigned char **out, const ASN1_ITEM *it,
 		if (asn1_cb && !asn1_cb(ASN1_OP_I2D_PRE, pval, it, NULL))
 			return 0;
 		/* First work out sequence content length */
-		for (i = 0, tt = it->templates; i < it->tcount; tt++, i++) {
-			const ASN1_TEMPLATE *seqtt;
-			ASN1_VALUE **pseqval;
-			seqtt = asn1_do_adb(pval, tt, 1);
-			if (!seqtt)
-				return 0;
-			pseqval = asn1_get_field_ptr(pval, seqtt);
-			/* FIXME: check for errors in enhanced version */
-			seqcontlen += asn1_template_ex_i2d(pseqval, NULL, seqtt,
-			    -1, aclass);
+		if (!asn1_enc_lens_next(el, &seqcontlen)) {
+			idx = asn1_enc_lens_reserve(el);
+			for (i = 0, tt = it->templates; i < it->tcount;
+			    tt++, i++) {
+				const ASN1_TEMPLATE *seqtt;
+				ASN1_VALUE **pseqval;
+				seqtt = asn1_do_adb(pval, tt, 1);
+				if (!seqtt)
+					return 0;
+				pseqval = asn1_get_field_ptr(pval, seqtt);
+				/* FIXME: check for errors */
+				seqcontlen += asn1_template_ex_i2d(pseqval,
+				    NULL, seqtt, -1, aclass,
+				    asn1_enc_lens_sizing(el));
+			}
+			asn1_enc_lens_set(el, idx, seqcontlen);
 		}
 
 		seqlen = ASN1_object_size(ndef, seqcontlen, tag);
@@ -246,7 +399,8 @@ ASN1_item_ex_i2d(ASN1_VALUE **pval, unsigned char **out, const ASN1_ITEM *it,
 				return 0;
 			pseqval = asn1_get_field_ptr(pval, seqtt);
 			/* FIXME: check for errors in enhanced version */
-			asn1_template_ex_i2d(pseqval, out, seqtt, -1, aclass);
+			asn1_template_ex_i2d(pseqval, out, seqtt, -1, aclass,
+			    el);
 		}
 		if (ndef == 2)
 			ASN1_put_eoc(out);
@@ -265,14 +419,14 @@ int
 ASN1_template_i2d(ASN1_VALUE **pval, unsigned char **out,
     const ASN1_TEMPLATE *tt)
 {
-	return asn1_template_ex_i2d(pval, out, tt, -1, 0);
+	return asn1_template_ex_i2d(pval, out, tt, -1, 0, NULL);
 }
 
 static int
 asn1_template_ex_i2d(ASN1_VALUE **pval, unsigned char **out,
-    const ASN1_TEMPLATE *tt, int tag, int iclass)
+    const ASN1_TEMPLATE *tt, int tag, int iclass, struct asn1_enc_lens *el)
 {
-	int i, ret, flags, ttag, tclass, ndef;
+	int i, idx, ret, flags, ttag, tclass, ndef;
 	flags = tt->flags;
 	/* Work out tag and class to use: tagging may come
 	 * either from the template or the arguments, not both
@@ -346,10 +500,15 @@ asn1_template_ex_i2d(ASN1_VALUE **pval, unsigned char **out,
 
 		/* Determine total length of items */
 		skcontlen = 0;
-		for (i = 0; i < sk_ASN1_VALUE_num(sk); i++) {
-			skitem = sk_ASN1_VALUE_value(sk, i);
-			skcontlen += ASN1_item_ex_i2d(&skitem, NULL,
-			    tt->item, -1, iclass);
+		if (!asn1_enc_lens_next(el, &skcontlen)) {
+			idx = asn1_enc_lens_reserve(el);
+			for (i = 0; i < sk_ASN1_VALUE_num(sk); i++) {
+				skitem = sk_ASN1_VALUE_value(sk, i);
+				skcontlen += asn1_item_ex_i2d_lens(&skitem,
+				    NULL, tt->item, -1, iclass,
+				    asn1_enc_lens_sizing(el));
+			}
+			asn1_enc_lens_set(el, idx, skcontlen);
 		}
 		sklen = ASN1_object_size(ndef, skcontlen, sktag);
 		/* If EXPLICIT need length of surrounding tag */
@@ -369,7 +528,7 @@ asn1_template_ex_i2d(ASN1_VALUE **pval, unsigned char **out,
 		ASN1_put_object(out, ndef, skcontlen, sktag, skaclass);
 		/* And the stuff itself */
 		asn1_set_seq_out(sk, out, skcontlen, tt->item,
-		    isset, iclass);
+		    isset, iclass, el);
 		if (ndef == 2) {
 			ASN1_put_eoc(out);
 			if (flags & ASN1_TFLG_EXPTAG)
@@ -382,8 +541,12 @@ asn1_template_ex_i2d(ASN1_VALUE **pval, unsigned char **out,
 	if (flags & ASN1_TFLG_EXPTAG) {
 		/* EXPLICIT tagging */
 		/* Find length of tagged item */
-		i = ASN1_item_ex_i2d(pval, NULL, tt->item,
-		    -1, iclass);
+		if (!asn1_enc_lens_next(el, &i)) {
+			idx = asn1_enc_lens_reserve(el);
+			i = asn1_item_ex_i2d_lens(pval, NULL, tt->item,
+			    -1, iclass, asn1_enc_lens_sizing(el));
+			asn1_enc_lens_set(el, idx, i);
+		}
 		if (!i)
 			return 0;
 		/* Find length of EXPLICIT tag */
@@ -391,8 +554,8 @@ asn1_template_ex_i2d(ASN1_VALUE **pval, unsigned char **out,
 		if (out) {
 			/* Output tag and item */
 			ASN1_put_object(out, ndef, i, ttag, tclass);
-			ASN1_item_ex_i2d(pval, out, tt->item,
-			    -1, iclass);
+			asn1_item_ex_i2d_lens(pval, out, tt->item,
+			    -1, iclass, el);
 			if (ndef == 2)
 				ASN1_put_eoc(out);
 		}
@@ -400,8 +563,8 @@ asn1_template_ex_i2d(ASN1_VALUE **pval, unsigned char **out,
 	}
 
 	/* Either normal or IMPLICIT tagging: combine class and flags */
-	return ASN1_item_ex_i2d(pval, out, tt->item,
-	    ttag, tclass | iclass);
+	return asn1_item_ex_i2d_lens(pval, out, tt->item,
+	    ttag, tclass | iclass, el);
 }
 
 /* Temporary structure used to hold DER encoding of items for SET OF */
@@ -425,65 +588,89 @@ der_cmp(const void *a, const void *b)
 	return d1->length - d2->length;
 }
 
-/* Output the content octets of SET OF or SEQUENCE OF */
+#define DER_ENC_INLINE	8
+
+/*
+ * Output the content octets of SET OF or SEQUENCE OF. The members of a SET
+ * OF are encoded in place and only copied around if they turn out not to
+ * be in order already, which they usually are.
+ */
 
 static int
 asn1_set_seq_out(STACK_OF(ASN1_VALUE) *sk, unsigned char **out, int skcontlen,
-    const ASN1_ITEM *item, int do_sort, int iclass)
+    const ASN1_ITEM *item, int do_sort, int iclass, struct asn1_enc_lens *el)
 {
-	int i;
+	int i, num, sorted;
 	ASN1_VALUE *skitem;
-	unsigned char *tmpdat = NULL, *p = NULL;
-	DER_ENC *derlst = NULL, *tder;
-
-	if (do_sort) {
-		/* Don't need to sort less than 2 items */
-		if (sk_ASN1_VALUE_num(sk) < 2)
-			do_sort = 0;
-		else {
-			derlst = reallocarray(NULL, sk_ASN1_VALUE_num(sk),
-			    sizeof(*derlst));
-			tmpdat = malloc(skcontlen);
-			if (!derlst || !tmpdat) {
-				free(derlst);
-				free(tmpdat);
-				return 0;
-			}
-		}
-	}
+	unsigned char *tmpdat = NULL, *start, *p;
+	DER_ENC derinline[DER_ENC_INLINE], *derlst = derinline, *tder;
+
+	num = sk_ASN1_VALUE_num(sk);
+
+	/* Don't need to sort less than 2 items */
+	if (num < 2)
+		do_sort = 0;
+
 	/* If not sorting just output each item */
 	if (!do_sort) {
-		for (i = 0; i < sk_ASN1_VALUE_num(sk); i++) {
+		for (i = 0; i < num; i++) {
 			skitem = sk_ASN1_VALUE_value(sk, i);
-			ASN1_item_ex_i2d(&skitem, out, item, -1, iclass);
+			asn1_item_ex_i2d_lens(&skitem, out, item, -1, iclass,
+			    el);
 		}
 		return 1;
 	}
-	p = tmpdat;
+
+	if (num > DER_ENC_INLINE) {
+		if ((derlst = reallocarray(NULL, num,
+		    sizeof(*derlst))) == NULL)
+			return 0;
+	}
 
 	/* Doing sort: build up a list of each member's DER encoding */
-	for (i = 0, tder = derlst; i < sk_ASN1_VALUE_num(sk); i++, tder++) {
+	start = p = *out;
+	for (i = 0, tder = derlst; i < num; i++, tder++) {
 		skitem = sk_ASN1_VALUE_value(sk, i);
 		tder->data = p;
-		tder->length = ASN1_item_ex_i2d(&skitem, &p, item, -1, iclass);
+		tder->length = asn1_item_ex_i2d_lens(&skitem, &p, item, -1,
+		    iclass, el);
 		tder->field = skitem;
 	}
+	*out = p;
+
+	sorted = 1;
+	for (i = 1; i < num && sorted; i++) {
+		if (der_cmp(&derlst[i - 1], &derlst[i]) > 0)
+			sorted = 0;
+	}
+	if (sorted)
+		goto done;
 
-	/* Now sort them */
-	qsort(derlst, sk_ASN1_VALUE_num(sk), sizeof(*derlst), der_cmp);
+	/* Now sort them, from a copy of the encodings */
+	if ((tmpdat = malloc(p - start)) == NULL) {
+		if (derlst != derinline)
+			free(derlst);
+		return 0;
+	}
+	memcpy(tmpdat, start, p - start);
+	for (i = 0, tder = derlst; i < num; i++, tder++)
+		tder->data = tmpdat + (tder->data - start);
+	qsort(derlst, num, sizeof(*derlst), der_cmp);
 	/* Output sorted DER encoding */
-	p = *out;
-	for (i = 0, tder = derlst; i < sk_ASN1_VALUE_num(sk); i++, tder++) {
+	p = start;
+	for (i = 0, tder = derlst; i < num; i++, tder++) {
 		memcpy(p, tder->data, tder->length);
 		p += tder->length;
 	}
-	*out = p;
 	/* If do_sort is 2 then reorder the STACK */
 	if (do_sort == 2) {
-		for (i = 0, tder = derlst; i < sk_ASN1_VALUE_num(sk); i++, tder++)
+		for (i = 0, tder = derlst; i < num; i++, tder++)
 			(void)sk_ASN1_VALUE_set(sk, i, tder->field);
 	}
-	free(derlst);
+
+ done:
+	if (derlst != derinline)
+		free(derlst);
 	free(tmpdat);
 	return 1;
 }
@@ -56,7 +56,10 @@
  * [including the GNU Public Licence.]
  */
 
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <openssl/opensslconf.h>
 
@@ -70,6 +73,9 @@
 static int X509_REVOKED_cmp(const X509_REVOKED * const *a,
     const X509_REVOKED * const *b);
 static void setup_idp(X509_CRL *crl, ISSUING_DIST_POINT *idp);
+static void crl_lazy_free(struct x509_crl_lazy *lazy);
+static int crl_lazy_lookup(X509_CRL *crl, X509_REVOKED **ret,
+    ASN1_INTEGER *serial, X509_NAME *issuer);
 
 static const ASN1_TEMPLATE X509_REVOKED_seq_tt[] = {
 	{
@@ -284,6 +290,7 @@ crl_cb(int operation, ASN1_VALUE **pval, const ASN1_ITEM *it, void *exarg)
 		crl->issuers = NULL;
 		crl->crl_number = NULL;
 		crl->base_crl_number = NULL;
+		crl->lazy = NULL;
 		break;
 
 	case ASN1_OP_D2I_POST:
@@ -355,6 +362,7 @@ crl_cb(int operation, ASN1_VALUE **pval, const ASN1_ITEM *it, void *exarg)
 		ASN1_INTEGER_free(crl->crl_number);
 		ASN1_INTEGER_free(crl->base_crl_number);
 		sk_GENERAL_NAMES_pop_free(crl->issuers, GENERAL_NAMES_free);
+		crl_lazy_free(crl->lazy);
 		break;
 	}
 	return rc;
@@ -535,6 +543,12 @@ X509_CRL_add0_revoked(X509_CRL *crl, X509_REVOKED *rev)
 {
 	X509_CRL_INFO *inf;
 
+	/* The entries of a lazily decoded CRL are only in its encoding. */
+	if (crl->lazy != NULL) {
+		ASN1error(ERR_R_SHOULD_NOT_HAVE_BEEN_CALLED);
+		return 0;
+	}
+
 	inf = crl->crl;
 	if (!inf->revoked)
 		inf->revoked = sk_X509_REVOKED_new(X509_REVOKED_cmp);
@@ -613,6 +627,9 @@ def_crl_lookup(X509_CRL *crl, X509_REVOKED **ret, ASN1_INTEGER *serial,
 	X509_REVOKED rtmp, *rev;
 	int idx;
 
+	if (crl->lazy != NULL && serial->type != V_ASN1_NEG_INTEGER)
+		return crl_lazy_lookup(crl, ret, serial, issuer);
+
 	rtmp.serialNumber = serial;
 	/* Sort revoked into serial number order if not already sorted.
 	 * Do this under a lock to avoid race condition.
@@ -641,6 +658,480 @@ def_crl_lookup(X509_CRL *crl, X509_REVOKED **ret, ASN1_INTEGER *serial,
 	return 0;
 }
 
+/*
+ * Lazily decoded CRLs.
+ *
+ * A CRL decoded by d2i_X509_CRL_lazy() does not hold its revoked
+ * entries as X509_REVOKED structures. Instead it keeps the DER of the
+ * tbsCertList, which is needed to check the signature anyway, and an
+ * array of the entries sorted by serial number pointing into it. An
+ * entry is only decoded once a lookup finds its serial number.
+ */
+
+struct x509_crl_lazy_entry {
+	const unsigned char *serial;	/* Magnitude, no leading zeros */
+	uint32_t serial_len;
+	uint32_t offset;		/* Of the entry in the tbsCertList */
+};
+
+struct x509_crl_lazy {
+	struct x509_crl_lazy_entry *entries;
+	size_t count;
+	X509_REVOKED **decoded;		/* Decoded entries, by index */
+};
+
+/* DER encoding of the certificateIssuer extension OID, 2.5.29.29. */
+static const unsigned char crl_lazy_cert_issuer_oid[] = { 0x55, 0x1d, 0x1d };
+
+static void
+crl_lazy_free(struct x509_crl_lazy *lazy)
+{
+	size_t i;
+
+	if (lazy == NULL)
+		return;
+	if (lazy->decoded != NULL) {
+		for (i = 0; i < lazy->count; i++)
+			X509_REVOKED_free(lazy->decoded[i]);
+	}
+	free(lazy->decoded);
+	free(lazy->entries);
+	free(lazy);
+}
+
+static int
+crl_lazy_serial_cmp(const unsigned char *s1, size_t l1,
+    const unsigned char *s2, size_t l2)
+{
+	if (l1 != l2)
+		return l1 < l2 ? -1 : 1;
+	return memcmp(s1, s2, l1);
+}
+
+static int
+crl_lazy_entry_cmp(const void *a, const void *b)
+{
+	const struct x509_crl_lazy_entry *e1 = a, *e2 = b;
+	int cmp;
+
+	if ((cmp = crl_lazy_serial_cmp(e1->serial, e1->serial_len,
+	    e2->serial, e2->serial_len)) != 0)
+		return cmp;
+	/* Keep entries with the same serial in CRL order. */
+	if (e1->offset != e2->offset)
+		return e1->offset < e2->offset ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Check the extensions of a revoked entry in [p, end) for critical ones
+ * we do not handle, as crl_set_issuers() does for decoded entries.
+ */
+static int
+crl_lazy_check_extensions(X509_CRL *crl, const unsigned char *p,
+    const unsigned char *end)
+{
+	const unsigned char *ext_end, *oid, *oid_end, *q, *q_end;
+	int tag, xclass, constructed, critical;
+
+	while (p < end) {
+		if (!asn1_get_tlv(&p, end, &tag, &xclass, &constructed,
+		    &ext_end) || tag != V_ASN1_SEQUENCE || !constructed)
+			return 0;
+		oid = p;
+		if (!asn1_get_tlv(&oid, ext_end, &tag, &xclass, &constructed,
+		    &oid_end) || tag != V_ASN1_OBJECT)
+			return 0;
+		critical = 0;
+		q = oid_end;
+		if (!asn1_get_tlv(&q, ext_end, &tag, &xclass, &constructed,
+		    &q_end))
+			return 0;
+		if (tag == V_ASN1_BOOLEAN) {
+			critical = q_end - q == 1 && q[0] != 0;
+			q = q_end;
+			if (!asn1_get_tlv(&q, ext_end, &tag, &xclass,
+			    &constructed, &q_end))
+				return 0;
+		}
+		if (tag != V_ASN1_OCTET_STRING || q_end != ext_end)
+			return 0;
+		if (critical && (oid_end - oid !=
+		    sizeof(crl_lazy_cert_issuer_oid) ||
+		    memcmp(oid, crl_lazy_cert_issuer_oid,
+		    sizeof(crl_lazy_cert_issuer_oid)) != 0))
+			crl->flags |= EXFLAG_CRITICAL;
+		p = ext_end;
+	}
+
+	return 1;
+}
+
+/*
+ * Set the certificate issuer and reason of a revoked entry, as
+ * crl_set_issuers() does. An indirect CRL is never decoded lazily, so
+ * an entry only takes its own certificate issuer extension into
+ * account.
+ */
+static int
+crl_lazy_setup_revoked(X509_REVOKED *rev, GENERAL_NAMES **gens)
+{
+	ASN1_ENUMERATED *reason;
+	int j;
+
+	*gens = X509_REVOKED_get_ext_d2i(rev, NID_certificate_issuer, &j,
+	    NULL);
+	if (*gens == NULL && j != -1)
+		return 0;
+	rev->issuer = *gens;
+
+	reason = X509_REVOKED_get_ext_d2i(rev, NID_crl_reason, &j, NULL);
+	if (reason == NULL && j != -1)
+		return 0;
+	if (reason != NULL) {
+		rev->reason = ASN1_ENUMERATED_get(reason);
+		ASN1_ENUMERATED_free(reason);
+	} else
+		rev->reason = CRL_REASON_NONE;
+
+	return 1;
+}
+
+/*
+ * Return the decoded entry at index i. An entry that cannot be decoded
+ * is treated as revoked with an unspecified reason rather than
+ * ignored.
+ */
+static X509_REVOKED *
+crl_lazy_decode(X509_CRL *crl, size_t i)
+{
+	struct x509_crl_lazy *lazy = crl->lazy;
+	X509_REVOKED *rev, **decoded;
+	GENERAL_NAMES *gens = NULL;
+	const unsigned char *p;
+	long len;
+
+	CRYPTO_r_lock(CRYPTO_LOCK_X509_CRL);
+	rev = lazy->decoded != NULL ? lazy->decoded[i] : NULL;
+	CRYPTO_r_unlock(CRYPTO_LOCK_X509_CRL);
+	if (rev != NULL)
+		return rev;
+
+	p = crl->crl->enc.enc + lazy->entries[i].offset;
+	len = crl->crl->enc.len - lazy->entries[i].offset;
+	if ((rev = d2i_X509_REVOKED(NULL, &p, len)) == NULL ||
+	    !crl_lazy_setup_revoked(rev, &gens)) {
+		GENERAL_NAMES_free(gens);
+		gens = NULL;
+		X509_REVOKED_free(rev);
+		if ((rev = X509_REVOKED_new()) == NULL)
+			return NULL;
+		if (!ASN1_STRING_set(rev->serialNumber,
+		    lazy->entries[i].serial, lazy->entries[i].serial_len)) {
+			X509_REVOKED_free(rev);
+			return NULL;
+		}
+		rev->reason = CRL_REASON_UNSPECIFIED;
+	}
+
+	CRYPTO_w_lock(CRYPTO_LOCK_X509_CRL);
+	if (lazy->decoded == NULL) {
+		if ((decoded = calloc(lazy->count, sizeof(*decoded))) == NULL)
+			goto err;
+		lazy->decoded = decoded;
+	}
+	if (lazy->decoded[i] != NULL) {
+		GENERAL_NAMES_free(gens);
+		X509_REVOKED_free(rev);
+		rev = lazy->decoded[i];
+		goto done;
+	}
+	if (gens != NULL) {
+		if (crl->issuers == NULL &&
+		    (crl->issuers = sk_GENERAL_NAMES_new_null()) == NULL)
+			goto err;
+		if (!sk_GENERAL_NAMES_push(crl->issuers, gens))
+			goto err;
+	}
+	lazy->decoded[i] = rev;
+ done:
+	CRYPTO_w_unlock(CRYPTO_LOCK_X509_CRL);
+
+	return rev;
+
+ err:
+	CRYPTO_w_unlock(CRYPTO_LOCK_X509_CRL);
+	GENERAL_NAMES_free(gens);
+	X509_REVOKED_free(rev);
+
+	return NULL;
+}
+
+static int
+crl_lazy_lookup(X509_CRL *crl, X509_REVOKED **ret, ASN1_INTEGER *serial,
+    X509_NAME *issuer)
+{
+	struct x509_crl_lazy *lazy = crl->lazy;
+	const unsigned char *s = serial->data;
+	size_t lo = 0, hi = lazy->count, mid, len = serial->length;
+	X509_REVOKED *rev;
+
+	while (len > 0 && s[0] == 0) {
+		s++;
+		len--;
+	}
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (crl_lazy_serial_cmp(lazy->entries[mid].serial,
+		    lazy->entries[mid].serial_len, s, len) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (; lo < lazy->count; lo++) {
+		if (crl_lazy_serial_cmp(lazy->entries[lo].serial,
+		    lazy->entries[lo].serial_len, s, len) != 0)
+			return 0;
+		if ((rev = crl_lazy_decode(crl, lo)) == NULL)
+			return 0;
+		if (crl_revoked_issuer_match(crl, issuer, rev)) {
+			if (ret)
+				*ret = rev;
+			if (rev->reason == CRL_REASON_REMOVE_FROM_CRL)
+				return 2;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Index the revoked entries in [p, end), the content of the
+ * revokedCertificates of the tbsCertList starting at tbs. Entries with
+ * a negative serial number are decoded into crl->crl->revoked as usual.
+ */
+static int
+crl_lazy_index(X509_CRL *crl, const unsigned char *tbs,
+    const unsigned char *p, const unsigned char *end)
+{
+	struct x509_crl_lazy *lazy = NULL;
+	struct x509_crl_lazy_entry *entries, *entry;
+	const unsigned char *entry_start, *entry_end, *q, *q_end;
+	X509_REVOKED *rev = NULL;
+	GENERAL_NAMES *gens = NULL;
+	size_t entries_len = 0;
+	int tag, xclass, constructed;
+
+	if ((lazy = calloc(1, sizeof(*lazy))) == NULL)
+		goto err;
+
+	while (p < end) {
+		entry_start = p;
+		if (!asn1_get_tlv(&p, end, &tag, &xclass, &constructed,
+		    &entry_end) || tag != V_ASN1_SEQUENCE || !constructed)
+			goto err;
+		if (entry_start - tbs > UINT32_MAX)
+			goto err;
+
+		q = p;
+		if (!asn1_get_tlv(&q, entry_end, &tag, &xclass, &constructed,
+		    &q_end) || tag != V_ASN1_INTEGER || constructed ||
+		    q == q_end)
+			goto err;
+
+		if ((q[0] & 0x80) != 0) {
+			/* Negative serial numbers are rare, decode them. */
+			q = entry_start;
+			if ((rev = d2i_X509_REVOKED(NULL, &q,
+			    entry_end - entry_start)) == NULL)
+				goto err;
+			if (!crl_lazy_setup_revoked(rev, &gens))
+				crl->flags |= EXFLAG_INVALID;
+			if (gens != NULL) {
+				if (crl->issuers == NULL && (crl->issuers =
+				    sk_GENERAL_NAMES_new_null()) == NULL)
+					goto err;
+				if (!sk_GENERAL_NAMES_push(crl->issuers, gens))
+					goto err;
+				gens = NULL;
+			}
+			/* Not X509_CRL_add0_revoked(), the encoding is kept. */
+			if (crl->crl->revoked == NULL && (crl->crl->revoked =
+			    sk_X509_REVOKED_new(X509_REVOKED_cmp)) == NULL)
+				goto err;
+			if (!sk_X509_REVOKED_push(crl->crl->revoked, rev))
+				goto err;
+			rev = NULL;
+			p = entry_end;
+			continue;
+		}
+
+		if (lazy->count == entries_len) {
+			if ((entries = recallocarray(lazy->entries,
+			    entries_len, entries_len + 1024,
+			    sizeof(*entries))) == NULL)
+				goto err;
+			lazy->entries = entries;
+			entries_len += 1024;
+		}
+		entry = &lazy->entries[lazy->count++];
+		entry->offset = entry_start - tbs;
+		while (q < q_end && q[0] == 0)
+			q++;
+		entry->serial = q;
+		entry->serial_len = q_end - q;
+
+		/* Skip revocationDate, then look at any extensions. */
+		q = q_end;
+		if (!asn1_get_tlv(&q, entry_end, &tag, &xclass, &constructed,
+		    &q_end) || (tag != V_ASN1_UTCTIME &&
+		    tag != V_ASN1_GENERALIZEDTIME))
+			goto err;
+		q = q_end;
+		if (q < entry_end) {
+			if (!asn1_get_tlv(&q, entry_end, &tag, &xclass,
+			    &constructed, &q_end) ||
+			    tag != V_ASN1_SEQUENCE || !constructed ||
+			    q_end != entry_end)
+				goto err;
+			if (!crl_lazy_check_extensions(crl, q, q_end))
+				goto err;
+		}
+		p = entry_end;
+	}
+
+	qsort(lazy->entries, lazy->count, sizeof(*lazy->entries),
+	    crl_lazy_entry_cmp);
+	crl->lazy = lazy;
+
+	return 1;
+
+ err:
+	GENERAL_NAMES_free(gens);
+	X509_REVOKED_free(rev);
+	crl_lazy_free(lazy);
+
+	return 0;
+}
+
+/*
+ * Decode a CRL without decoding its revoked entries. If the CRL cannot
+ * be handled lazily, such as an indirect CRL, it is decoded as by
+ * d2i_X509_CRL().
+ */
+X509_CRL *
+d2i_X509_CRL_lazy(X509_CRL **a, const unsigned char **in, long len)
+{
+	const unsigned char *p, *end, *crl_end, *tbs, *tbs_content, *tbs_end;
+	const unsigned char *revoked = NULL, *revoked_content, *revoked_end;
+	const unsigned char *elem, *elem_end;
+	unsigned char *der = NULL, *q, *enc = NULL;
+	size_t tbs_len, outer_len, der_len = 0;
+	X509_CRL *crl = NULL;
+	int tag, xclass, constructed, n;
+
+	if (len <= 0)
+		goto full;
+	p = *in;
+	end = p + len;
+	if (!asn1_get_tlv(&p, end, &tag, &xclass, &constructed, &crl_end) ||
+	    tag != V_ASN1_SEQUENCE || !constructed)
+		goto full;
+	tbs = p;
+	if (!asn1_get_tlv(&p, crl_end, &tag, &xclass, &constructed,
+	    &tbs_end) || tag != V_ASN1_SEQUENCE || !constructed)
+		goto full;
+	tbs_content = p;
+
+	/*
+	 * Find revokedCertificates: the first universal SEQUENCE after
+	 * the signature algorithm and issuer.
+	 */
+	for (elem = tbs_content, n = 0; elem < tbs_end; elem = elem_end) {
+		const unsigned char *start = elem;
+
+		if (!asn1_get_tlv(&elem, tbs_end, &tag, &xclass, &constructed,
+		    &elem_end))
+			goto full;
+		if (xclass != V_ASN1_UNIVERSAL || tag != V_ASN1_SEQUENCE)
+			continue;
+		if (++n == 3) {
+			revoked = start;
+			revoked_content = elem;
+			revoked_end = elem_end;
+			break;
+		}
+	}
+	if (revoked == NULL)
+		goto full;
+	if (tbs_end - tbs > UINT32_MAX)
+		goto full;
+
+	/* Build the CRL with an empty revoked list and decode that. */
+	tbs_len = (tbs_end - tbs_content) - (revoked_end - revoked);
+	outer_len = ASN1_object_size(1, tbs_len, V_ASN1_SEQUENCE) +
+	    (crl_end - tbs_end);
+	der_len = ASN1_object_size(1, outer_len, V_ASN1_SEQUENCE);
+	if ((der = malloc(der_len)) == NULL)
+		goto merr;
+	q = der;
+	ASN1_put_object(&q, 1, outer_len, V_ASN1_SEQUENCE, V_ASN1_UNIVERSAL);
+	ASN1_put_object(&q, 1, tbs_len, V_ASN1_SEQUENCE, V_ASN1_UNIVERSAL);
+	memcpy(q, tbs_content, revoked - tbs_content);
+	q += revoked - tbs_content;
+	memcpy(q, revoked_end, tbs_end - revoked_end);
+	q += tbs_end - revoked_end;
+	memcpy(q, tbs_end, crl_end - tbs_end);
+
+	p = der;
+	if ((crl = d2i_X509_CRL(NULL, &p, der_len)) == NULL)
+		goto err;
+	if ((crl->idp_flags & IDP_INDIRECT) != 0 || crl->crl->revoked != NULL) {
+		X509_CRL_free(crl);
+		crl = NULL;
+		goto full;
+	}
+
+	/* Keep the original encoding, for the signature and the entries. */
+	if ((enc = malloc(tbs_end - tbs)) == NULL)
+		goto merr;
+	memcpy(enc, tbs, tbs_end - tbs);
+	free(crl->crl->enc.enc);
+	crl->crl->enc.enc = enc;
+	crl->crl->enc.len = tbs_end - tbs;
+	crl->crl->enc.modified = 0;
+	if (!crl_lazy_index(crl, enc, enc + (revoked_content - tbs),
+	    enc + (revoked_end - tbs))) {
+		X509_CRL_free(crl);
+		crl = NULL;
+		goto full;
+	}
+#ifndef OPENSSL_NO_SHA
+	X509_CRL_digest(crl, EVP_sha1(), crl->sha1_hash, NULL);
+#endif
+
+	free(der);
+	*in = crl_end;
+	if (a != NULL) {
+		X509_CRL_free(*a);
+		*a = crl;
+	}
+	return crl;
+
+ full:
+	free(der);
+	return d2i_X509_CRL(a, in, len);
+
+ merr:
+	ASN1error(ERR_R_MALLOC_FAILURE);
+ err:
+	X509_CRL_free(crl);
+	free(der);
+	return NULL;
+}
+
 void
 X509_CRL_set_default_method(const X509_CRL_METHOD *meth)
 {
@@ -328,9 +328,6 @@ x509_name_ex_d2i(ASN1_VALUE **val, const unsigned char **in, long len,
 		sk_X509_NAME_ENTRY_free(entries);
 	}
 	sk_STACK_OF_X509_NAME_ENTRY_free(intname.s);
-	ret = x509_name_canon(nm.x);
-	if (!ret)
-		goto err;
 	nm.x->modified = 0;
 	*val = nm.a;
 	*in = p;
@@ -354,9 +351,10 @@ x509_name_ex_i2d(ASN1_VALUE **val, unsigned char **out, const ASN1_ITEM *it,
 		ret = x509_name_encode(a);
 		if (ret < 0)
 			return ret;
-		ret = x509_name_canon(a);
-		if (ret < 0)
-			return ret;
+		/* Rebuilt by x509_name_get_canon() when next needed. */
+		free(a->canon_enc);
+		a->canon_enc = NULL;
+		a->canon_enclen = 0;
 	}
 	ret = a->bytes->length;
 	if (out != NULL) {
@@ -372,12 +370,6 @@ local_sk_X509_NAME_ENTRY_free(STACK_OF(X509_NAME_ENTRY) *ne)
 	sk_X509_NAME_ENTRY_free(ne);
 }
 
-static void
-local_sk_X509_NAME_ENTRY_pop_free(STACK_OF(X509_NAME_ENTRY) *ne)
-{
-	sk_X509_NAME_ENTRY_pop_free(ne, X509_NAME_ENTRY_free);
-}
-
 static int
 x509_name_encode(X509_NAME *a)
 {
@@ -449,6 +441,11 @@ x509_name_ex_print(BIO *out, ASN1_VALUE **pval, int indent, const char *fname,
  * performed by just using memcmp() of the canonical encoding.
  * By omitting the leading SEQUENCE name constraints of type
  * dirName can also be checked with a simple memcmp().
+ *
+ * Most names are never compared, so the encoding is only generated on
+ * first use, see x509_name_get_canon(). Since a name may be shared
+ * between threads by then, the encoding is installed with a compare and
+ * swap and a thread that loses the race frees its own copy.
  */
 
 static int
@@ -457,22 +454,29 @@ x509_name_canon(X509_NAME *a)
 	unsigned char *p;
 	STACK_OF(STACK_OF_X509_NAME_ENTRY) *intname = NULL;
 	STACK_OF(X509_NAME_ENTRY) *entries = NULL;
-	X509_NAME_ENTRY *entry, *tmpentry = NULL;
-	int i, len, set = -1, ret = 0;
+	X509_NAME_ENTRY *entry, *tmpentry;
+	ASN1_STRING *tmpvalues = NULL;
+	X509_NAME_ENTRY *tmpentries = NULL;
+	unsigned char *canon_enc, *expected = NULL;
+	int i, n, len, set = -1, ret = 0;
 
-	if (a->canon_enc) {
-		free(a->canon_enc);
-		a->canon_enc = NULL;
-	}
 	/* Special case: empty X509_NAME => null encoding */
-	if (sk_X509_NAME_ENTRY_num(a->entries) == 0) {
-		a->canon_enclen = 0;
+	if ((n = sk_X509_NAME_ENTRY_num(a->entries)) == 0)
 		return 1;
-	}
+
+	/*
+	 * The canonical entries only live until the encoding is generated,
+	 * so allocate them in one go and share the objects of the name
+	 * rather than duplicating every entry.
+	 */
+	if ((tmpentries = calloc(n, sizeof(*tmpentries))) == NULL)
+		goto err;
+	if ((tmpvalues = calloc(n, sizeof(*tmpvalues))) == NULL)
+		goto err;
 	intname = sk_STACK_OF_X509_NAME_ENTRY_new_null();
 	if (!intname)
 		goto err;
-	for (i = 0; i < sk_X509_NAME_ENTRY_num(a->entries); i++) {
+	for (i = 0; i < n; i++) {
 		entry = sk_X509_NAME_ENTRY_value(a->entries, i);
 		if (entry->set != set) {
 			entries = sk_X509_NAME_ENTRY_new_null();
@@ -485,41 +489,66 @@ x509_name_canon(X509_NAME *a)
 			}
 			set = entry->set;
 		}
-		tmpentry = X509_NAME_ENTRY_new();
-		if (tmpentry == NULL)
-			goto err;
-		tmpentry->object = OBJ_dup(entry->object);
-		if (tmpentry->object == NULL)
-			goto err;
+		tmpentry = &tmpentries[i];
+		tmpentry->object = entry->object;
+		tmpentry->value = &tmpvalues[i];
 		if (!asn1_string_canon(tmpentry->value, entry->value))
 			goto err;
 		if (entries == NULL /* if entry->set is bogusly -1 */ ||
 		    !sk_X509_NAME_ENTRY_push(entries, tmpentry))
 			goto err;
-		tmpentry = NULL;
 	}
 
 	/* Finally generate encoding */
 	len = i2d_name_canon(intname, NULL);
 	if (len < 0)
 		goto err;
-	p = malloc(len);
-	if (p == NULL)
+	if ((canon_enc = malloc(len)) == NULL)
 		goto err;
-	a->canon_enc = p;
-	a->canon_enclen = len;
+	p = canon_enc;
 	i2d_name_canon(intname, &p);
+
+	/* Any thread that gets here stores the same length. */
+	__atomic_store_n(&a->canon_enclen, len, __ATOMIC_RELAXED);
+	if (!__atomic_compare_exchange_n(&a->canon_enc, &expected, canon_enc,
+	    0, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		free(canon_enc);
 	ret = 1;
 
 err:
-	if (tmpentry)
-		X509_NAME_ENTRY_free(tmpentry);
 	if (intname)
 		sk_STACK_OF_X509_NAME_ENTRY_pop_free(intname,
-		    local_sk_X509_NAME_ENTRY_pop_free);
+		    local_sk_X509_NAME_ENTRY_free);
+	if (tmpvalues != NULL) {
+		for (i = 0; i < n; i++)
+			free(tmpvalues[i].data);
+	}
+	free(tmpvalues);
+	free(tmpentries);
 	return ret;
 }
 
+/*
+ * Return the canonical encoding of a name, for comparing and hashing it,
+ * generating it if this has not been done yet. The encoding remains owned
+ * by the name and is valid until the name is modified.
+ */
+int
+x509_name_get_canon(X509_NAME *a, const unsigned char **canon_enc,
+    int *canon_enclen)
+{
+	if (a->modified && i2d_X509_NAME(a, NULL) < 0)
+		return 0;
+	if (__atomic_load_n(&a->canon_enc, __ATOMIC_ACQUIRE) == NULL &&
+	    !x509_name_canon(a))
+		return 0;
+
+	*canon_enc = __atomic_load_n(&a->canon_enc, __ATOMIC_ACQUIRE);
+	*canon_enclen = __atomic_load_n(&a->canon_enclen, __ATOMIC_RELAXED);
+
+	return 1;
+}
+
 /* Bitmap of all the types of string that will be canonicalized. */
 
 #define ASN1_MASK_CANON	\
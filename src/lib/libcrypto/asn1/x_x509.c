@@ -56,15 +56,24 @@
  * [including the GNU Public Licence.]
  */
 
+#include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <openssl/opensslconf.h>
 
 #include <openssl/asn1t.h>
+#include <openssl/err.h>
 #include <openssl/evp.h>
 #include <openssl/x509.h>
 #include <openssl/x509v3.h>
 
+#include "asn1_locl.h"
+
+static void x509_lazy_free(struct x509_lazy *lazy);
+
 static const ASN1_AUX X509_CINF_aux = {
 	.flags = ASN1_AFLG_ENCODING,
 	.enc_offset = offsetof(X509_CINF, enc),
@@ -168,6 +177,8 @@ X509_CINF_free(X509_CINF *a)
 /* X509 top level structure needs a bit of customisation */
 
 extern void policy_cache_free(X509_POLICY_CACHE *cache);
+extern void x509_constraints_cache_free(struct x509_constraints_cache *cache);
+extern void x509_host_cache_free(struct x509_host_cache *cache);
 
 static int
 x509_cb(int operation, ASN1_VALUE **pval, const ASN1_ITEM *it, void *exarg)
@@ -185,12 +196,18 @@ x509_cb(int operation, ASN1_VALUE **pval, const ASN1_ITEM *it, void *exarg)
 		ret->akid = NULL;
 		ret->aux = NULL;
 		ret->crldp = NULL;
+		ret->nc_cache = NULL;
+		ret->host_cache = NULL;
+		ret->lazy = NULL;
+		ret->ex_cached = 0;
 		CRYPTO_new_ex_data(CRYPTO_EX_INDEX_X509, ret, &ret->ex_data);
 		break;
 
 	case ASN1_OP_D2I_POST:
 		free(ret->name);
 		ret->name = X509_NAME_oneline(ret->cert_info->subject, NULL, 0);
+		x509_host_cache_free(ret->host_cache);
+		ret->host_cache = NULL;
 		break;
 
 	case ASN1_OP_FREE_POST:
@@ -202,6 +219,9 @@ x509_cb(int operation, ASN1_VALUE **pval, const ASN1_ITEM *it, void *exarg)
 		policy_cache_free(ret->policy_cache);
 		GENERAL_NAMES_free(ret->altname);
 		NAME_CONSTRAINTS_free(ret->nc);
+		x509_constraints_cache_free(ret->nc_cache);
+		x509_host_cache_free(ret->host_cache);
+		x509_lazy_free(ret->lazy);
 		free(ret->name);
 		ret->name = NULL;
 		break;
@@ -253,6 +273,226 @@ d2i_X509(X509 **a, const unsigned char **in, long len)
 	    &X509_it);
 }
 
+/*
+ * Lazily decoded certificates.
+ *
+ * A certificate decoded by d2i_X509_lazy() does not decode its
+ * extensions until one of the extension accessors asks for them. They
+ * stay in the cached encoding of the TBSCertificate, which is kept for
+ * the signature anyway, and are decoded as a whole on first use.
+ */
+
+struct x509_lazy {
+	pthread_mutex_t mutex;
+	size_t offset;			/* Of the extensions in the TBS */
+	size_t len;
+	int loaded;
+};
+
+static void
+x509_lazy_free(struct x509_lazy *lazy)
+{
+	if (lazy == NULL)
+		return;
+	pthread_mutex_destroy(&lazy->mutex);
+	free(lazy);
+}
+
+/*
+ * Check the structure of the extensions without decoding them, so that
+ * a certificate that d2i_X509() rejects is not accepted lazily.
+ */
+static int
+x509_lazy_check_extensions(const unsigned char *p, const unsigned char *end)
+{
+	const unsigned char *q, *q_end, *ext_end;
+	int tag, xclass, constructed;
+
+	while (p < end) {
+		if (!asn1_get_tlv(&p, end, &tag, &xclass, &constructed,
+		    &ext_end) || xclass != V_ASN1_UNIVERSAL ||
+		    tag != V_ASN1_SEQUENCE || !constructed)
+			return 0;
+		q = p;
+		if (!asn1_get_tlv(&q, ext_end, &tag, &xclass, &constructed,
+		    &q_end) || xclass != V_ASN1_UNIVERSAL ||
+		    tag != V_ASN1_OBJECT || constructed || q == q_end)
+			return 0;
+		q = q_end;
+		if (!asn1_get_tlv(&q, ext_end, &tag, &xclass, &constructed,
+		    &q_end) || xclass != V_ASN1_UNIVERSAL || constructed)
+			return 0;
+		if (tag == V_ASN1_BOOLEAN) {
+			if (q_end - q != 1)
+				return 0;
+			q = q_end;
+			if (!asn1_get_tlv(&q, ext_end, &tag, &xclass,
+			    &constructed, &q_end) ||
+			    xclass != V_ASN1_UNIVERSAL || constructed)
+				return 0;
+		}
+		if (tag != V_ASN1_OCTET_STRING || q_end != ext_end)
+			return 0;
+		p = ext_end;
+	}
+
+	return 1;
+}
+
+/*
+ * Decode the extensions of a lazily decoded certificate, if that has not
+ * happened yet. If they cannot be decoded the certificate is marked as
+ * invalid, since a missing extension may well lift a restriction.
+ */
+int
+x509_lazy_load_extensions(const X509 *x)
+{
+	struct x509_lazy *lazy = x->lazy;
+	STACK_OF(X509_EXTENSION) *exts;
+	const unsigned char *p;
+	int ret = 1;
+
+	if (lazy == NULL)
+		return 1;
+
+	pthread_mutex_lock(&lazy->mutex);
+	if (!lazy->loaded) {
+		p = x->cert_info->enc.enc + lazy->offset;
+		if ((exts = d2i_X509_EXTENSIONS(NULL, &p, lazy->len)) == NULL) {
+			((X509 *)x)->ex_flags |= EXFLAG_INVALID;
+			ret = 0;
+		} else {
+			x->cert_info->extensions = exts;
+			lazy->loaded = 1;
+		}
+	}
+	pthread_mutex_unlock(&lazy->mutex);
+
+	return ret;
+}
+
+/*
+ * Decode a certificate without decoding its extensions. A certificate
+ * without extensions, or one that cannot be split up, is decoded as by
+ * d2i_X509().
+ */
+X509 *
+d2i_X509_lazy(X509 **a, const unsigned char **in, long len)
+{
+	const unsigned char *p, *end, *cert_end, *tbs, *tbs_content, *tbs_end;
+	const unsigned char *elem, *elem_end, *exts = NULL, *exts_content;
+	const unsigned char *seq_end;
+	unsigned char *der = NULL, *q, *enc = NULL;
+	struct x509_lazy *lazy = NULL;
+	int tag, xclass, constructed;
+	int tbs_len, outer_len, der_len;
+	X509 *x = NULL;
+
+	ERR_set_mark();
+
+	if (len <= 0)
+		goto full;
+	p = *in;
+	end = p + len;
+	if (!asn1_get_tlv(&p, end, &tag, &xclass, &constructed, &cert_end) ||
+	    tag != V_ASN1_SEQUENCE || !constructed)
+		goto full;
+	tbs = p;
+	if (!asn1_get_tlv(&p, cert_end, &tag, &xclass, &constructed,
+	    &tbs_end) || tag != V_ASN1_SEQUENCE || !constructed)
+		goto full;
+	tbs_content = p;
+
+	/* The extensions are the [3] at the end of the TBSCertificate. */
+	for (elem = tbs_content; elem < tbs_end; elem = elem_end) {
+		const unsigned char *start = elem;
+
+		if (!asn1_get_tlv(&elem, tbs_end, &tag, &xclass, &constructed,
+		    &elem_end))
+			goto full;
+		exts = NULL;
+		if (xclass == V_ASN1_CONTEXT_SPECIFIC && tag == 3 &&
+		    constructed) {
+			exts = start;
+			exts_content = elem;
+		}
+	}
+	if (exts == NULL)
+		goto full;
+	p = exts_content;
+	if (!asn1_get_tlv(&p, tbs_end, &tag, &xclass, &constructed,
+	    &seq_end) || xclass != V_ASN1_UNIVERSAL ||
+	    tag != V_ASN1_SEQUENCE || !constructed || seq_end != tbs_end)
+		goto full;
+	if (!x509_lazy_check_extensions(p, seq_end))
+		goto full;
+
+	/* Build the certificate without extensions and decode that. */
+	if (tbs_end - tbs > INT_MAX || cert_end - tbs_end > INT_MAX)
+		goto full;
+	tbs_len = exts - tbs_content;
+	if ((outer_len = ASN1_object_size(1, tbs_len, V_ASN1_SEQUENCE)) < 0 ||
+	    outer_len > INT_MAX - (cert_end - tbs_end))
+		goto full;
+	outer_len += cert_end - tbs_end;
+	if ((der_len = ASN1_object_size(1, outer_len, V_ASN1_SEQUENCE)) < 0)
+		goto full;
+	if ((der = malloc(der_len)) == NULL)
+		goto merr;
+	q = der;
+	ASN1_put_object(&q, 1, outer_len, V_ASN1_SEQUENCE, V_ASN1_UNIVERSAL);
+	ASN1_put_object(&q, 1, tbs_len, V_ASN1_SEQUENCE, V_ASN1_UNIVERSAL);
+	memcpy(q, tbs_content, tbs_len);
+	q += tbs_len;
+	memcpy(q, tbs_end, cert_end - tbs_end);
+
+	p = der;
+	if ((x = d2i_X509(NULL, &p, der_len)) == NULL)
+		goto full;
+
+	/* Keep the original encoding, for the signature and the extensions. */
+	if ((enc = malloc(tbs_end - tbs)) == NULL)
+		goto merr;
+	memcpy(enc, tbs, tbs_end - tbs);
+	free(x->cert_info->enc.enc);
+	x->cert_info->enc.enc = enc;
+	x->cert_info->enc.len = tbs_end - tbs;
+	x->cert_info->enc.modified = 0;
+
+	if ((lazy = calloc(1, sizeof(*lazy))) == NULL)
+		goto merr;
+	if (pthread_mutex_init(&lazy->mutex, NULL) != 0) {
+		free(lazy);
+		goto merr;
+	}
+	lazy->offset = exts_content - tbs;
+	lazy->len = tbs_end - exts_content;
+	x->lazy = lazy;
+
+	ERR_pop_to_mark();
+
+	free(der);
+	*in = cert_end;
+	if (a != NULL) {
+		X509_free(*a);
+		*a = x;
+	}
+	return x;
+
+ full:
+	ERR_pop_to_mark();
+	X509_free(x);
+	free(der);
+	return d2i_X509(a, in, len);
+
+ merr:
+	ERR_pop_to_mark();
+	ASN1error(ERR_R_MALLOC_FAILURE);
+	X509_free(x);
+	free(der);
+	return NULL;
+}
+
 int
 i2d_X509(X509 *a, unsigned char **out)
 {
@@ -56,6 +56,8 @@
  * [including the GNU Public Licence.]
  */
 
+#include <sys/uio.h>
+
 #include <errno.h>
 #include <stdio.h>
 #include <string.h>
@@ -73,6 +75,17 @@ static int buffer_free(BIO *data);
 static long buffer_callback_ctrl(BIO *h, int cmd, bio_info_cb *fp);
 #define DEFAULT_BUFFER_SIZE	4096
 
+/*
+ * Unless the application sets its size, a buffer is doubled while it is
+ * smaller than the reads or writes passing through it, up to these sizes.
+ * Writes that do not fit in the output buffer are not copied: they pass
+ * straight through, gathered with any buffered data in a single writev()
+ * when the next BIO is a socket or file descriptor. A full size TLS
+ * record is therefore never copied on its way out.
+ */
+#define MAX_IBUF_SIZE		(64 * 1024)
+#define MAX_OBUF_SIZE		(16 * 1024)
+
 static const BIO_METHOD methods_buffer = {
 	.type = BIO_TYPE_BUFFER,
 	.name = "buffer",
@@ -117,6 +130,8 @@ buffer_new(BIO *bi)
 	ctx->ibuf_off = 0;
 	ctx->obuf_len = 0;
 	ctx->obuf_off = 0;
+	ctx->ibuf_fixed = 0;
+	ctx->obuf_fixed = 0;
 
 	bi->init = 1;
 	bi->ptr = (char *)ctx;
@@ -141,6 +156,54 @@ buffer_free(BIO *a)
 	return (1);
 }
 
+/*
+ * Replace an empty buffer with one that holds at least want bytes, doubling
+ * its size up to max. On failure the old buffer is kept.
+ */
+static void
+buffer_grow(char **buf, int *size, int want, int max)
+{
+	char *p;
+	int n;
+
+	for (n = *size; n < want && n < max; n *= 2)
+		;
+	if (n > max)
+		n = max;
+	if (n <= *size)
+		return;
+
+	if ((p = malloc(n)) == NULL)
+		return;
+	free(*buf);
+	*buf = p;
+	*size = n;
+}
+
+/*
+ * Write the buffered data followed by in, with a single writev() on the
+ * next BIO. Filters may pass unknown controls on down their chain, so this
+ * is only done when the next BIO is the descriptor itself. Return the
+ * number of bytes written, 0 if the next BIO cannot gather writes, or -1.
+ */
+static long
+buffer_writev(BIO *b, BIO_F_BUFFER_CTX *ctx, const char *in, int inl)
+{
+	struct iovec iov[2];
+	int type;
+
+	type = BIO_method_type(b->next_bio);
+	if (type != BIO_TYPE_SOCKET && type != BIO_TYPE_FD)
+		return 0;
+
+	iov[0].iov_base = &ctx->obuf[ctx->obuf_off];
+	iov[0].iov_len = ctx->obuf_len;
+	iov[1].iov_base = (char *)in;
+	iov[1].iov_len = inl;
+
+	return BIO_ctrl(b->next_bio, BIO_CTRL_WRITEV, 2, iov);
+}
+
 static int
 buffer_read(BIO *b, char *out, int outl)
 {
@@ -172,6 +235,10 @@ start:
 		out += i;
 	}
 
+	/* Make room for reads of this size, if we may. */
+	if (!ctx->ibuf_fixed && outl > ctx->ibuf_size)
+		buffer_grow(&ctx->ibuf, &ctx->ibuf_size, outl, MAX_IBUF_SIZE);
+
 	/* We may have done a partial read. try to do more.
 	 * We have nothing in the buffer.
 	 * If we get an error and have read some data, just return it
@@ -216,6 +283,7 @@ static int
 buffer_write(BIO *b, const char *in, int inl)
 {
 	int i, num = 0;
+	long w;
 	BIO_F_BUFFER_CTX *ctx;
 
 	if ((in == NULL) || (inl <= 0))
@@ -225,6 +293,14 @@ buffer_write(BIO *b, const char *in, int inl)
 		return (0);
 
 	BIO_clear_retry_flags(b);
+
+	/* Make room for writes of this size, if we may. */
+	if (!ctx->obuf_fixed && ctx->obuf_len == 0 && inl > ctx->obuf_size &&
+	    inl <= MAX_OBUF_SIZE) {
+		buffer_grow(&ctx->obuf, &ctx->obuf_size, inl, MAX_OBUF_SIZE);
+		ctx->obuf_off = 0;
+	}
+
 start:
 	i = ctx->obuf_size - (ctx->obuf_len + ctx->obuf_off);
 	/* add to buffer and return */
@@ -234,7 +310,30 @@ start:
 		return (num + inl);
 	}
 	/* else */
-	/* stuff already in buffer, so add to it first, then flush */
+	/* stuff already in buffer, send it along with the new data */
+	while (ctx->obuf_len != 0) {
+		if ((w = buffer_writev(b, ctx, in, inl)) == 0)
+			break;
+		if (w < 0) {
+			BIO_copy_next_retry(b);
+			return ((num > 0) ? num : (int)w);
+		}
+		if (w < ctx->obuf_len) {
+			ctx->obuf_off += w;
+			ctx->obuf_len -= w;
+			continue;
+		}
+		w -= ctx->obuf_len;
+		ctx->obuf_off = 0;
+		ctx->obuf_len = 0;
+		num += w;
+		in += w;
+		inl -= w;
+		if (inl == 0)
+			return (num);
+		goto start;
+	}
+	/* no gathered writes, so add to the buffer first, then flush */
 	if (ctx->obuf_len != 0) {
 		if (i > 0) /* lets fill it up if we can */
 		{
@@ -381,6 +480,10 @@ buffer_ctrl(BIO *b, int cmd, long num, void *ptr)
 				goto malloc_error;
 			}
 		}
+		if (ptr == NULL || *ip == 0)
+			ctx->ibuf_fixed = 1;
+		if (ptr == NULL || *ip != 0)
+			ctx->obuf_fixed = 1;
 		if (ctx->ibuf != p1) {
 			free(ctx->ibuf);
 			ctx->ibuf = p1;
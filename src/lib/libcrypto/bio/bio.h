@@ -98,6 +98,7 @@ extern "C" {
 #define BIO_TYPE_DGRAM		(21|0x0400|0x0100)
 #define BIO_TYPE_ASN1 		(22|0x0200)		/* filter */
 #define BIO_TYPE_COMP 		(23|0x0200)		/* filter */
+#define BIO_TYPE_MEM_SEG	(24|0x0400)
 
 #define BIO_TYPE_DESCRIPTOR	0x0100	/* socket, fd, connect or accept */
 #define BIO_TYPE_FILTER		0x0200
@@ -171,6 +172,21 @@ extern "C" {
 #define BIO_CTRL_DGRAM_SET_NEXT_TIMEOUT   45 /* Next DTLS handshake timeout to
                                               * adjust socket timeouts */
 
+#define BIO_CTRL_DGRAM_SET_BATCH	96  /* queue datagrams, see below */
+#define BIO_CTRL_DGRAM_GET_BATCH	97
+#define BIO_CTRL_DGRAM_SET_PACK		98  /* pack writes up to the MTU */
+#define BIO_CTRL_DGRAM_GET_PACK		99
+
+#define BIO_CTRL_SET_KTLS		72  /* socket BIO - hand keys to kernel */
+#define BIO_CTRL_GET_KTLS_SEND		73  /* kernel protects sent records */
+#define BIO_CTRL_GET_KTLS_RECV		76  /* kernel opens received records */
+
+#define BIO_CTRL_WRITEV			100 /* socket/fd BIO - gathered write */
+
+#define BIO_CTRL_SET_ZEROCOPY		101 /* socket BIO - send with MSG_ZEROCOPY */
+#define BIO_CTRL_GET_ZEROCOPY_SENT	102 /* zero-copy sends issued */
+#define BIO_CTRL_GET_ZEROCOPY_DONE	103 /* zero-copy sends completed */
+
 
 /* modifiers */
 #define BIO_FP_READ		0x02
@@ -205,6 +221,10 @@ extern "C" {
  */
 #define BIO_FLAGS_MEM_RDONLY	0x200
 
+/* Records are protected by the kernel, see BIO_CTRL_SET_KTLS. */
+#define BIO_FLAGS_KTLS_TX	0x800
+#define BIO_FLAGS_KTLS_RX	0x2000
+
 typedef struct bio_st BIO;
 
 void BIO_set_flags(BIO *b, int flags);
@@ -329,6 +349,9 @@ typedef struct bio_f_buffer_ctx_struct {
 	char *obuf;	/* the char array */
 	int obuf_len;	/* how many bytes are in it */
 	int obuf_off;	/* write/read offset */
+
+	int ibuf_fixed;	/* input buffer size set by the application */
+	int obuf_fixed;	/* output buffer size set by the application */
 } BIO_F_BUFFER_CTX;
 
 /* Prefix and suffix callback in ASN1 BIO */
@@ -426,6 +449,8 @@ int BIO_meth_set_callback_ctrl(BIO_METHOD *biom,
 #define BIO_C_SET_EX_ARG			153
 #define BIO_C_GET_EX_ARG			154
 
+#define BIO_C_SET_CONN_FASTOPEN			155
+
 #define BIO_set_app_data(s,arg)		BIO_set_ex_data(s,0,arg)
 #define BIO_get_app_data(s)		BIO_get_ex_data(s,0)
 
@@ -438,6 +463,7 @@ int BIO_meth_set_callback_ctrl(BIO_METHOD *biom,
 #define BIO_get_conn_port(b)      BIO_ptr_ctrl(b,BIO_C_GET_CONNECT,1)
 #define BIO_get_conn_ip(b) 		 BIO_ptr_ctrl(b,BIO_C_GET_CONNECT,2)
 #define BIO_get_conn_int_port(b) BIO_int_ctrl(b,BIO_C_GET_CONNECT,3,0)
+#define BIO_set_conn_fastopen(b,n) BIO_ctrl(b,BIO_C_SET_CONN_FASTOPEN,(n),NULL)
 
 
 #define BIO_set_nbio(b,n)	BIO_ctrl(b,BIO_C_SET_NBIO,(n),NULL)
@@ -477,6 +503,14 @@ int BIO_meth_set_callback_ctrl(BIO_METHOD *biom,
 #define BIO_set_fd(b,fd,c)	BIO_int_ctrl(b,BIO_C_SET_FD,c,fd)
 #define BIO_get_fd(b,c)		BIO_ctrl(b,BIO_C_GET_FD,0,(char *)c)
 
+#define BIO_set_ktls(b,info,tx)	BIO_ctrl(b,BIO_CTRL_SET_KTLS,tx,(char *)(info))
+#define BIO_get_ktls_send(b)	(int)BIO_ctrl(b,BIO_CTRL_GET_KTLS_SEND,0,NULL)
+#define BIO_get_ktls_recv(b)	(int)BIO_ctrl(b,BIO_CTRL_GET_KTLS_RECV,0,NULL)
+
+#define BIO_set_zerocopy(b,min)	BIO_ctrl(b,BIO_CTRL_SET_ZEROCOPY,min,NULL)
+#define BIO_get_zerocopy_sent(b) BIO_ctrl(b,BIO_CTRL_GET_ZEROCOPY_SENT,0,NULL)
+#define BIO_get_zerocopy_done(b) BIO_ctrl(b,BIO_CTRL_GET_ZEROCOPY_DONE,0,NULL)
+
 #define BIO_set_fp(b,fp,c)	BIO_ctrl(b,BIO_C_SET_FILE_PTR,c,(char *)fp)
 #define BIO_get_fp(b,fpp)	BIO_ctrl(b,BIO_C_GET_FILE_PTR,0,(char *)fpp)
 
@@ -571,6 +605,21 @@ int BIO_ctrl_reset_read_request(BIO *b);
 #define BIO_dgram_set_peer(b,peer) \
          (int)BIO_ctrl(b, BIO_CTRL_DGRAM_SET_PEER, 0, (char *)peer)
 
+/*
+ * Receive and send up to n datagrams per system call.  Reads return one
+ * datagram each, writes are queued until BIO_flush() or until the queue is
+ * full.  With packing, writes that fit in the MTU are sent as one datagram,
+ * which suits DTLS records.
+ */
+#define BIO_dgram_set_batch(b,n) \
+         (int)BIO_ctrl(b, BIO_CTRL_DGRAM_SET_BATCH, n, NULL)
+#define BIO_dgram_get_batch(b) \
+         (int)BIO_ctrl(b, BIO_CTRL_DGRAM_GET_BATCH, 0, NULL)
+#define BIO_dgram_set_pack(b,on) \
+         (int)BIO_ctrl(b, BIO_CTRL_DGRAM_SET_PACK, on, NULL)
+#define BIO_dgram_get_pack(b) \
+         (int)BIO_ctrl(b, BIO_CTRL_DGRAM_GET_PACK, 0, NULL)
+
 /* These two aren't currently implemented */
 /* int BIO_get_ex_num(BIO *bio); */
 /* void BIO_set_ex_free_func(BIO *bio,int idx,void (*cb)()); */
@@ -643,6 +692,12 @@ long BIO_debug_callback(BIO *bio, int cmd, const char *argp, int argi,
 
 const BIO_METHOD *BIO_s_mem(void);
 BIO *BIO_new_mem_buf(const void *buf, int len);
+const BIO_METHOD *BIO_s_mem_seg(void);
+struct iovec;
+int BIO_mem_seg_append(BIO *b, void *data, size_t len,
+    void (*free_cb)(void *data, size_t len, void *arg), void *arg);
+int BIO_mem_seg_peek(BIO *b, struct iovec *iov, int iovcnt);
+int BIO_mem_seg_consume(BIO *b, size_t len);
 const BIO_METHOD *BIO_s_socket(void);
 const BIO_METHOD *BIO_s_connect(void);
 const BIO_METHOD *BIO_s_accept(void);
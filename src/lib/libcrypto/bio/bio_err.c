@@ -65,18 +65,20 @@
 #include <openssl/err.h>
 #include <openssl/bio.h>
 
+#include "cryptlib.h"
+
 /* BEGIN ERROR CODES */
 #ifndef OPENSSL_NO_ERR
 
 #define ERR_FUNC(func) ERR_PACK(ERR_LIB_BIO,func,0)
 #define ERR_REASON(reason) ERR_PACK(ERR_LIB_BIO,0,reason)
 
-static ERR_STRING_DATA BIO_str_functs[] = {
+static const ERR_STRING_DATA BIO_str_functs[] = {
 	{ERR_FUNC(0xfff), "CRYPTO_internal"},
 	{0, NULL}
 };
 
-static ERR_STRING_DATA BIO_str_reasons[] = {
+static const ERR_STRING_DATA BIO_str_reasons[] = {
 	{ERR_REASON(BIO_R_ACCEPT_ERROR)          , "accept error"},
 	{ERR_REASON(BIO_R_BAD_FOPEN_MODE)        , "bad fopen mode"},
 	{ERR_REASON(BIO_R_BAD_HOSTNAME_LOOKUP)   , "bad hostname lookup"},
@@ -117,8 +119,8 @@ ERR_load_BIO_strings(void)
 {
 #ifndef OPENSSL_NO_ERR
 	if (ERR_func_error_string(BIO_str_functs[0].error) == NULL) {
-		ERR_load_strings(0, BIO_str_functs);
-		ERR_load_strings(0, BIO_str_reasons);
+		ERR_load_const_strings(BIO_str_functs);
+		ERR_load_const_strings(BIO_str_reasons);
 	}
 #endif
 }
@@ -111,6 +111,22 @@ BIO_s_bio(void)
 	return &methods_biop;
 }
 
+/*
+ * Each BIO of a pair writes to its own ring buffer, which is read through
+ * the peer. The two BIOs of a pair may be used by two different threads:
+ * each ring then has a single producer and a single consumer and needs no
+ * lock. Only the writer advances tail and only the reader advances head,
+ * each with a release store once it is done with the bytes, and each side
+ * loads the index of the other side with an acquire load. The indices are
+ * kept modulo 2 * size, so that a full ring can be told from an empty one,
+ * and on cache lines of their own, so that the two threads do not keep
+ * taking the line away from each other.
+ *
+ * Making, destroying and resetting a pair, and changing the buffer size,
+ * must not race with I/O on either BIO.
+ */
+#define BIO_PAIR_CACHE_LINE	64
+
 struct bio_bio_st {
 	BIO *peer;	/* NULL if buf == NULL.
 			 * If peer != NULL, then peer->ptr is also a bio_bio_st,
@@ -119,8 +135,6 @@ struct bio_bio_st {
 
 	/* This is for what we write (i.e. reading uses peer's struct): */
 	int closed;	/* valid iff peer != NULL */
-	size_t len;	/* valid iff buf != NULL; 0 if peer == NULL */
-	size_t offset;	/* valid iff buf != NULL; 0 if len == 0 */
 	size_t size;
 	char *buf;      /* "size" elements (if != NULL) */
 
@@ -128,14 +142,58 @@ struct bio_bio_st {
 			 * otherwise set by peer to number of bytes
 			 * it (unsuccessfully) tried to read,
 	                 * never more than buffer space (size-len) warrants. */
+
+	char pad0[BIO_PAIR_CACHE_LINE];
+	size_t head;	/* Advanced by the reader. */
+	char pad1[BIO_PAIR_CACHE_LINE - sizeof(size_t)];
+	size_t tail;	/* Advanced by the writer. */
+	char pad2[BIO_PAIR_CACHE_LINE - sizeof(size_t)];
 };
 
+static size_t
+bio_ring_offset(const struct bio_bio_st *b, size_t idx)
+{
+	return idx < b->size ? idx : idx - b->size;
+}
+
+static size_t
+bio_ring_advance(const struct bio_bio_st *b, size_t idx, size_t num)
+{
+	idx += num;
+	if (idx >= 2 * b->size)
+		idx -= 2 * b->size;
+	return idx;
+}
+
+static size_t
+bio_ring_len(const struct bio_bio_st *b, size_t head, size_t tail)
+{
+	return tail >= head ? tail - head : tail + 2 * b->size - head;
+}
+
+/* Number of bytes in the ring, as seen by a third party. */
+static size_t
+bio_ring_pending(const struct bio_bio_st *b)
+{
+	size_t head, tail;
+
+	head = __atomic_load_n(&b->head, __ATOMIC_ACQUIRE);
+	tail = __atomic_load_n(&b->tail, __ATOMIC_ACQUIRE);
+	return bio_ring_len(b, head, tail);
+}
+
+static void
+bio_set_request(struct bio_bio_st *b, size_t request)
+{
+	__atomic_store_n(&b->request, request, __ATOMIC_RELAXED);
+}
+
 static int
 bio_new(BIO *bio)
 {
 	struct bio_bio_st *b;
 
-	b = malloc(sizeof *b);
+	b = calloc(1, sizeof *b);
 	if (b == NULL)
 		return 0;
 
@@ -172,8 +230,9 @@ static int
 bio_read(BIO *bio, char *buf, int size_)
 {
 	size_t size = size_;
-	size_t rest;
+	size_t rest, len, head, tail;
 	struct bio_bio_st *b, *peer_b;
+	int closed;
 
 	BIO_clear_retry_flags(bio);
 
@@ -187,29 +246,35 @@ bio_read(BIO *bio, char *buf, int size_)
 	assert(peer_b != NULL);
 	assert(peer_b->buf != NULL);
 
-	peer_b->request = 0; /* will be set in "retry_read" situation */
+	bio_set_request(peer_b, 0); /* will be set in "retry_read" situation */
 
 	if (buf == NULL || size == 0)
 		return 0;
 
-	if (peer_b->len == 0) {
-		if (peer_b->closed)
+	/* Look at closed first: the writer sets it after its last write. */
+	closed = __atomic_load_n(&peer_b->closed, __ATOMIC_ACQUIRE);
+	head = peer_b->head;
+	tail = __atomic_load_n(&peer_b->tail, __ATOMIC_ACQUIRE);
+	len = bio_ring_len(peer_b, head, tail);
+
+	if (len == 0) {
+		if (closed)
 			return 0; /* writer has closed, and no data is left */
 		else {
 			BIO_set_retry_read(bio); /* buffer is empty */
 			if (size <= peer_b->size)
-				peer_b->request = size;
+				bio_set_request(peer_b, size);
 			else
 				/* don't ask for more than the peer can
 				 * deliver in one write */
-				peer_b->request = peer_b->size;
+				bio_set_request(peer_b, peer_b->size);
 			return -1;
 		}
 	}
 
 	/* we can read */
-	if (peer_b->len < size)
-		size = peer_b->len;
+	if (len < size)
+		size = len;
 
 	/* now read "size" bytes */
 
@@ -218,33 +283,25 @@ bio_read(BIO *bio, char *buf, int size_)
 	assert(rest > 0);
 	do /* one or two iterations */
 	{
-		size_t chunk;
+		size_t offset, chunk;
 
-		assert(rest <= peer_b->len);
-		if (peer_b->offset + rest <= peer_b->size)
+		offset = bio_ring_offset(peer_b, head);
+		if (offset + rest <= peer_b->size)
 			chunk = rest;
 		else
 			/* wrap around ring buffer */
-			chunk = peer_b->size - peer_b->offset;
-		assert(peer_b->offset + chunk <= peer_b->size);
-
-		memcpy(buf, peer_b->buf + peer_b->offset, chunk);
-
-		peer_b->len -= chunk;
-		if (peer_b->len) {
-			peer_b->offset += chunk;
-			assert(peer_b->offset <= peer_b->size);
-			if (peer_b->offset == peer_b->size)
-				peer_b->offset = 0;
-			buf += chunk;
-		} else {
-			/* buffer now empty, no need to advance "buf" */
-			assert(chunk == rest);
-			peer_b->offset = 0;
-		}
+			chunk = peer_b->size - offset;
+		assert(offset + chunk <= peer_b->size);
+
+		memcpy(buf, peer_b->buf + offset, chunk);
+
+		head = bio_ring_advance(peer_b, head, chunk);
+		buf += chunk;
 		rest -= chunk;
 	} while (rest);
 
+	__atomic_store_n(&peer_b->head, head, __ATOMIC_RELEASE);
+
 	return size;
 }
 
@@ -254,12 +311,11 @@ bio_read(BIO *bio, char *buf, int size_)
  * (example usage:  bio_nread0(), read from buffer, bio_nread()
  *  or just         bio_nread(), read from buffer)
  */
-/* WARNING: The non-copying interface is largely untested as of yet
- * and may contain bugs. */
 static ssize_t
 bio_nread0(BIO *bio, char **buf)
 {
 	struct bio_bio_st *b, *peer_b;
+	size_t head, tail, offset;
 	ssize_t num;
 
 	BIO_clear_retry_flags(bio);
@@ -274,23 +330,26 @@ bio_nread0(BIO *bio, char **buf)
 	assert(peer_b != NULL);
 	assert(peer_b->buf != NULL);
 
-	peer_b->request = 0;
+	bio_set_request(peer_b, 0);
 
-	if (peer_b->len == 0) {
+	head = peer_b->head;
+	tail = __atomic_load_n(&peer_b->tail, __ATOMIC_ACQUIRE);
+	if (head == tail) {
 		char dummy;
 
 		/* avoid code duplication -- nothing available for reading */
 		return bio_read(bio, &dummy, 1); /* returns 0 or -1 */
 	}
 
-	num = peer_b->len;
-	if (peer_b->size < peer_b->offset + num)
+	num = bio_ring_len(peer_b, head, tail);
+	offset = bio_ring_offset(peer_b, head);
+	if (peer_b->size < offset + num)
 		/* no ring buffer wrap-around for non-copying interface */
-		num = peer_b->size - peer_b->offset;
+		num = peer_b->size - offset;
 	assert(num > 0);
 
 	if (buf != NULL)
-		*buf = peer_b->buf + peer_b->offset;
+		*buf = peer_b->buf + offset;
 	return num;
 }
 
@@ -314,14 +373,8 @@ bio_nread(BIO *bio, char **buf, size_t num_)
 	b = bio->ptr;
 	peer_b = b->peer->ptr;
 
-	peer_b->len -= num;
-	if (peer_b->len) {
-		peer_b->offset += num;
-		assert(peer_b->offset <= peer_b->size);
-		if (peer_b->offset == peer_b->size)
-			peer_b->offset = 0;
-	} else
-		peer_b->offset = 0;
+	__atomic_store_n(&peer_b->head,
+	    bio_ring_advance(peer_b, peer_b->head, num), __ATOMIC_RELEASE);
 
 	return num;
 }
@@ -331,7 +384,7 @@ static int
 bio_write(BIO *bio, const char *buf, int num_)
 {
 	size_t num = num_;
-	size_t rest;
+	size_t rest, len, head, tail;
 	struct bio_bio_st *b;
 
 	BIO_clear_retry_flags(bio);
@@ -345,23 +398,27 @@ bio_write(BIO *bio, const char *buf, int num_)
 	assert(b->peer != NULL);
 	assert(b->buf != NULL);
 
-	b->request = 0;
+	bio_set_request(b, 0);
 	if (b->closed) {
 		/* we already closed */
 		BIOerror(BIO_R_BROKEN_PIPE);
 		return -1;
 	}
 
-	assert(b->len <= b->size);
+	head = __atomic_load_n(&b->head, __ATOMIC_ACQUIRE);
+	tail = b->tail;
+	len = bio_ring_len(b, head, tail);
 
-	if (b->len == b->size) {
+	assert(len <= b->size);
+
+	if (len == b->size) {
 		BIO_set_retry_write(bio); /* buffer is full */
 		return -1;
 	}
 
 	/* we can write */
-	if (num > b->size - b->len)
-		num = b->size - b->len;
+	if (num > b->size - len)
+		num = b->size - len;
 
 	/* now write "num" bytes */
 
@@ -373,11 +430,7 @@ bio_write(BIO *bio, const char *buf, int num_)
 		size_t write_offset;
 		size_t chunk;
 
-		assert(b->len + rest <= b->size);
-
-		write_offset = b->offset + b->len;
-		if (write_offset >= b->size)
-			write_offset -= b->size;
+		write_offset = bio_ring_offset(b, tail);
 		/* b->buf[write_offset] is the first byte we can write to. */
 
 		if (write_offset + rest <= b->size)
@@ -388,14 +441,13 @@ bio_write(BIO *bio, const char *buf, int num_)
 
 		memcpy(b->buf + write_offset, buf, chunk);
 
-		b->len += chunk;
-
-		assert(b->len <= b->size);
-
+		tail = bio_ring_advance(b, tail, chunk);
 		rest -= chunk;
 		buf += chunk;
 	} while (rest);
 
+	__atomic_store_n(&b->tail, tail, __ATOMIC_RELEASE);
+
 	return num;
 }
 
@@ -409,7 +461,7 @@ static ssize_t
 bio_nwrite0(BIO *bio, char **buf)
 {
 	struct bio_bio_st *b;
-	size_t num;
+	size_t num, len, head;
 	size_t write_offset;
 
 	BIO_clear_retry_flags(bio);
@@ -423,23 +475,24 @@ bio_nwrite0(BIO *bio, char **buf)
 	assert(b->peer != NULL);
 	assert(b->buf != NULL);
 
-	b->request = 0;
+	bio_set_request(b, 0);
 	if (b->closed) {
 		BIOerror(BIO_R_BROKEN_PIPE);
 		return -1;
 	}
 
-	assert(b->len <= b->size);
+	head = __atomic_load_n(&b->head, __ATOMIC_ACQUIRE);
+	len = bio_ring_len(b, head, b->tail);
+
+	assert(len <= b->size);
 
-	if (b->len == b->size) {
+	if (len == b->size) {
 		BIO_set_retry_write(bio);
 		return -1;
 	}
 
-	num = b->size - b->len;
-	write_offset = b->offset + b->len;
-	if (write_offset >= b->size)
-		write_offset -= b->size;
+	num = b->size - len;
+	write_offset = bio_ring_offset(b, b->tail);
 	if (write_offset + num > b->size)
 		/* no ring buffer wrap-around for non-copying interface
 		 * (to fulfil the promise by BIO_ctrl_get_write_guarantee,
@@ -471,8 +524,8 @@ bio_nwrite(BIO *bio, char **buf, size_t num_)
 		return num;
 	b = bio->ptr;
 	assert(b != NULL);
-	b->len += num;
-	assert(b->len <= b->size);
+	__atomic_store_n(&b->tail, bio_ring_advance(b, b->tail, num),
+	    __ATOMIC_RELEASE);
 
 	return num;
 }
@@ -493,7 +546,7 @@ bio_ctrl(BIO *bio, int cmd, long num, void *ptr)
 		if (b->peer) {
 			BIOerror(BIO_R_IN_USE);
 			ret = 0;
-		} else if (num == 0) {
+		} else if (num <= 0 || (unsigned long)num > SIZE_MAX / 2) {
 			BIOerror(BIO_R_INVALID_ARGUMENT);
 			ret = 0;
 		} else {
@@ -536,14 +589,14 @@ bio_ctrl(BIO *bio, int cmd, long num, void *ptr)
 		if (b->peer == NULL || b->closed)
 			ret = 0;
 		else
-			ret = (long) b->size - b->len;
+			ret = (long) (b->size - bio_ring_pending(b));
 		break;
 
 	case BIO_C_GET_READ_REQUEST:
 		/* If the peer unsuccessfully tried to read, how many bytes
 		 * were requested?  (As with BIO_CTRL_PENDING, that number
 		 * can usually be treated as boolean.) */
-		ret = (long) b->request;
+		ret = (long) __atomic_load_n(&b->request, __ATOMIC_RELAXED);
 		break;
 
 	case BIO_C_RESET_READ_REQUEST:
@@ -551,13 +604,13 @@ bio_ctrl(BIO *bio, int cmd, long num, void *ptr)
 		 * at the other side that are meant to be non-blocking,
 		 * e.g. when probing SSL_read to see if any data is
 		 * available.) */
-		b->request = 0;
+		bio_set_request(b, 0);
 		ret = 1;
 		break;
 
 	case BIO_C_SHUTDOWN_WR:
 		/* similar to shutdown(..., SHUT_WR) */
-		b->closed = 1;
+		__atomic_store_n(&b->closed, 1, __ATOMIC_RELEASE);
 		ret = 1;
 		break;
 
@@ -586,8 +639,8 @@ bio_ctrl(BIO *bio, int cmd, long num, void *ptr)
 
 	case BIO_CTRL_RESET:
 		if (b->buf != NULL) {
-			b->len = 0;
-			b->offset = 0;
+			b->head = 0;
+			b->tail = 0;
 		}
 		ret = 0;
 		break;
@@ -606,14 +659,14 @@ bio_ctrl(BIO *bio, int cmd, long num, void *ptr)
 		if (b->peer != NULL) {
 			struct bio_bio_st *peer_b = b->peer->ptr;
 
-			ret = (long) peer_b->len;
+			ret = (long) bio_ring_pending(peer_b);
 		} else
 			ret = 0;
 		break;
 
 	case BIO_CTRL_WPENDING:
 		if (b->buf != NULL)
-			ret = (long) b->len;
+			ret = (long) bio_ring_pending(b);
 		else
 			ret = 0;
 		break;
@@ -648,7 +701,9 @@ bio_ctrl(BIO *bio, int cmd, long num, void *ptr)
 				struct bio_bio_st *other_b = other_bio->ptr;
 
 				assert(other_b != NULL);
-				ret = other_b->len == 0 && other_b->closed;
+				ret = __atomic_load_n(&other_b->closed,
+				    __ATOMIC_ACQUIRE) &&
+				    bio_ring_pending(other_b) == 0;
 			} else
 				ret = 1;
 		}
@@ -689,8 +744,8 @@ bio_make_pair(BIO *bio1, BIO *bio2)
 			BIOerror(ERR_R_MALLOC_FAILURE);
 			return 0;
 		}
-		b1->len = 0;
-		b1->offset = 0;
+		b1->head = 0;
+		b1->tail = 0;
 	}
 
 	if (b2->buf == NULL) {
@@ -699,8 +754,8 @@ bio_make_pair(BIO *bio1, BIO *bio2)
 			BIOerror(ERR_R_MALLOC_FAILURE);
 			return 0;
 		}
-		b2->len = 0;
-		b2->offset = 0;
+		b2->head = 0;
+		b2->tail = 0;
 	}
 
 	b1->peer = bio2;
@@ -733,14 +788,14 @@ bio_destroy_pair(BIO *bio)
 			peer_b->peer = NULL;
 			peer_bio->init = 0;
 			assert(peer_b->buf != NULL);
-			peer_b->len = 0;
-			peer_b->offset = 0;
+			peer_b->head = 0;
+			peer_b->tail = 0;
 
 			b->peer = NULL;
 			bio->init = 0;
 			assert(b->buf != NULL);
-			b->len = 0;
-			b->offset = 0;
+			b->head = 0;
+			b->tail = 0;
 		}
 	}
 }
@@ -59,6 +59,7 @@
 #include <sys/socket.h>
 
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 
 #include <errno.h>
 #include <netdb.h>
@@ -78,6 +79,7 @@ typedef struct bio_connect_st {
 	char *param_hostname;
 	char *param_port;
 	int nbio;
+	int fastopen;
 
 	unsigned char ip[4];
 	unsigned short port;
@@ -226,6 +228,24 @@ conn_state(BIO *b, BIO_CONNECT *c)
 				BIOerror(BIO_R_KEEPALIVE);
 				goto exit_loop;
 			}
+#endif
+#if defined(TCP_FASTOPEN_CONNECT)
+			/*
+			 * connect() now returns at once and the first write,
+			 * typically the ClientHello, is sent in the SYN when
+			 * the kernel holds a cookie for this server.
+			 */
+			if (c->fastopen) {
+				i = 1;
+				if (setsockopt(b->num, IPPROTO_TCP,
+				    TCP_FASTOPEN_CONNECT, &i, sizeof(i)) < 0) {
+					SYSerror(errno);
+					ERR_asprintf_error_data("host=%s:%s",
+					    c->param_hostname, c->param_port);
+					BIOerror(BIO_R_UNABLE_TO_CREATE_SOCKET);
+					goto exit_loop;
+				}
+			}
 #endif
 			break;
 
@@ -299,6 +319,7 @@ BIO_CONNECT_new(void)
 	ret->param_port = NULL;
 	ret->info_callback = NULL;
 	ret->nbio = 0;
+	ret->fastopen = 0;
 	ret->ip[0] = 0;
 	ret->ip[1] = 0;
 	ret->ip[2] = 0;
@@ -491,6 +512,13 @@ conn_ctrl(BIO *b, int cmd, long num, void *ptr)
 	case BIO_C_SET_NBIO:
 		data->nbio = (int)num;
 		break;
+	case BIO_C_SET_CONN_FASTOPEN:
+#if defined(TCP_FASTOPEN_CONNECT)
+		data->fastopen = (int)num;
+#else
+		ret = 0;
+#endif
+		break;
 	case BIO_C_GET_FD:
 		if (b->init) {
 			ip = (int *)ptr;
@@ -521,6 +549,8 @@ conn_ctrl(BIO *b, int cmd, long num, void *ptr)
 				BIO_set_conn_hostname(dbio,
 				    data->param_hostname);
 			BIO_set_nbio(dbio, data->nbio);
+			if (data->fastopen)
+				BIO_set_conn_fastopen(dbio, data->fastopen);
 			/* FIXME: the cast of the function seems unlikely to be a good idea */
 			(void)BIO_set_info_callback(dbio,
 			    (bio_info_cb *)data->info_callback);
@@ -59,18 +59,21 @@
 
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 
 #include <netinet/in.h>
 
 #include <errno.h>
 #include <netdb.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
 #include <openssl/opensslconf.h>
 
 #include <openssl/bio.h>
+#include <openssl/err.h>
 
 #ifndef OPENSSL_NO_DGRAM
 
@@ -98,19 +101,51 @@ static const BIO_METHOD methods_dgramp = {
 };
 
 
+/*
+ * With BIO_dgram_set_batch() datagrams are received with recvmmsg() and
+ * handed out one per read, and writes are queued until BIO_flush() or a full
+ * queue sends them with sendmmsg().  Both come with MSG_WAITFORONE, which
+ * Linux only declares for _GNU_SOURCE.
+ */
+#if defined(MSG_WAITFORONE) && (!defined(__linux__) || defined(_GNU_SOURCE))
+#define DGRAM_MMSG
+#endif
+
+#define DGRAM_BATCH_MAX	64
+
+union dgram_addr {
+	struct sockaddr sa;
+	struct sockaddr_in sa_in;
+	struct sockaddr_in6 sa_in6;
+};
+
+struct dgram_slot {
+	unsigned char *buf;
+	size_t size;
+	size_t len;
+	union dgram_addr peer;
+	socklen_t peer_len;
+};
+
 typedef struct bio_dgram_data_st {
-	union {
-		struct sockaddr sa;
-		struct sockaddr_in sa_in;
-		struct sockaddr_in6 sa_in6;
-	} peer;
+	union dgram_addr peer;
 	unsigned int connected;
 	unsigned int _errno;
 	unsigned int mtu;
 	struct timeval next_timeout;
 	struct timeval socket_timeout;
+
+	unsigned int batch;
+	int pack;
+	struct dgram_slot *rq;		/* Received, from rq_next to rq_count. */
+	unsigned int rq_next;
+	unsigned int rq_count;
+	struct dgram_slot *wq;		/* Queued, the last one is being packed. */
+	unsigned int wq_count;
 } bio_dgram_data;
 
+static void dgram_batch_free(bio_dgram_data *data);
+
 
 const BIO_METHOD *
 BIO_s_datagram(void)
@@ -157,6 +192,7 @@ dgram_free(BIO *a)
 		return 0;
 
 	data = (bio_dgram_data *)a->ptr;
+	dgram_batch_free(data);
 	free(data);
 
 	return (1);
@@ -245,6 +281,265 @@ dgram_reset_rcv_timeout(BIO *b)
 #endif
 }
 
+static socklen_t
+dgram_peer_len(bio_dgram_data *data)
+{
+	if (data->peer.sa.sa_family == AF_INET)
+		return sizeof(data->peer.sa_in);
+	if (data->peer.sa.sa_family == AF_INET6)
+		return sizeof(data->peer.sa_in6);
+	return sizeof(data->peer);
+}
+
+static void
+dgram_slots_free(struct dgram_slot *slots, unsigned int n)
+{
+	unsigned int i;
+
+	if (slots == NULL)
+		return;
+	for (i = 0; i < n; i++)
+		free(slots[i].buf);
+	free(slots);
+}
+
+static void
+dgram_batch_free(bio_dgram_data *data)
+{
+	dgram_slots_free(data->rq, data->batch);
+	dgram_slots_free(data->wq, data->batch);
+	data->rq = data->wq = NULL;
+	data->rq_next = data->rq_count = data->wq_count = 0;
+	data->batch = 0;
+}
+
+#ifdef DGRAM_MMSG
+static int
+dgram_slot_reserve(struct dgram_slot *slot, size_t size)
+{
+	unsigned char *buf;
+
+	if (slot->size >= size)
+		return 1;
+	if ((buf = realloc(slot->buf, size)) == NULL)
+		return 0;
+	slot->buf = buf;
+	slot->size = size;
+
+	return 1;
+}
+
+static int
+dgram_read_batch(BIO *b, char *out, int outl)
+{
+	bio_dgram_data *data = b->ptr;
+	struct mmsghdr msgs[DGRAM_BATCH_MAX];
+	struct iovec iov[DGRAM_BATCH_MAX];
+	struct dgram_slot *slot;
+	unsigned int i;
+	int ret;
+
+	BIO_clear_retry_flags(b);
+
+	if (outl < 0)
+		return -1;
+
+	if (data->rq_next == data->rq_count) {
+		data->rq_next = data->rq_count = 0;
+
+		memset(msgs, 0, sizeof(msgs));
+		for (i = 0; i < data->batch; i++) {
+			slot = &data->rq[i];
+			if (!dgram_slot_reserve(slot, outl > 0 ? outl : 1)) {
+				BIOerror(ERR_R_MALLOC_FAILURE);
+				return -1;
+			}
+			iov[i].iov_base = slot->buf;
+			iov[i].iov_len = outl;
+			memset(&slot->peer, 0, sizeof(slot->peer));
+			msgs[i].msg_hdr.msg_name = &slot->peer;
+			msgs[i].msg_hdr.msg_namelen = sizeof(slot->peer);
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		errno = 0;
+		dgram_adjust_rcv_timeout(b);
+		ret = recvmmsg(b->num, msgs, data->batch, MSG_WAITFORONE, NULL);
+		dgram_reset_rcv_timeout(b);
+		if (ret <= 0) {
+			if (BIO_dgram_should_retry(ret)) {
+				BIO_set_retry_read(b);
+				data->_errno = errno;
+			}
+			return ret;
+		}
+
+		for (i = 0; i < (unsigned int)ret; i++) {
+			data->rq[i].len = msgs[i].msg_len;
+			data->rq[i].peer_len = msgs[i].msg_hdr.msg_namelen;
+		}
+		data->rq_count = ret;
+	}
+
+	slot = &data->rq[data->rq_next++];
+	ret = slot->len > (size_t)outl ? outl : (int)slot->len;
+	memcpy(out, slot->buf, ret);
+
+	if (!data->connected)
+		BIO_ctrl(b, BIO_CTRL_DGRAM_SET_PEER, 0, &slot->peer);
+
+	return ret;
+}
+
+/*
+ * Send the queued datagrams.  Those that could not be sent are kept, in
+ * order, for the next flush.
+ */
+static int
+dgram_flush_batch(BIO *b)
+{
+	bio_dgram_data *data = b->ptr;
+	struct mmsghdr msgs[DGRAM_BATCH_MAX];
+	struct iovec iov[DGRAM_BATCH_MAX];
+	struct dgram_slot *slot, tmp;
+	unsigned int i, n, sent = 0;
+	int ret;
+
+	BIO_clear_retry_flags(b);
+
+	while (sent < data->wq_count) {
+		n = data->wq_count - sent;
+
+		memset(msgs, 0, sizeof(msgs));
+		for (i = 0; i < n; i++) {
+			slot = &data->wq[sent + i];
+			iov[i].iov_base = slot->buf;
+			iov[i].iov_len = slot->len;
+			if (!data->connected) {
+				msgs[i].msg_hdr.msg_name = &slot->peer;
+				msgs[i].msg_hdr.msg_namelen = slot->peer_len;
+			}
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		errno = 0;
+		if ((ret = sendmmsg(b->num, msgs, n, 0)) <= 0) {
+			if (BIO_dgram_should_retry(ret)) {
+				BIO_set_retry_write(b);
+				data->_errno = errno;
+			} else {
+				/* As with sendto(), a failed datagram is gone. */
+				sent++;
+			}
+			break;
+		}
+		sent += ret;
+	}
+
+	/* Move what is left to the front, keeping the buffers of the rest. */
+	n = data->wq_count - sent;
+	for (i = 0; sent > 0 && i < n; i++) {
+		tmp = data->wq[i];
+		data->wq[i] = data->wq[sent + i];
+		data->wq[sent + i] = tmp;
+	}
+	data->wq_count = n;
+
+	return n == 0 ? 1 : -1;
+}
+
+/*
+ * Queue a datagram.  When packing, a write that fits in the MTU along with
+ * the last queued datagram for the same peer is added to it.
+ */
+static int
+dgram_write_batch(BIO *b, const char *in, int inl)
+{
+	bio_dgram_data *data = b->ptr;
+	struct dgram_slot *slot;
+	size_t size;
+	int ret;
+
+	BIO_clear_retry_flags(b);
+
+	if (in == NULL || inl < 0) {
+		BIOerror(BIO_R_NULL_PARAMETER);
+		return -1;
+	}
+
+	if (data->pack && data->wq_count > 0) {
+		slot = &data->wq[data->wq_count - 1];
+		if (slot->len + inl <= data->mtu &&
+		    slot->len + inl <= slot->size && (data->connected ||
+		    (slot->peer_len == dgram_peer_len(data) &&
+		    memcmp(&slot->peer, &data->peer, slot->peer_len) == 0))) {
+			memcpy(slot->buf + slot->len, in, inl);
+			slot->len += inl;
+			return inl;
+		}
+	}
+
+	if (data->wq_count == data->batch) {
+		if ((ret = dgram_flush_batch(b)) <= 0)
+			return ret;
+	}
+
+	slot = &data->wq[data->wq_count];
+	size = inl;
+	if (data->pack && size < data->mtu)
+		size = data->mtu;
+	if (!dgram_slot_reserve(slot, size > 0 ? size : 1)) {
+		BIOerror(ERR_R_MALLOC_FAILURE);
+		return -1;
+	}
+	memcpy(slot->buf, in, inl);
+	slot->len = inl;
+	slot->peer_len = dgram_peer_len(data);
+	memcpy(&slot->peer, &data->peer, sizeof(slot->peer));
+	data->wq_count++;
+
+	return inl;
+}
+#endif
+
+static int
+dgram_set_batch(BIO *b, long num)
+{
+#ifndef DGRAM_MMSG
+	return num == 0;
+#else
+	bio_dgram_data *data = b->ptr;
+
+	if (num < 0 || num > DGRAM_BATCH_MAX)
+		return 0;
+	if ((unsigned int)num == data->batch)
+		return 1;
+
+	/* Datagrams that were received but not yet read would be lost. */
+	if (data->rq_next != data->rq_count)
+		return 0;
+	if (data->wq_count > 0 && dgram_flush_batch(b) <= 0)
+		return 0;
+
+	dgram_batch_free(data);
+	if (num == 0)
+		return 1;
+
+	if ((data->rq = calloc(num, sizeof(*data->rq))) == NULL ||
+	    (data->wq = calloc(num, sizeof(*data->wq))) == NULL) {
+		free(data->rq);
+		data->rq = NULL;
+		BIOerror(ERR_R_MALLOC_FAILURE);
+		return 0;
+	}
+	data->batch = num;
+
+	return 1;
+#endif
+}
+
 static int
 dgram_read(BIO *b, char *out, int outl)
 {
@@ -262,6 +557,11 @@ dgram_read(BIO *b, char *out, int outl)
 
 	sa.len = sizeof(sa.peer);
 
+#ifdef DGRAM_MMSG
+	if (data->batch > 0 && out != NULL)
+		return dgram_read_batch(b, out, outl);
+#endif
+
 	if (out != NULL) {
 		errno = 0;
 		memset(&sa.peer, 0, sizeof(sa.peer));
@@ -289,19 +589,19 @@ dgram_write(BIO *b, const char *in, int inl)
 {
 	int ret;
 	bio_dgram_data *data = (bio_dgram_data *)b->ptr;
+
+#ifdef DGRAM_MMSG
+	if (data->batch > 0)
+		return dgram_write_batch(b, in, inl);
+#endif
+
 	errno = 0;
 
 	if (data->connected)
 		ret = write(b->num, in, inl);
-	else {
-		int peerlen = sizeof(data->peer);
-
-		if (data->peer.sa.sa_family == AF_INET)
-			peerlen = sizeof(data->peer.sa_in);
-		else if (data->peer.sa.sa_family == AF_INET6)
-			peerlen = sizeof(data->peer.sa_in6);
-		ret = sendto(b->num, in, inl, 0, &data->peer.sa, peerlen);
-	}
+	else
+		ret = sendto(b->num, in, inl, 0, &data->peer.sa,
+		    dgram_peer_len(data));
 
 	BIO_clear_retry_flags(b);
 	if (ret <= 0) {
@@ -371,12 +671,41 @@ dgram_ctrl(BIO *b, int cmd, long num, void *ptr)
 		b->shutdown = (int)num;
 		break;
 	case BIO_CTRL_PENDING:
+		/* The length of the next datagram that has been received. */
+		ret = 0;
+		if (data->rq_next < data->rq_count)
+			ret = data->rq[data->rq_next].len;
+		break;
 	case BIO_CTRL_WPENDING:
+		/*
+		 * When packing, the length of the datagram that the next write
+		 * may be added to.  DTLS sizes its records to fit in the rest.
+		 */
 		ret = 0;
+		if (data->pack && data->wq_count > 0)
+			ret = data->wq[data->wq_count - 1].len;
 		break;
 	case BIO_CTRL_DUP:
+		ret = 1;
+		break;
 	case BIO_CTRL_FLUSH:
 		ret = 1;
+#ifdef DGRAM_MMSG
+		if (data->wq_count > 0)
+			ret = dgram_flush_batch(b);
+#endif
+		break;
+	case BIO_CTRL_DGRAM_SET_BATCH:
+		ret = dgram_set_batch(b, num);
+		break;
+	case BIO_CTRL_DGRAM_GET_BATCH:
+		ret = data->batch;
+		break;
+	case BIO_CTRL_DGRAM_SET_PACK:
+		data->pack = num != 0;
+		break;
+	case BIO_CTRL_DGRAM_GET_PACK:
+		ret = data->pack;
 		break;
 	case BIO_CTRL_DGRAM_CONNECT:
 		to = (struct sockaddr *)ptr;
@@ -56,6 +56,8 @@
  * [including the GNU Public Licence.]
  */
 
+#include <sys/uio.h>
+
 #include <errno.h>
 #include <stdio.h>
 #include <string.h>
@@ -204,6 +206,16 @@ fd_ctrl(BIO *b, int cmd, long num, void *ptr)
 	case BIO_CTRL_FLUSH:
 		ret = 1;
 		break;
+	case BIO_CTRL_WRITEV:
+		errno = 0;
+		ret = writev(b->num, ptr, (int)num);
+		BIO_clear_retry_flags(b);
+		if (ret <= 0) {
+			if (BIO_fd_should_retry((int)ret))
+				BIO_set_retry_write(b);
+		} else
+			b->num_write += ret;
+		break;
 	default:
 		ret = 0;
 		break;
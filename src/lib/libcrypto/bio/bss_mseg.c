@@ -0,0 +1,405 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * A memory BIO made of a list of segments.
+ *
+ * Data written with BIO_write() is copied into segments owned by the BIO,
+ * filling the last one before another is allocated. Buffers appended with
+ * BIO_mem_seg_append() are linked in as they are and handed back through
+ * their callback once they have been read. Reads take data from the first
+ * segment and free it once it is empty, so the data is never moved.
+ */
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/bio.h>
+#include <openssl/err.h>
+
+#define MEM_SEG_CHUNK	4096
+
+struct mem_seg {
+	struct mem_seg *next;
+	unsigned char *data;
+	size_t size;
+	size_t off;		/* First unread byte. */
+	size_t end;		/* End of the data. */
+	int owned;		/* data was allocated by the BIO. */
+	void (*free_cb)(void *, size_t, void *);
+	void *arg;
+};
+
+struct mem_seg_ctx {
+	struct mem_seg *head;
+	struct mem_seg *tail;
+	size_t length;
+};
+
+static int mseg_write(BIO *h, const char *buf, int num);
+static int mseg_read(BIO *h, char *buf, int size);
+static int mseg_puts(BIO *h, const char *str);
+static int mseg_gets(BIO *h, char *str, int size);
+static long mseg_ctrl(BIO *h, int cmd, long arg1, void *arg2);
+static int mseg_new(BIO *h);
+static int mseg_free(BIO *data);
+
+static const BIO_METHOD mem_seg_method = {
+	.type = BIO_TYPE_MEM_SEG,
+	.name = "segmented memory buffer",
+	.bwrite = mseg_write,
+	.bread = mseg_read,
+	.bputs = mseg_puts,
+	.bgets = mseg_gets,
+	.ctrl = mseg_ctrl,
+	.create = mseg_new,
+	.destroy = mseg_free
+};
+
+const BIO_METHOD *
+BIO_s_mem_seg(void)
+{
+	return (&mem_seg_method);
+}
+
+static void
+mseg_seg_free(struct mem_seg *seg)
+{
+	if (seg->owned)
+		freezero(seg->data, seg->size);
+	else if (seg->free_cb != NULL)
+		seg->free_cb(seg->data, seg->size, seg->arg);
+	free(seg);
+}
+
+static void
+mseg_append(struct mem_seg_ctx *ctx, struct mem_seg *seg)
+{
+	if (ctx->tail != NULL)
+		ctx->tail->next = seg;
+	else
+		ctx->head = seg;
+	ctx->tail = seg;
+	ctx->length += seg->end - seg->off;
+}
+
+/*
+ * Drop len bytes from the front, freeing the segments that become empty.
+ * If out is not NULL the bytes are copied there first.
+ */
+static void
+mseg_consume(struct mem_seg_ctx *ctx, unsigned char *out, size_t len)
+{
+	struct mem_seg *seg;
+	size_t n;
+
+	while (len > 0 && (seg = ctx->head) != NULL) {
+		n = seg->end - seg->off;
+		if (n > len)
+			n = len;
+		if (out != NULL) {
+			memcpy(out, seg->data + seg->off, n);
+			out += n;
+		}
+		seg->off += n;
+		ctx->length -= n;
+		len -= n;
+
+		if (seg->off < seg->end)
+			break;
+
+		/* Keep the last owned segment, so that writes can refill it. */
+		if (seg == ctx->tail && seg->owned) {
+			seg->off = seg->end = 0;
+			break;
+		}
+		if ((ctx->head = seg->next) == NULL)
+			ctx->tail = NULL;
+		mseg_seg_free(seg);
+	}
+}
+
+static void
+mseg_clear(struct mem_seg_ctx *ctx)
+{
+	struct mem_seg *seg;
+
+	while ((seg = ctx->head) != NULL) {
+		ctx->head = seg->next;
+		mseg_seg_free(seg);
+	}
+	ctx->tail = NULL;
+	ctx->length = 0;
+}
+
+static int
+mseg_new(BIO *bi)
+{
+	struct mem_seg_ctx *ctx;
+
+	if ((ctx = calloc(1, sizeof(*ctx))) == NULL)
+		return (0);
+	bi->shutdown = 1;
+	bi->init = 1;
+	bi->num = -1;
+	bi->ptr = ctx;
+	return (1);
+}
+
+static int
+mseg_free(BIO *a)
+{
+	if (a == NULL)
+		return (0);
+	if (a->ptr != NULL) {
+		mseg_clear(a->ptr);
+		free(a->ptr);
+		a->ptr = NULL;
+	}
+	return (1);
+}
+
+static int
+mseg_read(BIO *b, char *out, int outl)
+{
+	struct mem_seg_ctx *ctx = b->ptr;
+	int ret;
+
+	BIO_clear_retry_flags(b);
+	ret = (outl >= 0 && (size_t)outl > ctx->length) ?
+	    (int)ctx->length : outl;
+	if (out != NULL && ret > 0)
+		mseg_consume(ctx, out, ret);
+	else if (ctx->length == 0) {
+		ret = b->num;
+		if (ret != 0)
+			BIO_set_retry_read(b);
+	}
+	return (ret);
+}
+
+static int
+mseg_write(BIO *b, const char *in, int inl)
+{
+	struct mem_seg_ctx *ctx = b->ptr;
+	struct mem_seg *seg;
+	size_t len, n;
+
+	if (in == NULL || inl < 0) {
+		BIOerror(BIO_R_NULL_PARAMETER);
+		return (-1);
+	}
+
+	BIO_clear_retry_flags(b);
+
+	len = inl;
+	if ((seg = ctx->tail) != NULL && seg->owned && seg->end < seg->size) {
+		n = seg->size - seg->end;
+		if (n > len)
+			n = len;
+		memcpy(seg->data + seg->end, in, n);
+		seg->end += n;
+		ctx->length += n;
+		in += n;
+		len -= n;
+	}
+	if (len == 0)
+		return (inl);
+
+	if ((seg = calloc(1, sizeof(*seg))) == NULL)
+		goto err;
+	seg->size = len > MEM_SEG_CHUNK ? len : MEM_SEG_CHUNK;
+	if ((seg->data = malloc(seg->size)) == NULL) {
+		free(seg);
+		goto err;
+	}
+	seg->owned = 1;
+	memcpy(seg->data, in, len);
+	seg->end = len;
+	mseg_append(ctx, seg);
+
+	return (inl);
+
+ err:
+	BIOerror(ERR_R_MALLOC_FAILURE);
+	/* The part copied into the last segment stays written. */
+	if (len < (size_t)inl)
+		return (inl - len);
+	return (-1);
+}
+
+static long
+mseg_ctrl(BIO *b, int cmd, long num, void *ptr)
+{
+	struct mem_seg_ctx *ctx = b->ptr;
+	long ret = 1;
+
+	switch (cmd) {
+	case BIO_CTRL_RESET:
+		mseg_clear(ctx);
+		break;
+	case BIO_CTRL_EOF:
+		ret = (long)(ctx->length == 0);
+		break;
+	case BIO_C_SET_BUF_MEM_EOF_RETURN:
+		b->num = (int)num;
+		break;
+	case BIO_CTRL_GET_CLOSE:
+		ret = (long)b->shutdown;
+		break;
+	case BIO_CTRL_SET_CLOSE:
+		b->shutdown = (int)num;
+		break;
+	case BIO_CTRL_WPENDING:
+		ret = 0L;
+		break;
+	case BIO_CTRL_PENDING:
+		ret = ctx->length > LONG_MAX ? LONG_MAX : (long)ctx->length;
+		break;
+	case BIO_CTRL_DUP:
+	case BIO_CTRL_FLUSH:
+		ret = 1;
+		break;
+	default:
+		ret = 0;
+		break;
+	}
+	return (ret);
+}
+
+static int
+mseg_gets(BIO *bp, char *buf, int size)
+{
+	struct mem_seg_ctx *ctx = bp->ptr;
+	struct mem_seg *seg;
+	unsigned char *nl;
+	size_t i, j, n;
+
+	BIO_clear_retry_flags(bp);
+
+	if (size <= 0)
+		return 0;
+	j = ctx->length;
+	if ((size_t)(size - 1) < j)
+		j = size - 1;
+
+	/* Find the number of bytes up to and including the first newline. */
+	for (i = 0, seg = ctx->head; seg != NULL && i < j; seg = seg->next) {
+		n = seg->end - seg->off;
+		if (n > j - i)
+			n = j - i;
+		if ((nl = memchr(seg->data + seg->off, '\n', n)) != NULL) {
+			i += nl - (seg->data + seg->off) + 1;
+			break;
+		}
+		i += n;
+	}
+
+	mseg_consume(ctx, buf, i);
+	buf[i] = '\0';
+	return (i);
+}
+
+static int
+mseg_puts(BIO *bp, const char *str)
+{
+	return mseg_write(bp, str, strlen(str));
+}
+
+int
+BIO_mem_seg_append(BIO *b, void *data, size_t len,
+    void (*free_cb)(void *data, size_t len, void *arg), void *arg)
+{
+	struct mem_seg *seg;
+
+	if (BIO_method_type(b) != BIO_TYPE_MEM_SEG) {
+		BIOerror(BIO_R_UNSUPPORTED_METHOD);
+		return 0;
+	}
+	if (data == NULL && len > 0) {
+		BIOerror(BIO_R_NULL_PARAMETER);
+		return 0;
+	}
+
+	/* Nothing references an empty buffer, so give it back at once. */
+	if (len == 0) {
+		if (free_cb != NULL)
+			free_cb(data, len, arg);
+		return 1;
+	}
+
+	if ((seg = calloc(1, sizeof(*seg))) == NULL) {
+		BIOerror(ERR_R_MALLOC_FAILURE);
+		return 0;
+	}
+	seg->data = data;
+	seg->size = len;
+	seg->end = len;
+	seg->free_cb = free_cb;
+	seg->arg = arg;
+	mseg_append(b->ptr, seg);
+
+	return 1;
+}
+
+int
+BIO_mem_seg_peek(BIO *b, struct iovec *iov, int iovcnt)
+{
+	struct mem_seg_ctx *ctx;
+	struct mem_seg *seg;
+	int n = 0;
+
+	if (BIO_method_type(b) != BIO_TYPE_MEM_SEG) {
+		BIOerror(BIO_R_UNSUPPORTED_METHOD);
+		return -1;
+	}
+	ctx = b->ptr;
+
+	for (seg = ctx->head; seg != NULL && n < iovcnt; seg = seg->next) {
+		if (seg->off == seg->end)
+			continue;
+		iov[n].iov_base = seg->data + seg->off;
+		iov[n].iov_len = seg->end - seg->off;
+		n++;
+	}
+
+	return n;
+}
+
+int
+BIO_mem_seg_consume(BIO *b, size_t len)
+{
+	struct mem_seg_ctx *ctx;
+
+	if (BIO_method_type(b) != BIO_TYPE_MEM_SEG) {
+		BIOerror(BIO_R_UNSUPPORTED_METHOD);
+		return 0;
+	}
+	ctx = b->ptr;
+
+	if (len > ctx->length) {
+		BIOerror(BIO_R_INVALID_ARGUMENT);
+		return 0;
+	}
+	mseg_consume(ctx, NULL, len);
+
+	return 1;
+}
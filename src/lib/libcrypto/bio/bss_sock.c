@@ -57,20 +57,105 @@
  */
 
 #include <sys/socket.h>
+#include <sys/uio.h>
+
+#ifdef __linux__
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/errqueue.h>
+#include <linux/tls.h>
+#endif
 
 #include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
 #include <openssl/bio.h>
 
+#ifdef __linux__
+#ifndef TCP_ULP
+#define TCP_ULP		31
+#endif
+#ifndef SOL_TLS
+#define SOL_TLS		282
+#endif
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY	60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY	0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY	5
+#endif
+#endif
+
+#define SOCK_KTLS_HEADER_LEN		5
+#define SOCK_KTLS_MAX_PAYLOAD		16384
+#define SOCK_KTLS_APPLICATION_DATA	23
+
+/*
+ * Once the kernel protects the records on a socket, the TLS layer still
+ * reads and writes whole records, only with their content in the clear.
+ * The record type from the header is passed to and from the kernel in a
+ * control message, while the kernel does its own framing.
+ */
+struct sock_ktls {
+	/* Type and remaining length of the record being written. */
+	uint8_t wtype;
+	size_t wleft;
+
+	/* Content read from the kernel, preceded by a record header. */
+	uint8_t rbuf[SOCK_KTLS_HEADER_LEN + SOCK_KTLS_MAX_PAYLOAD];
+	size_t roff;
+	size_t rlen;
+};
+
+/*
+ * Writes of at least min bytes are sent with MSG_ZEROCOPY, the kernel then
+ * sending straight from the pages of the caller, which must be left alone
+ * until the kernel reports on the error queue of the socket that it is done
+ * with them. Each zero-copy send takes the next of a sequence of 32 bit
+ * identifiers and completions report ranges of these. A range that arrives
+ * ahead of an earlier one is held until the earlier one has arrived; should
+ * more ranges need holding, done no longer advances, which leaves the
+ * caller holding on to its buffers rather than changing them too early.
+ */
+#define SOCK_ZEROCOPY_MIN		(16 * 1024)
+#define SOCK_ZEROCOPY_HELD		16
+
+struct sock_zerocopy_range {
+	uint32_t lo;
+	uint32_t hi;
+};
+
+struct sock_zerocopy {
+	size_t min;
+	uint32_t sent;
+	uint32_t done;
+	struct sock_zerocopy_range held[SOCK_ZEROCOPY_HELD];
+	int num_held;
+};
+
+struct sock_data {
+	struct sock_ktls *ktls;
+	struct sock_zerocopy zc;
+};
+
 static int sock_write(BIO *h, const char *buf, int num);
 static int sock_read(BIO *h, char *buf, int size);
 static int sock_puts(BIO *h, const char *str);
 static long sock_ctrl(BIO *h, int cmd, long arg1, void *arg2);
 static int sock_new(BIO *h);
 static int sock_free(BIO *data);
+#ifdef __linux__
+static int sock_ktls_write(BIO *h, const char *buf, int num);
+static int sock_ktls_read(BIO *h, char *buf, int size);
+static int sock_zerocopy_write(BIO *h, const char *buf, int num);
+#endif
 int BIO_sock_should_retry(int s);
 
 static const BIO_METHOD methods_sockp = {
@@ -112,11 +197,34 @@ sock_new(BIO *bi)
 	return (1);
 }
 
+static struct sock_data *
+sock_data(BIO *b)
+{
+	if (b->ptr == NULL)
+		b->ptr = calloc(1, sizeof(struct sock_data));
+
+	return (b->ptr);
+}
+
+static void
+sock_data_free(BIO *a)
+{
+	struct sock_data *d;
+
+	if ((d = a->ptr) != NULL) {
+		freezero(d->ktls, sizeof(struct sock_ktls));
+		free(d);
+	}
+	a->ptr = NULL;
+	BIO_clear_flags(a, BIO_FLAGS_KTLS_TX|BIO_FLAGS_KTLS_RX);
+}
+
 static int
 sock_free(BIO *a)
 {
 	if (a == NULL)
 		return (0);
+	sock_data_free(a);
 	if (a->shutdown) {
 		if (a->init) {
 			shutdown(a->num, SHUT_RDWR);
@@ -133,6 +241,11 @@ sock_read(BIO *b, char *out, int outl)
 {
 	int ret = 0;
 
+#ifdef __linux__
+	if (BIO_test_flags(b, BIO_FLAGS_KTLS_RX))
+		return sock_ktls_read(b, out, outl);
+#endif
+
 	if (out != NULL) {
 		errno = 0;
 		ret = read(b->num, out, outl);
@@ -149,6 +262,14 @@ static int
 sock_write(BIO *b, const char *in, int inl)
 {
 	int ret;
+#ifdef __linux__
+	struct sock_data *d = b->ptr;
+
+	if (BIO_test_flags(b, BIO_FLAGS_KTLS_TX))
+		return sock_ktls_write(b, in, inl);
+	if (d != NULL && d->zc.min > 0 && inl > 0 && (size_t)inl >= d->zc.min)
+		return sock_zerocopy_write(b, in, inl);
+#endif
 
 	errno = 0;
 	ret = write(b->num, in, inl);
@@ -160,6 +281,317 @@ sock_write(BIO *b, const char *in, int inl)
 	return (ret);
 }
 
+#ifdef __linux__
+static int
+sock_ktls_start(BIO *b, int is_tx, const struct tls_crypto_info *info)
+{
+	int flag = is_tx ? BIO_FLAGS_KTLS_TX : BIO_FLAGS_KTLS_RX;
+	struct sock_data *d;
+	socklen_t len;
+
+	if (!b->init || info == NULL)
+		return (0);
+
+	/* The kernel has no way of changing the keys once they are set. */
+	if (BIO_test_flags(b, flag))
+		return (0);
+
+	switch (info->cipher_type) {
+	case TLS_CIPHER_AES_GCM_128:
+		len = sizeof(struct tls12_crypto_info_aes_gcm_128);
+		break;
+	case TLS_CIPHER_AES_GCM_256:
+		len = sizeof(struct tls12_crypto_info_aes_gcm_256);
+		break;
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+	case TLS_CIPHER_CHACHA20_POLY1305:
+		len = sizeof(struct tls12_crypto_info_chacha20_poly1305);
+		break;
+#endif
+	default:
+		return (0);
+	}
+
+	if ((d = sock_data(b)) == NULL)
+		return (0);
+	if (d->ktls == NULL) {
+		if ((d->ktls = calloc(1, sizeof(struct sock_ktls))) == NULL)
+			return (0);
+	}
+
+	/* The upper layer protocol is set up once for both directions. */
+	if (setsockopt(b->num, IPPROTO_TCP, TCP_ULP, "tls",
+	    sizeof("tls")) == -1 && errno != EEXIST)
+		return (0);
+	if (setsockopt(b->num, SOL_TLS, is_tx ? TLS_TX : TLS_RX,
+	    info, len) == -1)
+		return (0);
+
+	BIO_set_flags(b, flag);
+
+	return (1);
+}
+
+static ssize_t
+sock_ktls_send(BIO *b, uint8_t type, const char *in, size_t len)
+{
+	unsigned char cbuf[CMSG_SPACE(sizeof(type))];
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+
+	if (type == SOCK_KTLS_APPLICATION_DATA)
+		return write(b->num, in, len);
+
+	memset(&msg, 0, sizeof(msg));
+	memset(cbuf, 0, sizeof(cbuf));
+
+	iov.iov_base = (void *)in;
+	iov.iov_len = len;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_TLS;
+	cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(type));
+	memcpy(CMSG_DATA(cmsg), &type, sizeof(type));
+
+	return sendmsg(b->num, &msg, 0);
+}
+
+static int
+sock_ktls_write(BIO *b, const char *in, int inl)
+{
+	struct sock_ktls *k = ((struct sock_data *)b->ptr)->ktls;
+	const unsigned char *p;
+	size_t hdr_len, len;
+	ssize_t ret;
+	int done = 0;
+
+	BIO_clear_retry_flags(b);
+
+	while (done < inl) {
+		hdr_len = 0;
+		if (k->wleft == 0) {
+			if (inl - done < SOCK_KTLS_HEADER_LEN) {
+				errno = EINVAL;
+				return (done > 0 ? done : -1);
+			}
+			p = (const unsigned char *)in + done;
+			k->wtype = p[0];
+			k->wleft = p[3] << 8 | p[4];
+			hdr_len = SOCK_KTLS_HEADER_LEN;
+		}
+
+		len = inl - done - hdr_len;
+		if (len > k->wleft)
+			len = k->wleft;
+		if (len == 0) {
+			done += hdr_len;
+			continue;
+		}
+
+		errno = 0;
+		if ((ret = sock_ktls_send(b, k->wtype, in + done + hdr_len,
+		    len)) <= 0) {
+			/* A header is only consumed along with its content. */
+			if (hdr_len > 0)
+				k->wleft = 0;
+			if (done > 0)
+				return (done);
+			if (BIO_sock_should_retry(ret))
+				BIO_set_retry_write(b);
+			return (-1);
+		}
+		k->wleft -= ret;
+		done += hdr_len + ret;
+	}
+
+	return (done);
+}
+
+static int
+sock_ktls_read(BIO *b, char *out, int outl)
+{
+	unsigned char cbuf[CMSG_SPACE(sizeof(uint8_t))];
+	struct sock_ktls *k = ((struct sock_data *)b->ptr)->ktls;
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	uint8_t type;
+	ssize_t ret;
+	size_t n;
+
+	BIO_clear_retry_flags(b);
+
+	if (out == NULL || outl <= 0)
+		return (0);
+
+	if (k->roff == k->rlen) {
+		memset(&msg, 0, sizeof(msg));
+
+		iov.iov_base = &k->rbuf[SOCK_KTLS_HEADER_LEN];
+		iov.iov_len = SOCK_KTLS_MAX_PAYLOAD;
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = cbuf;
+		msg.msg_controllen = sizeof(cbuf);
+
+		errno = 0;
+		if ((ret = recvmsg(b->num, &msg, 0)) <= 0) {
+			if (BIO_sock_should_retry(ret))
+				BIO_set_retry_read(b);
+			return (ret);
+		}
+
+		type = SOCK_KTLS_APPLICATION_DATA;
+		for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+		    cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if (cmsg->cmsg_level == SOL_TLS &&
+			    cmsg->cmsg_type == TLS_GET_RECORD_TYPE)
+				type = *CMSG_DATA(cmsg);
+		}
+
+		/*
+		 * Put back a header, so that the record reads as it would
+		 * from the wire. TLSv1.3 uses the TLSv1.2 record version.
+		 */
+		k->rbuf[0] = type;
+		k->rbuf[1] = 3;
+		k->rbuf[2] = 3;
+		k->rbuf[3] = ret >> 8;
+		k->rbuf[4] = ret & 0xff;
+		k->roff = 0;
+		k->rlen = SOCK_KTLS_HEADER_LEN + ret;
+	}
+
+	n = k->rlen - k->roff;
+	if (n > (size_t)outl)
+		n = outl;
+	memcpy(out, &k->rbuf[k->roff], n);
+	k->roff += n;
+
+	return (n);
+}
+
+static int
+sock_zerocopy_start(BIO *b, long min)
+{
+	struct sock_data *d;
+	int on = (min > 0);
+
+	if (!b->init || min < 0)
+		return (0);
+
+	if (setsockopt(b->num, SOL_SOCKET, SO_ZEROCOPY, &on,
+	    sizeof(on)) == -1)
+		return (0);
+	if ((d = sock_data(b)) == NULL)
+		return (0);
+
+	/* Below this, pinning the pages costs more than copying them. */
+	if (min > 0 && min < SOCK_ZEROCOPY_MIN)
+		min = SOCK_ZEROCOPY_MIN;
+	d->zc.min = min;
+
+	return (1);
+}
+
+static int
+sock_zerocopy_write(BIO *b, const char *in, int inl)
+{
+	struct sock_data *d = b->ptr;
+	int ret;
+
+	errno = 0;
+	ret = send(b->num, in, inl, MSG_ZEROCOPY);
+	if (ret == -1 && errno == ENOBUFS) {
+		/* Out of memory for pinning pages, send a copy instead. */
+		errno = 0;
+		ret = write(b->num, in, inl);
+	} else if (ret > 0)
+		d->zc.sent++;
+
+	BIO_clear_retry_flags(b);
+	if (ret <= 0) {
+		if (BIO_sock_should_retry(ret))
+			BIO_set_retry_write(b);
+	}
+	return (ret);
+}
+
+static void
+sock_zerocopy_complete(struct sock_zerocopy *zc, uint32_t lo, uint32_t hi)
+{
+	int i;
+
+	if ((int32_t)(lo - zc->done) > 0) {
+		if (zc->num_held < SOCK_ZEROCOPY_HELD) {
+			zc->held[zc->num_held].lo = lo;
+			zc->held[zc->num_held].hi = hi;
+			zc->num_held++;
+		}
+		return;
+	}
+	if ((int32_t)(hi + 1 - zc->done) > 0)
+		zc->done = hi + 1;
+
+	/* Take in the held ranges that now follow on. */
+	for (i = 0; i < zc->num_held; ) {
+		if ((int32_t)(zc->held[i].lo - zc->done) > 0) {
+			i++;
+			continue;
+		}
+		if ((int32_t)(zc->held[i].hi + 1 - zc->done) > 0)
+			zc->done = zc->held[i].hi + 1;
+		zc->held[i] = zc->held[--zc->num_held];
+		i = 0;
+	}
+}
+
+/*
+ * Read the completions of zero-copy sends from the error queue of the
+ * socket, without waiting for any.
+ */
+static void
+sock_zerocopy_reap(BIO *b)
+{
+	unsigned char cbuf[CMSG_SPACE(sizeof(struct sock_extended_err) +
+	    sizeof(struct sockaddr_in6))];
+	struct sock_data *d = b->ptr;
+	struct sock_extended_err *ee;
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+
+	while (d->zc.sent != d->zc.done) {
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = cbuf;
+		msg.msg_controllen = sizeof(cbuf);
+
+		if (recvmsg(b->num, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1)
+			break;
+
+		for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+		    cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if (!(cmsg->cmsg_level == SOL_IP &&
+			    cmsg->cmsg_type == IP_RECVERR) &&
+			    !(cmsg->cmsg_level == SOL_IPV6 &&
+			    cmsg->cmsg_type == IPV6_RECVERR))
+				continue;
+			ee = (struct sock_extended_err *)CMSG_DATA(cmsg);
+			if (ee->ee_errno != 0 ||
+			    ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+				continue;
+			sock_zerocopy_complete(&d->zc, ee->ee_info,
+			    ee->ee_data);
+		}
+	}
+}
+#endif
+
 static long
 sock_ctrl(BIO *b, int cmd, long num, void *ptr)
 {
@@ -189,9 +621,70 @@ sock_ctrl(BIO *b, int cmd, long num, void *ptr)
 		b->shutdown = (int)num;
 		break;
 	case BIO_CTRL_DUP:
+		/* The copy shares the kernel state, but keeps its own buffers. */
+		if (BIO_test_flags(b, BIO_FLAGS_KTLS_TX|BIO_FLAGS_KTLS_RX)) {
+			struct sock_data *d;
+
+			if ((d = sock_data(ptr)) == NULL ||
+			    (d->ktls = calloc(1,
+			    sizeof(struct sock_ktls))) == NULL)
+				ret = 0;
+		}
+		break;
 	case BIO_CTRL_FLUSH:
 		ret = 1;
 		break;
+#ifdef __linux__
+	case BIO_CTRL_SET_KTLS:
+		ret = sock_ktls_start(b, (int)num, ptr);
+		break;
+	case BIO_CTRL_PENDING:
+		ret = 0;
+		if (BIO_test_flags(b, BIO_FLAGS_KTLS_RX)) {
+			struct sock_ktls *k = ((struct sock_data *)b->ptr)->ktls;
+
+			ret = k->rlen - k->roff;
+		}
+		break;
+#endif
+	case BIO_CTRL_GET_KTLS_SEND:
+		ret = BIO_test_flags(b, BIO_FLAGS_KTLS_TX) != 0;
+		break;
+	case BIO_CTRL_GET_KTLS_RECV:
+		ret = BIO_test_flags(b, BIO_FLAGS_KTLS_RX) != 0;
+		break;
+#ifdef __linux__
+	case BIO_CTRL_SET_ZEROCOPY:
+		ret = sock_zerocopy_start(b, num);
+		break;
+	case BIO_CTRL_GET_ZEROCOPY_SENT:
+		ret = 0;
+		if (b->ptr != NULL)
+			ret = ((struct sock_data *)b->ptr)->zc.sent;
+		break;
+	case BIO_CTRL_GET_ZEROCOPY_DONE:
+		ret = 0;
+		if (b->ptr != NULL) {
+			sock_zerocopy_reap(b);
+			ret = ((struct sock_data *)b->ptr)->zc.done;
+		}
+		break;
+#endif
+	case BIO_CTRL_WRITEV:
+		/* Writes to a kernel TLS socket go through sock_ktls_write(). */
+		if (BIO_test_flags(b, BIO_FLAGS_KTLS_TX)) {
+			ret = 0;
+			break;
+		}
+		errno = 0;
+		ret = writev(b->num, ptr, (int)num);
+		BIO_clear_retry_flags(b);
+		if (ret <= 0) {
+			if (BIO_sock_should_retry((int)ret))
+				BIO_set_retry_write(b);
+		} else
+			b->num_write += ret;
+		break;
 	default:
 		ret = 0;
 		break;
@@ -408,6 +408,7 @@ int BN_GENCB_call(BN_GENCB *cb, int a, int b);
 const BIGNUM *BN_value_one(void);
 char *	BN_options(void);
 BN_CTX *BN_CTX_new(void);
+BN_CTX *BN_CTX_get_thread_default(void);
 #ifndef OPENSSL_NO_DEPRECATED
 void	BN_CTX_init(BN_CTX *c);
 #endif
@@ -63,6 +63,7 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <openssl/opensslconf.h>
 
@@ -1094,3 +1095,68 @@ bn_mul_mont(BN_ULONG *rp, const BN_ULONG *ap, const BN_ULONG *bp,
 #endif
 
 #endif /* !BN_MUL_COMBA */
+
+#if defined(OPENSSL_BN_ASM_MONT) && !defined(OPENSSL_NO_ASM) && \
+    defined(__aarch64__)
+/*
+ * Montgomery multiplication for aarch64. The multiplication and the reduction
+ * are interleaved one word at a time, so that the product never needs more
+ * than num + 2 words, and the compiler turns each 128-bit product into a
+ * mul/umulh pair. Larger operands than this are left to the generic code.
+ */
+#define BN_MONT_MAX_WORDS	128
+
+int
+bn_mul_mont(BN_ULONG *rp, const BN_ULONG *ap, const BN_ULONG *bp,
+    const BN_ULONG *np, const BN_ULONG *n0p, int num)
+{
+	BN_ULONG tp[BN_MONT_MAX_WORDS + 2];
+	BN_ULONG c, m, mask, n0 = *n0p;
+	__uint128_t t;
+	int i, j;
+
+	if (num > BN_MONT_MAX_WORDS)
+		return 0;
+
+	memset(tp, 0, (num + 2) * sizeof(BN_ULONG));
+
+	for (i = 0; i < num; i++) {
+		/* tp += ap * bp[i] */
+		c = 0;
+		for (j = 0; j < num; j++) {
+			t = (__uint128_t)ap[j] * bp[i] + tp[j] + c;
+			tp[j] = (BN_ULONG)t;
+			c = (BN_ULONG)(t >> 64);
+		}
+		t = (__uint128_t)tp[num] + c;
+		tp[num] = (BN_ULONG)t;
+		tp[num + 1] = (BN_ULONG)(t >> 64);
+
+		/* tp = (tp + np * m) / 2^64, where the low word cancels out */
+		m = tp[0] * n0;
+		t = (__uint128_t)np[0] * m + tp[0];
+		c = (BN_ULONG)(t >> 64);
+		for (j = 1; j < num; j++) {
+			t = (__uint128_t)np[j] * m + tp[j] + c;
+			tp[j - 1] = (BN_ULONG)t;
+			c = (BN_ULONG)(t >> 64);
+		}
+		t = (__uint128_t)tp[num] + c;
+		tp[num - 1] = (BN_ULONG)t;
+		tp[num] = tp[num + 1] + (BN_ULONG)(t >> 64);
+	}
+
+	/*
+	 * tp < 2 * np, so subtract np once, keeping the original if that
+	 * borrows. The choice is made without branches.
+	 */
+	c = bn_sub_words(rp, tp, np, num);
+	mask = tp[num] - c;
+	for (j = 0; j < num; j++)
+		rp[j] = (tp[j] & mask) | (rp[j] & ~mask);
+
+	explicit_bzero(tp, (num + 2) * sizeof(BN_ULONG));
+
+	return 1;
+}
+#endif
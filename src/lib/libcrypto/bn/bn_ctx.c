@@ -60,6 +60,7 @@
 #endif
 #endif
 
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -112,7 +113,7 @@ static void		BN_POOL_finish(BN_POOL *);
 static void		BN_POOL_reset(BN_POOL *);
 #endif
 static BIGNUM *		BN_POOL_get(BN_POOL *);
-static void		BN_POOL_release(BN_POOL *, unsigned int);
+static void		BN_POOL_release(BN_POOL *, unsigned int, int);
 
 /************/
 /* BN_STACK */
@@ -150,6 +151,8 @@ struct bignum_ctx {
 	int err_stack;
 	/* Block "gets" until an "end" (compatibility behaviour) */
 	int too_many;
+	/* Owned by a thread, see BN_CTX_get_thread_default() */
+	int thread_default;
 };
 
 /* Enable this to find BN_CTX bugs */
@@ -235,13 +238,14 @@ BN_CTX_new(void)
 	ret->used = 0;
 	ret->err_stack = 0;
 	ret->too_many = 0;
+	ret->thread_default = 0;
 	return ret;
 }
 
 void
 BN_CTX_free(BN_CTX *ctx)
 {
-	if (ctx == NULL)
+	if (ctx == NULL || ctx->thread_default)
 		return;
 #ifdef BN_CTX_DEBUG
 	{
@@ -294,7 +298,8 @@ BN_CTX_end(BN_CTX *ctx)
 		unsigned int fp = BN_STACK_pop(&ctx->stack);
 		/* Does this stack frame have anything to release? */
 		if (fp < ctx->used)
-			BN_POOL_release(&ctx->pool, ctx->used - fp);
+			BN_POOL_release(&ctx->pool, ctx->used - fp,
+			    ctx->thread_default);
 		ctx->used = fp;
 		/* Unjam "too_many" in case "get" had failed */
 		ctx->too_many = 0;
@@ -325,6 +330,56 @@ BN_CTX_get(BN_CTX *ctx)
 	return ret;
 }
 
+/*
+ * BN_CTX_get_thread_default() returns a BN_CTX that is kept for the life
+ * of the calling thread, so that the temporaries of one operation stay
+ * allocated for the next. It is shared by all callers on the thread, so
+ * temporaries may only be taken from it between BN_CTX_start() and
+ * BN_CTX_end(), which clears them. Callers still pass it to BN_CTX_free(),
+ * which does nothing for it, since a plain BN_CTX is returned if the
+ * thread's one cannot be set up.
+ */
+static pthread_once_t bn_ctx_thread_once = PTHREAD_ONCE_INIT;
+static pthread_key_t bn_ctx_thread_key;
+static int bn_ctx_thread_key_ok;
+
+static void
+bn_ctx_thread_free(void *arg)
+{
+	BN_CTX *ctx = arg;
+
+	ctx->thread_default = 0;
+	BN_CTX_free(ctx);
+}
+
+static void
+bn_ctx_thread_init(void)
+{
+	if (pthread_key_create(&bn_ctx_thread_key, bn_ctx_thread_free) == 0)
+		bn_ctx_thread_key_ok = 1;
+}
+
+BN_CTX *
+BN_CTX_get_thread_default(void)
+{
+	BN_CTX *ctx;
+
+	if (pthread_once(&bn_ctx_thread_once, bn_ctx_thread_init) != 0 ||
+	    !bn_ctx_thread_key_ok)
+		return BN_CTX_new();
+
+	if ((ctx = pthread_getspecific(bn_ctx_thread_key)) != NULL)
+		return ctx;
+
+	if ((ctx = BN_CTX_new()) == NULL)
+		return NULL;
+	if (pthread_setspecific(bn_ctx_thread_key, ctx) != 0)
+		return ctx;
+	ctx->thread_default = 1;
+
+	return ctx;
+}
+
 /************/
 /* BN_STACK */
 /************/
@@ -465,13 +520,15 @@ BN_POOL_get(BN_POOL *p)
 }
 
 static void
-BN_POOL_release(BN_POOL *p, unsigned int num)
+BN_POOL_release(BN_POOL *p, unsigned int num, int clear)
 {
 	unsigned int offset = (p->used - 1) % BN_CTX_POOL_SIZE;
 
 	p->used -= num;
 	while (num--) {
 		bn_check_top(p->current->vals + offset);
+		if (clear)
+			BN_clear(p->current->vals + offset);
 		if (!offset) {
 			offset = BN_CTX_POOL_SIZE - 1;
 			p->current = p->current->prev;
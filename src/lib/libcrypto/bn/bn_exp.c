@@ -829,6 +829,21 @@ BN_mod_exp_mont_consttime(BIGNUM *rr, const BIGNUM *a, const BIGNUM *p,
 		bn_correct_top(&tmp);
 	} else
 #endif
+#ifdef BN_FIXED
+	if (top <= BN_FIXED_MAX_WORDS) {
+		/* Zero the words above .top, as for the gather5 case. */
+		for (i = am.top; i < top; i++)
+			am.d[i] = 0;
+		for (i = tmp.top; i < top; i++)
+			tmp.d[i] = 0;
+
+		bn_fixed_mod_exp_mont(tmp.d, am.d, tmp.d, p, mont->N.d,
+		    mont->n0[0], top);
+
+		tmp.top = top;
+		bn_correct_top(&tmp);
+	} else
+#endif
 	{
 		if (!MOD_EXP_CTIME_COPY_TO_PREBUF(&tmp, top, powerbuf, 0,
 		    window))
@@ -904,6 +919,26 @@ err:
 	return (ret);
 }
 
+/*
+ * Two independent constant time exponentiations, as used for the CRT step
+ * of RSA.  Where the CPU can run both at once they are interleaved, otherwise
+ * this is the same as two calls to BN_mod_exp_mont_consttime().
+ */
+int
+BN_mod_exp_mont_consttime_x2(BIGNUM *rr1, const BIGNUM *a1, const BIGNUM *p1,
+    const BIGNUM *m1, BN_MONT_CTX *in_mont1, BIGNUM *rr2, const BIGNUM *a2,
+    const BIGNUM *p2, const BIGNUM *m2, BN_MONT_CTX *in_mont2, BN_CTX *ctx)
+{
+#ifdef BN_IFMA
+	if (bn_mod_exp_ifma_x2_supported(m1, m2))
+		return bn_mod_exp_ifma_x2(rr1, a1, p1, m1, rr2, a2, p2, m2,
+		    ctx);
+#endif
+	if (!BN_mod_exp_mont_consttime(rr1, a1, p1, m1, ctx, in_mont1))
+		return 0;
+	return BN_mod_exp_mont_consttime(rr2, a2, p2, m2, ctx, in_mont2);
+}
+
 int
 BN_mod_exp_mont_word(BIGNUM *rr, BN_ULONG a, const BIGNUM *p, const BIGNUM *m,
     BN_CTX *ctx, BN_MONT_CTX *in_mont)
@@ -0,0 +1,486 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Two constant time modular exponentiations at once with AVX-512 IFMA, for
+ * the CRT step of RSA-2048, RSA-3072 and RSA-4096.
+ *
+ * Numbers are held as 52 bit digits in the 64 bit lanes of zmm registers, so
+ * that vpmadd52luq and vpmadd52huq add the low and high halves of a digit
+ * product to an accumulator without carries between lanes.  Multiplication
+ * is the "almost Montgomery multiplication" of Gueron and Krasnov, "Software
+ * Implementation of Modular Exponentiation, Using Advanced Vector
+ * Instructions Architectures" (2012): the product is only reduced below 2m,
+ * which is enough as long as 4m < R.  The two exponentiations, one for each
+ * prime, are interleaved step by step so that one hides the latency of the
+ * other.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/bn.h>
+
+#include "bn_lcl.h"
+
+#ifdef BN_IFMA
+
+#include <immintrin.h>
+
+#include "x86_arch.h"
+
+#define BN_IFMA_TARGET \
+	__attribute__((__target__("avx512f,avx512ifma")))
+
+#define BN_IFMA_DIGIT_BITS	52
+#define BN_IFMA_DIGIT_MASK	((1ULL << BN_IFMA_DIGIT_BITS) - 1)
+#define BN_IFMA_MAX_VECS	5	/* 40 digits, for 2048 bit primes */
+#define BN_IFMA_MAX_DIGITS	(BN_IFMA_MAX_VECS * 8)
+#define BN_IFMA_WINDOW		5
+#define BN_IFMA_POWERS		(1 << BN_IFMA_WINDOW)
+
+struct bn_ifma_mod {
+	uint64_t m[BN_IFMA_MAX_DIGITS];
+	uint64_t rr[BN_IFMA_MAX_DIGITS];	/* R^2 mod m */
+	uint64_t k0;				/* -m^-1 mod 2^52 */
+};
+
+struct bn_ifma_ctx {
+	struct bn_ifma_mod mod[2];
+	uint64_t table[2][BN_IFMA_POWERS][BN_IFMA_MAX_DIGITS];
+	uint64_t acc[2][BN_IFMA_MAX_DIGITS];
+	uint64_t tmp[2][BN_IFMA_MAX_DIGITS];
+	uint64_t res[2][BN_IFMA_MAX_DIGITS];
+	uint64_t one[BN_IFMA_MAX_DIGITS];
+};
+
+/*
+ * Set r to (a1 * b1 / R) and (a2 * b2 / R) modulo the two moduli, reduced
+ * below 2m, where R is 2^(52 * ndigits).  The inputs are normalised digits
+ * below 2m and the outputs are normalised.
+ */
+static inline void BN_IFMA_TARGET __attribute__((__always_inline__))
+bn_ifma_amm_x2(uint64_t *r1, const uint64_t *a1, const uint64_t *b1,
+    uint64_t *r2, const uint64_t *a2, const uint64_t *b2,
+    const struct bn_ifma_mod *mod, int ndigits, int nvecs)
+{
+	__m512i A1[BN_IFMA_MAX_VECS], M1[BN_IFMA_MAX_VECS];
+	__m512i T1[BN_IFMA_MAX_VECS], A2[BN_IFMA_MAX_VECS];
+	__m512i M2[BN_IFMA_MAX_VECS], T2[BN_IFMA_MAX_VECS];
+	__m512i B1, B2, Y1, Y2, zero;
+	uint64_t m10 = mod[0].m[0], m20 = mod[1].m[0];
+	uint64_t k10 = mod[0].k0, k20 = mod[1].k0;
+	uint64_t t1, t2, y1, y2, c1, c2, v1, v2;
+	int i, j;
+
+	zero = _mm512_setzero_si512();
+	for (j = 0; j < nvecs; j++) {
+		A1[j] = _mm512_loadu_si512(&a1[8 * j]);
+		A2[j] = _mm512_loadu_si512(&a2[8 * j]);
+		M1[j] = _mm512_loadu_si512(&mod[0].m[8 * j]);
+		M2[j] = _mm512_loadu_si512(&mod[1].m[8 * j]);
+		T1[j] = zero;
+		T2[j] = zero;
+	}
+
+	for (i = 0; i < ndigits; i++) {
+		B1 = _mm512_set1_epi64(b1[i]);
+		B2 = _mm512_set1_epi64(b2[i]);
+		for (j = 0; j < nvecs; j++) {
+			T1[j] = _mm512_madd52lo_epu64(T1[j], A1[j], B1);
+			T2[j] = _mm512_madd52lo_epu64(T2[j], A2[j], B2);
+		}
+
+		/* Pick y so that the low digit becomes a multiple of 2^52. */
+		t1 = _mm_cvtsi128_si64(_mm512_castsi512_si128(T1[0]));
+		t2 = _mm_cvtsi128_si64(_mm512_castsi512_si128(T2[0]));
+		y1 = (t1 * k10) & BN_IFMA_DIGIT_MASK;
+		y2 = (t2 * k20) & BN_IFMA_DIGIT_MASK;
+		Y1 = _mm512_set1_epi64(y1);
+		Y2 = _mm512_set1_epi64(y2);
+		for (j = 0; j < nvecs; j++) {
+			T1[j] = _mm512_madd52lo_epu64(T1[j], M1[j], Y1);
+			T2[j] = _mm512_madd52lo_epu64(T2[j], M2[j], Y2);
+		}
+		c1 = (t1 + ((m10 * y1) & BN_IFMA_DIGIT_MASK)) >>
+		    BN_IFMA_DIGIT_BITS;
+		c2 = (t2 + ((m20 * y2) & BN_IFMA_DIGIT_MASK)) >>
+		    BN_IFMA_DIGIT_BITS;
+
+		/* Divide by 2^52, carrying out of the dropped digit. */
+		for (j = 0; j < nvecs - 1; j++) {
+			T1[j] = _mm512_alignr_epi64(T1[j + 1], T1[j], 1);
+			T2[j] = _mm512_alignr_epi64(T2[j + 1], T2[j], 1);
+		}
+		T1[nvecs - 1] = _mm512_alignr_epi64(zero, T1[nvecs - 1], 1);
+		T2[nvecs - 1] = _mm512_alignr_epi64(zero, T2[nvecs - 1], 1);
+		T1[0] = _mm512_add_epi64(T1[0], _mm512_maskz_set1_epi64(1, c1));
+		T2[0] = _mm512_add_epi64(T2[0], _mm512_maskz_set1_epi64(1, c2));
+
+		for (j = 0; j < nvecs; j++) {
+			T1[j] = _mm512_madd52hi_epu64(T1[j], A1[j], B1);
+			T2[j] = _mm512_madd52hi_epu64(T2[j], A2[j], B2);
+			T1[j] = _mm512_madd52hi_epu64(T1[j], M1[j], Y1);
+			T2[j] = _mm512_madd52hi_epu64(T2[j], M2[j], Y2);
+		}
+	}
+
+	for (j = 0; j < nvecs; j++) {
+		_mm512_storeu_si512(&r1[8 * j], T1[j]);
+		_mm512_storeu_si512(&r2[8 * j], T2[j]);
+	}
+
+	/* Each lane holds less than 2^61, so one pass of carries suffices. */
+	c1 = c2 = 0;
+	for (j = 0; j < ndigits; j++) {
+		v1 = r1[j] + c1;
+		v2 = r2[j] + c2;
+		r1[j] = v1 & BN_IFMA_DIGIT_MASK;
+		r2[j] = v2 & BN_IFMA_DIGIT_MASK;
+		c1 = v1 >> BN_IFMA_DIGIT_BITS;
+		c2 = v2 >> BN_IFMA_DIGIT_BITS;
+	}
+}
+
+/* Select the power idx of each table without a secret dependent access. */
+static inline void BN_IFMA_TARGET __attribute__((__always_inline__))
+bn_ifma_gather_x2(struct bn_ifma_ctx *ictx, uint64_t *r1, unsigned int idx1,
+    uint64_t *r2, unsigned int idx2, int nvecs)
+{
+	__m512i R1[BN_IFMA_MAX_VECS], R2[BN_IFMA_MAX_VECS];
+	__m512i I1, I2, K, one;
+	__mmask8 sel1, sel2;
+	int i, j;
+
+	I1 = _mm512_set1_epi64(idx1);
+	I2 = _mm512_set1_epi64(idx2);
+	K = _mm512_setzero_si512();
+	one = _mm512_set1_epi64(1);
+	for (j = 0; j < nvecs; j++) {
+		R1[j] = _mm512_setzero_si512();
+		R2[j] = _mm512_setzero_si512();
+	}
+
+	for (i = 0; i < BN_IFMA_POWERS; i++) {
+		sel1 = _mm512_cmpeq_epi64_mask(K, I1);
+		sel2 = _mm512_cmpeq_epi64_mask(K, I2);
+		for (j = 0; j < nvecs; j++) {
+			R1[j] = _mm512_mask_loadu_epi64(R1[j], sel1,
+			    &ictx->table[0][i][8 * j]);
+			R2[j] = _mm512_mask_loadu_epi64(R2[j], sel2,
+			    &ictx->table[1][i][8 * j]);
+		}
+		K = _mm512_add_epi64(K, one);
+	}
+
+	for (j = 0; j < nvecs; j++) {
+		_mm512_storeu_si512(&r1[8 * j], R1[j]);
+		_mm512_storeu_si512(&r2[8 * j], R2[j]);
+	}
+}
+
+/* Read the window of exponent bits starting at bit. */
+static unsigned int
+bn_ifma_window(const BIGNUM *p, int bit)
+{
+	BN_ULONG w;
+	int i = bit / BN_BITS2, shift = bit % BN_BITS2;
+
+	if (i >= p->top)
+		return 0;
+	w = p->d[i] >> shift;
+	if (shift > BN_BITS2 - BN_IFMA_WINDOW && i + 1 < p->top)
+		w |= p->d[i + 1] << (BN_BITS2 - shift);
+
+	return w & (BN_IFMA_POWERS - 1);
+}
+
+/*
+ * Fixed window exponentiation of both lanes, leaving a1^p1 and a2^p2 in
+ * r1 and r2, both in normal representation and fully reduced.  a1 and a2
+ * are below their moduli.
+ */
+static inline void BN_IFMA_TARGET __attribute__((__always_inline__))
+bn_ifma_mod_exp_x2_n(struct bn_ifma_ctx *ictx, uint64_t *r1, uint64_t *a1,
+    const BIGNUM *p1, uint64_t *r2, uint64_t *a2, const BIGNUM *p2, int bits,
+    int ndigits, int nvecs)
+{
+	const struct bn_ifma_mod *mod = ictx->mod;
+	uint64_t (*t1)[BN_IFMA_MAX_DIGITS] = ictx->table[0];
+	uint64_t (*t2)[BN_IFMA_MAX_DIGITS] = ictx->table[1];
+	uint64_t *acc1 = ictx->acc[0], *acc2 = ictx->acc[1];
+	uint64_t *tmp1 = ictx->tmp[0], *tmp2 = ictx->tmp[1];
+	uint64_t b1, b2, d1, d2, mask1, mask2;
+	int bit, i, j;
+
+	/* The powers a^0 ... a^31 in Montgomery representation. */
+	bn_ifma_amm_x2(t1[0], mod[0].rr, ictx->one, t2[0], mod[1].rr,
+	    ictx->one, mod, ndigits, nvecs);
+	bn_ifma_amm_x2(t1[1], a1, mod[0].rr, t2[1], a2, mod[1].rr,
+	    mod, ndigits, nvecs);
+	for (i = 2; i < BN_IFMA_POWERS; i++)
+		bn_ifma_amm_x2(t1[i], t1[i - 1], t1[1], t2[i], t2[i - 1],
+		    t2[1], mod, ndigits, nvecs);
+
+	bit = (bits - 1) / BN_IFMA_WINDOW * BN_IFMA_WINDOW;
+	bn_ifma_gather_x2(ictx, acc1, bn_ifma_window(p1, bit),
+	    acc2, bn_ifma_window(p2, bit), nvecs);
+	while (bit > 0) {
+		bit -= BN_IFMA_WINDOW;
+		for (i = 0; i < BN_IFMA_WINDOW; i++)
+			bn_ifma_amm_x2(acc1, acc1, acc1, acc2, acc2, acc2,
+			    mod, ndigits, nvecs);
+		bn_ifma_gather_x2(ictx, tmp1, bn_ifma_window(p1, bit),
+		    tmp2, bn_ifma_window(p2, bit), nvecs);
+		bn_ifma_amm_x2(acc1, acc1, tmp1, acc2, acc2, tmp2,
+		    mod, ndigits, nvecs);
+	}
+
+	/* Leave Montgomery representation, which gives a result below m + 1. */
+	bn_ifma_amm_x2(r1, acc1, ictx->one, r2, acc2, ictx->one,
+	    mod, ndigits, nvecs);
+
+	/* Subtract m unless that borrows. */
+	b1 = b2 = 0;
+	for (j = 0; j < ndigits; j++) {
+		d1 = r1[j] - mod[0].m[j] - b1;
+		d2 = r2[j] - mod[1].m[j] - b2;
+		b1 = d1 >> 63;
+		b2 = d2 >> 63;
+		tmp1[j] = d1 & BN_IFMA_DIGIT_MASK;
+		tmp2[j] = d2 & BN_IFMA_DIGIT_MASK;
+	}
+	mask1 = b1 - 1;
+	mask2 = b2 - 1;
+	for (j = 0; j < ndigits; j++) {
+		r1[j] = (tmp1[j] & mask1) | (r1[j] & ~mask1);
+		r2[j] = (tmp2[j] & mask2) | (r2[j] & ~mask2);
+	}
+}
+
+/* Instances with the loops over vectors unrolled for each size. */
+static void BN_IFMA_TARGET
+bn_ifma_mod_exp_x2_20(struct bn_ifma_ctx *ictx, uint64_t *r1, uint64_t *a1,
+    const BIGNUM *p1, uint64_t *r2, uint64_t *a2, const BIGNUM *p2, int bits)
+{
+	bn_ifma_mod_exp_x2_n(ictx, r1, a1, p1, r2, a2, p2, bits, 20, 3);
+}
+
+static void BN_IFMA_TARGET
+bn_ifma_mod_exp_x2_30(struct bn_ifma_ctx *ictx, uint64_t *r1, uint64_t *a1,
+    const BIGNUM *p1, uint64_t *r2, uint64_t *a2, const BIGNUM *p2, int bits)
+{
+	bn_ifma_mod_exp_x2_n(ictx, r1, a1, p1, r2, a2, p2, bits, 30, 4);
+}
+
+static void BN_IFMA_TARGET
+bn_ifma_mod_exp_x2_40(struct bn_ifma_ctx *ictx, uint64_t *r1, uint64_t *a1,
+    const BIGNUM *p1, uint64_t *r2, uint64_t *a2, const BIGNUM *p2, int bits)
+{
+	bn_ifma_mod_exp_x2_n(ictx, r1, a1, p1, r2, a2, p2, bits, 40, 5);
+}
+
+/* Number of 52 bit digits used for a modulus of top words, or 0. */
+static int
+bn_ifma_digits(int top)
+{
+	switch (top) {
+	case 16:
+		return 20;
+	case 24:
+		return 30;
+	case 32:
+		return 40;
+	}
+	return 0;
+}
+
+static void
+bn_ifma_from_bn(uint64_t *r, const BIGNUM *a, int ndigits)
+{
+	BN_ULONG w;
+	int bit, i, k, shift;
+
+	memset(r, 0, BN_IFMA_MAX_DIGITS * sizeof(*r));
+	for (k = 0; k < ndigits; k++) {
+		bit = k * BN_IFMA_DIGIT_BITS;
+		i = bit / BN_BITS2;
+		shift = bit % BN_BITS2;
+		if (i >= a->top)
+			break;
+		w = a->d[i] >> shift;
+		if (shift > BN_BITS2 - BN_IFMA_DIGIT_BITS && i + 1 < a->top)
+			w |= a->d[i + 1] << (BN_BITS2 - shift);
+		r[k] = w & BN_IFMA_DIGIT_MASK;
+	}
+}
+
+static int
+bn_ifma_to_bn(BIGNUM *r, const uint64_t *a, int top, int ndigits)
+{
+	int bit, i, k, shift;
+
+	if (bn_wexpand(r, top) == NULL)
+		return 0;
+	memset(r->d, 0, top * sizeof(BN_ULONG));
+	for (k = 0; k < ndigits; k++) {
+		bit = k * BN_IFMA_DIGIT_BITS;
+		i = bit / BN_BITS2;
+		shift = bit % BN_BITS2;
+		r->d[i] |= a[k] << shift;
+		if (shift > BN_BITS2 - BN_IFMA_DIGIT_BITS && i + 1 < top)
+			r->d[i + 1] |= a[k] >> (BN_BITS2 - shift);
+	}
+	r->top = top;
+	r->neg = 0;
+	bn_correct_top(r);
+
+	return 1;
+}
+
+static int
+bn_ifma_mod_init(struct bn_ifma_mod *mod, const BIGNUM *m, int ndigits,
+    BN_CTX *ctx)
+{
+	BIGNUM *rr, mct;
+	uint64_t inv;
+	int i, ret = 0;
+
+	BN_CTX_start(ctx);
+	if ((rr = BN_CTX_get(ctx)) == NULL)
+		goto err;
+
+	bn_ifma_from_bn(mod->m, m, ndigits);
+
+	/* Newton iteration for m^-1 mod 2^64, m * m = 1 mod 8 to start. */
+	inv = m->d[0];
+	for (i = 0; i < 5; i++)
+		inv *= 2 - m->d[0] * inv;
+	mod->k0 = (0 - inv) & BN_IFMA_DIGIT_MASK;
+
+	BN_init(&mct);
+	BN_with_flags(&mct, m, BN_FLG_CONSTTIME);
+	BN_zero(rr);
+	if (!BN_set_bit(rr, 2 * BN_IFMA_DIGIT_BITS * ndigits))
+		goto err;
+	if (!BN_mod_ct(rr, rr, &mct, ctx))
+		goto err;
+	bn_ifma_from_bn(mod->rr, rr, ndigits);
+
+	ret = 1;
+
+ err:
+	BN_CTX_end(ctx);
+
+	return ret;
+}
+
+int
+bn_mod_exp_ifma_x2_supported(const BIGNUM *m1, const BIGNUM *m2)
+{
+	if ((OPENSSL_cpu_caps() & CPUCAP_MASK_IFMA) == 0)
+		return 0;
+	if (m1->top != m2->top || bn_ifma_digits(m1->top) == 0)
+		return 0;
+	return BN_is_odd(m1) && BN_is_odd(m2);
+}
+
+/*
+ * Compute rr1 = a1^p1 mod m1 and rr2 = a2^p2 mod m2 in constant time.  The
+ * moduli must have been accepted by bn_mod_exp_ifma_x2_supported().
+ */
+int
+bn_mod_exp_ifma_x2(BIGNUM *rr1, const BIGNUM *a1, const BIGNUM *p1,
+    const BIGNUM *m1, BIGNUM *rr2, const BIGNUM *a2, const BIGNUM *p2,
+    const BIGNUM *m2, BN_CTX *ctx)
+{
+	struct bn_ifma_ctx *ictx = NULL;
+	uint64_t *r1, *r2, *x1, *x2;
+	BIGNUM *t1, *t2;
+	int bits, ndigits, top;
+	int ret = 0;
+
+	top = m1->top;
+	ndigits = bn_ifma_digits(top);
+
+	BN_CTX_start(ctx);
+	if ((t1 = BN_CTX_get(ctx)) == NULL)
+		goto err;
+	if ((t2 = BN_CTX_get(ctx)) == NULL)
+		goto err;
+
+	if ((ictx = calloc(1, sizeof(*ictx))) == NULL)
+		goto err;
+	r1 = ictx->res[0];
+	r2 = ictx->res[1];
+	x1 = ictx->acc[0];
+	x2 = ictx->acc[1];
+
+	if (!bn_ifma_mod_init(&ictx->mod[0], m1, ndigits, ctx))
+		goto err;
+	if (!bn_ifma_mod_init(&ictx->mod[1], m2, ndigits, ctx))
+		goto err;
+	ictx->one[0] = 1;
+
+	if (a1->neg || BN_ucmp(a1, m1) >= 0) {
+		if (!BN_mod_ct(t1, a1, m1, ctx))
+			goto err;
+		if (t1->neg && !BN_add(t1, t1, m1))
+			goto err;
+		a1 = t1;
+	}
+	if (a2->neg || BN_ucmp(a2, m2) >= 0) {
+		if (!BN_mod_ct(t2, a2, m2, ctx))
+			goto err;
+		if (t2->neg && !BN_add(t2, t2, m2))
+			goto err;
+		a2 = t2;
+	}
+	bn_ifma_from_bn(x1, a1, ndigits);
+	bn_ifma_from_bn(x2, a2, ndigits);
+
+	/* Both exponents are processed with the same number of windows. */
+	bits = BN_num_bits(p1);
+	if (BN_num_bits(p2) > bits)
+		bits = BN_num_bits(p2);
+	if (bits == 0)
+		bits = 1;
+
+	/* a1 and a2 are in acc, which is only used once they are in the table. */
+	if (ndigits == 20)
+		bn_ifma_mod_exp_x2_20(ictx, r1, x1, p1, r2, x2, p2, bits);
+	else if (ndigits == 30)
+		bn_ifma_mod_exp_x2_30(ictx, r1, x1, p1, r2, x2, p2, bits);
+	else
+		bn_ifma_mod_exp_x2_40(ictx, r1, x1, p1, r2, x2, p2, bits);
+
+	if (!bn_ifma_to_bn(rr1, r1, top, ndigits))
+		goto err;
+	if (!bn_ifma_to_bn(rr2, r2, top, ndigits))
+		goto err;
+
+	ret = 1;
+
+ err:
+	BN_CTX_end(ctx);
+	freezero(ictx, sizeof(*ictx));
+
+	return ret;
+}
+
+#endif /* BN_IFMA */
@@ -0,0 +1,242 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Fixed width Montgomery arithmetic on plain word arrays.
+ *
+ * The numbers are n words long, with n at most BN_FIXED_MAX_WORDS, and all
+ * temporaries live on the stack, so nothing here allocates or grows a
+ * BIGNUM.  The common sizes of EC fields and RSA primes are dispatched to
+ * copies of the code in which n is a constant, which lets the compiler
+ * unroll the inner loops.  This is only built where the word products can be
+ * done inline, through BN_LLONG or BN_UMULT_HIGH.  None of the code branches on or indexes memory
+ * with the values of the operands or the exponent.
+ */
+
+#include <string.h>
+
+#include <openssl/bn.h>
+
+#include "bn_lcl.h"
+#include "constant_time_locl.h"
+
+#ifdef BN_FIXED
+
+#define BN_FIXED_WINDOW		5
+#define BN_FIXED_POWERS		(1 << BN_FIXED_WINDOW)
+
+#define BN_FIXED_WORDS(bits)	(((bits) + BN_BITS2 - 1) / BN_BITS2)
+
+/*
+ * Add a * w to the n words at r and return the carry word.
+ */
+static inline BN_ULONG __attribute__((__always_inline__))
+bn_fixed_mul_add_words(BN_ULONG *r, const BN_ULONG *a, BN_ULONG w, int n)
+{
+	BN_ULONG c = 0;
+	int i;
+
+	for (i = 0; i < n; i++)
+		mul_add(r[i], a[i], w, c);
+
+	return c;
+}
+
+/*
+ * Set the 2n words at t to a^2, computing each cross product only once.
+ */
+static inline void __attribute__((__always_inline__))
+bn_fixed_sqr_words(BN_ULONG *t, const BN_ULONG *a, int n)
+{
+	BN_ULONG c, v, hi, lo;
+	int i;
+
+	for (i = 0; i < 2 * n; i++)
+		t[i] = 0;
+	for (i = 0; i < n - 1; i++)
+		t[i + n] = bn_fixed_mul_add_words(&t[2 * i + 1], &a[i + 1],
+		    a[i], n - i - 1);
+
+	/* Double the cross products and add the squares. */
+	for (c = 0, i = 0; i < 2 * n; i++) {
+		v = t[i];
+		t[i] = ((v << 1) | c) & BN_MASK2;
+		c = v >> (BN_BITS2 - 1);
+	}
+	for (c = 0, i = 0; i < n; i++) {
+		sqr(lo, hi, a[i]);
+		v = (t[2 * i] + c) & BN_MASK2;
+		c = v < c;
+		v = (v + lo) & BN_MASK2;
+		c += v < lo;
+		t[2 * i] = v;
+		v = (t[2 * i + 1] + c) & BN_MASK2;
+		c = v < c;
+		v = (v + hi) & BN_MASK2;
+		c += v < hi;
+		t[2 * i + 1] = v;
+	}
+}
+
+/*
+ * Set r to a * b / R mod m, with R = 2^(n * BN_BITS2), by a full product
+ * followed by a word by word reduction.  If a and b are below m then so is
+ * the result.  r may alias a or b.
+ */
+static inline void __attribute__((__always_inline__))
+bn_fixed_mont_mul_words(BN_ULONG *r, const BN_ULONG *a, const BN_ULONG *b,
+    const BN_ULONG *m, BN_ULONG n0, int n)
+{
+	BN_ULONG t[2 * BN_FIXED_MAX_WORDS], s[BN_FIXED_MAX_WORDS];
+	BN_ULONG c, carry, u, v, mask;
+	int i;
+
+	if (a == b)
+		bn_fixed_sqr_words(t, a, n);
+	else {
+		for (i = 0; i < n; i++)
+			t[i] = 0;
+		for (i = 0; i < n; i++)
+			t[i + n] = bn_fixed_mul_add_words(&t[i], a, b[i], n);
+	}
+
+	for (carry = 0, i = 0; i < n; i++) {
+		u = (t[i] * n0) & BN_MASK2;
+		c = bn_fixed_mul_add_words(&t[i], m, u, n);
+		v = (t[i + n] + c) & BN_MASK2;
+		c = v < c;
+		v = (v + carry) & BN_MASK2;
+		c += v < carry;
+		t[i + n] = v;
+		carry = c;
+	}
+
+	/*
+	 * The result, carry and t[n..2n-1], is below R + m.  Keep it minus m
+	 * unless the subtraction borrowed out of the carry word as well.
+	 */
+	mask = carry - bn_sub_words(s, &t[n], m, n);
+	for (i = 0; i < n; i++)
+		r[i] = (t[i + n] & mask) | (s[i] & ~mask);
+
+	explicit_bzero(t, sizeof(t));
+	explicit_bzero(s, sizeof(s));
+}
+
+/*
+ * Copy entry idx of the table to r, reading all of the table.
+ */
+static inline void __attribute__((__always_inline__))
+bn_fixed_select_words(BN_ULONG *r,
+    BN_ULONG table[BN_FIXED_POWERS][BN_FIXED_MAX_WORDS], int idx, int n)
+{
+	BN_ULONG mask;
+	int i, j;
+
+	for (j = 0; j < n; j++)
+		r[j] = 0;
+	for (i = 0; i < BN_FIXED_POWERS; i++) {
+		mask = (BN_ULONG)0 - (constant_time_eq_int(i, idx) & 1);
+		for (j = 0; j < n; j++)
+			r[j] |= table[i][j] & mask;
+	}
+}
+
+/*
+ * Set r to am^p in the Montgomery domain, where one is R mod m.  This uses
+ * fixed windows of BN_FIXED_WINDOW bits; only the bit length of p shows in
+ * the running time.  p must not be zero.
+ */
+static inline void __attribute__((__always_inline__))
+bn_fixed_mod_exp_words(BN_ULONG *r, const BN_ULONG *am, const BN_ULONG *one,
+    const BIGNUM *p, const BN_ULONG *m, BN_ULONG n0, int n)
+{
+	BN_ULONG table[BN_FIXED_POWERS][BN_FIXED_MAX_WORDS];
+	BN_ULONG acc[BN_FIXED_MAX_WORDS], tmp[BN_FIXED_MAX_WORDS];
+	int bits, wvalue;
+	int i;
+
+	memcpy(table[0], one, n * sizeof(BN_ULONG));
+	memcpy(table[1], am, n * sizeof(BN_ULONG));
+	for (i = 2; i < BN_FIXED_POWERS; i++) {
+		if (i % 2 == 0)
+			bn_fixed_mont_mul_words(table[i], table[i / 2],
+			    table[i / 2], m, n0, n);
+		else
+			bn_fixed_mont_mul_words(table[i], table[i - 1],
+			    table[1], m, n0, n);
+	}
+
+	bits = BN_num_bits(p) - 1;
+	for (wvalue = 0, i = bits % BN_FIXED_WINDOW; i >= 0; i--, bits--)
+		wvalue = (wvalue << 1) + BN_is_bit_set(p, bits);
+	bn_fixed_select_words(acc, table, wvalue, n);
+
+	while (bits >= 0) {
+		for (wvalue = 0, i = 0; i < BN_FIXED_WINDOW; i++, bits--) {
+			bn_fixed_mont_mul_words(acc, acc, acc, m, n0, n);
+			wvalue = (wvalue << 1) + BN_is_bit_set(p, bits);
+		}
+		bn_fixed_select_words(tmp, table, wvalue, n);
+		bn_fixed_mont_mul_words(acc, acc, tmp, m, n0, n);
+	}
+
+	memcpy(r, acc, n * sizeof(BN_ULONG));
+
+	explicit_bzero(table, sizeof(table));
+	explicit_bzero(acc, sizeof(acc));
+	explicit_bzero(tmp, sizeof(tmp));
+}
+
+#define BN_FIXED_SIZE(bits, call)					\
+	case BN_FIXED_WORDS(bits):					\
+		call(BN_FIXED_WORDS(bits));				\
+		return
+
+#define BN_FIXED_DISPATCH(n, call) do {					\
+	switch (n) {							\
+	BN_FIXED_SIZE(256, call);					\
+	BN_FIXED_SIZE(384, call);					\
+	BN_FIXED_SIZE(521, call);					\
+	BN_FIXED_SIZE(1024, call);					\
+	BN_FIXED_SIZE(1536, call);					\
+	BN_FIXED_SIZE(2048, call);					\
+	BN_FIXED_SIZE(3072, call);					\
+	BN_FIXED_SIZE(4096, call);					\
+	}								\
+	call(n);							\
+} while (0)
+
+void
+bn_fixed_mont_mul(BN_ULONG *r, const BN_ULONG *a, const BN_ULONG *b,
+    const BN_ULONG *m, BN_ULONG n0, int n)
+{
+#define MONT_MUL(words) bn_fixed_mont_mul_words(r, a, b, m, n0, (words))
+	BN_FIXED_DISPATCH(n, MONT_MUL);
+#undef MONT_MUL
+}
+
+void
+bn_fixed_mod_exp_mont(BN_ULONG *r, const BN_ULONG *am, const BN_ULONG *one,
+    const BIGNUM *p, const BN_ULONG *m, BN_ULONG n0, int n)
+{
+#define MOD_EXP(words) bn_fixed_mod_exp_words(r, am, one, p, m, n0, (words))
+	BN_FIXED_DISPATCH(n, MOD_EXP);
+#undef MOD_EXP
+}
+
+#endif /* BN_FIXED */
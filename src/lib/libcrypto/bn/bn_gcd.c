@@ -109,6 +109,10 @@
  *
  */
 
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include <openssl/err.h>
 
 #include "bn_lcl.h"
@@ -247,6 +251,8 @@ err:
 /* solves ax == 1 (mod n) */
 static BIGNUM *BN_mod_inverse_no_branch(BIGNUM *in, const BIGNUM *a,
     const BIGNUM *n, BN_CTX *ctx);
+static BIGNUM *bn_mod_inverse_safegcd(BIGNUM *in, const BIGNUM *a,
+    const BIGNUM *n, BN_CTX *ctx);
 
 static BIGNUM *
 BN_mod_inverse_internal(BIGNUM *in, const BIGNUM *a, const BIGNUM *n, BN_CTX *ctx,
@@ -256,8 +262,11 @@ BN_mod_inverse_internal(BIGNUM *in, const BIGNUM *a, const BIGNUM *n, BN_CTX *ct
 	BIGNUM *ret = NULL;
 	int sign;
 
-	if (ct)
+	if (ct) {
+		if (BN_is_odd(n) && !BN_is_one(n))
+			return bn_mod_inverse_safegcd(in, a, n, ctx);
 		return BN_mod_inverse_no_branch(in, a, n, ctx);
+	}
 
 	bn_check_top(a);
 	bn_check_top(n);
@@ -560,6 +569,333 @@ BN_mod_inverse_ct(BIGNUM *in, const BIGNUM *a, const BIGNUM *n, BN_CTX *ctx)
 	return BN_mod_inverse_internal(in, a, n, ctx, 1);
 }
 
+/*
+ * Constant time inversion modulo an odd n, with the divsteps of Bernstein
+ * and Yang, "Fast constant-time gcd computation and modular inversion".
+ * Numbers are held in limbs of 30 bits, the top one signed, so that 30
+ * divsteps at a time can be collected in a 2x2 matrix of 32 bit entries
+ * working on the low limbs only, and then applied to the whole numbers with
+ * 64 bit products.  This is the formulation of libsecp256k1's modinv32, for
+ * moduli of any size.  The number of divsteps done depends only on the
+ * number of bits of n.
+ */
+
+#define BN_S30_BITS	30
+#define BN_S30_MASK	((int32_t)(UINT32_MAX >> 2))
+
+struct bn_s30_matrix {
+	int32_t u, v, q, r;
+};
+
+static void
+bn_s30_from_bn(int32_t *out, int len, const BIGNUM *a)
+{
+	BN_ULONG w;
+	int i, bit, word, shift;
+
+	for (i = 0; i < len; i++) {
+		bit = i * BN_S30_BITS;
+		word = bit / BN_BITS2;
+		shift = bit % BN_BITS2;
+		w = 0;
+		if (word < a->top)
+			w = a->d[word] >> shift;
+		if (shift > BN_BITS2 - BN_S30_BITS && word + 1 < a->top)
+			w |= a->d[word + 1] << (BN_BITS2 - shift);
+		out[i] = (int32_t)(w & BN_S30_MASK);
+	}
+}
+
+static int
+bn_s30_to_bn(BIGNUM *r, const int32_t *in, int len, int nwords)
+{
+	BN_ULONG w;
+	int i, bit, word, shift;
+
+	if (bn_wexpand(r, nwords) == NULL)
+		return 0;
+	memset(r->d, 0, nwords * sizeof(BN_ULONG));
+	for (i = 0; i < len; i++) {
+		w = (uint32_t)in[i];
+		bit = i * BN_S30_BITS;
+		word = bit / BN_BITS2;
+		shift = bit % BN_BITS2;
+		if (word < nwords)
+			r->d[word] |= w << shift;
+		if (shift > BN_BITS2 - BN_S30_BITS && word + 1 < nwords)
+			r->d[word + 1] |= w >> (BN_BITS2 - shift);
+	}
+	r->top = nwords;
+	r->neg = 0;
+	bn_correct_top(r);
+
+	return 1;
+}
+
+/*
+ * Do 30 divsteps on the low bits f0 and g0 of f and g, with eta = -delta.
+ * The transition matrix, scaled by 2^30, goes into t and the new eta is
+ * returned.
+ */
+static int32_t
+bn_s30_divsteps(int32_t eta, uint32_t f0, uint32_t g0,
+    struct bn_s30_matrix *t)
+{
+	uint32_t u = 1, v = 0, q = 0, r = 1;
+	uint32_t f = f0, g = g0, x, y, z;
+	uint32_t mask1, mask2;
+	volatile uint32_t c1, c2;
+	int i;
+
+	for (i = 0; i < BN_S30_BITS; i++) {
+		/* Masks for delta > 0 and for g being odd. */
+		c1 = eta >> 31;
+		mask1 = c1;
+		c2 = g & 1;
+		mask2 = -c2;
+
+		/* g += f, or g -= f if delta > 0, when g is odd. */
+		x = (f ^ mask1) - mask1;
+		y = (u ^ mask1) - mask1;
+		z = (v ^ mask1) - mask1;
+		g += x & mask2;
+		q += y & mask2;
+		r += z & mask2;
+
+		/* If delta > 0 and g is odd, delta = -delta and f = g. */
+		mask1 &= mask2;
+		eta = (eta ^ (int32_t)mask1) - (int32_t)mask1 - 1;
+		f += g & mask1;
+		u += q & mask1;
+		v += r & mask1;
+
+		g >>= 1;
+		u <<= 1;
+		v <<= 1;
+	}
+
+	t->u = (int32_t)u;
+	t->v = (int32_t)v;
+	t->q = (int32_t)q;
+	t->r = (int32_t)r;
+
+	return eta;
+}
+
+/* [f, g] = t * [f, g] / 2^30, which is exact. */
+static void
+bn_s30_update_fg(int32_t *f, int32_t *g, int len,
+    const struct bn_s30_matrix *t)
+{
+	int64_t cf, cg;
+	int i;
+
+	cf = (int64_t)t->u * f[0] + (int64_t)t->v * g[0];
+	cg = (int64_t)t->q * f[0] + (int64_t)t->r * g[0];
+	cf >>= BN_S30_BITS;
+	cg >>= BN_S30_BITS;
+	for (i = 1; i < len; i++) {
+		cf += (int64_t)t->u * f[i] + (int64_t)t->v * g[i];
+		cg += (int64_t)t->q * f[i] + (int64_t)t->r * g[i];
+		f[i - 1] = (int32_t)cf & BN_S30_MASK;
+		g[i - 1] = (int32_t)cg & BN_S30_MASK;
+		cf >>= BN_S30_BITS;
+		cg >>= BN_S30_BITS;
+	}
+	f[len - 1] = (int32_t)cf;
+	g[len - 1] = (int32_t)cg;
+}
+
+/*
+ * [d, e] = t * [d, e] / 2^30 modulo n, adding the multiple of n that makes
+ * the division exact.  d and e stay in the range (-2n, n).
+ */
+static void
+bn_s30_update_de(int32_t *d, int32_t *e, int len,
+    const struct bn_s30_matrix *t, const int32_t *n, uint32_t n_inv)
+{
+	int32_t md, me, sd, se;
+	int64_t cd, ce;
+	int i;
+
+	/* Start with [u, q] if d < 0, plus [v, r] if e < 0. */
+	sd = d[len - 1] >> 31;
+	se = e[len - 1] >> 31;
+	md = (t->u & sd) + (t->v & se);
+	me = (t->q & sd) + (t->r & se);
+
+	cd = (int64_t)t->u * d[0] + (int64_t)t->v * e[0];
+	ce = (int64_t)t->q * d[0] + (int64_t)t->r * e[0];
+
+	/* Pick md and me so that the low 30 bits of the sums are zero. */
+	md -= (n_inv * (uint32_t)cd + md) & BN_S30_MASK;
+	me -= (n_inv * (uint32_t)ce + me) & BN_S30_MASK;
+	cd += (int64_t)n[0] * md;
+	ce += (int64_t)n[0] * me;
+	cd >>= BN_S30_BITS;
+	ce >>= BN_S30_BITS;
+
+	for (i = 1; i < len; i++) {
+		cd += (int64_t)t->u * d[i] + (int64_t)t->v * e[i];
+		ce += (int64_t)t->q * d[i] + (int64_t)t->r * e[i];
+		cd += (int64_t)n[i] * md;
+		ce += (int64_t)n[i] * me;
+		d[i - 1] = (int32_t)cd & BN_S30_MASK;
+		e[i - 1] = (int32_t)ce & BN_S30_MASK;
+		cd >>= BN_S30_BITS;
+		ce >>= BN_S30_BITS;
+	}
+	d[len - 1] = (int32_t)cd;
+	e[len - 1] = (int32_t)ce;
+}
+
+static void
+bn_s30_propagate(int32_t *r, int len)
+{
+	int i;
+
+	for (i = 0; i < len - 1; i++) {
+		r[i + 1] += r[i] >> BN_S30_BITS;
+		r[i] &= BN_S30_MASK;
+	}
+}
+
+/* Bring r from (-2n, n) to [0, n), negating it if sign is negative. */
+static void
+bn_s30_normalize(int32_t *r, int len, int32_t sign, const int32_t *n)
+{
+	volatile int32_t cond_add, cond_negate;
+	int i;
+
+	cond_add = r[len - 1] >> 31;
+	for (i = 0; i < len; i++)
+		r[i] += n[i] & cond_add;
+	cond_negate = sign >> 31;
+	for (i = 0; i < len; i++)
+		r[i] = (r[i] ^ cond_negate) - cond_negate;
+	bn_s30_propagate(r, len);
+
+	cond_add = r[len - 1] >> 31;
+	for (i = 0; i < len; i++)
+		r[i] += n[i] & cond_add;
+	bn_s30_propagate(r, len);
+}
+
+/* Is f one or minus one? */
+static int
+bn_s30_is_unit(const int32_t *f, int len)
+{
+	int32_t neg, limb;
+	int64_t c = 0;
+	uint32_t acc = 0;
+	int i;
+
+	neg = f[len - 1] >> 31;
+	for (i = 0; i < len; i++) {
+		c += (f[i] ^ neg) - neg;
+		limb = (int32_t)c & BN_S30_MASK;
+		c >>= BN_S30_BITS;
+		acc |= i == 0 ? limb ^ 1 : limb;
+	}
+
+	return acc == 0 && c == 0;
+}
+
+static BIGNUM *
+bn_mod_inverse_safegcd(BIGNUM *in, const BIGNUM *a, const BIGNUM *n,
+    BN_CTX *ctx)
+{
+	struct bn_s30_matrix t;
+	int32_t *buf = NULL, *d, *e, *f, *g, *m;
+	BIGNUM *B, *R = NULL, *ret = NULL;
+	BIGNUM local_B, *pB;
+	uint32_t n_inv;
+	int32_t eta = -1;
+	int bits, len, steps, i;
+	size_t buf_len = 0;
+
+	bn_check_top(a);
+	bn_check_top(n);
+
+	BN_CTX_start(ctx);
+	if ((B = BN_CTX_get(ctx)) == NULL)
+		goto err;
+
+	if ((R = in) == NULL)
+		R = BN_new();
+	if (R == NULL)
+		goto err;
+
+	if (BN_copy(B, a) == NULL)
+		goto err;
+	if (B->neg || BN_ucmp(B, n) >= 0) {
+		pB = &local_B;
+		BN_with_flags(pB, B, BN_FLG_CONSTTIME);
+		if (!BN_nnmod(B, pB, n, ctx))
+			goto err;
+	}
+
+	bits = BN_num_bits(n);
+	len = bits / BN_S30_BITS + 1;
+	buf_len = 5 * (size_t)len;
+	if ((buf = calloc(buf_len, sizeof(*buf))) == NULL) {
+		BNerror(ERR_R_MALLOC_FAILURE);
+		goto err;
+	}
+	d = buf;
+	e = d + len;
+	f = e + len;
+	g = f + len;
+	m = g + len;
+
+	/* d = 0, e = 1, f = n, g = a. */
+	e[0] = 1;
+	bn_s30_from_bn(f, len, n);
+	bn_s30_from_bn(g, len, B);
+	bn_s30_from_bn(m, len, n);
+
+	/* n^-1 mod 2^30, by Newton iteration from 3 correct bits. */
+	n_inv = (uint32_t)m[0];
+	for (i = 0; i < 4; i++)
+		n_inv *= 2 - (uint32_t)m[0] * n_inv;
+	n_inv &= BN_S30_MASK;
+
+	/*
+	 * With 0 <= g < f < 2^bits, this many divsteps bring g to zero
+	 * (Bernstein and Yang, theorem 11.2).
+	 */
+	if (bits < 46)
+		steps = (49 * bits + 80) / 17;
+	else
+		steps = (49 * bits + 57) / 17;
+
+	for (i = 0; i < steps; i += BN_S30_BITS) {
+		eta = bn_s30_divsteps(eta, f[0], g[0], &t);
+		bn_s30_update_de(d, e, len, &t, m, n_inv);
+		bn_s30_update_fg(f, g, len, &t);
+	}
+
+	/* f is now plus or minus gcd(a, n), and d is f / a modulo n. */
+	if (!bn_s30_is_unit(f, len)) {
+		BNerror(BN_R_NO_INVERSE);
+		goto err;
+	}
+	bn_s30_normalize(d, len, f[len - 1], m);
+
+	if (!bn_s30_to_bn(R, d, len, n->top))
+		goto err;
+	ret = R;
+
+ err:
+	if (ret == NULL && in == NULL)
+		BN_free(R);
+	freezero(buf, buf_len * sizeof(*buf));
+	BN_CTX_end(ctx);
+	bn_check_top(ret);
+
+	return ret;
+}
+
 /* BN_mod_inverse_no_branch is a special version of BN_mod_inverse.
  * It does not contain branches that may leak sensitive information.
  */
@@ -239,6 +239,13 @@ __BEGIN_HIDDEN_DECLS
 	     : "r"(a), "r"(b));		\
 	ret;			})
 #  endif	/* compiler */
+# elif defined(__aarch64__)
+#  if defined(__GNUC__) && __GNUC__>=4
+#   define BN_UMULT_HIGH(a,b)		(((__uint128_t)(a)*(b))>>64)
+#   define BN_UMULT_LOHI(low,high,a,b) ({	\
+	__uint128_t ret=(__uint128_t)(a)*(b);	\
+	(high)=ret>>64; (low)=ret;	 })
+#  endif
 # elif defined(__x86_64) || defined(__x86_64__)
 #  if defined(__GNUC__) && __GNUC__>=2
 #   define BN_UMULT_HIGH(a,b)	({	\
@@ -609,5 +616,40 @@ int	BN_gcd_nonct(BIGNUM *r, const BIGNUM *a, const BIGNUM *b, BN_CTX *ctx);
 
 int	BN_swap_ct(BN_ULONG swap, BIGNUM *a, BIGNUM *b, size_t nwords);
 
+int	bn_generate_prime_threads(BIGNUM *ret, int bits, int nthreads);
+
+int	BN_mod_exp_mont_consttime_x2(BIGNUM *rr1, const BIGNUM *a1,
+    const BIGNUM *p1, const BIGNUM *m1, BN_MONT_CTX *in_mont1, BIGNUM *rr2,
+    const BIGNUM *a2, const BIGNUM *p2, const BIGNUM *m2,
+    BN_MONT_CTX *in_mont2, BN_CTX *ctx);
+
+/*
+ * Fixed width Montgomery multiplication and constant time exponentiation on
+ * word arrays, for moduli of up to BN_FIXED_MAX_BITS bits.
+ */
+#if defined(BN_LLONG) || defined(BN_UMULT_LOHI) || defined(BN_UMULT_HIGH)
+#define BN_FIXED
+#define BN_FIXED_MAX_BITS	4096
+#define BN_FIXED_MAX_WORDS	(BN_FIXED_MAX_BITS / BN_BITS2)
+void	bn_fixed_mont_mul(BN_ULONG *r, const BN_ULONG *a, const BN_ULONG *b,
+    const BN_ULONG *m, BN_ULONG n0, int n);
+void	bn_fixed_mod_exp_mont(BN_ULONG *r, const BN_ULONG *am,
+    const BN_ULONG *one, const BIGNUM *p, const BN_ULONG *m, BN_ULONG n0,
+    int n);
+#endif
+
+/*
+ * Dual constant time exponentiation with AVX-512 IFMA, for moduli of 1024,
+ * 1536 and 2048 bits.
+ */
+#if defined(OPENSSL_BN_IFMA) && (defined(__x86_64) || defined(__x86_64__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 8))
+#define BN_IFMA
+int	bn_mod_exp_ifma_x2_supported(const BIGNUM *m1, const BIGNUM *m2);
+int	bn_mod_exp_ifma_x2(BIGNUM *rr1, const BIGNUM *a1, const BIGNUM *p1,
+    const BIGNUM *m1, BIGNUM *rr2, const BIGNUM *a2, const BIGNUM *p2,
+    const BIGNUM *m2, BN_CTX *ctx);
+#endif
+
 __END_HIDDEN_DECLS
 #endif
@@ -147,6 +147,19 @@ BN_mod_mul_montgomery(BIGNUM *r, const BIGNUM *a, const BIGNUM *b,
 		}
 	}
 #endif
+#ifdef BN_FIXED
+	if (mont->N.top <= BN_FIXED_MAX_WORDS && mont->N.top > 0 &&
+	    a->top == mont->N.top && b->top == mont->N.top) {
+		if (bn_wexpand(r, mont->N.top) == NULL)
+			return (0);
+		bn_fixed_mont_mul(r->d, a->d, b->d, mont->N.d, mont->n0[0],
+		    mont->N.top);
+		r->neg = a->neg^b->neg;
+		r->top = mont->N.top;
+		bn_correct_top(r);
+		return (1);
+	}
+#endif
 
 	BN_CTX_start(ctx);
 	if ((tmp = BN_CTX_get(ctx)) == NULL)
@@ -505,34 +518,33 @@ BN_MONT_CTX_copy(BN_MONT_CTX *to, BN_MONT_CTX *from)
 	return (to);
 }
 
+/*
+ * Return the Montgomery context cached in *pmont, setting it up on first
+ * use. A new context is published with a compare and swap, so that looking
+ * up an existing one takes no lock and lock is no longer used. Threads that
+ * race to set it up each build a context and all but one discard theirs.
+ */
 BN_MONT_CTX *
 BN_MONT_CTX_set_locked(BN_MONT_CTX **pmont, int lock, const BIGNUM *mod,
     BN_CTX *ctx)
 {
-	int got_write_lock = 0;
-	BN_MONT_CTX *ret;
+	BN_MONT_CTX *mont;
 
-	CRYPTO_r_lock(lock);
-	if (!*pmont) {
-		CRYPTO_r_unlock(lock);
-		CRYPTO_w_lock(lock);
-		got_write_lock = 1;
-
-		if (!*pmont) {
-			ret = BN_MONT_CTX_new();
-			if (ret && !BN_MONT_CTX_set(ret, mod, ctx))
-				BN_MONT_CTX_free(ret);
-			else
-				*pmont = ret;
-		}
-	}
+	if ((mont = *pmont) != NULL)
+		return mont;
 
-	ret = *pmont;
+	if ((mont = BN_MONT_CTX_new()) == NULL)
+		return NULL;
+	if (!BN_MONT_CTX_set(mont, mod, ctx)) {
+		BN_MONT_CTX_free(mont);
+		return NULL;
+	}
 
-	if (got_write_lock)
-		CRYPTO_w_unlock(lock);
-	else
-		CRYPTO_r_unlock(lock);
+	if (!__sync_bool_compare_and_swap(pmont, NULL, mont)) {
+		/* Another thread got there first. */
+		BN_MONT_CTX_free(mont);
+		mont = *pmont;
+	}
 
-	return ret;
+	return mont;
 }
@@ -109,12 +109,16 @@
  *
  */
 
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #include <openssl/err.h>
 
 #include "bn_lcl.h"
+#include "cryptlib.h"
 
 /* NB: these functions have been "upgraded", the deprecated versions (which are
  * compatibility wrappers using these functions) are in bn_depr.c.
@@ -127,6 +131,27 @@
  */
 #include "bn_prime.h"
 
+/*
+ * Candidates without a preset residue are searched for in intervals of
+ * BN_SIEVE_SIZE odd numbers above a random base.  The residues of the start
+ * of the interval modulo the small primes are computed once per base and
+ * carried from one interval to the next by addition.  Each interval is then
+ * sieved with one pass per prime instead of dividing every candidate by
+ * every prime.  Below BN_SIEVE_MIN_BITS the small primes themselves are
+ * candidates, so the plain search is used.
+ */
+#define BN_SIEVE_SIZE		4096
+#define BN_SIEVE_MIN_BITS	32
+
+struct bn_sieve {
+	BIGNUM *base;
+	int bits;
+	BN_ULONG delta;			/* start of the interval above base */
+	int next;			/* next candidate in the interval */
+	prime_t mods[NUMPRIMES];	/* residues of base + delta */
+	unsigned char composite[BN_SIEVE_SIZE];
+};
+
 static int witness(BIGNUM *w, const BIGNUM *a, const BIGNUM *a1,
     const BIGNUM *a1_odd, int k, BN_CTX *ctx, BN_MONT_CTX *mont);
 static int probable_prime(BIGNUM *rnd, int bits);
@@ -134,6 +159,9 @@ static int probable_prime_dh(BIGNUM *rnd, int bits,
     const BIGNUM *add, const BIGNUM *rem, BN_CTX *ctx);
 static int probable_prime_dh_safe(BIGNUM *rnd, int bits,
     const BIGNUM *add, const BIGNUM *rem, BN_CTX *ctx);
+static int bn_sieve_next(struct bn_sieve *sieve, BIGNUM *rnd);
+static int bn_generate_prime(BIGNUM *ret, int bits, int safe,
+    const BIGNUM *add, const BIGNUM *rem, BN_GENCB *cb, volatile int *stop);
 
 int
 BN_GENCB_call(BN_GENCB *cb, int a, int b)
@@ -162,6 +190,18 @@ int
 BN_generate_prime_ex(BIGNUM *ret, int bits, int safe, const BIGNUM *add,
     const BIGNUM *rem, BN_GENCB *cb)
 {
+	return bn_generate_prime(ret, bits, safe, add, rem, cb, NULL);
+}
+
+/*
+ * The search of BN_generate_prime_ex().  If stop is not NULL, give up and
+ * return 0 without an error once it is set by another thread.
+ */
+static int
+bn_generate_prime(BIGNUM *ret, int bits, int safe, const BIGNUM *add,
+    const BIGNUM *rem, BN_GENCB *cb, volatile int *stop)
+{
+	struct bn_sieve *sieve = NULL;
 	BIGNUM *t;
 	int found = 0;
 	int i, j, c1 = 0;
@@ -184,11 +224,27 @@ BN_generate_prime_ex(BIGNUM *ret, int bits, int safe, const BIGNUM *add,
 	if ((t = BN_CTX_get(ctx)) == NULL)
 		goto err;
 
+	if (add == NULL && bits >= BN_SIEVE_MIN_BITS) {
+		if ((sieve = calloc(1, sizeof(*sieve))) == NULL) {
+			BNerror(ERR_R_MALLOC_FAILURE);
+			goto err;
+		}
+		if ((sieve->base = BN_CTX_get(ctx)) == NULL)
+			goto err;
+		sieve->bits = bits;
+	}
+
 	checks = BN_prime_checks_for_size(bits);
 
 loop:
+	if (stop != NULL && *stop)
+		goto err;
+
 	/* make a random number and set the top and bottom bits */
-	if (add == NULL) {
+	if (sieve != NULL) {
+		if (!bn_sieve_next(sieve, ret))
+			goto err;
+	} else if (add == NULL) {
 		if (!probable_prime(ret, bits))
 			goto err;
 	} else {
@@ -241,6 +297,7 @@ loop:
 	found = 1;
 
 err:
+	freezero(sieve, sizeof(*sieve));
 	if (ctx != NULL) {
 		BN_CTX_end(ctx);
 		BN_CTX_free(ctx);
@@ -249,6 +306,104 @@ err:
 	return found;
 }
 
+struct bn_prime_worker {
+	pthread_t thread;
+	BIGNUM *ret;
+	int bits;
+	volatile int *stop;
+	int found;
+};
+
+static void
+bn_prime_worker_task(void *arg)
+{
+	struct bn_prime_worker *w = arg;
+
+	w->found = bn_generate_prime(w->ret, w->bits, 0, NULL, NULL, NULL,
+	    w->stop);
+	if (w->found)
+		__sync_bool_compare_and_swap(w->stop, 0, 1);
+}
+
+static void *
+bn_prime_worker_run(void *arg)
+{
+	bn_prime_worker_task(arg);
+	ERR_remove_thread_state(NULL);
+
+	return NULL;
+}
+
+/*
+ * Generate a prime of the given size, as by BN_generate_prime_ex() without
+ * add, rem and safe, by running nthreads independent searches.  They run
+ * as tasks if the application has set up a thread pool, otherwise each in
+ * a thread of its own.  The first prime found is used and the other
+ * searches are stopped.  The searches make no callbacks.  If no thread can
+ * be started, the search is done in the calling thread.
+ */
+int
+bn_generate_prime_threads(BIGNUM *ret, int bits, int nthreads)
+{
+	struct bn_prime_worker *workers = NULL;
+	struct crypto_tasks *tasks;
+	volatile int stop = 0;
+	int i, started = 0, found = 0;
+
+	if (nthreads <= 1)
+		return BN_generate_prime_ex(ret, bits, 0, NULL, NULL, NULL);
+
+	if ((workers = calloc(nthreads, sizeof(*workers))) == NULL) {
+		BNerror(ERR_R_MALLOC_FAILURE);
+		return 0;
+	}
+	for (i = 0; i < nthreads; i++) {
+		if ((workers[i].ret = BN_new()) == NULL)
+			goto err;
+		workers[i].bits = bits;
+		workers[i].stop = &stop;
+	}
+
+	if (crypto_tasks_threads() > 0 &&
+	    (tasks = crypto_tasks_new()) != NULL) {
+		for (started = 0; started < nthreads; started++)
+			crypto_tasks_add(tasks, bn_prime_worker_task,
+			    &workers[started]);
+		crypto_tasks_free(tasks);
+		goto done;
+	}
+
+	for (started = 0; started < nthreads; started++) {
+		if (pthread_create(&workers[started].thread, NULL,
+		    bn_prime_worker_run, &workers[started]) != 0)
+			break;
+	}
+	if (started == 0) {
+		found = BN_generate_prime_ex(ret, bits, 0, NULL, NULL, NULL);
+		goto err;
+	}
+
+	for (i = 0; i < started; i++)
+		pthread_join(workers[i].thread, NULL);
+
+ done:
+	for (i = 0; i < started; i++) {
+		if (workers[i].found) {
+			found = BN_copy(ret, workers[i].ret) != NULL;
+			break;
+		}
+	}
+	if (i == started)
+		BNerror(ERR_R_BN_LIB);
+
+ err:
+	for (i = 0; i < nthreads; i++)
+		BN_clear_free(workers[i].ret);
+	free(workers);
+
+	return found;
+}
+
 int
 BN_is_prime_ex(const BIGNUM *a, int checks, BN_CTX *ctx_passed, BN_GENCB *cb)
 {
@@ -427,6 +582,92 @@ loop:
 	return (1);
 }
 
+/*
+ * Mark the candidates of the interval that are 0 or 1 modulo a small prime,
+ * as probable_prime() does.  Candidate j is base + delta + 2j, so for each
+ * prime the first marked candidates solve 2j = -mods or 1 - mods.
+ */
+static void
+bn_sieve_fill(struct bn_sieve *sieve)
+{
+	unsigned int p, half, j;
+	int i;
+
+	memset(sieve->composite, 0, sizeof(sieve->composite));
+	for (i = 1; i < NUMPRIMES; i++) {
+		p = primes[i];
+		half = (p + 1) / 2;	/* the inverse of 2 */
+		for (j = (p - sieve->mods[i]) % p * half % p;
+		    j < BN_SIEVE_SIZE; j += p)
+			sieve->composite[j] = 1;
+		for (j = (p + 1 - sieve->mods[i]) % p * half % p;
+		    j < BN_SIEVE_SIZE; j += p)
+			sieve->composite[j] = 1;
+	}
+	sieve->next = 0;
+}
+
+static int
+bn_sieve_new_base(struct bn_sieve *sieve)
+{
+	BN_ULONG mod;
+	int i;
+
+	if (!BN_rand(sieve->base, sieve->bits, 1, 1))
+		return 0;
+	for (i = 1; i < NUMPRIMES; i++) {
+		mod = BN_mod_word(sieve->base, (BN_ULONG)primes[i]);
+		if (mod == (BN_ULONG)-1)
+			return 0;
+		sieve->mods[i] = (prime_t)mod;
+	}
+	sieve->delta = 0;
+	bn_sieve_fill(sieve);
+
+	return 1;
+}
+
+/*
+ * Set rnd to the next candidate that survived the sieve, moving on to the
+ * next interval, or to a new base, as needed.
+ */
+static int
+bn_sieve_next(struct bn_sieve *sieve, BIGNUM *rnd)
+{
+	const BN_ULONG step = 2 * BN_SIEVE_SIZE;
+	int i;
+
+	if (BN_is_zero(sieve->base) && !bn_sieve_new_base(sieve))
+		return 0;
+
+	for (;;) {
+		while (sieve->next < BN_SIEVE_SIZE &&
+		    sieve->composite[sieve->next])
+			sieve->next++;
+		if (sieve->next < BN_SIEVE_SIZE) {
+			if (BN_copy(rnd, sieve->base) == NULL)
+				return 0;
+			if (!BN_add_word(rnd,
+			    sieve->delta + 2 * (BN_ULONG)sieve->next++))
+				return 0;
+			if (BN_num_bits(rnd) == sieve->bits)
+				break;
+		} else if (sieve->delta <= BN_MASK2 - 2 * step) {
+			sieve->delta += step;
+			for (i = 1; i < NUMPRIMES; i++)
+				sieve->mods[i] =
+				    (sieve->mods[i] + step) % primes[i];
+			bn_sieve_fill(sieve);
+			continue;
+		}
+		if (!bn_sieve_new_base(sieve))
+			return 0;
+	}
+	bn_check_top(rnd);
+
+	return 1;
+}
+
 static int
 probable_prime_dh(BIGNUM *rnd, int bits, const BIGNUM *add, const BIGNUM *rem,
     BN_CTX *ctx)
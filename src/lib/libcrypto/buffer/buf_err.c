@@ -65,18 +65,20 @@
 #include <openssl/err.h>
 #include <openssl/buffer.h>
 
+#include "cryptlib.h"
+
 /* BEGIN ERROR CODES */
 #ifndef OPENSSL_NO_ERR
 
 #define ERR_FUNC(func) ERR_PACK(ERR_LIB_BUF,func,0)
 #define ERR_REASON(reason) ERR_PACK(ERR_LIB_BUF,0,reason)
 
-static ERR_STRING_DATA BUF_str_functs[] = {
+static const ERR_STRING_DATA BUF_str_functs[] = {
 	{ERR_FUNC(0xfff), "CRYPTO_internal"},
 	{0, NULL}
 };
 
-static ERR_STRING_DATA BUF_str_reasons[] = {
+static const ERR_STRING_DATA BUF_str_reasons[] = {
 	{0, NULL}
 };
 
@@ -87,8 +89,8 @@ ERR_load_BUF_strings(void)
 {
 #ifndef OPENSSL_NO_ERR
 	if (ERR_func_error_string(BUF_str_functs[0].error) == NULL) {
-		ERR_load_strings(0, BUF_str_functs);
-		ERR_load_strings(0, BUF_str_reasons);
+		ERR_load_const_strings(BUF_str_functs);
+		ERR_load_const_strings(BUF_str_reasons);
 	}
 #endif
 }
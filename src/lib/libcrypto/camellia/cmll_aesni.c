@@ -0,0 +1,522 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Camellia on 16 blocks at a time in xmm registers, or 32 in ymm registers,
+ * with AES-NI and AVX2.
+ *
+ * The blocks are byte sliced: after a transpose, vector j holds byte j of
+ * each block, so that the F and FL functions become byte-wise operations on
+ * eight vectors. The s1 S-box is inversion in GF(2^8) between two affine
+ * maps, as is the AES S-box in another representation of the field. A
+ * lookup is therefore an affine map into the AES representation, AESENCLAST
+ * with a zero key, and an affine map back that also undoes the one of AES,
+ * each affine map being two 4 bit table lookups with PSHUFB. The rotations
+ * that make s2, s3 and s4 out of s1 are folded into the tables. AESENCLAST
+ * also applies ShiftRows, which moves bytes between lanes, so the input is
+ * shuffled by the inverse first. See Kivilinna, "Block Ciphers: Fast
+ * Implementations on x86-64 Architecture" (2013).
+ *
+ * The 32 block kernel uses VAES where available, and otherwise applies
+ * AESENCLAST to each half of the ymm registers.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <openssl/camellia.h>
+#include <openssl/crypto.h>
+#include <openssl/modes.h>
+
+#include "cmll_locl.h"
+
+#ifdef CAMELLIA_AESNI
+
+#include <immintrin.h>
+
+#include "x86_arch.h"
+
+#define CAMELLIA_AESNI_TARGET \
+	__attribute__((__target__("aes,avx2")))
+#define CAMELLIA_VAES_TARGET \
+	__attribute__((__target__("aes,avx2,vaes")))
+
+#define CAMELLIA_AESNI_MAX_BLOCKS	32
+
+/*
+ * The affine maps around the AES S-box, as tables for the low and the high
+ * nibble of a byte. The input map for s4 rotates left first and the output
+ * maps for s2 and s3 rotate the result of s1 left and right.
+ */
+static const uint8_t camellia_aesni_pre_s1[2][16] = {
+	{
+		0x08, 0x09, 0x11, 0x10, 0xb9, 0xb8, 0xa0, 0xa1,
+		0xa3, 0xa2, 0xba, 0xbb, 0x12, 0x13, 0x0b, 0x0a,
+	},
+	{
+		0x00, 0xa7, 0x93, 0x34, 0x61, 0xc6, 0xf2, 0x55,
+		0xd9, 0x7e, 0x4a, 0xed, 0xb8, 0x1f, 0x2b, 0x8c,
+	},
+};
+
+static const uint8_t camellia_aesni_pre_s4[2][16] = {
+	{
+		0x08, 0x11, 0xb9, 0xa0, 0xa3, 0xba, 0x12, 0x0b,
+		0xaf, 0xb6, 0x1e, 0x07, 0x04, 0x1d, 0xb5, 0xac,
+	},
+	{
+		0x00, 0x93, 0x61, 0xf2, 0xd9, 0x4a, 0xb8, 0x2b,
+		0x01, 0x92, 0x60, 0xf3, 0xd8, 0x4b, 0xb9, 0x2a,
+	},
+};
+
+static const uint8_t camellia_aesni_post_s1[2][16] = {
+	{
+		0x11, 0x82, 0x84, 0x17, 0x3e, 0xad, 0xab, 0x38,
+		0x71, 0xe2, 0xe4, 0x77, 0x5e, 0xcd, 0xcb, 0x58,
+	},
+	{
+		0x00, 0xb8, 0xd9, 0x61, 0xa0, 0x18, 0x79, 0xc1,
+		0xa8, 0x10, 0x71, 0xc9, 0x08, 0xb0, 0xd1, 0x69,
+	},
+};
+
+static const uint8_t camellia_aesni_post_s2[2][16] = {
+	{
+		0x22, 0x05, 0x09, 0x2e, 0x7c, 0x5b, 0x57, 0x70,
+		0xe2, 0xc5, 0xc9, 0xee, 0xbc, 0x9b, 0x97, 0xb0,
+	},
+	{
+		0x00, 0x71, 0xb3, 0xc2, 0x41, 0x30, 0xf2, 0x83,
+		0x51, 0x20, 0xe2, 0x93, 0x10, 0x61, 0xa3, 0xd2,
+	},
+};
+
+static const uint8_t camellia_aesni_post_s3[2][16] = {
+	{
+		0x88, 0x41, 0x42, 0x8b, 0x1f, 0xd6, 0xd5, 0x1c,
+		0xb8, 0x71, 0x72, 0xbb, 0x2f, 0xe6, 0xe5, 0x2c,
+	},
+	{
+		0x00, 0x5c, 0xec, 0xb0, 0x50, 0x0c, 0xbc, 0xe0,
+		0x54, 0x08, 0xb8, 0xe4, 0x04, 0x58, 0xe8, 0xb4,
+	},
+};
+
+static const uint8_t camellia_aesni_inv_shift_rows[16] = {
+	0x00, 0x0d, 0x0a, 0x07, 0x04, 0x01, 0x0e, 0x0b,
+	0x08, 0x05, 0x02, 0x0f, 0x0c, 0x09, 0x06, 0x03,
+};
+
+/*
+ * Operations on the vectors of each kernel. Vector i of the 32 block kernel
+ * holds block i in its low half and block i + 16 in its high half, which the
+ * byte unpacks keep apart.
+ */
+#define CAMELLIA_AESNI_X_LOAD(p, i) \
+	_mm_loadu_si128((const __m128i *)(p) + (i))
+#define CAMELLIA_AESNI_X_STORE(p, i, v) \
+	_mm_storeu_si128((__m128i *)(p) + (i), (v))
+#define CAMELLIA_AESNI_X_TABLE(t) \
+	_mm_loadu_si128((const __m128i *)(t))
+#define CAMELLIA_AESNI_X_BCAST(b)	_mm_set1_epi8((char)(b))
+#define CAMELLIA_AESNI_X_SHUFFLE(t, v)	_mm_shuffle_epi8((t), (v))
+#define CAMELLIA_AESNI_X_SRLI16(v, n)	_mm_srli_epi16((v), (n))
+#define CAMELLIA_AESNI_X_ADD8(a, b)	_mm_add_epi8((a), (b))
+#define CAMELLIA_AESNI_X_UNPACKLO(a, b)	_mm_unpacklo_epi8((a), (b))
+#define CAMELLIA_AESNI_X_UNPACKHI(a, b)	_mm_unpackhi_epi8((a), (b))
+#define CAMELLIA_AESNI_X_AESLAST(v) \
+	_mm_aesenclast_si128((v), _mm_setzero_si128())
+
+#define CAMELLIA_AESNI_Y_LOAD(p, i) \
+	_mm256_inserti128_si256(_mm256_castsi128_si256( \
+	    CAMELLIA_AESNI_X_LOAD(p, i)), CAMELLIA_AESNI_X_LOAD(p, (i) + 16), 1)
+#define CAMELLIA_AESNI_Y_STORE(p, i, v) do { \
+	CAMELLIA_AESNI_X_STORE(p, i, _mm256_castsi256_si128(v)); \
+	CAMELLIA_AESNI_X_STORE(p, (i) + 16, _mm256_extracti128_si256(v, 1)); \
+} while (0)
+#define CAMELLIA_AESNI_Y_TABLE(t) \
+	_mm256_broadcastsi128_si256(CAMELLIA_AESNI_X_TABLE(t))
+#define CAMELLIA_AESNI_Y_BCAST(b)	_mm256_set1_epi8((char)(b))
+#define CAMELLIA_AESNI_Y_SHUFFLE(t, v)	_mm256_shuffle_epi8((t), (v))
+#define CAMELLIA_AESNI_Y_SRLI16(v, n)	_mm256_srli_epi16((v), (n))
+#define CAMELLIA_AESNI_Y_ADD8(a, b)	_mm256_add_epi8((a), (b))
+#define CAMELLIA_AESNI_Y_UNPACKLO(a, b)	_mm256_unpacklo_epi8((a), (b))
+#define CAMELLIA_AESNI_Y_UNPACKHI(a, b)	_mm256_unpackhi_epi8((a), (b))
+#define CAMELLIA_AESNI_Y_AESLAST(v) \
+	_mm256_inserti128_si256(_mm256_castsi128_si256( \
+	    CAMELLIA_AESNI_X_AESLAST(_mm256_castsi256_si128(v))), \
+	    CAMELLIA_AESNI_X_AESLAST(_mm256_extracti128_si256(v, 1)), 1)
+
+#define CAMELLIA_AESNI_V_LOAD		CAMELLIA_AESNI_Y_LOAD
+#define CAMELLIA_AESNI_V_STORE		CAMELLIA_AESNI_Y_STORE
+#define CAMELLIA_AESNI_V_TABLE		CAMELLIA_AESNI_Y_TABLE
+#define CAMELLIA_AESNI_V_BCAST		CAMELLIA_AESNI_Y_BCAST
+#define CAMELLIA_AESNI_V_SHUFFLE	CAMELLIA_AESNI_Y_SHUFFLE
+#define CAMELLIA_AESNI_V_SRLI16		CAMELLIA_AESNI_Y_SRLI16
+#define CAMELLIA_AESNI_V_ADD8		CAMELLIA_AESNI_Y_ADD8
+#define CAMELLIA_AESNI_V_UNPACKLO	CAMELLIA_AESNI_Y_UNPACKLO
+#define CAMELLIA_AESNI_V_UNPACKHI	CAMELLIA_AESNI_Y_UNPACKHI
+#define CAMELLIA_AESNI_V_AESLAST(v) \
+	_mm256_aesenclast_epi128((v), _mm256_setzero_si256())
+
+#define CAMELLIA_AESNI_OP(p, op)	CAMELLIA_AESNI_##p##_##op
+
+/*
+ * Subkey word i at k. The amd64 key schedule in cmll-x86_64 stores the two
+ * halves of each 64 bit subkey swapped relative to camellia.c.
+ */
+#define CAMELLIA_AESNI_RK(k, i)	((k)[(i) ^ 1])
+
+/* Byte n of the big endian word w, in every lane. */
+#define CAMELLIA_AESNI_KEY(p, w, n) \
+	CAMELLIA_AESNI_OP(p, BCAST)(((w) >> (24 - 8 * (n))) & 0xff)
+
+/* An affine map, given as nibble tables. */
+#define CAMELLIA_AESNI_AFFINE(p, t, v) \
+	(CAMELLIA_AESNI_OP(p, SHUFFLE)((t)[0], (v) & m4) ^ \
+	    CAMELLIA_AESNI_OP(p, SHUFFLE)((t)[1], \
+	    CAMELLIA_AESNI_OP(p, SRLI16)((v), 4) & m4))
+
+#define CAMELLIA_AESNI_SBOX(p, r, v, pre, post) do { \
+	u = CAMELLIA_AESNI_OP(p, SHUFFLE)((v), isr); \
+	u = CAMELLIA_AESNI_AFFINE(p, pre, u); \
+	u = CAMELLIA_AESNI_OP(p, AESLAST)(u); \
+	(r) = CAMELLIA_AESNI_AFFINE(p, post, u); \
+} while (0)
+
+/*
+ * y ^= F(x, k), for the eight vectors at x and y and the two subkey words at
+ * k. The P function takes 16 xors, and leaves the halves of its output
+ * swapped.
+ */
+#define CAMELLIA_AESNI_F(p, x, y, k) do { \
+	CAMELLIA_AESNI_SBOX(p, t0, (x)[0] ^ CAMELLIA_AESNI_KEY(p, CAMELLIA_AESNI_RK(k, 0), 0), \
+	    pre1, post1); \
+	CAMELLIA_AESNI_SBOX(p, t1, (x)[1] ^ CAMELLIA_AESNI_KEY(p, CAMELLIA_AESNI_RK(k, 0), 1), \
+	    pre1, post2); \
+	CAMELLIA_AESNI_SBOX(p, t2, (x)[2] ^ CAMELLIA_AESNI_KEY(p, CAMELLIA_AESNI_RK(k, 0), 2), \
+	    pre1, post3); \
+	CAMELLIA_AESNI_SBOX(p, t3, (x)[3] ^ CAMELLIA_AESNI_KEY(p, CAMELLIA_AESNI_RK(k, 0), 3), \
+	    pre4, post1); \
+	CAMELLIA_AESNI_SBOX(p, t4, (x)[4] ^ CAMELLIA_AESNI_KEY(p, CAMELLIA_AESNI_RK(k, 1), 0), \
+	    pre1, post2); \
+	CAMELLIA_AESNI_SBOX(p, t5, (x)[5] ^ CAMELLIA_AESNI_KEY(p, CAMELLIA_AESNI_RK(k, 1), 1), \
+	    pre1, post3); \
+	CAMELLIA_AESNI_SBOX(p, t6, (x)[6] ^ CAMELLIA_AESNI_KEY(p, CAMELLIA_AESNI_RK(k, 1), 2), \
+	    pre4, post1); \
+	CAMELLIA_AESNI_SBOX(p, t7, (x)[7] ^ CAMELLIA_AESNI_KEY(p, CAMELLIA_AESNI_RK(k, 1), 3), \
+	    pre1, post1); \
+	t0 ^= t5; t1 ^= t6; t2 ^= t7; t3 ^= t4; \
+	t4 ^= t2; t5 ^= t3; t6 ^= t0; t7 ^= t1; \
+	t0 ^= t7; t1 ^= t4; t2 ^= t5; t3 ^= t6; \
+	t4 ^= t3; t5 ^= t0; t6 ^= t1; t7 ^= t2; \
+	(y)[0] ^= t4; (y)[1] ^= t5; (y)[2] ^= t6; (y)[3] ^= t7; \
+	(y)[4] ^= t0; (y)[5] ^= t1; (y)[6] ^= t2; (y)[7] ^= t3; \
+} while (0)
+
+/* y ^= (x & k) <<< 1, on the four vectors of 32 bit words at x and y. */
+#define CAMELLIA_AESNI_ROTL1(p, x, y, k) do { \
+	t0 = (x)[0] & CAMELLIA_AESNI_KEY(p, k, 0); \
+	t1 = (x)[1] & CAMELLIA_AESNI_KEY(p, k, 1); \
+	t2 = (x)[2] & CAMELLIA_AESNI_KEY(p, k, 2); \
+	t3 = (x)[3] & CAMELLIA_AESNI_KEY(p, k, 3); \
+	(y)[0] ^= CAMELLIA_AESNI_OP(p, ADD8)(t0, t0) | \
+	    (CAMELLIA_AESNI_OP(p, SRLI16)(t1, 7) & m1); \
+	(y)[1] ^= CAMELLIA_AESNI_OP(p, ADD8)(t1, t1) | \
+	    (CAMELLIA_AESNI_OP(p, SRLI16)(t2, 7) & m1); \
+	(y)[2] ^= CAMELLIA_AESNI_OP(p, ADD8)(t2, t2) | \
+	    (CAMELLIA_AESNI_OP(p, SRLI16)(t3, 7) & m1); \
+	(y)[3] ^= CAMELLIA_AESNI_OP(p, ADD8)(t3, t3) | \
+	    (CAMELLIA_AESNI_OP(p, SRLI16)(t0, 7) & m1); \
+} while (0)
+
+/* y ^= x | k, on the four vectors of 32 bit words at x and y. */
+#define CAMELLIA_AESNI_OR(p, x, y, k) do { \
+	(y)[0] ^= (x)[0] | CAMELLIA_AESNI_KEY(p, k, 0); \
+	(y)[1] ^= (x)[1] | CAMELLIA_AESNI_KEY(p, k, 1); \
+	(y)[2] ^= (x)[2] | CAMELLIA_AESNI_KEY(p, k, 2); \
+	(y)[3] ^= (x)[3] | CAMELLIA_AESNI_KEY(p, k, 3); \
+} while (0)
+
+/* The FL and inverse FL layer, as in Camellia_EncryptBlock_Rounds(). */
+#define CAMELLIA_AESNI_FL(p, k0, k1, k2, k3) do { \
+	CAMELLIA_AESNI_ROTL1(p, &s[0], &s[4], k0); \
+	CAMELLIA_AESNI_OR(p, &s[12], &s[8], k3); \
+	CAMELLIA_AESNI_OR(p, &s[4], &s[0], k1); \
+	CAMELLIA_AESNI_ROTL1(p, &s[8], &s[12], k2); \
+} while (0)
+
+/* Xor the 16 vectors at x with the four subkey words at k. */
+#define CAMELLIA_AESNI_WHITEN(p, x, k) do { \
+	for (i = 0; i < 16; i++) \
+		(x)[i] ^= CAMELLIA_AESNI_KEY(p, CAMELLIA_AESNI_RK(k, i / 4), i % 4); \
+} while (0)
+
+/*
+ * Transpose the 16 by 16 byte matrices in the vectors at x. Each round moves
+ * the bytes as a rotation of the eight bits of their row and column.
+ */
+#define CAMELLIA_AESNI_TRANSPOSE(p, x) do { \
+	int h_; \
+ \
+	for (h_ = 0; h_ < 4; h_++) { \
+		for (i = 0; i < 8; i++) { \
+			t[2 * i] = CAMELLIA_AESNI_OP(p, UNPACKLO)((x)[i], \
+			    (x)[i + 8]); \
+			t[2 * i + 1] = CAMELLIA_AESNI_OP(p, UNPACKHI)((x)[i], \
+			    (x)[i + 8]); \
+		} \
+		for (i = 0; i < 16; i++) \
+			(x)[i] = t[i]; \
+	} \
+} while (0)
+
+/*
+ * Encrypt or decrypt the 16 or 32 blocks at in to out, following
+ * Camellia_EncryptBlock_Rounds() and Camellia_DecryptBlock_Rounds().
+ */
+#define CAMELLIA_AESNI_BLOCKS(vec, p) do { \
+	const uint32_t *k = key->u.rd_key; \
+	const uint32_t *kend = k + key->grand_rounds * 16; \
+	vec pre1[2], pre4[2], post1[2], post2[2], post3[2]; \
+	vec isr, m1, m4; \
+	vec s[16], t[16], t0, t1, t2, t3, t4, t5, t6, t7, u; \
+	int i; \
+ \
+	pre1[0] = CAMELLIA_AESNI_OP(p, TABLE)(camellia_aesni_pre_s1[0]); \
+	pre1[1] = CAMELLIA_AESNI_OP(p, TABLE)(camellia_aesni_pre_s1[1]); \
+	pre4[0] = CAMELLIA_AESNI_OP(p, TABLE)(camellia_aesni_pre_s4[0]); \
+	pre4[1] = CAMELLIA_AESNI_OP(p, TABLE)(camellia_aesni_pre_s4[1]); \
+	post1[0] = CAMELLIA_AESNI_OP(p, TABLE)(camellia_aesni_post_s1[0]); \
+	post1[1] = CAMELLIA_AESNI_OP(p, TABLE)(camellia_aesni_post_s1[1]); \
+	post2[0] = CAMELLIA_AESNI_OP(p, TABLE)(camellia_aesni_post_s2[0]); \
+	post2[1] = CAMELLIA_AESNI_OP(p, TABLE)(camellia_aesni_post_s2[1]); \
+	post3[0] = CAMELLIA_AESNI_OP(p, TABLE)(camellia_aesni_post_s3[0]); \
+	post3[1] = CAMELLIA_AESNI_OP(p, TABLE)(camellia_aesni_post_s3[1]); \
+	isr = CAMELLIA_AESNI_OP(p, TABLE)(camellia_aesni_inv_shift_rows); \
+	m1 = CAMELLIA_AESNI_OP(p, BCAST)(0x01); \
+	m4 = CAMELLIA_AESNI_OP(p, BCAST)(0x0f); \
+ \
+	for (i = 0; i < 16; i++) \
+		s[i] = CAMELLIA_AESNI_OP(p, LOAD)(in, i); \
+	CAMELLIA_AESNI_TRANSPOSE(p, s); \
+ \
+	if (enc) { \
+		CAMELLIA_AESNI_WHITEN(p, s, k); \
+		for (k += 4;; k += 4) { \
+			CAMELLIA_AESNI_F(p, &s[0], &s[8], k + 0); \
+			CAMELLIA_AESNI_F(p, &s[8], &s[0], k + 2); \
+			CAMELLIA_AESNI_F(p, &s[0], &s[8], k + 4); \
+			CAMELLIA_AESNI_F(p, &s[8], &s[0], k + 6); \
+			CAMELLIA_AESNI_F(p, &s[0], &s[8], k + 8); \
+			CAMELLIA_AESNI_F(p, &s[8], &s[0], k + 10); \
+			k += 12; \
+			if (k == kend) \
+				break; \
+			CAMELLIA_AESNI_FL(p, CAMELLIA_AESNI_RK(k, 0), \
+			    CAMELLIA_AESNI_RK(k, 1), CAMELLIA_AESNI_RK(k, 2), \
+			    CAMELLIA_AESNI_RK(k, 3)); \
+		} \
+	} else { \
+		k = kend; \
+		kend = key->u.rd_key + 4; \
+		CAMELLIA_AESNI_WHITEN(p, s, k); \
+		for (;;) { \
+			k -= 12; \
+			CAMELLIA_AESNI_F(p, &s[0], &s[8], k + 10); \
+			CAMELLIA_AESNI_F(p, &s[8], &s[0], k + 8); \
+			CAMELLIA_AESNI_F(p, &s[0], &s[8], k + 6); \
+			CAMELLIA_AESNI_F(p, &s[8], &s[0], k + 4); \
+			CAMELLIA_AESNI_F(p, &s[0], &s[8], k + 2); \
+			CAMELLIA_AESNI_F(p, &s[8], &s[0], k + 0); \
+			if (k == kend) \
+				break; \
+			k -= 4; \
+			CAMELLIA_AESNI_FL(p, CAMELLIA_AESNI_RK(k, 2), \
+			    CAMELLIA_AESNI_RK(k, 3), CAMELLIA_AESNI_RK(k, 0), \
+			    CAMELLIA_AESNI_RK(k, 1)); \
+		} \
+		k -= 4; \
+	} \
+ \
+	/* The halves are swapped on output. */ \
+	for (i = 0; i < 8; i++) { \
+		t0 = s[i]; \
+		s[i] = s[i + 8]; \
+		s[i + 8] = t0; \
+	} \
+	CAMELLIA_AESNI_WHITEN(p, s, k); \
+	CAMELLIA_AESNI_TRANSPOSE(p, s); \
+	for (i = 0; i < 16; i++) \
+		CAMELLIA_AESNI_OP(p, STORE)(out, i, s[i]); \
+ \
+	explicit_bzero(s, sizeof(s)); \
+	explicit_bzero(t, sizeof(t)); \
+} while (0)
+
+static void CAMELLIA_AESNI_TARGET
+camellia_aesni_blocks16(const uint8_t *in, uint8_t *out,
+    const CAMELLIA_KEY *key, int enc)
+{
+	CAMELLIA_AESNI_BLOCKS(__m128i, X);
+}
+
+static void CAMELLIA_AESNI_TARGET
+camellia_aesni_blocks32(const uint8_t *in, uint8_t *out,
+    const CAMELLIA_KEY *key, int enc)
+{
+	CAMELLIA_AESNI_BLOCKS(__m256i, Y);
+}
+
+static void CAMELLIA_VAES_TARGET
+camellia_vaes_blocks32(const uint8_t *in, uint8_t *out,
+    const CAMELLIA_KEY *key, int enc)
+{
+	CAMELLIA_AESNI_BLOCKS(__m256i, V);
+}
+
+int
+camellia_aesni_capable(void)
+{
+	return (OPENSSL_cpu_caps() & (CPUCAP_MASK_AESNI | CPUCAP_MASK_AVX2)) ==
+	    (CPUCAP_MASK_AESNI | CPUCAP_MASK_AVX2);
+}
+
+/*
+ * Process as many of the blocks as the kernels take, returning the number of
+ * blocks done, which is a multiple of 16.
+ */
+static size_t
+camellia_aesni_kernels(const uint8_t *in, uint8_t *out, size_t blocks,
+    const CAMELLIA_KEY *key, int enc)
+{
+	int vaes = (OPENSSL_cpu_caps() & CPUCAP_MASK_VAES) != 0;
+	size_t done = 0;
+
+	for (; blocks - done >= 32; done += 32) {
+		if (vaes)
+			camellia_vaes_blocks32(in + done * CAMELLIA_BLOCK_SIZE,
+			    out + done * CAMELLIA_BLOCK_SIZE, key, enc);
+		else
+			camellia_aesni_blocks32(in + done * CAMELLIA_BLOCK_SIZE,
+			    out + done * CAMELLIA_BLOCK_SIZE, key, enc);
+	}
+	if (blocks - done >= 16) {
+		camellia_aesni_blocks16(in + done * CAMELLIA_BLOCK_SIZE,
+		    out + done * CAMELLIA_BLOCK_SIZE, key, enc);
+		done += 16;
+	}
+
+	return done;
+}
+
+void
+camellia_aesni_ecb_encrypt(const unsigned char *in, unsigned char *out,
+    size_t blocks, const CAMELLIA_KEY *key, int enc)
+{
+	size_t i;
+
+	for (i = camellia_aesni_kernels(in, out, blocks, key, enc);
+	    i < blocks; i++) {
+		if (enc)
+			Camellia_encrypt(in + i * CAMELLIA_BLOCK_SIZE,
+			    out + i * CAMELLIA_BLOCK_SIZE, key);
+		else
+			Camellia_decrypt(in + i * CAMELLIA_BLOCK_SIZE,
+			    out + i * CAMELLIA_BLOCK_SIZE, key);
+	}
+}
+
+/*
+ * CBC decryption, which unlike encryption does not chain the block cipher.
+ * The blocks of each group are decrypted into a buffer and the xor is done
+ * from the last block down, so that in may be the same as out.
+ */
+void
+camellia_aesni_cbc_decrypt(const unsigned char *in, unsigned char *out,
+    size_t blocks, const CAMELLIA_KEY *key, unsigned char *ivec)
+{
+	uint8_t buf[CAMELLIA_AESNI_MAX_BLOCKS * CAMELLIA_BLOCK_SIZE];
+	uint8_t iv[CAMELLIA_BLOCK_SIZE];
+	const uint8_t *prev;
+	size_t i, j, n;
+
+	while (blocks >= 16) {
+		n = blocks >= 32 ? 32 : 16;
+		camellia_aesni_kernels(in, buf, n, key, 0);
+		memcpy(iv, in + (n - 1) * CAMELLIA_BLOCK_SIZE, sizeof(iv));
+		for (i = n; i-- > 0;) {
+			prev = i > 0 ? in + (i - 1) * CAMELLIA_BLOCK_SIZE : ivec;
+			for (j = 0; j < CAMELLIA_BLOCK_SIZE; j++)
+				out[i * CAMELLIA_BLOCK_SIZE + j] =
+				    buf[i * CAMELLIA_BLOCK_SIZE + j] ^ prev[j];
+		}
+		memcpy(ivec, iv, sizeof(iv));
+
+		in += n * CAMELLIA_BLOCK_SIZE;
+		out += n * CAMELLIA_BLOCK_SIZE;
+		blocks -= n;
+	}
+	if (blocks > 0)
+		CRYPTO_cbc128_decrypt(in, out, blocks * CAMELLIA_BLOCK_SIZE,
+		    key, ivec, (block128_f)Camellia_decrypt);
+
+	explicit_bzero(buf, sizeof(buf));
+}
+
+/*
+ * A ctr128_f, for CRYPTO_ctr128_encrypt_ctr32(), which keeps the low 32 bits
+ * of the counter from wrapping within a call.
+ */
+void
+camellia_aesni_ctr32_encrypt_blocks(const unsigned char *in,
+    unsigned char *out, size_t blocks, const void *key,
+    const unsigned char ivec[16])
+{
+	uint8_t buf[CAMELLIA_AESNI_MAX_BLOCKS * CAMELLIA_BLOCK_SIZE];
+	uint8_t *b;
+	uint32_t ctr;
+	size_t i, n;
+
+	ctr = (uint32_t)ivec[12] << 24 | (uint32_t)ivec[13] << 16 |
+	    (uint32_t)ivec[14] << 8 | ivec[15];
+
+	while (blocks > 0) {
+		n = blocks < CAMELLIA_AESNI_MAX_BLOCKS ? blocks :
+		    CAMELLIA_AESNI_MAX_BLOCKS;
+		for (i = 0; i < n; i++, ctr++) {
+			b = buf + i * CAMELLIA_BLOCK_SIZE;
+			memcpy(b, ivec, 12);
+			b[12] = ctr >> 24;
+			b[13] = ctr >> 16;
+			b[14] = ctr >> 8;
+			b[15] = ctr;
+		}
+		camellia_aesni_ecb_encrypt(buf, buf, n, key, 1);
+		for (i = 0; i < n * CAMELLIA_BLOCK_SIZE; i++)
+			out[i] = in[i] ^ buf[i];
+
+		in += n * CAMELLIA_BLOCK_SIZE;
+		out += n * CAMELLIA_BLOCK_SIZE;
+		blocks -= n;
+	}
+
+	explicit_bzero(buf, sizeof(buf));
+}
+
+#endif
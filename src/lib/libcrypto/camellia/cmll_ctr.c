@@ -52,12 +52,21 @@
 #include <openssl/camellia.h>
 #include <openssl/modes.h>
 
+#include "cmll_locl.h"
+
 void
 Camellia_ctr128_encrypt(const unsigned char *in, unsigned char *out,
     size_t length, const CAMELLIA_KEY *key,
     unsigned char ivec[CAMELLIA_BLOCK_SIZE],
     unsigned char ecount_buf[CAMELLIA_BLOCK_SIZE], unsigned int *num)
 {
+#ifdef CAMELLIA_AESNI
+	if (camellia_aesni_capable()) {
+		CRYPTO_ctr128_encrypt_ctr32(in, out, length, key, ivec,
+		    ecount_buf, num, camellia_aesni_ctr32_encrypt_blocks);
+		return;
+	}
+#endif
 	CRYPTO_ctr128_encrypt(in, out, length, key, ivec, ecount_buf, num,
 	    (block128_f)Camellia_encrypt);
 }
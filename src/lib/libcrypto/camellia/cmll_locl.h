@@ -84,6 +84,24 @@ void Camellia_EncryptBlock(int keyBitLength, const u8 plaintext[],
 void Camellia_DecryptBlock(int keyBitLength, const u8 ciphertext[],
 	    const KEY_TABLE_TYPE keyTable, u8 plaintext[]);
 
+/*
+ * Camellia on 16 or 32 blocks at a time with AES-NI and AVX2, for ECB, CBC
+ * decryption and CTR.
+ */
+#if defined(OPENSSL_CAMELLIA_AESNI) && \
+    (defined(__x86_64) || defined(__x86_64__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 8))
+#define CAMELLIA_AESNI
+int camellia_aesni_capable(void);
+void camellia_aesni_ecb_encrypt(const unsigned char *in, unsigned char *out,
+	    size_t blocks, const CAMELLIA_KEY *key, int enc);
+void camellia_aesni_cbc_decrypt(const unsigned char *in, unsigned char *out,
+	    size_t blocks, const CAMELLIA_KEY *key, unsigned char *ivec);
+void camellia_aesni_ctr32_encrypt_blocks(const unsigned char *in,
+	    unsigned char *out, size_t blocks, const void *key,
+	    const unsigned char ivec[16]);
+#endif
+
 __END_HIDDEN_DECLS
 
 #endif /* #ifndef HEADER_CAMELLIA_LOCL_H */
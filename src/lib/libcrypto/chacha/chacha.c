@@ -16,11 +16,270 @@
  */
 
 #include <stdint.h>
+#include <string.h>
 
 #include <openssl/chacha.h>
+#include <openssl/crypto.h>
+
+#include "cryptlib.h"
 
 #include "chacha-merged.c"
 
+/*
+ * Multi-block kernels, built using compiler vector extensions. Each lane of a
+ * vector holds the state for a different block, with consecutive counters, so
+ * that the rounds run on several blocks at once. The kernels are selected at
+ * runtime, based on the capabilities of the CPU.
+ */
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 12)
+#if defined(__x86_64__)
+#include "x86_arch.h"
+#define CHACHA_VEC
+#define CHACHA_VEC_SSSE3
+#define CHACHA_VEC_AVX2
+#elif defined(__aarch64__) && defined(__AARCH64EL__) && \
+    defined(OPENSSL_CPUID_OBJ)
+#include "arm_arch.h"
+#define CHACHA_VEC
+#define CHACHA_VEC_NEON
+#endif
+#endif
+
+#ifdef CHACHA_VEC
+typedef uint32_t chacha_u32x4 __attribute__((__vector_size__(16)));
+typedef uint32_t chacha_u32x8 __attribute__((__vector_size__(32)));
+
+typedef uint8_t chacha_u8x16 __attribute__((__vector_size__(16)));
+typedef uint8_t chacha_u8x32 __attribute__((__vector_size__(32)));
+
+#define CHACHA_VEC_ROTATE(v, c) (((v) << (c)) | ((v) >> (32 - (c))))
+
+/* Rotations by whole bytes are performed as byte shuffles. */
+#define CHACHA_VEC_ROTATE16_X4(v) ((chacha_u32x4)__builtin_shufflevector( \
+	(chacha_u8x16)(v), (chacha_u8x16)(v), \
+	2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13))
+#define CHACHA_VEC_ROTATE8_X4(v) ((chacha_u32x4)__builtin_shufflevector( \
+	(chacha_u8x16)(v), (chacha_u8x16)(v), \
+	3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14))
+#define CHACHA_VEC_ROTATE16_X8(v) ((chacha_u32x8)__builtin_shufflevector( \
+	(chacha_u8x32)(v), (chacha_u8x32)(v), \
+	2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13, \
+	18, 19, 16, 17, 22, 23, 20, 21, 26, 27, 24, 25, 30, 31, 28, 29))
+#define CHACHA_VEC_ROTATE8_X8(v) ((chacha_u32x8)__builtin_shufflevector( \
+	(chacha_u8x32)(v), (chacha_u8x32)(v), \
+	3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14, \
+	19, 16, 17, 18, 23, 20, 21, 22, 27, 24, 25, 26, 31, 28, 29, 30))
+
+#define CHACHA_VEC_QUARTERROUND(a, b, c, d, rot16, rot8) \
+	a += b; d = rot16(d ^ a); \
+	c += d; b = CHACHA_VEC_ROTATE(b ^ c, 12); \
+	a += b; d = rot8(d ^ a); \
+	c += d; b = CHACHA_VEC_ROTATE(b ^ c, 7);
+
+#define CHACHA_VEC_SHUFFLE(a, b, i0, i1, i2, i3) \
+	__builtin_shufflevector(a, b, i0, i1, i2, i3)
+
+/*
+ * XOR four consecutive words from each of four blocks, given as a vector per
+ * word with a lane per block, transposing them to the order of the blocks.
+ */
+#define CHACHA_VEC_XOR4(a, b, c, d, in, out) do { \
+	chacha_u32x4 t0, t1, t2, t3, v; \
+	int l; \
+ \
+	t0 = CHACHA_VEC_SHUFFLE(a, b, 0, 4, 1, 5); \
+	t1 = CHACHA_VEC_SHUFFLE(a, b, 2, 6, 3, 7); \
+	t2 = CHACHA_VEC_SHUFFLE(c, d, 0, 4, 1, 5); \
+	t3 = CHACHA_VEC_SHUFFLE(c, d, 2, 6, 3, 7); \
+	a = CHACHA_VEC_SHUFFLE(t0, t2, 0, 1, 4, 5); \
+	b = CHACHA_VEC_SHUFFLE(t0, t2, 2, 3, 6, 7); \
+	c = CHACHA_VEC_SHUFFLE(t1, t3, 0, 1, 4, 5); \
+	d = CHACHA_VEC_SHUFFLE(t1, t3, 2, 3, 6, 7); \
+ \
+	for (l = 0; l < 4; l++) { \
+		memcpy(&v, (in) + l * CHACHA_BLOCKLEN, sizeof(v)); \
+		v ^= l == 0 ? a : l == 1 ? b : l == 2 ? c : d; \
+		memcpy((out) + l * CHACHA_BLOCKLEN, &v, sizeof(v)); \
+	} \
+} while (0)
+
+/*
+ * Encrypt blocks, which must be a multiple of the number of lanes, using the
+ * given state. The low 32 bits of the counter must not wrap.
+ */
+#define CHACHA_VEC_BLOCKS(vec, lanes, rot16, rot8) do { \
+	chacha_u32x4 a[lanes / 4], b[lanes / 4], c[lanes / 4], d[lanes / 4]; \
+	vec x[16], j[16]; \
+	int h, i, k; \
+ \
+	for (i = 0; i < 16; i++) \
+		j[i] = (vec){ 0 } + input[i]; \
+	for (k = 0; k < lanes; k++) \
+		j[12][k] += k; \
+ \
+	for (; blocks >= lanes; blocks -= lanes) { \
+		for (i = 0; i < 16; i++) \
+			x[i] = j[i]; \
+		for (i = 20; i > 0; i -= 2) { \
+			CHACHA_VEC_QUARTERROUND(x[0], x[4], x[8], x[12], \
+			    rot16, rot8) \
+			CHACHA_VEC_QUARTERROUND(x[1], x[5], x[9], x[13], \
+			    rot16, rot8) \
+			CHACHA_VEC_QUARTERROUND(x[2], x[6], x[10], x[14], \
+			    rot16, rot8) \
+			CHACHA_VEC_QUARTERROUND(x[3], x[7], x[11], x[15], \
+			    rot16, rot8) \
+			CHACHA_VEC_QUARTERROUND(x[0], x[5], x[10], x[15], \
+			    rot16, rot8) \
+			CHACHA_VEC_QUARTERROUND(x[1], x[6], x[11], x[12], \
+			    rot16, rot8) \
+			CHACHA_VEC_QUARTERROUND(x[2], x[7], x[8], x[13], \
+			    rot16, rot8) \
+			CHACHA_VEC_QUARTERROUND(x[3], x[4], x[9], x[14], \
+			    rot16, rot8) \
+		} \
+		for (i = 0; i < 16; i += 4) { \
+			x[i] += j[i]; \
+			x[i + 1] += j[i + 1]; \
+			x[i + 2] += j[i + 2]; \
+			x[i + 3] += j[i + 3]; \
+			memcpy(a, &x[i], sizeof(a)); \
+			memcpy(b, &x[i + 1], sizeof(b)); \
+			memcpy(c, &x[i + 2], sizeof(c)); \
+			memcpy(d, &x[i + 3], sizeof(d)); \
+			for (h = 0; h < lanes / 4; h++) { \
+				CHACHA_VEC_XOR4(a[h], b[h], c[h], d[h], \
+				    in + h * 4 * CHACHA_BLOCKLEN + i * 4, \
+				    out + h * 4 * CHACHA_BLOCKLEN + i * 4); \
+			} \
+		} \
+		in += lanes * CHACHA_BLOCKLEN; \
+		out += lanes * CHACHA_BLOCKLEN; \
+		j[12] += lanes; \
+	} \
+ \
+	explicit_bzero(a, sizeof(a)); \
+	explicit_bzero(b, sizeof(b)); \
+	explicit_bzero(c, sizeof(c)); \
+	explicit_bzero(d, sizeof(d)); \
+	explicit_bzero(x, sizeof(x)); \
+} while (0)
+
+#ifdef CHACHA_VEC_SSSE3
+static void __attribute__((__target__("ssse3")))
+chacha_blocks_ssse3(const uint32_t input[16], uint8_t *out, const uint8_t *in,
+    size_t blocks)
+{
+	CHACHA_VEC_BLOCKS(chacha_u32x4, 4, CHACHA_VEC_ROTATE16_X4,
+	    CHACHA_VEC_ROTATE8_X4);
+}
+#endif
+
+#ifdef CHACHA_VEC_AVX2
+static void __attribute__((__target__("avx2")))
+chacha_blocks_avx2(const uint32_t input[16], uint8_t *out, const uint8_t *in,
+    size_t blocks)
+{
+	CHACHA_VEC_BLOCKS(chacha_u32x8, 8, CHACHA_VEC_ROTATE16_X8,
+	    CHACHA_VEC_ROTATE8_X8);
+}
+#endif
+
+#ifdef CHACHA_VEC_NEON
+static void
+chacha_blocks_neon(const uint32_t input[16], uint8_t *out, const uint8_t *in,
+    size_t blocks)
+{
+	CHACHA_VEC_BLOCKS(chacha_u32x4, 4, CHACHA_VEC_ROTATE16_X4,
+	    CHACHA_VEC_ROTATE8_X4);
+}
+#endif
+
+/*
+ * Encrypt as many whole blocks as the available kernels allow, advancing
+ * the counter and returning the number of bytes that have been processed.
+ */
+#define CHACHA_VEC_ADVANCE(n) do { \
+	x->input[12] += (n); \
+	m += (n) * CHACHA_BLOCKLEN; \
+	c += (n) * CHACHA_BLOCKLEN; \
+	done += (n); \
+	blocks -= (n); \
+} while (0)
+
+static size_t
+chacha_encrypt_blocks(chacha_ctx *x, const uint8_t *m, uint8_t *c, size_t len)
+{
+	size_t blocks, done = 0, n;
+
+	/* The kernels only handle the low 32 bits of the counter. */
+	blocks = len / CHACHA_BLOCKLEN;
+	if (blocks > 0x100000000ULL - x->input[12])
+		blocks = 0x100000000ULL - x->input[12];
+
+#ifdef CHACHA_VEC_AVX2
+	if ((OPENSSL_cpu_caps() & CPUCAP_MASK_AVX2) != 0 && blocks >= 8) {
+		n = blocks & ~7;
+		chacha_blocks_avx2(x->input, c, m, n);
+		CHACHA_VEC_ADVANCE(n);
+	}
+#endif
+#ifdef CHACHA_VEC_SSSE3
+	if ((OPENSSL_cpu_caps() & CPUCAP_MASK_SSSE3) != 0 && blocks >= 4) {
+		n = blocks & ~3;
+		chacha_blocks_ssse3(x->input, c, m, n);
+		CHACHA_VEC_ADVANCE(n);
+	}
+#endif
+#ifdef CHACHA_VEC_NEON
+	if ((OPENSSL_armcap_P & ARMV7_NEON) != 0 && blocks >= 4) {
+		n = blocks & ~3;
+		chacha_blocks_neon(x->input, c, m, n);
+		CHACHA_VEC_ADVANCE(n);
+	}
+#endif
+
+	/* Carry into the high 32 bits, when the low 32 bits have wrapped. */
+	if (done > 0 && x->input[12] == 0)
+		x->input[13]++;
+
+	return done * CHACHA_BLOCKLEN;
+}
+#endif
+
+const char *
+chacha_implementation(void)
+{
+#ifdef CHACHA_VEC_AVX2
+	if ((OPENSSL_cpu_caps() & CPUCAP_MASK_AVX2) != 0)
+		return "avx2";
+#endif
+#ifdef CHACHA_VEC_SSSE3
+	if ((OPENSSL_cpu_caps() & CPUCAP_MASK_SSSE3) != 0)
+		return "ssse3";
+#endif
+#ifdef CHACHA_VEC_NEON
+	if ((OPENSSL_armcap_P & ARMV7_NEON) != 0)
+		return "neon";
+#endif
+	return "c";
+}
+
+static void
+chacha_encrypt(chacha_ctx *x, const uint8_t *m, uint8_t *c, size_t len)
+{
+#ifdef CHACHA_VEC
+	size_t n;
+
+	n = chacha_encrypt_blocks(x, m, c, len);
+	m += n;
+	c += n;
+	len -= n;
+#endif
+
+	chacha_encrypt_bytes(x, m, c, (uint32_t)len);
+}
+
 void
 ChaCha_set_key(ChaCha_ctx *ctx, const unsigned char *key, uint32_t keybits)
 {
@@ -52,7 +311,7 @@ ChaCha(ChaCha_ctx *ctx, unsigned char *out, const unsigned char *in, size_t len)
 		len -= l;
 	}
 
-	chacha_encrypt_bytes((chacha_ctx *)ctx, in, out, (uint32_t)len);
+	chacha_encrypt((chacha_ctx *)ctx, in, out, len);
 }
 
 void
@@ -73,7 +332,7 @@ CRYPTO_chacha_20(unsigned char *out, const unsigned char *in, size_t len,
 		ctx.input[13] = (uint32_t)(counter >> 32);
 	}
 
-	chacha_encrypt_bytes(&ctx, in, out, (uint32_t)len);
+	chacha_encrypt(&ctx, in, out, len);
 }
 
 void
@@ -57,6 +57,15 @@
 
 #include <openssl/cmac.h>
 
+/*
+ * CMAC_batch() with AES-NI, for AES keys expanded by the AES-NI key
+ * schedule.
+ */
+#if defined(AES_ASM) && (defined(__x86_64) || defined(__x86_64__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 8))
+#define CMAC_AESNI
+#endif
+
 struct CMAC_CTX_st {
 	/* Cipher context to use */
 	EVP_CIPHER_CTX cctx;
@@ -279,3 +288,219 @@ CMAC_resume(CMAC_CTX *ctx)
 	 */
 	return EVP_EncryptInit_ex(&ctx->cctx, NULL, NULL, NULL, ctx->tbl);
 }
+
+#ifdef CMAC_AESNI
+#include <immintrin.h>
+
+#include <openssl/aes.h>
+
+#include "x86_arch.h"
+
+int aesni_set_encrypt_key(const unsigned char *userKey, int bits,
+    AES_KEY *key);
+
+/*
+ * AES-CMAC of eight messages at a time, each lane having its own key, so
+ * that the latency of the AES instructions is hidden behind the other
+ * lanes. A lane first encrypts the zero block to get its subkeys and then
+ * the blocks of its message, and takes the next message as soon as it is
+ * done with the previous one. Idle lanes encrypt zeroes.
+ */
+#define CMAC_AESNI_TARGET \
+	__attribute__((__target__("aes,sse2")))
+
+#define CMAC_AESNI_LANES	8
+
+#define CMAC_AESNI_LOAD(p, i) \
+	_mm_loadu_si128((const __m128i *)(p) + (i))
+#define CMAC_AESNI_STORE(p, i, v) \
+	_mm_storeu_si128((__m128i *)(p) + (i), (v))
+
+#define CMAC_AESNI_RK(k, r) \
+	CMAC_AESNI_LOAD(lane[k].ks.rd_key, r)
+
+#define CMAC_AESNI_ROUND(f, r) do { \
+	b0 = f(b0, CMAC_AESNI_RK(0, r)); b1 = f(b1, CMAC_AESNI_RK(1, r)); \
+	b2 = f(b2, CMAC_AESNI_RK(2, r)); b3 = f(b3, CMAC_AESNI_RK(3, r)); \
+	b4 = f(b4, CMAC_AESNI_RK(4, r)); b5 = f(b5, CMAC_AESNI_RK(5, r)); \
+	b6 = f(b6, CMAC_AESNI_RK(6, r)); b7 = f(b7, CMAC_AESNI_RK(7, r)); \
+} while (0)
+
+/* Xor the input of lane k into its chaining value and the first round key. */
+#define CMAC_AESNI_START(k) \
+	b##k = _mm_xor_si128(_mm_xor_si128(CMAC_AESNI_LOAD(c[k], 0), \
+	    cmac_aesni_lane_input(&lane[k], count)), CMAC_AESNI_RK(k, 0))
+
+struct cmac_aesni_lane {
+	AES_KEY ks;
+	const unsigned char *in;	/* Blocks before the last one. */
+	size_t blocks;
+	size_t rem;			/* Length of the last block. */
+	size_t msg;
+	int subkeys;			/* Encrypting the zero block. */
+	unsigned char last[16];		/* Last block, with K1 or K2. */
+};
+
+static void
+cmac_aesni_lane_start(struct cmac_aesni_lane *lane, const void *key,
+    int bits, const void *d, size_t n, size_t msg)
+{
+	aesni_set_encrypt_key(key, bits, &lane->ks);
+	lane->in = d;
+	lane->blocks = n > 0 ? (n - 1) / 16 : 0;
+	lane->rem = n - lane->blocks * 16;
+	lane->msg = msg;
+	lane->subkeys = 1;
+}
+
+/*
+ * Make the last block from the encrypted zero block in l, as CMAC_Final()
+ * does, once the lane has its subkeys.
+ */
+static void
+cmac_aesni_lane_last(struct cmac_aesni_lane *lane, unsigned char l[16])
+{
+	unsigned char k1[16], k2[16];
+	const unsigned char *p = lane->in + lane->blocks * 16;
+	int i;
+
+	make_kn(k1, l, 16);
+	if (lane->rem == 16) {
+		for (i = 0; i < 16; i++)
+			lane->last[i] = p[i] ^ k1[i];
+	} else {
+		make_kn(k2, k1, 16);
+		memset(lane->last, 0, sizeof(lane->last));
+		memcpy(lane->last, p, lane->rem);
+		lane->last[lane->rem] = 0x80;
+		for (i = 0; i < 16; i++)
+			lane->last[i] ^= k2[i];
+		explicit_bzero(k2, sizeof(k2));
+	}
+	lane->subkeys = 0;
+
+	explicit_bzero(k1, sizeof(k1));
+}
+
+static __m128i CMAC_AESNI_TARGET
+cmac_aesni_lane_input(const struct cmac_aesni_lane *lane, size_t count)
+{
+	if (lane->msg == count || lane->subkeys)
+		return _mm_setzero_si128();
+	if (lane->blocks > 0)
+		return CMAC_AESNI_LOAD(lane->in, 0);
+	return CMAC_AESNI_LOAD(lane->last, 0);
+}
+
+static void CMAC_AESNI_TARGET
+cmac_aesni_batch(int bits, const void *const *key, const void *const *d,
+    const size_t *n, unsigned char *const *out, size_t count)
+{
+	struct cmac_aesni_lane lane[CMAC_AESNI_LANES];
+	unsigned char c[CMAC_AESNI_LANES][16];
+	__m128i b0, b1, b2, b3, b4, b5, b6, b7;
+	size_t next = 0;
+	int active = 0;
+	int k, r, rounds;
+
+	memset(lane, 0, sizeof(lane));
+	memset(c, 0, sizeof(c));
+
+	for (k = 0; k < CMAC_AESNI_LANES; k++) {
+		lane[k].msg = count;
+		if (next < count) {
+			cmac_aesni_lane_start(&lane[k], key[next], bits,
+			    d[next], n[next], next);
+			next++;
+			active++;
+		}
+	}
+	rounds = lane[0].ks.rounds;
+
+	while (active > 0) {
+		CMAC_AESNI_START(0); CMAC_AESNI_START(1);
+		CMAC_AESNI_START(2); CMAC_AESNI_START(3);
+		CMAC_AESNI_START(4); CMAC_AESNI_START(5);
+		CMAC_AESNI_START(6); CMAC_AESNI_START(7);
+		for (r = 1; r <= rounds; r++)
+			CMAC_AESNI_ROUND(_mm_aesenc_si128, r);
+		CMAC_AESNI_ROUND(_mm_aesenclast_si128, r);
+		CMAC_AESNI_STORE(c[0], 0, b0); CMAC_AESNI_STORE(c[1], 0, b1);
+		CMAC_AESNI_STORE(c[2], 0, b2); CMAC_AESNI_STORE(c[3], 0, b3);
+		CMAC_AESNI_STORE(c[4], 0, b4); CMAC_AESNI_STORE(c[5], 0, b5);
+		CMAC_AESNI_STORE(c[6], 0, b6); CMAC_AESNI_STORE(c[7], 0, b7);
+
+		for (k = 0; k < CMAC_AESNI_LANES; k++) {
+			if (lane[k].msg == count)
+				continue;
+			if (lane[k].subkeys) {
+				cmac_aesni_lane_last(&lane[k], c[k]);
+				memset(c[k], 0, sizeof(c[k]));
+				continue;
+			}
+			if (lane[k].blocks > 0) {
+				lane[k].in += 16;
+				lane[k].blocks--;
+				continue;
+			}
+
+			memcpy(out[lane[k].msg], c[k], 16);
+			memset(c[k], 0, sizeof(c[k]));
+
+			lane[k].msg = count;
+			active--;
+			if (next < count) {
+				cmac_aesni_lane_start(&lane[k], key[next],
+				    bits, d[next], n[next], next);
+				next++;
+				active++;
+			}
+		}
+	}
+
+	explicit_bzero(lane, sizeof(lane));
+	explicit_bzero(c, sizeof(c));
+}
+#endif
+
+/*
+ * CMAC of count messages, each with its own key. AES is done several
+ * messages at a time with AES-NI where available. Other ciphers reuse a
+ * single context for all messages.
+ */
+int
+CMAC_batch(const EVP_CIPHER *cipher, const void *const *key, size_t keylen,
+    const void *const *d, const size_t *n, unsigned char *const *out,
+    size_t count)
+{
+	CMAC_CTX ctx;
+	size_t i, len;
+	int ret = 0;
+
+#ifdef CMAC_AESNI
+	if ((OPENSSL_cpu_caps() & CPUCAP_MASK_AESNI) != 0 &&
+	    (cipher == EVP_aes_128_cbc() || cipher == EVP_aes_192_cbc() ||
+	    cipher == EVP_aes_256_cbc()) &&
+	    keylen == (size_t)EVP_CIPHER_key_length(cipher)) {
+		cmac_aesni_batch(keylen * 8, key, d, n, out, count);
+		return 1;
+	}
+#endif
+
+	EVP_CIPHER_CTX_init(&ctx.cctx);
+	ctx.nlast_block = -1;
+	if (!CMAC_Init(&ctx, NULL, 0, cipher, NULL))
+		goto err;
+	for (i = 0; i < count; i++) {
+		if (!CMAC_Init(&ctx, key[i], keylen, NULL, NULL))
+			goto err;
+		if (!CMAC_Update(&ctx, d[i], n[i]))
+			goto err;
+		if (!CMAC_Final(&ctx, out[i], &len))
+			goto err;
+	}
+	ret = 1;
+err:
+	CMAC_CTX_cleanup(&ctx);
+	return ret;
+}
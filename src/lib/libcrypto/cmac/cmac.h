@@ -75,6 +75,9 @@ int CMAC_Init(CMAC_CTX *ctx, const void *key, size_t keylen,
 int CMAC_Update(CMAC_CTX *ctx, const void *data, size_t dlen);
 int CMAC_Final(CMAC_CTX *ctx, unsigned char *out, size_t *poutlen);
 int CMAC_resume(CMAC_CTX *ctx);
+int CMAC_batch(const EVP_CIPHER *cipher, const void *const *key, size_t keylen,
+    const void *const *d, const size_t *n, unsigned char *const *out,
+    size_t count);
 
 #ifdef  __cplusplus
 }
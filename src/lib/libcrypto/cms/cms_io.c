@@ -164,3 +164,10 @@ SMIME_read_CMS(BIO *bio, BIO **bcont)
 	return (CMS_ContentInfo *)SMIME_read_ASN1(bio, bcont,
 	    &CMS_ContentInfo_it);
 }
+
+CMS_ContentInfo *
+SMIME_read_CMS_stream(BIO *bio, BIO **bcont)
+{
+	return (CMS_ContentInfo *)SMIME_read_ASN1_stream(bio, bcont,
+	    &CMS_ContentInfo_it);
+}
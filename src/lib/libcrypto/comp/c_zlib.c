@@ -1,4 +1,5 @@
 /* $OpenBSD: c_zlib.c,v 1.20 2018/03/17 16:20:01 beck Exp $ */
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,6 +8,7 @@
 #include <openssl/err.h>
 
 COMP_METHOD *COMP_zlib(void );
+COMP_METHOD *COMP_zlib_oneshot(void );
 
 static COMP_METHOD zlib_method_nozlib = {
 	.type = NID_undef,
@@ -23,6 +25,10 @@ static int zlib_stateful_compress_block(COMP_CTX *ctx, unsigned char *out,
     unsigned int olen, unsigned char *in, unsigned int ilen);
 static int zlib_stateful_expand_block(COMP_CTX *ctx, unsigned char *out,
     unsigned int olen, unsigned char *in, unsigned int ilen);
+static int zlib_oneshot_compress_block(COMP_CTX *ctx, unsigned char *out,
+    unsigned int olen, unsigned char *in, unsigned int ilen);
+static int zlib_oneshot_expand_block(COMP_CTX *ctx, unsigned char *out,
+    unsigned int olen, unsigned char *in, unsigned int ilen);
 
 
 /* memory allocations functions for zlib intialization */
@@ -47,6 +53,17 @@ static COMP_METHOD zlib_stateful_method = {
 	.expand = zlib_stateful_expand_block
 };
 
+/*
+ * Each block is a complete zlib stream, as used for certificate compression
+ * (RFC 8879).  No state is kept between blocks.
+ */
+static COMP_METHOD zlib_oneshot_method = {
+	.type = NID_zlib_compression,
+	.name = LN_zlib_compression,
+	.compress = zlib_oneshot_compress_block,
+	.expand = zlib_oneshot_expand_block
+};
+
 struct zlib_state {
 	z_stream istream;
 	z_stream ostream;
@@ -169,6 +186,34 @@ zlib_stateful_expand_block(COMP_CTX *ctx, unsigned char *out,
 	return olen - state->istream.avail_out;
 }
 
+static int
+zlib_oneshot_compress_block(COMP_CTX *ctx, unsigned char *out,
+    unsigned int olen, unsigned char *in, unsigned int ilen)
+{
+	uLongf len = olen;
+
+	if (compress2(out, &len, in, ilen, Z_DEFAULT_COMPRESSION) != Z_OK)
+		return -1;
+	if (len > INT_MAX)
+		return -1;
+
+	return len;
+}
+
+static int
+zlib_oneshot_expand_block(COMP_CTX *ctx, unsigned char *out,
+    unsigned int olen, unsigned char *in, unsigned int ilen)
+{
+	uLongf len = olen;
+
+	if (uncompress(out, &len, in, ilen) != Z_OK)
+		return -1;
+	if (len > INT_MAX)
+		return -1;
+
+	return len;
+}
+
 #endif
 
 COMP_METHOD *
@@ -203,6 +248,19 @@ err:
 	return (meth);
 }
 
+COMP_METHOD *
+COMP_zlib_oneshot(void)
+{
+	COMP_METHOD *meth = &zlib_method_nozlib;
+
+#ifdef ZLIB
+	if (OPENSSL_init_crypto(0, NULL))
+		meth = &zlib_oneshot_method;
+#endif
+
+	return (meth);
+}
+
 void
 COMP_zlib_cleanup(void)
 {
@@ -44,6 +44,7 @@ int COMP_expand_block(COMP_CTX *ctx, unsigned char *out, int olen,
     unsigned char *in, int ilen);
 COMP_METHOD *COMP_rle(void );
 COMP_METHOD *COMP_zlib(void );
+COMP_METHOD *COMP_zlib_oneshot(void );
 void COMP_zlib_cleanup(void);
 
 #ifdef HEADER_BIO_H
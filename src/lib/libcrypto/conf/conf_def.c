@@ -58,6 +58,10 @@
 
 /* Part of the code in here was originally in conf.c, which is now removed */
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <limits.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -71,11 +75,14 @@
 #include "conf_def.h"
 
 #define MAX_CONF_VALUE_LENGTH 65536
+/* The macro BUFSIZE conflicts with a system macro in VxWorks */
+#define CONFBUFSIZE	512
 
 static char *eat_ws(CONF *conf, char *p);
 static char *eat_alpha_numeric(CONF *conf, char *p);
 static void clear_comments(CONF *conf, char *p);
-static int str_copy(CONF *conf, char *section, char **to, char *from);
+static int str_copy(CONF *conf, char *section, char **to, char *from,
+    BUF_MEM *buf);
 static char *scan_quote(CONF *conf, char *p);
 static char *scan_dquote(CONF *conf, char *p);
 #define scan_esc(conf,p)	(((IS_EOF((conf),(p)[1]))?((p)+1):((p)+2)))
@@ -87,6 +94,10 @@ static int def_destroy(CONF *conf);
 static int def_destroy_data(CONF *conf);
 static int def_load(CONF *conf, const char *name, long *eline);
 static int def_load_bio(CONF *conf, BIO *bp, long *eline);
+static int def_load_buf(CONF *conf, const char *data, size_t len,
+    long *eline);
+static int def_load_line(CONF *conf, char *buf, char **psection,
+    CONF_VALUE **psv, BUF_MEM *scratch);
 static int def_dump(const CONF *conf, BIO *bp);
 static int def_is_number(const CONF *conf, char c);
 static int def_to_int(const CONF *conf, char c);
@@ -188,9 +199,16 @@ def_destroy_data(CONF *conf)
 	return 1;
 }
 
+/*
+ * Regular files are mapped and parsed in place, which avoids reading them
+ * a line at a time through the BIO.
+ */
 static int
 def_load(CONF *conf, const char *name, long *line)
 {
+	struct stat sb;
+	FILE *fp = NULL;
+	void *data;
 	int ret;
 	BIO *in = NULL;
 
@@ -203,7 +221,15 @@ def_load(CONF *conf, const char *name, long *line)
 		return 0;
 	}
 
-	ret = def_load_bio(conf, in, line);
+	if (BIO_get_fp(in, &fp) == 1 && fp != NULL &&
+	    fstat(fileno(fp), &sb) == 0 && S_ISREG(sb.st_mode) &&
+	    sb.st_size > 0 && sb.st_size <= SSIZE_MAX &&
+	    (data = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE,
+	    fileno(fp), 0)) != MAP_FAILED) {
+		ret = def_load_buf(conf, data, sb.st_size, line);
+		munmap(data, sb.st_size);
+	} else
+		ret = def_load_bio(conf, in, line);
 	BIO_free(in);
 
 	return ret;
@@ -212,20 +238,163 @@ def_load(CONF *conf, const char *name, long *line)
 static int
 def_load_bio(CONF *conf, BIO *in, long *line)
 {
-/* The macro BUFSIZE conflicts with a system macro in VxWorks */
-#define CONFBUFSIZE	512
-	int bufnum = 0, i, ii;
-	BUF_MEM *buff = NULL;
+	BUF_MEM *buff;
+	size_t len = 0;
+	int i, ret = 0;
+
+	if ((buff = BUF_MEM_new()) == NULL) {
+		CONFerror(ERR_R_BUF_LIB);
+		return 0;
+	}
+	for (;;) {
+		if (!BUF_MEM_grow(buff, len + CONFBUFSIZE)) {
+			CONFerror(ERR_R_BUF_LIB);
+			goto err;
+		}
+		if ((i = BIO_read(in, buff->data + len, CONFBUFSIZE)) <= 0)
+			break;
+		len += i;
+	}
+
+	ret = def_load_buf(conf, buff->data, len, line);
+
+ err:
+	BUF_MEM_free(buff);
+
+	return ret;
+}
+
+/*
+ * Parse one logical line, with continuations joined and the line ending
+ * removed, into the section *psection, which a section header replaces.
+ */
+static int
+def_load_line(CONF *conf, char *buf, char **psection, CONF_VALUE **psv,
+    BUF_MEM *scratch)
+{
+	CONF_VALUE *v = NULL, *tv;
 	char *s, *p, *end;
-	int again;
+	char *start, *psection_name, *pname;
+	char *section = *psection;
+
+	clear_comments(conf, buf);
+	s = eat_ws(conf, buf);
+	if (IS_EOF(conf, *s))
+		return 1; /* blank line */
+	if (*s == '[') {
+		char *ss;
+
+		s++;
+		start = eat_ws(conf, s);
+		ss = start;
+again:
+		end = eat_alpha_numeric(conf, ss);
+		p = eat_ws(conf, end);
+		if (*p != ']') {
+			if (*p != '\0' && ss != p) {
+				ss = p;
+				goto again;
+			}
+			CONFerror(CONF_R_MISSING_CLOSE_SQUARE_BRACKET);
+			return 0;
+		}
+		*end = '\0';
+		if (!str_copy(conf, NULL, psection, start, scratch))
+			return 0;
+		if ((*psv = _CONF_get_section(conf, *psection)) == NULL)
+			*psv = _CONF_new_section(conf, *psection);
+		if (*psv == NULL) {
+			CONFerror(CONF_R_UNABLE_TO_CREATE_NEW_SECTION);
+			return 0;
+		}
+		return 1;
+	}
+
+	pname = s;
+	psection_name = NULL;
+	end = eat_alpha_numeric(conf, s);
+	if ((end[0] == ':') && (end[1] == ':')) {
+		*end = '\0';
+		end += 2;
+		psection_name = pname;
+		pname = end;
+		end = eat_alpha_numeric(conf, end);
+	}
+	p = eat_ws(conf, end);
+	if (*p != '=') {
+		CONFerror(CONF_R_MISSING_EQUAL_SIGN);
+		return 0;
+	}
+	*end = '\0';
+	p++;
+	start = eat_ws(conf, p);
+	while (!IS_EOF(conf, *p))
+		p++;
+	p--;
+	while ((p != start) && (IS_WS(conf, *p)))
+		p--;
+	p++;
+	*p = '\0';
+
+	if (!(v = malloc(sizeof(CONF_VALUE)))) {
+		CONFerror(ERR_R_MALLOC_FAILURE);
+		goto err;
+	}
+	if (psection_name == NULL)
+		psection_name = section;
+	v->name = strdup(pname);
+	v->value = NULL;
+	if (v->name == NULL) {
+		CONFerror(ERR_R_MALLOC_FAILURE);
+		goto err;
+	}
+	if (!str_copy(conf, psection_name, &(v->value), start, scratch))
+		goto err;
+
+	if (strcmp(psection_name, section) != 0) {
+		if ((tv = _CONF_get_section(conf, psection_name)) == NULL)
+			tv = _CONF_new_section(conf, psection_name);
+		if (tv == NULL) {
+			CONFerror(CONF_R_UNABLE_TO_CREATE_NEW_SECTION);
+			goto err;
+		}
+	} else
+		tv = *psv;
+
+	if (_CONF_add_string(conf, tv, v) == 0) {
+		CONFerror(ERR_R_MALLOC_FAILURE);
+		goto err;
+	}
+
+	return 1;
+
+ err:
+	if (v != NULL) {
+		free(v->name);
+		free(v->value);
+		free(v);
+	}
+	return 0;
+}
+
+/*
+ * Parse a whole configuration held in memory. Lines are found with
+ * memchr() and copied, joined with their continuations, into a single
+ * line buffer that is reused for the whole file.
+ */
+static int
+def_load_buf(CONF *conf, const char *data, size_t len, long *line)
+{
+	BUF_MEM *buff = NULL, *scratch = NULL;
+	const char *p, *nl, *data_end = data + len;
+	size_t bufnum = 0, start, n;
 	long eline = 0;
-	CONF_VALUE *v = NULL, *tv;
 	CONF_VALUE *sv = NULL;
-	char *section = NULL, *buf;
-	char *start, *psection, *pname;
+	char *section = NULL;
 	void *h = (void *)(conf->data);
 
-	if ((buff = BUF_MEM_new()) == NULL) {
+	if ((buff = BUF_MEM_new()) == NULL ||
+	    (scratch = BUF_MEM_new()) == NULL) {
 		CONFerror(ERR_R_BUF_LIB);
 		goto err;
 	}
@@ -247,157 +416,54 @@ def_load_bio(CONF *conf, BIO *in, long *line)
 		goto err;
 	}
 
-	bufnum = 0;
-	again = 0;
-	for (;;) {
-		if (!BUF_MEM_grow(buff, bufnum + CONFBUFSIZE)) {
+	for (p = data; p < data_end || bufnum > 0; p += n) {
+		if ((nl = memchr(p, '\n', data_end - p)) != NULL)
+			n = nl - p + 1;
+		else
+			n = data_end - p;
+
+		if (!BUF_MEM_grow(buff, bufnum + n + 1)) {
 			CONFerror(ERR_R_BUF_LIB);
 			goto err;
 		}
-		p = &(buff->data[bufnum]);
-		*p = '\0';
-		BIO_gets(in, p, CONFBUFSIZE - 1);
-		p[CONFBUFSIZE - 1] = '\0';
-		ii = i = strlen(p);
-		if (i == 0 && !again)
-			break;
-		again = 0;
-		while (i > 0) {
-			if ((p[i - 1] != '\r') && (p[i - 1] != '\n'))
-				break;
-			else
-				i--;
-		}
-		/* we removed some trailing stuff so there is a new
-		 * line on the end. */
-		if (ii && i == ii)
-			again = 1; /* long line */
-		else {
-			p[i] = '\0';
-			eline++; /* another input line */
-		}
+		memcpy(buff->data + bufnum, p, n);
+		start = bufnum;
+		bufnum += n;
 
-		/* we now have a line with trailing \r\n removed */
+		/* remove the trailing \r\n */
+		while (bufnum > start && (buff->data[bufnum - 1] == '\r' ||
+		    buff->data[bufnum - 1] == '\n'))
+			bufnum--;
+		buff->data[bufnum] = '\0';
 
-		/* i is the number of bytes */
-		bufnum += i;
-
-		v = NULL;
 		/* check for line continuation */
-		if (bufnum >= 1) {
+		if (n > 0 && bufnum >= 1) {
 			/* If we have bytes and the last char '\\' and
 			 * second last char is not '\\' */
-			p = &(buff->data[bufnum - 1]);
-			if (IS_ESC(conf, p[0]) &&
-			    ((bufnum <= 1) || !IS_ESC(conf, p[-1]))) {
+			if (IS_ESC(conf, buff->data[bufnum - 1]) &&
+			    ((bufnum <= 1) ||
+			    !IS_ESC(conf, buff->data[bufnum - 2]))) {
+				/* A last line without a newline ends at EOF. */
+				if (nl != NULL)
+					eline++;
 				bufnum--;
-				again = 1;
+				continue;
 			}
 		}
-		if (again)
-			continue;
+		eline++; /* another input line */
 		bufnum = 0;
-		buf = buff->data;
-
-		clear_comments(conf, buf);
-		s = eat_ws(conf, buf);
-		if (IS_EOF(conf, *s))
-			continue; /* blank line */
-		if (*s == '[') {
-			char *ss;
-
-			s++;
-			start = eat_ws(conf, s);
-			ss = start;
-again:
-			end = eat_alpha_numeric(conf, ss);
-			p = eat_ws(conf, end);
-			if (*p != ']') {
-				if (*p != '\0' && ss != p) {
-					ss = p;
-					goto again;
-				}
-				CONFerror(CONF_R_MISSING_CLOSE_SQUARE_BRACKET);
-				goto err;
-			}
-			*end = '\0';
-			if (!str_copy(conf, NULL, &section, start))
-				goto err;
-			if ((sv = _CONF_get_section(conf, section)) == NULL)
-				sv = _CONF_new_section(conf, section);
-			if (sv == NULL) {
-				CONFerror(CONF_R_UNABLE_TO_CREATE_NEW_SECTION);
-				goto err;
-			}
-			continue;
-		} else {
-			pname = s;
-			psection = NULL;
-			end = eat_alpha_numeric(conf, s);
-			if ((end[0] == ':') && (end[1] == ':')) {
-				*end = '\0';
-				end += 2;
-				psection = pname;
-				pname = end;
-				end = eat_alpha_numeric(conf, end);
-			}
-			p = eat_ws(conf, end);
-			if (*p != '=') {
-				CONFerror(CONF_R_MISSING_EQUAL_SIGN);
-				goto err;
-			}
-			*end = '\0';
-			p++;
-			start = eat_ws(conf, p);
-			while (!IS_EOF(conf, *p))
-				p++;
-			p--;
-			while ((p != start) && (IS_WS(conf, *p)))
-				p--;
-			p++;
-			*p = '\0';
 
-			if (!(v = malloc(sizeof(CONF_VALUE)))) {
-				CONFerror(ERR_R_MALLOC_FAILURE);
-				goto err;
-			}
-			if (psection == NULL)
-				psection = section;
-			v->name = strdup(pname);
-			v->value = NULL;
-			if (v->name == NULL) {
-				CONFerror(ERR_R_MALLOC_FAILURE);
-				goto err;
-			}
-			if (!str_copy(conf, psection, &(v->value), start))
-				goto err;
-
-			if (strcmp(psection, section) != 0) {
-				if ((tv = _CONF_get_section(conf, psection))
-					== NULL)
-					tv = _CONF_new_section(conf, psection);
-				if (tv == NULL) {
-					CONFerror(CONF_R_UNABLE_TO_CREATE_NEW_SECTION);
-					goto err;
-				}
-			} else
-				tv = sv;
-
-			if (_CONF_add_string(conf, tv, v) == 0) {
-				CONFerror(ERR_R_MALLOC_FAILURE);
-				goto err;
-			}
-			v = NULL;
-		}
+		if (!def_load_line(conf, buff->data, &section, &sv, scratch))
+			goto err;
 	}
-	if (buff != NULL)
-		BUF_MEM_free(buff);
+	BUF_MEM_free(buff);
+	BUF_MEM_free(scratch);
 	free(section);
 	return (1);
 
 err:
-	if (buff != NULL)
-		BUF_MEM_free(buff);
+	BUF_MEM_free(buff);
+	BUF_MEM_free(scratch);
 	free(section);
 	if (line != NULL)
 		*line = eline;
@@ -406,11 +472,6 @@ err:
 		CONF_free(conf->data);
 		conf->data = NULL;
 	}
-	if (v != NULL) {
-		free(v->name);
-		free(v->value);
-		free(v);
-	}
 	return (0);
 }
 
@@ -452,20 +513,21 @@ clear_comments(CONF *conf, char *p)
 	}
 }
 
+/*
+ * Copy a value, with quotes and escapes resolved and variables expanded,
+ * to a new string in *pto. The expansion is built in buf, which is only
+ * scratch space shared by all values of a file.
+ */
 static int
-str_copy(CONF *conf, char *section, char **pto, char *from)
+str_copy(CONF *conf, char *section, char **pto, char *from, BUF_MEM *buf)
 {
 	int q, r,rr = 0, to = 0, len = 0;
-	char *s, *e, *rp, *p, *rrp, *np, *cp, v;
+	char *s, *e, *rp, *p, *rrp, *np, *cp, *str, v;
 	size_t newsize;
-	BUF_MEM *buf;
-
-	if ((buf = BUF_MEM_new()) == NULL)
-		return (0);
 
 	len = strlen(from) + 1;
 	if (!BUF_MEM_grow(buf, len))
-		goto err;
+		return (0);
 
 	for (;;) {
 		if (IS_QUOTE(conf, *from)) {
@@ -592,14 +654,16 @@ str_copy(CONF *conf, char *section, char **pto, char *from)
 			buf->data[to++] = *(from++);
 	}
 	buf->data[to]='\0';
+	if ((str = malloc(to + 1)) == NULL) {
+		CONFerror(ERR_R_MALLOC_FAILURE);
+		return (0);
+	}
+	memcpy(str, buf->data, to + 1);
 	free(*pto);
-	*pto = buf->data;
-	free(buf);
+	*pto = str;
 	return (1);
 
 err:
-	if (buf != NULL)
-		BUF_MEM_free(buf);
 	return (0);
 }
 
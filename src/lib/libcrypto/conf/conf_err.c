@@ -65,18 +65,20 @@
 #include <openssl/conf.h>
 #include <openssl/err.h>
 
+#include "cryptlib.h"
+
 /* BEGIN ERROR CODES */
 #ifndef OPENSSL_NO_ERR
 
 #define ERR_FUNC(func) ERR_PACK(ERR_LIB_CONF,func,0)
 #define ERR_REASON(reason) ERR_PACK(ERR_LIB_CONF,0,reason)
 
-static ERR_STRING_DATA CONF_str_functs[]= {
+static const ERR_STRING_DATA CONF_str_functs[]= {
 	{ERR_FUNC(0xfff), "CRYPTO_internal"},
 	{0, NULL}
 };
 
-static ERR_STRING_DATA CONF_str_reasons[]= {
+static const ERR_STRING_DATA CONF_str_reasons[]= {
 	{ERR_REASON(CONF_R_ERROR_LOADING_DSO)    , "error loading dso"},
 	{ERR_REASON(CONF_R_LIST_CANNOT_BE_NULL)  , "list cannot be null"},
 	{ERR_REASON(CONF_R_MISSING_CLOSE_SQUARE_BRACKET), "missing close square bracket"},
@@ -104,8 +106,8 @@ ERR_load_CONF_strings(void)
 {
 #ifndef OPENSSL_NO_ERR
 	if (ERR_func_error_string(CONF_str_functs[0].error) == NULL) {
-		ERR_load_strings(0, CONF_str_functs);
-		ERR_load_strings(0, CONF_str_reasons);
+		ERR_load_const_strings(CONF_str_functs);
+		ERR_load_const_strings(CONF_str_reasons);
 	}
 #endif
 }
@@ -74,6 +74,44 @@ extern "C" {
 
 void OPENSSL_cpuid_setup(void);
 
+__BEGIN_HIDDEN_DECLS
+
+/*
+ * Registers a constant error string table of a library built into
+ * libcrypto.  The entries must already carry their library code; the
+ * table is searched in place instead of being copied into the string hash.
+ */
+struct ERR_string_data_st;
+void ERR_load_const_strings(const struct ERR_string_data_st *str);
+
+/*
+ * Names of the implementations that are in use on this CPU, as reported by
+ * OPENSSL_cpu_features_string().
+ */
+const char *chacha_implementation(void);
+const char *evp_aes_implementation(void);
+const char *gcm128_implementation(void);
+const char *poly1305_implementation(void);
+const char *sm3_implementation(void);
+const char *sm4_implementation(void);
+const char *x25519_implementation(void);
+
+/*
+ * Groups of tasks run by the thread pool or executor set up with
+ * CRYPTO_set_thread_pool() or CRYPTO_set_thread_executor().  Without
+ * either, tasks are run as they are added.
+ */
+struct crypto_tasks;
+
+int crypto_tasks_threads(void);
+struct crypto_tasks *crypto_tasks_new(void);
+void crypto_tasks_add(struct crypto_tasks *tasks, void (*fn)(void *),
+    void *arg);
+void crypto_tasks_wait(struct crypto_tasks *tasks);
+void crypto_tasks_free(struct crypto_tasks *tasks);
+
+__END_HIDDEN_DECLS
+
 #ifdef  __cplusplus
 }
 #endif
@@ -366,6 +366,14 @@ void CRYPTO_cleanup_all_ex_data(void);
 void CRYPTO_lock(int mode, int type, const char *file, int line);
 int CRYPTO_add_lock(int *pointer, int amount, int type, const char *file,
     int line);
+void CRYPTO_lock_stats_enable(int enable);
+int CRYPTO_lock_stats(int type, uint64_t *acquired, uint64_t *contended,
+    uint64_t *wait_nsec);
+int CRYPTO_lock_stats_print_fp(FILE *fp);
+
+int CRYPTO_set_thread_pool(int nthreads);
+void CRYPTO_set_thread_executor(int (*executor)(void (*task)(void *),
+    void *task_arg, void *arg), void *arg, int nthreads);
 
 /* Don't use this structure directly. */
 typedef struct crypto_threadid_st {
@@ -456,6 +464,29 @@ void OPENSSL_cleanse(void *ptr, size_t len);
 void CRYPTO_set_mem_debug_options(long bits);
 long CRYPTO_get_mem_debug_options(void);
 
+/* Allocation accounting by subsystem. */
+#define CRYPTO_MEM_ASN1			0
+#define CRYPTO_MEM_X509			1
+#define CRYPTO_MEM_BN			2
+#define CRYPTO_MEM_EVP			3
+#define CRYPTO_MEM_SSL_RECORD		4
+#define CRYPTO_MEM_SSL_HANDSHAKE	5
+#define CRYPTO_MEM_SSL			6
+#define CRYPTO_MEM_OTHER		7
+#define CRYPTO_MEM_SUBSYSTEMS		8
+
+typedef struct crypto_mem_counts_st {
+	uint64_t allocations;
+	uint64_t bytes;
+	uint64_t frees;
+} CRYPTO_MEM_COUNTS;
+
+int CRYPTO_mem_accounting(int enable);
+int CRYPTO_mem_get_counts(int subsystem, CRYPTO_MEM_COUNTS *counts);
+const char *CRYPTO_mem_subsystem_name(int subsystem);
+void CRYPTO_mem_count_alloc(const char *file, size_t size);
+void CRYPTO_mem_count_free(const char *file);
+
 #define CRYPTO_push_info(info) \
         CRYPTO_push_info_(info, __FILE__, __LINE__);
 int CRYPTO_push_info_(const char *info, const char *file, int line);
@@ -501,6 +532,8 @@ void OpenSSLDie(const char *file, int line, const char *assertion);
 #define OPENSSL_assert(e)       (void)((e) ? 0 : (OpenSSLDie(__FILE__, __LINE__, #e),1))
 
 uint64_t OPENSSL_cpu_caps(void);
+const char *OPENSSL_cpu_features_string(void);
+int OPENSSL_cpu_features_disable(const char *features);
 
 int OPENSSL_isservice(void);
 
@@ -0,0 +1,307 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * CPU feature reporting.
+ *
+ * The implementation of a primitive is chosen at run time from the features
+ * that OPENSSL_cpuid_setup() found. This names the features and the
+ * implementation that each primitive ends up with, and allows features to be
+ * turned off, so that the implementations can be compared on one machine.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <openssl/opensslconf.h>
+
+#ifndef OPENSSL_NO_CAMELLIA
+#include <openssl/camellia.h>
+#endif
+#include <openssl/crypto.h>
+
+#include "bn_lcl.h"
+#ifndef OPENSSL_NO_CAMELLIA
+#include "cmll_locl.h"
+#endif
+#include "cryptlib.h"
+
+#if defined(__i386) || defined(__i386__) || \
+    defined(__x86_64) || defined(__x86_64__)
+#include "x86_arch.h"
+#define CPU_FEATURES_X86
+extern uint64_t OPENSSL_ia32cap_P;
+#elif defined(__arm__) || defined(__aarch64__)
+#include "arm_arch.h"
+#define CPU_FEATURES_ARM
+#endif
+
+struct cpu_feature {
+	const char *name;
+	uint64_t mask;
+};
+
+static const struct cpu_feature cpu_features[] = {
+#ifdef CPU_FEATURES_X86
+	{ "mmx", CPUCAP_MASK_MMX },
+	{ "fxsr", CPUCAP_MASK_FXSR },
+	{ "sse", CPUCAP_MASK_SSE },
+	{ "sse2", IA32CAP_MASK0_SSE2 },
+	{ "ssse3", CPUCAP_MASK_SSSE3 },
+	{ "pclmul", CPUCAP_MASK_PCLMUL },
+	{ "aesni", CPUCAP_MASK_AESNI },
+	{ "avx", (uint64_t)IA32CAP_MASK1_AVX << 32 },
+	{ "fma3", (uint64_t)IA32CAP_MASK1_FMA3 << 32 },
+	{ "avx2", CPUCAP_MASK_AVX2 },
+	{ "vaes", CPUCAP_MASK_VAES },
+	{ "sha", CPUCAP_MASK_SHA },
+	{ "adx", CPUCAP_MASK_ADX },
+	{ "ifma", CPUCAP_MASK_IFMA },
+#endif
+#ifdef CPU_FEATURES_ARM
+	{ "neon", ARMV7_NEON },
+	{ "aes", ARMV8_AES },
+	{ "pmull", ARMV8_PMULL },
+	{ "sha1", ARMV8_SHA1 },
+	{ "sha256", ARMV8_SHA256 },
+	{ "sha512", ARMV8_SHA512 },
+#endif
+	{ NULL, 0 },
+};
+
+static pthread_mutex_t cpu_features_mutex = PTHREAD_MUTEX_INITIALIZER;
+static char cpu_features_buf[512];
+
+static uint64_t
+cpu_features_caps(void)
+{
+#if defined(CPU_FEATURES_X86)
+	return OPENSSL_ia32cap_P;
+#elif defined(CPU_FEATURES_ARM)
+	return OPENSSL_armcap_P;
+#else
+	return 0;
+#endif
+}
+
+static void
+cpu_features_clear(uint64_t mask)
+{
+#if defined(CPU_FEATURES_X86)
+	OPENSSL_ia32cap_P &= ~mask;
+#elif defined(CPU_FEATURES_ARM)
+	OPENSSL_armcap_P &= ~(unsigned int)mask;
+#endif
+}
+
+/*
+ * The SHA-1 and SHA-256 assembly choose between their kernels themselves,
+ * with the same tests as here.
+ */
+static const char *
+sha1_implementation(void)
+{
+#if defined(SHA1_ASM) && (defined(__x86_64) || defined(__x86_64__))
+	uint64_t caps = OPENSSL_cpu_caps();
+
+	if ((caps & CPUCAP_MASK_SHA) != 0)
+		return "shaext";
+	if ((caps & CPUCAP_MASK_SSSE3) == 0)
+		return "x86_64";
+	if ((caps & IA32CAP_MASK0_INTEL) != 0 &&
+	    (caps & ((uint64_t)IA32CAP_MASK1_AVX << 32)) != 0)
+		return "avx";
+	return "ssse3";
+#elif defined(SHA1_ASM)
+	return "asm";
+#elif defined(ARMV8_CE)
+	if ((OPENSSL_armcap_P & ARMV8_SHA1) != 0)
+		return "armv8";
+	return "c";
+#else
+	return "c";
+#endif
+}
+
+static const char *
+sha256_implementation(void)
+{
+#if defined(SHA256_ASM) && (defined(__x86_64) || defined(__x86_64__))
+	if ((OPENSSL_cpu_caps() & CPUCAP_MASK_SHA) != 0)
+		return "shaext";
+	return "x86_64";
+#elif defined(SHA256_ASM)
+	return "asm";
+#elif defined(ARMV8_CE)
+	if ((OPENSSL_armcap_P & ARMV8_SHA256) != 0)
+		return "armv8";
+	return "c";
+#else
+	return "c";
+#endif
+}
+
+static const char *
+sha512_implementation(void)
+{
+#if defined(SHA512_ASM)
+	return "asm";
+#elif defined(ARMV8_CE) && defined(__aarch64__)
+	if ((OPENSSL_armcap_P & ARMV8_SHA512) != 0)
+		return "armv8";
+	return "c";
+#else
+	return "c";
+#endif
+}
+
+#ifndef OPENSSL_NO_CAMELLIA
+static const char *
+camellia_implementation(void)
+{
+#ifdef CAMELLIA_AESNI
+	if (camellia_aesni_capable()) {
+		if ((OPENSSL_cpu_caps() & CPUCAP_MASK_VAES) != 0)
+			return "vaes-avx2";
+		return "aesni-avx2";
+	}
+#endif
+#if !defined(OPENSSL_NO_ASM) && (defined(__i386) || defined(__i386__) || \
+    defined(__x86_64) || defined(__x86_64__))
+	return "asm";
+#else
+	return "c";
+#endif
+}
+#endif
+
+static const char *
+bn_implementation(void)
+{
+#ifdef BN_IFMA
+	if ((OPENSSL_cpu_caps() & CPUCAP_MASK_IFMA) != 0)
+		return "ifma";
+#endif
+#ifdef OPENSSL_BN_ASM_MONT
+	return "mont-asm";
+#else
+	return "c";
+#endif
+}
+
+/*
+ * Return a single line of space separated key=value pairs, the first being
+ * the CPU features in use and the others the implementation of each
+ * primitive.
+ */
+const char *
+OPENSSL_cpu_features_string(void)
+{
+	const struct cpu_feature *feature;
+	const char *sep = "";
+	uint64_t caps;
+
+	OPENSSL_init_crypto(0, NULL);
+
+	pthread_mutex_lock(&cpu_features_mutex);
+
+	caps = cpu_features_caps();
+
+	strlcpy(cpu_features_buf, "cpu=", sizeof(cpu_features_buf));
+	for (feature = cpu_features; feature->name != NULL; feature++) {
+		if ((caps & feature->mask) == 0)
+			continue;
+		strlcat(cpu_features_buf, sep, sizeof(cpu_features_buf));
+		strlcat(cpu_features_buf, feature->name,
+		    sizeof(cpu_features_buf));
+		sep = ",";
+	}
+	if (*sep == '\0')
+		strlcat(cpu_features_buf, "none", sizeof(cpu_features_buf));
+
+#define CPU_FEATURES_IMPL(key, impl) do { \
+	strlcat(cpu_features_buf, " " key "=", sizeof(cpu_features_buf)); \
+	strlcat(cpu_features_buf, (impl), sizeof(cpu_features_buf)); \
+} while (0)
+
+	CPU_FEATURES_IMPL("aes", evp_aes_implementation());
+	CPU_FEATURES_IMPL("gcm", gcm128_implementation());
+#ifndef OPENSSL_NO_CAMELLIA
+	CPU_FEATURES_IMPL("camellia", camellia_implementation());
+#endif
+	CPU_FEATURES_IMPL("sha1", sha1_implementation());
+	CPU_FEATURES_IMPL("sha256", sha256_implementation());
+	CPU_FEATURES_IMPL("sha512", sha512_implementation());
+#ifndef OPENSSL_NO_SM3
+	CPU_FEATURES_IMPL("sm3", sm3_implementation());
+#endif
+#ifndef OPENSSL_NO_SM4
+	CPU_FEATURES_IMPL("sm4", sm4_implementation());
+#endif
+	CPU_FEATURES_IMPL("chacha20", chacha_implementation());
+	CPU_FEATURES_IMPL("poly1305", poly1305_implementation());
+	CPU_FEATURES_IMPL("x25519", x25519_implementation());
+	CPU_FEATURES_IMPL("bn", bn_implementation());
+
+#undef CPU_FEATURES_IMPL
+
+	pthread_mutex_unlock(&cpu_features_mutex);
+
+	return cpu_features_buf;
+}
+
+/*
+ * Turn off the comma separated CPU features, so that the implementations
+ * that need them are no longer used. Nothing is changed if any of the
+ * features is not known.
+ */
+int
+OPENSSL_cpu_features_disable(const char *features)
+{
+	const struct cpu_feature *feature;
+	const char *name, *end;
+	uint64_t mask = 0;
+	size_t len;
+
+	OPENSSL_init_crypto(0, NULL);
+
+	for (name = features; *name != '\0'; name = end) {
+		if ((end = strchr(name, ',')) == NULL)
+			end = name + strlen(name);
+		len = end - name;
+		if (*end == ',')
+			end++;
+		if (len == 0)
+			continue;
+
+		for (feature = cpu_features; feature->name != NULL; feature++) {
+			if (strlen(feature->name) == len &&
+			    strncmp(feature->name, name, len) == 0)
+				break;
+		}
+		if (feature->name == NULL)
+			return 0;
+		mask |= feature->mask;
+	}
+
+	pthread_mutex_lock(&cpu_features_mutex);
+	cpu_features_clear(mask);
+	pthread_mutex_unlock(&cpu_features_mutex);
+
+	return 1;
+}
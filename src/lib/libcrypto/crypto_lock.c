@@ -16,51 +16,66 @@
  */
 
 #include <pthread.h>
+#include <time.h>
 
 #include <openssl/crypto.h>
 
-static pthread_mutex_t locks[] = {
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
-	PTHREAD_MUTEX_INITIALIZER,
+/*
+ * Each lock is a reader/writer lock, so that CRYPTO_r_lock() callers only
+ * exclude writers.  The locks are kept on separate cache lines so that
+ * taking one does not slow down users of its neighbours.
+ */
+struct crypto_lock {
+	pthread_rwlock_t lock;
+	uint64_t acquired;
+	uint64_t contended;
+	uint64_t wait_nsec;
+} __attribute__((__aligned__(64)));
+
+#define CRYPTO_LOCK_INIT	{ PTHREAD_RWLOCK_INITIALIZER }
+
+static struct crypto_lock locks[] = {
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
+	CRYPTO_LOCK_INIT,
 };
 
 #define CTASSERT(x)	extern char  _ctassert[(x) ? 1 : -1 ] \
@@ -68,6 +83,87 @@ static pthread_mutex_t locks[] = {
 
 CTASSERT((sizeof(locks) / sizeof(*locks)) == CRYPTO_NUM_LOCKS);
 
+static const char *const lock_names[] = {
+	"<<ERROR>>",
+	"err",
+	"ex_data",
+	"x509",
+	"x509_info",
+	"x509_pkey",
+	"x509_crl",
+	"x509_req",
+	"dsa",
+	"rsa",
+	"evp_pkey",
+	"x509_store",
+	"ssl_ctx",
+	"ssl_cert",
+	"ssl_session",
+	"ssl_sess_cert",
+	"ssl",
+	"ssl_method",
+	"rand",
+	"rand2",
+	"debug_malloc",
+	"BIO",
+	"gethostbyname",
+	"getservbyname",
+	"readdir",
+	"RSA_blinding",
+	"dh",
+	"debug_malloc2",
+	"dso",
+	"dynlock",
+	"engine",
+	"ui",
+	"ecdsa",
+	"ec",
+	"ecdh",
+	"bn",
+	"ec_pre_comp",
+	"store",
+	"comp",
+	"fips",
+	"fips2",
+};
+
+CTASSERT((sizeof(lock_names) / sizeof(*lock_names)) == CRYPTO_NUM_LOCKS);
+
+static int lock_stats_enabled;
+
+static void
+crypto_lock_acquire(struct crypto_lock *l, int read)
+{
+	struct timespec start, end;
+	int ret;
+
+	if (!lock_stats_enabled) {
+		if (read)
+			(void) pthread_rwlock_rdlock(&l->lock);
+		else
+			(void) pthread_rwlock_wrlock(&l->lock);
+		return;
+	}
+
+	if (read)
+		ret = pthread_rwlock_tryrdlock(&l->lock);
+	else
+		ret = pthread_rwlock_trywrlock(&l->lock);
+	if (ret != 0) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (read)
+			(void) pthread_rwlock_rdlock(&l->lock);
+		else
+			(void) pthread_rwlock_wrlock(&l->lock);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		__sync_fetch_and_add(&l->contended, 1);
+		__sync_fetch_and_add(&l->wait_nsec,
+		    (end.tv_sec - start.tv_sec) * 1000000000LL +
+		    (end.tv_nsec - start.tv_nsec));
+	}
+	__sync_fetch_and_add(&l->acquired, 1);
+}
+
 void
 CRYPTO_lock(int mode, int type, const char *file, int line)
 {
@@ -75,9 +171,9 @@ CRYPTO_lock(int mode, int type, const char *file, int line)
 		return;
 
 	if (mode & CRYPTO_LOCK)
-		(void) pthread_mutex_lock(&locks[type]);
+		crypto_lock_acquire(&locks[type], (mode & CRYPTO_READ) != 0);
 	else if (mode & CRYPTO_UNLOCK)
-		(void) pthread_mutex_unlock(&locks[type]);
+		(void) pthread_rwlock_unlock(&locks[type].lock);
 }
 
 int
@@ -86,6 +182,20 @@ CRYPTO_add_lock(int *pointer, int amount, int type, const char *file,
 {
 	int ret;
 
+	/*
+	 * With these lock types CRYPTO_add() only updates the reference
+	 * counts of objects, which are never otherwise changed while the
+	 * lock is held, so an atomic update is sufficient.
+	 */
+	switch (type) {
+	case CRYPTO_LOCK_X509:
+	case CRYPTO_LOCK_X509_CRL:
+	case CRYPTO_LOCK_EVP_PKEY:
+	case CRYPTO_LOCK_SSL_CTX:
+	case CRYPTO_LOCK_SSL_SESSION:
+		return __sync_add_and_fetch(pointer, amount);
+	}
+
 	CRYPTO_lock(CRYPTO_LOCK|CRYPTO_WRITE, type, file, line);
 	ret = *pointer + amount;
 	*pointer = ret;
@@ -93,3 +203,62 @@ CRYPTO_add_lock(int *pointer, int amount, int type, const char *file,
 
 	return (ret);
 }
+
+void
+CRYPTO_lock_stats_enable(int enable)
+{
+	int i;
+
+	if (enable && !lock_stats_enabled) {
+		for (i = 0; i < CRYPTO_NUM_LOCKS; i++) {
+			locks[i].acquired = 0;
+			locks[i].contended = 0;
+			locks[i].wait_nsec = 0;
+		}
+	}
+	lock_stats_enabled = enable != 0;
+}
+
+int
+CRYPTO_lock_stats(int type, uint64_t *acquired, uint64_t *contended,
+    uint64_t *wait_nsec)
+{
+	struct crypto_lock *l;
+
+	if (type < 0 || type >= CRYPTO_NUM_LOCKS)
+		return 0;
+
+	l = &locks[type];
+	if (acquired != NULL)
+		*acquired = __sync_fetch_and_add(&l->acquired, 0);
+	if (contended != NULL)
+		*contended = __sync_fetch_and_add(&l->contended, 0);
+	if (wait_nsec != NULL)
+		*wait_nsec = __sync_fetch_and_add(&l->wait_nsec, 0);
+
+	return 1;
+}
+
+int
+CRYPTO_lock_stats_print_fp(FILE *fp)
+{
+	uint64_t acquired, contended, wait_nsec;
+	int i;
+
+	if (fprintf(fp, "%-16s %12s %12s %14s\n", "lock", "acquired",
+	    "contended", "wait (usec)") < 0)
+		return 0;
+	for (i = 1; i < CRYPTO_NUM_LOCKS; i++) {
+		if (!CRYPTO_lock_stats(i, &acquired, &contended, &wait_nsec))
+			return 0;
+		if (acquired == 0)
+			continue;
+		if (fprintf(fp, "%-16s %12llu %12llu %14llu\n", lock_names[i],
+		    (unsigned long long)acquired,
+		    (unsigned long long)contended,
+		    (unsigned long long)(wait_nsec / 1000)) < 0)
+			return 0;
+	}
+
+	return 1;
+}
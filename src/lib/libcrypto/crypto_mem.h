@@ -0,0 +1,128 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Allocation accounting.
+ *
+ * When libcrypto and libssl are built with CRYPTO_MEM_ACCOUNTING, this header
+ * is included ahead of every source file and turns the calls to the standard
+ * allocation functions into calls that first count the allocation against the
+ * file making it. The counting itself is in malloc-wrapper.c and only happens
+ * once it has been turned on with CRYPTO_mem_accounting().
+ */
+
+#ifndef HEADER_CRYPTO_MEM_H
+#define HEADER_CRYPTO_MEM_H
+
+#if defined(CRYPTO_MEM_ACCOUNTING) && !defined(__ASSEMBLER__)
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+void CRYPTO_mem_count_alloc(const char *file, size_t size);
+void CRYPTO_mem_count_free(const char *file);
+
+static inline void *
+crypto_mem_malloc(size_t size, const char *file)
+{
+	CRYPTO_mem_count_alloc(file, size);
+	return malloc(size);
+}
+
+static inline void *
+crypto_mem_calloc(size_t nmemb, size_t size, const char *file)
+{
+	CRYPTO_mem_count_alloc(file, size != 0 && nmemb <= SIZE_MAX / size ?
+	    nmemb * size : 0);
+	return calloc(nmemb, size);
+}
+
+static inline void *
+crypto_mem_realloc(void *ptr, size_t size, const char *file)
+{
+	CRYPTO_mem_count_alloc(file, size);
+	return realloc(ptr, size);
+}
+
+static inline void *
+crypto_mem_reallocarray(void *ptr, size_t nmemb, size_t size,
+    const char *file)
+{
+	CRYPTO_mem_count_alloc(file, size != 0 && nmemb <= SIZE_MAX / size ?
+	    nmemb * size : 0);
+	return reallocarray(ptr, nmemb, size);
+}
+
+static inline void *
+crypto_mem_recallocarray(void *ptr, size_t oldnmemb, size_t nmemb,
+    size_t size, const char *file)
+{
+	CRYPTO_mem_count_alloc(file, size != 0 && nmemb <= SIZE_MAX / size ?
+	    nmemb * size : 0);
+	return recallocarray(ptr, oldnmemb, nmemb, size);
+}
+
+static inline char *
+crypto_mem_strdup(const char *str, const char *file)
+{
+	CRYPTO_mem_count_alloc(file, strlen(str) + 1);
+	return strdup(str);
+}
+
+static inline char *
+crypto_mem_strndup(const char *str, size_t maxlen, const char *file)
+{
+	CRYPTO_mem_count_alloc(file, strnlen(str, maxlen) + 1);
+	return strndup(str, maxlen);
+}
+
+static inline void
+crypto_mem_free(void *ptr, const char *file)
+{
+	if (ptr != NULL)
+		CRYPTO_mem_count_free(file);
+	free(ptr);
+}
+
+static inline void
+crypto_mem_freezero(void *ptr, size_t size, const char *file)
+{
+	if (ptr != NULL)
+		CRYPTO_mem_count_free(file);
+	freezero(ptr, size);
+}
+
+#define malloc(size)	crypto_mem_malloc((size), __FILE__)
+#define calloc(nmemb, size) \
+	crypto_mem_calloc((nmemb), (size), __FILE__)
+#define realloc(ptr, size) \
+	crypto_mem_realloc((ptr), (size), __FILE__)
+#define reallocarray(ptr, nmemb, size) \
+	crypto_mem_reallocarray((ptr), (nmemb), (size), __FILE__)
+#define recallocarray(ptr, oldnmemb, nmemb, size) \
+	crypto_mem_recallocarray((ptr), (oldnmemb), (nmemb), (size), __FILE__)
+#define strdup(str)	crypto_mem_strdup((str), __FILE__)
+#define strndup(str, maxlen) \
+	crypto_mem_strndup((str), (maxlen), __FILE__)
+#define free(ptr)	crypto_mem_free((ptr), __FILE__)
+#define freezero(ptr, size) \
+	crypto_mem_freezero((ptr), (size), __FILE__)
+
+#endif
+
+#endif /* HEADER_CRYPTO_MEM_H */
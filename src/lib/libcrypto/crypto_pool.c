@@ -0,0 +1,535 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <openssl/crypto.h>
+#include <openssl/err.h>
+
+#include "cryptlib.h"
+
+/*
+ * An opt-in pool of threads that library routines may hand independent
+ * pieces of work to.  Each worker owns a deque: tasks queued from a worker
+ * go on the tail of its own deque and are taken back from the tail, while
+ * idle workers steal the oldest tasks from the head of other deques.  Tasks
+ * queued from outside the pool go on a shared deque.  Each deque has its
+ * own lock, so workers only contend when they steal.
+ *
+ * Instead of the pool, an application may install an executor to which
+ * tasks are handed to run however it likes.
+ */
+
+#define CRYPTO_POOL_MAX_THREADS	256
+#define CRYPTO_DEQUE_SLOTS	256	/* Power of two. */
+
+struct crypto_task {
+	void (*fn)(void *);
+	void *arg;
+	struct crypto_tasks *tasks;
+};
+
+struct crypto_deque {
+	pthread_mutex_t mtx;
+	volatile unsigned int head;	/* Oldest task, taken by thieves. */
+	volatile unsigned int tail;	/* Next free slot. */
+	struct crypto_task slots[CRYPTO_DEQUE_SLOTS];
+} __attribute__((__aligned__(64)));
+
+struct crypto_pool;
+
+struct crypto_worker {
+	struct crypto_pool *pool;
+	int index;
+	pthread_t thread;
+	struct crypto_deque deque;
+};
+
+struct crypto_pool {
+	pid_t pid;
+	int nworkers;
+	struct crypto_worker *workers;
+	struct crypto_deque shared;
+
+	pthread_mutex_t mtx;
+	pthread_cond_t cond;
+	volatile unsigned int queued;
+	volatile unsigned int sleeping;
+	int shutdown;
+	int refs;			/* Protected by crypto_pool_lock. */
+};
+
+struct crypto_tasks {
+	struct crypto_pool *pool;
+	int (*executor)(void (*)(void *), void *, void *);
+	void *executor_arg;
+
+	pthread_mutex_t mtx;
+	pthread_cond_t cond;
+	volatile unsigned int pending;
+};
+
+static pthread_mutex_t crypto_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct crypto_pool *crypto_pool;
+static int (*crypto_executor)(void (*)(void *), void *, void *);
+static void *crypto_executor_arg;
+static int crypto_executor_threads;
+
+static pthread_once_t crypto_worker_once = PTHREAD_ONCE_INIT;
+static pthread_key_t crypto_worker_key;
+static int crypto_worker_key_ok;
+
+static void
+crypto_worker_key_init(void)
+{
+	if (pthread_key_create(&crypto_worker_key, NULL) == 0)
+		crypto_worker_key_ok = 1;
+}
+
+static void
+crypto_deque_init(struct crypto_deque *dq)
+{
+	pthread_mutex_init(&dq->mtx, NULL);
+	dq->head = dq->tail = 0;
+}
+
+static int
+crypto_deque_push(struct crypto_deque *dq, const struct crypto_task *task)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&dq->mtx);
+	if (dq->tail - dq->head < CRYPTO_DEQUE_SLOTS) {
+		dq->slots[dq->tail++ & (CRYPTO_DEQUE_SLOTS - 1)] = *task;
+		ret = 1;
+	}
+	pthread_mutex_unlock(&dq->mtx);
+
+	return ret;
+}
+
+static int
+crypto_deque_pop(struct crypto_deque *dq, struct crypto_task *task)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&dq->mtx);
+	if (dq->tail != dq->head) {
+		*task = dq->slots[--dq->tail & (CRYPTO_DEQUE_SLOTS - 1)];
+		ret = 1;
+	}
+	pthread_mutex_unlock(&dq->mtx);
+
+	return ret;
+}
+
+static int
+crypto_deque_steal(struct crypto_deque *dq, struct crypto_task *task)
+{
+	int ret = 0;
+
+	/* Do not bother taking the lock of an empty deque. */
+	if (dq->tail == dq->head)
+		return 0;
+
+	pthread_mutex_lock(&dq->mtx);
+	if (dq->tail != dq->head) {
+		*task = dq->slots[dq->head++ & (CRYPTO_DEQUE_SLOTS - 1)];
+		ret = 1;
+	}
+	pthread_mutex_unlock(&dq->mtx);
+
+	return ret;
+}
+
+static struct crypto_worker *
+crypto_worker_self(struct crypto_pool *pool)
+{
+	struct crypto_worker *w;
+
+	if (!crypto_worker_key_ok)
+		return NULL;
+	if ((w = pthread_getspecific(crypto_worker_key)) == NULL ||
+	    w->pool != pool)
+		return NULL;
+
+	return w;
+}
+
+/*
+ * Find a task for self, which is NULL for a thread outside the pool: first
+ * the newest one of its own deque, then the oldest queued from outside,
+ * then the oldest one of another worker.
+ */
+static int
+crypto_pool_take(struct crypto_pool *pool, struct crypto_worker *self,
+    struct crypto_task *task)
+{
+	int i, start;
+
+	if (pool->queued == 0)
+		return 0;
+
+	if (self != NULL && crypto_deque_pop(&self->deque, task))
+		goto found;
+	if (crypto_deque_steal(&pool->shared, task))
+		goto found;
+
+	start = self != NULL ? self->index + 1 : 0;
+	for (i = 0; i < pool->nworkers; i++) {
+		if (crypto_deque_steal(
+		    &pool->workers[(start + i) % pool->nworkers].deque, task))
+			goto found;
+	}
+
+	return 0;
+
+ found:
+	__sync_fetch_and_sub(&pool->queued, 1);
+	return 1;
+}
+
+static void
+crypto_task_run(struct crypto_task *task)
+{
+	struct crypto_tasks *tasks = task->tasks;
+
+	task->fn(task->arg);
+
+	pthread_mutex_lock(&tasks->mtx);
+	if (--tasks->pending == 0)
+		pthread_cond_broadcast(&tasks->cond);
+	pthread_mutex_unlock(&tasks->mtx);
+}
+
+static void *
+crypto_worker_run(void *arg)
+{
+	struct crypto_worker *self = arg;
+	struct crypto_pool *pool = self->pool;
+	struct crypto_task task;
+
+	if (crypto_worker_key_ok)
+		pthread_setspecific(crypto_worker_key, self);
+
+	for (;;) {
+		if (crypto_pool_take(pool, self, &task)) {
+			crypto_task_run(&task);
+			continue;
+		}
+
+		/*
+		 * Announce that we are about to sleep before checking for
+		 * work once more, so that a task queued in between sees us
+		 * and wakes us up.
+		 */
+		pthread_mutex_lock(&pool->mtx);
+		__sync_fetch_and_add(&pool->sleeping, 1);
+		while (pool->queued == 0 && !pool->shutdown)
+			pthread_cond_wait(&pool->cond, &pool->mtx);
+		__sync_fetch_and_sub(&pool->sleeping, 1);
+		if (pool->queued == 0 && pool->shutdown) {
+			pthread_mutex_unlock(&pool->mtx);
+			break;
+		}
+		pthread_mutex_unlock(&pool->mtx);
+	}
+
+	ERR_remove_thread_state(NULL);
+
+	return NULL;
+}
+
+static int
+crypto_pool_push(struct crypto_pool *pool, const struct crypto_task *task)
+{
+	struct crypto_worker *self;
+	struct crypto_deque *dq;
+
+	dq = &pool->shared;
+	if ((self = crypto_worker_self(pool)) != NULL)
+		dq = &self->deque;
+
+	/* Count the task first, so that it cannot be taken uncounted. */
+	__sync_fetch_and_add(&pool->queued, 1);
+	if (!crypto_deque_push(dq, task)) {
+		__sync_fetch_and_sub(&pool->queued, 1);
+		return 0;
+	}
+	if (pool->sleeping > 0) {
+		pthread_mutex_lock(&pool->mtx);
+		pthread_cond_signal(&pool->cond);
+		pthread_mutex_unlock(&pool->mtx);
+	}
+
+	return 1;
+}
+
+static void
+crypto_pool_free(struct crypto_pool *pool)
+{
+	int i;
+
+	if (pool == NULL)
+		return;
+
+	for (i = 0; i < pool->nworkers; i++)
+		pthread_mutex_destroy(&pool->workers[i].deque.mtx);
+	pthread_mutex_destroy(&pool->shared.mtx);
+	pthread_mutex_destroy(&pool->mtx);
+	pthread_cond_destroy(&pool->cond);
+	free(pool->workers);
+	free(pool);
+}
+
+static void
+crypto_pool_release(struct crypto_pool *pool)
+{
+	int refs;
+
+	if (pool == NULL)
+		return;
+
+	pthread_mutex_lock(&crypto_pool_lock);
+	refs = --pool->refs;
+	pthread_mutex_unlock(&crypto_pool_lock);
+
+	if (refs == 0)
+		crypto_pool_free(pool);
+}
+
+/*
+ * Stop the workers once they have run every queued task.  Must not be
+ * called from a task.
+ */
+static void
+crypto_pool_shutdown(struct crypto_pool *pool)
+{
+	int i;
+
+	pthread_mutex_lock(&pool->mtx);
+	pool->shutdown = 1;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->mtx);
+
+	for (i = 0; i < pool->nworkers; i++)
+		pthread_join(pool->workers[i].thread, NULL);
+}
+
+static struct crypto_pool *
+crypto_pool_new(int nthreads)
+{
+	struct crypto_pool *pool;
+	int i;
+
+	if ((pool = calloc(1, sizeof(*pool))) == NULL) {
+		CRYPTOerror(ERR_R_MALLOC_FAILURE);
+		return NULL;
+	}
+	if ((pool->workers = calloc(nthreads, sizeof(*pool->workers))) ==
+	    NULL) {
+		CRYPTOerror(ERR_R_MALLOC_FAILURE);
+		free(pool);
+		return NULL;
+	}
+	pool->pid = getpid();
+	pool->refs = 1;
+	pthread_mutex_init(&pool->mtx, NULL);
+	pthread_cond_init(&pool->cond, NULL);
+	crypto_deque_init(&pool->shared);
+	for (i = 0; i < nthreads; i++) {
+		pool->workers[i].pool = pool;
+		pool->workers[i].index = i;
+		crypto_deque_init(&pool->workers[i].deque);
+	}
+
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&pool->workers[i].thread, NULL,
+		    crypto_worker_run, &pool->workers[i]) != 0)
+			break;
+		pool->nworkers++;
+	}
+	if (pool->nworkers < nthreads) {
+		crypto_pool_shutdown(pool);
+		crypto_pool_free(pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+int
+CRYPTO_set_thread_pool(int nthreads)
+{
+	struct crypto_pool *new = NULL, *old;
+
+	if (nthreads < 0 || nthreads > CRYPTO_POOL_MAX_THREADS)
+		return 0;
+
+	pthread_once(&crypto_worker_once, crypto_worker_key_init);
+
+	if (nthreads > 0 && (new = crypto_pool_new(nthreads)) == NULL)
+		return 0;
+
+	pthread_mutex_lock(&crypto_pool_lock);
+	old = crypto_pool;
+	crypto_pool = new;
+	pthread_mutex_unlock(&crypto_pool_lock);
+
+	/* Task groups still using the old pool keep it alive. */
+	if (old != NULL) {
+		crypto_pool_shutdown(old);
+		crypto_pool_release(old);
+	}
+
+	return 1;
+}
+
+void
+CRYPTO_set_thread_executor(int (*executor)(void (*task)(void *),
+    void *task_arg, void *arg), void *arg, int nthreads)
+{
+	pthread_mutex_lock(&crypto_pool_lock);
+	crypto_executor = executor;
+	crypto_executor_arg = arg;
+	crypto_executor_threads = executor != NULL && nthreads > 0 ?
+	    nthreads : 0;
+	pthread_mutex_unlock(&crypto_pool_lock);
+}
+
+/*
+ * The number of threads that may run tasks at the same time, counting the
+ * caller, or 0 if the application has not configured a pool or executor.
+ */
+int
+crypto_tasks_threads(void)
+{
+	int nthreads = 0;
+
+	pthread_mutex_lock(&crypto_pool_lock);
+	if (crypto_executor != NULL)
+		nthreads = crypto_executor_threads + 1;
+	else if (crypto_pool != NULL && crypto_pool->pid == getpid())
+		nthreads = crypto_pool->nworkers + 1;
+	pthread_mutex_unlock(&crypto_pool_lock);
+
+	return nthreads;
+}
+
+struct crypto_tasks *
+crypto_tasks_new(void)
+{
+	struct crypto_tasks *tasks;
+
+	if ((tasks = calloc(1, sizeof(*tasks))) == NULL)
+		return NULL;
+	pthread_mutex_init(&tasks->mtx, NULL);
+	pthread_cond_init(&tasks->cond, NULL);
+
+	pthread_mutex_lock(&crypto_pool_lock);
+	if (crypto_executor != NULL) {
+		tasks->executor = crypto_executor;
+		tasks->executor_arg = crypto_executor_arg;
+	} else if (crypto_pool != NULL && crypto_pool->pid == getpid()) {
+		/* A forked child has none of the workers. */
+		tasks->pool = crypto_pool;
+		tasks->pool->refs++;
+	}
+	pthread_mutex_unlock(&crypto_pool_lock);
+
+	return tasks;
+}
+
+static void
+crypto_task_run_executor(void *arg)
+{
+	struct crypto_task *task = arg;
+
+	crypto_task_run(task);
+	free(task);
+}
+
+/*
+ * Queue fn(arg) to be run as part of tasks.  If it cannot be queued, it is
+ * run before returning, so the caller need not handle failure.
+ */
+void
+crypto_tasks_add(struct crypto_tasks *tasks, void (*fn)(void *), void *arg)
+{
+	struct crypto_task task, *t;
+
+	task.fn = fn;
+	task.arg = arg;
+	task.tasks = tasks;
+
+	pthread_mutex_lock(&tasks->mtx);
+	tasks->pending++;
+	pthread_mutex_unlock(&tasks->mtx);
+
+	if (tasks->executor != NULL) {
+		if ((t = malloc(sizeof(*t))) != NULL) {
+			*t = task;
+			if (tasks->executor(crypto_task_run_executor, t,
+			    tasks->executor_arg))
+				return;
+			free(t);
+		}
+	} else if (tasks->pool != NULL && !tasks->pool->shutdown) {
+		if (crypto_pool_push(tasks->pool, &task))
+			return;
+	}
+
+	crypto_task_run(&task);
+}
+
+/*
+ * Wait for every task added to tasks to finish.  A waiter runs queued
+ * tasks itself, of any group, rather than sleeping while there are some,
+ * so a task may wait on tasks of its own.
+ */
+void
+crypto_tasks_wait(struct crypto_tasks *tasks)
+{
+	struct crypto_pool *pool = tasks->pool;
+	struct crypto_task task;
+
+	if (pool != NULL) {
+		while (tasks->pending > 0 &&
+		    crypto_pool_take(pool, crypto_worker_self(pool), &task))
+			crypto_task_run(&task);
+	}
+
+	pthread_mutex_lock(&tasks->mtx);
+	while (tasks->pending > 0)
+		pthread_cond_wait(&tasks->cond, &tasks->mtx);
+	pthread_mutex_unlock(&tasks->mtx);
+}
+
+void
+crypto_tasks_free(struct crypto_tasks *tasks)
+{
+	if (tasks == NULL)
+		return;
+
+	crypto_tasks_wait(tasks);
+	crypto_pool_release(tasks->pool);
+	pthread_mutex_destroy(&tasks->mtx);
+	pthread_cond_destroy(&tasks->cond);
+	free(tasks);
+}
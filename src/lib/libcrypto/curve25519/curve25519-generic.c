@@ -24,11 +24,77 @@
  * The field functions are shared by Ed25519 and X25519 where possible.
  */
 
+#include <string.h>
+
+#include <openssl/crypto.h>
+
+#include "cryptlib.h"
 #include "curve25519_internal.h"
 
+#if defined(X25519_ADX) || defined(X25519_IFMA)
+#include "x86_arch.h"
+#endif
+
+#ifdef X25519_IFMA
+/*
+ * The IFMA ladders take about as long as three and a half scalar
+ * multiplications with ADX, so a group of fewer than four is done one
+ * at a time.
+ */
+#define X25519_IFMA_MIN	4
+#endif
+
 void
 x25519_scalar_mult(uint8_t out[32], const uint8_t scalar[32],
     const uint8_t point[32])
 {
+#ifdef X25519_ADX
+	if ((OPENSSL_cpu_caps() & CPUCAP_MASK_ADX) != 0) {
+		x25519_scalar_mult_adx(out, scalar, point);
+		return;
+	}
+#endif
 	x25519_scalar_mult_generic(out, scalar, point);
 }
+
+/*
+ * Groups of eight are done at once with IFMA. A last group that is smaller
+ * is padded with copies of its first multiplication.
+ */
+void
+x25519_scalar_mult_batch(uint8_t *const *out, const uint8_t *const *scalar,
+    const uint8_t *const *point, size_t n)
+{
+	size_t i = 0;
+#ifdef X25519_IFMA
+	uint8_t pad[8][32];
+	uint8_t *o[8];
+	const uint8_t *s[8], *p[8];
+	size_t j, m;
+
+	if ((OPENSSL_cpu_caps() & CPUCAP_MASK_IFMA) != 0) {
+		for (; n - i >= X25519_IFMA_MIN; i += m) {
+			m = n - i < 8 ? n - i : 8;
+			for (j = 0; j < 8; j++) {
+				o[j] = j < m ? out[i + j] : pad[j];
+				s[j] = scalar[j < m ? i + j : i];
+				p[j] = point[j < m ? i + j : i];
+			}
+			x25519_scalar_mult_ifma(o, s, p);
+		}
+		explicit_bzero(pad, sizeof(pad));
+	}
+#endif
+	for (; i < n; i++)
+		x25519_scalar_mult(out[i], scalar[i], point[i]);
+}
+
+const char *
+x25519_implementation(void)
+{
+#ifdef X25519_ADX
+	if ((OPENSSL_cpu_caps() & CPUCAP_MASK_ADX) != 0)
+		return "adx";
+#endif
+	return "c";
+}
@@ -4728,8 +4728,730 @@ int ED25519_verify(const uint8_t *message, size_t message_len,
 
   return timingsafe_memcmp(rcheck, rcopy, sizeof(rcheck)) == 0;
 }
+
+/* Signatures are checked in groups of at most this many, which bounds the
+ * memory used by a single batch. */
+#define ED25519_BATCH_MAX 256
+
+/* Below this many signatures, verifying them one at a time is faster. */
+#define ED25519_BATCH_MIN 16
+
+static const uint8_t kEd25519BasePoint[32] = {
+    0x58, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66,
+    0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66,
+    0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66,
+};
+
+/* l - 1, where l is the order of the base point. */
+static const uint8_t kEd25519OrderMinusOne[32] = {
+    0xec, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58, 0xd6, 0x9c, 0xf7,
+    0xa2, 0xde, 0xf9, 0xde, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10,
+};
+
+/* Splits the scalar a, which must be below 2^253, into nwindows signed digits
+ * of c bits, with -2^(c-1) <= r[i] < 2^(c-1) and a = sum r[i] 2^(c i). */
+static void
+ed25519_batch_recode(signed char *r, int nwindows, int c, const uint8_t *a) {
+  int carry = 0;
+  int i;
+  int j;
+
+  for (i = 0; i < nwindows; ++i) {
+    int digit = 0;
+
+    for (j = 0; j < c && i * c + j < 256; ++j) {
+      int bit = i * c + j;
+      digit |= ((a[bit >> 3] >> (bit & 7)) & 1) << j;
+    }
+    digit += carry;
+    carry = (digit + (1 << (c - 1))) >> c;
+    r[i] = digit - (carry << c);
+  }
+}
+
+/* h = sum scalars[i] * points[i], using Pippenger's bucket method. This runs
+ * in variable time and is only used on public values. Returns zero on
+ * allocation failure. */
+static int
+ed25519_batch_msm(ge_p3 *h, const uint8_t (*scalars)[32],
+    const ge_p3 *points, size_t npoints) {
+  ge_cached *cached = NULL;
+  ge_p3 *buckets = NULL;
+  signed char *digits = NULL;
+  ge_cached t;
+  ge_p1p1 r;
+  ge_p2 q;
+  ge_p3 sum;
+  ge_p3 acc;
+  size_t i;
+  int best = 0;
+  int c = 0;
+  int nbuckets;
+  int nwindows;
+  int w;
+  int k;
+  int ret = 0;
+
+  /* Each window costs one addition per point and two per bucket. */
+  for (k = 2; k <= 8; ++k) {
+    int cost = (253 / k + 2) * (int)(npoints + (1 << k));
+
+    if (c == 0 || cost < best) {
+      best = cost;
+      c = k;
+    }
+  }
+  nwindows = 253 / c + 2;
+  nbuckets = 1 << (c - 1);
+
+  if ((cached = reallocarray(NULL, npoints, sizeof(*cached))) == NULL)
+    goto err;
+  if ((buckets = reallocarray(NULL, nbuckets, sizeof(*buckets))) == NULL)
+    goto err;
+  if ((digits = reallocarray(NULL, npoints, nwindows)) == NULL)
+    goto err;
+
+  for (i = 0; i < npoints; ++i) {
+    x25519_ge_p3_to_cached(&cached[i], &points[i]);
+    ed25519_batch_recode(&digits[i * nwindows], nwindows, c, scalars[i]);
+  }
+
+  ge_p3_0(h);
+  for (w = nwindows - 1; w >= 0; --w) {
+    if (w != nwindows - 1) {
+      ge_p3_dbl(&r, h);
+      for (k = 1; k < c; ++k) {
+        x25519_ge_p1p1_to_p2(&q, &r);
+        ge_p2_dbl(&r, &q);
+      }
+      x25519_ge_p1p1_to_p3(h, &r);
+    }
+
+    for (k = 0; k < nbuckets; ++k) {
+      ge_p3_0(&buckets[k]);
+    }
+    for (i = 0; i < npoints; ++i) {
+      int digit = digits[i * nwindows + w];
+
+      if (digit > 0) {
+        x25519_ge_add(&r, &buckets[digit - 1], &cached[i]);
+        x25519_ge_p1p1_to_p3(&buckets[digit - 1], &r);
+      } else if (digit < 0) {
+        x25519_ge_sub(&r, &buckets[-digit - 1], &cached[i]);
+        x25519_ge_p1p1_to_p3(&buckets[-digit - 1], &r);
+      }
+    }
+
+    /* acc = sum (k + 1) * buckets[k] */
+    ge_p3_0(&sum);
+    ge_p3_0(&acc);
+    for (k = nbuckets - 1; k >= 0; --k) {
+      x25519_ge_p3_to_cached(&t, &buckets[k]);
+      x25519_ge_add(&r, &sum, &t);
+      x25519_ge_p1p1_to_p3(&sum, &r);
+      x25519_ge_p3_to_cached(&t, &sum);
+      x25519_ge_add(&r, &acc, &t);
+      x25519_ge_p1p1_to_p3(&acc, &r);
+    }
+
+    x25519_ge_p3_to_cached(&t, &acc);
+    x25519_ge_add(&r, h, &t);
+    x25519_ge_p1p1_to_p3(h, &r);
+  }
+
+  ret = 1;
+
+ err:
+  free(cached);
+  free(buckets);
+  free(digits);
+
+  return ret;
+}
+
+/* Checks n signatures at once by testing that
+ *
+ *   8 * (sum z_i R_i + sum (z_i h_i) A_i - (sum z_i s_i) B) = 0
+ *
+ * for random 128-bit z_i. This holds for any set of valid signatures and,
+ * except with probability 2^-128, fails if any of them is invalid. Returns
+ * one if the batch verifies, zero otherwise, and -1 on allocation failure. */
+static int
+ed25519_verify_batch_check(const uint8_t *const *messages,
+    const size_t *message_lens, const uint8_t *const *signatures,
+    const uint8_t *const *public_keys, size_t n) {
+  static const uint8_t zero[32] = {0};
+  uint8_t (*scalars)[32] = NULL;
+  ge_p3 *points = NULL;
+  uint8_t bsum[32];
+  uint8_t h[SHA512_DIGEST_LENGTH];
+  uint8_t z[32];
+  SHA512_CTX hash_ctx;
+  ge_p3 Q;
+  ge_p1p1 r;
+  ge_p2 q;
+  fe check;
+  size_t npoints = 2 * n + 1;
+  size_t i;
+  int ret = -1;
+
+  if ((scalars = reallocarray(NULL, npoints, sizeof(*scalars))) == NULL)
+    goto err;
+  if ((points = reallocarray(NULL, npoints, sizeof(*points))) == NULL)
+    goto err;
+
+  memset(bsum, 0, sizeof(bsum));
+  memset(z, 0, sizeof(z));
+
+  ret = 0;
+  for (i = 0; i < n; ++i) {
+    if ((signatures[i][63] & 224) != 0 ||
+        x25519_ge_frombytes_vartime(&points[2 * i], public_keys[i]) != 0 ||
+        x25519_ge_frombytes_vartime(&points[2 * i + 1], signatures[i]) != 0) {
+      goto err;
+    }
+
+    SHA512_Init(&hash_ctx);
+    SHA512_Update(&hash_ctx, signatures[i], 32);
+    SHA512_Update(&hash_ctx, public_keys[i], 32);
+    SHA512_Update(&hash_ctx, messages[i], message_lens[i]);
+    SHA512_Final(h, &hash_ctx);
+    x25519_sc_reduce(h);
+
+    arc4random_buf(z, 16);
+    sc_muladd(scalars[2 * i], z, h, zero);
+    memcpy(scalars[2 * i + 1], z, 32);
+    sc_muladd(bsum, z, signatures[i] + 32, bsum);
+  }
+
+  if (x25519_ge_frombytes_vartime(&points[2 * n], kEd25519BasePoint) != 0)
+    goto err;
+  sc_muladd(scalars[2 * n], bsum, kEd25519OrderMinusOne, zero);
+
+  ret = -1;
+  if (!ed25519_batch_msm(&Q, (const uint8_t (*)[32])scalars, points,
+      npoints))
+    goto err;
+
+  /* Clear any small order component before comparing with the identity. */
+  ge_p3_dbl(&r, &Q);
+  x25519_ge_p1p1_to_p2(&q, &r);
+  ge_p2_dbl(&r, &q);
+  x25519_ge_p1p1_to_p2(&q, &r);
+  ge_p2_dbl(&r, &q);
+  x25519_ge_p1p1_to_p2(&q, &r);
+
+  fe_sub(check, q.Y, q.Z);
+  ret = !fe_isnonzero(q.X) && !fe_isnonzero(check);
+
+ err:
+  free(scalars);
+  free(points);
+
+  return ret;
+}
+
+/* ED25519_verify_batch verifies the n signatures signatures[i] over
+ * messages[i] under public_keys[i]. It returns one if all of them are valid
+ * and zero otherwise. If out_valid is not NULL, out_valid[i] is set to one or
+ * zero according to whether signature i is valid; the signatures of a group
+ * that fails the batch check are then verified one at a time.
+ *
+ * The batch check uses the cofactored verification equation, so a signature
+ * that includes a small order component may be accepted here while being
+ * rejected by ED25519_verify. Honestly generated signatures never do. */
+int ED25519_verify_batch(const uint8_t *const *messages,
+                         const size_t *message_lens,
+                         const uint8_t *const *signatures,
+                         const uint8_t *const *public_keys, size_t n,
+                         int *out_valid) {
+  size_t count;
+  size_t i, j;
+  int ok = 1;
+  int ret;
+
+  for (i = 0; i < n; i += count) {
+    count = n - i;
+    if (count > ED25519_BATCH_MAX)
+      count = ED25519_BATCH_MAX;
+
+    ret = -1;
+    if (count >= ED25519_BATCH_MIN) {
+      ret = ed25519_verify_batch_check(&messages[i], &message_lens[i],
+          &signatures[i], &public_keys[i], count);
+    }
+    if (ret == 1) {
+      if (out_valid != NULL) {
+        for (j = i; j < i + count; ++j)
+          out_valid[j] = 1;
+      }
+      continue;
+    }
+    if (ret == 0 && out_valid == NULL)
+      return 0;
+
+    for (j = i; j < i + count; ++j) {
+      int valid = ED25519_verify(messages[j], message_lens[j],
+          signatures[j], public_keys[j]);
+
+      if (out_valid != NULL)
+        out_valid[j] = valid;
+      ok &= valid;
+    }
+  }
+
+  return ok;
+}
+#endif
+
+#if defined(__SIZEOF_INT128__)
+#define X25519_FE51
+typedef unsigned __int128 uint128_t;
 #endif
 
+#if defined(X25519_FE51)
+/* fe51 is a field element t with five limbs of 51 bits:
+ * t[0]+2^51 t[1]+2^102 t[2]+2^153 t[3]+2^204 t[4]. After a multiplication
+ * or a subtraction no limb is much above 2^51, and sums of two such elements
+ * may be used as inputs to any of the functions below. */
+typedef uint64_t fe51[5];
+
+static const uint64_t kBottom51Bits = 0x7ffffffffffffULL;
+
+static uint64_t load_8(const uint8_t *in) {
+  return load_4(in) | (load_4(in + 4) << 32);
+}
+
+static void store_8(uint8_t *out, uint64_t v) {
+  int i;
+  for (i = 0; i < 8; i++) {
+    out[i] = v & 0xff;
+    v >>= 8;
+  }
+}
+
+static void fe51_frombytes(fe51 h, const uint8_t *s) {
+  /* Ignores top bit of s. */
+  uint64_t w0 = load_8(s);
+  uint64_t w1 = load_8(s + 8);
+  uint64_t w2 = load_8(s + 16);
+  uint64_t w3 = load_8(s + 24);
+
+  h[0] = w0 & kBottom51Bits;
+  h[1] = ((w0 >> 51) | (w1 << 13)) & kBottom51Bits;
+  h[2] = ((w1 >> 38) | (w2 << 26)) & kBottom51Bits;
+  h[3] = ((w2 >> 25) | (w3 << 39)) & kBottom51Bits;
+  h[4] = (w3 >> 12) & kBottom51Bits;
+}
+
+static void fe51_tobytes(uint8_t *s, const fe51 f) {
+  uint64_t h0 = f[0], h1 = f[1], h2 = f[2], h3 = f[3], h4 = f[4];
+  uint64_t q;
+
+  h1 += h0 >> 51; h0 &= kBottom51Bits;
+  h2 += h1 >> 51; h1 &= kBottom51Bits;
+  h3 += h2 >> 51; h2 &= kBottom51Bits;
+  h4 += h3 >> 51; h3 &= kBottom51Bits;
+  h0 += (h4 >> 51) * 19; h4 &= kBottom51Bits;
+
+  /* Now h < 2p, and q = 1 if h >= p, that is if h + 19 >= 2^255. */
+  q = (h0 + 19) >> 51;
+  q = (h1 + q) >> 51;
+  q = (h2 + q) >> 51;
+  q = (h3 + q) >> 51;
+  q = (h4 + q) >> 51;
+
+  /* h - q*p = h + 19q - q*2^255, where the last term is dropped below. */
+  h0 += 19 * q;
+  h1 += h0 >> 51; h0 &= kBottom51Bits;
+  h2 += h1 >> 51; h1 &= kBottom51Bits;
+  h3 += h2 >> 51; h2 &= kBottom51Bits;
+  h4 += h3 >> 51; h3 &= kBottom51Bits;
+  h4 &= kBottom51Bits;
+
+  store_8(s, h0 | (h1 << 51));
+  store_8(s + 8, (h1 >> 13) | (h2 << 38));
+  store_8(s + 16, (h2 >> 26) | (h3 << 25));
+  store_8(s + 24, (h3 >> 39) | (h4 << 12));
+}
+
+static void fe51_0(fe51 h) { memset(h, 0, sizeof(uint64_t) * 5); }
+
+static void fe51_1(fe51 h) {
+  fe51_0(h);
+  h[0] = 1;
+}
+
+static void fe51_copy(fe51 h, const fe51 f) {
+  memmove(h, f, sizeof(uint64_t) * 5);
+}
+
+static void fe51_add(fe51 h, const fe51 f, const fe51 g) {
+  unsigned i;
+  for (i = 0; i < 5; i++) {
+    h[i] = f[i] + g[i];
+  }
+}
+
+/* h = f - g, computed as f + 4p - g so that no limb goes negative, followed
+ * by a carry. This requires the limbs of g to be below 2^53. */
+static void fe51_sub(fe51 h, const fe51 f, const fe51 g) {
+  uint64_t h0, h1, h2, h3, h4;
+
+  h0 = f[0] + 0x1fffffffffffb4ULL - g[0];
+  h1 = f[1] + 0x1ffffffffffffcULL - g[1];
+  h2 = f[2] + 0x1ffffffffffffcULL - g[2];
+  h3 = f[3] + 0x1ffffffffffffcULL - g[3];
+  h4 = f[4] + 0x1ffffffffffffcULL - g[4];
+
+  h1 += h0 >> 51; h0 &= kBottom51Bits;
+  h2 += h1 >> 51; h1 &= kBottom51Bits;
+  h3 += h2 >> 51; h2 &= kBottom51Bits;
+  h4 += h3 >> 51; h3 &= kBottom51Bits;
+  h0 += (h4 >> 51) * 19; h4 &= kBottom51Bits;
+
+  h[0] = h0;
+  h[1] = h1;
+  h[2] = h2;
+  h[3] = h3;
+  h[4] = h4;
+}
+
+static void fe51_carry(fe51 h, uint128_t h0, uint128_t h1, uint128_t h2,
+                       uint128_t h3, uint128_t h4) {
+  uint64_t r0, r1, r2, r3, r4, c;
+
+  r0 = (uint64_t)h0 & kBottom51Bits; h1 += (uint64_t)(h0 >> 51);
+  r1 = (uint64_t)h1 & kBottom51Bits; h2 += (uint64_t)(h1 >> 51);
+  r2 = (uint64_t)h2 & kBottom51Bits; h3 += (uint64_t)(h2 >> 51);
+  r3 = (uint64_t)h3 & kBottom51Bits; h4 += (uint64_t)(h3 >> 51);
+  r4 = (uint64_t)h4 & kBottom51Bits; c = (uint64_t)(h4 >> 51);
+  r0 += c * 19;
+  r1 += r0 >> 51; r0 &= kBottom51Bits;
+
+  h[0] = r0;
+  h[1] = r1;
+  h[2] = r2;
+  h[3] = r3;
+  h[4] = r4;
+}
+
+static void fe51_mul(fe51 h, const fe51 f, const fe51 g) {
+  uint64_t f0 = f[0], f1 = f[1], f2 = f[2], f3 = f[3], f4 = f[4];
+  uint64_t g0 = g[0], g1 = g[1], g2 = g[2], g3 = g[3], g4 = g[4];
+  uint64_t g1_19 = 19 * g1, g2_19 = 19 * g2, g3_19 = 19 * g3;
+  uint64_t g4_19 = 19 * g4;
+  uint128_t h0, h1, h2, h3, h4;
+
+  h0 = (uint128_t)f0 * g0 + (uint128_t)f1 * g4_19 + (uint128_t)f2 * g3_19 +
+       (uint128_t)f3 * g2_19 + (uint128_t)f4 * g1_19;
+  h1 = (uint128_t)f0 * g1 + (uint128_t)f1 * g0 + (uint128_t)f2 * g4_19 +
+       (uint128_t)f3 * g3_19 + (uint128_t)f4 * g2_19;
+  h2 = (uint128_t)f0 * g2 + (uint128_t)f1 * g1 + (uint128_t)f2 * g0 +
+       (uint128_t)f3 * g4_19 + (uint128_t)f4 * g3_19;
+  h3 = (uint128_t)f0 * g3 + (uint128_t)f1 * g2 + (uint128_t)f2 * g1 +
+       (uint128_t)f3 * g0 + (uint128_t)f4 * g4_19;
+  h4 = (uint128_t)f0 * g4 + (uint128_t)f1 * g3 + (uint128_t)f2 * g2 +
+       (uint128_t)f3 * g1 + (uint128_t)f4 * g0;
+
+  fe51_carry(h, h0, h1, h2, h3, h4);
+}
+
+static void fe51_sq(fe51 h, const fe51 f) {
+  uint64_t f0 = f[0], f1 = f[1], f2 = f[2], f3 = f[3], f4 = f[4];
+  uint64_t f0_2 = 2 * f0, f1_2 = 2 * f1;
+  uint64_t f1_38 = 38 * f1, f2_38 = 38 * f2, f3_38 = 38 * f3;
+  uint64_t f3_19 = 19 * f3, f4_19 = 19 * f4;
+  uint128_t h0, h1, h2, h3, h4;
+
+  h0 = (uint128_t)f0 * f0 + (uint128_t)f1_38 * f4 + (uint128_t)f2_38 * f3;
+  h1 = (uint128_t)f0_2 * f1 + (uint128_t)f2_38 * f4 + (uint128_t)f3_19 * f3;
+  h2 = (uint128_t)f0_2 * f2 + (uint128_t)f1 * f1 + (uint128_t)f3_38 * f4;
+  h3 = (uint128_t)f0_2 * f3 + (uint128_t)f1_2 * f2 + (uint128_t)f4_19 * f4;
+  h4 = (uint128_t)f0_2 * f4 + (uint128_t)f1_2 * f3 + (uint128_t)f2 * f2;
+
+  fe51_carry(h, h0, h1, h2, h3, h4);
+}
+
+static void fe51_mul121666(fe51 h, const fe51 f) {
+  fe51_carry(h, (uint128_t)f[0] * 121666, (uint128_t)f[1] * 121666,
+             (uint128_t)f[2] * 121666, (uint128_t)f[3] * 121666,
+             (uint128_t)f[4] * 121666);
+}
+
+static void fe51_cswap(fe51 f, fe51 g, unsigned int b) {
+  uint64_t mask = 0 - (uint64_t)b;
+  unsigned i;
+  for (i = 0; i < 5; i++) {
+    uint64_t x = f[i] ^ g[i];
+    x &= mask;
+    f[i] ^= x;
+    g[i] ^= x;
+  }
+}
+
+static void fe51_invert(fe51 out, const fe51 z) {
+  fe51 t0, t1, t2, t3;
+  int i;
+
+  fe51_sq(t0, z);
+  fe51_sq(t1, t0);
+  fe51_sq(t1, t1);
+  fe51_mul(t1, z, t1);
+  fe51_mul(t0, t0, t1);
+  fe51_sq(t2, t0);
+  fe51_mul(t1, t1, t2);
+  fe51_sq(t2, t1);
+  for (i = 1; i < 5; ++i) {
+    fe51_sq(t2, t2);
+  }
+  fe51_mul(t1, t2, t1);
+  fe51_sq(t2, t1);
+  for (i = 1; i < 10; ++i) {
+    fe51_sq(t2, t2);
+  }
+  fe51_mul(t2, t2, t1);
+  fe51_sq(t3, t2);
+  for (i = 1; i < 20; ++i) {
+    fe51_sq(t3, t3);
+  }
+  fe51_mul(t2, t3, t2);
+  fe51_sq(t2, t2);
+  for (i = 1; i < 10; ++i) {
+    fe51_sq(t2, t2);
+  }
+  fe51_mul(t1, t2, t1);
+  fe51_sq(t2, t1);
+  for (i = 1; i < 50; ++i) {
+    fe51_sq(t2, t2);
+  }
+  fe51_mul(t2, t2, t1);
+  fe51_sq(t3, t2);
+  for (i = 1; i < 100; ++i) {
+    fe51_sq(t3, t3);
+  }
+  fe51_mul(t2, t3, t2);
+  fe51_sq(t2, t2);
+  for (i = 1; i < 50; ++i) {
+    fe51_sq(t2, t2);
+  }
+  fe51_mul(t1, t2, t1);
+  fe51_sq(t1, t1);
+  for (i = 1; i < 5; ++i) {
+    fe51_sq(t1, t1);
+  }
+  fe51_mul(out, t1, t0);
+}
+
+#if !defined(OPENSSL_SMALL)
+/* Group elements as above, with fe51 coordinates. They are only used for
+ * multiples of the base point, computed from k25519Precomp. */
+typedef struct {
+  fe51 X;
+  fe51 Y;
+  fe51 Z;
+} ge51_p2;
+
+typedef struct {
+  fe51 X;
+  fe51 Y;
+  fe51 Z;
+  fe51 T;
+} ge51_p3;
+
+typedef struct {
+  fe51 X;
+  fe51 Y;
+  fe51 Z;
+  fe51 T;
+} ge51_p1p1;
+
+typedef struct {
+  fe51 yplusx;
+  fe51 yminusx;
+  fe51 xy2d;
+} ge51_precomp;
+
+static void fe51_from_fe(fe51 h, const fe f) {
+  uint8_t s[32];
+
+  fe_tobytes(s, f);
+  fe51_frombytes(h, s);
+}
+
+static void ge51_p3_0(ge51_p3 *h) {
+  fe51_0(h->X);
+  fe51_1(h->Y);
+  fe51_1(h->Z);
+  fe51_0(h->T);
+}
+
+/* r = p */
+static void ge51_p1p1_to_p2(ge51_p2 *r, const ge51_p1p1 *p) {
+  fe51_mul(r->X, p->X, p->T);
+  fe51_mul(r->Y, p->Y, p->Z);
+  fe51_mul(r->Z, p->Z, p->T);
+}
+
+/* r = p */
+static void ge51_p1p1_to_p3(ge51_p3 *r, const ge51_p1p1 *p) {
+  fe51_mul(r->X, p->X, p->T);
+  fe51_mul(r->Y, p->Y, p->Z);
+  fe51_mul(r->Z, p->Z, p->T);
+  fe51_mul(r->T, p->X, p->Y);
+}
+
+/* r = 2 * p */
+static void ge51_p2_dbl(ge51_p1p1 *r, const ge51_p2 *p) {
+  fe51 t0;
+
+  fe51_sq(r->X, p->X);
+  fe51_sq(r->Z, p->Y);
+  fe51_sq(r->T, p->Z);
+  fe51_add(r->T, r->T, r->T);
+  fe51_add(r->Y, p->X, p->Y);
+  fe51_sq(t0, r->Y);
+  fe51_add(r->Y, r->Z, r->X);
+  fe51_sub(r->Z, r->Z, r->X);
+  fe51_sub(r->X, t0, r->Y);
+  fe51_sub(r->T, r->T, r->Z);
+}
+
+/* r = 2 * p */
+static void ge51_p3_dbl(ge51_p1p1 *r, const ge51_p3 *p) {
+  ge51_p2 q;
+
+  fe51_copy(q.X, p->X);
+  fe51_copy(q.Y, p->Y);
+  fe51_copy(q.Z, p->Z);
+  ge51_p2_dbl(r, &q);
+}
+
+/* r = p + q */
+static void ge51_madd(ge51_p1p1 *r, const ge51_p3 *p, const ge51_precomp *q) {
+  fe51 t0;
+
+  fe51_add(r->X, p->Y, p->X);
+  fe51_sub(r->Y, p->Y, p->X);
+  fe51_mul(r->Z, r->X, q->yplusx);
+  fe51_mul(r->Y, r->Y, q->yminusx);
+  fe51_mul(r->T, q->xy2d, p->T);
+  fe51_add(t0, p->Z, p->Z);
+  fe51_sub(r->X, r->Z, r->Y);
+  fe51_add(r->Y, r->Z, r->Y);
+  fe51_add(r->Z, t0, r->T);
+  fe51_sub(r->T, t0, r->T);
+}
+
+static void ge51_table_select(ge51_precomp *t, int pos, signed char b) {
+  ge_precomp u;
+
+  table_select(&u, pos, b);
+  fe51_from_fe(t->yplusx, u.yplusx);
+  fe51_from_fe(t->yminusx, u.yminusx);
+  fe51_from_fe(t->xy2d, u.xy2d);
+}
+
+/* h = a * B, as x25519_ge_scalarmult_base. */
+static void ge51_scalarmult_base(ge51_p3 *h, const uint8_t *a) {
+  signed char e[64];
+  signed char carry;
+  ge51_p1p1 r;
+  ge51_p2 s;
+  ge51_precomp t;
+  int i;
+
+  for (i = 0; i < 32; ++i) {
+    e[2 * i + 0] = (a[i] >> 0) & 15;
+    e[2 * i + 1] = (a[i] >> 4) & 15;
+  }
+
+  carry = 0;
+  for (i = 0; i < 63; ++i) {
+    e[i] += carry;
+    carry = e[i] + 8;
+    carry >>= 4;
+    e[i] -= carry << 4;
+  }
+  e[63] += carry;
+
+  ge51_p3_0(h);
+  for (i = 1; i < 64; i += 2) {
+    ge51_table_select(&t, i / 2, e[i]);
+    ge51_madd(&r, h, &t);
+    ge51_p1p1_to_p3(h, &r);
+  }
+
+  ge51_p3_dbl(&r, h);
+  ge51_p1p1_to_p2(&s, &r);
+  ge51_p2_dbl(&r, &s);
+  ge51_p1p1_to_p2(&s, &r);
+  ge51_p2_dbl(&r, &s);
+  ge51_p1p1_to_p2(&s, &r);
+  ge51_p2_dbl(&r, &s);
+  ge51_p1p1_to_p3(h, &r);
+
+  for (i = 0; i < 64; i += 2) {
+    ge51_table_select(&t, i / 2, e[i]);
+    ge51_madd(&r, h, &t);
+    ge51_p1p1_to_p3(h, &r);
+  }
+}
+#endif
+
+void
+x25519_scalar_mult_generic(uint8_t out[32], const uint8_t scalar[32],
+    const uint8_t point[32]) {
+  fe51 x1, x2, z2, x3, z3, tmp0, tmp1;
+
+  uint8_t e[32];
+  memcpy(e, scalar, 32);
+  e[0] &= 248;
+  e[31] &= 127;
+  e[31] |= 64;
+  fe51_frombytes(x1, point);
+  fe51_1(x2);
+  fe51_0(z2);
+  fe51_copy(x3, x1);
+  fe51_1(z3);
+
+  unsigned swap = 0;
+  int pos;
+  for (pos = 254; pos >= 0; --pos) {
+    unsigned b = 1 & (e[pos / 8] >> (pos & 7));
+    swap ^= b;
+    fe51_cswap(x2, x3, swap);
+    fe51_cswap(z2, z3, swap);
+    swap = b;
+    fe51_sub(tmp0, x3, z3);
+    fe51_sub(tmp1, x2, z2);
+    fe51_add(x2, x2, z2);
+    fe51_add(z2, x3, z3);
+    fe51_mul(z3, tmp0, x2);
+    fe51_mul(z2, z2, tmp1);
+    fe51_sq(tmp0, tmp1);
+    fe51_sq(tmp1, x2);
+    fe51_add(x3, z3, z2);
+    fe51_sub(z2, z3, z2);
+    fe51_mul(x2, tmp1, tmp0);
+    fe51_sub(tmp1, tmp1, tmp0);
+    fe51_sq(z2, z2);
+    fe51_mul121666(z3, tmp1);
+    fe51_sq(x3, x3);
+    fe51_add(tmp0, tmp0, z3);
+    fe51_mul(z3, x1, z2);
+    fe51_mul(z2, tmp1, tmp0);
+  }
+  fe51_cswap(x2, x3, swap);
+  fe51_cswap(z2, z3, swap);
+
+  fe51_invert(z2, z2);
+  fe51_mul(x2, x2, z2);
+  fe51_tobytes(out, x2);
+}
+#else
+
 /* Replace (f,g) with (g,f) if b == 1;
  * replace (f,g) with (f,g) if b == 0.
  *
@@ -4859,9 +5581,469 @@ x25519_scalar_mult_generic(uint8_t out[32], const uint8_t scalar[32],
   fe_mul(x2, x2, z2);
   fe_tobytes(out, x2);
 }
+#endif
+
+#if defined(X25519_ADX)
+/* fe64 is a field element as four 64-bit words, in [0, 2^256). Values are
+ * only reduced mod 2^256-38, except by fe64_tobytes. */
+typedef uint64_t fe64[4];
+
+static void fe64_frombytes(fe64 h, const uint8_t *s) {
+  /* Ignores top bit of s. */
+  h[0] = load_8(s);
+  h[1] = load_8(s + 8);
+  h[2] = load_8(s + 16);
+  h[3] = load_8(s + 24) & 0x7fffffffffffffffULL;
+}
+
+static void fe64_tobytes(uint8_t *s, const fe64 f) {
+  uint64_t h[4], t[4], mask;
+  uint128_t c;
+  unsigned i;
+
+  /* Fold bit 255 back in, which leaves h < 2^255 + 19. */
+  c = (uint128_t)(f[3] >> 63) * 19;
+  for (i = 0; i < 4; i++) {
+    c += i < 3 ? f[i] : f[3] & 0x7fffffffffffffffULL;
+    h[i] = (uint64_t)c;
+    c >>= 64;
+  }
+
+  /* Subtract p if h >= p, that is if h + 19 has bit 255 set. */
+  c = 19;
+  for (i = 0; i < 4; i++) {
+    c += h[i];
+    t[i] = (uint64_t)c;
+    c >>= 64;
+  }
+  mask = 0 - (t[3] >> 63);
+  t[3] &= 0x7fffffffffffffffULL;
+  for (i = 0; i < 4; i++) {
+    store_8(s + 8 * i, (t[i] & mask) | (h[i] & ~mask));
+  }
+}
+
+static void fe64_0(fe64 h) { memset(h, 0, sizeof(uint64_t) * 4); }
+
+static void fe64_1(fe64 h) {
+  fe64_0(h);
+  h[0] = 1;
+}
+
+static void fe64_copy(fe64 h, const fe64 f) {
+  memmove(h, f, sizeof(uint64_t) * 4);
+}
+
+/* h = f + g, folding a carry out of bit 256 back in as 38. */
+static void fe64_add(fe64 h, const fe64 f, const fe64 g) {
+  uint64_t h0, h1, h2, h3, c;
+
+  __asm__(
+      "movq	0(%[f]), %[h0]\n\t"
+      "movq	8(%[f]), %[h1]\n\t"
+      "movq	16(%[f]), %[h2]\n\t"
+      "movq	24(%[f]), %[h3]\n\t"
+      "addq	0(%[g]), %[h0]\n\t"
+      "adcq	8(%[g]), %[h1]\n\t"
+      "adcq	16(%[g]), %[h2]\n\t"
+      "adcq	24(%[g]), %[h3]\n\t"
+      "sbbq	%[c], %[c]\n\t"
+      "andq	$38, %[c]\n\t"
+      "addq	%[c], %[h0]\n\t"
+      "adcq	$0, %[h1]\n\t"
+      "adcq	$0, %[h2]\n\t"
+      "adcq	$0, %[h3]\n\t"
+      "sbbq	%[c], %[c]\n\t"
+      "andq	$38, %[c]\n\t"
+      "addq	%[c], %[h0]\n\t"
+      : [h0] "=&r" (h0), [h1] "=&r" (h1), [h2] "=&r" (h2), [h3] "=&r" (h3),
+        [c] "=&r" (c)
+      : [f] "r" (f), [g] "r" (g), "m" (*(const uint64_t (*)[4])f),
+        "m" (*(const uint64_t (*)[4])g)
+      : "cc");
+
+  h[0] = h0;
+  h[1] = h1;
+  h[2] = h2;
+  h[3] = h3;
+}
+
+/* h = f - g, folding a borrow out of bit 256 back in as 38. */
+static void fe64_sub(fe64 h, const fe64 f, const fe64 g) {
+  uint64_t h0, h1, h2, h3, c;
+
+  __asm__(
+      "movq	0(%[f]), %[h0]\n\t"
+      "movq	8(%[f]), %[h1]\n\t"
+      "movq	16(%[f]), %[h2]\n\t"
+      "movq	24(%[f]), %[h3]\n\t"
+      "subq	0(%[g]), %[h0]\n\t"
+      "sbbq	8(%[g]), %[h1]\n\t"
+      "sbbq	16(%[g]), %[h2]\n\t"
+      "sbbq	24(%[g]), %[h3]\n\t"
+      "sbbq	%[c], %[c]\n\t"
+      "andq	$38, %[c]\n\t"
+      "subq	%[c], %[h0]\n\t"
+      "sbbq	$0, %[h1]\n\t"
+      "sbbq	$0, %[h2]\n\t"
+      "sbbq	$0, %[h3]\n\t"
+      "sbbq	%[c], %[c]\n\t"
+      "andq	$38, %[c]\n\t"
+      "subq	%[c], %[h0]\n\t"
+      : [h0] "=&r" (h0), [h1] "=&r" (h1), [h2] "=&r" (h2), [h3] "=&r" (h3),
+        [c] "=&r" (c)
+      : [f] "r" (f), [g] "r" (g), "m" (*(const uint64_t (*)[4])f),
+        "m" (*(const uint64_t (*)[4])g)
+      : "cc");
+
+  h[0] = h0;
+  h[1] = h1;
+  h[2] = h2;
+  h[3] = h3;
+}
+
+static void fe64_mul121666(fe64 h, const fe64 f) {
+  uint64_t h0, h1, h2, h3, c;
+
+  __asm__(
+      "movl	$121666, %%edx\n\t"
+      "mulx	0(%[f]), %[h0], %[h1]\n\t"
+      "mulx	8(%[f]), %[c], %[h2]\n\t"
+      "addq	%[c], %[h1]\n\t"
+      "mulx	16(%[f]), %[c], %[h3]\n\t"
+      "adcq	%[c], %[h2]\n\t"
+      "mulx	24(%[f]), %[c], %%rdx\n\t"
+      "adcq	%[c], %[h3]\n\t"
+      "adcq	$0, %%rdx\n\t"
+      "imulq	$38, %%rdx, %%rdx\n\t"
+      "addq	%%rdx, %[h0]\n\t"
+      "adcq	$0, %[h1]\n\t"
+      "adcq	$0, %[h2]\n\t"
+      "adcq	$0, %[h3]\n\t"
+      "sbbq	%[c], %[c]\n\t"
+      "andq	$38, %[c]\n\t"
+      "addq	%[c], %[h0]\n\t"
+      : [h0] "=&r" (h0), [h1] "=&r" (h1), [h2] "=&r" (h2), [h3] "=&r" (h3),
+        [c] "=&r" (c)
+      : [f] "r" (f), "m" (*(const uint64_t (*)[4])f)
+      : "rdx", "cc");
+
+  h[0] = h0;
+  h[1] = h1;
+  h[2] = h2;
+  h[3] = h3;
+}
+
+/* h = f * g, using MULX with two carry chains, one through CF (ADCX) and
+ * one through OF (ADOX). The 512-bit product is then folded as
+ * lo + 38 * hi. */
+static void fe64_mul(fe64 h, const fe64 f, const fe64 g) {
+  uint64_t t0;
+
+  __asm__ volatile(
+      /* f[0] * g */
+      "movq	0(%%rsi), %%rdx\n\t"
+      "mulx	0(%%rcx), %%r8, %%rax\n\t"
+      "mulx	8(%%rcx), %%r9, %%rbx\n\t"
+      "addq	%%rax, %%r9\n\t"
+      "mulx	16(%%rcx), %%r10, %%rax\n\t"
+      "adcq	%%rbx, %%r10\n\t"
+      "mulx	24(%%rcx), %%r11, %%r12\n\t"
+      "adcq	%%rax, %%r11\n\t"
+      "adcq	$0, %%r12\n\t"
+      "movq	%%r8, %[t0]\n\t"
+      "xorl	%%r8d, %%r8d\n\t"	/* zero, and clear CF and OF */
+
+      /* f[1] * g */
+      "movq	8(%%rsi), %%rdx\n\t"
+      "mulx	0(%%rcx), %%rax, %%rbx\n\t"
+      "adox	%%rax, %%r9\n\t"
+      "adcx	%%rbx, %%r10\n\t"
+      "mulx	8(%%rcx), %%rax, %%rbx\n\t"
+      "adox	%%rax, %%r10\n\t"
+      "adcx	%%rbx, %%r11\n\t"
+      "mulx	16(%%rcx), %%rax, %%rbx\n\t"
+      "adox	%%rax, %%r11\n\t"
+      "adcx	%%rbx, %%r12\n\t"
+      "mulx	24(%%rcx), %%rax, %%r13\n\t"
+      "adox	%%rax, %%r12\n\t"
+      "adcx	%%r8, %%r13\n\t"
+      "adox	%%r8, %%r13\n\t"
+
+      /* f[2] * g */
+      "movq	16(%%rsi), %%rdx\n\t"
+      "mulx	0(%%rcx), %%rax, %%rbx\n\t"
+      "adcx	%%rax, %%r10\n\t"
+      "adox	%%rbx, %%r11\n\t"
+      "mulx	8(%%rcx), %%rax, %%rbx\n\t"
+      "adcx	%%rax, %%r11\n\t"
+      "adox	%%rbx, %%r12\n\t"
+      "mulx	16(%%rcx), %%rax, %%rbx\n\t"
+      "adcx	%%rax, %%r12\n\t"
+      "adox	%%rbx, %%r13\n\t"
+      "mulx	24(%%rcx), %%rax, %%r14\n\t"
+      "adcx	%%rax, %%r13\n\t"
+      "adox	%%r8, %%r14\n\t"
+      "adcx	%%r8, %%r14\n\t"
+
+      /* f[3] * g */
+      "movq	24(%%rsi), %%rdx\n\t"
+      "mulx	0(%%rcx), %%rax, %%rbx\n\t"
+      "adox	%%rax, %%r11\n\t"
+      "adcx	%%rbx, %%r12\n\t"
+      "mulx	8(%%rcx), %%rax, %%rbx\n\t"
+      "adox	%%rax, %%r12\n\t"
+      "adcx	%%rbx, %%r13\n\t"
+      "mulx	16(%%rcx), %%rax, %%rbx\n\t"
+      "adox	%%rax, %%r13\n\t"
+      "adcx	%%rbx, %%r14\n\t"
+      "mulx	24(%%rcx), %%rax, %%r15\n\t"
+      "adox	%%rax, %%r14\n\t"
+      "adcx	%%r8, %%r15\n\t"
+      "adox	%%r8, %%r15\n\t"
+
+      /* lo + 38 * hi, with lo in t0:r9:r10:r11 and hi in r12:r13:r14:r15 */
+      "movq	%[t0], %%rsi\n\t"
+      "movl	$38, %%edx\n\t"
+      "mulx	%%r12, %%rax, %%rbx\n\t"
+      "adcx	%%rax, %%rsi\n\t"
+      "adox	%%rbx, %%r9\n\t"
+      "mulx	%%r13, %%rax, %%rbx\n\t"
+      "adcx	%%rax, %%r9\n\t"
+      "adox	%%rbx, %%r10\n\t"
+      "mulx	%%r14, %%rax, %%rbx\n\t"
+      "adcx	%%rax, %%r10\n\t"
+      "adox	%%rbx, %%r11\n\t"
+      "mulx	%%r15, %%rax, %%r12\n\t"
+      "adcx	%%rax, %%r11\n\t"
+      "adox	%%r8, %%r12\n\t"
+      "adcx	%%r8, %%r12\n\t"
+
+      /* Fold the top word, then a possible last carry. */
+      "imulq	%%rdx, %%r12\n\t"
+      "addq	%%r12, %%rsi\n\t"
+      "adcq	$0, %%r9\n\t"
+      "adcq	$0, %%r10\n\t"
+      "adcq	$0, %%r11\n\t"
+      "sbbq	%%rax, %%rax\n\t"
+      "andq	$38, %%rax\n\t"
+      "addq	%%rax, %%rsi\n\t"
+
+      "movq	%%rsi, 0(%%rdi)\n\t"
+      "movq	%%r9, 8(%%rdi)\n\t"
+      "movq	%%r10, 16(%%rdi)\n\t"
+      "movq	%%r11, 24(%%rdi)\n\t"
+      : [t0] "=m" (t0), "+S" (f)
+      : "c" (g), "D" (h)
+      : "rax", "rbx", "rdx", "r8", "r9", "r10", "r11", "r12", "r13", "r14",
+        "r15", "cc", "memory");
+}
+
+/* h = f^2. The cross products are summed once and doubled through CF
+ * while the squares of the words are added through OF. */
+static void fe64_sq(fe64 h, const fe64 f) {
+  __asm__ volatile(
+      /* cross products */
+      "movq	0(%%rsi), %%rdx\n\t"
+      "mulx	8(%%rsi), %%r9, %%r10\n\t"
+      "mulx	16(%%rsi), %%rax, %%r11\n\t"
+      "addq	%%rax, %%r10\n\t"
+      "mulx	24(%%rsi), %%rax, %%r12\n\t"
+      "adcq	%%rax, %%r11\n\t"
+      "adcq	$0, %%r12\n\t"
+      "movq	8(%%rsi), %%rdx\n\t"
+      "xorl	%%ecx, %%ecx\n\t"	/* zero, and clear CF and OF */
+      "mulx	16(%%rsi), %%rax, %%rbx\n\t"
+      "adcx	%%rax, %%r11\n\t"
+      "adox	%%rbx, %%r12\n\t"
+      "mulx	24(%%rsi), %%rax, %%r13\n\t"
+      "adcx	%%rax, %%r12\n\t"
+      "adox	%%rcx, %%r13\n\t"
+      "adcx	%%rcx, %%r13\n\t"
+      "movq	16(%%rsi), %%rdx\n\t"
+      "mulx	24(%%rsi), %%rax, %%r14\n\t"
+      "addq	%%rax, %%r13\n\t"
+      "adcq	$0, %%r14\n\t"
+
+      /* double them and add the squares */
+      "xorl	%%ecx, %%ecx\n\t"
+      "movq	0(%%rsi), %%rdx\n\t"
+      "mulx	%%rdx, %%r8, %%rax\n\t"
+      "adcx	%%r9, %%r9\n\t"
+      "adox	%%rax, %%r9\n\t"
+      "movq	8(%%rsi), %%rdx\n\t"
+      "mulx	%%rdx, %%rax, %%rbx\n\t"
+      "adcx	%%r10, %%r10\n\t"
+      "adox	%%rax, %%r10\n\t"
+      "adcx	%%r11, %%r11\n\t"
+      "adox	%%rbx, %%r11\n\t"
+      "movq	16(%%rsi), %%rdx\n\t"
+      "mulx	%%rdx, %%rax, %%rbx\n\t"
+      "adcx	%%r12, %%r12\n\t"
+      "adox	%%rax, %%r12\n\t"
+      "adcx	%%r13, %%r13\n\t"
+      "adox	%%rbx, %%r13\n\t"
+      "movq	24(%%rsi), %%rdx\n\t"
+      "mulx	%%rdx, %%rax, %%r15\n\t"
+      "adcx	%%r14, %%r14\n\t"
+      "adox	%%rax, %%r14\n\t"
+      "adcx	%%rcx, %%r15\n\t"
+      "adox	%%rcx, %%r15\n\t"
+
+      /* lo + 38 * hi, with lo in r8:r9:r10:r11 and hi in r12:r13:r14:r15 */
+      "movl	$38, %%edx\n\t"
+      "mulx	%%r12, %%rax, %%rbx\n\t"
+      "adcx	%%rax, %%r8\n\t"
+      "adox	%%rbx, %%r9\n\t"
+      "mulx	%%r13, %%rax, %%rbx\n\t"
+      "adcx	%%rax, %%r9\n\t"
+      "adox	%%rbx, %%r10\n\t"
+      "mulx	%%r14, %%rax, %%rbx\n\t"
+      "adcx	%%rax, %%r10\n\t"
+      "adox	%%rbx, %%r11\n\t"
+      "mulx	%%r15, %%rax, %%r12\n\t"
+      "adcx	%%rax, %%r11\n\t"
+      "adox	%%rcx, %%r12\n\t"
+      "adcx	%%rcx, %%r12\n\t"
+
+      "imulq	%%rdx, %%r12\n\t"
+      "addq	%%r12, %%r8\n\t"
+      "adcq	$0, %%r9\n\t"
+      "adcq	$0, %%r10\n\t"
+      "adcq	$0, %%r11\n\t"
+      "sbbq	%%rax, %%rax\n\t"
+      "andq	$38, %%rax\n\t"
+      "addq	%%rax, %%r8\n\t"
+
+      "movq	%%r8, 0(%%rdi)\n\t"
+      "movq	%%r9, 8(%%rdi)\n\t"
+      "movq	%%r10, 16(%%rdi)\n\t"
+      "movq	%%r11, 24(%%rdi)\n\t"
+      :
+      : "S" (f), "D" (h)
+      : "rax", "rbx", "rcx", "rdx", "r8", "r9", "r10", "r11", "r12", "r13",
+        "r14", "r15", "cc", "memory");
+}
+
+static void fe64_cswap(fe64 f, fe64 g, unsigned int b) {
+  uint64_t mask = 0 - (uint64_t)b;
+  unsigned i;
+  for (i = 0; i < 4; i++) {
+    uint64_t x = f[i] ^ g[i];
+    x &= mask;
+    f[i] ^= x;
+    g[i] ^= x;
+  }
+}
+
+static void fe64_invert(fe64 out, const fe64 z) {
+  fe64 t0, t1, t2, t3;
+  int i;
+
+  fe64_sq(t0, z);
+  fe64_sq(t1, t0);
+  fe64_sq(t1, t1);
+  fe64_mul(t1, z, t1);
+  fe64_mul(t0, t0, t1);
+  fe64_sq(t2, t0);
+  fe64_mul(t1, t1, t2);
+  fe64_sq(t2, t1);
+  for (i = 1; i < 5; ++i) {
+    fe64_sq(t2, t2);
+  }
+  fe64_mul(t1, t2, t1);
+  fe64_sq(t2, t1);
+  for (i = 1; i < 10; ++i) {
+    fe64_sq(t2, t2);
+  }
+  fe64_mul(t2, t2, t1);
+  fe64_sq(t3, t2);
+  for (i = 1; i < 20; ++i) {
+    fe64_sq(t3, t3);
+  }
+  fe64_mul(t2, t3, t2);
+  fe64_sq(t2, t2);
+  for (i = 1; i < 10; ++i) {
+    fe64_sq(t2, t2);
+  }
+  fe64_mul(t1, t2, t1);
+  fe64_sq(t2, t1);
+  for (i = 1; i < 50; ++i) {
+    fe64_sq(t2, t2);
+  }
+  fe64_mul(t2, t2, t1);
+  fe64_sq(t3, t2);
+  for (i = 1; i < 100; ++i) {
+    fe64_sq(t3, t3);
+  }
+  fe64_mul(t2, t3, t2);
+  fe64_sq(t2, t2);
+  for (i = 1; i < 50; ++i) {
+    fe64_sq(t2, t2);
+  }
+  fe64_mul(t1, t2, t1);
+  fe64_sq(t1, t1);
+  for (i = 1; i < 5; ++i) {
+    fe64_sq(t1, t1);
+  }
+  fe64_mul(out, t1, t0);
+}
 
-#ifdef unused
 void
+x25519_scalar_mult_adx(uint8_t out[32], const uint8_t scalar[32],
+    const uint8_t point[32]) {
+  fe64 x1, x2, z2, x3, z3, tmp0, tmp1;
+
+  uint8_t e[32];
+  memcpy(e, scalar, 32);
+  e[0] &= 248;
+  e[31] &= 127;
+  e[31] |= 64;
+  fe64_frombytes(x1, point);
+  fe64_1(x2);
+  fe64_0(z2);
+  fe64_copy(x3, x1);
+  fe64_1(z3);
+
+  unsigned swap = 0;
+  int pos;
+  for (pos = 254; pos >= 0; --pos) {
+    unsigned b = 1 & (e[pos / 8] >> (pos & 7));
+    swap ^= b;
+    fe64_cswap(x2, x3, swap);
+    fe64_cswap(z2, z3, swap);
+    swap = b;
+    fe64_sub(tmp0, x3, z3);
+    fe64_sub(tmp1, x2, z2);
+    fe64_add(x2, x2, z2);
+    fe64_add(z2, x3, z3);
+    fe64_mul(z3, tmp0, x2);
+    fe64_mul(z2, z2, tmp1);
+    fe64_sq(tmp0, tmp1);
+    fe64_sq(tmp1, x2);
+    fe64_add(x3, z3, z2);
+    fe64_sub(z2, z3, z2);
+    fe64_mul(x2, tmp1, tmp0);
+    fe64_sub(tmp1, tmp1, tmp0);
+    fe64_sq(z2, z2);
+    fe64_mul121666(z3, tmp1);
+    fe64_sq(x3, x3);
+    fe64_add(tmp0, tmp0, z3);
+    fe64_mul(z3, x1, z2);
+    fe64_mul(z2, tmp1, tmp0);
+  }
+  fe64_cswap(x2, x3, swap);
+  fe64_cswap(z2, z3, swap);
+
+  fe64_invert(z2, z2);
+  fe64_mul(x2, x2, z2);
+  fe64_tobytes(out, x2);
+}
+#endif
+
+/* Fixed-base multiplication using the precomputed multiples of the Ed25519
+ * base point, which is birationally equivalent to the X25519 base point. */
+static void
 x25519_public_from_private_generic(uint8_t out_public_value[32],
     const uint8_t private_key[32])
 {
@@ -4872,6 +6054,19 @@ x25519_public_from_private_generic(uint8_t out_public_value[32],
   e[31] &= 127;
   e[31] |= 64;
 
+#if defined(X25519_FE51) && !defined(OPENSSL_SMALL)
+  ge51_p3 A;
+  ge51_scalarmult_base(&A, e);
+
+  /* We only need the u-coordinate of the curve25519 point. The map is
+   * u=(y+1)/(1-y). Since y=Y/Z, this gives u=(Z+Y)/(Z-Y). */
+  fe51 zplusy, zminusy, zminusy_inv;
+  fe51_add(zplusy, A.Z, A.Y);
+  fe51_sub(zminusy, A.Z, A.Y);
+  fe51_invert(zminusy_inv, zminusy);
+  fe51_mul(zplusy, zplusy, zminusy_inv);
+  fe51_tobytes(out_public_value, zplusy);
+#else
   ge_p3 A;
   x25519_ge_scalarmult_base(&A, e);
 
@@ -4883,16 +6078,14 @@ x25519_public_from_private_generic(uint8_t out_public_value[32],
   fe_invert(zminusy_inv, zminusy);
   fe_mul(zplusy, zplusy, zminusy_inv);
   fe_tobytes(out_public_value, zplusy);
-}
 #endif
+}
 
 void
 x25519_public_from_private(uint8_t out_public_value[32],
     const uint8_t private_key[32])
 {
-  static const uint8_t kMongomeryBasePoint[32] = {9};
-
-  x25519_scalar_mult(out_public_value, private_key, kMongomeryBasePoint);
+  x25519_public_from_private_generic(out_public_value, private_key);
 }
 
 void
@@ -4933,3 +6126,26 @@ X25519(uint8_t out_shared_key[X25519_KEY_LENGTH],
   /* The all-zero output results when the input is a point of small order. */
   return timingsafe_memcmp(kZeros, out_shared_key, 32) != 0;
 }
+
+int
+X25519_batch(uint8_t *const out_shared_keys[],
+    const uint8_t *const private_keys[],
+    const uint8_t *const peer_public_values[], size_t n, int *out_valid)
+{
+  static const uint8_t kZeros[32] = {0};
+  size_t i;
+  int ok = 1;
+  int valid;
+
+  x25519_scalar_mult_batch(out_shared_keys, private_keys, peer_public_values,
+      n);
+
+  for (i = 0; i < n; i++) {
+    valid = timingsafe_memcmp(kZeros, out_shared_keys[i], 32) != 0;
+    if (out_valid != NULL)
+      out_valid[i] = valid;
+    ok &= valid;
+  }
+
+  return ok;
+}
@@ -18,6 +18,7 @@
 #ifndef HEADER_CURVE25519_H
 #define HEADER_CURVE25519_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include <openssl/opensslconf.h>
@@ -61,6 +62,17 @@ int X25519(uint8_t out_shared_key[X25519_KEY_LENGTH],
     const uint8_t private_key[X25519_KEY_LENGTH],
     const uint8_t peers_public_value[X25519_KEY_LENGTH]);
 
+/*
+ * X25519_batch computes the n shared keys out_shared_keys[i] from
+ * private_keys[i] and peer_public_values[i], several at a time where the
+ * CPU allows it. It returns one if all of them succeeded and zero
+ * otherwise. If out_valid is not NULL, out_valid[i] is set to one or zero
+ * according to whether shared key i succeeded, as X25519 would return.
+ */
+int X25519_batch(uint8_t *const out_shared_keys[],
+    const uint8_t *const private_keys[],
+    const uint8_t *const peer_public_values[], size_t n, int *out_valid);
+
 #if defined(__cplusplus)
 }  /* extern C */
 #endif
@@ -18,6 +18,7 @@
 #ifndef HEADER_CURVE25519_INTERNAL_H
 #define HEADER_CURVE25519_INTERNAL_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 __BEGIN_HIDDEN_DECLS
@@ -94,6 +95,27 @@ void x25519_scalar_mult(uint8_t out[32], const uint8_t scalar[32],
 void x25519_scalar_mult_generic(uint8_t out[32], const uint8_t scalar[32],
     const uint8_t point[32]);
 
+#if defined(__x86_64__) && defined(__GNUC__) && \
+    !defined(OPENSSL_NO_ASM) && !defined(OPENSSL_NO_INLINE_ASM)
+#define X25519_ADX
+void x25519_scalar_mult_adx(uint8_t out[32], const uint8_t scalar[32],
+    const uint8_t point[32]);
+#endif
+
+/*
+ * Eight scalar multiplications at once with AVX-512 IFMA.
+ */
+#if defined(OPENSSL_X25519_IFMA) && \
+    (defined(__x86_64) || defined(__x86_64__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 8))
+#define X25519_IFMA
+void x25519_scalar_mult_ifma(uint8_t *const out[8],
+    const uint8_t *const scalar[8], const uint8_t *const point[8]);
+#endif
+
+void x25519_scalar_mult_batch(uint8_t *const *out,
+    const uint8_t *const *scalar, const uint8_t *const *point, size_t n);
+
 __END_HIDDEN_DECLS
 
 #endif  /* HEADER_CURVE25519_INTERNAL_H */
@@ -0,0 +1,431 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Eight X25519 scalar multiplications at once with AVX-512 IFMA.
+ *
+ * A field element has five limbs of 51 bits, and limb i of the eight
+ * elements is held in the 64 bit lanes of one zmm register.  vpmadd52luq
+ * and vpmadd52huq add the low 52 bits of a limb product to the accumulator
+ * of its weight, and the high bits to the accumulator of the next weight, at
+ * twice the value since 2^52 = 2 * 2^51.  The multiplier only looks at the
+ * low 52 bits of its inputs, so every result is carried once, on all limbs
+ * in parallel, which leaves each limb below 2^51 + 2^17.
+ *
+ * The eight Montgomery ladders run in lock step, each lane swapping
+ * according to the bits of its own scalar with a masked blend, so the
+ * sequence of instructions does not depend on any of the scalars.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "curve25519_internal.h"
+
+#ifdef X25519_IFMA
+
+#include <immintrin.h>
+
+#define X25519_IFMA_TARGET \
+	__attribute__((__target__("avx512f,avx512ifma")))
+#define X25519_IFMA_INLINE \
+	static inline X25519_IFMA_TARGET __attribute__((__always_inline__))
+
+#define X25519_IFMA_MASK51	0x7ffffffffffffULL
+
+typedef __m512i fe8[5];
+
+static uint64_t
+x25519_ifma_load_8(const uint8_t *in)
+{
+	uint64_t v = 0;
+	int i;
+
+	for (i = 7; i >= 0; i--)
+		v = (v << 8) | in[i];
+	return v;
+}
+
+static void
+x25519_ifma_store_8(uint8_t *out, uint64_t v)
+{
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		out[i] = v & 0xff;
+		v >>= 8;
+	}
+}
+
+/* Set lane k of the limbs in t to the element in s, ignoring its top bit. */
+static void
+x25519_ifma_frombytes(uint64_t t[5][8], int k, const uint8_t s[32])
+{
+	uint64_t w0 = x25519_ifma_load_8(s);
+	uint64_t w1 = x25519_ifma_load_8(s + 8);
+	uint64_t w2 = x25519_ifma_load_8(s + 16);
+	uint64_t w3 = x25519_ifma_load_8(s + 24);
+
+	t[0][k] = w0 & X25519_IFMA_MASK51;
+	t[1][k] = ((w0 >> 51) | (w1 << 13)) & X25519_IFMA_MASK51;
+	t[2][k] = ((w1 >> 38) | (w2 << 26)) & X25519_IFMA_MASK51;
+	t[3][k] = ((w2 >> 25) | (w3 << 39)) & X25519_IFMA_MASK51;
+	t[4][k] = (w3 >> 12) & X25519_IFMA_MASK51;
+}
+
+/* Write the element in lane k of the limbs in t, fully reduced, to s. */
+static void
+x25519_ifma_tobytes(uint8_t s[32], uint64_t t[5][8], int k)
+{
+	uint64_t h0 = t[0][k], h1 = t[1][k], h2 = t[2][k];
+	uint64_t h3 = t[3][k], h4 = t[4][k];
+	uint64_t q;
+
+	h1 += h0 >> 51; h0 &= X25519_IFMA_MASK51;
+	h2 += h1 >> 51; h1 &= X25519_IFMA_MASK51;
+	h3 += h2 >> 51; h2 &= X25519_IFMA_MASK51;
+	h4 += h3 >> 51; h3 &= X25519_IFMA_MASK51;
+	h0 += (h4 >> 51) * 19; h4 &= X25519_IFMA_MASK51;
+
+	/* Now h < 2p, and q = 1 if h >= p, that is if h + 19 >= 2^255. */
+	q = (h0 + 19) >> 51;
+	q = (h1 + q) >> 51;
+	q = (h2 + q) >> 51;
+	q = (h3 + q) >> 51;
+	q = (h4 + q) >> 51;
+
+	h0 += 19 * q;
+	h1 += h0 >> 51; h0 &= X25519_IFMA_MASK51;
+	h2 += h1 >> 51; h1 &= X25519_IFMA_MASK51;
+	h3 += h2 >> 51; h2 &= X25519_IFMA_MASK51;
+	h4 += h3 >> 51; h3 &= X25519_IFMA_MASK51;
+	h4 &= X25519_IFMA_MASK51;
+
+	x25519_ifma_store_8(s, h0 | (h1 << 51));
+	x25519_ifma_store_8(s + 8, (h1 >> 13) | (h2 << 38));
+	x25519_ifma_store_8(s + 16, (h2 >> 26) | (h3 << 25));
+	x25519_ifma_store_8(s + 24, (h3 >> 39) | (h4 << 12));
+}
+
+X25519_IFMA_INLINE __m512i
+fe8_mul19(__m512i x)
+{
+	return _mm512_add_epi64(_mm512_add_epi64(x, _mm512_slli_epi64(x, 1)),
+	    _mm512_slli_epi64(x, 4));
+}
+
+/* Carry each limb into the next one, and the top one times 19 into the first. */
+X25519_IFMA_INLINE void
+fe8_carry(fe8 h, __m512i h0, __m512i h1, __m512i h2, __m512i h3, __m512i h4)
+{
+	__m512i mask = _mm512_set1_epi64(X25519_IFMA_MASK51);
+
+	h[0] = _mm512_add_epi64(_mm512_and_si512(h0, mask),
+	    fe8_mul19(_mm512_srli_epi64(h4, 51)));
+	h[1] = _mm512_add_epi64(_mm512_and_si512(h1, mask),
+	    _mm512_srli_epi64(h0, 51));
+	h[2] = _mm512_add_epi64(_mm512_and_si512(h2, mask),
+	    _mm512_srli_epi64(h1, 51));
+	h[3] = _mm512_add_epi64(_mm512_and_si512(h3, mask),
+	    _mm512_srli_epi64(h2, 51));
+	h[4] = _mm512_add_epi64(_mm512_and_si512(h4, mask),
+	    _mm512_srli_epi64(h3, 51));
+}
+
+/*
+ * Reduce a product from the accumulators, lo[k] holding low halves at
+ * weight 2^(51k) and hi[k] high halves at weight 2^(51k + 52).  Each of them
+ * is a sum of at most five halves, so the folded limbs stay below 2^63.
+ */
+#define FE8_LIMB(k) \
+	_mm512_add_epi64(lo[k], _mm512_slli_epi64(hi[(k) - 1], 1))
+
+X25519_IFMA_INLINE void
+fe8_reduce(fe8 h, __m512i lo[9], __m512i hi[9])
+{
+	__m512i h0, h1, h2, h3, h4;
+
+	h0 = _mm512_add_epi64(lo[0], fe8_mul19(FE8_LIMB(5)));
+	h1 = _mm512_add_epi64(FE8_LIMB(1), fe8_mul19(FE8_LIMB(6)));
+	h2 = _mm512_add_epi64(FE8_LIMB(2), fe8_mul19(FE8_LIMB(7)));
+	h3 = _mm512_add_epi64(FE8_LIMB(3), fe8_mul19(FE8_LIMB(8)));
+	h4 = _mm512_add_epi64(FE8_LIMB(4),
+	    fe8_mul19(_mm512_slli_epi64(hi[8], 1)));
+
+	fe8_carry(h, h0, h1, h2, h3, h4);
+}
+
+#define FE8_MADD(k, a, b) do { \
+	lo[k] = _mm512_madd52lo_epu64(lo[k], (a), (b)); \
+	hi[k] = _mm512_madd52hi_epu64(hi[k], (a), (b)); \
+} while (0)
+
+#define FE8_MUL_ROW(i) do { \
+	FE8_MADD((i) + 0, f[i], g[0]); \
+	FE8_MADD((i) + 1, f[i], g[1]); \
+	FE8_MADD((i) + 2, f[i], g[2]); \
+	FE8_MADD((i) + 3, f[i], g[3]); \
+	FE8_MADD((i) + 4, f[i], g[4]); \
+} while (0)
+
+X25519_IFMA_INLINE void
+fe8_mul(fe8 h, const fe8 f, const fe8 g)
+{
+	__m512i lo[9], hi[9];
+	int k;
+
+	for (k = 0; k < 9; k++)
+		lo[k] = hi[k] = _mm512_setzero_si512();
+
+	FE8_MUL_ROW(0);
+	FE8_MUL_ROW(1);
+	FE8_MUL_ROW(2);
+	FE8_MUL_ROW(3);
+	FE8_MUL_ROW(4);
+
+	fe8_reduce(h, lo, hi);
+}
+
+/* The products of distinct limbs are added once and doubled. */
+X25519_IFMA_INLINE void
+fe8_sq(fe8 h, const fe8 f)
+{
+	__m512i lo[9], hi[9];
+	int k;
+
+	for (k = 0; k < 9; k++)
+		lo[k] = hi[k] = _mm512_setzero_si512();
+
+	FE8_MADD(1, f[0], f[1]);
+	FE8_MADD(2, f[0], f[2]);
+	FE8_MADD(3, f[0], f[3]);
+	FE8_MADD(4, f[0], f[4]);
+	FE8_MADD(3, f[1], f[2]);
+	FE8_MADD(4, f[1], f[3]);
+	FE8_MADD(5, f[1], f[4]);
+	FE8_MADD(5, f[2], f[3]);
+	FE8_MADD(6, f[2], f[4]);
+	FE8_MADD(7, f[3], f[4]);
+
+	for (k = 1; k < 8; k++) {
+		lo[k] = _mm512_add_epi64(lo[k], lo[k]);
+		hi[k] = _mm512_add_epi64(hi[k], hi[k]);
+	}
+
+	FE8_MADD(0, f[0], f[0]);
+	FE8_MADD(2, f[1], f[1]);
+	FE8_MADD(4, f[2], f[2]);
+	FE8_MADD(6, f[3], f[3]);
+	FE8_MADD(8, f[4], f[4]);
+
+	fe8_reduce(h, lo, hi);
+}
+
+X25519_IFMA_INLINE void
+fe8_mul121666(fe8 h, const fe8 f)
+{
+	__m512i c = _mm512_set1_epi64(121666);
+	__m512i zero = _mm512_setzero_si512();
+	__m512i lo[5], hi[5];
+	int k;
+
+	for (k = 0; k < 5; k++) {
+		lo[k] = _mm512_madd52lo_epu64(zero, f[k], c);
+		hi[k] = _mm512_madd52hi_epu64(zero, f[k], c);
+	}
+
+	fe8_carry(h,
+	    _mm512_add_epi64(lo[0], fe8_mul19(_mm512_slli_epi64(hi[4], 1))),
+	    FE8_LIMB(1), FE8_LIMB(2), FE8_LIMB(3), FE8_LIMB(4));
+}
+
+X25519_IFMA_INLINE void
+fe8_add(fe8 h, const fe8 f, const fe8 g)
+{
+	fe8_carry(h, _mm512_add_epi64(f[0], g[0]),
+	    _mm512_add_epi64(f[1], g[1]), _mm512_add_epi64(f[2], g[2]),
+	    _mm512_add_epi64(f[3], g[3]), _mm512_add_epi64(f[4], g[4]));
+}
+
+/* h = f + 2p - g, which needs the limbs of g to be below 2^52 - 38. */
+X25519_IFMA_INLINE void
+fe8_sub(fe8 h, const fe8 f, const fe8 g)
+{
+	__m512i p0 = _mm512_set1_epi64(0xfffffffffffdaULL);
+	__m512i p1 = _mm512_set1_epi64(0xffffffffffffeULL);
+
+	fe8_carry(h, _mm512_sub_epi64(_mm512_add_epi64(f[0], p0), g[0]),
+	    _mm512_sub_epi64(_mm512_add_epi64(f[1], p1), g[1]),
+	    _mm512_sub_epi64(_mm512_add_epi64(f[2], p1), g[2]),
+	    _mm512_sub_epi64(_mm512_add_epi64(f[3], p1), g[3]),
+	    _mm512_sub_epi64(_mm512_add_epi64(f[4], p1), g[4]));
+}
+
+/* Swap the lanes of f and g that are set in mask. */
+X25519_IFMA_INLINE void
+fe8_cswap(fe8 f, fe8 g, __mmask8 mask)
+{
+	__m512i t;
+	int k;
+
+	for (k = 0; k < 5; k++) {
+		t = _mm512_mask_blend_epi64(mask, f[k], g[k]);
+		g[k] = _mm512_mask_blend_epi64(mask, g[k], f[k]);
+		f[k] = t;
+	}
+}
+
+X25519_IFMA_INLINE void
+fe8_copy(fe8 h, const fe8 f)
+{
+	int k;
+
+	for (k = 0; k < 5; k++)
+		h[k] = f[k];
+}
+
+X25519_IFMA_INLINE void
+fe8_set(fe8 h, uint64_t v)
+{
+	int k;
+
+	h[0] = _mm512_set1_epi64(v);
+	for (k = 1; k < 5; k++)
+		h[k] = _mm512_setzero_si512();
+}
+
+static void X25519_IFMA_TARGET
+fe8_sq_n(fe8 h, const fe8 f, int n)
+{
+	int i;
+
+	fe8_sq(h, f);
+	for (i = 1; i < n; i++)
+		fe8_sq(h, h);
+}
+
+/* out = z^(p - 2), with the same chain as fe51_invert(). */
+static void X25519_IFMA_TARGET
+fe8_invert(fe8 out, const fe8 z)
+{
+	fe8 t0, t1, t2, t3;
+
+	fe8_sq(t0, z);
+	fe8_sq_n(t1, t0, 2);
+	fe8_mul(t1, z, t1);
+	fe8_mul(t0, t0, t1);
+	fe8_sq(t2, t0);
+	fe8_mul(t1, t1, t2);
+	fe8_sq_n(t2, t1, 5);
+	fe8_mul(t1, t2, t1);
+	fe8_sq_n(t2, t1, 10);
+	fe8_mul(t2, t2, t1);
+	fe8_sq_n(t3, t2, 20);
+	fe8_mul(t2, t3, t2);
+	fe8_sq_n(t2, t2, 10);
+	fe8_mul(t1, t2, t1);
+	fe8_sq_n(t2, t1, 50);
+	fe8_mul(t2, t2, t1);
+	fe8_sq_n(t3, t2, 100);
+	fe8_mul(t2, t3, t2);
+	fe8_sq_n(t2, t2, 50);
+	fe8_mul(t1, t2, t1);
+	fe8_sq_n(t1, t1, 5);
+	fe8_mul(out, t1, t0);
+}
+
+/*
+ * The ladder of x25519_scalar_mult_generic(), on the points x1 and scalars
+ * e of all lanes.  On return x2 / z2 holds the results.
+ */
+static void X25519_IFMA_TARGET
+x25519_ifma_ladder(fe8 x2, fe8 z2, const fe8 x1, const uint8_t e[8][32])
+{
+	fe8 x3, z3, tmp0, tmp1;
+	unsigned int b, swap = 0;
+	int k, pos;
+
+	fe8_set(x2, 1);
+	fe8_set(z2, 0);
+	fe8_copy(x3, x1);
+	fe8_set(z3, 1);
+
+	for (pos = 254; pos >= 0; pos--) {
+		b = 0;
+		for (k = 0; k < 8; k++)
+			b |= ((e[k][pos / 8] >> (pos & 7)) & 1) << k;
+		swap ^= b;
+		fe8_cswap(x2, x3, swap);
+		fe8_cswap(z2, z3, swap);
+		swap = b;
+		fe8_sub(tmp0, x3, z3);
+		fe8_sub(tmp1, x2, z2);
+		fe8_add(x2, x2, z2);
+		fe8_add(z2, x3, z3);
+		fe8_mul(z3, tmp0, x2);
+		fe8_mul(z2, z2, tmp1);
+		fe8_sq(tmp0, tmp1);
+		fe8_sq(tmp1, x2);
+		fe8_add(x3, z3, z2);
+		fe8_sub(z2, z3, z2);
+		fe8_mul(x2, tmp1, tmp0);
+		fe8_sub(tmp1, tmp1, tmp0);
+		fe8_sq(z2, z2);
+		fe8_mul121666(z3, tmp1);
+		fe8_sq(x3, x3);
+		fe8_add(tmp0, tmp0, z3);
+		fe8_mul(z3, x1, z2);
+		fe8_mul(z2, tmp1, tmp0);
+	}
+	fe8_cswap(x2, x3, swap);
+	fe8_cswap(z2, z3, swap);
+
+	fe8_invert(z2, z2);
+	fe8_mul(x2, x2, z2);
+}
+
+void X25519_IFMA_TARGET
+x25519_scalar_mult_ifma(uint8_t *const out[8], const uint8_t *const scalar[8],
+    const uint8_t *const point[8])
+{
+	uint64_t t[5][8];
+	uint8_t e[8][32];
+	fe8 x1, x2, z2;
+	int i, k;
+
+	for (k = 0; k < 8; k++) {
+		memcpy(e[k], scalar[k], 32);
+		e[k][0] &= 248;
+		e[k][31] &= 127;
+		e[k][31] |= 64;
+		x25519_ifma_frombytes(t, k, point[k]);
+	}
+	for (i = 0; i < 5; i++)
+		x1[i] = _mm512_loadu_si512(t[i]);
+
+	x25519_ifma_ladder(x2, z2, x1, e);
+
+	for (i = 0; i < 5; i++)
+		_mm512_storeu_si512(t[i], x2[i]);
+	for (k = 0; k < 8; k++)
+		x25519_ifma_tobytes(out[k], t, k);
+
+	explicit_bzero(e, sizeof(e));
+	explicit_bzero(t, sizeof(t));
+}
+
+#endif /* X25519_IFMA */
@@ -65,18 +65,20 @@
 #include <openssl/err.h>
 #include <openssl/dh.h>
 
+#include "cryptlib.h"
+
 /* BEGIN ERROR CODES */
 #ifndef OPENSSL_NO_ERR
 
 #define ERR_FUNC(func) ERR_PACK(ERR_LIB_DH,func,0)
 #define ERR_REASON(reason) ERR_PACK(ERR_LIB_DH,0,reason)
 
-static ERR_STRING_DATA DH_str_functs[]=	{
+static const ERR_STRING_DATA DH_str_functs[]=	{
 	{ERR_FUNC(0xfff), "CRYPTO_internal"},
 	{0, NULL}
 };
 
-static ERR_STRING_DATA DH_str_reasons[]=
+static const ERR_STRING_DATA DH_str_reasons[]=
 	{
 {ERR_REASON(DH_R_BAD_GENERATOR)          ,"bad generator"},
 {ERR_REASON(DH_R_BN_DECODE_ERROR)        ,"bn decode error"},
@@ -101,8 +103,8 @@ void ERR_load_DH_strings(void)
 
 	if (ERR_func_error_string(DH_str_functs[0].error) == NULL)
 		{
-		ERR_load_strings(0,DH_str_functs);
-		ERR_load_strings(0,DH_str_reasons);
+		ERR_load_const_strings(DH_str_functs);
+		ERR_load_const_strings(DH_str_reasons);
 		}
 #endif
 	}
@@ -0,0 +1,122 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * The primes of the ffdhe2048 and ffdhe3072 groups of RFC 7919, whose
+ * generator is 2, and R^2 mod p for their Montgomery contexts, least
+ * significant word first.  Both primes are -1 modulo 2^64, so the
+ * Montgomery constant n0 is 1 for any word size.
+ */
+
+#if BN_BITS2 == 64
+#define BN_DEF(lo, hi)	(((BN_ULONG)(hi) << 32) | (BN_ULONG)(lo))
+#else
+#define BN_DEF(lo, hi)	(BN_ULONG)(lo), (BN_ULONG)(hi)
+#endif
+
+
+static const BN_ULONG ffdhe2048_p[] = {
+	BN_DEF(0xFFFFFFFF, 0xFFFFFFFF), BN_DEF(0x61285C97, 0x886B4238),
+	BN_DEF(0xC1B2EFFA, 0xC6F34A26), BN_DEF(0x7D1683B2, 0xC58EF183),
+	BN_DEF(0x2EC22005, 0x3BB5FCBC), BN_DEF(0x4C6FAD73, 0xC3FE3B1B),
+	BN_DEF(0xEEF28183, 0x8E4F1232), BN_DEF(0xE98583FF, 0x9172FE9C),
+	BN_DEF(0x28342F61, 0xC03404CD), BN_DEF(0xCDF7E2EC, 0x9E02FCE1),
+	BN_DEF(0xEE0A6D70, 0x0B07A7C8), BN_DEF(0x6372BB19, 0xAE56EDE7),
+	BN_DEF(0xDE394DF4, 0x1D4F42A3), BN_DEF(0x60D7F468, 0xB96ADAB7),
+	BN_DEF(0xB2C8E3FB, 0xD108A94B), BN_DEF(0xB324FB61, 0xBC0AB182),
+	BN_DEF(0x483A797A, 0x30ACCA4F), BN_DEF(0x36ADE735, 0x1DF158A1),
+	BN_DEF(0xF3EFE872, 0xE2A689DA), BN_DEF(0xE0E68B77, 0x984F0C70),
+	BN_DEF(0x7F57C935, 0xB557135E), BN_DEF(0x3DED1AF3, 0x85636555),
+	BN_DEF(0x5F066ED0, 0x2433F51F), BN_DEF(0xD5FD6561, 0xD3DF1ED5),
+	BN_DEF(0xAEC4617A, 0xF681B202), BN_DEF(0x630C75D8, 0x7D2FE363),
+	BN_DEF(0x249B3EF9, 0xCC939DCE), BN_DEF(0x146433FB, 0xA9E13641),
+	BN_DEF(0xCE2D3695, 0xD8B9C583), BN_DEF(0x273D3CF1, 0xAFDC5620),
+	BN_DEF(0xA2BB4A9A, 0xADF85458), BN_DEF(0xFFFFFFFF, 0xFFFFFFFF),
+};
+
+static const BN_ULONG ffdhe2048_rr[] = {
+	BN_DEF(0xD38A4FA1, 0x187BE36B), BN_DEF(0x6458F3B8, 0x0A152F39),
+	BN_DEF(0xC422EEB7, 0x0570187E), BN_DEF(0x91173F2A, 0x18AF7482),
+	BN_DEF(0xCFF4EAAA, 0xE9FDAC6A), BN_DEF(0x6E589D6C, 0xF6AFEBB7),
+	BN_DEF(0xB7E33FB0, 0xF92F8E9A), BN_DEF(0x4CF36DDD, 0x70ACF2AA),
+	BN_DEF(0xD07137FD, 0x561AB426), BN_DEF(0x430EE91E, 0x5F57D037),
+	BN_DEF(0x60D10B8A, 0xE3E768C8), BN_DEF(0xA18AF8CE, 0xB14884D8),
+	BN_DEF(0xA12B74E4, 0xF8A98014), BN_DEF(0x3437B7A8, 0x748D407C),
+	BN_DEF(0x9875D5A7, 0x627588C4), BN_DEF(0x53C8F09D, 0xDD24A127),
+	BN_DEF(0x0CD51AEC, 0x85A997D5), BN_DEF(0xCE348458, 0x44F0C619),
+	BN_DEF(0x5F6B69A1, 0x9B894B24), BN_DEF(0xF6D4777E, 0xAE1302F2),
+	BN_DEF(0x375DB18E, 0xE6678EEB), BN_DEF(0x4FBCBDC8, 0x2674E1D6),
+	BN_DEF(0x6FA93D28, 0xB297A823), BN_DEF(0x7C8C0510, 0x6A12FB70),
+	BN_DEF(0xDB06F65B, 0x5C6D1AEB), BN_DEF(0x4C1804CA, 0xE8C2954E),
+	BN_DEF(0xF5500FA7, 0x06BDEAC1), BN_DEF(0x189CD76B, 0x6A315604),
+	BN_DEF(0x6E362DC0, 0xBAE7B0B3), BN_DEF(0xDC70FB82, 0xA57C73BD),
+	BN_DEF(0x9D573457, 0xFAFF50D2), BN_DEF(0xBE84058E, 0x352BD399),
+};
+
+static const BN_ULONG ffdhe3072_p[] = {
+	BN_DEF(0xFFFFFFFF, 0xFFFFFFFF), BN_DEF(0x66C62E37, 0x25E41D2B),
+	BN_DEF(0x3FD59D7C, 0x3C1B20EE), BN_DEF(0xFA53DDEF, 0x0ABCD06B),
+	BN_DEF(0xD5C4484E, 0x1DBF9A42), BN_DEF(0x9B0DEADA, 0xABC52197),
+	BN_DEF(0x22363A0D, 0xE86D2BC5), BN_DEF(0x9C9DF69E, 0x5CAE82AB),
+	BN_DEF(0x71F54BFF, 0x64F2E21E), BN_DEF(0xE2D74DD3, 0xF4FD4452),
+	BN_DEF(0xBC437944, 0xB4130C93), BN_DEF(0x85139270, 0xAEFE1309),
+	BN_DEF(0xC186D91C, 0x598CB0FA), BN_DEF(0x91F7F7EE, 0x7AD91D26),
+	BN_DEF(0xD6E6C907, 0x61B46FC9), BN_DEF(0xF99C0238, 0xBC34F4DE),
+	BN_DEF(0x6519035B, 0xDE355B3B), BN_DEF(0x611FCFDC, 0x886B4238),
+	BN_DEF(0xC1B2EFFA, 0xC6F34A26), BN_DEF(0x7D1683B2, 0xC58EF183),
+	BN_DEF(0x2EC22005, 0x3BB5FCBC), BN_DEF(0x4C6FAD73, 0xC3FE3B1B),
+	BN_DEF(0xEEF28183, 0x8E4F1232), BN_DEF(0xE98583FF, 0x9172FE9C),
+	BN_DEF(0x28342F61, 0xC03404CD), BN_DEF(0xCDF7E2EC, 0x9E02FCE1),
+	BN_DEF(0xEE0A6D70, 0x0B07A7C8), BN_DEF(0x6372BB19, 0xAE56EDE7),
+	BN_DEF(0xDE394DF4, 0x1D4F42A3), BN_DEF(0x60D7F468, 0xB96ADAB7),
+	BN_DEF(0xB2C8E3FB, 0xD108A94B), BN_DEF(0xB324FB61, 0xBC0AB182),
+	BN_DEF(0x483A797A, 0x30ACCA4F), BN_DEF(0x36ADE735, 0x1DF158A1),
+	BN_DEF(0xF3EFE872, 0xE2A689DA), BN_DEF(0xE0E68B77, 0x984F0C70),
+	BN_DEF(0x7F57C935, 0xB557135E), BN_DEF(0x3DED1AF3, 0x85636555),
+	BN_DEF(0x5F066ED0, 0x2433F51F), BN_DEF(0xD5FD6561, 0xD3DF1ED5),
+	BN_DEF(0xAEC4617A, 0xF681B202), BN_DEF(0x630C75D8, 0x7D2FE363),
+	BN_DEF(0x249B3EF9, 0xCC939DCE), BN_DEF(0x146433FB, 0xA9E13641),
+	BN_DEF(0xCE2D3695, 0xD8B9C583), BN_DEF(0x273D3CF1, 0xAFDC5620),
+	BN_DEF(0xA2BB4A9A, 0xADF85458), BN_DEF(0xFFFFFFFF, 0xFFFFFFFF),
+};
+
+static const BN_ULONG ffdhe3072_rr[] = {
+	BN_DEF(0x14BA1560, 0xFA1861EC), BN_DEF(0x17BC46DC, 0x6D42CB5B),
+	BN_DEF(0x17D3B9EE, 0x29B38C9F), BN_DEF(0x4F2F19C7, 0x84E19B8A),
+	BN_DEF(0x736DC403, 0xD2EE9266), BN_DEF(0x71FAD32A, 0x4A4D777D),
+	BN_DEF(0x3CF55AFA, 0x9B87C409), BN_DEF(0x46A689AE, 0x783B269A),
+	BN_DEF(0x31676817, 0x817ADCF8), BN_DEF(0x56DAFD28, 0xA793367B),
+	BN_DEF(0x52F92170, 0x2E90CB13), BN_DEF(0xE05502DB, 0x6E078202),
+	BN_DEF(0xDE5E6992, 0x373694DC), BN_DEF(0x3157A6FC, 0xE8283C27),
+	BN_DEF(0xA3C753B3, 0x76FFEA53), BN_DEF(0x13AAD0C3, 0xD4FAA7C3),
+	BN_DEF(0x3B3C4F5D, 0xD8BBA311), BN_DEF(0xE7DEE086, 0x622011D2),
+	BN_DEF(0x9EDE734F, 0xF8FA1E54), BN_DEF(0xE9C9AACD, 0xCA830FC7),
+	BN_DEF(0xC5D2B6B9, 0x27313949), BN_DEF(0xC8382B42, 0xB1B2A765),
+	BN_DEF(0x1DBB969A, 0xB593A5A3), BN_DEF(0x1E8EA35A, 0xADAD49E2),
+	BN_DEF(0x78672689, 0x73F31968), BN_DEF(0x4781117F, 0x9E124214),
+	BN_DEF(0x1F7E26BF, 0x47C2F120), BN_DEF(0xAF98B240, 0x051B9E86),
+	BN_DEF(0x5D31B3E1, 0xD17F1764), BN_DEF(0x8AA30DBD, 0xB957D016),
+	BN_DEF(0x3065C063, 0x5CEF7FEB), BN_DEF(0x194AC0C3, 0xFBA48A97),
+	BN_DEF(0x874C8BD6, 0x7F3B09C2), BN_DEF(0x568174B6, 0x336ADD6A),
+	BN_DEF(0x54503DB2, 0x8E6698AC), BN_DEF(0x79DDBC72, 0x06A7F1F9),
+	BN_DEF(0x92D11C5F, 0xBDE2B9C3), BN_DEF(0xE4181598, 0x27DEA14F),
+	BN_DEF(0xD0D96E9F, 0x10CE037C), BN_DEF(0x09E7823D, 0xB01833B5),
+	BN_DEF(0xBCD3A514, 0xB9631002), BN_DEF(0x63F6C287, 0x7829CC53),
+	BN_DEF(0xDD2410F7, 0xDC47AA6E), BN_DEF(0xD3CE8737, 0xCF12DFC2),
+	BN_DEF(0xD86373C1, 0x235844DC), BN_DEF(0xF80F1D3B, 0x6ED9EEAD),
+	BN_DEF(0xBC34B85A, 0xF128E8A3), BN_DEF(0x8EBA952B, 0xA15C076B),
+};
@@ -58,11 +58,16 @@
 
 #include <stdio.h>
 
+#include <stdlib.h>
+#include <string.h>
+
 #include <openssl/bn.h>
 #include <openssl/dh.h>
 #include <openssl/err.h>
 
 #include "bn_lcl.h"
+#include "constant_time_locl.h"
+#include "dh_ffdhe.h"
 
 static int generate_key(DH *dh);
 static int compute_key(unsigned char *key, const BIGNUM *pub_key, DH *dh);
@@ -71,6 +76,198 @@ static int dh_bn_mod_exp(const DH *dh, BIGNUM *r, const BIGNUM *a,
 static int dh_init(DH *dh);
 static int dh_finish(DH *dh);
 
+/*
+ * The ffdhe groups of RFC 7919 have statically initialised Montgomery
+ * contexts, so neither generate_key() nor compute_key() has to set one up
+ * for them.
+ *
+ * Where the fixed width Montgomery code is available, g^x is computed with
+ * a comb: the bits of x are laid out in DH_COMB_TEETH rows of spacing bits,
+ * and every column selects one of DH_COMB_ENTRIES products of the powers
+ * g^(2^(i * spacing)).  This takes spacing squarings and multiplications
+ * instead of one squaring per bit of x, and every table lookup reads all
+ * entries.  The tables are built on first use and shared between threads.
+ */
+#define DH_COMB_TEETH		6
+#define DH_COMB_ENTRIES		(1 << DH_COMB_TEETH)
+
+struct dh_named_group {
+	BN_MONT_CTX *mont;
+	BN_ULONG *table;
+};
+
+#define DH_FFDHE_MONT(bits) {						\
+	.ri = (bits),							\
+	.RR = {								\
+		(BN_ULONG *)ffdhe##bits##_rr,				\
+		(bits) / BN_BITS2,					\
+		(bits) / BN_BITS2,					\
+		0,							\
+		BN_FLG_STATIC_DATA					\
+	},								\
+	.N = {								\
+		(BN_ULONG *)ffdhe##bits##_p,				\
+		(bits) / BN_BITS2,					\
+		(bits) / BN_BITS2,					\
+		0,							\
+		BN_FLG_STATIC_DATA					\
+	},								\
+	.n0 = { 1, 0 },							\
+}
+
+static BN_MONT_CTX ffdhe2048_mont = DH_FFDHE_MONT(2048);
+static BN_MONT_CTX ffdhe3072_mont = DH_FFDHE_MONT(3072);
+
+static struct dh_named_group dh_named_groups[] = {
+	{ .mont = &ffdhe2048_mont },
+	{ .mont = &ffdhe3072_mont },
+};
+
+#define N_DH_NAMED_GROUPS \
+	(sizeof(dh_named_groups) / sizeof(dh_named_groups[0]))
+
+static struct dh_named_group *
+dh_named_group(const DH *dh)
+{
+	size_t i;
+
+	if (dh->p == NULL || dh->g == NULL || !BN_is_word(dh->g, 2))
+		return NULL;
+	for (i = 0; i < N_DH_NAMED_GROUPS; i++) {
+		if (BN_cmp(dh->p, &dh_named_groups[i].mont->N) == 0)
+			return &dh_named_groups[i];
+	}
+	return NULL;
+}
+
+#ifdef BN_FIXED
+static int
+dh_comb_spacing(const struct dh_named_group *group)
+{
+	return (BN_num_bits(&group->mont->N) + DH_COMB_TEETH - 1) /
+	    DH_COMB_TEETH;
+}
+
+/*
+ * Entry v of the table is the product of g^(2^(i * spacing)) over the bits
+ * i set in v, in the Montgomery domain.
+ */
+static const BN_ULONG *
+dh_comb_table(struct dh_named_group *group)
+{
+	const BN_MONT_CTX *mont = group->mont;
+	BN_ULONG base[BN_FIXED_MAX_WORDS], word[BN_FIXED_MAX_WORDS];
+	BN_ULONG *table;
+	int top = mont->N.top;
+	int spacing = dh_comb_spacing(group);
+	int i, j, v;
+
+	if ((table = group->table) != NULL)
+		return table;
+
+	if ((table = calloc(DH_COMB_ENTRIES, top * sizeof(BN_ULONG))) == NULL)
+		return NULL;
+
+	/* Entry 0 is 1 and base is g, both times R. */
+	memset(word, 0, sizeof(word));
+	word[0] = 1;
+	bn_fixed_mont_mul(table, mont->RR.d, word, mont->N.d, mont->n0[0],
+	    top);
+	word[0] = 2;
+	bn_fixed_mont_mul(base, mont->RR.d, word, mont->N.d, mont->n0[0],
+	    top);
+
+	for (i = 0; i < DH_COMB_TEETH; i++) {
+		for (v = 1 << i; v < 2 << i; v++)
+			bn_fixed_mont_mul(&table[v * top],
+			    &table[(v - (1 << i)) * top], base, mont->N.d,
+			    mont->n0[0], top);
+		for (j = 0; j < spacing; j++)
+			bn_fixed_mont_mul(base, base, base, mont->N.d,
+			    mont->n0[0], top);
+	}
+
+	if (!__sync_bool_compare_and_swap(&group->table, NULL, table)) {
+		/* Another thread got there first. */
+		free(table);
+		table = group->table;
+	}
+
+	return table;
+}
+
+/* Copies entry idx of the table to r, reading every entry. */
+static void
+dh_comb_select(BN_ULONG *r, const BN_ULONG *table, int idx, int top)
+{
+	BN_ULONG mask;
+	int v, w;
+
+	for (w = 0; w < top; w++)
+		r[w] = 0;
+	for (v = 0; v < DH_COMB_ENTRIES; v++) {
+		mask = (BN_ULONG)0 - (constant_time_eq_int(v, idx) & 1);
+		for (w = 0; w < top; w++)
+			r[w] |= table[w] & mask;
+		table += top;
+	}
+}
+
+/*
+ * Sets r to g^x mod p for a named group.  Returns -1 if the comb cannot be
+ * used, so that the caller falls back to the generic exponentiation.
+ */
+static int
+dh_named_group_exp(struct dh_named_group *group, BIGNUM *r, const BIGNUM *x)
+{
+	const BN_MONT_CTX *mont = group->mont;
+	BN_ULONG acc[BN_FIXED_MAX_WORDS], entry[BN_FIXED_MAX_WORDS];
+	const BN_ULONG *table;
+	int top = mont->N.top;
+	int spacing = dh_comb_spacing(group);
+	int i, j, idx;
+	int ret = 0;
+
+	if (BN_is_negative(x) || BN_num_bits(x) > DH_COMB_TEETH * spacing)
+		return -1;
+	if ((table = dh_comb_table(group)) == NULL)
+		return -1;
+
+	for (j = spacing - 1; j >= 0; j--) {
+		for (idx = 0, i = 0; i < DH_COMB_TEETH; i++)
+			idx |= BN_is_bit_set(x, i * spacing + j) << i;
+		dh_comb_select(entry, table, idx, top);
+		if (j == spacing - 1) {
+			memcpy(acc, entry, top * sizeof(BN_ULONG));
+			continue;
+		}
+		bn_fixed_mont_mul(acc, acc, acc, mont->N.d, mont->n0[0], top);
+		bn_fixed_mont_mul(acc, acc, entry, mont->N.d, mont->n0[0],
+		    top);
+	}
+
+	/* Leave the Montgomery domain by multiplying with 1. */
+	memset(entry, 0, sizeof(entry));
+	entry[0] = 1;
+	bn_fixed_mont_mul(acc, acc, entry, mont->N.d, mont->n0[0], top);
+
+	if (bn_wexpand(r, top) == NULL)
+		goto err;
+	memcpy(r->d, acc, top * sizeof(BN_ULONG));
+	r->top = top;
+	r->neg = 0;
+	bn_correct_top(r);
+
+	ret = 1;
+
+ err:
+	explicit_bzero(acc, sizeof(acc));
+	explicit_bzero(entry, sizeof(entry));
+
+	return ret;
+}
+#endif
+
 int
 DH_generate_key(DH *dh)
 {
@@ -101,6 +298,8 @@ DH_OpenSSL(void)
 static int
 generate_key(DH *dh)
 {
+	struct dh_named_group *named;
+	int comb = -1;
 	int ok = 0;
 	unsigned l;
 	BN_CTX *ctx;
@@ -112,7 +311,7 @@ generate_key(DH *dh)
 		return 0;
 	}
 
-	ctx = BN_CTX_new();
+	ctx = BN_CTX_get_thread_default();
 	if (ctx == NULL)
 		goto err;
 
@@ -126,7 +325,9 @@ generate_key(DH *dh)
 			goto err;
 	}
 
-	if (dh->flags & DH_FLAG_CACHE_MONT_P) {
+	if ((named = dh_named_group(dh)) != NULL)
+		mont = named->mont;
+	else if (dh->flags & DH_FLAG_CACHE_MONT_P) {
 		mont = BN_MONT_CTX_set_locked(&dh->method_mont_p,
 		    CRYPTO_LOCK_DH, dh->p, ctx);
 		if (!mont)
@@ -149,8 +350,14 @@ generate_key(DH *dh)
 		}
 	}
 
-	if (!dh->meth->bn_mod_exp(dh, pub_key, dh->g, priv_key, dh->p, ctx,
-	    mont))
+#ifdef BN_FIXED
+	if (named != NULL && dh->meth->bn_mod_exp == dh_bn_mod_exp)
+		comb = dh_named_group_exp(named, pub_key, priv_key);
+#endif
+	if (comb == 0)
+		goto err;
+	if (comb == -1 && !dh->meth->bn_mod_exp(dh, pub_key, dh->g, priv_key,
+	    dh->p, ctx, mont))
 		goto err;
 
 	dh->pub_key = pub_key;
@@ -172,6 +379,7 @@ generate_key(DH *dh)
 static int
 compute_key(unsigned char *key, const BIGNUM *pub_key, DH *dh)
 {
+	struct dh_named_group *named;
 	BN_CTX *ctx = NULL;
 	BN_MONT_CTX *mont = NULL;
 	BIGNUM *tmp;
@@ -183,7 +391,7 @@ compute_key(unsigned char *key, const BIGNUM *pub_key, DH *dh)
 		goto err;
 	}
 
-	ctx = BN_CTX_new();
+	ctx = BN_CTX_get_thread_default();
 	if (ctx == NULL)
 		goto err;
 	BN_CTX_start(ctx);
@@ -195,7 +403,10 @@ compute_key(unsigned char *key, const BIGNUM *pub_key, DH *dh)
 		goto err;
 	}
 
-	if (dh->flags & DH_FLAG_CACHE_MONT_P) {
+	if ((named = dh_named_group(dh)) != NULL) {
+		mont = named->mont;
+		BN_set_flags(dh->priv_key, BN_FLG_CONSTTIME);
+	} else if (dh->flags & DH_FLAG_CACHE_MONT_P) {
 		mont = BN_MONT_CTX_set_locked(&dh->method_mont_p,
 		    CRYPTO_LOCK_DH, dh->p, ctx);
 
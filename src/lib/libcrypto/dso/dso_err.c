@@ -65,18 +65,20 @@
 #include <openssl/err.h>
 #include <openssl/dso.h>
 
+#include "cryptlib.h"
+
 /* BEGIN ERROR CODES */
 #ifndef OPENSSL_NO_ERR
 
 #define ERR_FUNC(func) ERR_PACK(ERR_LIB_DSO,func,0)
 #define ERR_REASON(reason) ERR_PACK(ERR_LIB_DSO,0,reason)
 
-static ERR_STRING_DATA DSO_str_functs[]= {
+static const ERR_STRING_DATA DSO_str_functs[]= {
 	{ERR_FUNC(0xfff), "CRYPTO_internal"},
 	{0, NULL}
 };
 
-static ERR_STRING_DATA DSO_str_reasons[]= {
+static const ERR_STRING_DATA DSO_str_reasons[]= {
 	{ERR_REASON(DSO_R_CTRL_FAILED)           , "control command failed"},
 	{ERR_REASON(DSO_R_DSO_ALREADY_LOADED)    , "dso already loaded"},
 	{ERR_REASON(DSO_R_EMPTY_FILE_STRUCTURE)  , "empty file structure"},
@@ -104,8 +106,8 @@ ERR_load_DSO_strings(void)
 {
 #ifndef OPENSSL_NO_ERR
 	if (ERR_func_error_string(DSO_str_functs[0].error) == NULL) {
-		ERR_load_strings(0, DSO_str_functs);
-		ERR_load_strings(0, DSO_str_reasons);
+		ERR_load_const_strings(DSO_str_functs);
+		ERR_load_const_strings(DSO_str_reasons);
 	}
 #endif
 }
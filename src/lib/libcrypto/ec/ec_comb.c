@@ -0,0 +1,424 @@
+/*	$OpenBSD$	*/
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Fixed base comb multiplication of the generator of named prime curves.
+ *
+ * A scalar k is first made odd by replacing it with order - k if needed.
+ * An odd k < 2^bits can be written as k = sum s_i 2^i with every s_i
+ * either 1 or -1, where s_i = 2 e_i - 1 for the bits e_i of
+ * e = (k - 1) / 2 + 2^(bits - 1). The signs are laid out in EC_COMB_TEETH
+ * rows of spacing bits each. Up to the sign of its top row, every column
+ * of the comb is one of EC_COMB_ENTRIES precomputed points, and none of
+ * these is the point at infinity. The multiplication is then spacing - 1
+ * doublings and additions in a fixed sequence, and every table lookup
+ * reads all entries.
+ *
+ * Tables are built on first use from the built-in definition of a curve,
+ * kept for the life of the process and shared read-only between threads.
+ */
+
+#include <string.h>
+
+#include <openssl/bn.h>
+#include <openssl/ec.h>
+#include <openssl/err.h>
+#include <openssl/objects.h>
+
+#include "bn_lcl.h"
+#include "constant_time_locl.h"
+#include "ec_lcl.h"
+
+#define EC_COMB_TEETH		8
+#define EC_COMB_ENTRIES		(1 << (EC_COMB_TEETH - 1))
+#define EC_COMB_CACHE_SIZE	32
+
+struct ec_comb_st {
+	const EC_METHOD *meth;
+	int curve_name;
+	BIGNUM *field, *a, *b, *order;
+	EC_POINT *generator;
+	int spacing;		/* bits per row */
+	int top;		/* words per coordinate */
+	BIGNUM *one;		/* Z coordinate of every entry */
+	BN_ULONG *table;	/* X and Y of every entry */
+};
+
+static EC_COMB *ec_comb_cache[EC_COMB_CACHE_SIZE];
+
+static void
+ec_comb_free(EC_COMB *comb)
+{
+	if (comb == NULL)
+		return;
+
+	BN_free(comb->field);
+	BN_free(comb->a);
+	BN_free(comb->b);
+	BN_free(comb->order);
+	EC_POINT_free(comb->generator);
+	BN_free(comb->one);
+	free(comb->table);
+	free(comb);
+}
+
+static int
+ec_comb_matches(const EC_COMB *comb, const EC_GROUP *group, BN_CTX *ctx)
+{
+	return comb->meth == group->meth &&
+	    comb->curve_name == group->curve_name &&
+	    BN_cmp(comb->field, &group->field) == 0 &&
+	    BN_cmp(comb->a, &group->a) == 0 &&
+	    BN_cmp(comb->b, &group->b) == 0 &&
+	    BN_cmp(comb->order, &group->order) == 0 &&
+	    EC_POINT_cmp(group, comb->generator, group->generator, ctx) == 0;
+}
+
+/*
+ * With B_i = 2^(i * spacing) * generator, entry v is
+ * B_(TEETH - 1) + sum_(i < TEETH - 1) (bit i of v ? B_i : -B_i).
+ */
+static EC_COMB *
+ec_comb_new(const EC_GROUP *group, BN_CTX *ctx)
+{
+	EC_POINT *base[EC_COMB_TEETH - 1] = { NULL };
+	EC_POINT *points[EC_COMB_ENTRIES] = { NULL };
+	EC_POINT *top_base = NULL;
+	EC_COMB *comb = NULL;
+	BN_ULONG *entry;
+	int bits, i, j, v;
+	int ok = 0;
+
+	/*
+	 * A spacing larger than the number of teeth keeps every entry
+	 * smaller than the order.
+	 */
+	bits = BN_num_bits(&group->order);
+	if ((bits + EC_COMB_TEETH - 1) / EC_COMB_TEETH <= EC_COMB_TEETH ||
+	    !BN_is_odd(&group->order))
+		return NULL;
+
+	if ((comb = calloc(1, sizeof(*comb))) == NULL) {
+		ECerror(ERR_R_MALLOC_FAILURE);
+		return NULL;
+	}
+	comb->meth = group->meth;
+	comb->curve_name = group->curve_name;
+	comb->spacing = (bits + EC_COMB_TEETH - 1) / EC_COMB_TEETH;
+	comb->top = group->field.top;
+	if ((comb->field = BN_dup(&group->field)) == NULL ||
+	    (comb->a = BN_dup(&group->a)) == NULL ||
+	    (comb->b = BN_dup(&group->b)) == NULL ||
+	    (comb->order = BN_dup(&group->order)) == NULL)
+		goto err;
+	if ((comb->generator = EC_POINT_dup(group->generator, group)) == NULL)
+		goto err;
+
+	/* base[i] := B_i, top_base := B_(TEETH - 1) */
+	for (i = 0; i < EC_COMB_TEETH; i++) {
+		EC_POINT *p;
+
+		if ((p = EC_POINT_dup(i == 0 ? group->generator : base[i - 1],
+		    group)) == NULL)
+			goto err;
+		if (i < EC_COMB_TEETH - 1)
+			base[i] = p;
+		else
+			top_base = p;
+		for (j = 0; i > 0 && j < comb->spacing; j++) {
+			if (!EC_POINT_dbl(group, p, p, ctx))
+				goto err;
+		}
+	}
+
+	/* points[0] := B_(TEETH - 1) - sum B_i */
+	for (v = 0; v < EC_COMB_ENTRIES; v++) {
+		if ((points[v] = EC_POINT_new(group)) == NULL)
+			goto err;
+	}
+	if (!EC_POINT_copy(points[0], top_base))
+		goto err;
+	for (i = 0; i < EC_COMB_TEETH - 1; i++) {
+		if (!EC_POINT_invert(group, base[i], ctx))
+			goto err;
+		if (!EC_POINT_add(group, points[0], points[0], base[i], ctx))
+			goto err;
+		if (!EC_POINT_invert(group, base[i], ctx))
+			goto err;
+	}
+
+	/* Setting bit i of v turns -B_i into B_i. */
+	for (i = 0; i < EC_COMB_TEETH - 1; i++) {
+		if (!EC_POINT_dbl(group, base[i], base[i], ctx))
+			goto err;
+		for (v = 1 << i; v < 2 << i; v++) {
+			if (!EC_POINT_add(group, points[v],
+			    points[v - (1 << i)], base[i], ctx))
+				goto err;
+		}
+	}
+
+	if (!EC_POINTs_make_affine(group, EC_COMB_ENTRIES, points, ctx))
+		goto err;
+
+	if ((comb->table = calloc(EC_COMB_ENTRIES, 2 * comb->top *
+	    sizeof(BN_ULONG))) == NULL) {
+		ECerror(ERR_R_MALLOC_FAILURE);
+		goto err;
+	}
+	entry = comb->table;
+	for (v = 0; v < EC_COMB_ENTRIES; v++) {
+		if (EC_POINT_is_at_infinity(group, points[v]) ||
+		    !points[v]->Z_is_one ||
+		    points[v]->X.top > comb->top ||
+		    points[v]->Y.top > comb->top) {
+			ECerror(ERR_R_INTERNAL_ERROR);
+			goto err;
+		}
+		memcpy(entry, points[v]->X.d,
+		    points[v]->X.top * sizeof(BN_ULONG));
+		memcpy(entry + comb->top, points[v]->Y.d,
+		    points[v]->Y.top * sizeof(BN_ULONG));
+		entry += 2 * comb->top;
+	}
+	if ((comb->one = BN_dup(&points[0]->Z)) == NULL)
+		goto err;
+
+	ok = 1;
+
+ err:
+	for (i = 0; i < EC_COMB_TEETH - 1; i++)
+		EC_POINT_free(base[i]);
+	EC_POINT_free(top_base);
+	for (v = 0; v < EC_COMB_ENTRIES; v++)
+		EC_POINT_free(points[v]);
+	if (!ok) {
+		ec_comb_free(comb);
+		comb = NULL;
+	}
+
+	return comb;
+}
+
+/*
+ * Returns the comb for the generator of group, building it if this is the
+ * first use of the curve, or NULL if the group has none.
+ */
+const EC_COMB *
+ec_comb_get(const EC_GROUP *group, BN_CTX *ctx)
+{
+	EC_GROUP *curve;
+	EC_COMB *comb;
+	int i;
+
+	if (group->curve_name == NID_undef || group->generator == NULL ||
+	    EC_METHOD_get_field_type(group->meth) != NID_X9_62_prime_field)
+		return NULL;
+
+	for (i = 0; i < EC_COMB_CACHE_SIZE; i++) {
+		if ((comb = ec_comb_cache[i]) == NULL)
+			break;
+		if (ec_comb_matches(comb, group, ctx))
+			return comb;
+	}
+	if (i == EC_COMB_CACHE_SIZE)
+		return NULL;
+
+	/*
+	 * Only build from the built-in curve, so that a group that was
+	 * changed after it was created cannot take up a slot.
+	 */
+	if ((curve = EC_GROUP_new_by_curve_name(group->curve_name)) == NULL)
+		return NULL;
+	comb = ec_comb_new(curve, ctx);
+	EC_GROUP_free(curve);
+	if (comb == NULL)
+		return NULL;
+	if (!ec_comb_matches(comb, group, ctx)) {
+		ec_comb_free(comb);
+		return NULL;
+	}
+
+	for (; i < EC_COMB_CACHE_SIZE; i++) {
+		if (__sync_bool_compare_and_swap(&ec_comb_cache[i], NULL, comb))
+			return comb;
+		/* Another thread filled the slot, maybe for the same curve. */
+		if (ec_comb_matches(ec_comb_cache[i], group, ctx)) {
+			ec_comb_free(comb);
+			return ec_comb_cache[i];
+		}
+	}
+	ec_comb_free(comb);
+
+	return NULL;
+}
+
+/* Sets p to entry idx of the comb, reading every entry. */
+static int
+ec_comb_select(const EC_COMB *comb, EC_POINT *p, int idx)
+{
+	const BN_ULONG *entry = comb->table;
+	BN_ULONG mask;
+	int v, w;
+
+	if (bn_wexpand(&p->X, comb->top) == NULL ||
+	    bn_wexpand(&p->Y, comb->top) == NULL)
+		return 0;
+
+	for (w = 0; w < comb->top; w++) {
+		p->X.d[w] = 0;
+		p->Y.d[w] = 0;
+	}
+	for (v = 0; v < EC_COMB_ENTRIES; v++) {
+		mask = (BN_ULONG)0 - (constant_time_eq_int(v, idx) & 1);
+		for (w = 0; w < comb->top; w++) {
+			p->X.d[w] |= entry[w] & mask;
+			p->Y.d[w] |= entry[comb->top + w] & mask;
+		}
+		entry += 2 * comb->top;
+	}
+	p->X.top = comb->top;
+	p->Y.top = comb->top;
+	bn_correct_top(&p->X);
+	bn_correct_top(&p->Y);
+
+	return 1;
+}
+
+/* Negates p if cond is not 0, in constant time. */
+static int
+ec_comb_invert_ct(const EC_GROUP *group, EC_POINT *p, EC_POINT *tmp,
+    int cond, int top, BN_CTX *ctx)
+{
+	if (!EC_POINT_copy(tmp, p))
+		return 0;
+	if (!EC_POINT_invert(group, tmp, ctx))
+		return 0;
+	return BN_swap_ct(cond, &p->Y, &tmp->Y, top);
+}
+
+/*
+ * Computes r = scalar * generator in constant time, like
+ * ec_GFp_simple_mul_ct(), using the comb of the group.
+ *
+ * scalar should be in the range [0,n) otherwise all constant time bets are off.
+ */
+int
+ec_comb_mul_ct(const EC_GROUP *group, const EC_COMB *comb, EC_POINT *r,
+    const BIGNUM *scalar, BN_CTX *ctx)
+{
+	EC_POINT *p = NULL, *tmp = NULL;
+	BIGNUM *k, *m, *e;
+	BN_CTX *new_ctx = NULL;
+	int bit, even, idx, sign;
+	int i, j;
+	int ret = 0;
+
+	if (ctx == NULL && (ctx = new_ctx = BN_CTX_new()) == NULL)
+		return 0;
+
+	BN_CTX_start(ctx);
+
+	if ((k = BN_CTX_get(ctx)) == NULL)
+		goto err;
+	if ((m = BN_CTX_get(ctx)) == NULL)
+		goto err;
+	if ((e = BN_CTX_get(ctx)) == NULL)
+		goto err;
+	if ((p = EC_POINT_new(group)) == NULL)
+		goto err;
+	if ((tmp = EC_POINT_new(group)) == NULL)
+		goto err;
+
+	if (bn_wexpand(k, comb->order->top) == NULL ||
+	    bn_wexpand(m, comb->order->top) == NULL)
+		goto err;
+
+	if (BN_is_negative(scalar) || BN_ucmp(scalar, comb->order) >= 0) {
+		/*
+		 * This is an unusual input, and we don't guarantee
+		 * constant-timeness
+		 */
+		if (!BN_nnmod(k, scalar, comb->order, ctx))
+			goto err;
+	} else if (!BN_copy(k, scalar))
+		goto err;
+	BN_set_flags(k, BN_FLG_CONSTTIME);
+
+	/* The order is odd, so one of k and order - k is odd. */
+	if (!BN_usub(m, comb->order, k))
+		goto err;
+	even = !BN_is_odd(k);
+	if (!BN_swap_ct(even, k, m, comb->order->top))
+		goto err;
+
+	/* Bit i of e is set if s_i is 1. */
+	if (!BN_rshift1(e, k))
+		goto err;
+	if (!BN_set_bit(e, comb->spacing * EC_COMB_TEETH - 1))
+		goto err;
+	BN_set_flags(e, BN_FLG_CONSTTIME);
+
+	if (!BN_copy(&p->Z, comb->one))
+		goto err;
+	p->Z_is_one = 1;
+
+	for (j = comb->spacing - 1; j >= 0; j--) {
+		sign = BN_is_bit_set(e,
+		    (EC_COMB_TEETH - 1) * comb->spacing + j);
+		idx = 0;
+		for (i = 0; i < EC_COMB_TEETH - 1; i++) {
+			bit = BN_is_bit_set(e, i * comb->spacing + j);
+			idx |= (bit ^ sign ^ 1) << i;
+		}
+		if (!ec_comb_select(comb, p, idx))
+			goto err;
+		if (!ec_comb_invert_ct(group, p, tmp, sign ^ 1, comb->top,
+		    ctx))
+			goto err;
+
+		if (j == comb->spacing - 1) {
+			if (!EC_POINT_copy(r, p))
+				goto err;
+			/*
+			 * Apply coordinate blinding for EC_POINT if the
+			 * underlying EC_METHOD implements it.
+			 */
+			if (!ec_point_blind_coordinates(group, r, ctx))
+				goto err;
+			continue;
+		}
+		if (!EC_POINT_dbl(group, r, r, ctx))
+			goto err;
+		if (!EC_POINT_add(group, r, r, p, ctx))
+			goto err;
+	}
+
+	/* Undo the replacement of k by order - k. */
+	if (!ec_comb_invert_ct(group, r, tmp, even, comb->top, ctx))
+		goto err;
+
+	ret = 1;
+
+ err:
+	EC_POINT_free(p);
+	EC_POINT_free(tmp);
+	BN_CTX_end(ctx);
+	BN_CTX_free(new_ctx);
+
+	return ret;
+}
@@ -3187,9 +3187,21 @@ static const ec_list_element curve_list[] = {
 #else
 	{NID_secp224r1, &_EC_NIST_PRIME_224.h, 0, "NIST/SECG curve over a 224 bit prime field"},
 #endif
-	{NID_secp256k1, &_EC_SECG_PRIME_256K1.h, 0, "SECG curve over a 256 bit prime field"},
+	{NID_secp256k1, &_EC_SECG_PRIME_256K1.h,
+#if defined(ECP_SECP256K1)
+	 EC_GFp_secp256k1_method,
+#else
+	 0,
+#endif
+	 "SECG curve over a 256 bit prime field"},
 	/* SECG secp256r1 is the same as X9.62 prime256v1 and hence omitted */
-	{NID_secp384r1, &_EC_NIST_PRIME_384.h, 0, "NIST/SECG curve over a 384 bit prime field"},
+	{NID_secp384r1, &_EC_NIST_PRIME_384.h,
+#if defined(ECP_NISTZ384)
+	 EC_GFp_nistz384_method,
+#else
+	 0,
+#endif
+	 "NIST/SECG curve over a 384 bit prime field"},
 #ifndef OPENSSL_NO_EC_NISTP_64_GCC_128
 	{NID_secp521r1, &_EC_NIST_PRIME_521.h, EC_GFp_nistp521_method, "NIST/SECG curve over a 521 bit prime field"},
 #else
@@ -3409,27 +3421,56 @@ ec_group_new_from_data(const ec_list_element curve)
 	return group;
 }
 
+/*
+ * Each built-in curve is built from its data once and kept for the life of
+ * the process. Callers may change the group they are given, so they get a
+ * copy of it, which saves converting the parameters and setting up the
+ * field again.
+ */
+static EC_GROUP *ec_group_templates[curve_list_length];
+
+static const EC_GROUP *
+ec_group_template(size_t i)
+{
+	EC_GROUP *group;
+
+	if ((group = ec_group_templates[i]) != NULL)
+		return group;
+
+	if ((group = ec_group_new_from_data(curve_list[i])) == NULL)
+		return NULL;
+	EC_GROUP_set_curve_name(group, curve_list[i].nid);
+
+	if (!__sync_bool_compare_and_swap(&ec_group_templates[i], NULL,
+	    group)) {
+		/* Another thread built the same curve. */
+		EC_GROUP_free(group);
+		group = ec_group_templates[i];
+	}
+
+	return group;
+}
+
 EC_GROUP *
 EC_GROUP_new_by_curve_name(int nid)
 {
+	const EC_GROUP *group = NULL;
 	size_t i;
-	EC_GROUP *ret = NULL;
 
 	if (nid <= 0)
 		return NULL;
 
 	for (i = 0; i < curve_list_length; i++)
 		if (curve_list[i].nid == nid) {
-			ret = ec_group_new_from_data(curve_list[i]);
+			group = ec_group_template(i);
 			break;
 		}
-	if (ret == NULL) {
+	if (group == NULL) {
 		ECerror(EC_R_UNKNOWN_GROUP);
 		return NULL;
 	}
-	EC_GROUP_set_curve_name(ret, nid);
 
-	return ret;
+	return EC_GROUP_dup(group);
 }
 
 size_t 
@@ -65,18 +65,20 @@
 #include <openssl/err.h>
 #include <openssl/ec.h>
 
+#include "cryptlib.h"
+
 /* BEGIN ERROR CODES */
 #ifndef OPENSSL_NO_ERR
 
 #define ERR_FUNC(func) ERR_PACK(ERR_LIB_EC,func,0)
 #define ERR_REASON(reason) ERR_PACK(ERR_LIB_EC,0,reason)
 
-static ERR_STRING_DATA EC_str_functs[] = {
+static const ERR_STRING_DATA EC_str_functs[] = {
 	{ERR_FUNC(0xfff), "CRYPTO_internal"},
 	{0, NULL}
 };
 
-static ERR_STRING_DATA EC_str_reasons[] =
+static const ERR_STRING_DATA EC_str_reasons[] =
 {
 	{ERR_REASON(EC_R_ASN1_ERROR), "asn1 error"},
 	{ERR_REASON(EC_R_ASN1_UNKNOWN_FIELD), "asn1 unknown field"},
@@ -141,8 +143,8 @@ ERR_load_EC_strings(void)
 #ifndef OPENSSL_NO_ERR
 
 	if (ERR_func_error_string(EC_str_functs[0].error) == NULL) {
-		ERR_load_strings(0, EC_str_functs);
-		ERR_load_strings(0, EC_str_reasons);
+		ERR_load_const_strings(EC_str_functs);
+		ERR_load_const_strings(EC_str_reasons);
 	}
 #endif
 }
@@ -271,7 +271,7 @@ ossl_ec_key_gen(EC_KEY *eckey)
 
 	if ((order = BN_new()) == NULL)
 		goto err;
-	if ((ctx = BN_CTX_new()) == NULL)
+	if ((ctx = BN_CTX_get_thread_default()) == NULL)
 		goto err;
 
 	if ((priv_key = eckey->priv_key) == NULL) {
@@ -295,6 +295,7 @@ ossl_ec_key_gen(EC_KEY *eckey)
 
 	eckey->priv_key = priv_key;
 	eckey->pub_key = pub_key;
+	ec_wNAF_key_precompute_free(eckey);
 
 	ok = 1;
 
@@ -324,7 +325,7 @@ EC_KEY_check_key(const EC_KEY * eckey)
 		ECerror(EC_R_POINT_AT_INFINITY);
 		goto err;
 	}
-	if ((ctx = BN_CTX_new()) == NULL)
+	if ((ctx = BN_CTX_get_thread_default()) == NULL)
 		goto err;
 	if ((point = EC_POINT_new(eckey->group)) == NULL)
 		goto err;
@@ -387,9 +388,10 @@ EC_KEY_set_public_key_affine_coordinates(EC_KEY * key, BIGNUM * x, BIGNUM * y)
 		ECerror(ERR_R_PASSED_NULL_PARAMETER);
 		return 0;
 	}
-	ctx = BN_CTX_new();
+	ctx = BN_CTX_get_thread_default();
 	if (!ctx)
 		goto err;
+	BN_CTX_start(ctx);
 
 	point = EC_POINT_new(key->group);
 
@@ -422,6 +424,7 @@ EC_KEY_set_public_key_affine_coordinates(EC_KEY * key, BIGNUM * x, BIGNUM * y)
 	ok = 1;
 
  err:
+	BN_CTX_end(ctx);
 	BN_CTX_free(ctx);
 	EC_POINT_free(point);
 	return ok;
@@ -440,6 +443,7 @@ EC_KEY_set_group(EC_KEY * key, const EC_GROUP * group)
 	if (key->meth->set_group != NULL &&
 	    key->meth->set_group(key, group) == 0)
 		return 0;
+	ec_wNAF_key_precompute_free(key);
 	EC_GROUP_free(key->group);
 	key->group = EC_GROUP_dup(group);
 	return (key->group == NULL) ? 0 : 1;
@@ -474,6 +478,7 @@ EC_KEY_set_public_key(EC_KEY * key, const EC_POINT * pub_key)
 	if (key->meth->set_public != NULL &&
 	    key->meth->set_public(key, pub_key) == 0)
 		return 0;
+	ec_wNAF_key_precompute_free(key);
 	EC_POINT_free(key->pub_key);
 	key->pub_key = EC_POINT_dup(pub_key, key->group);
 	return (key->pub_key == NULL) ? 0 : 1;
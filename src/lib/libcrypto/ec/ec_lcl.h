@@ -305,6 +305,15 @@ int ec_wNAF_mul(const EC_GROUP *group, EC_POINT *r, const BIGNUM *scalar,
 	size_t num, const EC_POINT *points[], const BIGNUM *scalars[], BN_CTX *);
 int ec_wNAF_precompute_mult(EC_GROUP *group, BN_CTX *);
 int ec_wNAF_have_precompute_mult(const EC_GROUP *group);
+int ec_wNAF_mul_key(EC_KEY *key, EC_POINT *r, const BIGNUM *g_scalar,
+	const BIGNUM *p_scalar, BN_CTX *);
+void ec_wNAF_key_precompute_free(EC_KEY *key);
+
+/* fixed base comb for the generator in ec_comb.c */
+typedef struct ec_comb_st EC_COMB;
+const EC_COMB *ec_comb_get(const EC_GROUP *group, BN_CTX *);
+int ec_comb_mul_ct(const EC_GROUP *group, const EC_COMB *comb, EC_POINT *r,
+	const BIGNUM *scalar, BN_CTX *);
 
 
 /* method functions in ecp_smpl.c */
@@ -446,6 +455,14 @@ int ec_GFp_nistp256_have_precompute_mult(const EC_GROUP *group);
 const EC_METHOD *EC_GFp_nistz256_method(void);
 #endif
 
+#ifdef ECP_NISTZ384
+const EC_METHOD *EC_GFp_nistz384_method(void);
+#endif
+
+#ifdef ECP_SECP256K1
+const EC_METHOD *EC_GFp_secp256k1_method(void);
+#endif
+
 /* EC_METHOD definitions */
 
 struct ec_key_method_st {
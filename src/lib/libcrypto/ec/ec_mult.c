@@ -329,11 +329,14 @@ compute_wNAF(const BIGNUM * scalar, int w, size_t * ret_len)
  *      \sum scalars[i]*points[i],
  * also including
  *      scalar*generator
- * in the addition if scalar != NULL
+ * in the addition if scalar != NULL.
+ * If point_pre is not NULL, it holds the odd multiples of points[0]
+ * with window size point_pre->w.
  */
-int 
-ec_wNAF_mul(const EC_GROUP * group, EC_POINT * r, const BIGNUM * scalar,
-    size_t num, const EC_POINT * points[], const BIGNUM * scalars[], BN_CTX * ctx)
+static int
+ec_wNAF_mul_internal(const EC_GROUP * group, EC_POINT * r,
+    const BIGNUM * scalar, size_t num, const EC_POINT * points[],
+    const BIGNUM * scalars[], const EC_PRE_COMP * point_pre, BN_CTX * ctx)
 {
 	BN_CTX *new_ctx = NULL;
 	const EC_POINT *generator = NULL;
@@ -449,9 +452,14 @@ ec_wNAF_mul(const EC_GROUP * group, EC_POINT * r, const BIGNUM * scalar,
 	for (i = 0; i < num + num_scalar; i++) {
 		size_t bits;
 
-		bits = i < num ? BN_num_bits(scalars[i]) : BN_num_bits(scalar);
-		wsize[i] = EC_window_bits_for_scalar_size(bits);
-		num_val += (size_t) 1 << (wsize[i] - 1);
+		if (i == 0 && num > 0 && point_pre != NULL) {
+			wsize[i] = point_pre->w;
+		} else {
+			bits = i < num ? BN_num_bits(scalars[i]) :
+			    BN_num_bits(scalar);
+			wsize[i] = EC_window_bits_for_scalar_size(bits);
+			num_val += (size_t) 1 << (wsize[i] - 1);
+		}
 		wNAF[i + 1] = NULL;	/* make sure we always have a pivot */
 		wNAF[i] = compute_wNAF((i < num ? scalars[i] : scalar), wsize[i], &wNAF_len[i]);
 		if (wNAF[i] == NULL)
@@ -586,6 +594,10 @@ ec_wNAF_mul(const EC_GROUP * group, EC_POINT * r, const BIGNUM * scalar,
 	/* allocate points for precomputation */
 	v = val;
 	for (i = 0; i < num + num_scalar; i++) {
+		if (i == 0 && num > 0 && point_pre != NULL) {
+			val_sub[i] = point_pre->points;
+			continue;
+		}
 		val_sub[i] = v;
 		for (j = 0; j < ((size_t) 1 << (wsize[i] - 1)); j++) {
 			*v = EC_POINT_new(group);
@@ -606,6 +618,8 @@ ec_wNAF_mul(const EC_GROUP * group, EC_POINT * r, const BIGNUM * scalar,
 	 * val_sub[i][1] := 3 * points[i] val_sub[i][2] := 5 * points[i] ...
 	 */
 	for (i = 0; i < num + num_scalar; i++) {
+		if (i == 0 && num > 0 && point_pre != NULL)
+			continue;
 		if (i < num) {
 			if (!EC_POINT_copy(val_sub[i][0], points[i]))
 				goto err;
@@ -701,6 +715,14 @@ ec_wNAF_mul(const EC_GROUP * group, EC_POINT * r, const BIGNUM * scalar,
 	return ret;
 }
 
+int 
+ec_wNAF_mul(const EC_GROUP * group, EC_POINT * r, const BIGNUM * scalar,
+    size_t num, const EC_POINT * points[], const BIGNUM * scalars[], BN_CTX * ctx)
+{
+	return ec_wNAF_mul_internal(group, r, scalar, num, points, scalars,
+	    NULL, ctx);
+}
+
 
 /* ec_wNAF_precompute_mult()
  * creates an EC_PRE_COMP object with preprecomputed multiples of the generator
@@ -883,3 +905,126 @@ ec_wNAF_have_precompute_mult(const EC_GROUP * group)
 	else
 		return 0;
 }
+
+
+/*
+ * The odd multiples of a public key that ec_wNAF_mul_key() keeps with the
+ * key, in an EC_PRE_COMP with a single block. The window is wider than
+ * ec_wNAF_mul() would use, since the multiples are only computed once.
+ */
+static EC_PRE_COMP *
+ec_wNAF_key_precompute(const EC_GROUP *group, const EC_POINT *point,
+    BN_CTX *ctx)
+{
+	EC_PRE_COMP *pre_comp;
+	EC_POINT *tmp = NULL;
+	EC_POINT **points = NULL;
+	size_t i, num, w;
+
+	if ((pre_comp = ec_pre_comp_new(group)) == NULL)
+		return NULL;
+
+	w = EC_window_bits_for_scalar_size(BN_num_bits(&group->order)) + 2;
+	num = (size_t) 1 << (w - 1);
+
+	if ((points = reallocarray(NULL, num + 1, sizeof(EC_POINT *))) == NULL) {
+		ECerror(ERR_R_MALLOC_FAILURE);
+		goto err;
+	}
+	for (i = 0; i <= num; i++)
+		points[i] = NULL;
+	for (i = 0; i < num; i++) {
+		if ((points[i] = EC_POINT_new(group)) == NULL)
+			goto err;
+	}
+	if ((tmp = EC_POINT_new(group)) == NULL)
+		goto err;
+
+	if (!EC_POINT_copy(points[0], point))
+		goto err;
+	if (!EC_POINT_dbl(group, tmp, point, ctx))
+		goto err;
+	for (i = 1; i < num; i++) {
+		if (!EC_POINT_add(group, points[i], points[i - 1], tmp, ctx))
+			goto err;
+	}
+	if (!EC_POINTs_make_affine(group, num, points, ctx))
+		goto err;
+
+	pre_comp->blocksize = 0;
+	pre_comp->numblocks = 1;
+	pre_comp->w = w;
+	pre_comp->points = points;
+	pre_comp->num = num;
+	EC_POINT_free(tmp);
+
+	return pre_comp;
+
+ err:
+	if (points != NULL) {
+		for (i = 0; points[i] != NULL; i++)
+			EC_POINT_free(points[i]);
+		free(points);
+	}
+	EC_POINT_free(tmp);
+	ec_pre_comp_free(pre_comp);
+
+	return NULL;
+}
+
+/*
+ * Computes r = g_scalar * generator + p_scalar * pub_key for the
+ * verification of signatures made with key. The first call computes the
+ * multiples of the public key and keeps them in the method data of the
+ * key, later calls with the same public key reuse them. Methods that do
+ * not use ec_wNAF_mul() fall back to EC_POINT_mul().
+ */
+int
+ec_wNAF_mul_key(EC_KEY *key, EC_POINT *r, const BIGNUM *g_scalar,
+    const BIGNUM *p_scalar, BN_CTX *ctx)
+{
+	const EC_GROUP *group = key->group;
+	const EC_POINT *point = key->pub_key;
+	EC_PRE_COMP *pre_comp, *cached, *new_pre = NULL;
+	int ret;
+
+	if (group->meth->mul_double_nonct != ec_GFp_simple_mul_double_nonct)
+		return EC_POINT_mul(group, r, g_scalar, point, p_scalar, ctx);
+
+	if ((pre_comp = EC_KEY_get_key_method_data(key, ec_pre_comp_dup,
+	    ec_pre_comp_free, ec_pre_comp_clear_free)) == NULL) {
+		if ((new_pre = ec_wNAF_key_precompute(group, point,
+		    ctx)) == NULL)
+			return 0;
+		if ((cached = EC_KEY_insert_key_method_data(key, new_pre,
+		    ec_pre_comp_dup, ec_pre_comp_free,
+		    ec_pre_comp_clear_free)) != NULL)
+			pre_comp = cached;
+		else
+			pre_comp = new_pre;
+		/* The key owns new_pre unless it could not be inserted. */
+		if (EC_KEY_get_key_method_data(key, ec_pre_comp_dup,
+		    ec_pre_comp_free, ec_pre_comp_clear_free) == new_pre)
+			new_pre = NULL;
+	}
+
+	/* The public key may have been replaced without the key knowing. */
+	if (pre_comp->group != group ||
+	    EC_POINT_cmp(group, pre_comp->points[0], point, ctx) != 0)
+		pre_comp = NULL;
+
+	ret = ec_wNAF_mul_internal(group, r, g_scalar, 1, &point, &p_scalar,
+	    pre_comp, ctx);
+
+	ec_pre_comp_free(new_pre);
+
+	return ret;
+}
+
+/* Drops the multiples kept by ec_wNAF_mul_key() when the key changes. */
+void
+ec_wNAF_key_precompute_free(EC_KEY *key)
+{
+	EC_EX_DATA_free_data(&key->method_data, ec_pre_comp_dup,
+	    ec_pre_comp_free, ec_pre_comp_clear_free);
+}
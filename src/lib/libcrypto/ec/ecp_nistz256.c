@@ -46,6 +46,7 @@
 #include <openssl/ec.h>
 #include <openssl/err.h>
 
+#include "bn_lcl.h"
 #include "ec_lcl.h"
 
 #if BN_BITS2 != 64
@@ -326,6 +327,396 @@ void	ecp_nistz256_point_add(P256_POINT *r, const P256_POINT *a,
 void	ecp_nistz256_point_add_affine(P256_POINT *r, const P256_POINT *a,
 	    const P256_POINT_AFFINE *b);
 
+#if defined(__aarch64__)
+/*
+ * Field arithmetic and point operations for aarch64, written in C on top of
+ * 128-bit products instead of assembly. Unlike the assembly versions, all
+ * results are fully reduced mod P.
+ */
+
+static const BN_ULONG P256[P256_LIMBS] = {
+	TOBN(0xffffffff, 0xffffffff), TOBN(0x00000000, 0xffffffff),
+	TOBN(0x00000000, 0x00000000), TOBN(0xffffffff, 0x00000001)
+};
+
+/* res = a - P if a >= P, a otherwise, where a is carry:a[3..0] < 2P. */
+static void
+ecp_nistz256_reduce_once(BN_ULONG res[P256_LIMBS],
+    const BN_ULONG a[P256_LIMBS], BN_ULONG carry)
+{
+	BN_ULONG d[P256_LIMBS], borrow = 0, mask;
+	__uint128_t t;
+	int i;
+
+	for (i = 0; i < P256_LIMBS; i++) {
+		t = (__uint128_t)a[i] - P256[i] - borrow;
+		d[i] = (BN_ULONG)t;
+		borrow = (BN_ULONG)(t >> 64) & 1;
+	}
+
+	/* All ones if the subtraction borrowed past the carry word. */
+	mask = carry - borrow;
+	for (i = 0; i < P256_LIMBS; i++)
+		res[i] = (a[i] & mask) | (d[i] & ~mask);
+}
+
+/* res = a + b mod P */
+static void
+ecp_nistz256_add(BN_ULONG res[P256_LIMBS], const BN_ULONG a[P256_LIMBS],
+    const BN_ULONG b[P256_LIMBS])
+{
+	BN_ULONG s[P256_LIMBS], carry = 0;
+	__uint128_t t;
+	int i;
+
+	for (i = 0; i < P256_LIMBS; i++) {
+		t = (__uint128_t)a[i] + b[i] + carry;
+		s[i] = (BN_ULONG)t;
+		carry = (BN_ULONG)(t >> 64);
+	}
+	ecp_nistz256_reduce_once(res, s, carry);
+}
+
+/* res = a - b mod P */
+static void
+ecp_nistz256_sub(BN_ULONG res[P256_LIMBS], const BN_ULONG a[P256_LIMBS],
+    const BN_ULONG b[P256_LIMBS])
+{
+	BN_ULONG d[P256_LIMBS], borrow = 0, mask;
+	__uint128_t t;
+	int i;
+
+	for (i = 0; i < P256_LIMBS; i++) {
+		t = (__uint128_t)a[i] - b[i] - borrow;
+		d[i] = (BN_ULONG)t;
+		borrow = (BN_ULONG)(t >> 64) & 1;
+	}
+
+	/* Add P back if the subtraction borrowed. */
+	mask = 0 - borrow;
+	borrow = 0;
+	for (i = 0; i < P256_LIMBS; i++) {
+		t = (__uint128_t)d[i] + (P256[i] & mask) + borrow;
+		res[i] = (BN_ULONG)t;
+		borrow = (BN_ULONG)(t >> 64);
+	}
+}
+
+static void
+ecp_nistz256_mul_by_2(BN_ULONG res[P256_LIMBS], const BN_ULONG a[P256_LIMBS])
+{
+	ecp_nistz256_add(res, a, a);
+}
+
+static void
+ecp_nistz256_mul_by_3(BN_ULONG res[P256_LIMBS], const BN_ULONG a[P256_LIMBS])
+{
+	BN_ULONG t[P256_LIMBS];
+
+	ecp_nistz256_add(t, a, a);
+	ecp_nistz256_add(res, t, a);
+}
+
+/* res = a / 2 mod P */
+static void
+ecp_nistz256_div_by_2(BN_ULONG res[P256_LIMBS], const BN_ULONG a[P256_LIMBS])
+{
+	BN_ULONG s[P256_LIMBS], carry = 0, mask;
+	__uint128_t t;
+	int i;
+
+	/* Make a even by adding P if it is odd, then shift. */
+	mask = 0 - (a[0] & 1);
+	for (i = 0; i < P256_LIMBS; i++) {
+		t = (__uint128_t)a[i] + (P256[i] & mask) + carry;
+		s[i] = (BN_ULONG)t;
+		carry = (BN_ULONG)(t >> 64);
+	}
+	for (i = 0; i < P256_LIMBS - 1; i++)
+		res[i] = (s[i] >> 1) | (s[i + 1] << (BN_BITS2 - 1));
+	res[i] = (s[i] >> 1) | (carry << (BN_BITS2 - 1));
+}
+
+void
+ecp_nistz256_neg(BN_ULONG res[P256_LIMBS], const BN_ULONG a[P256_LIMBS])
+{
+	static const BN_ULONG zero[P256_LIMBS];
+
+	ecp_nistz256_sub(res, zero, a);
+}
+
+/*
+ * Word by word Montgomery multiplication. Since P = -1 mod 2^64, the
+ * reduction multiplier for each word is the low word of the accumulator
+ * itself, and P[2] is zero.
+ */
+void
+ecp_nistz256_mul_mont(BN_ULONG res[P256_LIMBS], const BN_ULONG a[P256_LIMBS],
+    const BN_ULONG b[P256_LIMBS])
+{
+	BN_ULONG acc[P256_LIMBS + 2] = { 0 };
+	BN_ULONG c, m;
+	__uint128_t t;
+	int i, j;
+
+	for (i = 0; i < P256_LIMBS; i++) {
+		c = 0;
+		for (j = 0; j < P256_LIMBS; j++) {
+			t = (__uint128_t)a[j] * b[i] + acc[j] + c;
+			acc[j] = (BN_ULONG)t;
+			c = (BN_ULONG)(t >> 64);
+		}
+		t = (__uint128_t)acc[4] + c;
+		acc[4] = (BN_ULONG)t;
+		acc[5] = (BN_ULONG)(t >> 64);
+
+		/* acc = (acc + m * P) / 2^64 */
+		m = acc[0];
+		t = (__uint128_t)m * P256[1] + acc[1] + m;
+		acc[0] = (BN_ULONG)t;
+		c = (BN_ULONG)(t >> 64);
+		t = (__uint128_t)acc[2] + c;
+		acc[1] = (BN_ULONG)t;
+		c = (BN_ULONG)(t >> 64);
+		t = (__uint128_t)m * P256[3] + acc[3] + c;
+		acc[2] = (BN_ULONG)t;
+		c = (BN_ULONG)(t >> 64);
+		t = (__uint128_t)acc[4] + c;
+		acc[3] = (BN_ULONG)t;
+		acc[4] = acc[5] + (BN_ULONG)(t >> 64);
+	}
+
+	ecp_nistz256_reduce_once(res, acc, acc[4]);
+}
+
+void
+ecp_nistz256_sqr_mont(BN_ULONG res[P256_LIMBS], const BN_ULONG a[P256_LIMBS])
+{
+	ecp_nistz256_mul_mont(res, a, a);
+}
+
+void
+ecp_nistz256_from_mont(BN_ULONG res[P256_LIMBS], const BN_ULONG in[P256_LIMBS])
+{
+	static const BN_ULONG one[P256_LIMBS] = { 1 };
+
+	ecp_nistz256_mul_mont(res, in, one);
+}
+
+/* val = in_t[index - 1], or zero if index is 0, touching every entry. */
+void
+ecp_nistz256_select_w5(P256_POINT *val, const P256_POINT *in_t, int index)
+{
+	BN_ULONG mask;
+	int i, j;
+
+	memset(val, 0, sizeof(*val));
+	for (i = 0; i < 16; i++) {
+		mask = 0 - is_zero((BN_ULONG)((i + 1) ^ index));
+		for (j = 0; j < P256_LIMBS; j++) {
+			val->X[j] |= in_t[i].X[j] & mask;
+			val->Y[j] |= in_t[i].Y[j] & mask;
+			val->Z[j] |= in_t[i].Z[j] & mask;
+		}
+	}
+}
+
+void
+ecp_nistz256_select_w7(P256_POINT_AFFINE *val, const P256_POINT_AFFINE *in_t,
+    int index)
+{
+	BN_ULONG mask;
+	int i, j;
+
+	memset(val, 0, sizeof(*val));
+	for (i = 0; i < 64; i++) {
+		mask = 0 - is_zero((BN_ULONG)((i + 1) ^ index));
+		for (j = 0; j < P256_LIMBS; j++) {
+			val->X[j] |= in_t[i].X[j] & mask;
+			val->Y[j] |= in_t[i].Y[j] & mask;
+		}
+	}
+}
+
+/* Point double: r = 2*a */
+void
+ecp_nistz256_point_double(P256_POINT *r, const P256_POINT *a)
+{
+	BN_ULONG S[P256_LIMBS], M[P256_LIMBS], Zsqr[P256_LIMBS];
+	BN_ULONG tmp0[P256_LIMBS];
+	const BN_ULONG *in_x = a->X, *in_y = a->Y, *in_z = a->Z;
+	BN_ULONG *res_x = r->X, *res_y = r->Y, *res_z = r->Z;
+
+	ecp_nistz256_mul_by_2(S, in_y);
+
+	ecp_nistz256_sqr_mont(Zsqr, in_z);
+
+	ecp_nistz256_sqr_mont(S, S);
+
+	ecp_nistz256_mul_mont(res_z, in_z, in_y);
+	ecp_nistz256_mul_by_2(res_z, res_z);
+
+	ecp_nistz256_add(M, in_x, Zsqr);
+	ecp_nistz256_sub(Zsqr, in_x, Zsqr);
+
+	ecp_nistz256_sqr_mont(res_y, S);
+	ecp_nistz256_div_by_2(res_y, res_y);
+
+	ecp_nistz256_mul_mont(M, M, Zsqr);
+	ecp_nistz256_mul_by_3(M, M);
+
+	ecp_nistz256_mul_mont(S, S, in_x);
+	ecp_nistz256_mul_by_2(tmp0, S);
+
+	ecp_nistz256_sqr_mont(res_x, M);
+
+	ecp_nistz256_sub(res_x, res_x, tmp0);
+	ecp_nistz256_sub(S, S, res_x);
+
+	ecp_nistz256_mul_mont(S, S, M);
+	ecp_nistz256_sub(res_y, S, res_y);
+}
+
+/* Point addition: r = a+b */
+void
+ecp_nistz256_point_add(P256_POINT *r, const P256_POINT *a, const P256_POINT *b)
+{
+	BN_ULONG U2[P256_LIMBS], S2[P256_LIMBS];
+	BN_ULONG U1[P256_LIMBS], S1[P256_LIMBS];
+	BN_ULONG Z1sqr[P256_LIMBS], Z2sqr[P256_LIMBS];
+	BN_ULONG H[P256_LIMBS], R[P256_LIMBS];
+	BN_ULONG Hsqr[P256_LIMBS], Rsqr[P256_LIMBS], Hcub[P256_LIMBS];
+	BN_ULONG res_x[P256_LIMBS], res_y[P256_LIMBS], res_z[P256_LIMBS];
+	BN_ULONG in1infty, in2infty;
+	const BN_ULONG *in1_x = a->X, *in1_y = a->Y, *in1_z = a->Z;
+	const BN_ULONG *in2_x = b->X, *in2_y = b->Y, *in2_z = b->Z;
+
+	/* Infinity is encoded as (,,0). */
+	in1infty = is_zero(in1_z[0] | in1_z[1] | in1_z[2] | in1_z[3]);
+	in2infty = is_zero(in2_z[0] | in2_z[1] | in2_z[2] | in2_z[3]);
+
+	ecp_nistz256_sqr_mont(Z2sqr, in2_z);		/* Z2^2 */
+	ecp_nistz256_sqr_mont(Z1sqr, in1_z);		/* Z1^2 */
+
+	ecp_nistz256_mul_mont(S1, Z2sqr, in2_z);	/* S1 = Z2^3 */
+	ecp_nistz256_mul_mont(S2, Z1sqr, in1_z);	/* S2 = Z1^3 */
+
+	ecp_nistz256_mul_mont(S1, S1, in1_y);		/* S1 = Y1*Z2^3 */
+	ecp_nistz256_mul_mont(S2, S2, in2_y);		/* S2 = Y2*Z1^3 */
+	ecp_nistz256_sub(R, S2, S1);			/* R = S2 - S1 */
+
+	ecp_nistz256_mul_mont(U1, in1_x, Z2sqr);	/* U1 = X1*Z2^2 */
+	ecp_nistz256_mul_mont(U2, in2_x, Z1sqr);	/* U2 = X2*Z1^2 */
+	ecp_nistz256_sub(H, U2, U1);			/* H = U2 - U1 */
+
+	/*
+	 * The formulae are incorrect if the points are equal, in which case
+	 * double instead. Points at infinity are handled at the end.
+	 */
+	if (is_equal(U1, U2) && !in1infty && !in2infty) {
+		if (is_equal(S1, S2)) {
+			ecp_nistz256_point_double(r, a);
+			return;
+		}
+		memset(r, 0, sizeof(*r));
+		return;
+	}
+
+	ecp_nistz256_sqr_mont(Rsqr, R);			/* R^2 */
+	ecp_nistz256_mul_mont(res_z, H, in1_z);		/* Z3 = H*Z1*Z2 */
+	ecp_nistz256_sqr_mont(Hsqr, H);			/* H^2 */
+	ecp_nistz256_mul_mont(res_z, res_z, in2_z);	/* Z3 = H*Z1*Z2 */
+	ecp_nistz256_mul_mont(Hcub, Hsqr, H);		/* H^3 */
+
+	ecp_nistz256_mul_mont(U2, U1, Hsqr);		/* U1*H^2 */
+	ecp_nistz256_mul_by_2(Hsqr, U2);		/* 2*U1*H^2 */
+
+	ecp_nistz256_sub(res_x, Rsqr, Hsqr);
+	ecp_nistz256_sub(res_x, res_x, Hcub);
+
+	ecp_nistz256_sub(res_y, U2, res_x);
+
+	ecp_nistz256_mul_mont(S2, S1, Hcub);
+	ecp_nistz256_mul_mont(res_y, R, res_y);
+	ecp_nistz256_sub(res_y, res_y, S2);
+
+	copy_conditional(res_x, in2_x, in1infty);
+	copy_conditional(res_y, in2_y, in1infty);
+	copy_conditional(res_z, in2_z, in1infty);
+
+	copy_conditional(res_x, in1_x, in2infty);
+	copy_conditional(res_y, in1_y, in2infty);
+	copy_conditional(res_z, in1_z, in2infty);
+
+	memcpy(r->X, res_x, sizeof(res_x));
+	memcpy(r->Y, res_y, sizeof(res_y));
+	memcpy(r->Z, res_z, sizeof(res_z));
+}
+
+/* Point addition when b is known to be affine: r = a+b */
+void
+ecp_nistz256_point_add_affine(P256_POINT *r, const P256_POINT *a,
+    const P256_POINT_AFFINE *b)
+{
+	BN_ULONG U2[P256_LIMBS], S2[P256_LIMBS];
+	BN_ULONG Z1sqr[P256_LIMBS];
+	BN_ULONG H[P256_LIMBS], R[P256_LIMBS];
+	BN_ULONG Hsqr[P256_LIMBS], Rsqr[P256_LIMBS], Hcub[P256_LIMBS];
+	BN_ULONG res_x[P256_LIMBS], res_y[P256_LIMBS], res_z[P256_LIMBS];
+	BN_ULONG in1infty, in2infty;
+	const BN_ULONG *in1_x = a->X, *in1_y = a->Y, *in1_z = a->Z;
+	const BN_ULONG *in2_x = b->X, *in2_y = b->Y;
+
+	/*
+	 * Infinity is encoded as (,,0) in Jacobian form and as (0,0) in
+	 * affine form, the latter not being on the curve.
+	 */
+	in1infty = is_zero(in1_z[0] | in1_z[1] | in1_z[2] | in1_z[3]);
+	in2infty = is_zero(in2_x[0] | in2_x[1] | in2_x[2] | in2_x[3] |
+	    in2_y[0] | in2_y[1] | in2_y[2] | in2_y[3]);
+
+	ecp_nistz256_sqr_mont(Z1sqr, in1_z);		/* Z1^2 */
+
+	ecp_nistz256_mul_mont(U2, in2_x, Z1sqr);	/* U2 = X2*Z1^2 */
+	ecp_nistz256_sub(H, U2, in1_x);			/* H = U2 - U1 */
+
+	ecp_nistz256_mul_mont(S2, Z1sqr, in1_z);	/* S2 = Z1^3 */
+
+	ecp_nistz256_mul_mont(res_z, H, in1_z);		/* Z3 = H*Z1*Z2 */
+
+	ecp_nistz256_mul_mont(S2, S2, in2_y);		/* S2 = Y2*Z1^3 */
+	ecp_nistz256_sub(R, S2, in1_y);			/* R = S2 - S1 */
+
+	ecp_nistz256_sqr_mont(Hsqr, H);			/* H^2 */
+	ecp_nistz256_sqr_mont(Rsqr, R);			/* R^2 */
+	ecp_nistz256_mul_mont(Hcub, Hsqr, H);		/* H^3 */
+
+	ecp_nistz256_mul_mont(U2, in1_x, Hsqr);		/* U1*H^2 */
+	ecp_nistz256_mul_by_2(Hsqr, U2);		/* 2*U1*H^2 */
+
+	ecp_nistz256_sub(res_x, Rsqr, Hsqr);
+	ecp_nistz256_sub(res_x, res_x, Hcub);
+	ecp_nistz256_sub(H, U2, res_x);
+
+	ecp_nistz256_mul_mont(S2, in1_y, Hcub);
+	ecp_nistz256_mul_mont(H, H, R);
+	ecp_nistz256_sub(res_y, H, S2);
+
+	copy_conditional(res_x, in2_x, in1infty);
+	copy_conditional(res_x, in1_x, in2infty);
+
+	copy_conditional(res_y, in2_y, in1infty);
+	copy_conditional(res_y, in1_y, in2infty);
+
+	copy_conditional(res_z, ONE, in1infty);
+	copy_conditional(res_z, in1_z, in2infty);
+
+	memcpy(r->X, res_x, sizeof(res_x));
+	memcpy(r->Y, res_y, sizeof(res_y));
+	memcpy(r->Z, res_z, sizeof(res_z));
+}
+#endif /* __aarch64__ */
+
 /* r = in^-1 mod p */
 static void
 ecp_nistz256_mod_inverse(BN_ULONG r[P256_LIMBS], const BN_ULONG in[P256_LIMBS])
@@ -994,6 +1385,30 @@ ecp_nistz256_points_mul(const EC_GROUP *group, EC_POINT *r,
 	return ret;
 }
 
+static int
+ecp_nistz256_mul_generator_ct(const EC_GROUP *group, EC_POINT *r,
+    const BIGNUM *scalar, BN_CTX *ctx)
+{
+	return ecp_nistz256_points_mul(group, r, scalar, 0, NULL, NULL, ctx);
+}
+
+static int
+ecp_nistz256_mul_single_ct(const EC_GROUP *group, EC_POINT *r,
+    const BIGNUM *scalar, const EC_POINT *point, BN_CTX *ctx)
+{
+	return ecp_nistz256_points_mul(group, r, NULL, 1, &point, &scalar,
+	    ctx);
+}
+
+static int
+ecp_nistz256_mul_double_nonct(const EC_GROUP *group, EC_POINT *r,
+    const BIGNUM *g_scalar, const BIGNUM *p_scalar, const EC_POINT *point,
+    BN_CTX *ctx)
+{
+	return ecp_nistz256_points_mul(group, r, g_scalar, 1, &point,
+	    &p_scalar, ctx);
+}
+
 static int
 ecp_nistz256_get_affine(const EC_GROUP *group, const EC_POINT *point,
     BIGNUM *x, BIGNUM *y, BN_CTX *ctx)
@@ -1174,7 +1589,9 @@ EC_GFp_nistz256_method(void)
 		.point_cmp = ec_GFp_simple_cmp,
 		.make_affine = ec_GFp_simple_make_affine,
 		.points_make_affine = ec_GFp_simple_points_make_affine,
-		.mul = ecp_nistz256_points_mul,
+		.mul_generator_ct = ecp_nistz256_mul_generator_ct,
+		.mul_single_ct = ecp_nistz256_mul_single_ct,
+		.mul_double_nonct = ecp_nistz256_mul_double_nonct,
 		.precompute_mult = ecp_nistz256_mult_precompute,
 		.have_precompute_mult =
 		    ecp_nistz256_window_have_precompute_mult,
@@ -0,0 +1,1023 @@
+/*	$OpenBSD$	*/
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * P-384 in the style of ecp_nistz256.c.
+ *
+ * Field elements are six 64-bit limbs in Montgomery form with R = 2^384.
+ * This is the representation the BN_MONT_CTX of the mont method uses for
+ * the coordinates of an EC_POINT, so points are converted by copying words.
+ *
+ * Scalars are recoded into 77 signed radix 2^5 digits. A point is
+ * multiplied with a table of its first 16 multiples and five doublings
+ * per digit, the generator with 77 tables of 16 affine points and no
+ * doublings. Every table lookup reads all entries. The generator tables
+ * are built on first use and kept for the life of the process.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/bn.h>
+#include <openssl/ec.h>
+#include <openssl/err.h>
+
+#include "bn_lcl.h"
+#include "ec_lcl.h"
+
+#if BN_BITS2 != 64 || !defined(__SIZEOF_INT128__)
+#error "ecp_nistz384.c needs 64-bit limbs and a 128-bit integer type"
+#endif
+
+typedef __uint128_t uint128_t;
+
+#define	P384_LIMBS	(384 / BN_BITS2)
+#define	P384_WINDOWS	77	/* ceil((384 + 1) / 5) */
+
+typedef struct {
+	BN_ULONG X[P384_LIMBS];
+	BN_ULONG Y[P384_LIMBS];
+	BN_ULONG Z[P384_LIMBS];
+} P384_POINT;
+
+typedef struct {
+	BN_ULONG X[P384_LIMBS];
+	BN_ULONG Y[P384_LIMBS];
+} P384_POINT_AFFINE;
+
+typedef P384_POINT_AFFINE PRECOMP384_ROW[16];
+
+/* p = 2^384 - 2^128 - 2^96 + 2^32 - 1 */
+static const BN_ULONG P384[P384_LIMBS] = {
+	0x00000000ffffffffULL, 0xffffffff00000000ULL, 0xfffffffffffffffeULL,
+	0xffffffffffffffffULL, 0xffffffffffffffffULL, 0xffffffffffffffffULL,
+};
+
+/* p - 2, the exponent of the inversion */
+static const BN_ULONG P384_MINUS_2[P384_LIMBS] = {
+	0x00000000fffffffdULL, 0xffffffff00000000ULL, 0xfffffffffffffffeULL,
+	0xffffffffffffffffULL, 0xffffffffffffffffULL, 0xffffffffffffffffULL,
+};
+
+/* -p^-1 mod 2^64 */
+#define	P384_N0		0x0000000100000001ULL
+
+/* R mod p, that is one in Montgomery form */
+static const BN_ULONG ONE[P384_LIMBS] = {
+	0xffffffff00000001ULL, 0x00000000ffffffffULL, 0x0000000000000001ULL,
+	0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL,
+};
+
+/* Coordinates of the generator in Montgomery form */
+static const BN_ULONG def_xG[P384_LIMBS] = {
+	0x3dd0756649c0b528ULL, 0x20e378e2a0d6ce38ULL, 0x879c3afc541b4d6eULL,
+	0x6454868459a30effULL, 0x812ff723614ede2bULL, 0x4d3aadc2299e1513ULL,
+};
+
+static const BN_ULONG def_yG[P384_LIMBS] = {
+	0x23043dad4b03a4feULL, 0xa1bfa8bf7bb4a9acULL, 0x8bade7562e83b050ULL,
+	0xc6c3521968f4ffd9ULL, 0xdd8002263969a840ULL, 0x2b78abc25a15c5e9ULL,
+};
+
+static PRECOMP384_ROW *ecp_nistz384_precomputed;
+
+static void
+copy_conditional(BN_ULONG dst[P384_LIMBS], const BN_ULONG src[P384_LIMBS],
+    BN_ULONG move)
+{
+	BN_ULONG mask1 = 0 - move;
+	BN_ULONG mask2 = ~mask1;
+	int i;
+
+	for (i = 0; i < P384_LIMBS; i++)
+		dst[i] = (src[i] & mask1) ^ (dst[i] & mask2);
+}
+
+static BN_ULONG
+is_zero(BN_ULONG in)
+{
+	in |= (0 - in);
+	in = ~in;
+	in >>= BN_BITS2 - 1;
+	return in;
+}
+
+static BN_ULONG
+is_zero_felem(const BN_ULONG a[P384_LIMBS])
+{
+	BN_ULONG res = 0;
+	int i;
+
+	for (i = 0; i < P384_LIMBS; i++)
+		res |= a[i];
+
+	return is_zero(res);
+}
+
+static BN_ULONG
+is_equal(const BN_ULONG a[P384_LIMBS], const BN_ULONG b[P384_LIMBS])
+{
+	BN_ULONG res = 0;
+	int i;
+
+	for (i = 0; i < P384_LIMBS; i++)
+		res |= a[i] ^ b[i];
+
+	return is_zero(res);
+}
+
+/* res = a - p if that does not borrow past carry, a otherwise. */
+static void
+ecp_nistz384_reduce_once(BN_ULONG res[P384_LIMBS],
+    const BN_ULONG a[P384_LIMBS], BN_ULONG carry)
+{
+	BN_ULONG d[P384_LIMBS], borrow = 0, mask;
+	uint128_t t;
+	int i;
+
+	for (i = 0; i < P384_LIMBS; i++) {
+		t = (uint128_t)a[i] - P384[i] - borrow;
+		d[i] = (BN_ULONG)t;
+		borrow = (BN_ULONG)(t >> 64) & 1;
+	}
+
+	mask = 0 - (borrow & (carry ^ 1));
+	for (i = 0; i < P384_LIMBS; i++)
+		res[i] = (a[i] & mask) | (d[i] & ~mask);
+}
+
+static void
+ecp_nistz384_add(BN_ULONG res[P384_LIMBS], const BN_ULONG a[P384_LIMBS],
+    const BN_ULONG b[P384_LIMBS])
+{
+	BN_ULONG t[P384_LIMBS];
+	uint128_t c = 0;
+	int i;
+
+	for (i = 0; i < P384_LIMBS; i++) {
+		c += (uint128_t)a[i] + b[i];
+		t[i] = (BN_ULONG)c;
+		c >>= 64;
+	}
+
+	ecp_nistz384_reduce_once(res, t, (BN_ULONG)c);
+}
+
+static void
+ecp_nistz384_sub(BN_ULONG res[P384_LIMBS], const BN_ULONG a[P384_LIMBS],
+    const BN_ULONG b[P384_LIMBS])
+{
+	BN_ULONG t[P384_LIMBS], borrow = 0, mask;
+	uint128_t c;
+	int i;
+
+	for (i = 0; i < P384_LIMBS; i++) {
+		c = (uint128_t)a[i] - b[i] - borrow;
+		t[i] = (BN_ULONG)c;
+		borrow = (BN_ULONG)(c >> 64) & 1;
+	}
+
+	/* Add p back if the subtraction borrowed. */
+	mask = 0 - borrow;
+	c = 0;
+	for (i = 0; i < P384_LIMBS; i++) {
+		c += (uint128_t)t[i] + (P384[i] & mask);
+		res[i] = (BN_ULONG)c;
+		c >>= 64;
+	}
+}
+
+static void
+ecp_nistz384_neg(BN_ULONG res[P384_LIMBS], const BN_ULONG a[P384_LIMBS])
+{
+	static const BN_ULONG zero[P384_LIMBS];
+
+	ecp_nistz384_sub(res, zero, a);
+}
+
+static void
+ecp_nistz384_mul_by_2(BN_ULONG res[P384_LIMBS], const BN_ULONG a[P384_LIMBS])
+{
+	ecp_nistz384_add(res, a, a);
+}
+
+/* res = a * b / R mod p */
+static void
+ecp_nistz384_mul_mont(BN_ULONG res[P384_LIMBS], const BN_ULONG a[P384_LIMBS],
+    const BN_ULONG b[P384_LIMBS])
+{
+	BN_ULONG t[P384_LIMBS + 2], m, carry;
+	uint128_t uv;
+	int i, j;
+
+	memset(t, 0, sizeof(t));
+
+	for (i = 0; i < P384_LIMBS; i++) {
+		carry = 0;
+		for (j = 0; j < P384_LIMBS; j++) {
+			uv = (uint128_t)a[j] * b[i] + t[j] + carry;
+			t[j] = (BN_ULONG)uv;
+			carry = (BN_ULONG)(uv >> 64);
+		}
+		uv = (uint128_t)t[P384_LIMBS] + carry;
+		t[P384_LIMBS] = (BN_ULONG)uv;
+		t[P384_LIMBS + 1] = (BN_ULONG)(uv >> 64);
+
+		m = t[0] * P384_N0;
+		uv = (uint128_t)m * P384[0] + t[0];
+		carry = (BN_ULONG)(uv >> 64);
+		for (j = 1; j < P384_LIMBS; j++) {
+			uv = (uint128_t)m * P384[j] + t[j] + carry;
+			t[j - 1] = (BN_ULONG)uv;
+			carry = (BN_ULONG)(uv >> 64);
+		}
+		uv = (uint128_t)t[P384_LIMBS] + carry;
+		t[P384_LIMBS - 1] = (BN_ULONG)uv;
+		t[P384_LIMBS] = t[P384_LIMBS + 1] + (BN_ULONG)(uv >> 64);
+	}
+
+	ecp_nistz384_reduce_once(res, t, t[P384_LIMBS]);
+}
+
+static void
+ecp_nistz384_sqr_mont(BN_ULONG res[P384_LIMBS], const BN_ULONG a[P384_LIMBS])
+{
+	ecp_nistz384_mul_mont(res, a, a);
+}
+
+static void
+ecp_nistz384_from_mont(BN_ULONG res[P384_LIMBS], const BN_ULONG in[P384_LIMBS])
+{
+	static const BN_ULONG one[P384_LIMBS] = { 1 };
+
+	ecp_nistz384_mul_mont(res, in, one);
+}
+
+/* r = in^-1 mod p, as in^(p - 2) with a fixed window of four bits. */
+static void
+ecp_nistz384_mod_inverse(BN_ULONG r[P384_LIMBS], const BN_ULONG in[P384_LIMBS])
+{
+	BN_ULONG table[16][P384_LIMBS];
+	BN_ULONG res[P384_LIMBS];
+	unsigned int nibble;
+	int i, j;
+
+	memcpy(table[0], ONE, sizeof(table[0]));
+	memcpy(table[1], in, sizeof(table[1]));
+	for (i = 2; i < 16; i++)
+		ecp_nistz384_mul_mont(table[i], table[i - 1], in);
+
+	/* The exponent is public, so it may be used as an index. */
+	memcpy(res, ONE, sizeof(res));
+	for (i = 384 - 4; i >= 0; i -= 4) {
+		for (j = 0; j < 4; j++)
+			ecp_nistz384_sqr_mont(res, res);
+		nibble = (P384_MINUS_2[i / 64] >> (i % 64)) & 0xf;
+		ecp_nistz384_mul_mont(res, res, table[nibble]);
+	}
+
+	memcpy(r, res, sizeof(res));
+}
+
+/*
+ * Recode the window of six bits b_(5j + 4) ... b_(5j - 1) into the signed
+ * digit b_(5j - 1) + b_(5j) + 2 b_(5j + 1) + 4 b_(5j + 2) + 8 b_(5j + 3) -
+ * 16 b_(5j + 4), returning its absolute value (0 .. 16) and setting *sign
+ * to one if it is negative.
+ */
+static unsigned int
+ecp_nistz384_recode(unsigned int in, unsigned int *sign)
+{
+	unsigned int s, d, mask;
+
+	s = in >> 5;
+	d = (in + 1) >> 1;
+	mask = 0 - s;
+	*sign = s;
+
+	return (d & ~mask) | ((32 - d) & mask);
+}
+
+/* The window of digit j of a scalar of 49 little endian bytes. */
+static unsigned int
+ecp_nistz384_window(const unsigned char p_str[49], unsigned int j)
+{
+	unsigned int index = 5 * j, off, wvalue;
+
+	if (j == 0)
+		return (p_str[0] << 1) & 0x3f;
+
+	off = (index - 1) / 8;
+	wvalue = p_str[off] | p_str[off + 1] << 8;
+
+	return (wvalue >> ((index - 1) % 8)) & 0x3f;
+}
+
+/* val = in_t[index - 1], or zero if index is 0, touching every entry. */
+static void
+ecp_nistz384_select_w5(P384_POINT *val, const P384_POINT in_t[16],
+    unsigned int index)
+{
+	BN_ULONG mask;
+	int i, j;
+
+	memset(val, 0, sizeof(*val));
+	for (i = 0; i < 16; i++) {
+		mask = 0 - is_zero((BN_ULONG)((i + 1) ^ index));
+		for (j = 0; j < P384_LIMBS; j++) {
+			val->X[j] |= in_t[i].X[j] & mask;
+			val->Y[j] |= in_t[i].Y[j] & mask;
+			val->Z[j] |= in_t[i].Z[j] & mask;
+		}
+	}
+}
+
+static void
+ecp_nistz384_select_affine_w5(P384_POINT_AFFINE *val,
+    const P384_POINT_AFFINE in_t[16], unsigned int index)
+{
+	BN_ULONG mask;
+	int i, j;
+
+	memset(val, 0, sizeof(*val));
+	for (i = 0; i < 16; i++) {
+		mask = 0 - is_zero((BN_ULONG)((i + 1) ^ index));
+		for (j = 0; j < P384_LIMBS; j++) {
+			val->X[j] |= in_t[i].X[j] & mask;
+			val->Y[j] |= in_t[i].Y[j] & mask;
+		}
+	}
+}
+
+/* Point double: r = 2*a, with a = -3. */
+static void
+ecp_nistz384_point_double(P384_POINT *r, const P384_POINT *a)
+{
+	BN_ULONG delta[P384_LIMBS], gamma[P384_LIMBS], beta[P384_LIMBS];
+	BN_ULONG alpha[P384_LIMBS], t0[P384_LIMBS], t1[P384_LIMBS];
+	BN_ULONG res_x[P384_LIMBS], res_y[P384_LIMBS], res_z[P384_LIMBS];
+
+	ecp_nistz384_sqr_mont(delta, a->Z);		/* delta = Z^2 */
+	ecp_nistz384_sqr_mont(gamma, a->Y);		/* gamma = Y^2 */
+	ecp_nistz384_mul_mont(beta, a->X, gamma);	/* beta = X*gamma */
+
+	ecp_nistz384_sub(t0, a->X, delta);
+	ecp_nistz384_add(t1, a->X, delta);
+	ecp_nistz384_mul_mont(t0, t0, t1);
+	ecp_nistz384_mul_by_2(alpha, t0);
+	ecp_nistz384_add(alpha, alpha, t0);		/* alpha = 3*(X-delta)*(X+delta) */
+
+	ecp_nistz384_add(res_z, a->Y, a->Z);
+	ecp_nistz384_sqr_mont(res_z, res_z);
+	ecp_nistz384_sub(res_z, res_z, gamma);
+	ecp_nistz384_sub(res_z, res_z, delta);		/* Z3 = (Y+Z)^2-gamma-delta */
+
+	ecp_nistz384_mul_by_2(beta, beta);
+	ecp_nistz384_mul_by_2(beta, beta);		/* 4*beta */
+	ecp_nistz384_sqr_mont(res_x, alpha);
+	ecp_nistz384_mul_by_2(t0, beta);
+	ecp_nistz384_sub(res_x, res_x, t0);		/* X3 = alpha^2-8*beta */
+
+	ecp_nistz384_sub(t0, beta, res_x);
+	ecp_nistz384_mul_mont(res_y, alpha, t0);
+	ecp_nistz384_sqr_mont(gamma, gamma);
+	ecp_nistz384_mul_by_2(gamma, gamma);
+	ecp_nistz384_mul_by_2(gamma, gamma);
+	ecp_nistz384_mul_by_2(gamma, gamma);
+	ecp_nistz384_sub(res_y, res_y, gamma);		/* Y3 = alpha*(4*beta-X3)-8*gamma^2 */
+
+	memcpy(r->X, res_x, sizeof(res_x));
+	memcpy(r->Y, res_y, sizeof(res_y));
+	memcpy(r->Z, res_z, sizeof(res_z));
+}
+
+/* Point addition: r = a+b */
+static void
+ecp_nistz384_point_add(P384_POINT *r, const P384_POINT *a, const P384_POINT *b)
+{
+	BN_ULONG U2[P384_LIMBS], S2[P384_LIMBS];
+	BN_ULONG U1[P384_LIMBS], S1[P384_LIMBS];
+	BN_ULONG Z1sqr[P384_LIMBS], Z2sqr[P384_LIMBS];
+	BN_ULONG H[P384_LIMBS], R[P384_LIMBS];
+	BN_ULONG Hsqr[P384_LIMBS], Rsqr[P384_LIMBS], Hcub[P384_LIMBS];
+	BN_ULONG res_x[P384_LIMBS], res_y[P384_LIMBS], res_z[P384_LIMBS];
+	BN_ULONG in1infty, in2infty;
+	const BN_ULONG *in1_x = a->X, *in1_y = a->Y, *in1_z = a->Z;
+	const BN_ULONG *in2_x = b->X, *in2_y = b->Y, *in2_z = b->Z;
+
+	/* Infinity is encoded as (,,0). */
+	in1infty = is_zero_felem(in1_z);
+	in2infty = is_zero_felem(in2_z);
+
+	ecp_nistz384_sqr_mont(Z2sqr, in2_z);		/* Z2^2 */
+	ecp_nistz384_sqr_mont(Z1sqr, in1_z);		/* Z1^2 */
+
+	ecp_nistz384_mul_mont(S1, Z2sqr, in2_z);	/* S1 = Z2^3 */
+	ecp_nistz384_mul_mont(S2, Z1sqr, in1_z);	/* S2 = Z1^3 */
+
+	ecp_nistz384_mul_mont(S1, S1, in1_y);		/* S1 = Y1*Z2^3 */
+	ecp_nistz384_mul_mont(S2, S2, in2_y);		/* S2 = Y2*Z1^3 */
+	ecp_nistz384_sub(R, S2, S1);			/* R = S2 - S1 */
+
+	ecp_nistz384_mul_mont(U1, in1_x, Z2sqr);	/* U1 = X1*Z2^2 */
+	ecp_nistz384_mul_mont(U2, in2_x, Z1sqr);	/* U2 = X2*Z1^2 */
+	ecp_nistz384_sub(H, U2, U1);			/* H = U2 - U1 */
+
+	/*
+	 * The formulae are incorrect if the points are equal, in which case
+	 * double instead. Points at infinity are handled at the end.
+	 */
+	if (is_equal(U1, U2) && !in1infty && !in2infty) {
+		if (is_equal(S1, S2)) {
+			ecp_nistz384_point_double(r, a);
+			return;
+		}
+		memset(r, 0, sizeof(*r));
+		return;
+	}
+
+	ecp_nistz384_sqr_mont(Rsqr, R);			/* R^2 */
+	ecp_nistz384_mul_mont(res_z, H, in1_z);		/* Z3 = H*Z1*Z2 */
+	ecp_nistz384_sqr_mont(Hsqr, H);			/* H^2 */
+	ecp_nistz384_mul_mont(res_z, res_z, in2_z);	/* Z3 = H*Z1*Z2 */
+	ecp_nistz384_mul_mont(Hcub, Hsqr, H);		/* H^3 */
+
+	ecp_nistz384_mul_mont(U2, U1, Hsqr);		/* U1*H^2 */
+	ecp_nistz384_mul_by_2(Hsqr, U2);		/* 2*U1*H^2 */
+
+	ecp_nistz384_sub(res_x, Rsqr, Hsqr);
+	ecp_nistz384_sub(res_x, res_x, Hcub);
+
+	ecp_nistz384_sub(res_y, U2, res_x);
+
+	ecp_nistz384_mul_mont(S2, S1, Hcub);
+	ecp_nistz384_mul_mont(res_y, R, res_y);
+	ecp_nistz384_sub(res_y, res_y, S2);
+
+	copy_conditional(res_x, in2_x, in1infty);
+	copy_conditional(res_y, in2_y, in1infty);
+	copy_conditional(res_z, in2_z, in1infty);
+
+	copy_conditional(res_x, in1_x, in2infty);
+	copy_conditional(res_y, in1_y, in2infty);
+	copy_conditional(res_z, in1_z, in2infty);
+
+	memcpy(r->X, res_x, sizeof(res_x));
+	memcpy(r->Y, res_y, sizeof(res_y));
+	memcpy(r->Z, res_z, sizeof(res_z));
+}
+
+/* Point addition when b is known to be affine: r = a+b */
+static void
+ecp_nistz384_point_add_affine(P384_POINT *r, const P384_POINT *a,
+    const P384_POINT_AFFINE *b)
+{
+	BN_ULONG U2[P384_LIMBS], S2[P384_LIMBS];
+	BN_ULONG Z1sqr[P384_LIMBS];
+	BN_ULONG H[P384_LIMBS], R[P384_LIMBS];
+	BN_ULONG Hsqr[P384_LIMBS], Rsqr[P384_LIMBS], Hcub[P384_LIMBS];
+	BN_ULONG res_x[P384_LIMBS], res_y[P384_LIMBS], res_z[P384_LIMBS];
+	BN_ULONG in1infty, in2infty;
+	const BN_ULONG *in1_x = a->X, *in1_y = a->Y, *in1_z = a->Z;
+	const BN_ULONG *in2_x = b->X, *in2_y = b->Y;
+
+	/*
+	 * Infinity is encoded as (,,0) in Jacobian form and as (0,0) in
+	 * affine form, the latter not being on the curve.
+	 */
+	in1infty = is_zero_felem(in1_z);
+	in2infty = is_zero_felem(in2_x) & is_zero_felem(in2_y);
+
+	ecp_nistz384_sqr_mont(Z1sqr, in1_z);		/* Z1^2 */
+
+	ecp_nistz384_mul_mont(U2, in2_x, Z1sqr);	/* U2 = X2*Z1^2 */
+	ecp_nistz384_sub(H, U2, in1_x);			/* H = U2 - U1 */
+
+	ecp_nistz384_mul_mont(S2, Z1sqr, in1_z);	/* S2 = Z1^3 */
+
+	ecp_nistz384_mul_mont(res_z, H, in1_z);		/* Z3 = H*Z1*Z2 */
+
+	ecp_nistz384_mul_mont(S2, S2, in2_y);		/* S2 = Y2*Z1^3 */
+	ecp_nistz384_sub(R, S2, in1_y);			/* R = S2 - S1 */
+
+	if (is_equal(U2, in1_x) && !in1infty && !in2infty) {
+		if (is_equal(S2, in1_y)) {
+			ecp_nistz384_point_double(r, a);
+			return;
+		}
+		memset(r, 0, sizeof(*r));
+		return;
+	}
+
+	ecp_nistz384_sqr_mont(Hsqr, H);			/* H^2 */
+	ecp_nistz384_sqr_mont(Rsqr, R);			/* R^2 */
+	ecp_nistz384_mul_mont(Hcub, Hsqr, H);		/* H^3 */
+
+	ecp_nistz384_mul_mont(U2, in1_x, Hsqr);		/* U1*H^2 */
+	ecp_nistz384_mul_by_2(Hsqr, U2);		/* 2*U1*H^2 */
+
+	ecp_nistz384_sub(res_x, Rsqr, Hsqr);
+	ecp_nistz384_sub(res_x, res_x, Hcub);
+	ecp_nistz384_sub(H, U2, res_x);
+
+	ecp_nistz384_mul_mont(S2, in1_y, Hcub);
+	ecp_nistz384_mul_mont(H, H, R);
+	ecp_nistz384_sub(res_y, H, S2);
+
+	copy_conditional(res_x, in2_x, in1infty);
+	copy_conditional(res_x, in1_x, in2infty);
+
+	copy_conditional(res_y, in2_y, in1infty);
+	copy_conditional(res_y, in1_y, in2infty);
+
+	copy_conditional(res_z, ONE, in1infty);
+	copy_conditional(res_z, in1_z, in2infty);
+
+	memcpy(r->X, res_x, sizeof(res_x));
+	memcpy(r->Y, res_y, sizeof(res_y));
+	memcpy(r->Z, res_z, sizeof(res_z));
+}
+
+/*
+ * ecp_nistz384_bignum_to_field_elem copies the contents of |in| to |out| and
+ * returns one if it fits. Otherwise it returns zero.
+ */
+static int
+ecp_nistz384_bignum_to_field_elem(BN_ULONG out[P384_LIMBS], const BIGNUM *in)
+{
+	if (in->top > P384_LIMBS)
+		return 0;
+
+	memset(out, 0, sizeof(BN_ULONG) * P384_LIMBS);
+	memcpy(out, in->d, sizeof(BN_ULONG) * in->top);
+	return 1;
+}
+
+static int
+ecp_nistz384_set_words(BIGNUM *a, const BN_ULONG words[P384_LIMBS])
+{
+	if (bn_wexpand(a, P384_LIMBS) == NULL) {
+		ECerror(ERR_R_MALLOC_FAILURE);
+		return 0;
+	}
+
+	memcpy(a->d, words, sizeof(BN_ULONG) * P384_LIMBS);
+	a->top = P384_LIMBS;
+	bn_correct_top(a);
+	return 1;
+}
+
+/*
+ * Write a scalar as 49 little endian bytes, reducing it first if it is
+ * negative or has more than 384 bits. This is an unusual input, for which
+ * we don't guarantee constant-timeness.
+ */
+static int
+ecp_nistz384_scalar_bytes(const EC_GROUP *group, unsigned char p_str[49],
+    const BIGNUM *scalar, BN_CTX *ctx)
+{
+	BIGNUM *mod;
+	BN_ULONG d;
+	int i, j;
+
+	if (BN_num_bits(scalar) > 384 || BN_is_negative(scalar)) {
+		if ((mod = BN_CTX_get(ctx)) == NULL)
+			return 0;
+		if (!BN_nnmod(mod, scalar, &group->order, ctx)) {
+			ECerror(ERR_R_BN_LIB);
+			return 0;
+		}
+		scalar = mod;
+	}
+
+	memset(p_str, 0, 49);
+	for (i = 0; i < scalar->top; i++) {
+		d = scalar->d[i];
+		for (j = 0; j < BN_BYTES; j++) {
+			p_str[i * BN_BYTES + j] = d & 0xff;
+			d >>= 8;
+		}
+	}
+
+	return 1;
+}
+
+/* r = scalar*point */
+static int
+ecp_nistz384_windowed_mul(const EC_GROUP *group, P384_POINT *r,
+    const BIGNUM *scalar, const EC_POINT *point, BN_CTX *ctx)
+{
+	P384_POINT table[16], h;
+	BN_ULONG tmp[P384_LIMBS];
+	unsigned char p_str[49];
+	unsigned int digit, sign;
+	int i;
+
+	if (!ecp_nistz384_scalar_bytes(group, p_str, scalar, ctx))
+		return 0;
+
+	/*
+	 * table[0] is implicitly (0,0,0) (the point at infinity),
+	 * therefore it is not stored. All other values are actually
+	 * stored with an offset of -1 in table.
+	 */
+	if (!ecp_nistz384_bignum_to_field_elem(table[0].X, &point->X) ||
+	    !ecp_nistz384_bignum_to_field_elem(table[0].Y, &point->Y) ||
+	    !ecp_nistz384_bignum_to_field_elem(table[0].Z, &point->Z)) {
+		ECerror(EC_R_COORDINATES_OUT_OF_RANGE);
+		return 0;
+	}
+	for (i = 2; i <= 16; i++) {
+		if (i % 2 == 0)
+			ecp_nistz384_point_double(&table[i - 1],
+			    &table[i / 2 - 1]);
+		else
+			ecp_nistz384_point_add(&table[i - 1], &table[i - 2],
+			    &table[0]);
+	}
+
+	digit = ecp_nistz384_recode(ecp_nistz384_window(p_str,
+	    P384_WINDOWS - 1), &sign);
+	ecp_nistz384_select_w5(r, table, digit);
+
+	for (i = P384_WINDOWS - 2; i >= 0; i--) {
+		ecp_nistz384_point_double(r, r);
+		ecp_nistz384_point_double(r, r);
+		ecp_nistz384_point_double(r, r);
+		ecp_nistz384_point_double(r, r);
+		ecp_nistz384_point_double(r, r);
+
+		digit = ecp_nistz384_recode(ecp_nistz384_window(p_str, i),
+		    &sign);
+		ecp_nistz384_select_w5(&h, table, digit);
+
+		ecp_nistz384_neg(tmp, h.Y);
+		copy_conditional(h.Y, tmp, sign);
+
+		ecp_nistz384_point_add(r, r, &h);
+	}
+
+	explicit_bzero(p_str, sizeof(p_str));
+	explicit_bzero(table, sizeof(table));
+	explicit_bzero(&h, sizeof(h));
+
+	return 1;
+}
+
+/*
+ * Build the tables for the generator, in which row j holds the first 16
+ * multiples of 2^(5j) G. The multiples are computed in Jacobian form and
+ * made affine with a single inversion.
+ */
+static PRECOMP384_ROW *
+ecp_nistz384_precompute(void)
+{
+	PRECOMP384_ROW *precomp = NULL;
+	P384_POINT *points = NULL;
+	BN_ULONG (*prod)[P384_LIMBS] = NULL;
+	BN_ULONG inv[P384_LIMBS], zinv[P384_LIMBS], zinv2[P384_LIMBS];
+	const size_t n = P384_WINDOWS * 16;
+	size_t i, j;
+
+	if ((precomp = reallocarray(NULL, P384_WINDOWS,
+	    sizeof(PRECOMP384_ROW))) == NULL)
+		goto err;
+	if ((points = reallocarray(NULL, n, sizeof(P384_POINT))) == NULL)
+		goto err;
+	if ((prod = reallocarray(NULL, n, sizeof(*prod))) == NULL)
+		goto err;
+
+	memcpy(points[0].X, def_xG, sizeof(def_xG));
+	memcpy(points[0].Y, def_yG, sizeof(def_yG));
+	memcpy(points[0].Z, ONE, sizeof(ONE));
+
+	for (i = 0; i < P384_WINDOWS; i++) {
+		P384_POINT *row = &points[16 * i];
+
+		if (i > 0)
+			ecp_nistz384_point_double(&row[0], &row[-1]);
+		ecp_nistz384_point_double(&row[1], &row[0]);
+		for (j = 2; j < 16; j++)
+			ecp_nistz384_point_add(&row[j], &row[j - 1], &row[0]);
+	}
+
+	/* None of the multiples is the point at infinity. */
+	memcpy(prod[0], points[0].Z, sizeof(prod[0]));
+	for (i = 1; i < n; i++)
+		ecp_nistz384_mul_mont(prod[i], prod[i - 1], points[i].Z);
+
+	ecp_nistz384_mod_inverse(inv, prod[n - 1]);
+
+	for (i = n - 1; i > 0; i--) {
+		ecp_nistz384_mul_mont(zinv, inv, prod[i - 1]);
+		ecp_nistz384_mul_mont(inv, inv, points[i].Z);
+		memcpy(prod[i], zinv, sizeof(zinv));
+	}
+	memcpy(prod[0], inv, sizeof(inv));
+
+	for (i = 0; i < n; i++) {
+		P384_POINT_AFFINE *out = &precomp[i / 16][i % 16];
+
+		ecp_nistz384_sqr_mont(zinv2, prod[i]);
+		ecp_nistz384_mul_mont(out->X, points[i].X, zinv2);
+		ecp_nistz384_mul_mont(zinv2, zinv2, prod[i]);
+		ecp_nistz384_mul_mont(out->Y, points[i].Y, zinv2);
+	}
+
+	free(points);
+	free(prod);
+
+	return precomp;
+
+ err:
+	ECerror(ERR_R_MALLOC_FAILURE);
+	free(precomp);
+	free(points);
+	free(prod);
+
+	return NULL;
+}
+
+static const PRECOMP384_ROW *
+ecp_nistz384_get_precomputed(void)
+{
+	PRECOMP384_ROW *precomp;
+
+	if ((precomp = ecp_nistz384_precomputed) != NULL)
+		return precomp;
+
+	if ((precomp = ecp_nistz384_precompute()) == NULL)
+		return NULL;
+	if (!__sync_bool_compare_and_swap(&ecp_nistz384_precomputed, NULL,
+	    precomp)) {
+		/* Another thread got there first. */
+		free(precomp);
+		precomp = ecp_nistz384_precomputed;
+	}
+
+	return precomp;
+}
+
+/* r = scalar*G, with the tables for the standard generator */
+static void
+ecp_nistz384_generator_mul(P384_POINT *r, const PRECOMP384_ROW *precomp,
+    const unsigned char p_str[49])
+{
+	P384_POINT_AFFINE t;
+	BN_ULONG tmp[P384_LIMBS];
+	unsigned int digit, sign;
+	int i;
+
+	memset(r, 0, sizeof(*r));
+
+	for (i = 0; i < P384_WINDOWS; i++) {
+		digit = ecp_nistz384_recode(ecp_nistz384_window(p_str, i),
+		    &sign);
+		ecp_nistz384_select_affine_w5(&t, precomp[i], digit);
+
+		ecp_nistz384_neg(tmp, t.Y);
+		copy_conditional(t.Y, tmp, sign);
+
+		ecp_nistz384_point_add_affine(r, r, &t);
+	}
+
+	explicit_bzero(&t, sizeof(t));
+}
+
+/*
+ * ecp_nistz384_is_affine_G returns one if |generator| is the standard, P-384
+ * generator.
+ */
+static int
+ecp_nistz384_is_affine_G(const EC_POINT *generator)
+{
+	BN_ULONG x[P384_LIMBS], y[P384_LIMBS], z[P384_LIMBS];
+
+	if (!ecp_nistz384_bignum_to_field_elem(x, &generator->X) ||
+	    !ecp_nistz384_bignum_to_field_elem(y, &generator->Y) ||
+	    !ecp_nistz384_bignum_to_field_elem(z, &generator->Z))
+		return 0;
+
+	return is_equal(x, def_xG) & is_equal(y, def_yG) & is_equal(z, ONE);
+}
+
+/* r = g_scalar*G + p_scalar*point */
+static int
+ecp_nistz384_points_mul(const EC_GROUP *group, EC_POINT *r,
+    const BIGNUM *g_scalar, const BIGNUM *p_scalar, const EC_POINT *point,
+    BN_CTX *ctx)
+{
+	BN_CTX *new_ctx = NULL;
+	const PRECOMP384_ROW *precomp = NULL;
+	const EC_POINT *generator = NULL;
+	unsigned char p_str[49];
+	P384_POINT p, t;
+	int ret = 0;
+
+	if (point != NULL && group->meth != point->meth) {
+		ECerror(EC_R_INCOMPATIBLE_OBJECTS);
+		return 0;
+	}
+
+	if (ctx == NULL) {
+		if ((ctx = new_ctx = BN_CTX_new()) == NULL)
+			return 0;
+	}
+
+	BN_CTX_start(ctx);
+
+	/* The point at infinity. */
+	memset(&p, 0, sizeof(p));
+
+	if (g_scalar != NULL) {
+		if ((generator = EC_GROUP_get0_generator(group)) == NULL) {
+			ECerror(EC_R_UNDEFINED_GENERATOR);
+			goto err;
+		}
+		if (ecp_nistz384_is_affine_G(generator))
+			precomp = ecp_nistz384_get_precomputed();
+
+		if (precomp != NULL) {
+			if (!ecp_nistz384_scalar_bytes(group, p_str, g_scalar,
+			    ctx))
+				goto err;
+			ecp_nistz384_generator_mul(&p, precomp, p_str);
+			explicit_bzero(p_str, sizeof(p_str));
+		} else {
+			/*
+			 * Without the tables, the generator is multiplied
+			 * like any other point.
+			 */
+			if (!ecp_nistz384_windowed_mul(group, &p, g_scalar,
+			    generator, ctx))
+				goto err;
+		}
+	}
+
+	if (p_scalar != NULL) {
+		if (!ecp_nistz384_windowed_mul(group, &t, p_scalar, point, ctx))
+			goto err;
+		ecp_nistz384_point_add(&p, &p, &t);
+	}
+
+	/* Not constant-time, but we're only operating on the public output. */
+	if (!ecp_nistz384_set_words(&r->X, p.X) ||
+	    !ecp_nistz384_set_words(&r->Y, p.Y) ||
+	    !ecp_nistz384_set_words(&r->Z, p.Z))
+		goto err;
+	r->Z_is_one = is_equal(p.Z, ONE) & 1;
+
+	ret = 1;
+
+ err:
+	BN_CTX_end(ctx);
+	BN_CTX_free(new_ctx);
+	explicit_bzero(&p, sizeof(p));
+	explicit_bzero(&t, sizeof(t));
+
+	return ret;
+}
+
+static int
+ecp_nistz384_mul_generator_ct(const EC_GROUP *group, EC_POINT *r,
+    const BIGNUM *scalar, BN_CTX *ctx)
+{
+	return ecp_nistz384_points_mul(group, r, scalar, NULL, NULL, ctx);
+}
+
+static int
+ecp_nistz384_mul_single_ct(const EC_GROUP *group, EC_POINT *r,
+    const BIGNUM *scalar, const EC_POINT *point, BN_CTX *ctx)
+{
+	return ecp_nistz384_points_mul(group, r, NULL, scalar, point, ctx);
+}
+
+static int
+ecp_nistz384_mul_double_nonct(const EC_GROUP *group, EC_POINT *r,
+    const BIGNUM *g_scalar, const BIGNUM *p_scalar, const EC_POINT *point,
+    BN_CTX *ctx)
+{
+	return ecp_nistz384_points_mul(group, r, g_scalar, p_scalar, point,
+	    ctx);
+}
+
+static int
+ecp_nistz384_get_affine(const EC_GROUP *group, const EC_POINT *point,
+    BIGNUM *x, BIGNUM *y, BN_CTX *ctx)
+{
+	BN_ULONG z_inv2[P384_LIMBS];
+	BN_ULONG z_inv3[P384_LIMBS];
+	BN_ULONG point_x[P384_LIMBS], point_y[P384_LIMBS], point_z[P384_LIMBS];
+
+	if (EC_POINT_is_at_infinity(group, point)) {
+		ECerror(EC_R_POINT_AT_INFINITY);
+		return 0;
+	}
+
+	if (!ecp_nistz384_bignum_to_field_elem(point_x, &point->X) ||
+	    !ecp_nistz384_bignum_to_field_elem(point_y, &point->Y) ||
+	    !ecp_nistz384_bignum_to_field_elem(point_z, &point->Z)) {
+		ECerror(EC_R_COORDINATES_OUT_OF_RANGE);
+		return 0;
+	}
+
+	ecp_nistz384_mod_inverse(z_inv3, point_z);
+	ecp_nistz384_sqr_mont(z_inv2, z_inv3);
+
+	if (x != NULL) {
+		BN_ULONG x_aff[P384_LIMBS];
+		BN_ULONG x_ret[P384_LIMBS];
+
+		ecp_nistz384_mul_mont(x_aff, z_inv2, point_x);
+		ecp_nistz384_from_mont(x_ret, x_aff);
+		if (!ecp_nistz384_set_words(x, x_ret))
+			return 0;
+	}
+
+	if (y != NULL) {
+		BN_ULONG y_aff[P384_LIMBS];
+		BN_ULONG y_ret[P384_LIMBS];
+
+		ecp_nistz384_mul_mont(z_inv3, z_inv3, z_inv2);
+		ecp_nistz384_mul_mont(y_aff, z_inv3, point_y);
+		ecp_nistz384_from_mont(y_ret, y_aff);
+		if (!ecp_nistz384_set_words(y, y_ret))
+			return 0;
+	}
+
+	return 1;
+}
+
+static int
+ecp_nistz384_have_precompute_mult(const EC_GROUP *group)
+{
+	const EC_POINT *generator = EC_GROUP_get0_generator(group);
+
+	/* The tables for the default generator are built on first use. */
+	return generator != NULL && ecp_nistz384_is_affine_G(generator);
+}
+
+const EC_METHOD *
+EC_GFp_nistz384_method(void)
+{
+	static const EC_METHOD ret = {
+		.flags = EC_FLAGS_DEFAULT_OCT,
+		.field_type = NID_X9_62_prime_field,
+		.group_init = ec_GFp_mont_group_init,
+		.group_finish = ec_GFp_mont_group_finish,
+		.group_clear_finish = ec_GFp_mont_group_clear_finish,
+		.group_copy = ec_GFp_mont_group_copy,
+		.group_set_curve = ec_GFp_mont_group_set_curve,
+		.group_get_curve = ec_GFp_simple_group_get_curve,
+		.group_get_degree = ec_GFp_simple_group_get_degree,
+		.group_check_discriminant =
+		    ec_GFp_simple_group_check_discriminant,
+		.point_init = ec_GFp_simple_point_init,
+		.point_finish = ec_GFp_simple_point_finish,
+		.point_clear_finish = ec_GFp_simple_point_clear_finish,
+		.point_copy = ec_GFp_simple_point_copy,
+		.point_set_to_infinity = ec_GFp_simple_point_set_to_infinity,
+		.point_set_Jprojective_coordinates =
+		    ec_GFp_simple_set_Jprojective_coordinates,
+		.point_get_Jprojective_coordinates =
+		    ec_GFp_simple_get_Jprojective_coordinates,
+		.point_set_affine_coordinates =
+		    ec_GFp_simple_point_set_affine_coordinates,
+		.point_get_affine_coordinates = ecp_nistz384_get_affine,
+		.add = ec_GFp_simple_add,
+		.dbl = ec_GFp_simple_dbl,
+		.invert = ec_GFp_simple_invert,
+		.is_at_infinity = ec_GFp_simple_is_at_infinity,
+		.is_on_curve = ec_GFp_simple_is_on_curve,
+		.point_cmp = ec_GFp_simple_cmp,
+		.make_affine = ec_GFp_simple_make_affine,
+		.points_make_affine = ec_GFp_simple_points_make_affine,
+		.mul_generator_ct = ecp_nistz384_mul_generator_ct,
+		.mul_single_ct = ecp_nistz384_mul_single_ct,
+		.mul_double_nonct = ecp_nistz384_mul_double_nonct,
+		.have_precompute_mult = ecp_nistz384_have_precompute_mult,
+		.field_mul = ec_GFp_mont_field_mul,
+		.field_sqr = ec_GFp_mont_field_sqr,
+		.field_encode = ec_GFp_mont_field_encode,
+		.field_decode = ec_GFp_mont_field_decode,
+		.field_set_to_one = ec_GFp_mont_field_set_to_one,
+		.blind_coordinates = NULL,
+	};
+
+	return &ret;
+}
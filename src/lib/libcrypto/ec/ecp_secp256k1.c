@@ -0,0 +1,1257 @@
+/*	$OpenBSD$	*/
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * secp256k1 in the style of ecp_nistz384.c.
+ *
+ * Field elements are four 64-bit limbs in Montgomery form with R = 2^256,
+ * the representation the mont method uses for the coordinates of an
+ * EC_POINT, so points are converted by copying words.
+ *
+ * The curve has the endomorphism phi(x, y) = (beta x, y), which acts as
+ * multiplication by lambda, a cube root of unity modulo the order n. A
+ * scalar k is split into k1 + k2 lambda with k1 and k2 of at most 128 bits
+ * (GLV), so that k P = k1 P + k2 phi(P) needs half the doublings. Both
+ * halves are recoded into 26 signed radix 2^5 digits and use tables of
+ * the first 16 multiples of P and phi(P). The generator is multiplied with
+ * 52 tables of 16 affine points and no doublings; these are built on first
+ * use and kept for the life of the process. Every table lookup reads all
+ * entries.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/bn.h>
+#include <openssl/ec.h>
+#include <openssl/err.h>
+
+#include "bn_lcl.h"
+#include "ec_lcl.h"
+
+#if BN_BITS2 != 64 || !defined(__SIZEOF_INT128__)
+#error "ecp_secp256k1.c needs 64-bit limbs and a 128-bit integer type"
+#endif
+
+typedef __uint128_t uint128_t;
+
+#define	K1_LIMBS	(256 / BN_BITS2)
+#define	K1_WINDOWS	52	/* ceil((256 + 1) / 5) */
+#define	K1_GLV_WINDOWS	26	/* ceil((128 + 1) / 5) */
+
+typedef struct {
+	BN_ULONG X[K1_LIMBS];
+	BN_ULONG Y[K1_LIMBS];
+	BN_ULONG Z[K1_LIMBS];
+} K1_POINT;
+
+typedef struct {
+	BN_ULONG X[K1_LIMBS];
+	BN_ULONG Y[K1_LIMBS];
+} K1_POINT_AFFINE;
+
+typedef K1_POINT_AFFINE PRECOMPK1_ROW[16];
+
+/* p = 2^256 - 2^32 - 977 */
+static const BN_ULONG K1_P[K1_LIMBS] = {
+	0xfffffffefffffc2fULL, 0xffffffffffffffffULL, 0xffffffffffffffffULL,
+	0xffffffffffffffffULL,
+};
+
+/* p - 2, the exponent of the inversion */
+static const BN_ULONG K1_P_MINUS_2[K1_LIMBS] = {
+	0xfffffffefffffc2dULL, 0xffffffffffffffffULL, 0xffffffffffffffffULL,
+	0xffffffffffffffffULL,
+};
+
+/* -p^-1 mod 2^64 */
+#define	K1_P_N0		0xd838091dd2253531ULL
+
+/* R mod p, that is one in Montgomery form */
+static const BN_ULONG ONE[K1_LIMBS] = {
+	0x00000001000003d1ULL, 0x0000000000000000ULL, 0x0000000000000000ULL,
+	0x0000000000000000ULL,
+};
+
+/* Coordinates of the generator in Montgomery form */
+static const BN_ULONG def_xG[K1_LIMBS] = {
+	0xd7362e5a487e2097ULL, 0x231e295329bc66dbULL, 0x979f48c033fd129cULL,
+	0x9981e643e9089f48ULL,
+};
+
+static const BN_ULONG def_yG[K1_LIMBS] = {
+	0xb15ea6d2d3dbabe2ULL, 0x8dfc5d5d1f1dc64dULL, 0x70b6b59aac19c136ULL,
+	0xcf3f851fd4a582d6ULL,
+};
+
+/* beta, a cube root of unity modulo p, in Montgomery form */
+static const BN_ULONG K1_BETA[K1_LIMBS] = {
+	0x58a4361c8e81894eULL, 0x03fde1631c4b80afULL, 0xf8e98978d02e3905ULL,
+	0x7a4a36aebcbb3d53ULL,
+};
+
+/* The group order n */
+static const BN_ULONG K1_N[K1_LIMBS] = {
+	0xbfd25e8cd0364141ULL, 0xbaaedce6af48a03bULL, 0xfffffffffffffffeULL,
+	0xffffffffffffffffULL,
+};
+
+/* -n^-1 mod 2^64 */
+#define	K1_N_N0		0x4b0dff665588b13fULL
+
+/* (n - 1) / 2 */
+static const BN_ULONG K1_N_HALF[K1_LIMBS] = {
+	0xdfe92f46681b20a0ULL, 0x5d576e7357a4501dULL, 0xffffffffffffffffULL,
+	0x7fffffffffffffffULL,
+};
+
+/*
+ * The constants of the decomposition, from libsecp256k1: g1 and g2 are
+ * round(2^384 b2 / n) and round(2^384 (-b1) / n), the remaining ones are
+ * -b1, -b2 and lambda times R mod n, so that a Montgomery multiplication
+ * by them is a plain multiplication modulo n.
+ */
+static const BN_ULONG K1_G1[K1_LIMBS] = {
+	0xe893209a45dbb031ULL, 0x3daa8a1471e8ca7fULL, 0xe86c90e49284eb15ULL,
+	0x3086d221a7d46bcdULL,
+};
+
+static const BN_ULONG K1_G2[K1_LIMBS] = {
+	0x1571b4ae8ac47f71ULL, 0x221208ac9df506c6ULL, 0x6f547fa90abfe4c4ULL,
+	0xe4437ed6010e8828ULL,
+};
+
+static const BN_ULONG K1_MINUS_B1_R[K1_LIMBS] = {
+	0xc50468d00ad9263cULL, 0x1b1c8205faa6ed42ULL, 0x1571b4ae8ac47f71ULL,
+	0x221208ac9df506c6ULL,
+};
+
+static const BN_ULONG K1_MINUS_B2_R[K1_LIMBS] = {
+	0x0cac5e506a144696ULL, 0x1e8a8dc5f3ba5939ULL, 0x176cdf65ba244fceULL,
+	0xc25575eb8e173580ULL,
+};
+
+static const BN_ULONG K1_LAMBDA_R[K1_LIMBS] = {
+	0xf07deb3dc9926c9eULL, 0x2c93e7ad83c6944cULL, 0x73a9660652697d91ULL,
+	0x532840178558d639ULL,
+};
+
+static PRECOMPK1_ROW *ecp_secp256k1_precomputed;
+
+static void
+copy_conditional(BN_ULONG dst[K1_LIMBS], const BN_ULONG src[K1_LIMBS],
+    BN_ULONG move)
+{
+	BN_ULONG mask1 = 0 - move;
+	BN_ULONG mask2 = ~mask1;
+	int i;
+
+	for (i = 0; i < K1_LIMBS; i++)
+		dst[i] = (src[i] & mask1) ^ (dst[i] & mask2);
+}
+
+static BN_ULONG
+is_zero(BN_ULONG in)
+{
+	in |= (0 - in);
+	in = ~in;
+	in >>= BN_BITS2 - 1;
+	return in;
+}
+
+static BN_ULONG
+is_zero_felem(const BN_ULONG a[K1_LIMBS])
+{
+	BN_ULONG res = 0;
+	int i;
+
+	for (i = 0; i < K1_LIMBS; i++)
+		res |= a[i];
+
+	return is_zero(res);
+}
+
+static BN_ULONG
+is_equal(const BN_ULONG a[K1_LIMBS], const BN_ULONG b[K1_LIMBS])
+{
+	BN_ULONG res = 0;
+	int i;
+
+	for (i = 0; i < K1_LIMBS; i++)
+		res |= a[i] ^ b[i];
+
+	return is_zero(res);
+}
+
+/*
+ * Arithmetic modulo m, which is either p or n. All inputs are fully
+ * reduced and so are all results.
+ */
+
+/* res = a - m if that does not borrow past carry, a otherwise. */
+static void
+ecp_secp256k1_reduce_once(BN_ULONG res[K1_LIMBS], const BN_ULONG a[K1_LIMBS],
+    BN_ULONG carry, const BN_ULONG m[K1_LIMBS])
+{
+	BN_ULONG d[K1_LIMBS], borrow = 0, mask;
+	uint128_t t;
+	int i;
+
+	for (i = 0; i < K1_LIMBS; i++) {
+		t = (uint128_t)a[i] - m[i] - borrow;
+		d[i] = (BN_ULONG)t;
+		borrow = (BN_ULONG)(t >> 64) & 1;
+	}
+
+	mask = 0 - (borrow & (carry ^ 1));
+	for (i = 0; i < K1_LIMBS; i++)
+		res[i] = (a[i] & mask) | (d[i] & ~mask);
+}
+
+static void
+ecp_secp256k1_add_mod(BN_ULONG res[K1_LIMBS], const BN_ULONG a[K1_LIMBS],
+    const BN_ULONG b[K1_LIMBS], const BN_ULONG m[K1_LIMBS])
+{
+	BN_ULONG t[K1_LIMBS];
+	uint128_t c = 0;
+	int i;
+
+	for (i = 0; i < K1_LIMBS; i++) {
+		c += (uint128_t)a[i] + b[i];
+		t[i] = (BN_ULONG)c;
+		c >>= 64;
+	}
+
+	ecp_secp256k1_reduce_once(res, t, (BN_ULONG)c, m);
+}
+
+static void
+ecp_secp256k1_sub_mod(BN_ULONG res[K1_LIMBS], const BN_ULONG a[K1_LIMBS],
+    const BN_ULONG b[K1_LIMBS], const BN_ULONG m[K1_LIMBS])
+{
+	BN_ULONG t[K1_LIMBS], borrow = 0, mask;
+	uint128_t c;
+	int i;
+
+	for (i = 0; i < K1_LIMBS; i++) {
+		c = (uint128_t)a[i] - b[i] - borrow;
+		t[i] = (BN_ULONG)c;
+		borrow = (BN_ULONG)(c >> 64) & 1;
+	}
+
+	/* Add m back if the subtraction borrowed. */
+	mask = 0 - borrow;
+	c = 0;
+	for (i = 0; i < K1_LIMBS; i++) {
+		c += (uint128_t)t[i] + (m[i] & mask);
+		res[i] = (BN_ULONG)c;
+		c >>= 64;
+	}
+}
+
+/* res = a * b / R mod m */
+static void
+ecp_secp256k1_mul_mont_mod(BN_ULONG res[K1_LIMBS], const BN_ULONG a[K1_LIMBS],
+    const BN_ULONG b[K1_LIMBS], const BN_ULONG m[K1_LIMBS], BN_ULONG n0)
+{
+	BN_ULONG t[K1_LIMBS + 2], q, carry;
+	uint128_t uv;
+	int i, j;
+
+	memset(t, 0, sizeof(t));
+
+	for (i = 0; i < K1_LIMBS; i++) {
+		carry = 0;
+		for (j = 0; j < K1_LIMBS; j++) {
+			uv = (uint128_t)a[j] * b[i] + t[j] + carry;
+			t[j] = (BN_ULONG)uv;
+			carry = (BN_ULONG)(uv >> 64);
+		}
+		uv = (uint128_t)t[K1_LIMBS] + carry;
+		t[K1_LIMBS] = (BN_ULONG)uv;
+		t[K1_LIMBS + 1] = (BN_ULONG)(uv >> 64);
+
+		q = t[0] * n0;
+		uv = (uint128_t)q * m[0] + t[0];
+		carry = (BN_ULONG)(uv >> 64);
+		for (j = 1; j < K1_LIMBS; j++) {
+			uv = (uint128_t)q * m[j] + t[j] + carry;
+			t[j - 1] = (BN_ULONG)uv;
+			carry = (BN_ULONG)(uv >> 64);
+		}
+		uv = (uint128_t)t[K1_LIMBS] + carry;
+		t[K1_LIMBS - 1] = (BN_ULONG)uv;
+		t[K1_LIMBS] = t[K1_LIMBS + 1] + (BN_ULONG)(uv >> 64);
+	}
+
+	ecp_secp256k1_reduce_once(res, t, t[K1_LIMBS], m);
+}
+
+static void
+ecp_secp256k1_add(BN_ULONG res[K1_LIMBS], const BN_ULONG a[K1_LIMBS],
+    const BN_ULONG b[K1_LIMBS])
+{
+	ecp_secp256k1_add_mod(res, a, b, K1_P);
+}
+
+static void
+ecp_secp256k1_sub(BN_ULONG res[K1_LIMBS], const BN_ULONG a[K1_LIMBS],
+    const BN_ULONG b[K1_LIMBS])
+{
+	ecp_secp256k1_sub_mod(res, a, b, K1_P);
+}
+
+static void
+ecp_secp256k1_neg(BN_ULONG res[K1_LIMBS], const BN_ULONG a[K1_LIMBS])
+{
+	static const BN_ULONG zero[K1_LIMBS];
+
+	ecp_secp256k1_sub(res, zero, a);
+}
+
+static void
+ecp_secp256k1_mul_by_2(BN_ULONG res[K1_LIMBS], const BN_ULONG a[K1_LIMBS])
+{
+	ecp_secp256k1_add(res, a, a);
+}
+
+static void
+ecp_secp256k1_mul_mont(BN_ULONG res[K1_LIMBS], const BN_ULONG a[K1_LIMBS],
+    const BN_ULONG b[K1_LIMBS])
+{
+	ecp_secp256k1_mul_mont_mod(res, a, b, K1_P, K1_P_N0);
+}
+
+static void
+ecp_secp256k1_sqr_mont(BN_ULONG res[K1_LIMBS], const BN_ULONG a[K1_LIMBS])
+{
+	ecp_secp256k1_mul_mont(res, a, a);
+}
+
+static void
+ecp_secp256k1_from_mont(BN_ULONG res[K1_LIMBS], const BN_ULONG in[K1_LIMBS])
+{
+	static const BN_ULONG one[K1_LIMBS] = { 1 };
+
+	ecp_secp256k1_mul_mont(res, in, one);
+}
+
+/* r = in^-1 mod p, as in^(p - 2) with a fixed window of four bits. */
+static void
+ecp_secp256k1_mod_inverse(BN_ULONG r[K1_LIMBS], const BN_ULONG in[K1_LIMBS])
+{
+	BN_ULONG table[16][K1_LIMBS];
+	BN_ULONG res[K1_LIMBS];
+	unsigned int nibble;
+	int i, j;
+
+	memcpy(table[0], ONE, sizeof(table[0]));
+	memcpy(table[1], in, sizeof(table[1]));
+	for (i = 2; i < 16; i++)
+		ecp_secp256k1_mul_mont(table[i], table[i - 1], in);
+
+	/* The exponent is public, so it may be used as an index. */
+	memcpy(res, ONE, sizeof(res));
+	for (i = 256 - 4; i >= 0; i -= 4) {
+		for (j = 0; j < 4; j++)
+			ecp_secp256k1_sqr_mont(res, res);
+		nibble = (K1_P_MINUS_2[i / 64] >> (i % 64)) & 0xf;
+		ecp_secp256k1_mul_mont(res, res, table[nibble]);
+	}
+
+	memcpy(r, res, sizeof(res));
+}
+
+/* res = round(a * b / 2^384), for the decomposition. */
+static void
+ecp_secp256k1_mul_shift_384(BN_ULONG res[K1_LIMBS],
+    const BN_ULONG a[K1_LIMBS], const BN_ULONG b[K1_LIMBS])
+{
+	BN_ULONG t[2 * K1_LIMBS], carry;
+	uint128_t uv;
+	int i, j;
+
+	memset(t, 0, sizeof(t));
+
+	for (i = 0; i < K1_LIMBS; i++) {
+		carry = 0;
+		for (j = 0; j < K1_LIMBS; j++) {
+			uv = (uint128_t)a[j] * b[i] + t[i + j] + carry;
+			t[i + j] = (BN_ULONG)uv;
+			carry = (BN_ULONG)(uv >> 64);
+		}
+		t[i + K1_LIMBS] = carry;
+	}
+
+	/* Round with bit 383. The result has at most 129 bits. */
+	uv = (uint128_t)t[6] + (t[5] >> 63);
+	res[0] = (BN_ULONG)uv;
+	res[1] = t[7] + (BN_ULONG)(uv >> 64);
+	res[2] = 0;
+	res[3] = 0;
+}
+
+/*
+ * Make a scalar modulo n of at most 128 bits in absolute value positive,
+ * setting *sign to one if it was negated.
+ */
+static void
+ecp_secp256k1_scalar_abs(BN_ULONG k[K1_LIMBS], BN_ULONG *sign)
+{
+	static const BN_ULONG zero[K1_LIMBS];
+	BN_ULONG t[K1_LIMBS], borrow = 0;
+	uint128_t c;
+	int i;
+
+	/* Negative if it exceeds (n - 1) / 2. */
+	for (i = 0; i < K1_LIMBS; i++) {
+		c = (uint128_t)K1_N_HALF[i] - k[i] - borrow;
+		borrow = (BN_ULONG)(c >> 64) & 1;
+	}
+
+	ecp_secp256k1_sub_mod(t, zero, k, K1_N);
+	copy_conditional(k, t, borrow);
+	*sign = borrow;
+}
+
+/*
+ * Split the scalar k < n into k1 + k2 lambda mod n, with k1 and k2 of at
+ * most 128 bits, returned as their absolute values and signs.
+ */
+static void
+ecp_secp256k1_split(BN_ULONG k1[K1_LIMBS], BN_ULONG *sign1,
+    BN_ULONG k2[K1_LIMBS], BN_ULONG *sign2, const BN_ULONG k[K1_LIMBS])
+{
+	static const BN_ULONG zero[K1_LIMBS];
+	BN_ULONG c1[K1_LIMBS], c2[K1_LIMBS];
+
+	ecp_secp256k1_mul_shift_384(c1, k, K1_G1);
+	ecp_secp256k1_mul_shift_384(c2, k, K1_G2);
+	ecp_secp256k1_mul_mont_mod(c1, c1, K1_MINUS_B1_R, K1_N, K1_N_N0);
+	ecp_secp256k1_mul_mont_mod(c2, c2, K1_MINUS_B2_R, K1_N, K1_N_N0);
+
+	/* k2 = c1 (-b1) + c2 (-b2), k1 = k - k2 lambda */
+	ecp_secp256k1_add_mod(k2, c1, c2, K1_N);
+	ecp_secp256k1_mul_mont_mod(k1, k2, K1_LAMBDA_R, K1_N, K1_N_N0);
+	ecp_secp256k1_sub_mod(k1, zero, k1, K1_N);
+	ecp_secp256k1_add_mod(k1, k1, k, K1_N);
+
+	ecp_secp256k1_scalar_abs(k1, sign1);
+	ecp_secp256k1_scalar_abs(k2, sign2);
+
+	explicit_bzero(c1, sizeof(c1));
+	explicit_bzero(c2, sizeof(c2));
+}
+
+static void
+ecp_secp256k1_scalar_to_bytes(unsigned char p_str[33],
+    const BN_ULONG k[K1_LIMBS])
+{
+	BN_ULONG d;
+	int i, j;
+
+	for (i = 0; i < K1_LIMBS; i++) {
+		d = k[i];
+		for (j = 0; j < BN_BYTES; j++) {
+			p_str[i * BN_BYTES + j] = d & 0xff;
+			d >>= 8;
+		}
+	}
+	p_str[32] = 0;
+}
+
+/*
+ * Recode the window of six bits b_(5j + 4) ... b_(5j - 1) into the signed
+ * digit b_(5j - 1) + b_(5j) + 2 b_(5j + 1) + 4 b_(5j + 2) + 8 b_(5j + 3) -
+ * 16 b_(5j + 4), returning its absolute value (0 .. 16) and setting *sign
+ * to one if it is negative.
+ */
+static unsigned int
+ecp_secp256k1_recode(unsigned int in, unsigned int *sign)
+{
+	unsigned int s, d, mask;
+
+	s = in >> 5;
+	d = (in + 1) >> 1;
+	mask = 0 - s;
+	*sign = s;
+
+	return (d & ~mask) | ((32 - d) & mask);
+}
+
+/* The window of digit j of a scalar of 33 little endian bytes. */
+static unsigned int
+ecp_secp256k1_window(const unsigned char p_str[33], unsigned int j)
+{
+	unsigned int index = 5 * j, off, wvalue;
+
+	if (j == 0)
+		return (p_str[0] << 1) & 0x3f;
+
+	off = (index - 1) / 8;
+	wvalue = p_str[off] | p_str[off + 1] << 8;
+
+	return (wvalue >> ((index - 1) % 8)) & 0x3f;
+}
+
+/* val = in_t[index - 1], or zero if index is 0, touching every entry. */
+static void
+ecp_secp256k1_select_w5(K1_POINT *val, const K1_POINT in_t[16],
+    unsigned int index)
+{
+	BN_ULONG mask;
+	int i, j;
+
+	memset(val, 0, sizeof(*val));
+	for (i = 0; i < 16; i++) {
+		mask = 0 - is_zero((BN_ULONG)((i + 1) ^ index));
+		for (j = 0; j < K1_LIMBS; j++) {
+			val->X[j] |= in_t[i].X[j] & mask;
+			val->Y[j] |= in_t[i].Y[j] & mask;
+			val->Z[j] |= in_t[i].Z[j] & mask;
+		}
+	}
+}
+
+static void
+ecp_secp256k1_select_affine_w5(K1_POINT_AFFINE *val,
+    const K1_POINT_AFFINE in_t[16], unsigned int index)
+{
+	BN_ULONG mask;
+	int i, j;
+
+	memset(val, 0, sizeof(*val));
+	for (i = 0; i < 16; i++) {
+		mask = 0 - is_zero((BN_ULONG)((i + 1) ^ index));
+		for (j = 0; j < K1_LIMBS; j++) {
+			val->X[j] |= in_t[i].X[j] & mask;
+			val->Y[j] |= in_t[i].Y[j] & mask;
+		}
+	}
+}
+
+/* Point double: r = 2*a, with a = 0. */
+static void
+ecp_secp256k1_point_double(K1_POINT *r, const K1_POINT *a)
+{
+	BN_ULONG A[K1_LIMBS], B[K1_LIMBS], C[K1_LIMBS], D[K1_LIMBS];
+	BN_ULONG E[K1_LIMBS], t0[K1_LIMBS];
+	BN_ULONG res_x[K1_LIMBS], res_y[K1_LIMBS], res_z[K1_LIMBS];
+
+	ecp_secp256k1_sqr_mont(A, a->X);		/* A = X^2 */
+	ecp_secp256k1_sqr_mont(B, a->Y);		/* B = Y^2 */
+	ecp_secp256k1_sqr_mont(C, B);			/* C = B^2 */
+
+	ecp_secp256k1_add(t0, a->X, B);
+	ecp_secp256k1_sqr_mont(t0, t0);
+	ecp_secp256k1_sub(t0, t0, A);
+	ecp_secp256k1_sub(t0, t0, C);
+	ecp_secp256k1_mul_by_2(D, t0);			/* D = 2*((X+B)^2-A-C) */
+
+	ecp_secp256k1_mul_by_2(E, A);
+	ecp_secp256k1_add(E, E, A);			/* E = 3*A */
+
+	ecp_secp256k1_mul_mont(res_z, a->Y, a->Z);
+	ecp_secp256k1_mul_by_2(res_z, res_z);		/* Z3 = 2*Y*Z */
+
+	ecp_secp256k1_sqr_mont(res_x, E);
+	ecp_secp256k1_mul_by_2(t0, D);
+	ecp_secp256k1_sub(res_x, res_x, t0);		/* X3 = E^2-2*D */
+
+	ecp_secp256k1_sub(t0, D, res_x);
+	ecp_secp256k1_mul_mont(res_y, E, t0);
+	ecp_secp256k1_mul_by_2(C, C);
+	ecp_secp256k1_mul_by_2(C, C);
+	ecp_secp256k1_mul_by_2(C, C);
+	ecp_secp256k1_sub(res_y, res_y, C);		/* Y3 = E*(D-X3)-8*C */
+
+	memcpy(r->X, res_x, sizeof(res_x));
+	memcpy(r->Y, res_y, sizeof(res_y));
+	memcpy(r->Z, res_z, sizeof(res_z));
+}
+
+/* Point addition: r = a+b */
+static void
+ecp_secp256k1_point_add(K1_POINT *r, const K1_POINT *a, const K1_POINT *b)
+{
+	BN_ULONG U2[K1_LIMBS], S2[K1_LIMBS];
+	BN_ULONG U1[K1_LIMBS], S1[K1_LIMBS];
+	BN_ULONG Z1sqr[K1_LIMBS], Z2sqr[K1_LIMBS];
+	BN_ULONG H[K1_LIMBS], R[K1_LIMBS];
+	BN_ULONG Hsqr[K1_LIMBS], Rsqr[K1_LIMBS], Hcub[K1_LIMBS];
+	BN_ULONG res_x[K1_LIMBS], res_y[K1_LIMBS], res_z[K1_LIMBS];
+	BN_ULONG in1infty, in2infty;
+	const BN_ULONG *in1_x = a->X, *in1_y = a->Y, *in1_z = a->Z;
+	const BN_ULONG *in2_x = b->X, *in2_y = b->Y, *in2_z = b->Z;
+
+	/* Infinity is encoded as (,,0). */
+	in1infty = is_zero_felem(in1_z);
+	in2infty = is_zero_felem(in2_z);
+
+	ecp_secp256k1_sqr_mont(Z2sqr, in2_z);		/* Z2^2 */
+	ecp_secp256k1_sqr_mont(Z1sqr, in1_z);		/* Z1^2 */
+
+	ecp_secp256k1_mul_mont(S1, Z2sqr, in2_z);	/* S1 = Z2^3 */
+	ecp_secp256k1_mul_mont(S2, Z1sqr, in1_z);	/* S2 = Z1^3 */
+
+	ecp_secp256k1_mul_mont(S1, S1, in1_y);		/* S1 = Y1*Z2^3 */
+	ecp_secp256k1_mul_mont(S2, S2, in2_y);		/* S2 = Y2*Z1^3 */
+	ecp_secp256k1_sub(R, S2, S1);			/* R = S2 - S1 */
+
+	ecp_secp256k1_mul_mont(U1, in1_x, Z2sqr);	/* U1 = X1*Z2^2 */
+	ecp_secp256k1_mul_mont(U2, in2_x, Z1sqr);	/* U2 = X2*Z1^2 */
+	ecp_secp256k1_sub(H, U2, U1);			/* H = U2 - U1 */
+
+	/*
+	 * The formulae are incorrect if the points are equal, in which case
+	 * double instead. Points at infinity are handled at the end.
+	 */
+	if (is_equal(U1, U2) && !in1infty && !in2infty) {
+		if (is_equal(S1, S2)) {
+			ecp_secp256k1_point_double(r, a);
+			return;
+		}
+		memset(r, 0, sizeof(*r));
+		return;
+	}
+
+	ecp_secp256k1_sqr_mont(Rsqr, R);		/* R^2 */
+	ecp_secp256k1_mul_mont(res_z, H, in1_z);	/* Z3 = H*Z1*Z2 */
+	ecp_secp256k1_sqr_mont(Hsqr, H);		/* H^2 */
+	ecp_secp256k1_mul_mont(res_z, res_z, in2_z);	/* Z3 = H*Z1*Z2 */
+	ecp_secp256k1_mul_mont(Hcub, Hsqr, H);		/* H^3 */
+
+	ecp_secp256k1_mul_mont(U2, U1, Hsqr);		/* U1*H^2 */
+	ecp_secp256k1_mul_by_2(Hsqr, U2);		/* 2*U1*H^2 */
+
+	ecp_secp256k1_sub(res_x, Rsqr, Hsqr);
+	ecp_secp256k1_sub(res_x, res_x, Hcub);
+
+	ecp_secp256k1_sub(res_y, U2, res_x);
+
+	ecp_secp256k1_mul_mont(S2, S1, Hcub);
+	ecp_secp256k1_mul_mont(res_y, R, res_y);
+	ecp_secp256k1_sub(res_y, res_y, S2);
+
+	copy_conditional(res_x, in2_x, in1infty);
+	copy_conditional(res_y, in2_y, in1infty);
+	copy_conditional(res_z, in2_z, in1infty);
+
+	copy_conditional(res_x, in1_x, in2infty);
+	copy_conditional(res_y, in1_y, in2infty);
+	copy_conditional(res_z, in1_z, in2infty);
+
+	memcpy(r->X, res_x, sizeof(res_x));
+	memcpy(r->Y, res_y, sizeof(res_y));
+	memcpy(r->Z, res_z, sizeof(res_z));
+}
+
+/* Point addition when b is known to be affine: r = a+b */
+static void
+ecp_secp256k1_point_add_affine(K1_POINT *r, const K1_POINT *a,
+    const K1_POINT_AFFINE *b)
+{
+	BN_ULONG U2[K1_LIMBS], S2[K1_LIMBS];
+	BN_ULONG Z1sqr[K1_LIMBS];
+	BN_ULONG H[K1_LIMBS], R[K1_LIMBS];
+	BN_ULONG Hsqr[K1_LIMBS], Rsqr[K1_LIMBS], Hcub[K1_LIMBS];
+	BN_ULONG res_x[K1_LIMBS], res_y[K1_LIMBS], res_z[K1_LIMBS];
+	BN_ULONG in1infty, in2infty;
+	const BN_ULONG *in1_x = a->X, *in1_y = a->Y, *in1_z = a->Z;
+	const BN_ULONG *in2_x = b->X, *in2_y = b->Y;
+
+	/*
+	 * Infinity is encoded as (,,0) in Jacobian form and as (0,0) in
+	 * affine form, the latter not being on the curve.
+	 */
+	in1infty = is_zero_felem(in1_z);
+	in2infty = is_zero_felem(in2_x) & is_zero_felem(in2_y);
+
+	ecp_secp256k1_sqr_mont(Z1sqr, in1_z);		/* Z1^2 */
+
+	ecp_secp256k1_mul_mont(U2, in2_x, Z1sqr);	/* U2 = X2*Z1^2 */
+	ecp_secp256k1_sub(H, U2, in1_x);		/* H = U2 - U1 */
+
+	ecp_secp256k1_mul_mont(S2, Z1sqr, in1_z);	/* S2 = Z1^3 */
+
+	ecp_secp256k1_mul_mont(res_z, H, in1_z);	/* Z3 = H*Z1*Z2 */
+
+	ecp_secp256k1_mul_mont(S2, S2, in2_y);		/* S2 = Y2*Z1^3 */
+	ecp_secp256k1_sub(R, S2, in1_y);		/* R = S2 - S1 */
+
+	if (is_equal(U2, in1_x) && !in1infty && !in2infty) {
+		if (is_equal(S2, in1_y)) {
+			ecp_secp256k1_point_double(r, a);
+			return;
+		}
+		memset(r, 0, sizeof(*r));
+		return;
+	}
+
+	ecp_secp256k1_sqr_mont(Hsqr, H);		/* H^2 */
+	ecp_secp256k1_sqr_mont(Rsqr, R);		/* R^2 */
+	ecp_secp256k1_mul_mont(Hcub, Hsqr, H);		/* H^3 */
+
+	ecp_secp256k1_mul_mont(U2, in1_x, Hsqr);	/* U1*H^2 */
+	ecp_secp256k1_mul_by_2(Hsqr, U2);		/* 2*U1*H^2 */
+
+	ecp_secp256k1_sub(res_x, Rsqr, Hsqr);
+	ecp_secp256k1_sub(res_x, res_x, Hcub);
+	ecp_secp256k1_sub(H, U2, res_x);
+
+	ecp_secp256k1_mul_mont(S2, in1_y, Hcub);
+	ecp_secp256k1_mul_mont(H, H, R);
+	ecp_secp256k1_sub(res_y, H, S2);
+
+	copy_conditional(res_x, in2_x, in1infty);
+	copy_conditional(res_x, in1_x, in2infty);
+
+	copy_conditional(res_y, in2_y, in1infty);
+	copy_conditional(res_y, in1_y, in2infty);
+
+	copy_conditional(res_z, ONE, in1infty);
+	copy_conditional(res_z, in1_z, in2infty);
+
+	memcpy(r->X, res_x, sizeof(res_x));
+	memcpy(r->Y, res_y, sizeof(res_y));
+	memcpy(r->Z, res_z, sizeof(res_z));
+}
+
+/* Negate the Y coordinates of a table of points if sign is one. */
+static void
+ecp_secp256k1_table_neg(K1_POINT table[16], BN_ULONG sign)
+{
+	BN_ULONG tmp[K1_LIMBS];
+	int i;
+
+	for (i = 0; i < 16; i++) {
+		ecp_secp256k1_neg(tmp, table[i].Y);
+		copy_conditional(table[i].Y, tmp, sign);
+	}
+}
+
+/* r = k*a, for a scalar k < n, as k1*a + k2*phi(a). */
+static void
+ecp_secp256k1_glv_mul(K1_POINT *r, const BN_ULONG k[K1_LIMBS],
+    const K1_POINT *a)
+{
+	K1_POINT table1[16], table2[16], h;
+	BN_ULONG k1[K1_LIMBS], k2[K1_LIMBS], sign1, sign2;
+	BN_ULONG tmp[K1_LIMBS];
+	unsigned char s1[33], s2[33];
+	unsigned int digit, sign;
+	int i;
+
+	ecp_secp256k1_split(k1, &sign1, k2, &sign2, k);
+	ecp_secp256k1_scalar_to_bytes(s1, k1);
+	ecp_secp256k1_scalar_to_bytes(s2, k2);
+
+	/*
+	 * table1[i - 1] holds i*a and table2[i - 1] holds i*phi(a), the
+	 * point at infinity is implicit. The tables are negated where the
+	 * decomposition produced negative halves.
+	 */
+	table1[0] = *a;
+	for (i = 2; i <= 16; i++) {
+		if (i % 2 == 0)
+			ecp_secp256k1_point_double(&table1[i - 1],
+			    &table1[i / 2 - 1]);
+		else
+			ecp_secp256k1_point_add(&table1[i - 1], &table1[i - 2],
+			    &table1[0]);
+	}
+	for (i = 0; i < 16; i++) {
+		ecp_secp256k1_mul_mont(table2[i].X, table1[i].X, K1_BETA);
+		memcpy(table2[i].Y, table1[i].Y, sizeof(table2[i].Y));
+		memcpy(table2[i].Z, table1[i].Z, sizeof(table2[i].Z));
+	}
+	ecp_secp256k1_table_neg(table1, sign1);
+	ecp_secp256k1_table_neg(table2, sign2);
+
+	digit = ecp_secp256k1_recode(ecp_secp256k1_window(s1,
+	    K1_GLV_WINDOWS - 1), &sign);
+	ecp_secp256k1_select_w5(r, table1, digit);
+	digit = ecp_secp256k1_recode(ecp_secp256k1_window(s2,
+	    K1_GLV_WINDOWS - 1), &sign);
+	ecp_secp256k1_select_w5(&h, table2, digit);
+	ecp_secp256k1_point_add(r, r, &h);
+
+	for (i = K1_GLV_WINDOWS - 2; i >= 0; i--) {
+		ecp_secp256k1_point_double(r, r);
+		ecp_secp256k1_point_double(r, r);
+		ecp_secp256k1_point_double(r, r);
+		ecp_secp256k1_point_double(r, r);
+		ecp_secp256k1_point_double(r, r);
+
+		digit = ecp_secp256k1_recode(ecp_secp256k1_window(s1, i),
+		    &sign);
+		ecp_secp256k1_select_w5(&h, table1, digit);
+		ecp_secp256k1_neg(tmp, h.Y);
+		copy_conditional(h.Y, tmp, sign);
+		ecp_secp256k1_point_add(r, r, &h);
+
+		digit = ecp_secp256k1_recode(ecp_secp256k1_window(s2, i),
+		    &sign);
+		ecp_secp256k1_select_w5(&h, table2, digit);
+		ecp_secp256k1_neg(tmp, h.Y);
+		copy_conditional(h.Y, tmp, sign);
+		ecp_secp256k1_point_add(r, r, &h);
+	}
+
+	explicit_bzero(k1, sizeof(k1));
+	explicit_bzero(k2, sizeof(k2));
+	explicit_bzero(s1, sizeof(s1));
+	explicit_bzero(s2, sizeof(s2));
+	explicit_bzero(table1, sizeof(table1));
+	explicit_bzero(table2, sizeof(table2));
+	explicit_bzero(&h, sizeof(h));
+}
+
+/*
+ * Build the tables for the generator, in which row j holds the first 16
+ * multiples of 2^(5j) G. The multiples are computed in Jacobian form and
+ * made affine with a single inversion.
+ */
+static PRECOMPK1_ROW *
+ecp_secp256k1_precompute(void)
+{
+	PRECOMPK1_ROW *precomp = NULL;
+	K1_POINT *points = NULL;
+	BN_ULONG (*prod)[K1_LIMBS] = NULL;
+	BN_ULONG inv[K1_LIMBS], zinv[K1_LIMBS], zinv2[K1_LIMBS];
+	const size_t n = K1_WINDOWS * 16;
+	size_t i, j;
+
+	if ((precomp = reallocarray(NULL, K1_WINDOWS,
+	    sizeof(PRECOMPK1_ROW))) == NULL)
+		goto err;
+	if ((points = reallocarray(NULL, n, sizeof(K1_POINT))) == NULL)
+		goto err;
+	if ((prod = reallocarray(NULL, n, sizeof(*prod))) == NULL)
+		goto err;
+
+	memcpy(points[0].X, def_xG, sizeof(def_xG));
+	memcpy(points[0].Y, def_yG, sizeof(def_yG));
+	memcpy(points[0].Z, ONE, sizeof(ONE));
+
+	for (i = 0; i < K1_WINDOWS; i++) {
+		K1_POINT *row = &points[16 * i];
+
+		if (i > 0)
+			ecp_secp256k1_point_double(&row[0], &row[-1]);
+		ecp_secp256k1_point_double(&row[1], &row[0]);
+		for (j = 2; j < 16; j++)
+			ecp_secp256k1_point_add(&row[j], &row[j - 1], &row[0]);
+	}
+
+	/* None of the multiples is the point at infinity. */
+	memcpy(prod[0], points[0].Z, sizeof(prod[0]));
+	for (i = 1; i < n; i++)
+		ecp_secp256k1_mul_mont(prod[i], prod[i - 1], points[i].Z);
+
+	ecp_secp256k1_mod_inverse(inv, prod[n - 1]);
+
+	for (i = n - 1; i > 0; i--) {
+		ecp_secp256k1_mul_mont(zinv, inv, prod[i - 1]);
+		ecp_secp256k1_mul_mont(inv, inv, points[i].Z);
+		memcpy(prod[i], zinv, sizeof(zinv));
+	}
+	memcpy(prod[0], inv, sizeof(inv));
+
+	for (i = 0; i < n; i++) {
+		K1_POINT_AFFINE *out = &precomp[i / 16][i % 16];
+
+		ecp_secp256k1_sqr_mont(zinv2, prod[i]);
+		ecp_secp256k1_mul_mont(out->X, points[i].X, zinv2);
+		ecp_secp256k1_mul_mont(zinv2, zinv2, prod[i]);
+		ecp_secp256k1_mul_mont(out->Y, points[i].Y, zinv2);
+	}
+
+	free(points);
+	free(prod);
+
+	return precomp;
+
+ err:
+	ECerror(ERR_R_MALLOC_FAILURE);
+	free(precomp);
+	free(points);
+	free(prod);
+
+	return NULL;
+}
+
+static const PRECOMPK1_ROW *
+ecp_secp256k1_get_precomputed(void)
+{
+	PRECOMPK1_ROW *precomp;
+
+	if ((precomp = ecp_secp256k1_precomputed) != NULL)
+		return precomp;
+
+	if ((precomp = ecp_secp256k1_precompute()) == NULL)
+		return NULL;
+	if (!__sync_bool_compare_and_swap(&ecp_secp256k1_precomputed, NULL,
+	    precomp)) {
+		/* Another thread got there first. */
+		free(precomp);
+		precomp = ecp_secp256k1_precomputed;
+	}
+
+	return precomp;
+}
+
+/* r = scalar*G, with the tables for the standard generator */
+static void
+ecp_secp256k1_generator_mul(K1_POINT *r, const PRECOMPK1_ROW *precomp,
+    const unsigned char p_str[33])
+{
+	K1_POINT_AFFINE t;
+	BN_ULONG tmp[K1_LIMBS];
+	unsigned int digit, sign;
+	int i;
+
+	memset(r, 0, sizeof(*r));
+
+	for (i = 0; i < K1_WINDOWS; i++) {
+		digit = ecp_secp256k1_recode(ecp_secp256k1_window(p_str, i),
+		    &sign);
+		ecp_secp256k1_select_affine_w5(&t, precomp[i], digit);
+
+		ecp_secp256k1_neg(tmp, t.Y);
+		copy_conditional(t.Y, tmp, sign);
+
+		ecp_secp256k1_point_add_affine(r, r, &t);
+	}
+
+	explicit_bzero(&t, sizeof(t));
+}
+
+/*
+ * ecp_secp256k1_bignum_to_field_elem copies the contents of |in| to |out|
+ * and returns one if it fits. Otherwise it returns zero.
+ */
+static int
+ecp_secp256k1_bignum_to_field_elem(BN_ULONG out[K1_LIMBS], const BIGNUM *in)
+{
+	if (in->top > K1_LIMBS)
+		return 0;
+
+	memset(out, 0, sizeof(BN_ULONG) * K1_LIMBS);
+	memcpy(out, in->d, sizeof(BN_ULONG) * in->top);
+	return 1;
+}
+
+static int
+ecp_secp256k1_set_words(BIGNUM *a, const BN_ULONG words[K1_LIMBS])
+{
+	if (bn_wexpand(a, K1_LIMBS) == NULL) {
+		ECerror(ERR_R_MALLOC_FAILURE);
+		return 0;
+	}
+
+	memcpy(a->d, words, sizeof(BN_ULONG) * K1_LIMBS);
+	a->top = K1_LIMBS;
+	bn_correct_top(a);
+	return 1;
+}
+
+/*
+ * Copy a scalar into k and reduce it modulo n. If it is negative or has
+ * more than 256 bits, it is first reduced with BN_nnmod. This is an unusual
+ * input, for which we don't guarantee constant-timeness.
+ */
+static int
+ecp_secp256k1_scalar_words(const EC_GROUP *group, BN_ULONG k[K1_LIMBS],
+    const BIGNUM *scalar, BN_CTX *ctx)
+{
+	BIGNUM *mod;
+
+	if (BN_num_bits(scalar) > 256 || BN_is_negative(scalar)) {
+		if ((mod = BN_CTX_get(ctx)) == NULL)
+			return 0;
+		if (!BN_nnmod(mod, scalar, &group->order, ctx)) {
+			ECerror(ERR_R_BN_LIB);
+			return 0;
+		}
+		scalar = mod;
+	}
+
+	if (!ecp_secp256k1_bignum_to_field_elem(k, scalar))
+		return 0;
+	ecp_secp256k1_reduce_once(k, k, 0, K1_N);
+
+	return 1;
+}
+
+/* r = scalar*point */
+static int
+ecp_secp256k1_windowed_mul(const EC_GROUP *group, K1_POINT *r,
+    const BIGNUM *scalar, const EC_POINT *point, BN_CTX *ctx)
+{
+	K1_POINT a;
+	BN_ULONG k[K1_LIMBS];
+
+	if (!ecp_secp256k1_scalar_words(group, k, scalar, ctx))
+		return 0;
+
+	if (!ecp_secp256k1_bignum_to_field_elem(a.X, &point->X) ||
+	    !ecp_secp256k1_bignum_to_field_elem(a.Y, &point->Y) ||
+	    !ecp_secp256k1_bignum_to_field_elem(a.Z, &point->Z)) {
+		ECerror(EC_R_COORDINATES_OUT_OF_RANGE);
+		return 0;
+	}
+
+	ecp_secp256k1_glv_mul(r, k, &a);
+
+	explicit_bzero(k, sizeof(k));
+
+	return 1;
+}
+
+/*
+ * ecp_secp256k1_is_affine_G returns one if |generator| is the standard
+ * secp256k1 generator.
+ */
+static int
+ecp_secp256k1_is_affine_G(const EC_POINT *generator)
+{
+	BN_ULONG x[K1_LIMBS], y[K1_LIMBS], z[K1_LIMBS];
+
+	if (!ecp_secp256k1_bignum_to_field_elem(x, &generator->X) ||
+	    !ecp_secp256k1_bignum_to_field_elem(y, &generator->Y) ||
+	    !ecp_secp256k1_bignum_to_field_elem(z, &generator->Z))
+		return 0;
+
+	return is_equal(x, def_xG) & is_equal(y, def_yG) & is_equal(z, ONE);
+}
+
+/* r = g_scalar*G + p_scalar*point */
+static int
+ecp_secp256k1_points_mul(const EC_GROUP *group, EC_POINT *r,
+    const BIGNUM *g_scalar, const BIGNUM *p_scalar, const EC_POINT *point,
+    BN_CTX *ctx)
+{
+	BN_CTX *new_ctx = NULL;
+	const PRECOMPK1_ROW *precomp = NULL;
+	const EC_POINT *generator = NULL;
+	BN_ULONG k[K1_LIMBS];
+	unsigned char p_str[33];
+	K1_POINT p, t;
+	int ret = 0;
+
+	if (point != NULL && group->meth != point->meth) {
+		ECerror(EC_R_INCOMPATIBLE_OBJECTS);
+		return 0;
+	}
+
+	if (ctx == NULL) {
+		if ((ctx = new_ctx = BN_CTX_new()) == NULL)
+			return 0;
+	}
+
+	BN_CTX_start(ctx);
+
+	/* The point at infinity. */
+	memset(&p, 0, sizeof(p));
+	memset(&t, 0, sizeof(t));
+
+	if (g_scalar != NULL) {
+		if ((generator = EC_GROUP_get0_generator(group)) == NULL) {
+			ECerror(EC_R_UNDEFINED_GENERATOR);
+			goto err;
+		}
+		if (ecp_secp256k1_is_affine_G(generator))
+			precomp = ecp_secp256k1_get_precomputed();
+
+		if (precomp != NULL) {
+			if (!ecp_secp256k1_scalar_words(group, k, g_scalar,
+			    ctx))
+				goto err;
+			ecp_secp256k1_scalar_to_bytes(p_str, k);
+			ecp_secp256k1_generator_mul(&p, precomp, p_str);
+			explicit_bzero(k, sizeof(k));
+			explicit_bzero(p_str, sizeof(p_str));
+		} else {
+			/*
+			 * Without the tables, the generator is multiplied
+			 * like any other point.
+			 */
+			if (!ecp_secp256k1_windowed_mul(group, &p, g_scalar,
+			    generator, ctx))
+				goto err;
+		}
+	}
+
+	if (p_scalar != NULL) {
+		if (!ecp_secp256k1_windowed_mul(group, &t, p_scalar, point,
+		    ctx))
+			goto err;
+		ecp_secp256k1_point_add(&p, &p, &t);
+	}
+
+	/* Not constant-time, but we're only operating on the public output. */
+	if (!ecp_secp256k1_set_words(&r->X, p.X) ||
+	    !ecp_secp256k1_set_words(&r->Y, p.Y) ||
+	    !ecp_secp256k1_set_words(&r->Z, p.Z))
+		goto err;
+	r->Z_is_one = is_equal(p.Z, ONE) & 1;
+
+	ret = 1;
+
+ err:
+	BN_CTX_end(ctx);
+	BN_CTX_free(new_ctx);
+	explicit_bzero(&p, sizeof(p));
+	explicit_bzero(&t, sizeof(t));
+
+	return ret;
+}
+
+static int
+ecp_secp256k1_mul_generator_ct(const EC_GROUP *group, EC_POINT *r,
+    const BIGNUM *scalar, BN_CTX *ctx)
+{
+	return ecp_secp256k1_points_mul(group, r, scalar, NULL, NULL, ctx);
+}
+
+static int
+ecp_secp256k1_mul_single_ct(const EC_GROUP *group, EC_POINT *r,
+    const BIGNUM *scalar, const EC_POINT *point, BN_CTX *ctx)
+{
+	return ecp_secp256k1_points_mul(group, r, NULL, scalar, point, ctx);
+}
+
+/*
+ * Used by ECDSA_do_verify() and ECDSA_verify_batch() through EC_POINT_mul(),
+ * which hand it the affine public keys.
+ */
+static int
+ecp_secp256k1_mul_double_nonct(const EC_GROUP *group, EC_POINT *r,
+    const BIGNUM *g_scalar, const BIGNUM *p_scalar, const EC_POINT *point,
+    BN_CTX *ctx)
+{
+	return ecp_secp256k1_points_mul(group, r, g_scalar, p_scalar, point,
+	    ctx);
+}
+
+static int
+ecp_secp256k1_get_affine(const EC_GROUP *group, const EC_POINT *point,
+    BIGNUM *x, BIGNUM *y, BN_CTX *ctx)
+{
+	BN_ULONG z_inv2[K1_LIMBS];
+	BN_ULONG z_inv3[K1_LIMBS];
+	BN_ULONG point_x[K1_LIMBS], point_y[K1_LIMBS], point_z[K1_LIMBS];
+
+	if (EC_POINT_is_at_infinity(group, point)) {
+		ECerror(EC_R_POINT_AT_INFINITY);
+		return 0;
+	}
+
+	if (!ecp_secp256k1_bignum_to_field_elem(point_x, &point->X) ||
+	    !ecp_secp256k1_bignum_to_field_elem(point_y, &point->Y) ||
+	    !ecp_secp256k1_bignum_to_field_elem(point_z, &point->Z)) {
+		ECerror(EC_R_COORDINATES_OUT_OF_RANGE);
+		return 0;
+	}
+
+	ecp_secp256k1_mod_inverse(z_inv3, point_z);
+	ecp_secp256k1_sqr_mont(z_inv2, z_inv3);
+
+	if (x != NULL) {
+		BN_ULONG x_aff[K1_LIMBS];
+		BN_ULONG x_ret[K1_LIMBS];
+
+		ecp_secp256k1_mul_mont(x_aff, z_inv2, point_x);
+		ecp_secp256k1_from_mont(x_ret, x_aff);
+		if (!ecp_secp256k1_set_words(x, x_ret))
+			return 0;
+	}
+
+	if (y != NULL) {
+		BN_ULONG y_aff[K1_LIMBS];
+		BN_ULONG y_ret[K1_LIMBS];
+
+		ecp_secp256k1_mul_mont(z_inv3, z_inv3, z_inv2);
+		ecp_secp256k1_mul_mont(y_aff, z_inv3, point_y);
+		ecp_secp256k1_from_mont(y_ret, y_aff);
+		if (!ecp_secp256k1_set_words(y, y_ret))
+			return 0;
+	}
+
+	return 1;
+}
+
+static int
+ecp_secp256k1_have_precompute_mult(const EC_GROUP *group)
+{
+	const EC_POINT *generator = EC_GROUP_get0_generator(group);
+
+	/* The tables for the default generator are built on first use. */
+	return generator != NULL && ecp_secp256k1_is_affine_G(generator);
+}
+
+const EC_METHOD *
+EC_GFp_secp256k1_method(void)
+{
+	static const EC_METHOD ret = {
+		.flags = EC_FLAGS_DEFAULT_OCT,
+		.field_type = NID_X9_62_prime_field,
+		.group_init = ec_GFp_mont_group_init,
+		.group_finish = ec_GFp_mont_group_finish,
+		.group_clear_finish = ec_GFp_mont_group_clear_finish,
+		.group_copy = ec_GFp_mont_group_copy,
+		.group_set_curve = ec_GFp_mont_group_set_curve,
+		.group_get_curve = ec_GFp_simple_group_get_curve,
+		.group_get_degree = ec_GFp_simple_group_get_degree,
+		.group_check_discriminant =
+		    ec_GFp_simple_group_check_discriminant,
+		.point_init = ec_GFp_simple_point_init,
+		.point_finish = ec_GFp_simple_point_finish,
+		.point_clear_finish = ec_GFp_simple_point_clear_finish,
+		.point_copy = ec_GFp_simple_point_copy,
+		.point_set_to_infinity = ec_GFp_simple_point_set_to_infinity,
+		.point_set_Jprojective_coordinates =
+		    ec_GFp_simple_set_Jprojective_coordinates,
+		.point_get_Jprojective_coordinates =
+		    ec_GFp_simple_get_Jprojective_coordinates,
+		.point_set_affine_coordinates =
+		    ec_GFp_simple_point_set_affine_coordinates,
+		.point_get_affine_coordinates = ecp_secp256k1_get_affine,
+		.add = ec_GFp_simple_add,
+		.dbl = ec_GFp_simple_dbl,
+		.invert = ec_GFp_simple_invert,
+		.is_at_infinity = ec_GFp_simple_is_at_infinity,
+		.is_on_curve = ec_GFp_simple_is_on_curve,
+		.point_cmp = ec_GFp_simple_cmp,
+		.make_affine = ec_GFp_simple_make_affine,
+		.points_make_affine = ec_GFp_simple_points_make_affine,
+		.mul_generator_ct = ecp_secp256k1_mul_generator_ct,
+		.mul_single_ct = ecp_secp256k1_mul_single_ct,
+		.mul_double_nonct = ecp_secp256k1_mul_double_nonct,
+		.have_precompute_mult = ecp_secp256k1_have_precompute_mult,
+		.field_mul = ec_GFp_mont_field_mul,
+		.field_sqr = ec_GFp_mont_field_sqr,
+		.field_encode = ec_GFp_mont_field_encode,
+		.field_decode = ec_GFp_mont_field_decode,
+		.field_set_to_one = ec_GFp_mont_field_set_to_one,
+		.blind_coordinates = NULL,
+	};
+
+	return &ret;
+}
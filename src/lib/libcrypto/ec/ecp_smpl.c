@@ -1705,6 +1705,11 @@ int
 ec_GFp_simple_mul_generator_ct(const EC_GROUP *group, EC_POINT *r,
     const BIGNUM *scalar, BN_CTX *ctx)
 {
+	const EC_COMB *comb;
+
+	if ((comb = ec_comb_get(group, ctx)) != NULL)
+		return ec_comb_mul_ct(group, comb, r, scalar, ctx);
+
 	return ec_GFp_simple_mul_ct(group, r, scalar, NULL, ctx);
 }
 
@@ -65,18 +65,20 @@
 #include <openssl/err.h>
 #include <openssl/ecdh.h>
 
+#include "cryptlib.h"
+
 /* BEGIN ERROR CODES */
 #ifndef OPENSSL_NO_ERR
 
 #define ERR_FUNC(func) ERR_PACK(ERR_LIB_ECDH,func,0)
 #define ERR_REASON(reason) ERR_PACK(ERR_LIB_ECDH,0,reason)
 
-static ERR_STRING_DATA ECDH_str_functs[]= {
+static const ERR_STRING_DATA ECDH_str_functs[]= {
 	{ERR_FUNC(0xfff), "CRYPTO_internal"},
 	{0, NULL}
 };
 
-static ERR_STRING_DATA ECDH_str_reasons[]= {
+static const ERR_STRING_DATA ECDH_str_reasons[]= {
 	{ERR_REASON(ECDH_R_KDF_FAILED)           , "KDF failed"},
 	{ERR_REASON(ECDH_R_KEY_TRUNCATION), "key would be truncated"},
 	{ERR_REASON(ECDH_R_NON_FIPS_METHOD)      , "non fips method"},
@@ -92,8 +94,8 @@ ERR_load_ECDH_strings(void)
 {
 #ifndef OPENSSL_NO_ERR
 	if (ERR_func_error_string(ECDH_str_functs[0].error) == NULL) {
-		ERR_load_strings(0, ECDH_str_functs);
-		ERR_load_strings(0, ECDH_str_reasons);
+		ERR_load_const_strings(ECDH_str_functs);
+		ERR_load_const_strings(ECDH_str_reasons);
 	}
 #endif
 }
@@ -182,6 +182,22 @@ ECDSA_SIG *ECDSA_do_sign_ex(const unsigned char *dgst, int dgstlen,
 int ECDSA_do_verify(const unsigned char *dgst, int dgst_len,
     const ECDSA_SIG *sig, EC_KEY* eckey);
 
+/** Verifies a batch of ECDSA signatures, sharing the work between
+ *  signatures whose keys are over the same curve.
+ *  \param  num        number of signatures
+ *  \param  dgsts      hash values
+ *  \param  dgst_lens  lengths of the hash values
+ *  \param  sigs       ECDSA_SIG structures
+ *  \param  eckeys     EC_KEY objects containing public EC keys
+ *  \param  results    if not NULL, receives the result of ECDSA_do_verify
+ *                     for each signature
+ *  \return 1 if all signatures are valid, 0 if one is invalid and -1 on
+ *          error
+ */
+int ECDSA_verify_batch(size_t num, const unsigned char *const *dgsts,
+    const int *dgst_lens, const ECDSA_SIG *const *sigs,
+    EC_KEY *const *eckeys, int *results);
+
 const ECDSA_METHOD *ECDSA_OpenSSL(void);
 
 /** Sets the default ECDSA method
@@ -65,18 +65,20 @@
 #include <openssl/err.h>
 #include <openssl/ecdsa.h>
 
+#include "cryptlib.h"
+
 /* BEGIN ERROR CODES */
 #ifndef OPENSSL_NO_ERR
 
 #define ERR_FUNC(func) ERR_PACK(ERR_LIB_ECDSA,func,0)
 #define ERR_REASON(reason) ERR_PACK(ERR_LIB_ECDSA,0,reason)
 
-static ERR_STRING_DATA ECDSA_str_functs[]= {
+static const ERR_STRING_DATA ECDSA_str_functs[]= {
 	{ERR_FUNC(0xfff), "CRYPTO_internal"},
 	{0, NULL}
 };
 
-static ERR_STRING_DATA ECDSA_str_reasons[]= {
+static const ERR_STRING_DATA ECDSA_str_reasons[]= {
 	{ERR_REASON(ECDSA_R_BAD_SIGNATURE)       , "bad signature"},
 	{ERR_REASON(ECDSA_R_DATA_TOO_LARGE_FOR_KEY_SIZE), "data too large for key size"},
 	{ERR_REASON(ECDSA_R_ERR_EC_LIB)          , "err ec lib"},
@@ -95,8 +97,8 @@ ERR_load_ECDSA_strings(void)
 {
 #ifndef OPENSSL_NO_ERR
 	if (ERR_func_error_string(ECDSA_str_functs[0].error) == NULL) {
-		ERR_load_strings(0, ECDSA_str_functs);
-		ERR_load_strings(0, ECDSA_str_reasons);
+		ERR_load_const_strings(ECDSA_str_functs);
+		ERR_load_const_strings(ECDSA_str_reasons);
 	}
 #endif
 }
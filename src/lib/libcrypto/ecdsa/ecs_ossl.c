@@ -56,6 +56,7 @@
  *
  */
 
+#include <stdlib.h>
 #include <string.h>
 
 #include <openssl/opensslconf.h>
@@ -65,6 +66,7 @@
 #include <openssl/bn.h>
 
 #include "bn_lcl.h"
+#include "ec_lcl.h"
 #include "ecs_locl.h"
 
 static int ecdsa_prepare_digest(const unsigned char *dgst, int dgst_len,
@@ -143,7 +145,7 @@ ecdsa_sign_setup(EC_KEY *eckey, BN_CTX *ctx_in, BIGNUM **kinvp, BIGNUM **rp)
 	}
 
 	if (ctx == NULL) {
-		if ((ctx = BN_CTX_new()) == NULL) {
+		if ((ctx = BN_CTX_get_thread_default()) == NULL) {
 			ECDSAerror(ERR_R_MALLOC_FAILURE);
 			return 0;
 		}
@@ -278,7 +280,7 @@ ecdsa_do_sign(const unsigned char *dgst, int dgst_len,
 	}
 	s = ret->s;
 
-	if ((ctx = BN_CTX_new()) == NULL || (order = BN_new()) == NULL ||
+	if ((ctx = BN_CTX_get_thread_default()) == NULL || (order = BN_new()) == NULL ||
 	    (range = BN_new()) == NULL || (b = BN_new()) == NULL ||
 	    (binv = BN_new()) == NULL || (bm = BN_new()) == NULL ||
 	    (bxr = BN_new()) == NULL || (m = BN_new()) == NULL) {
@@ -454,7 +456,7 @@ ecdsa_do_verify(const unsigned char *dgst, int dgst_len, const ECDSA_SIG *sig,
 		return -1;
 	}
 
-	if ((ctx = BN_CTX_new()) == NULL) {
+	if ((ctx = BN_CTX_get_thread_default()) == NULL) {
 		ECDSAerror(ERR_R_MALLOC_FAILURE);
 		return -1;
 	}
@@ -505,7 +507,7 @@ ecdsa_do_verify(const unsigned char *dgst, int dgst_len, const ECDSA_SIG *sig,
 		ECDSAerror(ERR_R_MALLOC_FAILURE);
 		goto err;
 	}
-	if (!EC_POINT_mul(group, point, u1, pub_key, u2, ctx)) {
+	if (!ec_wNAF_mul_key(eckey, point, u1, u2, ctx)) {
 		ECDSAerror(ERR_R_EC_LIB);
 		goto err;
 	}
@@ -539,3 +541,271 @@ ossl_ecdsa_verify_sig(const unsigned char *dgst, int dgst_len,
 		return 0;
 	return ecdsa->meth->ecdsa_do_verify(dgst, dgst_len, sig, eckey);
 }
+
+/*
+ * Verify a batch of signatures whose keys share a group. The inverses of
+ * all s are obtained from a single inversion modulo the order, and the
+ * points are made affine with a single field inversion.
+ */
+static void
+ecdsa_verify_batch_group(const EC_GROUP *group, const size_t *idx,
+    size_t num, const unsigned char *const *dgsts, const int *dgst_lens,
+    const ECDSA_SIG *const *sigs, EC_KEY *const *eckeys, int *results,
+    BN_CTX *ctx)
+{
+	BIGNUM *order, *u1, *u2, *m, *w;
+	BIGNUM **prod = NULL;
+	EC_POINT **points = NULL;
+	const ECDSA_SIG *sig;
+	size_t *valid = NULL;
+	size_t i, j, n = 0;
+
+	for (i = 0; i < num; i++)
+		results[idx[i]] = -1;
+
+	BN_CTX_start(ctx);
+	order = BN_CTX_get(ctx);
+	u1 = BN_CTX_get(ctx);
+	u2 = BN_CTX_get(ctx);
+	m = BN_CTX_get(ctx);
+	w = BN_CTX_get(ctx);
+	if (w == NULL) {
+		ECDSAerror(ERR_R_BN_LIB);
+		goto err;
+	}
+
+	if (!EC_GROUP_get_order(group, order, ctx)) {
+		ECDSAerror(ERR_R_EC_LIB);
+		goto err;
+	}
+
+	if ((prod = calloc(num, sizeof(*prod))) == NULL ||
+	    (points = calloc(num, sizeof(*points))) == NULL ||
+	    (valid = reallocarray(NULL, num, sizeof(*valid))) == NULL) {
+		ECDSAerror(ERR_R_MALLOC_FAILURE);
+		goto err;
+	}
+
+	/* Check the ranges and accumulate the products of the s values. */
+	for (i = 0; i < num; i++) {
+		if ((sig = sigs[idx[i]]) == NULL) {
+			ECDSAerror(ECDSA_R_MISSING_PARAMETERS);
+			continue;
+		}
+
+		/* Verify that r and s are in the range [1, order-1]. */
+		if (BN_is_zero(sig->r) || BN_is_negative(sig->r) ||
+		    BN_ucmp(sig->r, order) >= 0 ||
+		    BN_is_zero(sig->s) || BN_is_negative(sig->s) ||
+		    BN_ucmp(sig->s, order) >= 0) {
+			ECDSAerror(ECDSA_R_BAD_SIGNATURE);
+			results[idx[i]] = 0;
+			continue;
+		}
+
+		if ((prod[n] = BN_new()) == NULL) {
+			ECDSAerror(ERR_R_MALLOC_FAILURE);
+			goto err;
+		}
+		if (n == 0) {
+			if (BN_copy(prod[n], sig->s) == NULL) {
+				ECDSAerror(ERR_R_BN_LIB);
+				goto err;
+			}
+		} else if (!BN_mod_mul(prod[n], prod[n - 1], sig->s, order,
+		    ctx)) {
+			ECDSAerror(ERR_R_BN_LIB);
+			goto err;
+		}
+		valid[n++] = idx[i];
+	}
+	if (n == 0)
+		goto err;
+
+	if (!BN_mod_inverse_ct(w, prod[n - 1], order, ctx)) {
+		ECDSAerror(ERR_R_BN_LIB);
+		goto err;
+	}
+
+	/* Walk back, peeling off one inverse of s at a time. */
+	for (i = n; i-- > 0; ) {
+		j = valid[i];
+		sig = sigs[j];
+
+		if (i > 0) {
+			if (!BN_mod_mul(u2, w, prod[i - 1], order, ctx) ||
+			    !BN_mod_mul(w, w, sig->s, order, ctx)) {
+				ECDSAerror(ERR_R_BN_LIB);
+				goto err;
+			}
+		} else if (BN_copy(u2, w) == NULL) {
+			ECDSAerror(ERR_R_BN_LIB);
+			goto err;
+		}
+
+		if (!ecdsa_prepare_digest(dgsts[j], dgst_lens[j], order, m))
+			goto err;
+		if (!BN_mod_mul(u1, m, u2, order, ctx)) {	/* u1 = mw */
+			ECDSAerror(ERR_R_BN_LIB);
+			goto err;
+		}
+		if (!BN_mod_mul(u2, sig->r, u2, order, ctx)) {	/* u2 = rw */
+			ECDSAerror(ERR_R_BN_LIB);
+			goto err;
+		}
+
+		if ((points[i] = EC_POINT_new(group)) == NULL) {
+			ECDSAerror(ERR_R_MALLOC_FAILURE);
+			goto err;
+		}
+		if (!ec_wNAF_mul_key(eckeys[j], points[i], u1, u2, ctx)) {
+			ECDSAerror(ERR_R_EC_LIB);
+			goto err;
+		}
+	}
+
+	if (!EC_POINTs_make_affine(group, n, points, ctx)) {
+		ECDSAerror(ERR_R_EC_LIB);
+		goto err;
+	}
+
+	for (i = 0; i < n; i++) {
+		j = valid[i];
+
+		if (!EC_POINT_get_affine_coordinates(group, points[i], m, NULL,
+		    ctx)) {
+			ECDSAerror(ERR_R_EC_LIB);
+			continue;
+		}
+		if (!BN_nnmod(u1, m, order, ctx)) {
+			ECDSAerror(ERR_R_BN_LIB);
+			continue;
+		}
+
+		/* If the signature is correct, the x-coordinate is r. */
+		results[j] = (BN_ucmp(u1, sigs[j]->r) == 0);
+	}
+
+ err:
+	if (prod != NULL) {
+		for (i = 0; i < num; i++)
+			BN_free(prod[i]);
+	}
+	if (points != NULL) {
+		for (i = 0; i < num; i++)
+			EC_POINT_free(points[i]);
+	}
+	free(prod);
+	free(points);
+	free(valid);
+	BN_CTX_end(ctx);
+}
+
+/*
+ * Returns one if the signatures of eckey can be verified in a batch, that
+ * is they would otherwise be verified by ecdsa_do_verify().
+ */
+static int
+ecdsa_verify_batchable(EC_KEY *eckey)
+{
+	ECDSA_DATA *ecdsa;
+
+	if (EC_KEY_get0_group(eckey) == NULL ||
+	    EC_KEY_get0_public_key(eckey) == NULL)
+		return 0;
+	if (eckey->meth->verify_sig != ossl_ecdsa_verify_sig)
+		return 0;
+	if ((ecdsa = ecdsa_check(eckey)) == NULL)
+		return 0;
+
+	return ecdsa->meth->ecdsa_do_verify == ecdsa_do_verify;
+}
+
+int
+ECDSA_verify_batch(size_t num, const unsigned char *const *dgsts,
+    const int *dgst_lens, const ECDSA_SIG *const *sigs,
+    EC_KEY *const *eckeys, int *results)
+{
+	BN_CTX *ctx = NULL;
+	const EC_GROUP *group, *other;
+	int *res = results;
+	size_t *idx = NULL;
+	size_t i, j, n;
+	int ret = -1;
+
+	if (num == 0)
+		return 1;
+
+	if (res == NULL && (res = reallocarray(NULL, num,
+	    sizeof(*res))) == NULL) {
+		ECDSAerror(ERR_R_MALLOC_FAILURE);
+		goto err;
+	}
+	if ((idx = reallocarray(NULL, num, sizeof(*idx))) == NULL) {
+		ECDSAerror(ERR_R_MALLOC_FAILURE);
+		goto err;
+	}
+	if ((ctx = BN_CTX_get_thread_default()) == NULL) {
+		ECDSAerror(ERR_R_MALLOC_FAILURE);
+		goto err;
+	}
+
+	/* -2 marks a signature that has not been looked at yet. */
+	for (i = 0; i < num; i++)
+		res[i] = -2;
+
+	for (i = 0; i < num; i++) {
+		if (res[i] != -2)
+			continue;
+		if (eckeys[i] == NULL) {
+			ECDSAerror(ECDSA_R_MISSING_PARAMETERS);
+			res[i] = -1;
+			continue;
+		}
+		if (!ecdsa_verify_batchable(eckeys[i])) {
+			res[i] = ECDSA_do_verify(dgsts[i], dgst_lens[i],
+			    sigs[i], eckeys[i]);
+			continue;
+		}
+
+		/* Collect the remaining signatures over the same group. */
+		group = EC_KEY_get0_group(eckeys[i]);
+		n = 0;
+		for (j = i; j < num; j++) {
+			if (res[j] != -2 || eckeys[j] == NULL)
+				continue;
+			other = EC_KEY_get0_group(eckeys[j]);
+			if (other != group) {
+				if (other == NULL ||
+				    EC_GROUP_method_of(other) !=
+				    EC_GROUP_method_of(group) ||
+				    EC_GROUP_cmp(group, other, ctx) != 0)
+					continue;
+			}
+			if (!ecdsa_verify_batchable(eckeys[j]))
+				continue;
+			idx[n++] = j;
+		}
+
+		ecdsa_verify_batch_group(group, idx, n, dgsts, dgst_lens, sigs,
+		    eckeys, res, ctx);
+	}
+
+	ret = 1;
+	for (i = 0; i < num; i++) {
+		if (res[i] < 0) {
+			ret = -1;
+			break;
+		}
+		if (res[i] == 0)
+			ret = 0;
+	}
+
+ err:
+	BN_CTX_free(ctx);
+	free(idx);
+	if (res != results)
+		free(res);
+
+	return ret;
+}
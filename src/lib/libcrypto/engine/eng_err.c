@@ -65,18 +65,20 @@
 #include <openssl/err.h>
 #include <openssl/engine.h>
 
+#include "cryptlib.h"
+
 /* BEGIN ERROR CODES */
 #ifndef OPENSSL_NO_ERR
 
 #define ERR_FUNC(func) ERR_PACK(ERR_LIB_ENGINE,func,0)
 #define ERR_REASON(reason) ERR_PACK(ERR_LIB_ENGINE,0,reason)
 
-static ERR_STRING_DATA ENGINE_str_functs[] = {
+static const ERR_STRING_DATA ENGINE_str_functs[] = {
 	{ERR_FUNC(0xfff), "CRYPTO_internal"},
 	{0, NULL}
 };
 
-static ERR_STRING_DATA ENGINE_str_reasons[] = {
+static const ERR_STRING_DATA ENGINE_str_reasons[] = {
 	{ERR_REASON(ENGINE_R_ALREADY_LOADED)     , "already loaded"},
 	{ERR_REASON(ENGINE_R_ARGUMENT_IS_NOT_A_NUMBER), "argument is not a number"},
 	{ERR_REASON(ENGINE_R_CMD_NOT_EXECUTABLE) , "cmd not executable"},
@@ -128,8 +130,8 @@ ERR_load_ENGINE_strings(void)
 {
 #ifndef OPENSSL_NO_ERR
 	if (ERR_func_error_string(ENGINE_str_functs[0].error) == NULL) {
-		ERR_load_strings(0, ENGINE_str_functs);
-		ERR_load_strings(0, ENGINE_str_reasons);
+		ERR_load_const_strings(ENGINE_str_functs);
+		ERR_load_const_strings(ENGINE_str_reasons);
 	}
 #endif
 }
@@ -86,6 +86,13 @@ typedef struct st_engine_pile_doall {
 /* Global flags (ENGINE_TABLE_FLAG_***). */
 static unsigned int table_flags = 0;
 
+/*
+ * Set once an ENGINE has registered an implementation in any table, which
+ * most programs never do. Until then there is nothing to select and lookups
+ * return without taking CRYPTO_LOCK_ENGINE.
+ */
+static int table_registered = 0;
+
 /* API function manipulating 'table_flags' */
 unsigned int
 ENGINE_get_table_flags(void)
@@ -170,6 +177,7 @@ engine_table_register(ENGINE_TABLE **table, ENGINE_CLEANUP_CB *cleanup,
 			goto end;
 		/* "touch" this ENGINE_PILE */
 		fnd->uptodate = 0;
+		__atomic_store_n(&table_registered, 1, __ATOMIC_RELEASE);
 		if (setdefault) {
 			if (!engine_unlocked_init(e)) {
 				ENGINEerror(ENGINE_R_INIT_FAILED);
@@ -251,7 +259,8 @@ engine_table_select_tmp(ENGINE_TABLE **table, int nid, const char *f, int l)
 	ENGINE_PILE tmplate, *fnd = NULL;
 	int initres, loop = 0;
 
-	if (!(*table)) {
+	if (!__atomic_load_n(&table_registered, __ATOMIC_ACQUIRE) ||
+	    !(*table)) {
 #ifdef ENGINE_TABLE_DEBUG
 		fprintf(stderr, "engine_table_dbg: %s:%d, nid=%d, nothing "
 		    "registered!\n", f, l, nid);
@@ -122,14 +122,17 @@
 #include <openssl/err.h>
 #include <openssl/lhash.h>
 
+#include "cryptlib.h"
+
 DECLARE_LHASH_OF(ERR_STRING_DATA);
 DECLARE_LHASH_OF(ERR_STATE);
 
 static void err_load_strings(int lib, ERR_STRING_DATA *str);
+static void err_load_const_strings(const ERR_STRING_DATA *str);
 
 static void ERR_STATE_free(ERR_STATE *s);
 #ifndef OPENSSL_NO_ERR
-static ERR_STRING_DATA ERR_str_libraries[] = {
+static const ERR_STRING_DATA ERR_str_libraries[] = {
 	{ERR_PACK(ERR_LIB_NONE,0,0),		"unknown library"},
 	{ERR_PACK(ERR_LIB_SYS,0,0),		"system library"},
 	{ERR_PACK(ERR_LIB_BN,0,0),		"bignum routines"},
@@ -162,21 +165,21 @@ static ERR_STRING_DATA ERR_str_libraries[] = {
 	{0, NULL},
 };
 
-static ERR_STRING_DATA ERR_str_functs[] = {
-	{ERR_PACK(0,SYS_F_FOPEN, 0),     	"fopen"},
-	{ERR_PACK(0,SYS_F_CONNECT, 0),		"connect"},
-	{ERR_PACK(0,SYS_F_GETSERVBYNAME, 0),	"getservbyname"},
-	{ERR_PACK(0,SYS_F_SOCKET, 0),		"socket"},
-	{ERR_PACK(0,SYS_F_IOCTLSOCKET, 0),	"ioctl"},
-	{ERR_PACK(0,SYS_F_BIND, 0),		"bind"},
-	{ERR_PACK(0,SYS_F_LISTEN, 0),		"listen"},
-	{ERR_PACK(0,SYS_F_ACCEPT, 0),		"accept"},
-	{ERR_PACK(0,SYS_F_OPENDIR, 0),		"opendir"},
-	{ERR_PACK(0,SYS_F_FREAD, 0),		"fread"},
+static const ERR_STRING_DATA ERR_str_functs[] = {
+	{ERR_PACK(ERR_LIB_SYS,SYS_F_FOPEN,0),	"fopen"},
+	{ERR_PACK(ERR_LIB_SYS,SYS_F_CONNECT,0),	"connect"},
+	{ERR_PACK(ERR_LIB_SYS,SYS_F_GETSERVBYNAME,0),	"getservbyname"},
+	{ERR_PACK(ERR_LIB_SYS,SYS_F_SOCKET,0),	"socket"},
+	{ERR_PACK(ERR_LIB_SYS,SYS_F_IOCTLSOCKET,0),	"ioctl"},
+	{ERR_PACK(ERR_LIB_SYS,SYS_F_BIND,0),	"bind"},
+	{ERR_PACK(ERR_LIB_SYS,SYS_F_LISTEN,0),	"listen"},
+	{ERR_PACK(ERR_LIB_SYS,SYS_F_ACCEPT,0),	"accept"},
+	{ERR_PACK(ERR_LIB_SYS,SYS_F_OPENDIR,0),	"opendir"},
+	{ERR_PACK(ERR_LIB_SYS,SYS_F_FREAD,0),	"fread"},
 	{0, NULL},
 };
 
-static ERR_STRING_DATA ERR_str_reasons[] = {
+static const ERR_STRING_DATA ERR_str_reasons[] = {
 	{ERR_R_SYS_LIB,				"system lib"},
 	{ERR_R_BN_LIB,				"BN lib"},
 	{ERR_R_RSA_LIB,				"RSA lib"},
@@ -283,6 +286,17 @@ static LHASH_OF(ERR_STATE) *int_thread_hash = NULL;
 static int int_thread_hash_references = 0;
 static int int_err_library_number = ERR_LIB_USER;
 
+/*
+ * The error strings of the libraries built into libcrypto are constant
+ * tables that are searched in place, so loading them neither allocates nor
+ * touches the hash above.  Each library has room for its function and
+ * reason tables.  Strings loaded with ERR_load_strings() still go into the
+ * hash and are looked up first.
+ */
+#define ERR_NUM_CONST_TABLES 2
+
+static const ERR_STRING_DATA *err_const_tables[ERR_LIB_USER][ERR_NUM_CONST_TABLES];
+
 static pthread_t err_init_thread;
 
 /* Internal function that checks whether "err_fns" is set and if not, sets it to
@@ -329,6 +343,7 @@ ERR_set_implementation(const ERR_FNS *fns)
 
 static unsigned long get_error_values(int inc, int top, const char **file,
     int *line, const char **data, int *flags);
+static ERR_STATE *err_state_get(int create);
 
 /* The internal functions used in the "err_defaults" implementation */
 
@@ -596,7 +611,7 @@ build_SYS_str_reasons(void)
 	for (i = 1; i <= NUM_SYS_STR_REASONS; i++) {
 		ERR_STRING_DATA *str = &SYS_str_reasons[i - 1];
 
-		str->error = (unsigned long)i;
+		str->error = ERR_PACK(ERR_LIB_SYS, 0, i);
 		if (str->string == NULL) {
 			char (*dest)[LEN_SYS_STR_REASON] =
 			    &(strerror_tab[i - 1]);
@@ -611,7 +626,7 @@ build_SYS_str_reasons(void)
 	}
 
 	/* Now we still have SYS_str_reasons[NUM_SYS_STR_REASONS] = {0, NULL},
-	 * as required by ERR_load_strings. */
+	 * as required by ERR_load_const_strings. */
 
 	init = 0;
 
@@ -658,11 +673,11 @@ ERR_load_ERR_strings_internal(void)
 	err_init_thread = pthread_self();
 	err_fns_check();
 #ifndef OPENSSL_NO_ERR
-	err_load_strings(0, ERR_str_libraries);
-	err_load_strings(0, ERR_str_reasons);
-	err_load_strings(ERR_LIB_SYS, ERR_str_functs);
+	/* ERR_str_libraries is searched directly by err_const_get_item(). */
+	err_load_const_strings(ERR_str_reasons);
+	err_load_const_strings(ERR_str_functs);
 	build_SYS_str_reasons();
-	err_load_strings(ERR_LIB_SYS, SYS_str_reasons);
+	err_load_const_strings(SYS_str_reasons);
 #endif
 }
 
@@ -699,6 +714,97 @@ ERR_load_strings(int lib, ERR_STRING_DATA *str)
 	err_load_strings(lib, str);
 }
 
+static void
+err_load_const_strings(const ERR_STRING_DATA *str)
+{
+	const ERR_STRING_DATA **tables;
+	unsigned long lib;
+	int i;
+
+	if (str->error == 0)
+		return;
+
+	lib = ERR_GET_LIB(str->error);
+	if (lib >= ERR_LIB_USER) {
+		err_load_strings(0, (ERR_STRING_DATA *)str);
+		return;
+	}
+
+	tables = err_const_tables[lib];
+
+	CRYPTO_w_lock(CRYPTO_LOCK_ERR);
+	for (i = 0; i < ERR_NUM_CONST_TABLES; i++) {
+		if (tables[i] == NULL)
+			tables[i] = str;
+		if (tables[i] == str)
+			break;
+	}
+	CRYPTO_w_unlock(CRYPTO_LOCK_ERR);
+
+	/* Out of slots, fall back to the hash. */
+	if (i == ERR_NUM_CONST_TABLES)
+		err_load_strings(0, (ERR_STRING_DATA *)str);
+}
+
+void
+ERR_load_const_strings(const ERR_STRING_DATA *str)
+{
+	ERR_load_ERR_strings();
+	err_load_const_strings(str);
+}
+
+static const ERR_STRING_DATA *
+err_const_get_item(unsigned long e)
+{
+	const ERR_STRING_DATA *str;
+	unsigned long lib;
+	int i;
+
+	lib = ERR_GET_LIB(e);
+	if (lib >= ERR_LIB_USER)
+		return NULL;
+
+#ifndef OPENSSL_NO_ERR
+	if (ERR_GET_FUNC(e) == 0 && ERR_GET_REASON(e) == 0) {
+		for (str = ERR_str_libraries; str->error != 0; str++) {
+			if (str->error == e)
+				return str;
+		}
+	}
+#endif
+
+	CRYPTO_r_lock(CRYPTO_LOCK_ERR);
+	for (i = 0; i < ERR_NUM_CONST_TABLES; i++) {
+		if (err_const_tables[lib][i] == NULL)
+			break;
+		for (str = err_const_tables[lib][i]; str->error != 0; str++) {
+			if (str->error == e) {
+				CRYPTO_r_unlock(CRYPTO_LOCK_ERR);
+				return str;
+			}
+		}
+	}
+	CRYPTO_r_unlock(CRYPTO_LOCK_ERR);
+
+	return NULL;
+}
+
+static const char *
+err_get_string(unsigned long e)
+{
+	ERR_STRING_DATA d, *p;
+	const ERR_STRING_DATA *str;
+
+	err_fns_check();
+	d.error = e;
+	if ((p = ERRFN(err_get_item)(&d)) != NULL)
+		return p->string;
+	if ((str = err_const_get_item(e)) != NULL)
+		return str->string;
+
+	return NULL;
+}
+
 void
 ERR_unload_strings(int lib, ERR_STRING_DATA *str)
 {
@@ -750,7 +856,9 @@ ERR_clear_error(void)
 	int i;
 	ERR_STATE *es;
 
-	es = ERR_get_state();
+	/* Nothing to clear if this thread has never had an error. */
+	if ((es = err_state_get(0)) == NULL)
+		return;
 
 	for (i = 0; i < ERR_NUM_ERRORS; i++) {
 		err_clear(es, i);
@@ -825,8 +933,6 @@ get_error_values(int inc, int top, const char **file, int *line,
 	ERR_STATE *es;
 	unsigned long ret;
 
-	es = ERR_get_state();
-
 	if (inc && top) {
 		if (file)
 			*file = "";
@@ -840,6 +946,8 @@ get_error_values(int inc, int top, const char **file, int *line,
 		return ERR_R_INTERNAL_ERROR;
 	}
 
+	if ((es = err_state_get(0)) == NULL)
+		return 0;
 	if (es->bottom == es->top)
 		return 0;
 	if (top)
@@ -975,104 +1083,119 @@ ERR_release_err_state_table(LHASH_OF(ERR_STATE) **hash)
 const char *
 ERR_lib_error_string(unsigned long e)
 {
-	ERR_STRING_DATA d, *p;
-	unsigned long l;
-
 	if (!OPENSSL_init_crypto(0, NULL))
 		return NULL;
 
-	err_fns_check();
-	l = ERR_GET_LIB(e);
-	d.error = ERR_PACK(l, 0, 0);
-	p = ERRFN(err_get_item)(&d);
-	return ((p == NULL) ? NULL : p->string);
+	return err_get_string(ERR_PACK(ERR_GET_LIB(e), 0, 0));
 }
 
 const char *
 ERR_func_error_string(unsigned long e)
 {
-	ERR_STRING_DATA d, *p;
-	unsigned long l, f;
-
-	err_fns_check();
-	l = ERR_GET_LIB(e);
-	f = ERR_GET_FUNC(e);
-	d.error = ERR_PACK(l, f, 0);
-	p = ERRFN(err_get_item)(&d);
-	return ((p == NULL) ? NULL : p->string);
+	return err_get_string(ERR_PACK(ERR_GET_LIB(e), ERR_GET_FUNC(e), 0));
 }
 
 const char *
 ERR_reason_error_string(unsigned long e)
 {
-	ERR_STRING_DATA d, *p = NULL;
-	unsigned long l, r;
+	const char *s;
+	unsigned long r;
 
-	err_fns_check();
-	l = ERR_GET_LIB(e);
 	r = ERR_GET_REASON(e);
-	d.error = ERR_PACK(l, 0, r);
-	p = ERRFN(err_get_item)(&d);
-	if (!p) {
-		d.error = ERR_PACK(0, 0, r);
-		p = ERRFN(err_get_item)(&d);
-	}
-	return ((p == NULL) ? NULL : p->string);
+	if ((s = err_get_string(ERR_PACK(ERR_GET_LIB(e), 0, r))) == NULL)
+		s = err_get_string(ERR_PACK(0, 0, r));
+
+	return s;
 }
 
-void
-ERR_remove_thread_state(const CRYPTO_THREADID *id)
+/*
+ * With the default implementation the error state of each thread is kept in
+ * thread specific data, so finding it takes neither a lock nor a lookup in
+ * the shared hash.  The state is freed when the thread exits.  An
+ * implementation set with ERR_set_implementation() keeps its own table.
+ */
+static pthread_once_t err_state_once = PTHREAD_ONCE_INIT;
+static pthread_key_t err_state_key;
+static int err_state_key_ok;
+
+static void
+err_state_key_free(void *s)
 {
-	ERR_STATE tmp;
+	ERR_STATE_free(s);
+}
 
-	if (id)
-		CRYPTO_THREADID_cpy(&tmp.tid, id);
-	else
-		CRYPTO_THREADID_current(&tmp.tid);
+static void
+err_state_key_init(void)
+{
+	if (pthread_key_create(&err_state_key, err_state_key_free) == 0)
+		err_state_key_ok = 1;
+}
+
+static int
+err_state_local(void)
+{
 	err_fns_check();
-	/* thread_del_item automatically destroys the LHASH if the number of
-	 * items reaches zero. */
-	ERRFN(thread_del_item)(&tmp);
+	if (err_fns != &err_defaults)
+		return 0;
+	(void) pthread_once(&err_state_once, err_state_key_init);
+	return err_state_key_ok;
 }
 
-#ifndef OPENSSL_NO_DEPRECATED
-void
-ERR_remove_state(unsigned long pid)
+static ERR_STATE *
+err_state_new(const CRYPTO_THREADID *tid)
 {
-	ERR_remove_thread_state(NULL);
+	ERR_STATE *ret;
+	int i;
+
+	if ((ret = malloc(sizeof(ERR_STATE))) == NULL)
+		return NULL;
+	CRYPTO_THREADID_cpy(&ret->tid, tid);
+	ret->top = 0;
+	ret->bottom = 0;
+	for (i = 0; i < ERR_NUM_ERRORS; i++) {
+		ret->err_data[i] = NULL;
+		ret->err_data_flags[i] = 0;
+	}
+	return ret;
 }
-#endif
 
-ERR_STATE *
-ERR_get_state(void)
+/*
+ * Return the error state of the current thread.  If it has none yet, make
+ * one if create is set and return NULL otherwise.
+ */
+static ERR_STATE *
+err_state_get(int create)
 {
-	static ERR_STATE fallback;
 	ERR_STATE *ret, tmp, *tmpp = NULL;
-	int i;
 	CRYPTO_THREADID tid;
 
-	err_fns_check();
+	if (err_state_local()) {
+		if ((ret = pthread_getspecific(err_state_key)) != NULL ||
+		    !create)
+			return ret;
+		CRYPTO_THREADID_current(&tid);
+		if ((ret = err_state_new(&tid)) == NULL)
+			return NULL;
+		if (pthread_setspecific(err_state_key, ret) != 0) {
+			ERR_STATE_free(ret);
+			return NULL;
+		}
+		return ret;
+	}
+
 	CRYPTO_THREADID_current(&tid);
 	CRYPTO_THREADID_cpy(&tmp.tid, &tid);
 	ret = ERRFN(thread_get_item)(&tmp);
 
 	/* ret == the error state, if NULL, make a new one */
-	if (ret == NULL) {
-		ret = malloc(sizeof(ERR_STATE));
-		if (ret == NULL)
-			return (&fallback);
-		CRYPTO_THREADID_cpy(&ret->tid, &tid);
-		ret->top = 0;
-		ret->bottom = 0;
-		for (i = 0; i < ERR_NUM_ERRORS; i++) {
-			ret->err_data[i] = NULL;
-			ret->err_data_flags[i] = 0;
-		}
+	if (ret == NULL && create) {
+		if ((ret = err_state_new(&tid)) == NULL)
+			return NULL;
 		tmpp = ERRFN(thread_set_item)(ret);
 		/* To check if insertion failed, do a get. */
 		if (ERRFN(thread_get_item)(ret) != ret) {
 			ERR_STATE_free(ret); /* could not insert it */
-			return (&fallback);
+			return NULL;
 		}
 		/* If a race occured in this function and we came second, tmpp
 		 * is the first one that we just replaced. */
@@ -1082,6 +1205,53 @@ ERR_get_state(void)
 	return ret;
 }
 
+void
+ERR_remove_thread_state(const CRYPTO_THREADID *id)
+{
+	ERR_STATE tmp, *es;
+
+	if (id)
+		CRYPTO_THREADID_cpy(&tmp.tid, id);
+	else
+		CRYPTO_THREADID_current(&tmp.tid);
+
+	if (err_state_local()) {
+		/*
+		 * The state of another thread cannot be reached from here,
+		 * it is freed when that thread exits.
+		 */
+		if ((es = pthread_getspecific(err_state_key)) == NULL ||
+		    CRYPTO_THREADID_cmp(&es->tid, &tmp.tid) != 0)
+			return;
+		(void) pthread_setspecific(err_state_key, NULL);
+		ERR_STATE_free(es);
+		return;
+	}
+
+	/* thread_del_item automatically destroys the LHASH if the number of
+	 * items reaches zero. */
+	ERRFN(thread_del_item)(&tmp);
+}
+
+#ifndef OPENSSL_NO_DEPRECATED
+void
+ERR_remove_state(unsigned long pid)
+{
+	ERR_remove_thread_state(NULL);
+}
+#endif
+
+ERR_STATE *
+ERR_get_state(void)
+{
+	static ERR_STATE fallback;
+	ERR_STATE *ret;
+
+	if ((ret = err_state_get(1)) == NULL)
+		return (&fallback);
+	return ret;
+}
+
 int
 ERR_get_next_error_library(void)
 {
@@ -192,6 +192,10 @@ OpenSSL_add_all_ciphers_internal(void)
 	EVP_add_cipher(EVP_aes_128_cbc_hmac_sha1());
 	EVP_add_cipher(EVP_aes_256_cbc_hmac_sha1());
 #endif
+#ifndef OPENSSL_NO_SHA256
+	EVP_add_cipher(EVP_aes_128_cbc_hmac_sha256());
+	EVP_add_cipher(EVP_aes_256_cbc_hmac_sha256());
+#endif
 #endif
 
 #ifndef OPENSSL_NO_CAMELLIA
@@ -178,15 +178,28 @@ EVP_DigestInit_ex(EVP_MD_CTX *ctx, const EVP_MD *type, ENGINE *impl)
 	}
 #endif
 	if (ctx->digest != type) {
+		int keep = 0;
+
 		if (ctx->digest && ctx->digest->ctx_size && ctx->md_data &&
 		    !EVP_MD_CTX_test_flags(ctx, EVP_MD_CTX_FLAG_REUSE)) {
-			freezero(ctx->md_data, ctx->digest->ctx_size);
-			ctx->md_data = NULL;
+			/*
+			 * Digests of the same family share their state size,
+			 * so the data of one can be reused by another.
+			 */
+			if (ctx->digest->ctx_size == type->ctx_size &&
+			    !(ctx->flags & EVP_MD_CTX_FLAG_NO_INIT)) {
+				explicit_bzero(ctx->md_data, type->ctx_size);
+				keep = 1;
+			} else {
+				freezero(ctx->md_data, ctx->digest->ctx_size);
+				ctx->md_data = NULL;
+			}
 		}
 		ctx->digest = type;
 		if (!(ctx->flags & EVP_MD_CTX_FLAG_NO_INIT) && type->ctx_size) {
 			ctx->update = type->update;
-			ctx->md_data = calloc(1, type->ctx_size);
+			if (!keep)
+				ctx->md_data = calloc(1, type->ctx_size);
 			if (ctx->md_data == NULL) {
 				EVP_PKEY_CTX_free(ctx->pctx);
 				ctx->pctx = NULL;
@@ -272,7 +285,8 @@ EVP_MD_CTX_copy_ex(EVP_MD_CTX *out, const EVP_MD_CTX *in)
 	}
 #endif
 
-	if (out->digest == in->digest) {
+	if (out->digest != NULL &&
+	    out->digest->ctx_size == in->digest->ctx_size) {
 		tmp_buf = out->md_data;
 		EVP_MD_CTX_set_flags(out, EVP_MD_CTX_FLAG_REUSE);
 	} else
@@ -291,7 +305,8 @@ EVP_MD_CTX_copy_ex(EVP_MD_CTX *out, const EVP_MD_CTX *in)
 			}
 		}
 		memcpy(out->md_data, in->md_data, out->digest->ctx_size);
-	}
+	} else if (tmp_buf != NULL)
+		freezero(tmp_buf, out->digest->ctx_size);
 
 	out->update = in->update;
 
@@ -49,6 +49,9 @@
  *
  */
 
+#include <sys/types.h>
+#include <sys/uio.h>
+
 #include <limits.h>
 #include <stdlib.h>
 #include <string.h>
@@ -60,6 +63,7 @@
 #include <openssl/err.h>
 #include <openssl/evp.h>
 
+#include "cryptlib.h"
 #include "evp_locl.h"
 #include "modes_lcl.h"
 
@@ -69,6 +73,8 @@ typedef struct {
 	union {
 		cbc128_f cbc;
 		ctr128_f ctr;
+		void (*ecb)(const unsigned char *in, unsigned char *out,
+		    size_t blocks, const AES_KEY *key, int enc);
 	} stream;
 } EVP_AES_KEY;
 
@@ -137,6 +143,13 @@ void AES_ctr32_encrypt(const unsigned char *in, unsigned char *out,
     size_t blocks, const AES_KEY *key,
     const unsigned char ivec[AES_BLOCK_SIZE]);
 #endif
+#ifndef AES_ASM
+void aes_ct_ecb_encrypt(const unsigned char *in, unsigned char *out,
+    size_t blocks, const AES_KEY *key, int enc);
+void aes_ct_ctr32_encrypt_blocks(const unsigned char *in, unsigned char *out,
+    size_t blocks, const AES_KEY *key,
+    const unsigned char ivec[AES_BLOCK_SIZE]);
+#endif
 #ifdef AES_XTS_ASM
 void AES_xts_encrypt(const char *inp, char *out, size_t len,
     const AES_KEY *key1, const AES_KEY *key2, const unsigned char iv[16]);
@@ -144,6 +157,29 @@ void AES_xts_decrypt(const char *inp, char *out, size_t len,
     const AES_KEY *key1, const AES_KEY *key2, const unsigned char iv[16]);
 #endif
 
+#ifdef __aarch64__
+#include "arm_arch.h"
+#endif
+
+#ifdef ARMV8_CE
+#define ARMV8_AES_CAPABLE	(OPENSSL_armcap_P & ARMV8_AES)
+
+int aes_v8_set_encrypt_key(const unsigned char *userKey, int bits,
+    AES_KEY *key);
+int aes_v8_set_decrypt_key(const unsigned char *userKey, int bits,
+    AES_KEY *key);
+
+void aes_v8_encrypt(const unsigned char *in, unsigned char *out,
+    const AES_KEY *key);
+void aes_v8_decrypt(const unsigned char *in, unsigned char *out,
+    const AES_KEY *key);
+
+void aes_v8_cbc_encrypt(const unsigned char *in, unsigned char *out,
+    size_t length, const AES_KEY *key, unsigned char *ivec, int enc);
+void aes_v8_ctr32_encrypt_blocks(const unsigned char *in, unsigned char *out,
+    size_t blocks, const AES_KEY *key, const unsigned char ivec[16]);
+#endif
+
 #if	defined(AES_ASM) &&				(  \
 	((defined(__i386)	|| defined(__i386__)	|| \
 	  defined(_M_IX86)) && defined(OPENSSL_IA32_SSE2))|| \
@@ -190,6 +226,16 @@ void aesni_xts_decrypt(const unsigned char *in, unsigned char *out,
     size_t length, const AES_KEY *key1, const AES_KEY *key2,
     const unsigned char iv[16]);
 
+#ifdef XTS_AESNI
+void xts128_aesni_encrypt(const unsigned char *in, unsigned char *out,
+    size_t length, const AES_KEY *key1, const AES_KEY *key2,
+    const unsigned char iv[16]);
+
+void xts128_aesni_decrypt(const unsigned char *in, unsigned char *out,
+    size_t length, const AES_KEY *key1, const AES_KEY *key2,
+    const unsigned char iv[16]);
+#endif
+
 void aesni_ccm64_encrypt_blocks (const unsigned char *in, unsigned char *out,
     size_t blocks, const void *key, const unsigned char ivec[16],
     unsigned char cmac[16]);
@@ -289,6 +335,9 @@ aesni_gcm_init_key(EVP_CIPHER_CTX *ctx, const unsigned char *key,
 		aesni_set_encrypt_key(key, ctx->key_len * 8, &gctx->ks);
 		CRYPTO_gcm128_init(&gctx->gcm, &gctx->ks,
 		    (block128_f)aesni_encrypt);
+#ifdef GCM_AESNI
+		gcm128_enable_aesni(&gctx->gcm);
+#endif
 		gctx->ctr = (ctr128_f)aesni_ctr32_encrypt_blocks;
 		/* If we have an iv can set it directly, otherwise use
 		 * saved IV.
@@ -338,6 +387,12 @@ aesni_xts_init_key(EVP_CIPHER_CTX *ctx, const unsigned char *key,
 			xctx->xts.block1 = (block128_f)aesni_decrypt;
 			xctx->stream = aesni_xts_decrypt;
 		}
+#ifdef XTS_AESNI
+		if ((OPENSSL_cpu_caps() & (CPUCAP_MASK_AVX2 |
+		    CPUCAP_MASK_VAES)) == (CPUCAP_MASK_AVX2 | CPUCAP_MASK_VAES))
+			xctx->stream = enc ? xts128_aesni_encrypt :
+			    xts128_aesni_decrypt;
+#endif
 
 		aesni_set_encrypt_key(key + ctx->key_len / 2,
 		    ctx->key_len * 4, &xctx->ks2);
@@ -510,6 +565,15 @@ aes_init_key(EVP_CIPHER_CTX *ctx, const unsigned char *key,
 	mode = ctx->cipher->flags & EVP_CIPH_MODE;
 	if ((mode == EVP_CIPH_ECB_MODE || mode == EVP_CIPH_CBC_MODE) &&
 	    !enc)
+#ifdef ARMV8_AES_CAPABLE
+		if (ARMV8_AES_CAPABLE) {
+			ret = aes_v8_set_decrypt_key(key, ctx->key_len * 8,
+			    &dat->ks);
+			dat->block = (block128_f)aes_v8_decrypt;
+			dat->stream.cbc = mode == EVP_CIPH_CBC_MODE ?
+			    (cbc128_f)aes_v8_cbc_encrypt : NULL;
+		} else
+#endif
 #ifdef BSAES_CAPABLE
 		if (BSAES_CAPABLE && mode == EVP_CIPH_CBC_MODE) {
 			ret = AES_set_decrypt_key(key, ctx->key_len * 8,
@@ -533,7 +597,23 @@ aes_init_key(EVP_CIPHER_CTX *ctx, const unsigned char *key,
 			dat->block = (block128_f)AES_decrypt;
 			dat->stream.cbc = mode == EVP_CIPH_CBC_MODE ?
 			    (cbc128_f)AES_cbc_encrypt : NULL;
+#ifndef AES_ASM
+			if (mode == EVP_CIPH_ECB_MODE)
+				dat->stream.ecb = aes_ct_ecb_encrypt;
+#endif
 		} else
+#ifdef ARMV8_AES_CAPABLE
+		if (ARMV8_AES_CAPABLE) {
+			ret = aes_v8_set_encrypt_key(key, ctx->key_len * 8,
+			    &dat->ks);
+			dat->block = (block128_f)aes_v8_encrypt;
+			dat->stream.cbc = mode == EVP_CIPH_CBC_MODE ?
+			    (cbc128_f)aes_v8_cbc_encrypt : NULL;
+			if (mode == EVP_CIPH_CTR_MODE)
+				dat->stream.ctr =
+				    (ctr128_f)aes_v8_ctr32_encrypt_blocks;
+		} else
+#endif
 #ifdef BSAES_CAPABLE
 		if (BSAES_CAPABLE && mode == EVP_CIPH_CTR_MODE) {
 			ret = AES_set_encrypt_key(key, ctx->key_len * 8,
@@ -560,6 +640,13 @@ aes_init_key(EVP_CIPHER_CTX *ctx, const unsigned char *key,
 #ifdef AES_CTR_ASM
 			if (mode == EVP_CIPH_CTR_MODE)
 				dat->stream.ctr = (ctr128_f)AES_ctr32_encrypt;
+#endif
+#ifndef AES_ASM
+			if (mode == EVP_CIPH_ECB_MODE)
+				dat->stream.ecb = aes_ct_ecb_encrypt;
+			if (mode == EVP_CIPH_CTR_MODE)
+				dat->stream.ctr =
+				    (ctr128_f)aes_ct_ctr32_encrypt_blocks;
 #endif
 		}
 
@@ -601,6 +688,11 @@ aes_ecb_cipher(EVP_CIPHER_CTX *ctx, unsigned char *out,
 	if (len < bl)
 		return 1;
 
+	if (dat->stream.ecb != NULL) {
+		(*dat->stream.ecb)(in, out, len / bl, &dat->ks, ctx->encrypt);
+		return 1;
+	}
+
 	for (i = 0, len -= bl; i <= len; i += bl)
 		(*dat->block)(in + i, out + i, &dat->ks);
 
@@ -859,6 +951,13 @@ static ctr128_f
 aes_gcm_set_key(AES_KEY *aes_key, GCM128_CONTEXT *gcm_ctx,
     const unsigned char *key, size_t key_len)
 {
+#ifdef ARMV8_AES_CAPABLE
+	if (ARMV8_AES_CAPABLE) {
+		aes_v8_set_encrypt_key(key, key_len * 8, aes_key);
+		CRYPTO_gcm128_init(gcm_ctx, aes_key, (block128_f)aes_v8_encrypt);
+		return (ctr128_f)aes_v8_ctr32_encrypt_blocks;
+	} else
+#endif
 #ifdef BSAES_CAPABLE
 	if (BSAES_CAPABLE) {
 		AES_set_encrypt_key(key, key_len * 8, aes_key);
@@ -879,6 +978,8 @@ aes_gcm_set_key(AES_KEY *aes_key, GCM128_CONTEXT *gcm_ctx,
 	CRYPTO_gcm128_init(gcm_ctx, aes_key, (block128_f)AES_encrypt);
 #ifdef AES_CTR_ASM
 	return (ctr128_f)AES_ctr32_encrypt;
+#elif !defined(AES_ASM)
+	return (ctr128_f)aes_ct_ctr32_encrypt_blocks;
 #else
 	return NULL;
 #endif
@@ -1146,6 +1247,26 @@ aes_xts_init_key(EVP_CIPHER_CTX *ctx, const unsigned char *key,
 			break;
 		} else
 #endif
+#ifdef ARMV8_AES_CAPABLE
+		if (ARMV8_AES_CAPABLE) {
+			if (enc) {
+				aes_v8_set_encrypt_key(key, ctx->key_len * 4,
+				    &xctx->ks1);
+				xctx->xts.block1 = (block128_f)aes_v8_encrypt;
+			} else {
+				aes_v8_set_decrypt_key(key, ctx->key_len * 4,
+				    &xctx->ks1);
+				xctx->xts.block1 = (block128_f)aes_v8_decrypt;
+			}
+
+			aes_v8_set_encrypt_key(key + ctx->key_len / 2,
+			    ctx->key_len * 4, &xctx->ks2);
+			xctx->xts.block2 = (block128_f)aes_v8_encrypt;
+
+			xctx->xts.key1 = &xctx->ks1;
+			break;
+		} else
+#endif
 			(void)0;	/* terminate potentially open 'else' */
 
 		if (enc) {
@@ -1191,6 +1312,49 @@ aes_xts_cipher(EVP_CIPHER_CTX *ctx, unsigned char *out,
 	return 1;
 }
 
+int
+EVP_CipherSectors(EVP_CIPHER_CTX *ctx, unsigned char *out,
+    const unsigned char *in, size_t sector_len, size_t nsectors,
+    const unsigned char *tweaks)
+{
+	EVP_AES_XTS_CTX *xctx;
+	XTS128_CONTEXT xts;
+	size_t i;
+
+	if (ctx->cipher == NULL || ctx->cipher->do_cipher != aes_xts_cipher) {
+		EVPerror(EVP_R_INVALID_OPERATION);
+		return 0;
+	}
+	xctx = ctx->cipher_data;
+	if (xctx->xts.key1 == NULL) {
+		EVPerror(EVP_R_NO_KEY_SET);
+		return 0;
+	}
+	if (sector_len < AES_BLOCK_SIZE) {
+		EVPerror(EVP_R_BAD_BLOCK_LENGTH);
+		return 0;
+	}
+
+	/* The tweaks take the place of the IV, which need not be set. */
+	xts = xctx->xts;
+	xts.key2 = &xctx->ks2;
+
+	for (i = 0; i < nsectors; i++) {
+		if (xctx->stream != NULL)
+			(*xctx->stream)(in, out, sector_len, xts.key1,
+			    xts.key2, tweaks);
+		else if (CRYPTO_xts128_encrypt(&xts, tweaks, in, out,
+		    sector_len, ctx->encrypt))
+			return 0;
+
+		in += sector_len;
+		out += sector_len;
+		tweaks += 16;
+	}
+
+	return 1;
+}
+
 #define aes_xts_cleanup NULL
 
 #define XTS_FLAGS \
@@ -1282,6 +1446,17 @@ aes_ccm_init_key(EVP_CIPHER_CTX *ctx, const unsigned char *key,
 			cctx->key_set = 1;
 			break;
 		}
+#endif
+#ifdef ARMV8_AES_CAPABLE
+		if (ARMV8_AES_CAPABLE) {
+			aes_v8_set_encrypt_key(key, ctx->key_len * 8,
+			    &cctx->ks);
+			CRYPTO_ccm128_init(&cctx->ccm, cctx->M, cctx->L,
+			    &cctx->ks, (block128_f)aes_v8_encrypt);
+			cctx->str = NULL;
+			cctx->key_set = 1;
+			break;
+		}
 #endif
 		AES_set_encrypt_key(key, ctx->key_len * 8, &cctx->ks);
 		CRYPTO_ccm128_init(&cctx->ccm, cctx->M, cctx->L,
@@ -1408,6 +1583,9 @@ aead_aes_gcm_init(EVP_AEAD_CTX *ctx, const unsigned char *key, size_t key_len,
 		aesni_set_encrypt_key(key, key_bits, &gcm_ctx->ks.ks);
 		CRYPTO_gcm128_init(&gcm_ctx->gcm, &gcm_ctx->ks.ks,
 		    (block128_f)aesni_encrypt);
+#ifdef GCM_AESNI
+		gcm128_enable_aesni(&gcm_ctx->gcm);
+#endif
 		gcm_ctx->ctr = (ctr128_f) aesni_ctr32_encrypt_blocks;
 	} else
 #endif
@@ -1430,14 +1608,35 @@ aead_aes_gcm_cleanup(EVP_AEAD_CTX *ctx)
 }
 
 static int
-aead_aes_gcm_seal(const EVP_AEAD_CTX *ctx, unsigned char *out, size_t *out_len,
-    size_t max_out_len, const unsigned char *nonce, size_t nonce_len,
-    const unsigned char *in, size_t in_len, const unsigned char *ad,
-    size_t ad_len)
+aead_aes_gcm_copy(EVP_AEAD_CTX *out, const EVP_AEAD_CTX *in)
+{
+	const struct aead_aes_gcm_ctx *gcm_ctx = in->aead_state;
+	struct aead_aes_gcm_ctx *gcm_out;
+
+	if ((gcm_out = malloc(sizeof(*gcm_out))) == NULL)
+		return 0;
+	memcpy(gcm_out, gcm_ctx, sizeof(*gcm_out));
+	gcm_out->gcm.key = &gcm_out->ks;
+	out->aead_state = gcm_out;
+
+	return 1;
+}
+
+static int
+aead_aes_gcm_seal_iov(const EVP_AEAD_CTX *ctx, unsigned char *out,
+    size_t *out_len, size_t max_out_len, const unsigned char *nonce,
+    size_t nonce_len, const struct iovec *in_iov, int in_iovcnt,
+    const struct iovec *ad_iov, int ad_iovcnt)
 {
 	const struct aead_aes_gcm_ctx *gcm_ctx = ctx->aead_state;
 	GCM128_CONTEXT gcm;
-	size_t bulk = 0;
+	size_t in_len, offset;
+	int i;
+
+	if (!evp_aead_iov_len(in_iov, in_iovcnt, &in_len)) {
+		EVPerror(EVP_R_TOO_LARGE);
+		return 0;
+	}
 
 	if (max_out_len < in_len + gcm_ctx->tag_len) {
 		EVPerror(EVP_R_BUFFER_TOO_SMALL);
@@ -1452,19 +1651,28 @@ aead_aes_gcm_seal(const EVP_AEAD_CTX *ctx, unsigned char *out, size_t *out_len,
 	}
 	CRYPTO_gcm128_setiv(&gcm, nonce, nonce_len);
 
-	if (ad_len > 0 && CRYPTO_gcm128_aad(&gcm, ad, ad_len))
-		return 0;
-
-	if (gcm_ctx->ctr) {
-		if (CRYPTO_gcm128_encrypt_ctr32(&gcm, in + bulk, out + bulk,
-		    in_len - bulk, gcm_ctx->ctr))
-			return 0;
-	} else {
-		if (CRYPTO_gcm128_encrypt(&gcm, in + bulk, out + bulk,
-		    in_len - bulk))
+	for (i = 0; i < ad_iovcnt; i++) {
+		if (ad_iov[i].iov_len == 0)
+			continue;
+		if (CRYPTO_gcm128_aad(&gcm, ad_iov[i].iov_base,
+		    ad_iov[i].iov_len))
 			return 0;
 	}
 
+	for (i = 0, offset = 0; i < in_iovcnt; i++) {
+		if (gcm_ctx->ctr) {
+			if (CRYPTO_gcm128_encrypt_ctr32(&gcm,
+			    in_iov[i].iov_base, out + offset,
+			    in_iov[i].iov_len, gcm_ctx->ctr))
+				return 0;
+		} else {
+			if (CRYPTO_gcm128_encrypt(&gcm, in_iov[i].iov_base,
+			    out + offset, in_iov[i].iov_len))
+				return 0;
+		}
+		offset += in_iov[i].iov_len;
+	}
+
 	CRYPTO_gcm128_tag(&gcm, out + in_len, gcm_ctx->tag_len);
 	*out_len = in_len + gcm_ctx->tag_len;
 
@@ -1472,16 +1680,24 @@ aead_aes_gcm_seal(const EVP_AEAD_CTX *ctx, unsigned char *out, size_t *out_len,
 }
 
 static int
-aead_aes_gcm_open(const EVP_AEAD_CTX *ctx, unsigned char *out, size_t *out_len,
-    size_t max_out_len, const unsigned char *nonce, size_t nonce_len,
-    const unsigned char *in, size_t in_len, const unsigned char *ad,
-    size_t ad_len)
+aead_aes_gcm_open_iov(const EVP_AEAD_CTX *ctx, unsigned char *out,
+    size_t *out_len, size_t max_out_len, const unsigned char *nonce,
+    size_t nonce_len, const struct iovec *in_iov, int in_iovcnt,
+    const struct iovec *ad_iov, int ad_iovcnt)
 {
 	const struct aead_aes_gcm_ctx *gcm_ctx = ctx->aead_state;
+	unsigned char in_tag[EVP_AEAD_AES_GCM_TAG_LEN];
 	unsigned char tag[EVP_AEAD_AES_GCM_TAG_LEN];
 	GCM128_CONTEXT gcm;
-	size_t plaintext_len;
-	size_t bulk = 0;
+	const unsigned char *in;
+	size_t in_len, plaintext_len;
+	size_t len, offset, tag_offset;
+	int i;
+
+	if (!evp_aead_iov_len(in_iov, in_iovcnt, &in_len)) {
+		EVPerror(EVP_R_TOO_LARGE);
+		return 0;
+	}
 
 	if (in_len < gcm_ctx->tag_len) {
 		EVPerror(EVP_R_BAD_DECRYPT);
@@ -1503,21 +1719,41 @@ aead_aes_gcm_open(const EVP_AEAD_CTX *ctx, unsigned char *out, size_t *out_len,
 	}
 	CRYPTO_gcm128_setiv(&gcm, nonce, nonce_len);
 
-	if (CRYPTO_gcm128_aad(&gcm, ad, ad_len))
-		return 0;
-
-	if (gcm_ctx->ctr) {
-		if (CRYPTO_gcm128_decrypt_ctr32(&gcm, in + bulk, out + bulk,
-		    in_len - bulk - gcm_ctx->tag_len, gcm_ctx->ctr))
-			return 0;
-	} else {
-		if (CRYPTO_gcm128_decrypt(&gcm, in + bulk, out + bulk,
-		    in_len - bulk - gcm_ctx->tag_len))
+	for (i = 0; i < ad_iovcnt; i++) {
+		if (CRYPTO_gcm128_aad(&gcm, ad_iov[i].iov_base,
+		    ad_iov[i].iov_len))
 			return 0;
 	}
 
+	/*
+	 * Decrypt the ciphertext, collecting the tag as we go since it may
+	 * span multiple fragments.
+	 */
+	for (i = 0, offset = 0, tag_offset = 0; i < in_iovcnt; i++) {
+		in = in_iov[i].iov_base;
+		len = in_iov[i].iov_len;
+		if (offset < plaintext_len) {
+			if (len > plaintext_len - offset)
+				len = plaintext_len - offset;
+			if (gcm_ctx->ctr) {
+				if (CRYPTO_gcm128_decrypt_ctr32(&gcm, in,
+				    out + offset, len, gcm_ctx->ctr))
+					return 0;
+			} else {
+				if (CRYPTO_gcm128_decrypt(&gcm, in,
+				    out + offset, len))
+					return 0;
+			}
+			offset += len;
+			in += len;
+			len = in_iov[i].iov_len - len;
+		}
+		memcpy(&in_tag[tag_offset], in, len);
+		tag_offset += len;
+	}
+
 	CRYPTO_gcm128_tag(&gcm, tag, gcm_ctx->tag_len);
-	if (timingsafe_memcmp(tag, in + plaintext_len, gcm_ctx->tag_len) != 0) {
+	if (timingsafe_memcmp(tag, in_tag, gcm_ctx->tag_len) != 0) {
 		EVPerror(EVP_R_BAD_DECRYPT);
 		return 0;
 	}
@@ -1527,6 +1763,32 @@ aead_aes_gcm_open(const EVP_AEAD_CTX *ctx, unsigned char *out, size_t *out_len,
 	return 1;
 }
 
+static int
+aead_aes_gcm_seal(const EVP_AEAD_CTX *ctx, unsigned char *out, size_t *out_len,
+    size_t max_out_len, const unsigned char *nonce, size_t nonce_len,
+    const unsigned char *in, size_t in_len, const unsigned char *ad,
+    size_t ad_len)
+{
+	struct iovec in_iov = { (void *)in, in_len };
+	struct iovec ad_iov = { (void *)ad, ad_len };
+
+	return aead_aes_gcm_seal_iov(ctx, out, out_len, max_out_len,
+	    nonce, nonce_len, &in_iov, 1, &ad_iov, 1);
+}
+
+static int
+aead_aes_gcm_open(const EVP_AEAD_CTX *ctx, unsigned char *out, size_t *out_len,
+    size_t max_out_len, const unsigned char *nonce, size_t nonce_len,
+    const unsigned char *in, size_t in_len, const unsigned char *ad,
+    size_t ad_len)
+{
+	struct iovec in_iov = { (void *)in, in_len };
+	struct iovec ad_iov = { (void *)ad, ad_len };
+
+	return aead_aes_gcm_open_iov(ctx, out, out_len, max_out_len,
+	    nonce, nonce_len, &in_iov, 1, &ad_iov, 1);
+}
+
 static const EVP_AEAD aead_aes_128_gcm = {
 	.key_len = 16,
 	.nonce_len = 12,
@@ -1535,8 +1797,11 @@ static const EVP_AEAD aead_aes_128_gcm = {
 
 	.init = aead_aes_gcm_init,
 	.cleanup = aead_aes_gcm_cleanup,
+	.copy = aead_aes_gcm_copy,
 	.seal = aead_aes_gcm_seal,
 	.open = aead_aes_gcm_open,
+	.seal_iov = aead_aes_gcm_seal_iov,
+	.open_iov = aead_aes_gcm_open_iov,
 };
 
 static const EVP_AEAD aead_aes_256_gcm = {
@@ -1547,8 +1812,11 @@ static const EVP_AEAD aead_aes_256_gcm = {
 
 	.init = aead_aes_gcm_init,
 	.cleanup = aead_aes_gcm_cleanup,
+	.copy = aead_aes_gcm_copy,
 	.seal = aead_aes_gcm_seal,
 	.open = aead_aes_gcm_open,
+	.seal_iov = aead_aes_gcm_seal_iov,
+	.open_iov = aead_aes_gcm_open_iov,
 };
 
 const EVP_AEAD *
@@ -1563,6 +1831,593 @@ EVP_aead_aes_256_gcm(void)
 	return &aead_aes_256_gcm;
 }
 
+/*
+ * AES-GCM-SIV, a nonce misuse resistant AEAD, from RFC 8452.  Each message
+ * gets its own authentication and encryption keys, derived from the nonce
+ * with the key-generating key.  POLYVAL is computed with the GHASH code.
+ */
+
+#define EVP_AEAD_AES_GCM_SIV_TAG_LEN	16
+#define EVP_AEAD_AES_GCM_SIV_NONCE_LEN	12
+#define EVP_AEAD_AES_GCM_SIV_MAX_LEN	((uint64_t)1 << 36)
+#define EVP_AEAD_AES_GCM_SIV_BLOCKS	16
+
+struct aead_aes_gcm_siv_ctx {
+	union {
+		double align;
+		AES_KEY ks;
+	} ks;
+	block128_f block;
+	size_t key_len;
+};
+
+static block128_f
+aead_aes_gcm_siv_set_key(AES_KEY *aes_key, const unsigned char *key,
+    size_t key_len)
+{
+#ifdef AESNI_CAPABLE
+	if (AESNI_CAPABLE) {
+		aesni_set_encrypt_key(key, key_len * 8, aes_key);
+		return (block128_f)aesni_encrypt;
+	}
+#endif
+#ifdef ARMV8_AES_CAPABLE
+	if (ARMV8_AES_CAPABLE) {
+		aes_v8_set_encrypt_key(key, key_len * 8, aes_key);
+		return (block128_f)aes_v8_encrypt;
+	}
+#endif
+#ifdef VPAES_CAPABLE
+	if (VPAES_CAPABLE) {
+		vpaes_set_encrypt_key(key, key_len * 8, aes_key);
+		return (block128_f)vpaes_encrypt;
+	}
+#endif
+	AES_set_encrypt_key(key, key_len * 8, aes_key);
+	return (block128_f)AES_encrypt;
+}
+
+static int
+aead_aes_gcm_siv_init(EVP_AEAD_CTX *ctx, const unsigned char *key,
+    size_t key_len, size_t tag_len)
+{
+	struct aead_aes_gcm_siv_ctx *siv_ctx;
+
+	if (key_len != 16 && key_len != 32) {
+		EVPerror(EVP_R_BAD_KEY_LENGTH);
+		return 0;
+	}
+
+	if (tag_len == EVP_AEAD_DEFAULT_TAG_LENGTH)
+		tag_len = EVP_AEAD_AES_GCM_SIV_TAG_LEN;
+
+	if (tag_len > EVP_AEAD_AES_GCM_SIV_TAG_LEN) {
+		EVPerror(EVP_R_TAG_TOO_LARGE);
+		return 0;
+	}
+	if (tag_len != EVP_AEAD_AES_GCM_SIV_TAG_LEN) {
+		EVPerror(EVP_R_INVALID_OPERATION);
+		return 0;
+	}
+
+	if ((siv_ctx = calloc(1, sizeof(*siv_ctx))) == NULL)
+		return 0;
+
+	siv_ctx->block = aead_aes_gcm_siv_set_key(&siv_ctx->ks.ks, key,
+	    key_len);
+	siv_ctx->key_len = key_len;
+	ctx->aead_state = siv_ctx;
+
+	return 1;
+}
+
+static void
+aead_aes_gcm_siv_cleanup(EVP_AEAD_CTX *ctx)
+{
+	struct aead_aes_gcm_siv_ctx *siv_ctx = ctx->aead_state;
+
+	freezero(siv_ctx, sizeof(*siv_ctx));
+}
+
+static int
+aead_aes_gcm_siv_copy(EVP_AEAD_CTX *out, const EVP_AEAD_CTX *in)
+{
+	const struct aead_aes_gcm_siv_ctx *siv_ctx = in->aead_state;
+	struct aead_aes_gcm_siv_ctx *siv_out;
+
+	if ((siv_out = malloc(sizeof(*siv_out))) == NULL)
+		return 0;
+	memcpy(siv_out, siv_ctx, sizeof(*siv_out));
+	out->aead_state = siv_out;
+
+	return 1;
+}
+
+/*
+ * Derive the per-message keys: the first half of each of the encrypted
+ * blocks LE32(i) || nonce gives 16 bytes of POLYVAL key followed by 16 or
+ * 32 bytes of AES key.
+ */
+static block128_f
+aead_aes_gcm_siv_keys(const struct aead_aes_gcm_siv_ctx *siv_ctx,
+    const unsigned char *nonce, unsigned char auth_key[16], AES_KEY *enc_ks)
+{
+	unsigned char keys[16 + 32], in[16], out[16];
+	block128_f block;
+	size_t i;
+
+	memset(in, 0, sizeof(in));
+	memcpy(in + 4, nonce, EVP_AEAD_AES_GCM_SIV_NONCE_LEN);
+	for (i = 0; i < (16 + siv_ctx->key_len) / 8; i++) {
+		in[0] = i;
+		(*siv_ctx->block)(in, out, &siv_ctx->ks.ks);
+		memcpy(keys + 8 * i, out, 8);
+	}
+
+	memcpy(auth_key, keys, 16);
+	block = aead_aes_gcm_siv_set_key(enc_ks, keys + 16, siv_ctx->key_len);
+
+	explicit_bzero(keys, sizeof(keys));
+	explicit_bzero(out, sizeof(out));
+
+	return block;
+}
+
+static void
+aead_aes_gcm_siv_tag(unsigned char tag[16], const unsigned char auth_key[16],
+    const AES_KEY *enc_ks, block128_f block, const unsigned char *nonce,
+    const unsigned char *in, size_t in_len, const unsigned char *ad,
+    size_t ad_len)
+{
+	GCM128_CONTEXT polyval;
+	unsigned char lens[16];
+	uint64_t ad_bits = (uint64_t)ad_len * 8, in_bits = (uint64_t)in_len * 8;
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		lens[i] = ad_bits >> (8 * i);
+		lens[8 + i] = in_bits >> (8 * i);
+	}
+
+	gcm128_polyval_init(&polyval, auth_key);
+	gcm128_polyval_update(&polyval, ad, ad_len);
+	gcm128_polyval_update(&polyval, in, in_len);
+	gcm128_polyval_update(&polyval, lens, sizeof(lens));
+	gcm128_polyval_final(&polyval, tag);
+
+	for (i = 0; i < EVP_AEAD_AES_GCM_SIV_NONCE_LEN; i++)
+		tag[i] ^= nonce[i];
+	tag[15] &= 0x7f;
+	(*block)(tag, tag, enc_ks);
+
+	explicit_bzero(&polyval, sizeof(polyval));
+}
+
+/*
+ * CTR mode with the tag as the initial counter block, its top bit set and
+ * a 32-bit little endian counter in the first four bytes.  With AES-NI the
+ * counter blocks are encrypted several at a time with aesni_ecb_encrypt.
+ */
+static void
+aead_aes_gcm_siv_crypt(unsigned char *out, const unsigned char *in,
+    size_t len, const unsigned char tag[16], const AES_KEY *enc_ks,
+    block128_f block)
+{
+	unsigned char ctr[EVP_AEAD_AES_GCM_SIV_BLOCKS * 16];
+	unsigned char ks[EVP_AEAD_AES_GCM_SIV_BLOCKS * 16];
+	uint32_t counter;
+	size_t i, n;
+
+	uint64_t a, b;
+
+	counter = (uint32_t)tag[0] | (uint32_t)tag[1] << 8 |
+	    (uint32_t)tag[2] << 16 | (uint32_t)tag[3] << 24;
+	for (i = 0; i < sizeof(ctr); i += 16) {
+		memcpy(&ctr[i], tag, 16);
+		ctr[i + 15] |= 0x80;
+	}
+
+	while (len > 0) {
+		n = len < sizeof(ks) ? len : sizeof(ks);
+		for (i = 0; i < n; i += 16) {
+			ctr[i] = counter;
+			ctr[i + 1] = counter >> 8;
+			ctr[i + 2] = counter >> 16;
+			ctr[i + 3] = counter >> 24;
+			counter++;
+		}
+#ifdef AESNI_CAPABLE
+		if (AESNI_CAPABLE)
+			aesni_ecb_encrypt(ctr, ks, i, enc_ks, 1);
+		else
+#endif
+		{
+			for (i = 0; i < n; i += 16)
+				(*block)(&ctr[i], &ks[i], enc_ks);
+		}
+		for (i = 0; i + 8 <= n; i += 8) {
+			memcpy(&a, &in[i], 8);
+			memcpy(&b, &ks[i], 8);
+			a ^= b;
+			memcpy(&out[i], &a, 8);
+		}
+		for (; i < n; i++)
+			out[i] = in[i] ^ ks[i];
+		in += n;
+		out += n;
+		len -= n;
+	}
+
+	explicit_bzero(ks, sizeof(ks));
+}
+
+static int
+aead_aes_gcm_siv_seal(const EVP_AEAD_CTX *ctx, unsigned char *out,
+    size_t *out_len, size_t max_out_len, const unsigned char *nonce,
+    size_t nonce_len, const unsigned char *in, size_t in_len,
+    const unsigned char *ad, size_t ad_len)
+{
+	const struct aead_aes_gcm_siv_ctx *siv_ctx = ctx->aead_state;
+	unsigned char auth_key[16], tag[EVP_AEAD_AES_GCM_SIV_TAG_LEN];
+	AES_KEY enc_ks;
+	block128_f block;
+
+	if ((uint64_t)in_len > EVP_AEAD_AES_GCM_SIV_MAX_LEN ||
+	    (uint64_t)ad_len > EVP_AEAD_AES_GCM_SIV_MAX_LEN) {
+		EVPerror(EVP_R_TOO_LARGE);
+		return 0;
+	}
+
+	if (max_out_len < in_len + EVP_AEAD_AES_GCM_SIV_TAG_LEN) {
+		EVPerror(EVP_R_BUFFER_TOO_SMALL);
+		return 0;
+	}
+
+	if (nonce_len != EVP_AEAD_AES_GCM_SIV_NONCE_LEN) {
+		EVPerror(EVP_R_INVALID_IV_LENGTH);
+		return 0;
+	}
+
+	block = aead_aes_gcm_siv_keys(siv_ctx, nonce, auth_key, &enc_ks);
+	aead_aes_gcm_siv_tag(tag, auth_key, &enc_ks, block, nonce, in, in_len,
+	    ad, ad_len);
+	aead_aes_gcm_siv_crypt(out, in, in_len, tag, &enc_ks, block);
+	memcpy(out + in_len, tag, EVP_AEAD_AES_GCM_SIV_TAG_LEN);
+	*out_len = in_len + EVP_AEAD_AES_GCM_SIV_TAG_LEN;
+
+	explicit_bzero(auth_key, sizeof(auth_key));
+	explicit_bzero(&enc_ks, sizeof(enc_ks));
+
+	return 1;
+}
+
+static int
+aead_aes_gcm_siv_open(const EVP_AEAD_CTX *ctx, unsigned char *out,
+    size_t *out_len, size_t max_out_len, const unsigned char *nonce,
+    size_t nonce_len, const unsigned char *in, size_t in_len,
+    const unsigned char *ad, size_t ad_len)
+{
+	const struct aead_aes_gcm_siv_ctx *siv_ctx = ctx->aead_state;
+	unsigned char auth_key[16];
+	unsigned char in_tag[EVP_AEAD_AES_GCM_SIV_TAG_LEN];
+	unsigned char tag[EVP_AEAD_AES_GCM_SIV_TAG_LEN];
+	size_t plaintext_len;
+	AES_KEY enc_ks;
+	block128_f block;
+	int ret = 0;
+
+	if (in_len < EVP_AEAD_AES_GCM_SIV_TAG_LEN) {
+		EVPerror(EVP_R_BAD_DECRYPT);
+		return 0;
+	}
+
+	plaintext_len = in_len - EVP_AEAD_AES_GCM_SIV_TAG_LEN;
+
+	if ((uint64_t)plaintext_len > EVP_AEAD_AES_GCM_SIV_MAX_LEN ||
+	    (uint64_t)ad_len > EVP_AEAD_AES_GCM_SIV_MAX_LEN) {
+		EVPerror(EVP_R_TOO_LARGE);
+		return 0;
+	}
+
+	if (max_out_len < plaintext_len) {
+		EVPerror(EVP_R_BUFFER_TOO_SMALL);
+		return 0;
+	}
+
+	if (nonce_len != EVP_AEAD_AES_GCM_SIV_NONCE_LEN) {
+		EVPerror(EVP_R_INVALID_IV_LENGTH);
+		return 0;
+	}
+
+	memcpy(in_tag, in + plaintext_len, sizeof(in_tag));
+
+	block = aead_aes_gcm_siv_keys(siv_ctx, nonce, auth_key, &enc_ks);
+	aead_aes_gcm_siv_crypt(out, in, plaintext_len, in_tag, &enc_ks, block);
+	aead_aes_gcm_siv_tag(tag, auth_key, &enc_ks, block, nonce, out,
+	    plaintext_len, ad, ad_len);
+
+	if (timingsafe_memcmp(tag, in_tag, sizeof(tag)) != 0) {
+		explicit_bzero(out, plaintext_len);
+		EVPerror(EVP_R_BAD_DECRYPT);
+		goto err;
+	}
+
+	*out_len = plaintext_len;
+
+	ret = 1;
+
+ err:
+	explicit_bzero(auth_key, sizeof(auth_key));
+	explicit_bzero(&enc_ks, sizeof(enc_ks));
+
+	return ret;
+}
+
+static const EVP_AEAD aead_aes_128_gcm_siv = {
+	.key_len = 16,
+	.nonce_len = EVP_AEAD_AES_GCM_SIV_NONCE_LEN,
+	.overhead = EVP_AEAD_AES_GCM_SIV_TAG_LEN,
+	.max_tag_len = EVP_AEAD_AES_GCM_SIV_TAG_LEN,
+
+	.init = aead_aes_gcm_siv_init,
+	.cleanup = aead_aes_gcm_siv_cleanup,
+	.copy = aead_aes_gcm_siv_copy,
+	.seal = aead_aes_gcm_siv_seal,
+	.open = aead_aes_gcm_siv_open,
+};
+
+static const EVP_AEAD aead_aes_256_gcm_siv = {
+	.key_len = 32,
+	.nonce_len = EVP_AEAD_AES_GCM_SIV_NONCE_LEN,
+	.overhead = EVP_AEAD_AES_GCM_SIV_TAG_LEN,
+	.max_tag_len = EVP_AEAD_AES_GCM_SIV_TAG_LEN,
+
+	.init = aead_aes_gcm_siv_init,
+	.cleanup = aead_aes_gcm_siv_cleanup,
+	.copy = aead_aes_gcm_siv_copy,
+	.seal = aead_aes_gcm_siv_seal,
+	.open = aead_aes_gcm_siv_open,
+};
+
+const EVP_AEAD *
+EVP_aead_aes_128_gcm_siv(void)
+{
+	return &aead_aes_128_gcm_siv;
+}
+
+const EVP_AEAD *
+EVP_aead_aes_256_gcm_siv(void)
+{
+	return &aead_aes_256_gcm_siv;
+}
+
+/*
+ * AES-CCM with a 13 byte nonce (so L = 2 and messages of at most 65535
+ * bytes), as used by IEEE 802.15.4, Bluetooth LE and OSCORE.  The tag
+ * length may be any even value from 4 to 16 bytes and defaults to 16.
+ */
+
+#define EVP_AEAD_AES_CCM_NONCE_LEN	13
+#define EVP_AEAD_AES_CCM_L		(15 - EVP_AEAD_AES_CCM_NONCE_LEN)
+#define EVP_AEAD_AES_CCM_MAX_TAG_LEN	16
+#define EVP_AEAD_AES_CCM_MAX_LEN	\
+    (((size_t)1 << (8 * EVP_AEAD_AES_CCM_L)) - 1)
+
+struct aead_aes_ccm_ctx {
+	union {
+		double align;
+		AES_KEY ks;
+	} ks;
+	CCM128_CONTEXT ccm;
+	ccm128_f enc_str, dec_str;
+	unsigned char tag_len;
+};
+
+static int
+aead_aes_ccm_init(EVP_AEAD_CTX *ctx, const unsigned char *key, size_t key_len,
+    size_t tag_len)
+{
+	struct aead_aes_ccm_ctx *ccm_ctx;
+	block128_f block;
+
+	if (key_len != 16) {
+		EVPerror(EVP_R_BAD_KEY_LENGTH);
+		return 0;
+	}
+
+	if (tag_len == EVP_AEAD_DEFAULT_TAG_LENGTH)
+		tag_len = EVP_AEAD_AES_CCM_MAX_TAG_LEN;
+
+	if (tag_len > EVP_AEAD_AES_CCM_MAX_TAG_LEN) {
+		EVPerror(EVP_R_TAG_TOO_LARGE);
+		return 0;
+	}
+	if (tag_len < 4 || (tag_len & 1) != 0) {
+		EVPerror(EVP_R_INVALID_OPERATION);
+		return 0;
+	}
+
+	if ((ccm_ctx = calloc(1, sizeof(*ccm_ctx))) == NULL)
+		return 0;
+
+	/* The key setup is shared with AES-GCM-SIV. */
+	block = aead_aes_gcm_siv_set_key(&ccm_ctx->ks.ks, key, key_len);
+	CRYPTO_ccm128_init(&ccm_ctx->ccm, tag_len, EVP_AEAD_AES_CCM_L,
+	    &ccm_ctx->ks.ks, block);
+#ifdef AESNI_CAPABLE
+	if (AESNI_CAPABLE) {
+		ccm_ctx->enc_str = (ccm128_f)aesni_ccm64_encrypt_blocks;
+		ccm_ctx->dec_str = (ccm128_f)aesni_ccm64_decrypt_blocks;
+	}
+#endif
+	ccm_ctx->tag_len = tag_len;
+	ctx->aead_state = ccm_ctx;
+
+	return 1;
+}
+
+static void
+aead_aes_ccm_cleanup(EVP_AEAD_CTX *ctx)
+{
+	struct aead_aes_ccm_ctx *ccm_ctx = ctx->aead_state;
+
+	freezero(ccm_ctx, sizeof(*ccm_ctx));
+}
+
+static int
+aead_aes_ccm_copy(EVP_AEAD_CTX *out, const EVP_AEAD_CTX *in)
+{
+	const struct aead_aes_ccm_ctx *ccm_ctx = in->aead_state;
+	struct aead_aes_ccm_ctx *ccm_out;
+
+	if ((ccm_out = malloc(sizeof(*ccm_out))) == NULL)
+		return 0;
+	memcpy(ccm_out, ccm_ctx, sizeof(*ccm_out));
+	ccm_out->ccm.key = &ccm_out->ks;
+	out->aead_state = ccm_out;
+
+	return 1;
+}
+
+static int
+aead_aes_ccm_seal(const EVP_AEAD_CTX *ctx, unsigned char *out,
+    size_t *out_len, size_t max_out_len, const unsigned char *nonce,
+    size_t nonce_len, const unsigned char *in, size_t in_len,
+    const unsigned char *ad, size_t ad_len)
+{
+	const struct aead_aes_ccm_ctx *ccm_ctx = ctx->aead_state;
+	CCM128_CONTEXT ccm;
+	int ret = 0;
+
+	if (in_len > EVP_AEAD_AES_CCM_MAX_LEN) {
+		EVPerror(EVP_R_TOO_LARGE);
+		return 0;
+	}
+
+	if (max_out_len < in_len + ccm_ctx->tag_len) {
+		EVPerror(EVP_R_BUFFER_TOO_SMALL);
+		return 0;
+	}
+
+	if (nonce_len != EVP_AEAD_AES_CCM_NONCE_LEN) {
+		EVPerror(EVP_R_INVALID_IV_LENGTH);
+		return 0;
+	}
+
+	memcpy(&ccm, &ccm_ctx->ccm, sizeof(ccm));
+
+	if (CRYPTO_ccm128_setiv(&ccm, nonce, nonce_len, in_len) != 0)
+		goto err;
+	CRYPTO_ccm128_aad(&ccm, ad, ad_len);
+	if (ccm_ctx->enc_str != NULL) {
+		if (CRYPTO_ccm128_encrypt_ccm64(&ccm, in, out, in_len,
+		    ccm_ctx->enc_str) != 0)
+			goto err;
+	} else {
+		if (CRYPTO_ccm128_encrypt(&ccm, in, out, in_len) != 0)
+			goto err;
+	}
+	if (CRYPTO_ccm128_tag(&ccm, out + in_len, ccm_ctx->tag_len) !=
+	    ccm_ctx->tag_len)
+		goto err;
+	*out_len = in_len + ccm_ctx->tag_len;
+
+	ret = 1;
+
+ err:
+	explicit_bzero(&ccm, sizeof(ccm));
+
+	return ret;
+}
+
+static int
+aead_aes_ccm_open(const EVP_AEAD_CTX *ctx, unsigned char *out,
+    size_t *out_len, size_t max_out_len, const unsigned char *nonce,
+    size_t nonce_len, const unsigned char *in, size_t in_len,
+    const unsigned char *ad, size_t ad_len)
+{
+	const struct aead_aes_ccm_ctx *ccm_ctx = ctx->aead_state;
+	unsigned char in_tag[EVP_AEAD_AES_CCM_MAX_TAG_LEN];
+	unsigned char tag[EVP_AEAD_AES_CCM_MAX_TAG_LEN];
+	CCM128_CONTEXT ccm;
+	size_t plaintext_len;
+	int ret = 0;
+
+	if (in_len < ccm_ctx->tag_len) {
+		EVPerror(EVP_R_BAD_DECRYPT);
+		return 0;
+	}
+
+	plaintext_len = in_len - ccm_ctx->tag_len;
+
+	if (plaintext_len > EVP_AEAD_AES_CCM_MAX_LEN) {
+		EVPerror(EVP_R_TOO_LARGE);
+		return 0;
+	}
+
+	if (max_out_len < plaintext_len) {
+		EVPerror(EVP_R_BUFFER_TOO_SMALL);
+		return 0;
+	}
+
+	if (nonce_len != EVP_AEAD_AES_CCM_NONCE_LEN) {
+		EVPerror(EVP_R_INVALID_IV_LENGTH);
+		return 0;
+	}
+
+	memcpy(in_tag, in + plaintext_len, ccm_ctx->tag_len);
+	memcpy(&ccm, &ccm_ctx->ccm, sizeof(ccm));
+
+	if (CRYPTO_ccm128_setiv(&ccm, nonce, nonce_len, plaintext_len) != 0)
+		goto err;
+	CRYPTO_ccm128_aad(&ccm, ad, ad_len);
+	if (ccm_ctx->dec_str != NULL) {
+		if (CRYPTO_ccm128_decrypt_ccm64(&ccm, in, out, plaintext_len,
+		    ccm_ctx->dec_str) != 0)
+			goto err;
+	} else {
+		if (CRYPTO_ccm128_decrypt(&ccm, in, out, plaintext_len) != 0)
+			goto err;
+	}
+	if (CRYPTO_ccm128_tag(&ccm, tag, ccm_ctx->tag_len) !=
+	    ccm_ctx->tag_len)
+		goto err;
+
+	if (timingsafe_memcmp(tag, in_tag, ccm_ctx->tag_len) != 0) {
+		explicit_bzero(out, plaintext_len);
+		EVPerror(EVP_R_BAD_DECRYPT);
+		goto err;
+	}
+
+	*out_len = plaintext_len;
+
+	ret = 1;
+
+ err:
+	explicit_bzero(&ccm, sizeof(ccm));
+
+	return ret;
+}
+
+static const EVP_AEAD aead_aes_128_ccm = {
+	.key_len = 16,
+	.nonce_len = EVP_AEAD_AES_CCM_NONCE_LEN,
+	.overhead = EVP_AEAD_AES_CCM_MAX_TAG_LEN,
+	.max_tag_len = EVP_AEAD_AES_CCM_MAX_TAG_LEN,
+
+	.init = aead_aes_ccm_init,
+	.cleanup = aead_aes_ccm_cleanup,
+	.copy = aead_aes_ccm_copy,
+	.seal = aead_aes_ccm_seal,
+	.open = aead_aes_ccm_open,
+};
+
+const EVP_AEAD *
+EVP_aead_aes_128_ccm(void)
+{
+	return &aead_aes_128_ccm;
+}
+
 typedef struct {
 	union {
 		double align;
@@ -1732,4 +2587,31 @@ EVP_aes_256_wrap(void)
 	return &aes_256_wrap;
 }
 
+const char *
+evp_aes_implementation(void)
+{
+#ifdef AESNI_CAPABLE
+	if (AESNI_CAPABLE)
+		return "aesni";
+#endif
+#ifdef ARMV8_AES_CAPABLE
+	if (ARMV8_AES_CAPABLE)
+		return "armv8";
+#endif
+#ifdef VPAES_CAPABLE
+	if (VPAES_CAPABLE) {
+#ifdef BSAES_CAPABLE
+		return "vpaes,bsaes";
+#else
+		return "vpaes";
+#endif
+	}
+#endif
+#ifdef AES_ASM
+	return "asm";
+#else
+	return "c";
+#endif
+}
+
 #endif
@@ -0,0 +1,292 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * AES in CBC mode with HMAC-SHA256, for sealing TLS records in one pass.
+ *
+ * The ctrl interface is that of EVP_aes_128_cbc_hmac_sha1(): the MAC key
+ * is set with EVP_CTRL_AEAD_SET_MAC_KEY and each record is preceded by
+ * EVP_CTRL_AEAD_TLS1_AAD, which returns the length of the HMAC and padding
+ * that EVP_Cipher() appends to the payload. Only encryption is supported in
+ * this mode, since opening a record needs the constant time MAC check of
+ * the TLS record layer.
+ */
+
+#include <string.h>
+
+#include <openssl/opensslconf.h>
+
+#if !defined(OPENSSL_NO_AES) && !defined(OPENSSL_NO_SHA256)
+
+#include <openssl/evp.h>
+#include <openssl/objects.h>
+#include <openssl/aes.h>
+#include <openssl/sha.h>
+#include "evp_locl.h"
+
+#define TLS1_1_VERSION 0x0302
+
+typedef struct {
+	AES_KEY		ks;
+	SHA256_CTX	head, tail, md;
+	size_t		payload_length;
+	unsigned int	tls_ver;
+} EVP_AES_HMAC_SHA256;
+
+#define NO_PAYLOAD_LENGTH	((size_t)-1)
+
+/*
+ * The payload is hashed and encrypted in chunks that are small enough to
+ * still be in the first level cache when they are encrypted, so each byte
+ * of the record is only read from memory once.
+ */
+#define AES_HMAC_SHA256_CHUNK	1024
+
+#if	defined(AES_ASM) &&	( \
+	defined(__x86_64)	|| defined(__x86_64__)	|| \
+	defined(_M_AMD64)	|| defined(_M_X64)	|| \
+	defined(__INTEL__)	)
+
+#include "x86_arch.h"
+
+int aesni_set_encrypt_key(const unsigned char *userKey, int bits, AES_KEY *key);
+int aesni_set_decrypt_key(const unsigned char *userKey, int bits, AES_KEY *key);
+
+void aesni_cbc_encrypt(const unsigned char *in, unsigned char *out,
+    size_t length, const AES_KEY *key, unsigned char *ivec, int enc);
+
+#define data(ctx) ((EVP_AES_HMAC_SHA256 *)(ctx)->cipher_data)
+
+static int
+aesni_cbc_hmac_sha256_init_key(EVP_CIPHER_CTX *ctx, const unsigned char *inkey,
+    const unsigned char *iv, int enc)
+{
+	EVP_AES_HMAC_SHA256 *key = data(ctx);
+	int ret;
+
+	if (enc)
+		ret = aesni_set_encrypt_key(inkey, ctx->key_len * 8, &key->ks);
+	else
+		ret = aesni_set_decrypt_key(inkey, ctx->key_len * 8, &key->ks);
+
+	SHA256_Init(&key->head);
+	key->tail = key->head;
+	key->md = key->head;
+
+	key->payload_length = NO_PAYLOAD_LENGTH;
+
+	return ret < 0 ? 0 : 1;
+}
+
+static int
+aesni_cbc_hmac_sha256_cipher(EVP_CIPHER_CTX *ctx, unsigned char *out,
+    const unsigned char *in, size_t len)
+{
+	EVP_AES_HMAC_SHA256 *key = data(ctx);
+	size_t plen = key->payload_length,
+	    iv = 0,		/* explicit IV in TLS 1.1 and later */
+	    off, sha_off, n;
+	unsigned int l;
+
+	key->payload_length = NO_PAYLOAD_LENGTH;
+
+	if (len % AES_BLOCK_SIZE)
+		return 0;
+
+	if (!ctx->encrypt) {
+		aesni_cbc_encrypt(in, out, len, &key->ks, ctx->iv, 0);
+		SHA256_Update(&key->md, out, len);
+		return 1;
+	}
+
+	if (plen == NO_PAYLOAD_LENGTH)
+		plen = len;
+	else if (len != ((plen + SHA256_DIGEST_LENGTH + AES_BLOCK_SIZE) &
+	    -AES_BLOCK_SIZE))
+		return 0;
+	else if (key->tls_ver >= TLS1_1_VERSION)
+		iv = AES_BLOCK_SIZE;
+
+	/* Hash each chunk of whole payload blocks, then encrypt it. */
+	for (off = 0; plen - off >= AES_BLOCK_SIZE; off += n) {
+		n = (plen - off) & -AES_BLOCK_SIZE;
+		if (n > AES_HMAC_SHA256_CHUNK)
+			n = AES_HMAC_SHA256_CHUNK;
+		sha_off = off > iv ? off : iv;
+		if (off + n > sha_off)
+			SHA256_Update(&key->md, in + sha_off,
+			    off + n - sha_off);
+		aesni_cbc_encrypt(in + off, out + off, n, &key->ks,
+		    ctx->iv, 1);
+	}
+
+	if (plen == len)
+		return 1;
+
+	/* "TLS" mode of operation */
+	if (in != out)
+		memcpy(out + off, in + off, plen - off);
+	sha_off = off > iv ? off : iv;
+	SHA256_Update(&key->md, out + sha_off, plen - sha_off);
+
+	/* calculate HMAC and append it to payload */
+	SHA256_Final(out + plen, &key->md);
+	key->md = key->tail;
+	SHA256_Update(&key->md, out + plen, SHA256_DIGEST_LENGTH);
+	SHA256_Final(out + plen, &key->md);
+
+	/* pad the payload|hmac */
+	plen += SHA256_DIGEST_LENGTH;
+	for (l = len - plen - 1; plen < len; plen++)
+		out[plen] = l;
+
+	/* encrypt the rest of the payload, the HMAC and padding at once */
+	aesni_cbc_encrypt(out + off, out + off, len - off, &key->ks,
+	    ctx->iv, 1);
+
+	return 1;
+}
+
+static int
+aesni_cbc_hmac_sha256_ctrl(EVP_CIPHER_CTX *ctx, int type, int arg, void *ptr)
+{
+	EVP_AES_HMAC_SHA256 *key = data(ctx);
+
+	switch (type) {
+	case EVP_CTRL_AEAD_SET_MAC_KEY:
+		{
+			unsigned int  i;
+			unsigned char hmac_key[64];
+
+			if (arg < 0)
+				return -1;
+
+			memset(hmac_key, 0, sizeof(hmac_key));
+
+			if (arg > (int)sizeof(hmac_key)) {
+				SHA256_Init(&key->head);
+				SHA256_Update(&key->head, ptr, arg);
+				SHA256_Final(hmac_key, &key->head);
+			} else {
+				memcpy(hmac_key, ptr, arg);
+			}
+
+			for (i = 0; i < sizeof(hmac_key); i++)
+				hmac_key[i] ^= 0x36;		/* ipad */
+			SHA256_Init(&key->head);
+			SHA256_Update(&key->head, hmac_key, sizeof(hmac_key));
+
+			for (i = 0; i < sizeof(hmac_key); i++)
+				hmac_key[i] ^= 0x36 ^ 0x5c;	/* opad */
+			SHA256_Init(&key->tail);
+			SHA256_Update(&key->tail, hmac_key, sizeof(hmac_key));
+
+			explicit_bzero(hmac_key, sizeof(hmac_key));
+
+			return 1;
+		}
+	case EVP_CTRL_AEAD_TLS1_AAD:
+		{
+			unsigned char *p = ptr;
+			unsigned int len, tls_ver;
+
+			/* RFC 5246, 6.2.3.3: additional data has length 13 */
+			if (arg != 13)
+				return -1;
+
+			/* Records are opened by the TLS record layer. */
+			if (!ctx->encrypt)
+				return -1;
+
+			len = p[arg - 2] << 8 | p[arg - 1];
+
+			if ((tls_ver = p[arg - 4] << 8 | p[arg - 3]) >=
+			    TLS1_1_VERSION) {
+				if (len < AES_BLOCK_SIZE)
+					return -1;
+				key->payload_length = len;
+				len -= AES_BLOCK_SIZE;
+				p[arg - 2] = len >> 8;
+				p[arg - 1] = len;
+			} else
+				key->payload_length = len;
+			key->tls_ver = tls_ver;
+
+			key->md = key->head;
+			SHA256_Update(&key->md, p, arg);
+
+			return (int)(((len + SHA256_DIGEST_LENGTH +
+			    AES_BLOCK_SIZE) & -AES_BLOCK_SIZE) - len);
+		}
+	default:
+		return -1;
+	}
+}
+
+static EVP_CIPHER aesni_128_cbc_hmac_sha256_cipher = {
+	.nid = NID_aes_128_cbc_hmac_sha256,
+	.block_size = 16,
+	.key_len = 16,
+	.iv_len = 16,
+	.flags = EVP_CIPH_CBC_MODE | EVP_CIPH_FLAG_DEFAULT_ASN1 |
+	    EVP_CIPH_FLAG_AEAD_CIPHER,
+	.init = aesni_cbc_hmac_sha256_init_key,
+	.do_cipher = aesni_cbc_hmac_sha256_cipher,
+	.ctx_size = sizeof(EVP_AES_HMAC_SHA256),
+	.ctrl = aesni_cbc_hmac_sha256_ctrl
+};
+
+static EVP_CIPHER aesni_256_cbc_hmac_sha256_cipher = {
+	.nid = NID_aes_256_cbc_hmac_sha256,
+	.block_size = 16,
+	.key_len = 32,
+	.iv_len = 16,
+	.flags = EVP_CIPH_CBC_MODE | EVP_CIPH_FLAG_DEFAULT_ASN1 |
+	    EVP_CIPH_FLAG_AEAD_CIPHER,
+	.init = aesni_cbc_hmac_sha256_init_key,
+	.do_cipher = aesni_cbc_hmac_sha256_cipher,
+	.ctx_size = sizeof(EVP_AES_HMAC_SHA256),
+	.ctrl = aesni_cbc_hmac_sha256_ctrl
+};
+
+const EVP_CIPHER *
+EVP_aes_128_cbc_hmac_sha256(void)
+{
+	return (OPENSSL_cpu_caps() & CPUCAP_MASK_AESNI) ?
+	    &aesni_128_cbc_hmac_sha256_cipher : NULL;
+}
+
+const EVP_CIPHER *
+EVP_aes_256_cbc_hmac_sha256(void)
+{
+	return (OPENSSL_cpu_caps() & CPUCAP_MASK_AESNI) ?
+	    &aesni_256_cbc_hmac_sha256_cipher : NULL;
+}
+#else
+const EVP_CIPHER *
+EVP_aes_128_cbc_hmac_sha256(void)
+{
+	return NULL;
+}
+
+const EVP_CIPHER *
+EVP_aes_256_cbc_hmac_sha256(void)
+{
+	return NULL;
+}
+#endif
+#endif
@@ -61,6 +61,8 @@
 #include <openssl/evp.h>
 #include <openssl/err.h>
 #include <openssl/camellia.h>
+
+#include "cmll_locl.h"
 #include "evp_locl.h"
 
 static int camellia_init_key(EVP_CIPHER_CTX *ctx, const unsigned char *key,
@@ -74,24 +76,88 @@ typedef struct {
 /* Attribute operation for Camellia */
 #define data(ctx)	EVP_C_DATA(EVP_CAMELLIA_KEY,ctx)
 
-IMPLEMENT_BLOCK_CIPHER(camellia_128, ks, Camellia, EVP_CAMELLIA_KEY,
-    NID_camellia_128, 16, 16, 16, 128,
-    0, camellia_init_key, NULL,
-    EVP_CIPHER_set_asn1_iv,
-    EVP_CIPHER_get_asn1_iv,
-    NULL)
-IMPLEMENT_BLOCK_CIPHER(camellia_192, ks, Camellia, EVP_CAMELLIA_KEY,
-    NID_camellia_192, 16, 24, 16, 128,
-    0, camellia_init_key, NULL,
-    EVP_CIPHER_set_asn1_iv,
-    EVP_CIPHER_get_asn1_iv,
-    NULL)
-IMPLEMENT_BLOCK_CIPHER(camellia_256, ks, Camellia, EVP_CAMELLIA_KEY,
-    NID_camellia_256, 16, 32, 16, 128,
-    0, camellia_init_key, NULL,
-    EVP_CIPHER_set_asn1_iv,
-    EVP_CIPHER_get_asn1_iv,
-    NULL)
+static int
+camellia_ecb_cipher(EVP_CIPHER_CTX *ctx, unsigned char *out,
+    const unsigned char *in, size_t inl)
+{
+	const CAMELLIA_KEY *key = &data(ctx)->ks;
+	size_t i;
+
+#ifdef CAMELLIA_AESNI
+	if (camellia_aesni_capable()) {
+		camellia_aesni_ecb_encrypt(in, out, inl / CAMELLIA_BLOCK_SIZE,
+		    key, ctx->encrypt);
+		return 1;
+	}
+#endif
+	for (i = 0; inl - i >= CAMELLIA_BLOCK_SIZE; i += CAMELLIA_BLOCK_SIZE)
+		Camellia_ecb_encrypt(in + i, out + i, key, ctx->encrypt);
+
+	return 1;
+}
+
+static void
+camellia_cbc_chunk(EVP_CIPHER_CTX *ctx, unsigned char *out,
+    const unsigned char *in, size_t len)
+{
+	const CAMELLIA_KEY *key = &data(ctx)->ks;
+#ifdef CAMELLIA_AESNI
+	size_t n;
+
+	/* Decryption is parallel across blocks, encryption is not. */
+	if (!ctx->encrypt && camellia_aesni_capable()) {
+		n = len & ~(size_t)(CAMELLIA_BLOCK_SIZE - 1);
+		camellia_aesni_cbc_decrypt(in, out, n / CAMELLIA_BLOCK_SIZE,
+		    key, ctx->iv);
+		in += n;
+		out += n;
+		len -= n;
+		if (len == 0)
+			return;
+	}
+#endif
+	Camellia_cbc_encrypt(in, out, len, key, ctx->iv, ctx->encrypt);
+}
+
+static int
+camellia_cbc_cipher(EVP_CIPHER_CTX *ctx, unsigned char *out,
+    const unsigned char *in, size_t inl)
+{
+	while (inl >= EVP_MAXCHUNK) {
+		camellia_cbc_chunk(ctx, out, in, EVP_MAXCHUNK);
+		inl -= EVP_MAXCHUNK;
+		in += EVP_MAXCHUNK;
+		out += EVP_MAXCHUNK;
+	}
+	if (inl)
+		camellia_cbc_chunk(ctx, out, in, inl);
+
+	return 1;
+}
+
+/* The key sizes share the ECB and CBC functions. */
+#define camellia_128_ecb_cipher	camellia_ecb_cipher
+#define camellia_192_ecb_cipher	camellia_ecb_cipher
+#define camellia_256_ecb_cipher	camellia_ecb_cipher
+#define camellia_128_cbc_cipher	camellia_cbc_cipher
+#define camellia_192_cbc_cipher	camellia_cbc_cipher
+#define camellia_256_cbc_cipher	camellia_cbc_cipher
+
+#define IMPLEMENT_CAMELLIA(ksize) \
+	BLOCK_CIPHER_func_cfb(camellia_##ksize, Camellia, 128, \
+	    EVP_CAMELLIA_KEY, ks) \
+	BLOCK_CIPHER_func_ofb(camellia_##ksize, Camellia, 128, \
+	    EVP_CAMELLIA_KEY, ks) \
+	BLOCK_CIPHER_defs(camellia_##ksize, EVP_CAMELLIA_KEY, \
+	    NID_camellia_##ksize, 16, ksize / 8, 16, 128, \
+	    0, camellia_init_key, NULL, \
+	    EVP_CIPHER_set_asn1_iv, \
+	    EVP_CIPHER_get_asn1_iv, \
+	    NULL)
+
+IMPLEMENT_CAMELLIA(128)
+IMPLEMENT_CAMELLIA(192)
+IMPLEMENT_CAMELLIA(256)
 
 #define IMPLEMENT_CAMELLIA_CFBR(ksize,cbits)	IMPLEMENT_CFBR(camellia,Camellia,EVP_CAMELLIA_KEY,ks,ksize,cbits,16)
 
@@ -17,6 +17,9 @@
  * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <sys/types.h>
+#include <sys/uio.h>
+
 #include <stdint.h>
 #include <string.h>
 
@@ -80,33 +83,46 @@ aead_chacha20_poly1305_cleanup(EVP_AEAD_CTX *ctx)
 	freezero(c20_ctx, sizeof(*c20_ctx));
 }
 
+static int
+aead_chacha20_poly1305_copy(EVP_AEAD_CTX *out, const EVP_AEAD_CTX *in)
+{
+	const struct aead_chacha20_poly1305_ctx *c20_ctx = in->aead_state;
+	struct aead_chacha20_poly1305_ctx *c20_out;
+
+	if ((c20_out = malloc(sizeof(*c20_out))) == NULL)
+		return 0;
+	memcpy(c20_out, c20_ctx, sizeof(*c20_out));
+	out->aead_state = c20_out;
+
+	return 1;
+}
+
+/*
+ * Authenticate the lengths of the additional data and the ciphertext, as a
+ * single block of two little endian 64-bit values.
+ */
 static void
-poly1305_update_with_length(poly1305_state *poly1305,
-    const unsigned char *data, size_t data_len)
+poly1305_update_lengths(poly1305_state *poly1305, size_t ad_len,
+    size_t data_len)
 {
-	size_t j = data_len;
-	unsigned char length_bytes[8];
+	unsigned char length_bytes[16];
+	uint64_t ad_len_64 = ad_len, data_len_64 = data_len;
 	unsigned i;
 
-	for (i = 0; i < sizeof(length_bytes); i++) {
-		length_bytes[i] = j;
-		j >>= 8;
+	for (i = 0; i < 8; i++) {
+		length_bytes[i] = ad_len_64 >> (i * 8);
+		length_bytes[i + 8] = data_len_64 >> (i * 8);
 	}
 
-	if (data != NULL)
-		CRYPTO_poly1305_update(poly1305, data, data_len);
 	CRYPTO_poly1305_update(poly1305, length_bytes, sizeof(length_bytes));
 }
 
 static void
-poly1305_update_with_pad16(poly1305_state *poly1305,
-    const unsigned char *data, size_t data_len)
+poly1305_pad16(poly1305_state *poly1305, size_t data_len)
 {
 	static const unsigned char zero_pad16[16];
 	size_t pad_len;
 
-	CRYPTO_poly1305_update(poly1305, data, data_len);
-
 	/* pad16() is defined in RFC 7539 2.8.1. */
 	if ((pad_len = data_len % 16) == 0)
 		return;
@@ -114,18 +130,63 @@ poly1305_update_with_pad16(poly1305_state *poly1305,
 	CRYPTO_poly1305_update(poly1305, zero_pad16, 16 - pad_len);
 }
 
+static void
+poly1305_update_iov_with_pad16(poly1305_state *poly1305,
+    const struct iovec *iov, int iovcnt, size_t data_len)
+{
+	int i;
+
+	for (i = 0; i < iovcnt; i++)
+		CRYPTO_poly1305_update(poly1305, iov[i].iov_base,
+		    iov[i].iov_len);
+
+	poly1305_pad16(poly1305, data_len);
+}
+
+/*
+ * Set up the ChaCha20 state and Poly1305 key for the given key, IV and upper
+ * 32-bits of the block counter. The Poly1305 key is produced from block zero,
+ * leaving the ChaCha20 state positioned at block one, ready for the payload.
+ */
+static void
+chacha20_poly1305_setup(ChaCha_ctx *chacha, poly1305_state *poly1305,
+    const unsigned char key[32], const unsigned char iv[CHACHA20_IV_LEN],
+    const unsigned char *ctr_high)
+{
+	unsigned char poly1305_key[64];
+	unsigned char ctr[8];
+
+	memset(ctr, 0, sizeof(ctr));
+	if (ctr_high != NULL)
+		memcpy(&ctr[4], ctr_high, 4);
+
+	ChaCha_set_key(chacha, key, 256);
+	ChaCha_set_iv(chacha, iv, ctr);
+
+	/* Consume all of block zero, so that the payload starts at block one. */
+	memset(poly1305_key, 0, sizeof(poly1305_key));
+	ChaCha(chacha, poly1305_key, poly1305_key, sizeof(poly1305_key));
+	CRYPTO_poly1305_init(poly1305, poly1305_key);
+
+	explicit_bzero(poly1305_key, sizeof(poly1305_key));
+}
+
 static int
-aead_chacha20_poly1305_seal(const EVP_AEAD_CTX *ctx, unsigned char *out,
-    size_t *out_len, size_t max_out_len, const unsigned char *nonce,
-    size_t nonce_len, const unsigned char *in, size_t in_len,
-    const unsigned char *ad, size_t ad_len)
+chacha20_poly1305_seal(ChaCha_ctx *chacha, poly1305_state *poly1305,
+    size_t tag_len, unsigned char *out, size_t *out_len, size_t max_out_len,
+    const struct iovec *in_iov, int in_iovcnt, const struct iovec *ad_iov,
+    int ad_iovcnt)
 {
-	const struct aead_chacha20_poly1305_ctx *c20_ctx = ctx->aead_state;
-	unsigned char poly1305_key[32];
-	poly1305_state poly1305;
-	const unsigned char *iv;
-	const uint64_t in_len_64 = in_len;
-	uint64_t ctr;
+	unsigned char tag[POLY1305_TAG_LEN];
+	size_t ad_len, in_len, offset;
+	uint64_t in_len_64;
+	int i;
+
+	if (!evp_aead_iov_len(in_iov, in_iovcnt, &in_len) ||
+	    !evp_aead_iov_len(ad_iov, ad_iovcnt, &ad_len)) {
+		EVPerror(EVP_R_TOO_LARGE);
+		return 0;
+	}
 
 	/* The underlying ChaCha implementation may not overflow the block
 	 * counter into the second counter word. Therefore we disallow
@@ -134,65 +195,62 @@ aead_chacha20_poly1305_seal(const EVP_AEAD_CTX *ctx, unsigned char *out,
 	 * 32-bits and this produces a warning because it's always false.
 	 * Casting to uint64_t inside the conditional is not sufficient to stop
 	 * the warning. */
+	in_len_64 = in_len;
 	if (in_len_64 >= (1ULL << 32) * 64 - 64) {
 		EVPerror(EVP_R_TOO_LARGE);
 		return 0;
 	}
 
-	if (max_out_len < in_len + c20_ctx->tag_len) {
+	if (max_out_len < in_len + tag_len) {
 		EVPerror(EVP_R_BUFFER_TOO_SMALL);
 		return 0;
 	}
 
-	if (nonce_len != ctx->aead->nonce_len) {
-		EVPerror(EVP_R_IV_TOO_LARGE);
-		return 0;
+	poly1305_update_iov_with_pad16(poly1305, ad_iov, ad_iovcnt, ad_len);
+
+	for (i = 0, offset = 0; i < in_iovcnt; i++) {
+		ChaCha(chacha, out + offset, in_iov[i].iov_base,
+		    in_iov[i].iov_len);
+		offset += in_iov[i].iov_len;
 	}
+	CRYPTO_poly1305_update(poly1305, out, in_len);
+	poly1305_pad16(poly1305, in_len);
 
-	ctr = (uint64_t)((uint32_t)(nonce[0]) | (uint32_t)(nonce[1]) << 8 |
-	    (uint32_t)(nonce[2]) << 16 | (uint32_t)(nonce[3]) << 24) << 32;
-	iv = nonce + CHACHA20_CONSTANT_LEN;
+	poly1305_update_lengths(poly1305, ad_len, in_len);
 
-	memset(poly1305_key, 0, sizeof(poly1305_key));
-	CRYPTO_chacha_20(poly1305_key, poly1305_key,
-	    sizeof(poly1305_key), c20_ctx->key, iv, ctr);
-
-	CRYPTO_poly1305_init(&poly1305, poly1305_key);
-	poly1305_update_with_pad16(&poly1305, ad, ad_len);
-	CRYPTO_chacha_20(out, in, in_len, c20_ctx->key, iv, ctr + 1);
-	poly1305_update_with_pad16(&poly1305, out, in_len);
-	poly1305_update_with_length(&poly1305, NULL, ad_len);
-	poly1305_update_with_length(&poly1305, NULL, in_len);
-
-	if (c20_ctx->tag_len != POLY1305_TAG_LEN) {
-		unsigned char tag[POLY1305_TAG_LEN];
-		CRYPTO_poly1305_finish(&poly1305, tag);
-		memcpy(out + in_len, tag, c20_ctx->tag_len);
-		*out_len = in_len + c20_ctx->tag_len;
+	if (tag_len != POLY1305_TAG_LEN) {
+		CRYPTO_poly1305_finish(poly1305, tag);
+		memcpy(out + in_len, tag, tag_len);
+		*out_len = in_len + tag_len;
 		return 1;
 	}
 
-	CRYPTO_poly1305_finish(&poly1305, out + in_len);
+	CRYPTO_poly1305_finish(poly1305, out + in_len);
 	*out_len = in_len + POLY1305_TAG_LEN;
 	return 1;
 }
 
 static int
-aead_chacha20_poly1305_open(const EVP_AEAD_CTX *ctx, unsigned char *out,
-    size_t *out_len, size_t max_out_len, const unsigned char *nonce,
-    size_t nonce_len, const unsigned char *in, size_t in_len,
-    const unsigned char *ad, size_t ad_len)
+chacha20_poly1305_open(ChaCha_ctx *chacha, poly1305_state *poly1305,
+    size_t tag_len, unsigned char *out, size_t *out_len, size_t max_out_len,
+    const struct iovec *in_iov, int in_iovcnt, const struct iovec *ad_iov,
+    int ad_iovcnt)
 {
-	const struct aead_chacha20_poly1305_ctx *c20_ctx = ctx->aead_state;
 	unsigned char mac[POLY1305_TAG_LEN];
-	unsigned char poly1305_key[32];
-	const unsigned char *iv = nonce;
-	poly1305_state poly1305;
-	const uint64_t in_len_64 = in_len;
-	size_t plaintext_len;
-	uint64_t ctr = 0;
+	unsigned char tag[POLY1305_TAG_LEN];
+	size_t ad_len, in_len, plaintext_len;
+	size_t len, offset, tag_offset;
+	const unsigned char *in;
+	uint64_t in_len_64;
+	int i;
+
+	if (!evp_aead_iov_len(in_iov, in_iovcnt, &in_len) ||
+	    !evp_aead_iov_len(ad_iov, ad_iovcnt, &ad_len)) {
+		EVPerror(EVP_R_TOO_LARGE);
+		return 0;
+	}
 
-	if (in_len < c20_ctx->tag_len) {
+	if (in_len < tag_len) {
 		EVPerror(EVP_R_BAD_DECRYPT);
 		return 0;
 	}
@@ -204,149 +262,230 @@ aead_chacha20_poly1305_open(const EVP_AEAD_CTX *ctx, unsigned char *out,
 	 * 32-bits and this produces a warning because it's always false.
 	 * Casting to uint64_t inside the conditional is not sufficient to stop
 	 * the warning. */
+	in_len_64 = in_len;
 	if (in_len_64 >= (1ULL << 32) * 64 - 64) {
 		EVPerror(EVP_R_TOO_LARGE);
 		return 0;
 	}
 
-	if (nonce_len != ctx->aead->nonce_len) {
-		EVPerror(EVP_R_IV_TOO_LARGE);
-		return 0;
-	}
-
-	plaintext_len = in_len - c20_ctx->tag_len;
+	plaintext_len = in_len - tag_len;
 
 	if (max_out_len < plaintext_len) {
 		EVPerror(EVP_R_BUFFER_TOO_SMALL);
 		return 0;
 	}
 
-	ctr = (uint64_t)((uint32_t)(nonce[0]) | (uint32_t)(nonce[1]) << 8 |
-	    (uint32_t)(nonce[2]) << 16 | (uint32_t)(nonce[3]) << 24) << 32;
-	iv = nonce + CHACHA20_CONSTANT_LEN;
-
-	memset(poly1305_key, 0, sizeof(poly1305_key));
-	CRYPTO_chacha_20(poly1305_key, poly1305_key,
-	    sizeof(poly1305_key), c20_ctx->key, iv, ctr);
+	poly1305_update_iov_with_pad16(poly1305, ad_iov, ad_iovcnt, ad_len);
+
+	/*
+	 * Authenticate the ciphertext, collecting the tag as we go since it
+	 * may span multiple fragments.
+	 */
+	for (i = 0, offset = 0, tag_offset = 0; i < in_iovcnt; i++) {
+		in = in_iov[i].iov_base;
+		len = in_iov[i].iov_len;
+		if (offset < plaintext_len) {
+			if (len > plaintext_len - offset)
+				len = plaintext_len - offset;
+			CRYPTO_poly1305_update(poly1305, in, len);
+			offset += len;
+			in += len;
+			len = in_iov[i].iov_len - len;
+		}
+		memcpy(&tag[tag_offset], in, len);
+		tag_offset += len;
+	}
+	poly1305_pad16(poly1305, plaintext_len);
 
-	CRYPTO_poly1305_init(&poly1305, poly1305_key);
-	poly1305_update_with_pad16(&poly1305, ad, ad_len);
-	poly1305_update_with_pad16(&poly1305, in, plaintext_len);
-	poly1305_update_with_length(&poly1305, NULL, ad_len);
-	poly1305_update_with_length(&poly1305, NULL, plaintext_len);
+	poly1305_update_lengths(poly1305, ad_len, plaintext_len);
 
-	CRYPTO_poly1305_finish(&poly1305, mac);
+	CRYPTO_poly1305_finish(poly1305, mac);
 
-	if (timingsafe_memcmp(mac, in + plaintext_len, c20_ctx->tag_len) != 0) {
+	if (timingsafe_memcmp(mac, tag, tag_len) != 0) {
 		EVPerror(EVP_R_BAD_DECRYPT);
 		return 0;
 	}
 
-	CRYPTO_chacha_20(out, in, plaintext_len, c20_ctx->key, iv, ctr + 1);
+	for (i = 0, offset = 0; i < in_iovcnt && offset < plaintext_len; i++) {
+		len = in_iov[i].iov_len;
+		if (len > plaintext_len - offset)
+			len = plaintext_len - offset;
+		ChaCha(chacha, out + offset, in_iov[i].iov_base, len);
+		offset += len;
+	}
+
 	*out_len = plaintext_len;
 	return 1;
 }
 
 static int
-aead_xchacha20_poly1305_seal(const EVP_AEAD_CTX *ctx, unsigned char *out,
+aead_chacha20_poly1305_seal_iov(const EVP_AEAD_CTX *ctx, unsigned char *out,
     size_t *out_len, size_t max_out_len, const unsigned char *nonce,
-    size_t nonce_len, const unsigned char *in, size_t in_len,
-    const unsigned char *ad, size_t ad_len)
+    size_t nonce_len, const struct iovec *in_iov, int in_iovcnt,
+    const struct iovec *ad_iov, int ad_iovcnt)
 {
 	const struct aead_chacha20_poly1305_ctx *c20_ctx = ctx->aead_state;
-	unsigned char poly1305_key[32];
-	unsigned char subkey[32];
 	poly1305_state poly1305;
+	ChaCha_ctx chacha;
+	int ret;
 
-	if (max_out_len < in_len + c20_ctx->tag_len) {
-		EVPerror(EVP_R_BUFFER_TOO_SMALL);
+	if (nonce_len != ctx->aead->nonce_len) {
+		EVPerror(EVP_R_IV_TOO_LARGE);
 		return 0;
 	}
 
+	chacha20_poly1305_setup(&chacha, &poly1305, c20_ctx->key,
+	    nonce + CHACHA20_CONSTANT_LEN, nonce);
+
+	ret = chacha20_poly1305_seal(&chacha, &poly1305, c20_ctx->tag_len,
+	    out, out_len, max_out_len, in_iov, in_iovcnt, ad_iov, ad_iovcnt);
+
+	explicit_bzero(&chacha, sizeof(chacha));
+	explicit_bzero(&poly1305, sizeof(poly1305));
+
+	return ret;
+}
+
+static int
+aead_chacha20_poly1305_open_iov(const EVP_AEAD_CTX *ctx, unsigned char *out,
+    size_t *out_len, size_t max_out_len, const unsigned char *nonce,
+    size_t nonce_len, const struct iovec *in_iov, int in_iovcnt,
+    const struct iovec *ad_iov, int ad_iovcnt)
+{
+	const struct aead_chacha20_poly1305_ctx *c20_ctx = ctx->aead_state;
+	poly1305_state poly1305;
+	ChaCha_ctx chacha;
+	int ret;
+
 	if (nonce_len != ctx->aead->nonce_len) {
 		EVPerror(EVP_R_IV_TOO_LARGE);
 		return 0;
 	}
 
-	CRYPTO_hchacha_20(subkey, c20_ctx->key, nonce);
+	chacha20_poly1305_setup(&chacha, &poly1305, c20_ctx->key,
+	    nonce + CHACHA20_CONSTANT_LEN, nonce);
 
-	CRYPTO_chacha_20(out, in, in_len, subkey, nonce + 16, 1);
+	ret = chacha20_poly1305_open(&chacha, &poly1305, c20_ctx->tag_len,
+	    out, out_len, max_out_len, in_iov, in_iovcnt, ad_iov, ad_iovcnt);
 
-	memset(poly1305_key, 0, sizeof(poly1305_key));
-	CRYPTO_chacha_20(poly1305_key, poly1305_key, sizeof(poly1305_key),
-	    subkey, nonce + 16, 0);
-
-	CRYPTO_poly1305_init(&poly1305, poly1305_key);
-	poly1305_update_with_pad16(&poly1305, ad, ad_len);
-	poly1305_update_with_pad16(&poly1305, out, in_len);
-	poly1305_update_with_length(&poly1305, NULL, ad_len);
-	poly1305_update_with_length(&poly1305, NULL, in_len);
-
-	if (c20_ctx->tag_len != POLY1305_TAG_LEN) {
-		unsigned char tag[POLY1305_TAG_LEN];
-		CRYPTO_poly1305_finish(&poly1305, tag);
-		memcpy(out + in_len, tag, c20_ctx->tag_len);
-		*out_len = in_len + c20_ctx->tag_len;
-		return 1;
-	}
+	explicit_bzero(&chacha, sizeof(chacha));
+	explicit_bzero(&poly1305, sizeof(poly1305));
 
-	CRYPTO_poly1305_finish(&poly1305, out + in_len);
-	*out_len = in_len + POLY1305_TAG_LEN;
-	return 1;
+	return ret;
 }
 
 static int
-aead_xchacha20_poly1305_open(const EVP_AEAD_CTX *ctx, unsigned char *out,
+aead_chacha20_poly1305_seal(const EVP_AEAD_CTX *ctx, unsigned char *out,
     size_t *out_len, size_t max_out_len, const unsigned char *nonce,
     size_t nonce_len, const unsigned char *in, size_t in_len,
     const unsigned char *ad, size_t ad_len)
+{
+	struct iovec in_iov = { (void *)in, in_len };
+	struct iovec ad_iov = { (void *)ad, ad_len };
+
+	return aead_chacha20_poly1305_seal_iov(ctx, out, out_len, max_out_len,
+	    nonce, nonce_len, &in_iov, 1, &ad_iov, 1);
+}
+
+static int
+aead_chacha20_poly1305_open(const EVP_AEAD_CTX *ctx, unsigned char *out,
+    size_t *out_len, size_t max_out_len, const unsigned char *nonce,
+    size_t nonce_len, const unsigned char *in, size_t in_len,
+    const unsigned char *ad, size_t ad_len)
+{
+	struct iovec in_iov = { (void *)in, in_len };
+	struct iovec ad_iov = { (void *)ad, ad_len };
+
+	return aead_chacha20_poly1305_open_iov(ctx, out, out_len, max_out_len,
+	    nonce, nonce_len, &in_iov, 1, &ad_iov, 1);
+}
+
+static int
+aead_xchacha20_poly1305_seal_iov(const EVP_AEAD_CTX *ctx, unsigned char *out,
+    size_t *out_len, size_t max_out_len, const unsigned char *nonce,
+    size_t nonce_len, const struct iovec *in_iov, int in_iovcnt,
+    const struct iovec *ad_iov, int ad_iovcnt)
 {
 	const struct aead_chacha20_poly1305_ctx *c20_ctx = ctx->aead_state;
-	unsigned char mac[POLY1305_TAG_LEN];
-	unsigned char poly1305_key[32];
 	unsigned char subkey[32];
 	poly1305_state poly1305;
-	size_t plaintext_len;
-
-	if (in_len < c20_ctx->tag_len) {
-		EVPerror(EVP_R_BAD_DECRYPT);
-		return 0;
-	}
+	ChaCha_ctx chacha;
+	int ret;
 
 	if (nonce_len != ctx->aead->nonce_len) {
 		EVPerror(EVP_R_IV_TOO_LARGE);
 		return 0;
 	}
 
-	plaintext_len = in_len - c20_ctx->tag_len;
+	CRYPTO_hchacha_20(subkey, c20_ctx->key, nonce);
 
-	if (max_out_len < plaintext_len) {
-		EVPerror(EVP_R_BUFFER_TOO_SMALL);
+	chacha20_poly1305_setup(&chacha, &poly1305, subkey, nonce + 16, NULL);
+
+	ret = chacha20_poly1305_seal(&chacha, &poly1305, c20_ctx->tag_len,
+	    out, out_len, max_out_len, in_iov, in_iovcnt, ad_iov, ad_iovcnt);
+
+	explicit_bzero(subkey, sizeof(subkey));
+	explicit_bzero(&chacha, sizeof(chacha));
+	explicit_bzero(&poly1305, sizeof(poly1305));
+
+	return ret;
+}
+
+static int
+aead_xchacha20_poly1305_open_iov(const EVP_AEAD_CTX *ctx, unsigned char *out,
+    size_t *out_len, size_t max_out_len, const unsigned char *nonce,
+    size_t nonce_len, const struct iovec *in_iov, int in_iovcnt,
+    const struct iovec *ad_iov, int ad_iovcnt)
+{
+	const struct aead_chacha20_poly1305_ctx *c20_ctx = ctx->aead_state;
+	unsigned char subkey[32];
+	poly1305_state poly1305;
+	ChaCha_ctx chacha;
+	int ret;
+
+	if (nonce_len != ctx->aead->nonce_len) {
+		EVPerror(EVP_R_IV_TOO_LARGE);
 		return 0;
 	}
 
 	CRYPTO_hchacha_20(subkey, c20_ctx->key, nonce);
 
-	memset(poly1305_key, 0, sizeof(poly1305_key));
-	CRYPTO_chacha_20(poly1305_key, poly1305_key, sizeof(poly1305_key),
-	    subkey, nonce + 16, 0);
+	chacha20_poly1305_setup(&chacha, &poly1305, subkey, nonce + 16, NULL);
 
-	CRYPTO_poly1305_init(&poly1305, poly1305_key);
-	poly1305_update_with_pad16(&poly1305, ad, ad_len);
-	poly1305_update_with_pad16(&poly1305, in, plaintext_len);
-	poly1305_update_with_length(&poly1305, NULL, ad_len);
-	poly1305_update_with_length(&poly1305, NULL, plaintext_len);
+	ret = chacha20_poly1305_open(&chacha, &poly1305, c20_ctx->tag_len,
+	    out, out_len, max_out_len, in_iov, in_iovcnt, ad_iov, ad_iovcnt);
 
-	CRYPTO_poly1305_finish(&poly1305, mac);
-	if (timingsafe_memcmp(mac, in + plaintext_len, c20_ctx->tag_len) != 0) {
-		EVPerror(EVP_R_BAD_DECRYPT);
-		return 0;
-	}
+	explicit_bzero(subkey, sizeof(subkey));
+	explicit_bzero(&chacha, sizeof(chacha));
+	explicit_bzero(&poly1305, sizeof(poly1305));
 
-	CRYPTO_chacha_20(out, in, plaintext_len, subkey, nonce + 16, 1);
+	return ret;
+}
 
-	*out_len = plaintext_len;
-	return 1;
+static int
+aead_xchacha20_poly1305_seal(const EVP_AEAD_CTX *ctx, unsigned char *out,
+    size_t *out_len, size_t max_out_len, const unsigned char *nonce,
+    size_t nonce_len, const unsigned char *in, size_t in_len,
+    const unsigned char *ad, size_t ad_len)
+{
+	struct iovec in_iov = { (void *)in, in_len };
+	struct iovec ad_iov = { (void *)ad, ad_len };
+
+	return aead_xchacha20_poly1305_seal_iov(ctx, out, out_len, max_out_len,
+	    nonce, nonce_len, &in_iov, 1, &ad_iov, 1);
+}
+
+static int
+aead_xchacha20_poly1305_open(const EVP_AEAD_CTX *ctx, unsigned char *out,
+    size_t *out_len, size_t max_out_len, const unsigned char *nonce,
+    size_t nonce_len, const unsigned char *in, size_t in_len,
+    const unsigned char *ad, size_t ad_len)
+{
+	struct iovec in_iov = { (void *)in, in_len };
+	struct iovec ad_iov = { (void *)ad, ad_len };
+
+	return aead_xchacha20_poly1305_open_iov(ctx, out, out_len, max_out_len,
+	    nonce, nonce_len, &in_iov, 1, &ad_iov, 1);
 }
 
 /* RFC 7539 */
@@ -358,8 +497,11 @@ static const EVP_AEAD aead_chacha20_poly1305 = {
 
 	.init = aead_chacha20_poly1305_init,
 	.cleanup = aead_chacha20_poly1305_cleanup,
+	.copy = aead_chacha20_poly1305_copy,
 	.seal = aead_chacha20_poly1305_seal,
 	.open = aead_chacha20_poly1305_open,
+	.seal_iov = aead_chacha20_poly1305_seal_iov,
+	.open_iov = aead_chacha20_poly1305_open_iov,
 };
 
 const EVP_AEAD *
@@ -376,8 +518,11 @@ static const EVP_AEAD aead_xchacha20_poly1305 = {
 
 	.init = aead_chacha20_poly1305_init,
 	.cleanup = aead_chacha20_poly1305_cleanup,
+	.copy = aead_chacha20_poly1305_copy,
 	.seal = aead_xchacha20_poly1305_seal,
 	.open = aead_xchacha20_poly1305_open,
+	.seal_iov = aead_xchacha20_poly1305_seal_iov,
+	.open_iov = aead_xchacha20_poly1305_open_iov,
 };
 
 const EVP_AEAD *
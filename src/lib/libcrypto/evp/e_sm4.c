@@ -18,11 +18,17 @@
 #include <openssl/opensslconf.h>
 
 #ifndef OPENSSL_NO_SM4
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/err.h>
 #include <openssl/evp.h>
 #include <openssl/modes.h>
 #include <openssl/sm4.h>
 
 #include "evp_locl.h"
+#include "modes_lcl.h"
+#include "sm4_locl.h"
 
 typedef struct {
 	SM4_KEY ks;
@@ -40,6 +46,20 @@ static void
 sm4_cbc_encrypt(const unsigned char *in, unsigned char *out, size_t len,
     const SM4_KEY *key, unsigned char *ivec, const int enc)
 {
+#ifdef SM4_AESNI
+	size_t n;
+
+	/* Decryption is parallel across blocks, encryption is not. */
+	if (!enc && sm4_aesni_capable()) {
+		n = len & ~(size_t)(SM4_BLOCK_SIZE - 1);
+		sm4_aesni_cbc_decrypt(in, out, n / SM4_BLOCK_SIZE, key, ivec);
+		in += n;
+		out += n;
+		len -= n;
+		if (len == 0)
+			return;
+	}
+#endif
 	if (enc)
 		CRYPTO_cbc128_encrypt(in, out, len, key, ivec,
 		    (block128_f)SM4_encrypt);
@@ -56,16 +76,6 @@ sm4_cfb128_encrypt(const unsigned char *in, unsigned char *out, size_t length,
 	    (block128_f)SM4_encrypt);
 }
 
-static void
-sm4_ecb_encrypt(const unsigned char *in, unsigned char *out, const SM4_KEY *key,
-    const int enc)
-{
-	if (enc)
-		SM4_encrypt(in, out, key);
-	else
-		SM4_decrypt(in, out, key);
-}
-
 static void
 sm4_ofb128_encrypt(const unsigned char *in, unsigned char *out, size_t length,
     const SM4_KEY *key, unsigned char *ivec, int *num)
@@ -74,7 +84,34 @@ sm4_ofb128_encrypt(const unsigned char *in, unsigned char *out, size_t length,
 	    (block128_f)SM4_encrypt);
 }
 
-IMPLEMENT_BLOCK_CIPHER(sm4, ks, sm4, EVP_SM4_KEY, NID_sm4, 16, 16, 16, 128,
+static int
+sm4_ecb_cipher(EVP_CIPHER_CTX *ctx, unsigned char *out,
+    const unsigned char *in, size_t inl)
+{
+	const SM4_KEY *key = &EVP_C_DATA(EVP_SM4_KEY, ctx)->ks;
+	size_t i;
+
+#ifdef SM4_AESNI
+	if (sm4_aesni_capable()) {
+		sm4_aesni_ecb_encrypt(in, out, inl / SM4_BLOCK_SIZE, key,
+		    ctx->encrypt);
+		return 1;
+	}
+#endif
+	for (i = 0; inl - i >= SM4_BLOCK_SIZE; i += SM4_BLOCK_SIZE) {
+		if (ctx->encrypt)
+			SM4_encrypt(in + i, out + i, key);
+		else
+			SM4_decrypt(in + i, out + i, key);
+	}
+
+	return 1;
+}
+
+BLOCK_CIPHER_func_cbc(sm4, sm4, EVP_SM4_KEY, ks)
+BLOCK_CIPHER_func_cfb(sm4, sm4, 128, EVP_SM4_KEY, ks)
+BLOCK_CIPHER_func_ofb(sm4, sm4, 128, EVP_SM4_KEY, ks)
+BLOCK_CIPHER_defs(sm4, EVP_SM4_KEY, NID_sm4, 16, 16, 16, 128,
     EVP_CIPH_FLAG_DEFAULT_ASN1, sm4_init_key, NULL, 0, 0, 0)
 
 static int
@@ -83,6 +120,13 @@ sm4_ctr_cipher(EVP_CIPHER_CTX *ctx, unsigned char *out, const unsigned char *in,
 {
 	EVP_SM4_KEY *key = EVP_C_DATA(EVP_SM4_KEY, ctx);
 
+#ifdef SM4_AESNI
+	if (sm4_aesni_capable()) {
+		CRYPTO_ctr128_encrypt_ctr32(in, out, len, &key->ks, ctx->iv,
+		    ctx->buf, &ctx->num, sm4_aesni_ctr32_encrypt_blocks);
+		return 1;
+	}
+#endif
 	CRYPTO_ctr128_encrypt(in, out, len, &key->ks, ctx->iv, ctx->buf,
 	    &ctx->num, (block128_f)SM4_encrypt);
 	return 1;
@@ -110,4 +154,187 @@ EVP_sm4_ctr(void)
 	return &sm4_ctr_mode;
 }
 
+/* SM4-GCM, as used by the TLS 1.3 SM suites of RFC 8998. */
+
+#define EVP_AEAD_SM4_GCM_TAG_LEN 16
+
+struct aead_sm4_gcm_ctx {
+	SM4_KEY ks;
+	GCM128_CONTEXT gcm;
+	ctr128_f ctr;
+	unsigned char tag_len;
+};
+
+static int
+aead_sm4_gcm_init(EVP_AEAD_CTX *ctx, const unsigned char *key, size_t key_len,
+    size_t tag_len)
+{
+	struct aead_sm4_gcm_ctx *gcm_ctx;
+
+	/* EVP_AEAD_CTX_init should catch this. */
+	if (key_len != SM4_BLOCK_SIZE) {
+		EVPerror(EVP_R_BAD_KEY_LENGTH);
+		return 0;
+	}
+
+	if (tag_len == EVP_AEAD_DEFAULT_TAG_LENGTH)
+		tag_len = EVP_AEAD_SM4_GCM_TAG_LEN;
+
+	if (tag_len > EVP_AEAD_SM4_GCM_TAG_LEN) {
+		EVPerror(EVP_R_TAG_TOO_LARGE);
+		return 0;
+	}
+
+	if ((gcm_ctx = calloc(1, sizeof(struct aead_sm4_gcm_ctx))) == NULL)
+		return 0;
+
+	SM4_set_key(key, &gcm_ctx->ks);
+	CRYPTO_gcm128_init(&gcm_ctx->gcm, &gcm_ctx->ks,
+	    (block128_f)SM4_encrypt);
+#ifdef SM4_AESNI
+	if (sm4_aesni_capable())
+		gcm_ctx->ctr = sm4_aesni_ctr32_encrypt_blocks;
+#endif
+	gcm_ctx->tag_len = tag_len;
+	ctx->aead_state = gcm_ctx;
+
+	return 1;
+}
+
+static void
+aead_sm4_gcm_cleanup(EVP_AEAD_CTX *ctx)
+{
+	struct aead_sm4_gcm_ctx *gcm_ctx = ctx->aead_state;
+
+	freezero(gcm_ctx, sizeof(*gcm_ctx));
+}
+
+static int
+aead_sm4_gcm_copy(EVP_AEAD_CTX *out, const EVP_AEAD_CTX *in)
+{
+	const struct aead_sm4_gcm_ctx *gcm_ctx = in->aead_state;
+	struct aead_sm4_gcm_ctx *gcm_out;
+
+	if ((gcm_out = malloc(sizeof(*gcm_out))) == NULL)
+		return 0;
+	memcpy(gcm_out, gcm_ctx, sizeof(*gcm_out));
+	gcm_out->gcm.key = &gcm_out->ks;
+	out->aead_state = gcm_out;
+
+	return 1;
+}
+
+static int
+aead_sm4_gcm_seal(const EVP_AEAD_CTX *ctx, unsigned char *out, size_t *out_len,
+    size_t max_out_len, const unsigned char *nonce, size_t nonce_len,
+    const unsigned char *in, size_t in_len, const unsigned char *ad,
+    size_t ad_len)
+{
+	const struct aead_sm4_gcm_ctx *gcm_ctx = ctx->aead_state;
+	GCM128_CONTEXT gcm;
+
+	if (max_out_len < in_len + gcm_ctx->tag_len) {
+		EVPerror(EVP_R_BUFFER_TOO_SMALL);
+		return 0;
+	}
+
+	memcpy(&gcm, &gcm_ctx->gcm, sizeof(gcm));
+
+	if (nonce_len == 0) {
+		EVPerror(EVP_R_INVALID_IV_LENGTH);
+		return 0;
+	}
+	CRYPTO_gcm128_setiv(&gcm, nonce, nonce_len);
+
+	if (CRYPTO_gcm128_aad(&gcm, ad, ad_len))
+		return 0;
+
+	if (gcm_ctx->ctr) {
+		if (CRYPTO_gcm128_encrypt_ctr32(&gcm, in, out, in_len,
+		    gcm_ctx->ctr))
+			return 0;
+	} else {
+		if (CRYPTO_gcm128_encrypt(&gcm, in, out, in_len))
+			return 0;
+	}
+
+	CRYPTO_gcm128_tag(&gcm, out + in_len, gcm_ctx->tag_len);
+	*out_len = in_len + gcm_ctx->tag_len;
+
+	return 1;
+}
+
+static int
+aead_sm4_gcm_open(const EVP_AEAD_CTX *ctx, unsigned char *out, size_t *out_len,
+    size_t max_out_len, const unsigned char *nonce, size_t nonce_len,
+    const unsigned char *in, size_t in_len, const unsigned char *ad,
+    size_t ad_len)
+{
+	const struct aead_sm4_gcm_ctx *gcm_ctx = ctx->aead_state;
+	unsigned char tag[EVP_AEAD_SM4_GCM_TAG_LEN];
+	GCM128_CONTEXT gcm;
+	size_t plaintext_len;
+
+	if (in_len < gcm_ctx->tag_len) {
+		EVPerror(EVP_R_BAD_DECRYPT);
+		return 0;
+	}
+
+	plaintext_len = in_len - gcm_ctx->tag_len;
+
+	if (max_out_len < plaintext_len) {
+		EVPerror(EVP_R_BUFFER_TOO_SMALL);
+		return 0;
+	}
+
+	memcpy(&gcm, &gcm_ctx->gcm, sizeof(gcm));
+
+	if (nonce_len == 0) {
+		EVPerror(EVP_R_INVALID_IV_LENGTH);
+		return 0;
+	}
+	CRYPTO_gcm128_setiv(&gcm, nonce, nonce_len);
+
+	if (CRYPTO_gcm128_aad(&gcm, ad, ad_len))
+		return 0;
+
+	if (gcm_ctx->ctr) {
+		if (CRYPTO_gcm128_decrypt_ctr32(&gcm, in, out, plaintext_len,
+		    gcm_ctx->ctr))
+			return 0;
+	} else {
+		if (CRYPTO_gcm128_decrypt(&gcm, in, out, plaintext_len))
+			return 0;
+	}
+
+	CRYPTO_gcm128_tag(&gcm, tag, gcm_ctx->tag_len);
+	if (timingsafe_memcmp(tag, in + plaintext_len, gcm_ctx->tag_len) != 0) {
+		EVPerror(EVP_R_BAD_DECRYPT);
+		return 0;
+	}
+
+	*out_len = plaintext_len;
+
+	return 1;
+}
+
+static const EVP_AEAD aead_sm4_gcm = {
+	.key_len = 16,
+	.nonce_len = 12,
+	.overhead = EVP_AEAD_SM4_GCM_TAG_LEN,
+	.max_tag_len = EVP_AEAD_SM4_GCM_TAG_LEN,
+
+	.init = aead_sm4_gcm_init,
+	.cleanup = aead_sm4_gcm_cleanup,
+	.copy = aead_sm4_gcm_copy,
+	.seal = aead_sm4_gcm_seal,
+	.open = aead_sm4_gcm_open,
+};
+
+const EVP_AEAD *
+EVP_aead_sm4_gcm(void)
+{
+	return &aead_sm4_gcm;
+}
+
 #endif
@@ -121,6 +121,37 @@ conv_ascii2bin(unsigned char a)
 	return data_ascii2bin[a];
 }
 
+/*
+ * Decode a 64 character line that holds nothing but base64 characters, with
+ * no padding, whitespace or line endings. Returns 0 without writing any
+ * output if the line holds anything else.
+ */
+static int
+decode_line(unsigned char *t, const unsigned char *f)
+{
+	unsigned char check = 0;
+	int i;
+
+	for (i = 0; i < 64; i++)
+		check |= conv_ascii2bin(f[i]) | (f[i] == '=' ? 0x80 : 0);
+	if (check & 0x80)
+		return 0;
+
+	for (i = 0; i < 64; i += 4) {
+		unsigned long l;
+
+		l = (((unsigned long)data_ascii2bin[f[i]]) << 18) |
+		    (((unsigned long)data_ascii2bin[f[i + 1]]) << 12) |
+		    (((unsigned long)data_ascii2bin[f[i + 2]]) << 6) |
+		    ((unsigned long)data_ascii2bin[f[i + 3]]);
+		*(t++) = (l >> 16) & 0xff;
+		*(t++) = (l >> 8) & 0xff;
+		*(t++) = l & 0xff;
+	}
+
+	return 1;
+}
+
 EVP_ENCODE_CTX *
 EVP_ENCODE_CTX_new(void)
 {
@@ -268,8 +299,23 @@ EVP_DecodeUpdate(EVP_ENCODE_CTX *ctx, unsigned char *out, int *outl,
 		goto end;
 	}
 
-	for (i = 0; i < inl; i++) {
+	i = 0;
+	while (i < inl) {
+		/*
+		 * Whole lines of plain base64 are decoded straight from the
+		 * input, which gives the same result as buffering them.
+		 */
+		if (n == 0 && eof == 0 && inl - i >= 64 &&
+		    decode_line(out, in)) {
+			in += 64;
+			i += 64;
+			ret += 48;
+			out += 48;
+			continue;
+		}
+
 		tmp = *(in++);
+		i++;
 		v = conv_ascii2bin(tmp);
 		if (v == B64_ERROR) {
 			rv = -1;
@@ -538,6 +538,9 @@ unsigned long EVP_CIPHER_CTX_flags(const EVP_CIPHER_CTX *ctx);
 
 int EVP_Cipher(EVP_CIPHER_CTX *c, unsigned char *out, const unsigned char *in,
     unsigned int inl);
+int EVP_CipherSectors(EVP_CIPHER_CTX *ctx, unsigned char *out,
+    const unsigned char *in, size_t sector_len, size_t nsectors,
+    const unsigned char *tweaks);
 
 #define EVP_add_cipher_alias(n,alias) \
 	OBJ_NAME_add((alias),OBJ_NAME_TYPE_CIPHER_METH|OBJ_NAME_ALIAS,(n))
@@ -819,6 +822,10 @@ const EVP_CIPHER *EVP_aes_256_xts(void);
 const EVP_CIPHER *EVP_aes_128_cbc_hmac_sha1(void);
 const EVP_CIPHER *EVP_aes_256_cbc_hmac_sha1(void);
 #endif
+#ifndef OPENSSL_NO_SHA256
+const EVP_CIPHER *EVP_aes_128_cbc_hmac_sha256(void);
+const EVP_CIPHER *EVP_aes_256_cbc_hmac_sha256(void);
+#endif
 #endif
 #ifndef OPENSSL_NO_CAMELLIA
 const EVP_CIPHER *EVP_camellia_128_ecb(void);
@@ -988,6 +995,10 @@ int PKCS5_PBKDF2_HMAC_SHA1(const char *pass, int passlen,
 int PKCS5_PBKDF2_HMAC(const char *pass, int passlen, const unsigned char *salt,
     int saltlen, int iter, const EVP_MD *digest, int keylen,
     unsigned char *out);
+int PKCS5_PBKDF2_HMAC_batch(const char *const *pass, const int *passlen,
+    const unsigned char *const *salt, const int *saltlen, int iter,
+    const EVP_MD *digest, int keylen, unsigned char *const *out,
+    size_t count);
 int PKCS5_v2_PBE_keyivgen(EVP_CIPHER_CTX *ctx, const char *pass, int passlen,
     ASN1_TYPE *param, const EVP_CIPHER *cipher, const EVP_MD *md,
     int en_de);
@@ -1274,6 +1285,18 @@ typedef struct evp_aead_st EVP_AEAD;
 const EVP_AEAD *EVP_aead_aes_128_gcm(void);
 /* EVP_aes_256_gcm is AES-256 in Galois Counter Mode. */
 const EVP_AEAD *EVP_aead_aes_256_gcm(void);
+/*
+ * EVP_aead_aes_128_gcm_siv is AES-128 in GCM-SIV mode (RFC 8452), which is
+ * resistant to nonce reuse.
+ */
+const EVP_AEAD *EVP_aead_aes_128_gcm_siv(void);
+/* EVP_aead_aes_256_gcm_siv is AES-256 in GCM-SIV mode. */
+const EVP_AEAD *EVP_aead_aes_256_gcm_siv(void);
+/*
+ * EVP_aead_aes_128_ccm is AES-128 in CCM mode with a 13 byte nonce, allowing
+ * tags of 4 to 16 bytes.
+ */
+const EVP_AEAD *EVP_aead_aes_128_ccm(void);
 #endif
 
 #if !defined(OPENSSL_NO_CHACHA) && !defined(OPENSSL_NO_POLY1305)
@@ -1283,6 +1306,11 @@ const EVP_AEAD *EVP_aead_chacha20_poly1305(void);
 const EVP_AEAD *EVP_aead_xchacha20_poly1305(void);
 #endif
 
+#ifndef OPENSSL_NO_SM4
+/* EVP_aead_sm4_gcm is SM4 in Galois Counter Mode. */
+const EVP_AEAD *EVP_aead_sm4_gcm(void);
+#endif
+
 /* EVP_AEAD_key_length returns the length of the keys used. */
 size_t EVP_AEAD_key_length(const EVP_AEAD *aead);
 
@@ -1325,6 +1353,11 @@ int EVP_AEAD_CTX_init(EVP_AEAD_CTX *ctx, const EVP_AEAD *aead,
 /* EVP_AEAD_CTX_cleanup frees any data allocated for this context. */
 void EVP_AEAD_CTX_cleanup(EVP_AEAD_CTX *ctx);
 
+/* EVP_AEAD_CTX_copy initialises out with a copy of the keyed state of in,
+ * without repeating the key setup. Any previous contents of out are
+ * overwritten, not freed. Both contexts must be cleaned up separately. */
+int EVP_AEAD_CTX_copy(EVP_AEAD_CTX *out, const EVP_AEAD_CTX *in);
+
 /* EVP_AEAD_CTX_seal encrypts and authenticates the input and authenticates
  * any additional data (AD), the result being written as output. One is
  * returned on success, otherwise zero.
@@ -1372,6 +1405,32 @@ int EVP_AEAD_CTX_open(const EVP_AEAD_CTX *ctx, unsigned char *out,
     size_t nonce_len, const unsigned char *in, size_t in_len,
     const unsigned char *ad, size_t ad_len);
 
+struct iovec;
+
+/* EVP_AEAD_CTX_seal_iov behaves like EVP_AEAD_CTX_seal, except that the
+ * input and additional data are each given as an array of fragments, which
+ * are processed as though they had been concatenated. The output (including
+ * the tag) is written contiguously to out.
+ *
+ * If a fragment of the input and the output are aliased then out, offset by
+ * the length of all preceding input fragments, must be <= the fragment. */
+int EVP_AEAD_CTX_seal_iov(const EVP_AEAD_CTX *ctx, unsigned char *out,
+    size_t *out_len, size_t max_out_len, const unsigned char *nonce,
+    size_t nonce_len, const struct iovec *in_iov, int in_iovcnt,
+    const struct iovec *ad_iov, int ad_iovcnt);
+
+/* EVP_AEAD_CTX_open_iov behaves like EVP_AEAD_CTX_open, except that the
+ * input (including the tag) and additional data are each given as an array
+ * of fragments, which are processed as though they had been concatenated.
+ * The output is written contiguously to out.
+ *
+ * If a fragment of the input and the output are aliased then out, offset by
+ * the length of all preceding input fragments, must be <= the fragment. */
+int EVP_AEAD_CTX_open_iov(const EVP_AEAD_CTX *ctx, unsigned char *out,
+    size_t *out_len, size_t max_out_len, const unsigned char *nonce,
+    size_t nonce_len, const struct iovec *in_iov, int in_iovcnt,
+    const struct iovec *ad_iov, int ad_iovcnt);
+
 void EVP_add_alg_module(void);
 
 /* BEGIN ERROR CODES */
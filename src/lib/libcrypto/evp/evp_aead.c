@@ -15,7 +15,11 @@
  * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <sys/types.h>
+#include <sys/uio.h>
+
 #include <limits.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <openssl/evp.h>
@@ -68,6 +72,26 @@ EVP_AEAD_CTX_cleanup(EVP_AEAD_CTX *ctx)
 	ctx->aead = NULL;
 }
 
+int
+EVP_AEAD_CTX_copy(EVP_AEAD_CTX *out, const EVP_AEAD_CTX *in)
+{
+	memset(out, 0, sizeof(*out));
+
+	if (in->aead == NULL) {
+		EVPerror(EVP_R_INPUT_NOT_INITIALIZED);
+		return 0;
+	}
+	if (in->aead->copy == NULL) {
+		EVPerror(EVP_R_METHOD_NOT_SUPPORTED);
+		return 0;
+	}
+	if (!in->aead->copy(out, in))
+		return 0;
+	out->aead = in->aead;
+
+	return 1;
+}
+
 /* check_alias returns 0 if out points within the buffer determined by in
  * and in_len and 1 otherwise.
  *
@@ -142,3 +166,186 @@ error:
 	*out_len = 0;
 	return 0;
 }
+
+int
+evp_aead_iov_len(const struct iovec *iov, int iovcnt, size_t *out_len)
+{
+	size_t len = 0;
+	int i;
+
+	*out_len = 0;
+
+	if (iovcnt < 0)
+		return 0;
+
+	for (i = 0; i < iovcnt; i++) {
+		if (len + iov[i].iov_len < len)
+			return 0;
+		len += iov[i].iov_len;
+	}
+
+	*out_len = len;
+
+	return 1;
+}
+
+/* check_alias_iov applies check_alias to each input fragment, against the
+ * position in out that the fragment will be written to. */
+static int
+check_alias_iov(const struct iovec *iov, int iovcnt, const unsigned char *out)
+{
+	size_t offset = 0;
+	int i;
+
+	for (i = 0; i < iovcnt; i++) {
+		if (!check_alias(iov[i].iov_base, iov[i].iov_len, out + offset))
+			return 0;
+		offset += iov[i].iov_len;
+	}
+
+	return 1;
+}
+
+/* linearise_iov copies the given fragments into a newly allocated buffer,
+ * for use with AEADs that do not natively support fragmented input. */
+static int
+linearise_iov(const struct iovec *iov, int iovcnt, unsigned char **out,
+    size_t *out_len)
+{
+	unsigned char *buf;
+	size_t len, offset = 0;
+	int i;
+
+	*out = NULL;
+	*out_len = 0;
+
+	if (!evp_aead_iov_len(iov, iovcnt, &len))
+		return 0;
+	if ((buf = malloc(len > 0 ? len : 1)) == NULL)
+		return 0;
+
+	for (i = 0; i < iovcnt; i++) {
+		if (iov[i].iov_len == 0)
+			continue;
+		memcpy(buf + offset, iov[i].iov_base, iov[i].iov_len);
+		offset += iov[i].iov_len;
+	}
+
+	*out = buf;
+	*out_len = len;
+
+	return 1;
+}
+
+int
+EVP_AEAD_CTX_seal_iov(const EVP_AEAD_CTX *ctx, unsigned char *out,
+    size_t *out_len, size_t max_out_len, const unsigned char *nonce,
+    size_t nonce_len, const struct iovec *in_iov, int in_iovcnt,
+    const struct iovec *ad_iov, int ad_iovcnt)
+{
+	unsigned char *in = NULL, *ad = NULL;
+	size_t in_len = 0, ad_len = 0;
+	size_t possible_out_len;
+
+	if (!evp_aead_iov_len(in_iov, in_iovcnt, &in_len) ||
+	    !evp_aead_iov_len(ad_iov, ad_iovcnt, &ad_len)) {
+		EVPerror(EVP_R_TOO_LARGE);
+		goto error;
+	}
+
+	/* Overflow. */
+	possible_out_len = in_len + ctx->aead->overhead;
+	if (possible_out_len < in_len) {
+		EVPerror(EVP_R_TOO_LARGE);
+		goto error;
+	}
+
+	if (!check_alias_iov(in_iov, in_iovcnt, out)) {
+		EVPerror(EVP_R_OUTPUT_ALIASES_INPUT);
+		goto error;
+	}
+
+	if (ctx->aead->seal_iov != NULL) {
+		if (ctx->aead->seal_iov(ctx, out, out_len, max_out_len,
+		    nonce, nonce_len, in_iov, in_iovcnt, ad_iov, ad_iovcnt))
+			return 1;
+		goto error;
+	}
+
+	if (!linearise_iov(in_iov, in_iovcnt, &in, &in_len))
+		goto error;
+	if (!linearise_iov(ad_iov, ad_iovcnt, &ad, &ad_len))
+		goto error;
+
+	if (!ctx->aead->seal(ctx, out, out_len, max_out_len, nonce, nonce_len,
+	    in, in_len, ad, ad_len))
+		goto error;
+
+	freezero(in, in_len);
+	freezero(ad, ad_len);
+
+	return 1;
+
+error:
+	freezero(in, in_len);
+	freezero(ad, ad_len);
+
+	/* In the event of an error, clear the output buffer so that a caller
+	 * that doesn't check the return value doesn't send raw data. */
+	memset(out, 0, max_out_len);
+	*out_len = 0;
+	return 0;
+}
+
+int
+EVP_AEAD_CTX_open_iov(const EVP_AEAD_CTX *ctx, unsigned char *out,
+    size_t *out_len, size_t max_out_len, const unsigned char *nonce,
+    size_t nonce_len, const struct iovec *in_iov, int in_iovcnt,
+    const struct iovec *ad_iov, int ad_iovcnt)
+{
+	unsigned char *in = NULL, *ad = NULL;
+	size_t in_len = 0, ad_len = 0;
+
+	if (!evp_aead_iov_len(in_iov, in_iovcnt, &in_len) ||
+	    !evp_aead_iov_len(ad_iov, ad_iovcnt, &ad_len)) {
+		EVPerror(EVP_R_TOO_LARGE);
+		goto error;
+	}
+
+	if (!check_alias_iov(in_iov, in_iovcnt, out)) {
+		EVPerror(EVP_R_OUTPUT_ALIASES_INPUT);
+		goto error;
+	}
+
+	if (ctx->aead->open_iov != NULL) {
+		if (ctx->aead->open_iov(ctx, out, out_len, max_out_len,
+		    nonce, nonce_len, in_iov, in_iovcnt, ad_iov, ad_iovcnt))
+			return 1;
+		goto error;
+	}
+
+	if (!linearise_iov(in_iov, in_iovcnt, &in, &in_len))
+		goto error;
+	if (!linearise_iov(ad_iov, ad_iovcnt, &ad, &ad_len))
+		goto error;
+
+	if (!ctx->aead->open(ctx, out, out_len, max_out_len, nonce, nonce_len,
+	    in, in_len, ad, ad_len))
+		goto error;
+
+	freezero(in, in_len);
+	freezero(ad, ad_len);
+
+	return 1;
+
+error:
+	freezero(in, in_len);
+	freezero(ad, ad_len);
+
+	/* In the event of an error, clear the output buffer so that a caller
+	 * that doesn't check the return value doesn't try and process bad
+	 * data. */
+	memset(out, 0, max_out_len);
+	*out_len = 0;
+	return 0;
+}
@@ -76,6 +76,30 @@
 
 #define M_do_cipher(ctx, out, in, inl) ctx->cipher->do_cipher(ctx, out, in, inl)
 
+/*
+ * Clean up the cipher data of c and take it out of the context, so that it
+ * can be reused by the same cipher rather than freed and allocated again.
+ * EVP_CIPHER_CTX_cleanup() then no longer sees a cipher to clean up.
+ */
+static int
+evp_cipher_ctx_take_data(EVP_CIPHER_CTX *c, void **data)
+{
+	*data = NULL;
+
+	if (c->cipher == NULL || c->cipher_data == NULL ||
+	    c->cipher->ctx_size == 0)
+		return 1;
+	if (c->cipher->cleanup && !c->cipher->cleanup(c))
+		return 0;
+	explicit_bzero(c->cipher_data, c->cipher->ctx_size);
+
+	*data = c->cipher_data;
+	c->cipher_data = NULL;
+	c->cipher = NULL;
+
+	return 1;
+}
+
 int
 EVP_CipherInit(EVP_CIPHER_CTX *ctx, const EVP_CIPHER *cipher,
     const unsigned char *key, const unsigned char *iv, int enc)
@@ -89,6 +113,9 @@ int
 EVP_CipherInit_ex(EVP_CIPHER_CTX *ctx, const EVP_CIPHER *cipher, ENGINE *impl,
     const unsigned char *key, const unsigned char *iv, int enc)
 {
+	const EVP_CIPHER *kept_cipher = NULL;
+	void *kept_data = NULL;
+
 	if (enc == -1)
 		enc = ctx->encrypt;
 	else {
@@ -111,6 +138,12 @@ EVP_CipherInit_ex(EVP_CIPHER_CTX *ctx, const EVP_CIPHER *cipher, ENGINE *impl,
 		 * ENGINE and EVP_CIPHER could be used). */
 		if (ctx->cipher) {
 			unsigned long flags = ctx->flags;
+
+			if (ctx->cipher == cipher && impl == NULL) {
+				if (!evp_cipher_ctx_take_data(ctx, &kept_data))
+					return 0;
+				kept_cipher = cipher;
+			}
 			EVP_CIPHER_CTX_cleanup(ctx);
 			/* Restore encrypt and flags */
 			ctx->encrypt = enc;
@@ -130,6 +163,7 @@ EVP_CipherInit_ex(EVP_CIPHER_CTX *ctx, const EVP_CIPHER *cipher, ENGINE *impl,
 			const EVP_CIPHER *c =
 			    ENGINE_get_cipher(impl, cipher->nid);
 			if (!c) {
+				freezero(kept_data, cipher->ctx_size);
 				EVPerror(EVP_R_INITIALIZATION_ERROR);
 				return 0;
 			}
@@ -143,8 +177,16 @@ EVP_CipherInit_ex(EVP_CIPHER_CTX *ctx, const EVP_CIPHER *cipher, ENGINE *impl,
 			ctx->engine = NULL;
 #endif
 
+		/* An ENGINE may have replaced the cipher. */
+		if (kept_data != NULL && kept_cipher != cipher) {
+			freezero(kept_data, kept_cipher->ctx_size);
+			kept_data = NULL;
+		}
+
 		ctx->cipher = cipher;
-		if (ctx->cipher->ctx_size) {
+		if (kept_data != NULL) {
+			ctx->cipher_data = kept_data;
+		} else if (ctx->cipher->ctx_size) {
 			ctx->cipher_data = calloc(1, ctx->cipher->ctx_size);
 			if (ctx->cipher_data == NULL) {
 				EVPerror(ERR_R_MALLOC_FAILURE);
@@ -673,6 +715,8 @@ EVP_CIPHER_CTX_rand_key(EVP_CIPHER_CTX *ctx, unsigned char *key)
 int
 EVP_CIPHER_CTX_copy(EVP_CIPHER_CTX *out, const EVP_CIPHER_CTX *in)
 {
+	void *cipher_data = NULL;
+
 	if ((in == NULL) || (in->cipher == NULL)) {
 		EVPerror(EVP_R_INPUT_NOT_INITIALIZED);
 		return 0;
@@ -685,17 +729,25 @@ EVP_CIPHER_CTX_copy(EVP_CIPHER_CTX *out, const EVP_CIPHER_CTX *in)
 	}
 #endif
 
+	/* Reuse the cipher data of out if it is for the same cipher. */
+	if (out->cipher == in->cipher) {
+		if (!evp_cipher_ctx_take_data(out, &cipher_data))
+			return 0;
+	}
 	EVP_CIPHER_CTX_cleanup(out);
 	memcpy(out, in, sizeof *out);
 
 	if (in->cipher_data && in->cipher->ctx_size) {
-		out->cipher_data = calloc(1, in->cipher->ctx_size);
-		if (out->cipher_data == NULL) {
+		if (cipher_data != NULL) {
+			out->cipher_data = cipher_data;
+		} else if ((out->cipher_data =
+		    calloc(1, in->cipher->ctx_size)) == NULL) {
 			EVPerror(ERR_R_MALLOC_FAILURE);
 			return 0;
 		}
 		memcpy(out->cipher_data, in->cipher_data, in->cipher->ctx_size);
-	}
+	} else
+		freezero(cipher_data, in->cipher->ctx_size);
 
 	if (in->cipher->flags & EVP_CIPH_CUSTOM_COPY) {
 		if (!in->cipher->ctrl((EVP_CIPHER_CTX *)in, EVP_CTRL_COPY,
@@ -356,6 +356,10 @@ struct evp_aead_st {
 	    size_t key_len, size_t tag_len);
 	void (*cleanup)(struct evp_aead_ctx_st*);
 
+	/* Duplicates the keyed state of in into out. */
+	int (*copy)(struct evp_aead_ctx_st *out,
+	    const struct evp_aead_ctx_st *in);
+
 	int (*seal)(const struct evp_aead_ctx_st *ctx, unsigned char *out,
 	    size_t *out_len, size_t max_out_len, const unsigned char *nonce,
 	    size_t nonce_len, const unsigned char *in, size_t in_len,
@@ -365,8 +369,21 @@ struct evp_aead_st {
 	    size_t *out_len, size_t max_out_len, const unsigned char *nonce,
 	    size_t nonce_len, const unsigned char *in, size_t in_len,
 	    const unsigned char *ad, size_t ad_len);
+
+	/* Optional - if NULL, fragments are linearised and seal/open used. */
+	int (*seal_iov)(const struct evp_aead_ctx_st *ctx, unsigned char *out,
+	    size_t *out_len, size_t max_out_len, const unsigned char *nonce,
+	    size_t nonce_len, const struct iovec *in_iov, int in_iovcnt,
+	    const struct iovec *ad_iov, int ad_iovcnt);
+
+	int (*open_iov)(const struct evp_aead_ctx_st *ctx, unsigned char *out,
+	    size_t *out_len, size_t max_out_len, const unsigned char *nonce,
+	    size_t nonce_len, const struct iovec *in_iov, int in_iovcnt,
+	    const struct iovec *ad_iov, int ad_iovcnt);
 };
 
+int evp_aead_iov_len(const struct iovec *iov, int iovcnt, size_t *out_len);
+
 int EVP_PKEY_CTX_md(EVP_PKEY_CTX *ctx, int optype, int cmd, const char *md_name);
 
 __END_HIDDEN_DECLS
@@ -67,9 +67,11 @@
 #include <openssl/err.h>
 #include <openssl/evp.h>
 #include <openssl/hmac.h>
+#include <openssl/sha.h>
 #include <openssl/x509.h>
 
 #include "evp_locl.h"
+#include "sha_internal.h"
 
 /* This is an implementation of PKCS#5 v2.0 password based encryption key
  * derivation function PBKDF2.
@@ -77,6 +79,117 @@
  * <pgut001@cs.auckland.ac.nz> to the PKCS-TNG <pkcs-tng@rsa.com> mailing list.
  */
 
+#ifndef OPENSSL_NO_SHA256
+/*
+ * Compute the key states and the first iteration of each output block of
+ * PBKDF2-HMAC-SHA256, leaving the other iterations to
+ * sha256_pbkdf2_iterate().
+ */
+static void
+pbkdf2_sha256_start(const char *pass, int passlen, const unsigned char *salt,
+    int saltlen, struct sha256_pbkdf2_chain *chains, size_t blocks)
+{
+	SHA256_CTX ictx, octx, ctx;
+	unsigned char key[SHA_CBLOCK], pad[SHA_CBLOCK];
+	unsigned char md[SHA256_DIGEST_LENGTH], itmp[4];
+	size_t i, j;
+
+	memset(key, 0, sizeof(key));
+	if (passlen > SHA_CBLOCK)
+		SHA256(pass, passlen, key);
+	else if (passlen > 0)
+		memcpy(key, pass, passlen);
+
+	for (i = 0; i < SHA_CBLOCK; i++)
+		pad[i] = key[i] ^ 0x36;
+	SHA256_Init(&ictx);
+	SHA256_Update(&ictx, pad, sizeof(pad));
+	for (i = 0; i < SHA_CBLOCK; i++)
+		pad[i] = key[i] ^ 0x5c;
+	SHA256_Init(&octx);
+	SHA256_Update(&octx, pad, sizeof(pad));
+
+	for (j = 0; j < blocks; j++) {
+		memcpy(chains[j].istate, ictx.h, sizeof(chains[j].istate));
+		memcpy(chains[j].ostate, octx.h, sizeof(chains[j].ostate));
+
+		itmp[0] = (unsigned char)(((j + 1) >> 24) & 0xff);
+		itmp[1] = (unsigned char)(((j + 1) >> 16) & 0xff);
+		itmp[2] = (unsigned char)(((j + 1) >> 8) & 0xff);
+		itmp[3] = (unsigned char)((j + 1) & 0xff);
+
+		ctx = ictx;
+		SHA256_Update(&ctx, salt, saltlen);
+		SHA256_Update(&ctx, itmp, sizeof(itmp));
+		SHA256_Final(md, &ctx);
+		ctx = octx;
+		SHA256_Update(&ctx, md, sizeof(md));
+		SHA256_Final(chains[j].u, &ctx);
+
+		memcpy(chains[j].t, chains[j].u, sizeof(chains[j].t));
+	}
+
+	explicit_bzero(&ictx, sizeof(ictx));
+	explicit_bzero(&octx, sizeof(octx));
+	explicit_bzero(&ctx, sizeof(ctx));
+	explicit_bzero(key, sizeof(key));
+	explicit_bzero(pad, sizeof(pad));
+	explicit_bzero(md, sizeof(md));
+}
+
+/*
+ * PBKDF2-HMAC-SHA256 of count passwords at once. The output blocks of all
+ * of them are independent, so they are iterated together, several at a
+ * time where the multi-buffer SHA-256 kernels are available.
+ */
+static int
+pbkdf2_sha256(const char *const *pass, const int *passlen,
+    const unsigned char *const *salt, const int *saltlen, int iter,
+    int keylen, unsigned char *const *out, size_t count)
+{
+	struct sha256_pbkdf2_chain *chains;
+	size_t blocks, i, j;
+	int cplen, plen;
+
+	if (keylen < 0)
+		return 0;
+	if (keylen == 0 || count == 0)
+		return 1;
+
+	blocks = (keylen + SHA256_DIGEST_LENGTH - 1) / SHA256_DIGEST_LENGTH;
+	if ((chains = calloc(count, blocks * sizeof(*chains))) == NULL) {
+		EVPerror(ERR_R_MALLOC_FAILURE);
+		return 0;
+	}
+
+	for (i = 0; i < count; i++) {
+		plen = passlen[i];
+		if (pass[i] == NULL)
+			plen = 0;
+		else if (plen == -1)
+			plen = strlen(pass[i]);
+		pbkdf2_sha256_start(pass[i], plen, salt[i], saltlen[i],
+		    &chains[i * blocks], blocks);
+	}
+
+	sha256_pbkdf2_iterate(chains, count * blocks, iter);
+
+	for (i = 0; i < count; i++) {
+		for (j = 0; j < blocks; j++) {
+			cplen = keylen - j * SHA256_DIGEST_LENGTH;
+			if (cplen > SHA256_DIGEST_LENGTH)
+				cplen = SHA256_DIGEST_LENGTH;
+			memcpy(out[i] + j * SHA256_DIGEST_LENGTH,
+			    chains[i * blocks + j].t, cplen);
+		}
+	}
+
+	freezero(chains, count * blocks * sizeof(*chains));
+
+	return 1;
+}
+#endif
+
 int
 PKCS5_PBKDF2_HMAC(const char *pass, int passlen, const unsigned char *salt,
     int saltlen, int iter, const EVP_MD *digest, int keylen, unsigned char *out)
@@ -85,6 +198,15 @@ PKCS5_PBKDF2_HMAC(const char *pass, int passlen, const unsigned char *salt,
 	int cplen, j, k, tkeylen, mdlen;
 	unsigned long i = 1;
 	HMAC_CTX hctx_tpl, hctx;
+	HMAC_PRECOMPUTED *state = NULL;
+	int ret = 0;
+
+#ifndef OPENSSL_NO_SHA256
+	/* The iterations of HMAC-SHA256 are run on the hash states directly. */
+	if (digest == EVP_sha256() && iter > 1)
+		return pbkdf2_sha256(&pass, &passlen, &salt, &saltlen, iter,
+		    keylen, &out, 1);
+#endif
 
 	mdlen = EVP_MD_size(digest);
 	if (mdlen < 0)
@@ -101,6 +223,12 @@ PKCS5_PBKDF2_HMAC(const char *pass, int passlen, const unsigned char *salt,
 		HMAC_CTX_cleanup(&hctx_tpl);
 		return 0;
 	}
+	/* The iterations only ever hash one digest with the same key. */
+	if (iter > 1 &&
+	    (state = HMAC_precomputed_new(digest, pass, passlen)) == NULL) {
+		HMAC_CTX_cleanup(&hctx_tpl);
+		return 0;
+	}
 	while (tkeylen) {
 		if (tkeylen > mdlen)
 			cplen = mdlen;
@@ -113,31 +241,20 @@ PKCS5_PBKDF2_HMAC(const char *pass, int passlen, const unsigned char *salt,
 		itmp[1] = (unsigned char)((i >> 16) & 0xff);
 		itmp[2] = (unsigned char)((i >> 8) & 0xff);
 		itmp[3] = (unsigned char)(i & 0xff);
-		if (!HMAC_CTX_copy(&hctx, &hctx_tpl)) {
-			HMAC_CTX_cleanup(&hctx_tpl);
-			return 0;
-		}
+		if (!HMAC_CTX_copy(&hctx, &hctx_tpl))
+			goto err;
 		if (!HMAC_Update(&hctx, salt, saltlen) ||
 		    !HMAC_Update(&hctx, itmp, 4) ||
 		    !HMAC_Final(&hctx, digtmp, NULL)) {
-			HMAC_CTX_cleanup(&hctx_tpl);
 			HMAC_CTX_cleanup(&hctx);
-			return 0;
+			goto err;
 		}
 		HMAC_CTX_cleanup(&hctx);
 		memcpy(p, digtmp, cplen);
 		for (j = 1; j < iter; j++) {
-			if (!HMAC_CTX_copy(&hctx, &hctx_tpl)) {
-				HMAC_CTX_cleanup(&hctx_tpl);
-				return 0;
-			}
-			if (!HMAC_Update(&hctx, digtmp, mdlen) ||
-			    !HMAC_Final(&hctx, digtmp, NULL)) {
-				HMAC_CTX_cleanup(&hctx_tpl);
-				HMAC_CTX_cleanup(&hctx);
-				return 0;
-			}
-			HMAC_CTX_cleanup(&hctx);
+			if (!HMAC_precomputed_mac(state, digtmp, mdlen, digtmp,
+			    NULL))
+				goto err;
 			for (k = 0; k < cplen; k++)
 				p[k] ^= digtmp[k];
 		}
@@ -145,7 +262,36 @@ PKCS5_PBKDF2_HMAC(const char *pass, int passlen, const unsigned char *salt,
 		i++;
 		p += cplen;
 	}
+
+	ret = 1;
+
+ err:
 	HMAC_CTX_cleanup(&hctx_tpl);
+	HMAC_precomputed_free(state);
+	explicit_bzero(digtmp, sizeof(digtmp));
+
+	return ret;
+}
+
+int
+PKCS5_PBKDF2_HMAC_batch(const char *const *pass, const int *passlen,
+    const unsigned char *const *salt, const int *saltlen, int iter,
+    const EVP_MD *digest, int keylen, unsigned char *const *out, size_t count)
+{
+	size_t i;
+
+#ifndef OPENSSL_NO_SHA256
+	if (digest == EVP_sha256() && iter > 1)
+		return pbkdf2_sha256(pass, passlen, salt, saltlen, iter,
+		    keylen, out, count);
+#endif
+
+	for (i = 0; i < count; i++) {
+		if (!PKCS5_PBKDF2_HMAC(pass[i], passlen[i], salt[i],
+		    saltlen[i], iter, digest, keylen, out[i]))
+			return 0;
+	}
+
 	return 1;
 }
 
@@ -247,6 +247,27 @@ typedef struct st_ex_class_item {
 /* When assigning new class indexes, this is our counter */
 static int ex_class = CRYPTO_EX_INDEX_USER;
 
+/*
+ * Classes below EX_SNAPSHOT_CLASSES, which include all the built-in ones,
+ * also have their methods published in an immutable snapshot, so that
+ * creating, duplicating and freeing objects reads the methods without
+ * taking CRYPTO_LOCK_EX_DATA. A new snapshot is built under the lock each
+ * time an index is added to the class, and replaces the previous one,
+ * which may still be in use by other threads and is therefore only freed
+ * by CRYPTO_cleanup_all_ex_data(). Since indexes are registered a handful
+ * of times per class, the snapshots kept around stay small.
+ */
+#define EX_SNAPSHOT_CLASSES	(CRYPTO_EX_INDEX_USER + 16)
+
+typedef struct st_ex_class_snapshot {
+	struct st_ex_class_snapshot *retired;
+	int num;
+	CRYPTO_EX_DATA_FUNCS *funcs[];
+} EX_CLASS_SNAPSHOT;
+
+static EX_CLASS_SNAPSHOT *volatile ex_snapshots[EX_SNAPSHOT_CLASSES];
+static EX_CLASS_SNAPSHOT *ex_snapshots_retired = NULL;
+
 /* The global hash table of EX_CLASS_ITEM items */
 DECLARE_LHASH_OF(EX_CLASS_ITEM);
 static LHASH_OF(EX_CLASS_ITEM) *ex_data = NULL;
@@ -304,6 +325,39 @@ def_cleanup_cb(void *a_void)
 	free(item);
 }
 
+/* Publish the methods of a class in a new snapshot. Called with the ex_data
+ * lock held. */
+static int
+def_publish_class(EX_CLASS_ITEM *item)
+{
+	EX_CLASS_SNAPSHOT *snap, *old;
+	int i, num;
+
+	if (item->class_index < 0 || item->class_index >= EX_SNAPSHOT_CLASSES)
+		return 1;
+
+	num = sk_CRYPTO_EX_DATA_FUNCS_num(item->meth);
+	if ((snap = malloc(sizeof(*snap) +
+	    num * sizeof(CRYPTO_EX_DATA_FUNCS *))) == NULL)
+		return 0;
+	snap->retired = NULL;
+	snap->num = num;
+	for (i = 0; i < num; i++)
+		snap->funcs[i] = sk_CRYPTO_EX_DATA_FUNCS_value(item->meth, i);
+
+	/* The snapshot must be complete before readers can see it. */
+	__sync_synchronize();
+
+	old = ex_snapshots[item->class_index];
+	ex_snapshots[item->class_index] = snap;
+	if (old != NULL) {
+		old->retired = ex_snapshots_retired;
+		ex_snapshots_retired = old;
+	}
+
+	return 1;
+}
+
 /* Return the EX_CLASS_ITEM from the "ex_data" hash table that corresponds to a
  * given class. Handles locking. */
 static EX_CLASS_ITEM *
@@ -366,11 +420,72 @@ def_add_index(EX_CLASS_ITEM *item, long argl, void *argp,
 	}
 	toret = item->meth_num++;
 	(void)sk_CRYPTO_EX_DATA_FUNCS_set(item->meth, toret, a);
+	if (!def_publish_class(item)) {
+		/*
+		 * Readers would not see the new method, so give the index
+		 * back rather than hand out one that is only half working.
+		 */
+		CRYPTOerror(ERR_R_MALLOC_FAILURE);
+		(void)sk_CRYPTO_EX_DATA_FUNCS_set(item->meth, toret, NULL);
+		item->meth_num--;
+		free(a);
+		toret = -1;
+	}
 err:
 	CRYPTO_w_unlock(CRYPTO_LOCK_EX_DATA);
 	return toret;
 }
 
+/* Return the methods of a class, and their number in *num. For classes with
+ * a snapshot no lock is taken and the methods are used in place; otherwise
+ * they are copied under the lock, and the copy, which the caller frees, is
+ * also returned in *copy. Returns 0 on error. */
+static int
+def_get_funcs(int class_index, CRYPTO_EX_DATA_FUNCS ***funcs, int *num,
+    CRYPTO_EX_DATA_FUNCS ***copy)
+{
+	EX_CLASS_SNAPSHOT *snap;
+	CRYPTO_EX_DATA_FUNCS **storage = NULL;
+	EX_CLASS_ITEM *item;
+	int mx, i;
+
+	*funcs = NULL;
+	*copy = NULL;
+	*num = 0;
+
+	if (class_index >= 0 && class_index < EX_SNAPSHOT_CLASSES) {
+		/* A class without a snapshot has no methods yet. */
+		if ((snap = ex_snapshots[class_index]) != NULL) {
+			*funcs = snap->funcs;
+			*num = snap->num;
+		}
+		return 1;
+	}
+
+	if ((item = def_get_class(class_index)) == NULL)
+		/* error is already set */
+		return 0;
+	CRYPTO_r_lock(CRYPTO_LOCK_EX_DATA);
+	mx = sk_CRYPTO_EX_DATA_FUNCS_num(item->meth);
+	if (mx > 0) {
+		storage = reallocarray(NULL, mx, sizeof(CRYPTO_EX_DATA_FUNCS*));
+		if (!storage)
+			goto skip;
+		for (i = 0; i < mx; i++)
+			storage[i] = sk_CRYPTO_EX_DATA_FUNCS_value(
+			    item->meth, i);
+	}
+skip:
+	CRYPTO_r_unlock(CRYPTO_LOCK_EX_DATA);
+	if ((mx > 0) && !storage) {
+		CRYPTOerror(ERR_R_MALLOC_FAILURE);
+		return 0;
+	}
+	*funcs = *copy = storage;
+	*num = mx;
+	return 1;
+}
+
 /**************************************************************/
 /* The functions in the default CRYPTO_EX_DATA_IMPL structure */
 
@@ -388,7 +503,18 @@ int_new_class(void)
 static void
 int_cleanup(void)
 {
+	EX_CLASS_SNAPSHOT *snap;
+	int i;
+
 	EX_DATA_CHECK(return;)
+	for (i = 0; i < EX_SNAPSHOT_CLASSES; i++) {
+		free(ex_snapshots[i]);
+		ex_snapshots[i] = NULL;
+	}
+	while ((snap = ex_snapshots_retired) != NULL) {
+		ex_snapshots_retired = snap->retired;
+		free(snap);
+	}
 	lh_EX_CLASS_ITEM_doall(ex_data, def_cleanup_cb);
 	lh_EX_CLASS_ITEM_free(ex_data);
 	ex_data = NULL;
@@ -407,38 +533,20 @@ int_get_new_index(int class_index, long argl, void *argp,
 	return def_add_index(item, argl, argp, new_func, dup_func, free_func);
 }
 
-/* Thread-safe by copying a class's array of "CRYPTO_EX_DATA_FUNCS" entries in
- * the lock, then using them outside the lock. NB: Thread-safety only applies to
- * the global "ex_data" state (ie. class definitions), not thread-safe on 'ad'
- * itself. */
+/* Thread-safe by using a snapshot of a class's array of "CRYPTO_EX_DATA_FUNCS"
+ * entries, or a copy made in the lock, outside the lock. NB: Thread-safety only
+ * applies to the global "ex_data" state (ie. class definitions), not
+ * thread-safe on 'ad' itself. */
 static int
 int_new_ex_data(int class_index, void *obj, CRYPTO_EX_DATA *ad)
 {
 	int mx, i;
 	void *ptr;
-	CRYPTO_EX_DATA_FUNCS **storage = NULL;
-	EX_CLASS_ITEM *item = def_get_class(class_index);
+	CRYPTO_EX_DATA_FUNCS **storage, **copy;
 
-	if (!item)
-		/* error is already set */
-		return 0;
 	ad->sk = NULL;
-	CRYPTO_r_lock(CRYPTO_LOCK_EX_DATA);
-	mx = sk_CRYPTO_EX_DATA_FUNCS_num(item->meth);
-	if (mx > 0) {
-		storage = reallocarray(NULL, mx, sizeof(CRYPTO_EX_DATA_FUNCS*));
-		if (!storage)
-			goto skip;
-		for (i = 0; i < mx; i++)
-			storage[i] = sk_CRYPTO_EX_DATA_FUNCS_value(
-			    item->meth, i);
-	}
-skip:
-	CRYPTO_r_unlock(CRYPTO_LOCK_EX_DATA);
-	if ((mx > 0) && !storage) {
-		CRYPTOerror(ERR_R_MALLOC_FAILURE);
+	if (!def_get_funcs(class_index, &storage, &mx, &copy))
 		return 0;
-	}
 	for (i = 0; i < mx; i++) {
 		if (storage[i] && storage[i]->new_func) {
 			ptr = CRYPTO_get_ex_data(ad, i);
@@ -446,7 +554,7 @@ skip:
 			    storage[i]->argl, storage[i]->argp);
 		}
 	}
-	free(storage);
+	free(copy);
 	return 1;
 }
 
@@ -456,33 +564,16 @@ int_dup_ex_data(int class_index, CRYPTO_EX_DATA *to, CRYPTO_EX_DATA *from)
 {
 	int mx, j, i;
 	char *ptr;
-	CRYPTO_EX_DATA_FUNCS **storage = NULL;
-	EX_CLASS_ITEM *item;
+	CRYPTO_EX_DATA_FUNCS **storage, **copy;
 
 	if (!from->sk)
 		/* 'to' should be "blank" which *is* just like 'from' */
 		return 1;
-	if ((item = def_get_class(class_index)) == NULL)
+	if (!def_get_funcs(class_index, &storage, &mx, &copy))
 		return 0;
-	CRYPTO_r_lock(CRYPTO_LOCK_EX_DATA);
-	mx = sk_CRYPTO_EX_DATA_FUNCS_num(item->meth);
 	j = sk_void_num(from->sk);
 	if (j < mx)
 		mx = j;
-	if (mx > 0) {
-		storage = reallocarray(NULL, mx, sizeof(CRYPTO_EX_DATA_FUNCS*));
-		if (!storage)
-			goto skip;
-		for (i = 0; i < mx; i++)
-			storage[i] = sk_CRYPTO_EX_DATA_FUNCS_value(
-			    item->meth, i);
-	}
-skip:
-	CRYPTO_r_unlock(CRYPTO_LOCK_EX_DATA);
-	if ((mx > 0) && !storage) {
-		CRYPTOerror(ERR_R_MALLOC_FAILURE);
-		return 0;
-	}
 	for (i = 0; i < mx; i++) {
 		ptr = CRYPTO_get_ex_data(from, i);
 		if (storage[i] && storage[i]->dup_func)
@@ -490,7 +581,7 @@ skip:
 			    storage[i]->argl, storage[i]->argp);
 		CRYPTO_set_ex_data(to, i, ptr);
 	}
-	free(storage);
+	free(copy);
 	return 1;
 }
 
@@ -499,28 +590,11 @@ static void
 int_free_ex_data(int class_index, void *obj, CRYPTO_EX_DATA *ad)
 {
 	int mx, i;
-	EX_CLASS_ITEM *item;
 	void *ptr;
-	CRYPTO_EX_DATA_FUNCS **storage = NULL;
+	CRYPTO_EX_DATA_FUNCS **storage, **copy;
 
-	if ((item = def_get_class(class_index)) == NULL)
-		return;
-	CRYPTO_r_lock(CRYPTO_LOCK_EX_DATA);
-	mx = sk_CRYPTO_EX_DATA_FUNCS_num(item->meth);
-	if (mx > 0) {
-		storage = reallocarray(NULL, mx, sizeof(CRYPTO_EX_DATA_FUNCS*));
-		if (!storage)
-			goto skip;
-		for (i = 0; i < mx; i++)
-			storage[i] = sk_CRYPTO_EX_DATA_FUNCS_value(
-			    item->meth, i);
-	}
-skip:
-	CRYPTO_r_unlock(CRYPTO_LOCK_EX_DATA);
-	if ((mx > 0) && !storage) {
-		CRYPTOerror(ERR_R_MALLOC_FAILURE);
+	if (!def_get_funcs(class_index, &storage, &mx, &copy))
 		return;
-	}
 	for (i = 0; i < mx; i++) {
 		if (storage[i] && storage[i]->free_func) {
 			ptr = CRYPTO_get_ex_data(ad, i);
@@ -528,7 +602,7 @@ skip:
 			    storage[i]->argl, storage[i]->argp);
 		}
 	}
-	free(storage);
+	free(copy);
 	if (ad->sk) {
 		sk_void_free(ad->sk);
 		ad->sk = NULL;
@@ -102,6 +102,50 @@ Gost2814789_encrypt(const unsigned char *in, unsigned char *out,
 	l2c(n1, out);
 }
 
+/*
+ * Run four independent blocks through the rounds side by side, so that the
+ * table lookups of one block overlap with those of the others instead of
+ * waiting on the previous round of the same block.
+ */
+#define ROUND4(a, b, k) do {						\
+	unsigned int k_ = (k);						\
+	b##0 ^= f(key, a##0 + k_); b##1 ^= f(key, a##1 + k_);		\
+	b##2 ^= f(key, a##2 + k_); b##3 ^= f(key, a##3 + k_);		\
+} while (0)
+
+static void
+Gost2814789_encrypt4(const unsigned char *in, unsigned char *out,
+    const GOST2814789_KEY *key)
+{
+	unsigned int x0, x1, x2, x3, y0, y1, y2, y3; /* n1, n2 in the GOST */
+	int i;
+
+	c2l(in, x0); c2l(in, y0);
+	c2l(in, x1); c2l(in, y1);
+	c2l(in, x2); c2l(in, y2);
+	c2l(in, x3); c2l(in, y3);
+
+	/* Instead of swapping halves, swap names each round */
+	for (i = 0; i < 3; i++) {
+		ROUND4(x, y, key->key[0]); ROUND4(y, x, key->key[1]);
+		ROUND4(x, y, key->key[2]); ROUND4(y, x, key->key[3]);
+		ROUND4(x, y, key->key[4]); ROUND4(y, x, key->key[5]);
+		ROUND4(x, y, key->key[6]); ROUND4(y, x, key->key[7]);
+	}
+
+	ROUND4(x, y, key->key[7]); ROUND4(y, x, key->key[6]);
+	ROUND4(x, y, key->key[5]); ROUND4(y, x, key->key[4]);
+	ROUND4(x, y, key->key[3]); ROUND4(y, x, key->key[2]);
+	ROUND4(x, y, key->key[1]); ROUND4(y, x, key->key[0]);
+
+	l2c(y0, out); l2c(x0, out);
+	l2c(y1, out); l2c(x1, out);
+	l2c(y2, out); l2c(x2, out);
+	l2c(y3, out); l2c(x3, out);
+}
+
+#undef ROUND4
+
 void
 Gost2814789_decrypt(const unsigned char *in, unsigned char *out,
     const GOST2814789_KEY *key)
@@ -206,11 +250,25 @@ Gost2814789_mac_mesh(const unsigned char *data, unsigned char *mac,
 	key->count += 8;
 }
 
+/*
+ * Whether the next four blocks can be processed together, that is, none of
+ * them is due for a CryptoPro key mesh.
+ */
+static inline int
+Gost2814789_nomesh4(const GOST2814789_KEY *key)
+{
+	return !key->key_meshing || key->count + 24 < 1024;
+}
+
 void
 Gost2814789_cfb64_encrypt(const unsigned char *in, unsigned char *out,
     size_t len, GOST2814789_KEY *key, unsigned char *ivec, int *num,
     const int enc)
 {
+	union {
+		size_t t[32 / sizeof(size_t)];
+		unsigned char c[32];
+	} ks;
 	unsigned int n;
 	size_t l = 0;
 
@@ -279,6 +337,23 @@ Gost2814789_cfb64_encrypt(const unsigned char *in, unsigned char *out,
 				break;
 #endif
 			while (len >= 8) {
+				if (len >= 32 && Gost2814789_nomesh4(key)) {
+					memcpy(ks.c, ivec, 8);
+					memcpy(ks.c + 8, in, 24);
+					memcpy(ivec, in + 24, 8);
+					Gost2814789_encrypt4(ks.c, ks.c, key);
+					key->count += 32;
+					for (; n < 32; n += sizeof(size_t)) {
+						*(size_t*)(out + n) =
+						    *(size_t*)(ks.c + n) ^
+						    *(size_t*)(in + n);
+					}
+					len -= 32;
+					out += 32;
+					in  += 32;
+					n = 0;
+					continue;
+				}
 				Gost2814789_encrypt_mesh(ivec, key);
 				for (; n < 8; n += sizeof(size_t)) {
 					size_t t = *(size_t*)(in + n);
@@ -321,21 +396,11 @@ Gost2814789_cfb64_encrypt(const unsigned char *in, unsigned char *out,
 }
 
 static inline void
-Gost2814789_cnt_next(unsigned char *ivec, unsigned char *out,
-    GOST2814789_KEY *key)
+Gost2814789_cnt_inc(unsigned char *ivec)
 {
 	unsigned char *p = ivec, *p2 = ivec;
 	unsigned int val, val2;
 
-	if (key->count == 0)
-		Gost2814789_encrypt(ivec, ivec, key);
-
-	if (key->key_meshing && key->count == 1024) {
-		Gost2814789_cryptopro_key_mesh(key);
-		Gost2814789_encrypt(ivec, ivec, key);
-		key->count = 0;
-	}
-
 	c2l(p, val);
 	val2 = val + 0x01010101;
 	l2c(val2, p2);
@@ -345,15 +410,55 @@ Gost2814789_cnt_next(unsigned char *ivec, unsigned char *out,
 	if (val > val2) /* overflow */
 		val2++;
 	l2c(val2, p2);
+}
+
+static inline void
+Gost2814789_cnt_next(unsigned char *ivec, unsigned char *out,
+    GOST2814789_KEY *key)
+{
+	if (key->count == 0)
+		Gost2814789_encrypt(ivec, ivec, key);
+
+	if (key->key_meshing && key->count == 1024) {
+		Gost2814789_cryptopro_key_mesh(key);
+		Gost2814789_encrypt(ivec, ivec, key);
+		key->count = 0;
+	}
+
+	Gost2814789_cnt_inc(ivec);
 
 	Gost2814789_encrypt(ivec, out, key);
 	key->count += 8;
 }
 
+/*
+ * Produce the key stream for the next four counter values at once. The
+ * caller ensures that the counter has been set up and that no key mesh
+ * falls within these blocks.
+ */
+static inline void
+Gost2814789_cnt_next4(unsigned char *ivec, unsigned char *out,
+    GOST2814789_KEY *key)
+{
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		Gost2814789_cnt_inc(ivec);
+		memcpy(out + 8 * i, ivec, 8);
+	}
+
+	Gost2814789_encrypt4(out, out, key);
+	key->count += 32;
+}
+
 void
 Gost2814789_cnt_encrypt(const unsigned char *in, unsigned char *out, size_t len,
     GOST2814789_KEY *key, unsigned char *ivec, unsigned char *cnt_buf, int *num)
 {
+	union {
+		size_t t[32 / sizeof(size_t)];
+		unsigned char c[32];
+	} ks;
 	unsigned int n;
 	size_t l = 0;
 
@@ -373,6 +478,18 @@ Gost2814789_cnt_encrypt(const unsigned char *in, unsigned char *out, size_t len,
 			break;
 #endif
 		while (len >= 8) {
+			if (len >= 32 && key->count != 0 &&
+			    Gost2814789_nomesh4(key)) {
+				Gost2814789_cnt_next4(ivec, ks.c, key);
+				for (; n < 32; n += sizeof(size_t))
+					*(size_t *)(out + n) = *(size_t *)(in + n) ^
+					    *(size_t *)(ks.c + n);
+				len -= 32;
+				out += 32;
+				in  += 32;
+				n = 0;
+				continue;
+			}
 			Gost2814789_cnt_next(ivec, cnt_buf, key);
 			for (; n < 8; n += sizeof(size_t))
 				*(size_t *)(out + n) = *(size_t *)(in + n) ^
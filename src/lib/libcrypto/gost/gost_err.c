@@ -62,18 +62,20 @@
 #include <openssl/err.h>
 #include <openssl/gost.h>
 
+#include "cryptlib.h"
+
 /* BEGIN ERROR CODES */
 #ifndef OPENSSL_NO_ERR
 
 #define ERR_FUNC(func) ERR_PACK(ERR_LIB_GOST,func,0)
 #define ERR_REASON(reason) ERR_PACK(ERR_LIB_GOST,0,reason)
 
-static ERR_STRING_DATA GOST_str_functs[]= {
+static const ERR_STRING_DATA GOST_str_functs[]= {
 	{ERR_FUNC(0xfff), "CRYPTO_internal"},
 	{0, NULL}
 };
 
-static ERR_STRING_DATA GOST_str_reasons[] = {
+static const ERR_STRING_DATA GOST_str_reasons[] = {
 	{ERR_REASON(GOST_R_BAD_KEY_PARAMETERS_FORMAT),"bad key parameters format"},
 	{ERR_REASON(GOST_R_BAD_PKEY_PARAMETERS_FORMAT),"bad pkey parameters format"},
 	{ERR_REASON(GOST_R_CANNOT_PACK_EPHEMERAL_KEY),"cannot pack ephemeral key"},
@@ -104,8 +106,8 @@ void
 ERR_load_GOST_strings(void) {
 #ifndef OPENSSL_NO_ERR
 	if (ERR_func_error_string(GOST_str_functs[0].error) == NULL) {
-		ERR_load_strings(0,GOST_str_functs);
-		ERR_load_strings(0,GOST_str_reasons);
+		ERR_load_const_strings(GOST_str_functs);
+		ERR_load_const_strings(GOST_str_reasons);
 	}
 #endif
 }
@@ -60,8 +60,13 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <openssl/opensslconf.h>
+
 #include <openssl/err.h>
 #include <openssl/hmac.h>
+#include <openssl/sha.h>
+
+#include "sha_internal.h"
 
 int
 HMAC_Init_ex(HMAC_CTX *ctx, const void *key, int len, const EVP_MD *md,
@@ -274,3 +279,48 @@ err:
 	HMAC_CTX_cleanup(&c);
 	return NULL;
 }
+
+/*
+ * HMAC of count messages, each with its own key. HMAC-SHA256 is computed
+ * directly on the hash state, several messages at a time where the
+ * multi-buffer SHA-256 kernels are available. Other digests reuse a single
+ * context for all messages.
+ */
+int
+HMAC_batch(const EVP_MD *evp_md, const void *const *key, const int *key_len,
+    const unsigned char *const *d, const size_t *n, unsigned char *const *md,
+    size_t count)
+{
+	HMAC_CTX c;
+	size_t i;
+	int ret = 0;
+
+	for (i = 0; i < count; i++) {
+		if (key_len[i] < 0 || (key[i] == NULL && key_len[i] != 0)) {
+			EVPerror(EVP_R_BAD_KEY_LENGTH);
+			return 0;
+		}
+	}
+
+#ifndef OPENSSL_NO_SHA256
+	if (evp_md == EVP_sha256()) {
+		sha256_hmac_multi(key, key_len, d, n, md, count);
+		return 1;
+	}
+#endif
+
+	HMAC_CTX_init(&c);
+	for (i = 0; i < count; i++) {
+		if (!HMAC_Init_ex(&c, key[i] != NULL ? key[i] : "",
+		    key_len[i], evp_md, NULL))
+			goto err;
+		if (!HMAC_Update(&c, d[i], n[i]))
+			goto err;
+		if (!HMAC_Final(&c, md[i], NULL))
+			goto err;
+	}
+	ret = 1;
+err:
+	HMAC_CTX_cleanup(&c);
+	return ret;
+}
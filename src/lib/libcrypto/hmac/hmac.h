@@ -99,11 +99,24 @@ int HMAC_Update(HMAC_CTX *ctx, const unsigned char *data, size_t len);
 int HMAC_Final(HMAC_CTX *ctx, unsigned char *md, unsigned int *len);
 unsigned char *HMAC(const EVP_MD *evp_md, const void *key, int key_len,
     const unsigned char *d, size_t n, unsigned char *md, unsigned int *md_len);
+int HMAC_batch(const EVP_MD *evp_md, const void *const *key, const int *key_len,
+    const unsigned char *const *d, const size_t *n, unsigned char *const *md,
+    size_t count);
 int HMAC_CTX_copy(HMAC_CTX *dctx, HMAC_CTX *sctx);
 
 void HMAC_CTX_set_flags(HMAC_CTX *ctx, unsigned long flags);
 const EVP_MD *HMAC_CTX_get_md(const HMAC_CTX *ctx);
 
+typedef struct hmac_precomputed_st HMAC_PRECOMPUTED;
+
+HMAC_PRECOMPUTED *HMAC_precomputed_new(const EVP_MD *md, const void *key,
+    size_t key_len);
+void HMAC_precomputed_free(HMAC_PRECOMPUTED *state);
+int HMAC_precomputed_mac(const HMAC_PRECOMPUTED *state,
+    const unsigned char *data, size_t data_len, unsigned char *out,
+    unsigned int *out_len);
+const EVP_MD *HMAC_precomputed_get_md(const HMAC_PRECOMPUTED *state);
+
 #ifdef  __cplusplus
 }
 #endif
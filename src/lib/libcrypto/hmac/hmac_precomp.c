@@ -0,0 +1,367 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * HMAC with a key that is set up once.
+ *
+ * The state of the hash after the inner and outer padded key blocks is
+ * kept, so that each MAC only hashes the data and the inner digest.  For the
+ * built-in MD5, SHA-1 and SHA-2 digests this state is the plain hash context,
+ * which is copied by value and needs neither an allocation nor the EVP
+ * layer.  Any other digest goes through a pair of EVP_MD_CTX.  The state is
+ * not changed by computing a MAC, so it may be shared between threads.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/opensslconf.h>
+
+#include <openssl/err.h>
+#include <openssl/hmac.h>
+#include <openssl/md5.h>
+#include <openssl/objects.h>
+#include <openssl/sha.h>
+
+union hmac_hash {
+#ifndef OPENSSL_NO_MD5
+	MD5_CTX md5;
+#endif
+#ifndef OPENSSL_NO_SHA
+	SHA_CTX sha1;
+#endif
+#ifndef OPENSSL_NO_SHA256
+	SHA256_CTX sha256;
+#endif
+#ifndef OPENSSL_NO_SHA512
+	SHA512_CTX sha512;
+#endif
+};
+
+struct hmac_precomputed_st {
+	const EVP_MD *md;
+	int nid;		/* NID_undef if the EVP contexts are used */
+	unsigned int md_size;
+	union hmac_hash inner;
+	union hmac_hash outer;
+	EVP_MD_CTX *i_ctx;
+	EVP_MD_CTX *o_ctx;
+};
+
+/*
+ * Return the NID of md if its hash context can be used directly, that is if
+ * it is one of the built-in digests and not one provided by an ENGINE.
+ */
+static int
+hmac_hash_nid(const EVP_MD *md)
+{
+	switch (EVP_MD_type(md)) {
+#ifndef OPENSSL_NO_MD5
+	case NID_md5:
+		if (md == EVP_md5())
+			return NID_md5;
+		break;
+#endif
+#ifndef OPENSSL_NO_SHA
+	case NID_sha1:
+		if (md == EVP_sha1())
+			return NID_sha1;
+		break;
+#endif
+#ifndef OPENSSL_NO_SHA256
+	case NID_sha224:
+		if (md == EVP_sha224())
+			return NID_sha224;
+		break;
+	case NID_sha256:
+		if (md == EVP_sha256())
+			return NID_sha256;
+		break;
+#endif
+#ifndef OPENSSL_NO_SHA512
+	case NID_sha384:
+		if (md == EVP_sha384())
+			return NID_sha384;
+		break;
+	case NID_sha512:
+		if (md == EVP_sha512())
+			return NID_sha512;
+		break;
+#endif
+	}
+
+	return NID_undef;
+}
+
+static void
+hmac_hash_init(int nid, union hmac_hash *h)
+{
+	switch (nid) {
+#ifndef OPENSSL_NO_MD5
+	case NID_md5:
+		MD5_Init(&h->md5);
+		break;
+#endif
+#ifndef OPENSSL_NO_SHA
+	case NID_sha1:
+		SHA1_Init(&h->sha1);
+		break;
+#endif
+#ifndef OPENSSL_NO_SHA256
+	case NID_sha224:
+		SHA224_Init(&h->sha256);
+		break;
+	case NID_sha256:
+		SHA256_Init(&h->sha256);
+		break;
+#endif
+#ifndef OPENSSL_NO_SHA512
+	case NID_sha384:
+		SHA384_Init(&h->sha512);
+		break;
+	case NID_sha512:
+		SHA512_Init(&h->sha512);
+		break;
+#endif
+	}
+}
+
+static void
+hmac_hash_update(int nid, union hmac_hash *h, const void *data, size_t len)
+{
+	switch (nid) {
+#ifndef OPENSSL_NO_MD5
+	case NID_md5:
+		MD5_Update(&h->md5, data, len);
+		break;
+#endif
+#ifndef OPENSSL_NO_SHA
+	case NID_sha1:
+		SHA1_Update(&h->sha1, data, len);
+		break;
+#endif
+#ifndef OPENSSL_NO_SHA256
+	case NID_sha224:
+	case NID_sha256:
+		SHA256_Update(&h->sha256, data, len);
+		break;
+#endif
+#ifndef OPENSSL_NO_SHA512
+	case NID_sha384:
+	case NID_sha512:
+		SHA512_Update(&h->sha512, data, len);
+		break;
+#endif
+	}
+}
+
+static void
+hmac_hash_final(int nid, union hmac_hash *h, unsigned char *out)
+{
+	switch (nid) {
+#ifndef OPENSSL_NO_MD5
+	case NID_md5:
+		MD5_Final(out, &h->md5);
+		break;
+#endif
+#ifndef OPENSSL_NO_SHA
+	case NID_sha1:
+		SHA1_Final(out, &h->sha1);
+		break;
+#endif
+#ifndef OPENSSL_NO_SHA256
+	case NID_sha224:
+	case NID_sha256:
+		SHA256_Final(out, &h->sha256);
+		break;
+#endif
+#ifndef OPENSSL_NO_SHA512
+	case NID_sha384:
+	case NID_sha512:
+		SHA512_Final(out, &h->sha512);
+		break;
+#endif
+	}
+}
+
+static int
+hmac_precomputed_pad(HMAC_PRECOMPUTED *state, const unsigned char *key,
+    unsigned char pad_byte, int block_size, union hmac_hash *h,
+    EVP_MD_CTX **md_ctx)
+{
+	unsigned char pad[HMAC_MAX_MD_CBLOCK];
+	int i, ret = 0;
+
+	for (i = 0; i < block_size; i++)
+		pad[i] = key[i] ^ pad_byte;
+
+	if (state->nid != NID_undef) {
+		hmac_hash_init(state->nid, h);
+		hmac_hash_update(state->nid, h, pad, block_size);
+	} else {
+		if ((*md_ctx = EVP_MD_CTX_new()) == NULL) {
+			EVPerror(ERR_R_MALLOC_FAILURE);
+			goto err;
+		}
+		if (!EVP_DigestInit_ex(*md_ctx, state->md, NULL))
+			goto err;
+		if (!EVP_DigestUpdate(*md_ctx, pad, block_size))
+			goto err;
+	}
+
+	ret = 1;
+
+ err:
+	explicit_bzero(pad, sizeof(pad));
+
+	return ret;
+}
+
+HMAC_PRECOMPUTED *
+HMAC_precomputed_new(const EVP_MD *md, const void *key, size_t key_len)
+{
+	HMAC_PRECOMPUTED *state = NULL;
+	unsigned char key_block[HMAC_MAX_MD_CBLOCK];
+	unsigned int len;
+	int block_size, md_size;
+
+	memset(key_block, 0, sizeof(key_block));
+
+	if ((block_size = EVP_MD_block_size(md)) <= 0 ||
+	    (size_t)block_size > sizeof(key_block)) {
+		EVPerror(EVP_R_BAD_BLOCK_LENGTH);
+		goto err;
+	}
+	if ((md_size = EVP_MD_size(md)) <= 0 || md_size > EVP_MAX_MD_SIZE) {
+		EVPerror(EVP_R_INVALID_DIGEST);
+		goto err;
+	}
+
+	if ((state = calloc(1, sizeof(*state))) == NULL) {
+		EVPerror(ERR_R_MALLOC_FAILURE);
+		goto err;
+	}
+	state->md = md;
+	state->nid = hmac_hash_nid(md);
+	state->md_size = md_size;
+
+	if (key_len > (size_t)block_size) {
+		if (!EVP_Digest(key, key_len, key_block, &len, md, NULL))
+			goto err;
+	} else if (key_len > 0)
+		memcpy(key_block, key, key_len);
+
+	if (!hmac_precomputed_pad(state, key_block, 0x36, block_size,
+	    &state->inner, &state->i_ctx))
+		goto err;
+	if (!hmac_precomputed_pad(state, key_block, 0x5c, block_size,
+	    &state->outer, &state->o_ctx))
+		goto err;
+
+	explicit_bzero(key_block, sizeof(key_block));
+
+	return state;
+
+ err:
+	explicit_bzero(key_block, sizeof(key_block));
+	HMAC_precomputed_free(state);
+
+	return NULL;
+}
+
+void
+HMAC_precomputed_free(HMAC_PRECOMPUTED *state)
+{
+	if (state == NULL)
+		return;
+
+	EVP_MD_CTX_free(state->i_ctx);
+	EVP_MD_CTX_free(state->o_ctx);
+
+	freezero(state, sizeof(*state));
+}
+
+static int
+hmac_precomputed_mac_evp(const HMAC_PRECOMPUTED *state,
+    const unsigned char *data, size_t data_len, unsigned char *out,
+    unsigned char *inner)
+{
+	EVP_MD_CTX md_ctx;
+	int ret = 0;
+
+	EVP_MD_CTX_init(&md_ctx);
+
+	if (!EVP_MD_CTX_copy_ex(&md_ctx, state->i_ctx))
+		goto err;
+	if (!EVP_DigestUpdate(&md_ctx, data, data_len))
+		goto err;
+	if (!EVP_DigestFinal_ex(&md_ctx, inner, NULL))
+		goto err;
+	if (!EVP_MD_CTX_copy_ex(&md_ctx, state->o_ctx))
+		goto err;
+	if (!EVP_DigestUpdate(&md_ctx, inner, state->md_size))
+		goto err;
+	if (!EVP_DigestFinal_ex(&md_ctx, out, NULL))
+		goto err;
+
+	ret = 1;
+
+ err:
+	EVP_MD_CTX_cleanup(&md_ctx);
+
+	return ret;
+}
+
+int
+HMAC_precomputed_mac(const HMAC_PRECOMPUTED *state, const unsigned char *data,
+    size_t data_len, unsigned char *out, unsigned int *out_len)
+{
+	unsigned char inner[EVP_MAX_MD_SIZE];
+	union hmac_hash h;
+	int ret = 0;
+
+	if (state->nid == NID_undef) {
+		if (!hmac_precomputed_mac_evp(state, data, data_len, out,
+		    inner))
+			goto err;
+	} else {
+		h = state->inner;
+		hmac_hash_update(state->nid, &h, data, data_len);
+		hmac_hash_final(state->nid, &h, inner);
+
+		h = state->outer;
+		hmac_hash_update(state->nid, &h, inner, state->md_size);
+		hmac_hash_final(state->nid, &h, out);
+	}
+
+	if (out_len != NULL)
+		*out_len = state->md_size;
+
+	ret = 1;
+
+ err:
+	explicit_bzero(&h, sizeof(h));
+	explicit_bzero(inner, sizeof(inner));
+
+	return ret;
+}
+
+const EVP_MD *
+HMAC_precomputed_get_md(const HMAC_PRECOMPUTED *state)
+{
+	return state->md;
+}
@@ -0,0 +1,341 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Open addressing hash table with linear probing.
+ *
+ * A slot holds a 32 bit tag, derived from the hash of its item, next to the
+ * item pointer, so a probe only compares items whose tags match and usually
+ * touches a single cache line. Tags below OA_HASH_TAG_MIN mark empty and
+ * deleted slots. A table is kept at most three quarters full, counting
+ * deleted slots, so every probe sequence ends at an empty slot.
+ *
+ * When the table fills up a new one is allocated, sized for four times the
+ * number of items, and the old table is kept until its items have been
+ * moved over, OA_HASH_MOVE_SLOTS slots at every insertion and deletion.
+ * Lookups search the new table and then the part of the old one that has
+ * not been moved yet.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/lhash.h>
+
+#include "oa_hash.h"
+
+#define OA_HASH_TAG_EMPTY	0
+#define OA_HASH_TAG_DELETED	1
+#define OA_HASH_TAG_MIN		2
+
+#define OA_HASH_MIN_SLOTS	16
+#define OA_HASH_MOVE_SLOTS	8
+
+struct oa_hash_slot {
+	uint32_t tag;
+	void *data;
+};
+
+struct oa_hash_table {
+	struct oa_hash_slot *slots;
+	size_t mask;		/* Number of slots less one. */
+	size_t used;		/* Slots that are not empty. */
+	size_t items;
+};
+
+struct oa_hash_st {
+	struct oa_hash_table cur;
+	struct oa_hash_table old;	/* Being moved to cur, if slots set. */
+	size_t moved;			/* Slots of old already moved. */
+	int walking;
+
+	LHASH_HASH_FN_TYPE hash;
+	LHASH_COMP_FN_TYPE cmp;
+	int error;
+};
+
+static uint32_t
+oa_hash_tag(const OA_HASH *h, const void *data)
+{
+	uint64_t v;
+	uint32_t tag;
+
+	/* The lhash functions mostly vary in their low bits, so mix them. */
+	v = h->hash(data);
+	v *= 0x9e3779b97f4a7c15ULL;
+	tag = v >> 32;
+	if (tag < OA_HASH_TAG_MIN)
+		tag += OA_HASH_TAG_MIN;
+
+	return tag;
+}
+
+static int
+oa_hash_table_init(struct oa_hash_table *t, size_t nslots)
+{
+	memset(t, 0, sizeof(*t));
+	if ((t->slots = calloc(nslots, sizeof(*t->slots))) == NULL)
+		return 0;
+	t->mask = nslots - 1;
+
+	return 1;
+}
+
+static struct oa_hash_slot *
+oa_hash_table_find(const OA_HASH *h, const struct oa_hash_table *t,
+    uint32_t tag, const void *data)
+{
+	struct oa_hash_slot *s;
+	size_t i;
+
+	if (t->slots == NULL)
+		return NULL;
+
+	for (i = tag & t->mask; ; i = (i + 1) & t->mask) {
+		s = &t->slots[i];
+		if (s->tag == OA_HASH_TAG_EMPTY)
+			return NULL;
+		if (s->tag == tag && h->cmp(s->data, data) == 0)
+			return s;
+	}
+}
+
+/* Place an item known not to be in the table. */
+static void
+oa_hash_table_place(struct oa_hash_table *t, uint32_t tag, void *data)
+{
+	struct oa_hash_slot *s;
+	size_t i;
+
+	for (i = tag & t->mask; ; i = (i + 1) & t->mask) {
+		s = &t->slots[i];
+		if (s->tag < OA_HASH_TAG_MIN)
+			break;
+	}
+	if (s->tag == OA_HASH_TAG_EMPTY)
+		t->used++;
+	s->tag = tag;
+	s->data = data;
+	t->items++;
+}
+
+static void
+oa_hash_move(OA_HASH *h, size_t nslots)
+{
+	struct oa_hash_slot *s;
+
+	if (h->old.slots == NULL || h->walking)
+		return;
+
+	for (; nslots > 0 && h->moved <= h->old.mask; nslots--, h->moved++) {
+		s = &h->old.slots[h->moved];
+		if (s->tag < OA_HASH_TAG_MIN)
+			continue;
+		oa_hash_table_place(&h->cur, s->tag, s->data);
+		h->old.items--;
+		/* Keep the probe sequences that pass through this slot. */
+		s->tag = OA_HASH_TAG_DELETED;
+		s->data = NULL;
+	}
+	if (h->moved > h->old.mask) {
+		free(h->old.slots);
+		memset(&h->old, 0, sizeof(h->old));
+		h->moved = 0;
+	}
+}
+
+/*
+ * Make room for one more item, starting to move the items to a larger table
+ * if the current one would be too full.
+ */
+static int
+oa_hash_expand(OA_HASH *h)
+{
+	struct oa_hash_table t;
+	size_t items, nslots;
+
+	if ((h->cur.used + h->old.items + 1) * 4 <= (h->cur.mask + 1) * 3)
+		return 1;
+
+	/* Finish with the previous table first, which is rarely needed. */
+	oa_hash_move(h, SIZE_MAX);
+	if ((h->cur.used + 1) * 4 <= (h->cur.mask + 1) * 3)
+		return 1;
+
+	items = h->cur.items + 1;
+	for (nslots = OA_HASH_MIN_SLOTS; nslots < items * 4; nslots *= 2) {
+		if (nslots > SIZE_MAX / 2 / sizeof(struct oa_hash_slot))
+			return 0;
+	}
+	if (!oa_hash_table_init(&t, nslots))
+		return 0;
+
+	h->old = h->cur;
+	h->cur = t;
+	h->moved = 0;
+
+	return 1;
+}
+
+OA_HASH *
+oa_hash_new(LHASH_HASH_FN_TYPE hash, LHASH_COMP_FN_TYPE cmp)
+{
+	OA_HASH *h;
+
+	if ((h = calloc(1, sizeof(*h))) == NULL)
+		return NULL;
+	if (!oa_hash_table_init(&h->cur, OA_HASH_MIN_SLOTS)) {
+		free(h);
+		return NULL;
+	}
+	h->hash = hash;
+	h->cmp = cmp;
+
+	return h;
+}
+
+void
+oa_hash_free(OA_HASH *h)
+{
+	if (h == NULL)
+		return;
+
+	free(h->cur.slots);
+	free(h->old.slots);
+	free(h);
+}
+
+void *
+oa_hash_insert(OA_HASH *h, void *data)
+{
+	struct oa_hash_slot *s;
+	uint32_t tag;
+	void *ret;
+
+	h->error = 0;
+
+	tag = oa_hash_tag(h, data);
+	if ((s = oa_hash_table_find(h, &h->cur, tag, data)) != NULL ||
+	    (s = oa_hash_table_find(h, &h->old, tag, data)) != NULL) {
+		ret = s->data;
+		s->data = data;
+		return ret;
+	}
+
+	if (!oa_hash_expand(h)) {
+		h->error = 1;
+		return NULL;
+	}
+	oa_hash_table_place(&h->cur, tag, data);
+	oa_hash_move(h, OA_HASH_MOVE_SLOTS);
+
+	return NULL;
+}
+
+void *
+oa_hash_delete(OA_HASH *h, const void *data)
+{
+	struct oa_hash_slot *s;
+	uint32_t tag;
+	void *ret;
+
+	h->error = 0;
+
+	tag = oa_hash_tag(h, data);
+	if ((s = oa_hash_table_find(h, &h->cur, tag, data)) != NULL)
+		h->cur.items--;
+	else if ((s = oa_hash_table_find(h, &h->old, tag, data)) != NULL)
+		h->old.items--;
+	else
+		return NULL;
+
+	ret = s->data;
+	s->tag = OA_HASH_TAG_DELETED;
+	s->data = NULL;
+	oa_hash_move(h, OA_HASH_MOVE_SLOTS);
+
+	return ret;
+}
+
+void *
+oa_hash_retrieve(const OA_HASH *h, const void *data)
+{
+	struct oa_hash_slot *s;
+	uint32_t tag;
+
+	tag = oa_hash_tag(h, data);
+	if ((s = oa_hash_table_find(h, &h->cur, tag, data)) != NULL ||
+	    (s = oa_hash_table_find(h, &h->old, tag, data)) != NULL)
+		return s->data;
+
+	return NULL;
+}
+
+static void
+oa_hash_table_doall(struct oa_hash_table *t, size_t start,
+    LHASH_DOALL_FN_TYPE func, LHASH_DOALL_ARG_FN_TYPE func_arg, void *arg)
+{
+	size_t i;
+
+	if (t->slots == NULL)
+		return;
+
+	for (i = start; i <= t->mask; i++) {
+		if (t->slots[i].tag < OA_HASH_TAG_MIN)
+			continue;
+		if (func_arg != NULL)
+			func_arg(t->slots[i].data, arg);
+		else
+			func(t->slots[i].data);
+	}
+}
+
+static void
+oa_hash_doall_internal(OA_HASH *h, LHASH_DOALL_FN_TYPE func,
+    LHASH_DOALL_ARG_FN_TYPE func_arg, void *arg)
+{
+	/* Deletions only mark slots while walking, so no item can move. */
+	h->walking++;
+	oa_hash_table_doall(&h->old, h->moved, func, func_arg, arg);
+	oa_hash_table_doall(&h->cur, 0, func, func_arg, arg);
+	h->walking--;
+}
+
+void
+oa_hash_doall(OA_HASH *h, LHASH_DOALL_FN_TYPE func)
+{
+	oa_hash_doall_internal(h, func, NULL, NULL);
+}
+
+void
+oa_hash_doall_arg(OA_HASH *h, LHASH_DOALL_ARG_FN_TYPE func, void *arg)
+{
+	oa_hash_doall_internal(h, NULL, func, arg);
+}
+
+size_t
+oa_hash_num_items(const OA_HASH *h)
+{
+	return h->cur.items + h->old.items;
+}
+
+int
+oa_hash_error(const OA_HASH *h)
+{
+	return h->error;
+}
@@ -0,0 +1,84 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* oa_hash */
+#ifndef HEADER_OA_HASH_H
+#define HEADER_OA_HASH_H
+
+#include <stddef.h>
+
+#include <openssl/lhash.h>
+
+__BEGIN_HIDDEN_DECLS
+
+/*
+ * An open addressing hash table of pointers, for internal users of lhash
+ * that look items up often. It takes the same hash, compare and doall
+ * functions as lhash, stores each item and its hash inline in the table
+ * rather than in a separately allocated node, and grows incrementally, by
+ * moving a few items from the old table on each insertion or deletion.
+ *
+ * oa_hash_retrieve() does not modify the table, so that it may be called
+ * by several threads at once. Items may be deleted but not inserted while
+ * the table is walked by oa_hash_doall() or oa_hash_doall_arg().
+ */
+typedef struct oa_hash_st OA_HASH;
+
+OA_HASH *oa_hash_new(LHASH_HASH_FN_TYPE hash, LHASH_COMP_FN_TYPE cmp);
+void oa_hash_free(OA_HASH *h);
+void *oa_hash_insert(OA_HASH *h, void *data);
+void *oa_hash_delete(OA_HASH *h, const void *data);
+void *oa_hash_retrieve(const OA_HASH *h, const void *data);
+void oa_hash_doall(OA_HASH *h, LHASH_DOALL_FN_TYPE func);
+void oa_hash_doall_arg(OA_HASH *h, LHASH_DOALL_ARG_FN_TYPE func, void *arg);
+size_t oa_hash_num_items(const OA_HASH *h);
+int oa_hash_error(const OA_HASH *h);
+
+/* Type checked wrappers, in the manner of LHASH_OF. */
+#define OA_HASH_OF(type) struct oa_hash_st_##type
+#define DECLARE_OA_HASH_OF(type) OA_HASH_OF(type) { int dummy; }
+
+#define CHECKED_OA_HASH_OF(type, h) \
+	((OA_HASH *)CHECKED_PTR_OF(OA_HASH_OF(type), h))
+
+#define OA_HASH_NEW(type, name) \
+	((OA_HASH_OF(type) *)oa_hash_new(LHASH_HASH_FN(name), \
+	    LHASH_COMP_FN(name)))
+#define OA_HASH_FREE(type, h) \
+	oa_hash_free(CHECKED_OA_HASH_OF(type, h))
+#define OA_HASH_INSERT(type, h, inst) \
+	((type *)oa_hash_insert(CHECKED_OA_HASH_OF(type, h), \
+	    CHECKED_PTR_OF(type, inst)))
+#define OA_HASH_DELETE(type, h, inst) \
+	((type *)oa_hash_delete(CHECKED_OA_HASH_OF(type, h), \
+	    CHECKED_PTR_OF(type, inst)))
+#define OA_HASH_RETRIEVE(type, h, inst) \
+	((type *)oa_hash_retrieve(CHECKED_OA_HASH_OF(type, h), \
+	    CHECKED_PTR_OF(type, inst)))
+#define OA_HASH_DOALL(type, h, fn) \
+	oa_hash_doall(CHECKED_OA_HASH_OF(type, h), fn)
+#define OA_HASH_DOALL_ARG(type, h, fn, arg_type, arg) \
+	oa_hash_doall_arg(CHECKED_OA_HASH_OF(type, h), fn, \
+	    CHECKED_PTR_OF(arg_type, arg))
+#define OA_HASH_NUM_ITEMS(type, h) \
+	oa_hash_num_items(CHECKED_OA_HASH_OF(type, h))
+#define OA_HASH_ERROR(type, h) \
+	oa_hash_error(CHECKED_OA_HASH_OF(type, h))
+
+__END_HIDDEN_DECLS
+
+#endif
@@ -18,6 +18,232 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <openssl/crypto.h>
+
+/*
+ * The allocations made here are counted against the file of the caller,
+ * which is passed in, rather than this one.
+ */
+#ifdef CRYPTO_MEM_ACCOUNTING
+#undef malloc
+#undef calloc
+#undef realloc
+#undef reallocarray
+#undef recallocarray
+#undef strdup
+#undef strndup
+#undef free
+#undef freezero
+#endif
+
+/*
+ * Allocation accounting, by subsystem. A file is taken to belong to a
+ * libcrypto subsystem by the directory it is in and to a part of libssl by
+ * its name.
+ */
+static int crypto_mem_enabled;
+static CRYPTO_MEM_COUNTS crypto_mem_counts[CRYPTO_MEM_SUBSYSTEMS];
+
+static const char *crypto_mem_names[CRYPTO_MEM_SUBSYSTEMS] = {
+	[CRYPTO_MEM_ASN1] = "asn1",
+	[CRYPTO_MEM_X509] = "x509",
+	[CRYPTO_MEM_BN] = "bn",
+	[CRYPTO_MEM_EVP] = "evp",
+	[CRYPTO_MEM_SSL_RECORD] = "ssl-record",
+	[CRYPTO_MEM_SSL_HANDSHAKE] = "ssl-handshake",
+	[CRYPTO_MEM_SSL] = "ssl",
+	[CRYPTO_MEM_OTHER] = "other",
+};
+
+static const struct {
+	const char *name;
+	int subsystem;
+} crypto_mem_dirs[] = {
+	{ "asn1", CRYPTO_MEM_ASN1 },
+	{ "x509", CRYPTO_MEM_X509 },
+	{ "bn", CRYPTO_MEM_BN },
+	{ "evp", CRYPTO_MEM_EVP },
+	{ NULL, 0 },
+};
+
+static const char *crypto_mem_ssl_record[] = {
+	"d1_pkt.c",
+	"s3_cbc.c",
+	"ssl_ktls.c",
+	"ssl_pkt.c",
+	"tls12_record_layer.c",
+	"tls13_buffer.c",
+	"tls13_record.c",
+	"tls13_record_layer.c",
+	NULL,
+};
+
+static const char *crypto_mem_ssl_handshake[] = {
+	"bs_ber.c",
+	"bs_cbb.c",
+	"bs_cbs.c",
+	"d1_both.c",
+	"ssl_both.c",
+	"ssl_clnt.c",
+	"ssl_hello.c",
+	"ssl_kex.c",
+	"ssl_nego.c",
+	"ssl_packet.c",
+	"ssl_sigalgs.c",
+	"ssl_srvr.c",
+	"ssl_tlsext.c",
+	"ssl_transcript.c",
+	"ssl_versions.c",
+	"t1_enc.c",
+	"t1_lib.c",
+	"tls12_key_schedule.c",
+	"tls13_cert_comp.c",
+	"tls13_client.c",
+	"tls13_handshake.c",
+	"tls13_handshake_msg.c",
+	"tls13_key_schedule.c",
+	"tls13_key_share.c",
+	"tls13_legacy.c",
+	"tls13_server.c",
+	NULL,
+};
+
+static const char *crypto_mem_ssl[] = {
+	"bio_ssl.c",
+	"d1_lib.c",
+	"d1_srtp.c",
+	"pqueue.c",
+	"s3_lib.c",
+	"ssl_algs.c",
+	"ssl_asn1.c",
+	"ssl_cert.c",
+	"ssl_ciph.c",
+	"ssl_ciphers.c",
+	"ssl_err.c",
+	"ssl_init.c",
+	"ssl_lib.c",
+	"ssl_methods.c",
+	"ssl_peer.c",
+	"ssl_rsa.c",
+	"ssl_sess.c",
+	"ssl_stat.c",
+	"ssl_stats.c",
+	"ssl_trace.c",
+	"ssl_txt.c",
+	"tls12_lib.c",
+	"tls13_error.c",
+	"tls13_lib.c",
+	NULL,
+};
+
+static int
+crypto_mem_file_in(const char *name, const char **files)
+{
+	for (; *files != NULL; files++) {
+		if (strcmp(name, *files) == 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+static int
+crypto_mem_subsystem(const char *file)
+{
+	const char *name, *dir;
+	size_t dir_len, i;
+
+	if (file == NULL)
+		return CRYPTO_MEM_OTHER;
+
+	if ((name = strrchr(file, '/')) == NULL)
+		name = file;
+	else
+		name++;
+
+	if (crypto_mem_file_in(name, crypto_mem_ssl_record))
+		return CRYPTO_MEM_SSL_RECORD;
+	if (crypto_mem_file_in(name, crypto_mem_ssl_handshake))
+		return CRYPTO_MEM_SSL_HANDSHAKE;
+	if (crypto_mem_file_in(name, crypto_mem_ssl))
+		return CRYPTO_MEM_SSL;
+
+	if (name == file)
+		return CRYPTO_MEM_OTHER;
+	for (dir = name - 1; dir > file && dir[-1] != '/'; dir--)
+		;
+	dir_len = name - 1 - dir;
+	for (i = 0; crypto_mem_dirs[i].name != NULL; i++) {
+		if (strlen(crypto_mem_dirs[i].name) == dir_len &&
+		    strncmp(dir, crypto_mem_dirs[i].name, dir_len) == 0)
+			return crypto_mem_dirs[i].subsystem;
+	}
+
+	return CRYPTO_MEM_OTHER;
+}
+
+void
+CRYPTO_mem_count_alloc(const char *file, size_t size)
+{
+	CRYPTO_MEM_COUNTS *counts;
+
+	if (!crypto_mem_enabled)
+		return;
+
+	counts = &crypto_mem_counts[crypto_mem_subsystem(file)];
+	__sync_fetch_and_add(&counts->allocations, 1);
+	__sync_fetch_and_add(&counts->bytes, size);
+}
+
+void
+CRYPTO_mem_count_free(const char *file)
+{
+	if (!crypto_mem_enabled)
+		return;
+
+	__sync_fetch_and_add(&crypto_mem_counts[
+	    crypto_mem_subsystem(file)].frees, 1);
+}
+
+int
+CRYPTO_mem_accounting(int enable)
+{
+	crypto_mem_enabled = enable != 0;
+
+#ifdef CRYPTO_MEM_ACCOUNTING
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+int
+CRYPTO_mem_get_counts(int subsystem, CRYPTO_MEM_COUNTS *counts)
+{
+	CRYPTO_MEM_COUNTS *c;
+
+	memset(counts, 0, sizeof(*counts));
+
+	if (subsystem < 0 || subsystem >= CRYPTO_MEM_SUBSYSTEMS)
+		return 0;
+
+	c = &crypto_mem_counts[subsystem];
+	counts->allocations = __sync_fetch_and_add(&c->allocations, 0);
+	counts->bytes = __sync_fetch_and_add(&c->bytes, 0);
+	counts->frees = __sync_fetch_and_add(&c->frees, 0);
+
+	return 1;
+}
+
+const char *
+CRYPTO_mem_subsystem_name(int subsystem)
+{
+	if (subsystem < 0 || subsystem >= CRYPTO_MEM_SUBSYSTEMS)
+		return NULL;
+
+	return crypto_mem_names[subsystem];
+}
+
 int
 CRYPTO_set_mem_functions(void *(*m)(size_t), void *(*r)(void *, size_t),
     void (*f)(void *))
@@ -120,6 +346,7 @@ CRYPTO_malloc_locked(int num, const char *file, int line)
 {
 	if (num <= 0)
 		return NULL;
+	CRYPTO_mem_count_alloc(file, num);
 	return malloc(num);
 }
 
@@ -134,12 +361,14 @@ CRYPTO_malloc(int num, const char *file, int line)
 {
 	if (num <= 0)
 		return NULL;
+	CRYPTO_mem_count_alloc(file, num);
 	return malloc(num);
 }
 
 char *
 CRYPTO_strdup(const char *str, const char *file, int line)
 {
+	CRYPTO_mem_count_alloc(file, strlen(str) + 1);
 	return strdup(str);
 }
 
@@ -148,6 +377,7 @@ CRYPTO_realloc(void *ptr, int num, const char *file, int line)
 {
 	if (num <= 0)
 		return NULL;
+	CRYPTO_mem_count_alloc(file, num);
 	return realloc(ptr, num);
 }
 
@@ -160,6 +390,7 @@ CRYPTO_realloc_clean(void *ptr, int old_len, int num, const char *file,
 	/* Original does not support shrinking. */
 	if (num < old_len)
 		return NULL;
+	CRYPTO_mem_count_alloc(file, num);
 	return recallocarray(ptr, old_len, num, 1);
 }
 
@@ -173,6 +404,7 @@ void *
 CRYPTO_remalloc(void *a, int num, const char *file, int line)
 {
 	free(a);
+	CRYPTO_mem_count_alloc(file, num);
 	return malloc(num);
 }
 
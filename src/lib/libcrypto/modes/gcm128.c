@@ -51,6 +51,7 @@
 #define OPENSSL_FIPSAPI
 
 #include <openssl/crypto.h>
+#include "cryptlib.h"
 #include "modes_lcl.h"
 #include <string.h>
 
@@ -670,6 +671,167 @@ void gcm_ghash_neon(u64 Xi[2],const u128 Htable[16],const u8 *inp,size_t len);
 # endif
 #endif
 
+#if	TABLE_BITS==4 && !defined(GHASH_ASM) && defined(__aarch64__) && \
+	!defined(OPENSSL_SMALL_FOOTPRINT)
+# include "arm_arch.h"
+# ifdef ARMV8_CE
+#  define GHASH_ARMV8
+#  define GCM_FUNCREF_4BIT
+#  include <arm_neon.h>
+
+/*
+ * GHASH using the ARMv8 PMULL instructions. Field elements are kept byte
+ * reflected, as in the stitched AES-NI code, and multiplied using Karatsuba.
+ * Htable holds H, H^2, H^3 and H^4, so that four blocks are hashed with a
+ * single reduction.
+ */
+#define GCM_V8_BLOCKS	4
+
+static inline uint64x2_t
+gcm_v8_load(const void *p)
+{
+	uint8x16_t x;
+
+	x = vrev64q_u8(vld1q_u8(p));
+	return vreinterpretq_u64_u8(vextq_u8(x, x, 8));
+}
+
+static inline void
+gcm_v8_store(void *p, uint64x2_t x)
+{
+	uint8x16_t b;
+
+	b = vrev64q_u8(vreinterpretq_u8_u64(x));
+	vst1q_u8(p, vextq_u8(b, b, 8));
+}
+
+static inline uint64x2_t
+gcm_v8_karatsuba(uint64x2_t h)
+{
+	return veorq_u64(h, vextq_u64(h, h, 1));
+}
+
+/*
+ * Accumulate the product of a and the power of H h, where hk holds the xor
+ * of the halves of h, into lo, mid and hi.
+ */
+static inline void ARMV8_TARGET(aes)
+gcm_v8_mul(uint64x2_t a, uint64x2_t h, uint64x2_t hk, uint64x2_t *lo,
+    uint64x2_t *mid, uint64x2_t *hi)
+{
+	uint64x2_t ak;
+
+	ak = gcm_v8_karatsuba(a);
+	*lo = veorq_u64(*lo, vreinterpretq_u64_p128(vmull_p64(
+	    (poly64_t)vgetq_lane_u64(a, 0), (poly64_t)vgetq_lane_u64(h, 0))));
+	*hi = veorq_u64(*hi, vreinterpretq_u64_p128(vmull_high_p64(
+	    vreinterpretq_p64_u64(a), vreinterpretq_p64_u64(h))));
+	*mid = veorq_u64(*mid, vreinterpretq_u64_p128(vmull_p64(
+	    (poly64_t)vgetq_lane_u64(ak, 0), (poly64_t)vgetq_lane_u64(hk, 0))));
+}
+
+/* Reduce a 256 bit product modulo x^128 + x^7 + x^2 + x + 1. */
+static inline uint64x2_t
+gcm_v8_reduce(uint64x2_t lo, uint64x2_t mid, uint64x2_t hi)
+{
+	uint64x2_t zero, t;
+
+	zero = vdupq_n_u64(0);
+
+	/* Recover the middle term from the Karatsuba product. */
+	mid = veorq_u64(mid, veorq_u64(lo, hi));
+	lo = veorq_u64(lo, vextq_u64(zero, mid, 1));
+	hi = veorq_u64(hi, vextq_u64(mid, zero, 1));
+
+	/* Shift left by one bit, since the operands are reflected. */
+	t = vshrq_n_u64(lo, 63);
+	hi = veorq_u64(vshlq_n_u64(hi, 1),
+	    vextq_u64(t, vshrq_n_u64(hi, 63), 1));
+	lo = veorq_u64(vshlq_n_u64(lo, 1), vextq_u64(zero, t, 1));
+
+	t = veorq_u64(veorq_u64(vshlq_n_u64(lo, 63), vshlq_n_u64(lo, 62)),
+	    vshlq_n_u64(lo, 57));
+	lo = veorq_u64(lo, vextq_u64(zero, t, 1));
+
+	t = veorq_u64(veorq_u64(vshlq_n_u64(lo, 63), vshlq_n_u64(lo, 62)),
+	    vshlq_n_u64(lo, 57));
+	t = veorq_u64(vextq_u64(t, zero, 1), veorq_u64(veorq_u64(
+	    vshrq_n_u64(lo, 1), vshrq_n_u64(lo, 2)), vshrq_n_u64(lo, 7)));
+
+	return veorq_u64(hi, veorq_u64(lo, t));
+}
+
+static void ARMV8_TARGET(aes)
+gcm_init_v8(u128 Htable[16], const u64 H[2])
+{
+	uint64x2_t h, hk, hp, lo, mid, hi;
+	int i;
+
+	/* H is held in host byte order, so this is H byte reflected. */
+	h = vcombine_u64(vcreate_u64(H[1]), vcreate_u64(H[0]));
+	hk = gcm_v8_karatsuba(h);
+
+	hp = h;
+	vst1q_u64((uint64_t *)&Htable[0], hp);
+	for (i = 1; i < GCM_V8_BLOCKS; i++) {
+		lo = mid = hi = vdupq_n_u64(0);
+		gcm_v8_mul(hp, h, hk, &lo, &mid, &hi);
+		hp = gcm_v8_reduce(lo, mid, hi);
+		vst1q_u64((uint64_t *)&Htable[i], hp);
+	}
+}
+
+static void ARMV8_TARGET(aes)
+gcm_gmult_v8(u64 Xi[2], const u128 Htable[16])
+{
+	uint64x2_t h, lo, mid, hi;
+
+	h = vld1q_u64((const uint64_t *)&Htable[0]);
+	lo = mid = hi = vdupq_n_u64(0);
+	gcm_v8_mul(gcm_v8_load(Xi), h, gcm_v8_karatsuba(h), &lo, &mid, &hi);
+	gcm_v8_store(Xi, gcm_v8_reduce(lo, mid, hi));
+}
+
+static void ARMV8_TARGET(aes)
+gcm_ghash_v8(u64 Xi[2], const u128 Htable[16], const u8 *inp, size_t len)
+{
+	uint64x2_t h1, h2, h3, h4, hk1, hk2, hk3, hk4;
+	uint64x2_t x, lo, mid, hi;
+
+	h1 = vld1q_u64((const uint64_t *)&Htable[0]);
+	h2 = vld1q_u64((const uint64_t *)&Htable[1]);
+	h3 = vld1q_u64((const uint64_t *)&Htable[2]);
+	h4 = vld1q_u64((const uint64_t *)&Htable[3]);
+	hk1 = gcm_v8_karatsuba(h1);
+	hk2 = gcm_v8_karatsuba(h2);
+	hk3 = gcm_v8_karatsuba(h3);
+	hk4 = gcm_v8_karatsuba(h4);
+
+	x = gcm_v8_load(Xi);
+
+	for (; len >= GCM_V8_BLOCKS * 16; len -= GCM_V8_BLOCKS * 16) {
+		lo = mid = hi = vdupq_n_u64(0);
+		gcm_v8_mul(veorq_u64(x, gcm_v8_load(inp)), h4, hk4,
+		    &lo, &mid, &hi);
+		gcm_v8_mul(gcm_v8_load(inp + 16), h3, hk3, &lo, &mid, &hi);
+		gcm_v8_mul(gcm_v8_load(inp + 32), h2, hk2, &lo, &mid, &hi);
+		gcm_v8_mul(gcm_v8_load(inp + 48), h1, hk1, &lo, &mid, &hi);
+		x = gcm_v8_reduce(lo, mid, hi);
+		inp += GCM_V8_BLOCKS * 16;
+	}
+	for (; len >= 16; len -= 16) {
+		lo = mid = hi = vdupq_n_u64(0);
+		gcm_v8_mul(veorq_u64(x, gcm_v8_load(inp)), h1, hk1,
+		    &lo, &mid, &hi);
+		x = gcm_v8_reduce(lo, mid, hi);
+		inp += 16;
+	}
+
+	gcm_v8_store(Xi, x);
+}
+# endif
+#endif
+
 #ifdef GCM_FUNCREF_4BIT
 # undef  GCM_MUL
 # define GCM_MUL(ctx,Xi)	(*gcm_gmult_p)(ctx->Xi.u,ctx->Htable)
@@ -679,29 +841,10 @@ void gcm_ghash_neon(u64 Xi[2],const u128 Htable[16],const u8 *inp,size_t len);
 # endif
 #endif
 
-void CRYPTO_gcm128_init(GCM128_CONTEXT *ctx,void *key,block128_f block)
+/* Set up Htable and the gmult/ghash functions for the H in ctx. */
+static void
+gcm_init_htable(GCM128_CONTEXT *ctx)
 {
-	memset(ctx,0,sizeof(*ctx));
-	ctx->block = block;
-	ctx->key   = key;
-
-	(*block)(ctx->H.c,ctx->H.c,key);
-
-#if BYTE_ORDER == LITTLE_ENDIAN
-	/* H is stored in host byte order */
-#ifdef BSWAP8
-	ctx->H.u[0] = BSWAP8(ctx->H.u[0]);
-	ctx->H.u[1] = BSWAP8(ctx->H.u[1]);
-#else
-	u8 *p = ctx->H.c;
-	u64 hi,lo;
-	hi = (u64)GETU32(p)  <<32|GETU32(p+4);
-	lo = (u64)GETU32(p+8)<<32|GETU32(p+12);
-	ctx->H.u[0] = hi;
-	ctx->H.u[1] = lo;
-#endif
-#endif
-
 #if	TABLE_BITS==8
 	gcm_init_8bit(ctx->Htable,ctx->H.u);
 #elif	TABLE_BITS==4
@@ -742,12 +885,48 @@ void CRYPTO_gcm128_init(GCM128_CONTEXT *ctx,void *key,block128_f block)
 		ctx->gmult = gcm_gmult_4bit;
 		ctx->ghash = gcm_ghash_4bit;
 	}
+# elif	defined(GHASH_ARMV8)
+	if (OPENSSL_armcap_P & ARMV8_PMULL) {
+		gcm_init_v8(ctx->Htable,ctx->H.u);
+		ctx->gmult = gcm_gmult_v8;
+		ctx->ghash = gcm_ghash_v8;
+	} else {
+		gcm_init_4bit(ctx->Htable,ctx->H.u);
+		ctx->gmult = gcm_gmult_4bit;
+		ctx->ghash = gcm_ghash_4bit;
+	}
 # else
 	gcm_init_4bit(ctx->Htable,ctx->H.u);
 # endif
 #endif
 }
 
+void CRYPTO_gcm128_init(GCM128_CONTEXT *ctx,void *key,block128_f block)
+{
+	memset(ctx,0,sizeof(*ctx));
+	ctx->block = block;
+	ctx->key   = key;
+
+	(*block)(ctx->H.c,ctx->H.c,key);
+
+#if BYTE_ORDER == LITTLE_ENDIAN
+	/* H is stored in host byte order */
+#ifdef BSWAP8
+	ctx->H.u[0] = BSWAP8(ctx->H.u[0]);
+	ctx->H.u[1] = BSWAP8(ctx->H.u[1]);
+#else
+	u8 *p = ctx->H.c;
+	u64 hi,lo;
+	hi = (u64)GETU32(p)  <<32|GETU32(p+4);
+	lo = (u64)GETU32(p+8)<<32|GETU32(p+12);
+	ctx->H.u[0] = hi;
+	ctx->H.u[1] = lo;
+#endif
+#endif
+
+	gcm_init_htable(ctx);
+}
+
 void CRYPTO_gcm128_setiv(GCM128_CONTEXT *ctx,const unsigned char *iv,size_t len)
 {
 	unsigned int ctr;
@@ -1255,6 +1434,417 @@ int CRYPTO_gcm128_decrypt(GCM128_CONTEXT *ctx,
 	return 0;
 }
 
+#ifdef GCM_AESNI
+#include <immintrin.h>
+
+#include <openssl/aes.h>
+
+#include "x86_arch.h"
+
+/*
+ * Stitched AES-GCM - the counter mode encryption of a group of blocks is
+ * interleaved with GHASH, so that the AES and carry-less multiplication units
+ * are used at the same time and the data is only traversed once. GHASH is
+ * calculated with aggregated reduction: the blocks of a group are multiplied
+ * by H^8 ... H^1 and summed, before a single reduction. Field elements are
+ * kept byte reflected, as described in Intel's "Carry-Less Multiplication
+ * and Its Usage for Computing the GCM Mode".
+ */
+#define GCM_AESNI_TARGET \
+	__attribute__((__target__("aes,pclmul,ssse3,sse4.1")))
+#define GCM_VAES_TARGET \
+	__attribute__((__target__("aes,pclmul,ssse3,sse4.1,avx2,vaes,vpclmulqdq")))
+
+#define GCM_AESNI_BSWAP \
+	_mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15)
+
+/* Reduce a 256 bit product modulo x^128 + x^7 + x^2 + x + 1. */
+static inline __m128i GCM_AESNI_TARGET
+gcm_aesni_reduce(__m128i lo, __m128i mid, __m128i hi)
+{
+	__m128i t1, t2, t3;
+
+	/* Recover the middle term from the Karatsuba product. */
+	mid = _mm_xor_si128(mid, _mm_xor_si128(lo, hi));
+	lo = _mm_xor_si128(lo, _mm_slli_si128(mid, 8));
+	hi = _mm_xor_si128(hi, _mm_srli_si128(mid, 8));
+
+	/* Shift left by one bit, since the operands are reflected. */
+	t1 = _mm_srli_epi32(lo, 31);
+	t2 = _mm_srli_epi32(hi, 31);
+	lo = _mm_slli_epi32(lo, 1);
+	hi = _mm_slli_epi32(hi, 1);
+	t3 = _mm_srli_si128(t1, 12);
+	t2 = _mm_slli_si128(t2, 4);
+	t1 = _mm_slli_si128(t1, 4);
+	lo = _mm_or_si128(lo, t1);
+	hi = _mm_or_si128(_mm_or_si128(hi, t2), t3);
+
+	t1 = _mm_xor_si128(_mm_xor_si128(_mm_slli_epi32(lo, 31),
+	    _mm_slli_epi32(lo, 30)), _mm_slli_epi32(lo, 25));
+	t2 = _mm_srli_si128(t1, 4);
+	t1 = _mm_slli_si128(t1, 12);
+	lo = _mm_xor_si128(lo, t1);
+
+	t1 = _mm_xor_si128(_mm_xor_si128(_mm_srli_epi32(lo, 1),
+	    _mm_srli_epi32(lo, 2)), _mm_srli_epi32(lo, 7));
+	lo = _mm_xor_si128(lo, _mm_xor_si128(t1, t2));
+
+	return _mm_xor_si128(hi, lo);
+}
+
+/*
+ * Accumulate the product of a and the power of H h, where hk holds the xor
+ * of the halves of h, into lo, mid and hi.
+ */
+static inline void GCM_AESNI_TARGET
+gcm_aesni_mul(__m128i a, __m128i h, __m128i hk, __m128i *lo, __m128i *mid,
+    __m128i *hi)
+{
+	*lo = _mm_xor_si128(*lo, _mm_clmulepi64_si128(a, h, 0x00));
+	*hi = _mm_xor_si128(*hi, _mm_clmulepi64_si128(a, h, 0x11));
+	*mid = _mm_xor_si128(*mid, _mm_clmulepi64_si128(_mm_xor_si128(a,
+	    _mm_shuffle_epi32(a, 0x4e)), hk, 0x00));
+}
+
+static inline __m128i GCM_AESNI_TARGET
+gcm_aesni_karatsuba(__m128i h)
+{
+	return _mm_xor_si128(h, _mm_shuffle_epi32(h, 0x4e));
+}
+
+static void GCM_AESNI_TARGET
+gcm_aesni_init(GCM128_CONTEXT *ctx)
+{
+	__m128i h, hp, lo, mid, hi;
+	int i;
+
+	/* H is held in host byte order, so this is H byte reflected. */
+	h = _mm_set_epi64x(ctx->H.u[0], ctx->H.u[1]);
+
+	hp = h;
+	_mm_storeu_si128((__m128i *)&ctx->Hpow[0], hp);
+	for (i = 1; i < GCM_AESNI_BLOCKS; i++) {
+		lo = mid = hi = _mm_setzero_si128();
+		gcm_aesni_mul(hp, h, gcm_aesni_karatsuba(h), &lo, &mid, &hi);
+		hp = gcm_aesni_reduce(lo, mid, hi);
+		_mm_storeu_si128((__m128i *)&ctx->Hpow[i], hp);
+	}
+}
+
+void
+gcm128_enable_aesni(GCM128_CONTEXT *ctx)
+{
+	ctx->aesni = 0;
+
+	if ((OPENSSL_cpu_caps() & (CPUCAP_MASK_AESNI | CPUCAP_MASK_PCLMUL |
+	    CPUCAP_MASK_SSSE3)) !=
+	    (CPUCAP_MASK_AESNI | CPUCAP_MASK_PCLMUL | CPUCAP_MASK_SSSE3))
+		return;
+
+	gcm_aesni_init(ctx);
+
+	ctx->aesni = 1;
+	if ((OPENSSL_cpu_caps() & (CPUCAP_MASK_AVX2 | CPUCAP_MASK_VAES)) ==
+	    (CPUCAP_MASK_AVX2 | CPUCAP_MASK_VAES))
+		ctx->aesni = 2;
+}
+
+/* Counter block i of a group, with the counter in the last 32 bits. */
+#define GCM_AESNI_CTR(iv, ctr, i) \
+	_mm_insert_epi32(iv, (int)__builtin_bswap32((ctr) + (i)), 3)
+
+#define GCM_AESNI_LOAD(p, i) \
+	_mm_loadu_si128((const __m128i *)(p) + (i))
+
+/* Apply an AES round to all blocks of a group. */
+#define GCM_AESNI_ROUND(f, k) do { \
+	__m128i rk_ = (k); \
+	t0 = f(t0, rk_); t1 = f(t1, rk_); t2 = f(t2, rk_); t3 = f(t3, rk_); \
+	t4 = f(t4, rk_); t5 = f(t5, rk_); t6 = f(t6, rk_); t7 = f(t7, rk_); \
+} while (0)
+
+/* Start a group, with an AES round and the hash of a block per step. */
+#define GCM_AESNI_START() do { \
+	__m128i rk_ = GCM_AESNI_LOAD(rk, 0); \
+	t0 = _mm_xor_si128(GCM_AESNI_CTR(iv, ctr, 0), rk_); \
+	t1 = _mm_xor_si128(GCM_AESNI_CTR(iv, ctr, 1), rk_); \
+	t2 = _mm_xor_si128(GCM_AESNI_CTR(iv, ctr, 2), rk_); \
+	t3 = _mm_xor_si128(GCM_AESNI_CTR(iv, ctr, 3), rk_); \
+	t4 = _mm_xor_si128(GCM_AESNI_CTR(iv, ctr, 4), rk_); \
+	t5 = _mm_xor_si128(GCM_AESNI_CTR(iv, ctr, 5), rk_); \
+	t6 = _mm_xor_si128(GCM_AESNI_CTR(iv, ctr, 6), rk_); \
+	t7 = _mm_xor_si128(GCM_AESNI_CTR(iv, ctr, 7), rk_); \
+} while (0)
+
+#define GCM_AESNI_HASH(p, i) do { \
+	__m128i y_ = _mm_shuffle_epi8(GCM_AESNI_LOAD(p, i), bswap); \
+	if ((i) == 0) \
+		y_ = _mm_xor_si128(y_, x); \
+	gcm_aesni_mul(y_, GCM_AESNI_LOAD(ctx->Hpow, 7 - (i)), hk[7 - (i)], \
+	    &lo, &mid, &hi); \
+} while (0)
+
+#define GCM_AESNI_HASH_ROUNDS(p) do { \
+	lo = mid = hi = _mm_setzero_si128(); \
+	GCM_AESNI_ROUND(_mm_aesenc_si128, GCM_AESNI_LOAD(rk, 1)); \
+	GCM_AESNI_HASH(p, 0); \
+	GCM_AESNI_ROUND(_mm_aesenc_si128, GCM_AESNI_LOAD(rk, 2)); \
+	GCM_AESNI_HASH(p, 1); \
+	GCM_AESNI_ROUND(_mm_aesenc_si128, GCM_AESNI_LOAD(rk, 3)); \
+	GCM_AESNI_HASH(p, 2); \
+	GCM_AESNI_ROUND(_mm_aesenc_si128, GCM_AESNI_LOAD(rk, 4)); \
+	GCM_AESNI_HASH(p, 3); \
+	GCM_AESNI_ROUND(_mm_aesenc_si128, GCM_AESNI_LOAD(rk, 5)); \
+	GCM_AESNI_HASH(p, 4); \
+	GCM_AESNI_ROUND(_mm_aesenc_si128, GCM_AESNI_LOAD(rk, 6)); \
+	GCM_AESNI_HASH(p, 5); \
+	GCM_AESNI_ROUND(_mm_aesenc_si128, GCM_AESNI_LOAD(rk, 7)); \
+	GCM_AESNI_HASH(p, 6); \
+	GCM_AESNI_ROUND(_mm_aesenc_si128, GCM_AESNI_LOAD(rk, 8)); \
+	GCM_AESNI_HASH(p, 7); \
+	for (r = 9; r <= rounds; r++) \
+		GCM_AESNI_ROUND(_mm_aesenc_si128, GCM_AESNI_LOAD(rk, r)); \
+	x = gcm_aesni_reduce(lo, mid, hi); \
+} while (0)
+
+/* Finish a group with the last AES round and xor with the input. */
+#define GCM_AESNI_FINISH() do { \
+	GCM_AESNI_ROUND(_mm_aesenclast_si128, GCM_AESNI_LOAD(rk, r)); \
+	_mm_storeu_si128((__m128i *)out + 0, \
+	    _mm_xor_si128(t0, GCM_AESNI_LOAD(in, 0))); \
+	_mm_storeu_si128((__m128i *)out + 1, \
+	    _mm_xor_si128(t1, GCM_AESNI_LOAD(in, 1))); \
+	_mm_storeu_si128((__m128i *)out + 2, \
+	    _mm_xor_si128(t2, GCM_AESNI_LOAD(in, 2))); \
+	_mm_storeu_si128((__m128i *)out + 3, \
+	    _mm_xor_si128(t3, GCM_AESNI_LOAD(in, 3))); \
+	_mm_storeu_si128((__m128i *)out + 4, \
+	    _mm_xor_si128(t4, GCM_AESNI_LOAD(in, 4))); \
+	_mm_storeu_si128((__m128i *)out + 5, \
+	    _mm_xor_si128(t5, GCM_AESNI_LOAD(in, 5))); \
+	_mm_storeu_si128((__m128i *)out + 6, \
+	    _mm_xor_si128(t6, GCM_AESNI_LOAD(in, 6))); \
+	_mm_storeu_si128((__m128i *)out + 7, \
+	    _mm_xor_si128(t7, GCM_AESNI_LOAD(in, 7))); \
+	ctr += GCM_AESNI_BLOCKS; \
+	in += GCM_AESNI_BLOCKS * 16; \
+	out += GCM_AESNI_BLOCKS * 16; \
+	blocks -= GCM_AESNI_BLOCKS; \
+} while (0)
+
+/*
+ * Encrypt or decrypt blocks (a multiple of GCM_AESNI_BLOCKS) starting at
+ * counter ctr, updating Xi with the ciphertext. When encrypting, the
+ * ciphertext of the previous group is hashed while the next group is
+ * encrypted. When decrypting, the ciphertext is hashed while it is being
+ * decrypted.
+ */
+static void GCM_AESNI_TARGET
+gcm_aesni_crypt(GCM128_CONTEXT *ctx, const u8 *in, u8 *out, size_t blocks,
+    unsigned int ctr, int enc)
+{
+	const AES_KEY *key = ctx->key;
+	const __m128i *rk = (const __m128i *)key->rd_key;
+	__m128i t0, t1, t2, t3, t4, t5, t6, t7;
+	__m128i bswap, iv, x, lo, mid, hi;
+	__m128i hk[GCM_AESNI_BLOCKS];
+	int rounds = key->rounds;
+	int i, r;
+
+	bswap = GCM_AESNI_BSWAP;
+	iv = _mm_loadu_si128((const __m128i *)ctx->Yi.c);
+	x = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)ctx->Xi.c),
+	    bswap);
+	for (i = 0; i < GCM_AESNI_BLOCKS; i++)
+		hk[i] = gcm_aesni_karatsuba(GCM_AESNI_LOAD(ctx->Hpow, i));
+
+	if (enc) {
+		GCM_AESNI_START();
+		for (r = 1; r <= rounds; r++)
+			GCM_AESNI_ROUND(_mm_aesenc_si128, GCM_AESNI_LOAD(rk, r));
+		GCM_AESNI_FINISH();
+
+		while (blocks > 0) {
+			GCM_AESNI_START();
+			GCM_AESNI_HASH_ROUNDS(out - GCM_AESNI_BLOCKS * 16);
+			GCM_AESNI_FINISH();
+		}
+
+		/* Hash the final group. */
+		lo = mid = hi = _mm_setzero_si128();
+		for (i = 0; i < GCM_AESNI_BLOCKS; i++)
+			GCM_AESNI_HASH(out - GCM_AESNI_BLOCKS * 16, i);
+		x = gcm_aesni_reduce(lo, mid, hi);
+	} else {
+		while (blocks > 0) {
+			GCM_AESNI_START();
+			GCM_AESNI_HASH_ROUNDS(in);
+			GCM_AESNI_FINISH();
+		}
+	}
+
+	_mm_storeu_si128((__m128i *)ctx->Xi.c, _mm_shuffle_epi8(x, bswap));
+}
+
+/*
+ * The same with VAES and VPCLMULQDQ, processing two blocks per instruction
+ * in 256 bit registers.
+ */
+#define GCM_VAES_LOAD(p, i) \
+	_mm256_loadu_si256((const __m256i *)(p) + (i))
+#define GCM_VAES_BROADCAST(p, i) \
+	_mm256_broadcastsi128_si256(GCM_AESNI_LOAD(p, i))
+#define GCM_VAES_PAIR(a, b) \
+	_mm256_inserti128_si256(_mm256_castsi128_si256(a), (b), 1)
+
+#define GCM_VAES_ROUND(f, k) do { \
+	__m256i rk_ = (k); \
+	t0 = f(t0, rk_); t1 = f(t1, rk_); t2 = f(t2, rk_); t3 = f(t3, rk_); \
+} while (0)
+
+#define GCM_VAES_START() do { \
+	__m256i rk_ = GCM_VAES_BROADCAST(rk, 0); \
+	t0 = _mm256_xor_si256(GCM_VAES_PAIR(GCM_AESNI_CTR(iv, ctr, 0), \
+	    GCM_AESNI_CTR(iv, ctr, 1)), rk_); \
+	t1 = _mm256_xor_si256(GCM_VAES_PAIR(GCM_AESNI_CTR(iv, ctr, 2), \
+	    GCM_AESNI_CTR(iv, ctr, 3)), rk_); \
+	t2 = _mm256_xor_si256(GCM_VAES_PAIR(GCM_AESNI_CTR(iv, ctr, 4), \
+	    GCM_AESNI_CTR(iv, ctr, 5)), rk_); \
+	t3 = _mm256_xor_si256(GCM_VAES_PAIR(GCM_AESNI_CTR(iv, ctr, 6), \
+	    GCM_AESNI_CTR(iv, ctr, 7)), rk_); \
+} while (0)
+
+/* Hash blocks 2i and 2i + 1 of a group, with H^(8 - 2i) and H^(7 - 2i). */
+#define GCM_VAES_HASH(p, i) do { \
+	__m256i y_ = _mm256_shuffle_epi8(GCM_VAES_LOAD(p, i), bswap); \
+	if ((i) == 0) \
+		y_ = _mm256_xor_si256(y_, \
+		    _mm256_inserti128_si256(_mm256_setzero_si256(), x, 0)); \
+	lo = _mm256_xor_si256(lo, _mm256_clmulepi64_epi128(y_, h[i], 0x00)); \
+	hi = _mm256_xor_si256(hi, _mm256_clmulepi64_epi128(y_, h[i], 0x11)); \
+	mid = _mm256_xor_si256(mid, _mm256_clmulepi64_epi128( \
+	    _mm256_xor_si256(y_, _mm256_shuffle_epi32(y_, 0x4e)), hk[i], \
+	    0x00)); \
+} while (0)
+
+#define GCM_VAES_REDUCE() \
+	gcm_aesni_reduce( \
+	    _mm_xor_si128(_mm256_castsi256_si128(lo), \
+	    _mm256_extracti128_si256(lo, 1)), \
+	    _mm_xor_si128(_mm256_castsi256_si128(mid), \
+	    _mm256_extracti128_si256(mid, 1)), \
+	    _mm_xor_si128(_mm256_castsi256_si128(hi), \
+	    _mm256_extracti128_si256(hi, 1)))
+
+#define GCM_VAES_HASH_ROUNDS(p) do { \
+	lo = mid = hi = _mm256_setzero_si256(); \
+	GCM_VAES_ROUND(_mm256_aesenc_epi128, GCM_VAES_BROADCAST(rk, 1)); \
+	GCM_VAES_HASH(p, 0); \
+	GCM_VAES_ROUND(_mm256_aesenc_epi128, GCM_VAES_BROADCAST(rk, 2)); \
+	GCM_VAES_HASH(p, 1); \
+	GCM_VAES_ROUND(_mm256_aesenc_epi128, GCM_VAES_BROADCAST(rk, 3)); \
+	GCM_VAES_HASH(p, 2); \
+	GCM_VAES_ROUND(_mm256_aesenc_epi128, GCM_VAES_BROADCAST(rk, 4)); \
+	GCM_VAES_HASH(p, 3); \
+	for (r = 5; r <= rounds; r++) \
+		GCM_VAES_ROUND(_mm256_aesenc_epi128, \
+		    GCM_VAES_BROADCAST(rk, r)); \
+	x = GCM_VAES_REDUCE(); \
+} while (0)
+
+#define GCM_VAES_FINISH() do { \
+	GCM_VAES_ROUND(_mm256_aesenclast_epi128, GCM_VAES_BROADCAST(rk, r)); \
+	_mm256_storeu_si256((__m256i *)out + 0, \
+	    _mm256_xor_si256(t0, GCM_VAES_LOAD(in, 0))); \
+	_mm256_storeu_si256((__m256i *)out + 1, \
+	    _mm256_xor_si256(t1, GCM_VAES_LOAD(in, 1))); \
+	_mm256_storeu_si256((__m256i *)out + 2, \
+	    _mm256_xor_si256(t2, GCM_VAES_LOAD(in, 2))); \
+	_mm256_storeu_si256((__m256i *)out + 3, \
+	    _mm256_xor_si256(t3, GCM_VAES_LOAD(in, 3))); \
+	ctr += GCM_AESNI_BLOCKS; \
+	in += GCM_AESNI_BLOCKS * 16; \
+	out += GCM_AESNI_BLOCKS * 16; \
+	blocks -= GCM_AESNI_BLOCKS; \
+} while (0)
+
+static void GCM_VAES_TARGET
+gcm_vaes_crypt(GCM128_CONTEXT *ctx, const u8 *in, u8 *out, size_t blocks,
+    unsigned int ctr, int enc)
+{
+	const AES_KEY *key = ctx->key;
+	const __m128i *rk = (const __m128i *)key->rd_key;
+	__m256i t0, t1, t2, t3;
+	__m256i bswap, lo, mid, hi;
+	__m256i h[GCM_AESNI_BLOCKS / 2], hk[GCM_AESNI_BLOCKS / 2];
+	__m128i iv, x;
+	int rounds = key->rounds;
+	int i, r;
+
+	bswap = _mm256_broadcastsi128_si256(GCM_AESNI_BSWAP);
+	iv = _mm_loadu_si128((const __m128i *)ctx->Yi.c);
+	x = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)ctx->Xi.c),
+	    GCM_AESNI_BSWAP);
+	for (i = 0; i < GCM_AESNI_BLOCKS / 2; i++) {
+		h[i] = GCM_VAES_PAIR(GCM_AESNI_LOAD(ctx->Hpow, 7 - 2 * i),
+		    GCM_AESNI_LOAD(ctx->Hpow, 6 - 2 * i));
+		hk[i] = _mm256_xor_si256(h[i], _mm256_shuffle_epi32(h[i], 0x4e));
+	}
+
+	if (enc) {
+		GCM_VAES_START();
+		for (r = 1; r <= rounds; r++)
+			GCM_VAES_ROUND(_mm256_aesenc_epi128,
+			    GCM_VAES_BROADCAST(rk, r));
+		GCM_VAES_FINISH();
+
+		while (blocks > 0) {
+			GCM_VAES_START();
+			GCM_VAES_HASH_ROUNDS(out - GCM_AESNI_BLOCKS * 16);
+			GCM_VAES_FINISH();
+		}
+
+		/* Hash the final group. */
+		lo = mid = hi = _mm256_setzero_si256();
+		for (i = 0; i < GCM_AESNI_BLOCKS / 2; i++)
+			GCM_VAES_HASH(out - GCM_AESNI_BLOCKS * 16, i);
+		x = GCM_VAES_REDUCE();
+	} else {
+		while (blocks > 0) {
+			GCM_VAES_START();
+			GCM_VAES_HASH_ROUNDS(in);
+			GCM_VAES_FINISH();
+		}
+	}
+
+	_mm_storeu_si128((__m128i *)ctx->Xi.c, _mm_shuffle_epi8(x,
+	    GCM_AESNI_BSWAP));
+}
+
+/*
+ * Process as many groups of blocks as possible with the stitched
+ * implementation, returning the number of bytes processed.
+ */
+static size_t
+gcm_aesni(GCM128_CONTEXT *ctx, const u8 *in, u8 *out, size_t len,
+    unsigned int ctr, int enc)
+{
+	size_t blocks;
+
+	blocks = (len / 16) & ~(size_t)(GCM_AESNI_BLOCKS - 1);
+	if (blocks == 0)
+		return 0;
+
+	if (ctx->aesni == 2)
+		gcm_vaes_crypt(ctx, in, out, blocks, ctr, enc);
+	else
+		gcm_aesni_crypt(ctx, in, out, blocks, ctr, enc);
+
+	return blocks * 16;
+}
+#endif
+
 int CRYPTO_gcm128_encrypt_ctr32(GCM128_CONTEXT *ctx,
 		const unsigned char *in, unsigned char *out,
 		size_t len, ctr128_f stream)
@@ -1305,6 +1895,23 @@ int CRYPTO_gcm128_encrypt_ctr32(GCM128_CONTEXT *ctx,
 			return 0;
 		}
 	}
+#ifdef GCM_AESNI
+	if (ctx->aesni && (i = gcm_aesni(ctx, in, out, len, ctr, 1)) != 0) {
+		ctr += (unsigned int)(i / 16);
+#if BYTE_ORDER == LITTLE_ENDIAN
+#ifdef BSWAP4
+		ctx->Yi.d[3] = BSWAP4(ctr);
+#else
+		PUTU32(ctx->Yi.c+12,ctr);
+#endif
+#else /* BIG_ENDIAN */
+		ctx->Yi.d[3] = ctr;
+#endif
+		in  += i;
+		out += i;
+		len -= i;
+	}
+#endif
 #if defined(GHASH) && !defined(OPENSSL_SMALL_FOOTPRINT)
 	while (len>=GHASH_CHUNK) {
 		(*stream)(in,out,GHASH_CHUNK/16,key,ctx->Yi.c);
@@ -1425,6 +2032,23 @@ int CRYPTO_gcm128_decrypt_ctr32(GCM128_CONTEXT *ctx,
 			return 0;
 		}
 	}
+#ifdef GCM_AESNI
+	if (ctx->aesni && (i = gcm_aesni(ctx, in, out, len, ctr, 0)) != 0) {
+		ctr += (unsigned int)(i / 16);
+#if BYTE_ORDER == LITTLE_ENDIAN
+#ifdef BSWAP4
+		ctx->Yi.d[3] = BSWAP4(ctr);
+#else
+		PUTU32(ctx->Yi.c+12,ctr);
+#endif
+#else /* BIG_ENDIAN */
+		ctx->Yi.d[3] = ctr;
+#endif
+		in  += i;
+		out += i;
+		len -= i;
+	}
+#endif
 #if defined(GHASH) && !defined(OPENSSL_SMALL_FOOTPRINT)
 	while (len>=GHASH_CHUNK) {
 		GHASH(ctx,in,GHASH_CHUNK);
@@ -1560,3 +2184,150 @@ void CRYPTO_gcm128_release(GCM128_CONTEXT *ctx)
 {
 	freezero(ctx, sizeof(*ctx));
 }
+
+/*
+ * POLYVAL, as used by AES-GCM-SIV (RFC 8452), is computed with the GHASH
+ * implementation above, since POLYVAL(H, X_1, ..., X_n) is the byte
+ * reversal of GHASH(mulX_GHASH(ByteReverse(H)), ByteReverse(X_1), ...,
+ * ByteReverse(X_n)).  See RFC 8452, appendix A.
+ */
+void
+gcm128_polyval_init(GCM128_CONTEXT *ctx, const unsigned char key[16])
+{
+	u128 V;
+	int i;
+
+	memset(ctx, 0, sizeof(*ctx));
+
+	/* ByteReverse(H) in host byte order is H loaded as little endian. */
+	V.hi = V.lo = 0;
+	for (i = 7; i >= 0; i--) {
+		V.hi = V.hi << 8 | key[8 + i];
+		V.lo = V.lo << 8 | key[i];
+	}
+	REDUCE1BIT(V);
+	ctx->H.u[0] = V.hi;
+	ctx->H.u[1] = V.lo;
+
+	gcm_init_htable(ctx);
+}
+
+/*
+ * Absorb len bytes of input.  A trailing partial block is padded with
+ * zeroes, so only the last call for each of the AAD and the message may
+ * pass a length that is not a multiple of 16.
+ */
+void
+gcm128_polyval_update(GCM128_CONTEXT *ctx, const unsigned char *in,
+    size_t len)
+{
+	u8 buf[16 * 16];
+	size_t i, j, n;
+#ifdef GCM_FUNCREF_4BIT
+# ifdef GHASH
+	void (*gcm_ghash_p)(u64 Xi[2],const u128 Htable[16],
+				const u8 *inp,size_t len)	= ctx->ghash;
+# else
+	void (*gcm_gmult_p)(u64 Xi[2],const u128 Htable[16])	= ctx->gmult;
+# endif
+#endif
+
+	while (len > 0) {
+		n = len < sizeof(buf) ? len : sizeof(buf);
+		for (i = 0; i + 16 <= n; i += 16) {
+#if BYTE_ORDER == LITTLE_ENDIAN && defined(BSWAP8)
+			u64 hi, lo;
+
+			memcpy(&hi, in + i + 8, 8);
+			memcpy(&lo, in + i, 8);
+			hi = BSWAP8(hi);
+			lo = BSWAP8(lo);
+			memcpy(buf + i, &hi, 8);
+			memcpy(buf + i + 8, &lo, 8);
+#else
+			for (j = 0; j < 16; j++)
+				buf[i + j] = in[i + 15 - j];
+#endif
+		}
+		if (i < n) {
+			for (j = 0; j < 16; j++)
+				buf[i + j] = i + 15 - j < n ? in[i + 15 - j] : 0;
+			i += 16;
+		}
+		/* i is now n rounded up to a whole number of blocks. */
+#ifdef GHASH
+		GHASH(ctx, buf, i);
+#else
+		for (j = 0; j < i; j++) {
+			ctx->Xi.c[j % 16] ^= buf[j];
+			if (j % 16 == 15)
+				GCM_MUL(ctx, Xi);
+		}
+#endif
+		in += n;
+		len -= n;
+	}
+
+	explicit_bzero(buf, sizeof(buf));
+}
+
+void
+gcm128_polyval_final(GCM128_CONTEXT *ctx, unsigned char out[16])
+{
+	int i;
+
+	for (i = 0; i < 16; i++)
+		out[i] = ctx->Xi.c[15 - i];
+}
+
+/* Name the GHASH implementation that AES-GCM will use. */
+const char *
+gcm128_implementation(void)
+{
+#ifdef GCM_AESNI
+	uint64_t caps = OPENSSL_cpu_caps();
+
+	if ((caps & (CPUCAP_MASK_AESNI | CPUCAP_MASK_PCLMUL |
+	    CPUCAP_MASK_SSSE3)) ==
+	    (CPUCAP_MASK_AESNI | CPUCAP_MASK_PCLMUL | CPUCAP_MASK_SSSE3)) {
+		if ((caps & (CPUCAP_MASK_AVX2 | CPUCAP_MASK_VAES)) ==
+		    (CPUCAP_MASK_AVX2 | CPUCAP_MASK_VAES))
+			return "aesni-vaes";
+		return "aesni";
+	}
+#endif
+#if	TABLE_BITS==8
+	return "8bit";
+#elif	TABLE_BITS==4
+# if	defined(GHASH_ASM_X86_OR_64)
+#  if	!defined(GHASH_ASM_X86) || defined(OPENSSL_IA32_SSE2)
+	if ((OPENSSL_cpu_caps() & (CPUCAP_MASK_FXSR | CPUCAP_MASK_PCLMUL)) ==
+	    (CPUCAP_MASK_FXSR | CPUCAP_MASK_PCLMUL))
+		return "clmul";
+#  endif
+#  if	defined(GHASH_ASM_X86)
+#   if	defined(OPENSSL_IA32_SSE2)
+	if (OPENSSL_cpu_caps() & CPUCAP_MASK_SSE)
+#   else
+	if (OPENSSL_cpu_caps() & CPUCAP_MASK_MMX)
+#   endif
+		return "4bit-mmx";
+	return "4bit-x86";
+#  else
+	return "4bit-asm";
+#  endif
+# elif	defined(GHASH_ASM_ARM)
+	if (OPENSSL_armcap_P & ARMV7_NEON)
+		return "neon";
+	return "4bit";
+# elif	defined(GHASH_ARMV8)
+	if (OPENSSL_armcap_P & ARMV8_PMULL)
+		return "pmull";
+	return "4bit";
+# else
+	return "4bit";
+# endif
+#else
+	return "1bit";
+#endif
+}
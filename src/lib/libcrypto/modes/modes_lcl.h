@@ -78,6 +78,25 @@ typedef struct { u64 hi,lo; } u128;
  */
 #define	TABLE_BITS 4
 
+/*
+ * Stitched AES-GCM, which encrypts and hashes several blocks at a time with
+ * AES-NI and PCLMULQDQ, using a key schedule from aesni_set_encrypt_key().
+ */
+#if defined(AES_ASM) && (defined(__x86_64) || defined(__x86_64__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 8))
+#define GCM_AESNI
+#define GCM_AESNI_BLOCKS 8
+#endif
+
+/*
+ * XTS with AES-NI, and VAES where available, processing eight or sixteen
+ * blocks at a time.
+ */
+#if defined(AES_ASM) && (defined(__x86_64) || defined(__x86_64__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 8))
+#define XTS_AESNI
+#endif
+
 struct gcm128_context {
 	/* Following 6 names follow names in GCM specification */
 	union { u64 u[2]; u32 d[4]; u8 c[16]; size_t t[16/sizeof(size_t)]; }
@@ -94,6 +113,11 @@ struct gcm128_context {
 	unsigned int mres, ares;
 	block128_f block;
 	void *key;
+#ifdef GCM_AESNI
+	/* H^1 to H^8, byte reflected, for the stitched implementation. */
+	u128 Hpow[GCM_AESNI_BLOCKS];
+	int aesni;
+#endif
 };
 
 struct xts128_context {
@@ -108,4 +132,13 @@ struct ccm128_context {
 	void *key;
 };
 
+#ifdef GCM_AESNI
+void gcm128_enable_aesni(GCM128_CONTEXT *ctx);
+#endif
+
+void gcm128_polyval_init(GCM128_CONTEXT *ctx, const unsigned char key[16]);
+void gcm128_polyval_update(GCM128_CONTEXT *ctx, const unsigned char *in,
+    size_t len);
+void gcm128_polyval_final(GCM128_CONTEXT *ctx, unsigned char out[16]);
+
 __END_HIDDEN_DECLS
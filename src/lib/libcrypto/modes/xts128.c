@@ -183,3 +183,303 @@ int CRYPTO_xts128_encrypt(const XTS128_CONTEXT *ctx, const unsigned char iv[16],
 
 	return 0;
 }
+
+#ifdef XTS_AESNI
+#include <immintrin.h>
+
+#include <openssl/aes.h>
+
+#include "x86_arch.h"
+
+/*
+ * XTS with AES-NI, processing eight blocks at a time so that the latency of
+ * the AES instructions is hidden, or sixteen blocks in eight 256 bit
+ * registers with VAES. The tweaks of a group are kept on the stack between
+ * the first and the last round, which leaves the registers for the blocks.
+ * They are stored combined with the last round key, since the final xor of
+ * XTS then comes for free with the last AES round.
+ */
+#define XTS_AESNI_TARGET \
+	__attribute__((__target__("aes,sse2")))
+#define XTS_VAES_TARGET \
+	__attribute__((__target__("aes,avx2,vaes")))
+
+#define XTS_AESNI_LOAD(p, i) \
+	_mm_loadu_si128((const __m128i *)(p) + (i))
+#define XTS_AESNI_STORE(p, i, v) \
+	_mm_storeu_si128((__m128i *)(p) + (i), (v))
+
+/*
+ * Multiply the tweak by x: shift it left by one bit and, if the top bit was
+ * set, add x^7 + x^2 + x + 1.
+ */
+static inline __m128i XTS_AESNI_TARGET
+xts_aesni_mulx(__m128i t)
+{
+	__m128i c;
+
+	c = _mm_shuffle_epi32(_mm_srai_epi32(t, 31), 0x13);
+	c = _mm_and_si128(c, _mm_set_epi32(0, 1, 0, 0x87));
+
+	return _mm_xor_si128(_mm_add_epi64(t, t), c);
+}
+
+static inline __m128i XTS_AESNI_TARGET
+xts_aesni_block(__m128i b, const __m128i *rk, int rounds, int enc)
+{
+	int r;
+
+	b = _mm_xor_si128(b, XTS_AESNI_LOAD(rk, 0));
+	if (enc) {
+		for (r = 1; r <= rounds; r++)
+			b = _mm_aesenc_si128(b, XTS_AESNI_LOAD(rk, r));
+		return _mm_aesenclast_si128(b, XTS_AESNI_LOAD(rk, r));
+	}
+	for (r = 1; r <= rounds; r++)
+		b = _mm_aesdec_si128(b, XTS_AESNI_LOAD(rk, r));
+	return _mm_aesdeclast_si128(b, XTS_AESNI_LOAD(rk, r));
+}
+
+/* Apply an AES round to all blocks of a group. */
+#define XTS_AESNI_ROUND(f, k) do { \
+	__m128i rk_ = (k); \
+	b0 = f(b0, rk_); b1 = f(b1, rk_); b2 = f(b2, rk_); b3 = f(b3, rk_); \
+	b4 = f(b4, rk_); b5 = f(b5, rk_); b6 = f(b6, rk_); b7 = f(b7, rk_); \
+} while (0)
+
+#define XTS_AESNI_START(i) do { \
+	w[i] = _mm_xor_si128(tw, rkl); \
+	b##i = _mm_xor_si128(_mm_xor_si128(XTS_AESNI_LOAD(in, i), tw), rk0); \
+	tw = xts_aesni_mulx(tw); \
+} while (0)
+
+#define XTS_AESNI_FINISH(f, i) \
+	XTS_AESNI_STORE(out, i, f(b##i, w[i]))
+
+#define XTS_AESNI_GROUPS(f, flast) do { \
+	while (blocks >= 8) { \
+		XTS_AESNI_START(0); XTS_AESNI_START(1); \
+		XTS_AESNI_START(2); XTS_AESNI_START(3); \
+		XTS_AESNI_START(4); XTS_AESNI_START(5); \
+		XTS_AESNI_START(6); XTS_AESNI_START(7); \
+		for (r = 1; r <= rounds; r++) \
+			XTS_AESNI_ROUND(f, XTS_AESNI_LOAD(rk, r)); \
+		XTS_AESNI_FINISH(flast, 0); XTS_AESNI_FINISH(flast, 1); \
+		XTS_AESNI_FINISH(flast, 2); XTS_AESNI_FINISH(flast, 3); \
+		XTS_AESNI_FINISH(flast, 4); XTS_AESNI_FINISH(flast, 5); \
+		XTS_AESNI_FINISH(flast, 6); XTS_AESNI_FINISH(flast, 7); \
+		in += 8 * 16; \
+		out += 8 * 16; \
+		blocks -= 8; \
+	} \
+} while (0)
+
+/*
+ * Process blocks (a multiple of eight) with the tweak of the first block in
+ * tw, eight at a time. Returns the tweak of the block that follows.
+ */
+static __m128i XTS_AESNI_TARGET
+xts_aesni_groups(const u8 *in, u8 *out, size_t blocks, const AES_KEY *key,
+    __m128i tw, int enc)
+{
+	const __m128i *rk = (const __m128i *)key->rd_key;
+	__m128i b0, b1, b2, b3, b4, b5, b6, b7;
+	__m128i rk0 = XTS_AESNI_LOAD(rk, 0);
+	__m128i rkl = XTS_AESNI_LOAD(rk, key->rounds + 1);
+	__m128i w[8];
+	int rounds = key->rounds;
+	int r;
+
+	if (enc)
+		XTS_AESNI_GROUPS(_mm_aesenc_si128, _mm_aesenclast_si128);
+	else
+		XTS_AESNI_GROUPS(_mm_aesdec_si128, _mm_aesdeclast_si128);
+
+	return tw;
+}
+
+/*
+ * The same with VAES, two blocks per 256 bit register. Each register holds
+ * a pair of consecutive tweaks, so the next pair is found by multiplying
+ * both by x^2.
+ */
+#define XTS_VAES_LOAD(p, i) \
+	_mm256_loadu_si256((const __m256i *)(p) + (i))
+#define XTS_VAES_STORE(p, i, v) \
+	_mm256_storeu_si256((__m256i *)(p) + (i), (v))
+#define XTS_VAES_BROADCAST(p, i) \
+	_mm256_broadcastsi128_si256(XTS_AESNI_LOAD(p, i))
+
+static inline __m256i XTS_VAES_TARGET
+xts_vaes_mulx2(__m256i t)
+{
+	__m256i c;
+
+	c = _mm256_srli_epi64(t, 62);
+	t = _mm256_xor_si256(_mm256_slli_epi64(t, 2),
+	    _mm256_slli_si256(c, 8));
+	c = _mm256_srli_si256(c, 8);
+	c = _mm256_xor_si256(_mm256_xor_si256(c, _mm256_slli_epi64(c, 1)),
+	    _mm256_xor_si256(_mm256_slli_epi64(c, 2), _mm256_slli_epi64(c, 7)));
+
+	return _mm256_xor_si256(t, c);
+}
+
+#define XTS_VAES_ROUND(f, k) do { \
+	__m256i rk_ = (k); \
+	b0 = f(b0, rk_); b1 = f(b1, rk_); b2 = f(b2, rk_); b3 = f(b3, rk_); \
+	b4 = f(b4, rk_); b5 = f(b5, rk_); b6 = f(b6, rk_); b7 = f(b7, rk_); \
+} while (0)
+
+#define XTS_VAES_START(i) do { \
+	w[i] = _mm256_xor_si256(tw, rkl); \
+	b##i = _mm256_xor_si256(_mm256_xor_si256(XTS_VAES_LOAD(in, i), tw), \
+	    rk0); \
+	tw = xts_vaes_mulx2(tw); \
+} while (0)
+
+#define XTS_VAES_FINISH(f, i) \
+	XTS_VAES_STORE(out, i, f(b##i, w[i]))
+
+#define XTS_VAES_GROUPS(f, flast) do { \
+	while (blocks >= 16) { \
+		XTS_VAES_START(0); XTS_VAES_START(1); \
+		XTS_VAES_START(2); XTS_VAES_START(3); \
+		XTS_VAES_START(4); XTS_VAES_START(5); \
+		XTS_VAES_START(6); XTS_VAES_START(7); \
+		for (r = 1; r <= rounds; r++) \
+			XTS_VAES_ROUND(f, XTS_VAES_BROADCAST(rk, r)); \
+		XTS_VAES_FINISH(flast, 0); XTS_VAES_FINISH(flast, 1); \
+		XTS_VAES_FINISH(flast, 2); XTS_VAES_FINISH(flast, 3); \
+		XTS_VAES_FINISH(flast, 4); XTS_VAES_FINISH(flast, 5); \
+		XTS_VAES_FINISH(flast, 6); XTS_VAES_FINISH(flast, 7); \
+		in += 16 * 16; \
+		out += 16 * 16; \
+		blocks -= 16; \
+	} \
+} while (0)
+
+static __m128i XTS_VAES_TARGET
+xts_vaes_groups(const u8 *in, u8 *out, size_t blocks, const AES_KEY *key,
+    __m128i t0, __m128i t1, int enc)
+{
+	const __m128i *rk = (const __m128i *)key->rd_key;
+	__m256i b0, b1, b2, b3, b4, b5, b6, b7;
+	__m256i rk0 = XTS_VAES_BROADCAST(rk, 0);
+	__m256i rkl = XTS_VAES_BROADCAST(rk, key->rounds + 1);
+	__m256i tw, w[8];
+	int rounds = key->rounds;
+	int r;
+
+	tw = _mm256_inserti128_si256(_mm256_castsi128_si256(t0), t1, 1);
+
+	if (enc)
+		XTS_VAES_GROUPS(_mm256_aesenc_epi128, _mm256_aesenclast_epi128);
+	else
+		XTS_VAES_GROUPS(_mm256_aesdec_epi128, _mm256_aesdeclast_epi128);
+
+	return _mm256_castsi256_si128(tw);
+}
+
+/*
+ * The same as CRYPTO_xts128_encrypt(), with key1 and key2 from
+ * aesni_set_{en,de}crypt_key().
+ */
+static void XTS_AESNI_TARGET
+xts_aesni_crypt(const unsigned char *in, unsigned char *out, size_t len,
+    const AES_KEY *key1, const AES_KEY *key2, const unsigned char iv[16],
+    int enc)
+{
+	const __m128i *rk1 = (const __m128i *)key1->rd_key;
+	const __m128i *rk2 = (const __m128i *)key2->rd_key;
+	unsigned char buf[16];
+	__m128i tw, tw1, b;
+	size_t blocks, tail, n;
+	int rounds = key1->rounds;
+	size_t i;
+
+	if (len < 16)
+		return;
+
+	tw = xts_aesni_block(XTS_AESNI_LOAD(iv, 0), rk2, key2->rounds, 1);
+
+	blocks = len / 16;
+	tail = len % 16;
+	/* When decrypting, the last full block is needed for stealing. */
+	if (!enc && tail != 0)
+		blocks--;
+
+	if (blocks >= 16 && (OPENSSL_cpu_caps() &
+	    (CPUCAP_MASK_AVX2 | CPUCAP_MASK_VAES)) ==
+	    (CPUCAP_MASK_AVX2 | CPUCAP_MASK_VAES)) {
+		n = blocks & ~(size_t)15;
+		tw = xts_vaes_groups(in, out, n, key1, tw, xts_aesni_mulx(tw),
+		    enc);
+		in += n * 16;
+		out += n * 16;
+		blocks -= n;
+	}
+	if (blocks >= 8) {
+		n = blocks & ~(size_t)7;
+		tw = xts_aesni_groups(in, out, n, key1, tw, enc);
+		in += n * 16;
+		out += n * 16;
+		blocks -= n;
+	}
+	while (blocks > 0) {
+		b = _mm_xor_si128(XTS_AESNI_LOAD(in, 0), tw);
+		b = xts_aesni_block(b, rk1, rounds, enc);
+		XTS_AESNI_STORE(out, 0, _mm_xor_si128(b, tw));
+		tw = xts_aesni_mulx(tw);
+		in += 16;
+		out += 16;
+		blocks--;
+	}
+
+	if (tail == 0)
+		return;
+
+	if (enc) {
+		/* Steal from the last ciphertext block, which is at out - 16. */
+		memcpy(buf, out - 16, 16);
+		for (i = 0; i < tail; i++) {
+			u8 c = in[i];
+			out[i] = buf[i];
+			buf[i] = c;
+		}
+		b = _mm_xor_si128(XTS_AESNI_LOAD(buf, 0), tw);
+		b = xts_aesni_block(b, rk1, rounds, enc);
+		XTS_AESNI_STORE(out - 16, 0, _mm_xor_si128(b, tw));
+	} else {
+		/* The last full block is decrypted with the following tweak. */
+		tw1 = xts_aesni_mulx(tw);
+		b = _mm_xor_si128(XTS_AESNI_LOAD(in, 0), tw1);
+		b = xts_aesni_block(b, rk1, rounds, enc);
+		XTS_AESNI_STORE(buf, 0, _mm_xor_si128(b, tw1));
+		for (i = 0; i < tail; i++) {
+			u8 c = in[16 + i];
+			out[16 + i] = buf[i];
+			buf[i] = c;
+		}
+		b = _mm_xor_si128(XTS_AESNI_LOAD(buf, 0), tw);
+		b = xts_aesni_block(b, rk1, rounds, enc);
+		XTS_AESNI_STORE(out, 0, _mm_xor_si128(b, tw));
+	}
+
+	explicit_bzero(buf, sizeof(buf));
+}
+
+void
+xts128_aesni_encrypt(const unsigned char *in, unsigned char *out, size_t len,
+    const AES_KEY *key1, const AES_KEY *key2, const unsigned char iv[16])
+{
+	xts_aesni_crypt(in, out, len, key1, key2, iv, 1);
+}
+
+void
+xts128_aesni_decrypt(const unsigned char *in, unsigned char *out, size_t len,
+    const AES_KEY *key1, const AES_KEY *key2, const unsigned char iv[16])
+{
+	xts_aesni_crypt(in, out, len, key1, key2, iv, 0);
+}
+#endif
@@ -58,6 +58,7 @@
 
 #include <ctype.h>
 #include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -70,18 +71,10 @@
 #include <openssl/objects.h>
 
 /* obj_dat.h is generated from objects.h by obj_dat.pl */
+#include "asn1_locl.h"
+#include "oa_hash.h"
 #include "obj_dat.h"
 
-static int sn_cmp_BSEARCH_CMP_FN(const void *, const void *);
-static int sn_cmp(const ASN1_OBJECT * const *, unsigned int const *);
-static unsigned int *OBJ_bsearch_sn(const ASN1_OBJECT * *key, unsigned int const *base, int num);
-static int ln_cmp_BSEARCH_CMP_FN(const void *, const void *);
-static int ln_cmp(const ASN1_OBJECT * const *, unsigned int const *);
-static unsigned int *OBJ_bsearch_ln(const ASN1_OBJECT * *key, unsigned int const *base, int num);
-static int obj_cmp_BSEARCH_CMP_FN(const void *, const void *);
-static int obj_cmp(const ASN1_OBJECT * const *, unsigned int const *);
-static unsigned int *OBJ_bsearch_obj(const ASN1_OBJECT * *key, unsigned int const *base, int num);
-
 #define ADDED_DATA	0
 #define ADDED_SNAME	1
 #define ADDED_LNAME	2
@@ -91,51 +84,80 @@ typedef struct added_obj_st {
 	int type;
 	ASN1_OBJECT *obj;
 } ADDED_OBJ;
-DECLARE_LHASH_OF(ADDED_OBJ);
+DECLARE_OA_HASH_OF(ADDED_OBJ);
 
 static int new_nid = NUM_NID;
-static LHASH_OF(ADDED_OBJ) *added = NULL;
+static OA_HASH_OF(ADDED_OBJ) *added = NULL;
 
-static int sn_cmp(const ASN1_OBJECT * const *a, const unsigned int *b)
+/*
+ * The hash used by the perfect hash tables that obj_dat.pl generates for the
+ * short names, long names and content octets of the built in objects; it
+ * must match obj_hash() in obj_dat.pl.
+ */
+static unsigned int
+obj_hash(unsigned int seed, const unsigned char *key, size_t len)
 {
-	return (strcmp((*a)->sn, nid_objs[*b].sn));
-}
+	uint32_t h = 0x811c9dc5U ^ seed;
 
+	while (len-- > 0) {
+		h ^= *key++;
+		h *= 0x01000193U;
+	}
+	return (h ^ (h >> 16));
+}
 
+/*
+ * Return the index in nid_objs of the only built in object that may have the
+ * given key, or -1 if there is none. The caller compares the keys.
+ */
 static int
-sn_cmp_BSEARCH_CMP_FN(const void *a_, const void *b_)
+obj_hash_find(const unsigned short *seeds, unsigned int nbuckets,
+    const unsigned short *slots, unsigned int nslots, const void *key,
+    size_t len)
 {
-	const ASN1_OBJECT * const *a = a_;
-	unsigned int const *b = b_;
-	return sn_cmp(a, b);
-}
+	unsigned int seed;
 
-static unsigned int *
-OBJ_bsearch_sn(const ASN1_OBJECT * *key, unsigned int const *base, int num)
-{
-	return (unsigned int *)OBJ_bsearch_(key, base, num, sizeof(unsigned int),
-	    sn_cmp_BSEARCH_CMP_FN);
+	seed = seeds[obj_hash(0, key, len) & (nbuckets - 1)];
+	return ((int)slots[obj_hash(seed, key, len) & (nslots - 1)] - 1);
 }
 
-static int ln_cmp(const ASN1_OBJECT * const *a, const unsigned int *b)
+static const ASN1_OBJECT *
+obj_find_sn(const char *s)
 {
-	return (strcmp((*a)->ln, nid_objs[*b].ln));
-}
+	int i;
 
+	i = obj_hash_find(sn_hash_seeds, SN_HASH_BUCKETS, sn_hash_slots,
+	    SN_HASH_SLOTS, s, strlen(s));
+	if (i < 0 || strcmp(nid_objs[i].sn, s) != 0)
+		return (NULL);
+	return (&nid_objs[i]);
+}
 
-static int
-ln_cmp_BSEARCH_CMP_FN(const void *a_, const void *b_)
+static const ASN1_OBJECT *
+obj_find_ln(const char *s)
 {
-	const ASN1_OBJECT * const *a = a_;
-	unsigned int const *b = b_;
-	return ln_cmp(a, b);
+	int i;
+
+	i = obj_hash_find(ln_hash_seeds, LN_HASH_BUCKETS, ln_hash_slots,
+	    LN_HASH_SLOTS, s, strlen(s));
+	if (i < 0 || strcmp(nid_objs[i].ln, s) != 0)
+		return (NULL);
+	return (&nid_objs[i]);
 }
 
-static unsigned int *
-OBJ_bsearch_ln(const ASN1_OBJECT * *key, unsigned int const *base, int num)
+static const ASN1_OBJECT *
+obj_find_data(const unsigned char *data, int length)
 {
-	return (unsigned int *)OBJ_bsearch_(key, base, num, sizeof(unsigned int),
-	    ln_cmp_BSEARCH_CMP_FN);
+	int i;
+
+	if (length <= 0 || data == NULL)
+		return (NULL);
+	i = obj_hash_find(obj_hash_seeds, OBJ_HASH_BUCKETS, obj_hash_slots,
+	    OBJ_HASH_SLOTS, data, length);
+	if (i < 0 || nid_objs[i].length != length ||
+	    memcmp(nid_objs[i].data, data, length) != 0)
+		return (NULL);
+	return (&nid_objs[i]);
 }
 
 static unsigned long
@@ -218,7 +240,7 @@ init_added(void)
 {
 	if (added != NULL)
 		return (1);
-	added = lh_ADDED_OBJ_new();
+	added = OA_HASH_NEW(ADDED_OBJ, added_obj);
 	return (added != NULL);
 }
 
@@ -271,11 +293,11 @@ OBJ_cleanup(void)
 	}
 	if (added == NULL)
 		return;
-	lh_ADDED_OBJ_down_load(added) = 0;
-	lh_ADDED_OBJ_doall(added, LHASH_DOALL_FN(cleanup1)); /* zero counters */
-	lh_ADDED_OBJ_doall(added, LHASH_DOALL_FN(cleanup2)); /* set counters */
-	lh_ADDED_OBJ_doall(added, LHASH_DOALL_FN(cleanup3)); /* free objects */
-	lh_ADDED_OBJ_free(added);
+	/* Zero the counters, set them, then free the objects. */
+	OA_HASH_DOALL(ADDED_OBJ, added, LHASH_DOALL_FN(cleanup1));
+	OA_HASH_DOALL(ADDED_OBJ, added, LHASH_DOALL_FN(cleanup2));
+	OA_HASH_DOALL(ADDED_OBJ, added, LHASH_DOALL_FN(cleanup3));
+	OA_HASH_FREE(ADDED_OBJ, added);
 	added = NULL;
 }
 
@@ -317,7 +339,7 @@ OBJ_add_object(const ASN1_OBJECT *obj)
 		if (ao[i] != NULL) {
 			ao[i]->type = i;
 			ao[i]->obj = o;
-			aop = lh_ADDED_OBJ_insert(added, ao[i]);
+			aop = OA_HASH_INSERT(ADDED_OBJ, added, ao[i]);
 			/* memory leak, buit should not normally matter */
 			free(aop);
 		}
@@ -355,7 +377,7 @@ OBJ_nid2obj(int n)
 		ad.type = ADDED_NID;
 		ad.obj = &ob;
 		ob.nid = n;
-		adp = lh_ADDED_OBJ_retrieve(added, &ad);
+		adp = OA_HASH_RETRIEVE(ADDED_OBJ, added, &ad);
 		if (adp != NULL)
 			return (adp->obj);
 		else {
@@ -383,7 +405,7 @@ OBJ_nid2sn(int n)
 		ad.type = ADDED_NID;
 		ad.obj = &ob;
 		ob.nid = n;
-		adp = lh_ADDED_OBJ_retrieve(added, &ad);
+		adp = OA_HASH_RETRIEVE(ADDED_OBJ, added, &ad);
 		if (adp != NULL)
 			return (adp->obj->sn);
 		else {
@@ -411,7 +433,7 @@ OBJ_nid2ln(int n)
 		ad.type = ADDED_NID;
 		ad.obj = &ob;
 		ob.nid = n;
-		adp = lh_ADDED_OBJ_retrieve(added, &ad);
+		adp = OA_HASH_RETRIEVE(ADDED_OBJ, added, &ad);
 		if (adp != NULL)
 			return (adp->obj->ln);
 		else {
@@ -421,39 +443,10 @@ OBJ_nid2ln(int n)
 	}
 }
 
-static int
-obj_cmp(const ASN1_OBJECT * const *ap, const unsigned int *bp)
-{
-	int j;
-	const ASN1_OBJECT *a= *ap;
-	const ASN1_OBJECT *b = &nid_objs[*bp];
-
-	j = (a->length - b->length);
-	if (j)
-		return (j);
-	return (memcmp(a->data, b->data, a->length));
-}
-
-
-static int
-obj_cmp_BSEARCH_CMP_FN(const void *a_, const void *b_)
-{
-	const ASN1_OBJECT * const *a = a_;
-	unsigned int const *b = b_;
-	return obj_cmp(a, b);
-}
-
-static unsigned int *
-OBJ_bsearch_obj(const ASN1_OBJECT * *key, unsigned int const *base, int num)
-{
-	return (unsigned int *)OBJ_bsearch_(key, base, num, sizeof(unsigned int),
-	    obj_cmp_BSEARCH_CMP_FN);
-}
-
 int
 OBJ_obj2nid(const ASN1_OBJECT *a)
 {
-	const unsigned int *op;
+	const ASN1_OBJECT *op;
 	ADDED_OBJ ad, *adp;
 
 	if (a == NULL)
@@ -464,14 +457,24 @@ OBJ_obj2nid(const ASN1_OBJECT *a)
 	if (added != NULL) {
 		ad.type = ADDED_DATA;
 		ad.obj=(ASN1_OBJECT *)a; /* XXX: ugly but harmless */
-		adp = lh_ADDED_OBJ_retrieve(added, &ad);
+		adp = OA_HASH_RETRIEVE(ADDED_OBJ, added, &ad);
 		if (adp != NULL)
 			return (adp->obj->nid);
 	}
-	op = OBJ_bsearch_obj(&a, obj_objs, NUM_OBJ);
-	if (op == NULL)
+	if ((op = obj_find_data(a->data, a->length)) == NULL)
 		return (NID_undef);
-	return (nid_objs[*op].nid);
+	return (op->nid);
+}
+
+/*
+ * Return the built in object with the given content octets, or NULL.
+ * Built in objects are never freed, so decoders may hand them out
+ * instead of allocating a copy of each object they decode.
+ */
+const ASN1_OBJECT *
+obj_bsearch_builtin(const unsigned char *data, int length)
+{
+	return (obj_find_data(data, length));
 }
 
 /* Convert an object name into an ASN1_OBJECT
@@ -644,10 +647,28 @@ OBJ_obj2txt(char *buf, int buf_len, const ASN1_OBJECT *a, int no_name)
 int
 OBJ_txt2nid(const char *s)
 {
-	ASN1_OBJECT *obj;
-	int nid;
+	unsigned char buf[64];
+	ASN1_OBJECT *obj, ob;
+	int i, nid;
+
+	if ((nid = OBJ_sn2nid(s)) != NID_undef ||
+	    (nid = OBJ_ln2nid(s)) != NID_undef)
+		return nid;
+
+	/*
+	 * Look dotted numerical forms up by their content octets, without
+	 * building an object, unless they are too long for the buffer.
+	 */
+	if ((i = a2d_ASN1_OBJECT(NULL, 0, s, -1)) <= 0)
+		return NID_undef;
+	if (i <= sizeof(buf) && a2d_ASN1_OBJECT(buf, i, s, -1) == i) {
+		memset(&ob, 0, sizeof(ob));
+		ob.data = buf;
+		ob.length = i;
+		return OBJ_obj2nid(&ob);
+	}
 
-	obj = OBJ_txt2obj(s, 0);
+	obj = OBJ_txt2obj(s, 1);
 	nid = OBJ_obj2nid(obj);
 	ASN1_OBJECT_free(obj);
 	return nid;
@@ -657,44 +678,40 @@ int
 OBJ_ln2nid(const char *s)
 {
 	ASN1_OBJECT o;
-	const ASN1_OBJECT *oo = &o;
 	ADDED_OBJ ad, *adp;
-	const unsigned int *op;
+	const ASN1_OBJECT *op;
 
 	o.ln = s;
 	if (added != NULL) {
 		ad.type = ADDED_LNAME;
 		ad.obj = &o;
-		adp = lh_ADDED_OBJ_retrieve(added, &ad);
+		adp = OA_HASH_RETRIEVE(ADDED_OBJ, added, &ad);
 		if (adp != NULL)
 			return (adp->obj->nid);
 	}
-	op = OBJ_bsearch_ln(&oo, ln_objs, NUM_LN);
-	if (op == NULL)
+	if ((op = obj_find_ln(s)) == NULL)
 		return (NID_undef);
-	return (nid_objs[*op].nid);
+	return (op->nid);
 }
 
 int
 OBJ_sn2nid(const char *s)
 {
 	ASN1_OBJECT o;
-	const ASN1_OBJECT *oo = &o;
 	ADDED_OBJ ad, *adp;
-	const unsigned int *op;
+	const ASN1_OBJECT *op;
 
 	o.sn = s;
 	if (added != NULL) {
 		ad.type = ADDED_SNAME;
 		ad.obj = &o;
-		adp = lh_ADDED_OBJ_retrieve(added, &ad);
+		adp = OA_HASH_RETRIEVE(ADDED_OBJ, added, &ad);
 		if (adp != NULL)
 			return (adp->obj->nid);
 	}
-	op = OBJ_bsearch_sn(&oo, sn_objs, NUM_SN);
-	if (op == NULL)
+	if ((op = obj_find_sn(s)) == NULL)
 		return (NID_undef);
-	return (nid_objs[*op].nid);
+	return (op->nid);
 }
 
 const void *
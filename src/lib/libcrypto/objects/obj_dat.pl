@@ -130,6 +130,7 @@ for ($i=0; $i<$n; $i++)
 				}
 			$obj_der{$obj{$nid{$i}}}=$z;
 			$obj_len{$obj{$nid{$i}}}=$length;
+			$obj_raw{$nid{$i}}=$r;
 
 			push(@lvalues,sprintf("%-45s/* [%3d] %s */\n",
 				$z,$lvalues,$obj{$nid{$i}}));
@@ -145,28 +146,32 @@ for ($i=0; $i<$n; $i++)
 		}
 	}
 
-@a=grep(defined($sn{$nid{$_}}),0 .. $n);
-foreach (sort { $sn{$nid{$a}} cmp $sn{$nid{$b}} } @a)
+# The short names, long names and content octets of the objects are
+# looked up through perfect hash tables; a name that is used by several
+# objects finds the one with the lowest NID.
+%sn_key=();
+foreach (grep(defined($sn{$nid{$_}}),0 .. $n))
 	{
-	push(@sn,sprintf("%2d,\t/* \"$sn{$nid{$_}}\" */\n",$_));
+	$sn_key{$sn{$nid{$_}}}=$_ unless defined($sn_key{$sn{$nid{$_}}});
 	}
 
-@a=grep(defined($ln{$nid{$_}}),0 .. $n);
-foreach (sort { $ln{$nid{$a}} cmp $ln{$nid{$b}} } @a)
+%ln_key=();
+foreach (grep(defined($ln{$nid{$_}}),0 .. $n))
 	{
-	push(@ln,sprintf("%2d,\t/* \"$ln{$nid{$_}}\" */\n",$_));
+	$ln_key{$ln{$nid{$_}}}=$_ unless defined($ln_key{$ln{$nid{$_}}});
 	}
 
-@a=grep(defined($obj{$nid{$_}}),0 .. $n);
-foreach (sort obj_cmp @a)
+%ob_key=();
+foreach (grep(defined($obj_raw{$nid{$_}}),0 .. $n))
 	{
-	$m=$obj{$nid{$_}};
-	$v=$objd{$m};
-	$v =~ s/L//g;
-	$v =~ s/,/ /g;
-	push(@ob,sprintf("%2d,\t/* %-32s %s */\n",$_,$m,$v));
+	$ob_key{$obj_raw{$nid{$_}}}=$_ unless defined($ob_key{$obj_raw{$nid{$_}}});
 	}
 
+die "too many NIDs for the hash tables" if ($n >= 65535);
+@sn=&perfect_hash(*sn_key);
+@ln=&perfect_hash(*ln_key);
+@ob=&perfect_hash(*ob_key);
+
 print OUT <<'EOF';
 /* crypto/objects/obj_dat.h */
 
@@ -235,9 +240,9 @@ print OUT <<'EOF';
 EOF
 
 printf OUT "#define NUM_NID %d\n",$n;
-printf OUT "#define NUM_SN %d\n",$#sn+1;
-printf OUT "#define NUM_LN %d\n",$#ln+1;
-printf OUT "#define NUM_OBJ %d\n\n",$#ob+1;
+printf OUT "#define NUM_SN %d\n",scalar(keys %sn_key);
+printf OUT "#define NUM_LN %d\n",scalar(keys %ln_key);
+printf OUT "#define NUM_OBJ %d\n\n",scalar(keys %ob_key);
 
 printf OUT "static const unsigned char lvalues[%d]={\n",$lvalues+1;
 print OUT @lvalues;
@@ -267,19 +272,102 @@ foreach (@out)
 	}
 print  OUT "};\n\n";
 
-printf OUT "static const unsigned int sn_objs[NUM_SN]={\n";
-print  OUT @sn;
-print  OUT "};\n\n";
+&print_hash("sn",@sn);
+&print_hash("ln",@ln);
+&print_hash("obj",@ob);
 
-printf OUT "static const unsigned int ln_objs[NUM_LN]={\n";
-print  OUT @ln;
-print  OUT "};\n\n";
+close OUT;
 
-printf OUT "static const unsigned int obj_objs[NUM_OBJ]={\n";
-print  OUT @ob;
-print  OUT "};\n\n";
+# Must match obj_hash() in obj_dat.c.
+sub obj_hash
+	{
+	local($seed,$key)=@_;
+	local($h);
 
-close OUT;
+	$h=(0x811c9dc5 ^ $seed) & 0xffffffff;
+	foreach (unpack("C*",$key))
+		{
+		$h^=$_;
+		$h=($h*0x01000193) & 0xffffffff;
+		}
+	return($h ^ ($h >> 16));
+	}
+
+# Build a hash and displace table for the keys of %keys, whose values are
+# NIDs. The keys are spread over buckets by their hash with seed 0, then the
+# buckets, largest first, are each given the first seed that puts all their
+# keys in slots still free. Returns the number of buckets and of slots,
+# a reference to the seeds and one to the slots, which hold NID + 1 or 0.
+sub perfect_hash
+	{
+	local(*keys)=@_;
+	local($nbuckets,$nslots,@buckets,@seeds,@slots,%used);
+	local($b,$k,$seed,$ok,@placed);
+
+	$nslots=1;
+	$nslots*=2 while ($nslots < 2*scalar(keys %keys));
+	$nbuckets=$nslots/4;
+	$nbuckets=1 if ($nbuckets < 1);
+
+	foreach $k (sort keys %keys)
+		{
+		push(@{$buckets[&obj_hash(0,$k) & ($nbuckets-1)]},$k);
+		}
+	@slots=(0) x $nslots;
+	@seeds=(0) x $nbuckets;
+
+	foreach $b (sort { scalar(@{$buckets[$b]}) <=> scalar(@{$buckets[$a]})
+	    || $a <=> $b } grep(defined($buckets[$_]),0 .. $nbuckets-1))
+		{
+		for ($seed=1; $seed < 65536; $seed++)
+			{
+			%used=();
+			@placed=();
+			$ok=1;
+			foreach $k (@{$buckets[$b]})
+				{
+				$i=&obj_hash($seed,$k) & ($nslots-1);
+				if ($slots[$i] != 0 || defined($used{$i}))
+					{ $ok=0; last; }
+				$used{$i}=1;
+				push(@placed,$i);
+				}
+			last if $ok;
+			}
+		die "no perfect hash seed found" unless $ok;
+		$seeds[$b]=$seed;
+		foreach $k (@{$buckets[$b]})
+			{
+			$slots[shift(@placed)]=$keys{$k}+1;
+			}
+		}
+	return($nbuckets,$nslots,\@seeds,\@slots);
+	}
+
+sub print_hash
+	{
+	local($name,$nbuckets,$nslots,$seeds,$slots)=@_;
+	local($i,$line);
+
+	printf OUT "#define %s_HASH_BUCKETS %d\n",uc($name),$nbuckets;
+	printf OUT "#define %s_HASH_SLOTS %d\n\n",uc($name),$nslots;
+	foreach (["seeds",$seeds,"BUCKETS"],["slots",$slots,"SLOTS"])
+		{
+		printf OUT "static const unsigned short %s_hash_%s[%s_HASH_%s]={\n",
+		    $name,$$_[0],uc($name),$$_[2];
+		$line="";
+		for ($i=0; $i <= $#{$$_[1]}; $i++)
+			{
+			$line.=sprintf("%d,",$$_[1][$i]);
+			if (($i % 10) == 9 || $i == $#{$$_[1]})
+				{
+				print OUT "$line\n";
+				$line="";
+				}
+			}
+		print OUT "};\n\n";
+		}
+	}
 
 sub der_it
 	{
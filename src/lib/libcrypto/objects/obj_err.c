@@ -65,18 +65,20 @@
 #include <openssl/err.h>
 #include <openssl/objects.h>
 
+#include "cryptlib.h"
+
 /* BEGIN ERROR CODES */
 #ifndef OPENSSL_NO_ERR
 
 #define ERR_FUNC(func) ERR_PACK(ERR_LIB_OBJ,func,0)
 #define ERR_REASON(reason) ERR_PACK(ERR_LIB_OBJ,0,reason)
 
-static ERR_STRING_DATA OBJ_str_functs[] = {
+static const ERR_STRING_DATA OBJ_str_functs[] = {
 	{ERR_FUNC(0xfff), "CRYPTO_internal"},
 	{0, NULL}
 };
 
-static ERR_STRING_DATA OBJ_str_reasons[] = {
+static const ERR_STRING_DATA OBJ_str_reasons[] = {
 	{ERR_REASON(OBJ_R_MALLOC_FAILURE)        , "malloc failure"},
 	{ERR_REASON(OBJ_R_UNKNOWN_NID)           , "unknown nid"},
 	{0, NULL}
@@ -89,8 +91,8 @@ ERR_load_OBJ_strings(void)
 {
 #ifndef OPENSSL_NO_ERR
 	if (ERR_func_error_string(OBJ_str_functs[0].error) == NULL) {
-		ERR_load_strings(0, OBJ_str_functs);
-		ERR_load_strings(0, OBJ_str_reasons);
+		ERR_load_const_strings(OBJ_str_functs);
+		ERR_load_const_strings(OBJ_str_reasons);
 	}
 #endif
 }
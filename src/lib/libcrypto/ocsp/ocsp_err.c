@@ -65,18 +65,20 @@
 #include <openssl/err.h>
 #include <openssl/ocsp.h>
 
+#include "cryptlib.h"
+
 /* BEGIN ERROR CODES */
 #ifndef OPENSSL_NO_ERR
 
 #define ERR_FUNC(func) ERR_PACK(ERR_LIB_OCSP,func,0)
 #define ERR_REASON(reason) ERR_PACK(ERR_LIB_OCSP,0,reason)
 
-static ERR_STRING_DATA OCSP_str_functs[]= {
+static const ERR_STRING_DATA OCSP_str_functs[]= {
 	{ERR_FUNC(0xfff), "CRYPTO_internal"},
 	{0, NULL}
 };
 
-static ERR_STRING_DATA OCSP_str_reasons[]= {
+static const ERR_STRING_DATA OCSP_str_reasons[]= {
 	{ERR_REASON(OCSP_R_BAD_DATA)             , "bad data"},
 	{ERR_REASON(OCSP_R_CERTIFICATE_VERIFY_ERROR), "certificate verify error"},
 	{ERR_REASON(OCSP_R_DIGEST_ERR)           , "digest err"},
@@ -117,8 +119,8 @@ ERR_load_OCSP_strings(void)
 {
 #ifndef OPENSSL_NO_ERR
 	if (ERR_func_error_string(OCSP_str_functs[0].error) == NULL) {
-		ERR_load_strings(0, OCSP_str_functs);
-		ERR_load_strings(0, OCSP_str_reasons);
+		ERR_load_const_strings(OCSP_str_functs);
+		ERR_load_const_strings(OCSP_str_reasons);
 	}
 #endif
 }
@@ -59,6 +59,18 @@
 #include <openssl/ocsp.h>
 #include <openssl/err.h>
 #include <string.h>
+#include <time.h>
+
+#include "../x509/x509_chain_cache.h"
+
+/*
+ * Responder chains are kept in the verify cache of the store, if it has
+ * one, under a key for the digest of the responder certificate and one
+ * for the hash of its public key, which is how most responders name
+ * themselves in their responses.
+ */
+#define OCSP_CACHE_CERT		1
+#define OCSP_CACHE_KEYID	2
 
 static int ocsp_find_signer(X509 **psigner, OCSP_BASICRESP *bs,
     STACK_OF(X509) *certs, X509_STORE *st, unsigned long flags);
@@ -72,18 +84,32 @@ static int ocsp_check_delegated(X509 *x, int flags);
 static int ocsp_req_find_signer(X509 **psigner, OCSP_REQUEST *req,
     X509_NAME *nm, STACK_OF(X509) *certs, X509_STORE *st,
     unsigned long flags);
+static int ocsp_cache_key(X509_STORE_CTX *ctx, int type,
+    const unsigned char *id, size_t id_len, unsigned long flags,
+    unsigned char *md);
+static int ocsp_basic_verify_cached(OCSP_BASICRESP *bs, STACK_OF(X509) *certs,
+    X509_STORE *st, unsigned long flags);
 
 /* Verify a basic response message */
 int
 OCSP_basic_verify(OCSP_BASICRESP *bs, STACK_OF(X509) *certs, X509_STORE *st,
     unsigned long flags)
 {
+	unsigned char cert_key[X509_CHAIN_CACHE_MD_LEN];
+	unsigned char keyid_key[X509_CHAIN_CACHE_MD_LEN];
+	unsigned char md[EVP_MAX_MD_SIZE];
+	unsigned int md_len;
 	X509 *signer, *x;
 	STACK_OF(X509) *chain = NULL;
 	STACK_OF(X509) *untrusted = NULL;
 	X509_STORE_CTX ctx;
+	uint64_t generation = 0;
+	int cache = 0;
 	int i, ret = 0;
 
+	if (ocsp_basic_verify_cached(bs, certs, st, flags))
+		return 1;
+
 	ret = ocsp_find_signer(&signer, bs, certs, st, flags);
 	if (!ret) {
 		OCSPerror(OCSP_R_SIGNER_CERTIFICATE_NOT_FOUND);
@@ -133,9 +159,26 @@ OCSP_basic_verify(OCSP_BASICRESP *bs, STACK_OF(X509) *certs, X509_STORE *st,
 			ret = -1;
 			goto end;
 		}
+		if (x509_verify_cert_cacheable(&ctx) &&
+		    X509_digest(signer, EVP_sha512(), md, &md_len) &&
+		    ocsp_cache_key(&ctx, OCSP_CACHE_CERT, md, md_len, flags,
+		    cert_key) &&
+		    X509_pubkey_digest(signer, EVP_sha1(), md, &md_len) &&
+		    ocsp_cache_key(&ctx, OCSP_CACHE_KEYID, md, md_len, flags,
+		    keyid_key)) {
+			generation =
+			    x509_chain_cache_generation(st->verify_cache);
+			cache = 1;
+		}
 		ret = X509_verify_cert(&ctx);
 		chain = X509_STORE_CTX_get1_chain(&ctx);
 		X509_STORE_CTX_cleanup(&ctx);
+		if (cache && ret > 0 && chain != NULL) {
+			x509_chain_cache_add(st->verify_cache, cert_key,
+			    generation, chain, 0);
+			x509_chain_cache_add(st->verify_cache, keyid_key,
+			    generation, chain, 0);
+		}
 		if (ret <= 0) {
 			i = X509_STORE_CTX_get_error(&ctx);
 			OCSPerror(OCSP_R_CERTIFICATE_VERIFY_ERROR);
@@ -179,6 +222,156 @@ end:
 	return ret;
 }
 
+/*
+ * The key of a responder chain in the verify cache. Besides the responder
+ * it covers the OCSP flags and the verification parameters that go into
+ * the key of a certificate verification.
+ */
+static int
+ocsp_cache_key(X509_STORE_CTX *ctx, int type, const unsigned char *id,
+    size_t id_len, unsigned long flags, unsigned char *md)
+{
+	static const char tag[] = "OCSP responder";
+	X509_VERIFY_PARAM *param = ctx->param;
+	EVP_MD_CTX *md_ctx;
+	uint64_t parts[6];
+	unsigned int md_len;
+	int ret = 0;
+
+	if ((md_ctx = EVP_MD_CTX_new()) == NULL)
+		return 0;
+	if (!EVP_DigestInit_ex(md_ctx, EVP_sha512(), NULL))
+		goto err;
+
+	parts[0] = type;
+	parts[1] = flags;
+	parts[2] = param->flags;
+	parts[3] = param->purpose;
+	parts[4] = param->trust;
+	parts[5] = param->depth;
+	if (!EVP_DigestUpdate(md_ctx, tag, sizeof(tag)))
+		goto err;
+	if (!EVP_DigestUpdate(md_ctx, parts, sizeof(parts)))
+		goto err;
+	if (!EVP_DigestUpdate(md_ctx, id, id_len))
+		goto err;
+
+	if (!EVP_DigestFinal_ex(md_ctx, md, &md_len))
+		goto err;
+	if (md_len != X509_CHAIN_CACHE_MD_LEN)
+		goto err;
+
+	ret = 1;
+
+ err:
+	EVP_MD_CTX_free(md_ctx);
+
+	return ret;
+}
+
+/*
+ * Verify a response with a responder chain from the verify cache of the
+ * store, so that a responder that was verified before only costs the
+ * check of the response signature. A response naming its responder by
+ * key hash is matched without looking at the certificates at all. All
+ * checks of the response itself are still made on the cached chain.
+ * Returns 1 on success, or 0 if the response has to be verified in full,
+ * without leaving anything on the error stack.
+ */
+static int
+ocsp_basic_verify_cached(OCSP_BASICRESP *bs, STACK_OF(X509) *certs,
+    X509_STORE *st, unsigned long flags)
+{
+	OCSP_RESPID *rid = bs->tbsResponseData->responderId;
+	unsigned char key[X509_CHAIN_CACHE_MD_LEN];
+	unsigned char md[EVP_MAX_MD_SIZE];
+	unsigned int md_len;
+	STACK_OF(X509) *chain = NULL;
+	X509_STORE_CTX ctx;
+	X509 *signer = NULL, *x;
+	EVP_PKEY *skey;
+	time_t check_time;
+	int check_validity, last_untrusted;
+	int i, init = 0, ret = 0;
+
+	if (st == NULL || st->verify_cache == NULL)
+		return 0;
+	if (flags & OCSP_NOVERIFY)
+		return 0;
+
+	ERR_set_mark();
+
+	if (rid->type == V_OCSP_RESPID_KEY) {
+		if (rid->value.byKey->length != SHA_DIGEST_LENGTH)
+			goto err;
+	} else if (!ocsp_find_signer(&signer, bs, certs, st, flags))
+		goto err;
+
+	if (!X509_STORE_CTX_init(&ctx, st, signer, NULL))
+		goto err;
+	init = 1;
+	if (!X509_STORE_CTX_set_purpose(&ctx, X509_PURPOSE_OCSP_HELPER))
+		goto err;
+	if (!x509_verify_cert_cacheable(&ctx))
+		goto err;
+
+	if (signer == NULL) {
+		if (!ocsp_cache_key(&ctx, OCSP_CACHE_KEYID,
+		    rid->value.byKey->data, rid->value.byKey->length, flags,
+		    key))
+			goto err;
+	} else {
+		if (!X509_digest(signer, EVP_sha512(), md, &md_len))
+			goto err;
+		if (!ocsp_cache_key(&ctx, OCSP_CACHE_CERT, md, md_len, flags,
+		    key))
+			goto err;
+	}
+
+	check_validity = !(ctx.param->flags & X509_V_FLAG_NO_CHECK_TIME);
+	if (ctx.param->flags & X509_V_FLAG_USE_CHECK_TIME)
+		check_time = ctx.param->check_time;
+	else
+		check_time = time(NULL);
+
+	if (!x509_chain_cache_find(st->verify_cache, key, check_time,
+	    check_validity, &chain, &last_untrusted))
+		goto err;
+	signer = sk_X509_value(chain, 0);
+
+	if (!(flags & OCSP_NOSIGS)) {
+		if ((skey = X509_get_pubkey(signer)) == NULL)
+			goto err;
+		i = OCSP_BASICRESP_verify(bs, skey, 0);
+		EVP_PKEY_free(skey);
+		if (i <= 0)
+			goto err;
+	}
+
+	if (!(flags & OCSP_NOCHECKS)) {
+		if ((i = ocsp_check_issuer(bs, chain, flags)) < 0)
+			goto err;
+		if (i == 0) {
+			if (flags & OCSP_NOEXPLICIT)
+				goto err;
+			x = sk_X509_value(chain, sk_X509_num(chain) - 1);
+			if (X509_check_trust(x, NID_OCSP_sign, 0) !=
+			    X509_TRUST_TRUSTED)
+				goto err;
+		}
+	}
+
+	ret = 1;
+
+ err:
+	if (init)
+		X509_STORE_CTX_cleanup(&ctx);
+	sk_X509_pop_free(chain, X509_free);
+	ERR_pop_to_mark();
+
+	return ret;
+}
+
 static int
 ocsp_find_signer(X509 **psigner, OCSP_BASICRESP *bs, STACK_OF(X509) *certs,
     X509_STORE *st, unsigned long flags)
@@ -397,6 +397,9 @@ int	PEM_ASN1_write_bio(i2d_of_void *i2d, const char *name, BIO *bp, void *x,
 
 STACK_OF(X509_INFO) *	PEM_X509_INFO_read_bio(BIO *bp,
 	    STACK_OF(X509_INFO) *sk, pem_password_cb *cb, void *u);
+int	PEM_X509_INFO_read_bio_cb(BIO *bp,
+	    int (*info_cb)(X509_INFO *, void *), void *arg,
+	    pem_password_cb *cb, void *u);
 int	PEM_X509_INFO_write_bio(BIO *bp, X509_INFO *xi, EVP_CIPHER *enc,
 	    unsigned char *kstr, int klen, pem_password_cb *cd, void *u);
 #endif
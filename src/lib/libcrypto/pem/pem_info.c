@@ -75,6 +75,8 @@
 #include <openssl/rsa.h>
 #endif
 
+#include "pem_internal.h"
+
 STACK_OF(X509_INFO) *
 PEM_X509_INFO_read(FILE *fp, STACK_OF(X509_INFO) *sk, pem_password_cb *cb,
     void *u)
@@ -92,35 +94,53 @@ PEM_X509_INFO_read(FILE *fp, STACK_OF(X509_INFO) *sk, pem_password_cb *cb,
 	return (ret);
 }
 
-STACK_OF(X509_INFO) *
-PEM_X509_INFO_read_bio(BIO *bp, STACK_OF(X509_INFO) *sk, pem_password_cb *cb,
-    void *u)
+/*
+ * Pass on a completed X509_INFO and start a new one.
+ */
+static int
+pem_x509_info_done(X509_INFO **xi, int (*info_cb)(X509_INFO *, void *),
+    void *arg)
+{
+	int ret;
+
+	ret = info_cb(*xi, arg);
+	if ((*xi = X509_INFO_new()) == NULL)
+		return 0;
+	return ret;
+}
+
+/*
+ * Decode the objects of a PEM stream one by one, and pass each X509_INFO
+ * to info_cb as soon as it is complete, instead of collecting them all.
+ * The callback owns the X509_INFO it is passed, and stops the reading by
+ * returning 0.
+ */
+int
+PEM_X509_INFO_read_bio_cb(BIO *bp, int (*info_cb)(X509_INFO *, void *),
+    void *arg, pem_password_cb *cb, void *u)
 {
+	struct pem_reader pr;
 	X509_INFO *xi = NULL;
-	char *name = NULL, *header = NULL;
+	char *name, *header;
 	void *pp;
-	unsigned char *data = NULL;
+	unsigned char *data;
 	const unsigned char *p;
 	long len;
 	int ok = 0;
-	int num_in, ptype, raw;
-	STACK_OF(X509_INFO) *ret = sk;
+	int ptype, raw;
 	d2i_of_void *d2i = NULL;
 
-	if (ret == NULL) {
-		if ((ret = sk_X509_INFO_new_null()) == NULL) {
-			PEMerror(ERR_R_MALLOC_FAILURE);
-			return NULL;
-		}
+	if (!pem_reader_init(&pr, bp)) {
+		PEMerror(ERR_R_MALLOC_FAILURE);
+		return 0;
 	}
-	num_in = sk_X509_INFO_num(ret);
 
 	if ((xi = X509_INFO_new()) == NULL)
 		goto err;
 	for (;;) {
 		raw = 0;
 		ptype = 0;
-		if (!PEM_read_bio(bp, &name, &header, &data, &len)) {
+		if (!pem_reader_next(&pr, &name, &header, &data, &len)) {
 			if (ERR_GET_REASON(ERR_peek_last_error()) ==
 			    PEM_R_NO_START_LINE) {
 				ERR_clear_error();
@@ -130,29 +150,23 @@ PEM_X509_INFO_read_bio(BIO *bp, STACK_OF(X509_INFO) *sk, pem_password_cb *cb,
 		}
 		if ((strcmp(name, PEM_STRING_X509) == 0) ||
 		    (strcmp(name, PEM_STRING_X509_OLD) == 0)) {
-			d2i = (D2I_OF(void))d2i_X509;
+			d2i = (D2I_OF(void))d2i_X509_lazy;
 			if (xi->x509 != NULL) {
-				if (!sk_X509_INFO_push(ret, xi))
-					goto err;
-				if ((xi = X509_INFO_new()) == NULL)
+				if (!pem_x509_info_done(&xi, info_cb, arg))
 					goto err;
 			}
 			pp = &(xi->x509);
 		} else if ((strcmp(name, PEM_STRING_X509_TRUSTED) == 0)) {
 			d2i = (D2I_OF(void))d2i_X509_AUX;
 			if (xi->x509 != NULL) {
-				if (!sk_X509_INFO_push(ret, xi))
-					goto err;
-				if ((xi = X509_INFO_new()) == NULL)
+				if (!pem_x509_info_done(&xi, info_cb, arg))
 					goto err;
 			}
 			pp = &(xi->x509);
 		} else if (strcmp(name, PEM_STRING_X509_CRL) == 0) {
 			d2i = (D2I_OF(void))d2i_X509_CRL;
 			if (xi->crl != NULL) {
-				if (!sk_X509_INFO_push(ret, xi))
-					goto err;
-				if ((xi = X509_INFO_new()) == NULL)
+				if (!pem_x509_info_done(&xi, info_cb, arg))
 					goto err;
 			}
 			pp = &(xi->crl);
@@ -161,9 +175,7 @@ PEM_X509_INFO_read_bio(BIO *bp, STACK_OF(X509_INFO) *sk, pem_password_cb *cb,
 		if (strcmp(name, PEM_STRING_RSA) == 0) {
 			d2i = (D2I_OF(void))d2i_RSAPrivateKey;
 			if (xi->x_pkey != NULL) {
-				if (!sk_X509_INFO_push(ret, xi))
-					goto err;
-				if ((xi = X509_INFO_new()) == NULL)
+				if (!pem_x509_info_done(&xi, info_cb, arg))
 					goto err;
 			}
 			xi->enc_data = NULL;
@@ -181,9 +193,7 @@ PEM_X509_INFO_read_bio(BIO *bp, STACK_OF(X509_INFO) *sk, pem_password_cb *cb,
 		if (strcmp(name, PEM_STRING_DSA) == 0) {
 			d2i = (D2I_OF(void))d2i_DSAPrivateKey;
 			if (xi->x_pkey != NULL) {
-				if (!sk_X509_INFO_push(ret, xi))
-					goto err;
-				if ((xi = X509_INFO_new()) == NULL)
+				if (!pem_x509_info_done(&xi, info_cb, arg))
 					goto err;
 			}
 			xi->enc_data = NULL;
@@ -201,9 +211,7 @@ PEM_X509_INFO_read_bio(BIO *bp, STACK_OF(X509_INFO) *sk, pem_password_cb *cb,
 		if (strcmp(name, PEM_STRING_ECPRIVATEKEY) == 0) {
 			d2i = (D2I_OF(void))d2i_ECPrivateKey;
 			if (xi->x_pkey != NULL) {
-				if (!sk_X509_INFO_push(ret, xi))
-					goto err;
-				if ((xi = X509_INFO_new()) == NULL)
+				if (!pem_x509_info_done(&xi, info_cb, arg))
 					goto err;
 			}
 			xi->enc_data = NULL;
@@ -245,44 +253,71 @@ PEM_X509_INFO_read_bio(BIO *bp, STACK_OF(X509_INFO) *sk, pem_password_cb *cb,
 				if (!PEM_get_EVP_CIPHER_INFO(header,
 				    &xi->enc_cipher))
 					goto err;
-				xi->enc_data = (char *)data;
+				if ((xi->enc_data = malloc(len)) == NULL) {
+					PEMerror(ERR_R_MALLOC_FAILURE);
+					goto err;
+				}
+				memcpy(xi->enc_data, data, len);
 				xi->enc_len = (int)len;
-				data = NULL;
 			}
 		} else {
 			/* unknown */
 		}
-		free(name);
-		free(header);
-		free(data);
-		name = NULL;
-		header = NULL;
-		data = NULL;
 	}
 
-	/* if the last one hasn't been pushed yet and there is anything
-	 * in it then add it to the stack ...
+	/* if the last one hasn't been completed yet and there is anything
+	 * in it then pass it on ...
 	 */
 	if ((xi->x509 != NULL) || (xi->crl != NULL) ||
 	    (xi->x_pkey != NULL) || (xi->enc_data != NULL)) {
-		if (!sk_X509_INFO_push(ret, xi))
-			goto err;
+		ok = info_cb(xi, arg);
 		xi = NULL;
+		if (!ok)
+			goto err;
 	}
 	ok = 1;
 
 err:
-	if (!ok) {
+	X509_INFO_free(xi);
+	pem_reader_cleanup(&pr);
+
+	return ok;
+}
+
+static int
+pem_x509_info_push(X509_INFO *xi, void *arg)
+{
+	STACK_OF(X509_INFO) *sk = arg;
+
+	if (!sk_X509_INFO_push(sk, xi)) {
+		X509_INFO_free(xi);
+		return 0;
+	}
+	return 1;
+}
+
+STACK_OF(X509_INFO) *
+PEM_X509_INFO_read_bio(BIO *bp, STACK_OF(X509_INFO) *sk, pem_password_cb *cb,
+    void *u)
+{
+	STACK_OF(X509_INFO) *ret = sk;
+	int num_in;
+
+	if (ret == NULL) {
+		if ((ret = sk_X509_INFO_new_null()) == NULL) {
+			PEMerror(ERR_R_MALLOC_FAILURE);
+			return NULL;
+		}
+	}
+	num_in = sk_X509_INFO_num(ret);
+
+	if (!PEM_X509_INFO_read_bio_cb(bp, pem_x509_info_push, ret, cb, u)) {
 		while (sk_X509_INFO_num(ret) > num_in)
 			X509_INFO_free(sk_X509_INFO_pop(ret));
 		if (ret != sk)
 			sk_X509_INFO_free(ret);
 		ret = NULL;
 	}
-	X509_INFO_free(xi);
-	free(name);
-	free(header);
-	free(data);
 
 	return ret;
 }
@@ -0,0 +1,48 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef HEADER_PEM_INTERNAL_H
+#define HEADER_PEM_INTERNAL_H
+
+#include <openssl/bio.h>
+#include <openssl/buffer.h>
+
+__BEGIN_HIDDEN_DECLS
+
+/*
+ * Reads the PEM objects from a BIO one after the other, decoding the base64
+ * of each line as it is read. The name, header and data returned by
+ * pem_reader_next() stay owned by the reader, and are overwritten by the
+ * next call - the buffers are reused, so that reading many objects does not
+ * allocate for each of them.
+ */
+struct pem_reader {
+	BIO *bp;
+	BUF_MEM *name;
+	BUF_MEM *header;
+	BUF_MEM *data;
+	char line[256];
+};
+
+int pem_reader_init(struct pem_reader *pr, BIO *bp);
+void pem_reader_cleanup(struct pem_reader *pr);
+int pem_reader_next(struct pem_reader *pr, char **name, char **header,
+    unsigned char **data, long *len);
+
+__END_HIDDEN_DECLS
+
+#endif /* HEADER_PEM_INTERNAL_H */
@@ -57,6 +57,7 @@
  */
 
 #include <ctype.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -79,6 +80,7 @@
 #endif
 
 #include "asn1_locl.h"
+#include "pem_internal.h"
 
 #define MIN_LENGTH	4
 
@@ -665,175 +667,222 @@ PEM_read(FILE *fp, char **name, char **header, unsigned char **data, long *len)
 }
 
 int
-PEM_read_bio(BIO *bp, char **name, char **header, unsigned char **data,
-    long *len)
+pem_reader_init(struct pem_reader *pr, BIO *bp)
 {
-	EVP_ENCODE_CTX ctx;
-	int end = 0, i, k, bl = 0, hl = 0, nohead = 0;
-	char buf[256];
-	BUF_MEM *nameB;
-	BUF_MEM *headerB;
-	BUF_MEM *dataB, *tmpB;
-
-	nameB = BUF_MEM_new();
-	headerB = BUF_MEM_new();
-	dataB = BUF_MEM_new();
-	if ((nameB == NULL) || (headerB == NULL) || (dataB == NULL)) {
-		BUF_MEM_free(nameB);
-		BUF_MEM_free(headerB);
-		BUF_MEM_free(dataB);
-		PEMerror(ERR_R_MALLOC_FAILURE);
-		return (0);
+	memset(pr, 0, sizeof(*pr));
+	pr->bp = bp;
+	if ((pr->name = BUF_MEM_new()) == NULL ||
+	    (pr->header = BUF_MEM_new()) == NULL ||
+	    (pr->data = BUF_MEM_new()) == NULL) {
+		pem_reader_cleanup(pr);
+		return 0;
 	}
+	return 1;
+}
+
+void
+pem_reader_cleanup(struct pem_reader *pr)
+{
+	BUF_MEM_free(pr->name);
+	BUF_MEM_free(pr->header);
+	BUF_MEM_free(pr->data);
+	memset(pr, 0, sizeof(*pr));
+}
+
+/*
+ * Read a line with trailing white space replaced by a single newline, or
+ * return 0 at the end of the input.
+ */
+static int
+pem_reader_gets(struct pem_reader *pr)
+{
+	char *buf = pr->line;
+	int i;
 
 	buf[254] = '\0';
-	for (;;) {
-		i = BIO_gets(bp, buf, 254);
+	if ((i = BIO_gets(pr->bp, buf, 254)) <= 0) {
+		buf[0] = '\0';
+		return 0;
+	}
+	while ((i >= 0) && (buf[i] <= ' '))
+		i--;
+	buf[++i] = '\n';
+	buf[++i] = '\0';
 
-		if (i <= 0) {
-			PEMerror(PEM_R_NO_START_LINE);
-			goto err;
-		}
+	return i;
+}
 
-		while ((i >= 0) && (buf[i] <= ' '))
-			i--;
-		buf[++i] = '\n';
-		buf[++i] = '\0';
+static int
+pem_reader_decode(struct pem_reader *pr, EVP_ENCODE_CTX *ctx, int *done,
+    size_t *len, int linelen)
+{
+	int outl, ret;
 
+	/* An EVP_ENCODE_CTX forgets about padding, so refuse data after it. */
+	if (*done) {
+		if (pr->line[0] == '\n')
+			return 1;
+		PEMerror(PEM_R_BAD_BASE64_DECODE);
+		return 0;
+	}
+	if (!BUF_MEM_grow_clean(pr->data, *len + linelen + 80)) {
+		PEMerror(ERR_R_MALLOC_FAILURE);
+		return 0;
+	}
+	ret = EVP_DecodeUpdate(ctx, (unsigned char *)&pr->data->data[*len],
+	    &outl, (unsigned char *)pr->line, linelen);
+	if (ret < 0) {
+		PEMerror(PEM_R_BAD_BASE64_DECODE);
+		return 0;
+	}
+	*len += outl;
+	*done = (ret == 0);
+
+	return 1;
+}
+
+/*
+ * The first line after the BEGIN line tells whether the object has RFC 1421
+ * headers, which are followed by an empty line and then by base64 lines of
+ * 64 characters. Without headers, lines of any length are decoded up to the
+ * END line.
+ */
+int
+pem_reader_next(struct pem_reader *pr, char **name, char **header,
+    unsigned char **data, long *len)
+{
+	EVP_ENCODE_CTX ctx;
+	char *buf = pr->line;
+	size_t hl, dl = 0;
+	int done = 0, end = 0, i, k;
+
+	for (;;) {
+		if (pem_reader_gets(pr) == 0) {
+			PEMerror(PEM_R_NO_START_LINE);
+			return 0;
+		}
 		if (strncmp(buf, "-----BEGIN ", 11) == 0) {
 			i = strlen(&(buf[11]));
 
 			if (strncmp(&(buf[11 + i - 6]), "-----\n", 6) != 0)
 				continue;
-			if (!BUF_MEM_grow(nameB, i + 9)) {
+			if (!BUF_MEM_grow(pr->name, i + 9)) {
 				PEMerror(ERR_R_MALLOC_FAILURE);
-				goto err;
+				return 0;
 			}
-			memcpy(nameB->data, &(buf[11]), i - 6);
-			nameB->data[i - 6] = '\0';
+			memcpy(pr->name->data, &(buf[11]), i - 6);
+			pr->name->data[i - 6] = '\0';
 			break;
 		}
 	}
 	hl = 0;
-	if (!BUF_MEM_grow(headerB, 256)) {
+	if (!BUF_MEM_grow(pr->header, 256)) {
 		PEMerror(ERR_R_MALLOC_FAILURE);
-		goto err;
-	}
-	headerB->data[0] = '\0';
-	for (;;) {
-		i = BIO_gets(bp, buf, 254);
-		if (i <= 0)
-			break;
-
-		while ((i >= 0) && (buf[i] <= ' '))
-			i--;
-		buf[++i] = '\n';
-		buf[++i] = '\0';
-
-		if (buf[0] == '\n')
-			break;
-		if (!BUF_MEM_grow(headerB, hl + i + 9)) {
-			PEMerror(ERR_R_MALLOC_FAILURE);
-			goto err;
-		}
-		if (strncmp(buf, "-----END ", 9) == 0) {
-			nohead = 1;
-			break;
-		}
-		memcpy(&(headerB->data[hl]), buf, i);
-		headerB->data[hl + i] = '\0';
-		hl += i;
+		return 0;
 	}
+	pr->header->data[0] = '\0';
+	EVP_DecodeInit(&ctx);
 
-	bl = 0;
-	if (!BUF_MEM_grow(dataB, 1024)) {
-		PEMerror(ERR_R_MALLOC_FAILURE);
-		goto err;
-	}
-	dataB->data[0] = '\0';
-	if (!nohead) {
-		for (;;) {
-			i = BIO_gets(bp, buf, 254);
-			if (i <= 0)
+	i = pem_reader_gets(pr);
+	if (i > 0 && strchr(buf, ':') != NULL) {
+		while (i > 0 && buf[0] != '\n') {
+			if (strncmp(buf, "-----END ", 9) == 0)
 				break;
-
-			while ((i >= 0) && (buf[i] <= ' '))
-				i--;
-			buf[++i] = '\n';
-			buf[++i] = '\0';
-
+			if (!BUF_MEM_grow(pr->header, hl + i + 9)) {
+				PEMerror(ERR_R_MALLOC_FAILURE);
+				return 0;
+			}
+			memcpy(&(pr->header->data[hl]), buf, i);
+			pr->header->data[hl + i] = '\0';
+			hl += i;
+			i = pem_reader_gets(pr);
+		}
+		if (i > 0 && buf[0] == '\n')
+			i = pem_reader_gets(pr);
+		end = 1;
+	} else if (i > 0 && buf[0] == '\n') {
+		i = pem_reader_gets(pr);
+		end = 1;
+	}
+
+	if (end) {
+		/* Base64 lines of 64 characters, up to a shorter one. */
+		end = 0;
+		for (; i > 0; i = pem_reader_gets(pr)) {
 			if (i != 65)
 				end = 1;
 			if (strncmp(buf, "-----END ", 9) == 0)
 				break;
 			if (i > 65)
 				break;
-			if (!BUF_MEM_grow_clean(dataB, i + bl + 9)) {
-				PEMerror(ERR_R_MALLOC_FAILURE);
-				goto err;
-			}
-			memcpy(&(dataB->data[bl]), buf, i);
-			dataB->data[bl + i] = '\0';
-			bl += i;
+			if (!pem_reader_decode(pr, &ctx, &done, &dl, i))
+				return 0;
 			if (end) {
-				buf[0] = '\0';
-				i = BIO_gets(bp, buf, 254);
-				if (i <= 0)
-					break;
-
-				while ((i >= 0) && (buf[i] <= ' '))
-					i--;
-				buf[++i] = '\n';
-				buf[++i] = '\0';
-
+				pem_reader_gets(pr);
 				break;
 			}
 		}
 	} else {
-		tmpB = headerB;
-		headerB = dataB;
-		dataB = tmpB;
-		bl = hl;
+		for (; i > 0; i = pem_reader_gets(pr)) {
+			if (strncmp(buf, "-----END ", 9) == 0)
+				break;
+			if (buf[0] == '\n')
+				break;
+			if (!pem_reader_decode(pr, &ctx, &done, &dl, i))
+				return 0;
+		}
 	}
-	i = strlen(nameB->data);
+
+	i = strlen(pr->name->data);
 	if ((strncmp(buf, "-----END ", 9) != 0) ||
-	    (strncmp(nameB->data, &(buf[9]), i) != 0) ||
+	    (strncmp(pr->name->data, &(buf[9]), i) != 0) ||
 	    (strncmp(&(buf[9 + i]), "-----\n", 6) != 0)) {
 		PEMerror(PEM_R_BAD_END_LINE);
-		goto err;
+		return 0;
 	}
 
-	EVP_DecodeInit(&ctx);
-	i = EVP_DecodeUpdate(&ctx,
-	    (unsigned char *)dataB->data, &bl,
-	    (unsigned char *)dataB->data, bl);
-	if (i < 0) {
-		PEMerror(PEM_R_BAD_BASE64_DECODE);
-		goto err;
+	if (!BUF_MEM_grow_clean(pr->data, dl + 80)) {
+		PEMerror(ERR_R_MALLOC_FAILURE);
+		return 0;
 	}
-	i = EVP_DecodeFinal(&ctx, (unsigned char *)&(dataB->data[bl]), &k);
-	if (i < 0) {
+	if (EVP_DecodeFinal(&ctx, (unsigned char *)&pr->data->data[dl],
+	    &k) < 0) {
 		PEMerror(PEM_R_BAD_BASE64_DECODE);
-		goto err;
+		return 0;
 	}
-	bl += k;
+	dl += k;
 
-	if (bl == 0)
-		goto err;
-	*name = nameB->data;
-	*header = headerB->data;
-	*data = (unsigned char *)dataB->data;
-	*len = bl;
-	free(nameB);
-	free(headerB);
-	free(dataB);
-	return (1);
+	if (dl == 0 || dl > LONG_MAX)
+		return 0;
+	*name = pr->name->data;
+	*header = pr->header->data;
+	*data = (unsigned char *)pr->data->data;
+	*len = dl;
 
-err:
-	BUF_MEM_free(nameB);
-	BUF_MEM_free(headerB);
-	BUF_MEM_free(dataB);
-	return (0);
+	return 1;
+}
+
+int
+PEM_read_bio(BIO *bp, char **name, char **header, unsigned char **data,
+    long *len)
+{
+	struct pem_reader pr;
+	int ret = 0;
+
+	if (!pem_reader_init(&pr, bp)) {
+		PEMerror(ERR_R_MALLOC_FAILURE);
+		return (0);
+	}
+	if (pem_reader_next(&pr, name, header, data, len)) {
+		/* Hand the buffers over to the caller. */
+		pr.name->data = NULL;
+		pr.header->data = NULL;
+		pr.data->data = NULL;
+		ret = 1;
+	}
+	pem_reader_cleanup(&pr);
+
+	return (ret);
 }
 
 /* Check pem string and return prefix length.
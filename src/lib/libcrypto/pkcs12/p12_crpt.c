@@ -62,6 +62,8 @@
 #include <openssl/err.h>
 #include <openssl/pkcs12.h>
 
+#include "pkcs12_locl.h"
+
 /* PKCS#12 PBE algorithms now in static table */
 
 void
@@ -72,6 +74,15 @@ PKCS12_PBE_add(void)
 int
 PKCS12_PBE_keyivgen(EVP_CIPHER_CTX *ctx, const char *pass, int passlen,
     ASN1_TYPE *param, const EVP_CIPHER *cipher, const EVP_MD *md, int en_de)
+{
+	return pkcs12_pbe_keyivgen_cached(NULL, ctx, pass, passlen, param,
+	    cipher, md, en_de);
+}
+
+int
+pkcs12_pbe_keyivgen_cached(PKCS12_KEY_CACHE *cache, EVP_CIPHER_CTX *ctx,
+    const char *pass, int passlen, ASN1_TYPE *param, const EVP_CIPHER *cipher,
+    const EVP_MD *md, int en_de)
 {
 	PBEPARAM *pbe;
 	int saltlen, iter, ret;
@@ -101,14 +112,14 @@ PKCS12_PBE_keyivgen(EVP_CIPHER_CTX *ctx, const char *pass, int passlen,
 	}
 	salt = pbe->salt->data;
 	saltlen = pbe->salt->length;
-	if (!PKCS12_key_gen(pass, passlen, salt, saltlen, PKCS12_KEY_ID,
-	    iter, EVP_CIPHER_key_length(cipher), key, md)) {
+	if (!pkcs12_key_gen_cached(cache, pass, passlen, salt, saltlen,
+	    PKCS12_KEY_ID, iter, EVP_CIPHER_key_length(cipher), key, md)) {
 		PKCS12error(PKCS12_R_KEY_GEN_ERROR);
 		PBEPARAM_free(pbe);
 		return 0;
 	}
-	if (!PKCS12_key_gen(pass, passlen, salt, saltlen, PKCS12_IV_ID,
-	    iter, EVP_CIPHER_iv_length(cipher), iv, md)) {
+	if (!pkcs12_key_gen_cached(cache, pass, passlen, salt, saltlen,
+	    PKCS12_IV_ID, iter, EVP_CIPHER_iv_length(cipher), iv, md)) {
 		PKCS12error(PKCS12_R_IV_GEN_ERROR);
 		PBEPARAM_free(pbe);
 		return 0;
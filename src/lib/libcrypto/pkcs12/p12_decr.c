@@ -62,6 +62,43 @@
 #include <openssl/err.h>
 #include <openssl/pkcs12.h>
 
+#include "pkcs12_locl.h"
+
+/*
+ * EVP_PBE_CipherInit(), with the keys of the PKCS#12 PBE algorithms taken
+ * from the cache.
+ */
+static int
+pkcs12_pbe_cipher_init(PKCS12_KEY_CACHE *cache, const X509_ALGOR *algor,
+    const char *pass, int passlen, EVP_CIPHER_CTX *ctx, int en_de)
+{
+	const EVP_CIPHER *cipher;
+	const EVP_MD *md;
+	int cipher_nid, md_nid;
+	EVP_PBE_KEYGEN *keygen;
+
+	if (cache == NULL || !EVP_PBE_find(EVP_PBE_TYPE_OUTER,
+	    OBJ_obj2nid(algor->algorithm), &cipher_nid, &md_nid, &keygen) ||
+	    keygen != PKCS12_PBE_keyivgen || cipher_nid == -1 || md_nid == -1)
+		return EVP_PBE_CipherInit(algor->algorithm, pass, passlen,
+		    algor->parameter, ctx, en_de);
+
+	if ((cipher = EVP_get_cipherbynid(cipher_nid)) == NULL) {
+		EVPerror(EVP_R_UNKNOWN_CIPHER);
+		return 0;
+	}
+	if ((md = EVP_get_digestbynid(md_nid)) == NULL) {
+		EVPerror(EVP_R_UNKNOWN_DIGEST);
+		return 0;
+	}
+	if (!pkcs12_pbe_keyivgen_cached(cache, ctx, pass, passlen,
+	    algor->parameter, cipher, md, en_de)) {
+		EVPerror(EVP_R_KEYGEN_FAILURE);
+		return 0;
+	}
+	return 1;
+}
+
 /* Encrypt/Decrypt a buffer based on password and algor, result in a
  * malloc'ed buffer
  */
@@ -70,6 +107,15 @@ unsigned char *
 PKCS12_pbe_crypt(const X509_ALGOR *algor, const char *pass, int passlen,
     const unsigned char *in, int inlen, unsigned char **data, int *datalen,
     int en_de)
+{
+	return pkcs12_pbe_crypt_cached(NULL, algor, pass, passlen, in, inlen,
+	    data, datalen, en_de);
+}
+
+unsigned char *
+pkcs12_pbe_crypt_cached(PKCS12_KEY_CACHE *cache, const X509_ALGOR *algor,
+    const char *pass, int passlen, const unsigned char *in, int inlen,
+    unsigned char **data, int *datalen, int en_de)
 {
 	unsigned char *out;
 	int outlen, i;
@@ -77,8 +123,8 @@ PKCS12_pbe_crypt(const X509_ALGOR *algor, const char *pass, int passlen,
 
 	EVP_CIPHER_CTX_init(&ctx);
 	/* Decrypt data */
-	if (!EVP_PBE_CipherInit(algor->algorithm, pass, passlen,
-	    algor->parameter, &ctx, en_de)) {
+	if (!pkcs12_pbe_cipher_init(cache, algor, pass, passlen, &ctx,
+	    en_de)) {
 		out = NULL;
 		PKCS12error(PKCS12_R_PKCS12_ALGOR_CIPHERINIT_ERROR);
 		goto err;
@@ -122,14 +168,23 @@ err:
 void *
 PKCS12_item_decrypt_d2i(const X509_ALGOR *algor, const ASN1_ITEM *it,
     const char *pass, int passlen, const ASN1_OCTET_STRING *oct, int zbuf)
+{
+	return pkcs12_item_decrypt_d2i_cached(NULL, algor, it, pass, passlen,
+	    oct, zbuf);
+}
+
+void *
+pkcs12_item_decrypt_d2i_cached(PKCS12_KEY_CACHE *cache,
+    const X509_ALGOR *algor, const ASN1_ITEM *it, const char *pass,
+    int passlen, const ASN1_OCTET_STRING *oct, int zbuf)
 {
 	unsigned char *out;
 	const unsigned char *p;
 	void *ret;
 	int outlen;
 
-	if (!PKCS12_pbe_crypt(algor, pass, passlen, oct->data, oct->length,
-	    &out, &outlen, 0)) {
+	if (!pkcs12_pbe_crypt_cached(cache, algor, pass, passlen, oct->data,
+	    oct->length, &out, &outlen, 0)) {
 		PKCS12error(PKCS12_R_PKCS12_PBE_CRYPT_ERROR);
 		return NULL;
 	}
@@ -57,12 +57,15 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <openssl/bn.h>
 #include <openssl/err.h>
 #include <openssl/pkcs12.h>
 
+#include "pkcs12_locl.h"
+
 /* PKCS12 compatible key/IV generation */
 #ifndef min
 #define min(a,b) ((a) < (b) ? (a) : (b))
@@ -195,3 +198,101 @@ end:
 	EVP_MD_CTX_cleanup(&ctx);
 	return ret;
 }
+
+struct pkcs12_key_cache_entry {
+	struct pkcs12_key_cache_entry *next;
+	size_t size;
+	int has_pass;
+	int passlen;
+	int saltlen;
+	int id;
+	int iter;
+	int n;
+	const EVP_MD *md_type;
+	/* Followed by the password, the salt and the key. */
+};
+
+struct pkcs12_key_cache_st {
+	struct pkcs12_key_cache_entry *entries;
+};
+
+PKCS12_KEY_CACHE *
+pkcs12_key_cache_new(void)
+{
+	return calloc(1, sizeof(PKCS12_KEY_CACHE));
+}
+
+void
+pkcs12_key_cache_free(PKCS12_KEY_CACHE *cache)
+{
+	struct pkcs12_key_cache_entry *entry;
+
+	if (cache == NULL)
+		return;
+
+	while ((entry = cache->entries) != NULL) {
+		cache->entries = entry->next;
+		freezero(entry, entry->size);
+	}
+	free(cache);
+}
+
+int
+pkcs12_key_gen_cached(PKCS12_KEY_CACHE *cache, const char *pass, int passlen,
+    unsigned char *salt, int saltlen, int id, int iter, int n,
+    unsigned char *out, const EVP_MD *md_type)
+{
+	struct pkcs12_key_cache_entry *entry;
+	unsigned char *p;
+	size_t size;
+
+	if (pass == NULL)
+		passlen = 0;
+	else if (passlen == -1)
+		passlen = strlen(pass);
+
+	if (cache == NULL || passlen < 0 || saltlen < 0 || n <= 0)
+		return PKCS12_key_gen(pass, passlen, salt, saltlen, id, iter,
+		    n, out, md_type);
+
+	for (entry = cache->entries; entry != NULL; entry = entry->next) {
+		p = (unsigned char *)(entry + 1);
+		if (entry->has_pass != (pass != NULL) ||
+		    entry->passlen != passlen || entry->saltlen != saltlen ||
+		    entry->id != id || entry->iter != iter || entry->n != n ||
+		    entry->md_type != md_type)
+			continue;
+		if (timingsafe_bcmp(p, pass, passlen) != 0 ||
+		    memcmp(p + passlen, salt, saltlen) != 0)
+			continue;
+		memcpy(out, p + passlen + saltlen, n);
+		return 1;
+	}
+
+	if (!PKCS12_key_gen(pass, passlen, salt, saltlen, id, iter, n, out,
+	    md_type))
+		return 0;
+
+	/* Failing to remember the key only costs another derivation. */
+	size = sizeof(*entry) + (size_t)passlen + saltlen + n;
+	if ((entry = calloc(1, size)) == NULL)
+		return 1;
+	entry->size = size;
+	entry->has_pass = pass != NULL;
+	entry->passlen = passlen;
+	entry->saltlen = saltlen;
+	entry->id = id;
+	entry->iter = iter;
+	entry->n = n;
+	entry->md_type = md_type;
+	p = (unsigned char *)(entry + 1);
+	if (passlen > 0)
+		memcpy(p, pass, passlen);
+	if (saltlen > 0)
+		memcpy(p + passlen, salt, saltlen);
+	memcpy(p + passlen + saltlen, out, n);
+	entry->next = cache->entries;
+	cache->entries = entry;
+
+	return 1;
+}
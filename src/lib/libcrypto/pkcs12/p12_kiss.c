@@ -61,16 +61,18 @@
 #include <openssl/err.h>
 #include <openssl/pkcs12.h>
 
-/* Simplified PKCS#12 routines */
+#include "pkcs12_locl.h"
 
-static int parse_pk12( PKCS12 *p12, const char *pass, int passlen,
-    EVP_PKEY **pkey, STACK_OF(X509) *ocerts);
+/* Simplified PKCS#12 routines */
 
-static int parse_bags( STACK_OF(PKCS12_SAFEBAG) *bags, const char *pass,
+static int parse_pk12(PKCS12 *p12, PKCS12_KEY_CACHE *cache, const char *pass,
     int passlen, EVP_PKEY **pkey, STACK_OF(X509) *ocerts);
 
-static int parse_bag( PKCS12_SAFEBAG *bag, const char *pass, int passlen,
-    EVP_PKEY **pkey, STACK_OF(X509) *ocerts);
+static int parse_bags(STACK_OF(PKCS12_SAFEBAG) *bags, PKCS12_KEY_CACHE *cache,
+    const char *pass, int passlen, EVP_PKEY **pkey, STACK_OF(X509) *ocerts);
+
+static int parse_bag(PKCS12_SAFEBAG *bag, PKCS12_KEY_CACHE *cache,
+    const char *pass, int passlen, EVP_PKEY **pkey, STACK_OF(X509) *ocerts);
 
 /* Parse and decrypt a PKCS#12 structure returning user key, user cert
  * and other (CA) certs. Note either ca should be NULL, *ca should be NULL,
@@ -83,6 +85,7 @@ PKCS12_parse(PKCS12 *p12, const char *pass, EVP_PKEY **pkey, X509 **cert,
     STACK_OF(X509) **ca)
 {
 	STACK_OF(X509) *ocerts = NULL;
+	PKCS12_KEY_CACHE *cache = NULL;
 	X509 *x = NULL;
 	/* Check for NULL PKCS12 structure */
 
@@ -125,7 +128,13 @@ PKCS12_parse(PKCS12 *p12, const char *pass, EVP_PKEY **pkey, X509 **cert,
 		return 0;
 	}
 
-	if (!parse_pk12(p12, pass, -1, pkey, ocerts)) {
+	/* Bags encrypted with the same salt only need one key derivation. */
+	if ((cache = pkcs12_key_cache_new()) == NULL) {
+		PKCS12error(ERR_R_MALLOC_FAILURE);
+		goto err;
+	}
+
+	if (!parse_pk12(p12, cache, pass, -1, pkey, ocerts)) {
 		PKCS12error(PKCS12_R_PARSE_ERROR);
 		goto err;
 	}
@@ -154,6 +163,7 @@ PKCS12_parse(PKCS12 *p12, const char *pass, EVP_PKEY **pkey, X509 **cert,
 
 	if (ocerts)
 		sk_X509_pop_free(ocerts, X509_free);
+	pkcs12_key_cache_free(cache);
 
 	return 1;
 
@@ -165,14 +175,15 @@ err:
 	X509_free(x);
 	if (ocerts)
 		sk_X509_pop_free(ocerts, X509_free);
+	pkcs12_key_cache_free(cache);
 	return 0;
 }
 
 /* Parse the outer PKCS#12 structure */
 
 static int
-parse_pk12(PKCS12 *p12, const char *pass, int passlen, EVP_PKEY **pkey,
-    STACK_OF(X509) *ocerts)
+parse_pk12(PKCS12 *p12, PKCS12_KEY_CACHE *cache, const char *pass, int passlen,
+    EVP_PKEY **pkey, STACK_OF(X509) *ocerts)
 {
 	STACK_OF(PKCS7) *asafes;
 	STACK_OF(PKCS12_SAFEBAG) *bags;
@@ -187,14 +198,17 @@ parse_pk12(PKCS12 *p12, const char *pass, int passlen, EVP_PKEY **pkey,
 		if (bagnid == NID_pkcs7_data) {
 			bags = PKCS12_unpack_p7data(p7);
 		} else if (bagnid == NID_pkcs7_encrypted) {
-			bags = PKCS12_unpack_p7encdata(p7, pass, passlen);
+			bags = pkcs12_item_decrypt_d2i_cached(cache,
+			    p7->d.encrypted->enc_data->algorithm,
+			    &PKCS12_SAFEBAGS_it, pass, passlen,
+			    p7->d.encrypted->enc_data->enc_data, 1);
 		} else
 			continue;
 		if (!bags) {
 			sk_PKCS7_pop_free(asafes, PKCS7_free);
 			return 0;
 		}
-		if (!parse_bags(bags, pass, passlen, pkey, ocerts)) {
+		if (!parse_bags(bags, cache, pass, passlen, pkey, ocerts)) {
 			sk_PKCS12_SAFEBAG_pop_free(bags, PKCS12_SAFEBAG_free);
 			sk_PKCS7_pop_free(asafes, PKCS7_free);
 			return 0;
@@ -206,22 +220,22 @@ parse_pk12(PKCS12 *p12, const char *pass, int passlen, EVP_PKEY **pkey,
 }
 
 static int
-parse_bags(STACK_OF(PKCS12_SAFEBAG) *bags, const char *pass, int passlen,
-    EVP_PKEY **pkey, STACK_OF(X509) *ocerts)
+parse_bags(STACK_OF(PKCS12_SAFEBAG) *bags, PKCS12_KEY_CACHE *cache,
+    const char *pass, int passlen, EVP_PKEY **pkey, STACK_OF(X509) *ocerts)
 {
 	int i;
 
 	for (i = 0; i < sk_PKCS12_SAFEBAG_num(bags); i++) {
-		if (!parse_bag(sk_PKCS12_SAFEBAG_value(bags, i), pass, passlen,
-		    pkey, ocerts))
+		if (!parse_bag(sk_PKCS12_SAFEBAG_value(bags, i), cache, pass,
+		    passlen, pkey, ocerts))
 			return 0;
 	}
 	return 1;
 }
 
 static int
-parse_bag(PKCS12_SAFEBAG *bag, const char *pass, int passlen, EVP_PKEY **pkey,
-    STACK_OF(X509) *ocerts)
+parse_bag(PKCS12_SAFEBAG *bag, PKCS12_KEY_CACHE *cache, const char *pass,
+    int passlen, EVP_PKEY **pkey, STACK_OF(X509) *ocerts)
 {
 	PKCS8_PRIV_KEY_INFO *p8;
 	X509 *x509;
@@ -246,7 +260,9 @@ parse_bag(PKCS12_SAFEBAG *bag, const char *pass, int passlen, EVP_PKEY **pkey,
 	case NID_pkcs8ShroudedKeyBag:
 		if (!pkey || *pkey)
 			return 1;
-		if (!(p8 = PKCS12_decrypt_skey(bag, pass, passlen)))
+		if (!(p8 = pkcs12_item_decrypt_d2i_cached(cache,
+		    bag->value.shkeybag->algor, &PKCS8_PRIV_KEY_INFO_it, pass,
+		    passlen, bag->value.shkeybag->digest, 1)))
 			return 0;
 		*pkey = EVP_PKCS82PKEY(p8);
 		PKCS8_PRIV_KEY_INFO_free(p8);
@@ -285,7 +301,7 @@ parse_bag(PKCS12_SAFEBAG *bag, const char *pass, int passlen, EVP_PKEY **pkey,
 		break;
 
 	case NID_safeContentsBag:
-		return parse_bags(bag->value.safes, pass, passlen,
+		return parse_bags(bag->value.safes, cache, pass, passlen,
 		    pkey, ocerts);
 		break;
 
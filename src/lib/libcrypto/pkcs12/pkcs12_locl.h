@@ -0,0 +1,53 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef HEADER_PKCS12_LOCL_H
+#define HEADER_PKCS12_LOCL_H
+
+#include <openssl/evp.h>
+#include <openssl/pkcs12.h>
+
+__BEGIN_HIDDEN_DECLS
+
+/*
+ * Keys derived with the PKCS#12 KDF while a single PKCS#12 structure is
+ * processed, so that the KDF runs only once for each password, salt,
+ * iteration count, ID, key length and digest. A NULL cache derives every
+ * key afresh.
+ */
+typedef struct pkcs12_key_cache_st PKCS12_KEY_CACHE;
+
+PKCS12_KEY_CACHE *pkcs12_key_cache_new(void);
+void pkcs12_key_cache_free(PKCS12_KEY_CACHE *cache);
+
+int pkcs12_key_gen_cached(PKCS12_KEY_CACHE *cache, const char *pass,
+    int passlen, unsigned char *salt, int saltlen, int id, int iter, int n,
+    unsigned char *out, const EVP_MD *md_type);
+int pkcs12_pbe_keyivgen_cached(PKCS12_KEY_CACHE *cache, EVP_CIPHER_CTX *ctx,
+    const char *pass, int passlen, ASN1_TYPE *param, const EVP_CIPHER *cipher,
+    const EVP_MD *md, int en_de);
+unsigned char *pkcs12_pbe_crypt_cached(PKCS12_KEY_CACHE *cache,
+    const X509_ALGOR *algor, const char *pass, int passlen,
+    const unsigned char *in, int inlen, unsigned char **data, int *datalen,
+    int en_de);
+void *pkcs12_item_decrypt_d2i_cached(PKCS12_KEY_CACHE *cache,
+    const X509_ALGOR *algor, const ASN1_ITEM *it, const char *pass,
+    int passlen, const ASN1_OCTET_STRING *oct, int zbuf);
+
+__END_HIDDEN_DECLS
+
+#endif /* !HEADER_PKCS12_LOCL_H */
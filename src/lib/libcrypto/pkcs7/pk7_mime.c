@@ -96,3 +96,9 @@ SMIME_read_PKCS7(BIO *bio, BIO **bcont)
 {
 	return (PKCS7 *)SMIME_read_ASN1(bio, bcont, &PKCS7_it);
 }
+
+PKCS7 *
+SMIME_read_PKCS7_stream(BIO *bio, BIO **bcont)
+{
+	return (PKCS7 *)SMIME_read_ASN1_stream(bio, bcont, &PKCS7_it);
+}
@@ -6,6 +6,8 @@
  */
 
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 
 static inline void poly1305_init(poly1305_context *ctx,
     const unsigned char key[32]);
@@ -173,6 +175,429 @@ poly1305_blocks(poly1305_state_internal_t *st, const unsigned char *m, size_t by
 	st->h[4] = h4;
 }
 
+/*
+ * Multi-block implementations, which process four blocks per step using
+ * 32 bit * 32 bit = 64 bit vector multiplication. Each lane accumulates
+ * every fourth block, multiplying by r^4 at each step - once all blocks are
+ * absorbed, the lanes are multiplied by r^4, r^3, r^2 and r respectively and
+ * summed, which gives the same result as processing the blocks in sequence.
+ * The powers of r are computed for each run of blocks, since there is no
+ * room to keep them in the context.
+ */
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5)
+#if defined(__x86_64__)
+#include <immintrin.h>
+#include <openssl/crypto.h>
+#include "x86_arch.h"
+#define POLY1305_VEC
+#define POLY1305_VEC_AVX2
+#elif defined(__aarch64__) && defined(__AARCH64EL__) && \
+    defined(OPENSSL_CPUID_OBJ)
+#include <arm_neon.h>
+#include "arm_arch.h"
+#define POLY1305_VEC
+#define POLY1305_VEC_NEON
+#endif
+#endif
+
+#ifdef POLY1305_VEC
+#define poly1305_vec_block_size (4 * poly1305_block_size)
+
+/* Only use the multi-block implementations for runs of at least 16 blocks. */
+#define poly1305_vec_min_bytes (4 * poly1305_vec_block_size)
+
+/* h = d % p, partially reduced */
+static void
+poly1305_carry(unsigned long h[5], unsigned long long d[5])
+{
+	unsigned long c;
+
+	c = (unsigned long)(d[0] >> 26);
+	h[0] = (unsigned long)d[0] & 0x3ffffff;
+	d[1] += c;
+	c = (unsigned long)(d[1] >> 26);
+	h[1] = (unsigned long)d[1] & 0x3ffffff;
+	d[2] += c;
+	c = (unsigned long)(d[2] >> 26);
+	h[2] = (unsigned long)d[2] & 0x3ffffff;
+	d[3] += c;
+	c = (unsigned long)(d[3] >> 26);
+	h[3] = (unsigned long)d[3] & 0x3ffffff;
+	d[4] += c;
+	c = (unsigned long)(d[4] >> 26);
+	h[4] = (unsigned long)d[4] & 0x3ffffff;
+	h[0] += c * 5;
+	c = (h[0] >> 26);
+	h[0] = h[0] & 0x3ffffff;
+	h[1] += c;
+}
+
+/* h = (a * b) % p, partially reduced */
+static void
+poly1305_mul(unsigned long h[5], const unsigned long a[5],
+    const unsigned long b[5])
+{
+	unsigned long long d[5];
+	unsigned long s1, s2, s3, s4;
+
+	s1 = b[1] * 5;
+	s2 = b[2] * 5;
+	s3 = b[3] * 5;
+	s4 = b[4] * 5;
+
+	d[0] = ((unsigned long long)a[0] * b[0]) +
+	    ((unsigned long long)a[1] * s4) +
+	    ((unsigned long long)a[2] * s3) +
+	    ((unsigned long long)a[3] * s2) +
+	    ((unsigned long long)a[4] * s1);
+	d[1] = ((unsigned long long)a[0] * b[1]) +
+	    ((unsigned long long)a[1] * b[0]) +
+	    ((unsigned long long)a[2] * s4) +
+	    ((unsigned long long)a[3] * s3) +
+	    ((unsigned long long)a[4] * s2);
+	d[2] = ((unsigned long long)a[0] * b[2]) +
+	    ((unsigned long long)a[1] * b[1]) +
+	    ((unsigned long long)a[2] * b[0]) +
+	    ((unsigned long long)a[3] * s4) +
+	    ((unsigned long long)a[4] * s3);
+	d[3] = ((unsigned long long)a[0] * b[3]) +
+	    ((unsigned long long)a[1] * b[2]) +
+	    ((unsigned long long)a[2] * b[1]) +
+	    ((unsigned long long)a[3] * b[0]) +
+	    ((unsigned long long)a[4] * s4);
+	d[4] = ((unsigned long long)a[0] * b[4]) +
+	    ((unsigned long long)a[1] * b[3]) +
+	    ((unsigned long long)a[2] * b[2]) +
+	    ((unsigned long long)a[3] * b[1]) +
+	    ((unsigned long long)a[4] * b[0]);
+
+	poly1305_carry(h, d);
+}
+
+/* rp[i] = r^(4 - i), for lanes 0 to 3 */
+static void
+poly1305_powers(poly1305_state_internal_t *st, unsigned long rp[4][5])
+{
+	memcpy(rp[3], st->r, sizeof(rp[3]));
+	poly1305_mul(rp[2], rp[3], rp[3]);
+	poly1305_mul(rp[1], rp[2], rp[3]);
+	poly1305_mul(rp[0], rp[1], rp[3]);
+}
+
+/* h = sum(d[0..3]) % p, partially reduced */
+static void
+poly1305_vec_sum(poly1305_state_internal_t *st, uint64_t d[5][4])
+{
+	unsigned long long sum[5];
+	int i;
+
+	for (i = 0; i < 5; i++)
+		sum[i] = d[i][0] + d[i][1] + d[i][2] + d[i][3];
+
+	poly1305_carry(st->h, sum);
+}
+#endif
+
+#ifdef POLY1305_VEC_AVX2
+/* Load four blocks, as 26 bit limbs with one block per 64 bit lane. */
+#define POLY1305_AVX2_LOAD(m, t) do { \
+	__m256i x, y, lo, hi; \
+	x = _mm256_loadu_si256((const __m256i *)(m)); \
+	y = _mm256_loadu_si256((const __m256i *)((m) + 32)); \
+	lo = _mm256_permute4x64_epi64(_mm256_unpacklo_epi64(x, y), \
+	    _MM_SHUFFLE(3, 1, 2, 0)); \
+	hi = _mm256_permute4x64_epi64(_mm256_unpackhi_epi64(x, y), \
+	    _MM_SHUFFLE(3, 1, 2, 0)); \
+	t[0] = _mm256_and_si256(lo, mask); \
+	t[1] = _mm256_and_si256(_mm256_srli_epi64(lo, 26), mask); \
+	t[2] = _mm256_and_si256(_mm256_or_si256(_mm256_srli_epi64(lo, 52), \
+	    _mm256_slli_epi64(hi, 12)), mask); \
+	t[3] = _mm256_and_si256(_mm256_srli_epi64(hi, 14), mask); \
+	t[4] = _mm256_or_si256(_mm256_srli_epi64(hi, 40), hibit); \
+} while (0)
+
+#define POLY1305_AVX2_MUL(d, a, r, s) do { \
+	d[0] = _mm256_add_epi64(_mm256_add_epi64( \
+	    _mm256_add_epi64(_mm256_mul_epu32(a[0], r[0]), \
+	    _mm256_mul_epu32(a[1], s[4])), \
+	    _mm256_add_epi64(_mm256_mul_epu32(a[2], s[3]), \
+	    _mm256_mul_epu32(a[3], s[2]))), _mm256_mul_epu32(a[4], s[1])); \
+	d[1] = _mm256_add_epi64(_mm256_add_epi64( \
+	    _mm256_add_epi64(_mm256_mul_epu32(a[0], r[1]), \
+	    _mm256_mul_epu32(a[1], r[0])), \
+	    _mm256_add_epi64(_mm256_mul_epu32(a[2], s[4]), \
+	    _mm256_mul_epu32(a[3], s[3]))), _mm256_mul_epu32(a[4], s[2])); \
+	d[2] = _mm256_add_epi64(_mm256_add_epi64( \
+	    _mm256_add_epi64(_mm256_mul_epu32(a[0], r[2]), \
+	    _mm256_mul_epu32(a[1], r[1])), \
+	    _mm256_add_epi64(_mm256_mul_epu32(a[2], r[0]), \
+	    _mm256_mul_epu32(a[3], s[4]))), _mm256_mul_epu32(a[4], s[3])); \
+	d[3] = _mm256_add_epi64(_mm256_add_epi64( \
+	    _mm256_add_epi64(_mm256_mul_epu32(a[0], r[3]), \
+	    _mm256_mul_epu32(a[1], r[2])), \
+	    _mm256_add_epi64(_mm256_mul_epu32(a[2], r[1]), \
+	    _mm256_mul_epu32(a[3], r[0]))), _mm256_mul_epu32(a[4], s[4])); \
+	d[4] = _mm256_add_epi64(_mm256_add_epi64( \
+	    _mm256_add_epi64(_mm256_mul_epu32(a[0], r[4]), \
+	    _mm256_mul_epu32(a[1], r[3])), \
+	    _mm256_add_epi64(_mm256_mul_epu32(a[2], r[2]), \
+	    _mm256_mul_epu32(a[3], r[1]))), _mm256_mul_epu32(a[4], r[0])); \
+} while (0)
+
+static void __attribute__((__target__("avx2")))
+poly1305_blocks_avx2(poly1305_state_internal_t *st, const unsigned char *m,
+    size_t bytes)
+{
+	unsigned long rp[4][5];
+	__m256i mask, hibit, c;
+	__m256i r[5], s[5], a[5], t[5], d[5];
+	uint64_t dl[5][4];
+	int i;
+
+	mask = _mm256_set1_epi64x(0x3ffffff);
+	hibit = _mm256_set1_epi64x(1 << 24);
+
+	poly1305_powers(st, rp);
+
+	for (i = 0; i < 5; i++) {
+		r[i] = _mm256_set1_epi64x(rp[0][i]);
+		s[i] = _mm256_set1_epi64x(rp[0][i] * 5);
+	}
+
+	/* a = m[0..3], with h added to the first lane */
+	POLY1305_AVX2_LOAD(m, a);
+	for (i = 0; i < 5; i++)
+		a[i] = _mm256_add_epi64(a[i], _mm256_set_epi64x(0, 0, 0,
+		    st->h[i]));
+	m += poly1305_vec_block_size;
+	bytes -= poly1305_vec_block_size;
+
+	while (bytes >= poly1305_vec_block_size) {
+		/* a *= r^4 */
+		POLY1305_AVX2_MUL(d, a, r, s);
+
+		/* (partial) a %= p */
+		c = _mm256_srli_epi64(d[0], 26);
+		a[0] = _mm256_and_si256(d[0], mask);
+		d[1] = _mm256_add_epi64(d[1], c);
+		c = _mm256_srli_epi64(d[1], 26);
+		a[1] = _mm256_and_si256(d[1], mask);
+		d[2] = _mm256_add_epi64(d[2], c);
+		c = _mm256_srli_epi64(d[2], 26);
+		a[2] = _mm256_and_si256(d[2], mask);
+		d[3] = _mm256_add_epi64(d[3], c);
+		c = _mm256_srli_epi64(d[3], 26);
+		a[3] = _mm256_and_si256(d[3], mask);
+		d[4] = _mm256_add_epi64(d[4], c);
+		c = _mm256_srli_epi64(d[4], 26);
+		a[4] = _mm256_and_si256(d[4], mask);
+		a[0] = _mm256_add_epi64(a[0],
+		    _mm256_add_epi64(c, _mm256_slli_epi64(c, 2)));
+		c = _mm256_srli_epi64(a[0], 26);
+		a[0] = _mm256_and_si256(a[0], mask);
+		a[1] = _mm256_add_epi64(a[1], c);
+
+		/* a += m[i..i+3] */
+		POLY1305_AVX2_LOAD(m, t);
+		for (i = 0; i < 5; i++)
+			a[i] = _mm256_add_epi64(a[i], t[i]);
+
+		m += poly1305_vec_block_size;
+		bytes -= poly1305_vec_block_size;
+	}
+
+	/* h = a[0] * r^4 + a[1] * r^3 + a[2] * r^2 + a[3] * r */
+	for (i = 0; i < 5; i++) {
+		r[i] = _mm256_set_epi64x(rp[3][i], rp[2][i], rp[1][i],
+		    rp[0][i]);
+		s[i] = _mm256_set_epi64x(rp[3][i] * 5, rp[2][i] * 5,
+		    rp[1][i] * 5, rp[0][i] * 5);
+	}
+	POLY1305_AVX2_MUL(d, a, r, s);
+	for (i = 0; i < 5; i++)
+		_mm256_storeu_si256((__m256i *)dl[i], d[i]);
+
+	poly1305_vec_sum(st, dl);
+
+	explicit_bzero(rp, sizeof(rp));
+	explicit_bzero(dl, sizeof(dl));
+}
+#endif
+
+#ifdef POLY1305_VEC_NEON
+/* Multiply the low and high pairs of 32 bit lanes, into 64 bit lanes. */
+#define POLY1305_NEON_MUL1(lo, hi, a, b) do { \
+	lo = vmull_u32(vget_low_u32(a), vget_low_u32(b)); \
+	hi = vmull_high_u32(a, b); \
+} while (0)
+#define POLY1305_NEON_MLA(lo, hi, a, b) do { \
+	lo = vmlal_u32(lo, vget_low_u32(a), vget_low_u32(b)); \
+	hi = vmlal_high_u32(hi, a, b); \
+} while (0)
+
+#define POLY1305_NEON_MUL(dl, dh, a, r, s) do { \
+	POLY1305_NEON_MUL1(dl[0], dh[0], a[0], r[0]); \
+	POLY1305_NEON_MLA(dl[0], dh[0], a[1], s[4]); \
+	POLY1305_NEON_MLA(dl[0], dh[0], a[2], s[3]); \
+	POLY1305_NEON_MLA(dl[0], dh[0], a[3], s[2]); \
+	POLY1305_NEON_MLA(dl[0], dh[0], a[4], s[1]); \
+	POLY1305_NEON_MUL1(dl[1], dh[1], a[0], r[1]); \
+	POLY1305_NEON_MLA(dl[1], dh[1], a[1], r[0]); \
+	POLY1305_NEON_MLA(dl[1], dh[1], a[2], s[4]); \
+	POLY1305_NEON_MLA(dl[1], dh[1], a[3], s[3]); \
+	POLY1305_NEON_MLA(dl[1], dh[1], a[4], s[2]); \
+	POLY1305_NEON_MUL1(dl[2], dh[2], a[0], r[2]); \
+	POLY1305_NEON_MLA(dl[2], dh[2], a[1], r[1]); \
+	POLY1305_NEON_MLA(dl[2], dh[2], a[2], r[0]); \
+	POLY1305_NEON_MLA(dl[2], dh[2], a[3], s[4]); \
+	POLY1305_NEON_MLA(dl[2], dh[2], a[4], s[3]); \
+	POLY1305_NEON_MUL1(dl[3], dh[3], a[0], r[3]); \
+	POLY1305_NEON_MLA(dl[3], dh[3], a[1], r[2]); \
+	POLY1305_NEON_MLA(dl[3], dh[3], a[2], r[1]); \
+	POLY1305_NEON_MLA(dl[3], dh[3], a[3], r[0]); \
+	POLY1305_NEON_MLA(dl[3], dh[3], a[4], s[4]); \
+	POLY1305_NEON_MUL1(dl[4], dh[4], a[0], r[4]); \
+	POLY1305_NEON_MLA(dl[4], dh[4], a[1], r[3]); \
+	POLY1305_NEON_MLA(dl[4], dh[4], a[2], r[2]); \
+	POLY1305_NEON_MLA(dl[4], dh[4], a[3], r[1]); \
+	POLY1305_NEON_MLA(dl[4], dh[4], a[4], r[0]); \
+} while (0)
+
+/* Load four blocks, as 26 bit limbs with one block per 32 bit lane. */
+#define POLY1305_NEON_LOAD(m, t) do { \
+	uint32x4x4_t w = vld4q_u32((const uint32_t *)(m)); \
+	t[0] = vandq_u32(w.val[0], mask); \
+	t[1] = vandq_u32(vorrq_u32(vshrq_n_u32(w.val[0], 26), \
+	    vshlq_n_u32(w.val[1], 6)), mask); \
+	t[2] = vandq_u32(vorrq_u32(vshrq_n_u32(w.val[1], 20), \
+	    vshlq_n_u32(w.val[2], 12)), mask); \
+	t[3] = vandq_u32(vorrq_u32(vshrq_n_u32(w.val[2], 14), \
+	    vshlq_n_u32(w.val[3], 18)), mask); \
+	t[4] = vorrq_u32(vshrq_n_u32(w.val[3], 8), hibit); \
+} while (0)
+
+static void
+poly1305_blocks_neon(poly1305_state_internal_t *st, const unsigned char *m,
+    size_t bytes)
+{
+	unsigned long rp[4][5];
+	uint32_t lanes[4];
+	uint32x4_t mask, hibit;
+	uint32x4_t r[5], s[5], a[5], t[5];
+	uint64x2_t dl[5], dh[5], mask64, c;
+	uint64_t dv[5][4];
+	int i, j;
+
+	mask = vdupq_n_u32(0x3ffffff);
+	hibit = vdupq_n_u32(1 << 24);
+	mask64 = vdupq_n_u64(0x3ffffff);
+
+	poly1305_powers(st, rp);
+
+	for (i = 0; i < 5; i++) {
+		r[i] = vdupq_n_u32(rp[0][i]);
+		s[i] = vdupq_n_u32(rp[0][i] * 5);
+	}
+
+	/* a = m[0..3], with h added to the first lane */
+	POLY1305_NEON_LOAD(m, a);
+	for (i = 0; i < 5; i++)
+		a[i] = vaddq_u32(a[i], vsetq_lane_u32(st->h[i],
+		    vdupq_n_u32(0), 0));
+	m += poly1305_vec_block_size;
+	bytes -= poly1305_vec_block_size;
+
+	while (bytes >= poly1305_vec_block_size) {
+		/* a *= r^4 */
+		POLY1305_NEON_MUL(dl, dh, a, r, s);
+
+		/* (partial) a %= p */
+		for (i = 0; i < 4; i++) {
+			c = vshrq_n_u64(dl[i], 26);
+			dl[i] = vandq_u64(dl[i], mask64);
+			dl[i + 1] = vaddq_u64(dl[i + 1], c);
+			c = vshrq_n_u64(dh[i], 26);
+			dh[i] = vandq_u64(dh[i], mask64);
+			dh[i + 1] = vaddq_u64(dh[i + 1], c);
+		}
+		c = vshrq_n_u64(dl[4], 26);
+		dl[4] = vandq_u64(dl[4], mask64);
+		dl[0] = vaddq_u64(dl[0], vaddq_u64(c, vshlq_n_u64(c, 2)));
+		c = vshrq_n_u64(dh[4], 26);
+		dh[4] = vandq_u64(dh[4], mask64);
+		dh[0] = vaddq_u64(dh[0], vaddq_u64(c, vshlq_n_u64(c, 2)));
+		c = vshrq_n_u64(dl[0], 26);
+		dl[0] = vandq_u64(dl[0], mask64);
+		dl[1] = vaddq_u64(dl[1], c);
+		c = vshrq_n_u64(dh[0], 26);
+		dh[0] = vandq_u64(dh[0], mask64);
+		dh[1] = vaddq_u64(dh[1], c);
+		for (i = 0; i < 5; i++)
+			a[i] = vcombine_u32(vmovn_u64(dl[i]), vmovn_u64(dh[i]));
+
+		/* a += m[i..i+3] */
+		POLY1305_NEON_LOAD(m, t);
+		for (i = 0; i < 5; i++)
+			a[i] = vaddq_u32(a[i], t[i]);
+
+		m += poly1305_vec_block_size;
+		bytes -= poly1305_vec_block_size;
+	}
+
+	/* h = a[0] * r^4 + a[1] * r^3 + a[2] * r^2 + a[3] * r */
+	for (i = 0; i < 5; i++) {
+		for (j = 0; j < 4; j++)
+			lanes[j] = rp[j][i];
+		r[i] = vld1q_u32(lanes);
+		for (j = 0; j < 4; j++)
+			lanes[j] = rp[j][i] * 5;
+		s[i] = vld1q_u32(lanes);
+	}
+	POLY1305_NEON_MUL(dl, dh, a, r, s);
+	for (i = 0; i < 5; i++) {
+		vst1q_u64(&dv[i][0], dl[i]);
+		vst1q_u64(&dv[i][2], dh[i]);
+	}
+
+	poly1305_vec_sum(st, dv);
+
+	explicit_bzero(rp, sizeof(rp));
+	explicit_bzero(lanes, sizeof(lanes));
+	explicit_bzero(dv, sizeof(dv));
+}
+#endif
+
+#ifdef POLY1305_VEC
+/*
+ * Process as many multiples of four blocks as possible using a multi-block
+ * implementation, returning the number of bytes processed.
+ */
+static size_t
+poly1305_blocks_vec(poly1305_state_internal_t *st, const unsigned char *m,
+    size_t bytes)
+{
+	if (bytes < poly1305_vec_min_bytes)
+		return 0;
+
+	bytes &= ~(poly1305_vec_block_size - 1);
+
+#ifdef POLY1305_VEC_AVX2
+	if ((OPENSSL_cpu_caps() & CPUCAP_MASK_AVX2) != 0) {
+		poly1305_blocks_avx2(st, m, bytes);
+		return bytes;
+	}
+#endif
+#ifdef POLY1305_VEC_NEON
+	if ((OPENSSL_armcap_P & ARMV7_NEON) != 0) {
+		poly1305_blocks_neon(st, m, bytes);
+		return bytes;
+	}
+#endif
+
+	return 0;
+}
+#endif
+
 static inline void
 poly1305_update(poly1305_context *ctx, const unsigned char *m, size_t bytes)
 {
@@ -196,6 +621,13 @@ poly1305_update(poly1305_context *ctx, const unsigned char *m, size_t bytes)
 	}
 
 	/* process full blocks */
+#ifdef POLY1305_VEC
+	if (bytes >= poly1305_vec_min_bytes) {
+		size_t done = poly1305_blocks_vec(st, m, bytes);
+		m += done;
+		bytes -= done;
+	}
+#endif
 	if (bytes >= poly1305_block_size) {
 		size_t want = (bytes & ~(poly1305_block_size - 1));
 		poly1305_blocks(st, m, want);
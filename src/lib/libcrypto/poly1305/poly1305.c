@@ -15,7 +15,11 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <string.h>
+
 #include <openssl/poly1305.h>
+
+#include "cryptlib.h"
 #include "poly1305-donna.c"
 
 void
@@ -36,3 +40,30 @@ CRYPTO_poly1305_finish(poly1305_context *ctx, unsigned char mac[16])
 {
 	poly1305_finish(ctx, mac);
 }
+
+void
+CRYPTO_poly1305(unsigned char mac[16], const unsigned char *in, size_t len,
+    const unsigned char key[32])
+{
+	poly1305_context ctx;
+
+	poly1305_init(&ctx, key);
+	poly1305_update(&ctx, in, len);
+	poly1305_finish(&ctx, mac);
+
+	explicit_bzero(&ctx, sizeof(ctx));
+}
+
+const char *
+poly1305_implementation(void)
+{
+#ifdef POLY1305_VEC_AVX2
+	if ((OPENSSL_cpu_caps() & CPUCAP_MASK_AVX2) != 0)
+		return "avx2";
+#endif
+#ifdef POLY1305_VEC_NEON
+	if ((OPENSSL_armcap_P & ARMV7_NEON) != 0)
+		return "neon";
+#endif
+	return "c";
+}
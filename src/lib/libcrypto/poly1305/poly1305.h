@@ -41,6 +41,8 @@ void CRYPTO_poly1305_init(poly1305_context *ctx, const unsigned char key[32]);
 void CRYPTO_poly1305_update(poly1305_context *ctx, const unsigned char *in,
     size_t len);
 void CRYPTO_poly1305_finish(poly1305_context *ctx, unsigned char mac[16]);
+void CRYPTO_poly1305(unsigned char mac[16], const unsigned char *in,
+    size_t len, const unsigned char key[32]);
 
 #ifdef  __cplusplus
 }
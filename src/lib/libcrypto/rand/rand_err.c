@@ -65,18 +65,20 @@
 #include <openssl/err.h>
 #include <openssl/rand.h>
 
+#include "cryptlib.h"
+
 /* BEGIN ERROR CODES */
 #ifndef OPENSSL_NO_ERR
 
 #define ERR_FUNC(func) ERR_PACK(ERR_LIB_RAND,func,0)
 #define ERR_REASON(reason) ERR_PACK(ERR_LIB_RAND,0,reason)
 
-static ERR_STRING_DATA RAND_str_functs[] = {
+static const ERR_STRING_DATA RAND_str_functs[] = {
 	{ERR_FUNC(0xfff), "CRYPTO_internal"},
 	{0, NULL}
 };
 
-static ERR_STRING_DATA RAND_str_reasons[] = {
+static const ERR_STRING_DATA RAND_str_reasons[] = {
 	{ERR_REASON(RAND_R_DUAL_EC_DRBG_DISABLED), "dual ec drbg disabled"},
 	{ERR_REASON(RAND_R_ERROR_INITIALISING_DRBG), "error initialising drbg"},
 	{ERR_REASON(RAND_R_ERROR_INSTANTIATING_DRBG), "error instantiating drbg"},
@@ -92,8 +94,8 @@ ERR_load_RAND_strings(void)
 {
 #ifndef OPENSSL_NO_ERR
 	if (ERR_func_error_string(RAND_str_functs[0].error) == NULL) {
-		ERR_load_strings(0, RAND_str_functs);
-		ERR_load_strings(0, RAND_str_reasons);
+		ERR_load_const_strings(RAND_str_functs);
+		ERR_load_const_strings(RAND_str_reasons);
 	}
 #endif
 }
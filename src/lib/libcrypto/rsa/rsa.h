@@ -174,7 +174,8 @@ struct rsa_st {
 	/* all BIGNUM values are actually in the following data, if it is not
 	 * NULL */
 	BN_BLINDING *blinding;
-	BN_BLINDING *mt_blinding;
+	BN_BLINDING *mt_blinding;		/* unused */
+	BN_BLINDING **blinding_pool;
 };
 
 #ifndef OPENSSL_RSA_MAX_MODULUS_BITS
@@ -326,6 +327,8 @@ RSA *RSA_generate_key(int bits, unsigned long e,
 
 /* New version */
 int RSA_generate_key_ex(RSA *rsa, int bits, BIGNUM *e, BN_GENCB *cb);
+int RSA_generate_key_threads(RSA *rsa, int bits, BIGNUM *e, int nthreads,
+    BN_GENCB *cb);
 
 int RSA_check_key(const RSA *);
 /* next 4 return -1 on error */
@@ -78,6 +78,10 @@ rsa_cb(int operation, ASN1_VALUE **pval, const ASN1_ITEM *it, void *exarg)
 		RSA_free((RSA *)*pval);
 		*pval = NULL;
 		return 2;
+	} else if (operation == ASN1_OP_D2I_POST) {
+		/* Only RSA_eay caches Montgomery contexts. */
+		if (((RSA *)*pval)->meth == RSA_PKCS1_SSLeay())
+			return rsa_eay_mont_precompute((RSA *)*pval);
 	}
 	return 1;
 }
@@ -110,6 +110,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <openssl/opensslconf.h>
@@ -119,6 +120,7 @@
 #include <openssl/rsa.h>
 
 #include "bn_lcl.h"
+#include "rsa_locl.h"
 
 static int RSA_eay_public_encrypt(int flen, const unsigned char *from,
     unsigned char *to, RSA *rsa, int padding);
@@ -183,7 +185,7 @@ RSA_eay_public_encrypt(int flen, const unsigned char *from, unsigned char *to,
 		}
 	}
 
-	if ((ctx = BN_CTX_new()) == NULL)
+	if ((ctx = BN_CTX_get_thread_default()) == NULL)
 		goto err;
 
 	BN_CTX_start(ctx);
@@ -251,97 +253,78 @@ err:
 	return r;
 }
 
-static BN_BLINDING *
-rsa_get_blinding(RSA *rsa, int *local, BN_CTX *ctx)
-{
-	BN_BLINDING *ret;
-	int got_write_lock = 0;
-	CRYPTO_THREADID cur;
-
-	CRYPTO_r_lock(CRYPTO_LOCK_RSA);
+/*
+ * Blinding.
+ *
+ * A BN_BLINDING holds the unblinding factor of the operation in progress,
+ * so only one thread may use it at a time. The thread that set up
+ * rsa->blinding with RSA_blinding_on() keeps using it. Every other thread
+ * takes a blinding from a pool kept with the key. Slots are claimed and
+ * returned with compare and swap, starting at a slot picked by thread id,
+ * so private key operations do not serialise on a lock. If every slot is
+ * empty a new blinding is set up, and it is freed if there is no room to
+ * return it.
+ */
 
-	if (rsa->blinding == NULL) {
-		CRYPTO_r_unlock(CRYPTO_LOCK_RSA);
-		CRYPTO_w_lock(CRYPTO_LOCK_RSA);
-		got_write_lock = 1;
+static BN_BLINDING **
+rsa_blinding_pool(RSA *rsa)
+{
+	BN_BLINDING **pool;
 
-		if (rsa->blinding == NULL)
-			rsa->blinding = RSA_setup_blinding(rsa, ctx);
+	if ((pool = rsa->blinding_pool) != NULL)
+		return pool;
+	if ((pool = calloc(RSA_BLINDING_POOL_SIZE, sizeof(*pool))) == NULL)
+		return NULL;
+	if (!__sync_bool_compare_and_swap(&rsa->blinding_pool, NULL, pool)) {
+		free(pool);
+		pool = rsa->blinding_pool;
 	}
+	return pool;
+}
 
-	ret = rsa->blinding;
-	if (ret == NULL)
-		goto err;
+static BN_BLINDING *
+rsa_get_blinding(RSA *rsa, int *slot, BN_CTX *ctx)
+{
+	BN_BLINDING **pool, *ret;
+	CRYPTO_THREADID cur;
+	int i, start;
 
 	CRYPTO_THREADID_current(&cur);
-	if (!CRYPTO_THREADID_cmp(&cur, BN_BLINDING_thread_id(ret))) {
-		/* rsa->blinding is ours! */
-		*local = 1;
-	} else {
-		/* resort to rsa->mt_blinding instead */
-		/*
-		 * Instruct rsa_blinding_convert(), rsa_blinding_invert()
-		 * that the BN_BLINDING is shared, meaning that accesses
-		 * require locks, and that the blinding factor must be
-		 * stored outside the BN_BLINDING
-		 */
-		*local = 0;
 
-		if (rsa->mt_blinding == NULL) {
-			if (!got_write_lock) {
-				CRYPTO_r_unlock(CRYPTO_LOCK_RSA);
-				CRYPTO_w_lock(CRYPTO_LOCK_RSA);
-				got_write_lock = 1;
-			}
+	*slot = -1;
+	if ((ret = rsa->blinding) != NULL &&
+	    !CRYPTO_THREADID_cmp(&cur, BN_BLINDING_thread_id(ret)))
+		return ret;
 
-			if (rsa->mt_blinding == NULL)
-				rsa->mt_blinding = RSA_setup_blinding(rsa, ctx);
-		}
-		ret = rsa->mt_blinding;
+	if ((pool = rsa_blinding_pool(rsa)) == NULL)
+		return NULL;
+	start = CRYPTO_THREADID_hash(&cur) % RSA_BLINDING_POOL_SIZE;
+	for (i = 0; i < RSA_BLINDING_POOL_SIZE; i++) {
+		*slot = (start + i) % RSA_BLINDING_POOL_SIZE;
+		if ((ret = pool[*slot]) != NULL &&
+		    __sync_bool_compare_and_swap(&pool[*slot], ret, NULL))
+			return ret;
 	}
 
-err:
-	if (got_write_lock)
-		CRYPTO_w_unlock(CRYPTO_LOCK_RSA);
-	else
-		CRYPTO_r_unlock(CRYPTO_LOCK_RSA);
-	return ret;
+	*slot = start;
+	return RSA_setup_blinding(rsa, ctx);
 }
 
-static int
-rsa_blinding_convert(BN_BLINDING *b, BIGNUM *f, BIGNUM *unblind, BN_CTX *ctx)
+/* Return a blinding taken from the pool. */
+static void
+rsa_put_blinding(RSA *rsa, BN_BLINDING *b, int slot)
 {
-	if (unblind == NULL)
-		/*
-		 * Local blinding: store the unblinding factor
-		 * in BN_BLINDING.
-		 */
-		return BN_BLINDING_convert_ex(f, NULL, b, ctx);
-	else {
-		/*
-		 * Shared blinding: store the unblinding factor
-		 * outside BN_BLINDING.
-		 */
-		int ret;
-		CRYPTO_w_lock(CRYPTO_LOCK_RSA_BLINDING);
-		ret = BN_BLINDING_convert_ex(f, unblind, b, ctx);
-		CRYPTO_w_unlock(CRYPTO_LOCK_RSA_BLINDING);
-		return ret;
-	}
-}
+	BN_BLINDING **pool = rsa->blinding_pool;
+	int i;
 
-static int
-rsa_blinding_invert(BN_BLINDING *b, BIGNUM *f, BIGNUM *unblind, BN_CTX *ctx)
-{
-	/*
-	 * For local blinding, unblind is set to NULL, and BN_BLINDING_invert_ex
-	 * will use the unblinding factor stored in BN_BLINDING.
-	 * If BN_BLINDING is shared between threads, unblind must be non-null:
-	 * BN_BLINDING_invert_ex will then use the local unblinding factor,
-	 * and will only read the modulus from BN_BLINDING.
-	 * In both cases it's safe to access the blinding without a lock.
-	 */
-	return BN_BLINDING_invert_ex(f, unblind, b, ctx);
+	if (b == NULL || slot == -1)
+		return;
+	for (i = 0; i < RSA_BLINDING_POOL_SIZE; i++) {
+		if (__sync_bool_compare_and_swap(
+		    &pool[(slot + i) % RSA_BLINDING_POOL_SIZE], NULL, b))
+			return;
+	}
+	BN_BLINDING_free(b);
 }
 
 /* signing */
@@ -353,16 +336,10 @@ RSA_eay_private_encrypt(int flen, const unsigned char *from, unsigned char *to,
 	int i, j, k, num = 0, r = -1;
 	unsigned char *buf = NULL;
 	BN_CTX *ctx = NULL;
-	int local_blinding = 0;
-	/*
-	 * Used only if the blinding structure is shared. A non-NULL unblind
-	 * instructs rsa_blinding_convert() and rsa_blinding_invert() to store
-	 * the unblinding factor outside the blinding structure.
-	 */
-	BIGNUM *unblind = NULL;
 	BN_BLINDING *blinding = NULL;
+	int blinding_slot = -1;
 
-	if ((ctx = BN_CTX_new()) == NULL)
+	if ((ctx = BN_CTX_get_thread_default()) == NULL)
 		goto err;
 
 	BN_CTX_start(ctx);
@@ -403,19 +380,12 @@ RSA_eay_private_encrypt(int flen, const unsigned char *from, unsigned char *to,
 	}
 
 	if (!(rsa->flags & RSA_FLAG_NO_BLINDING)) {
-		blinding = rsa_get_blinding(rsa, &local_blinding, ctx);
+		blinding = rsa_get_blinding(rsa, &blinding_slot, ctx);
 		if (blinding == NULL) {
 			RSAerror(ERR_R_INTERNAL_ERROR);
 			goto err;
 		}
-	}
-
-	if (blinding != NULL) {
-		if (!local_blinding && ((unblind = BN_CTX_get(ctx)) == NULL)) {
-			RSAerror(ERR_R_MALLOC_FAILURE);
-			goto err;
-		}
-		if (!rsa_blinding_convert(blinding, f, unblind, ctx))
+		if (!BN_BLINDING_convert_ex(f, NULL, blinding, ctx))
 			goto err;
 	}
 
@@ -442,7 +412,7 @@ RSA_eay_private_encrypt(int flen, const unsigned char *from, unsigned char *to,
 	}
 
 	if (blinding)
-		if (!rsa_blinding_invert(blinding, ret, unblind, ctx))
+		if (!BN_BLINDING_invert_ex(ret, NULL, blinding, ctx))
 			goto err;
 
 	if (padding == RSA_X931_PADDING) {
@@ -467,6 +437,7 @@ err:
 		BN_CTX_end(ctx);
 		BN_CTX_free(ctx);
 	}
+	rsa_put_blinding(rsa, blinding, blinding_slot);
 	freezero(buf, num);
 	return r;
 }
@@ -480,16 +451,10 @@ RSA_eay_private_decrypt(int flen, const unsigned char *from, unsigned char *to,
 	unsigned char *p;
 	unsigned char *buf = NULL;
 	BN_CTX *ctx = NULL;
-	int local_blinding = 0;
-	/*
-	 * Used only if the blinding structure is shared. A non-NULL unblind
-	 * instructs rsa_blinding_convert() and rsa_blinding_invert() to store
-	 * the unblinding factor outside the blinding structure.
-	 */
-	BIGNUM *unblind = NULL;
 	BN_BLINDING *blinding = NULL;
+	int blinding_slot = -1;
 
-	if ((ctx = BN_CTX_new()) == NULL)
+	if ((ctx = BN_CTX_get_thread_default()) == NULL)
 		goto err;
 
 	BN_CTX_start(ctx);
@@ -520,19 +485,12 @@ RSA_eay_private_decrypt(int flen, const unsigned char *from, unsigned char *to,
 	}
 
 	if (!(rsa->flags & RSA_FLAG_NO_BLINDING)) {
-		blinding = rsa_get_blinding(rsa, &local_blinding, ctx);
+		blinding = rsa_get_blinding(rsa, &blinding_slot, ctx);
 		if (blinding == NULL) {
 			RSAerror(ERR_R_INTERNAL_ERROR);
 			goto err;
 		}
-	}
-
-	if (blinding != NULL) {
-		if (!local_blinding && ((unblind = BN_CTX_get(ctx)) == NULL)) {
-			RSAerror(ERR_R_MALLOC_FAILURE);
-			goto err;
-		}
-		if (!rsa_blinding_convert(blinding, f, unblind, ctx))
+		if (!BN_BLINDING_convert_ex(f, NULL, blinding, ctx))
 			goto err;
 	}
 
@@ -560,7 +518,7 @@ RSA_eay_private_decrypt(int flen, const unsigned char *from, unsigned char *to,
 	}
 
 	if (blinding)
-		if (!rsa_blinding_invert(blinding, ret, unblind, ctx))
+		if (!BN_BLINDING_invert_ex(ret, NULL, blinding, ctx))
 			goto err;
 
 	p = buf;
@@ -590,6 +548,7 @@ err:
 		BN_CTX_end(ctx);
 		BN_CTX_free(ctx);
 	}
+	rsa_put_blinding(rsa, blinding, blinding_slot);
 	freezero(buf, num);
 	return r;
 }
@@ -623,7 +582,7 @@ RSA_eay_public_decrypt(int flen, const unsigned char *from, unsigned char *to,
 		}
 	}
 
-	if ((ctx = BN_CTX_new()) == NULL)
+	if ((ctx = BN_CTX_get_thread_default()) == NULL)
 		goto err;
 
 	BN_CTX_start(ctx);
@@ -697,15 +656,16 @@ err:
 static int
 RSA_eay_mod_exp(BIGNUM *r0, const BIGNUM *I, RSA *rsa, BN_CTX *ctx)
 {
-	BIGNUM *r1, *m1, *vrfy;
+	BIGNUM *r1, *r2, *m1, *vrfy;
 	BIGNUM dmp1, dmq1, c, pr1;
 	int ret = 0;
 
 	BN_CTX_start(ctx);
 	r1 = BN_CTX_get(ctx);
+	r2 = BN_CTX_get(ctx);
 	m1 = BN_CTX_get(ctx);
 	vrfy = BN_CTX_get(ctx);
-	if (r1 == NULL || m1 == NULL || vrfy == NULL) {
+	if (r1 == NULL || r2 == NULL || m1 == NULL || vrfy == NULL) {
 		RSAerror(ERR_R_MALLOC_FAILURE);
 		goto err;
 	}
@@ -737,34 +697,37 @@ RSA_eay_mod_exp(BIGNUM *r0, const BIGNUM *I, RSA *rsa, BN_CTX *ctx)
 		    CRYPTO_LOCK_RSA, rsa->n, ctx))
 			goto err;
 
-	/* compute I mod q */
+	/* compute I mod q and I mod p */
 	BN_init(&c);
 	BN_with_flags(&c, I, BN_FLG_CONSTTIME);
 
 	if (!BN_mod_ct(r1, &c, rsa->q, ctx))
 		goto err;
+	if (!BN_mod_ct(r2, &c, rsa->p, ctx))
+		goto err;
 
-	/* compute r1^dmq1 mod q */
 	BN_init(&dmq1);
 	BN_with_flags(&dmq1, rsa->dmq1, BN_FLG_CONSTTIME);
-
-	if (!rsa->meth->bn_mod_exp(m1, r1, &dmq1, rsa->q, ctx,
-	    rsa->_method_mod_q))
-		goto err;
-
-	/* compute I mod p */
-	BN_with_flags(&c, I, BN_FLG_CONSTTIME);
-
-	if (!BN_mod_ct(r1, &c, rsa->p, ctx))
-		goto err;
-
-	/* compute r1^dmp1 mod p */
 	BN_init(&dmp1);
 	BN_with_flags(&dmp1, rsa->dmp1, BN_FLG_CONSTTIME);
 
-	if (!rsa->meth->bn_mod_exp(r0, r1, &dmp1, rsa->p, ctx,
-	    rsa->_method_mod_p))
-		goto err;
+	if (rsa->meth->bn_mod_exp == BN_mod_exp_mont_ct) {
+		/* compute r1^dmq1 mod q and r2^dmp1 mod p together */
+		if (!BN_mod_exp_mont_consttime_x2(m1, r1, &dmq1, rsa->q,
+		    rsa->_method_mod_q, r0, r2, &dmp1, rsa->p,
+		    rsa->_method_mod_p, ctx))
+			goto err;
+	} else {
+		/* compute r1^dmq1 mod q */
+		if (!rsa->meth->bn_mod_exp(m1, r1, &dmq1, rsa->q, ctx,
+		    rsa->_method_mod_q))
+			goto err;
+
+		/* compute r2^dmp1 mod p */
+		if (!rsa->meth->bn_mod_exp(r0, r2, &dmp1, rsa->p, ctx,
+		    rsa->_method_mod_p))
+			goto err;
+	}
 
 	if (!BN_sub(r0, r0, m1))
 		goto err;
@@ -859,3 +822,48 @@ RSA_eay_finish(RSA *rsa)
 
 	return 1;
 }
+
+/*
+ * Set up the Montgomery contexts that RSA_eay caches with a key, as soon as
+ * the key has been decoded, so that the first operations on it need not.
+ * Keys with an even modulus or prime are left for the operations to reject.
+ */
+int
+rsa_eay_mont_precompute(RSA *rsa)
+{
+	BN_CTX *ctx;
+	BIGNUM p, q;
+	int ret = 0;
+
+	if ((ctx = BN_CTX_new()) == NULL)
+		return 0;
+
+	if ((rsa->flags & RSA_FLAG_CACHE_PUBLIC) != 0 && rsa->n != NULL &&
+	    BN_is_odd(rsa->n)) {
+		if (!BN_MONT_CTX_set_locked(&rsa->_method_mod_n,
+		    CRYPTO_LOCK_RSA, rsa->n, ctx))
+			goto err;
+	}
+
+	if ((rsa->flags & RSA_FLAG_CACHE_PRIVATE) != 0 && rsa->p != NULL &&
+	    rsa->q != NULL && BN_is_odd(rsa->p) && BN_is_odd(rsa->q)) {
+		BN_init(&p);
+		BN_init(&q);
+		BN_with_flags(&p, rsa->p, BN_FLG_CONSTTIME);
+		BN_with_flags(&q, rsa->q, BN_FLG_CONSTTIME);
+
+		if (!BN_MONT_CTX_set_locked(&rsa->_method_mod_p,
+		    CRYPTO_LOCK_RSA, &p, ctx))
+			goto err;
+		if (!BN_MONT_CTX_set_locked(&rsa->_method_mod_q,
+		    CRYPTO_LOCK_RSA, &q, ctx))
+			goto err;
+	}
+
+	ret = 1;
+
+ err:
+	BN_CTX_free(ctx);
+
+	return ret;
+}
@@ -65,18 +65,20 @@
 #include <openssl/err.h>
 #include <openssl/rsa.h>
 
+#include "cryptlib.h"
+
 /* BEGIN ERROR CODES */
 #ifndef OPENSSL_NO_ERR
 
 #define ERR_FUNC(func) ERR_PACK(ERR_LIB_RSA,func,0)
 #define ERR_REASON(reason) ERR_PACK(ERR_LIB_RSA,0,reason)
 
-static ERR_STRING_DATA RSA_str_functs[] = {
+static const ERR_STRING_DATA RSA_str_functs[] = {
 	{ERR_FUNC(0xfff), "CRYPTO_internal"},
 	{0, NULL}
 };
 
-static ERR_STRING_DATA RSA_str_reasons[] = {
+static const ERR_STRING_DATA RSA_str_reasons[] = {
 	{ERR_REASON(RSA_R_ALGORITHM_MISMATCH)    , "algorithm mismatch"},
 	{ERR_REASON(RSA_R_BAD_E_VALUE)           , "bad e value"},
 	{ERR_REASON(RSA_R_BAD_FIXED_HEADER_DECRYPT), "bad fixed header decrypt"},
@@ -156,8 +158,8 @@ ERR_load_RSA_strings(void)
 {
 #ifndef OPENSSL_NO_ERR
 	if (ERR_func_error_string(RSA_str_functs[0].error) == NULL) {
-		ERR_load_strings(0, RSA_str_functs);
-		ERR_load_strings(0, RSA_str_reasons);
+		ERR_load_const_strings(RSA_str_functs);
+		ERR_load_const_strings(RSA_str_reasons);
 	}
 #endif
 }
@@ -70,8 +70,10 @@
 #include <openssl/rsa.h>
 
 #include "bn_lcl.h"
+#include "cryptlib.h"
 
-static int rsa_builtin_keygen(RSA *rsa, int bits, BIGNUM *e_value, BN_GENCB *cb);
+static int rsa_builtin_keygen(RSA *rsa, int bits, BIGNUM *e_value,
+    int nthreads, BN_GENCB *cb);
 
 /*
  * NB: this wrapper would normally be placed in rsa_lib.c and the static
@@ -83,13 +85,45 @@ static int rsa_builtin_keygen(RSA *rsa, int bits, BIGNUM *e_value, BN_GENCB *cb)
 int
 RSA_generate_key_ex(RSA *rsa, int bits, BIGNUM *e_value, BN_GENCB *cb)
 {
+	int nthreads = 1;
+
 	if (rsa->meth->rsa_keygen)
 		return rsa->meth->rsa_keygen(rsa, bits, e_value, cb);
-	return rsa_builtin_keygen(rsa, bits, e_value, cb);
+
+	/*
+	 * The threaded prime search makes no progress callbacks, so only use
+	 * the application's thread pool when nobody is listening.
+	 */
+	if (cb == NULL && crypto_tasks_threads() > 1)
+		nthreads = crypto_tasks_threads();
+
+	return rsa_builtin_keygen(rsa, bits, e_value, nthreads, cb);
+}
+
+/*
+ * As RSA_generate_key_ex(), but search for each prime with nthreads
+ * threads.  A method with its own key generation is used as is.
+ */
+int
+RSA_generate_key_threads(RSA *rsa, int bits, BIGNUM *e_value, int nthreads,
+    BN_GENCB *cb)
+{
+	if (rsa->meth->rsa_keygen)
+		return rsa->meth->rsa_keygen(rsa, bits, e_value, cb);
+	return rsa_builtin_keygen(rsa, bits, e_value, nthreads, cb);
+}
+
+static int
+rsa_generate_prime(BIGNUM *p, int bits, int nthreads, BN_GENCB *cb)
+{
+	if (nthreads > 1)
+		return bn_generate_prime_threads(p, bits, nthreads);
+	return BN_generate_prime_ex(p, bits, 0, NULL, NULL, cb);
 }
 
 static int
-rsa_builtin_keygen(RSA *rsa, int bits, BIGNUM *e_value, BN_GENCB *cb)
+rsa_builtin_keygen(RSA *rsa, int bits, BIGNUM *e_value, int nthreads,
+    BN_GENCB *cb)
 {
 	BIGNUM *r0 = NULL, *r1 = NULL, *r2 = NULL, *r3 = NULL, *tmp;
 	BIGNUM pr0, d, p;
@@ -134,7 +168,7 @@ rsa_builtin_keygen(RSA *rsa, int bits, BIGNUM *e_value, BN_GENCB *cb)
 
 	/* generate p and q */
 	for (;;) {
-		if (!BN_generate_prime_ex(rsa->p, bitsp, 0, NULL, NULL, cb))
+		if (!rsa_generate_prime(rsa->p, bitsp, nthreads, cb))
 			goto err;
 		if (!BN_sub(r2, rsa->p, BN_value_one()))
 			goto err;
@@ -155,8 +189,7 @@ rsa_builtin_keygen(RSA *rsa, int bits, BIGNUM *e_value, BN_GENCB *cb)
 		 */
 		unsigned int degenerate = 0;
 		do {
-			if (!BN_generate_prime_ex(rsa->q, bitsq, 0, NULL, NULL,
-			    cb))
+			if (!rsa_generate_prime(rsa->q, bitsq, nthreads, cb))
 				goto err;
 		} while (BN_cmp(rsa->p, rsa->q) == 0 &&
 		    ++degenerate < 3);
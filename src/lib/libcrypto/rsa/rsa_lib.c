@@ -68,6 +68,7 @@
 #include <openssl/rsa.h>
 
 #include "evp_locl.h"
+#include "rsa_locl.h"
 
 #ifndef OPENSSL_NO_ENGINE
 #include <openssl/engine.h>
@@ -209,6 +210,11 @@ RSA_free(RSA *r)
 	BN_clear_free(r->iqmp);
 	BN_BLINDING_free(r->blinding);
 	BN_BLINDING_free(r->mt_blinding);
+	if (r->blinding_pool != NULL) {
+		for (i = 0; i < RSA_BLINDING_POOL_SIZE; i++)
+			BN_BLINDING_free(r->blinding_pool[i]);
+		free(r->blinding_pool);
+	}
 	RSA_PSS_PARAMS_free(r->pss);
 	free(r);
 }
@@ -224,6 +224,8 @@ $code.=<<___;
 sha1_block_data_order:
 	mov	OPENSSL_ia32cap_P+0(%rip),%r9d
 	mov	OPENSSL_ia32cap_P+4(%rip),%r8d
+	test	\$IA32CAP_MASK0_SHA,%r9d		# check SHA bit
+	jnz	_shaext_shortcut
 	test	\$IA32CAP_MASK1_SSSE3,%r8d		# check SSSE3 bit
 	jz	.Lialu
 ___
@@ -293,6 +295,97 @@ $code.=<<___;
 .size	sha1_block_data_order,.-sha1_block_data_order
 ___
 {{{
+######################################################################
+# SHA extensions: sha1rnds4 performs four rounds at a time, sha1nexte
+# derives the next E from the previous A and sha1msg1/sha1msg2 compute
+# the message schedule. The frame is laid out as in the SSSE3 code so
+# that ssse3_handler can unwind it.
+#
+my ($ABCD,$E_SAVE,$BSWAP,$ABCD_SAVE)=("%xmm0","%xmm7","%xmm8","%xmm9");
+my @E=("%xmm1","%xmm2");
+my @MSG=map("%xmm$_",(3..6));
+
+$code.=<<___;
+.type	sha1_block_data_order_shaext,\@function,3
+.align	16
+sha1_block_data_order_shaext:
+_shaext_shortcut:
+	push	%rbx
+	push	%rbp
+	push	%r12
+	lea	`-64-($win64?5*16:0)`(%rsp),%rsp
+___
+$code.=<<___ if ($win64);
+	movaps	%xmm6,64+0(%rsp)
+	movaps	%xmm7,64+16(%rsp)
+	movaps	%xmm8,64+32(%rsp)
+	movaps	%xmm9,64+48(%rsp)
+.Lprologue_shaext:
+___
+$code.=<<___;
+	movdqu	0(%rdi),$ABCD		# load context
+	movd	16(%rdi),@E[0]
+	movdqa	K_XX_XX+0x50(%rip),$BSWAP	# byte swap mask
+	pshufd	\$0x1b,$ABCD,$ABCD	# A in the most significant word
+	pshufd	\$0x1b,@E[0],@E[0]	# E in the most significant word
+	jmp	.Loop_shaext
+
+.align	16
+.Loop_shaext:
+	movdqa	$ABCD,$ABCD_SAVE
+	movdqa	@E[0],$E_SAVE
+	movdqu	0(%rsi),@MSG[0]
+	movdqu	16(%rsi),@MSG[1]
+	movdqu	32(%rsi),@MSG[2]
+	movdqu	48(%rsi),@MSG[3]
+	pshufb	$BSWAP,@MSG[0]
+	pshufb	$BSWAP,@MSG[1]
+	pshufb	$BSWAP,@MSG[2]
+	pshufb	$BSWAP,@MSG[3]
+	lea	64(%rsi),%rsi
+
+	paddd	@MSG[0],@E[0]
+___
+for (my $i=0; $i<20; $i++) {
+	my ($m0,$m1,$m2)=(@MSG[$i&3],@MSG[($i+1)&3],@MSG[($i-1)&3]);
+	$code.="	sha1nexte	$m0,@E[0]\n"		if ($i>0);
+	$code.="	movdqa	$ABCD,@E[1]\n";
+	$code.="	sha1msg2	$m0,$m1\n"		if ($i>=3 && $i<19);
+	$code.="	sha1rnds4	\$".int($i/5).",@E[0],$ABCD\n";
+	$code.="	sha1msg1	$m0,$m2\n"		if ($i>=1 && $i<17);
+	$code.="	pxor	$m0,@MSG[($i-2)&3]\n"	if ($i>=2 && $i<18);
+	push(@E,shift(@E));
+}
+$code.=<<___;
+
+	sha1nexte	$E_SAVE,@E[0]
+	paddd	$ABCD_SAVE,$ABCD
+	dec	%rdx
+	jnz	.Loop_shaext
+
+	pshufd	\$0x1b,$ABCD,$ABCD
+	pshufd	\$0x1b,@E[0],@E[0]
+	movdqu	$ABCD,0(%rdi)		# update context
+	movd	@E[0],16(%rdi)
+___
+$code.=<<___ if ($win64);
+	movaps	64+0(%rsp),%xmm6
+	movaps	64+16(%rsp),%xmm7
+	movaps	64+32(%rsp),%xmm8
+	movaps	64+48(%rsp),%xmm9
+___
+$code.=<<___;
+	lea	`64+($win64?5*16:0)`(%rsp),%rsi
+	mov	0(%rsi),%r12
+	mov	8(%rsi),%rbp
+	mov	16(%rsi),%rbx
+	lea	24(%rsi),%rsp
+.Lepilogue_shaext:
+	ret
+.size	sha1_block_data_order_shaext,.-sha1_block_data_order_shaext
+___
+}}}
+{{{
 my $Xi=4;
 my @X=map("%xmm$_",(4..7,0..3));
 my @Tx=map("%xmm$_",(8..10));
@@ -1078,6 +1171,7 @@ K_XX_XX:
 .long	0x8f1bbcdc,0x8f1bbcdc,0x8f1bbcdc,0x8f1bbcdc	# K_40_59
 .long	0xca62c1d6,0xca62c1d6,0xca62c1d6,0xca62c1d6	# K_60_79
 .long	0x00010203,0x04050607,0x08090a0b,0x0c0d0e0f	# pbswap mask
+.long	0x0c0d0e0f,0x08090a0b,0x04050607,0x00010203	# byte swap mask
 ___
 }}}
 $code.=<<___;
@@ -1227,6 +1321,9 @@ ssse3_handler:
 	.rva	.LSEH_begin_sha1_block_data_order
 	.rva	.LSEH_end_sha1_block_data_order
 	.rva	.LSEH_info_sha1_block_data_order
+	.rva	.LSEH_begin_sha1_block_data_order_shaext
+	.rva	.LSEH_end_sha1_block_data_order_shaext
+	.rva	.LSEH_info_sha1_block_data_order_shaext
 	.rva	.LSEH_begin_sha1_block_data_order_ssse3
 	.rva	.LSEH_end_sha1_block_data_order_ssse3
 	.rva	.LSEH_info_sha1_block_data_order_ssse3
@@ -1242,6 +1339,10 @@ $code.=<<___;
 .LSEH_info_sha1_block_data_order:
 	.byte	9,0,0,0
 	.rva	se_handler
+.LSEH_info_sha1_block_data_order_shaext:
+	.byte	9,0,0,0
+	.rva	ssse3_handler
+	.rva	.Lprologue_shaext,.Lepilogue_shaext	# HandlerData[]
 .LSEH_info_sha1_block_data_order_ssse3:
 	.byte	9,0,0,0
 	.rva	ssse3_handler
@@ -1258,5 +1359,34 @@ ___
 ####################################################################
 
 $code =~ s/\`([^\`]*)\`/eval $1/gem;
+
+# Encode the SHA instructions by hand, older assemblers do not know them.
+sub sha1op38 {
+    my ($op,$args)=@_;
+    my %opcodelet=(
+	"sha1nexte" => 0xc8,
+	"sha1msg1" => 0xc9,
+	"sha1msg2" => 0xca);
+
+    if (defined($opcodelet{$op}) &&
+	$args =~ /%xmm([0-7]),\s*%xmm([0-7])/) {
+	return sprintf(".byte\t0x0f,0x38,0x%02x,0x%02x",
+	    $opcodelet{$op}, 0xc0|$1|($2<<3));
+    }
+    return "$op\t$args";
+}
+
+sub sha1rnds4 {
+    my ($args)=@_;
+
+    if ($args =~ /\$([0-3]),\s*%xmm([0-7]),\s*%xmm([0-7])/) {
+	return sprintf(".byte\t0x0f,0x3a,0xcc,0x%02x,%d",
+	    0xc0|$2|($3<<3), $1);
+    }
+    return "sha1rnds4\t$args";
+}
+
+$code =~ s/\bsha1rnds4[ \t]+(.*)/sha1rnds4($1)/gem;
+$code =~ s/\b(sha1nexte|sha1msg[12])[ \t]+(.*)/sha1op38($1,$2)/gem;
 print $code;
 close STDOUT;
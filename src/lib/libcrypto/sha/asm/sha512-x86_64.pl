@@ -44,6 +44,8 @@ $flavour = shift;
 $output  = shift;
 if ($flavour =~ /\./) { $output = $flavour; undef $flavour; }
 
+$win64=0; $win64=1 if ($flavour =~ /[nm]asm|mingw64/ || $output =~ /\.asm$/);
+
 $0 =~ m/(.*[\/\\])[^\/\\]+$/; $dir=$1;
 ( $xlate="${dir}x86_64-xlate.pl" and -f $xlate ) or
 ( $xlate="${dir}../../perlasm/x86_64-xlate.pl" and -f $xlate) or
@@ -170,11 +172,24 @@ ___
 
 $code=<<___;
 .text
+___
+$code.=<<___ if ($SZ==4);
+.extern	OPENSSL_ia32cap_P
+.hidden	OPENSSL_ia32cap_P
+___
+$code.=<<___;
 
 .globl	$func
 .type	$func,\@function,4
 .align	16
 $func:
+___
+$code.=<<___ if ($SZ==4);
+	mov	OPENSSL_ia32cap_P+0(%rip),%r11d
+	test	\$IA32CAP_MASK0_SHA,%r11d		# check SHA bit
+	jnz	_shaext_shortcut
+___
+$code.=<<___;
 	push	%rbx
 	push	%rbp
 	push	%r12
@@ -268,6 +283,100 @@ $code.=<<___;
 ___
 
 if ($SZ==4) {
+######################################################################
+# SHA extensions: sha256rnds2 performs two rounds on the state held as
+# ABEF and CDGH, taking W[i]+K[i] from %xmm0, while sha256msg1 and
+# sha256msg2 compute the message schedule four words at a time.
+#
+my ($Wi,$ABEF,$CDGH,$TMP,$BSWAP,$ABEF_SAVE,$CDGH_SAVE)=
+    map("%xmm$_",(0..2,7..10));
+my @MSG=map("%xmm$_",(3..6));
+
+$code.=<<___;
+.type	sha256_block_data_order_shaext,\@function,3
+.align	16
+sha256_block_data_order_shaext:
+_shaext_shortcut:
+___
+$code.=<<___ if ($win64);
+	lea	`-8-5*16`(%rsp),%rsp
+	movaps	%xmm6,0(%rsp)
+	movaps	%xmm7,16(%rsp)
+	movaps	%xmm8,32(%rsp)
+	movaps	%xmm9,48(%rsp)
+	movaps	%xmm10,64(%rsp)
+___
+$code.=<<___;
+	lea	$TABLE(%rip),%rcx
+	movdqu	0($ctx),$ABEF		# DCBA
+	movdqu	16($ctx),$CDGH		# HGFE
+	movdqa	16*16(%rcx),$BSWAP	# byte swap mask
+
+	pshufd	\$0x1b,$ABEF,$TMP	# ABCD
+	pshufd	\$0xb1,$ABEF,$ABEF	# CDAB
+	pshufd	\$0x1b,$CDGH,$CDGH	# EFGH
+	palignr	\$8,$CDGH,$ABEF		# ABEF
+	punpcklqdq	$TMP,$CDGH	# CDGH
+	jmp	.Loop_shaext
+
+.align	16
+.Loop_shaext:
+	movdqu	0($inp),@MSG[0]
+	movdqu	16($inp),@MSG[1]
+	movdqu	32($inp),@MSG[2]
+	movdqu	48($inp),@MSG[3]
+	pshufb	$BSWAP,@MSG[0]
+	pshufb	$BSWAP,@MSG[1]
+	pshufb	$BSWAP,@MSG[2]
+	pshufb	$BSWAP,@MSG[3]
+	movdqa	$ABEF,$ABEF_SAVE
+	movdqa	$CDGH,$CDGH_SAVE
+	lea	64($inp),$inp
+___
+for (my $i=0; $i<16; $i++) {
+	my ($m0,$m1,$m2)=(@MSG[$i&3],@MSG[($i+1)&3],@MSG[($i-1)&3]);
+	$code.="	movdqa	16*$i(%rcx),$Wi\n";
+	$code.="	paddd	$m0,$Wi\n";
+	$code.="	sha256rnds2	$ABEF,$CDGH\n";
+	if ($i>=3 && $i<15) {
+		$code.="	movdqa	$m0,$TMP\n";
+		$code.="	palignr	\$4,$m2,$TMP\n";
+		$code.="	paddd	$TMP,$m1\n";
+		$code.="	sha256msg2	$m0,$m1\n";
+	}
+	$code.="	pshufd	\$0x0e,$Wi,$Wi\n";
+	$code.="	sha256rnds2	$CDGH,$ABEF\n";
+	$code.="	sha256msg1	$m0,$m2\n"	if ($i>=1 && $i<13);
+}
+$code.=<<___;
+
+	paddd	$ABEF_SAVE,$ABEF
+	paddd	$CDGH_SAVE,$CDGH
+	dec	%rdx
+	jnz	.Loop_shaext
+
+	pshufd	\$0xb1,$CDGH,$CDGH	# DCHG
+	pshufd	\$0x1b,$ABEF,$TMP	# FEBA
+	pshufd	\$0xb1,$ABEF,$ABEF	# BAFE
+	punpckhqdq	$CDGH,$ABEF	# DCBA
+	palignr	\$8,$TMP,$CDGH		# HGFE
+
+	movdqu	$ABEF,0($ctx)
+	movdqu	$CDGH,16($ctx)
+___
+$code.=<<___ if ($win64);
+	movaps	0(%rsp),%xmm6
+	movaps	16(%rsp),%xmm7
+	movaps	32(%rsp),%xmm8
+	movaps	48(%rsp),%xmm9
+	movaps	64(%rsp),%xmm10
+	lea	`8+5*16`(%rsp),%rsp
+___
+$code.=<<___;
+	ret
+.size	sha256_block_data_order_shaext,.-sha256_block_data_order_shaext
+___
+
 $code.=<<___;
 .align	64
 .type	$TABLE,\@object
@@ -288,6 +397,8 @@ $TABLE:
 	.long	0x391c0cb3,0x4ed8aa4a,0x5b9cca4f,0x682e6ff3
 	.long	0x748f82ee,0x78a5636f,0x84c87814,0x8cc70208
 	.long	0x90befffa,0xa4506ceb,0xbef9a3f7,0xc67178f2
+
+	.long	0x00010203,0x04050607,0x08090a0b,0x0c0d0e0f	# byte swap mask
 ___
 } else {
 $code.=<<___;
@@ -338,5 +449,23 @@ ___
 }
 
 $code =~ s/\`([^\`]*)\`/eval $1/gem;
+
+# Encode the SHA instructions by hand, older assemblers do not know them.
+sub sha256op38 {
+    my ($op,$args)=@_;
+    my %opcodelet=(
+	"sha256rnds2" => 0xcb,
+	"sha256msg1" => 0xcc,
+	"sha256msg2" => 0xcd);
+
+    if (defined($opcodelet{$op}) &&
+	$args =~ /%xmm([0-7]),\s*%xmm([0-7])/) {
+	return sprintf(".byte\t0x0f,0x38,0x%02x,0x%02x",
+	    $opcodelet{$op}, 0xc0|$1|($2<<3));
+    }
+    return "$op\t$args";
+}
+
+$code =~ s/\b(sha256rnds2|sha256msg[12])[ \t]+(.*)/sha256op38($1,$2)/gem;
 print $code;
 close STDOUT;
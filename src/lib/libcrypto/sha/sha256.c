@@ -18,6 +18,34 @@
 #include <openssl/sha.h>
 #include <openssl/opensslv.h>
 
+#include "sha_internal.h"
+
+#ifdef __aarch64__
+#include "arm_arch.h"
+#endif
+
+#if !defined(SHA256_ASM) && defined(ARMV8_CE)
+#include <arm_neon.h>
+#define SHA256_ARMV8
+#endif
+
+/*
+ * Multi-buffer kernels for SHA256_multi(), built using compiler vector
+ * extensions. Each lane of a vector holds the state for a different message.
+ */
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 12)
+#if defined(__x86_64__)
+#include "x86_arch.h"
+#define SHA256_MB
+#define SHA256_MB_SSE2
+#define SHA256_MB_AVX2
+#elif defined(__aarch64__) && defined(__AARCH64EL__) && \
+    defined(OPENSSL_CPUID_OBJ)
+#define SHA256_MB
+#define SHA256_MB_NEON
+#endif
+#endif
+
 int SHA224_Init(SHA256_CTX *c)
 	{
 	memset (c,0,sizeof(*c));
@@ -116,7 +144,7 @@ void sha256_block_data_order (SHA256_CTX *ctx, const void *in, size_t num);
 
 #include "md32_common.h"
 
-#ifndef SHA256_ASM
+#if !defined(SHA256_ASM) || defined(SHA256_MB)
 static const SHA_LONG K256[64] = {
 	0x428a2f98UL,0x71374491UL,0xb5c0fbcfUL,0xe9b5dba5UL,
 	0x3956c25bUL,0x59f111f1UL,0x923f82a4UL,0xab1c5ed5UL,
@@ -134,6 +162,9 @@ static const SHA_LONG K256[64] = {
 	0x391c0cb3UL,0x4ed8aa4aUL,0x5b9cca4fUL,0x682e6ff3UL,
 	0x748f82eeUL,0x78a5636fUL,0x84c87814UL,0x8cc70208UL,
 	0x90befffaUL,0xa4506cebUL,0xbef9a3f7UL,0xc67178f2UL };
+#endif
+
+#ifndef SHA256_ASM
 
 /*
  * FIPS specification refers to right rotations, while our ROTATE macro
@@ -148,6 +179,57 @@ static const SHA_LONG K256[64] = {
 #define Ch(x,y,z)	(((x) & (y)) ^ ((~(x)) & (z)))
 #define Maj(x,y,z)	(((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
 
+#ifdef SHA256_ARMV8
+/*
+ * SHA-256 using the ARMv8 Crypto Extensions, which perform four rounds and
+ * extend the message schedule by four words at a time.
+ */
+#define SHA256_V8_ROUND4(i, w0, w1, w2, w3) do {			\
+	wk = vaddq_u32(w0, vld1q_u32(&K256[i]));			\
+	t = abcd;							\
+	abcd = vsha256hq_u32(abcd, efgh, wk);				\
+	efgh = vsha256h2q_u32(efgh, t, wk);				\
+	if ((i) < 48)							\
+		w0 = vsha256su1q_u32(vsha256su0q_u32(w0, w1), w2, w3);	\
+} while (0)
+
+static void ARMV8_TARGET(sha2)
+sha256_block_armv8(SHA256_CTX *ctx, const void *in, size_t num)
+{
+	const unsigned char *data = in;
+	uint32x4_t abcd, efgh, abcd0, efgh0, w0, w1, w2, w3, wk, t;
+	int i;
+
+	abcd = vld1q_u32(&ctx->h[0]);
+	efgh = vld1q_u32(&ctx->h[4]);
+
+	while (num--) {
+		abcd0 = abcd;
+		efgh0 = efgh;
+
+		w0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data)));
+		w1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16)));
+		w2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 32)));
+		w3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 48)));
+
+		for (i = 0; i < 64; i += 16) {
+			SHA256_V8_ROUND4(i, w0, w1, w2, w3);
+			SHA256_V8_ROUND4(i + 4, w1, w2, w3, w0);
+			SHA256_V8_ROUND4(i + 8, w2, w3, w0, w1);
+			SHA256_V8_ROUND4(i + 12, w3, w0, w1, w2);
+		}
+
+		abcd = vaddq_u32(abcd, abcd0);
+		efgh = vaddq_u32(efgh, efgh0);
+
+		data += SHA256_CBLOCK;
+	}
+
+	vst1q_u32(&ctx->h[0], abcd);
+	vst1q_u32(&ctx->h[4], efgh);
+}
+#endif
+
 #ifdef OPENSSL_SMALL_FOOTPRINT
 
 static void sha256_block_data_order (SHA256_CTX *ctx, const void *in, size_t num)
@@ -157,6 +239,13 @@ static void sha256_block_data_order (SHA256_CTX *ctx, const void *in, size_t num
 	int i;
 	const unsigned char *data=in;
 
+#ifdef SHA256_ARMV8
+	if ((OPENSSL_armcap_P & ARMV8_SHA256) != 0) {
+		sha256_block_armv8(ctx, in, num);
+		return;
+	}
+#endif
+
 			while (num--) {
 
 	a = ctx->h[0];	b = ctx->h[1];	c = ctx->h[2];	d = ctx->h[3];
@@ -209,6 +298,13 @@ static void sha256_block_data_order (SHA256_CTX *ctx, const void *in, size_t num
 	int i;
 	const unsigned char *data=in;
 
+#ifdef SHA256_ARMV8
+	if ((OPENSSL_armcap_P & ARMV8_SHA256) != 0) {
+		sha256_block_armv8(ctx, in, num);
+		return;
+	}
+#endif
+
 			while (num--) {
 
 	a = ctx->h[0];	b = ctx->h[1];	c = ctx->h[2];	d = ctx->h[3];
@@ -281,4 +377,518 @@ static void sha256_block_data_order (SHA256_CTX *ctx, const void *in, size_t num
 #endif
 #endif /* SHA256_ASM */
 
+#ifdef SHA256_MB
+typedef uint32_t sha256_u32x4 __attribute__((__vector_size__(16)));
+typedef uint32_t sha256_u32x8 __attribute__((__vector_size__(32)));
+
+#define SHA256_MB_LANES		8
+
+#define SHA256_MB_ROTATE(v, c)	(((v) >> (c)) | ((v) << (32 - (c))))
+
+#define SHA256_MB_ROUND(i, a, b, c, d, e, f, g, h) do { \
+	t1 = h + (SHA256_MB_ROTATE(e, 6) ^ SHA256_MB_ROTATE(e, 11) ^ \
+	    SHA256_MB_ROTATE(e, 25)) + (((f ^ g) & e) ^ g) + K256[i] + \
+	    x[(i) & 15]; \
+	t2 = (SHA256_MB_ROTATE(a, 2) ^ SHA256_MB_ROTATE(a, 13) ^ \
+	    SHA256_MB_ROTATE(a, 22)) + ((a & b) | ((a | b) & c)); \
+	d += t1; \
+	h = t1 + t2; \
+} while (0)
+
+#define SHA256_MB_SCHEDULE(i) do { \
+	t1 = x[((i) + 1) & 15]; \
+	t2 = x[((i) + 14) & 15]; \
+	x[(i) & 15] += (SHA256_MB_ROTATE(t1, 7) ^ SHA256_MB_ROTATE(t1, 18) ^ \
+	    (t1 >> 3)) + (SHA256_MB_ROTATE(t2, 17) ^ \
+	    SHA256_MB_ROTATE(t2, 19) ^ (t2 >> 10)) + x[((i) + 9) & 15]; \
+} while (0)
+
+/*
+ * Process one block for each lane, with the state for lane k held in st[][k]
+ * and its block at in[k].
+ */
+#define SHA256_MB_BLOCK(vec, lanes) do { \
+	vec a, b, c, d, e, f, g, h, t1, t2, x[16]; \
+	const unsigned char *p; \
+	SHA_LONG l; \
+	int i, k; \
+ \
+	for (i = 0; i < 16; i++) { \
+		for (k = 0; k < lanes; k++) { \
+			p = in[k] + i * 4; \
+			HOST_c2l(p, l); \
+			x[i][k] = l; \
+		} \
+	} \
+ \
+	memcpy(&a, st[0], sizeof(a)); \
+	memcpy(&b, st[1], sizeof(b)); \
+	memcpy(&c, st[2], sizeof(c)); \
+	memcpy(&d, st[3], sizeof(d)); \
+	memcpy(&e, st[4], sizeof(e)); \
+	memcpy(&f, st[5], sizeof(f)); \
+	memcpy(&g, st[6], sizeof(g)); \
+	memcpy(&h, st[7], sizeof(h)); \
+ \
+	for (i = 0; i < 64; i += 8) { \
+		if (i >= 16) { \
+			for (k = i; k < i + 8; k++) \
+				SHA256_MB_SCHEDULE(k); \
+		} \
+		SHA256_MB_ROUND(i, a, b, c, d, e, f, g, h); \
+		SHA256_MB_ROUND(i + 1, h, a, b, c, d, e, f, g); \
+		SHA256_MB_ROUND(i + 2, g, h, a, b, c, d, e, f); \
+		SHA256_MB_ROUND(i + 3, f, g, h, a, b, c, d, e); \
+		SHA256_MB_ROUND(i + 4, e, f, g, h, a, b, c, d); \
+		SHA256_MB_ROUND(i + 5, d, e, f, g, h, a, b, c); \
+		SHA256_MB_ROUND(i + 6, c, d, e, f, g, h, a, b); \
+		SHA256_MB_ROUND(i + 7, b, c, d, e, f, g, h, a); \
+	} \
+ \
+	SHA256_MB_ADD(st[0], a); \
+	SHA256_MB_ADD(st[1], b); \
+	SHA256_MB_ADD(st[2], c); \
+	SHA256_MB_ADD(st[3], d); \
+	SHA256_MB_ADD(st[4], e); \
+	SHA256_MB_ADD(st[5], f); \
+	SHA256_MB_ADD(st[6], g); \
+	SHA256_MB_ADD(st[7], h); \
+} while (0)
+
+#define SHA256_MB_ADD(s, v) do { \
+	memcpy(&t1, (s), sizeof(t1)); \
+	t1 += (v); \
+	memcpy((s), &t1, sizeof(t1)); \
+} while (0)
+
+typedef void (*sha256_mb_block_f)(SHA_LONG st[8][SHA256_MB_LANES],
+    const unsigned char *in[SHA256_MB_LANES]);
+
+#ifdef SHA256_MB_AVX2
+static void __attribute__((__target__("avx2")))
+sha256_mb_block_avx2(SHA_LONG st[8][SHA256_MB_LANES],
+    const unsigned char *in[SHA256_MB_LANES])
+{
+	SHA256_MB_BLOCK(sha256_u32x8, 8);
+}
+#endif
+
+static void
+sha256_mb_block_x4(SHA_LONG st[8][SHA256_MB_LANES],
+    const unsigned char *in[SHA256_MB_LANES])
+{
+	SHA256_MB_BLOCK(sha256_u32x4, 4);
+}
+#endif
+
+/*
+ * The padded key blocks of HMAC-SHA256. A key longer than a block is hashed
+ * first.
+ */
+static void
+sha256_hmac_pads(const void *key, int key_len, unsigned char ipad[SHA_CBLOCK],
+    unsigned char opad[SHA_CBLOCK])
+{
+	unsigned char k[SHA_CBLOCK];
+	int i;
+
+	memset(k, 0, sizeof(k));
+	if (key_len > SHA_CBLOCK)
+		SHA256(key, key_len, k);
+	else if (key_len > 0)
+		memcpy(k, key, key_len);
+
+	for (i = 0; i < SHA_CBLOCK; i++) {
+		ipad[i] = k[i] ^ 0x36;
+		opad[i] = k[i] ^ 0x5c;
+	}
+
+	explicit_bzero(k, sizeof(k));
+}
+
+static void
+sha256_hmac(const void *key, int key_len, const unsigned char *d, size_t n,
+    unsigned char *md)
+{
+	SHA256_CTX ctx;
+	unsigned char ipad[SHA_CBLOCK], opad[SHA_CBLOCK];
+
+	sha256_hmac_pads(key, key_len, ipad, opad);
+
+	SHA256_Init(&ctx);
+	SHA256_Update(&ctx, ipad, sizeof(ipad));
+	SHA256_Update(&ctx, d, n);
+	SHA256_Final(md, &ctx);
+
+	SHA256_Init(&ctx);
+	SHA256_Update(&ctx, opad, sizeof(opad));
+	SHA256_Update(&ctx, md, SHA256_DIGEST_LENGTH);
+	SHA256_Final(md, &ctx);
+
+	explicit_bzero(&ctx, sizeof(ctx));
+	explicit_bzero(ipad, sizeof(ipad));
+	explicit_bzero(opad, sizeof(opad));
+}
+
+#ifdef SHA256_MB
+struct sha256_mb_lane {
+	const unsigned char *prefix;	/* Padded HMAC key block, if any. */
+	const unsigned char *in;	/* Full blocks of the message. */
+	size_t blocks;
+	unsigned char *tail;		/* Padded final blocks. */
+	size_t tail_blocks;
+	size_t msg;
+	int outer;			/* Hashing the outer HMAC message. */
+	unsigned char buf[2 * SHA_CBLOCK];
+	unsigned char ipad[SHA_CBLOCK];
+	unsigned char opad[SHA_CBLOCK];
+	unsigned char md[SHA256_DIGEST_LENGTH];
+};
+
+/*
+ * Start hashing prefix, a block or NULL, followed by the n bytes at d.
+ */
+static void
+sha256_mb_lane_start(struct sha256_mb_lane *lane,
+    SHA_LONG st[8][SHA256_MB_LANES], int k, const unsigned char *prefix,
+    const unsigned char *d, size_t n, size_t msg)
+{
+	static const SHA_LONG iv[8] = {
+		0x6a09e667UL, 0xbb67ae85UL, 0x3c6ef372UL, 0xa54ff53aUL,
+		0x510e527fUL, 0x9b05688cUL, 0x1f83d9abUL, 0x5be0cd19UL,
+	};
+	size_t rem = n % SHA_CBLOCK;
+	uint64_t bits;
+	unsigned char *p;
+	int i;
+
+	lane->prefix = prefix;
+	lane->in = d;
+	lane->blocks = n / SHA_CBLOCK;
+	lane->tail = lane->buf;
+	lane->tail_blocks = rem < SHA_CBLOCK - 8 ? 1 : 2;
+	lane->msg = msg;
+
+	bits = (uint64_t)n << 3;
+	if (prefix != NULL)
+		bits += SHA_CBLOCK * 8;
+
+	memset(lane->buf, 0, sizeof(lane->buf));
+	if (rem > 0)
+		memcpy(lane->buf, d + n - rem, rem);
+	lane->buf[rem] = 0x80;
+	p = lane->buf + lane->tail_blocks * SHA_CBLOCK - 8;
+	HOST_l2c((SHA_LONG)(bits >> 32), p);
+	HOST_l2c((SHA_LONG)bits, p);
+
+	for (i = 0; i < 8; i++)
+		st[i][k] = iv[i];
+}
+
+/*
+ * Start on message msg: its hash, or the inner hash of its HMAC if there
+ * are keys.
+ */
+static void
+sha256_mb_lane_next(struct sha256_mb_lane *lane,
+    SHA_LONG st[8][SHA256_MB_LANES], int k, const void *const *key,
+    const int *key_len, const unsigned char *const *d, const size_t *n,
+    size_t msg)
+{
+	if (key == NULL) {
+		sha256_mb_lane_start(lane, st, k, NULL, d[msg], n[msg], msg);
+		return;
+	}
+
+	sha256_hmac_pads(key[msg], key_len[msg], lane->ipad, lane->opad);
+	sha256_mb_lane_start(lane, st, k, lane->ipad, d[msg], n[msg], msg);
+	lane->outer = 0;
+}
+
+/*
+ * Hash the messages using the given kernel, or compute their HMAC if there
+ * are keys. Each lane takes the next message as soon as it has finished
+ * with the previous one, so that the lanes stay busy when the lengths
+ * differ. Idle lanes hash a block of zeroes.
+ */
+static void
+sha256_mb(const void *const *key, const int *key_len,
+    const unsigned char *const *d, const size_t *n, unsigned char *const *md,
+    size_t count, int lanes, sha256_mb_block_f block)
+{
+	static const unsigned char zero[SHA_CBLOCK];
+	struct sha256_mb_lane lane[SHA256_MB_LANES];
+	SHA_LONG st[8][SHA256_MB_LANES];
+	const unsigned char *in[SHA256_MB_LANES];
+	unsigned char *out;
+	size_t next = 0;
+	int active = 0;
+	int i, k;
+
+	for (k = 0; k < lanes; k++) {
+		lane[k].msg = count;
+		if (next < count) {
+			sha256_mb_lane_next(&lane[k], st, k, key, key_len,
+			    d, n, next);
+			next++;
+			active++;
+		}
+	}
+
+	while (active > 0) {
+		for (k = 0; k < lanes; k++) {
+			if (lane[k].msg == count)
+				in[k] = zero;
+			else if (lane[k].prefix != NULL)
+				in[k] = lane[k].prefix;
+			else if (lane[k].blocks > 0)
+				in[k] = lane[k].in;
+			else
+				in[k] = lane[k].tail;
+		}
+
+		block(st, in);
+
+		for (k = 0; k < lanes; k++) {
+			if (lane[k].msg == count)
+				continue;
+			if (lane[k].prefix != NULL) {
+				lane[k].prefix = NULL;
+				continue;
+			}
+			if (lane[k].blocks > 0) {
+				lane[k].in += SHA_CBLOCK;
+				lane[k].blocks--;
+				continue;
+			}
+			lane[k].tail += SHA_CBLOCK;
+			if (--lane[k].tail_blocks > 0)
+				continue;
+
+			if (key != NULL && !lane[k].outer) {
+				out = lane[k].md;
+				for (i = 0; i < 8; i++)
+					HOST_l2c(st[i][k], out);
+				sha256_mb_lane_start(&lane[k], st, k,
+				    lane[k].opad, lane[k].md,
+				    SHA256_DIGEST_LENGTH, lane[k].msg);
+				lane[k].outer = 1;
+				continue;
+			}
+
+			out = md[lane[k].msg];
+			for (i = 0; i < 8; i++)
+				HOST_l2c(st[i][k], out);
+
+			lane[k].msg = count;
+			active--;
+			if (next < count) {
+				sha256_mb_lane_next(&lane[k], st, k, key,
+				    key_len, d, n, next);
+				next++;
+				active++;
+			}
+		}
+	}
+
+	explicit_bzero(lane, sizeof(lane));
+	explicit_bzero(st, sizeof(st));
+}
+#endif
+
+/*
+ * The SHA extensions hash a single message faster than the multi-buffer
+ * kernels, so the kernels are only used on CPUs without them.
+ */
+static void
+sha256_multi(const void *const *key, const int *key_len,
+    const unsigned char *const *d, const size_t *n, unsigned char *const *md,
+    size_t count)
+{
+	size_t i;
+
+#ifdef SHA256_MB_AVX2
+	if ((OPENSSL_cpu_caps() & (CPUCAP_MASK_AVX2 | CPUCAP_MASK_SHA)) ==
+	    CPUCAP_MASK_AVX2 && count >= 4) {
+		sha256_mb(key, key_len, d, n, md, count, 8,
+		    sha256_mb_block_avx2);
+		return;
+	}
+#endif
+#ifdef SHA256_MB_SSE2
+	if ((OPENSSL_cpu_caps() & CPUCAP_MASK_SHA) == 0 && count >= 3) {
+		sha256_mb(key, key_len, d, n, md, count, 4,
+		    sha256_mb_block_x4);
+		return;
+	}
+#endif
+#ifdef SHA256_MB_NEON
+	if ((OPENSSL_armcap_P & ARMV8_SHA256) == 0 && count >= 3) {
+		sha256_mb(key, key_len, d, n, md, count, 4,
+		    sha256_mb_block_x4);
+		return;
+	}
+#endif
+
+	for (i = 0; i < count; i++) {
+		if (key == NULL)
+			SHA256(d[i], n[i], md[i]);
+		else
+			sha256_hmac(key[i], key_len[i], d[i], n[i], md[i]);
+	}
+}
+
+void
+SHA256_multi(const unsigned char *const *d, const size_t *n,
+    unsigned char *const *md, size_t count)
+{
+	sha256_multi(NULL, NULL, d, n, md, count);
+}
+
+/*
+ * HMAC-SHA256 of count messages, each with its own key.
+ */
+void
+sha256_hmac_multi(const void *const *key, const int *key_len,
+    const unsigned char *const *d, const size_t *n, unsigned char *const *md,
+    size_t count)
+{
+	sha256_multi(key, key_len, d, n, md, count);
+}
+
+/*
+ * Each PBKDF2 iteration is an HMAC of the previous digest. It takes one block
+ * from the inner key state and one from the outer key state, and both blocks
+ * hold a digest followed by the padding for a message of 96 bytes.
+ */
+static void
+sha256_pbkdf2_pad(unsigned char blk[SHA_CBLOCK])
+{
+	unsigned char *p = blk + SHA_CBLOCK - 8;
+
+	memset(blk + SHA256_DIGEST_LENGTH, 0,
+	    SHA_CBLOCK - SHA256_DIGEST_LENGTH);
+	blk[SHA256_DIGEST_LENGTH] = 0x80;
+	HOST_l2c(0, p);
+	HOST_l2c((SHA_CBLOCK + SHA256_DIGEST_LENGTH) * 8, p);
+}
+
+static void
+sha256_pbkdf2_chain(struct sha256_pbkdf2_chain *c, int iter)
+{
+	SHA256_CTX ctx;
+	unsigned char blk[SHA_CBLOCK], *p;
+	int i, j;
+
+	sha256_pbkdf2_pad(blk);
+	memcpy(blk, c->u, SHA256_DIGEST_LENGTH);
+
+	for (j = 1; j < iter; j++) {
+		memcpy(ctx.h, c->istate, sizeof(ctx.h));
+		sha256_block_data_order(&ctx, blk, 1);
+		for (p = blk, i = 0; i < 8; i++)
+			HOST_l2c(ctx.h[i], p);
+
+		memcpy(ctx.h, c->ostate, sizeof(ctx.h));
+		sha256_block_data_order(&ctx, blk, 1);
+		for (p = blk, i = 0; i < 8; i++)
+			HOST_l2c(ctx.h[i], p);
+
+		for (i = 0; i < SHA256_DIGEST_LENGTH; i++)
+			c->t[i] ^= blk[i];
+	}
+
+	explicit_bzero(&ctx, sizeof(ctx));
+	explicit_bzero(blk, sizeof(blk));
+}
+
+#ifdef SHA256_MB
+/*
+ * Run the chains in groups of one chain per lane. All chains take the same
+ * number of iterations, so the lanes of a group finish together.
+ */
+static void
+sha256_pbkdf2_mb(struct sha256_pbkdf2_chain *c, size_t count, int iter,
+    int lanes, sha256_mb_block_f block)
+{
+	static const unsigned char zero[SHA_CBLOCK];
+	unsigned char blk[SHA256_MB_LANES][SHA_CBLOCK], *p;
+	const unsigned char *in[SHA256_MB_LANES];
+	SHA_LONG st[8][SHA256_MB_LANES];
+	int i, j, k, n;
+
+	memset(st, 0, sizeof(st));
+
+	for (; count > 0; c += n, count -= n) {
+		n = count < (size_t)lanes ? (int)count : lanes;
+		for (k = 0; k < lanes; k++) {
+			in[k] = zero;
+			if (k < n) {
+				sha256_pbkdf2_pad(blk[k]);
+				memcpy(blk[k], c[k].u, SHA256_DIGEST_LENGTH);
+				in[k] = blk[k];
+			}
+		}
+
+		for (j = 1; j < iter; j++) {
+			for (k = 0; k < n; k++) {
+				for (i = 0; i < 8; i++)
+					st[i][k] = c[k].istate[i];
+			}
+			block(st, in);
+			for (k = 0; k < n; k++) {
+				for (p = blk[k], i = 0; i < 8; i++)
+					HOST_l2c(st[i][k], p);
+				for (i = 0; i < 8; i++)
+					st[i][k] = c[k].ostate[i];
+			}
+			block(st, in);
+			for (k = 0; k < n; k++) {
+				for (p = blk[k], i = 0; i < 8; i++)
+					HOST_l2c(st[i][k], p);
+				for (i = 0; i < SHA256_DIGEST_LENGTH; i++)
+					c[k].t[i] ^= blk[k][i];
+			}
+		}
+	}
+
+	explicit_bzero(blk, sizeof(blk));
+	explicit_bzero(st, sizeof(st));
+}
+#endif
+
+/*
+ * Run iterations 2 to iter of each chain, the first being done by the
+ * caller. The kernels are chosen as for SHA256_multi().
+ */
+void
+sha256_pbkdf2_iterate(struct sha256_pbkdf2_chain *chains, size_t count,
+    int iter)
+{
+	size_t i;
+
+#ifdef SHA256_MB_AVX2
+	if ((OPENSSL_cpu_caps() & (CPUCAP_MASK_AVX2 | CPUCAP_MASK_SHA)) ==
+	    CPUCAP_MASK_AVX2 && count >= 4) {
+		sha256_pbkdf2_mb(chains, count, iter, 8, sha256_mb_block_avx2);
+		return;
+	}
+#endif
+#ifdef SHA256_MB_SSE2
+	if ((OPENSSL_cpu_caps() & CPUCAP_MASK_SHA) == 0 && count >= 3) {
+		sha256_pbkdf2_mb(chains, count, iter, 4, sha256_mb_block_x4);
+		return;
+	}
+#endif
+#ifdef SHA256_MB_NEON
+	if ((OPENSSL_armcap_P & ARMV8_SHA256) == 0 && count >= 3) {
+		sha256_pbkdf2_mb(chains, count, iter, 4, sha256_mb_block_x4);
+		return;
+	}
+#endif
+
+	for (i = 0; i < count; i++)
+		sha256_pbkdf2_chain(&chains[i], iter);
+}
+
 #endif /* OPENSSL_NO_SHA256 */
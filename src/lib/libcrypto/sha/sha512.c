@@ -57,6 +57,15 @@
 #define SHA512_BLOCK_CAN_MANAGE_UNALIGNED_DATA
 #endif
 
+#ifdef __aarch64__
+#include "arm_arch.h"
+#endif
+
+#if !defined(SHA512_ASM) && defined(ARMV8_CE)
+#include <arm_neon.h>
+#define SHA512_ARMV8
+#endif
+
 int SHA384_Init(SHA512_CTX *c)
 	{
 	c->h[0]=U64(0xcbbb9d5dc1059ed8);
@@ -351,6 +360,86 @@ static const SHA_LONG64 K512[80] = {
 #define Ch(x,y,z)	(((x) & (y)) ^ ((~(x)) & (z)))
 #define Maj(x,y,z)	(((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
 
+#ifdef SHA512_ARMV8
+/*
+ * SHA-512 using the ARMv8.2 SHA-512 instructions, which perform two rounds
+ * and extend the message schedule by two words at a time. The state is held
+ * as the pairs ab, cd, ef and gh - after each pair of rounds the new ab and
+ * ef are written over cd and gh, so the roles of the variables alternate.
+ */
+#define SHA512_V8_ROUND2(i, ab, cd, ef, gh, w0, w1, w4, w5, w7) do {	\
+	wk = vaddq_u64(w0, vld1q_u64((const uint64_t *)&K512[i]));	\
+	t = vaddq_u64(gh, vextq_u64(wk, wk, 1));			\
+	t = vsha512hq_u64(t, vextq_u64(ef, gh, 1), vextq_u64(cd, ef, 1)); \
+	gh = vaddq_u64(cd, t);						\
+	cd = vsha512h2q_u64(t, cd, ab);					\
+	if ((i) < 64)							\
+		w0 = vsha512su1q_u64(vsha512su0q_u64(w0, w1), w7,	\
+		    vextq_u64(w4, w5, 1));				\
+} while (0)
+
+static void ARMV8_TARGET(sha3)
+sha512_block_armv8(SHA512_CTX *ctx, const void *in, size_t num)
+{
+	const unsigned char *data = in;
+	uint64x2_t ab, cd, ef, gh, ab0, cd0, ef0, gh0, wk, t;
+	uint64x2_t w0, w1, w2, w3, w4, w5, w6, w7;
+	uint64_t *h = (uint64_t *)ctx->h;
+	int i;
+
+	ab = vld1q_u64(&h[0]);
+	cd = vld1q_u64(&h[2]);
+	ef = vld1q_u64(&h[4]);
+	gh = vld1q_u64(&h[6]);
+
+	while (num--) {
+		ab0 = ab;
+		cd0 = cd;
+		ef0 = ef;
+		gh0 = gh;
+
+		w0 = vreinterpretq_u64_u8(vrev64q_u8(vld1q_u8(data)));
+		w1 = vreinterpretq_u64_u8(vrev64q_u8(vld1q_u8(data + 16)));
+		w2 = vreinterpretq_u64_u8(vrev64q_u8(vld1q_u8(data + 32)));
+		w3 = vreinterpretq_u64_u8(vrev64q_u8(vld1q_u8(data + 48)));
+		w4 = vreinterpretq_u64_u8(vrev64q_u8(vld1q_u8(data + 64)));
+		w5 = vreinterpretq_u64_u8(vrev64q_u8(vld1q_u8(data + 80)));
+		w6 = vreinterpretq_u64_u8(vrev64q_u8(vld1q_u8(data + 96)));
+		w7 = vreinterpretq_u64_u8(vrev64q_u8(vld1q_u8(data + 112)));
+
+		for (i = 0; i < 80; i += 16) {
+			SHA512_V8_ROUND2(i, ab, cd, ef, gh,
+			    w0, w1, w4, w5, w7);
+			SHA512_V8_ROUND2(i + 2, cd, ab, gh, ef,
+			    w1, w2, w5, w6, w0);
+			SHA512_V8_ROUND2(i + 4, ab, cd, ef, gh,
+			    w2, w3, w6, w7, w1);
+			SHA512_V8_ROUND2(i + 6, cd, ab, gh, ef,
+			    w3, w4, w7, w0, w2);
+			SHA512_V8_ROUND2(i + 8, ab, cd, ef, gh,
+			    w4, w5, w0, w1, w3);
+			SHA512_V8_ROUND2(i + 10, cd, ab, gh, ef,
+			    w5, w6, w1, w2, w4);
+			SHA512_V8_ROUND2(i + 12, ab, cd, ef, gh,
+			    w6, w7, w2, w3, w5);
+			SHA512_V8_ROUND2(i + 14, cd, ab, gh, ef,
+			    w7, w0, w3, w4, w6);
+		}
+
+		ab = vaddq_u64(ab, ab0);
+		cd = vaddq_u64(cd, cd0);
+		ef = vaddq_u64(ef, ef0);
+		gh = vaddq_u64(gh, gh0);
+
+		data += SHA512_CBLOCK;
+	}
+
+	vst1q_u64(&h[0], ab);
+	vst1q_u64(&h[2], cd);
+	vst1q_u64(&h[4], ef);
+	vst1q_u64(&h[6], gh);
+}
+#endif
 
 #if defined(__i386) || defined(__i386__) || defined(_M_IX86)
 /*
@@ -415,6 +504,13 @@ static void sha512_block_data_order (SHA512_CTX *ctx, const void *in, size_t num
 	SHA_LONG64	X[16];
 	int i;
 
+#ifdef SHA512_ARMV8
+	if ((OPENSSL_armcap_P & ARMV8_SHA512) != 0) {
+		sha512_block_armv8(ctx, in, num);
+		return;
+	}
+#endif
+
 			while (num--) {
 
 	a = ctx->h[0];	b = ctx->h[1];	c = ctx->h[2];	d = ctx->h[3];
@@ -472,6 +568,13 @@ static void sha512_block_data_order (SHA512_CTX *ctx, const void *in, size_t num
 	SHA_LONG64	X[16];
 	int i;
 
+#ifdef SHA512_ARMV8
+	if ((OPENSSL_armcap_P & ARMV8_SHA512) != 0) {
+		sha512_block_armv8(ctx, in, num);
+		return;
+	}
+#endif
+
 			while (num--) {
 
 	a = ctx->h[0];	b = ctx->h[1];	c = ctx->h[2];	d = ctx->h[3];
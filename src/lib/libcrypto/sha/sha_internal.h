@@ -0,0 +1,46 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef HEADER_SHA_INTERNAL_H
+#define HEADER_SHA_INTERNAL_H
+
+#include <openssl/sha.h>
+
+__BEGIN_HIDDEN_DECLS
+
+#ifndef OPENSSL_NO_SHA256
+/*
+ * One PBKDF2-HMAC-SHA256 output block: the hash states after the inner and
+ * outer padded key blocks, the first iteration u and the running xor t.
+ */
+struct sha256_pbkdf2_chain {
+	SHA_LONG istate[8];
+	SHA_LONG ostate[8];
+	unsigned char u[SHA256_DIGEST_LENGTH];
+	unsigned char t[SHA256_DIGEST_LENGTH];
+};
+
+void sha256_pbkdf2_iterate(struct sha256_pbkdf2_chain *chains, size_t count,
+    int iter);
+void sha256_hmac_multi(const void *const *key, const int *key_len,
+    const unsigned char *const *d, const size_t *n, unsigned char *const *md,
+    size_t count);
+#endif
+
+__END_HIDDEN_DECLS
+
+#endif /* !HEADER_SHA_INTERNAL_H */
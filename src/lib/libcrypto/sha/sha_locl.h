@@ -62,6 +62,15 @@
 #include <openssl/opensslconf.h>
 #include <openssl/sha.h>
 
+#ifdef __aarch64__
+#include "arm_arch.h"
+#endif
+
+#if !defined(SHA1_ASM) && defined(ARMV8_CE)
+#include <arm_neon.h>
+#define SHA1_ARMV8
+#endif
+
 #define DATA_ORDER_IS_BIG_ENDIAN
 
 #define HASH_LONG               SHA_LONG
@@ -119,6 +128,99 @@ int SHA1_Init(SHA_CTX *c)
 #define K_40_59 0x8f1bbcdcUL
 #define K_60_79 0xca62c1d6UL
 
+#ifdef SHA1_ARMV8
+/*
+ * SHA-1 using the ARMv8 Crypto Extensions, which perform four rounds and
+ * extend the message schedule by four words at a time.
+ */
+#define SHA1_V8_ROUND4(i, f, k, w0, w1, w2, w3) do {			\
+	wk = vaddq_u32(w0, vdupq_n_u32(k));				\
+	e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));			\
+	abcd = f(abcd, e, wk);						\
+	e = e1;								\
+	if ((i) < 16)							\
+		w0 = vsha1su1q_u32(vsha1su0q_u32(w0, w1, w2), w3);	\
+} while (0)
+
+static void ARMV8_TARGET(sha2)
+sha1_block_armv8(SHA_CTX *c, const void *p, size_t num)
+{
+	const unsigned char *data = p;
+	uint32x4_t abcd, abcd0, w0, w1, w2, w3, wk;
+	uint32_t h[4], e, e0, e1;
+
+	h[0] = c->h0;
+	h[1] = c->h1;
+	h[2] = c->h2;
+	h[3] = c->h3;
+	abcd = vld1q_u32(h);
+	e = c->h4;
+
+	while (num--) {
+		abcd0 = abcd;
+		e0 = e;
+
+		w0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data)));
+		w1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16)));
+		w2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 32)));
+		w3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 48)));
+
+		SHA1_V8_ROUND4(0, vsha1cq_u32, K_00_19,
+		    w0, w1, w2, w3);
+		SHA1_V8_ROUND4(1, vsha1cq_u32, K_00_19,
+		    w1, w2, w3, w0);
+		SHA1_V8_ROUND4(2, vsha1cq_u32, K_00_19,
+		    w2, w3, w0, w1);
+		SHA1_V8_ROUND4(3, vsha1cq_u32, K_00_19,
+		    w3, w0, w1, w2);
+		SHA1_V8_ROUND4(4, vsha1cq_u32, K_00_19,
+		    w0, w1, w2, w3);
+		SHA1_V8_ROUND4(5, vsha1pq_u32, K_20_39,
+		    w1, w2, w3, w0);
+		SHA1_V8_ROUND4(6, vsha1pq_u32, K_20_39,
+		    w2, w3, w0, w1);
+		SHA1_V8_ROUND4(7, vsha1pq_u32, K_20_39,
+		    w3, w0, w1, w2);
+		SHA1_V8_ROUND4(8, vsha1pq_u32, K_20_39,
+		    w0, w1, w2, w3);
+		SHA1_V8_ROUND4(9, vsha1pq_u32, K_20_39,
+		    w1, w2, w3, w0);
+		SHA1_V8_ROUND4(10, vsha1mq_u32, K_40_59,
+		    w2, w3, w0, w1);
+		SHA1_V8_ROUND4(11, vsha1mq_u32, K_40_59,
+		    w3, w0, w1, w2);
+		SHA1_V8_ROUND4(12, vsha1mq_u32, K_40_59,
+		    w0, w1, w2, w3);
+		SHA1_V8_ROUND4(13, vsha1mq_u32, K_40_59,
+		    w1, w2, w3, w0);
+		SHA1_V8_ROUND4(14, vsha1mq_u32, K_40_59,
+		    w2, w3, w0, w1);
+		SHA1_V8_ROUND4(15, vsha1pq_u32, K_60_79,
+		    w3, w0, w1, w2);
+		SHA1_V8_ROUND4(16, vsha1pq_u32, K_60_79,
+		    w0, w1, w2, w3);
+		SHA1_V8_ROUND4(17, vsha1pq_u32, K_60_79,
+		    w1, w2, w3, w0);
+		SHA1_V8_ROUND4(18, vsha1pq_u32, K_60_79,
+		    w2, w3, w0, w1);
+		SHA1_V8_ROUND4(19, vsha1pq_u32, K_60_79,
+		    w3, w0, w1, w2);
+
+		abcd = vaddq_u32(abcd, abcd0);
+		e += e0;
+
+		data += SHA_CBLOCK;
+	}
+
+	vst1q_u32(h, abcd);
+	c->h0 = h[0];
+	c->h1 = h[1];
+	c->h2 = h[2];
+	c->h3 = h[3];
+	c->h4 = e;
+}
+#endif
+
 /* As  pointed out by Wei Dai <weidai@eskimo.com>, F() below can be
  * simplified to the code in F_00_19.  Wei attributes these optimisations
  * to Peter Gutmann's SHS code, and he attributes it to Rich Schroeppel.
@@ -198,6 +300,13 @@ static void HASH_BLOCK_DATA_ORDER (SHA_CTX *c, const void *p, size_t num)
 	SHA_LONG	XX[16];
 #endif
 
+#ifdef SHA1_ARMV8
+	if ((OPENSSL_armcap_P & ARMV8_SHA1) != 0) {
+		sha1_block_armv8(c, p, num);
+		return;
+	}
+#endif
+
 	A=c->h0;
 	B=c->h1;
 	C=c->h2;
@@ -379,6 +488,13 @@ static void HASH_BLOCK_DATA_ORDER (SHA_CTX *c, const void *p, size_t num)
 	int i;
 	SHA_LONG	X[16];
 
+#ifdef SHA1_ARMV8
+	if ((OPENSSL_armcap_P & ARMV8_SHA1) != 0) {
+		sha1_block_armv8(c, p, num);
+		return;
+	}
+#endif
+
 	A=c->h0;
 	B=c->h1;
 	C=c->h2;
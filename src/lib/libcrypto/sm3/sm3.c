@@ -17,10 +17,18 @@
 
 #ifndef OPENSSL_NO_SM3
 
+#include <openssl/crypto.h>
 #include <openssl/sm3.h>
 
+#include "cryptlib.h"
 #include "sm3_locl.h"
 
+#ifdef SM3_AVX2
+#include <immintrin.h>
+
+#include "x86_arch.h"
+#endif
+
 int
 SM3_Init(SM3_CTX *c)
 {
@@ -36,6 +44,159 @@ SM3_Init(SM3_CTX *c)
 	return 1;
 }
 
+#ifdef SM3_AVX2
+/*
+ * The message schedule does not depend on the chaining value, so that of
+ * eight blocks is expanded at once, with one block in each 32 bit lane after
+ * a transpose. The rounds then run on each block in turn, and read the
+ * expanded words from memory.
+ */
+
+#define SM3_AVX2_BLOCKS	8
+
+/* T_j rotated left by j, as in the rounds of SM3_block_data_order(). */
+static const SM3_WORD sm3_avx2_t[64] = {
+	0x79cc4519, 0xf3988a32, 0xe7311465, 0xce6228cb,
+	0x9cc45197, 0x3988a32f, 0x7311465e, 0xe6228cbc,
+	0xcc451979, 0x988a32f3, 0x311465e7, 0x6228cbce,
+	0xc451979c, 0x88a32f39, 0x11465e73, 0x228cbce6,
+	0x9d8a7a87, 0x3b14f50f, 0x7629ea1e, 0xec53d43c,
+	0xd8a7a879, 0xb14f50f3, 0x629ea1e7, 0xc53d43ce,
+	0x8a7a879d, 0x14f50f3b, 0x29ea1e76, 0x53d43cec,
+	0xa7a879d8, 0x4f50f3b1, 0x9ea1e762, 0x3d43cec5,
+	0x7a879d8a, 0xf50f3b14, 0xea1e7629, 0xd43cec53,
+	0xa879d8a7, 0x50f3b14f, 0xa1e7629e, 0x43cec53d,
+	0x879d8a7a, 0x0f3b14f5, 0x1e7629ea, 0x3cec53d4,
+	0x79d8a7a8, 0xf3b14f50, 0xe7629ea1, 0xcec53d43,
+	0x9d8a7a87, 0x3b14f50f, 0x7629ea1e, 0xec53d43c,
+	0xd8a7a879, 0xb14f50f3, 0x629ea1e7, 0xc53d43ce,
+	0x8a7a879d, 0x14f50f3b, 0x29ea1e76, 0x53d43cec,
+	0xa7a879d8, 0x4f50f3b1, 0x9ea1e762, 0x3d43cec5,
+};
+
+static const uint8_t sm3_avx2_bswap[16] = {
+	0x03, 0x02, 0x01, 0x00, 0x07, 0x06, 0x05, 0x04,
+	0x0b, 0x0a, 0x09, 0x08, 0x0f, 0x0e, 0x0d, 0x0c,
+};
+
+#define SM3_AVX2_ROTATE(v, n) \
+	(_mm256_slli_epi32((v), (n)) | _mm256_srli_epi32((v), 32 - (n)))
+
+/*
+ * Load a word from each of the eight blocks at p into x, for eight
+ * consecutive words, by transposing an 8 by 8 word matrix.
+ */
+#define SM3_AVX2_LOAD(x, p) do { \
+	for (i = 0; i < 8; i++) \
+		r[i] = _mm256_loadu_si256((const __m256i *)((p) + \
+		    i * SM3_CBLOCK)); \
+	for (i = 0; i < 8; i += 2) { \
+		t[i] = _mm256_unpacklo_epi32(r[i], r[i + 1]); \
+		t[i + 1] = _mm256_unpackhi_epi32(r[i], r[i + 1]); \
+	} \
+	for (i = 0; i < 8; i += 4) { \
+		r[i] = _mm256_unpacklo_epi64(t[i], t[i + 2]); \
+		r[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]); \
+		r[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]); \
+		r[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]); \
+	} \
+	for (i = 0; i < 4; i++) { \
+		(x)[i] = _mm256_shuffle_epi8(_mm256_permute2x128_si256( \
+		    r[i], r[i + 4], 0x20), bswap); \
+		(x)[i + 4] = _mm256_shuffle_epi8(_mm256_permute2x128_si256( \
+		    r[i], r[i + 4], 0x31), bswap); \
+	} \
+} while (0)
+
+/* Expand the message schedule of the eight blocks at data into w. */
+static void __attribute__((__target__("avx2")))
+sm3_avx2_schedule(const unsigned char *data, SM3_WORD w[68][SM3_AVX2_BLOCKS])
+{
+	__m256i bswap, r[8], t[8], x[68], v;
+	int i;
+
+	bswap = _mm256_broadcastsi128_si256(
+	    _mm_loadu_si128((const __m128i *)sm3_avx2_bswap));
+
+	SM3_AVX2_LOAD(&x[0], data);
+	SM3_AVX2_LOAD(&x[8], data + 32);
+
+	for (i = 16; i < 68; i++) {
+		v = x[i - 16] ^ x[i - 9] ^ SM3_AVX2_ROTATE(x[i - 3], 15);
+		x[i] = v ^ SM3_AVX2_ROTATE(v, 15) ^ SM3_AVX2_ROTATE(v, 23) ^
+		    SM3_AVX2_ROTATE(x[i - 13], 7) ^ x[i - 6];
+	}
+	for (i = 0; i < 68; i++)
+		_mm256_storeu_si256((__m256i *)w[i], x[i]);
+
+	explicit_bzero(x, sizeof(x));
+}
+
+#define SM3_AVX2_ROUNDS(R, j) do { \
+	R(A, B, C, D, E, F, G, H, sm3_avx2_t[(j)], w[(j)][b], \
+	    w[(j)][b] ^ w[(j) + 4][b]); \
+	R(D, A, B, C, H, E, F, G, sm3_avx2_t[(j) + 1], w[(j) + 1][b], \
+	    w[(j) + 1][b] ^ w[(j) + 5][b]); \
+	R(C, D, A, B, G, H, E, F, sm3_avx2_t[(j) + 2], w[(j) + 2][b], \
+	    w[(j) + 2][b] ^ w[(j) + 6][b]); \
+	R(B, C, D, A, F, G, H, E, sm3_avx2_t[(j) + 3], w[(j) + 3][b], \
+	    w[(j) + 3][b] ^ w[(j) + 7][b]); \
+} while (0)
+
+/* Process a multiple of eight blocks. */
+static void
+sm3_avx2_block_data_order(SM3_CTX *ctx, const unsigned char *data, size_t num)
+{
+	SM3_WORD w[68][SM3_AVX2_BLOCKS];
+	SM3_WORD A, B, C, D, E, F, G, H;
+	int b;
+
+	for (; num >= SM3_AVX2_BLOCKS; num -= SM3_AVX2_BLOCKS) {
+		sm3_avx2_schedule(data, w);
+		data += SM3_AVX2_BLOCKS * SM3_CBLOCK;
+
+		for (b = 0; b < SM3_AVX2_BLOCKS; b++) {
+			A = ctx->A;
+			B = ctx->B;
+			C = ctx->C;
+			D = ctx->D;
+			E = ctx->E;
+			F = ctx->F;
+			G = ctx->G;
+			H = ctx->H;
+
+			SM3_AVX2_ROUNDS(R1, 0);
+			SM3_AVX2_ROUNDS(R1, 4);
+			SM3_AVX2_ROUNDS(R1, 8);
+			SM3_AVX2_ROUNDS(R1, 12);
+			SM3_AVX2_ROUNDS(R2, 16);
+			SM3_AVX2_ROUNDS(R2, 20);
+			SM3_AVX2_ROUNDS(R2, 24);
+			SM3_AVX2_ROUNDS(R2, 28);
+			SM3_AVX2_ROUNDS(R2, 32);
+			SM3_AVX2_ROUNDS(R2, 36);
+			SM3_AVX2_ROUNDS(R2, 40);
+			SM3_AVX2_ROUNDS(R2, 44);
+			SM3_AVX2_ROUNDS(R2, 48);
+			SM3_AVX2_ROUNDS(R2, 52);
+			SM3_AVX2_ROUNDS(R2, 56);
+			SM3_AVX2_ROUNDS(R2, 60);
+
+			ctx->A ^= A;
+			ctx->B ^= B;
+			ctx->C ^= C;
+			ctx->D ^= D;
+			ctx->E ^= E;
+			ctx->F ^= F;
+			ctx->G ^= G;
+			ctx->H ^= H;
+		}
+	}
+
+	explicit_bzero(w, sizeof(w));
+}
+#endif
+
 void
 SM3_block_data_order(SM3_CTX *ctx, const void *p, size_t num)
 {
@@ -43,6 +204,17 @@ SM3_block_data_order(SM3_CTX *ctx, const void *p, size_t num)
 	SM3_WORD A, B, C, D, E, F, G, H;
 	SM3_WORD W00, W01, W02, W03, W04, W05, W06, W07;
 	SM3_WORD W08, W09, W10, W11, W12, W13, W14, W15;
+#ifdef SM3_AVX2
+	size_t n;
+
+	if (num >= SM3_AVX2_BLOCKS &&
+	    (OPENSSL_cpu_caps() & CPUCAP_MASK_AVX2) != 0) {
+		n = num - num % SM3_AVX2_BLOCKS;
+		sm3_avx2_block_data_order(ctx, data, n);
+		data += n * SM3_CBLOCK;
+		num -= n;
+	}
+#endif
 
 	while (num-- != 0) {
 		A = ctx->A;
@@ -203,4 +375,14 @@ SM3_block_data_order(SM3_CTX *ctx, const void *p, size_t num)
 	}
 }
 
+const char *
+sm3_implementation(void)
+{
+#ifdef SM3_AVX2
+	if ((OPENSSL_cpu_caps() & CPUCAP_MASK_AVX2) != 0)
+		return "avx2";
+#endif
+	return "c";
+}
+
 #endif /* !OPENSSL_NO_SM3 */
@@ -40,6 +40,13 @@
 } while (0)
 #define HASH_BLOCK_DATA_ORDER   SM3_block_data_order
 
+/* The message schedule of eight blocks at a time in AVX2 registers. */
+#if defined(OPENSSL_SM3_AVX2) && \
+    (defined(__x86_64) || defined(__x86_64__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 8))
+#define SM3_AVX2
+#endif
+
 void SM3_block_data_order(SM3_CTX *c, const void *p, size_t num);
 void SM3_transform(SM3_CTX *c, const unsigned char *data);
 
@@ -18,11 +18,15 @@
 #include <openssl/opensslconf.h>
 
 #ifndef OPENSSL_NO_SM4
+#include <openssl/crypto.h>
 #include <openssl/sm4.h>
 
-struct sm4_key {
-        uint32_t rk[SM4_KEY_SCHEDULE];
-};
+#include "cryptlib.h"
+#include "sm4_locl.h"
+
+#ifdef SM4_AESNI
+#include "x86_arch.h"
+#endif
 
 static const uint8_t SM4_S[256] = {
 	0xD6, 0x90, 0xE9, 0xFE, 0xCC, 0xE1, 0x3D, 0xB7, 0x16, 0xB6, 0x14, 0xC2,
@@ -260,4 +264,17 @@ SM4_decrypt(const uint8_t *in, uint8_t *out, const SM4_KEY *k)
 	store_u32_be(B0, out + 12);
 }
 
+const char *
+sm4_implementation(void)
+{
+#ifdef SM4_AESNI
+	if (sm4_aesni_capable()) {
+		if ((OPENSSL_cpu_caps() & CPUCAP_MASK_VAES) != 0)
+			return "vaes-avx2";
+		return "aesni-avx2";
+	}
+#endif
+	return "c";
+}
+
 #endif /* OPENSSL_NO_SM4 */
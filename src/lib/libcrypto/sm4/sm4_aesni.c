@@ -0,0 +1,424 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * SM4 on 8 blocks at a time in xmm registers, or 16 in ymm registers, with
+ * AES-NI and AVX2.
+ *
+ * The blocks are word sliced: after a transpose of each group of four
+ * blocks, vector j holds word j of each of them, and a round is done on all
+ * the blocks with 32 bit lane operations. The S-box is inversion in GF(2^8)
+ * between two affine maps, as is the AES S-box in another representation of
+ * the field. A lookup is therefore an affine map into the AES
+ * representation, AESENCLAST with a zero key, and an affine map back that
+ * also undoes the one of AES, each affine map being two 4 bit table lookups
+ * with PSHUFB. AESENCLAST also applies ShiftRows, which moves bytes between
+ * lanes, so the input is shuffled by the inverse first. The rotations of the
+ * linear transform are byte shuffles, except for the one by two bits.
+ *
+ * Two groups are processed together, to hide the latency of AESENCLAST. The
+ * 16 block kernel uses VAES where available, and otherwise applies
+ * AESENCLAST to each half of the ymm registers.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <openssl/crypto.h>
+#include <openssl/modes.h>
+#include <openssl/sm4.h>
+
+#include "sm4_locl.h"
+
+#ifdef SM4_AESNI
+
+#include <immintrin.h>
+
+#include "x86_arch.h"
+
+#define SM4_AESNI_TARGET \
+	__attribute__((__target__("aes,avx2")))
+#define SM4_VAES_TARGET \
+	__attribute__((__target__("aes,avx2,vaes")))
+
+#define SM4_AESNI_MAX_BLOCKS	16
+
+/*
+ * The affine maps around the AES S-box, as tables for the low and the high
+ * nibble of a byte.
+ */
+static const uint8_t sm4_aesni_pre[2][16] = {
+	{
+		0x3e, 0xb2, 0x0e, 0x82, 0xbb, 0x37, 0x8b, 0x07,
+		0xa1, 0x2d, 0x91, 0x1d, 0x24, 0xa8, 0x14, 0x98,
+	},
+	{
+		0x00, 0xdc, 0x2e, 0xf2, 0xc5, 0x19, 0xeb, 0x37,
+		0x08, 0xd4, 0x26, 0xfa, 0xcd, 0x11, 0xe3, 0x3f,
+	},
+};
+
+static const uint8_t sm4_aesni_post[2][16] = {
+	{
+		0x6c, 0xd4, 0xa6, 0x1e, 0x52, 0xea, 0x98, 0x20,
+		0x0b, 0xb3, 0xc1, 0x79, 0x35, 0x8d, 0xff, 0x47,
+	},
+	{
+		0x00, 0xe0, 0x50, 0xb0, 0x9d, 0x7d, 0xcd, 0x2d,
+		0xc0, 0x20, 0x90, 0x70, 0x5d, 0xbd, 0x0d, 0xed,
+	},
+};
+
+static const uint8_t sm4_aesni_inv_shift_rows[16] = {
+	0x00, 0x0d, 0x0a, 0x07, 0x04, 0x01, 0x0e, 0x0b,
+	0x08, 0x05, 0x02, 0x0f, 0x0c, 0x09, 0x06, 0x03,
+};
+
+/* Byte shuffles within each 32 bit lane. */
+static const uint8_t sm4_aesni_bswap[16] = {
+	0x03, 0x02, 0x01, 0x00, 0x07, 0x06, 0x05, 0x04,
+	0x0b, 0x0a, 0x09, 0x08, 0x0f, 0x0e, 0x0d, 0x0c,
+};
+
+static const uint8_t sm4_aesni_rotl8[16] = {
+	0x03, 0x00, 0x01, 0x02, 0x07, 0x04, 0x05, 0x06,
+	0x0b, 0x08, 0x09, 0x0a, 0x0f, 0x0c, 0x0d, 0x0e,
+};
+
+static const uint8_t sm4_aesni_rotl16[16] = {
+	0x02, 0x03, 0x00, 0x01, 0x06, 0x07, 0x04, 0x05,
+	0x0a, 0x0b, 0x08, 0x09, 0x0e, 0x0f, 0x0c, 0x0d,
+};
+
+static const uint8_t sm4_aesni_rotl24[16] = {
+	0x01, 0x02, 0x03, 0x00, 0x05, 0x06, 0x07, 0x04,
+	0x09, 0x0a, 0x0b, 0x08, 0x0d, 0x0e, 0x0f, 0x0c,
+};
+
+/*
+ * Operations on the vectors of each kernel. A group is four blocks in xmm
+ * registers, and eight in ymm registers, where vector i holds block i in its
+ * low half and block i + 4 in its high half, which the unpacks keep apart.
+ */
+#define SM4_AESNI_X_GROUP		4
+#define SM4_AESNI_X_LOAD(p, i) \
+	_mm_loadu_si128((const __m128i *)(p) + (i))
+#define SM4_AESNI_X_STORE(p, i, v) \
+	_mm_storeu_si128((__m128i *)(p) + (i), (v))
+#define SM4_AESNI_X_TABLE(t) \
+	_mm_loadu_si128((const __m128i *)(t))
+#define SM4_AESNI_X_BCAST8(b)		_mm_set1_epi8((char)(b))
+#define SM4_AESNI_X_BCAST32(w)		_mm_set1_epi32((int)(w))
+#define SM4_AESNI_X_SHUFFLE(t, v)	_mm_shuffle_epi8((t), (v))
+#define SM4_AESNI_X_SRLI16(v, n)	_mm_srli_epi16((v), (n))
+#define SM4_AESNI_X_SLLI32(v, n)	_mm_slli_epi32((v), (n))
+#define SM4_AESNI_X_SRLI32(v, n)	_mm_srli_epi32((v), (n))
+#define SM4_AESNI_X_UNPACKLO32(a, b)	_mm_unpacklo_epi32((a), (b))
+#define SM4_AESNI_X_UNPACKHI32(a, b)	_mm_unpackhi_epi32((a), (b))
+#define SM4_AESNI_X_UNPACKLO64(a, b)	_mm_unpacklo_epi64((a), (b))
+#define SM4_AESNI_X_UNPACKHI64(a, b)	_mm_unpackhi_epi64((a), (b))
+#define SM4_AESNI_X_AESLAST(v) \
+	_mm_aesenclast_si128((v), _mm_setzero_si128())
+
+#define SM4_AESNI_Y_GROUP		8
+#define SM4_AESNI_Y_LOAD(p, i) \
+	_mm256_inserti128_si256(_mm256_castsi128_si256( \
+	    SM4_AESNI_X_LOAD(p, i)), SM4_AESNI_X_LOAD(p, (i) + 4), 1)
+#define SM4_AESNI_Y_STORE(p, i, v) do { \
+	SM4_AESNI_X_STORE(p, i, _mm256_castsi256_si128(v)); \
+	SM4_AESNI_X_STORE(p, (i) + 4, _mm256_extracti128_si256(v, 1)); \
+} while (0)
+#define SM4_AESNI_Y_TABLE(t) \
+	_mm256_broadcastsi128_si256(SM4_AESNI_X_TABLE(t))
+#define SM4_AESNI_Y_BCAST8(b)		_mm256_set1_epi8((char)(b))
+#define SM4_AESNI_Y_BCAST32(w)		_mm256_set1_epi32((int)(w))
+#define SM4_AESNI_Y_SHUFFLE(t, v)	_mm256_shuffle_epi8((t), (v))
+#define SM4_AESNI_Y_SRLI16(v, n)	_mm256_srli_epi16((v), (n))
+#define SM4_AESNI_Y_SLLI32(v, n)	_mm256_slli_epi32((v), (n))
+#define SM4_AESNI_Y_SRLI32(v, n)	_mm256_srli_epi32((v), (n))
+#define SM4_AESNI_Y_UNPACKLO32(a, b)	_mm256_unpacklo_epi32((a), (b))
+#define SM4_AESNI_Y_UNPACKHI32(a, b)	_mm256_unpackhi_epi32((a), (b))
+#define SM4_AESNI_Y_UNPACKLO64(a, b)	_mm256_unpacklo_epi64((a), (b))
+#define SM4_AESNI_Y_UNPACKHI64(a, b)	_mm256_unpackhi_epi64((a), (b))
+#define SM4_AESNI_Y_AESLAST(v) \
+	_mm256_inserti128_si256(_mm256_castsi128_si256( \
+	    SM4_AESNI_X_AESLAST(_mm256_castsi256_si128(v))), \
+	    SM4_AESNI_X_AESLAST(_mm256_extracti128_si256(v, 1)), 1)
+
+#define SM4_AESNI_V_GROUP		SM4_AESNI_Y_GROUP
+#define SM4_AESNI_V_LOAD		SM4_AESNI_Y_LOAD
+#define SM4_AESNI_V_STORE		SM4_AESNI_Y_STORE
+#define SM4_AESNI_V_TABLE		SM4_AESNI_Y_TABLE
+#define SM4_AESNI_V_BCAST8		SM4_AESNI_Y_BCAST8
+#define SM4_AESNI_V_BCAST32		SM4_AESNI_Y_BCAST32
+#define SM4_AESNI_V_SHUFFLE		SM4_AESNI_Y_SHUFFLE
+#define SM4_AESNI_V_SRLI16		SM4_AESNI_Y_SRLI16
+#define SM4_AESNI_V_SLLI32		SM4_AESNI_Y_SLLI32
+#define SM4_AESNI_V_SRLI32		SM4_AESNI_Y_SRLI32
+#define SM4_AESNI_V_UNPACKLO32		SM4_AESNI_Y_UNPACKLO32
+#define SM4_AESNI_V_UNPACKHI32		SM4_AESNI_Y_UNPACKHI32
+#define SM4_AESNI_V_UNPACKLO64		SM4_AESNI_Y_UNPACKLO64
+#define SM4_AESNI_V_UNPACKHI64		SM4_AESNI_Y_UNPACKHI64
+#define SM4_AESNI_V_AESLAST(v) \
+	_mm256_aesenclast_epi128((v), _mm256_setzero_si256())
+
+#define SM4_AESNI_OP(p, op)	SM4_AESNI_##p##_##op
+
+/* An affine map, given as nibble tables. */
+#define SM4_AESNI_AFFINE(p, t, v) \
+	(SM4_AESNI_OP(p, SHUFFLE)((t)[0], (v) & m4) ^ \
+	    SM4_AESNI_OP(p, SHUFFLE)((t)[1], \
+	    SM4_AESNI_OP(p, SRLI16)((v), 4) & m4))
+
+/* v = L(S(v)), the T function of SM4_encrypt() on every lane. */
+#define SM4_AESNI_T(p, v) do { \
+	u = SM4_AESNI_OP(p, SHUFFLE)((v), isr); \
+	u = SM4_AESNI_AFFINE(p, pre, u); \
+	u = SM4_AESNI_OP(p, AESLAST)(u); \
+	(v) = SM4_AESNI_AFFINE(p, post, u); \
+	u = (v) ^ SM4_AESNI_OP(p, SHUFFLE)((v), rotl8) ^ \
+	    SM4_AESNI_OP(p, SHUFFLE)((v), rotl16); \
+	(v) ^= SM4_AESNI_OP(p, SHUFFLE)((v), rotl24) ^ \
+	    SM4_AESNI_OP(p, SLLI32)(u, 2) ^ SM4_AESNI_OP(p, SRLI32)(u, 30); \
+} while (0)
+
+/* One round on both groups, as in SM4_ROUNDS(). */
+#define SM4_AESNI_ROUND(p, i0, i1, i2, i3, r) do { \
+	k = SM4_AESNI_OP(p, BCAST32)(rk[enc ? (r) : 31 - (r)]); \
+	t0 = x[0][i1] ^ x[0][i2] ^ x[0][i3] ^ k; \
+	t1 = x[1][i1] ^ x[1][i2] ^ x[1][i3] ^ k; \
+	SM4_AESNI_T(p, t0); \
+	SM4_AESNI_T(p, t1); \
+	x[0][i0] ^= t0; \
+	x[1][i0] ^= t1; \
+} while (0)
+
+/* Transpose the 4 by 4 word matrices in the vectors at x. */
+#define SM4_AESNI_TRANSPOSE(p, x) do { \
+	t0 = SM4_AESNI_OP(p, UNPACKLO32)((x)[0], (x)[1]); \
+	t1 = SM4_AESNI_OP(p, UNPACKLO32)((x)[2], (x)[3]); \
+	t2 = SM4_AESNI_OP(p, UNPACKHI32)((x)[0], (x)[1]); \
+	t3 = SM4_AESNI_OP(p, UNPACKHI32)((x)[2], (x)[3]); \
+	(x)[0] = SM4_AESNI_OP(p, UNPACKLO64)(t0, t1); \
+	(x)[1] = SM4_AESNI_OP(p, UNPACKHI64)(t0, t1); \
+	(x)[2] = SM4_AESNI_OP(p, UNPACKLO64)(t2, t3); \
+	(x)[3] = SM4_AESNI_OP(p, UNPACKHI64)(t2, t3); \
+} while (0)
+
+/*
+ * Encrypt or decrypt the 8 or 16 blocks at in to out, following
+ * SM4_encrypt() and SM4_decrypt().
+ */
+#define SM4_AESNI_BLOCKS(vec, p) do { \
+	const uint32_t *rk = ((const struct sm4_key *)key)->rk; \
+	vec pre[2], post[2], isr, bswap, rotl8, rotl16, rotl24, m4; \
+	vec x[2][4], t0, t1, t2, t3, k, u; \
+	int g, i, r; \
+ \
+	pre[0] = SM4_AESNI_OP(p, TABLE)(sm4_aesni_pre[0]); \
+	pre[1] = SM4_AESNI_OP(p, TABLE)(sm4_aesni_pre[1]); \
+	post[0] = SM4_AESNI_OP(p, TABLE)(sm4_aesni_post[0]); \
+	post[1] = SM4_AESNI_OP(p, TABLE)(sm4_aesni_post[1]); \
+	isr = SM4_AESNI_OP(p, TABLE)(sm4_aesni_inv_shift_rows); \
+	bswap = SM4_AESNI_OP(p, TABLE)(sm4_aesni_bswap); \
+	rotl8 = SM4_AESNI_OP(p, TABLE)(sm4_aesni_rotl8); \
+	rotl16 = SM4_AESNI_OP(p, TABLE)(sm4_aesni_rotl16); \
+	rotl24 = SM4_AESNI_OP(p, TABLE)(sm4_aesni_rotl24); \
+	m4 = SM4_AESNI_OP(p, BCAST8)(0x0f); \
+ \
+	for (g = 0; g < 2; g++) { \
+		for (i = 0; i < 4; i++) \
+			x[g][i] = SM4_AESNI_OP(p, SHUFFLE)(SM4_AESNI_OP(p, \
+			    LOAD)(in, g * SM4_AESNI_OP(p, GROUP) + i), bswap); \
+		SM4_AESNI_TRANSPOSE(p, x[g]); \
+	} \
+ \
+	for (r = 0; r < 32; r += 4) { \
+		SM4_AESNI_ROUND(p, 0, 1, 2, 3, r); \
+		SM4_AESNI_ROUND(p, 1, 0, 2, 3, r + 1); \
+		SM4_AESNI_ROUND(p, 2, 0, 1, 3, r + 2); \
+		SM4_AESNI_ROUND(p, 3, 0, 1, 2, r + 3); \
+	} \
+ \
+	/* The words are stored in reverse order. */ \
+	for (g = 0; g < 2; g++) { \
+		t0 = x[g][0]; \
+		x[g][0] = x[g][3]; \
+		x[g][3] = t0; \
+		t0 = x[g][1]; \
+		x[g][1] = x[g][2]; \
+		x[g][2] = t0; \
+		SM4_AESNI_TRANSPOSE(p, x[g]); \
+		for (i = 0; i < 4; i++) \
+			SM4_AESNI_OP(p, STORE)(out, \
+			    g * SM4_AESNI_OP(p, GROUP) + i, \
+			    SM4_AESNI_OP(p, SHUFFLE)(x[g][i], bswap)); \
+	} \
+ \
+	explicit_bzero(x, sizeof(x)); \
+} while (0)
+
+static void SM4_AESNI_TARGET
+sm4_aesni_blocks8(const uint8_t *in, uint8_t *out, const SM4_KEY *key,
+    int enc)
+{
+	SM4_AESNI_BLOCKS(__m128i, X);
+}
+
+static void SM4_AESNI_TARGET
+sm4_aesni_blocks16(const uint8_t *in, uint8_t *out, const SM4_KEY *key,
+    int enc)
+{
+	SM4_AESNI_BLOCKS(__m256i, Y);
+}
+
+static void SM4_VAES_TARGET
+sm4_vaes_blocks16(const uint8_t *in, uint8_t *out, const SM4_KEY *key,
+    int enc)
+{
+	SM4_AESNI_BLOCKS(__m256i, V);
+}
+
+int
+sm4_aesni_capable(void)
+{
+	return (OPENSSL_cpu_caps() & (CPUCAP_MASK_AESNI | CPUCAP_MASK_AVX2)) ==
+	    (CPUCAP_MASK_AESNI | CPUCAP_MASK_AVX2);
+}
+
+/*
+ * Process as many of the blocks as the kernels take, returning the number of
+ * blocks done, which is a multiple of 8.
+ */
+static size_t
+sm4_aesni_kernels(const uint8_t *in, uint8_t *out, size_t blocks,
+    const SM4_KEY *key, int enc)
+{
+	int vaes = (OPENSSL_cpu_caps() & CPUCAP_MASK_VAES) != 0;
+	size_t done = 0;
+
+	for (; blocks - done >= 16; done += 16) {
+		if (vaes)
+			sm4_vaes_blocks16(in + done * SM4_BLOCK_SIZE,
+			    out + done * SM4_BLOCK_SIZE, key, enc);
+		else
+			sm4_aesni_blocks16(in + done * SM4_BLOCK_SIZE,
+			    out + done * SM4_BLOCK_SIZE, key, enc);
+	}
+	if (blocks - done >= 8) {
+		sm4_aesni_blocks8(in + done * SM4_BLOCK_SIZE,
+		    out + done * SM4_BLOCK_SIZE, key, enc);
+		done += 8;
+	}
+
+	return done;
+}
+
+void
+sm4_aesni_ecb_encrypt(const unsigned char *in, unsigned char *out,
+    size_t blocks, const SM4_KEY *key, int enc)
+{
+	size_t i;
+
+	for (i = sm4_aesni_kernels(in, out, blocks, key, enc);
+	    i < blocks; i++) {
+		if (enc)
+			SM4_encrypt(in + i * SM4_BLOCK_SIZE,
+			    out + i * SM4_BLOCK_SIZE, key);
+		else
+			SM4_decrypt(in + i * SM4_BLOCK_SIZE,
+			    out + i * SM4_BLOCK_SIZE, key);
+	}
+}
+
+/*
+ * CBC decryption, which unlike encryption does not chain the block cipher.
+ * The blocks of each group are decrypted into a buffer and the xor is done
+ * from the last block down, so that in may be the same as out.
+ */
+void
+sm4_aesni_cbc_decrypt(const unsigned char *in, unsigned char *out,
+    size_t blocks, const SM4_KEY *key, unsigned char *ivec)
+{
+	uint8_t buf[SM4_AESNI_MAX_BLOCKS * SM4_BLOCK_SIZE];
+	uint8_t iv[SM4_BLOCK_SIZE];
+	const uint8_t *prev;
+	size_t i, j, n;
+
+	while (blocks >= 8) {
+		n = blocks >= 16 ? 16 : 8;
+		sm4_aesni_kernels(in, buf, n, key, 0);
+		memcpy(iv, in + (n - 1) * SM4_BLOCK_SIZE, sizeof(iv));
+		for (i = n; i-- > 0;) {
+			prev = i > 0 ? in + (i - 1) * SM4_BLOCK_SIZE : ivec;
+			for (j = 0; j < SM4_BLOCK_SIZE; j++)
+				out[i * SM4_BLOCK_SIZE + j] =
+				    buf[i * SM4_BLOCK_SIZE + j] ^ prev[j];
+		}
+		memcpy(ivec, iv, sizeof(iv));
+
+		in += n * SM4_BLOCK_SIZE;
+		out += n * SM4_BLOCK_SIZE;
+		blocks -= n;
+	}
+	if (blocks > 0)
+		CRYPTO_cbc128_decrypt(in, out, blocks * SM4_BLOCK_SIZE,
+		    key, ivec, (block128_f)SM4_decrypt);
+
+	explicit_bzero(buf, sizeof(buf));
+}
+
+/*
+ * A ctr128_f, for CRYPTO_ctr128_encrypt_ctr32() and the GCM code, which keep
+ * the low 32 bits of the counter from wrapping within a call.
+ */
+void
+sm4_aesni_ctr32_encrypt_blocks(const unsigned char *in, unsigned char *out,
+    size_t blocks, const void *key, const unsigned char ivec[16])
+{
+	uint8_t buf[SM4_AESNI_MAX_BLOCKS * SM4_BLOCK_SIZE];
+	uint8_t *b;
+	uint32_t ctr;
+	size_t i, n;
+
+	ctr = (uint32_t)ivec[12] << 24 | (uint32_t)ivec[13] << 16 |
+	    (uint32_t)ivec[14] << 8 | ivec[15];
+
+	while (blocks > 0) {
+		n = blocks < SM4_AESNI_MAX_BLOCKS ? blocks :
+		    SM4_AESNI_MAX_BLOCKS;
+		for (i = 0; i < n; i++, ctr++) {
+			b = buf + i * SM4_BLOCK_SIZE;
+			memcpy(b, ivec, 12);
+			b[12] = ctr >> 24;
+			b[13] = ctr >> 16;
+			b[14] = ctr >> 8;
+			b[15] = ctr;
+		}
+		sm4_aesni_ecb_encrypt(buf, buf, n, key, 1);
+		for (i = 0; i < n * SM4_BLOCK_SIZE; i++)
+			out[i] = in[i] ^ buf[i];
+
+		in += n * SM4_BLOCK_SIZE;
+		out += n * SM4_BLOCK_SIZE;
+		blocks -= n;
+	}
+
+	explicit_bzero(buf, sizeof(buf));
+}
+
+#endif
@@ -0,0 +1,52 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef HEADER_SM4_LOCL_H
+#define HEADER_SM4_LOCL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <openssl/sm4.h>
+
+__BEGIN_HIDDEN_DECLS
+
+struct sm4_key {
+	uint32_t rk[SM4_KEY_SCHEDULE];
+};
+
+/*
+ * SM4 on 8 or 16 blocks at a time with AES-NI and AVX2, for ECB, CBC
+ * decryption and CTR.
+ */
+#if defined(OPENSSL_SM4_AESNI) && \
+    (defined(__x86_64) || defined(__x86_64__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 8))
+#define SM4_AESNI
+int sm4_aesni_capable(void);
+void sm4_aesni_ecb_encrypt(const unsigned char *in, unsigned char *out,
+	    size_t blocks, const SM4_KEY *key, int enc);
+void sm4_aesni_cbc_decrypt(const unsigned char *in, unsigned char *out,
+	    size_t blocks, const SM4_KEY *key, unsigned char *ivec);
+void sm4_aesni_ctr32_encrypt_blocks(const unsigned char *in,
+	    unsigned char *out, size_t blocks, const void *key,
+	    const unsigned char ivec[16]);
+#endif
+
+__END_HIDDEN_DECLS
+
+#endif /* HEADER_SM4_LOCL_H */
@@ -224,6 +224,30 @@ typedef struct TS_resp_st {
 	TS_TST_INFO *tst_info;
 } TS_RESP;
 
+/*
+MerklePath ::= SEQUENCE {
+	messageImprint		MessageImprint,
+	leafIndex		INTEGER,
+	treeSize		INTEGER,
+	path			OCTET STRING,
+	  -- the SHA-256 node hashes from the leaf up to the root
+	nonce			INTEGER			OPTIONAL }
+*/
+
+typedef struct TS_merkle_path_st {
+	TS_MSG_IMPRINT *msg_imprint;
+	ASN1_INTEGER *leaf_index;
+	ASN1_INTEGER *tree_size;
+	ASN1_OCTET_STRING *path;
+	ASN1_INTEGER *nonce;		/* OPTIONAL */
+} TS_MERKLE_PATH;
+
+/*
+ * A batched response carries its MerklePath as an unsigned attribute of the
+ * signer info, with this type.
+ */
+#define TS_MERKLE_PATH_OID	"1.3.6.1.4.1.30155.10.1"
+
 /* The structure below would belong to the ESS component. */
 
 /*
@@ -290,11 +314,20 @@ int		i2d_TS_MSG_IMPRINT_fp(FILE *fp, TS_MSG_IMPRINT *a);
 TS_MSG_IMPRINT	*d2i_TS_MSG_IMPRINT_bio(BIO *fp, TS_MSG_IMPRINT **a);
 int		i2d_TS_MSG_IMPRINT_bio(BIO *fp, TS_MSG_IMPRINT *a);
 
+TS_MERKLE_PATH	*TS_MERKLE_PATH_new(void);
+void		TS_MERKLE_PATH_free(TS_MERKLE_PATH *a);
+int		i2d_TS_MERKLE_PATH(const TS_MERKLE_PATH *a, unsigned char **pp);
+TS_MERKLE_PATH	*d2i_TS_MERKLE_PATH(TS_MERKLE_PATH **a,
+		    const unsigned char **pp, long length);
+
+TS_MERKLE_PATH	*TS_MERKLE_PATH_dup(TS_MERKLE_PATH *a);
+
 TS_RESP	*TS_RESP_new(void);
 void	TS_RESP_free(TS_RESP *a);
 int	i2d_TS_RESP(const TS_RESP *a, unsigned char **pp);
 TS_RESP	*d2i_TS_RESP(TS_RESP **a, const unsigned char **pp, long length);
 TS_TST_INFO *PKCS7_to_TS_TST_INFO(PKCS7 *token);
+TS_MERKLE_PATH *PKCS7_to_TS_MERKLE_PATH(PKCS7 *token);
 TS_RESP	*TS_RESP_dup(TS_RESP *a);
 
 TS_RESP	*d2i_TS_RESP_fp(FILE *fp, TS_RESP **a);
@@ -583,6 +616,15 @@ TS_TST_INFO *TS_RESP_CTX_get_tst_info(TS_RESP_CTX *ctx);
  */
 TS_RESP *TS_RESP_create_response(TS_RESP_CTX *ctx, BIO *req_bio);
 
+/*
+ * Creates the responses for num requests with a single signature, over the
+ * root of a Merkle tree of their message imprints. Each response is put in
+ * responses[i], and returned with its status set as TS_RESP_create_response
+ * would. Returns 0 only in case of memory allocation/fatal error.
+ */
+int TS_RESP_create_batch_response(TS_RESP_CTX *ctx, BIO **req_bios, int num,
+    TS_RESP **responses);
+
 /*
  * Declarations related to response verification,
  * they are defined in ts/ts_resp_verify.c.
@@ -806,6 +848,7 @@ void ERR_load_TS_strings(void);
 #define TS_R_ESS_SIGNING_CERTIFICATE_ERROR		 101
 #define TS_R_INVALID_NULL_POINTER			 102
 #define TS_R_INVALID_SIGNER_CERTIFICATE_PURPOSE		 117
+#define TS_R_MERKLE_PATH_MISMATCH			 135
 #define TS_R_MESSAGE_IMPRINT_MISMATCH			 103
 #define TS_R_NONCE_MISMATCH				 104
 #define TS_R_NONCE_NOT_RETURNED				 105
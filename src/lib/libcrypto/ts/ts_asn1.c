@@ -61,6 +61,8 @@
 #include <openssl/err.h>
 #include <openssl/asn1t.h>
 
+#include "ts_lcl.h"
+
 static const ASN1_TEMPLATE TS_MSG_IMPRINT_seq_tt[] = {
 	{
 		.flags = 0,
@@ -669,6 +671,86 @@ i2d_TS_RESP_fp(FILE *fp, TS_RESP *a)
 	return ASN1_item_i2d_fp(&TS_RESP_it, fp, a);
 }
 
+static const ASN1_TEMPLATE TS_MERKLE_PATH_seq_tt[] = {
+	{
+		.flags = 0,
+		.tag = 0,
+		.offset = offsetof(TS_MERKLE_PATH, msg_imprint),
+		.field_name = "msg_imprint",
+		.item = &TS_MSG_IMPRINT_it,
+	},
+	{
+		.flags = 0,
+		.tag = 0,
+		.offset = offsetof(TS_MERKLE_PATH, leaf_index),
+		.field_name = "leaf_index",
+		.item = &ASN1_INTEGER_it,
+	},
+	{
+		.flags = 0,
+		.tag = 0,
+		.offset = offsetof(TS_MERKLE_PATH, tree_size),
+		.field_name = "tree_size",
+		.item = &ASN1_INTEGER_it,
+	},
+	{
+		.flags = 0,
+		.tag = 0,
+		.offset = offsetof(TS_MERKLE_PATH, path),
+		.field_name = "path",
+		.item = &ASN1_OCTET_STRING_it,
+	},
+	{
+		.flags = ASN1_TFLG_OPTIONAL,
+		.tag = 0,
+		.offset = offsetof(TS_MERKLE_PATH, nonce),
+		.field_name = "nonce",
+		.item = &ASN1_INTEGER_it,
+	},
+};
+
+const ASN1_ITEM TS_MERKLE_PATH_it = {
+	.itype = ASN1_ITYPE_SEQUENCE,
+	.utype = V_ASN1_SEQUENCE,
+	.templates = TS_MERKLE_PATH_seq_tt,
+	.tcount = sizeof(TS_MERKLE_PATH_seq_tt) / sizeof(ASN1_TEMPLATE),
+	.funcs = NULL,
+	.size = sizeof(TS_MERKLE_PATH),
+	.sname = "TS_MERKLE_PATH",
+};
+
+
+TS_MERKLE_PATH *
+d2i_TS_MERKLE_PATH(TS_MERKLE_PATH **a, const unsigned char **in, long len)
+{
+	return (TS_MERKLE_PATH *)ASN1_item_d2i((ASN1_VALUE **)a, in, len,
+	    &TS_MERKLE_PATH_it);
+}
+
+int
+i2d_TS_MERKLE_PATH(const TS_MERKLE_PATH *a, unsigned char **out)
+{
+	return ASN1_item_i2d((ASN1_VALUE *)a, out, &TS_MERKLE_PATH_it);
+}
+
+TS_MERKLE_PATH *
+TS_MERKLE_PATH_new(void)
+{
+	return (TS_MERKLE_PATH *)ASN1_item_new(&TS_MERKLE_PATH_it);
+}
+
+void
+TS_MERKLE_PATH_free(TS_MERKLE_PATH *a)
+{
+	ASN1_item_free((ASN1_VALUE *)a, &TS_MERKLE_PATH_it);
+}
+
+TS_MERKLE_PATH *
+TS_MERKLE_PATH_dup(TS_MERKLE_PATH *x)
+{
+	return ASN1_item_dup(&TS_MERKLE_PATH_it, x);
+}
+
 static const ASN1_TEMPLATE ESS_ISSUER_SERIAL_seq_tt[] = {
 	{
 		.flags = ASN1_TFLG_SEQUENCE_OF,
@@ -888,3 +970,60 @@ PKCS7_to_TS_TST_INFO(PKCS7 *token)
 	p = tst_info_der->data;
 	return d2i_TS_TST_INFO(NULL, &p, tst_info_der->length);
 }
+
+/*
+ * Getting the MerklePath of a batched response from the unsigned attributes
+ * of its PKCS7 signer info. Sets *out_mp to NULL if the token has none, and
+ * returns 0 only if there is one that can not be decoded.
+ */
+int
+ts_get_merkle_path(PKCS7 *token, TS_MERKLE_PATH **out_mp)
+{
+	PKCS7_SIGNER_INFO *si;
+	X509_ATTRIBUTE *attr;
+	ASN1_OBJECT *oid;
+	ASN1_TYPE *path_wrapper;
+	const unsigned char *p;
+	int idx;
+
+	*out_mp = NULL;
+
+	if (!PKCS7_type_is_signed(token)) {
+		TSerror(TS_R_BAD_PKCS7_TYPE);
+		return 0;
+	}
+	if ((si = sk_PKCS7_SIGNER_INFO_value(PKCS7_get_signer_info(token),
+	    0)) == NULL)
+		return 1;
+
+	if ((oid = OBJ_txt2obj(TS_MERKLE_PATH_OID, 1)) == NULL)
+		return 0;
+	idx = X509at_get_attr_by_OBJ(si->unauth_attr, oid, -1);
+	ASN1_OBJECT_free(oid);
+	if (idx < 0)
+		return 1;
+
+	attr = X509at_get_attr(si->unauth_attr, idx);
+	if ((path_wrapper = X509_ATTRIBUTE_get0_type(attr, 0)) == NULL ||
+	    path_wrapper->type != V_ASN1_SEQUENCE) {
+		TSerror(TS_R_BAD_TYPE);
+		return 0;
+	}
+
+	p = path_wrapper->value.sequence->data;
+	*out_mp = d2i_TS_MERKLE_PATH(NULL, &p,
+	    path_wrapper->value.sequence->length);
+
+	return *out_mp != NULL;
+}
+
+TS_MERKLE_PATH *
+PKCS7_to_TS_MERKLE_PATH(PKCS7 *token)
+{
+	TS_MERKLE_PATH *mp;
+
+	if (!ts_get_merkle_path(token, &mp))
+		return NULL;
+
+	return mp;
+}
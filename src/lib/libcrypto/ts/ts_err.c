@@ -65,18 +65,20 @@
 #include <openssl/err.h>
 #include <openssl/ts.h>
 
+#include "cryptlib.h"
+
 /* BEGIN ERROR CODES */
 #ifndef OPENSSL_NO_ERR
 
 #define ERR_FUNC(func) ERR_PACK(ERR_LIB_TS,func,0)
 #define ERR_REASON(reason) ERR_PACK(ERR_LIB_TS,0,reason)
 
-static ERR_STRING_DATA TS_str_functs[] = {
+static const ERR_STRING_DATA TS_str_functs[] = {
 	{ERR_FUNC(0xfff), "CRYPTO_internal"},
 	{0, NULL}
 };
 
-static ERR_STRING_DATA TS_str_reasons[]= {
+static const ERR_STRING_DATA TS_str_reasons[]= {
 	{ERR_REASON(TS_R_BAD_PKCS7_TYPE)         , "bad pkcs7 type"},
 	{ERR_REASON(TS_R_BAD_TYPE)               , "bad type"},
 	{ERR_REASON(TS_R_CERTIFICATE_VERIFY_ERROR), "certificate verify error"},
@@ -88,6 +90,7 @@ static ERR_STRING_DATA TS_str_reasons[]= {
 	{ERR_REASON(TS_R_ESS_SIGNING_CERTIFICATE_ERROR), "ess signing certificate error"},
 	{ERR_REASON(TS_R_INVALID_NULL_POINTER)   , "invalid null pointer"},
 	{ERR_REASON(TS_R_INVALID_SIGNER_CERTIFICATE_PURPOSE), "invalid signer certificate purpose"},
+	{ERR_REASON(TS_R_MERKLE_PATH_MISMATCH)   , "merkle path mismatch"},
 	{ERR_REASON(TS_R_MESSAGE_IMPRINT_MISMATCH), "message imprint mismatch"},
 	{ERR_REASON(TS_R_NONCE_MISMATCH)         , "nonce mismatch"},
 	{ERR_REASON(TS_R_NONCE_NOT_RETURNED)     , "nonce not returned"},
@@ -122,8 +125,8 @@ ERR_load_TS_strings(void)
 {
 #ifndef OPENSSL_NO_ERR
 	if (ERR_func_error_string(TS_str_functs[0].error) == NULL) {
-		ERR_load_strings(0, TS_str_functs);
-		ERR_load_strings(0, TS_str_reasons);
+		ERR_load_const_strings(TS_str_functs);
+		ERR_load_const_strings(TS_str_reasons);
 	}
 #endif
 }
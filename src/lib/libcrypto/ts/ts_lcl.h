@@ -0,0 +1,41 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef HEADER_TS_LCL_H
+#define HEADER_TS_LCL_H
+
+#include <openssl/sha.h>
+#include <openssl/ts.h>
+
+__BEGIN_HIDDEN_DECLS
+
+/*
+ * The Merkle tree of a batch is built as in RFC 6962, over the DER encoding
+ * of the message imprint and nonce of each request.
+ */
+#define TS_MERKLE_HASH_LEN	SHA256_DIGEST_LENGTH
+
+int ts_merkle_leaf_hash(const TS_MSG_IMPRINT *msg_imprint,
+    ASN1_INTEGER *nonce, unsigned char *out);
+void ts_merkle_node_hash(const unsigned char *left, const unsigned char *right,
+    unsigned char *out);
+int ts_merkle_path_root(const TS_MERKLE_PATH *mp, unsigned char *root);
+int ts_get_merkle_path(PKCS7 *token, TS_MERKLE_PATH **out_mp);
+
+__END_HIDDEN_DECLS
+
+#endif /* HEADER_TS_LCL_H */
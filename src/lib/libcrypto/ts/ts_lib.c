@@ -57,13 +57,17 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <openssl/bn.h>
 #include <openssl/objects.h>
+#include <openssl/sha.h>
 #include <openssl/ts.h>
 #include <openssl/x509v3.h>
 
+#include "ts_lcl.h"
+
 /* Local function declarations. */
 
 /* Function definitions. */
@@ -148,3 +152,94 @@ TS_MSG_IMPRINT_print_bio(BIO *bio, TS_MSG_IMPRINT *a)
 
 	return 1;
 }
+
+/*
+ * Merkle tree hashes, with the leaf and node prefixes of RFC 6962 so that a
+ * leaf can not be taken for a node.
+ */
+int
+ts_merkle_leaf_hash(const TS_MSG_IMPRINT *msg_imprint,
+    ASN1_INTEGER *nonce, unsigned char *out)
+{
+	SHA256_CTX sha256;
+	unsigned char prefix = 0x00;
+	unsigned char *der = NULL;
+	int der_len;
+
+	SHA256_Init(&sha256);
+	SHA256_Update(&sha256, &prefix, sizeof(prefix));
+
+	if ((der_len = i2d_TS_MSG_IMPRINT(msg_imprint, &der)) <= 0)
+		return 0;
+	SHA256_Update(&sha256, der, der_len);
+	free(der);
+	der = NULL;
+
+	if (nonce != NULL) {
+		if ((der_len = i2d_ASN1_INTEGER(nonce, &der)) <= 0)
+			return 0;
+		SHA256_Update(&sha256, der, der_len);
+		free(der);
+	}
+
+	SHA256_Final(out, &sha256);
+
+	return 1;
+}
+
+void
+ts_merkle_node_hash(const unsigned char *left, const unsigned char *right,
+    unsigned char *out)
+{
+	SHA256_CTX sha256;
+	unsigned char prefix = 0x01;
+
+	SHA256_Init(&sha256);
+	SHA256_Update(&sha256, &prefix, sizeof(prefix));
+	SHA256_Update(&sha256, left, TS_MERKLE_HASH_LEN);
+	SHA256_Update(&sha256, right, TS_MERKLE_HASH_LEN);
+	SHA256_Final(out, &sha256);
+}
+
+/*
+ * Computes the root of the tree from the leaf and path of mp, as in section
+ * 2.1.3.2 of RFC 9162. Returns 0 if the path does not fit the tree.
+ */
+int
+ts_merkle_path_root(const TS_MERKLE_PATH *mp, unsigned char *root)
+{
+	const unsigned char *node;
+	long fn, sn;
+	int i, n;
+
+	if ((fn = ASN1_INTEGER_get(mp->leaf_index)) < 0)
+		return 0;
+	if ((sn = ASN1_INTEGER_get(mp->tree_size)) <= fn)
+		return 0;
+	sn--;
+
+	if (mp->path->length % TS_MERKLE_HASH_LEN != 0)
+		return 0;
+	n = mp->path->length / TS_MERKLE_HASH_LEN;
+
+	if (!ts_merkle_leaf_hash(mp->msg_imprint, mp->nonce, root))
+		return 0;
+
+	for (i = 0; i < n; i++) {
+		node = mp->path->data + i * TS_MERKLE_HASH_LEN;
+		if (sn == 0)
+			return 0;
+		if ((fn & 1) != 0 || fn == sn) {
+			ts_merkle_node_hash(node, root, root);
+			while ((fn & 1) == 0 && fn != 0) {
+				fn >>= 1;
+				sn >>= 1;
+			}
+		} else
+			ts_merkle_node_hash(root, node, root);
+		fn >>= 1;
+		sn >>= 1;
+	}
+
+	return sn == 0;
+}
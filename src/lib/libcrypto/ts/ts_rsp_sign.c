@@ -58,6 +58,7 @@
 
 #include <sys/time.h>
 
+#include <stdlib.h>
 #include <string.h>
 
 #include <openssl/err.h>
@@ -65,6 +66,8 @@
 #include <openssl/pkcs7.h>
 #include <openssl/ts.h>
 
+#include "ts_lcl.h"
+
 /* Private function declarations. */
 
 static ASN1_INTEGER *def_serial_cb(struct TS_resp_ctx *, void *);
@@ -79,6 +82,17 @@ static TS_TST_INFO *TS_RESP_create_tst_info(TS_RESP_CTX *ctx,
     ASN1_OBJECT *policy);
 static int TS_RESP_process_extensions(TS_RESP_CTX *ctx);
 static int TS_RESP_sign(TS_RESP_CTX *ctx);
+static ASN1_OBJECT *TS_RESP_read_request(TS_RESP_CTX *ctx, BIO *req_bio);
+static int TS_RESP_create_token(TS_RESP_CTX *ctx, ASN1_OBJECT *policy);
+static TS_RESP *TS_RESP_end_response(TS_RESP_CTX *ctx, int result);
+
+struct ts_batch_leaf;
+static int TS_RESP_sign_batch(TS_RESP_CTX *ctx, ASN1_OBJECT *policy,
+    struct ts_batch_leaf *leaves, int nleaves,
+    unsigned char (*tree)[TS_MERKLE_HASH_LEN], TS_RESP **responses);
+static int TS_RESP_set_leaf_token(TS_RESP_CTX *ctx, TS_RESP *root_response,
+    struct ts_batch_leaf *leaves, int nleaves, int n,
+    unsigned char (*tree)[TS_MERKLE_HASH_LEN]);
 
 static ESS_SIGNING_CERT *ESS_SIGNING_CERT_new_init(X509 *signcert,
     STACK_OF(X509) *certs);
@@ -413,15 +427,298 @@ TS_RESP *
 TS_RESP_create_response(TS_RESP_CTX *ctx, BIO *req_bio)
 {
 	ASN1_OBJECT *policy;
-	TS_RESP *response;
 	int result = 0;
 
 	TS_RESP_CTX_init(ctx);
 
+	/* Parsing and checking the request. */
+	if (!(policy = TS_RESP_read_request(ctx, req_bio)))
+		goto end;
+
+	/* Creating and signing the TS_TST_INFO object. */
+	if (!TS_RESP_create_token(ctx, policy))
+		goto end;
+
+	/* Everything was successful. */
+	result = 1;
+
+end:
+	return TS_RESP_end_response(ctx, result);
+}
+
+/*
+ * Batched responses.
+ *
+ * The requests of a batch that are granted with the same policy and carry no
+ * extensions are the leaves of a Merkle tree, and a single TS_TST_INFO is
+ * signed for its root. Each of their responses gets a copy of that token,
+ * with the MerklePath from its leaf to the root as an unsigned attribute.
+ * Any other request is answered as by TS_RESP_create_response().
+ */
+struct ts_batch_leaf {
+	int index;		/* Of the request in the batch. */
+	TS_REQ *request;
+};
+
+int
+TS_RESP_create_batch_response(TS_RESP_CTX *ctx, BIO **req_bios, int num,
+    TS_RESP **responses)
+{
+	struct ts_batch_leaf *leaves = NULL;
+	unsigned char (*tree)[TS_MERKLE_HASH_LEN] = NULL;
+	ASN1_OBJECT *batch_policy = NULL, *policy;
+	int i, nleaves = 0;
+	int ret = 0;
+
+	for (i = 0; i < num; i++)
+		responses[i] = NULL;
+	if (num <= 0)
+		return 1;
+
+	if ((leaves = calloc(num, sizeof(*leaves))) == NULL ||
+	    (tree = reallocarray(NULL, 2 * (size_t)num + 32,
+	    sizeof(*tree))) == NULL) {
+		TSerror(ERR_R_MALLOC_FAILURE);
+		goto err;
+	}
+
+	for (i = 0; i < num; i++) {
+		TS_RESP_CTX_init(ctx);
+
+		policy = TS_RESP_read_request(ctx, req_bios[i]);
+		if (policy != NULL && batch_policy == NULL)
+			batch_policy = policy;
+		if (policy != NULL && OBJ_cmp(policy, batch_policy) == 0 &&
+		    TS_REQ_get_ext_count(ctx->request) == 0) {
+			if (!ts_merkle_leaf_hash(ctx->request->msg_imprint,
+			    ctx->request->nonce, tree[nleaves])) {
+				TSerror(ERR_R_MALLOC_FAILURE);
+				TS_RESP_CTX_cleanup(ctx);
+				goto err;
+			}
+			leaves[nleaves].index = i;
+			leaves[nleaves].request = ctx->request;
+			ctx->request = NULL;
+			nleaves++;
+			responses[i] = ctx->response;
+			ctx->response = NULL;
+			TS_RESP_CTX_cleanup(ctx);
+			continue;
+		}
+
+		if (policy != NULL && TS_RESP_create_token(ctx, policy))
+			responses[i] = TS_RESP_end_response(ctx, 1);
+		else
+			responses[i] = TS_RESP_end_response(ctx, 0);
+		if (responses[i] == NULL)
+			goto err;
+	}
+
+	/* A batch of one needs no tree. */
+	if (nleaves == 1) {
+		TS_RESP_CTX_init(ctx);
+		ctx->request = leaves[0].request;
+		leaves[0].request = NULL;
+		ctx->response = responses[leaves[0].index];
+		responses[leaves[0].index] = NULL;
+		if ((responses[leaves[0].index] = TS_RESP_end_response(ctx,
+		    TS_RESP_create_token(ctx, batch_policy))) == NULL)
+			goto err;
+	} else if (nleaves > 1) {
+		if (!TS_RESP_sign_batch(ctx, batch_policy, leaves, nleaves,
+		    tree, responses))
+			goto err;
+	}
+
+	ret = 1;
+
+err:
+	if (leaves != NULL) {
+		for (i = 0; i < nleaves; i++)
+			TS_REQ_free(leaves[i].request);
+	}
+	free(leaves);
+	free(tree);
+	if (!ret) {
+		for (i = 0; i < num; i++) {
+			TS_RESP_free(responses[i]);
+			responses[i] = NULL;
+		}
+	}
+	return ret;
+}
+
+/*
+ * Signs the root of the tree over the leaves of a batch, whose hashes are the
+ * first nleaves entries of tree, and sets the responses of the leaves.
+ */
+static int
+TS_RESP_sign_batch(TS_RESP_CTX *ctx, ASN1_OBJECT *policy,
+    struct ts_batch_leaf *leaves, int nleaves,
+    unsigned char (*tree)[TS_MERKLE_HASH_LEN], TS_RESP **responses)
+{
+	TS_MSG_IMPRINT *root_imprint = NULL;
+	TS_RESP *root_response = NULL;
+	X509_ALGOR *algo = NULL;
+	int count, i, off;
+	int signed_root = 0;
+	int ret = 0;
+
+	/* Build the tree bottom up, promoting the last node of an odd level. */
+	for (off = 0, count = nleaves; count > 1; count = (count + 1) / 2) {
+		for (i = 0; i < count / 2; i++)
+			ts_merkle_node_hash(tree[off + 2 * i],
+			    tree[off + 2 * i + 1], tree[off + count + i]);
+		if (count % 2 != 0)
+			memcpy(tree[off + count + count / 2],
+			    tree[off + count - 1], TS_MERKLE_HASH_LEN);
+		off += count;
+	}
+
+	/* Time-stamp the root as if it were requested with SHA-256. */
+	TS_RESP_CTX_init(ctx);
+	if ((ctx->request = TS_REQ_new()) == NULL ||
+	    (root_imprint = TS_MSG_IMPRINT_new()) == NULL ||
+	    (algo = X509_ALGOR_new()) == NULL ||
+	    (ctx->response = TS_RESP_new()) == NULL) {
+		TSerror(ERR_R_MALLOC_FAILURE);
+		goto err;
+	}
+	X509_ALGOR_set_md(algo, EVP_sha256());
+	if (!TS_REQ_set_version(ctx->request, 1) ||
+	    !TS_MSG_IMPRINT_set_algo(root_imprint, algo) ||
+	    !TS_MSG_IMPRINT_set_msg(root_imprint, tree[off],
+	    TS_MERKLE_HASH_LEN) ||
+	    !TS_REQ_set_msg_imprint(ctx->request, root_imprint))
+		goto err;
+	if (!TS_RESP_CTX_set_status_info(ctx, TS_STATUS_GRANTED, NULL))
+		goto err;
+	signed_root = TS_RESP_create_token(ctx, policy);
+
+	root_response = ctx->response;
+	for (i = 0; i < nleaves; i++) {
+		ctx->response = responses[leaves[i].index];
+		if (signed_root && TS_RESP_set_leaf_token(ctx, root_response,
+		    leaves, nleaves, i, tree))
+			continue;
+		if (!TS_RESP_CTX_set_status_info_cond(ctx,
+		    TS_STATUS_REJECTION, "Error during response generation."))
+			goto err;
+	}
+
+	ret = 1;
+
+err:
+	if (!ret)
+		TSerror(TS_R_RESPONSE_SETUP_ERROR);
+	if (root_response != NULL)
+		ctx->response = root_response;
+	TS_RESP_CTX_cleanup(ctx);
+	TS_MSG_IMPRINT_free(root_imprint);
+	X509_ALGOR_free(algo);
+	return ret;
+}
+
+/*
+ * Sets the token of the root in the response of leaf n, with the path from
+ * the leaf to the root.
+ */
+static int
+TS_RESP_set_leaf_token(TS_RESP_CTX *ctx, TS_RESP *root_response,
+    struct ts_batch_leaf *leaves, int nleaves, int n,
+    unsigned char (*tree)[TS_MERKLE_HASH_LEN])
+{
+	TS_REQ *request = leaves[n].request;
+	TS_MERKLE_PATH *mp = NULL;
+	PKCS7_SIGNER_INFO *si;
+	TS_TST_INFO *tst_info = NULL;
+	PKCS7 *p7 = NULL;
+	ASN1_OBJECT *oid = NULL;
+	unsigned char path[32][TS_MERKLE_HASH_LEN];
+	unsigned char *der = NULL;
+	int count, idx, off;
+	int der_len = 0, path_len = 0;
+	int i, ret = 0;
+
+	if ((mp = TS_MERKLE_PATH_new()) == NULL)
+		goto err;
+	TS_MSG_IMPRINT_free(mp->msg_imprint);
+	mp->msg_imprint = TS_MSG_IMPRINT_dup(request->msg_imprint);
+	if (mp->msg_imprint == NULL)
+		goto err;
+	if (request->nonce != NULL &&
+	    (mp->nonce = ASN1_INTEGER_dup(request->nonce)) == NULL)
+		goto err;
+	if (!ASN1_INTEGER_set(mp->leaf_index, n) ||
+	    !ASN1_INTEGER_set(mp->tree_size, nleaves))
+		goto err;
+
+	/* Collect the sibling of each node on the way up to the root. */
+	for (off = 0, count = nleaves, idx = n; count > 1;
+	    off += count, count = (count + 1) / 2, idx /= 2) {
+		if (idx % 2 != 0)
+			i = idx - 1;
+		else if (idx + 1 < count)
+			i = idx + 1;
+		else
+			continue;
+		memcpy(path[path_len++], tree[off + i], TS_MERKLE_HASH_LEN);
+	}
+	if (!ASN1_OCTET_STRING_set(mp->path, path[0],
+	    path_len * TS_MERKLE_HASH_LEN))
+		goto err;
+
+	if ((der_len = i2d_TS_MERKLE_PATH(mp, &der)) <= 0)
+		goto err;
+
+	if ((p7 = PKCS7_dup(root_response->token)) == NULL ||
+	    (tst_info = TS_TST_INFO_dup(root_response->tst_info)) == NULL)
+		goto err;
+
+	if (TS_REQ_get_cert_req(request)) {
+		PKCS7_add_certificate(p7, ctx->signer_cert);
+		for (i = 0; i < sk_X509_num(ctx->certs); i++)
+			PKCS7_add_certificate(p7, sk_X509_value(ctx->certs, i));
+	}
+
+	if ((si = sk_PKCS7_SIGNER_INFO_value(PKCS7_get_signer_info(p7),
+	    0)) == NULL)
+		goto err;
+	if ((oid = OBJ_txt2obj(TS_MERKLE_PATH_OID, 1)) == NULL)
+		goto err;
+	if (X509at_add1_attr_by_OBJ(&si->unauth_attr, oid, V_ASN1_SEQUENCE,
+	    der, der_len) == NULL)
+		goto err;
+
+	TS_RESP_set_tst_info(ctx->response, p7, tst_info);
+	p7 = NULL;		/* Ownership is lost. */
+	tst_info = NULL;	/* Ownership is lost. */
+
+	ret = 1;
+
+err:
+	if (!ret)
+		TSerror(TS_R_TS_DATASIGN);
+	ASN1_OBJECT_free(oid);
+	TS_TST_INFO_free(tst_info);
+	PKCS7_free(p7);
+	free(der);
+	TS_MERKLE_PATH_free(mp);
+	return ret;
+}
+
+/*
+ * Creates the response object of the context, parses the DER request into it
+ * and checks it. Returns the policy of the request, or NULL with the status
+ * of the response set.
+ */
+static ASN1_OBJECT *
+TS_RESP_read_request(TS_RESP_CTX *ctx, BIO *req_bio)
+{
 	/* Creating the response object. */
 	if (!(ctx->response = TS_RESP_new())) {
 		TSerror(ERR_R_MALLOC_FAILURE);
-		goto end;
+		return NULL;
 	}
 
 	/* Parsing DER request. */
@@ -430,37 +727,46 @@ TS_RESP_create_response(TS_RESP_CTX *ctx, BIO *req_bio)
 		    "Bad request format or "
 		    "system error.");
 		TS_RESP_CTX_add_failure_info(ctx, TS_INFO_BAD_DATA_FORMAT);
-		goto end;
+		return NULL;
 	}
 
 	/* Setting default status info. */
 	if (!TS_RESP_CTX_set_status_info(ctx, TS_STATUS_GRANTED, NULL))
-		goto end;
+		return NULL;
 
 	/* Checking the request format. */
 	if (!TS_RESP_check_request(ctx))
-		goto end;
+		return NULL;
 
 	/* Checking acceptable policies. */
-	if (!(policy = TS_RESP_get_policy(ctx)))
-		goto end;
+	return TS_RESP_get_policy(ctx);
+}
 
+/* Creates the TS_TST_INFO object and signs it into the response. */
+static int
+TS_RESP_create_token(TS_RESP_CTX *ctx, ASN1_OBJECT *policy)
+{
 	/* Creating the TS_TST_INFO object. */
 	if (!(ctx->tst_info = TS_RESP_create_tst_info(ctx, policy)))
-		goto end;
+		return 0;
 
 	/* Processing extensions. */
 	if (!TS_RESP_process_extensions(ctx))
-		goto end;
+		return 0;
 
 	/* Generating the signature. */
-	if (!TS_RESP_sign(ctx))
-		goto end;
+	return TS_RESP_sign(ctx);
+}
 
-	/* Everything was successful. */
-	result = 1;
+/*
+ * Sets the status of a failed response and returns the response, cleaning
+ * up the context. Returns NULL only in case of fatal error.
+ */
+static TS_RESP *
+TS_RESP_end_response(TS_RESP_CTX *ctx, int result)
+{
+	TS_RESP *response;
 
-end:
 	if (!result) {
 		TSerror(TS_R_RESPONSE_SETUP_ERROR);
 		if (ctx->response != NULL) {
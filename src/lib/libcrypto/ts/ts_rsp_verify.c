@@ -64,6 +64,8 @@
 #include <openssl/pkcs7.h>
 #include <openssl/ts.h>
 
+#include "ts_lcl.h"
+
 /* Private function declarations. */
 
 static int TS_verify_cert(X509_STORE *store, STACK_OF(X509) *untrusted,
@@ -77,13 +79,14 @@ static int int_TS_RESP_verify_token(TS_VERIFY_CTX *ctx,
 static int TS_check_status_info(TS_RESP *response);
 static char *TS_get_status_text(STACK_OF(ASN1_UTF8STRING) *text);
 static int TS_check_policy(ASN1_OBJECT *req_oid, TS_TST_INFO *tst_info);
-static int TS_compute_imprint(BIO *data, TS_TST_INFO *tst_info,
+static int TS_check_merkle_path(TS_MERKLE_PATH *mp, TS_TST_INFO *tst_info);
+static int TS_compute_imprint(BIO *data, TS_MSG_IMPRINT *msg_imprint,
     X509_ALGOR **md_alg,
     unsigned char **imprint, unsigned *imprint_len);
 static int TS_check_imprints(X509_ALGOR *algor_a,
     unsigned char *imprint_a, unsigned len_a,
-    TS_TST_INFO *tst_info);
-static int TS_check_nonces(const ASN1_INTEGER *a, TS_TST_INFO *tst_info);
+    TS_MSG_IMPRINT *msg_imprint);
+static int TS_check_nonces(const ASN1_INTEGER *a, const ASN1_INTEGER *b);
 static int TS_check_signer_name(GENERAL_NAME *tsa_name, X509 *signer);
 static int TS_find_name(STACK_OF(GENERAL_NAME) *gen_names, GENERAL_NAME *name);
 
@@ -420,6 +423,7 @@ TS_RESP_verify_token(TS_VERIFY_CTX *ctx, PKCS7 *token)
  *	- Verifies the signature of the TS_TST_INFO.
  *	- Checks the version number of the response.
  *	- Check if the requested and returned policies math.
+ *	- Check the Merkle path of a batched response.
  *	- Check if the message imprints are the same.
  *	- Check if the nonces are the same.
  *	- Check if the TSA name matches the signer.
@@ -431,6 +435,9 @@ int_TS_RESP_verify_token(TS_VERIFY_CTX *ctx, PKCS7 *token,
 {
 	X509 *signer = NULL;
 	GENERAL_NAME *tsa_name = TS_TST_INFO_get_tsa(tst_info);
+	TS_MSG_IMPRINT *msg_imprint = TS_TST_INFO_get_msg_imprint(tst_info);
+	const ASN1_INTEGER *nonce = TS_TST_INFO_get_nonce(tst_info);
+	TS_MERKLE_PATH *mp = NULL;
 	X509_ALGOR *md_alg = NULL;
 	unsigned char *imprint = NULL;
 	unsigned imprint_len = 0;
@@ -453,22 +460,35 @@ int_TS_RESP_verify_token(TS_VERIFY_CTX *ctx, PKCS7 *token,
 	    !TS_check_policy(ctx->policy, tst_info))
 		goto err;
 
+	/*
+	 * The token of a batched response is for the root of a Merkle tree,
+	 * and the message imprint and nonce are those of the path to it.
+	 */
+	if (!ts_get_merkle_path(token, &mp))
+		goto err;
+	if (mp != NULL) {
+		if (!TS_check_merkle_path(mp, tst_info))
+			goto err;
+		msg_imprint = mp->msg_imprint;
+		nonce = mp->nonce;
+	}
+
 	/* Check message imprints. */
 	if ((ctx->flags & TS_VFY_IMPRINT) &&
 	    !TS_check_imprints(ctx->md_alg, ctx->imprint, ctx->imprint_len,
-		tst_info))
+		msg_imprint))
 		goto err;
 
 	/* Compute and check message imprints. */
 	if ((ctx->flags & TS_VFY_DATA) &&
-	    (!TS_compute_imprint(ctx->data, tst_info,
+	    (!TS_compute_imprint(ctx->data, msg_imprint,
 	    &md_alg, &imprint, &imprint_len) ||
-	    !TS_check_imprints(md_alg, imprint, imprint_len, tst_info)))
+	    !TS_check_imprints(md_alg, imprint, imprint_len, msg_imprint)))
 		goto err;
 
 	/* Check nonces. */
 	if ((ctx->flags & TS_VFY_NONCE) &&
-	    !TS_check_nonces(ctx->nonce, tst_info))
+	    !TS_check_nonces(ctx->nonce, nonce))
 		goto err;
 
 	/* Check whether TSA name and signer certificate match. */
@@ -489,6 +509,7 @@ int_TS_RESP_verify_token(TS_VERIFY_CTX *ctx, PKCS7 *token,
 
 err:
 	X509_free(signer);
+	TS_MERKLE_PATH_free(mp);
 	X509_ALGOR_free(md_alg);
 	free(imprint);
 	return ret;
@@ -592,11 +613,40 @@ TS_check_policy(ASN1_OBJECT *req_oid, TS_TST_INFO *tst_info)
 	return 1;
 }
 
+/* Checks that the path of a batched response leads to the time-stamped root. */
 static int
-TS_compute_imprint(BIO *data, TS_TST_INFO *tst_info, X509_ALGOR **out_md_alg,
-    unsigned char **out_imprint, unsigned int *out_imprint_len)
+TS_check_merkle_path(TS_MERKLE_PATH *mp, TS_TST_INFO *tst_info)
+{
+	TS_MSG_IMPRINT *root_imprint = TS_TST_INFO_get_msg_imprint(tst_info);
+	unsigned char root[TS_MERKLE_HASH_LEN];
+	X509_ALGOR *md_alg = NULL;
+	int ret = 0;
+
+	if ((md_alg = X509_ALGOR_new()) == NULL) {
+		TSerror(ERR_R_MALLOC_FAILURE);
+		return 0;
+	}
+	X509_ALGOR_set_md(md_alg, EVP_sha256());
+
+	if (!ts_merkle_path_root(mp, root))
+		goto err;
+	if (!TS_check_imprints(md_alg, root, sizeof(root), root_imprint))
+		goto err;
+
+	ret = 1;
+
+err:
+	if (!ret)
+		TSerror(TS_R_MERKLE_PATH_MISMATCH);
+	X509_ALGOR_free(md_alg);
+	return ret;
+}
+
+static int
+TS_compute_imprint(BIO *data, TS_MSG_IMPRINT *msg_imprint,
+    X509_ALGOR **out_md_alg, unsigned char **out_imprint,
+    unsigned int *out_imprint_len)
 {
-	TS_MSG_IMPRINT *msg_imprint;
 	X509_ALGOR *md_alg_resp;
 	X509_ALGOR *md_alg = NULL;
 	unsigned char *imprint = NULL;
@@ -611,7 +661,6 @@ TS_compute_imprint(BIO *data, TS_TST_INFO *tst_info, X509_ALGOR **out_md_alg,
 	*out_imprint_len = 0;
 
 	/* Retrieve the MD algorithm of the response. */
-	msg_imprint = TS_TST_INFO_get_msg_imprint(tst_info);
 	md_alg_resp = TS_MSG_IMPRINT_get_algo(msg_imprint);
 	if ((md_alg = X509_ALGOR_dup(md_alg_resp)) == NULL)
 		goto err;
@@ -656,9 +705,8 @@ err:
 
 static int
 TS_check_imprints(X509_ALGOR *algor_a, unsigned char *imprint_a, unsigned len_a,
-    TS_TST_INFO *tst_info)
+    TS_MSG_IMPRINT *b)
 {
-	TS_MSG_IMPRINT *b = TS_TST_INFO_get_msg_imprint(tst_info);
 	X509_ALGOR *algor_b = TS_MSG_IMPRINT_get_algo(b);
 	int ret = 0;
 
@@ -687,10 +735,8 @@ err:
 }
 
 static int
-TS_check_nonces(const ASN1_INTEGER *a, TS_TST_INFO *tst_info)
+TS_check_nonces(const ASN1_INTEGER *a, const ASN1_INTEGER *b)
 {
-	const ASN1_INTEGER *b = TS_TST_INFO_get_nonce(tst_info);
-
 	/* Error if nonce is missing. */
 	if (!b) {
 		TSerror(TS_R_NONCE_NOT_RETURNED);
@@ -65,18 +65,20 @@
 #include <openssl/err.h>
 #include <openssl/ui.h>
 
+#include "cryptlib.h"
+
 /* BEGIN ERROR CODES */
 #ifndef OPENSSL_NO_ERR
 
 #define ERR_FUNC(func) ERR_PACK(ERR_LIB_UI,func,0)
 #define ERR_REASON(reason) ERR_PACK(ERR_LIB_UI,0,reason)
 
-static ERR_STRING_DATA UI_str_functs[] = {
+static const ERR_STRING_DATA UI_str_functs[] = {
 	{ERR_FUNC(0xfff), "CRYPTO_internal"},
 	{0, NULL}
 };
 
-static ERR_STRING_DATA UI_str_reasons[] = {
+static const ERR_STRING_DATA UI_str_reasons[] = {
 	{ERR_REASON(UI_R_COMMON_OK_AND_CANCEL_CHARACTERS), "common ok and cancel characters"},
 	{ERR_REASON(UI_R_INDEX_TOO_LARGE), "index too large"},
 	{ERR_REASON(UI_R_INDEX_TOO_SMALL), "index too small"},
@@ -94,8 +96,8 @@ ERR_load_UI_strings(void)
 {
 #ifndef OPENSSL_NO_ERR
 	if (ERR_func_error_string(UI_str_functs[0].error) == NULL) {
-		ERR_load_strings(0, UI_str_functs);
-		ERR_load_strings(0, UI_str_reasons);
+		ERR_load_const_strings(UI_str_functs);
+		ERR_load_const_strings(UI_str_reasons);
 	}
 #endif
 }
@@ -58,8 +58,10 @@
 
 #include <sys/types.h>
 
+#include <dirent.h>
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
@@ -72,17 +74,37 @@
 
 # include <sys/stat.h>
 
+#include "x509_lcl.h"
+
 typedef struct lookup_dir_hashes_st {
 	unsigned long hash;
 	int suffix;
 } BY_DIR_HASH;
 
+typedef struct lookup_dir_name_st {
+	unsigned long hash;
+	int is_crl;
+} BY_DIR_NAME;
+
 typedef struct lookup_dir_entry_st {
 	char *dir;
 	int dir_type;
 	STACK_OF(BY_DIR_HASH) *hashes;
+	/* Sorted snapshot of the hash names in dir, if names_valid. */
+	BY_DIR_NAME *names;
+	size_t names_num;
+	int names_valid;
+	struct timespec mtime;
+	time_t checked;
 } BY_DIR_ENTRY;
 
+/*
+ * How long, in seconds, a directory snapshot is trusted before the
+ * directory is stat(2)ed again.  A name hash missing from the snapshot is
+ * not looked up on disk for this long.
+ */
+#define BY_DIR_SNAPSHOT_TTL	5
+
 typedef struct lookup_dir_st {
 	BUF_MEM *buffer;
 	STACK_OF(BY_DIR_ENTRY) *dirs;
@@ -179,6 +201,7 @@ static void
 by_dir_entry_free(BY_DIR_ENTRY *ent)
 {
 	free(ent->dir);
+	free(ent->names);
 	if (ent->hashes)
 		sk_BY_DIR_HASH_pop_free(ent->hashes, by_dir_hash_free);
 	free(ent);
@@ -240,6 +263,10 @@ add_cert_dir(BY_DIR *ctx, const char *dir, int type)
 				return 0;
 			}
 			ent->dir_type = type;
+			ent->names = NULL;
+			ent->names_num = 0;
+			ent->names_valid = 0;
+			ent->checked = 0;
 			ent->hashes = sk_BY_DIR_HASH_new(by_dir_hash_cmp);
 			ent->dir = strndup(ss, (size_t)len);
 			if (!ent->dir || !ent->hashes) {
@@ -257,41 +284,189 @@ add_cert_dir(BY_DIR *ctx, const char *dir, int type)
 	return 1;
 }
 
+static int
+by_dir_name_cmp(const void *a, const void *b)
+{
+	const BY_DIR_NAME *na = a, *nb = b;
+
+	if (na->hash != nb->hash)
+		return na->hash < nb->hash ? -1 : 1;
+	return na->is_crl - nb->is_crl;
+}
+
+/* Parse a file name of the form HHHHHHHH.N or HHHHHHHH.rN. */
+static int
+by_dir_parse_name(const char *filename, BY_DIR_NAME *name)
+{
+	const char *p = filename;
+	unsigned long hash = 0;
+	int i;
+
+	for (i = 0; i < 8; i++, p++) {
+		if (*p >= '0' && *p <= '9')
+			hash = hash << 4 | (*p - '0');
+		else if (*p >= 'a' && *p <= 'f')
+			hash = hash << 4 | (*p - 'a' + 10);
+		else
+			return 0;
+	}
+	if (*p++ != '.')
+		return 0;
+	name->is_crl = 0;
+	if (*p == 'r') {
+		name->is_crl = 1;
+		p++;
+	}
+	if (*p < '0' || *p > '9')
+		return 0;
+	while (*p >= '0' && *p <= '9')
+		p++;
+	if (*p != '\0')
+		return 0;
+	name->hash = hash;
+
+	return 1;
+}
+
+static int
+by_dir_scan(const char *dir, BY_DIR_NAME **out_names, size_t *out_num)
+{
+	BY_DIR_NAME *names = NULL, *tmp;
+	size_t num = 0, max = 0;
+	struct dirent *dp;
+	DIR *dirp;
+
+	if ((dirp = opendir(dir)) == NULL)
+		return 0;
+	while ((dp = readdir(dirp)) != NULL) {
+		if (num == max) {
+			if ((tmp = reallocarray(names, max + 64,
+			    sizeof(*names))) == NULL) {
+				closedir(dirp);
+				free(names);
+				return 0;
+			}
+			names = tmp;
+			max += 64;
+		}
+		if (by_dir_parse_name(dp->d_name, &names[num]))
+			num++;
+	}
+	closedir(dirp);
+
+	if (num > 0)
+		qsort(names, num, sizeof(*names), by_dir_name_cmp);
+
+	*out_names = names;
+	*out_num = num;
+
+	return 1;
+}
+
+/*
+ * Rescan the directory if its modification time changed since the last
+ * snapshot, checking at most once every BY_DIR_SNAPSHOT_TTL seconds.
+ */
+static void
+by_dir_snapshot_refresh(BY_DIR_ENTRY *ent)
+{
+	BY_DIR_NAME *names = NULL;
+	struct timespec now;
+	struct stat st;
+	size_t num = 0;
+	int valid = 0, unchanged;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &now) == -1)
+		return;
+
+	CRYPTO_r_lock(CRYPTO_LOCK_X509_STORE);
+	unchanged = ent->checked != 0 &&
+	    now.tv_sec - ent->checked < BY_DIR_SNAPSHOT_TTL;
+	CRYPTO_r_unlock(CRYPTO_LOCK_X509_STORE);
+	if (unchanged)
+		return;
+
+	memset(&st, 0, sizeof(st));
+	if (stat(ent->dir, &st) == -1) {
+		/* A missing directory has no files to look up. */
+		valid = (errno == ENOENT);
+		goto done;
+	}
+
+	CRYPTO_r_lock(CRYPTO_LOCK_X509_STORE);
+	unchanged = ent->names_valid &&
+	    ent->mtime.tv_sec == st.st_mtim.tv_sec &&
+	    ent->mtime.tv_nsec == st.st_mtim.tv_nsec;
+	CRYPTO_r_unlock(CRYPTO_LOCK_X509_STORE);
+	if (unchanged) {
+		CRYPTO_w_lock(CRYPTO_LOCK_X509_STORE);
+		ent->checked = now.tv_sec;
+		CRYPTO_w_unlock(CRYPTO_LOCK_X509_STORE);
+		return;
+	}
+
+	valid = by_dir_scan(ent->dir, &names, &num);
+
+	/*
+	 * With a coarse timestamp, a file added in the same second as the
+	 * scan would not change the modification time.  Rescan next time.
+	 */
+	if (time(NULL) - st.st_mtim.tv_sec < 2) {
+		st.st_mtim.tv_sec = 0;
+		st.st_mtim.tv_nsec = 0;
+	}
+
+ done:
+	CRYPTO_w_lock(CRYPTO_LOCK_X509_STORE);
+	free(ent->names);
+	ent->names = names;
+	ent->names_num = num;
+	ent->names_valid = valid;
+	ent->mtime = st.st_mtim;
+	ent->checked = now.tv_sec;
+	CRYPTO_w_unlock(CRYPTO_LOCK_X509_STORE);
+}
+
+/*
+ * Return 0 if the snapshot of the directory has no file with the given
+ * name hash, 1 if it has, and -1 if there is no snapshot.
+ */
+static int
+by_dir_snapshot_has(BY_DIR_ENTRY *ent, unsigned long hash, int is_crl)
+{
+	BY_DIR_NAME key;
+	int ret = -1;
+
+	key.hash = hash;
+	key.is_crl = is_crl;
+
+	CRYPTO_r_lock(CRYPTO_LOCK_X509_STORE);
+	if (ent->names_valid)
+		ret = bsearch(&key, ent->names, ent->names_num,
+		    sizeof(*ent->names), by_dir_name_cmp) != NULL;
+	CRYPTO_r_unlock(CRYPTO_LOCK_X509_STORE);
+
+	return ret;
+}
+
 static int
 get_cert_by_subject(X509_LOOKUP *xl, int type, X509_NAME *name,
     X509_OBJECT *ret)
 {
 	BY_DIR *ctx;
-	union	{
-		struct	{
-			X509 st_x509;
-			X509_CINF st_x509_cinf;
-		} x509;
-		struct	{
-			X509_CRL st_crl;
-			X509_CRL_INFO st_crl_info;
-		} crl;
-	} data;
 	int ok = 0;
 	int i, j, k;
 	unsigned long h;
 	BUF_MEM *b = NULL;
-	X509_OBJECT stmp, *tmp;
+	X509_OBJECT *tmp;
 	const char *postfix="";
 
 	if (name == NULL)
 		return (0);
 
-	stmp.type = type;
 	if (type == X509_LU_X509) {
-		data.x509.st_x509.cert_info = &data.x509.st_x509_cinf;
-		data.x509.st_x509_cinf.subject = name;
-		stmp.data.x509 = &data.x509.st_x509;
 		postfix="";
 	} else if (type == X509_LU_CRL) {
-		data.crl.st_crl.crl = &data.crl.st_crl_info;
-		data.crl.st_crl_info.issuer = name;
-		stmp.data.crl = &data.crl.st_crl;
 		postfix="r";
 	} else {
 		X509error(X509_R_WRONG_LOOKUP_TYPE);
@@ -311,6 +486,9 @@ get_cert_by_subject(X509_LOOKUP *xl, int type, X509_NAME *name,
 		int idx;
 		BY_DIR_HASH htmp, *hent;
 		ent = sk_BY_DIR_ENTRY_value(ctx->dirs, i);
+		by_dir_snapshot_refresh(ent);
+		if (by_dir_snapshot_has(ent, h, type == X509_LU_CRL) == 0)
+			continue;
 		j = strlen(ent->dir) + 1 + 8 + 6 + 1 + 1;
 		if (!BUF_MEM_grow(b, j)) {
 			X509error(ERR_R_MALLOC_FAILURE);
@@ -356,13 +534,7 @@ get_cert_by_subject(X509_LOOKUP *xl, int type, X509_NAME *name,
 		}
 
 		/* we have added it to the cache so now pull it out again */
-		CRYPTO_w_lock(CRYPTO_LOCK_X509_STORE);
-		j = sk_X509_OBJECT_find(xl->store_ctx->objs, &stmp);
-		if (j != -1)
-			tmp = sk_X509_OBJECT_value(xl->store_ctx->objs, j);
-		else
-			tmp = NULL;
-		CRYPTO_w_unlock(CRYPTO_LOCK_X509_STORE);
+		tmp = x509_store_get0_by_subject(xl->store_ctx, type, name);
 
 		/* If a CRL, update the last file suffix added for this */
 		if (type == X509_LU_CRL) {
@@ -156,7 +156,7 @@ X509_load_cert_file(X509_LOOKUP *ctx, const char *file, int type)
 		}
 		ret = count;
 	} else if (type == X509_FILETYPE_ASN1) {
-		x = d2i_X509_bio(in, NULL);
+		x = ASN1_d2i_bio_of(X509, X509_new, d2i_X509_lazy, in, NULL);
 		if (x == NULL) {
 			X509error(ERR_R_ASN1_LIB);
 			goto err;
@@ -234,13 +234,40 @@ err:
 	return (ret);
 }
 
+struct load_info {
+	X509_LOOKUP *ctx;
+	int count;
+};
+
+static int
+load_info_cb(X509_INFO *itmp, void *arg)
+{
+	struct load_info *li = arg;
+
+	if (itmp->x509) {
+		X509_STORE_add_cert(li->ctx->store_ctx, itmp->x509);
+		li->count++;
+	}
+	if (itmp->crl) {
+		X509_STORE_add_crl(li->ctx->store_ctx, itmp->crl);
+		li->count++;
+	}
+	X509_INFO_free(itmp);
+	return 1;
+}
+
+/*
+ * The objects are added to the store as they are read, so that a large
+ * bundle is never held in memory as a whole. If the file turns out to be
+ * invalid, the objects before the error stay in the store.
+ */
 int
 X509_load_cert_crl_file(X509_LOOKUP *ctx, const char *file, int type)
 {
-	STACK_OF(X509_INFO) *inf;
-	X509_INFO *itmp;
+	struct load_info li;
 	BIO *in;
-	int i, count = 0;
+	int ok;
+
 	if (type != X509_FILETYPE_PEM)
 		return X509_load_cert_file(ctx, file, type);
 	in = BIO_new_file(file, "r");
@@ -248,24 +275,14 @@ X509_load_cert_crl_file(X509_LOOKUP *ctx, const char *file, int type)
 		X509error(ERR_R_SYS_LIB);
 		return 0;
 	}
-	inf = PEM_X509_INFO_read_bio(in, NULL, NULL, NULL);
+	li.ctx = ctx;
+	li.count = 0;
+	ok = PEM_X509_INFO_read_bio_cb(in, load_info_cb, &li, NULL, NULL);
 	BIO_free(in);
-	if (!inf) {
+	if (!ok) {
 		X509error(ERR_R_PEM_LIB);
 		return 0;
 	}
-	for (i = 0; i < sk_X509_INFO_num(inf); i++) {
-		itmp = sk_X509_INFO_value(inf, i);
-		if (itmp->x509) {
-			X509_STORE_add_cert(ctx->store_ctx, itmp->x509);
-			count++;
-		}
-		if (itmp->crl) {
-			X509_STORE_add_crl(ctx->store_ctx, itmp->crl);
-			count++;
-		}
-	}
-	sk_X509_INFO_pop_free(inf, X509_INFO_free);
-	return count;
+	return li.count;
 }
 
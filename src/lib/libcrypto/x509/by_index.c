@@ -0,0 +1,368 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Lookup method for pre-indexed certificate files, as written by
+ * "openssl certhash -o".  The file is mapped into memory when it is
+ * added and certificates and CRLs are only decoded when a lookup asks
+ * for their subject or issuer name.
+ *
+ * All integers are 32 bit big endian.  The file starts with a header
+ *
+ *	magic "CERTINDX", version, number of entries
+ *
+ * followed by the entries, each
+ *
+ *	name hash, object type, offset, length
+ *
+ * sorted by name hash and followed by the DER encoded objects.  The name
+ * hash is X509_NAME_hash() of the certificate subject or the CRL issuer,
+ * the type is X509_LU_X509 or X509_LU_CRL and the offset is from the
+ * start of the file.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <openssl/err.h>
+#include <openssl/x509.h>
+
+#include "x509_lcl.h"
+
+#define BY_INDEX_MAGIC		"CERTINDX"
+#define BY_INDEX_MAGIC_LEN	8
+#define BY_INDEX_VERSION	1
+#define BY_INDEX_HEADER_LEN	16
+#define BY_INDEX_ENTRY_LEN	16
+
+typedef struct lookup_index_file_st {
+	unsigned char *data;
+	size_t len;
+	uint32_t count;
+	unsigned char *loaded;
+	struct lookup_index_file_st *next;
+} BY_INDEX_FILE;
+
+typedef struct lookup_index_st {
+	BY_INDEX_FILE *files;
+} BY_INDEX;
+
+static int index_ctrl(X509_LOOKUP *ctx, int cmd, const char *argp,
+    long argl, char **ret);
+static int new_index(X509_LOOKUP *lu);
+static void free_index(X509_LOOKUP *lu);
+static int get_cert_by_subject(X509_LOOKUP *xl, int type, X509_NAME *name,
+    X509_OBJECT *ret);
+
+static X509_LOOKUP_METHOD x509_index_lookup = {
+	.name = "Load certs from a pre-indexed file",
+	.new_item = new_index,
+	.free = free_index,
+	.init = NULL,
+	.shutdown = NULL,
+	.ctrl = index_ctrl,
+	.get_by_subject = get_cert_by_subject,
+	.get_by_issuer_serial = NULL,
+	.get_by_fingerprint = NULL,
+	.get_by_alias = NULL,
+};
+
+X509_LOOKUP_METHOD *
+X509_LOOKUP_index(void)
+{
+	return (&x509_index_lookup);
+}
+
+static uint32_t
+index_get32(const unsigned char *p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+	    (uint32_t)p[2] << 8 | (uint32_t)p[3];
+}
+
+static const unsigned char *
+index_entry(const BY_INDEX_FILE *bf, uint32_t i)
+{
+	return bf->data + BY_INDEX_HEADER_LEN + (size_t)i * BY_INDEX_ENTRY_LEN;
+}
+
+static void
+index_file_free(BY_INDEX_FILE *bf)
+{
+	if (bf == NULL)
+		return;
+	if (bf->data != NULL)
+		munmap(bf->data, bf->len);
+	free(bf->loaded);
+	free(bf);
+}
+
+/* Check that the index is sorted and every object lies inside the file. */
+static int
+index_file_check(BY_INDEX_FILE *bf)
+{
+	const unsigned char *ent;
+	uint32_t i, hash, last = 0, type, off, len;
+	size_t table_end;
+
+	if (bf->len < BY_INDEX_HEADER_LEN)
+		return 0;
+	if (memcmp(bf->data, BY_INDEX_MAGIC, BY_INDEX_MAGIC_LEN) != 0)
+		return 0;
+	if (index_get32(bf->data + 8) != BY_INDEX_VERSION)
+		return 0;
+	bf->count = index_get32(bf->data + 12);
+	if (bf->count > (bf->len - BY_INDEX_HEADER_LEN) / BY_INDEX_ENTRY_LEN)
+		return 0;
+	table_end = BY_INDEX_HEADER_LEN +
+	    (size_t)bf->count * BY_INDEX_ENTRY_LEN;
+
+	for (i = 0; i < bf->count; i++) {
+		ent = index_entry(bf, i);
+		hash = index_get32(ent);
+		type = index_get32(ent + 4);
+		off = index_get32(ent + 8);
+		len = index_get32(ent + 12);
+		if (hash < last)
+			return 0;
+		if (type != X509_LU_X509 && type != X509_LU_CRL)
+			return 0;
+		if (off < table_end || off > bf->len || len == 0 ||
+		    len > bf->len - off)
+			return 0;
+		last = hash;
+	}
+
+	return 1;
+}
+
+static int
+add_index_file(BY_INDEX *ctx, const char *file)
+{
+	BY_INDEX_FILE *bf = NULL;
+	struct stat sb;
+	void *data;
+	int fd = -1;
+
+	if (file == NULL) {
+		X509error(X509_R_INVALID_INDEX);
+		return 0;
+	}
+
+	if ((bf = calloc(1, sizeof(*bf))) == NULL) {
+		X509error(ERR_R_MALLOC_FAILURE);
+		goto err;
+	}
+	if ((fd = open(file, O_RDONLY)) == -1) {
+		SYSerror(errno);
+		goto err;
+	}
+	if (fstat(fd, &sb) == -1) {
+		SYSerror(errno);
+		goto err;
+	}
+	if (sb.st_size < BY_INDEX_HEADER_LEN || sb.st_size > SIZE_MAX) {
+		X509error(X509_R_INVALID_INDEX);
+		goto err;
+	}
+	bf->len = sb.st_size;
+	data = mmap(NULL, bf->len, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		SYSerror(errno);
+		goto err;
+	}
+	bf->data = data;
+	close(fd);
+	fd = -1;
+
+	if (!index_file_check(bf)) {
+		X509error(X509_R_INVALID_INDEX);
+		goto err;
+	}
+	if ((bf->loaded = calloc(bf->count ? bf->count : 1, 1)) == NULL) {
+		X509error(ERR_R_MALLOC_FAILURE);
+		goto err;
+	}
+
+	bf->next = ctx->files;
+	ctx->files = bf;
+
+	return 1;
+
+ err:
+	if (fd != -1)
+		close(fd);
+	index_file_free(bf);
+
+	return 0;
+}
+
+static int
+index_ctrl(X509_LOOKUP *ctx, int cmd, const char *argp, long argl,
+    char **retp)
+{
+	BY_INDEX *bi = (BY_INDEX *)ctx->method_data;
+
+	switch (cmd) {
+	case X509_L_INDEX_LOAD:
+		return add_index_file(bi, argp);
+	}
+	return 0;
+}
+
+static int
+new_index(X509_LOOKUP *lu)
+{
+	BY_INDEX *a;
+
+	if ((a = calloc(1, sizeof(*a))) == NULL) {
+		X509error(ERR_R_MALLOC_FAILURE);
+		return 0;
+	}
+	lu->method_data = (char *)a;
+	return 1;
+}
+
+static void
+free_index(X509_LOOKUP *lu)
+{
+	BY_INDEX *a = (BY_INDEX *)lu->method_data;
+	BY_INDEX_FILE *bf, *next;
+
+	if (a == NULL)
+		return;
+	for (bf = a->files; bf != NULL; bf = next) {
+		next = bf->next;
+		index_file_free(bf);
+	}
+	free(a);
+}
+
+/* Return the first entry with the given hash, or count if there is none. */
+static uint32_t
+index_find(const BY_INDEX_FILE *bf, uint32_t hash)
+{
+	uint32_t lo = 0, hi = bf->count, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (index_get32(index_entry(bf, mid)) < hash)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/*
+ * Decode the object behind entry i and add it to the store.  Each entry
+ * is only tried once; an object that the store already holds counts as
+ * loaded.
+ */
+static void
+index_load_entry(X509_LOOKUP *xl, BY_INDEX_FILE *bf, uint32_t i, int type)
+{
+	const unsigned char *ent, *p, *end;
+	X509_CRL *crl = NULL;
+	X509 *x = NULL;
+	int loaded;
+
+	CRYPTO_r_lock(CRYPTO_LOCK_X509_STORE);
+	loaded = bf->loaded[i];
+	CRYPTO_r_unlock(CRYPTO_LOCK_X509_STORE);
+	if (loaded)
+		return;
+
+	ent = index_entry(bf, i);
+	p = bf->data + index_get32(ent + 8);
+	end = p + index_get32(ent + 12);
+
+	ERR_set_mark();
+	if (type == X509_LU_X509) {
+		if ((x = d2i_X509(NULL, &p, end - p)) == NULL || p != end)
+			goto err;
+		if (!X509_STORE_add_cert(xl->store_ctx, x) &&
+		    ERR_GET_REASON(ERR_peek_last_error()) !=
+		    X509_R_CERT_ALREADY_IN_HASH_TABLE)
+			goto err;
+	} else {
+		if ((crl = d2i_X509_CRL(NULL, &p, end - p)) == NULL || p != end)
+			goto err;
+		if (!X509_STORE_add_crl(xl->store_ctx, crl) &&
+		    ERR_GET_REASON(ERR_peek_last_error()) !=
+		    X509_R_CERT_ALREADY_IN_HASH_TABLE)
+			goto err;
+	}
+	ERR_pop_to_mark();
+
+ err:
+	CRYPTO_w_lock(CRYPTO_LOCK_X509_STORE);
+	bf->loaded[i] = 1;
+	CRYPTO_w_unlock(CRYPTO_LOCK_X509_STORE);
+
+	X509_free(x);
+	X509_CRL_free(crl);
+}
+
+static int
+get_cert_by_subject(X509_LOOKUP *xl, int type, X509_NAME *name,
+    X509_OBJECT *ret)
+{
+	BY_INDEX *bi;
+	BY_INDEX_FILE *bf;
+	X509_OBJECT *tmp;
+	const unsigned char *ent;
+	uint32_t hash, i;
+
+	if (name == NULL)
+		return 0;
+	if (type != X509_LU_X509 && type != X509_LU_CRL) {
+		X509error(X509_R_WRONG_LOOKUP_TYPE);
+		return 0;
+	}
+
+	bi = (BY_INDEX *)xl->method_data;
+	hash = X509_NAME_hash(name);
+
+	for (bf = bi->files; bf != NULL; bf = bf->next) {
+		for (i = index_find(bf, hash); i < bf->count; i++) {
+			ent = index_entry(bf, i);
+			if (index_get32(ent) != hash)
+				break;
+			if (index_get32(ent + 4) != (uint32_t)type)
+				continue;
+			index_load_entry(xl, bf, i, type);
+		}
+	}
+
+	if ((tmp = x509_store_get0_by_subject(xl->store_ctx, type,
+	    name)) == NULL)
+		return 0;
+
+	/* As in by_dir, the reference stays with the store. */
+	ret->type = tmp->type;
+	memcpy(&ret->data, &tmp->data, sizeof(ret->data));
+
+	return 1;
+}
@@ -72,4 +72,6 @@ struct X509_VERIFY_PARAM_ID_st {
 	int poisoned;
 };
 
+void x509_verify_param_reset(X509_VERIFY_PARAM *param);
+
 __END_HIDDEN_DECLS
@@ -287,6 +287,12 @@ struct x509_st
 	STACK_OF(DIST_POINT) *crldp;
 	STACK_OF(GENERAL_NAME) *altname;
 	NAME_CONSTRAINTS *nc;
+	struct x509_constraints_cache *nc_cache; /* compiled nc */
+	struct x509_host_cache *host_cache; /* compiled DNS names */
+	struct x509_lazy *lazy;		/* extensions not decoded */
+	int ex_cached;			/* extension values cached */
+	time_t not_before;		/* validity, cached with extensions */
+	time_t not_after;
 #ifndef OPENSSL_NO_SHA
 	unsigned char sha1_hash[SHA_DIGEST_LENGTH];
 #endif
@@ -464,6 +470,7 @@ struct X509_crl_st
 	STACK_OF(GENERAL_NAMES) *issuers;
 	const X509_CRL_METHOD *meth;
 	void *meth_data;
+	struct x509_crl_lazy *lazy;	/* revoked entries not decoded */
 	} /* X509_CRL */;
 
 DECLARE_STACK_OF(X509_CRL)
@@ -870,6 +877,7 @@ extern const ASN1_ITEM X509_CINF_it;
 X509 *X509_new(void);
 void X509_free(X509 *a);
 X509 *d2i_X509(X509 **a, const unsigned char **in, long len);
+X509 *d2i_X509_lazy(X509 **a, const unsigned char **in, long len);
 int i2d_X509(X509 *a, unsigned char **out);
 extern const ASN1_ITEM X509_it;
 X509_CERT_AUX *X509_CERT_AUX_new(void);
@@ -921,6 +929,7 @@ extern const ASN1_ITEM X509_CRL_INFO_it;
 X509_CRL *X509_CRL_new(void);
 void X509_CRL_free(X509_CRL *a);
 X509_CRL *d2i_X509_CRL(X509_CRL **a, const unsigned char **in, long len);
+X509_CRL *d2i_X509_CRL_lazy(X509_CRL **a, const unsigned char **in, long len);
 int i2d_X509_CRL(X509_CRL *a, unsigned char **out);
 extern const ASN1_ITEM X509_CRL_it;
 
@@ -1382,9 +1391,12 @@ void ERR_load_X509_strings(void);
 #define X509_R_BASE64_DECODE_ERROR			 118
 #define X509_R_CANT_CHECK_DH_KEY			 114
 #define X509_R_CERT_ALREADY_IN_HASH_TABLE		 101
+#define X509_R_CRL_NOT_FOUND				 128
 #define X509_R_ERR_ASN1_LIB				 102
+#define X509_R_INVALID_CRL_FILTER			 129
 #define X509_R_INVALID_DIRECTORY			 113
 #define X509_R_INVALID_FIELD_NAME			 119
+#define X509_R_INVALID_INDEX				 127
 #define X509_R_INVALID_TRUST				 123
 #define X509_R_KEY_TYPE_MISMATCH			 115
 #define X509_R_KEY_VALUES_MISMATCH			 116
@@ -1402,6 +1414,7 @@ void ERR_load_X509_strings(void);
 #define X509_R_UNKNOWN_PURPOSE_ID			 121
 #define X509_R_UNKNOWN_TRUST_ID				 120
 #define X509_R_UNSUPPORTED_ALGORITHM			 111
+#define X509_R_UNSUPPORTED_CRL				 130
 #define X509_R_WRONG_LOOKUP_TYPE			 112
 #define X509_R_WRONG_TYPE				 122
 
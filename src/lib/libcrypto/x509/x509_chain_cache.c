@@ -0,0 +1,267 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* x509_chain_cache */
+
+/*
+ * The chain cache remembers the outcome of successful verifications
+ * made against an X509_STORE. It is keyed on a digest of the leaf, the
+ * untrusted certificates in the order they were presented and the
+ * verification parameters that affect the result.
+ *
+ * A hit hands back the chain that was built, so that the complete chain
+ * building and signature checking can be skipped. Entries are tied to
+ * the generation of the store when the verification started and are
+ * dropped once anything is added to the store, the validity window of
+ * the chain does not cover the time checked, or the entry is older than
+ * X509_CHAIN_CACHE_TTL seconds, which bounds how stale a revocation
+ * result may become.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "x509_chain_cache.h"
+#include "x509_internal.h"
+
+static int
+x509_chain_cmp(struct x509_chain *c1, struct x509_chain *c2)
+{
+	return memcmp(c1->md, c2->md, X509_CHAIN_CACHE_MD_LEN);
+}
+
+RB_PROTOTYPE(x509_chain_tree, x509_chain, entry, x509_chain_cmp);
+RB_GENERATE(x509_chain_tree, x509_chain, entry, x509_chain_cmp);
+
+static void
+x509_chain_free(struct x509_chain *chain)
+{
+	if (chain == NULL)
+		return;
+	sk_X509_pop_free(chain->chain, X509_free);
+	free(chain);
+}
+
+static void
+x509_chain_cache_remove(struct x509_chain_cache *cache,
+    struct x509_chain *chain)
+{
+	RB_REMOVE(x509_chain_tree, &cache->tree, chain);
+	TAILQ_REMOVE(&cache->lru, chain, queue);
+	cache->count--;
+	x509_chain_free(chain);
+}
+
+/* Drop entries from the tail of the LRU until at most max remain. */
+static void
+x509_chain_cache_trim(struct x509_chain_cache *cache, size_t max)
+{
+	struct x509_chain *old;
+
+	while (cache->count > max) {
+		if ((old = TAILQ_LAST(&cache->lru, x509_chain_lru)) == NULL)
+			break;
+		x509_chain_cache_remove(cache, old);
+	}
+}
+
+struct x509_chain_cache *
+x509_chain_cache_new(size_t max)
+{
+	struct x509_chain_cache *cache;
+
+	if ((cache = calloc(1, sizeof(*cache))) == NULL)
+		return NULL;
+	if (pthread_mutex_init(&cache->mutex, NULL) != 0) {
+		free(cache);
+		return NULL;
+	}
+	RB_INIT(&cache->tree);
+	TAILQ_INIT(&cache->lru);
+	cache->max = max;
+
+	return cache;
+}
+
+void
+x509_chain_cache_free(struct x509_chain_cache *cache)
+{
+	if (cache == NULL)
+		return;
+	x509_chain_cache_trim(cache, 0);
+	pthread_mutex_destroy(&cache->mutex);
+	free(cache);
+}
+
+void
+x509_chain_cache_set_max(struct x509_chain_cache *cache, size_t max)
+{
+	if (pthread_mutex_lock(&cache->mutex) != 0)
+		return;
+	cache->max = max;
+	x509_chain_cache_trim(cache, max);
+	(void) pthread_mutex_unlock(&cache->mutex);
+}
+
+uint64_t
+x509_chain_cache_generation(struct x509_chain_cache *cache)
+{
+	uint64_t generation;
+
+	if (pthread_mutex_lock(&cache->mutex) != 0)
+		return 0;
+	generation = cache->generation;
+	(void) pthread_mutex_unlock(&cache->mutex);
+
+	return generation;
+}
+
+/*
+ * Called whenever the store changes. Entries of older generations can
+ * never be hit again, so they are released straight away.
+ */
+void
+x509_chain_cache_bump(struct x509_chain_cache *cache)
+{
+	if (pthread_mutex_lock(&cache->mutex) != 0)
+		return;
+	cache->generation++;
+	x509_chain_cache_trim(cache, 0);
+	(void) pthread_mutex_unlock(&cache->mutex);
+}
+
+/*
+ * Look up a verified chain by its digest. On a hit, *chain is set to a
+ * copy of the cached chain holding its own certificate references and 1
+ * is returned. A stale entry is removed and 0 returned.
+ */
+int
+x509_chain_cache_find(struct x509_chain_cache *cache,
+    const unsigned char *md, time_t check_time, int check_validity,
+    STACK_OF(X509) **chain, int *last_untrusted)
+{
+	struct x509_chain candidate, *found;
+	int ret = 0;
+
+	*chain = NULL;
+
+	memset(&candidate, 0, sizeof(candidate));
+	memcpy(candidate.md, md, X509_CHAIN_CACHE_MD_LEN);
+
+	if (pthread_mutex_lock(&cache->mutex) != 0)
+		return 0;
+	if ((found = RB_FIND(x509_chain_tree, &cache->tree,
+	    &candidate)) == NULL)
+		goto done;
+	if (found->generation != cache->generation ||
+	    found->expires < time(NULL)) {
+		x509_chain_cache_remove(cache, found);
+		goto done;
+	}
+	if (check_validity && (check_time < found->not_before ||
+	    check_time > found->not_after))
+		goto done;
+	if ((*chain = X509_chain_up_ref(found->chain)) == NULL)
+		goto done;
+	*last_untrusted = found->last_untrusted;
+	TAILQ_REMOVE(&cache->lru, found, queue);
+	TAILQ_INSERT_HEAD(&cache->lru, found, queue);
+	ret = 1;
+
+ done:
+	if (ret)
+		cache->hits++;
+	else
+		cache->misses++;
+	(void) pthread_mutex_unlock(&cache->mutex);
+
+	return ret;
+}
+
+/*
+ * Compute the window in which every certificate of the chain is within
+ * its validity period. Returns 0 if a time cannot be converted.
+ */
+static int
+x509_chain_window(STACK_OF(X509) *chain, time_t *not_before,
+    time_t *not_after)
+{
+	X509 *cert;
+	time_t nb, na;
+	int i;
+
+	*not_before = 0;
+	*not_after = 0;
+
+	for (i = 0; i < sk_X509_num(chain); i++) {
+		cert = sk_X509_value(chain, i);
+		x509v3_cache_extensions(cert);
+		if (cert->ex_flags &
+		    (EXFLAG_BAD_NOT_BEFORE | EXFLAG_BAD_NOT_AFTER))
+			return 0;
+		nb = cert->not_before;
+		na = cert->not_after;
+		if (i == 0 || nb > *not_before)
+			*not_before = nb;
+		if (i == 0 || na < *not_after)
+			*not_after = na;
+	}
+
+	return sk_X509_num(chain) > 0;
+}
+
+/*
+ * Add a successfully verified chain. The generation is the one read
+ * before the verification started, so a chain that was built while the
+ * store changed is not added.
+ */
+void
+x509_chain_cache_add(struct x509_chain_cache *cache,
+    const unsigned char *md, uint64_t generation, STACK_OF(X509) *chain,
+    int last_untrusted)
+{
+	struct x509_chain *new, *old;
+
+	if (cache->max == 0)
+		return;
+	if ((new = calloc(1, sizeof(*new))) == NULL)
+		return;
+	memcpy(new->md, md, X509_CHAIN_CACHE_MD_LEN);
+	new->generation = generation;
+	new->last_untrusted = last_untrusted;
+	new->expires = time(NULL) + X509_CHAIN_CACHE_TTL;
+	if (!x509_chain_window(chain, &new->not_before, &new->not_after))
+		goto err;
+	if ((new->chain = X509_chain_up_ref(chain)) == NULL)
+		goto err;
+
+	if (pthread_mutex_lock(&cache->mutex) != 0)
+		goto err;
+	if (generation != cache->generation)
+		goto unlock;
+	if ((old = RB_FIND(x509_chain_tree, &cache->tree, new)) != NULL)
+		x509_chain_cache_remove(cache, old);
+	x509_chain_cache_trim(cache, cache->max - 1);
+	RB_INSERT(x509_chain_tree, &cache->tree, new);
+	TAILQ_INSERT_HEAD(&cache->lru, new, queue);
+	cache->count++;
+	new = NULL;
+ unlock:
+	(void) pthread_mutex_unlock(&cache->mutex);
+ err:
+	x509_chain_free(new);
+}
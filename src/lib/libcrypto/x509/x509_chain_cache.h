@@ -0,0 +1,79 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* x509_chain_cache */
+#ifndef HEADER_X509_CHAIN_CACHE_H
+#define HEADER_X509_CHAIN_CACHE_H
+
+#include <sys/tree.h>
+#include <sys/queue.h>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <openssl/sha.h>
+#include <openssl/x509.h>
+
+__BEGIN_HIDDEN_DECLS
+
+#define X509_CHAIN_CACHE_MD_LEN	SHA512_DIGEST_LENGTH
+#define X509_CHAIN_CACHE_TTL	300	/* Seconds an entry is trusted. */
+
+struct x509_chain {
+	RB_ENTRY(x509_chain) entry;
+	TAILQ_ENTRY(x509_chain) queue;	/* LRU queue of entries */
+	unsigned char md[X509_CHAIN_CACHE_MD_LEN];
+	uint64_t generation;		/* Store generation when verified. */
+	time_t not_before;		/* Latest notBefore in the chain. */
+	time_t not_after;		/* Earliest notAfter in the chain. */
+	time_t expires;			/* Wall clock expiry of the entry. */
+	STACK_OF(X509) *chain;		/* Verified chain. */
+	int last_untrusted;
+};
+
+RB_HEAD(x509_chain_tree, x509_chain);
+TAILQ_HEAD(x509_chain_lru, x509_chain);
+
+struct x509_chain_cache {
+	pthread_mutex_t mutex;
+	struct x509_chain_tree tree;
+	struct x509_chain_lru lru;
+	size_t count;
+	size_t max;
+	uint64_t generation;
+	uint64_t hits;
+	uint64_t misses;
+};
+
+struct x509_chain_cache *x509_chain_cache_new(size_t max);
+void x509_chain_cache_free(struct x509_chain_cache *cache);
+void x509_chain_cache_set_max(struct x509_chain_cache *cache, size_t max);
+uint64_t x509_chain_cache_generation(struct x509_chain_cache *cache);
+void x509_chain_cache_bump(struct x509_chain_cache *cache);
+int x509_chain_cache_find(struct x509_chain_cache *cache,
+    const unsigned char *md, time_t check_time, int check_validity,
+    STACK_OF(X509) **chain, int *last_untrusted);
+void x509_chain_cache_add(struct x509_chain_cache *cache,
+    const unsigned char *md, uint64_t generation, STACK_OF(X509) *chain,
+    int last_untrusted);
+
+int x509_verify_cert_cacheable(X509_STORE_CTX *ctx);
+
+__END_HIDDEN_DECLS
+
+#endif
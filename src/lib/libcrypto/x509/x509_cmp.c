@@ -68,6 +68,8 @@
 #include <openssl/x509.h>
 #include <openssl/x509v3.h>
 
+#include "asn1_locl.h"
+
 int
 X509_issuer_and_serial_cmp(const X509 *a, const X509 *b)
 {
@@ -220,23 +222,21 @@ X509_cmp(const X509 *a, const X509 *b)
 int
 X509_NAME_cmp(const X509_NAME *a, const X509_NAME *b)
 {
+	const unsigned char *a_enc, *b_enc;
+	int a_len, b_len;
 	int ret;
 
 	/* Ensure canonical encoding is present and up to date */
-	if (!a->canon_enc || a->modified) {
-		ret = i2d_X509_NAME((X509_NAME *)a, NULL);
-		if (ret < 0)
-			return -2;
-	}
-	if (!b->canon_enc || b->modified) {
-		ret = i2d_X509_NAME((X509_NAME *)b, NULL);
-		if (ret < 0)
-			return -2;
-	}
-	ret = a->canon_enclen - b->canon_enclen;
+	if (!x509_name_get_canon((X509_NAME *)a, &a_enc, &a_len))
+		return -2;
+	if (!x509_name_get_canon((X509_NAME *)b, &b_enc, &b_len))
+		return -2;
+	ret = a_len - b_len;
 	if (ret)
 		return ret;
-	return memcmp(a->canon_enc, b->canon_enc, a->canon_enclen);
+	if (a_len == 0)
+		return 0;
+	return memcmp(a_enc, b_enc, a_len);
 }
 
 unsigned long
@@ -244,11 +244,13 @@ X509_NAME_hash(X509_NAME *x)
 {
 	unsigned long ret = 0;
 	unsigned char md[SHA_DIGEST_LENGTH];
+	const unsigned char *canon_enc;
+	int canon_enclen;
 
 	/* Make sure X509_NAME structure contains valid cached encoding */
-	i2d_X509_NAME(x, NULL);
-	if (!EVP_Digest(x->canon_enc, x->canon_enclen, md, NULL, EVP_sha1(),
-	    NULL))
+	if (!x509_name_get_canon(x, &canon_enc, &canon_enclen))
+		return 0;
+	if (!EVP_Digest(canon_enc, canon_enclen, md, NULL, EVP_sha1(), NULL))
 		return 0;
 
 	ret = (((unsigned long)md[0]) | ((unsigned long)md[1] << 8L) |
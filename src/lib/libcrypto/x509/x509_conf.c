@@ -66,6 +66,8 @@
 #include <openssl/x509.h>
 #include <openssl/x509v3.h>
 
+#include "asn1_locl.h"
+
 static int v3_check_critical(const char **value);
 static int v3_check_generic(const char **value);
 static X509_EXTENSION *do_ext_nconf(CONF *conf, X509V3_CTX *ctx, int ext_nid,
@@ -371,8 +373,11 @@ X509V3_EXT_add_nconf(CONF *conf, X509V3_CTX *ctx, const char *section,
 {
 	STACK_OF(X509_EXTENSION) **sk = NULL;
 
-	if (cert)
+	if (cert) {
+		if (!x509_lazy_load_extensions(cert))
+			return 0;
 		sk = &cert->cert_info->extensions;
+	}
 	return X509V3_EXT_add_nconf_sk(conf, ctx, section, sk);
 }
 
@@ -18,6 +18,7 @@
 #include <ctype.h>
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
@@ -29,6 +30,7 @@
 #include <openssl/x509.h>
 #include <openssl/x509v3.h>
 
+#include "asn1_locl.h"
 #include "x509_internal.h"
 
 /* RFC 2821 section 4.5.3.1 */
@@ -661,9 +663,12 @@ x509_constraints_general_to_bytes(GENERAL_NAME *name, uint8_t **bytes,
 	}
 	if (name->type == GEN_DIRNAME) {
 		X509_NAME *dname = name->d.directoryName;
-		if (!dname->modified || i2d_X509_NAME(dname, NULL) >= 0) {
-			*bytes = dname->canon_enc;
-			*len = dname->canon_enclen;
+		const unsigned char *canon_enc;
+		int canon_enclen;
+
+		if (x509_name_get_canon(dname, &canon_enc, &canon_enclen)) {
+			*bytes = (uint8_t *)canon_enc;
+			*len = canon_enclen;
 			return name->type;
 		}
 	}
@@ -783,22 +788,23 @@ x509_constraints_extract_names(struct x509_constraints_names *names,
 	if (X509_NAME_entry_count(subject_name) > 0) {
 		X509_NAME_ENTRY *email;
 		X509_NAME_ENTRY *cn;
+		const unsigned char *canon_enc;
+		int canon_enclen;
 		/*
 		 * This cert has a non-empty subject, so we must add
 		 * the subject as a dirname to be compared against
 		 * any dirname constraints
 		 */
-		if ((subject_name->modified &&
-		    i2d_X509_NAME(subject_name, NULL) < 0) ||
+		if (!x509_name_get_canon(subject_name, &canon_enc,
+		    &canon_enclen) ||
 		    (vname = x509_constraints_name_new()) == NULL ||
-		    (vname->der = malloc(subject_name->canon_enclen)) == NULL) {
+		    (vname->der = malloc(canon_enclen)) == NULL) {
 			*error = X509_V_ERR_OUT_OF_MEM;
 			goto err;
 		}
 
-		memcpy(vname->der, subject_name->canon_enc,
-		    subject_name->canon_enclen);
-		vname->der_len = subject_name->canon_enclen;
+		memcpy(vname->der, canon_enc, canon_enclen);
+		vname->der_len = canon_enclen;
 		vname->type = GEN_DIRNAME;
 		if (!x509_constraints_names_add(names, vname)) {
 			*error = X509_V_ERR_OUT_OF_MEM;
@@ -1106,6 +1112,371 @@ x509_constraints_check(struct x509_constraints_names *names,
 	return 1;
 }
 
+/*
+ * Compiled name constraints.
+ *
+ * DNS name constraints match any name ending in the constraint,
+ * ignoring case, as in x509_constraints_sandns(). The trie holds each
+ * constraint with its characters reversed and folded to lower case, so
+ * a name matches if walking it backwards through the trie passes a
+ * node where a constraint ends.
+ */
+struct x509_constraints_trie {
+	struct x509_constraints_trie *child;
+	struct x509_constraints_trie *sibling;
+	unsigned char c;
+	int terminal;
+};
+
+static void
+x509_constraints_trie_free(struct x509_constraints_trie *node)
+{
+	struct x509_constraints_trie *next;
+
+	while (node != NULL) {
+		next = node->sibling;
+		x509_constraints_trie_free(node->child);
+		free(node);
+		node = next;
+	}
+}
+
+static int
+x509_constraints_trie_add(struct x509_constraints_trie **root,
+    const char *constraint)
+{
+	struct x509_constraints_trie *node, *child;
+	size_t len = strlen(constraint);
+	unsigned char c;
+
+	if (*root == NULL && (*root = calloc(1, sizeof(**root))) == NULL)
+		return 0;
+	node = *root;
+
+	while (len > 0) {
+		c = tolower((unsigned char)constraint[--len]);
+		for (child = node->child; child != NULL; child = child->sibling) {
+			if (child->c == c)
+				break;
+		}
+		if (child == NULL) {
+			if ((child = calloc(1, sizeof(*child))) == NULL)
+				return 0;
+			child->c = c;
+			child->sibling = node->child;
+			node->child = child;
+		}
+		node = child;
+	}
+	node->terminal = 1;
+
+	return 1;
+}
+
+static int
+x509_constraints_trie_match(const struct x509_constraints_trie *node,
+    const char *name)
+{
+	const struct x509_constraints_trie *child;
+	size_t len = strlen(name);
+	unsigned char c;
+
+	if (node == NULL)
+		return 0;
+	for (;;) {
+		if (node->terminal)
+			return 1;
+		if (len == 0)
+			return 0;
+		c = tolower((unsigned char)name[--len]);
+		for (child = node->child; child != NULL; child = child->sibling) {
+			if (child->c == c)
+				break;
+		}
+		if (child == NULL)
+			return 0;
+		node = child;
+	}
+}
+
+static int
+x509_constraints_ipgroup_add(struct x509_constraints_set *set,
+    const struct x509_constraints_name *constraint)
+{
+	struct x509_constraints_ipgroup *group, *groups;
+	uint8_t (*addrs)[16];
+	size_t i, len;
+
+	len = constraint->af == AF_INET ? 4 : 16;
+	for (i = 0; i < set->ipgroups_count; i++) {
+		group = &set->ipgroups[i];
+		if (group->af == constraint->af &&
+		    memcmp(group->mask, &constraint->address[len], len) == 0)
+			break;
+	}
+	if (i == set->ipgroups_count) {
+		if ((groups = reallocarray(set->ipgroups,
+		    set->ipgroups_count + 1, sizeof(*groups))) == NULL)
+			return 0;
+		set->ipgroups = groups;
+		group = &set->ipgroups[set->ipgroups_count++];
+		memset(group, 0, sizeof(*group));
+		group->af = constraint->af;
+		group->len = len;
+		memcpy(group->mask, &constraint->address[len], len);
+	}
+
+	if ((addrs = reallocarray(group->addrs, group->addrs_count + 1,
+	    sizeof(*addrs))) == NULL)
+		return 0;
+	group->addrs = addrs;
+	memset(group->addrs[group->addrs_count], 0, 16);
+	for (i = 0; i < len; i++)
+		group->addrs[group->addrs_count][i] =
+		    constraint->address[i] & group->mask[i];
+	group->addrs_count++;
+
+	return 1;
+}
+
+static int
+x509_constraints_addr_cmp(const void *a, const void *b)
+{
+	return memcmp(a, b, 16);
+}
+
+static int
+x509_constraints_ipgroups_match(const struct x509_constraints_set *set,
+    const struct x509_constraints_name *name)
+{
+	const struct x509_constraints_ipgroup *group;
+	uint8_t addr[16];
+	size_t i, j;
+
+	for (i = 0; i < set->ipgroups_count; i++) {
+		group = &set->ipgroups[i];
+		if (group->af != name->af)
+			continue;
+		memset(addr, 0, sizeof(addr));
+		for (j = 0; j < group->len; j++)
+			addr[j] = name->address[j] & group->mask[j];
+		if (bsearch(addr, group->addrs, group->addrs_count,
+		    sizeof(*group->addrs), x509_constraints_addr_cmp) != NULL)
+			return 1;
+	}
+
+	return 0;
+}
+
+static void
+x509_constraints_set_clear(struct x509_constraints_set *set)
+{
+	size_t i;
+
+	x509_constraints_trie_free(set->dns);
+	for (i = 0; i < set->ipgroups_count; i++)
+		free(set->ipgroups[i].addrs);
+	free(set->ipgroups);
+	x509_constraints_names_free(set->others);
+	memset(set, 0, sizeof(*set));
+}
+
+/*
+ * Move the extracted constraints in names into the compiled set. The
+ * names are consumed.
+ */
+static int
+x509_constraints_set_compile(struct x509_constraints_set *set,
+    struct x509_constraints_names *names)
+{
+	struct x509_constraints_name *constraint;
+	size_t i;
+
+	if ((set->others = x509_constraints_names_new(
+	    X509_VERIFY_MAX_CHAIN_CONSTRAINTS)) == NULL)
+		return 0;
+
+	for (i = 0; i < names->names_count; i++) {
+		constraint = names->names[i];
+		if (constraint->type < 0 || constraint->type > GEN_RID)
+			continue;
+		set->type_count[constraint->type]++;
+		set->count++;
+		switch (constraint->type) {
+		case GEN_DNS:
+			if (!x509_constraints_trie_add(&set->dns,
+			    constraint->name))
+				return 0;
+			continue;
+		case GEN_IPADD:
+			if (constraint->af != AF_INET &&
+			    constraint->af != AF_INET6)
+				break;
+			if (!x509_constraints_ipgroup_add(set, constraint))
+				return 0;
+			continue;
+		}
+		if (!x509_constraints_names_add(set->others, constraint))
+			return 0;
+		names->names[i] = NULL;
+	}
+
+	for (i = 0; i < set->ipgroups_count; i++)
+		qsort(set->ipgroups[i].addrs, set->ipgroups[i].addrs_count,
+		    sizeof(*set->ipgroups[i].addrs), x509_constraints_addr_cmp);
+
+	return 1;
+}
+
+static int
+x509_constraints_set_match(const struct x509_constraints_set *set,
+    struct x509_constraints_name *name)
+{
+	size_t i;
+
+	if (name->type < 0 || name->type > GEN_RID ||
+	    set->type_count[name->type] == 0)
+		return 0;
+	if (name->type == GEN_DNS)
+		return x509_constraints_trie_match(set->dns, name->name);
+	if (name->type == GEN_IPADD &&
+	    x509_constraints_ipgroups_match(set, name))
+		return 1;
+	for (i = 0; i < set->others->names_count; i++) {
+		if (x509_constraints_match(name, set->others->names[i]))
+			return 1;
+	}
+
+	return 0;
+}
+
+void
+x509_constraints_cache_free(struct x509_constraints_cache *cache)
+{
+	if (cache == NULL)
+		return;
+	x509_constraints_set_clear(&cache->permitted);
+	x509_constraints_set_clear(&cache->excluded);
+	free(cache);
+}
+
+static struct x509_constraints_cache *
+x509_constraints_cache_new(X509 *cert)
+{
+	struct x509_constraints_cache *cache;
+	struct x509_constraints_names *excluded = NULL;
+	struct x509_constraints_names *permitted = NULL;
+	int error = X509_V_OK;
+
+	if ((cache = calloc(1, sizeof(*cache))) == NULL)
+		return NULL;
+	if ((permitted = x509_constraints_names_new(
+	    X509_VERIFY_MAX_CHAIN_CONSTRAINTS)) == NULL)
+		goto err;
+	if ((excluded = x509_constraints_names_new(
+	    X509_VERIFY_MAX_CHAIN_CONSTRAINTS)) == NULL)
+		goto err;
+
+	if (!x509_constraints_extract_constraints(cert, permitted, excluded,
+	    &error)) {
+		/*
+		 * Failures that depend on the certificate alone are kept,
+		 * so that a hostile certificate is only parsed once. An
+		 * out of memory error is not unless the constraint limit
+		 * caused it.
+		 */
+		if (error == X509_V_ERR_OUT_OF_MEM &&
+		    permitted->names_count < X509_VERIFY_MAX_CHAIN_CONSTRAINTS &&
+		    excluded->names_count < X509_VERIFY_MAX_CHAIN_CONSTRAINTS)
+			goto err;
+		cache->error = error;
+		goto done;
+	}
+	if (!x509_constraints_set_compile(&cache->permitted, permitted))
+		goto err;
+	if (!x509_constraints_set_compile(&cache->excluded, excluded))
+		goto err;
+
+ done:
+	x509_constraints_names_free(excluded);
+	x509_constraints_names_free(permitted);
+	return cache;
+
+ err:
+	x509_constraints_names_free(excluded);
+	x509_constraints_names_free(permitted);
+	x509_constraints_cache_free(cache);
+	return NULL;
+}
+
+/*
+ * Return the compiled name constraints of cert, compiling them on first
+ * use. Returns NULL with error set if they are unusable, or if the
+ * certificate has no name constraints with error set to X509_V_OK.
+ */
+const struct x509_constraints_cache *
+x509_constraints_cache_get(X509 *cert, int *error)
+{
+	struct x509_constraints_cache *cache;
+
+	*error = X509_V_OK;
+	if (cert->nc == NULL)
+		return NULL;
+
+	CRYPTO_r_lock(CRYPTO_LOCK_X509);
+	cache = cert->nc_cache;
+	CRYPTO_r_unlock(CRYPTO_LOCK_X509);
+
+	if (cache == NULL) {
+		if ((cache = x509_constraints_cache_new(cert)) == NULL) {
+			*error = X509_V_ERR_OUT_OF_MEM;
+			return NULL;
+		}
+		CRYPTO_w_lock(CRYPTO_LOCK_X509);
+		if (cert->nc_cache == NULL) {
+			cert->nc_cache = cache;
+		} else {
+			x509_constraints_cache_free(cache);
+			cache = cert->nc_cache;
+		}
+		CRYPTO_w_unlock(CRYPTO_LOCK_X509);
+	}
+
+	if (cache->error != X509_V_OK) {
+		*error = cache->error;
+		return NULL;
+	}
+
+	return cache;
+}
+
+/*
+ * As x509_constraints_check(), against compiled name constraints.
+ */
+int
+x509_constraints_check_cache(struct x509_constraints_names *names,
+    const struct x509_constraints_cache *cache, int *error)
+{
+	size_t i;
+
+	for (i = 0; i < names->names_count; i++) {
+		if (x509_constraints_set_match(&cache->excluded,
+		    names->names[i])) {
+			*error = X509_V_ERR_EXCLUDED_VIOLATION;
+			return 0;
+		}
+		if (names->names[i]->type >= 0 &&
+		    names->names[i]->type <= GEN_RID &&
+		    cache->permitted.type_count[names->names[i]->type] > 0 &&
+		    !x509_constraints_set_match(&cache->permitted,
+		    names->names[i])) {
+			*error = X509_V_ERR_PERMITTED_VIOLATION;
+			return 0;
+		}
+	}
+	return 1;
+}
+
 /*
  * Walk a validated chain of X509 certs, starting at the leaf, and
  * validate the name constraints in the chain. Intended for use with
@@ -1118,9 +1489,8 @@ int
 x509_constraints_chain(STACK_OF(X509) *chain, int *error, int *depth)
 {
 	int chain_length, verify_err = X509_V_ERR_UNSPECIFIED, i = 0;
+	const struct x509_constraints_cache *nc;
 	struct x509_constraints_names *names = NULL;
-	struct x509_constraints_names *excluded = NULL;
-	struct x509_constraints_names *permitted = NULL;
 	size_t constraints_count = 0;
 	X509 *cert;
 
@@ -1142,33 +1512,19 @@ x509_constraints_chain(STACK_OF(X509) *chain, int *error, int *depth)
 		if ((cert = sk_X509_value(chain, i)) == NULL)
 			goto err;
 		if (cert->nc != NULL) {
-			if ((permitted = x509_constraints_names_new(
-			    X509_VERIFY_MAX_CHAIN_CONSTRAINTS)) == NULL) {
-				verify_err = X509_V_ERR_OUT_OF_MEM;
+			if ((nc = x509_constraints_cache_get(cert,
+			    &verify_err)) == NULL)
 				goto err;
-			}
-			if ((excluded = x509_constraints_names_new(
-			    X509_VERIFY_MAX_CHAIN_CONSTRAINTS)) == NULL) {
-				verify_err = X509_V_ERR_OUT_OF_MEM;
-				goto err;
-			}
-			if (!x509_constraints_extract_constraints(cert,
-			    permitted, excluded, &verify_err))
-				goto err;
-			constraints_count += permitted->names_count;
-			constraints_count += excluded->names_count;
+			constraints_count += nc->permitted.count;
+			constraints_count += nc->excluded.count;
 			if (constraints_count >
 			    X509_VERIFY_MAX_CHAIN_CONSTRAINTS) {
 				verify_err = X509_V_ERR_OUT_OF_MEM;
 				goto err;
 			}
-			if (!x509_constraints_check(names, permitted, excluded,
+			if (!x509_constraints_check_cache(names, nc,
 			    &verify_err))
 				goto err;
-			x509_constraints_names_free(excluded);
-			excluded = NULL;
-			x509_constraints_names_free(permitted);
-			permitted = NULL;
 		}
 		if (!x509_constraints_extract_names(names, cert, 0,
 		    &verify_err))
@@ -1181,8 +1537,6 @@ x509_constraints_chain(STACK_OF(X509) *chain, int *error, int *depth)
  err:
 	*error = verify_err;
 	*depth = i;
-	x509_constraints_names_free(excluded);
-	x509_constraints_names_free(permitted);
 	x509_constraints_names_free(names);
 	return 0;
 }
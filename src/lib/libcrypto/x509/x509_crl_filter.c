@@ -0,0 +1,699 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* x509_crl_filter */
+
+/*
+ * A CRL filter is a cascade of Bloom filters over the revoked serial
+ * numbers of a set of CRLs, as written by "openssl crl -filterout".  It
+ * answers whether a certificate is revoked from a few bits per revoked
+ * entry instead of the CRLs themselves.
+ *
+ * Keys are the SHA-256 digest of the canonical issuer name and the serial
+ * number.  Level 0 holds the revoked keys.  Each following level holds the
+ * keys that the level before wrongly reports: level 1 the unrevoked keys
+ * found in level 0, level 2 the revoked keys found in level 1 and so on,
+ * until no key is reported wrongly.  A lookup walks the levels until one
+ * does not contain the key, and the parity of that level is the answer.
+ *
+ * The cascade is only exact for the keys it was built from.  Without the
+ * unrevoked certificates of the covered issuers, it is a single level
+ * that proves a certificate unrevoked when the key is absent, and leaves
+ * everything else to the CRLs.
+ *
+ * All integers are big endian.  The file starts with a header
+ *
+ *	magic "CRLFILTR", version, flags, next update (64 bit),
+ *	number of issuers, number of levels
+ *
+ * followed by the issuers, the first 8 bytes of the SHA-256 digest of
+ * each canonical issuer name in ascending order, and then each level as
+ *
+ *	number of bits, number of bits set per key, bits
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <openssl/bio.h>
+#include <openssl/err.h>
+#include <openssl/sha.h>
+#include <openssl/x509.h>
+#include <openssl/x509v3.h>
+
+#include "x509_crl_filter.h"
+#include "x509_internal.h"
+
+#define CRL_FILTER_MAGIC	"CRLFILTR"
+#define CRL_FILTER_MAGIC_LEN	8
+#define CRL_FILTER_VERSION	1
+#define CRL_FILTER_HEADER_LEN	32
+#define CRL_FILTER_LEVEL_LEN	8
+#define CRL_FILTER_ISSUER_LEN	8
+#define CRL_FILTER_KEY_LEN	SHA256_DIGEST_LENGTH
+
+#define CRL_FILTER_COMPLETE	0x1
+
+/* Bits per key of a level with a false positive rate of 2^-e, times 1000. */
+#define CRL_FILTER_BITS_PER_E	1443
+
+struct crl_filter_set {
+	unsigned char *md;
+	size_t md_len;
+	size_t len;
+	size_t size;
+};
+
+static uint32_t
+crl_filter_get32(const unsigned char *p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+	    (uint32_t)p[2] << 8 | (uint32_t)p[3];
+}
+
+static uint64_t
+crl_filter_get64(const unsigned char *p)
+{
+	return (uint64_t)crl_filter_get32(p) << 32 | crl_filter_get32(p + 4);
+}
+
+static void
+crl_filter_put32(unsigned char *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static void
+crl_filter_put64(unsigned char *p, uint64_t v)
+{
+	crl_filter_put32(p, v >> 32);
+	crl_filter_put32(p + 4, v);
+}
+
+static uint64_t
+crl_filter_mix(uint64_t z)
+{
+	z ^= z >> 30;
+	z *= 0xbf58476d1ce4e5b9ULL;
+	z ^= z >> 27;
+	z *= 0x94d049bb133111ebULL;
+	z ^= z >> 31;
+
+	return z;
+}
+
+/*
+ * The bits of a key are h1 + i * h2 for i below k.  Every level derives
+ * its own h1 and h2, so that the false positives of the levels are
+ * independent.
+ */
+static void
+crl_filter_hashes(const unsigned char *key, uint32_t level, uint64_t *h1,
+    uint64_t *h2)
+{
+	uint64_t salt = level + 1;
+
+	*h1 = crl_filter_mix(crl_filter_get64(key) +
+	    salt * 0x9e3779b97f4a7c15ULL);
+	*h2 = crl_filter_mix(crl_filter_get64(key + 8) ^
+	    salt * 0xc2b2ae3d27d4eb4fULL) | 1;
+}
+
+static int
+crl_filter_test(const unsigned char *bits, uint32_t nbits, uint32_t k,
+    uint32_t level, const unsigned char *key)
+{
+	uint64_t h1, h2, bit;
+	uint32_t i;
+
+	crl_filter_hashes(key, level, &h1, &h2);
+	for (i = 0; i < k; i++) {
+		bit = (h1 + i * h2) % nbits;
+		if ((bits[bit >> 3] & (1 << (bit & 7))) == 0)
+			return 0;
+	}
+	return 1;
+}
+
+static void
+crl_filter_set_bits(unsigned char *bits, uint32_t nbits, uint32_t k,
+    uint32_t level, const unsigned char *key)
+{
+	uint64_t h1, h2, bit;
+	uint32_t i;
+
+	crl_filter_hashes(key, level, &h1, &h2);
+	for (i = 0; i < k; i++) {
+		bit = (h1 + i * h2) % nbits;
+		bits[bit >> 3] |= 1 << (bit & 7);
+	}
+}
+
+static int
+crl_filter_issuer_md(X509_NAME *name, unsigned char *out)
+{
+	unsigned char md[SHA256_DIGEST_LENGTH];
+
+	/* Make sure that the canonical encoding is up to date. */
+	if (i2d_X509_NAME(name, NULL) < 0)
+		return 0;
+	if (SHA256(name->canon_enc, name->canon_enclen, md) == NULL)
+		return 0;
+	memcpy(out, md, CRL_FILTER_ISSUER_LEN);
+
+	return 1;
+}
+
+static int
+crl_filter_key(X509_NAME *issuer, const ASN1_INTEGER *serial,
+    unsigned char *key)
+{
+	SHA256_CTX sha;
+	unsigned char len[4], neg;
+
+	if (serial == NULL)
+		return 0;
+	if (i2d_X509_NAME(issuer, NULL) < 0)
+		return 0;
+
+	crl_filter_put32(len, issuer->canon_enclen);
+	neg = serial->type == V_ASN1_NEG_INTEGER;
+
+	if (!SHA256_Init(&sha))
+		return 0;
+	if (!SHA256_Update(&sha, len, sizeof(len)))
+		return 0;
+	if (!SHA256_Update(&sha, issuer->canon_enc, issuer->canon_enclen))
+		return 0;
+	if (!SHA256_Update(&sha, &neg, sizeof(neg)))
+		return 0;
+	if (!SHA256_Update(&sha, serial->data, serial->length))
+		return 0;
+	if (!SHA256_Final(key, &sha))
+		return 0;
+
+	return 1;
+}
+
+static int
+crl_filter_find_issuer(const struct x509_crl_filter *filter,
+    const unsigned char *md)
+{
+	uint32_t lo = 0, hi = filter->nissuers, mid;
+	int cmp;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		cmp = memcmp(filter->issuers + (size_t)mid *
+		    CRL_FILTER_ISSUER_LEN, md, CRL_FILTER_ISSUER_LEN);
+		if (cmp == 0)
+			return 1;
+		if (cmp < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return 0;
+}
+
+int
+x509_crl_filter_lookup(const struct x509_crl_filter *filter, X509 *x,
+    time_t check_time)
+{
+	const struct x509_crl_filter_level *l;
+	unsigned char md[CRL_FILTER_ISSUER_LEN], key[CRL_FILTER_KEY_LEN];
+	X509_NAME *issuer;
+	uint32_t level;
+
+	if (filter->next_update != 0 && check_time > filter->next_update)
+		return X509_CRL_FILTER_UNKNOWN;
+
+	issuer = X509_get_issuer_name(x);
+	if (!crl_filter_issuer_md(issuer, md))
+		return X509_CRL_FILTER_UNKNOWN;
+	if (!crl_filter_find_issuer(filter, md))
+		return X509_CRL_FILTER_UNKNOWN;
+	if (!crl_filter_key(issuer, X509_get_serialNumber(x), key))
+		return X509_CRL_FILTER_UNKNOWN;
+
+	for (level = 0; level < filter->nlevels; level++) {
+		l = &filter->levels[level];
+		if (!crl_filter_test(l->bits, l->nbits, l->k, level, key))
+			break;
+	}
+
+	/* Absent from an even level, or present in an odd last level. */
+	if (level % 2 == 0)
+		return X509_CRL_FILTER_GOOD;
+	if (!filter->complete)
+		return X509_CRL_FILTER_UNKNOWN;
+
+	return X509_CRL_FILTER_REVOKED;
+}
+
+/* Check the layout of the file and point the levels into it. */
+static int
+crl_filter_parse(struct x509_crl_filter *filter)
+{
+	const unsigned char *p, *end;
+	struct x509_crl_filter_level *l;
+	uint64_t next_update;
+	uint32_t i;
+
+	if (filter->len < CRL_FILTER_HEADER_LEN)
+		return 0;
+	p = filter->data;
+	end = p + filter->len;
+
+	if (memcmp(p, CRL_FILTER_MAGIC, CRL_FILTER_MAGIC_LEN) != 0)
+		return 0;
+	if (crl_filter_get32(p + 8) != CRL_FILTER_VERSION)
+		return 0;
+	filter->complete = (crl_filter_get32(p + 12) & CRL_FILTER_COMPLETE) != 0;
+	next_update = crl_filter_get64(p + 16);
+	if (next_update > INT64_MAX)
+		return 0;
+	filter->next_update = (time_t)next_update;
+	filter->nissuers = crl_filter_get32(p + 24);
+	filter->nlevels = crl_filter_get32(p + 28);
+	if (filter->nlevels == 0 ||
+	    filter->nlevels > X509_CRL_FILTER_MAX_LEVELS)
+		return 0;
+	p += CRL_FILTER_HEADER_LEN;
+
+	if (filter->nissuers > (end - p) / CRL_FILTER_ISSUER_LEN)
+		return 0;
+	filter->issuers = p;
+	for (i = 1; i < filter->nissuers; i++) {
+		if (memcmp(p + (size_t)(i - 1) * CRL_FILTER_ISSUER_LEN,
+		    p + (size_t)i * CRL_FILTER_ISSUER_LEN,
+		    CRL_FILTER_ISSUER_LEN) >= 0)
+			return 0;
+	}
+	p += (size_t)filter->nissuers * CRL_FILTER_ISSUER_LEN;
+
+	for (i = 0; i < filter->nlevels; i++) {
+		l = &filter->levels[i];
+		if (end - p < CRL_FILTER_LEVEL_LEN)
+			return 0;
+		l->nbits = crl_filter_get32(p);
+		l->k = crl_filter_get32(p + 4);
+		p += CRL_FILTER_LEVEL_LEN;
+		if (l->nbits == 0 || l->k == 0 || l->k > 32)
+			return 0;
+		if ((l->nbits + 7ULL) / 8 > (uint64_t)(end - p))
+			return 0;
+		l->bits = p;
+		p += (l->nbits + 7ULL) / 8;
+	}
+
+	return p == end;
+}
+
+void
+x509_crl_filter_free(struct x509_crl_filter *filter)
+{
+	if (filter == NULL)
+		return;
+	if (filter->data != NULL)
+		munmap(filter->data, filter->len);
+	free(filter);
+}
+
+struct x509_crl_filter *
+x509_crl_filter_load(const char *file)
+{
+	struct x509_crl_filter *filter = NULL;
+	struct stat sb;
+	void *data;
+	int fd = -1;
+
+	if (file == NULL) {
+		X509error(X509_R_INVALID_CRL_FILTER);
+		return NULL;
+	}
+
+	if ((filter = calloc(1, sizeof(*filter))) == NULL) {
+		X509error(ERR_R_MALLOC_FAILURE);
+		goto err;
+	}
+	if ((fd = open(file, O_RDONLY)) == -1) {
+		SYSerror(errno);
+		goto err;
+	}
+	if (fstat(fd, &sb) == -1) {
+		SYSerror(errno);
+		goto err;
+	}
+	if (sb.st_size < CRL_FILTER_HEADER_LEN || sb.st_size > SIZE_MAX) {
+		X509error(X509_R_INVALID_CRL_FILTER);
+		goto err;
+	}
+	filter->len = sb.st_size;
+	data = mmap(NULL, filter->len, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		SYSerror(errno);
+		goto err;
+	}
+	filter->data = data;
+	close(fd);
+	fd = -1;
+
+	if (!crl_filter_parse(filter)) {
+		X509error(X509_R_INVALID_CRL_FILTER);
+		goto err;
+	}
+
+	return filter;
+
+ err:
+	if (fd != -1)
+		close(fd);
+	x509_crl_filter_free(filter);
+
+	return NULL;
+}
+
+static int
+crl_filter_set_add(struct crl_filter_set *set, const unsigned char *md)
+{
+	unsigned char *p;
+	size_t size;
+
+	if (set->len == set->size) {
+		size = set->size != 0 ? set->size * 2 : 64;
+		if ((p = recallocarray(set->md, set->size, size,
+		    set->md_len)) == NULL)
+			return 0;
+		set->md = p;
+		set->size = size;
+	}
+	memcpy(set->md + set->len * set->md_len, md, set->md_len);
+	set->len++;
+
+	return 1;
+}
+
+static int
+crl_filter_issuer_cmp(const void *a, const void *b)
+{
+	return memcmp(a, b, CRL_FILTER_ISSUER_LEN);
+}
+
+static int
+crl_filter_key_cmp(const void *a, const void *b)
+{
+	return memcmp(a, b, CRL_FILTER_KEY_LEN);
+}
+
+/* Sort the set and drop duplicates. */
+static void
+crl_filter_set_sort(struct crl_filter_set *set,
+    int (*cmp)(const void *, const void *))
+{
+	size_t i, n = 0;
+
+	if (set->len == 0)
+		return;
+	qsort(set->md, set->len, set->md_len, cmp);
+	for (i = 1; i < set->len; i++) {
+		if (cmp(set->md + n * set->md_len,
+		    set->md + i * set->md_len) == 0)
+			continue;
+		n++;
+		memmove(set->md + n * set->md_len,
+		    set->md + i * set->md_len, set->md_len);
+	}
+	set->len = n + 1;
+}
+
+static int
+crl_filter_set_find(const struct crl_filter_set *set, const unsigned char *md,
+    int (*cmp)(const void *, const void *))
+{
+	if (set->len == 0)
+		return 0;
+	return bsearch(md, set->md, set->len, set->md_len, cmp) != NULL;
+}
+
+static int
+crl_filter_add_crl(X509_CRL *crl, struct crl_filter_set *issuers,
+    struct crl_filter_set *revoked, time_t *next_update)
+{
+	STACK_OF(X509_REVOKED) *revs;
+	X509_REVOKED *rev;
+	X509_NAME *issuer;
+	unsigned char md[CRL_FILTER_KEY_LEN];
+	time_t t;
+	int i;
+
+	/* Entries of indirect CRLs may have other issuers. */
+	if (crl->lazy != NULL || (crl->idp_flags & IDP_INDIRECT)) {
+		X509error(X509_R_UNSUPPORTED_CRL);
+		return 0;
+	}
+
+	if (X509_CRL_get_nextUpdate(crl) != NULL) {
+		if (!x509_verify_asn1_time_to_time_t(
+		    X509_CRL_get_nextUpdate(crl), 0, &t)) {
+			X509error(X509_R_UNSUPPORTED_CRL);
+			return 0;
+		}
+		if (*next_update == 0 || t < *next_update)
+			*next_update = t;
+	}
+
+	issuer = X509_CRL_get_issuer(crl);
+	if (!crl_filter_issuer_md(issuer, md))
+		return 0;
+	if (!crl_filter_set_add(issuers, md))
+		goto err;
+
+	revs = X509_CRL_get_REVOKED(crl);
+	for (i = 0; i < sk_X509_REVOKED_num(revs); i++) {
+		rev = sk_X509_REVOKED_value(revs, i);
+		if (rev->reason == CRL_REASON_REMOVE_FROM_CRL)
+			continue;
+		if (!crl_filter_key(issuer, rev->serialNumber, md))
+			return 0;
+		if (!crl_filter_set_add(revoked, md))
+			goto err;
+	}
+
+	return 1;
+
+ err:
+	X509error(ERR_R_MALLOC_FAILURE);
+	return 0;
+}
+
+/*
+ * Build level number level from the keys of in, and collect the keys of
+ * other that it wrongly contains in fp.  The level has a false positive
+ * rate of 2^-e.
+ */
+static int
+crl_filter_build_level(struct x509_crl_filter_level *l, unsigned char **bitsp,
+    uint32_t level, uint32_t e, const struct crl_filter_set *in,
+    const struct crl_filter_set *other, struct crl_filter_set *fp)
+{
+	const unsigned char *key;
+	unsigned char *bits;
+	uint64_t nbits;
+	size_t i;
+
+	nbits = (uint64_t)in->len * e * CRL_FILTER_BITS_PER_E / 1000;
+	if (nbits < 64)
+		nbits = 64;
+	if (nbits > UINT32_MAX - 7) {
+		X509error(X509_R_UNSUPPORTED_CRL);
+		return 0;
+	}
+	if ((bits = calloc(1, (nbits + 7) / 8)) == NULL) {
+		X509error(ERR_R_MALLOC_FAILURE);
+		return 0;
+	}
+	l->bits = *bitsp = bits;
+	l->nbits = nbits;
+	l->k = e;
+
+	for (i = 0; i < in->len; i++) {
+		key = in->md + i * CRL_FILTER_KEY_LEN;
+		crl_filter_set_bits(bits, l->nbits, l->k, level, key);
+	}
+	for (i = 0; i < other->len; i++) {
+		key = other->md + i * CRL_FILTER_KEY_LEN;
+		if (!crl_filter_test(bits, l->nbits, l->k, level, key))
+			continue;
+		if (!crl_filter_set_add(fp, key)) {
+			X509error(ERR_R_MALLOC_FAILURE);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int
+crl_filter_write(BIO *bp, const struct x509_crl_filter *filter)
+{
+	const struct x509_crl_filter_level *l;
+	unsigned char hdr[CRL_FILTER_HEADER_LEN];
+	size_t len;
+	uint32_t i;
+
+	memcpy(hdr, CRL_FILTER_MAGIC, CRL_FILTER_MAGIC_LEN);
+	crl_filter_put32(hdr + 8, CRL_FILTER_VERSION);
+	crl_filter_put32(hdr + 12, filter->complete ? CRL_FILTER_COMPLETE : 0);
+	crl_filter_put64(hdr + 16, filter->next_update);
+	crl_filter_put32(hdr + 24, filter->nissuers);
+	crl_filter_put32(hdr + 28, filter->nlevels);
+	if (BIO_write(bp, hdr, sizeof(hdr)) != sizeof(hdr))
+		return 0;
+
+	len = (size_t)filter->nissuers * CRL_FILTER_ISSUER_LEN;
+	if (len > INT_MAX)
+		return 0;
+	if (len > 0 && BIO_write(bp, filter->issuers, len) != (int)len)
+		return 0;
+
+	for (i = 0; i < filter->nlevels; i++) {
+		l = &filter->levels[i];
+		crl_filter_put32(hdr, l->nbits);
+		crl_filter_put32(hdr + 4, l->k);
+		if (BIO_write(bp, hdr, CRL_FILTER_LEVEL_LEN) !=
+		    CRL_FILTER_LEVEL_LEN)
+			return 0;
+		len = (l->nbits + 7ULL) / 8;
+		if (BIO_write(bp, l->bits, len) != (int)len)
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Write a CRL filter for the revoked entries of crls.  If certs is not
+ * NULL, it must hold every unrevoked certificate of the CRL issuers that
+ * the filter is to answer for, and the filter then reports revocations
+ * on its own.  The CRLs are expected to have been verified by the caller.
+ */
+int
+X509_CRL_filter_write(BIO *bp, STACK_OF(X509_CRL) *crls, STACK_OF(X509) *certs)
+{
+	struct crl_filter_set sets[X509_CRL_FILTER_MAX_LEVELS + 2];
+	unsigned char *bits[X509_CRL_FILTER_MAX_LEVELS];
+	struct crl_filter_set issuers;
+	struct x509_crl_filter filter;
+	unsigned char md[CRL_FILTER_KEY_LEN];
+	uint64_t nrevoked, ngood;
+	uint32_t level, e;
+	time_t next_update = 0;
+	X509 *x;
+	int i, ret = 0;
+
+	memset(sets, 0, sizeof(sets));
+	memset(bits, 0, sizeof(bits));
+	memset(&issuers, 0, sizeof(issuers));
+	memset(&filter, 0, sizeof(filter));
+	issuers.md_len = CRL_FILTER_ISSUER_LEN;
+	for (level = 0; level < X509_CRL_FILTER_MAX_LEVELS + 2; level++)
+		sets[level].md_len = CRL_FILTER_KEY_LEN;
+
+	/* sets[0] holds the unrevoked keys and sets[1] the revoked ones. */
+	for (i = 0; i < sk_X509_CRL_num(crls); i++) {
+		if (!crl_filter_add_crl(sk_X509_CRL_value(crls, i), &issuers,
+		    &sets[1], &next_update))
+			goto err;
+	}
+	crl_filter_set_sort(&issuers, crl_filter_issuer_cmp);
+	crl_filter_set_sort(&sets[1], crl_filter_key_cmp);
+
+	for (i = 0; i < sk_X509_num(certs); i++) {
+		x = sk_X509_value(certs, i);
+		if (!crl_filter_issuer_md(X509_get_issuer_name(x), md))
+			goto err;
+		if (!crl_filter_set_find(&issuers, md, crl_filter_issuer_cmp))
+			continue;
+		if (!crl_filter_key(X509_get_issuer_name(x),
+		    X509_get_serialNumber(x), md))
+			goto err;
+		if (crl_filter_set_find(&sets[1], md, crl_filter_key_cmp))
+			continue;
+		if (!crl_filter_set_add(&sets[0], md)) {
+			X509error(ERR_R_MALLOC_FAILURE);
+			goto err;
+		}
+	}
+	crl_filter_set_sort(&sets[0], crl_filter_key_cmp);
+
+	/*
+	 * Size the first level to wrongly report about sqrt(2) times fewer
+	 * unrevoked keys than it holds revoked ones, and the others for a
+	 * false positive rate of one half.  Without the unrevoked keys there
+	 * is only one level, which aims for 1 in 256.
+	 */
+	nrevoked = sets[1].len;
+	ngood = sets[0].len;
+	e = 8;
+	if (certs != NULL) {
+		for (e = 1; e < 16; e++) {
+			if ((nrevoked << e) * 1000 >= ngood * 1414)
+				break;
+		}
+	}
+
+	for (level = 0; level == 0 || sets[level + 1].len > 0; level++) {
+		if (level == X509_CRL_FILTER_MAX_LEVELS) {
+			X509error(X509_R_UNSUPPORTED_CRL);
+			goto err;
+		}
+		if (!crl_filter_build_level(&filter.levels[level], &bits[level],
+		    level, level == 0 ? e : 1, &sets[level + 1], &sets[level],
+		    &sets[level + 2]))
+			goto err;
+	}
+
+	filter.complete = certs != NULL;
+	filter.next_update = next_update;
+	filter.issuers = issuers.md;
+	filter.nissuers = issuers.len;
+	filter.nlevels = level;
+	if (!crl_filter_write(bp, &filter))
+		goto err;
+
+	ret = 1;
+
+ err:
+	for (level = 0; level < X509_CRL_FILTER_MAX_LEVELS; level++)
+		free(bits[level]);
+	for (level = 0; level < X509_CRL_FILTER_MAX_LEVELS + 2; level++)
+		free(sets[level].md);
+	free(issuers.md);
+
+	return ret;
+}
@@ -0,0 +1,61 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* x509_crl_filter */
+#ifndef HEADER_X509_CRL_FILTER_H
+#define HEADER_X509_CRL_FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <openssl/x509.h>
+
+__BEGIN_HIDDEN_DECLS
+
+#define X509_CRL_FILTER_MAX_LEVELS	32
+
+/* Results of x509_crl_filter_lookup(). */
+#define X509_CRL_FILTER_UNKNOWN		0	/* Check CRLs as usual. */
+#define X509_CRL_FILTER_GOOD		1	/* Not revoked. */
+#define X509_CRL_FILTER_REVOKED		2	/* Revoked. */
+
+struct x509_crl_filter_level {
+	const unsigned char *bits;
+	uint32_t nbits;
+	uint32_t k;			/* Bits set per key. */
+};
+
+struct x509_crl_filter {
+	unsigned char *data;		/* Mapped file. */
+	size_t len;
+	int complete;			/* Built with the unrevoked certs. */
+	time_t next_update;		/* Earliest nextUpdate, or 0. */
+	const unsigned char *issuers;	/* Sorted issuer name digests. */
+	uint32_t nissuers;
+	uint32_t nlevels;
+	struct x509_crl_filter_level levels[X509_CRL_FILTER_MAX_LEVELS];
+};
+
+struct x509_crl_filter *x509_crl_filter_load(const char *file);
+void x509_crl_filter_free(struct x509_crl_filter *filter);
+int x509_crl_filter_lookup(const struct x509_crl_filter *filter, X509 *x,
+    time_t check_time);
+
+__END_HIDDEN_DECLS
+
+#endif
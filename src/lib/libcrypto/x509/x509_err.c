@@ -66,30 +66,35 @@
 #include <openssl/x509.h>
 #include <openssl/x509v3.h>
 
+#include "cryptlib.h"
+
 /* BEGIN ERROR CODES */
 #ifndef OPENSSL_NO_ERR
 
 #define ERR_FUNC(func) ERR_PACK(ERR_LIB_X509,func,0)
 #define ERR_REASON(reason) ERR_PACK(ERR_LIB_X509,0,reason)
 
-static ERR_STRING_DATA X509_str_functs[] = {
+static const ERR_STRING_DATA X509_str_functs[] = {
 	{ERR_FUNC(0xfff), "CRYPTO_internal"},
 	{0, NULL}
 };
 
-static ERR_STRING_DATA X509V3_str_functs[] = {
+static const ERR_STRING_DATA X509V3_str_functs[] = {
 	{ERR_FUNC(0xfff), "CRYPTO_internal"},
 	{0, NULL}
 };
 
-static ERR_STRING_DATA X509_str_reasons[] = {
+static const ERR_STRING_DATA X509_str_reasons[] = {
 	{ERR_REASON(X509_R_BAD_X509_FILETYPE)    , "bad x509 filetype"},
 	{ERR_REASON(X509_R_BASE64_DECODE_ERROR)  , "base64 decode error"},
 	{ERR_REASON(X509_R_CANT_CHECK_DH_KEY)    , "cant check dh key"},
 	{ERR_REASON(X509_R_CERT_ALREADY_IN_HASH_TABLE), "cert already in hash table"},
+	{ERR_REASON(X509_R_CRL_NOT_FOUND)        , "crl not found"},
 	{ERR_REASON(X509_R_ERR_ASN1_LIB)         , "err asn1 lib"},
+	{ERR_REASON(X509_R_INVALID_CRL_FILTER)   , "invalid crl filter"},
 	{ERR_REASON(X509_R_INVALID_DIRECTORY)    , "invalid directory"},
 	{ERR_REASON(X509_R_INVALID_FIELD_NAME)   , "invalid field name"},
+	{ERR_REASON(X509_R_INVALID_INDEX)        , "invalid index"},
 	{ERR_REASON(X509_R_INVALID_TRUST)        , "invalid trust"},
 	{ERR_REASON(X509_R_KEY_TYPE_MISMATCH)    , "key type mismatch"},
 	{ERR_REASON(X509_R_KEY_VALUES_MISMATCH)  , "key values mismatch"},
@@ -107,12 +112,13 @@ static ERR_STRING_DATA X509_str_reasons[] = {
 	{ERR_REASON(X509_R_UNKNOWN_PURPOSE_ID)   , "unknown purpose id"},
 	{ERR_REASON(X509_R_UNKNOWN_TRUST_ID)     , "unknown trust id"},
 	{ERR_REASON(X509_R_UNSUPPORTED_ALGORITHM), "unsupported algorithm"},
+	{ERR_REASON(X509_R_UNSUPPORTED_CRL)      , "unsupported crl"},
 	{ERR_REASON(X509_R_WRONG_LOOKUP_TYPE)    , "wrong lookup type"},
 	{ERR_REASON(X509_R_WRONG_TYPE)           , "wrong type"},
 	{0, NULL}
 };
 
-static ERR_STRING_DATA X509V3_str_reasons[] = {
+static const ERR_STRING_DATA X509V3_str_reasons[] = {
 	{ERR_REASON(X509V3_R_BAD_IP_ADDRESS)     , "bad ip address"},
 	{ERR_REASON(X509V3_R_BAD_OBJECT)         , "bad object"},
 	{ERR_REASON(X509V3_R_BN_DEC2BN_ERROR)    , "bn dec2bn error"},
@@ -191,8 +197,8 @@ ERR_load_X509_strings(void)
 {
 #ifndef OPENSSL_NO_ERR
 	if (ERR_func_error_string(X509_str_functs[0].error) == NULL) {
-		ERR_load_strings(0, X509_str_functs);
-		ERR_load_strings(0, X509_str_reasons);
+		ERR_load_const_strings(X509_str_functs);
+		ERR_load_const_strings(X509_str_reasons);
 	}
 #endif
 }
@@ -203,8 +209,8 @@ ERR_load_X509V3_strings(void)
 {
 #ifndef OPENSSL_NO_ERR
 	if (ERR_func_error_string(X509V3_str_functs[0].error) == NULL) {
-		ERR_load_strings(0, X509V3_str_functs);
-		ERR_load_strings(0, X509V3_str_reasons);
+		ERR_load_const_strings(X509V3_str_functs);
+		ERR_load_const_strings(X509V3_str_reasons);
 	}
 #endif
 }
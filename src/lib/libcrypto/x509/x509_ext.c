@@ -65,6 +65,8 @@
 #include <openssl/x509.h>
 #include <openssl/x509v3.h>
 
+#include "asn1_locl.h"
+
 int
 X509_CRL_get_ext_count(const X509_CRL *x)
 {
@@ -123,24 +125,32 @@ X509_CRL_add_ext(X509_CRL *x, X509_EXTENSION *ex, int loc)
 int
 X509_get_ext_count(const X509 *x)
 {
+	if (!x509_lazy_load_extensions(x))
+		return 0;
 	return (X509v3_get_ext_count(x->cert_info->extensions));
 }
 
 int
 X509_get_ext_by_NID(const X509 *x, int nid, int lastpos)
 {
+	if (!x509_lazy_load_extensions(x))
+		return -1;
 	return (X509v3_get_ext_by_NID(x->cert_info->extensions, nid, lastpos));
 }
 
 int
 X509_get_ext_by_OBJ(const X509 *x, const ASN1_OBJECT *obj, int lastpos)
 {
+	if (!x509_lazy_load_extensions(x))
+		return -1;
 	return (X509v3_get_ext_by_OBJ(x->cert_info->extensions, obj, lastpos));
 }
 
 int
 X509_get_ext_by_critical(const X509 *x, int crit, int lastpos)
 {
+	if (!x509_lazy_load_extensions(x))
+		return -1;
 	return (X509v3_get_ext_by_critical(x->cert_info->extensions, crit,
 	    lastpos));
 }
@@ -148,30 +158,40 @@ X509_get_ext_by_critical(const X509 *x, int crit, int lastpos)
 X509_EXTENSION *
 X509_get_ext(const X509 *x, int loc)
 {
+	if (!x509_lazy_load_extensions(x))
+		return NULL;
 	return (X509v3_get_ext(x->cert_info->extensions, loc));
 }
 
 X509_EXTENSION *
 X509_delete_ext(X509 *x, int loc)
 {
+	if (!x509_lazy_load_extensions(x))
+		return NULL;
 	return (X509v3_delete_ext(x->cert_info->extensions, loc));
 }
 
 int
 X509_add_ext(X509 *x, X509_EXTENSION *ex, int loc)
 {
+	if (!x509_lazy_load_extensions(x))
+		return 0;
 	return (X509v3_add_ext(&(x->cert_info->extensions), ex, loc) != NULL);
 }
 
 void *
 X509_get_ext_d2i(const X509 *x, int nid, int *crit, int *idx)
 {
+	if (!x509_lazy_load_extensions(x))
+		return X509V3_get_d2i(NULL, nid, crit, idx);
 	return X509V3_get_d2i(x->cert_info->extensions, nid, crit, idx);
 }
 
 int
 X509_add1_ext_i2d(X509 *x, int nid, void *value, int crit, unsigned long flags)
 {
+	if (!x509_lazy_load_extensions(x))
+		return 0;
 	return X509V3_add1_i2d(&x->cert_info->extensions, nid, value, crit,
 	    flags);
 }
@@ -21,6 +21,7 @@
 #include <netinet/in.h>
 
 #include <openssl/x509_verify.h>
+#include <openssl/x509v3.h>
 
 /* Hard limits on structure size and number of signature checks. */
 #define X509_VERIFY_MAX_CHAINS		8	/* Max validated chains */
@@ -56,6 +57,37 @@ struct x509_constraints_names {
 	size_t names_max;
 };
 
+/*
+ * Name constraints of a certificate, compiled once and kept with the
+ * certificate. DNS constraints are held in a trie of their reversed
+ * characters and address constraints in sorted arrays, one for each
+ * address family and mask. Other constraints are matched in turn.
+ */
+struct x509_constraints_trie;
+
+struct x509_constraints_ipgroup {
+	int af;
+	size_t len;			/* 4 or 16 */
+	uint8_t mask[16];
+	uint8_t (*addrs)[16];		/* Sorted, already masked */
+	size_t addrs_count;
+};
+
+struct x509_constraints_set {
+	struct x509_constraints_trie *dns;
+	struct x509_constraints_ipgroup *ipgroups;
+	size_t ipgroups_count;
+	struct x509_constraints_names *others;
+	size_t type_count[GEN_RID + 1];	/* Constraints of each type */
+	size_t count;
+};
+
+struct x509_constraints_cache {
+	struct x509_constraints_set permitted;
+	struct x509_constraints_set excluded;
+	int error;			/* Extraction result, or X509_V_OK */
+};
+
 struct x509_verify_chain {
 	STACK_OF(X509) *certs;		/* Kept in chain order, includes leaf */
 	int *cert_errors;		/* Verify error for each cert in chain. */
@@ -93,13 +125,24 @@ int x509_vfy_check_trust(X509_STORE_CTX *ctx);
 int x509_vfy_check_chain_extensions(X509_STORE_CTX *ctx);
 void x509v3_cache_extensions(X509 *x);
 
+/*
+ * Private ex_flags, set by x509v3_cache_extensions() if notBefore or
+ * notAfter cannot be cached in not_before or not_after.
+ */
+#define EXFLAG_BAD_NOT_BEFORE	0x40000000UL
+#define EXFLAG_BAD_NOT_AFTER	0x80000000UL
+
 int x509_verify_asn1_time_to_tm(const ASN1_TIME *atime, struct tm *tm,
     int notafter);
+int x509_verify_asn1_time_to_time_t(const ASN1_TIME *atime, int notafter,
+    time_t *out);
 
 struct x509_verify_ctx *x509_verify_ctx_new_from_xsc(X509_STORE_CTX *xsc,
     STACK_OF(X509) *roots);
 
+struct x509_constraints_name *x509_constraints_name_new(void);
 void x509_constraints_name_clear(struct x509_constraints_name *name);
+void x509_constraints_name_free(struct x509_constraints_name *name);
 int x509_constraints_names_add(struct x509_constraints_names *names,
     struct x509_constraints_name *name);
 struct x509_constraints_names *x509_constraints_names_dup(
@@ -128,6 +171,12 @@ int x509_constraints_check(struct x509_constraints_names *names,
     struct x509_constraints_names *excluded, int *error);
 int x509_constraints_chain(STACK_OF(X509) *chain, int *error,
     int *depth);
+const struct x509_constraints_cache *x509_constraints_cache_get(X509 *cert,
+    int *error);
+void x509_constraints_cache_free(struct x509_constraints_cache *cache);
+void x509_host_cache_free(struct x509_host_cache *cache);
+int x509_constraints_check_cache(struct x509_constraints_names *names,
+    const struct x509_constraints_cache *cache, int *error);
 
 __END_HIDDEN_DECLS
 
@@ -29,13 +29,38 @@
  * validity of "child". It allows us to skip doing the public key math
  * when validating a certificate chain. It does not allow us to skip
  * any other steps of validation (times, names, key usage, etc.)
+ *
+ * The cache is split into shards, each with its own lock, tree and
+ * CLOCK queue, selected by the hashes. A hit only marks the entry as
+ * referenced, so lookups need only a read lock, and entries are given
+ * a second chance on eviction rather than being moved on every hit.
+ *
+ * In front of the shards each thread keeps a small direct mapped cache
+ * of recent results, which needs no locking at all. Since a result for
+ * a given parent and child never changes, these never need invalidating.
  */
 
 #include <pthread.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "x509_issuer_cache.h"
 
+/* Lookups counted per thread before being added to the global counters. */
+#define X509_ISSUER_FRONT_FLUSH 64
+
+struct x509_issuer_front_entry {
+	unsigned char parent_md[EVP_MAX_MD_SIZE];
+	unsigned char child_md[EVP_MAX_MD_SIZE];
+	int valid;			/* -1 if the entry is unused. */
+};
+
+struct x509_issuer_front {
+	struct x509_issuer_front_entry entries[X509_ISSUER_FRONT_SIZE];
+	uint64_t hits;
+	uint64_t misses;
+};
+
 static int
 x509_issuer_cmp(struct x509_issuer *x1, struct x509_issuer *x2)
 {
@@ -45,30 +70,161 @@ x509_issuer_cmp(struct x509_issuer *x1, struct x509_issuer *x2)
 	return memcmp(x1->child_md, x2->child_md, EVP_MAX_MD_SIZE);
 }
 
-static size_t x509_issuer_cache_count;
+RB_HEAD(x509_issuer_tree, x509_issuer);
+TAILQ_HEAD(x509_issuer_queue, x509_issuer);
+
+struct x509_issuer_shard {
+	pthread_rwlock_t lock;
+	struct x509_issuer_tree tree;
+	struct x509_issuer_queue queue;
+	size_t count;
+};
+
 static size_t x509_issuer_cache_max = X509_ISSUER_CACHE_MAX;
-static RB_HEAD(x509_issuer_tree, x509_issuer) x509_issuer_cache =
-    RB_INITIALIZER(&x509_issuer_cache);
-static TAILQ_HEAD(lruqueue, x509_issuer) x509_issuer_lru =
-    TAILQ_HEAD_INITIALIZER(x509_issuer_lru);
-static pthread_mutex_t x509_issuer_tree_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct x509_issuer_shard x509_issuer_shards[X509_ISSUER_CACHE_SHARDS];
+static pthread_once_t x509_issuer_cache_once = PTHREAD_ONCE_INIT;
+static pthread_key_t x509_issuer_front_key;
+static int x509_issuer_front_key_valid;
+static int x509_issuer_cache_ready;
+static uint64_t x509_issuer_cache_hits;
+static uint64_t x509_issuer_cache_misses;
 
 RB_PROTOTYPE(x509_issuer_tree, x509_issuer, entry, x509_issuer_cmp);
 RB_GENERATE(x509_issuer_tree, x509_issuer, entry, x509_issuer_cmp);
 
+static void
+x509_issuer_front_flush(struct x509_issuer_front *front)
+{
+	if (front->hits > 0)
+		__sync_fetch_and_add(&x509_issuer_cache_hits, front->hits);
+	if (front->misses > 0)
+		__sync_fetch_and_add(&x509_issuer_cache_misses, front->misses);
+	front->hits = 0;
+	front->misses = 0;
+}
+
+static void
+x509_issuer_front_free(void *arg)
+{
+	struct x509_issuer_front *front = arg;
+
+	x509_issuer_front_flush(front);
+	free(front);
+}
+
+static void
+x509_issuer_cache_init(void)
+{
+	size_t i;
+
+	for (i = 0; i < X509_ISSUER_CACHE_SHARDS; i++) {
+		if (pthread_rwlock_init(&x509_issuer_shards[i].lock,
+		    NULL) != 0)
+			return;
+		RB_INIT(&x509_issuer_shards[i].tree);
+		TAILQ_INIT(&x509_issuer_shards[i].queue);
+	}
+	if (pthread_key_create(&x509_issuer_front_key,
+	    x509_issuer_front_free) == 0)
+		x509_issuer_front_key_valid = 1;
+	x509_issuer_cache_ready = 1;
+}
+
+static int
+x509_issuer_cache_setup(void)
+{
+	if (pthread_once(&x509_issuer_cache_once, x509_issuer_cache_init) != 0)
+		return 0;
+	return x509_issuer_cache_ready;
+}
+
+/*
+ * The hashes are message digests, so any of their bytes will do to pick
+ * a shard or a front cache entry.
+ */
+static struct x509_issuer_shard *
+x509_issuer_shard(const unsigned char *parent_md,
+    const unsigned char *child_md)
+{
+	return &x509_issuer_shards[(parent_md[0] ^ child_md[0]) &
+	    (X509_ISSUER_CACHE_SHARDS - 1)];
+}
+
+static struct x509_issuer_front_entry *
+x509_issuer_front_entry(const unsigned char *parent_md,
+    const unsigned char *child_md)
+{
+	struct x509_issuer_front *front;
+	size_t i;
+
+	if (!x509_issuer_front_key_valid)
+		return NULL;
+	if ((front = pthread_getspecific(x509_issuer_front_key)) == NULL) {
+		if ((front = calloc(1, sizeof(*front))) == NULL)
+			return NULL;
+		for (i = 0; i < X509_ISSUER_FRONT_SIZE; i++)
+			front->entries[i].valid = -1;
+		if (pthread_setspecific(x509_issuer_front_key, front) != 0) {
+			free(front);
+			return NULL;
+		}
+	}
+
+	return &front->entries[(parent_md[1] ^ child_md[1]) &
+	    (X509_ISSUER_FRONT_SIZE - 1)];
+}
+
+static void
+x509_issuer_front_set(struct x509_issuer_front_entry *fe,
+    const unsigned char *parent_md, const unsigned char *child_md, int valid)
+{
+	memcpy(fe->parent_md, parent_md, EVP_MAX_MD_SIZE);
+	memcpy(fe->child_md, child_md, EVP_MAX_MD_SIZE);
+	fe->valid = valid;
+}
+
+static void
+x509_issuer_cache_count(int hit)
+{
+	struct x509_issuer_front *front = NULL;
+
+	if (x509_issuer_front_key_valid)
+		front = pthread_getspecific(x509_issuer_front_key);
+	if (front == NULL) {
+		__sync_fetch_and_add(hit ? &x509_issuer_cache_hits :
+		    &x509_issuer_cache_misses, 1);
+		return;
+	}
+
+	if (hit)
+		front->hits++;
+	else
+		front->misses++;
+	if (front->hits + front->misses >= X509_ISSUER_FRONT_FLUSH)
+		x509_issuer_front_flush(front);
+}
+
+static void
+x509_issuer_free(struct x509_issuer *x)
+{
+	if (x == NULL)
+		return;
+	free(x->parent_md);
+	free(x->child_md);
+	free(x);
+}
+
 /*
  * Set the maximum number of cached entries. On additions to the cache
- * the least recently used entries will be discarded so that the cache
- * stays under the maximum number of entries.  Setting a maximum of 0
- * disables the cache.
+ * entries that have not been used since the CLOCK last passed them will
+ * be discarded so that the cache stays under the maximum number of
+ * entries. The maximum is split evenly between the shards. Setting a
+ * maximum of 0 disables the cache.
  */
 int
 x509_issuer_cache_set_max(size_t max)
 {
-	if (pthread_mutex_lock(&x509_issuer_tree_mutex) != 0)
-		return 0;
 	x509_issuer_cache_max = max;
-	(void) pthread_mutex_unlock(&x509_issuer_tree_mutex);
 
 	return 1;
 }
@@ -85,6 +241,8 @@ int
 x509_issuer_cache_find(unsigned char *parent_md, unsigned char *child_md)
 {
 	struct x509_issuer candidate, *found;
+	struct x509_issuer_front_entry *fe;
+	struct x509_issuer_shard *shard;
 	int ret = -1;
 
 	memset(&candidate, 0, sizeof(candidate));
@@ -93,16 +251,32 @@ x509_issuer_cache_find(unsigned char *parent_md, unsigned char *child_md)
 
 	if (x509_issuer_cache_max == 0)
 		return -1;
+	if (!x509_issuer_cache_setup())
+		return -1;
+
+	if ((fe = x509_issuer_front_entry(parent_md, child_md)) != NULL &&
+	    fe->valid != -1 &&
+	    memcmp(fe->parent_md, parent_md, EVP_MAX_MD_SIZE) == 0 &&
+	    memcmp(fe->child_md, child_md, EVP_MAX_MD_SIZE) == 0) {
+		x509_issuer_cache_count(1);
+		return fe->valid;
+	}
 
-	if (pthread_mutex_lock(&x509_issuer_tree_mutex) != 0)
+	shard = x509_issuer_shard(parent_md, child_md);
+	if (pthread_rwlock_rdlock(&shard->lock) != 0)
 		return -1;
-	if ((found = RB_FIND(x509_issuer_tree, &x509_issuer_cache,
+	if ((found = RB_FIND(x509_issuer_tree, &shard->tree,
 	    &candidate)) != NULL) {
-		TAILQ_REMOVE(&x509_issuer_lru, found, queue);
-		TAILQ_INSERT_HEAD(&x509_issuer_lru, found, queue);
+		if (!found->referenced)
+			(void)__sync_bool_compare_and_swap(&found->referenced,
+			    0, 1);
 		ret = found->valid;
 	}
-	(void) pthread_mutex_unlock(&x509_issuer_tree_mutex);
+	(void) pthread_rwlock_unlock(&shard->lock);
+
+	if (ret != -1 && fe != NULL)
+		x509_issuer_front_set(fe, parent_md, child_md, ret);
+	x509_issuer_cache_count(ret != -1);
 
 	return ret;
 }
@@ -120,12 +294,19 @@ void
 x509_issuer_cache_add(unsigned char *parent_md, unsigned char *child_md,
     int valid)
 {
-	struct x509_issuer *new;
+	struct x509_issuer *new, *old;
+	struct x509_issuer_front_entry *fe;
+	struct x509_issuer_shard *shard;
+	size_t max;
 
-	if (x509_issuer_cache_max == 0)
+	if ((max = x509_issuer_cache_max) == 0)
 		return;
 	if (valid != 0 && valid != 1)
 		return;
+	if (!x509_issuer_cache_setup())
+		return;
+
+	max = (max + X509_ISSUER_CACHE_SHARDS - 1) / X509_ISSUER_CACHE_SHARDS;
 
 	if ((new = calloc(1, sizeof(struct x509_issuer))) == NULL)
 		return;
@@ -138,30 +319,67 @@ x509_issuer_cache_add(unsigned char *parent_md, unsigned char *child_md,
 
 	new->valid = valid;
 
-	if (pthread_mutex_lock(&x509_issuer_tree_mutex) != 0)
+	shard = x509_issuer_shard(parent_md, child_md);
+	if (pthread_rwlock_wrlock(&shard->lock) != 0)
 		goto err;
-	while (x509_issuer_cache_count >= x509_issuer_cache_max) {
-		struct x509_issuer *old;
-		if ((old = TAILQ_LAST(&x509_issuer_lru, lruqueue)) == NULL)
-			goto err;
-		TAILQ_REMOVE(&x509_issuer_lru, old, queue);
-		RB_REMOVE(x509_issuer_tree, &x509_issuer_cache, old);
-		free(old->parent_md);
-		free(old->child_md);
-		free(old);
-		x509_issuer_cache_count--;
+	while (shard->count >= max) {
+		if ((old = TAILQ_LAST(&shard->queue, x509_issuer_queue)) ==
+		    NULL)
+			break;
+		TAILQ_REMOVE(&shard->queue, old, queue);
+		if (old->referenced) {
+			/* Second chance, go round again. */
+			old->referenced = 0;
+			TAILQ_INSERT_HEAD(&shard->queue, old, queue);
+			continue;
+		}
+		RB_REMOVE(x509_issuer_tree, &shard->tree, old);
+		x509_issuer_free(old);
+		shard->count--;
 	}
-	if (RB_INSERT(x509_issuer_tree, &x509_issuer_cache, new) == NULL) {
-		TAILQ_INSERT_HEAD(&x509_issuer_lru, new, queue);
-		x509_issuer_cache_count++;
+	if ((old = RB_INSERT(x509_issuer_tree, &shard->tree, new)) == NULL) {
+		TAILQ_INSERT_HEAD(&shard->queue, new, queue);
+		shard->count++;
 		new = NULL;
-	}
+	} else
+		valid = old->valid;
+	(void) pthread_rwlock_unlock(&shard->lock);
+
+	if ((fe = x509_issuer_front_entry(parent_md, child_md)) != NULL)
+		x509_issuer_front_set(fe, parent_md, child_md, valid);
+
  err:
-	(void) pthread_mutex_unlock(&x509_issuer_tree_mutex);
-	if (new != NULL) {
-		free(new->parent_md);
-		free(new->child_md);
+	x509_issuer_free(new);
+}
+
+/*
+ * Report the number of lookups that found or did not find a result, and
+ * the number of entries currently cached. Lookups are counted per thread
+ * and only periodically added to the totals, so recent lookups may not
+ * be included yet.
+ */
+void
+x509_issuer_cache_stats(struct x509_issuer_cache_stats *stats)
+{
+	struct x509_issuer_front *front;
+	size_t i;
+
+	memset(stats, 0, sizeof(*stats));
+
+	if (!x509_issuer_cache_setup())
+		return;
+
+	if (x509_issuer_front_key_valid &&
+	    (front = pthread_getspecific(x509_issuer_front_key)) != NULL)
+		x509_issuer_front_flush(front);
+
+	stats->hits = __sync_fetch_and_add(&x509_issuer_cache_hits, 0);
+	stats->misses = __sync_fetch_and_add(&x509_issuer_cache_misses, 0);
+
+	for (i = 0; i < X509_ISSUER_CACHE_SHARDS; i++) {
+		if (pthread_rwlock_rdlock(&x509_issuer_shards[i].lock) != 0)
+			continue;
+		stats->entries += x509_issuer_shards[i].count;
+		(void) pthread_rwlock_unlock(&x509_issuer_shards[i].lock);
 	}
-	free(new);
-	return;
 }
@@ -28,19 +28,29 @@ __BEGIN_HIDDEN_DECLS
 
 struct x509_issuer {
 	RB_ENTRY(x509_issuer) entry;
-	TAILQ_ENTRY(x509_issuer) queue;	/* LRU of entries */
+	TAILQ_ENTRY(x509_issuer) queue;	/* CLOCK queue of entries */
 	/* parent_md and child_md must point to EVP_MAX_MD_SIZE of memory */
 	unsigned char *parent_md;
 	unsigned char *child_md;
 	int valid;			/* Result of signature validation. */
+	int referenced;			/* Found since last passed by CLOCK. */
 };
 
 #define X509_ISSUER_CACHE_MAX 40000	/* Approx 7.5 MB, entries 200 bytes */
+#define X509_ISSUER_CACHE_SHARDS 16	/* Must be a power of two. */
+#define X509_ISSUER_FRONT_SIZE 16	/* Per thread entries, power of two. */
+
+struct x509_issuer_cache_stats {
+	uint64_t hits;
+	uint64_t misses;
+	size_t entries;
+};
 
 int x509_issuer_cache_set_max(size_t max);
 int x509_issuer_cache_find(unsigned char *parent_md, unsigned char *child_md);
 void x509_issuer_cache_add(unsigned char *parent_md, unsigned char *child_md,
     int valid);
+void x509_issuer_cache_stats(struct x509_issuer_cache_stats *stats);
 
 __END_HIDDEN_DECLS
 
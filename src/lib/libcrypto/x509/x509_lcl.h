@@ -59,5 +59,7 @@
 __BEGIN_HIDDEN_DECLS
 
 int x509_check_cert_time(X509_STORE_CTX *ctx, X509 *x, int quiet);
+X509_OBJECT *x509_store_get0_by_subject(X509_STORE *store, int type,
+    X509_NAME *name);
 
 __END_HIDDEN_DECLS
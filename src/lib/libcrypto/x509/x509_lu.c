@@ -56,16 +56,20 @@
  * [including the GNU Public Licence.]
  */
 
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include <openssl/err.h>
 #include <openssl/lhash.h>
 #include <openssl/x509.h>
 #include <openssl/x509v3.h>
+#include "asn1_locl.h"
+#include "x509_chain_cache.h"
+#include "x509_crl_filter.h"
 #include "x509_lcl.h"
 
-static void X509_OBJECT_dec_ref_count(X509_OBJECT *a);
-
 X509_LOOKUP *
 X509_LOOKUP_new(X509_LOOKUP_METHOD *method)
 {
@@ -192,6 +196,351 @@ x509_object_cmp(const X509_OBJECT * const *a, const X509_OBJECT * const *b)
 	return ret;
 }
 
+/*
+ * Optional hash index over the objects of a store.  Certificates are
+ * chained by subject name and by subject key identifier, CRLs by issuer
+ * name.  The index has its own lock, so lookups only need to share it
+ * with other readers; insertions still serialize on the store lock and
+ * then briefly take the index lock for writing.
+ */
+struct x509_store_entry {
+	X509_OBJECT *obj;
+	uint32_t name_hash;
+	uint32_t skid_hash;
+	int has_skid;
+	struct x509_store_entry *name_next;
+	struct x509_store_entry *skid_next;
+};
+
+struct x509_store_index {
+	pthread_rwlock_t lock;
+	struct x509_store_entry **names;
+	struct x509_store_entry **skids;
+	size_t size;
+	size_t count;
+};
+
+#define X509_STORE_INDEX_MIN_SIZE	64
+
+static uint32_t
+x509_store_hash(uint32_t h, const unsigned char *data, size_t len)
+{
+	size_t i;
+
+	/* FNV-1a */
+	for (i = 0; i < len; i++) {
+		h ^= data[i];
+		h *= 16777619;
+	}
+	return h;
+}
+
+static X509_NAME *
+x509_object_name(const X509_OBJECT *obj)
+{
+	switch (obj->type) {
+	case X509_LU_X509:
+		return obj->data.x509->cert_info->subject;
+	case X509_LU_CRL:
+		return obj->data.crl->crl->issuer;
+	}
+	return NULL;
+}
+
+/* Hash the canonical encoding of name, the one X509_NAME_cmp() uses. */
+static int
+x509_store_name_hash(int type, X509_NAME *name, uint32_t *hash)
+{
+	const unsigned char *canon_enc;
+	int canon_enclen;
+
+	if (name == NULL)
+		return 0;
+	if (!x509_name_get_canon(name, &canon_enc, &canon_enclen))
+		return 0;
+	*hash = x509_store_hash(2166136261U ^ type, canon_enc, canon_enclen);
+	return 1;
+}
+
+static uint32_t
+x509_store_skid_hash(const ASN1_OCTET_STRING *skid)
+{
+	return x509_store_hash(2166136261U, skid->data, skid->length);
+}
+
+static struct x509_store_index *
+x509_store_index_new(void)
+{
+	struct x509_store_index *idx;
+
+	if ((idx = calloc(1, sizeof(*idx))) == NULL)
+		return NULL;
+	idx->size = X509_STORE_INDEX_MIN_SIZE;
+	if ((idx->names = calloc(idx->size, sizeof(*idx->names))) == NULL)
+		goto err;
+	if ((idx->skids = calloc(idx->size, sizeof(*idx->skids))) == NULL)
+		goto err;
+	if (pthread_rwlock_init(&idx->lock, NULL) != 0)
+		goto err;
+
+	return idx;
+
+ err:
+	free(idx->names);
+	free(idx->skids);
+	free(idx);
+	return NULL;
+}
+
+static void
+x509_store_index_free(struct x509_store_index *idx)
+{
+	struct x509_store_entry *ent, *next;
+	size_t i;
+
+	if (idx == NULL)
+		return;
+
+	/* Every entry is on exactly one name chain. */
+	for (i = 0; i < idx->size; i++) {
+		for (ent = idx->names[i]; ent != NULL; ent = next) {
+			next = ent->name_next;
+			free(ent);
+		}
+	}
+	pthread_rwlock_destroy(&idx->lock);
+	free(idx->names);
+	free(idx->skids);
+	free(idx);
+}
+
+static struct x509_store_entry *
+x509_store_entry_new(X509_OBJECT *obj)
+{
+	struct x509_store_entry *ent;
+	ASN1_OCTET_STRING *skid;
+	X509 *x;
+
+	if ((ent = calloc(1, sizeof(*ent))) == NULL)
+		return NULL;
+	ent->obj = obj;
+	if (!x509_store_name_hash(obj->type, x509_object_name(obj),
+	    &ent->name_hash)) {
+		free(ent);
+		return NULL;
+	}
+	if (obj->type == X509_LU_X509) {
+		x = obj->data.x509;
+		/*
+		 * Only fetch the key identifier. Caching all the extensions
+		 * would decode those of lazily decoded certificates, most of
+		 * which are never used.
+		 */
+		if ((skid = X509_get_ext_d2i(x, NID_subject_key_identifier,
+		    NULL, NULL)) != NULL) {
+			ent->has_skid = 1;
+			ent->skid_hash = x509_store_skid_hash(skid);
+			ASN1_OCTET_STRING_free(skid);
+		}
+	}
+	return ent;
+}
+
+/*
+ * Double the tables.  An entry of old bucket i goes either to new bucket
+ * i or i + size, so walking each old chain in order and appending keeps
+ * the insertion order within every chain.
+ */
+static int
+x509_store_index_grow(struct x509_store_index *idx)
+{
+	struct x509_store_entry **names, **skids, **lo, **hi;
+	struct x509_store_entry *ent, *next;
+	size_t i, size;
+
+	size = idx->size;
+	if ((names = calloc(size * 2, sizeof(*names))) == NULL)
+		return 0;
+	if ((skids = calloc(size * 2, sizeof(*skids))) == NULL) {
+		free(names);
+		return 0;
+	}
+
+	for (i = 0; i < size; i++) {
+		lo = &names[i];
+		hi = &names[i + size];
+		for (ent = idx->names[i]; ent != NULL; ent = next) {
+			next = ent->name_next;
+			ent->name_next = NULL;
+			if (ent->name_hash & size) {
+				*hi = ent;
+				hi = &ent->name_next;
+			} else {
+				*lo = ent;
+				lo = &ent->name_next;
+			}
+		}
+		lo = &skids[i];
+		hi = &skids[i + size];
+		for (ent = idx->skids[i]; ent != NULL; ent = next) {
+			next = ent->skid_next;
+			ent->skid_next = NULL;
+			if (ent->skid_hash & size) {
+				*hi = ent;
+				hi = &ent->skid_next;
+			} else {
+				*lo = ent;
+				lo = &ent->skid_next;
+			}
+		}
+	}
+
+	free(idx->names);
+	free(idx->skids);
+	idx->names = names;
+	idx->skids = skids;
+	idx->size = size * 2;
+
+	return 1;
+}
+
+/* Add an entry to the index, with the index lock held for writing. */
+static int
+x509_store_index_link(struct x509_store_index *idx,
+    struct x509_store_entry *ent)
+{
+	struct x509_store_entry **entp;
+
+	if (idx->count >= idx->size && !x509_store_index_grow(idx))
+		return 0;
+
+	entp = &idx->names[ent->name_hash & (idx->size - 1)];
+	while (*entp != NULL)
+		entp = &(*entp)->name_next;
+	*entp = ent;
+
+	if (ent->has_skid) {
+		entp = &idx->skids[ent->skid_hash & (idx->size - 1)];
+		while (*entp != NULL)
+			entp = &(*entp)->skid_next;
+		*entp = ent;
+	}
+	idx->count++;
+
+	return 1;
+}
+
+/*
+ * Remove the entry of obj from the index, with the index lock held for
+ * writing, and return it.
+ */
+static struct x509_store_entry *
+x509_store_index_unlink(struct x509_store_index *idx, X509_OBJECT *obj)
+{
+	struct x509_store_entry **entp, *ent;
+	uint32_t hash;
+
+	if (!x509_store_name_hash(obj->type, x509_object_name(obj), &hash))
+		return NULL;
+
+	entp = &idx->names[hash & (idx->size - 1)];
+	while (*entp != NULL && (*entp)->obj != obj)
+		entp = &(*entp)->name_next;
+	if ((ent = *entp) == NULL)
+		return NULL;
+	*entp = ent->name_next;
+
+	if (ent->has_skid) {
+		entp = &idx->skids[ent->skid_hash & (idx->size - 1)];
+		while (*entp != ent)
+			entp = &(*entp)->skid_next;
+		*entp = ent->skid_next;
+	}
+	idx->count--;
+
+	ent->name_next = NULL;
+	ent->skid_next = NULL;
+
+	return ent;
+}
+
+static int
+x509_store_index_insert(struct x509_store_index *idx,
+    struct x509_store_entry *ent)
+{
+	int ret;
+
+	pthread_rwlock_wrlock(&idx->lock);
+	ret = x509_store_index_link(idx, ent);
+	pthread_rwlock_unlock(&idx->lock);
+
+	return ret;
+}
+
+/*
+ * Replace the entry of old by new in a single update, so that a lookup
+ * finds one or the other.  The index cannot need to grow, since it loses
+ * an entry before it gains one.
+ */
+static struct x509_store_entry *
+x509_store_index_replace(struct x509_store_index *idx, X509_OBJECT *old,
+    struct x509_store_entry *new)
+{
+	struct x509_store_entry *ent;
+
+	pthread_rwlock_wrlock(&idx->lock);
+	if ((ent = x509_store_index_unlink(idx, old)) != NULL)
+		(void)x509_store_index_link(idx, new);
+	pthread_rwlock_unlock(&idx->lock);
+
+	return ent;
+}
+
+/* Return the first entry at or after ent with the given type and name. */
+static struct x509_store_entry *
+x509_store_index_next(struct x509_store_entry *ent, int type, X509_NAME *name,
+    uint32_t hash)
+{
+	for (; ent != NULL; ent = ent->name_next) {
+		if (ent->name_hash != hash || ent->obj->type != type)
+			continue;
+		if (X509_NAME_cmp(x509_object_name(ent->obj), name) == 0)
+			return ent;
+	}
+	return NULL;
+}
+
+static struct x509_store_entry *
+x509_store_index_first(struct x509_store_index *idx, int type,
+    X509_NAME *name, uint32_t hash)
+{
+	return x509_store_index_next(idx->names[hash & (idx->size - 1)],
+	    type, name, hash);
+}
+
+/* Index counterpart of X509_OBJECT_retrieve_match(). */
+static X509_OBJECT *
+x509_store_index_match(struct x509_store_index *idx,
+    struct x509_store_entry *new)
+{
+	struct x509_store_entry *ent;
+	X509_OBJECT *obj = new->obj;
+	X509_NAME *name = x509_object_name(obj);
+
+	for (ent = x509_store_index_first(idx, obj->type, name,
+	    new->name_hash); ent != NULL; ent = x509_store_index_next(
+	    ent->name_next, obj->type, name, new->name_hash)) {
+		if (obj->type == X509_LU_X509) {
+			if (!X509_cmp(ent->obj->data.x509, obj->data.x509))
+				return ent->obj;
+		} else {
+			if (!X509_CRL_match(ent->obj->data.crl, obj->data.crl))
+				return ent->obj;
+		}
+	}
+	return NULL;
+}
+
 X509_STORE *
 X509_STORE_new(void)
 {
@@ -217,6 +566,9 @@ X509_STORE_new(void)
 	ret->lookup_certs = 0;
 	ret->lookup_crls = 0;
 	ret->cleanup = 0;
+	ret->index = NULL;
+	ret->verify_cache = NULL;
+	ret->crl_filter = NULL;
 
 	if (!CRYPTO_new_ex_data(CRYPTO_EX_INDEX_X509_STORE, ret, &ret->ex_data))
 		goto err;
@@ -260,6 +612,9 @@ X509_STORE_free(X509_STORE *vfy)
 		X509_LOOKUP_free(lu);
 	}
 	sk_X509_LOOKUP_free(sk);
+	x509_store_index_free(vfy->index);
+	x509_chain_cache_free(vfy->verify_cache);
+	x509_crl_filter_free(vfy->crl_filter);
 	sk_X509_OBJECT_pop_free(vfy->objs, X509_OBJECT_free);
 
 	CRYPTO_free_ex_data(CRYPTO_EX_INDEX_X509_STORE, vfy, &vfy->ex_data);
@@ -312,9 +667,7 @@ X509_STORE_get_by_subject(X509_STORE_CTX *vs, int type, X509_NAME *name,
 	X509_OBJECT stmp, *tmp;
 	int i, j;
 
-	CRYPTO_w_lock(CRYPTO_LOCK_X509_STORE);
-	tmp = X509_OBJECT_retrieve_by_subject(ctx->objs, type, name);
-	CRYPTO_w_unlock(CRYPTO_LOCK_X509_STORE);
+	tmp = x509_store_get0_by_subject(ctx, type, name);
 
 	if (tmp == NULL || type == X509_LU_CRL) {
 		for (i = vs->current_method;
@@ -345,11 +698,63 @@ X509_STORE_get_by_subject(X509_STORE_CTX *vs, int type, X509_NAME *name,
 	return 1;
 }
 
+/*
+ * Add obj to the store and to its index, if there is one.  On failure the
+ * caller keeps its reference to the certificate or CRL held by obj.
+ */
+static int
+x509_store_add(X509_STORE *store, X509_OBJECT *obj)
+{
+	struct x509_store_entry *ent = NULL;
+	X509_OBJECT *found;
+	int ret = 0;
+
+	CRYPTO_w_lock(CRYPTO_LOCK_X509_STORE);
+
+	if (store->index != NULL) {
+		if ((ent = x509_store_entry_new(obj)) == NULL) {
+			X509error(ERR_R_MALLOC_FAILURE);
+			goto err;
+		}
+		found = x509_store_index_match(store->index, ent);
+	} else
+		found = X509_OBJECT_retrieve_match(store->objs, obj);
+	if (found != NULL) {
+		X509error(X509_R_CERT_ALREADY_IN_HASH_TABLE);
+		goto err;
+	}
+
+	if (sk_X509_OBJECT_push(store->objs, obj) == 0) {
+		X509error(ERR_R_MALLOC_FAILURE);
+		goto err;
+	}
+	if (ent != NULL) {
+		if (!x509_store_index_insert(store->index, ent)) {
+			(void)sk_X509_OBJECT_pop(store->objs);
+			X509error(ERR_R_MALLOC_FAILURE);
+			goto err;
+		}
+		ent = NULL;
+	}
+	X509_OBJECT_up_ref_count(obj);
+
+	/* A new root or CRL may change any cached verification result. */
+	if (store->verify_cache != NULL)
+		x509_chain_cache_bump(store->verify_cache);
+
+	ret = 1;
+
+ err:
+	CRYPTO_w_unlock(CRYPTO_LOCK_X509_STORE);
+	free(ent);
+
+	return ret;
+}
+
 int
 X509_STORE_add_cert(X509_STORE *ctx, X509 *x)
 {
 	X509_OBJECT *obj;
-	int ret = 1;
 
 	if (x == NULL)
 		return 0;
@@ -361,38 +766,19 @@ X509_STORE_add_cert(X509_STORE *ctx, X509 *x)
 	obj->type = X509_LU_X509;
 	obj->data.x509 = x;
 
-	CRYPTO_w_lock(CRYPTO_LOCK_X509_STORE);
-
-	X509_OBJECT_up_ref_count(obj);
-
-	if (X509_OBJECT_retrieve_match(ctx->objs, obj)) {
-		X509error(X509_R_CERT_ALREADY_IN_HASH_TABLE);
-		ret = 0;
-	} else {
-		if (sk_X509_OBJECT_push(ctx->objs, obj) == 0) {
-			X509error(ERR_R_MALLOC_FAILURE);
-			ret = 0;
-		}
-	}
-
-	if (ret == 0)
-		X509_OBJECT_dec_ref_count(obj);
-
-	CRYPTO_w_unlock(CRYPTO_LOCK_X509_STORE);
-
-	if (ret == 0) {
+	if (!x509_store_add(ctx, obj)) {
 		obj->data.x509 = NULL; /* owned by the caller */
 		X509_OBJECT_free(obj);
+		return 0;
 	}
 
-	return ret;
+	return 1;
 }
 
 int
 X509_STORE_add_crl(X509_STORE *ctx, X509_CRL *x)
 {
 	X509_OBJECT *obj;
-	int ret = 1;
 
 	if (x == NULL)
 		return 0;
@@ -404,44 +790,234 @@ X509_STORE_add_crl(X509_STORE *ctx, X509_CRL *x)
 	obj->type = X509_LU_CRL;
 	obj->data.crl = x;
 
-	CRYPTO_w_lock(CRYPTO_LOCK_X509_STORE);
+	if (!x509_store_add(ctx, obj)) {
+		obj->data.crl = NULL; /* owned by the caller */
+		X509_OBJECT_free(obj);
+		return 0;
+	}
 
-	X509_OBJECT_up_ref_count(obj);
+	return 1;
+}
 
-	if (X509_OBJECT_retrieve_match(ctx->objs, obj)) {
-		X509error(X509_R_CERT_ALREADY_IN_HASH_TABLE);
-		ret = 0;
-	} else {
-		if (sk_X509_OBJECT_push(ctx->objs, obj) == 0) {
+/*
+ * Replace a CRL of the store by another one, typically a newer issue of
+ * the same CRL, in one step under the store lock.  A verification sees
+ * either the old or the new CRL, never neither, and the old one is only
+ * released once the lock has been dropped, so that freeing a large CRL
+ * does not hold up verifications either.
+ */
+int
+X509_STORE_replace_crl(X509_STORE *store, X509_CRL *old, X509_CRL *new)
+{
+	struct x509_store_entry *ent = NULL, *old_ent = NULL;
+	X509_OBJECT *obj, *found, *old_obj = NULL;
+	int i, ret = 0;
+
+	if (old == NULL)
+		return X509_STORE_add_crl(store, new);
+	if (new == NULL)
+		return 0;
+
+	if ((obj = malloc(sizeof(X509_OBJECT))) == NULL) {
+		X509error(ERR_R_MALLOC_FAILURE);
+		return 0;
+	}
+	obj->type = X509_LU_CRL;
+	obj->data.crl = new;
+
+	CRYPTO_w_lock(CRYPTO_LOCK_X509_STORE);
+
+	/*
+	 * Check for a duplicate first: searching the stack sorts it, which
+	 * would move the object found below.
+	 */
+	if (store->index != NULL) {
+		if ((ent = x509_store_entry_new(obj)) == NULL) {
 			X509error(ERR_R_MALLOC_FAILURE);
-			ret = 0;
+			goto err;
 		}
+		found = x509_store_index_match(store->index, ent);
+	} else
+		found = X509_OBJECT_retrieve_match(store->objs, obj);
+	if (found != NULL) {
+		X509error(X509_R_CERT_ALREADY_IN_HASH_TABLE);
+		goto err;
+	}
+
+	for (i = 0; i < sk_X509_OBJECT_num(store->objs); i++) {
+		old_obj = sk_X509_OBJECT_value(store->objs, i);
+		if (old_obj->type == X509_LU_CRL && old_obj->data.crl == old)
+			break;
+	}
+	if (i == sk_X509_OBJECT_num(store->objs)) {
+		old_obj = NULL;
+		X509error(X509_R_CRL_NOT_FOUND);
+		goto err;
 	}
 
-	if (ret == 0)
-		X509_OBJECT_dec_ref_count(obj);
+	if (ent != NULL) {
+		if ((old_ent = x509_store_index_replace(store->index, old_obj,
+		    ent)) == NULL) {
+			X509error(X509_R_CRL_NOT_FOUND);
+			goto err;
+		}
+		ent = NULL;
+	}
+
+	/* The stack is unsorted by this and sorted again on the next find. */
+	(void)sk_X509_OBJECT_set(store->objs, i, obj);
+	X509_OBJECT_up_ref_count(obj);
+	obj = NULL;
+
+	if (store->verify_cache != NULL)
+		x509_chain_cache_bump(store->verify_cache);
+
+	ret = 1;
 
+ err:
 	CRYPTO_w_unlock(CRYPTO_LOCK_X509_STORE);
 
-	if (ret == 0) {
+	if (obj != NULL) {
 		obj->data.crl = NULL; /* owned by the caller */
 		X509_OBJECT_free(obj);
+		old_obj = NULL;
 	}
+	X509_OBJECT_free(old_obj);
+	free(old_ent);
+	free(ent);
 
 	return ret;
 }
 
-static void
-X509_OBJECT_dec_ref_count(X509_OBJECT *a)
+/*
+ * Build a hash index over the objects of the store.  Later lookups by
+ * subject or issuer name, and the issuer search of the verifier, use the
+ * index instead of the sorted object stack.
+ */
+int
+X509_STORE_enable_index(X509_STORE *ctx)
 {
-	switch (a->type) {
-	case X509_LU_X509:
-		CRYPTO_add(&a->data.x509->references, -1, CRYPTO_LOCK_X509);
-		break;
-	case X509_LU_CRL:
-		CRYPTO_add(&a->data.crl->references, -1, CRYPTO_LOCK_X509_CRL);
-		break;
+	struct x509_store_index *idx = NULL;
+	struct x509_store_entry *ent;
+	int i, ret = 0;
+
+	CRYPTO_w_lock(CRYPTO_LOCK_X509_STORE);
+
+	if (ctx->index != NULL) {
+		ret = 1;
+		goto err;
+	}
+	if ((idx = x509_store_index_new()) == NULL)
+		goto merr;
+	for (i = 0; i < sk_X509_OBJECT_num(ctx->objs); i++) {
+		ent = x509_store_entry_new(sk_X509_OBJECT_value(ctx->objs, i));
+		if (ent == NULL)
+			goto merr;
+		if (!x509_store_index_insert(idx, ent)) {
+			free(ent);
+			goto merr;
+		}
+	}
+	ctx->index = idx;
+	idx = NULL;
+
+	ret = 1;
+	goto err;
+
+ merr:
+	X509error(ERR_R_MALLOC_FAILURE);
+ err:
+	CRYPTO_w_unlock(CRYPTO_LOCK_X509_STORE);
+	x509_store_index_free(idx);
+
+	return ret;
+}
+
+/*
+ * Remember up to max successful verifications made against the store,
+ * so that verifying the same leaf and intermediates again can reuse the
+ * chain.  A max of zero empties the cache and stops adding to it.
+ */
+int
+X509_STORE_enable_verify_cache(X509_STORE *ctx, size_t max)
+{
+	struct x509_chain_cache *cache;
+	int ret = 0;
+
+	CRYPTO_w_lock(CRYPTO_LOCK_X509_STORE);
+
+	if (ctx->verify_cache != NULL) {
+		x509_chain_cache_set_max(ctx->verify_cache, max);
+		ret = 1;
+		goto err;
+	}
+	if ((cache = x509_chain_cache_new(max)) == NULL) {
+		X509error(ERR_R_MALLOC_FAILURE);
+		goto err;
+	}
+	ctx->verify_cache = cache;
+
+	ret = 1;
+
+ err:
+	CRYPTO_w_unlock(CRYPTO_LOCK_X509_STORE);
+
+	return ret;
+}
+
+/*
+ * Map a CRL filter written by X509_CRL_filter_write() and consult it
+ * before the CRLs when checking revocation.  A filter loaded earlier is
+ * replaced; verifications only use the filter with the store lock held,
+ * so the old one can be unmapped once the lock has been dropped.
+ */
+int
+X509_STORE_load_crl_filter(X509_STORE *ctx, const char *file)
+{
+	struct x509_crl_filter *filter, *old;
+
+	if ((filter = x509_crl_filter_load(file)) == NULL)
+		return 0;
+
+	CRYPTO_w_lock(CRYPTO_LOCK_X509_STORE);
+	old = ctx->crl_filter;
+	ctx->crl_filter = filter;
+	if (ctx->verify_cache != NULL)
+		x509_chain_cache_bump(ctx->verify_cache);
+	CRYPTO_w_unlock(CRYPTO_LOCK_X509_STORE);
+
+	x509_crl_filter_free(old);
+
+	return 1;
+}
+
+/*
+ * Return the first object of the given type and name without taking a
+ * reference.  Objects stay in the store until it is freed.
+ */
+X509_OBJECT *
+x509_store_get0_by_subject(X509_STORE *store, int type, X509_NAME *name)
+{
+	struct x509_store_entry *ent;
+	X509_OBJECT *obj = NULL;
+	uint32_t hash;
+
+	if (store->index == NULL) {
+		CRYPTO_w_lock(CRYPTO_LOCK_X509_STORE);
+		obj = X509_OBJECT_retrieve_by_subject(store->objs, type, name);
+		CRYPTO_w_unlock(CRYPTO_LOCK_X509_STORE);
+		return obj;
 	}
+
+	if (!x509_store_name_hash(type, name, &hash))
+		return NULL;
+	pthread_rwlock_rdlock(&store->index->lock);
+	if ((ent = x509_store_index_first(store->index, type, name,
+	    hash)) != NULL)
+		obj = ent->obj;
+	pthread_rwlock_unlock(&store->index->lock);
+
+	return obj;
 }
 
 int
@@ -553,6 +1129,70 @@ X509_OBJECT_get0_X509_CRL(X509_OBJECT *xo)
 	return NULL;
 }
 
+static STACK_OF(X509) *
+x509_store_index_get1_certs(struct x509_store_index *idx, X509_NAME *nm)
+{
+	struct x509_store_entry *ent;
+	STACK_OF(X509) *sk;
+	uint32_t hash;
+
+	if (!x509_store_name_hash(X509_LU_X509, nm, &hash))
+		return NULL;
+	if ((sk = sk_X509_new_null()) == NULL)
+		return NULL;
+
+	pthread_rwlock_rdlock(&idx->lock);
+	for (ent = x509_store_index_first(idx, X509_LU_X509, nm, hash);
+	    ent != NULL; ent = x509_store_index_next(ent->name_next,
+	    X509_LU_X509, nm, hash)) {
+		if (!sk_X509_push(sk, ent->obj->data.x509)) {
+			pthread_rwlock_unlock(&idx->lock);
+			sk_X509_free(sk);
+			return NULL;
+		}
+		X509_up_ref(ent->obj->data.x509);
+	}
+	pthread_rwlock_unlock(&idx->lock);
+
+	if (sk_X509_num(sk) == 0) {
+		sk_X509_free(sk);
+		return NULL;
+	}
+	return sk;
+}
+
+static STACK_OF(X509_CRL) *
+x509_store_index_get1_crls(struct x509_store_index *idx, X509_NAME *nm)
+{
+	struct x509_store_entry *ent;
+	STACK_OF(X509_CRL) *sk;
+	uint32_t hash;
+
+	if (!x509_store_name_hash(X509_LU_CRL, nm, &hash))
+		return NULL;
+	if ((sk = sk_X509_CRL_new_null()) == NULL)
+		return NULL;
+
+	pthread_rwlock_rdlock(&idx->lock);
+	for (ent = x509_store_index_first(idx, X509_LU_CRL, nm, hash);
+	    ent != NULL; ent = x509_store_index_next(ent->name_next,
+	    X509_LU_CRL, nm, hash)) {
+		if (!sk_X509_CRL_push(sk, ent->obj->data.crl)) {
+			pthread_rwlock_unlock(&idx->lock);
+			sk_X509_CRL_free(sk);
+			return NULL;
+		}
+		X509_CRL_up_ref(ent->obj->data.crl);
+	}
+	pthread_rwlock_unlock(&idx->lock);
+
+	if (sk_X509_CRL_num(sk) == 0) {
+		sk_X509_CRL_free(sk);
+		return NULL;
+	}
+	return sk;
+}
+
 STACK_OF(X509) *
 X509_STORE_get1_certs(X509_STORE_CTX *ctx, X509_NAME *nm)
 {
@@ -561,6 +1201,19 @@ X509_STORE_get1_certs(X509_STORE_CTX *ctx, X509_NAME *nm)
 	X509 *x;
 	X509_OBJECT *obj;
 
+	if (ctx->ctx->index != NULL) {
+		X509_OBJECT xobj;
+
+		if ((sk = x509_store_index_get1_certs(ctx->ctx->index,
+		    nm)) != NULL)
+			return sk;
+		/* Nothing found in cache: do lookup and try again. */
+		if (!X509_STORE_get_by_subject(ctx, X509_LU_X509, nm, &xobj))
+			return NULL;
+		X509_OBJECT_free_contents(&xobj);
+		return x509_store_index_get1_certs(ctx->ctx->index, nm);
+	}
+
 	sk = sk_X509_new_null();
 	if (sk == NULL)
 		return NULL;
@@ -610,6 +1263,14 @@ X509_STORE_get1_crls(X509_STORE_CTX *ctx, X509_NAME *nm)
 	X509_CRL *x;
 	X509_OBJECT *obj, xobj;
 
+	if (ctx->ctx->index != NULL) {
+		/* Always do lookup to possibly add new CRLs to cache. */
+		if (!X509_STORE_get_by_subject(ctx, X509_LU_CRL, nm, &xobj))
+			return NULL;
+		X509_OBJECT_free_contents(&xobj);
+		return x509_store_index_get1_crls(ctx->ctx->index, nm);
+	}
+
 	sk = sk_X509_CRL_new_null();
 	if (sk == NULL)
 		return NULL;
@@ -676,6 +1337,81 @@ X509_OBJECT_retrieve_match(STACK_OF(X509_OBJECT) *h, X509_OBJECT *x)
 	return NULL;
 }
 
+/*
+ * Issuer search of X509_STORE_CTX_get1_issuer() using the store index.
+ * Certificates whose key identifier matches the authority key identifier
+ * of x are the likeliest issuers, so they are tried before the others
+ * with the same subject name.
+ */
+static int
+x509_store_index_get1_issuer(X509 **issuer, X509_STORE_CTX *ctx, X509 *x)
+{
+	struct x509_store_index *idx = ctx->ctx->index;
+	struct x509_store_entry *ent;
+	ASN1_OCTET_STRING *keyid = NULL;
+	X509_NAME *xn;
+	uint32_t hash, skid_hash = 0;
+	X509 *candidate;
+	int ret = 0;
+
+	xn = X509_get_issuer_name(x);
+	if (!x509_store_name_hash(X509_LU_X509, xn, &hash))
+		return 0;
+	X509_check_purpose(x, -1, 0);
+	if (x->akid != NULL)
+		keyid = x->akid->keyid;
+
+	pthread_rwlock_rdlock(&idx->lock);
+
+	if (keyid != NULL) {
+		skid_hash = x509_store_skid_hash(keyid);
+		for (ent = idx->skids[skid_hash & (idx->size - 1)];
+		    ent != NULL; ent = ent->skid_next) {
+			candidate = ent->obj->data.x509;
+			if (ent->skid_hash != skid_hash ||
+			    ent->name_hash != hash)
+				continue;
+			X509_check_purpose(candidate, -1, 0);
+			if (candidate->skid == NULL ||
+			    ASN1_OCTET_STRING_cmp(candidate->skid, keyid) != 0)
+				continue;
+			if (X509_NAME_cmp(xn, X509_get_subject_name(candidate)))
+				continue;
+			if (!ctx->check_issued(ctx, x, candidate))
+				continue;
+			*issuer = candidate;
+			ret = 1;
+			if (x509_check_cert_time(ctx, *issuer, 1))
+				goto done;
+		}
+	}
+
+	for (ent = x509_store_index_first(idx, X509_LU_X509, xn, hash);
+	    ent != NULL; ent = x509_store_index_next(ent->name_next,
+	    X509_LU_X509, xn, hash)) {
+		candidate = ent->obj->data.x509;
+		/* Skip the candidates tried above. */
+		if (keyid != NULL && candidate->skid != NULL &&
+		    ent->skid_hash == skid_hash &&
+		    ASN1_OCTET_STRING_cmp(candidate->skid, keyid) == 0)
+			continue;
+		if (!ctx->check_issued(ctx, x, candidate))
+			continue;
+		*issuer = candidate;
+		ret = 1;
+		/* As below, keep the last match if no time is OK. */
+		if (x509_check_cert_time(ctx, *issuer, 1))
+			break;
+	}
+
+ done:
+	if (*issuer != NULL)
+		X509_up_ref(*issuer);
+	pthread_rwlock_unlock(&idx->lock);
+
+	return ret;
+}
+
 /* Try to get issuer certificate from store. Due to limitations
  * of the API this can only retrieve a single certificate matching
  * a given subject name. However it will fill the cache with all
@@ -718,6 +1454,9 @@ X509_STORE_CTX_get1_issuer(X509 **issuer, X509_STORE_CTX *ctx, X509 *x)
 	}
 	X509_OBJECT_free_contents(&obj);
 
+	if (ctx->ctx->index != NULL)
+		return x509_store_index_get1_issuer(issuer, ctx, x);
+
 	/* Else find index of first cert accepted by 'check_issued' */
 	ret = 0;
 	CRYPTO_w_lock(CRYPTO_LOCK_X509_STORE);
@@ -64,6 +64,8 @@
 #include <openssl/err.h>
 #include <openssl/x509v3.h>
 
+#include "asn1_locl.h"
+
 static void *v2i_NAME_CONSTRAINTS(const X509V3_EXT_METHOD *method,
     X509V3_CTX *ctx, STACK_OF(CONF_VALUE) *nval);
 static int i2r_NAME_CONSTRAINTS(const X509V3_EXT_METHOD *method,
@@ -428,14 +430,17 @@ nc_match_single(GENERAL_NAME *gen, GENERAL_NAME *base)
 static int
 nc_dn(X509_NAME *nm, X509_NAME *base)
 {
+	const unsigned char *nm_enc, *base_enc;
+	int nm_len, base_len;
+
 	/* Ensure canonical encodings are up to date.  */
-	if (nm->modified && i2d_X509_NAME(nm, NULL) < 0)
+	if (!x509_name_get_canon(nm, &nm_enc, &nm_len))
 		return X509_V_ERR_OUT_OF_MEM;
-	if (base->modified && i2d_X509_NAME(base, NULL) < 0)
+	if (!x509_name_get_canon(base, &base_enc, &base_len))
 		return X509_V_ERR_OUT_OF_MEM;
-	if (base->canon_enclen > nm->canon_enclen)
+	if (base_len > nm_len)
 		return X509_V_ERR_PERMITTED_VIOLATION;
-	if (memcmp(base->canon_enc, nm->canon_enc, base->canon_enclen))
+	if (base_len > 0 && memcmp(base_enc, nm_enc, base_len))
 		return X509_V_ERR_PERMITTED_VIOLATION;
 	return X509_V_OK;
 }
@@ -56,6 +56,7 @@
  *
  */
 
+#include <sched.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -65,6 +66,8 @@
 #include <openssl/x509v3.h>
 #include <openssl/x509_vfy.h>
 
+#include "x509_internal.h"
+
 #define V1_ROOT (EXFLAG_V1|EXFLAG_SS)
 #define ku_reject(x, usage) \
 	(((x)->ex_flags & EXFLAG_KUSAGE) && !((x)->ex_kusage & (usage)))
@@ -73,8 +76,6 @@
 #define ns_reject(x, usage) \
 	(((x)->ex_flags & EXFLAG_NSCERT) && !((x)->ex_nscert & (usage)))
 
-void x509v3_cache_extensions(X509 *x);
-
 static int check_ssl_ca(const X509 *x);
 static int check_purpose_ssl_client(const X509_PURPOSE *xp, const X509 *x,
     int ca);
@@ -129,9 +130,7 @@ X509_check_purpose(X509 *x, int id, int ca)
 	const X509_PURPOSE *pt;
 
 	if (!(x->ex_flags & EXFLAG_SET)) {
-		CRYPTO_w_lock(CRYPTO_LOCK_X509);
 		x509v3_cache_extensions(x);
-		CRYPTO_w_unlock(CRYPTO_LOCK_X509);
 		if (x->ex_flags & EXFLAG_INVALID)
 			return X509_V_ERR_UNSPECIFIED;
 	}
@@ -433,8 +432,8 @@ setup_crldp(X509 *x)
 		setup_dp(x, sk_DIST_POINT_value(x->crldp, i));
 }
 
-void
-x509v3_cache_extensions(X509 *x)
+static void
+x509v3_cache_extensions_internal(X509 *x)
 {
 	BASIC_CONSTRAINTS *bs;
 	PROXY_CERT_INFO_EXTENSION *pci;
@@ -455,6 +454,14 @@ x509v3_cache_extensions(X509 *x)
 	if (!X509_get_version(x))
 		x->ex_flags |= EXFLAG_V1;
 
+	/* Validity, so that the verifiers need not parse it every time. */
+	if (!x509_verify_asn1_time_to_time_t(X509_get_notBefore(x), 0,
+	    &x->not_before))
+		x->ex_flags |= EXFLAG_BAD_NOT_BEFORE;
+	if (!x509_verify_asn1_time_to_time_t(X509_get_notAfter(x), 1,
+	    &x->not_after))
+		x->ex_flags |= EXFLAG_BAD_NOT_AFTER;
+
 	/* Handle basic constraints */
 	if ((bs = X509_get_ext_d2i(x, NID_basic_constraints, &i, NULL))) {
 		if (bs->ca)
@@ -606,6 +613,36 @@ x509v3_cache_extensions(X509 *x)
 	x->ex_flags |= EXFLAG_SET;
 }
 
+#define X509_EX_CACHING	1
+#define X509_EX_CACHED	2
+
+/*
+ * Cache the extension values of a certificate, once. The first thread to
+ * get here does the work, while any others wait for it rather than for a
+ * global lock, and once ex_cached is X509_EX_CACHED the cached values may
+ * be read without taking any lock.
+ */
+void
+x509v3_cache_extensions(X509 *x)
+{
+	int state = 0;
+
+	if (__atomic_load_n(&x->ex_cached, __ATOMIC_ACQUIRE) == X509_EX_CACHED)
+		return;
+
+	if (__atomic_compare_exchange_n(&x->ex_cached, &state,
+	    X509_EX_CACHING, 0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+		x509v3_cache_extensions_internal(x);
+		__atomic_store_n(&x->ex_cached, X509_EX_CACHED,
+		    __ATOMIC_RELEASE);
+		return;
+	}
+
+	while (__atomic_load_n(&x->ex_cached, __ATOMIC_ACQUIRE) !=
+	    X509_EX_CACHED)
+		sched_yield();
+}
+
 /* CA checks common to all purposes
  * return codes:
  * 0 not a CA
@@ -647,9 +684,7 @@ int
 X509_check_ca(X509 *x)
 {
 	if (!(x->ex_flags & EXFLAG_SET)) {
-		CRYPTO_w_lock(CRYPTO_LOCK_X509);
 		x509v3_cache_extensions(x);
-		CRYPTO_w_unlock(CRYPTO_LOCK_X509);
 		if (x->ex_flags & EXFLAG_INVALID)
 			return X509_V_ERR_UNSPECIFIED;
 	}
@@ -63,9 +63,13 @@
 #include <openssl/objects.h>
 #include <openssl/x509.h>
 
+#include "asn1_locl.h"
+
 const STACK_OF(X509_EXTENSION) *
 X509_get0_extensions(const X509 *x)
 {
+	if (!x509_lazy_load_extensions(x))
+		return NULL;
 	return x->cert_info->extensions;
 }
 
@@ -58,7 +58,9 @@
 /* X509 v3 extension utilities */
 
 #include <ctype.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <openssl/bn.h>
@@ -66,6 +68,8 @@
 #include <openssl/err.h>
 #include <openssl/x509v3.h>
 
+#include "x509_internal.h"
+
 char *bn_to_string(const BIGNUM *bn);
 static char *strip_spaces(char *name);
 static int sk_strcmp(const char * const *a, const char * const *b);
@@ -927,6 +931,366 @@ equal_wildcard(const unsigned char *pattern, size_t pattern_len,
 	    subject, subject_len, flags);
 }
 
+/*
+ * The DNS names of a certificate, compiled on first use by
+ * X509_check_host().  Names are lowercased and classified once, and exact
+ * names and the suffixes of "*.example.com" wildcards are hashed, so that
+ * a check is a couple of hash lookups.  Partial label wildcards, which are
+ * rare, are still matched one by one.  Each name keeps its position, so
+ * that the first match in certificate order is reported as before.
+ */
+
+#define HOST_CACHE_MAX_LEN	255
+
+struct x509_host_name {
+	unsigned char *name;		/* Lowercased. */
+	size_t len;
+	unsigned char *orig;		/* As in the certificate. */
+	size_t orig_len;
+	size_t star;			/* Offset of the wildcard, or len. */
+	int full;			/* Wildcard is the whole first label. */
+};
+
+struct x509_host_set {
+	struct x509_host_name *names;
+	size_t count;
+	size_t *partial;		/* Indexes of partial wildcards. */
+	size_t npartial;
+	size_t *table;			/* Index + 1 of hashed names. */
+	size_t table_size;
+	int present;			/* A name of this kind was seen. */
+};
+
+struct x509_host_cache {
+	int error;			/* Fall back to do_x509_check(). */
+	struct x509_host_set san;
+	struct x509_host_set cn;
+};
+
+static uint32_t
+host_hash(const unsigned char *p, size_t len)
+{
+	uint32_t h = 2166136261U;
+
+	while (len-- > 0) {
+		h ^= *p++;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+/* The hashed key of a name: itself, or the suffix after the wildcard. */
+static void
+host_name_key(const struct x509_host_name *hn, const unsigned char **key,
+    size_t *key_len)
+{
+	*key = hn->name;
+	*key_len = hn->len;
+	if (hn->full) {
+		*key += 1;
+		*key_len -= 1;
+	}
+}
+
+static void
+host_set_free(struct x509_host_set *set)
+{
+	size_t i;
+
+	for (i = 0; i < set->count; i++) {
+		free(set->names[i].name);
+		free(set->names[i].orig);
+	}
+	free(set->names);
+	free(set->partial);
+	free(set->table);
+}
+
+void
+x509_host_cache_free(struct x509_host_cache *cache)
+{
+	if (cache == NULL)
+		return;
+	host_set_free(&cache->san);
+	host_set_free(&cache->cn);
+	free(cache);
+}
+
+/* Add a name as do_check_string() would compare it. */
+static int
+host_set_add(struct x509_host_set *set, const unsigned char *data, size_t len)
+{
+	struct x509_host_name *hn, *names;
+	const unsigned char *star;
+	size_t i;
+
+	set->present = 1;
+
+	/* Names that equal_nocase() can never match. */
+	if (len == 0 || memchr(data, '\0', len) != NULL)
+		return 1;
+
+	if ((names = recallocarray(set->names, set->count, set->count + 1,
+	    sizeof(*names))) == NULL)
+		return 0;
+	set->names = names;
+	hn = &set->names[set->count];
+
+	if ((hn->orig = malloc(len)) == NULL)
+		return 0;
+	memcpy(hn->orig, data, len);
+	hn->orig_len = len;
+	if ((hn->name = malloc(len)) == NULL) {
+		free(hn->orig);
+		return 0;
+	}
+	for (i = 0; i < len; i++)
+		hn->name[i] = tolower(data[i]);
+	hn->len = len;
+	set->count++;
+
+	hn->star = len;
+	if ((star = valid_star(hn->name, len, 0)) != NULL) {
+		hn->star = star - hn->name;
+		hn->full = hn->star == 0 && hn->name[1] == '.';
+	}
+
+	return 1;
+}
+
+static int
+host_set_compile(struct x509_host_set *set)
+{
+	const unsigned char *key;
+	size_t i, j, key_len;
+
+	if ((set->partial = calloc(set->count + 1, sizeof(size_t))) == NULL)
+		return 0;
+	for (set->table_size = 8; set->table_size < 2 * set->count; )
+		set->table_size *= 2;
+	if ((set->table = calloc(set->table_size, sizeof(size_t))) == NULL)
+		return 0;
+
+	for (i = 0; i < set->count; i++) {
+		if (set->names[i].star != set->names[i].len &&
+		    !set->names[i].full) {
+			set->partial[set->npartial++] = i;
+			continue;
+		}
+		host_name_key(&set->names[i], &key, &key_len);
+		j = host_hash(key, key_len) & (set->table_size - 1);
+		while (set->table[j] != 0)
+			j = (j + 1) & (set->table_size - 1);
+		set->table[j] = i + 1;
+	}
+
+	return 1;
+}
+
+/* Return the first exact name, or full wildcard, equal to key. */
+static size_t
+host_set_find(const struct x509_host_set *set, const unsigned char *key,
+    size_t key_len, int full)
+{
+	const struct x509_host_name *hn;
+	const unsigned char *hkey;
+	size_t i, j, hkey_len, best = set->count;
+
+	j = host_hash(key, key_len) & (set->table_size - 1);
+	for (; set->table[j] != 0; j = (j + 1) & (set->table_size - 1)) {
+		i = set->table[j] - 1;
+		hn = &set->names[i];
+		if (hn->full != full || i >= best)
+			continue;
+		host_name_key(hn, &hkey, &hkey_len);
+		if (hkey_len == key_len && memcmp(hkey, key, key_len) == 0)
+			best = i;
+	}
+	return best;
+}
+
+/*
+ * Return the index of the first name matching the lowercased host, as
+ * equal_nocase() or equal_wildcard() would, or count if none does.
+ */
+static size_t
+host_set_match(const struct x509_host_set *set, const unsigned char *host,
+    size_t len, unsigned int flags)
+{
+	const struct x509_host_name *hn;
+	const unsigned char *dot, *p;
+	size_t i, n, best;
+
+	best = host_set_find(set, host, len, 0);
+	if (flags & X509_CHECK_FLAG_NO_WILDCARDS)
+		return best;
+
+	/* A "*.example.com" wildcard covers one non-empty first label. */
+	if ((dot = memchr(host, '.', len)) != NULL && dot != host) {
+		for (p = host; p != dot; p++) {
+			if (!(('0' <= *p && *p <= '9') ||
+			    ('a' <= *p && *p <= 'z') || *p == '-'))
+				break;
+		}
+		if (p == dot) {
+			i = host_set_find(set, dot, len - (dot - host), 1);
+			if (i < best)
+				best = i;
+		}
+	}
+
+	if (flags & X509_CHECK_FLAG_NO_PARTIAL_WILDCARDS)
+		return best;
+	for (n = 0; n < set->npartial && set->partial[n] < best; n++) {
+		hn = &set->names[set->partial[n]];
+		if (wildcard_match(hn->name, hn->star, hn->name + hn->star + 1,
+		    hn->len - hn->star - 1, host, len, flags))
+			best = set->partial[n];
+	}
+
+	return best;
+}
+
+static struct x509_host_cache *
+x509_host_cache_new(X509 *x)
+{
+	struct x509_host_cache *cache;
+	GENERAL_NAMES *gens = NULL;
+	GENERAL_NAME *gen;
+	X509_NAME *name;
+	ASN1_STRING *str;
+	unsigned char *astr;
+	int i, astrlen;
+
+	if ((cache = calloc(1, sizeof(*cache))) == NULL)
+		return NULL;
+
+	if ((gens = X509_get_ext_d2i(x, NID_subject_alt_name, NULL,
+	    NULL)) != NULL) {
+		for (i = 0; i < sk_GENERAL_NAME_num(gens); i++) {
+			gen = sk_GENERAL_NAME_value(gens, i);
+			if (gen->type != GEN_DNS)
+				continue;
+			str = gen->d.dNSName;
+			if (str->data == NULL || str->type != V_ASN1_IA5STRING) {
+				cache->san.present = 1;
+				continue;
+			}
+			if (!host_set_add(&cache->san, str->data, str->length))
+				goto err;
+		}
+	}
+
+	i = -1;
+	name = X509_get_subject_name(x);
+	while ((i = X509_NAME_get_index_by_NID(name, NID_commonName, i)) >= 0) {
+		str = X509_NAME_ENTRY_get_data(X509_NAME_get_entry(name, i));
+		if (str == NULL || str->data == NULL || str->length == 0)
+			continue;
+		if ((astrlen = ASN1_STRING_to_UTF8(&astr, str)) < 0) {
+			/* do_x509_check() reports this as an error. */
+			cache->error = 1;
+			break;
+		}
+		if (!host_set_add(&cache->cn, astr, astrlen)) {
+			free(astr);
+			goto err;
+		}
+		free(astr);
+	}
+
+	if (!host_set_compile(&cache->san) || !host_set_compile(&cache->cn))
+		goto err;
+
+	GENERAL_NAMES_free(gens);
+	return cache;
+
+ err:
+	GENERAL_NAMES_free(gens);
+	x509_host_cache_free(cache);
+	return NULL;
+}
+
+static struct x509_host_cache *
+x509_host_cache_get(X509 *x)
+{
+	struct x509_host_cache *cache;
+
+	CRYPTO_r_lock(CRYPTO_LOCK_X509);
+	cache = x->host_cache;
+	CRYPTO_r_unlock(CRYPTO_LOCK_X509);
+
+	if (cache == NULL) {
+		if ((cache = x509_host_cache_new(x)) == NULL)
+			return NULL;
+		CRYPTO_w_lock(CRYPTO_LOCK_X509);
+		if (x->host_cache == NULL) {
+			x->host_cache = cache;
+		} else {
+			x509_host_cache_free(cache);
+			cache = x->host_cache;
+		}
+		CRYPTO_w_unlock(CRYPTO_LOCK_X509);
+	}
+
+	return cache;
+}
+
+/*
+ * X509_check_host() against the compiled names.  Returns 0 if the check
+ * is not covered, and do_x509_check() has to be used instead.
+ */
+static int
+check_host_cached(X509 *x, const char *chk, size_t chklen, unsigned int flags,
+    char **peername, int *rv)
+{
+	const unsigned int supported = X509_CHECK_FLAG_ALWAYS_CHECK_SUBJECT |
+	    X509_CHECK_FLAG_NO_WILDCARDS |
+	    X509_CHECK_FLAG_NO_PARTIAL_WILDCARDS |
+	    X509_CHECK_FLAG_SINGLE_LABEL_SUBDOMAINS |
+	    X509_CHECK_FLAG_NEVER_CHECK_SUBJECT;
+	unsigned char host[HOST_CACHE_MAX_LEN];
+	const struct x509_host_set *set;
+	struct x509_host_cache *cache;
+	size_t i;
+
+	/* Sub-domain patterns and literal '*' take the long way. */
+	if ((flags & ~supported) != 0)
+		return 0;
+	if (chklen > HOST_CACHE_MAX_LEN || chk[0] == '.' ||
+	    memchr(chk, '*', chklen) != NULL)
+		return 0;
+	if ((cache = x509_host_cache_get(x)) == NULL || cache->error)
+		return 0;
+
+	for (i = 0; i < chklen; i++)
+		host[i] = tolower((unsigned char)chk[i]);
+
+	set = &cache->san;
+	if ((i = host_set_match(set, host, chklen, flags)) == set->count) {
+		/* As in do_x509_check(), DNS names hide the subject. */
+		set = NULL;
+		if ((!cache->san.present ||
+		    (flags & X509_CHECK_FLAG_ALWAYS_CHECK_SUBJECT)) &&
+		    !(flags & X509_CHECK_FLAG_NEVER_CHECK_SUBJECT)) {
+			set = &cache->cn;
+			i = host_set_match(set, host, chklen, flags);
+			if (i == set->count)
+				set = NULL;
+		}
+	}
+
+	*rv = 0;
+	if (set == NULL)
+		return 1;
+	*rv = 1;
+	if (peername != NULL && (*peername = strndup(
+	    (char *)set->names[i].orig, set->names[i].orig_len)) == NULL)
+		*rv = -1;
+
+	return 1;
+}
+
 /*
  * Compare an ASN1_STRING to a supplied string. If they match return 1. If
  * cmp_type > 0 only compare if string matches the type, otherwise convert it
@@ -1057,12 +1421,16 @@ int
 X509_check_host(X509 *x, const char *chk, size_t chklen, unsigned int flags,
     char **peername)
 {
+	int rv;
+
 	if (chk == NULL)
 		return -2;
 	if (chklen == 0)
 		chklen = strlen(chk);
 	else if (memchr(chk, '\0', chklen))
 		return -2;
+	if (check_host_cached(x, chk, chklen, flags, peername, &rv))
+		return rv;
 	return do_x509_check(x, chk, chklen, flags, GEN_DNS, peername);
 }
 
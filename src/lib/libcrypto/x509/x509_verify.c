@@ -19,6 +19,7 @@
 
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
@@ -40,6 +41,14 @@ static void x509_verify_chain_free(struct x509_verify_chain *chain);
 
 #define X509_VERIFY_CERT_HASH (EVP_sha512())
 
+struct x509_verify_candidate {
+	X509 *cert;
+	int keyid_match;
+	int have_not_before;
+	time_t not_before;
+	int index;
+};
+
 struct x509_verify_chain *
 x509_verify_chain_new(void)
 {
@@ -187,11 +196,7 @@ x509_verify_ctx_clear(struct x509_verify_ctx *ctx)
 
 static int
 x509_verify_cert_cache_extensions(X509 *cert) {
-	if (!(cert->ex_flags & EXFLAG_SET)) {
-		CRYPTO_w_lock(CRYPTO_LOCK_X509);
-		x509v3_cache_extensions(cert);
-		CRYPTO_w_unlock(CRYPTO_LOCK_X509);
-	}
+	x509v3_cache_extensions(cert);
 	if (cert->ex_flags & EXFLAG_INVALID)
 		return 0;
 	return (cert->ex_flags & EXFLAG_SET);
@@ -474,7 +479,11 @@ x509_verify_consider_candidate(struct x509_verify_ctx *ctx, X509 *cert,
 		}
 	}
 
-	if (ctx->sig_checks++ > X509_VERIFY_MAX_SIGCHECKS) {
+	/* Do the cheap checks before the signature. */
+	if (!x509_verify_cert_valid(ctx, candidate, current_chain))
+		return 0;
+
+	if (ctx->sig_checks++ > ctx->max_sigs) {
 		/* don't allow callback to override safety check */
 		(void) x509_verify_cert_error(ctx, candidate, depth,
 		    X509_V_ERR_CERT_CHAIN_TOO_LONG, 0);
@@ -488,9 +497,6 @@ x509_verify_consider_candidate(struct x509_verify_ctx *ctx, X509 *cert,
 			return 0;
 	}
 
-	if (!x509_verify_cert_valid(ctx, candidate, current_chain))
-		return 0;
-
 	/* candidate is good, add it to a copy of the current chain */
 	if ((new_chain = x509_verify_chain_dup(current_chain)) == NULL) {
 		x509_verify_cert_error(ctx, candidate, depth,
@@ -541,20 +547,99 @@ x509_verify_cert_error(struct x509_verify_ctx *ctx, X509 *cert, size_t depth,
 	return ok;
 }
 
+/*
+ * Stop looking once we have as many chains as we were asked for.  With
+ * an xsc only the first chain is used, so there is no point in finding
+ * more, it just exercises the potentially buggy callback processing in
+ * the calling software.
+ */
+static int
+x509_verify_ctx_done(struct x509_verify_ctx *ctx)
+{
+	if (ctx->xsc != NULL && ctx->chains_count > 0)
+		return 1;
+	return ctx->chains_count >= ctx->max_chains;
+}
+
+/*
+ * Order candidates so that the most likely parent is tried first: one
+ * whose subject key identifier matches the authority key identifier of
+ * the child, then the most recently issued one.  Ties keep the order
+ * in which the candidates were supplied.
+ */
+static int
+x509_verify_candidate_cmp(const void *a, const void *b)
+{
+	const struct x509_verify_candidate *ca = a, *cb = b;
+
+	if (ca->keyid_match != cb->keyid_match)
+		return cb->keyid_match - ca->keyid_match;
+	if (ca->have_not_before != cb->have_not_before)
+		return cb->have_not_before - ca->have_not_before;
+	if (ca->have_not_before && ca->not_before != cb->not_before)
+		return ca->not_before < cb->not_before ? 1 : -1;
+	return ca->index - cb->index;
+}
+
+/*
+ * Collect the certificates from certs that could have issued cert, in
+ * the order they should be tried.  Returns the number of candidates, or
+ * -1 if memory allocation failed.
+ */
+static int
+x509_verify_candidates(struct x509_verify_ctx *ctx, X509 *cert,
+    STACK_OF(X509) *certs, struct x509_verify_candidate **out_candidates)
+{
+	struct x509_verify_candidate *candidates = NULL, *c;
+	ASN1_OCTET_STRING *keyid = NULL;
+	X509 *candidate;
+	int i, n = 0;
+
+	*out_candidates = NULL;
+
+	if (sk_X509_num(certs) <= 0)
+		return 0;
+	if ((candidates = calloc(sk_X509_num(certs),
+	    sizeof(*candidates))) == NULL)
+		return -1;
+
+	if (cert->akid != NULL)
+		keyid = cert->akid->keyid;
+
+	for (i = 0; i < sk_X509_num(certs); i++) {
+		candidate = sk_X509_value(certs, i);
+		if (!x509_verify_potential_parent(ctx, candidate, cert))
+			continue;
+		c = &candidates[n++];
+		c->cert = candidate;
+		c->index = i;
+		c->keyid_match = keyid != NULL && candidate->skid != NULL &&
+		    ASN1_OCTET_STRING_cmp(keyid, candidate->skid) == 0;
+		x509v3_cache_extensions(candidate);
+		c->have_not_before =
+		    (candidate->ex_flags & EXFLAG_BAD_NOT_BEFORE) == 0;
+		c->not_before = candidate->not_before;
+	}
+
+	if (n > 1)
+		qsort(candidates, n, sizeof(*candidates),
+		    x509_verify_candidate_cmp);
+
+	*out_candidates = candidates;
+
+	return n;
+}
+
 static void
 x509_verify_build_chains(struct x509_verify_ctx *ctx, X509 *cert,
     struct x509_verify_chain *current_chain, int full_chain)
 {
 	unsigned char cert_md[EVP_MAX_MD_SIZE] = { 0 };
+	struct x509_verify_candidate *candidates;
 	X509 *candidate;
-	int i, depth, count, ret, is_root;
+	int i, n, depth, count, ret, is_root;
 
-	/*
-	 * If we are finding chains with an xsc, just stop after we have
-	 * one chain, there's no point in finding more, it just exercises
-	 * the potentially buggy callback processing in the calling software.
-	 */
-	if (ctx->xsc != NULL && ctx->chains_count > 0)
+	if (x509_verify_ctx_done(ctx))
 		return;
 
 	depth = sk_X509_num(current_chain->certs);
@@ -589,18 +674,24 @@ x509_verify_build_chains(struct x509_verify_ctx *ctx, X509 *cert,
 	}
 
 	/* Check to see if we have a trusted root issuer. */
-	for (i = 0; i < sk_X509_num(ctx->roots); i++) {
-		candidate = sk_X509_value(ctx->roots, i);
-		if (x509_verify_potential_parent(ctx, candidate, cert)) {
-			is_root = !full_chain ||
-			    x509_verify_cert_self_signed(candidate);
-			x509_verify_consider_candidate(ctx, cert,
-			    cert_md, is_root, candidate, current_chain,
-			    full_chain);
-		}
+	if ((n = x509_verify_candidates(ctx, cert, ctx->roots,
+	    &candidates)) == -1) {
+		x509_verify_cert_error(ctx, cert, depth,
+		    X509_V_ERR_OUT_OF_MEM, 0);
+		return;
+	}
+	for (i = 0; i < n && !x509_verify_ctx_done(ctx); i++) {
+		candidate = candidates[i].cert;
+		is_root = !full_chain ||
+		    x509_verify_cert_self_signed(candidate);
+		x509_verify_consider_candidate(ctx, cert,
+		    cert_md, is_root, candidate, current_chain,
+		    full_chain);
 	}
+	free(candidates);
+
 	/* Check for legacy mode roots */
-	if (ctx->xsc != NULL) {
+	if (ctx->xsc != NULL && !x509_verify_ctx_done(ctx)) {
 		if ((ret = ctx->xsc->get_issuer(&candidate, ctx->xsc, cert)) < 0) {
 			x509_verify_cert_error(ctx, cert, depth,
 			    X509_V_ERR_STORE_LOOKUP, 0);
@@ -619,15 +710,19 @@ x509_verify_build_chains(struct x509_verify_ctx *ctx, X509 *cert,
 	}
 
 	/* Check intermediates after checking roots */
-	if (ctx->intermediates != NULL) {
-		for (i = 0; i < sk_X509_num(ctx->intermediates); i++) {
-			candidate = sk_X509_value(ctx->intermediates, i);
-			if (x509_verify_potential_parent(ctx, candidate, cert)) {
-				x509_verify_consider_candidate(ctx, cert,
-				    cert_md, 0, candidate, current_chain,
-				    full_chain);
-			}
+	if (ctx->intermediates != NULL && !x509_verify_ctx_done(ctx)) {
+		if ((n = x509_verify_candidates(ctx, cert, ctx->intermediates,
+		    &candidates)) == -1) {
+			x509_verify_cert_error(ctx, cert, depth,
+			    X509_V_ERR_OUT_OF_MEM, 0);
+			return;
+		}
+		for (i = 0; i < n && !x509_verify_ctx_done(ctx); i++) {
+			x509_verify_consider_candidate(ctx, cert,
+			    cert_md, 0, candidates[i].cert, current_chain,
+			    full_chain);
 		}
+		free(candidates);
 	}
 
 	if (ctx->chains_count > count) {
@@ -746,11 +841,27 @@ x509_verify_asn1_time_to_tm(const ASN1_TIME *atime, struct tm *tm, int notafter)
 	return 1;
 }
 
+/* The same as x509_verify_asn1_time_to_tm(), as seconds since the epoch. */
+int
+x509_verify_asn1_time_to_time_t(const ASN1_TIME *atime, int notafter,
+    time_t *out)
+{
+	struct tm tm;
+
+	if (atime == NULL)
+		return 0;
+	if (!x509_verify_asn1_time_to_tm(atime, &tm, notafter))
+		return 0;
+	*out = timegm(&tm);
+
+	return 1;
+}
+
+/* Check the validity of cert, as cached by x509v3_cache_extensions(). */
 static int
-x509_verify_cert_time(int is_notafter, const ASN1_TIME *cert_asn1,
-    time_t *cmp_time, int *error)
+x509_verify_cert_time(int is_notafter, X509 *cert, time_t *cmp_time,
+    int *error)
 {
-	struct tm cert_tm, when_tm;
 	time_t when;
 
 	if (cmp_time == NULL)
@@ -758,26 +869,23 @@ x509_verify_cert_time(int is_notafter, const ASN1_TIME *cert_asn1,
 	else
 		when = *cmp_time;
 
-	if (!x509_verify_asn1_time_to_tm(cert_asn1, &cert_tm,
-	    is_notafter)) {
-		*error = is_notafter ?
-		    X509_V_ERR_ERROR_IN_CERT_NOT_AFTER_FIELD :
-		    X509_V_ERR_ERROR_IN_CERT_NOT_BEFORE_FIELD;
-		return 0;
-	}
-
-	if (gmtime_r(&when, &when_tm) == NULL) {
-		*error = X509_V_ERR_UNSPECIFIED;
-		return 0;
-	}
+	x509v3_cache_extensions(cert);
 
 	if (is_notafter) {
-		if (ASN1_time_tm_cmp(&cert_tm, &when_tm) == -1) {
+		if (cert->ex_flags & EXFLAG_BAD_NOT_AFTER) {
+			*error = X509_V_ERR_ERROR_IN_CERT_NOT_AFTER_FIELD;
+			return 0;
+		}
+		if (cert->not_after < when) {
 			*error = X509_V_ERR_CERT_HAS_EXPIRED;
 			return 0;
 		}
 	} else  {
-		if (ASN1_time_tm_cmp(&cert_tm, &when_tm) == 1) {
+		if (cert->ex_flags & EXFLAG_BAD_NOT_BEFORE) {
+			*error = X509_V_ERR_ERROR_IN_CERT_NOT_BEFORE_FIELD;
+			return 0;
+		}
+		if (cert->not_before > when) {
 			*error = X509_V_ERR_CERT_NOT_YET_VALID;
 			return 0;
 		}
@@ -790,39 +898,23 @@ static int
 x509_verify_validate_constraints(X509 *cert,
     struct x509_verify_chain *current_chain, int *error)
 {
-	struct x509_constraints_names *excluded = NULL;
-	struct x509_constraints_names *permitted = NULL;
+	const struct x509_constraints_cache *nc;
 	int err = X509_V_ERR_UNSPECIFIED;
 
 	if (current_chain == NULL)
 		return 1;
 
 	if (cert->nc != NULL) {
-		if ((permitted = x509_constraints_names_new(
-		    X509_VERIFY_MAX_CHAIN_CONSTRAINTS)) == NULL) {
-			err = X509_V_ERR_OUT_OF_MEM;
-			goto err;
-		}
-		if ((excluded = x509_constraints_names_new(
-		    X509_VERIFY_MAX_CHAIN_CONSTRAINTS)) == NULL) {
-			err = X509_V_ERR_OUT_OF_MEM;
-			goto err;
-		}
-		if (!x509_constraints_extract_constraints(cert,
-		    permitted, excluded, &err))
+		if ((nc = x509_constraints_cache_get(cert, &err)) == NULL)
 			goto err;
-		if (!x509_constraints_check(current_chain->names,
-		    permitted, excluded, &err))
+		if (!x509_constraints_check_cache(current_chain->names, nc,
+		    &err))
 			goto err;
-		x509_constraints_names_free(excluded);
-		x509_constraints_names_free(permitted);
 	}
 
 	return 1;
  err:
 	*error = err;
-	x509_constraints_names_free(excluded);
-	x509_constraints_names_free(permitted);
 	return 0;
 }
 
@@ -886,15 +978,15 @@ x509_verify_cert_valid(struct x509_verify_ctx *ctx, X509 *cert,
 	}
 
 	if (x509_verify_set_check_time(ctx)) {
-		if (!x509_verify_cert_time(0, X509_get_notBefore(cert),
-		    ctx->check_time, &ctx->error)) {
+		if (!x509_verify_cert_time(0, cert, ctx->check_time,
+		    &ctx->error)) {
 			if (!x509_verify_cert_error(ctx, cert, depth,
 			    ctx->error, 0))
 				return 0;
 		}
 
-		if (!x509_verify_cert_time(1, X509_get_notAfter(cert),
-		    ctx->check_time, &ctx->error)) {
+		if (!x509_verify_cert_time(1, cert, ctx->check_time,
+		    &ctx->error)) {
 			if (!x509_verify_cert_error(ctx, cert, depth,
 			    ctx->error, 0))
 				return 0;
@@ -75,6 +75,8 @@
 #include <openssl/x509v3.h>
 #include "asn1_locl.h"
 #include "vpm_int.h"
+#include "x509_chain_cache.h"
+#include "x509_crl_filter.h"
 #include "x509_internal.h"
 #include "x509_lcl.h"
 #include "x509_internal.h"
@@ -127,6 +129,8 @@ static int check_trust(X509_STORE_CTX *ctx);
 static int check_revocation(X509_STORE_CTX *ctx);
 static int check_cert(X509_STORE_CTX *ctx, STACK_OF(X509) *chain, int depth);
 static int check_policy(X509_STORE_CTX *ctx);
+static int check_crl(X509_STORE_CTX *ctx, X509_CRL *crl);
+static int cert_crl(X509_STORE_CTX *ctx, X509_CRL *crl, X509 *x);
 
 static int get_crl_score(X509_STORE_CTX *ctx, X509 **pissuer,
     unsigned int *preasons, X509_CRL *crl, X509 *x);
@@ -141,6 +145,7 @@ static int crl_crldp_check(X509 *x, X509_CRL *crl, int crl_score,
 static int check_crl_path(X509_STORE_CTX *ctx, X509 *x);
 static int check_crl_chain(X509_STORE_CTX *ctx, STACK_OF(X509) *cert_path,
     STACK_OF(X509) *crl_path);
+static int x509_cmp_cert_time(X509 *x, int notafter, time_t *cmp_time);
 static int X509_cmp_time_internal(const ASN1_TIME *ctm, time_t *cmp_time,
     int clamp_notafter);
 
@@ -581,8 +586,128 @@ X509_verify_cert_legacy(X509_STORE_CTX *ctx)
 	return ok;
 }
 
+/*
+ * A result from the store's verify cache may only stand in for a full
+ * verification if nothing outside the cache key could change it, so any
+ * callback or parameter that is not covered makes us verify normally.
+ */
 int
-X509_verify_cert(X509_STORE_CTX *ctx)
+x509_verify_cert_cacheable(X509_STORE_CTX *ctx)
+{
+	if (ctx->ctx == NULL || ctx->ctx->verify_cache == NULL)
+		return 0;
+	if (ctx->parent != NULL || ctx->crls != NULL)
+		return 0;
+	if (ctx->verify_cb != null_callback ||
+	    ctx->verify != internal_verify ||
+	    ctx->get_issuer != X509_STORE_CTX_get1_issuer ||
+	    ctx->check_issued != check_issued ||
+	    ctx->check_revocation != check_revocation ||
+	    ctx->get_crl != NULL ||
+	    ctx->check_crl != check_crl ||
+	    ctx->cert_crl != cert_crl ||
+	    ctx->check_policy != check_policy ||
+	    ctx->lookup_certs != X509_STORE_get1_certs ||
+	    ctx->lookup_crls != X509_STORE_get1_crls)
+		return 0;
+	if ((ctx->param->flags & X509_V_FLAG_POLICY_CHECK) ||
+	    ctx->param->policies != NULL)
+		return 0;
+
+	return 1;
+}
+
+/*
+ * The cache key covers the leaf, the untrusted certificates in the
+ * order given, and the parameters that change which chain is accepted.
+ * Host, email and address checks are not part of it since they are
+ * redone on every hit.
+ */
+static int
+X509_verify_cert_cache_key(X509_STORE_CTX *ctx, unsigned char *md)
+{
+	unsigned char cert_md[EVP_MAX_MD_SIZE];
+	unsigned int cert_md_len, md_len;
+	X509_VERIFY_PARAM *param = ctx->param;
+	EVP_MD_CTX *md_ctx;
+	int32_t parts[4];
+	int i, ret = 0;
+
+	if ((md_ctx = EVP_MD_CTX_new()) == NULL)
+		return 0;
+	if (!EVP_DigestInit_ex(md_ctx, EVP_sha512(), NULL))
+		goto err;
+
+	parts[0] = param->flags;
+	parts[1] = param->purpose;
+	parts[2] = param->trust;
+	parts[3] = param->depth;
+	if (!EVP_DigestUpdate(md_ctx, parts, sizeof(parts)))
+		goto err;
+
+	if (!X509_digest(ctx->cert, EVP_sha512(), cert_md, &cert_md_len))
+		goto err;
+	if (!EVP_DigestUpdate(md_ctx, cert_md, cert_md_len))
+		goto err;
+	for (i = 0; i < sk_X509_num(ctx->untrusted); i++) {
+		if (!X509_digest(sk_X509_value(ctx->untrusted, i),
+		    EVP_sha512(), cert_md, &cert_md_len))
+			goto err;
+		if (!EVP_DigestUpdate(md_ctx, cert_md, cert_md_len))
+			goto err;
+	}
+
+	if (!EVP_DigestFinal_ex(md_ctx, md, &md_len))
+		goto err;
+	if (md_len != X509_CHAIN_CACHE_MD_LEN)
+		goto err;
+
+	ret = 1;
+
+ err:
+	EVP_MD_CTX_free(md_ctx);
+
+	return ret;
+}
+
+/* Fill in ctx from a cached chain, as a successful verification would. */
+static int
+X509_verify_cert_cache_hit(X509_STORE_CTX *ctx, const unsigned char *md)
+{
+	X509_VERIFY_PARAM_ID *id = ctx->param->id;
+	STACK_OF(X509) *chain;
+	time_t check_time;
+	int check_validity, last_untrusted;
+
+	check_validity = !(ctx->param->flags & X509_V_FLAG_NO_CHECK_TIME);
+	if (ctx->param->flags & X509_V_FLAG_USE_CHECK_TIME)
+		check_time = ctx->param->check_time;
+	else
+		check_time = time(NULL);
+
+	if (!x509_chain_cache_find(ctx->ctx->verify_cache, md, check_time,
+	    check_validity, &chain, &last_untrusted))
+		return 0;
+
+	ctx->chain = chain;
+	ctx->last_untrusted = last_untrusted;
+	ctx->error = X509_V_OK;
+	ctx->error_depth = 0;
+	ctx->current_cert = ctx->cert;
+
+	if (id->hosts != NULL || id->email != NULL || id->ip != NULL) {
+		if (!check_id(ctx)) {
+			if (ctx->error == X509_V_OK)
+				ctx->error = X509_V_ERR_UNSPECIFIED;
+			return -1;
+		}
+	}
+
+	return 1;
+}
+
+static int
+X509_verify_cert_internal(X509_STORE_CTX *ctx)
 {
 	STACK_OF(X509) *roots = NULL;
 	struct x509_verify_ctx *vctx = NULL;
@@ -693,6 +818,33 @@ X509_verify_cert(X509_STORE_CTX *ctx)
 	return (chain_count > 0 && ctx->chain != NULL);
 }
 
+int
+X509_verify_cert(X509_STORE_CTX *ctx)
+{
+	unsigned char md[X509_CHAIN_CACHE_MD_LEN];
+	uint64_t generation = 0;
+	int cache = 0, ret;
+
+	if (ctx->cert != NULL && ctx->chain == NULL &&
+	    !ctx->param->id->poisoned &&
+	    ctx->error == X509_V_ERR_INVALID_CALL &&
+	    x509_verify_cert_cacheable(ctx) &&
+	    X509_verify_cert_cache_key(ctx, md)) {
+		if ((ret = X509_verify_cert_cache_hit(ctx, md)) != 0)
+			return ret > 0;
+		generation = x509_chain_cache_generation(ctx->ctx->verify_cache);
+		cache = 1;
+	}
+
+	ret = X509_verify_cert_internal(ctx);
+
+	if (cache && ret > 0 && ctx->error == X509_V_OK && ctx->chain != NULL)
+		x509_chain_cache_add(ctx->ctx->verify_cache, md, generation,
+		    ctx->chain, ctx->last_untrusted);
+
+	return ret;
+}
+
 /* Given a STACK_OF(X509) find the issuer of cert (if any)
  */
 
@@ -1003,9 +1155,37 @@ x509_vfy_check_trust(X509_STORE_CTX *ctx)
 	return check_trust(ctx);
 }
 
+/*
+ * Look x up in the CRL filter of the store, if there is one.  The store
+ * lock keeps the filter mapped while it is used.
+ */
+static int
+check_crl_filter(X509_STORE_CTX *ctx, X509 *x)
+{
+	time_t check_time;
+	int ret = X509_CRL_FILTER_UNKNOWN;
+
+	if (ctx->ctx == NULL || ctx->ctx->crl_filter == NULL)
+		return X509_CRL_FILTER_UNKNOWN;
+
+	if (ctx->param->flags & X509_V_FLAG_USE_CHECK_TIME)
+		check_time = ctx->param->check_time;
+	else
+		check_time = time(NULL);
+
+	CRYPTO_r_lock(CRYPTO_LOCK_X509_STORE);
+	if (ctx->ctx->crl_filter != NULL)
+		ret = x509_crl_filter_lookup(ctx->ctx->crl_filter, x,
+		    check_time);
+	CRYPTO_r_unlock(CRYPTO_LOCK_X509_STORE);
+
+	return ret;
+}
+
 static int
 check_revocation(X509_STORE_CTX *ctx)
 {
+	X509 *x;
 	int i, last, ok;
 
 	if (!(ctx->param->flags & X509_V_FLAG_CRL_CHECK))
@@ -1019,7 +1199,20 @@ check_revocation(X509_STORE_CTX *ctx)
 		last = 0;
 	}
 	for (i = 0; i <= last; i++) {
-		ok = check_cert(ctx, ctx->chain, i);
+		x = sk_X509_value(ctx->chain, i);
+		switch (check_crl_filter(ctx, x)) {
+		case X509_CRL_FILTER_GOOD:
+			continue;
+		case X509_CRL_FILTER_REVOKED:
+			ctx->error_depth = i;
+			ctx->current_cert = x;
+			ctx->error = X509_V_ERR_CERT_REVOKED;
+			ok = ctx->verify_cb(0, ctx);
+			break;
+		default:
+			ok = check_cert(ctx, ctx->chain, i);
+			break;
+		}
 		if (!ok)
 			return ok;
 	}
@@ -1288,24 +1481,35 @@ static void
 get_delta_sk(X509_STORE_CTX *ctx, X509_CRL **dcrl, int *pscore, X509_CRL *base,
     STACK_OF(X509_CRL) *crls)
 {
-	X509_CRL *delta;
-	int i;
+	X509_CRL *delta, *best = NULL;
+	int i, best_time = 0, time_ok;
 
 	if (!(ctx->param->flags & X509_V_FLAG_USE_DELTAS))
 		return;
 	if (!((ctx->current_cert->ex_flags | base->flags) & EXFLAG_FRESHEST))
 		return;
+	/*
+	 * Several deltas may be present when new ones are added as they are
+	 * issued: prefer a current one, then the one with the highest number.
+	 */
 	for (i = 0; i < sk_X509_CRL_num(crls); i++) {
 		delta = sk_X509_CRL_value(crls, i);
-		if (check_delta_base(delta, base)) {
-			if (check_crl_time(ctx, delta, 0))
-				*pscore |= CRL_SCORE_TIME_DELTA;
-			CRYPTO_add(&delta->references, 1, CRYPTO_LOCK_X509_CRL);
-			*dcrl = delta;
-			return;
-		}
+		if (!check_delta_base(delta, base))
+			continue;
+		time_ok = check_crl_time(ctx, delta, 0);
+		if (best != NULL && (time_ok < best_time ||
+		    (time_ok == best_time && ASN1_INTEGER_cmp(delta->crl_number,
+		    best->crl_number) <= 0)))
+			continue;
+		best = delta;
+		best_time = time_ok;
+	}
+	if (best != NULL) {
+		if (best_time)
+			*pscore |= CRL_SCORE_TIME_DELTA;
+		CRYPTO_add(&best->references, 1, CRYPTO_LOCK_X509_CRL);
 	}
-	*dcrl = NULL;
+	*dcrl = best;
 }
 
 /* For a given CRL return how suitable it is for the supplied certificate 'x'.
@@ -1894,7 +2098,7 @@ x509_check_cert_time(X509_STORE_CTX *ctx, X509 *x, int depth)
 	else
 		ptime = NULL;
 
-	i = X509_cmp_time(X509_get_notBefore(x), ptime);
+	i = x509_cmp_cert_time(x, 0, ptime);
 	if (i >= 0 && depth < 0)
 		return 0;
 	if (i == 0 && !verify_cb_cert(ctx, x, depth,
@@ -1904,7 +2108,7 @@ x509_check_cert_time(X509_STORE_CTX *ctx, X509 *x, int depth)
 	    X509_V_ERR_CERT_NOT_YET_VALID))
 		return 0;
 
-	i = X509_cmp_time_internal(X509_get_notAfter(x), ptime, 1);
+	i = x509_cmp_cert_time(x, 1, ptime);
 	if (i <= 0 && depth < 0)
 		return 0;
 	if (i == 0 && !verify_cb_cert(ctx, x, depth,
@@ -2044,6 +2248,36 @@ X509_cmp_time(const ASN1_TIME *ctm, time_t *cmp_time)
 	return X509_cmp_time_internal(ctm, cmp_time, 0);
 }
 
+/*
+ * Compare the notBefore or notAfter of a certificate in the same way as
+ * X509_cmp_time(), from the validity cached with its extensions.
+ */
+static int
+x509_cmp_cert_time(X509 *x, int notafter, time_t *cmp_time)
+{
+	time_t compare, cert_time;
+
+	if (cmp_time == NULL)
+		compare = time(NULL);
+	else
+		compare = *cmp_time;
+
+	x509v3_cache_extensions(x);
+
+	if (notafter) {
+		if (x->ex_flags & EXFLAG_BAD_NOT_AFTER)
+			return 0;
+		cert_time = x->not_after;
+	} else {
+		if (x->ex_flags & EXFLAG_BAD_NOT_BEFORE)
+			return 0;
+		cert_time = x->not_before;
+	}
+
+	/* The same time counts as earlier, since 0 is used for errors. */
+	return cert_time > compare ? 1 : -1;
+}
+
 
 ASN1_TIME *
 X509_gmtime_adj(ASN1_TIME *s, long adj)
@@ -2315,9 +2549,9 @@ X509_STORE_CTX_free(X509_STORE_CTX *ctx)
 	free(ctx);
 }
 
-int
-X509_STORE_CTX_init(X509_STORE_CTX *ctx, X509_STORE *store, X509 *x509,
-    STACK_OF(X509) *chain)
+static int
+x509_store_ctx_init(X509_STORE_CTX *ctx, X509_STORE *store, X509 *x509,
+    STACK_OF(X509) *chain, X509_VERIFY_PARAM *param)
 {
 	int param_ret = 1;
 
@@ -2405,7 +2639,10 @@ X509_STORE_CTX_init(X509_STORE_CTX *ctx, X509_STORE *store, X509 *x509,
 	else
 		ctx->cleanup = NULL;
 
-	ctx->param = X509_VERIFY_PARAM_new();
+	if (param != NULL)
+		ctx->param = param;
+	else
+		ctx->param = X509_VERIFY_PARAM_new();
 	if (!ctx->param) {
 		X509error(ERR_R_MALLOC_FAILURE);
 		return 0;
@@ -2436,6 +2673,28 @@ X509_STORE_CTX_init(X509_STORE_CTX *ctx, X509_STORE *store, X509 *x509,
 	return 1;
 }
 
+int
+X509_STORE_CTX_init(X509_STORE_CTX *ctx, X509_STORE *store, X509 *x509,
+    STACK_OF(X509) *chain)
+{
+	return x509_store_ctx_init(ctx, store, x509, chain, NULL);
+}
+
+/*
+ * Set up a context that was already used for a verification, or newly
+ * allocated, for the next one. Unlike X509_STORE_CTX_init(), this keeps
+ * the verification parameters allocated, so that contexts kept around for
+ * repeated verifications avoid setting them up from scratch each time.
+ */
+int
+X509_STORE_CTX_reinit(X509_STORE_CTX *ctx, X509_STORE *store, X509 *x509,
+    STACK_OF(X509) *chain)
+{
+	X509_STORE_CTX_reset(ctx);
+
+	return x509_store_ctx_init(ctx, store, x509, chain, ctx->param);
+}
+
 /* Set alternative lookup method: just a STACK of trusted certificates.
  * This avoids X509_STORE nastiness where it isn't needed.
  */
@@ -2476,6 +2735,27 @@ X509_STORE_CTX_cleanup(X509_STORE_CTX *ctx)
 	memset(&ctx->ex_data, 0, sizeof(CRYPTO_EX_DATA));
 }
 
+/*
+ * Release everything held by the last verification, as with
+ * X509_STORE_CTX_cleanup(), but keep the verification parameters for the
+ * next X509_STORE_CTX_reinit().
+ */
+void
+X509_STORE_CTX_reset(X509_STORE_CTX *ctx)
+{
+	X509_VERIFY_PARAM *param = NULL;
+
+	if (ctx->parent == NULL) {
+		param = ctx->param;
+		ctx->param = NULL;
+	}
+	X509_STORE_CTX_cleanup(ctx);
+	ctx->cleanup = NULL;
+
+	x509_verify_param_reset(param);
+	ctx->param = param;
+}
+
 void
 X509_STORE_CTX_set_depth(X509_STORE_CTX *ctx, int depth)
 {
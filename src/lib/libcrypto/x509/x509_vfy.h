@@ -197,6 +197,10 @@ struct x509_store_st
 
 	CRYPTO_EX_DATA ex_data;
 	int references;
+
+	struct x509_store_index *index;	/* optional hash index of objs */
+	struct x509_chain_cache *verify_cache; /* optional verify results */
+	struct x509_crl_filter *crl_filter; /* optional revocation filter */
 	} /* X509_STORE */;
 
 int X509_STORE_set_depth(X509_STORE *store, int depth);
@@ -278,6 +282,7 @@ void X509_STORE_CTX_set_depth(X509_STORE_CTX *ctx, int depth);
 #define X509_L_FILE_LOAD	1
 #define X509_L_ADD_DIR		2
 #define X509_L_MEM		3
+#define X509_L_INDEX_LOAD	4
 
 #define X509_LOOKUP_load_file(x,name,type) \
 		X509_LOOKUP_ctrl((x),X509_L_FILE_LOAD,(name),(long)(type),NULL)
@@ -289,6 +294,9 @@ void X509_STORE_CTX_set_depth(X509_STORE_CTX *ctx, int depth);
 		X509_LOOKUP_ctrl((x),X509_L_MEM,(const char *)(iov),\
 		(long)(type),NULL)
 
+#define X509_LOOKUP_load_index(x,name) \
+		X509_LOOKUP_ctrl((x),X509_L_INDEX_LOAD,(name),0,NULL)
+
 #define		X509_V_OK					0
 #define		X509_V_ERR_UNSPECIFIED				1
 #define		X509_V_ERR_UNABLE_TO_GET_ISSUER_CERT		2
@@ -446,6 +454,11 @@ int X509_STORE_set_ex_data(X509_STORE *xs, int idx, void *data);
 		(newf), (dupf), (freef))
 
 int X509_STORE_set_flags(X509_STORE *ctx, unsigned long flags);
+int X509_STORE_enable_index(X509_STORE *ctx);
+int X509_STORE_enable_verify_cache(X509_STORE *ctx, size_t max);
+int X509_STORE_load_crl_filter(X509_STORE *ctx, const char *file);
+int X509_CRL_filter_write(BIO *bp, STACK_OF(X509_CRL) *crls,
+    STACK_OF(X509) *certs);
 int X509_STORE_set_purpose(X509_STORE *ctx, int purpose);
 int X509_STORE_set_trust(X509_STORE *ctx, int trust);
 int X509_STORE_set1_param(X509_STORE *ctx, X509_VERIFY_PARAM *pm);
@@ -461,6 +474,8 @@ int X509_STORE_CTX_get1_issuer(X509 **issuer, X509_STORE_CTX *ctx, X509 *x);
 void X509_STORE_CTX_free(X509_STORE_CTX *ctx);
 int X509_STORE_CTX_init(X509_STORE_CTX *ctx, X509_STORE *store,
 			 X509 *x509, STACK_OF(X509) *chain);
+int X509_STORE_CTX_reinit(X509_STORE_CTX *ctx, X509_STORE *store,
+			 X509 *x509, STACK_OF(X509) *chain);
 X509 *X509_STORE_CTX_get0_cert(X509_STORE_CTX *ctx);
 STACK_OF(X509) *X509_STORE_CTX_get0_chain(X509_STORE_CTX *xs);
 X509_STORE *X509_STORE_CTX_get0_store(X509_STORE_CTX *xs);
@@ -469,15 +484,18 @@ void X509_STORE_CTX_set0_untrusted(X509_STORE_CTX *ctx, STACK_OF(X509) *sk);
 void X509_STORE_CTX_trusted_stack(X509_STORE_CTX *ctx, STACK_OF(X509) *sk);
 void X509_STORE_CTX_set0_trusted_stack(X509_STORE_CTX *ctx, STACK_OF(X509) *sk);
 void X509_STORE_CTX_cleanup(X509_STORE_CTX *ctx);
+void X509_STORE_CTX_reset(X509_STORE_CTX *ctx);
 
 X509_LOOKUP *X509_STORE_add_lookup(X509_STORE *v, X509_LOOKUP_METHOD *m);
 
 X509_LOOKUP_METHOD *X509_LOOKUP_hash_dir(void);
 X509_LOOKUP_METHOD *X509_LOOKUP_file(void);
 X509_LOOKUP_METHOD *X509_LOOKUP_mem(void);
+X509_LOOKUP_METHOD *X509_LOOKUP_index(void);
 
 int X509_STORE_add_cert(X509_STORE *ctx, X509 *x);
 int X509_STORE_add_crl(X509_STORE *ctx, X509_CRL *x);
+int X509_STORE_replace_crl(X509_STORE *store, X509_CRL *old, X509_CRL *new);
 
 int X509_STORE_get_by_subject(X509_STORE_CTX *vs,int type,X509_NAME *name,
 	X509_OBJECT *ret);
@@ -200,6 +200,19 @@ x509_verify_param_zero(X509_VERIFY_PARAM *param)
 	paramid->poisoned = 0;
 }
 
+/*
+ * Return param to the state of a newly allocated one, for reuse.
+ */
+void
+x509_verify_param_reset(X509_VERIFY_PARAM *param)
+{
+	if (param == NULL)
+		return;
+	x509_verify_param_zero(param);
+	param->check_time = 0;
+	param->id->hostflags = 0;
+}
+
 X509_VERIFY_PARAM *
 X509_VERIFY_PARAM_new(void)
 {
@@ -144,6 +144,10 @@ X509_CRL_sort(X509_CRL *c)
 	int i;
 	X509_REVOKED *r;
 
+	/* A lazily decoded CRL has no entries to write out. */
+	if (c->lazy != NULL)
+		return 0;
+
 	/* sort the data so it will be written in serial
 	 * number order */
 	sk_X509_REVOKED_sort(c->crl->revoked);
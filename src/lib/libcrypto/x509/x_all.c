@@ -73,6 +73,8 @@
 #include <openssl/rsa.h>
 #endif
 
+#include "asn1_locl.h"
+
 X509 *
 d2i_X509_bio(BIO *bp, X509 **x509)
 {
@@ -498,6 +500,9 @@ NETSCAPE_SPKI_verify(NETSCAPE_SPKI *a, EVP_PKEY *r)
 int
 X509_sign(X509 *x, EVP_PKEY *pkey, const EVP_MD *md)
 {
+	/* Re-encoding must not drop extensions still left undecoded. */
+	if (!x509_lazy_load_extensions(x))
+		return 0;
 	x->cert_info->enc.modified = 1;
 	return (ASN1_item_sign(&X509_CINF_it,
 	    x->cert_info->signature, x->sig_alg, x->signature,
@@ -507,6 +512,8 @@ X509_sign(X509 *x, EVP_PKEY *pkey, const EVP_MD *md)
 int
 X509_sign_ctx(X509 *x, EVP_MD_CTX *ctx)
 {
+	if (!x509_lazy_load_extensions(x))
+		return 0;
 	x->cert_info->enc.modified = 1;
 	return ASN1_item_sign_ctx(&X509_CINF_it,
 	    x->cert_info->signature, x->sig_alg, x->signature,
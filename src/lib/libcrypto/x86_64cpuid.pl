@@ -146,16 +146,53 @@ OPENSSL_ia32_cpuid:
 	or	%ecx,%r9d		# merge AMD XOP flag
 
 	mov	%edx,%r10d		# %r9d:%r10d is copy of %ecx:%edx
+	and	\$(~(IA32CAP_MASK0_AVX2 | IA32CAP_MASK0_VAES | IA32CAP_MASK0_SHA | IA32CAP_MASK0_ADX | IA32CAP_MASK0_IFMA)),%r10d	# force reserved bits to 0
+	cmp	\$7,%r11d
+	jb	.Lno_extended
+	mov	\$7,%eax
+	xor	%ecx,%ecx
+	cpuid
+	bt	\$29,%ebx		# test SHA bit
+	jnc	.Lno_sha
+	or	\$IA32CAP_MASK0_SHA,%r10d
+.Lno_sha:
+	mov	%ebx,%eax
+	and	\$0x80100,%eax		# isolate BMI2 and ADX bits
+	cmp	\$0x80100,%eax
+	jne	.Lno_adx
+	or	\$IA32CAP_MASK0_ADX,%r10d
+.Lno_adx:
+	mov	%ebx,%eax
+	and	\$0x210000,%eax		# isolate AVX512F and AVX512IFMA bits
+	cmp	\$0x210000,%eax
+	jne	.Lno_ifma
+	or	\$IA32CAP_MASK0_IFMA,%r10d
+.Lno_ifma:
+	bt	\$5,%ebx		# test AVX2 bit
+	jnc	.Lno_extended
+	or	\$IA32CAP_MASK0_AVX2,%r10d
+	and	\$0x600,%ecx		# isolate VAES and VPCLMULQDQ bits
+	cmp	\$0x600,%ecx
+	jne	.Lno_extended
+	or	\$IA32CAP_MASK0_VAES,%r10d
+.Lno_extended:
 	bt	\$IA32CAP_BIT1_OSXSAVE,%r9d	# check OSXSAVE bit
 	jnc	.Lclear_avx
 	xor	%ecx,%ecx		# XCR0
 	.byte	0x0f,0x01,0xd0		# xgetbv
+	mov	%eax,%ecx
+	and	\$0xe6,%ecx		# isolate XMM, YMM, opmask and ZMM state
+	cmp	\$0xe6,%ecx
+	je	.Lzmm_ok
+	and	\$(~IA32CAP_MASK0_IFMA),%r10d	# clear IFMA bit
+.Lzmm_ok:
 	and	\$6,%eax		# isolate XMM and YMM state support
 	cmp	\$6,%eax
 	je	.Ldone
 .Lclear_avx:
 	mov	\$(~(IA32CAP_MASK1_AVX | IA32CAP_MASK1_FMA3 | IA32CAP_MASK1_AMD_XOP)),%eax
 	and	%eax,%r9d		# clear AVX, FMA and AMD XOP bits
+	and	\$(~(IA32CAP_MASK0_AVX2 | IA32CAP_MASK0_VAES | IA32CAP_MASK0_IFMA)),%r10d	# clear AVX2, VAES and IFMA bits
 .Ldone:
 	shl	\$32,%r9
 	mov	%r10d,%eax
@@ -51,6 +51,13 @@
 #define	IA32CAP_BIT0_INTELP4	20
 #define	IA32CAP_BIT0_INTEL	30
 
+/* the following bits are obtained from "cpuid 7" rather than "cpuid 1" */
+#define	IA32CAP_BIT0_AVX2	10
+#define	IA32CAP_BIT0_VAES	11	/* VAES and VPCLMULQDQ */
+#define	IA32CAP_BIT0_SHA	12	/* replaces MTRR */
+#define	IA32CAP_BIT0_ADX	13	/* BMI2 and ADX, replaces PGE */
+#define	IA32CAP_BIT0_IFMA	14	/* AVX-512F and IFMA, replaces MCA */
+
 /* bit numbers for the high word */
 #define	IA32CAP_BIT1_PCLMUL	1
 #define	IA32CAP_BIT1_SSSE3	9
@@ -71,6 +78,12 @@
 #define	IA32CAP_MASK0_INTELP4	(1 << IA32CAP_BIT0_INTELP4)
 #define	IA32CAP_MASK0_INTEL	(1 << IA32CAP_BIT0_INTEL)
 
+#define	IA32CAP_MASK0_AVX2	(1 << IA32CAP_BIT0_AVX2)
+#define	IA32CAP_MASK0_VAES	(1 << IA32CAP_BIT0_VAES)
+#define	IA32CAP_MASK0_SHA	(1 << IA32CAP_BIT0_SHA)
+#define	IA32CAP_MASK0_ADX	(1 << IA32CAP_BIT0_ADX)
+#define	IA32CAP_MASK0_IFMA	(1 << IA32CAP_BIT0_IFMA)
+
 /* bit masks for the high word */
 #define	IA32CAP_MASK1_PCLMUL	(1 << IA32CAP_BIT1_PCLMUL)
 #define	IA32CAP_MASK1_SSSE3	(1 << IA32CAP_BIT1_SSSE3)
@@ -85,6 +98,11 @@
 #define	CPUCAP_MASK_FXSR	IA32CAP_MASK0_FXSR
 #define	CPUCAP_MASK_SSE		IA32CAP_MASK0_SSE
 #define	CPUCAP_MASK_INTELP4	IA32CAP_MASK0_INTELP4
+#define	CPUCAP_MASK_AVX2	IA32CAP_MASK0_AVX2
+#define	CPUCAP_MASK_VAES	IA32CAP_MASK0_VAES
+#define	CPUCAP_MASK_SHA		IA32CAP_MASK0_SHA
+#define	CPUCAP_MASK_ADX		IA32CAP_MASK0_ADX
+#define	CPUCAP_MASK_IFMA	IA32CAP_MASK0_IFMA
 #define	CPUCAP_MASK_PCLMUL	(1ULL << (32 + IA32CAP_BIT1_PCLMUL))
 #define	CPUCAP_MASK_SSSE3	(1ULL << (32 + IA32CAP_BIT1_SSSE3))
 #define	CPUCAP_MASK_AESNI	(1ULL << (32 + IA32CAP_BIT1_AESNI))
@@ -96,8 +96,8 @@ for (@ARGV) { $sse2=1 if (/-DOPENSSL_IA32_SSE2/); }
 	&mov	("eax",1);
 	&xor	("ecx","ecx");
 	&cpuid	();
-	# force reserved bits to 0.
-	&and	("edx","\$~(IA32CAP_MASK0_INTELP4 | IA32CAP_MASK0_INTEL)");
+	# force reserved bits to 0, the "cpuid 7" bits are not probed here.
+	&and	("edx","\$~(IA32CAP_MASK0_INTELP4 | IA32CAP_MASK0_INTEL | IA32CAP_MASK0_AVX2 | IA32CAP_MASK0_VAES | IA32CAP_MASK0_SHA | IA32CAP_MASK0_ADX | IA32CAP_MASK0_IFMA)");
 	&cmp	("ebp",0);
 	&jne	(&label("notintel"));
 	# set reserved bit#30 on Intel CPUs
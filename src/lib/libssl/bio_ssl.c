@@ -374,6 +374,17 @@ ssl_ctrl(BIO *b, int cmd, long num, void *ptr)
 		break;
 	case BIO_CTRL_FLUSH:
 		BIO_clear_retry_flags(b);
+		if ((ret = SSL_flush(ssl)) <= 0) {
+			switch (SSL_get_error(ssl, ret)) {
+			case SSL_ERROR_WANT_WRITE:
+				BIO_set_retry_write(b);
+				break;
+			case SSL_ERROR_WANT_READ:
+				BIO_set_retry_read(b);
+				break;
+			}
+			break;
+		}
 		ret = BIO_ctrl(ssl->wbio, cmd, num, ptr);
 		BIO_copy_next_retry(b);
 		break;
@@ -75,10 +75,46 @@ CBB_init_fixed(CBB *cbb, uint8_t *buf, size_t len)
 	return 1;
 }
 
+int
+CBB_init_arena(CBB *cbb, CBB_ARENA *arena, size_t initial_capacity)
+{
+	struct cbb_buffer_st *base = &arena->base;
+	uint8_t *buf;
+
+	memset(cbb, 0, sizeof(*cbb));
+
+	if (initial_capacity == 0)
+		initial_capacity = CBB_INITIAL_SIZE;
+
+	if (base->cap < initial_capacity) {
+		if ((buf = recallocarray(base->buf, base->cap,
+		    initial_capacity, 1)) == NULL)
+			return 0;
+		base->buf = buf;
+		base->cap = initial_capacity;
+	}
+
+	base->len = 0;
+	base->can_resize = 1;
+	base->is_arena = 1;
+
+	cbb->base = base;
+	cbb->is_top_level = 1;
+
+	return 1;
+}
+
+void
+CBB_arena_cleanup(CBB_ARENA *arena)
+{
+	freezero(arena->base.buf, arena->base.cap);
+	memset(arena, 0, sizeof(*arena));
+}
+
 void
 CBB_cleanup(CBB *cbb)
 {
-	if (cbb->base) {
+	if (cbb->base != NULL && !cbb->base->is_arena) {
 		if (cbb->base->can_resize)
 			freezero(cbb->base->buf, cbb->base->cap);
 		free(cbb->base);
@@ -169,7 +205,8 @@ CBB_finish(CBB *cbb, uint8_t **out_data, size_t *out_len)
 	if (out_len != NULL)
 		*out_len = cbb->base->len;
 
-	cbb->base->buf = NULL;
+	if (!cbb->base->is_arena)
+		cbb->base->buf = NULL;
 	CBB_cleanup(cbb);
 	return 1;
 }
@@ -269,6 +306,15 @@ CBB_flush(CBB *cbb)
 	return 1;
 }
 
+size_t
+CBB_len(const CBB *cbb)
+{
+	if (cbb->base == NULL)
+		return 0;
+
+	return cbb->base->len;
+}
+
 void
 CBB_discard_child(CBB *cbb)
 {
@@ -413,6 +459,15 @@ CBB_add_u32(CBB *cbb, size_t value)
 	return cbb_add_u(cbb, (uint32_t)value, 4);
 }
 
+int
+CBB_add_u64(CBB *cbb, uint64_t value)
+{
+	if (!cbb_add_u(cbb, (uint32_t)(value >> 32), 4))
+		return 0;
+
+	return cbb_add_u(cbb, (uint32_t)value, 4);
+}
+
 int
 CBB_add_asn1_uint64(CBB *cbb, uint64_t value)
 {
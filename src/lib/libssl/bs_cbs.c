@@ -185,6 +185,23 @@ CBS_get_u32(CBS *cbs, uint32_t *out)
 	return cbs_get_u(cbs, out, 4);
 }
 
+int
+CBS_get_u64(CBS *cbs, uint64_t *out)
+{
+	uint32_t a, b;
+
+	if (cbs->len < 8)
+		return 0;
+
+	if (!CBS_get_u32(cbs, &a))
+		return 0;
+	if (!CBS_get_u32(cbs, &b))
+		return 0;
+
+	*out = (uint64_t)a << 32 | b;
+	return 1;
+}
+
 int
 CBS_get_bytes(CBS *cbs, CBS *out, size_t len)
 {
@@ -133,6 +133,12 @@ int CBS_get_u24(CBS *cbs, uint32_t *out);
  */
 int CBS_get_u32(CBS *cbs, uint32_t *out);
 
+/*
+ * CBS_get_u64 sets |*out| to the next, big-endian uint64_t value from |cbs|
+ * and advances |cbs|. It returns one on success and zero on error.
+ */
+int CBS_get_u64(CBS *cbs, uint64_t *out);
+
 /*
  * CBS_get_bytes sets |*out| to the next |len| bytes from |cbs| and advances
  * |cbs|. It returns one on success and zero on error.
@@ -323,8 +329,24 @@ struct cbb_buffer_st {
 	 * resized.
 	 */
 	char can_resize;
+
+	/*
+	 * One iff this object is part of a |CBB_ARENA|, which owns |buf| and
+	 * keeps it once the |CBB| is done with.
+	 */
+	char is_arena;
 };
 
+/*
+ * A CBB_ARENA holds a buffer that is reused by each |CBB| initialised with
+ * |CBB_init_arena|, so that a series of serialisations need only allocate
+ * when one of them is larger than any before it.  A zeroed CBB_ARENA is
+ * ready for use.
+ */
+typedef struct cbb_arena_st {
+	struct cbb_buffer_st base;
+} CBB_ARENA;
+
 typedef struct cbb_st {
 	struct cbb_buffer_st *base;
 
@@ -366,6 +388,20 @@ int CBB_init(CBB *cbb, size_t initial_capacity);
  */
 int CBB_init_fixed(CBB *cbb, uint8_t *buf, size_t len);
 
+/*
+ * CBB_init_arena initialises |cbb| to write to the buffer of |arena|, which is
+ * grown as needed. Only one |CBB| may use |arena| at a time, and writing to a
+ * |CBB| initialised with |arena| invalidates any data previously returned by
+ * |CBB_finish| from |arena|. It returns one on success or zero on error.
+ */
+int CBB_init_arena(CBB *cbb, CBB_ARENA *arena, size_t initial_capacity);
+
+/*
+ * CBB_arena_cleanup releases the buffer owned by |arena|, which must not be in
+ * use by a |CBB|.
+ */
+void CBB_arena_cleanup(CBB_ARENA *arena);
+
 /*
  * CBB_cleanup frees all resources owned by |cbb| and other |CBB| objects
  * writing to the same buffer. This should be used in an error case where a
@@ -377,11 +413,12 @@ void CBB_cleanup(CBB *cbb);
  * CBB_finish completes any pending length prefix and sets |*out_data| to a
  * malloced buffer and |*out_len| to the length of that buffer. The caller
  * takes ownership of the buffer and, unless the buffer was fixed with
- * |CBB_init_fixed|, must call |free| when done.
+ * |CBB_init_fixed| or belongs to an arena from |CBB_init_arena|, must call
+ * |free| when done.
  *
  * It can only be called on a "top level" |CBB|, i.e. one initialised with
- * |CBB_init| or |CBB_init_fixed|. It returns one on success and zero on
- * error.
+ * |CBB_init|, |CBB_init_fixed| or |CBB_init_arena|. It returns one on success
+ * and zero on error.
  */
 int CBB_finish(CBB *cbb, uint8_t **out_data, size_t *out_len);
 
@@ -392,6 +429,12 @@ int CBB_finish(CBB *cbb, uint8_t **out_data, size_t *out_len);
  */
 int CBB_flush(CBB *cbb);
 
+/*
+ * CBB_len returns the number of bytes written to the buffer of the top-level
+ * |cbb|, including any pending length prefixes and the contents of its child.
+ */
+size_t CBB_len(const CBB *cbb);
+
 /*
  * CBB_discard_child discards the current unflushed child of |cbb|. Neither the
  * child's contents nor the length prefix will be included in the output.
@@ -466,6 +509,12 @@ int CBB_add_u24(CBB *cbb, size_t value);
  */
 int CBB_add_u32(CBB *cbb, size_t value);
 
+/*
+ * CBB_add_u64 appends a 64-bit, big-endian number from |value| to |cbb|. It
+ * returns one on success and zero otherwise.
+ */
+int CBB_add_u64(CBB *cbb, uint64_t value);
+
 /*
  * CBB_add_asn1_uint64 writes an ASN.1 INTEGER into |cbb| using |CBB_add_asn1|
  * and writes |value| in its contents. It returns one on success and zero on
@@ -129,32 +129,6 @@
 
 #define RSMBLY_BITMASK_SIZE(msg_len) (((msg_len) + 7) / 8)
 
-#define RSMBLY_BITMASK_MARK(bitmask, start, end) { \
-			if ((end) - (start) <= 8) { \
-				long ii; \
-				for (ii = (start); ii < (end); ii++) bitmask[((ii) >> 3)] |= (1 << ((ii) & 7)); \
-			} else { \
-				long ii; \
-				bitmask[((start) >> 3)] |= bitmask_start_values[((start) & 7)]; \
-				for (ii = (((start) >> 3) + 1); ii < ((((end) - 1)) >> 3); ii++) bitmask[ii] = 0xff; \
-				bitmask[(((end) - 1) >> 3)] |= bitmask_end_values[((end) & 7)]; \
-			} }
-
-#define RSMBLY_BITMASK_IS_COMPLETE(bitmask, msg_len, is_complete) { \
-			long ii; \
-			OPENSSL_assert((msg_len) > 0); \
-			is_complete = 1; \
-			if (bitmask[(((msg_len) - 1) >> 3)] != bitmask_end_values[((msg_len) & 7)]) is_complete = 0; \
-			if (is_complete) for (ii = (((msg_len) - 1) >> 3) - 1; ii >= 0 ; ii--) \
-				if (bitmask[ii] != 0xff) { is_complete = 0; break; } }
-
-static const unsigned char bitmask_start_values[] = {
-	0xff, 0xfe, 0xfc, 0xf8, 0xf0, 0xe0, 0xc0, 0x80
-};
-static const unsigned char bitmask_end_values[] = {
-	0xff, 0x01, 0x03, 0x07, 0x0f, 0x1f, 0x3f, 0x7f
-};
-
 /* XDTLS:  figure out the right values */
 static const unsigned int g_probable_mtu[] = {1500 - 28, 512 - 28, 256 - 28};
 
@@ -168,44 +142,93 @@ static long dtls1_get_message_fragment(SSL *s, int st1, int stn, long max,
 
 void dtls1_hm_fragment_free(hm_fragment *frag);
 
+/*
+ * Allocate a fragment together with its body and, for a message that is
+ * being reassembled, its bitmask.
+ */
 static hm_fragment *
 dtls1_hm_fragment_new(unsigned long frag_len, int reassembly)
 {
 	hm_fragment *frag;
+	size_t len;
 
-	if ((frag = calloc(1, sizeof(*frag))) == NULL)
-		goto err;
+	len = sizeof(*frag) + frag_len;
+	if (reassembly)
+		len += RSMBLY_BITMASK_SIZE(frag_len);
 
-	if (frag_len > 0) {
-		if ((frag->fragment = calloc(1, frag_len)) == NULL)
-			goto err;
-	}
+	if ((frag = calloc(1, len)) == NULL)
+		return NULL;
 
-	/* Initialize reassembly bitmask if necessary. */
+	if (frag_len > 0)
+		frag->fragment = (unsigned char *)(frag + 1);
 	if (reassembly) {
-		if ((frag->reassembly = calloc(1,
-		    RSMBLY_BITMASK_SIZE(frag_len))) == NULL)
-			goto err;
+		frag->reassembly = (unsigned char *)(frag + 1) + frag_len;
+		frag->missing = frag_len;
 	}
 
 	return frag;
-
- err:
-	dtls1_hm_fragment_free(frag);
-	return NULL;
 }
 
 void
 dtls1_hm_fragment_free(hm_fragment *frag)
 {
-	if (frag == NULL)
-		return;
-
-	free(frag->fragment);
-	free(frag->reassembly);
 	free(frag);
 }
 
+/*
+ * Mark the bytes from start to end as received, returning the number that
+ * had not been received before.
+ */
+static unsigned long
+dtls1_hm_fragment_mark(hm_fragment *frag, unsigned long start,
+    unsigned long end)
+{
+	unsigned long count = 0, i = start;
+	unsigned char bits, newbits;
+
+	while (i < end) {
+		if ((i & 7) == 0 && end - i >= 8) {
+			bits = 0xff;
+			i += 8;
+		} else {
+			bits = 1 << (i & 7);
+			i++;
+		}
+		newbits = bits & ~frag->reassembly[(i - 1) >> 3];
+		frag->reassembly[(i - 1) >> 3] |= bits;
+		for (; newbits != 0; newbits &= newbits - 1)
+			count++;
+	}
+
+	return count;
+}
+
+/* Return the buffered message with sequence number seq, if there is one. */
+static hm_fragment *
+dtls1_buffered_message(SSL *s, unsigned short seq)
+{
+	hm_fragment *frag;
+
+	frag = D1I(s)->buffered_messages[seq % DTLS1_BUFFERED_MESSAGES];
+	if (frag == NULL || frag->msg_header.seq != seq)
+		return NULL;
+
+	return frag;
+}
+
+/* Buffer a message, replacing whatever was left in its slot. */
+static void
+dtls1_buffer_received_message(SSL *s, hm_fragment *frag)
+{
+	hm_fragment **slot;
+
+	slot = &D1I(s)->buffered_messages[frag->msg_header.seq %
+	    DTLS1_BUFFERED_MESSAGES];
+	if (*slot != frag)
+		dtls1_hm_fragment_free(*slot);
+	*slot = frag;
+}
+
 /* send s->internal->init_buf in records of type 'type' (SSL3_RT_HANDSHAKE or SSL3_RT_CHANGE_CIPHER_SPEC) */
 int
 dtls1_do_write(SSL *s, int type)
@@ -250,10 +273,19 @@ dtls1_do_write(SSL *s, int type)
 		    DTLS1_RT_HEADER_LENGTH - overhead;
 
 		if (curr_mtu <= DTLS1_HM_HEADER_LENGTH) {
-			/* grr.. we could get an error if MTU picked was wrong */
-			ret = BIO_flush(SSL_get_wbio(s));
-			if (ret <= 0)
-				return ret;
+			/*
+			 * A packing datagram BIO starts the next datagram
+			 * itself and sends the flight once it is flushed.
+			 */
+			if (!BIO_dgram_get_pack(SSL_get_wbio(s))) {
+				/*
+				 * grr.. we could get an error if MTU picked
+				 * was wrong
+				 */
+				ret = BIO_flush(SSL_get_wbio(s));
+				if (ret <= 0)
+					return ret;
+			}
 			curr_mtu = D1I(s)->mtu - DTLS1_RT_HEADER_LENGTH -
 			    overhead;
 		}
@@ -341,6 +373,11 @@ dtls1_do_write(SSL *s, int type)
 			}
 
 			if (ret == s->internal->init_num) {
+				if (type == SSL3_RT_HANDSHAKE)
+					ssl_trace_message(s, 1,
+					    s->internal->init_buf->data,
+					    s->internal->init_off +
+					    s->internal->init_num);
 				if (s->internal->msg_callback)
 					s->internal->msg_callback(1, s->version, type,
 					    s->internal->init_buf->data,
@@ -414,6 +451,7 @@ dtls1_get_message(SSL *s, int st1, int stn, int mt, long max, int *ok)
 	msg_len += DTLS1_HM_HEADER_LENGTH;
 
 	tls1_transcript_record(s, p, msg_len);
+	ssl_trace_message(s, 0, p, msg_len);
 	if (s->internal->msg_callback)
 		s->internal->msg_callback(0, s->version, SSL3_RT_HANDSHAKE, p, msg_len,
 		    s, s->internal->msg_callback_arg);
@@ -492,48 +530,52 @@ dtls1_retrieve_buffered_fragment(SSL *s, long max, int *ok)
 	 * (1) copy over the fragment to s->internal->init_buf->data[]
 	 * (2) update s->internal->init_num
 	 */
-	pitem *item;
+	hm_fragment **slot;
 	hm_fragment *frag;
+	unsigned long frag_len;
 	int al;
 
 	*ok = 0;
-	item = pqueue_peek(D1I(s)->buffered_messages);
-	if (item == NULL)
+
+	slot = &D1I(s)->buffered_messages[D1I(s)->handshake_read_seq %
+	    DTLS1_BUFFERED_MESSAGES];
+	if ((frag = *slot) == NULL)
 		return 0;
 
-	frag = (hm_fragment *)item->data;
+	/* Anything else in the slot is left over from an earlier message. */
+	if (frag->msg_header.seq != D1I(s)->handshake_read_seq) {
+		dtls1_hm_fragment_free(frag);
+		*slot = NULL;
+		return 0;
+	}
 
 	/* Don't return if reassembly still in progress */
 	if (frag->reassembly != NULL)
 		return 0;
 
-	if (D1I(s)->handshake_read_seq == frag->msg_header.seq) {
-		unsigned long frag_len = frag->msg_header.frag_len;
-		pqueue_pop(D1I(s)->buffered_messages);
+	frag_len = frag->msg_header.frag_len;
+	*slot = NULL;
 
-		al = dtls1_preprocess_fragment(s, &frag->msg_header, max);
+	al = dtls1_preprocess_fragment(s, &frag->msg_header, max);
 
-		if (al == 0) /* no alert */
-		{
-			unsigned char *p = (unsigned char *)s->internal->init_buf->data + DTLS1_HM_HEADER_LENGTH;
-			memcpy(&p[frag->msg_header.frag_off],
-			    frag->fragment, frag->msg_header.frag_len);
-		}
+	if (al == 0) /* no alert */
+	{
+		unsigned char *p = (unsigned char *)s->internal->init_buf->data + DTLS1_HM_HEADER_LENGTH;
+		memcpy(&p[frag->msg_header.frag_off],
+		    frag->fragment, frag->msg_header.frag_len);
+	}
 
-		dtls1_hm_fragment_free(frag);
-		pitem_free(item);
+	dtls1_hm_fragment_free(frag);
 
-		if (al == 0) {
-			*ok = 1;
-			return frag_len;
-		}
+	if (al == 0) {
+		*ok = 1;
+		return frag_len;
+	}
 
-		ssl3_send_alert(s, SSL3_AL_FATAL, al);
-		s->internal->init_num = 0;
-		*ok = 0;
-		return -1;
-	} else
-		return 0;
+	ssl3_send_alert(s, SSL3_AL_FATAL, al);
+	s->internal->init_num = 0;
+	*ok = 0;
+	return -1;
 }
 
 /*
@@ -556,9 +598,8 @@ static int
 dtls1_reassemble_fragment(SSL *s, struct hm_header_st* msg_hdr, int *ok)
 {
 	hm_fragment *frag = NULL;
-	pitem *item = NULL;
-	int i = -1, is_complete;
-	unsigned char seq64be[8];
+	int buffered = 0;
+	int i = -1;
 	unsigned long frag_len = msg_hdr->frag_len;
 
 	if ((msg_hdr->frag_off + frag_len) > msg_hdr->msg_len ||
@@ -570,13 +611,8 @@ dtls1_reassemble_fragment(SSL *s, struct hm_header_st* msg_hdr, int *ok)
 		goto err;
 	}
 
-	/* Try to find item in queue */
-	memset(seq64be, 0, sizeof(seq64be));
-	seq64be[6] = (unsigned char)(msg_hdr->seq >> 8);
-	seq64be[7] = (unsigned char)msg_hdr->seq;
-	item = pqueue_find(D1I(s)->buffered_messages, seq64be);
-
-	if (item == NULL) {
+	/* Try to find the message in the buffer */
+	if ((frag = dtls1_buffered_message(s, msg_hdr->seq)) == NULL) {
 		frag = dtls1_hm_fragment_new(msg_hdr->msg_len, 1);
 		if (frag == NULL)
 			goto err;
@@ -584,9 +620,8 @@ dtls1_reassemble_fragment(SSL *s, struct hm_header_st* msg_hdr, int *ok)
 		frag->msg_header.frag_len = frag->msg_header.msg_len;
 		frag->msg_header.frag_off = 0;
 	} else {
-		frag = (hm_fragment*)item->data;
+		buffered = 1;
 		if (frag->msg_header.msg_len != msg_hdr->msg_len) {
-			item = NULL;
 			frag = NULL;
 			goto err;
 		}
@@ -617,35 +652,20 @@ dtls1_reassemble_fragment(SSL *s, struct hm_header_st* msg_hdr, int *ok)
 	if (i <= 0 || (unsigned long)i != frag_len)
 		goto err;
 
-	RSMBLY_BITMASK_MARK(frag->reassembly, (long)msg_hdr->frag_off,
-	    (long)(msg_hdr->frag_off + frag_len));
-
-	RSMBLY_BITMASK_IS_COMPLETE(frag->reassembly, (long)msg_hdr->msg_len,
-	    is_complete);
+	frag->missing -= dtls1_hm_fragment_mark(frag, msg_hdr->frag_off,
+	    msg_hdr->frag_off + frag_len);
 
-	if (is_complete) {
-		free(frag->reassembly);
+	/* The bitmask is part of the fragment allocation. */
+	if (frag->missing == 0)
 		frag->reassembly = NULL;
-	}
-
-	if (item == NULL) {
-		memset(seq64be, 0, sizeof(seq64be));
-		seq64be[6] = (unsigned char)(msg_hdr->seq >> 8);
-		seq64be[7] = (unsigned char)(msg_hdr->seq);
 
-		item = pitem_new(seq64be, frag);
-		if (item == NULL) {
-			i = -1;
-			goto err;
-		}
-
-		pqueue_insert(D1I(s)->buffered_messages, item);
-	}
+	if (!buffered)
+		dtls1_buffer_received_message(s, frag);
 
 	return DTLS1_HM_FRAGMENT_RETRY;
 
  err:
-	if (item == NULL && frag != NULL)
+	if (!buffered)
 		dtls1_hm_fragment_free(frag);
 	*ok = 0;
 	return i;
@@ -657,38 +677,34 @@ dtls1_process_out_of_seq_message(SSL *s, struct hm_header_st* msg_hdr, int *ok)
 {
 	int i = -1;
 	hm_fragment *frag = NULL;
-	pitem *item = NULL;
-	unsigned char seq64be[8];
 	unsigned long frag_len = msg_hdr->frag_len;
 
 	if ((msg_hdr->frag_off + frag_len) > msg_hdr->msg_len)
 		goto err;
 
-	/* Try to find item in queue, to prevent duplicate entries */
-	memset(seq64be, 0, sizeof(seq64be));
-	seq64be[6] = (unsigned char) (msg_hdr->seq >> 8);
-	seq64be[7] = (unsigned char) msg_hdr->seq;
-	item = pqueue_find(D1I(s)->buffered_messages, seq64be);
+	/* Try to find the message in the buffer, to prevent duplicates */
+	frag = dtls1_buffered_message(s, msg_hdr->seq);
 
 	/*
 	 * If we already have an entry and this one is a fragment,
 	 * don't discard it and rather try to reassemble it.
 	 */
-	if (item != NULL && frag_len < msg_hdr->msg_len)
-		item = NULL;
+	if (frag != NULL && frag_len < msg_hdr->msg_len)
+		frag = NULL;
 
 	/*
 	 * Discard the message if sequence number was already there, is
-	 * too far in the future, already in the queue or if we received
+	 * too far in the future, already in the buffer or if we received
 	 * a FINISHED before the SERVER_HELLO, which then must be a stale
 	 * retransmit.
 	 */
 	if (msg_hdr->seq <= D1I(s)->handshake_read_seq ||
-	    msg_hdr->seq > D1I(s)->handshake_read_seq + 10 || item != NULL ||
+	    msg_hdr->seq > D1I(s)->handshake_read_seq + 10 || frag != NULL ||
 	    (D1I(s)->handshake_read_seq == 0 &&
 	    msg_hdr->type == SSL3_MT_FINISHED)) {
 		unsigned char devnull [256];
 
+		frag = NULL;
 		while (frag_len) {
 			i = s->method->ssl_read_bytes(s, SSL3_RT_HANDSHAKE,
 			    devnull, frag_len > sizeof(devnull) ?
@@ -718,22 +734,13 @@ dtls1_process_out_of_seq_message(SSL *s, struct hm_header_st* msg_hdr, int *ok)
 				goto err;
 		}
 
-		memset(seq64be, 0, sizeof(seq64be));
-		seq64be[6] = (unsigned char)(msg_hdr->seq >> 8);
-		seq64be[7] = (unsigned char)(msg_hdr->seq);
-
-		item = pitem_new(seq64be, frag);
-		if (item == NULL)
-			goto err;
-
-		pqueue_insert(D1I(s)->buffered_messages, item);
+		dtls1_buffer_received_message(s, frag);
 	}
 
 	return DTLS1_HM_FRAGMENT_RETRY;
 
  err:
-	if (item == NULL && frag != NULL)
-		dtls1_hm_fragment_free(frag);
+	dtls1_hm_fragment_free(frag);
 	*ok = 0;
 	return i;
 }
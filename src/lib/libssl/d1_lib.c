@@ -90,8 +90,6 @@ dtls1_new(SSL *s)
 		goto err;
 	if ((s->d1->internal->processed_rcds.q = pqueue_new()) == NULL)
 		goto err;
-	if ((s->d1->internal->buffered_messages = pqueue_new()) == NULL)
-		goto err;
 	if ((s->d1->sent_messages = pqueue_new()) == NULL)
 		goto err;
 	if ((s->d1->internal->buffered_app_data.q = pqueue_new()) == NULL)
@@ -142,9 +140,14 @@ dtls1_drain_fragments(pqueue queue)
 static void
 dtls1_clear_queues(SSL *s)
 {
+	size_t i;
+
 	dtls1_drain_records(D1I(s)->unprocessed_rcds.q);
 	dtls1_drain_records(D1I(s)->processed_rcds.q);
-	dtls1_drain_fragments(D1I(s)->buffered_messages);
+	for (i = 0; i < DTLS1_BUFFERED_MESSAGES; i++) {
+		dtls1_hm_fragment_free(D1I(s)->buffered_messages[i]);
+		D1I(s)->buffered_messages[i] = NULL;
+	}
 	dtls1_drain_fragments(s->d1->sent_messages);
 	dtls1_drain_records(D1I(s)->buffered_app_data.q);
 }
@@ -161,7 +164,6 @@ dtls1_free(SSL *s)
 
 	pqueue_free(D1I(s)->unprocessed_rcds.q);
 	pqueue_free(D1I(s)->processed_rcds.q);
-	pqueue_free(D1I(s)->buffered_messages);
 	pqueue_free(s->d1->sent_messages);
 	pqueue_free(D1I(s)->buffered_app_data.q);
 
@@ -177,7 +179,6 @@ dtls1_clear(SSL *s)
 	struct dtls1_state_internal_st *internal;
 	pqueue unprocessed_rcds;
 	pqueue processed_rcds;
-	pqueue buffered_messages;
 	pqueue sent_messages;
 	pqueue buffered_app_data;
 	unsigned int mtu;
@@ -185,7 +186,6 @@ dtls1_clear(SSL *s)
 	if (s->d1) {
 		unprocessed_rcds = D1I(s)->unprocessed_rcds.q;
 		processed_rcds = D1I(s)->processed_rcds.q;
-		buffered_messages = D1I(s)->buffered_messages;
 		sent_messages = s->d1->sent_messages;
 		buffered_app_data = D1I(s)->buffered_app_data.q;
 		mtu = D1I(s)->mtu;
@@ -213,7 +213,6 @@ dtls1_clear(SSL *s)
 
 		D1I(s)->unprocessed_rcds.q = unprocessed_rcds;
 		D1I(s)->processed_rcds.q = processed_rcds;
-		D1I(s)->buffered_messages = buffered_messages;
 		s->d1->sent_messages = sent_messages;
 		D1I(s)->buffered_app_data.q = buffered_app_data;
 	}
@@ -431,3 +430,67 @@ dtls1_listen(SSL *s, struct sockaddr *client)
 	(void)BIO_dgram_get_peer(SSL_get_rbio(s), client);
 	return 1;
 }
+
+int
+SSL_set1_dtls_cid(SSL *s, const unsigned char *cid, size_t cid_len)
+{
+	if (!SSL_is_dtls(s)) {
+		SSLerror(s, ERR_R_SHOULD_NOT_HAVE_BEEN_CALLED);
+		return 0;
+	}
+	if (cid_len > DTLS1_MAX_CID_LENGTH || (cid == NULL && cid_len > 0)) {
+		SSLerror(s, SSL_R_BAD_LENGTH);
+		return 0;
+	}
+
+	if (cid_len > 0)
+		memcpy(s->internal->dtls_cid, cid, cid_len);
+	s->internal->dtls_cid_len = cid_len;
+	s->internal->dtls_cid_enabled = 1;
+
+	return 1;
+}
+
+int
+SSL_get0_dtls_peer_cid(const SSL *s, const unsigned char **cid,
+    size_t *cid_len)
+{
+	*cid = NULL;
+	*cid_len = 0;
+
+	if (!s->internal->dtls_cid_negotiated)
+		return 0;
+
+	*cid = s->internal->dtls_peer_cid;
+	*cid_len = s->internal->dtls_peer_cid_len;
+
+	return 1;
+}
+
+void
+dtls1_cid_reset(SSL *s)
+{
+	s->internal->dtls_cid_negotiated = 0;
+	s->internal->dtls_peer_cid_len = 0;
+
+	tls12_record_layer_set_cids(s->internal->rl, NULL, NULL);
+}
+
+/*
+ * Both sides have agreed to use connection IDs.  Records sent to us carry
+ * our own CID and records we send carry the peer's, from the next epoch.
+ */
+int
+dtls1_cid_negotiated(SSL *s, CBS *peer_cid)
+{
+	CBS own_cid;
+
+	if (!CBS_write_bytes(peer_cid, s->internal->dtls_peer_cid,
+	    sizeof(s->internal->dtls_peer_cid), &s->internal->dtls_peer_cid_len))
+		return 0;
+	s->internal->dtls_cid_negotiated = 1;
+
+	CBS_init(&own_cid, s->internal->dtls_cid, s->internal->dtls_cid_len);
+
+	return tls12_record_layer_set_cids(s->internal->rl, &own_cid, peer_cid);
+}
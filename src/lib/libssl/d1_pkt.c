@@ -310,14 +310,13 @@ static int
 dtls1_process_record(SSL *s)
 {
 	SSL3_RECORD_INTERNAL *rr = &(S3I(s)->rrec);
-	uint8_t alert_desc;
-	uint8_t *out;
-	size_t out_len;
+	uint8_t alert_desc, content_type;
+	CBS plaintext;
 
 	tls12_record_layer_set_version(s->internal->rl, s->version);
 
 	if (!tls12_record_layer_open_record(s->internal->rl, s->internal->packet,
-	    s->internal->packet_length, &out, &out_len)) {
+	    s->internal->packet_length, &content_type, &plaintext)) {
 		tls12_record_layer_alert(s->internal->rl, &alert_desc);
 
 		if (alert_desc == 0)
@@ -331,8 +330,10 @@ dtls1_process_record(SSL *s)
 		goto fatal_err;
 	}
 
-	rr->data = out;
-	rr->length = out_len;
+	/* A record with a connection ID carries its real content type. */
+	rr->type = content_type;
+	rr->data = (unsigned char *)CBS_data(&plaintext);
+	rr->length = CBS_len(&plaintext);
 	rr->off = 0;
 
 	s->internal->packet_length = 0;
@@ -346,6 +347,26 @@ dtls1_process_record(SSL *s)
 }
 
 
+/*
+ * Length of the header of the record at the start of the packet, which is
+ * longer for a record with a connection ID.  Zero if it cannot be parsed.
+ */
+static int
+dtls1_record_header_len(SSL *s)
+{
+	size_t cid_len;
+
+	if (s->internal->packet_length < DTLS1_RT_HEADER_LENGTH)
+		return 0;
+	if (s->internal->packet[0] != DTLS1_RT_TLS12_CID)
+		return DTLS1_RT_HEADER_LENGTH;
+
+	if ((cid_len = tls12_record_layer_read_cid_len(s->internal->rl)) == 0)
+		return 0;
+
+	return DTLS1_RT_HEADER_LENGTH + cid_len;
+}
+
 /* Call this to get a new input record.
  * It will return <= 0 if more data is needed, normally due to an error
  * or non-blocking IO.
@@ -362,6 +383,7 @@ dtls1_get_record(SSL *s)
 	unsigned char *p = NULL;
 	DTLS1_BITMAP *bitmap;
 	unsigned int is_next_epoch;
+	int header_len;
 	int n;
 
 	rr = &(S3I(s)->rrec);
@@ -398,6 +420,17 @@ dtls1_get_record(SSL *s)
 		if (n != DTLS1_RT_HEADER_LENGTH)
 			goto again;
 
+		/* The header of a tls12_cid record holds the connection ID. */
+		if ((header_len = dtls1_record_header_len(s)) == 0)
+			goto again;
+		if (header_len > DTLS1_RT_HEADER_LENGTH) {
+			n = ssl3_packet_extend(s, header_len);
+			if (n <= 0)
+				return (n);
+			if (n != header_len)
+				goto again;
+		}
+
 		s->internal->rstate = SSL_ST_READ_BODY;
 
 		CBS_init(&header, s->internal->packet, s->internal->packet_length);
@@ -413,6 +446,9 @@ dtls1_get_record(SSL *s)
 		    !CBS_get_bytes(&header, &seq_no, 6))
 			goto again;
 
+		if (!CBS_skip(&header, header_len - DTLS1_RT_HEADER_LENGTH))
+			goto again;
+
 		if (!CBS_get_u16(&header, &len))
 			goto again;
 
@@ -442,12 +478,15 @@ dtls1_get_record(SSL *s)
 
 	/* s->internal->rstate == SSL_ST_READ_BODY, get and decode the data */
 
-	n = ssl3_packet_extend(s, DTLS1_RT_HEADER_LENGTH + rr->length);
+	if ((header_len = dtls1_record_header_len(s)) == 0)
+		goto again;
+
+	n = ssl3_packet_extend(s, header_len + rr->length);
 	if (n <= 0)
 		return (n);
 
 	/* If this packet contained a partial record, dump it. */
-	if (n != DTLS1_RT_HEADER_LENGTH + rr->length)
+	if (n != header_len + rr->length)
 		goto again;
 
 	s->internal->rstate = SSL_ST_READ_HEADER; /* set state for later operations */
@@ -812,6 +851,7 @@ dtls1_read_bytes(SSL *s, int type, unsigned char *buf, int len, int peek)
 		{
 			s->internal->rwstate = SSL_NOTHING;
 			S3I(s)->fatal_alert = alert_descr;
+			ssl_stats_alert(s, 0, alert_descr);
 			SSLerror(s, SSL_AD_REASON_OFFSET + alert_descr);
 			ERR_asprintf_error_data("SSL alert number %d",
 			    alert_descr);
@@ -82,6 +82,10 @@ extern "C" {
 
 #define DTLS1_RT_HEADER_LENGTH                  13
 
+/* Connection IDs - RFC 9146. */
+#define DTLS1_MAX_CID_LENGTH                    255
+#define DTLS1_RT_TLS12_CID                      25
+
 #define DTLS1_HM_HEADER_LENGTH                  12
 
 #define DTLS1_HM_BAD_FRAGMENT                   -2
@@ -111,12 +111,24 @@ typedef struct record_pqueue_st {
 	struct _pqueue *q;
 } record_pqueue;
 
+/*
+ * A buffered handshake message. The body and the reassembly bitmask are
+ * allocated with the structure.
+ */
 typedef struct hm_fragment_st {
 	struct hm_header_st msg_header;
 	unsigned char *fragment;
 	unsigned char *reassembly;
+	unsigned long missing;	/* Bytes not yet received. */
 } hm_fragment;
 
+/*
+ * Handshake messages received ahead of the one expected are buffered in a
+ * ring indexed by message sequence number. Messages are only accepted up to
+ * ten ahead, so the entries in use never collide.
+ */
+#define DTLS1_BUFFERED_MESSAGES	16
+
 typedef struct dtls1_record_data_internal_st {
 	unsigned char *packet;
 	unsigned int packet_length;
@@ -156,7 +168,7 @@ typedef struct dtls1_state_internal_st {
 	record_pqueue processed_rcds;
 
 	/* Buffered handshake messages */
-	struct _pqueue *buffered_messages;
+	hm_fragment *buffered_messages[DTLS1_BUFFERED_MESSAGES];
 
 	/* Buffered application records.
 	 * Only for records between CCS and Finished
@@ -240,6 +252,9 @@ long dtls1_get_message(SSL *s, int st1, int stn, int mt, long max, int *ok);
 int dtls1_get_record(SSL *s);
 int dtls1_dispatch_alert(SSL *s);
 
+void dtls1_cid_reset(SSL *s);
+int dtls1_cid_negotiated(SSL *s, CBS *peer_cid);
+
 __END_HIDDEN_DECLS
 
 #endif
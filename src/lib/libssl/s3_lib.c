@@ -1571,9 +1571,12 @@ ssl3_free(SSL *s)
 	tls13_key_share_free(S3I(s)->hs.tls13.key_share);
 	tls13_secrets_destroy(S3I(s)->hs.tls13.secrets);
 	freezero(S3I(s)->hs.tls13.cookie, S3I(s)->hs.tls13.cookie_len);
+	freezero(S3I(s)->hs.tls13.psk_identity,
+	    S3I(s)->hs.tls13.psk_identity_len);
 	tls13_clienthello_hash_clear(&S3I(s)->hs.tls13);
 
 	sk_X509_NAME_pop_free(S3I(s)->hs.tls12.ca_names, X509_NAME_free);
+	free(S3I(s)->hs.tls12.kex_params);
 
 	tls1_transcript_free(s);
 	tls1_transcript_hash_free(s);
@@ -1595,6 +1598,7 @@ ssl3_clear(SSL *s)
 
 	tls1_cleanup_key_block(s);
 	sk_X509_NAME_pop_free(S3I(s)->hs.tls12.ca_names, X509_NAME_free);
+	free(S3I(s)->hs.tls12.kex_params);
 
 	DH_free(S3I(s)->tmp.dh);
 	S3I(s)->tmp.dh = NULL;
@@ -1616,6 +1620,10 @@ ssl3_clear(SSL *s)
 	freezero(S3I(s)->hs.tls13.cookie, S3I(s)->hs.tls13.cookie_len);
 	S3I(s)->hs.tls13.cookie = NULL;
 	S3I(s)->hs.tls13.cookie_len = 0;
+	freezero(S3I(s)->hs.tls13.psk_identity,
+	    S3I(s)->hs.tls13.psk_identity_len);
+	S3I(s)->hs.tls13.psk_identity = NULL;
+	S3I(s)->hs.tls13.psk_identity_len = 0;
 	tls13_clienthello_hash_clear(&S3I(s)->hs.tls13);
 
 	S3I(s)->hs.extensions_seen = 0;
@@ -1745,6 +1753,11 @@ _SSL_set_tmp_dh(SSL *s, DH *dh)
 		return 0;
 	}
 
+	if (!ssl_cert_unshare(&s->cert)) {
+		DH_free(dh_tmp);
+		return 0;
+	}
+
 	DH_free(s->cert->dh_tmp);
 	s->cert->dh_tmp = dh_tmp;
 
@@ -1754,6 +1767,8 @@ _SSL_set_tmp_dh(SSL *s, DH *dh)
 static int
 _SSL_set_dh_auto(SSL *s, int state)
 {
+	if (!ssl_cert_unshare(&s->cert))
+		return 0;
 	s->cert->dh_tmp_auto = state;
 	return 1;
 }
@@ -1878,24 +1893,36 @@ _SSL_set_tlsext_status_ocsp_resp(SSL *s, unsigned char *resp, int resp_len)
 int
 SSL_set0_chain(SSL *ssl, STACK_OF(X509) *chain)
 {
+	if (!ssl_cert_unshare(&ssl->cert))
+		return 0;
+
 	return ssl_cert_set0_chain(ssl->cert, chain);
 }
 
 int
 SSL_set1_chain(SSL *ssl, STACK_OF(X509) *chain)
 {
+	if (!ssl_cert_unshare(&ssl->cert))
+		return 0;
+
 	return ssl_cert_set1_chain(ssl->cert, chain);
 }
 
 int
 SSL_add0_chain_cert(SSL *ssl, X509 *x509)
 {
+	if (!ssl_cert_unshare(&ssl->cert))
+		return 0;
+
 	return ssl_cert_add0_chain_cert(ssl->cert, x509);
 }
 
 int
 SSL_add1_chain_cert(SSL *ssl, X509 *x509)
 {
+	if (!ssl_cert_unshare(&ssl->cert))
+		return 0;
+
 	return ssl_cert_add1_chain_cert(ssl->cert, x509);
 }
 
@@ -1913,6 +1940,9 @@ SSL_get0_chain_certs(const SSL *ssl, STACK_OF(X509) **out_chain)
 int
 SSL_clear_chain_certs(SSL *ssl)
 {
+	if (!ssl_cert_unshare(&ssl->cert))
+		return 0;
+
 	return ssl_cert_set0_chain(ssl->cert, NULL);
 }
 
@@ -2134,6 +2164,8 @@ ssl3_callback_ctrl(SSL *s, int cmd, void (*fp)(void))
 		return 0;
 
 	case SSL_CTRL_SET_TMP_DH_CB:
+		if (!ssl_cert_unshare(&s->cert))
+			return 0;
 		s->cert->dh_tmp_cb = (DH *(*)(SSL *, int, int))fp;
 		return 1;
 
@@ -2159,6 +2191,11 @@ _SSL_CTX_set_tmp_dh(SSL_CTX *ctx, DH *dh)
 		return 0;
 	}
 
+	if (!ssl_cert_unshare(&ctx->internal->cert)) {
+		DH_free(dh_tmp);
+		return 0;
+	}
+
 	DH_free(ctx->internal->cert->dh_tmp);
 	ctx->internal->cert->dh_tmp = dh_tmp;
 
@@ -2168,6 +2205,8 @@ _SSL_CTX_set_tmp_dh(SSL_CTX *ctx, DH *dh)
 static int
 _SSL_CTX_set_dh_auto(SSL_CTX *ctx, int state)
 {
+	if (!ssl_cert_unshare(&ctx->internal->cert))
+		return 0;
 	ctx->internal->cert->dh_tmp_auto = state;
 	return 1;
 }
@@ -2233,7 +2272,7 @@ _SSL_CTX_set_tlsext_ticket_keys(SSL_CTX *ctx, unsigned char *keys, int keys_len)
 	memcpy(ctx->internal->tlsext_tick_hmac_key, keys + 16, 16);
 	memcpy(ctx->internal->tlsext_tick_aes_key, keys + 32, 16);
 
-	return 1;
+	return tls1_ticket_aead_init(ctx);
 }
 
 static int
@@ -2253,24 +2292,36 @@ _SSL_CTX_set_tlsext_status_arg(SSL_CTX *ctx, void *arg)
 int
 SSL_CTX_set0_chain(SSL_CTX *ctx, STACK_OF(X509) *chain)
 {
+	if (!ssl_cert_unshare(&ctx->internal->cert))
+		return 0;
+
 	return ssl_cert_set0_chain(ctx->internal->cert, chain);
 }
 
 int
 SSL_CTX_set1_chain(SSL_CTX *ctx, STACK_OF(X509) *chain)
 {
+	if (!ssl_cert_unshare(&ctx->internal->cert))
+		return 0;
+
 	return ssl_cert_set1_chain(ctx->internal->cert, chain);
 }
 
 int
 SSL_CTX_add0_chain_cert(SSL_CTX *ctx, X509 *x509)
 {
+	if (!ssl_cert_unshare(&ctx->internal->cert))
+		return 0;
+
 	return ssl_cert_add0_chain_cert(ctx->internal->cert, x509);
 }
 
 int
 SSL_CTX_add1_chain_cert(SSL_CTX *ctx, X509 *x509)
 {
+	if (!ssl_cert_unshare(&ctx->internal->cert))
+		return 0;
+
 	return ssl_cert_add1_chain_cert(ctx->internal->cert, x509);
 }
 
@@ -2288,6 +2339,9 @@ SSL_CTX_get0_chain_certs(const SSL_CTX *ctx, STACK_OF(X509) **out_chain)
 int
 SSL_CTX_clear_chain_certs(SSL_CTX *ctx)
 {
+	if (!ssl_cert_unshare(&ctx->internal->cert))
+		return 0;
+
 	return ssl_cert_set0_chain(ctx->internal->cert, NULL);
 }
 
@@ -2455,6 +2509,8 @@ ssl3_ctx_callback_ctrl(SSL_CTX *ctx, int cmd, void (*fp)(void))
 		return 0;
 
 	case SSL_CTRL_SET_TMP_DH_CB:
+		if (!ssl_cert_unshare(&ctx->internal->cert))
+			return 0;
 		ctx->internal->cert->dh_tmp_cb =
 		    (DH *(*)(SSL *, int, int))fp;
 		return 1;
@@ -2484,29 +2540,82 @@ ssl3_ctx_callback_ctrl(SSL_CTX *ctx, int cmd, void (*fp)(void))
 	return 0;
 }
 
-SSL_CIPHER *
-ssl3_choose_cipher(SSL *s, STACK_OF(SSL_CIPHER) *clnt,
+/*
+ * A set of cipher suites, with one bit for each entry of ssl3_ciphers.
+ */
+struct ssl3_cipher_set {
+	uint64_t bits[(SSL3_NUM_CIPHERS + 63) / 64];
+};
+
+static int
+ssl3_cipher_set_index(const SSL_CIPHER *c, size_t *word, uint64_t *bit)
+{
+	size_t idx;
+
+	if (c < ssl3_ciphers || c >= &ssl3_ciphers[SSL3_NUM_CIPHERS])
+		return 0;
+
+	idx = c - ssl3_ciphers;
+	*word = idx / 64;
+	*bit = (uint64_t)1 << (idx % 64);
+
+	return 1;
+}
+
+/*
+ * Build the set of cipher suites in a list. Zero is returned if the list
+ * has one that is not in ssl3_ciphers and so cannot be represented.
+ */
+static int
+ssl3_cipher_set_from_list(struct ssl3_cipher_set *set,
+    STACK_OF(SSL_CIPHER) *ciphers)
+{
+	size_t word;
+	uint64_t bit;
+	int i;
+
+	memset(set, 0, sizeof(*set));
+
+	for (i = 0; i < sk_SSL_CIPHER_num(ciphers); i++) {
+		if (!ssl3_cipher_set_index(sk_SSL_CIPHER_value(ciphers, i),
+		    &word, &bit))
+			return 0;
+		set->bits[word] |= bit;
+	}
+
+	return 1;
+}
+
+static int
+ssl3_cipher_set_contains(const struct ssl3_cipher_set *set,
+    const SSL_CIPHER *c)
+{
+	size_t word;
+	uint64_t bit;
+
+	if (!ssl3_cipher_set_index(c, &word, &bit))
+		return 0;
+
+	return (set->bits[word] & bit) != 0;
+}
+
+static SSL_CIPHER *
+ssl3_choose_cipher_uncached(SSL *s, STACK_OF(SSL_CIPHER) *clnt,
     STACK_OF(SSL_CIPHER) *srvr)
 {
 	unsigned long alg_k, alg_a, mask_k, mask_a;
+	struct ssl3_cipher_set prio_set, allow_set;
 	STACK_OF(SSL_CIPHER) *prio, *allow;
-	SSL_CIPHER *c, *ret = NULL;
-	int can_use_ecc;
-	int i, ii, ok;
-	CERT *cert;
-
-	/* Let's see which ciphers we can support */
-	cert = s->cert;
-
-	can_use_ecc = (tls1_get_shared_curve(s) != NID_undef);
+	SSL_CIPHER *c;
+	int can_use_ecc, ec_server_key = -1;
+	int use_sets, shared;
+	size_t i;
+	int ii;
 
 	/*
 	 * Do not set the compare functions, because this may lead to a
 	 * reordering by "id". We want to keep the original ordering.
-	 * We may pay a price in performance during sk_SSL_CIPHER_find(),
-	 * but would have to pay with the price of sk_SSL_CIPHER_dup().
 	 */
-
 	if (s->internal->options & SSL_OP_CIPHER_SERVER_PREFERENCE) {
 		prio = srvr;
 		allow = clnt;
@@ -2515,8 +2624,36 @@ ssl3_choose_cipher(SSL *s, STACK_OF(SSL_CIPHER) *clnt,
 		allow = srvr;
 	}
 
-	for (i = 0; i < sk_SSL_CIPHER_num(prio); i++) {
-		c = sk_SSL_CIPHER_value(prio, i);
+	/*
+	 * Membership of the allowed list is a bit test, rather than a
+	 * search of the list for every candidate. If there is no cipher
+	 * suite in both lists there is nothing more to do.
+	 */
+	use_sets = ssl3_cipher_set_from_list(&prio_set, prio) &&
+	    ssl3_cipher_set_from_list(&allow_set, allow);
+	if (use_sets) {
+		shared = 0;
+		for (i = 0; i < sizeof(prio_set.bits) / sizeof(prio_set.bits[0]);
+		    i++) {
+			prio_set.bits[i] &= allow_set.bits[i];
+			shared |= prio_set.bits[i] != 0;
+		}
+		if (!shared)
+			return NULL;
+	}
+
+	/* Let's see which ciphers we can support */
+	ssl_cert_masks(s->cert, &mask_k, &mask_a);
+
+	can_use_ecc = (tls1_get_shared_curve(s) != NID_undef);
+
+	for (ii = 0; ii < sk_SSL_CIPHER_num(prio); ii++) {
+		c = sk_SSL_CIPHER_value(prio, ii);
+
+		if (use_sets) {
+			if (!ssl3_cipher_set_contains(&prio_set, c))
+				continue;
+		}
 
 		/* Skip TLS v1.2 only ciphersuites if not supported. */
 		if ((c->algorithm_ssl & SSL_TLSV1_2) &&
@@ -2533,37 +2670,51 @@ ssl3_choose_cipher(SSL *s, STACK_OF(SSL_CIPHER) *clnt,
 		    !(c->algorithm_ssl & SSL_TLSV1_3))
 			continue;
 
-		ssl_set_cert_masks(cert, c);
-		mask_k = cert->mask_k;
-		mask_a = cert->mask_a;
-
 		alg_k = c->algorithm_mkey;
 		alg_a = c->algorithm_auth;
 
-		ok = (alg_k & mask_k) && (alg_a & mask_a);
+		if ((alg_k & mask_k) == 0 || (alg_a & mask_a) == 0)
+			continue;
 
 		/*
 		 * If we are considering an ECC cipher suite that uses our
 		 * certificate check it.
 		 */
-		if (alg_a & SSL_aECDSA)
-			ok = ok && tls1_check_ec_server_key(s);
+		if (alg_a & SSL_aECDSA) {
+			if (ec_server_key == -1)
+				ec_server_key = tls1_check_ec_server_key(s);
+			if (!ec_server_key)
+				continue;
+		}
 		/*
 		 * If we are considering an ECC cipher suite that uses
 		 * an ephemeral EC key check it.
 		 */
-		if (alg_k & SSL_kECDHE)
-			ok = ok && can_use_ecc;
-
-		if (!ok)
+		if ((alg_k & SSL_kECDHE) && !can_use_ecc)
 			continue;
-		ii = sk_SSL_CIPHER_find(allow, c);
-		if (ii >= 0) {
-			ret = sk_SSL_CIPHER_value(allow, ii);
-			break;
-		}
+
+		if (use_sets)
+			return c;
+		if (sk_SSL_CIPHER_find(allow, c) >= 0)
+			return c;
 	}
-	return (ret);
+
+	return NULL;
+}
+
+SSL_CIPHER *
+ssl3_choose_cipher(SSL *s, STACK_OF(SSL_CIPHER) *clnt,
+    STACK_OF(SSL_CIPHER) *srvr)
+{
+	const SSL_CIPHER *cipher;
+
+	if (ssl_nego_cache_get_cipher(s, clnt, srvr, &cipher))
+		return (SSL_CIPHER *)cipher;
+
+	if ((cipher = ssl3_choose_cipher_uncached(s, clnt, srvr)) != NULL)
+		ssl_nego_cache_set_cipher(s, cipher);
+
+	return (SSL_CIPHER *)cipher;
 }
 
 int
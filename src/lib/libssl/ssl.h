@@ -143,7 +143,10 @@
 #ifndef HEADER_SSL_H
 #define HEADER_SSL_H
 
+#include <sys/types.h>
+
 #include <stdint.h>
+#include <time.h>
 
 #include <openssl/opensslconf.h>
 
@@ -380,6 +383,18 @@ typedef int (*tls_session_secret_cb_fn)(SSL *s, void *secret, int *secret_len,
 /* Allow initial connection to servers that don't support RI */
 #define SSL_OP_LEGACY_SERVER_CONNECT			0x00000004L
 
+/* Hand the record protection to the kernel once the handshake is done. */
+#define SSL_OP_ENABLE_KTLS				0x00000008L
+
+/* Offer and accept compressed TLSv1.3 certificates (RFC 8879). */
+#define SSL_OP_ENABLE_CERT_COMPRESSION			0x00000010L
+
+/* Keep no TLSv1.3 server state across a HelloRetryRequest. */
+#define SSL_OP_STATELESS_HRR				0x00000020L
+
+/* Refer to the peer certificate in session tickets by its digest. */
+#define SSL_OP_TICKET_PEER_CERT_DIGEST			0x00000040L
+
 /* Disable SSL 3.0/TLS 1.0 CBC vulnerability workaround that was added
  * in OpenSSL 0.9.6d.  Usually (depending on the application protocol)
  * the workaround is not needed.
@@ -464,6 +479,12 @@ typedef int (*tls_session_secret_cb_fn)(SSL *s, void *secret, int *secret_len,
  * TLS only.)  "Released" buffers are put onto a free-list in the context
  * or just freed (depending on the context's setting for freelist_max_len). */
 #define SSL_MODE_RELEASE_BUFFERS 0x00000010L
+/* Size TLSv1.3 application data records dynamically, starting with records
+ * that fit into a single TCP segment and growing as data is written. */
+#define SSL_MODE_DYNAMIC_RECORDS 0x00001000L
+/* Coalesce small TLSv1.3 application data writes into a single record, which
+ * is only sent once full, or on SSL_flush(), SSL_read() or SSL_shutdown(). */
+#define SSL_MODE_COALESCE_WRITES 0x00002000L
 
 /* Note: SSL[_CTX]_set_{options,mode} use |= op on the previous value,
  * they cannot be used to clear bits. */
@@ -515,6 +536,8 @@ typedef struct ssl_aead_ctx_st SSL_AEAD_CTX;
 #define SSL_MAX_CERT_LIST_DEFAULT 1024*100 /* 100k max cert list :-) */
 
 #define SSL_SESSION_CACHE_MAX_SIZE_DEFAULT	(1024*20)
+#define SSL_SESSION_CACHE_MAX_SHARDS		256
+#define SSL_SESSION_CACHE_MAX_SHM_SLOTS		(1024*256)
 
 /* This callback type is used inside SSL_CTX, SSL, and in the functions that set
  * them. It is used to override the generation of SSL/TLS session IDs in a
@@ -681,16 +704,100 @@ void SSL_CTX_set_alpn_select_cb(SSL_CTX *ctx,
 void SSL_get0_alpn_selected(const SSL *ssl, const unsigned char **data,
     unsigned int *len);
 
+#define SSL_CLIENT_HELLO_MAX_KEY_SHARES	8
+
+typedef struct ssl_client_hello_st {
+	uint16_t legacy_version;
+	uint16_t version;
+	const uint8_t *random;
+	const uint8_t *session_id;
+	size_t session_id_len;
+	const uint8_t *cipher_suites;
+	size_t cipher_suites_len;
+	const uint8_t *extensions;
+	size_t extensions_len;
+	const uint8_t *servername;
+	size_t servername_len;
+	const uint8_t *alpn;
+	size_t alpn_len;
+	const uint8_t *supported_groups;
+	size_t supported_groups_len;
+	const uint8_t *key_shares;
+	size_t key_shares_len;
+	uint16_t key_share_groups[SSL_CLIENT_HELLO_MAX_KEY_SHARES];
+	size_t num_key_share_groups;
+} SSL_CLIENT_HELLO;
+
+int SSL_client_hello_parse(const uint8_t *data, size_t len,
+    SSL_CLIENT_HELLO *ch);
+
+#define SSL_PRIVATE_KEY_SUCCESS	1
+#define SSL_PRIVATE_KEY_FAILURE	0
+#define SSL_PRIVATE_KEY_RETRY	-1
+
+typedef struct ssl_private_key_method_st {
+	int (*sign)(SSL *ssl, uint8_t *out, size_t *out_len, size_t max_out,
+	    uint16_t sigalg, const uint8_t *in, size_t in_len);
+	int (*complete)(SSL *ssl, uint8_t *out, size_t *out_len,
+	    size_t max_out);
+} SSL_PRIVATE_KEY_METHOD;
+
+void SSL_CTX_set_private_key_method(SSL_CTX *ctx,
+    const SSL_PRIVATE_KEY_METHOD *method);
+void SSL_set_private_key_method(SSL *ssl,
+    const SSL_PRIVATE_KEY_METHOD *method);
+void SSL_get_private_key_time(const SSL *ssl, struct timespec *ts);
+
+void SSL_get_record_counts(const SSL *ssl, uint64_t *records_read,
+    uint64_t *records_written);
+uint64_t SSL_num_key_updates(const SSL *ssl);
+
+typedef struct ssl_handshake_stats_st {
+	uint64_t handshakes;
+	uint64_t full_handshakes;
+	uint64_t resumed_handshakes;
+	uint64_t hello_retry_requests;
+	uint64_t failures;
+	uint64_t ticket_decrypt_failures;
+	struct timespec cpu_time;
+} SSL_HANDSHAKE_STATS;
+
+#define SSL_HANDSHAKE_STAT_VERSION		1
+#define SSL_HANDSHAKE_STAT_CIPHER		2
+#define SSL_HANDSHAKE_STAT_GROUP		3
+#define SSL_HANDSHAKE_STAT_ALERT_SENT		4
+#define SSL_HANDSHAKE_STAT_ALERT_RECEIVED	5
+
+#define SSL_TRACE_STATE			1
+#define SSL_TRACE_MESSAGE_SENT		2
+#define SSL_TRACE_MESSAGE_RECEIVED	3
+
+typedef void (*ssl_handshake_trace_cb_fn)(const SSL *ssl, int event,
+    int value, size_t len, const struct timespec *ts, void *arg);
+
+void SSL_CTX_set_handshake_trace_callback(SSL_CTX *ctx,
+    ssl_handshake_trace_cb_fn cb, void *arg);
+void SSL_set_handshake_trace_callback(SSL *ssl, ssl_handshake_trace_cb_fn cb,
+    void *arg);
+
+void SSL_CTX_get_handshake_stats(SSL_CTX *ctx, SSL_HANDSHAKE_STATS *stats);
+uint64_t SSL_CTX_get_handshake_count(SSL_CTX *ctx, int type,
+    unsigned int value);
+int SSL_hibernate(SSL *ssl);
+
 #define SSL_NOTHING	1
 #define SSL_WRITING	2
 #define SSL_READING	3
 #define SSL_X509_LOOKUP	4
+#define SSL_PRIVATE_KEY_OPERATION	5
 
 /* These will only be used when doing non-blocking IO */
 #define SSL_want_nothing(s)	(SSL_want(s) == SSL_NOTHING)
 #define SSL_want_read(s)	(SSL_want(s) == SSL_READING)
 #define SSL_want_write(s)	(SSL_want(s) == SSL_WRITING)
 #define SSL_want_x509_lookup(s)	(SSL_want(s) == SSL_X509_LOOKUP)
+#define SSL_want_private_key_operation(s) \
+	(SSL_want(s) == SSL_PRIVATE_KEY_OPERATION)
 
 #define SSL_MAC_FLAG_READ_MAC_STREAM 1
 #define SSL_MAC_FLAG_WRITE_MAC_STREAM 2
@@ -938,6 +1045,7 @@ int PEM_write_SSL_SESSION(FILE *fp, SSL_SESSION *x);
 #define SSL_ERROR_ZERO_RETURN		6
 #define SSL_ERROR_WANT_CONNECT		7
 #define SSL_ERROR_WANT_ACCEPT		8
+#define SSL_ERROR_WANT_PRIVATE_KEY_OPERATION	13
 
 #define SSL_CTRL_NEED_TMP_RSA			1
 #define SSL_CTRL_SET_TMP_RSA			2
@@ -1228,6 +1336,10 @@ int SSL_want(const SSL *s);
 int	SSL_clear(SSL *s);
 
 void	SSL_CTX_flush_sessions(SSL_CTX *ctx, long tm);
+int	SSL_CTX_set_session_cache_shards(SSL_CTX *ctx, unsigned int shards);
+unsigned int SSL_CTX_get_session_cache_shards(const SSL_CTX *ctx);
+int	SSL_CTX_set_session_cache_shm(SSL_CTX *ctx, unsigned int slots);
+unsigned int SSL_CTX_get_session_cache_shm(const SSL_CTX *ctx);
 
 const SSL_CIPHER *SSL_get_current_cipher(const SSL *s);
 const SSL_CIPHER *SSL_CIPHER_get_by_id(unsigned int id);
@@ -1336,6 +1448,9 @@ int	SSL_has_matching_session_id(const SSL *ssl, const unsigned char *id,
 	    unsigned int id_len);
 SSL_SESSION *d2i_SSL_SESSION(SSL_SESSION **a, const unsigned char **pp,
 	    long length);
+int	SSL_SESSION_to_compact(SSL_SESSION *ss, unsigned char **out,
+	    size_t *out_len);
+SSL_SESSION *SSL_SESSION_from_compact(const unsigned char *in, size_t in_len);
 
 #ifdef HEADER_X509_H
 X509 *	SSL_get_peer_certificate(const SSL *s);
@@ -1392,6 +1507,14 @@ int	SSL_is_server(const SSL *s);
 int 	SSL_read(SSL *ssl, void *buf, int num);
 int 	SSL_peek(SSL *ssl, void *buf, int num);
 int 	SSL_write(SSL *ssl, const void *buf, int num);
+struct iovec;
+int	SSL_writev(SSL *ssl, const struct iovec *iov, int iovcnt);
+ssize_t	SSL_sendfile(SSL *ssl, int fd, off_t offset, size_t size, int flags);
+int	SSL_flush(SSL *ssl);
+
+int	SSL_set1_dtls_cid(SSL *ssl, const unsigned char *cid, size_t cid_len);
+int	SSL_get0_dtls_peer_cid(const SSL *ssl, const unsigned char **cid,
+	    size_t *cid_len);
 
 #if defined(LIBRESSL_HAS_TLS1_3) || defined(LIBRESSL_INTERNAL)
 uint32_t SSL_CTX_get_max_early_data(const SSL_CTX *ctx);
@@ -1566,6 +1689,18 @@ int SSL_get_ex_data_X509_STORE_CTX_idx(void );
 #define SSL_set_max_send_fragment(ssl,m) \
 	SSL_ctrl(ssl,SSL_CTRL_SET_MAX_SEND_FRAGMENT,m,NULL)
 
+int SSL_CTX_set_buffer_pool_size(SSL_CTX *ctx, size_t size);
+size_t SSL_CTX_get_buffer_pool_size(const SSL_CTX *ctx);
+
+int SSL_CTX_set_key_share_pool_size(SSL_CTX *ctx, size_t size);
+size_t SSL_CTX_get_key_share_pool_size(const SSL_CTX *ctx);
+int SSL_CTX_fill_key_share_pool(SSL_CTX *ctx);
+
+int SSL_CTX_set_numa_nodes(SSL_CTX *ctx, unsigned int nodes);
+unsigned int SSL_CTX_get_numa_nodes(const SSL_CTX *ctx);
+int SSL_set_thread_numa_node(unsigned int node);
+unsigned int SSL_get_thread_numa_node(void);
+
 /* NB: the keylength is only applicable when is_export is true */
 void SSL_CTX_set_tmp_rsa_callback(SSL_CTX *ctx,
     RSA *(*cb)(SSL *ssl, int is_export, int keylength));
@@ -2009,6 +2144,7 @@ void ERR_load_SSL_strings(void);
 #define SSL_R_PEER_ERROR_NO_CIPHER			 203
 #define SSL_R_PEER_ERROR_UNSUPPORTED_CERTIFICATE_TYPE	 204
 #define SSL_R_PRE_MAC_LENGTH_TOO_LONG			 205
+#define SSL_R_PRIVATE_KEY_OPERATION_FAILED		 409
 #define SSL_R_PROBLEMS_MAPPING_CIPHER_FUNCTIONS		 206
 #define SSL_R_PROTOCOL_IS_SHUTDOWN			 207
 #define SSL_R_PSK_IDENTITY_NOT_FOUND			 223
@@ -92,6 +92,8 @@ SSL_library_init(void)
 	EVP_add_cipher(EVP_aes_256_gcm());
 	EVP_add_cipher(EVP_aes_128_cbc_hmac_sha1());
 	EVP_add_cipher(EVP_aes_256_cbc_hmac_sha1());
+	EVP_add_cipher(EVP_aes_128_cbc_hmac_sha256());
+	EVP_add_cipher(EVP_aes_256_cbc_hmac_sha256());
 #ifndef OPENSSL_NO_CAMELLIA
 	EVP_add_cipher(EVP_camellia_128_cbc());
 	EVP_add_cipher(EVP_camellia_256_cbc());
@@ -17,6 +17,7 @@
 
 #include <limits.h>
 
+#include <openssl/sha.h>
 #include <openssl/ssl.h>
 #include <openssl/x509.h>
 
@@ -32,6 +33,9 @@
 #define SSLASN1_HOSTNAME_TAG		(SSLASN1_TAG | 6)
 #define SSLASN1_LIFETIME_TAG		(SSLASN1_TAG | 9)
 #define SSLASN1_TICKET_TAG		(SSLASN1_TAG | 10)
+#define SSLASN1_TICKET_AGE_ADD_TAG	(SSLASN1_TAG | 14)
+#define SSLASN1_MAX_EARLY_DATA_TAG	(SSLASN1_TAG | 15)
+#define SSLASN1_ALPN_SELECTED_TAG	(SSLASN1_TAG | 16)
 
 static uint64_t
 time_max(void)
@@ -44,11 +48,11 @@ time_max(void)
 }
 
 static int
-SSL_SESSION_encode(SSL_SESSION *s, unsigned char **out, size_t *out_len,
-    int ticket_encoding)
+SSL_SESSION_encode(SSL_SESSION *s, unsigned char **out, size_t *out_len)
 {
 	CBB cbb, session, cipher_suite, session_id, master_key, time, timeout;
 	CBB peer_cert, sidctx, verify_result, hostname, lifetime, ticket, value;
+	CBB age_add, max_early_data, alpn_selected;
 	unsigned char *peer_cert_bytes = NULL;
 	int len, rv = 0;
 	uint16_t cid;
@@ -79,11 +83,10 @@ SSL_SESSION_encode(SSL_SESSION *s, unsigned char **out, size_t *out_len,
 	if (!CBB_add_u16(&cipher_suite, cid))
 		goto err;
 
-	/* Session ID - zero length for a ticket. */
+	/* Session ID. */
 	if (!CBB_add_asn1(&session, &session_id, CBS_ASN1_OCTETSTRING))
 		goto err;
-	if (!CBB_add_bytes(&session_id, s->session_id,
-	    ticket_encoding ? 0 : s->session_id_length))
+	if (!CBB_add_bytes(&session_id, s->session_id, s->session_id_length))
 		goto err;
 
 	/* Master key. */
@@ -177,6 +180,38 @@ SSL_SESSION_encode(SSL_SESSION *s, unsigned char **out, size_t *out_len,
 
 	/* Compression method [11]. */
 	/* SRP username [12]. */
+	/* Flags [13]. */
+
+	/* Ticket age add [14]. */
+	if (s->tlsext_tick_age_add != 0) {
+		if (!CBB_add_asn1(&session, &age_add,
+		    SSLASN1_TICKET_AGE_ADD_TAG))
+			goto err;
+		if (!CBB_add_asn1_uint64(&age_add, s->tlsext_tick_age_add))
+			goto err;
+	}
+
+	/* Max early data [15]. */
+	if (s->max_early_data != 0) {
+		if (!CBB_add_asn1(&session, &max_early_data,
+		    SSLASN1_MAX_EARLY_DATA_TAG))
+			goto err;
+		if (!CBB_add_asn1_uint64(&max_early_data, s->max_early_data))
+			goto err;
+	}
+
+	/* ALPN selected [16]. */
+	if (s->alpn_selected != NULL) {
+		if (!CBB_add_asn1(&session, &alpn_selected,
+		    SSLASN1_ALPN_SELECTED_TAG))
+			goto err;
+		if (!CBB_add_asn1(&alpn_selected, &value,
+		    CBS_ASN1_OCTETSTRING))
+			goto err;
+		if (!CBB_add_bytes(&value, s->alpn_selected,
+		    s->alpn_selected_len))
+			goto err;
+	}
 
 	if (!CBB_finish(&cbb, out, out_len))
 		goto err;
@@ -190,18 +225,6 @@ SSL_SESSION_encode(SSL_SESSION *s, unsigned char **out, size_t *out_len,
 	return rv;
 }
 
-int
-SSL_SESSION_ticket(SSL_SESSION *ss, unsigned char **out, size_t *out_len)
-{
-	if (ss == NULL)
-		return 0;
-
-	if (ss->cipher == NULL && ss->cipher_id == 0)
-		return 0;
-
-	return SSL_SESSION_encode(ss, out, out_len, 1);
-}
-
 int
 i2d_SSL_SESSION(SSL_SESSION *ss, unsigned char **pp)
 {
@@ -215,7 +238,7 @@ i2d_SSL_SESSION(SSL_SESSION *ss, unsigned char **pp)
 	if (ss->cipher == NULL && ss->cipher_id == 0)
 		return 0;
 
-	if (!SSL_SESSION_encode(ss, &data, &data_len, 0))
+	if (!SSL_SESSION_encode(ss, &data, &data_len))
 		goto err;
 
 	if (data_len > INT_MAX)
@@ -243,8 +266,9 @@ SSL_SESSION *
 d2i_SSL_SESSION(SSL_SESSION **a, const unsigned char **pp, long length)
 {
 	CBS cbs, session, cipher_suite, session_id, master_key, peer_cert;
-	CBS hostname, ticket;
+	CBS hostname, ticket, alpn_selected;
 	uint64_t version, tls_version, stime, timeout, verify_result, lifetime;
+	uint64_t age_add, max_early_data;
 	const unsigned char *peer_cert_bytes;
 	uint16_t cipher_value;
 	SSL_SESSION *s = NULL;
@@ -412,6 +436,36 @@ d2i_SSL_SESSION(SSL_SESSION **a, const unsigned char **pp, long length)
 
 	/* Compression method [11]. */
 	/* SRP username [12]. */
+	/* Flags [13]. */
+
+	/* Ticket age add [14]. */
+	if (!CBS_get_optional_asn1_uint64(&session, &age_add,
+	    SSLASN1_TICKET_AGE_ADD_TAG, 0))
+		goto err;
+	if (age_add > UINT32_MAX)
+		goto err;
+	s->tlsext_tick_age_add = (uint32_t)age_add;
+
+	/* Max early data [15]. */
+	if (!CBS_get_optional_asn1_uint64(&session, &max_early_data,
+	    SSLASN1_MAX_EARLY_DATA_TAG, 0))
+		goto err;
+	if (max_early_data > UINT32_MAX)
+		goto err;
+	s->max_early_data = (uint32_t)max_early_data;
+
+	/* ALPN selected [16]. */
+	free(s->alpn_selected);
+	s->alpn_selected = NULL;
+	s->alpn_selected_len = 0;
+	if (!CBS_get_optional_asn1_octet_string(&session, &alpn_selected,
+	    &present, SSLASN1_ALPN_SELECTED_TAG))
+		goto err;
+	if (present) {
+		if (!CBS_stow(&alpn_selected, &s->alpn_selected,
+		    &s->alpn_selected_len))
+			goto err;
+	}
 
 	*pp = CBS_data(&cbs);
 
@@ -428,3 +482,401 @@ d2i_SSL_SESSION(SSL_SESSION **a, const unsigned char **pp, long length)
 
 	return (NULL);
 }
+
+/*
+ * Compact session encoding.
+ *
+ * A version byte that cannot start a DER SEQUENCE, a flags field saying
+ * which optional fields are present, then the fields in a fixed order as
+ * fixed width integers and length prefixed strings. The peer certificate is
+ * either carried as DER or, for tickets, by the SHA-256 digest under which
+ * it was added to the peer certificate cache of the issuing SSL_CTX.
+ */
+#define SSL_SESSION_COMPACT_VERSION	0x01
+
+#define SSLC_TIME			0x0001
+#define SSLC_TIMEOUT			0x0002
+#define SSLC_PEER_CERT			0x0004
+#define SSLC_PEER_CERT_DIGEST		0x0008
+#define SSLC_VERIFY_RESULT		0x0010
+#define SSLC_HOSTNAME			0x0020
+#define SSLC_LIFETIME			0x0040
+#define SSLC_TICKET			0x0080
+#define SSLC_TICKET_AGE_ADD		0x0100
+#define SSLC_MAX_EARLY_DATA		0x0200
+#define SSLC_ALPN_SELECTED		0x0400
+#define SSLC_ALL			0x07ff
+
+static int
+SSL_SESSION_encode_compact(SSL_SESSION *s, SSL_CTX *peer_ctx,
+    int ticket_encoding, unsigned char **out, size_t *out_len)
+{
+	CBB cbb, value;
+	uint8_t digest[SHA256_DIGEST_LENGTH];
+	unsigned char *peer_cert_bytes = NULL;
+	uint16_t cid, flags = 0;
+	int len, rv = 0;
+
+	memset(&cbb, 0, sizeof(cbb));
+
+	if (s->ssl_version < 0 || s->ssl_version > 0xffff)
+		goto err;
+	if (s->time < 0 || s->timeout < 0)
+		goto err;
+	if (s->verify_result < 0 || (uint64_t)s->verify_result > UINT32_MAX)
+		goto err;
+	if ((uint64_t)s->tlsext_tick_lifetime_hint > UINT32_MAX)
+		goto err;
+
+	/* XXX - require cipher to be non-NULL or always/only use cipher_id. */
+	cid = (uint16_t)(s->cipher_id & 0xffff);
+	if (s->cipher != NULL)
+		cid = ssl3_cipher_get_value(s->cipher);
+
+	if (s->time != 0)
+		flags |= SSLC_TIME;
+	if (s->timeout != 0)
+		flags |= SSLC_TIMEOUT;
+	if (s->peer != NULL)
+		flags |= peer_ctx != NULL ? SSLC_PEER_CERT_DIGEST :
+		    SSLC_PEER_CERT;
+	if (s->verify_result != X509_V_OK)
+		flags |= SSLC_VERIFY_RESULT;
+	if (s->tlsext_hostname != NULL)
+		flags |= SSLC_HOSTNAME;
+	if (s->tlsext_tick_lifetime_hint > 0)
+		flags |= SSLC_LIFETIME;
+	if (s->tlsext_tick != NULL)
+		flags |= SSLC_TICKET;
+	if (s->tlsext_tick_age_add != 0)
+		flags |= SSLC_TICKET_AGE_ADD;
+	if (s->max_early_data != 0)
+		flags |= SSLC_MAX_EARLY_DATA;
+	if (s->alpn_selected != NULL)
+		flags |= SSLC_ALPN_SELECTED;
+
+	if (!CBB_init(&cbb, 0))
+		goto err;
+
+	if (!CBB_add_u8(&cbb, SSL_SESSION_COMPACT_VERSION))
+		goto err;
+	if (!CBB_add_u16(&cbb, flags))
+		goto err;
+	if (!CBB_add_u16(&cbb, s->ssl_version))
+		goto err;
+	if (!CBB_add_u16(&cbb, cid))
+		goto err;
+
+	/* Session ID - zero length for a ticket. */
+	if (!CBB_add_u8_length_prefixed(&cbb, &value))
+		goto err;
+	if (!CBB_add_bytes(&value, s->session_id,
+	    ticket_encoding ? 0 : s->session_id_length))
+		goto err;
+
+	if (!CBB_add_u8_length_prefixed(&cbb, &value))
+		goto err;
+	if (!CBB_add_bytes(&value, s->master_key, s->master_key_length))
+		goto err;
+
+	if (!CBB_add_u8_length_prefixed(&cbb, &value))
+		goto err;
+	if (!CBB_add_bytes(&value, s->sid_ctx, s->sid_ctx_length))
+		goto err;
+
+	if ((flags & SSLC_TIME) != 0) {
+		if (!CBB_add_u64(&cbb, s->time))
+			goto err;
+	}
+	if ((flags & SSLC_TIMEOUT) != 0) {
+		if (!CBB_add_u64(&cbb, s->timeout))
+			goto err;
+	}
+
+	if ((flags & SSLC_PEER_CERT) != 0) {
+		if ((len = i2d_X509(s->peer, &peer_cert_bytes)) <= 0)
+			goto err;
+		if (!CBB_add_u24_length_prefixed(&cbb, &value))
+			goto err;
+		if (!CBB_add_bytes(&value, peer_cert_bytes, len))
+			goto err;
+	}
+	if ((flags & SSLC_PEER_CERT_DIGEST) != 0) {
+		if (!ssl_peer_cache_add(peer_ctx->internal->peer_cache,
+		    s->peer, digest, sizeof(digest)))
+			goto err;
+		if (!CBB_add_bytes(&cbb, digest, sizeof(digest)))
+			goto err;
+	}
+	if ((flags & SSLC_VERIFY_RESULT) != 0) {
+		if (!CBB_add_u32(&cbb, s->verify_result))
+			goto err;
+	}
+	if ((flags & SSLC_HOSTNAME) != 0) {
+		if (!CBB_add_u16_length_prefixed(&cbb, &value))
+			goto err;
+		if (!CBB_add_bytes(&value, (const uint8_t *)s->tlsext_hostname,
+		    strlen(s->tlsext_hostname)))
+			goto err;
+	}
+	if ((flags & SSLC_LIFETIME) != 0) {
+		if (!CBB_add_u32(&cbb, s->tlsext_tick_lifetime_hint))
+			goto err;
+	}
+	if ((flags & SSLC_TICKET) != 0) {
+		if (!CBB_add_u16_length_prefixed(&cbb, &value))
+			goto err;
+		if (!CBB_add_bytes(&value, s->tlsext_tick, s->tlsext_ticklen))
+			goto err;
+	}
+	if ((flags & SSLC_TICKET_AGE_ADD) != 0) {
+		if (!CBB_add_u32(&cbb, s->tlsext_tick_age_add))
+			goto err;
+	}
+	if ((flags & SSLC_MAX_EARLY_DATA) != 0) {
+		if (!CBB_add_u32(&cbb, s->max_early_data))
+			goto err;
+	}
+	if ((flags & SSLC_ALPN_SELECTED) != 0) {
+		if (!CBB_add_u8_length_prefixed(&cbb, &value))
+			goto err;
+		if (!CBB_add_bytes(&value, s->alpn_selected,
+		    s->alpn_selected_len))
+			goto err;
+	}
+
+	if (!CBB_finish(&cbb, out, out_len))
+		goto err;
+
+	rv = 1;
+
+ err:
+	CBB_cleanup(&cbb);
+	free(peer_cert_bytes);
+
+	return rv;
+}
+
+static SSL_SESSION *
+SSL_SESSION_decode_compact(CBS *cbs, SSL_CTX *peer_ctx)
+{
+	CBS session_id, master_key, sid_ctx, peer_cert, digest, hostname;
+	CBS ticket, alpn_selected;
+	uint64_t stime, timeout;
+	uint32_t verify_result, lifetime, age_add, max_early_data;
+	const unsigned char *peer_cert_bytes;
+	uint16_t flags, tls_version, cipher_value;
+	SSL_SESSION *s = NULL;
+	size_t data_len;
+	uint8_t version;
+
+	if (!CBS_get_u8(cbs, &version))
+		goto err;
+	if (version != SSL_SESSION_COMPACT_VERSION)
+		goto err;
+	if (!CBS_get_u16(cbs, &flags))
+		goto err;
+	if ((flags & ~SSLC_ALL) != 0)
+		goto err;
+	if ((flags & SSLC_PEER_CERT) != 0 &&
+	    (flags & SSLC_PEER_CERT_DIGEST) != 0)
+		goto err;
+
+	if ((s = SSL_SESSION_new()) == NULL) {
+		SSLerrorx(ERR_R_MALLOC_FAILURE);
+		return (NULL);
+	}
+
+	if (!CBS_get_u16(cbs, &tls_version))
+		goto err;
+	s->ssl_version = tls_version;
+
+	/* XXX - populate cipher instead? */
+	if (!CBS_get_u16(cbs, &cipher_value))
+		goto err;
+	s->cipher = NULL;
+	s->cipher_id = SSL3_CK_ID | cipher_value;
+
+	if (!CBS_get_u8_length_prefixed(cbs, &session_id))
+		goto err;
+	if (!CBS_write_bytes(&session_id, s->session_id, sizeof(s->session_id),
+	    &data_len))
+		goto err;
+	s->session_id_length = (unsigned int)data_len;
+
+	if (!CBS_get_u8_length_prefixed(cbs, &master_key))
+		goto err;
+	if (!CBS_write_bytes(&master_key, s->master_key, sizeof(s->master_key),
+	    &data_len))
+		goto err;
+	s->master_key_length = (int)data_len;
+
+	if (!CBS_get_u8_length_prefixed(cbs, &sid_ctx))
+		goto err;
+	if (!CBS_write_bytes(&sid_ctx, s->sid_ctx, sizeof(s->sid_ctx),
+	    &data_len))
+		goto err;
+	s->sid_ctx_length = (unsigned int)data_len;
+
+	/* A missing time or timeout is replaced as by d2i_SSL_SESSION(). */
+	s->time = time(NULL);
+	if ((flags & SSLC_TIME) != 0) {
+		if (!CBS_get_u64(cbs, &stime))
+			goto err;
+		if (stime == 0 || stime > time_max())
+			goto err;
+		s->time = (time_t)stime;
+	}
+	s->timeout = 3;
+	if ((flags & SSLC_TIMEOUT) != 0) {
+		if (!CBS_get_u64(cbs, &timeout))
+			goto err;
+		if (timeout == 0 || timeout > LONG_MAX)
+			goto err;
+		s->timeout = (long)timeout;
+	}
+
+	if ((flags & SSLC_PEER_CERT) != 0) {
+		if (!CBS_get_u24_length_prefixed(cbs, &peer_cert))
+			goto err;
+		peer_cert_bytes = CBS_data(&peer_cert);
+		if (d2i_X509(&s->peer, &peer_cert_bytes,
+		    (long)CBS_len(&peer_cert)) == NULL)
+			goto err;
+	}
+	if ((flags & SSLC_PEER_CERT_DIGEST) != 0) {
+		if (peer_ctx == NULL)
+			goto err;
+		if (!CBS_get_bytes(cbs, &digest, SHA256_DIGEST_LENGTH))
+			goto err;
+		s->peer = ssl_peer_cache_get(peer_ctx->internal->peer_cache,
+		    CBS_data(&digest), CBS_len(&digest));
+		if (s->peer == NULL)
+			goto err;
+	}
+
+	s->verify_result = X509_V_OK;
+	if ((flags & SSLC_VERIFY_RESULT) != 0) {
+		if (!CBS_get_u32(cbs, &verify_result))
+			goto err;
+		if (verify_result > LONG_MAX)
+			goto err;
+		s->verify_result = (long)verify_result;
+	}
+
+	if ((flags & SSLC_HOSTNAME) != 0) {
+		if (!CBS_get_u16_length_prefixed(cbs, &hostname))
+			goto err;
+		if (CBS_contains_zero_byte(&hostname))
+			goto err;
+		if (!CBS_strdup(&hostname, &s->tlsext_hostname))
+			goto err;
+	}
+
+	if ((flags & SSLC_LIFETIME) != 0) {
+		if (!CBS_get_u32(cbs, &lifetime))
+			goto err;
+		if (lifetime > LONG_MAX)
+			goto err;
+		s->tlsext_tick_lifetime_hint = (long)lifetime;
+	}
+
+	if ((flags & SSLC_TICKET) != 0) {
+		if (!CBS_get_u16_length_prefixed(cbs, &ticket))
+			goto err;
+		if (!CBS_stow(&ticket, &s->tlsext_tick, &s->tlsext_ticklen))
+			goto err;
+	}
+
+	if ((flags & SSLC_TICKET_AGE_ADD) != 0) {
+		if (!CBS_get_u32(cbs, &age_add))
+			goto err;
+		s->tlsext_tick_age_add = age_add;
+	}
+
+	if ((flags & SSLC_MAX_EARLY_DATA) != 0) {
+		if (!CBS_get_u32(cbs, &max_early_data))
+			goto err;
+		s->max_early_data = max_early_data;
+	}
+
+	if ((flags & SSLC_ALPN_SELECTED) != 0) {
+		if (!CBS_get_u8_length_prefixed(cbs, &alpn_selected))
+			goto err;
+		if (!CBS_stow(&alpn_selected, &s->alpn_selected,
+		    &s->alpn_selected_len))
+			goto err;
+	}
+
+	if (CBS_len(cbs) != 0)
+		goto err;
+
+	return (s);
+
+ err:
+	SSL_SESSION_free(s);
+
+	return (NULL);
+}
+
+int
+SSL_SESSION_to_compact(SSL_SESSION *ss, unsigned char **out, size_t *out_len)
+{
+	if (ss == NULL)
+		return 0;
+
+	if (ss->cipher == NULL && ss->cipher_id == 0)
+		return 0;
+
+	return SSL_SESSION_encode_compact(ss, NULL, 0, out, out_len);
+}
+
+SSL_SESSION *
+SSL_SESSION_from_compact(const unsigned char *in, size_t in_len)
+{
+	CBS cbs;
+
+	CBS_init(&cbs, in, in_len);
+
+	return SSL_SESSION_decode_compact(&cbs, NULL);
+}
+
+/*
+ * Encode a session for a ticket. If peer_ctx is not NULL the peer
+ * certificate is referred to by its digest in the peer certificate cache of
+ * peer_ctx, otherwise it is included.
+ */
+int
+SSL_SESSION_ticket(SSL_SESSION *ss, SSL_CTX *peer_ctx, unsigned char **out,
+    size_t *out_len)
+{
+	if (ss == NULL)
+		return 0;
+
+	if (ss->cipher == NULL && ss->cipher_id == 0)
+		return 0;
+
+	return SSL_SESSION_encode_compact(ss, peer_ctx, 1, out, out_len);
+}
+
+/*
+ * Decode a session from a ticket, in the compact encoding or, for tickets
+ * issued by older versions, in DER.
+ */
+SSL_SESSION *
+SSL_SESSION_from_ticket(const unsigned char *ticket, size_t ticket_len,
+    SSL_CTX *peer_ctx)
+{
+	const unsigned char *p = ticket;
+	CBS cbs;
+
+	if (ticket_len > 0 && ticket[0] == CBS_ASN1_SEQUENCE) {
+		if (ticket_len > LONG_MAX)
+			return NULL;
+		return d2i_SSL_SESSION(NULL, &p, (long)ticket_len);
+	}
+
+	CBS_init(&cbs, ticket, ticket_len);
+
+	return SSL_SESSION_decode_compact(&cbs, peer_ctx);
+}
@@ -115,6 +115,7 @@
  */
 
 #include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -150,6 +151,9 @@ ssl3_do_write(SSL *s, int type)
 		    (unsigned char *)&s->internal->init_buf->data[s->internal->init_off], ret);
 
 	if (ret == s->internal->init_num) {
+		if (type == SSL3_RT_HANDSHAKE)
+			ssl_trace_message(s, 1, s->internal->init_buf->data,
+			    s->internal->init_off + s->internal->init_num);
 		if (s->internal->msg_callback)
 			s->internal->msg_callback(1, s->version, type, s->internal->init_buf->data,
 			    (size_t)(s->internal->init_off + s->internal->init_num), s,
@@ -337,12 +341,106 @@ ssl3_add_cert(CBB *cbb, X509 *x)
 	return (ret);
 }
 
+/*
+ * Encode the certificate list of a CERT_PKEY with its own chain. For TLSv1.3
+ * the chain certificates are each followed by an empty extensions block and
+ * a copy of the leaf is skipped, while the extensions of the leaf are left
+ * to the caller. The length of the leaf is returned in leaf_len.
+ */
+static int
+ssl_cert_pkey_cert_list_encode(CERT_PKEY *cpk, int tls13, uint8_t **out,
+    size_t *out_len, size_t *leaf_len)
+{
+	CBB cbb, cert_exts;
+	X509 *x;
+	int i;
+
+	if (!CBB_init(&cbb, 0))
+		goto err;
+
+	if (!ssl3_add_cert(&cbb, cpk->x509))
+		goto err;
+	*leaf_len = CBB_len(&cbb);
+
+	for (i = 0; i < sk_X509_num(cpk->chain); i++) {
+		x = sk_X509_value(cpk->chain, i);
+		if (tls13 && i == 0 && x == cpk->x509)
+			continue;
+		if (!ssl3_add_cert(&cbb, x))
+			goto err;
+		if (tls13) {
+			if (!CBB_add_u16_length_prefixed(&cbb, &cert_exts))
+				goto err;
+			if (!CBB_flush(&cbb))
+				goto err;
+		}
+	}
+
+	if (!CBB_finish(&cbb, out, out_len))
+		goto err;
+
+	return 1;
+
+ err:
+	CBB_cleanup(&cbb);
+
+	return 0;
+}
+
+/*
+ * Return the encoded certificate list of a CERT_PKEY that has its own
+ * chain, split after the leaf certificate. This is built on first use and
+ * is then identical for every handshake, until ssl_cert_pkey_flush() is
+ * called. The CERT may be shared by connections in several threads.
+ */
+int
+ssl_cert_pkey_cert_list(CERT_PKEY *cpk, int tls13, CBS *leaf, CBS *chain)
+{
+	uint8_t *data = NULL;
+	size_t len, leaf_len;
+	int idx = tls13 ? 1 : 0;
+
+	if (cpk->x509 == NULL || cpk->chain == NULL)
+		return 0;
+
+	CRYPTO_r_lock(CRYPTO_LOCK_SSL_CERT);
+	data = cpk->cert_list[idx];
+	len = cpk->cert_list_len[idx];
+	leaf_len = cpk->cert_list_leaf_len[idx];
+	CRYPTO_r_unlock(CRYPTO_LOCK_SSL_CERT);
+
+	if (data == NULL) {
+		if (!ssl_cert_pkey_cert_list_encode(cpk, tls13, &data, &len,
+		    &leaf_len))
+			return 0;
+
+		CRYPTO_w_lock(CRYPTO_LOCK_SSL_CERT);
+		if (cpk->cert_list[idx] == NULL) {
+			cpk->cert_list[idx] = data;
+			cpk->cert_list_len[idx] = len;
+			cpk->cert_list_leaf_len[idx] = leaf_len;
+		} else {
+			free(data);
+			data = cpk->cert_list[idx];
+			len = cpk->cert_list_len[idx];
+			leaf_len = cpk->cert_list_leaf_len[idx];
+		}
+		CRYPTO_w_unlock(CRYPTO_LOCK_SSL_CERT);
+	}
+
+	CBS_init(leaf, data, leaf_len);
+	CBS_init(chain, data + leaf_len, len - leaf_len);
+
+	return 1;
+}
+
 int
 ssl3_output_cert_chain(SSL *s, CBB *cbb, CERT_PKEY *cpk)
 {
 	X509_STORE_CTX *xs_ctx = NULL;
 	STACK_OF(X509) *chain;
 	CBB cert_list;
+	CBS leaf_cbs, chain_cbs;
 	X509 *x;
 	int ret = 0;
 	int i;
@@ -354,6 +452,19 @@ ssl3_output_cert_chain(SSL *s, CBB *cbb, CERT_PKEY *cpk)
 	if (cpk == NULL)
 		goto done;
 
+	/* A certificate with its own chain has a prebuilt encoding. */
+	if (cpk->chain != NULL) {
+		if (!ssl_cert_pkey_cert_list(cpk, 0, &leaf_cbs, &chain_cbs))
+			goto err;
+		if (!CBB_add_bytes(&cert_list, CBS_data(&leaf_cbs),
+		    CBS_len(&leaf_cbs)))
+			goto err;
+		if (!CBB_add_bytes(&cert_list, CBS_data(&chain_cbs),
+		    CBS_len(&chain_cbs)))
+			goto err;
+		goto done;
+	}
+
 	if ((chain = cpk->chain) == NULL)
 		chain = s->ctx->extra_certs;
 
@@ -515,6 +626,8 @@ ssl3_get_message(SSL *s, int st1, int stn, int mt, long max, int *ok)
 	if (s->internal->mac_packet) {
 		tls1_transcript_record(s, (unsigned char *)s->internal->init_buf->data,
 		    s->internal->init_num + 4);
+		ssl_trace_message(s, 0, s->internal->init_buf->data,
+		    s->internal->init_num + 4);
 
 		if (s->internal->msg_callback)
 			s->internal->msg_callback(0, s->version,
@@ -653,14 +766,197 @@ ssl3_release_init_buffer(SSL *s)
 	s->internal->init_off = 0;
 }
 
+/*
+ * Record buffers may be drawn from a pool held by the SSL_CTX, so that
+ * connections that release their buffers while idle (SSL_MODE_RELEASE_BUFFERS)
+ * can later reuse them. The pool keeps buffers in a few size classes: record
+ * buffers are all SSL_BUFFER_POOL_BUF_LEN bytes, while the others serve the
+ * buffers that TLSv1.3 handshake messages are received into. Pooled buffers
+ * are zeroed before being returned to the pool.
+ */
+#define SSL_BUFFER_POOL_CLASSES	4
+
+static const size_t ssl_buffer_class_len[SSL_BUFFER_POOL_CLASSES] = {
+	4096,
+	16384,
+	SSL_BUFFER_POOL_BUF_LEN,
+	65536,
+};
+
+struct ssl_buffer_class {
+	uint8_t **bufs;
+	size_t num;
+};
+
+struct ssl_buffer_pool {
+	pthread_mutex_t lock;
+	struct ssl_buffer_class classes[SSL_BUFFER_POOL_CLASSES];
+	size_t max;
+};
+
+/* Return the smallest size class that holds len bytes, or -1 if none does. */
+static int
+ssl_buffer_class(size_t len)
+{
+	int i;
+
+	for (i = 0; i < SSL_BUFFER_POOL_CLASSES; i++) {
+		if (len <= ssl_buffer_class_len[i])
+			return i;
+	}
+
+	return -1;
+}
+
+/*
+ * Allocate a zeroed buffer of at least len bytes, the number of bytes that
+ * were allocated is returned in out_len.
+ */
+uint8_t *
+ssl_buffer_get(SSL_CTX *ctx, size_t len, size_t *out_len)
+{
+	struct ssl_buffer_class *class;
+	struct ssl_buffer_pool *pool;
+	uint8_t *buf = NULL;
+	int i;
+
+	*out_len = 0;
+
+	if (ctx == NULL || (pool = ctx->internal->buffer_pool) == NULL ||
+	    (i = ssl_buffer_class(len)) == -1) {
+		if ((buf = calloc(1, len)) != NULL)
+			*out_len = len;
+		return buf;
+	}
+	class = &pool->classes[i];
+
+	pthread_mutex_lock(&pool->lock);
+	if (class->num > 0)
+		buf = class->bufs[--class->num];
+	pthread_mutex_unlock(&pool->lock);
+
+	if (buf == NULL)
+		buf = calloc(1, ssl_buffer_class_len[i]);
+	if (buf != NULL)
+		*out_len = ssl_buffer_class_len[i];
+
+	return buf;
+}
+
+void
+ssl_buffer_put(SSL_CTX *ctx, uint8_t *buf, size_t len)
+{
+	struct ssl_buffer_class *class;
+	struct ssl_buffer_pool *pool;
+	int i;
+
+	if (buf == NULL)
+		return;
+
+	explicit_bzero(buf, len);
+
+	if (ctx != NULL && (pool = ctx->internal->buffer_pool) != NULL &&
+	    (i = ssl_buffer_class(len)) != -1 &&
+	    len == ssl_buffer_class_len[i]) {
+		class = &pool->classes[i];
+		pthread_mutex_lock(&pool->lock);
+		if (class->num < pool->max) {
+			class->bufs[class->num++] = buf;
+			buf = NULL;
+		}
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	free(buf);
+}
+
+int
+ssl_buffer_pool_set_size(SSL_CTX *ctx, size_t max)
+{
+	struct ssl_buffer_class *class;
+	struct ssl_buffer_pool *pool;
+	uint8_t **bufs;
+	int i;
+
+	if ((pool = ctx->internal->buffer_pool) == NULL) {
+		if (max == 0)
+			return 1;
+		if ((pool = calloc(1, sizeof(*pool))) == NULL)
+			return 0;
+		if (pthread_mutex_init(&pool->lock, NULL) != 0) {
+			free(pool);
+			return 0;
+		}
+		ctx->internal->buffer_pool = pool;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	for (i = 0; i < SSL_BUFFER_POOL_CLASSES; i++) {
+		class = &pool->classes[i];
+		while (class->num > max)
+			free(class->bufs[--class->num]);
+		if (max > pool->max) {
+			if ((bufs = reallocarray(class->bufs, max,
+			    sizeof(*bufs))) == NULL) {
+				pthread_mutex_unlock(&pool->lock);
+				return 0;
+			}
+			class->bufs = bufs;
+		}
+	}
+	pool->max = max;
+	pthread_mutex_unlock(&pool->lock);
+
+	return 1;
+}
+
+size_t
+ssl_buffer_pool_size(const SSL_CTX *ctx)
+{
+	struct ssl_buffer_pool *pool;
+	size_t max;
+
+	if ((pool = ctx->internal->buffer_pool) == NULL)
+		return 0;
+
+	pthread_mutex_lock(&pool->lock);
+	max = pool->max;
+	pthread_mutex_unlock(&pool->lock);
+
+	return max;
+}
+
+void
+ssl_buffer_pool_free(SSL_CTX *ctx)
+{
+	struct ssl_buffer_class *class;
+	struct ssl_buffer_pool *pool;
+	int i;
+
+	if ((pool = ctx->internal->buffer_pool) == NULL)
+		return;
+
+	for (i = 0; i < SSL_BUFFER_POOL_CLASSES; i++) {
+		class = &pool->classes[i];
+		while (class->num > 0)
+			free(class->bufs[--class->num]);
+		free(class->bufs);
+	}
+	pthread_mutex_destroy(&pool->lock);
+	free(pool);
+
+	ctx->internal->buffer_pool = NULL;
+}
+
 int
 ssl3_setup_read_buffer(SSL *s)
 {
 	unsigned char *p;
 	size_t len, align, headerlen;
 
+	/* Allow for a connection ID and the inner content type. */
 	if (SSL_is_dtls(s))
-		headerlen = DTLS1_RT_HEADER_LENGTH;
+		headerlen = DTLS1_RT_HEADER_LENGTH + DTLS1_MAX_CID_LENGTH + 1;
 	else
 		headerlen = SSL3_RT_HEADER_LENGTH;
 
@@ -669,7 +965,7 @@ ssl3_setup_read_buffer(SSL *s)
 	if (S3I(s)->rbuf.buf == NULL) {
 		len = SSL3_RT_MAX_PLAIN_LENGTH +
 		    SSL3_RT_MAX_ENCRYPTED_OVERHEAD + headerlen + align;
-		if ((p = calloc(1, len)) == NULL)
+		if ((p = ssl_buffer_get(s->ctx, len, &len)) == NULL)
 			goto err;
 		S3I(s)->rbuf.buf = p;
 		S3I(s)->rbuf.len = len;
@@ -689,8 +985,10 @@ ssl3_setup_write_buffer(SSL *s)
 	unsigned char *p;
 	size_t len, align, headerlen;
 
+	/* See ssl3_setup_read_buffer(). */
 	if (SSL_is_dtls(s))
-		headerlen = DTLS1_RT_HEADER_LENGTH + 1;
+		headerlen = DTLS1_RT_HEADER_LENGTH + 1 +
+		    DTLS1_MAX_CID_LENGTH + 1;
 	else
 		headerlen = SSL3_RT_HEADER_LENGTH;
 
@@ -703,7 +1001,7 @@ ssl3_setup_write_buffer(SSL *s)
 			len += headerlen + align +
 			    SSL3_RT_SEND_MAX_ENCRYPTED_OVERHEAD;
 
-		if ((p = calloc(1, len)) == NULL)
+		if ((p = ssl_buffer_get(s->ctx, len, &len)) == NULL)
 			goto err;
 		S3I(s)->wbuf.buf = p;
 		S3I(s)->wbuf.len = len;
@@ -737,11 +1035,15 @@ ssl3_release_buffer(SSL3_BUFFER_INTERNAL *b)
 void
 ssl3_release_read_buffer(SSL *s)
 {
-	ssl3_release_buffer(&S3I(s)->rbuf);
+	ssl_buffer_put(s->ctx, S3I(s)->rbuf.buf, S3I(s)->rbuf.len);
+	S3I(s)->rbuf.buf = NULL;
+	S3I(s)->rbuf.len = 0;
 }
 
 void
 ssl3_release_write_buffer(SSL *s)
 {
-	ssl3_release_buffer(&S3I(s)->wbuf);
+	ssl_buffer_put(s->ctx, S3I(s)->wbuf.buf, S3I(s)->wbuf.len);
+	S3I(s)->wbuf.buf = NULL;
+	S3I(s)->wbuf.len = 0;
 }
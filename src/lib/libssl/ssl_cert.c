@@ -117,6 +117,7 @@
 #include <sys/types.h>
 
 #include <dirent.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <unistd.h>
 
@@ -126,9 +127,11 @@
 #include <openssl/objects.h>
 #include <openssl/opensslconf.h>
 #include <openssl/pem.h>
+#include <openssl/rsa.h>
 #include <openssl/x509v3.h>
 
 #include "ssl_locl.h"
+#include "ssl_sigalgs.h"
 
 int
 SSL_get_ex_data_X509_STORE_CTX_idx(void)
@@ -191,10 +194,6 @@ ssl_cert_dup(CERT *cert)
 	 */
 	ret->key = &ret->pkeys[cert->key - &cert->pkeys[0]];
 
-	ret->valid = cert->valid;
-	ret->mask_k = cert->mask_k;
-	ret->mask_a = cert->mask_a;
-
 	if (cert->dh_tmp != NULL) {
 		ret->dh_tmp = DHparams_dup(cert->dh_tmp);
 		if (ret->dh_tmp == NULL) {
@@ -305,11 +304,161 @@ ssl_cert_free(CERT *c)
 		X509_free(c->pkeys[i].x509);
 		EVP_PKEY_free(c->pkeys[i].privatekey);
 		sk_X509_pop_free(c->pkeys[i].chain, X509_free);
+		ssl_cert_pkey_flush(&c->pkeys[i]);
 	}
 
 	free(c);
 }
 
+static void
+ssl_sign_ctx_free(struct ssl_sign_ctx *sctx)
+{
+	if (sctx == NULL)
+		return;
+
+	EVP_PKEY_CTX_free(sctx->pctx);
+	free(sctx);
+}
+
+/*
+ * Discard the encoded certificate lists, the compressed Certificate message
+ * and the signing context, which must be done whenever the certificate or
+ * the chain of a CERT_PKEY is changed.
+ */
+void
+ssl_cert_pkey_flush(CERT_PKEY *cpk)
+{
+	size_t i;
+
+	for (i = 0; i < 2; i++) {
+		free(cpk->cert_list[i]);
+		cpk->cert_list[i] = NULL;
+		cpk->cert_list_len[i] = 0;
+		cpk->cert_list_leaf_len[i] = 0;
+	}
+
+	free(cpk->cert_comp);
+	cpk->cert_comp = NULL;
+	cpk->cert_comp_len = 0;
+	cpk->cert_comp_uncompressed_len = 0;
+	cpk->cert_comp_alg = 0;
+
+	ssl_sign_ctx_free(__atomic_exchange_n(&cpk->sign_ctx, NULL,
+	    __ATOMIC_ACQUIRE));
+}
+
+static struct ssl_sign_ctx *
+ssl_sign_ctx_new(EVP_PKEY *pkey, const struct ssl_sigalg *sigalg)
+{
+	struct ssl_sign_ctx *sctx;
+
+	if ((sctx = calloc(1, sizeof(*sctx))) == NULL)
+		return NULL;
+	sctx->sigalg = sigalg->value;
+
+	if ((sctx->pctx = EVP_PKEY_CTX_new(pkey, NULL)) == NULL)
+		goto err;
+	if (EVP_PKEY_sign_init(sctx->pctx) <= 0)
+		goto err;
+	if (EVP_PKEY_CTX_set_signature_md(sctx->pctx, sigalg->md()) <= 0)
+		goto err;
+	if ((sigalg->flags & SIGALG_FLAG_RSA_PSS) &&
+	    (!EVP_PKEY_CTX_set_rsa_padding(sctx->pctx, RSA_PKCS1_PSS_PADDING) ||
+	    !EVP_PKEY_CTX_set_rsa_pss_saltlen(sctx->pctx, -1)))
+		goto err;
+
+	return sctx;
+
+ err:
+	ssl_sign_ctx_free(sctx);
+
+	return NULL;
+}
+
+/*
+ * Return a signing context for the private key of cpk, set up for sigalg.
+ * The CERT_PKEY keeps the context of the last signature, which is taken
+ * over for the next one with the same algorithm, so that a server with a
+ * fixed key does not create and configure a context for every handshake.
+ * The context is only used by one signature at a time, since a CERT_PKEY
+ * is shared by all the SSLs of an SSL_CTX.
+ */
+struct ssl_sign_ctx *
+ssl_cert_pkey_sign_ctx(CERT_PKEY *cpk, const struct ssl_sigalg *sigalg)
+{
+	struct ssl_sign_ctx *sctx;
+
+	if (cpk->privatekey == NULL)
+		return NULL;
+
+	sctx = __atomic_exchange_n(&cpk->sign_ctx, NULL, __ATOMIC_ACQUIRE);
+	if (sctx != NULL && sctx->sigalg == sigalg->value &&
+	    EVP_PKEY_CTX_get0_pkey(sctx->pctx) == cpk->privatekey)
+		return sctx;
+	ssl_sign_ctx_free(sctx);
+
+	return ssl_sign_ctx_new(cpk->privatekey, sigalg);
+}
+
+/*
+ * Hand back a signing context once the signature is done. It is kept for
+ * the next signature if it may be reused and no other context was kept in
+ * the meantime.
+ */
+void
+ssl_cert_pkey_sign_ctx_done(CERT_PKEY *cpk, struct ssl_sign_ctx *sctx,
+    int reuse)
+{
+	struct ssl_sign_ctx *unused = NULL;
+
+	if (sctx == NULL)
+		return;
+
+	if (reuse && EVP_PKEY_CTX_get0_pkey(sctx->pctx) == cpk->privatekey &&
+	    __atomic_compare_exchange_n(&cpk->sign_ctx, &unused, sctx, 0,
+	    __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		return;
+
+	ssl_sign_ctx_free(sctx);
+}
+
+/*
+ * A CERT is shared by reference between an SSL_CTX and the SSLs created
+ * from it.  Anything that changes a CERT must first call this, which
+ * replaces a shared CERT with a private copy.
+ */
+int
+ssl_cert_unshare(CERT **certp)
+{
+	CERT *cert;
+
+	if (*certp == NULL)
+		return 0;
+	if ((*certp)->references == 1)
+		return 1;
+
+	if ((cert = ssl_cert_dup(*certp)) == NULL)
+		return 0;
+	ssl_cert_free(*certp);
+	*certp = cert;
+
+	return 1;
+}
+
+/*
+ * Take a reference to a CERT, in place of making a copy of it.
+ */
+CERT *
+ssl_cert_share(CERT *cert)
+{
+	if (cert == NULL)
+		return NULL;
+
+	CRYPTO_add(&cert->references, 1, CRYPTO_LOCK_SSL_CERT);
+
+	return cert;
+}
+
 int
 ssl_cert_set0_chain(CERT *c, STACK_OF(X509) *chain)
 {
@@ -318,6 +467,7 @@ ssl_cert_set0_chain(CERT *c, STACK_OF(X509) *chain)
 
 	sk_X509_pop_free(c->key->chain, X509_free);
 	c->key->chain = chain;
+	ssl_cert_pkey_flush(c->key);
 
 	return 1;
 }
@@ -351,6 +501,7 @@ ssl_cert_add0_chain_cert(CERT *c, X509 *cert)
 	}
 	if (!sk_X509_push(c->key->chain, cert))
 		return 0;
+	ssl_cert_pkey_flush(c->key);
 
 	return 1;
 }
@@ -405,22 +556,85 @@ ssl_sess_cert_free(SESS_CERT *sc)
 	free(sc);
 }
 
+/*
+ * Certificate chains are verified with an X509_STORE_CTX kept for the life
+ * of the calling thread, which keeps its verification parameters allocated
+ * from one verification to the next. It is taken from the thread while in
+ * use, in case a verify callback leads to another verification.
+ */
+static pthread_once_t ssl_verify_ctx_once = PTHREAD_ONCE_INIT;
+static pthread_key_t ssl_verify_ctx_key;
+static int ssl_verify_ctx_key_ok;
+
+static void
+ssl_verify_ctx_thread_free(void *arg)
+{
+	X509_STORE_CTX_free(arg);
+}
+
+static void
+ssl_verify_ctx_thread_init(void)
+{
+	if (pthread_key_create(&ssl_verify_ctx_key,
+	    ssl_verify_ctx_thread_free) == 0)
+		ssl_verify_ctx_key_ok = 1;
+}
+
+static X509_STORE_CTX *
+ssl_verify_ctx_get(void)
+{
+	X509_STORE_CTX *ctx;
+
+	if (pthread_once(&ssl_verify_ctx_once, ssl_verify_ctx_thread_init) != 0 ||
+	    !ssl_verify_ctx_key_ok)
+		return X509_STORE_CTX_new();
+
+	if ((ctx = pthread_getspecific(ssl_verify_ctx_key)) == NULL)
+		return X509_STORE_CTX_new();
+	if (pthread_setspecific(ssl_verify_ctx_key, NULL) != 0)
+		return X509_STORE_CTX_new();
+
+	return ctx;
+}
+
+static void
+ssl_verify_ctx_done(X509_STORE_CTX *ctx)
+{
+	if (ctx == NULL)
+		return;
+
+	X509_STORE_CTX_reset(ctx);
+
+	if (ssl_verify_ctx_key_ok &&
+	    pthread_getspecific(ssl_verify_ctx_key) == NULL &&
+	    pthread_setspecific(ssl_verify_ctx_key, ctx) == 0)
+		return;
+
+	X509_STORE_CTX_free(ctx);
+}
+
 int
 ssl_verify_cert_chain(SSL *s, STACK_OF(X509) *sk)
 {
-	X509_STORE_CTX ctx;
+	X509_STORE_CTX *ctx;
 	X509 *x;
 	int ret;
 
 	if ((sk == NULL) || (sk_X509_num(sk) == 0))
 		return (0);
 
+	if ((ctx = ssl_verify_ctx_get()) == NULL) {
+		SSLerror(s, ERR_R_MALLOC_FAILURE);
+		return (0);
+	}
+
 	x = sk_X509_value(sk, 0);
-	if (!X509_STORE_CTX_init(&ctx, s->ctx->cert_store, x, sk)) {
+	if (!X509_STORE_CTX_reinit(ctx, s->ctx->cert_store, x, sk)) {
 		SSLerror(s, ERR_R_X509_LIB);
+		ssl_verify_ctx_done(ctx);
 		return (0);
 	}
-	X509_STORE_CTX_set_ex_data(&ctx,
+	X509_STORE_CTX_set_ex_data(ctx,
 	    SSL_get_ex_data_X509_STORE_CTX_idx(), s);
 
 	/*
@@ -428,26 +642,26 @@ ssl_verify_cert_chain(SSL *s, STACK_OF(X509) *sk)
 	 * determined by the context: if its a server it will verify
 	 * SSL client certificates or vice versa.
 	 */
-	X509_STORE_CTX_set_default(&ctx,
+	X509_STORE_CTX_set_default(ctx,
 	    s->server ? "ssl_client" : "ssl_server");
 
 	/*
 	 * Anything non-default in "param" should overwrite anything
 	 * in the ctx.
 	 */
-	X509_VERIFY_PARAM_set1(X509_STORE_CTX_get0_param(&ctx), s->param);
+	X509_VERIFY_PARAM_set1(X509_STORE_CTX_get0_param(ctx), s->param);
 
 	if (s->internal->verify_callback)
-		X509_STORE_CTX_set_verify_cb(&ctx, s->internal->verify_callback);
+		X509_STORE_CTX_set_verify_cb(ctx, s->internal->verify_callback);
 
 	if (s->ctx->internal->app_verify_callback != NULL)
-		ret = s->ctx->internal->app_verify_callback(&ctx,
+		ret = s->ctx->internal->app_verify_callback(ctx,
 		    s->ctx->internal->app_verify_arg);
 	else
-		ret = X509_verify_cert(&ctx);
+		ret = X509_verify_cert(ctx);
 
-	s->verify_result = ctx.error;
-	X509_STORE_CTX_cleanup(&ctx);
+	s->verify_result = X509_STORE_CTX_get_error(ctx);
+	ssl_verify_ctx_done(ctx);
 
 	return (ret);
 }
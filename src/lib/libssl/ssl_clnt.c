@@ -571,8 +571,6 @@ ssl3_connect(SSL *s)
 
 		case SSL_ST_OK:
 			/* clean a few things up */
-			tls1_cleanup_key_block(s);
-
 			if (S3I(s)->handshake_transcript != NULL) {
 				SSLerror(s, ERR_R_INTERNAL_ERROR);
 				ret = -1;
@@ -584,6 +582,14 @@ ssl3_connect(SSL *s)
 
 			ssl_free_wbio_buffer(s);
 
+			/* The key block is still needed for kernel TLS. */
+			if (!ssl_ktls_start(s)) {
+				SSLerror(s, ERR_R_INTERNAL_ERROR);
+				ret = -1;
+				goto end;
+			}
+			tls1_cleanup_key_block(s);
+
 			s->internal->init_num = 0;
 			s->internal->renegotiate = 0;
 			s->internal->new_session = 0;
@@ -596,6 +602,7 @@ ssl3_connect(SSL *s)
 			/* s->server=0; */
 			s->internal->handshake_func = ssl3_connect;
 			s->ctx->internal->stats.sess_connect_good++;
+			ssl_stats_handshake_done(s);
 
 			if (cb != NULL)
 				cb(s, SSL_CB_HANDSHAKE_DONE, 1);
@@ -630,6 +637,8 @@ ssl3_connect(SSL *s)
 				S3I(s)->hs.state = new_state;
 			}
 		}
+		if (S3I(s)->hs.state != state)
+			ssl_trace_state(s);
 		skip = 0;
 	}
 
@@ -1423,6 +1432,7 @@ ssl3_get_server_kex_ecdhe(SSL *s, EVP_PKEY **pkey, CBS *cbs)
 		SSLerror(s, SSL_R_UNABLE_TO_FIND_ECDH_PARAMETERS);
 		goto fatal_err;
 	}
+	S3I(s)->hs.group = curve_id;
 
 	if (!CBS_get_u8_length_prefixed(cbs, &public))
 		goto decode_err;
@@ -1691,6 +1701,10 @@ ssl3_get_certificate_request(SSL *s)
 		if (!CBS_stow(&sigalgs, &S3I(s)->hs.sigalgs,
 		    &S3I(s)->hs.sigalgs_len))
 			goto err;
+
+		/* Our CertificateVerify only needs digests. */
+		if (!tls1_transcript_digests_init(s))
+			goto err;
 	}
 
 	/* get the CA RDNs */
@@ -2322,19 +2336,22 @@ ssl3_send_client_verify_sigalgs(SSL *s, EVP_PKEY *pkey,
 {
 	CBB cbb_signature;
 	EVP_PKEY_CTX *pctx = NULL;
-	EVP_MD_CTX mctx;
-	const unsigned char *hdata;
+	unsigned char digest[EVP_MAX_MD_SIZE];
 	unsigned char *signature = NULL;
-	size_t signature_len, hdata_len;
+	size_t signature_len, digest_len;
 	int ret = 0;
 
-	EVP_MD_CTX_init(&mctx);
-
-	if (!tls1_transcript_data(s, &hdata, &hdata_len)) {
+	if (!tls1_transcript_digest(s, sigalg->md(), digest, sizeof(digest),
+	    &digest_len)) {
 		SSLerror(s, ERR_R_INTERNAL_ERROR);
 		goto err;
 	}
-	if (!EVP_DigestSignInit(&mctx, &pctx, sigalg->md(), NULL, pkey)) {
+	if ((pctx = EVP_PKEY_CTX_new(pkey, NULL)) == NULL) {
+		SSLerror(s, ERR_R_EVP_LIB);
+		goto err;
+	}
+	if (EVP_PKEY_sign_init(pctx) <= 0 ||
+	    EVP_PKEY_CTX_set_signature_md(pctx, sigalg->md()) <= 0) {
 		SSLerror(s, ERR_R_EVP_LIB);
 		goto err;
 	}
@@ -2350,12 +2367,8 @@ ssl3_send_client_verify_sigalgs(SSL *s, EVP_PKEY *pkey,
 		SSLerror(s, ERR_R_EVP_LIB);
 		goto err;
 	}
-	if (!EVP_DigestSignUpdate(&mctx, hdata, hdata_len)) {
-		SSLerror(s, ERR_R_EVP_LIB);
-		goto err;
-	}
-	if (!EVP_DigestSignFinal(&mctx, NULL, &signature_len) ||
-	    signature_len == 0) {
+	if (EVP_PKEY_sign(pctx, NULL, &signature_len, digest,
+	    digest_len) <= 0 || signature_len == 0) {
 		SSLerror(s, ERR_R_EVP_LIB);
 		goto err;
 	}
@@ -2363,7 +2376,8 @@ ssl3_send_client_verify_sigalgs(SSL *s, EVP_PKEY *pkey,
 		SSLerror(s, ERR_R_MALLOC_FAILURE);
 		goto err;
 	}
-	if (!EVP_DigestSignFinal(&mctx, signature, &signature_len)) {
+	if (EVP_PKEY_sign(pctx, signature, &signature_len, digest,
+	    digest_len) <= 0) {
 		SSLerror(s, ERR_R_EVP_LIB);
 		goto err;
 	}
@@ -2380,7 +2394,7 @@ ssl3_send_client_verify_sigalgs(SSL *s, EVP_PKEY *pkey,
 	ret = 1;
 
  err:
-	EVP_MD_CTX_cleanup(&mctx);
+	EVP_PKEY_CTX_free(pctx);
 	free(signature);
 	return ret;
 }
@@ -0,0 +1,336 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Standalone ClientHello parser.
+ *
+ * This allows the first flight from a client to be inspected, for instance
+ * to select a backend based on the server name or ALPN protocols, without
+ * an SSL_CTX or SSL. Nothing is allocated - everything that is returned
+ * points into the caller's buffer.
+ */
+
+#include <string.h>
+
+#include <openssl/ssl.h>
+
+#include "bytestring.h"
+#include "ssl_tlsext.h"
+
+#define SSL_HELLO_SEEN_SNI		0x01
+#define SSL_HELLO_SEEN_GROUPS		0x02
+#define SSL_HELLO_SEEN_ALPN		0x04
+#define SSL_HELLO_SEEN_VERSIONS		0x08
+#define SSL_HELLO_SEEN_KEY_SHARE	0x10
+
+/* RFC 8701 reserves values of the form 0x?a?a, with both nibbles equal. */
+static int
+ssl_hello_is_grease(uint16_t value)
+{
+	return (value & 0x0f0f) == 0x0a0a && (value >> 8) == (value & 0xff);
+}
+
+static int
+ssl_hello_parse_sni(CBS *cbs, SSL_CLIENT_HELLO *ch)
+{
+	CBS server_name_list, host_name;
+	uint8_t name_type;
+
+	if (!CBS_get_u16_length_prefixed(cbs, &server_name_list))
+		return 0;
+	if (!CBS_get_u8(&server_name_list, &name_type))
+		return 0;
+	if (name_type != TLSEXT_NAMETYPE_host_name)
+		return 0;
+	if (!CBS_get_u16_length_prefixed(&server_name_list, &host_name))
+		return 0;
+	if (CBS_len(&host_name) < 1)
+		return 0;
+	if (!tlsext_sni_is_valid_hostname(&host_name))
+		return 0;
+	if (CBS_len(cbs) != 0)
+		return 0;
+
+	ch->servername = CBS_data(&host_name);
+	ch->servername_len = CBS_len(&host_name);
+
+	return 1;
+}
+
+static int
+ssl_hello_parse_alpn(CBS *cbs, SSL_CLIENT_HELLO *ch)
+{
+	CBS proto_name_list, alpn, proto_name;
+
+	if (!CBS_get_u16_length_prefixed(cbs, &alpn))
+		return 0;
+	if (CBS_len(&alpn) < 2)
+		return 0;
+	if (CBS_len(cbs) != 0)
+		return 0;
+
+	CBS_dup(&alpn, &proto_name_list);
+	while (CBS_len(&proto_name_list) > 0) {
+		if (!CBS_get_u8_length_prefixed(&proto_name_list, &proto_name))
+			return 0;
+		if (CBS_len(&proto_name) == 0)
+			return 0;
+	}
+
+	ch->alpn = CBS_data(&alpn);
+	ch->alpn_len = CBS_len(&alpn);
+
+	return 1;
+}
+
+static int
+ssl_hello_parse_supported_groups(CBS *cbs, SSL_CLIENT_HELLO *ch)
+{
+	CBS grouplist;
+
+	if (!CBS_get_u16_length_prefixed(cbs, &grouplist))
+		return 0;
+	if (CBS_len(cbs) != 0)
+		return 0;
+	if (CBS_len(&grouplist) == 0 || CBS_len(&grouplist) % 2 != 0)
+		return 0;
+
+	ch->supported_groups = CBS_data(&grouplist);
+	ch->supported_groups_len = CBS_len(&grouplist);
+
+	return 1;
+}
+
+static int
+ssl_hello_parse_versions(CBS *cbs, SSL_CLIENT_HELLO *ch)
+{
+	CBS versions;
+	uint16_t version;
+	uint16_t max = 0;
+
+	if (!CBS_get_u8_length_prefixed(cbs, &versions))
+		return 0;
+	if (CBS_len(cbs) != 0)
+		return 0;
+	if (CBS_len(&versions) == 0 || CBS_len(&versions) % 2 != 0)
+		return 0;
+
+	while (CBS_len(&versions) > 0) {
+		if (!CBS_get_u16(&versions, &version))
+			return 0;
+		if (ssl_hello_is_grease(version))
+			continue;
+		if (version > max)
+			max = version;
+	}
+	if (max != 0)
+		ch->version = max;
+
+	return 1;
+}
+
+static int
+ssl_hello_parse_key_share(CBS *cbs, SSL_CLIENT_HELLO *ch)
+{
+	CBS client_shares, key_exchange;
+	uint16_t group;
+
+	if (!CBS_get_u16_length_prefixed(cbs, &client_shares))
+		return 0;
+	if (CBS_len(cbs) != 0)
+		return 0;
+
+	ch->key_shares = CBS_data(&client_shares);
+	ch->key_shares_len = CBS_len(&client_shares);
+
+	while (CBS_len(&client_shares) > 0) {
+		if (!CBS_get_u16(&client_shares, &group))
+			return 0;
+		if (!CBS_get_u16_length_prefixed(&client_shares, &key_exchange))
+			return 0;
+		if (CBS_len(&key_exchange) == 0)
+			return 0;
+		if (ssl_hello_is_grease(group))
+			continue;
+		if (ch->num_key_share_groups >= SSL_CLIENT_HELLO_MAX_KEY_SHARES)
+			continue;
+		ch->key_share_groups[ch->num_key_share_groups++] = group;
+	}
+
+	return 1;
+}
+
+static int
+ssl_hello_parse_extensions(CBS *cbs, SSL_CLIENT_HELLO *ch)
+{
+	CBS extensions, extension_data;
+	uint16_t type;
+	int seen = 0, bit;
+	int ret;
+
+	if (!CBS_get_u16_length_prefixed(cbs, &extensions))
+		return 0;
+
+	ch->extensions = CBS_data(&extensions);
+	ch->extensions_len = CBS_len(&extensions);
+
+	while (CBS_len(&extensions) > 0) {
+		if (!CBS_get_u16(&extensions, &type))
+			return 0;
+		if (!CBS_get_u16_length_prefixed(&extensions, &extension_data))
+			return 0;
+
+		switch (type) {
+		case TLSEXT_TYPE_server_name:
+			bit = SSL_HELLO_SEEN_SNI;
+			ret = ssl_hello_parse_sni(&extension_data, ch);
+			break;
+		case TLSEXT_TYPE_supported_groups:
+			bit = SSL_HELLO_SEEN_GROUPS;
+			ret = ssl_hello_parse_supported_groups(&extension_data,
+			    ch);
+			break;
+		case TLSEXT_TYPE_application_layer_protocol_negotiation:
+			bit = SSL_HELLO_SEEN_ALPN;
+			ret = ssl_hello_parse_alpn(&extension_data, ch);
+			break;
+		case TLSEXT_TYPE_supported_versions:
+			bit = SSL_HELLO_SEEN_VERSIONS;
+			ret = ssl_hello_parse_versions(&extension_data, ch);
+			break;
+		case TLSEXT_TYPE_key_share:
+			bit = SSL_HELLO_SEEN_KEY_SHARE;
+			ret = ssl_hello_parse_key_share(&extension_data, ch);
+			break;
+		default:
+			continue;
+		}
+
+		/* RFC 8446 section 4.2 - duplicates are not permitted. */
+		if ((seen & bit) != 0)
+			return 0;
+		seen |= bit;
+
+		if (!ret)
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Parse a ClientHello, either as a handshake message or as the TLS record
+ * that carries one. Returns 1 on success, 0 if data does not contain a valid
+ * ClientHello and -1 if more data is needed to tell.
+ */
+int
+SSL_client_hello_parse(const uint8_t *data, size_t len, SSL_CLIENT_HELLO *ch)
+{
+	CBS cbs, record, body, random, session_id, cipher_suites;
+	CBS compression_methods;
+	uint16_t record_version, record_len;
+	uint8_t content_type, msg_type;
+	uint32_t msg_len;
+
+	memset(ch, 0, sizeof(*ch));
+
+	CBS_init(&cbs, data, len);
+
+	/*
+	 * A handshake record starts with a content type of 22, where a
+	 * handshake message starts with a ClientHello type of 1.
+	 */
+	if (CBS_len(&cbs) < 1)
+		return -1;
+	content_type = CBS_data(&cbs)[0];
+	if (content_type == SSL3_RT_HANDSHAKE) {
+		if (CBS_len(&cbs) < SSL3_RT_HEADER_LENGTH)
+			return -1;
+		if (!CBS_skip(&cbs, 1))
+			return 0;
+		if (!CBS_get_u16(&cbs, &record_version))
+			return 0;
+		if ((record_version >> 8) != SSL3_VERSION_MAJOR)
+			return 0;
+		if (!CBS_get_u16(&cbs, &record_len))
+			return 0;
+		if (record_len > SSL3_RT_MAX_PLAIN_LENGTH)
+			return 0;
+		if (CBS_len(&cbs) < record_len)
+			return -1;
+		if (!CBS_get_bytes(&cbs, &record, record_len))
+			return 0;
+		cbs = record;
+	}
+
+	if (CBS_len(&cbs) < SSL3_HM_HEADER_LENGTH)
+		return content_type == SSL3_RT_HANDSHAKE ? 0 : -1;
+	if (!CBS_get_u8(&cbs, &msg_type))
+		return 0;
+	if (msg_type != SSL3_MT_CLIENT_HELLO)
+		return 0;
+	if (!CBS_get_u24(&cbs, &msg_len))
+		return 0;
+	if (msg_len > SSL3_RT_MAX_PLAIN_LENGTH - SSL3_HM_HEADER_LENGTH)
+		return 0;
+	if (CBS_len(&cbs) < msg_len) {
+		/*
+		 * A ClientHello that spans more than one record cannot be
+		 * parsed in place.
+		 */
+		return content_type == SSL3_RT_HANDSHAKE ? 0 : -1;
+	}
+	if (!CBS_get_bytes(&cbs, &body, msg_len))
+		return 0;
+	if (CBS_len(&cbs) != 0)
+		return 0;
+
+	if (!CBS_get_u16(&body, &ch->legacy_version))
+		return 0;
+	if ((ch->legacy_version >> 8) != SSL3_VERSION_MAJOR)
+		return 0;
+	ch->version = ch->legacy_version;
+	if (!CBS_get_bytes(&body, &random, SSL3_RANDOM_SIZE))
+		return 0;
+	ch->random = CBS_data(&random);
+	if (!CBS_get_u8_length_prefixed(&body, &session_id))
+		return 0;
+	if (CBS_len(&session_id) > SSL3_SESSION_ID_SIZE)
+		return 0;
+	ch->session_id = CBS_data(&session_id);
+	ch->session_id_len = CBS_len(&session_id);
+	if (!CBS_get_u16_length_prefixed(&body, &cipher_suites))
+		return 0;
+	if (CBS_len(&cipher_suites) < 2 || CBS_len(&cipher_suites) % 2 != 0)
+		return 0;
+	ch->cipher_suites = CBS_data(&cipher_suites);
+	ch->cipher_suites_len = CBS_len(&cipher_suites);
+	if (!CBS_get_u8_length_prefixed(&body, &compression_methods))
+		return 0;
+	if (CBS_len(&compression_methods) < 1)
+		return 0;
+
+	/* Extensions are optional before TLSv1.3. */
+	if (CBS_len(&body) == 0)
+		return 1;
+	if (!ssl_hello_parse_extensions(&body, ch))
+		return 0;
+	if (CBS_len(&body) != 0)
+		return 0;
+
+	return 1;
+}
@@ -0,0 +1,309 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Kernel TLS offload.
+ *
+ * With SSL_OP_ENABLE_KTLS, once a TLSv1.2 or TLSv1.3 handshake has completed
+ * with an AES-GCM or ChaCha20-Poly1305 cipher suite, the traffic keys and
+ * sequence numbers are handed to the kernel through the socket BIO, one
+ * direction at a time.  The record layer then passes records through in the
+ * clear and the kernel encrypts and decrypts them.  A direction that cannot
+ * be offloaded stays in user space.
+ */
+
+#include <sys/types.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <linux/tls.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+
+#include <openssl/bio.h>
+
+#include "bytestring.h"
+#include "ssl_locl.h"
+#include "tls13_internal.h"
+
+#ifdef __linux__
+union ssl_ktls_crypto_info {
+	struct tls_crypto_info info;
+	struct tls12_crypto_info_aes_gcm_128 aes_gcm_128;
+	struct tls12_crypto_info_aes_gcm_256 aes_gcm_256;
+	struct tls12_crypto_info_chacha20_poly1305 chacha20_poly1305;
+};
+
+static int
+ssl_ktls_copy(CBS *cbs, uint8_t *out, size_t out_len)
+{
+	if (CBS_len(cbs) != out_len)
+		return 0;
+	memcpy(out, CBS_data(cbs), out_len);
+
+	return 1;
+}
+
+/*
+ * With AES-GCM the kernel builds the nonce from a four byte salt and an
+ * eight byte IV.  In TLSv1.2 the salt is the fixed IV from the key block and
+ * the explicit part of the nonce is the sequence number.  In TLSv1.3 the
+ * twelve byte IV is split in two.
+ */
+static int
+ssl_ktls_gcm_nonce(uint16_t version, CBS *iv, CBS *seq_num, CBS *salt,
+    CBS *nonce)
+{
+	if (version == TLS1_2_VERSION) {
+		CBS_dup(iv, salt);
+		CBS_dup(seq_num, nonce);
+		return 1;
+	}
+
+	CBS_dup(iv, nonce);
+	return CBS_get_bytes(nonce, salt, TLS_CIPHER_AES_GCM_128_SALT_SIZE);
+}
+
+static int
+ssl_ktls_crypto_info(uint16_t version, const EVP_AEAD *aead, CBS *key,
+    CBS *iv, CBS *seq_num, union ssl_ktls_crypto_info *ci)
+{
+	struct tls12_crypto_info_aes_gcm_128 *gcm128;
+	struct tls12_crypto_info_aes_gcm_256 *gcm256;
+	struct tls12_crypto_info_chacha20_poly1305 *chacha;
+	CBS salt, nonce;
+
+	memset(ci, 0, sizeof(*ci));
+
+	if (version == TLS1_2_VERSION)
+		ci->info.version = TLS_1_2_VERSION;
+	else if (version == TLS1_3_VERSION)
+		ci->info.version = TLS_1_3_VERSION;
+	else
+		return 0;
+
+	if (aead == EVP_aead_aes_128_gcm()) {
+		gcm128 = &ci->aes_gcm_128;
+		gcm128->info.cipher_type = TLS_CIPHER_AES_GCM_128;
+		if (!ssl_ktls_gcm_nonce(version, iv, seq_num, &salt, &nonce))
+			return 0;
+		if (!ssl_ktls_copy(key, gcm128->key, sizeof(gcm128->key)))
+			return 0;
+		if (!ssl_ktls_copy(&salt, gcm128->salt, sizeof(gcm128->salt)))
+			return 0;
+		if (!ssl_ktls_copy(&nonce, gcm128->iv, sizeof(gcm128->iv)))
+			return 0;
+		return ssl_ktls_copy(seq_num, gcm128->rec_seq,
+		    sizeof(gcm128->rec_seq));
+	}
+	if (aead == EVP_aead_aes_256_gcm()) {
+		gcm256 = &ci->aes_gcm_256;
+		gcm256->info.cipher_type = TLS_CIPHER_AES_GCM_256;
+		if (!ssl_ktls_gcm_nonce(version, iv, seq_num, &salt, &nonce))
+			return 0;
+		if (!ssl_ktls_copy(key, gcm256->key, sizeof(gcm256->key)))
+			return 0;
+		if (!ssl_ktls_copy(&salt, gcm256->salt, sizeof(gcm256->salt)))
+			return 0;
+		if (!ssl_ktls_copy(&nonce, gcm256->iv, sizeof(gcm256->iv)))
+			return 0;
+		return ssl_ktls_copy(seq_num, gcm256->rec_seq,
+		    sizeof(gcm256->rec_seq));
+	}
+	if (aead == EVP_aead_chacha20_poly1305()) {
+		chacha = &ci->chacha20_poly1305;
+		chacha->info.cipher_type = TLS_CIPHER_CHACHA20_POLY1305;
+		if (!ssl_ktls_copy(key, chacha->key, sizeof(chacha->key)))
+			return 0;
+		if (!ssl_ktls_copy(iv, chacha->iv, sizeof(chacha->iv)))
+			return 0;
+		return ssl_ktls_copy(seq_num, chacha->rec_seq,
+		    sizeof(chacha->rec_seq));
+	}
+
+	return 0;
+}
+#endif
+
+static int
+ssl_ktls_start_bio(BIO *bio, int is_write, uint16_t version,
+    const EVP_AEAD *aead, CBS *key, CBS *iv, CBS *seq_num)
+{
+#ifdef __linux__
+	union ssl_ktls_crypto_info ci;
+	int ret = 0;
+
+	if (bio == NULL || BIO_method_type(bio) != BIO_TYPE_SOCKET)
+		return 0;
+
+	if (ssl_ktls_crypto_info(version, aead, key, iv, seq_num, &ci))
+		ret = BIO_set_ktls(bio, &ci, is_write) > 0;
+
+	explicit_bzero(&ci, sizeof(ci));
+
+	return ret;
+#else
+	return 0;
+#endif
+}
+
+static int
+ssl_ktls_start_tls12(SSL *s)
+{
+	struct tls12_key_block *kb = S3I(s)->hs.tls12.key_block;
+	const EVP_AEAD *aead;
+	CBS mac_key, key, iv, seq_num;
+	int is_write;
+
+	if (kb == NULL)
+		return 1;
+	if (!ssl_cipher_get_evp_aead(s->session, &aead) || aead == NULL)
+		return 1;
+
+	for (is_write = 0; is_write <= 1; is_write++) {
+		/* Anything the record layer still holds must go first. */
+		if (is_write && S3I(s)->wbuf.left != 0)
+			continue;
+		if (!is_write &&
+		    (S3I(s)->rbuf.left != 0 || S3I(s)->rrec.length != 0))
+			continue;
+
+		if (s->server != is_write)
+			tls12_key_block_client_write(kb, &mac_key, &key, &iv);
+		else
+			tls12_key_block_server_write(kb, &mac_key, &key, &iv);
+		tls12_record_layer_seq_num(s->internal->rl, is_write, &seq_num);
+
+		if (!ssl_ktls_start_bio(is_write ? s->wbio : s->rbio, is_write,
+		    TLS1_2_VERSION, aead, &key, &iv, &seq_num))
+			continue;
+
+		/* The kernel now has the keys, so there is no way back. */
+		if (!tls12_record_layer_use_ktls(s->internal->rl, is_write))
+			return 0;
+	}
+
+	return 1;
+}
+
+static void
+ssl_ktls_start_tls13(SSL *s)
+{
+	struct tls13_ctx *ctx = s->internal->tls13;
+	struct tls13_secret context = { .data = "", .len = 0 };
+	struct tls13_secret key = { .data = NULL, .len = 0 };
+	struct tls13_secret iv = { .data = NULL, .len = 0 };
+	struct tls13_secrets *secrets;
+	struct tls13_secret *traffic;
+	CBS key_cbs, iv_cbs, seq_num;
+	int is_write;
+
+	if (ctx == NULL || !ctx->handshake_completed)
+		return;
+	if ((secrets = ctx->hs->tls13.secrets) == NULL)
+		return;
+
+	for (is_write = 0; is_write <= 1; is_write++) {
+		if (!tls13_record_layer_ktls_seq_num(ctx->rl, is_write,
+		    &seq_num))
+			continue;
+
+		if (s->server != is_write)
+			traffic = &secrets->client_application_traffic;
+		else
+			traffic = &secrets->server_application_traffic;
+
+		if (!tls13_secret_init(&key, EVP_AEAD_key_length(ctx->aead)))
+			goto err;
+		if (!tls13_secret_init(&iv, EVP_AEAD_nonce_length(ctx->aead)))
+			goto err;
+		if (!tls13_hkdf_expand_label(&key, ctx->hash, traffic, "key",
+		    &context))
+			goto err;
+		if (!tls13_hkdf_expand_label(&iv, ctx->hash, traffic, "iv",
+		    &context))
+			goto err;
+
+		CBS_init(&key_cbs, key.data, key.len);
+		CBS_init(&iv_cbs, iv.data, iv.len);
+		if (ssl_ktls_start_bio(is_write ? s->wbio : s->rbio, is_write,
+		    TLS1_3_VERSION, ctx->aead, &key_cbs, &iv_cbs, &seq_num))
+			tls13_record_layer_use_ktls(ctx->rl, is_write);
+
+		tls13_secret_cleanup(&key);
+		tls13_secret_cleanup(&iv);
+	}
+
+ err:
+	tls13_secret_cleanup(&key);
+	tls13_secret_cleanup(&iv);
+}
+
+/*
+ * Called once a handshake has completed.  A direction that cannot be
+ * offloaded is left as it was, with the records protected in user space.
+ * Zero is only returned if the kernel took the keys and the record layer
+ * could not follow.
+ */
+int
+ssl_ktls_start(SSL *s)
+{
+	if ((s->internal->options & SSL_OP_ENABLE_KTLS) == 0)
+		return 1;
+	if (SSL_is_dtls(s))
+		return 1;
+
+	if (S3I(s)->hs.negotiated_tls_version == TLS1_3_VERSION)
+		ssl_ktls_start_tls13(s);
+	else if (S3I(s)->hs.negotiated_tls_version == TLS1_2_VERSION)
+		return ssl_ktls_start_tls12(s);
+
+	return 1;
+}
+
+ssize_t
+ssl_ktls_sendfile(SSL *s, int fd, off_t offset, size_t size, int flags)
+{
+#ifdef __linux__
+	ssize_t ret;
+	int sock;
+
+	if (BIO_get_fd(s->wbio, &sock) < 0) {
+		SSLerror(s, SSL_R_UNINITIALIZED);
+		return -1;
+	}
+
+	s->internal->rwstate = SSL_WRITING;
+	BIO_clear_retry_flags(s->wbio);
+
+	if ((ret = sendfile(sock, fd, &offset, size)) < 0) {
+		if (BIO_sock_should_retry(ret))
+			BIO_set_retry_write(s->wbio);
+		else
+			SYSerror(errno);
+		return -1;
+	}
+
+	s->internal->rwstate = SSL_NOTHING;
+
+	return ret;
+#else
+	SSLerror(s, SSL_R_UNINITIALIZED);
+	return -1;
+#endif
+}
@@ -142,11 +142,15 @@
 
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 
+#include <limits.h>
 #include <stdio.h>
 
 #include <openssl/bn.h>
+#include <openssl/curve25519.h>
 #include <openssl/dh.h>
 #include <openssl/lhash.h>
 #include <openssl/objects.h>
@@ -265,8 +269,8 @@ SSL_new(SSL_CTX *ctx)
 	s->internal->mode = ctx->internal->mode;
 	s->internal->max_cert_list = ctx->internal->max_cert_list;
 
-	if ((s->cert = ssl_cert_dup(ctx->internal->cert)) == NULL)
-		goto err;
+	/* The CERT is copied if either side changes it. */
+	s->cert = ssl_cert_share(ctx->internal->cert);
 
 	s->internal->read_ahead = ctx->internal->read_ahead;
 	s->internal->msg_callback = ctx->internal->msg_callback;
@@ -277,6 +281,9 @@ SSL_new(SSL_CTX *ctx)
 	memcpy(&s->sid_ctx, &ctx->sid_ctx, sizeof(s->sid_ctx));
 	s->internal->verify_callback = ctx->internal->default_verify_callback;
 	s->internal->generate_session_id = ctx->internal->generate_session_id;
+	s->internal->private_key_method = ctx->internal->private_key_method;
+	s->internal->handshake_trace_cb = ctx->internal->handshake_trace_cb;
+	s->internal->handshake_trace_arg = ctx->internal->handshake_trace_arg;
 
 	s->param = X509_VERIFY_PARAM_new();
 	if (!s->param)
@@ -284,6 +291,7 @@ SSL_new(SSL_CTX *ctx)
 	X509_VERIFY_PARAM_inherit(s->param, ctx->param);
 	s->internal->quiet_shutdown = ctx->internal->quiet_shutdown;
 	s->max_send_fragment = ctx->internal->max_send_fragment;
+	s->internal->max_early_data = ctx->internal->max_early_data;
 
 	CRYPTO_add(&ctx->references, 1, CRYPTO_LOCK_SSL_CTX);
 	s->ctx = ctx;
@@ -426,9 +434,7 @@ SSL_has_matching_session_id(const SSL *ssl, const unsigned char *id,
 	r.session_id_length = id_len;
 	memcpy(r.session_id, id, id_len);
 
-	CRYPTO_r_lock(CRYPTO_LOCK_SSL_CTX);
-	p = lh_SSL_SESSION_retrieve(ssl->ctx->internal->sessions, &r);
-	CRYPTO_r_unlock(CRYPTO_LOCK_SSL_CTX);
+	p = ssl_session_cache_retrieve(ssl->ctx, &r, 0);
 	return (p != NULL);
 }
 
@@ -522,6 +528,8 @@ SSL_free(SSL *s)
 
 	CRYPTO_free_ex_data(CRYPTO_EX_INDEX_SSL, s, &s->internal->ex_data);
 
+	ssl_zerocopy_free(s);
+
 	if (s->bbio != NULL) {
 		/* If the buffering BIO is in place, pop it off */
 		if (s->bbio == s->wbio) {
@@ -600,6 +608,9 @@ SSL_set_bio(SSL *s, BIO *rbio, BIO *wbio)
 		}
 	}
 
+	if (s->wbio != wbio)
+		ssl_zerocopy_free(s);
+
 	if (s->rbio != rbio && s->rbio != s->wbio)
 		BIO_free_all(s->rbio);
 	if (s->wbio != wbio)
@@ -933,7 +944,7 @@ SSL_accept(SSL *s)
 	if (s->internal->handshake_func == NULL)
 		SSL_set_accept_state(s); /* Not properly initialized yet */
 
-	return (s->method->ssl_accept(s));
+	return (ssl_stats_handshake(s, s->method->ssl_accept));
 }
 
 int
@@ -942,7 +953,7 @@ SSL_connect(SSL *s)
 	if (s->internal->handshake_func == NULL)
 		SSL_set_connect_state(s); /* Not properly initialized yet */
 
-	return (s->method->ssl_connect(s));
+	return (ssl_stats_handshake(s, s->method->ssl_connect));
 }
 
 int
@@ -1018,34 +1029,126 @@ SSL_write(SSL *s, const void *buf, int num)
 	return ssl3_write(s, buf, num);
 }
 
+int
+SSL_writev(SSL *s, const struct iovec *iov, int iovcnt)
+{
+	size_t len = 0;
+	int i, ret, sent = 0;
+
+	if (s->internal->handshake_func == NULL) {
+		SSLerror(s, SSL_R_UNINITIALIZED);
+		return (-1);
+	}
+
+	if (s->internal->shutdown & SSL_SENT_SHUTDOWN) {
+		s->internal->rwstate = SSL_NOTHING;
+		SSLerror(s, SSL_R_PROTOCOL_IS_SHUTDOWN);
+		return (-1);
+	}
+
+	if (iovcnt < 0 || iovcnt > IOV_MAX) {
+		SSLerror(s, SSL_R_BAD_LENGTH);
+		return (-1);
+	}
+	for (i = 0; i < iovcnt; i++) {
+		if (iov[i].iov_len > INT_MAX - len) {
+			SSLerror(s, SSL_R_BAD_LENGTH);
+			return (-1);
+		}
+		len += iov[i].iov_len;
+	}
+
+	if (s->method->ssl_writev != NULL)
+		return s->method->ssl_writev(s, iov, iovcnt);
+
+	/* Otherwise write out each piece in turn. */
+	for (i = 0; i < iovcnt; i++) {
+		if (iov[i].iov_len == 0)
+			continue;
+		if ((ret = ssl3_write(s, iov[i].iov_base,
+		    iov[i].iov_len)) <= 0)
+			return (sent > 0 ? sent : ret);
+		sent += ret;
+		if (ret < iov[i].iov_len)
+			break;
+	}
+
+	return (sent);
+}
+
+int
+SSL_flush(SSL *s)
+{
+	if (s->method->ssl_flush == NULL)
+		return (1);
+
+	return s->method->ssl_flush(s);
+}
+
+ssize_t
+SSL_sendfile(SSL *s, int fd, off_t offset, size_t size, int flags)
+{
+	int ret;
+
+	if (s->internal->handshake_func == NULL) {
+		SSLerror(s, SSL_R_UNINITIALIZED);
+		return (-1);
+	}
+
+	if (s->internal->shutdown & SSL_SENT_SHUTDOWN) {
+		s->internal->rwstate = SSL_NOTHING;
+		SSLerror(s, SSL_R_PROTOCOL_IS_SHUTDOWN);
+		return (-1);
+	}
+
+	/* The file goes straight to the socket, so the kernel must seal it. */
+	if (s->wbio == NULL || !BIO_get_ktls_send(s->wbio)) {
+		SSLerror(s, SSL_R_UNINITIALIZED);
+		return (-1);
+	}
+
+	/* Data from earlier writes has to go out first. */
+	if ((ret = SSL_flush(s)) <= 0)
+		return (ret);
+	if (S3I(s)->wbuf.left != 0 || (s->internal->tls13 != NULL &&
+	    tls13_record_layer_write_pending(s->internal->tls13->rl))) {
+		SSLerror(s, SSL_R_BAD_WRITE_RETRY);
+		return (-1);
+	}
+
+	return ssl_ktls_sendfile(s, fd, offset, size, flags);
+}
+
 uint32_t
 SSL_CTX_get_max_early_data(const SSL_CTX *ctx)
 {
-	return 0;
+	return ctx->internal->max_early_data;
 }
 
 int
 SSL_CTX_set_max_early_data(SSL_CTX *ctx, uint32_t max_early_data)
 {
+	ctx->internal->max_early_data = max_early_data;
 	return 1;
 }
 
 uint32_t
 SSL_get_max_early_data(const SSL *s)
 {
-	return 0;
+	return s->internal->max_early_data;
 }
 
 int
 SSL_set_max_early_data(SSL *s, uint32_t max_early_data)
 {
+	s->internal->max_early_data = max_early_data;
 	return 1;
 }
 
 int
 SSL_get_early_data_status(const SSL *s)
 {
-	return SSL_EARLY_DATA_REJECTED;
+	return S3I(s)->hs.tls13.early_data_status;
 }
 
 int
@@ -1058,7 +1161,14 @@ SSL_read_early_data(SSL *s, void *buf, size_t num, size_t *readbytes)
 		return SSL_READ_EARLY_DATA_ERROR;
 	}
 
-	return SSL_READ_EARLY_DATA_FINISH;
+	if (s->internal->handshake_func == NULL)
+		SSL_set_accept_state(s);
+
+	/* Early data only exists in TLSv1.3. */
+	if (SSL_is_dtls(s) || s->method->version < TLS1_3_VERSION)
+		return SSL_READ_EARLY_DATA_FINISH;
+
+	return tls13_legacy_read_early_data(s, buf, num, readbytes);
 }
 
 int
@@ -1238,7 +1348,7 @@ SSL_CTX_ctrl(SSL_CTX *ctx, int cmd, long larg, void *parg)
 		return (ctx->internal->session_cache_mode);
 
 	case SSL_CTRL_SESS_NUMBER:
-		return (lh_SSL_SESSION_num_items(ctx->internal->sessions));
+		return (ssl_session_cache_count(ctx));
 	case SSL_CTRL_SESS_CONNECT:
 		return (ctx->internal->stats.sess_connect);
 	case SSL_CTRL_SESS_CONNECT_GOOD:
@@ -1721,6 +1831,25 @@ SSL_get0_alpn_selected(const SSL *ssl, const unsigned char **data,
 	*len = ssl->s3->internal->alpn_selected_len;
 }
 
+/*
+ * SSL_CTX_set_private_key_method sets a method that performs the signature
+ * for the server handshake in place of the configured private key. The
+ * method may complete the operation later, in which case the handshake
+ * returns with SSL_ERROR_WANT_PRIVATE_KEY_OPERATION.
+ */
+void
+SSL_CTX_set_private_key_method(SSL_CTX *ctx,
+    const SSL_PRIVATE_KEY_METHOD *method)
+{
+	ctx->internal->private_key_method = method;
+}
+
+void
+SSL_set_private_key_method(SSL *ssl, const SSL_PRIVATE_KEY_METHOD *method)
+{
+	ssl->internal->private_key_method = method;
+}
+
 int
 SSL_export_keying_material(SSL *s, unsigned char *out, size_t olen,
     const char *label, size_t llen, const unsigned char *p, size_t plen,
@@ -1794,6 +1923,31 @@ ssl_session_LHASH_COMP(const void *arg1, const void *arg2)
 	return ssl_session_cmp(a, b);
 }
 
+struct lhash_st_SSL_SESSION *
+ssl_session_lhash_new(void)
+{
+	return lh_SSL_SESSION_new();
+}
+
+/*
+ * Key the AEAD for HelloRetryRequest cookies once, rather than repeating
+ * the AES and GHASH key setup for every cookie.
+ */
+static int
+ssl_ctx_cookie_aead_init(SSL_CTX *ctx)
+{
+	unsigned char key[32];
+	int ret;
+
+	arc4random_buf(key, sizeof(key));
+	ret = EVP_AEAD_CTX_init(&ctx->internal->tls13_cookie_aead_ctx,
+	    EVP_aead_aes_256_gcm(), key, sizeof(key),
+	    EVP_AEAD_DEFAULT_TAG_LENGTH, NULL);
+	explicit_bzero(key, sizeof(key));
+
+	return ret;
+}
+
 SSL_CTX *
 SSL_CTX_new(const SSL_METHOD *meth)
 {
@@ -1865,6 +2019,12 @@ SSL_CTX_new(const SSL_METHOD *meth)
 
 	if ((ret->internal->cert = ssl_cert_new()) == NULL)
 		goto err;
+	if ((ret->internal->nego_cache = ssl_nego_cache_new()) == NULL)
+		goto err;
+	if ((ret->internal->peer_cache = ssl_peer_cache_new()) == NULL)
+		goto err;
+	if ((ret->internal->stats_hs = ssl_stats_new()) == NULL)
+		goto err;
 
 	ret->default_passwd_callback = 0;
 	ret->default_passwd_callback_userdata = NULL;
@@ -1907,6 +2067,10 @@ SSL_CTX_new(const SSL_METHOD *meth)
 	arc4random_buf(ret->internal->tlsext_tick_key_name, 16);
 	arc4random_buf(ret->internal->tlsext_tick_hmac_key, 16);
 	arc4random_buf(ret->internal->tlsext_tick_aes_key, 16);
+	if (!tls1_ticket_aead_init(ret))
+		goto err;
+	if (!ssl_ctx_cookie_aead_init(ret))
+		goto err;
 
 	ret->internal->tlsext_status_cb = 0;
 	ret->internal->tlsext_status_arg = NULL;
@@ -1974,6 +2138,16 @@ SSL_CTX_free(SSL_CTX *ctx)
 	CRYPTO_free_ex_data(CRYPTO_EX_INDEX_SSL_CTX, ctx, &ctx->internal->ex_data);
 
 	lh_SSL_SESSION_free(ctx->internal->sessions);
+	ssl_session_cache_free(ctx);
+	ssl_session_shm_free(ctx);
+	ssl_buffer_pool_free(ctx);
+	tls13_key_share_pool_free(ctx->internal->key_share_pool);
+	ssl_ctx_nodes_free(ctx);
+	ssl_nego_cache_free(ctx->internal->nego_cache);
+	ssl_peer_cache_free(ctx->internal->peer_cache);
+	ssl_stats_free(ctx->internal->stats_hs);
+	EVP_AEAD_CTX_cleanup(&ctx->internal->tlsext_tick_aead_ctx);
+	EVP_AEAD_CTX_cleanup(&ctx->internal->tls13_cookie_aead_ctx);
 
 	X509_STORE_free(ctx->cert_store);
 	sk_SSL_CIPHER_free(ctx->cipher_list);
@@ -1996,6 +2170,8 @@ SSL_CTX_free(SSL_CTX *ctx)
 
 	free(ctx->internal->alpn_client_proto_list);
 
+	tls13_anti_replay_free(ctx->internal->anti_replay);
+
 	free(ctx->internal);
 	free(ctx);
 }
@@ -2063,42 +2239,41 @@ ssl_cert_can_sign(X509 *x)
 	    (x->ex_kusage & X509v3_KU_DIGITAL_SIGNATURE));
 }
 
+/*
+ * Compute the key exchange and authentication algorithms that the keys in c
+ * allow.  Since c may be shared, nothing is cached in it.
+ */
 void
-ssl_set_cert_masks(CERT *c, const SSL_CIPHER *cipher)
+ssl_cert_masks(const CERT *c, unsigned long *mask_k, unsigned long *mask_a)
 {
-	unsigned long mask_a, mask_k;
-	CERT_PKEY *cpk;
+	const CERT_PKEY *cpk;
+
+	*mask_a = SSL_aNULL | SSL_aTLS1_3;
+	*mask_k = SSL_kECDHE | SSL_kTLS1_3;
 
 	if (c == NULL)
 		return;
 
-	mask_a = SSL_aNULL | SSL_aTLS1_3;
-	mask_k = SSL_kECDHE | SSL_kTLS1_3;
-
 	if (c->dh_tmp != NULL || c->dh_tmp_cb != NULL || c->dh_tmp_auto != 0)
-		mask_k |= SSL_kDHE;
+		*mask_k |= SSL_kDHE;
 
 	cpk = &(c->pkeys[SSL_PKEY_ECC]);
 	if (cpk->x509 != NULL && cpk->privatekey != NULL) {
 		if (ssl_cert_can_sign(cpk->x509))
-			mask_a |= SSL_aECDSA;
+			*mask_a |= SSL_aECDSA;
 	}
 
 	cpk = &(c->pkeys[SSL_PKEY_GOST01]);
 	if (cpk->x509 != NULL && cpk->privatekey != NULL) {
-		mask_k |= SSL_kGOST;
-		mask_a |= SSL_aGOST01;
+		*mask_k |= SSL_kGOST;
+		*mask_a |= SSL_aGOST01;
 	}
 
 	cpk = &(c->pkeys[SSL_PKEY_RSA]);
 	if (cpk->x509 != NULL && cpk->privatekey != NULL) {
-		mask_a |= SSL_aRSA;
-		mask_k |= SSL_kRSA;
+		*mask_a |= SSL_aRSA;
+		*mask_k |= SSL_kRSA;
 	}
-
-	c->mask_k = mask_k;
-	c->mask_a = mask_a;
-	c->valid = 1;
 }
 
 /* See if this handshake is using an ECC cipher suite. */
@@ -2146,7 +2321,6 @@ ssl_get_server_send_pkey(const SSL *s)
 	int		 i;
 
 	c = s->cert;
-	ssl_set_cert_masks(c, S3I(s)->hs.cipher);
 
 	alg_a = S3I(s)->hs.cipher->algorithm_auth;
 
@@ -2198,6 +2372,310 @@ ssl_get_sign_pkey(SSL *s, const SSL_CIPHER *cipher, const EVP_MD **pmd,
 	return (pkey);
 }
 
+/*
+ * Sign with the kept signing context of the certificate that pkey belongs
+ * to - see ssl_cert_pkey_sign_ctx().
+ */
+static int
+ssl_private_key_sign_cpk(SSL *s, CERT_PKEY *cpk,
+    const struct ssl_sigalg *sigalg, const uint8_t *in, size_t in_len,
+    uint8_t **out, size_t *out_len)
+{
+	struct ssl_sign_ctx *sctx;
+	uint8_t md[EVP_MAX_MD_SIZE];
+	unsigned int md_len;
+	uint8_t *sig = NULL;
+	size_t sig_len;
+	int ret = 0;
+
+	if ((sctx = ssl_cert_pkey_sign_ctx(cpk, sigalg)) == NULL) {
+		SSLerror(s, ERR_R_EVP_LIB);
+		goto err;
+	}
+	if (!EVP_Digest(in, in_len, md, &md_len, sigalg->md(), NULL)) {
+		SSLerror(s, ERR_R_EVP_LIB);
+		goto err;
+	}
+	if (EVP_PKEY_sign(sctx->pctx, NULL, &sig_len, md, md_len) <= 0 ||
+	    sig_len == 0) {
+		SSLerror(s, ERR_R_EVP_LIB);
+		goto err;
+	}
+	if ((sig = calloc(1, sig_len)) == NULL) {
+		SSLerror(s, ERR_R_MALLOC_FAILURE);
+		goto err;
+	}
+	if (EVP_PKEY_sign(sctx->pctx, sig, &sig_len, md, md_len) <= 0) {
+		SSLerror(s, ERR_R_EVP_LIB);
+		goto err;
+	}
+
+	*out = sig;
+	*out_len = sig_len;
+	sig = NULL;
+
+	ret = 1;
+
+ err:
+	ssl_cert_pkey_sign_ctx_done(cpk, sctx, ret);
+	explicit_bzero(md, sizeof(md));
+	free(sig);
+
+	return ret;
+}
+
+static int
+ssl_private_key_sign_pkey(SSL *s, EVP_PKEY *pkey,
+    const struct ssl_sigalg *sigalg, const uint8_t *in, size_t in_len,
+    uint8_t **out, size_t *out_len)
+{
+	EVP_MD_CTX *mdctx = NULL;
+	EVP_PKEY_CTX *pctx;
+	uint8_t *sig = NULL;
+	size_t sig_len;
+	int i, ret = 0;
+
+	/* RSA and ECDSA keys of our own certificates keep their context. */
+	if (s->cert != NULL && (sigalg->key_type == EVP_PKEY_RSA ||
+	    sigalg->key_type == EVP_PKEY_EC)) {
+		for (i = 0; i < SSL_PKEY_NUM; i++) {
+			if (s->cert->pkeys[i].privatekey == pkey)
+				return ssl_private_key_sign_cpk(s,
+				    &s->cert->pkeys[i], sigalg, in, in_len,
+				    out, out_len);
+		}
+	}
+
+	if ((mdctx = EVP_MD_CTX_new()) == NULL) {
+		SSLerror(s, ERR_R_MALLOC_FAILURE);
+		goto err;
+	}
+	if (!EVP_DigestSignInit(mdctx, &pctx, sigalg->md(), NULL, pkey)) {
+		SSLerror(s, ERR_R_EVP_LIB);
+		goto err;
+	}
+	if ((sigalg->flags & SIGALG_FLAG_RSA_PSS) &&
+	    (!EVP_PKEY_CTX_set_rsa_padding(pctx, RSA_PKCS1_PSS_PADDING) ||
+	    !EVP_PKEY_CTX_set_rsa_pss_saltlen(pctx, -1))) {
+		SSLerror(s, ERR_R_EVP_LIB);
+		goto err;
+	}
+	if (!EVP_DigestSignUpdate(mdctx, in, in_len)) {
+		SSLerror(s, ERR_R_EVP_LIB);
+		goto err;
+	}
+	if (EVP_DigestSignFinal(mdctx, NULL, &sig_len) <= 0 || sig_len == 0) {
+		SSLerror(s, ERR_R_EVP_LIB);
+		goto err;
+	}
+	if ((sig = calloc(1, sig_len)) == NULL) {
+		SSLerror(s, ERR_R_MALLOC_FAILURE);
+		goto err;
+	}
+	if (EVP_DigestSignFinal(mdctx, sig, &sig_len) <= 0) {
+		SSLerror(s, ERR_R_EVP_LIB);
+		goto err;
+	}
+
+	*out = sig;
+	*out_len = sig_len;
+	sig = NULL;
+
+	ret = 1;
+
+ err:
+	EVP_MD_CTX_free(mdctx);
+	free(sig);
+
+	return ret;
+}
+
+static int
+ssl_private_key_sign_method(SSL *s, EVP_PKEY *pkey,
+    const struct ssl_sigalg *sigalg, const uint8_t *in, size_t in_len,
+    uint8_t **out, size_t *out_len)
+{
+	const SSL_PRIVATE_KEY_METHOD *method = s->internal->private_key_method;
+	uint8_t *sig = NULL;
+	size_t sig_len = 0;
+	size_t max_out;
+	int ret = 0;
+
+	if (EVP_PKEY_size(pkey) <= 0) {
+		SSLerror(s, ERR_R_INTERNAL_ERROR);
+		goto err;
+	}
+	max_out = EVP_PKEY_size(pkey);
+	if ((sig = calloc(1, max_out)) == NULL) {
+		SSLerror(s, ERR_R_MALLOC_FAILURE);
+		goto err;
+	}
+
+	if (S3I(s)->hs.private_key_pending) {
+		S3I(s)->hs.private_key_pending = 0;
+		s->internal->rwstate = SSL_NOTHING;
+		ret = method->complete(s, sig, &sig_len, max_out);
+	} else {
+		ret = method->sign(s, sig, &sig_len, max_out, sigalg->value,
+		    in, in_len);
+	}
+	if (ret == SSL_PRIVATE_KEY_RETRY) {
+		S3I(s)->hs.private_key_pending = 1;
+		s->internal->rwstate = SSL_PRIVATE_KEY_OPERATION;
+		goto err;
+	}
+	if (ret != SSL_PRIVATE_KEY_SUCCESS || sig_len == 0 ||
+	    sig_len > max_out) {
+		SSLerror(s, SSL_R_PRIVATE_KEY_OPERATION_FAILED);
+		ret = 0;
+		goto err;
+	}
+
+	*out = sig;
+	*out_len = sig_len;
+	sig = NULL;
+
+	ret = 1;
+
+ err:
+	free(sig);
+
+	return ret;
+}
+
+/*
+ * Sign the handshake data with pkey, or with the private key method if one
+ * is set. Returns 1 on success and 0 on failure. A return of -1 means that
+ * the private key method has not yet completed the operation, in which case
+ * the caller must return to the application and call again with the same
+ * input when the handshake is resumed.
+ */
+int
+ssl_private_key_sign(SSL *s, EVP_PKEY *pkey, const struct ssl_sigalg *sigalg,
+    const uint8_t *in, size_t in_len, uint8_t **out, size_t *out_len)
+{
+	struct timespec start, now;
+	int ret;
+
+	*out = NULL;
+	*out_len = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	/* The legacy MD5/SHA-1 signature has no signature algorithm. */
+	if (s->internal->private_key_method != NULL &&
+	    sigalg->value != SIGALG_RSA_PKCS1_MD5_SHA1)
+		ret = ssl_private_key_sign_method(s, pkey, sigalg, in, in_len,
+		    out, out_len);
+	else
+		ret = ssl_private_key_sign_pkey(s, pkey, sigalg, in, in_len,
+		    out, out_len);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	timespecsub(&now, &start, &now);
+	timespecadd(&s->internal->private_key_time, &now,
+	    &s->internal->private_key_time);
+
+	return ret;
+}
+
+void
+SSL_get_record_counts(const SSL *s, uint64_t *records_read,
+    uint64_t *records_written)
+{
+	uint64_t num_read, num_written;
+
+	tls12_record_layer_record_counts(s->internal->rl, records_read,
+	    records_written);
+
+	/* The TLSv1.3 handshake has its own record layer. */
+	if (s->internal->tls13 != NULL) {
+		tls13_record_layer_record_counts(s->internal->tls13->rl,
+		    &num_read, &num_written);
+		*records_read += num_read;
+		*records_written += num_written;
+	}
+}
+
+uint64_t
+SSL_num_key_updates(const SSL *s)
+{
+	if (s->internal->tls13 == NULL)
+		return 0;
+
+	return s->internal->tls13->key_updates;
+}
+
+/*
+ * Free the state that is only needed during a handshake, along with record
+ * buffers that hold no data, for a connection that is going to be idle.
+ * The session is left alone, since it may still be resumed.
+ */
+int
+SSL_hibernate(SSL *s)
+{
+	if (!SSL_is_init_finished(s) || SSL_is_dtls(s)) {
+		SSLerror(s, ERR_R_SHOULD_NOT_HAVE_BEEN_CALLED);
+		return 0;
+	}
+
+	tls1_cleanup_key_block(s);
+
+	DH_free(S3I(s)->tmp.dh);
+	S3I(s)->tmp.dh = NULL;
+	EC_KEY_free(S3I(s)->tmp.ecdh);
+	S3I(s)->tmp.ecdh = NULL;
+	freezero(S3I(s)->tmp.x25519, X25519_KEY_LENGTH);
+	S3I(s)->tmp.x25519 = NULL;
+
+	freezero(S3I(s)->hs.sigalgs, S3I(s)->hs.sigalgs_len);
+	S3I(s)->hs.sigalgs = NULL;
+	S3I(s)->hs.sigalgs_len = 0;
+
+	sk_X509_NAME_pop_free(S3I(s)->hs.tls12.ca_names, X509_NAME_free);
+	S3I(s)->hs.tls12.ca_names = NULL;
+	free(S3I(s)->hs.tls12.kex_params);
+	S3I(s)->hs.tls12.kex_params = NULL;
+	S3I(s)->hs.tls12.kex_params_len = 0;
+
+	/* The secrets are kept for key updates and session tickets. */
+	tls13_key_share_free(S3I(s)->hs.tls13.key_share);
+	S3I(s)->hs.tls13.key_share = NULL;
+	freezero(S3I(s)->hs.tls13.cookie, S3I(s)->hs.tls13.cookie_len);
+	S3I(s)->hs.tls13.cookie = NULL;
+	S3I(s)->hs.tls13.cookie_len = 0;
+	freezero(S3I(s)->hs.tls13.psk_identity,
+	    S3I(s)->hs.tls13.psk_identity_len);
+	S3I(s)->hs.tls13.psk_identity = NULL;
+	S3I(s)->hs.tls13.psk_identity_len = 0;
+	tls13_clienthello_hash_clear(&S3I(s)->hs.tls13);
+
+	tls1_transcript_free(s);
+	tls1_transcript_hash_free(s);
+
+	ssl3_release_init_buffer(s);
+	if (s->bbio != NULL && BIO_wpending(s->bbio) == 0)
+		ssl_free_wbio_buffer(s);
+
+	if (S3I(s)->rbuf.left == 0 && S3I(s)->rrec.length == 0)
+		ssl3_release_read_buffer(s);
+	if (S3I(s)->wbuf.left == 0)
+		ssl3_release_write_buffer(s);
+
+	if (s->internal->tls13 != NULL) {
+		tls13_record_layer_hibernate(s->internal->tls13->rl);
+		tls13_legacy_wire_release(s->internal->tls13);
+	}
+
+	return 1;
+}
+
+void
+SSL_get_private_key_time(const SSL *s, struct timespec *ts)
+{
+	*ts = s->internal->private_key_time;
+}
+
 DH *
 ssl_get_auto_dh(SSL *s)
 {
@@ -2267,9 +2745,13 @@ ssl_update_cache(SSL *s, int mode)
 			SSL_SESSION_free(s->session);
 	}
 
-	/* auto flush every 255 connections */
+	/*
+	 * Auto flush every 255 connections - a sharded session cache expires
+	 * sessions incrementally instead.
+	 */
 	if ((!(i & SSL_SESS_CACHE_NO_AUTO_CLEAR)) &&
-	    ((i & mode) == mode)) {
+	    ((i & mode) == mode) &&
+	    s->session_ctx->internal->session_shards == NULL) {
 		if ((((mode & SSL_SESS_CACHE_CLIENT) ?
 		    s->session_ctx->internal->stats.sess_connect_good :
 		    s->session_ctx->internal->stats.sess_accept_good) & 0xff) == 0xff) {
@@ -2379,6 +2861,9 @@ SSL_get_error(const SSL *s, int i)
 	if ((i < 0) && SSL_want_x509_lookup(s)) {
 		return (SSL_ERROR_WANT_X509_LOOKUP);
 	}
+	if ((i < 0) && SSL_want_private_key_operation(s)) {
+		return (SSL_ERROR_WANT_PRIVATE_KEY_OPERATION);
+	}
 
 	if (i == 0) {
 		if ((s->internal->shutdown & SSL_RECEIVED_SHUTDOWN) &&
@@ -2401,7 +2886,7 @@ SSL_do_handshake(SSL *s)
 	s->method->ssl_renegotiate_check(s);
 
 	if (SSL_in_init(s) || SSL_in_before(s)) {
-		ret = s->internal->handshake_func(s);
+		ret = ssl_stats_handshake(s, s->internal->handshake_func);
 	}
 	return (ret);
 }
@@ -2496,20 +2981,12 @@ SSL_dup(SSL *s)
 		if (!SSL_copy_session_id(ret, s))
 			goto err;
 	} else {
-		/*
-		 * No session has been established yet, so we have to expect
-		 * that s->cert or ret->cert will be changed later --
-		 * they should not both point to the same object,
-		 * and thus we can't use SSL_copy_session_id.
-		 */
-
 		ret->method->ssl_free(ret);
 		ret->method = s->method;
 		ret->method->ssl_new(ret);
 
 		ssl_cert_free(ret->cert);
-		if ((ret->cert = ssl_cert_dup(s->cert)) == NULL)
-			goto err;
+		ret->cert = ssl_cert_share(s->cert);
 
 		if (!SSL_set_session_id_context(ret, s->sid_ctx,
 		    s->sid_ctx_length))
@@ -2522,6 +2999,8 @@ SSL_dup(SSL *s)
 	SSL_set_read_ahead(ret, SSL_get_read_ahead(s));
 	ret->internal->msg_callback = s->internal->msg_callback;
 	ret->internal->msg_callback_arg = s->internal->msg_callback_arg;
+	ret->internal->handshake_trace_cb = s->internal->handshake_trace_cb;
+	ret->internal->handshake_trace_arg = s->internal->handshake_trace_arg;
 	SSL_set_verify(ret, SSL_get_verify_mode(s),
 	SSL_get_verify_callback(s));
 	SSL_set_verify_depth(ret, SSL_get_verify_depth(s));
@@ -2703,11 +3182,19 @@ ssl_init_wbio_buffer(SSL *s, int push)
 			s->wbio = BIO_pop(s->wbio);
 	}
 	(void)BIO_reset(bbio);
-/*	if (!BIO_set_write_buffer_size(bbio,16*1024)) */
 	if (!BIO_set_read_buffer_size(bbio, 1)) {
 		SSLerror(s, ERR_R_BUF_LIB);
 		return (0);
 	}
+	/*
+	 * Make room for a whole flight, so that it goes out in a single
+	 * write when the handshake flushes. DTLS flushes each message.
+	 */
+	if (!SSL_is_dtls(s) &&
+	    !BIO_set_write_buffer_size(bbio, SSL3_RT_MAX_PACKET_SIZE)) {
+		SSLerror(s, ERR_R_BUF_LIB);
+		return (0);
+	}
 	if (push) {
 		if (s->wbio != bbio)
 			s->wbio = BIO_push(bbio, s->wbio);
@@ -2747,6 +3234,58 @@ SSL_CTX_get_quiet_shutdown(const SSL_CTX *ctx)
 	return (ctx->internal->quiet_shutdown);
 }
 
+int
+SSL_CTX_set_buffer_pool_size(SSL_CTX *ctx, size_t size)
+{
+	if (!ssl_buffer_pool_set_size(ctx, size)) {
+		SSLerrorx(ERR_R_MALLOC_FAILURE);
+		return 0;
+	}
+	return 1;
+}
+
+size_t
+SSL_CTX_get_buffer_pool_size(const SSL_CTX *ctx)
+{
+	return ssl_buffer_pool_size(ctx);
+}
+
+int
+SSL_CTX_set_key_share_pool_size(SSL_CTX *ctx, size_t size)
+{
+	struct tls13_key_share_pool *pool;
+
+	if ((pool = ctx->internal->key_share_pool) == NULL) {
+		if (size == 0)
+			return 1;
+		if ((pool = tls13_key_share_pool_new()) == NULL) {
+			SSLerrorx(ERR_R_MALLOC_FAILURE);
+			return 0;
+		}
+		ctx->internal->key_share_pool = pool;
+	}
+
+	return tls13_key_share_pool_set_size(pool, size);
+}
+
+size_t
+SSL_CTX_get_key_share_pool_size(const SSL_CTX *ctx)
+{
+	if (ctx->internal->key_share_pool == NULL)
+		return 0;
+
+	return tls13_key_share_pool_size(ctx->internal->key_share_pool);
+}
+
+int
+SSL_CTX_fill_key_share_pool(SSL_CTX *ctx)
+{
+	if (ctx->internal->key_share_pool == NULL)
+		return 1;
+
+	return tls13_key_share_pool_fill(ctx->internal->key_share_pool);
+}
+
 void
 SSL_set_quiet_shutdown(SSL *s, int mode)
 {
@@ -2786,17 +3325,13 @@ SSL_get_SSL_CTX(const SSL *ssl)
 SSL_CTX *
 SSL_set_SSL_CTX(SSL *ssl, SSL_CTX* ctx)
 {
-	CERT *new_cert;
-
 	if (ctx == NULL)
 		ctx = ssl->initial_ctx;
 	if (ssl->ctx == ctx)
 		return (ssl->ctx);
 
-	if ((new_cert = ssl_cert_dup(ctx->internal->cert)) == NULL)
-		return NULL;
 	ssl_cert_free(ssl->cert);
-	ssl->cert = new_cert;
+	ssl->cert = ssl_cert_share(ctx->internal->cert);
 
 	SSL_CTX_up_ref(ctx);
 	SSL_CTX_free(ssl->ctx); /* decrement reference count */
@@ -340,6 +340,9 @@ __BEGIN_HIDDEN_DECLS
 
 #define SSL_MAX_EMPTY_RECORDS	32
 
+/* Number of digests used by TLSv1.2 signature algorithms. */
+#define TLS1_TRANSCRIPT_DIGESTS	4
+
 /* SSL_kRSA <- RSA_ENC | (RSA_TMP & RSA_SIGN) |
  * 	    <- (EXPORT & (RSA_ENC | RSA_TMP) & RSA_SIGN)
  * SSL_kDH  <- DH_ENC & (RSA_ENC | RSA_SIGN | DSA_SIGN)
@@ -401,6 +404,8 @@ struct ssl_method_st {
 	int (*ssl_read_bytes)(SSL *s, int type, unsigned char *buf, int len,
 	    int peek);
 	int (*ssl_write_bytes)(SSL *s, int type, const void *buf_, int len);
+	int (*ssl_writev)(SSL *s, const struct iovec *iov, int iovcnt);
+	int (*ssl_flush)(SSL *s);
 
 	int (*ssl_dispatch_alert)(SSL *s);
 	const SSL_CIPHER *(*get_cipher)(unsigned int ncipher);
@@ -450,6 +455,9 @@ typedef struct ssl_session_internal_st {
  *	Ticket [10]             EXPLICIT OCTET STRING, -- session ticket (clients only)
  *	Compression_meth [11]   EXPLICIT OCTET STRING, -- optional compression method
  *	SRP_username [ 12 ] EXPLICIT OCTET STRING -- optional SRP username
+ *	Ticket_age_add [ 14 ] EXPLICIT INTEGER -- TLSv1.3 ticket age add
+ *	Max_early_data [ 15 ] EXPLICIT INTEGER -- TLSv1.3 early data limit
+ *	ALPN_selected [ 16 ] EXPLICIT OCTET STRING -- selected ALPN protocol
  *	}
  * Look in ssl/ssl_asn1.c for more details
  * I'm using EXPLICIT tags so I can read the damn things using asn1parse :-).
@@ -495,14 +503,49 @@ struct ssl_session_st {
 	unsigned char *tlsext_tick;	/* Session ticket */
 	size_t tlsext_ticklen;		/* Session ticket length */
 	long tlsext_tick_lifetime_hint;	/* Session lifetime hint in seconds */
+	uint32_t tlsext_tick_age_add;	/* TLSv1.3 ticket age obfuscation */
+	uint32_t max_early_data;	/* TLSv1.3 early data limit */
+
+	/* ALPN protocol selected for the connection (early data only). */
+	uint8_t *alpn_selected;
+	size_t alpn_selected_len;
 
 	struct ssl_session_internal_st *internal;
 };
 
+/*
+ * A signing context for the private key of a CERT_PKEY, set up for one
+ * signature algorithm - see ssl_cert_pkey_sign_ctx().
+ */
+struct ssl_sign_ctx {
+	uint16_t sigalg;
+	EVP_PKEY_CTX *pctx;
+};
+
 typedef struct cert_pkey_st {
 	X509 *x509;
 	EVP_PKEY *privatekey;
 	STACK_OF(X509) *chain;
+
+	/*
+	 * Encoded certificate lists for TLSv1.2 and earlier, and for TLSv1.3,
+	 * built on first use - see ssl_cert_pkey_cert_list().
+	 */
+	uint8_t *cert_list[2];
+	size_t cert_list_len[2];
+	size_t cert_list_leaf_len[2];
+
+	/*
+	 * Compressed TLSv1.3 Certificate message, built on first use - see
+	 * tls13_cert_comp_add_cached().
+	 */
+	uint16_t cert_comp_alg;
+	uint8_t *cert_comp;
+	size_t cert_comp_len;
+	size_t cert_comp_uncompressed_len;
+
+	/* Signing context of the last signature, when not in use. */
+	struct ssl_sign_ctx *sign_ctx;
 } CERT_PKEY;
 
 struct ssl_sigalg;
@@ -527,12 +570,19 @@ typedef struct ssl_handshake_tls12_st {
 
 	/* Transcript hash prior to sending certificate verify message. */
 	uint8_t cert_verify[EVP_MAX_MD_SIZE];
+
+	/* Server key exchange parameters, kept while signing is pending. */
+	uint8_t *kex_params;
+	size_t kex_params_len;
 } SSL_HANDSHAKE_TLS12;
 
 typedef struct ssl_handshake_tls13_st {
 	int use_legacy;
 	int hrr;
 
+	/* HelloRetryRequest restored from a stateless cookie. */
+	int hrr_restored;
+
 	/* Certificate selected for use (static pointer). */
 	const CERT_PKEY *cpk;
 
@@ -546,6 +596,31 @@ typedef struct ssl_handshake_tls13_st {
 	uint8_t *cookie;
 	size_t cookie_len;
 
+	/*
+	 * Pre-shared key offered by the client - only the first identity is
+	 * retained. psk_binders_len is the length of the binders list and its
+	 * length prefix, which is stripped from the end of the ClientHello
+	 * when computing the binder.
+	 */
+	int psk_dhe_ke;
+	int psk_selected;
+	uint8_t *psk_identity;
+	size_t psk_identity_len;
+	uint32_t psk_obfuscated_age;
+	uint8_t psk_binder[EVP_MAX_MD_SIZE];
+	size_t psk_binder_len;
+	size_t psk_binders_len;
+
+	/* Early data status, one of SSL_EARLY_DATA_*. */
+	int early_data_status;
+
+	/*
+	 * Certificate compression (RFC 8879) - whether a client offered it and
+	 * the algorithm a server compresses its Certificate with, if any.
+	 */
+	int cert_comp_offered;
+	uint16_t cert_comp_alg;
+
 	/* Preserved transcript hash. */
 	uint8_t transcript_hash[EVP_MAX_MD_SIZE];
 	size_t transcript_hash_len;
@@ -588,6 +663,9 @@ typedef struct ssl_handshake_st {
 	/* Cipher being negotiated in this handshake. */
 	const SSL_CIPHER *cipher;
 
+	/* Group of the TLSv1.2 ECDHE key exchange, if any. */
+	uint16_t group;
+
 	/* Extensions seen in this handshake. */
 	uint32_t extensions_seen;
 
@@ -599,6 +677,13 @@ typedef struct ssl_handshake_st {
 	uint8_t *sigalgs;
 	size_t sigalgs_len;
 
+	/* Key of this handshake in the negotiation cache of the SSL_CTX. */
+	uint8_t nego_key[SHA256_DIGEST_LENGTH];
+	int nego_key_valid;
+
+	/* A private key method operation has returned retry. */
+	int private_key_pending;
+
 	/*
 	 * Copies of the verify data sent in our finished message and the
 	 * verify data received in the finished message sent by our peer.
@@ -629,6 +714,8 @@ struct tls12_record_layer *tls12_record_layer_new(void);
 void tls12_record_layer_free(struct tls12_record_layer *rl);
 void tls12_record_layer_alert(struct tls12_record_layer *rl,
     uint8_t *alert_desc);
+void tls12_record_layer_record_counts(struct tls12_record_layer *rl,
+    uint64_t *num_read, uint64_t *num_written);
 int tls12_record_layer_write_overhead(struct tls12_record_layer *rl,
     size_t *overhead);
 int tls12_record_layer_read_protected(struct tls12_record_layer *rl);
@@ -650,6 +737,9 @@ void tls12_record_layer_write_epoch_done(struct tls12_record_layer *rl,
     uint16_t epoch);
 void tls12_record_layer_clear_read_state(struct tls12_record_layer *rl);
 void tls12_record_layer_clear_write_state(struct tls12_record_layer *rl);
+void tls12_record_layer_seq_num(struct tls12_record_layer *rl, int is_write,
+    CBS *seq_num);
+int tls12_record_layer_use_ktls(struct tls12_record_layer *rl, int is_write);
 void tls12_record_layer_reflect_seq_num(struct tls12_record_layer *rl);
 void tls12_record_layer_read_cipher_hash(struct tls12_record_layer *rl,
     EVP_CIPHER_CTX **cipher, EVP_MD_CTX **hash);
@@ -657,8 +747,11 @@ int tls12_record_layer_change_read_cipher_state(struct tls12_record_layer *rl,
     CBS *mac_key, CBS *key, CBS *iv);
 int tls12_record_layer_change_write_cipher_state(struct tls12_record_layer *rl,
     CBS *mac_key, CBS *key, CBS *iv);
+int tls12_record_layer_set_cids(struct tls12_record_layer *rl, CBS *read_cid,
+    CBS *write_cid);
+size_t tls12_record_layer_read_cid_len(struct tls12_record_layer *rl);
 int tls12_record_layer_open_record(struct tls12_record_layer *rl,
-    uint8_t *buf, size_t buf_len, uint8_t **out, size_t *out_len);
+    uint8_t *buf, size_t buf_len, uint8_t *content_type, CBS *out_plaintext);
 int tls12_record_layer_seal_record(struct tls12_record_layer *rl,
     uint8_t content_type, const uint8_t *content, size_t content_len,
     CBB *out);
@@ -732,6 +825,40 @@ typedef struct ssl_ctx_internal_st {
 
 	struct lhash_st_SSL_SESSION *sessions;
 
+	/*
+	 * Internal session cache shards, if enabled via
+	 * SSL_CTX_set_session_cache_shards(). In this case sessions are held
+	 * in the shards, rather than in sessions and the session cache list.
+	 */
+	struct ssl_session_shard *session_shards;
+	unsigned int session_shards_num;
+
+	/*
+	 * Shared session cache, if enabled via SSL_CTX_set_session_cache_shm().
+	 * This is mapped shared so that it is inherited by forked processes.
+	 */
+	struct ssl_session_shm_slot *session_shm;
+	unsigned int session_shm_slots;
+
+	/* Pool of record buffers, see SSL_CTX_set_buffer_pool_size(). */
+	struct ssl_buffer_pool *buffer_pool;
+
+	/* Pregenerated TLSv1.3 key shares, see tls13_key_share.c. */
+	struct tls13_key_share_pool *key_share_pool;
+
+	/* Negotiation results for recently seen ClientHellos, see ssl_nego.c. */
+	struct ssl_nego_cache *nego_cache;
+
+	/* Peer certificates that tickets refer to, see ssl_peer.c. */
+	struct ssl_peer_cache *peer_cache;
+
+	/* Handshake statistics, see ssl_stats.c. */
+	struct ssl_stats *stats_hs;
+
+	/* Per node replicas, see ssl_node.c. */
+	struct ssl_node **nodes;
+	unsigned int nodes_num;
+
 	/* Most session-ids that will be cached, default is
 	 * SSL_SESSION_CACHE_MAX_SIZE_DEFAULT. 0 is unlimited. */
 	unsigned long session_cache_size;
@@ -798,6 +925,16 @@ typedef struct ssl_ctx_internal_st {
 	unsigned char tlsext_tick_hmac_key[16];
 	unsigned char tlsext_tick_aes_key[16];
 
+	/* Seals tickets under the HMAC and AES keys, when there is no cb. */
+	EVP_AEAD_CTX tlsext_tick_aead_ctx;
+
+	/* Seals stateless HelloRetryRequest cookies, under a random key. */
+	EVP_AEAD_CTX tls13_cookie_aead_ctx;
+
+	/* TLSv1.3 early data and anti-replay state. */
+	uint32_t max_early_data;
+	struct tls13_anti_replay *anti_replay;
+
 	/* SRTP profiles we are willing to do from RFC 5764 */
 	STACK_OF(SRTP_PROTECTION_PROFILE) *srtp_profiles;
 
@@ -824,6 +961,12 @@ typedef struct ssl_ctx_internal_st {
 	unsigned char *alpn_client_proto_list;
 	unsigned int alpn_client_proto_list_len;
 
+	const SSL_PRIVATE_KEY_METHOD *private_key_method;
+
+	/* Handshake trace callback, see ssl_trace.c. */
+	ssl_handshake_trace_cb_fn handshake_trace_cb;
+	void *handshake_trace_arg;
+
 	size_t tlsext_ecpointformatlist_length;
 	uint8_t *tlsext_ecpointformatlist; /* our list */
 	size_t tlsext_supportedgroups_length;
@@ -850,6 +993,15 @@ typedef struct ssl_internal_st {
 	unsigned char *alpn_client_proto_list;
 	unsigned int alpn_client_proto_list_len;
 
+	const SSL_PRIVATE_KEY_METHOD *private_key_method;
+
+	/* Handshake trace callback, see ssl_trace.c. */
+	ssl_handshake_trace_cb_fn handshake_trace_cb;
+	void *handshake_trace_arg;
+
+	/* Time spent in ssl_private_key_sign(). */
+	struct timespec private_key_time;
+
 	/* XXX Callbacks */
 
 	/* true when we are actually in SSL_accept() or SSL_connect() */
@@ -921,6 +1073,9 @@ typedef struct ssl_internal_st {
 
 	struct tls12_record_layer *rl;
 
+	/* Write buffers still in flight, see ssl_zerocopy.c. */
+	struct ssl_zerocopy *zerocopy;
+
 	/* session info */
 
 	/* extra application data */
@@ -949,6 +1104,9 @@ typedef struct ssl_internal_st {
 	/* RFC4507 session ticket expected to be received or sent */
 	int tlsext_ticket_expected;
 
+	/* Maximum amount of TLSv1.3 early data that will be accepted. */
+	uint32_t max_early_data;
+
 	size_t tlsext_ecpointformatlist_length;
 	uint8_t *tlsext_ecpointformatlist; /* our list */
 	size_t tlsext_supportedgroups_length;
@@ -960,6 +1118,14 @@ typedef struct ssl_internal_st {
 	STACK_OF(SRTP_PROTECTION_PROFILE) *srtp_profiles;	/* What we'll do */
 	const SRTP_PROTECTION_PROFILE *srtp_profile;		/* What's been chosen */
 
+	/* DTLS connection IDs - RFC 9146. */
+	int dtls_cid_enabled;
+	uint8_t dtls_cid[DTLS1_MAX_CID_LENGTH];			/* Ours */
+	size_t dtls_cid_len;
+	int dtls_cid_negotiated;
+	uint8_t dtls_peer_cid[DTLS1_MAX_CID_LENGTH];		/* Theirs */
+	size_t dtls_peer_cid_len;
+
 	int renegotiate;/* 1 if we are renegotiating.
 		 	 * 2 if we are a server and are inside a handshake
 	                 * (i.e. not just sending a HelloRequest) */
@@ -1025,6 +1191,12 @@ typedef struct ssl3_state_internal_st {
 	/* Rolling hash of handshake messages. */
 	EVP_MD_CTX *handshake_hash;
 
+	/*
+	 * Digests of the handshake messages for signature algorithms, used
+	 * in place of handshake_transcript for a TLSv1.2 CertificateVerify.
+	 */
+	EVP_MD_CTX *handshake_digests[TLS1_TRANSCRIPT_DIGESTS];
+
 	/* this is set whenerver we see a change_cipher_spec message
 	 * come in when we are not looking for one */
 	int change_cipher_spec;
@@ -1089,19 +1261,13 @@ typedef struct cert_st {
 			 * Probably it would make more sense to store
 			 * an index, not a pointer. */
 
-	/* The following masks are for the key and auth
-	 * algorithms that are supported by the certs below */
-	int valid;
-	unsigned long mask_k;
-	unsigned long mask_a;
-
 	DH *dh_tmp;
 	DH *(*dh_tmp_cb)(SSL *ssl, int is_export, int keysize);
 	int dh_tmp_auto;
 
 	CERT_PKEY pkeys[SSL_PKEY_NUM];
 
-	int references; /* >1 only if SSL_copy_session_id is used */
+	int references; /* shared by the SSL_CTX and its SSLs until changed */
 } CERT;
 
 
@@ -1181,6 +1347,14 @@ int ssl_clear_bad_session(SSL *s);
 CERT *ssl_cert_new(void);
 CERT *ssl_cert_dup(CERT *cert);
 void ssl_cert_free(CERT *c);
+CERT *ssl_cert_share(CERT *cert);
+int ssl_cert_unshare(CERT **certp);
+void ssl_cert_pkey_flush(CERT_PKEY *cpk);
+struct ssl_sign_ctx *ssl_cert_pkey_sign_ctx(CERT_PKEY *cpk,
+    const struct ssl_sigalg *sigalg);
+void ssl_cert_pkey_sign_ctx_done(CERT_PKEY *cpk, struct ssl_sign_ctx *sctx,
+    int reuse);
+int ssl_cert_pkey_cert_list(CERT_PKEY *cpk, int tls13, CBS *leaf, CBS *chain);
 int ssl_cert_set0_chain(CERT *c, STACK_OF(X509) *chain);
 int ssl_cert_set1_chain(CERT *c, STACK_OF(X509) *chain);
 int ssl_cert_add0_chain_cert(CERT *c, X509 *cert);
@@ -1191,6 +1365,12 @@ void ssl_sess_cert_free(SESS_CERT *sc);
 int ssl_get_new_session(SSL *s, int session);
 int ssl_get_prev_session(SSL *s, CBS *session_id, CBS *ext_block,
     int *alert);
+struct lhash_st_SSL_SESSION *ssl_session_lhash_new(void);
+SSL_SESSION *ssl_session_cache_retrieve(SSL_CTX *ctx, SSL_SESSION *key,
+    int ref);
+unsigned long ssl_session_cache_count(SSL_CTX *ctx);
+void ssl_session_cache_free(SSL_CTX *ctx);
+void ssl_session_shm_free(SSL_CTX *ctx);
 int ssl_cipher_id_cmp(const SSL_CIPHER *a, const SSL_CIPHER *b);
 SSL_CIPHER *OBJ_bsearch_ssl_cipher_id(SSL_CIPHER *key, SSL_CIPHER const *base,
     int num);
@@ -1207,6 +1387,11 @@ void ssl_update_cache(SSL *s, int mode);
 int ssl_cipher_get_evp(const SSL_SESSION *s, const EVP_CIPHER **enc,
     const EVP_MD **md, int *mac_pkey_type, int *mac_secret_size);
 int ssl_cipher_get_evp_aead(const SSL_SESSION *s, const EVP_AEAD **aead);
+
+int ssl_ktls_start(SSL *s);
+ssize_t ssl_ktls_sendfile(SSL *s, int fd, off_t offset, size_t size,
+    int flags);
+
 int ssl_get_handshake_evp_md(SSL *s, const EVP_MD **md);
 
 int ssl_verify_cert_chain(SSL *s, STACK_OF(X509) *sk);
@@ -1216,14 +1401,21 @@ int ssl_undefined_const_function(const SSL *s);
 CERT_PKEY *ssl_get_server_send_pkey(const SSL *s);
 EVP_PKEY *ssl_get_sign_pkey(SSL *s, const SSL_CIPHER *c, const EVP_MD **pmd,
     const struct ssl_sigalg **sap);
+int ssl_private_key_sign(SSL *s, EVP_PKEY *pkey,
+    const struct ssl_sigalg *sigalg, const uint8_t *in, size_t in_len,
+    uint8_t **out, size_t *out_len);
 DH *ssl_get_auto_dh(SSL *s);
 int ssl_cert_type(X509 *x, EVP_PKEY *pkey);
-void ssl_set_cert_masks(CERT *c, const SSL_CIPHER *cipher);
+void ssl_cert_masks(const CERT *c, unsigned long *mask_k,
+    unsigned long *mask_a);
 STACK_OF(SSL_CIPHER) *ssl_get_ciphers_by_id(SSL *s);
 int ssl_has_ecc_ciphers(SSL *s);
 int ssl_verify_alarm_type(long type);
 
-int SSL_SESSION_ticket(SSL_SESSION *ss, unsigned char **out, size_t *out_len);
+int SSL_SESSION_ticket(SSL_SESSION *ss, SSL_CTX *peer_ctx, unsigned char **out,
+    size_t *out_len);
+SSL_SESSION *SSL_SESSION_from_ticket(const unsigned char *ticket,
+    size_t ticket_len, SSL_CTX *peer_ctx);
 
 const SSL_CIPHER *ssl3_get_cipher_by_char(const unsigned char *p);
 int ssl3_send_server_certificate(SSL *s);
@@ -1259,6 +1451,62 @@ int	ssl3_setup_write_buffer(SSL *s);
 void ssl3_release_buffer(SSL3_BUFFER_INTERNAL *b);
 void ssl3_release_read_buffer(SSL *s);
 void ssl3_release_write_buffer(SSL *s);
+
+/*
+ * Size of pooled record buffers - large enough for both the SSLv3/TLS and
+ * DTLS read and write buffers, as well as a TLSv1.3 record.
+ */
+#define SSL_BUFFER_POOL_BUF_LEN \
+	(SSL3_RT_MAX_PLAIN_LENGTH + 2 * (SSL3_RT_MAX_ENCRYPTED_OVERHEAD + \
+	DTLS1_RT_HEADER_LENGTH + 1 + SSL3_ALIGN_PAYLOAD))
+
+uint8_t *ssl_buffer_get(SSL_CTX *ctx, size_t len, size_t *out_len);
+void ssl_buffer_put(SSL_CTX *ctx, uint8_t *buf, size_t len);
+int ssl_zerocopy_retire(SSL *s, uint8_t *buf, size_t len);
+void ssl_zerocopy_free(SSL *s);
+int ssl_buffer_pool_set_size(SSL_CTX *ctx, size_t max);
+size_t ssl_buffer_pool_size(const SSL_CTX *ctx);
+void ssl_buffer_pool_free(SSL_CTX *ctx);
+
+struct ssl_nego_cache *ssl_nego_cache_new(void);
+void ssl_nego_cache_free(struct ssl_nego_cache *cache);
+int ssl_nego_cache_get_cipher(SSL *s, STACK_OF(SSL_CIPHER) *clnt,
+    STACK_OF(SSL_CIPHER) *srvr, const SSL_CIPHER **cipher);
+void ssl_nego_cache_set_cipher(SSL *s, const SSL_CIPHER *cipher);
+int ssl_nego_cache_get_group(SSL *s, int *nid);
+void ssl_nego_cache_set_group(SSL *s, int nid);
+int ssl_nego_cache_get_sigalg(SSL *s, EVP_PKEY *pkey,
+    const struct ssl_sigalg **sigalg);
+void ssl_nego_cache_set_sigalg(SSL *s, EVP_PKEY *pkey,
+    const struct ssl_sigalg *sigalg);
+
+struct ssl_peer_cache *ssl_peer_cache_new(void);
+void ssl_peer_cache_free(struct ssl_peer_cache *cache);
+int ssl_peer_cache_add(struct ssl_peer_cache *cache, X509 *cert,
+    uint8_t *digest, size_t digest_len);
+X509 *ssl_peer_cache_get(struct ssl_peer_cache *cache, const uint8_t *digest,
+    size_t digest_len);
+
+struct ssl_stats *ssl_stats_new(void);
+void ssl_stats_free(struct ssl_stats *stats);
+void ssl_stats_handshake_done(SSL *s);
+void ssl_stats_hello_retry_request(SSL *s);
+void ssl_stats_alert(SSL *s, int sent, uint8_t desc);
+void ssl_stats_ticket_decrypt_failure(SSL *s);
+int ssl_stats_handshake(SSL *s, int (*handshake_func)(SSL *));
+void ssl_stats_merge(struct ssl_stats *dst, struct ssl_stats *src);
+
+struct ssl_stats *ssl_ctx_stats(SSL_CTX *ctx);
+struct ssl_stats *ssl_ctx_stats_index(SSL_CTX *ctx, unsigned int i);
+unsigned int ssl_ctx_stats_num(SSL_CTX *ctx);
+const EVP_AEAD_CTX *ssl_ctx_ticket_aead_ctx(SSL_CTX *ctx);
+const EVP_AEAD_CTX *ssl_ctx_cookie_aead_ctx(SSL_CTX *ctx);
+int ssl_ctx_nodes_ticket_aead_update(SSL_CTX *ctx);
+void ssl_ctx_nodes_free(SSL_CTX *ctx);
+
+void ssl_trace_state(SSL *s);
+void ssl_trace_message(SSL *s, int sent, const void *msg, size_t len);
+
 int	ssl3_new(SSL *s);
 void	ssl3_free(SSL *s);
 int	ssl3_accept(SSL *s);
@@ -1346,6 +1594,9 @@ int tls1_transcript_data(SSL *s, const unsigned char **data, size_t *len);
 void tls1_transcript_freeze(SSL *s);
 void tls1_transcript_unfreeze(SSL *s);
 int tls1_transcript_record(SSL *s, const unsigned char *buf, size_t len);
+int tls1_transcript_digests_init(SSL *s);
+int tls1_transcript_digest(SSL *s, const EVP_MD *md, unsigned char *out,
+    size_t out_len, size_t *outlen);
 
 int tls1_PRF(SSL *s, const unsigned char *secret, size_t secret_len,
     const void *seed1, size_t seed1_len, const void *seed2, size_t seed2_len,
@@ -1395,7 +1646,12 @@ int ssl_check_serverhello_tlsext(SSL *s);
 #define TLS1_TICKET_NOT_DECRYPTED	 2
 #define TLS1_TICKET_DECRYPTED		 3
 
+#define TLS1_TICKET_NONCE_LEN		12
+
+int tls1_ticket_aead_init(SSL_CTX *ctx);
 int tls1_process_ticket(SSL *s, CBS *ext_block, int *alert, SSL_SESSION **ret);
+int tls1_decrypt_ticket(SSL *s, CBS *ticket, int *alert, SSL_SESSION **psess);
+int tls1_encrypt_ticket(SSL *s, SSL_SESSION *sess, CBB *cbb);
 
 int tls1_check_ec_server_key(SSL *s);
 
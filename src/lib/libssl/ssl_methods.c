@@ -264,6 +264,8 @@ static const SSL_METHOD TLS_method_data = {
 	.ssl_pending = tls13_legacy_pending,
 	.ssl_read_bytes = tls13_legacy_read_bytes,
 	.ssl_write_bytes = tls13_legacy_write_bytes,
+	.ssl_writev = tls13_legacy_writev,
+	.ssl_flush = tls13_legacy_flush,
 	.ssl_dispatch_alert = ssl3_dispatch_alert,
 	.get_cipher = ssl3_get_cipher,
 	.enc_flags = TLSV1_3_ENC_FLAGS,
@@ -310,6 +312,8 @@ static const SSL_METHOD TLS_client_method_data = {
 	.ssl_pending = tls13_legacy_pending,
 	.ssl_read_bytes = tls13_legacy_read_bytes,
 	.ssl_write_bytes = tls13_legacy_write_bytes,
+	.ssl_writev = tls13_legacy_writev,
+	.ssl_flush = tls13_legacy_flush,
 	.ssl_dispatch_alert = ssl3_dispatch_alert,
 	.get_cipher = ssl3_get_cipher,
 	.enc_flags = TLSV1_3_ENC_FLAGS,
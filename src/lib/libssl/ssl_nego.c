@@ -0,0 +1,345 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Server negotiation cache.
+ *
+ * Clients send few distinct ClientHellos, so the cipher suite, group and
+ * signature algorithm that a server selects for one are remembered in a
+ * small direct mapped cache held by the SSL_CTX.  The key is a hash of
+ * everything the selection depends on - the negotiated version, the options,
+ * the client and server cipher suite and group lists, the client point
+ * formats and signature algorithms, and the CERT.  An entry holds a
+ * reference to its CERT, so a CERT that changes is copied first (see
+ * ssl_cert_unshare()) and no longer matches.
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include <openssl/sha.h>
+
+#include "ssl_locl.h"
+#include "ssl_sigalgs.h"
+
+#define SSL_NEGO_CACHE_SIZE	64
+
+#define SSL_NEGO_CIPHER		0x01
+#define SSL_NEGO_GROUP		0x02
+#define SSL_NEGO_SIGALG		0x04
+
+struct ssl_nego_entry {
+	uint8_t key[SHA256_DIGEST_LENGTH];
+	CERT *cert;
+	int flags;
+	const SSL_CIPHER *cipher;
+	int group_nid;
+	const EVP_PKEY *sigalg_pkey;
+	const struct ssl_sigalg *sigalg;
+};
+
+struct ssl_nego_cache {
+	pthread_mutex_t lock;
+	struct ssl_nego_entry entries[SSL_NEGO_CACHE_SIZE];
+};
+
+struct ssl_nego_cache *
+ssl_nego_cache_new(void)
+{
+	struct ssl_nego_cache *cache;
+
+	if ((cache = calloc(1, sizeof(*cache))) == NULL)
+		return NULL;
+	if (pthread_mutex_init(&cache->lock, NULL) != 0) {
+		free(cache);
+		return NULL;
+	}
+
+	return cache;
+}
+
+void
+ssl_nego_cache_free(struct ssl_nego_cache *cache)
+{
+	size_t i;
+
+	if (cache == NULL)
+		return;
+
+	for (i = 0; i < SSL_NEGO_CACHE_SIZE; i++)
+		ssl_cert_free(cache->entries[i].cert);
+	pthread_mutex_destroy(&cache->lock);
+	free(cache);
+}
+
+static void
+ssl_nego_hash_list(SHA256_CTX *sha, const void *list, size_t len, size_t size)
+{
+	uint8_t present = (list != NULL);
+
+	SHA256_Update(sha, &present, sizeof(present));
+	SHA256_Update(sha, &len, sizeof(len));
+	if (len > 0)
+		SHA256_Update(sha, list, len * size);
+}
+
+static void
+ssl_nego_hash_ciphers(SHA256_CTX *sha, STACK_OF(SSL_CIPHER) *ciphers)
+{
+	const SSL_CIPHER *cipher;
+	int i, num;
+
+	num = sk_SSL_CIPHER_num(ciphers);
+	SHA256_Update(sha, &num, sizeof(num));
+	for (i = 0; i < num; i++) {
+		cipher = sk_SSL_CIPHER_value(ciphers, i);
+		SHA256_Update(sha, &cipher->id, sizeof(cipher->id));
+	}
+}
+
+/*
+ * Compute the cache key for the current handshake and keep it, so that the
+ * group and signature algorithm can be looked up later in the handshake.
+ */
+static void
+ssl_nego_key(SSL *s, STACK_OF(SSL_CIPHER) *clnt, STACK_OF(SSL_CIPHER) *srvr)
+{
+	const uint16_t *groups;
+	const uint8_t *formats;
+	size_t groups_len, formats_len;
+	SHA256_CTX sha;
+
+	SHA256_Init(&sha);
+
+	SHA256_Update(&sha, &S3I(s)->hs.negotiated_tls_version,
+	    sizeof(S3I(s)->hs.negotiated_tls_version));
+	SHA256_Update(&sha, &s->internal->options,
+	    sizeof(s->internal->options));
+	SHA256_Update(&sha, &s->cert, sizeof(s->cert));
+
+	ssl_nego_hash_ciphers(&sha, clnt);
+	ssl_nego_hash_ciphers(&sha, srvr);
+
+	tls1_get_group_list(s, 1, &groups, &groups_len);
+	ssl_nego_hash_list(&sha, groups, groups_len, sizeof(*groups));
+	tls1_get_group_list(s, 0, &groups, &groups_len);
+	ssl_nego_hash_list(&sha, groups, groups_len, sizeof(*groups));
+	tls1_get_formatlist(s, 1, &formats, &formats_len);
+	ssl_nego_hash_list(&sha, formats, formats_len, sizeof(*formats));
+	ssl_nego_hash_list(&sha, S3I(s)->hs.sigalgs, S3I(s)->hs.sigalgs_len,
+	    sizeof(*S3I(s)->hs.sigalgs));
+
+	SHA256_Final(S3I(s)->hs.nego_key, &sha);
+	S3I(s)->hs.nego_key_valid = 1;
+
+	explicit_bzero(&sha, sizeof(sha));
+}
+
+static struct ssl_nego_cache *
+ssl_nego_cache(SSL *s)
+{
+	if (!s->server || s->cert == NULL || !S3I(s)->hs.nego_key_valid)
+		return NULL;
+
+	return s->ctx->internal->nego_cache;
+}
+
+static struct ssl_nego_entry *
+ssl_nego_entry(struct ssl_nego_cache *cache, SSL *s)
+{
+	const uint8_t *key = S3I(s)->hs.nego_key;
+
+	return &cache->entries[(key[0] | key[1] << 8) % SSL_NEGO_CACHE_SIZE];
+}
+
+static int
+ssl_nego_entry_match(struct ssl_nego_entry *entry, SSL *s, int flag)
+{
+	if ((entry->flags & flag) == 0 || entry->cert != s->cert)
+		return 0;
+
+	return memcmp(entry->key, S3I(s)->hs.nego_key,
+	    sizeof(entry->key)) == 0;
+}
+
+/*
+ * Return the entry for the current handshake, replacing whatever held its
+ * slot.  Called with the lock held, the CERT that was replaced is returned
+ * in old_cert to be freed once the lock has been released.
+ */
+static struct ssl_nego_entry *
+ssl_nego_entry_claim(struct ssl_nego_cache *cache, SSL *s, CERT **old_cert)
+{
+	struct ssl_nego_entry *entry;
+
+	*old_cert = NULL;
+
+	entry = ssl_nego_entry(cache, s);
+	if (entry->cert == s->cert && memcmp(entry->key, S3I(s)->hs.nego_key,
+	    sizeof(entry->key)) == 0)
+		return entry;
+
+	*old_cert = entry->cert;
+	memset(entry, 0, sizeof(*entry));
+	memcpy(entry->key, S3I(s)->hs.nego_key, sizeof(entry->key));
+	entry->cert = ssl_cert_share(s->cert);
+
+	return entry;
+}
+
+int
+ssl_nego_cache_get_cipher(SSL *s, STACK_OF(SSL_CIPHER) *clnt,
+    STACK_OF(SSL_CIPHER) *srvr, const SSL_CIPHER **cipher)
+{
+	struct ssl_nego_cache *cache;
+	struct ssl_nego_entry *entry;
+	int found = 0;
+
+	S3I(s)->hs.nego_key_valid = 0;
+	if (!s->server || s->cert == NULL ||
+	    s->ctx->internal->nego_cache == NULL)
+		return 0;
+
+	ssl_nego_key(s, clnt, srvr);
+	if ((cache = ssl_nego_cache(s)) == NULL)
+		return 0;
+
+	pthread_mutex_lock(&cache->lock);
+	entry = ssl_nego_entry(cache, s);
+	if (ssl_nego_entry_match(entry, s, SSL_NEGO_CIPHER)) {
+		*cipher = entry->cipher;
+		found = 1;
+	}
+	pthread_mutex_unlock(&cache->lock);
+
+	return found;
+}
+
+void
+ssl_nego_cache_set_cipher(SSL *s, const SSL_CIPHER *cipher)
+{
+	struct ssl_nego_cache *cache;
+	struct ssl_nego_entry *entry;
+	CERT *old_cert;
+
+	if ((cache = ssl_nego_cache(s)) == NULL)
+		return;
+
+	pthread_mutex_lock(&cache->lock);
+	entry = ssl_nego_entry_claim(cache, s, &old_cert);
+	entry->cipher = cipher;
+	entry->flags |= SSL_NEGO_CIPHER;
+	pthread_mutex_unlock(&cache->lock);
+
+	ssl_cert_free(old_cert);
+}
+
+int
+ssl_nego_cache_get_group(SSL *s, int *nid)
+{
+	struct ssl_nego_cache *cache;
+	struct ssl_nego_entry *entry;
+	int found = 0;
+
+	if ((cache = ssl_nego_cache(s)) == NULL)
+		return 0;
+
+	pthread_mutex_lock(&cache->lock);
+	entry = ssl_nego_entry(cache, s);
+	if (ssl_nego_entry_match(entry, s, SSL_NEGO_GROUP)) {
+		*nid = entry->group_nid;
+		found = 1;
+	}
+	pthread_mutex_unlock(&cache->lock);
+
+	return found;
+}
+
+void
+ssl_nego_cache_set_group(SSL *s, int nid)
+{
+	struct ssl_nego_cache *cache;
+	struct ssl_nego_entry *entry;
+	CERT *old_cert;
+
+	if ((cache = ssl_nego_cache(s)) == NULL)
+		return;
+
+	pthread_mutex_lock(&cache->lock);
+	entry = ssl_nego_entry_claim(cache, s, &old_cert);
+	entry->group_nid = nid;
+	entry->flags |= SSL_NEGO_GROUP;
+	pthread_mutex_unlock(&cache->lock);
+
+	ssl_cert_free(old_cert);
+}
+
+int
+ssl_nego_cache_get_sigalg(SSL *s, EVP_PKEY *pkey,
+    const struct ssl_sigalg **sigalg)
+{
+	struct ssl_nego_cache *cache;
+	struct ssl_nego_entry *entry;
+	int found = 0;
+
+	if ((cache = ssl_nego_cache(s)) == NULL)
+		return 0;
+
+	pthread_mutex_lock(&cache->lock);
+	entry = ssl_nego_entry(cache, s);
+	if (ssl_nego_entry_match(entry, s, SSL_NEGO_SIGALG) &&
+	    entry->sigalg_pkey == pkey) {
+		*sigalg = entry->sigalg;
+		found = 1;
+	}
+	pthread_mutex_unlock(&cache->lock);
+
+	return found;
+}
+
+void
+ssl_nego_cache_set_sigalg(SSL *s, EVP_PKEY *pkey,
+    const struct ssl_sigalg *sigalg)
+{
+	struct ssl_nego_cache *cache;
+	struct ssl_nego_entry *entry;
+	CERT *old_cert;
+	int i;
+
+	if ((cache = ssl_nego_cache(s)) == NULL)
+		return;
+
+	/*
+	 * Only the keys of the CERT are remembered, since the entry holds a
+	 * reference that keeps them from being freed and reused.
+	 */
+	for (i = 0; i < SSL_PKEY_NUM; i++) {
+		if (s->cert->pkeys[i].privatekey == pkey)
+			break;
+	}
+	if (i == SSL_PKEY_NUM)
+		return;
+
+	pthread_mutex_lock(&cache->lock);
+	entry = ssl_nego_entry_claim(cache, s, &old_cert);
+	entry->sigalg_pkey = pkey;
+	entry->sigalg = sigalg;
+	entry->flags |= SSL_NEGO_SIGALG;
+	pthread_mutex_unlock(&cache->lock);
+
+	ssl_cert_free(old_cert);
+}
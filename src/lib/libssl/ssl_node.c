@@ -0,0 +1,285 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Per node replicas of SSL_CTX state.
+ *
+ * On machines with several memory nodes, the state of an SSL_CTX that every
+ * handshake uses is remote to most threads, and the counters that every
+ * handshake updates bounce between the caches of the nodes. Once
+ * SSL_CTX_set_numa_nodes() has been called, each node gets its own
+ * handshake counters and its own copies of the keyed AEADs for session
+ * tickets and HelloRetryRequest cookies. Threads name the node they run on
+ * with SSL_set_thread_numa_node(), as libssl has no portable way of finding
+ * out. A replica is allocated and filled by the first thread of its node
+ * that needs it, so that its memory is local to that node on systems that
+ * place pages on first touch.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <openssl/evp.h>
+
+#include "ssl_locl.h"
+
+#define SSL_NUMA_NODES_MAX	64
+
+struct ssl_node {
+	struct ssl_stats *stats;
+	EVP_AEAD_CTX tick_aead_ctx;
+	EVP_AEAD_CTX cookie_aead_ctx;
+};
+
+static pthread_once_t ssl_node_once = PTHREAD_ONCE_INIT;
+static pthread_key_t ssl_node_key;
+static int ssl_node_key_valid;
+
+static void
+ssl_node_key_init(void)
+{
+	ssl_node_key_valid = (pthread_key_create(&ssl_node_key, NULL) == 0);
+}
+
+int
+SSL_set_thread_numa_node(unsigned int node)
+{
+	if (node >= SSL_NUMA_NODES_MAX)
+		return 0;
+
+	if (pthread_once(&ssl_node_once, ssl_node_key_init) != 0 ||
+	    !ssl_node_key_valid)
+		return 0;
+
+	/* Store node + 1, so that threads that never set it read node 0. */
+	return pthread_setspecific(ssl_node_key,
+	    (void *)(uintptr_t)(node + 1)) == 0;
+}
+
+unsigned int
+SSL_get_thread_numa_node(void)
+{
+	void *value;
+
+	if (pthread_once(&ssl_node_once, ssl_node_key_init) != 0 ||
+	    !ssl_node_key_valid)
+		return 0;
+	if ((value = pthread_getspecific(ssl_node_key)) == NULL)
+		return 0;
+
+	return (uintptr_t)value - 1;
+}
+
+static void
+ssl_node_free(struct ssl_node *node)
+{
+	if (node == NULL)
+		return;
+
+	ssl_stats_free(node->stats);
+	EVP_AEAD_CTX_cleanup(&node->tick_aead_ctx);
+	EVP_AEAD_CTX_cleanup(&node->cookie_aead_ctx);
+	free(node);
+}
+
+static struct ssl_node *
+ssl_node_new(SSL_CTX *ctx)
+{
+	struct ssl_node *node;
+
+	if ((node = calloc(1, sizeof(*node))) == NULL)
+		return NULL;
+	if ((node->stats = ssl_stats_new()) == NULL)
+		goto err;
+	if (!EVP_AEAD_CTX_copy(&node->tick_aead_ctx,
+	    &ctx->internal->tlsext_tick_aead_ctx))
+		goto err;
+	if (!EVP_AEAD_CTX_copy(&node->cookie_aead_ctx,
+	    &ctx->internal->tls13_cookie_aead_ctx))
+		goto err;
+
+	return node;
+
+ err:
+	ssl_node_free(node);
+
+	return NULL;
+}
+
+/*
+ * Return the replica for the node of the calling thread, creating it on
+ * first use. Without replicas, or if one cannot be created, return NULL
+ * and leave the caller to use the state of the SSL_CTX.
+ */
+static struct ssl_node *
+ssl_ctx_node(SSL_CTX *ctx)
+{
+	struct ssl_node **slot, *node;
+
+	if (ctx->internal->nodes == NULL)
+		return NULL;
+
+	slot = &ctx->internal->nodes[SSL_get_thread_numa_node() %
+	    ctx->internal->nodes_num];
+	if ((node = *slot) != NULL)
+		return node;
+
+	if ((node = ssl_node_new(ctx)) == NULL)
+		return NULL;
+	if (!__sync_bool_compare_and_swap(slot, NULL, node)) {
+		/* Another thread of the node got there first. */
+		ssl_node_free(node);
+		node = *slot;
+	}
+
+	return node;
+}
+
+struct ssl_stats *
+ssl_ctx_stats(SSL_CTX *ctx)
+{
+	struct ssl_node *node;
+
+	if ((node = ssl_ctx_node(ctx)) != NULL)
+		return node->stats;
+
+	return ctx->internal->stats_hs;
+}
+
+/*
+ * Return counter block i of the SSL_CTX, where block 0 is the one of the
+ * SSL_CTX itself and the others are those of the replicas. Replicas that
+ * have not been created yet have none.
+ */
+struct ssl_stats *
+ssl_ctx_stats_index(SSL_CTX *ctx, unsigned int i)
+{
+	struct ssl_node *node;
+
+	if (i == 0)
+		return ctx->internal->stats_hs;
+	if (ctx->internal->nodes == NULL || i > ctx->internal->nodes_num)
+		return NULL;
+	if ((node = ctx->internal->nodes[i - 1]) == NULL)
+		return NULL;
+
+	return node->stats;
+}
+
+unsigned int
+ssl_ctx_stats_num(SSL_CTX *ctx)
+{
+	return 1 + ctx->internal->nodes_num;
+}
+
+const EVP_AEAD_CTX *
+ssl_ctx_ticket_aead_ctx(SSL_CTX *ctx)
+{
+	struct ssl_node *node;
+
+	if ((node = ssl_ctx_node(ctx)) != NULL)
+		return &node->tick_aead_ctx;
+
+	return &ctx->internal->tlsext_tick_aead_ctx;
+}
+
+const EVP_AEAD_CTX *
+ssl_ctx_cookie_aead_ctx(SSL_CTX *ctx)
+{
+	struct ssl_node *node;
+
+	if ((node = ssl_ctx_node(ctx)) != NULL)
+		return &node->cookie_aead_ctx;
+
+	return &ctx->internal->tls13_cookie_aead_ctx;
+}
+
+/*
+ * Copy new ticket keys to the replicas. Like the keys of the SSL_CTX, these
+ * must not be changed while handshakes are running.
+ */
+int
+ssl_ctx_nodes_ticket_aead_update(SSL_CTX *ctx)
+{
+	struct ssl_node *node;
+	unsigned int i;
+
+	for (i = 0; i < ctx->internal->nodes_num; i++) {
+		if ((node = ctx->internal->nodes[i]) == NULL)
+			continue;
+		EVP_AEAD_CTX_cleanup(&node->tick_aead_ctx);
+		if (!EVP_AEAD_CTX_copy(&node->tick_aead_ctx,
+		    &ctx->internal->tlsext_tick_aead_ctx))
+			return 0;
+	}
+
+	return 1;
+}
+
+/* Free the replicas, keeping their counts in the SSL_CTX. */
+void
+ssl_ctx_nodes_free(SSL_CTX *ctx)
+{
+	struct ssl_node *node;
+	unsigned int i;
+
+	for (i = 0; i < ctx->internal->nodes_num; i++) {
+		if ((node = ctx->internal->nodes[i]) == NULL)
+			continue;
+		ssl_stats_merge(ctx->internal->stats_hs, node->stats);
+		ssl_node_free(node);
+	}
+	free(ctx->internal->nodes);
+
+	ctx->internal->nodes = NULL;
+	ctx->internal->nodes_num = 0;
+}
+
+int
+SSL_CTX_set_numa_nodes(SSL_CTX *ctx, unsigned int nodes)
+{
+	struct ssl_node **new_nodes = NULL;
+
+	if (nodes > SSL_NUMA_NODES_MAX)
+		return 0;
+
+	if (nodes > 1) {
+		if ((new_nodes = calloc(nodes, sizeof(*new_nodes))) == NULL) {
+			SSLerrorx(ERR_R_MALLOC_FAILURE);
+			return 0;
+		}
+	}
+
+	ssl_ctx_nodes_free(ctx);
+
+	if (new_nodes != NULL) {
+		ctx->internal->nodes = new_nodes;
+		ctx->internal->nodes_num = nodes;
+	}
+
+	return 1;
+}
+
+unsigned int
+SSL_CTX_get_numa_nodes(const SSL_CTX *ctx)
+{
+	if (ctx->internal->nodes == NULL)
+		return 1;
+
+	return ctx->internal->nodes_num;
+}
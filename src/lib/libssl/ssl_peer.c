@@ -0,0 +1,144 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Peer certificate cache.
+ *
+ * With SSL_OP_TICKET_PEER_CERT_DIGEST, a session ticket refers to the peer
+ * certificate by its SHA-256 digest rather than carrying it.  The
+ * certificate is kept in a small direct mapped cache held by the SSL_CTX that
+ * issued the ticket, and a ticket whose certificate is no longer there is
+ * not accepted, which results in a full handshake.
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+#include <openssl/x509.h>
+
+#include "ssl_locl.h"
+
+#define SSL_PEER_CACHE_SIZE	128
+
+struct ssl_peer_entry {
+	uint8_t digest[SHA256_DIGEST_LENGTH];
+	X509 *cert;
+};
+
+struct ssl_peer_cache {
+	pthread_mutex_t lock;
+	struct ssl_peer_entry entries[SSL_PEER_CACHE_SIZE];
+};
+
+struct ssl_peer_cache *
+ssl_peer_cache_new(void)
+{
+	struct ssl_peer_cache *cache;
+
+	if ((cache = calloc(1, sizeof(*cache))) == NULL)
+		return NULL;
+	if (pthread_mutex_init(&cache->lock, NULL) != 0) {
+		free(cache);
+		return NULL;
+	}
+
+	return cache;
+}
+
+void
+ssl_peer_cache_free(struct ssl_peer_cache *cache)
+{
+	size_t i;
+
+	if (cache == NULL)
+		return;
+
+	for (i = 0; i < SSL_PEER_CACHE_SIZE; i++)
+		X509_free(cache->entries[i].cert);
+	pthread_mutex_destroy(&cache->lock);
+	free(cache);
+}
+
+static struct ssl_peer_entry *
+ssl_peer_cache_entry(struct ssl_peer_cache *cache, const uint8_t *digest)
+{
+	return &cache->entries[(digest[0] << 8 | digest[1]) %
+	    SSL_PEER_CACHE_SIZE];
+}
+
+/*
+ * Add cert to the cache, replacing whatever was in its slot, and return its
+ * digest.
+ */
+int
+ssl_peer_cache_add(struct ssl_peer_cache *cache, X509 *cert, uint8_t *digest,
+    size_t digest_len)
+{
+	struct ssl_peer_entry *entry;
+	X509 *old_cert = NULL;
+	unsigned int len;
+
+	if (cache == NULL || digest_len != SHA256_DIGEST_LENGTH)
+		return 0;
+
+	if (!X509_digest(cert, EVP_sha256(), digest, &len))
+		return 0;
+	if (len != SHA256_DIGEST_LENGTH)
+		return 0;
+
+	pthread_mutex_lock(&cache->lock);
+	entry = ssl_peer_cache_entry(cache, digest);
+	if (entry->cert != cert) {
+		X509_up_ref(cert);
+		old_cert = entry->cert;
+		entry->cert = cert;
+		memcpy(entry->digest, digest, sizeof(entry->digest));
+	}
+	pthread_mutex_unlock(&cache->lock);
+
+	X509_free(old_cert);
+
+	return 1;
+}
+
+/*
+ * Return a reference to the certificate with the given digest, or NULL if
+ * it is not in the cache.
+ */
+X509 *
+ssl_peer_cache_get(struct ssl_peer_cache *cache, const uint8_t *digest,
+    size_t digest_len)
+{
+	struct ssl_peer_entry *entry;
+	X509 *cert = NULL;
+
+	if (cache == NULL || digest_len != SHA256_DIGEST_LENGTH)
+		return NULL;
+
+	pthread_mutex_lock(&cache->lock);
+	entry = ssl_peer_cache_entry(cache, digest);
+	if (entry->cert != NULL &&
+	    memcmp(entry->digest, digest, sizeof(entry->digest)) == 0) {
+		X509_up_ref(entry->cert);
+		cert = entry->cert;
+	}
+	pthread_mutex_unlock(&cache->lock);
+
+	return cert;
+}
@@ -327,9 +327,8 @@ ssl3_get_record(SSL *s)
 {
 	SSL3_BUFFER_INTERNAL *rb = &(S3I(s)->rbuf);
 	SSL3_RECORD_INTERNAL *rr = &(S3I(s)->rrec);
-	uint8_t alert_desc;
-	uint8_t *out;
-	size_t out_len;
+	uint8_t alert_desc, content_type;
+	CBS plaintext;
 	int al, n;
 	int ret = -1;
 
@@ -406,7 +405,7 @@ ssl3_get_record(SSL *s)
 	tls12_record_layer_set_version(s->internal->rl, s->version);
 
 	if (!tls12_record_layer_open_record(s->internal->rl, s->internal->packet,
-	    s->internal->packet_length, &out, &out_len)) {
+	    s->internal->packet_length, &content_type, &plaintext)) {
 		tls12_record_layer_alert(s->internal->rl, &alert_desc);
 
 		if (alert_desc == 0)
@@ -421,8 +420,9 @@ ssl3_get_record(SSL *s)
 		goto fatal_err;
 	}
 
-	rr->data = out;
-	rr->length = out_len;
+	rr->type = content_type;
+	rr->data = (unsigned char *)CBS_data(&plaintext);
+	rr->length = CBS_len(&plaintext);
 	rr->off = 0;
 
 	/* we have pulled in a full packet so zero things */
@@ -664,7 +664,11 @@ ssl3_write_pending(SSL *s, int type, const unsigned char *buf, unsigned int len)
 		if (i == wb->left) {
 			wb->left = 0;
 			wb->offset += i;
-			if (s->internal->mode & SSL_MODE_RELEASE_BUFFERS &&
+			/* The kernel may still be sending from the buffer. */
+			if (ssl_zerocopy_retire(s, wb->buf, wb->len)) {
+				wb->buf = NULL;
+				wb->len = 0;
+			} else if (s->internal->mode & SSL_MODE_RELEASE_BUFFERS &&
 			    !SSL_is_dtls(s))
 				ssl3_release_write_buffer(s);
 			s->internal->rwstate = SSL_NOTHING;
@@ -1014,6 +1018,7 @@ ssl3_read_bytes(SSL *s, int type, unsigned char *buf, int len, int peek)
 		} else if (alert_level == SSL3_AL_FATAL) {
 			s->internal->rwstate = SSL_NOTHING;
 			S3I(s)->fatal_alert = alert_descr;
+			ssl_stats_alert(s, 0, alert_descr);
 			SSLerror(s, SSL_AD_REASON_OFFSET + alert_descr);
 			ERR_asprintf_error_data("SSL alert number %d",
 			    alert_descr);
@@ -1194,6 +1199,8 @@ ssl3_send_alert(SSL *s, int level, int desc)
 	/* If a fatal one, remove from cache */
 	if ((level == 2) && (s->session != NULL))
 		SSL_CTX_remove_session(s->ctx, s->session);
+	if (level == SSL3_AL_FATAL)
+		ssl_stats_alert(s, 1, desc);
 
 	S3I(s)->alert_dispatch = 1;
 	S3I(s)->send_alert[0] = level;
@@ -66,11 +66,11 @@
 
 #include "ssl_locl.h"
 
-static int ssl_set_cert(CERT *c, X509 *x509);
-static int ssl_set_pkey(CERT *c, EVP_PKEY *pkey);
-static int use_certificate_chain_bio(BIO *in, CERT *cert,
+static int ssl_set_cert(CERT **certp, X509 *x509);
+static int ssl_set_pkey(CERT **certp, EVP_PKEY *pkey);
+static int use_certificate_chain_bio(BIO *in, CERT **certp,
     pem_password_cb *passwd_cb, void *passwd_arg);
-static int use_certificate_chain_file(const char *file, CERT *cert,
+static int use_certificate_chain_file(const char *file, CERT **certp,
     pem_password_cb *passwd_cb, void *passwd_arg);
 
 int
@@ -80,7 +80,7 @@ SSL_use_certificate(SSL *ssl, X509 *x)
 		SSLerror(ssl, ERR_R_PASSED_NULL_PARAMETER);
 		return (0);
 	}
-	return (ssl_set_cert(ssl->cert, x));
+	return (ssl_set_cert(&ssl->cert, x));
 }
 
 int
@@ -161,14 +161,15 @@ SSL_use_RSAPrivateKey(SSL *ssl, RSA *rsa)
 	RSA_up_ref(rsa);
 	EVP_PKEY_assign_RSA(pkey, rsa);
 
-	ret = ssl_set_pkey(ssl->cert, pkey);
+	ret = ssl_set_pkey(&ssl->cert, pkey);
 	EVP_PKEY_free(pkey);
 	return (ret);
 }
 
 static int
-ssl_set_pkey(CERT *c, EVP_PKEY *pkey)
+ssl_set_pkey(CERT **certp, EVP_PKEY *pkey)
 {
+	CERT *c;
 	int i;
 
 	i = ssl_cert_type(NULL, pkey);
@@ -177,6 +178,10 @@ ssl_set_pkey(CERT *c, EVP_PKEY *pkey)
 		return (0);
 	}
 
+	if (!ssl_cert_unshare(certp))
+		return (0);
+	c = *certp;
+
 	if (c->pkeys[i].x509 != NULL) {
 		EVP_PKEY *pktmp;
 		pktmp = X509_get_pubkey(c->pkeys[i].x509);
@@ -195,6 +200,7 @@ ssl_set_pkey(CERT *c, EVP_PKEY *pkey)
 		if (!X509_check_private_key(c->pkeys[i].x509, pkey)) {
 			X509_free(c->pkeys[i].x509);
 			c->pkeys[i].x509 = NULL;
+			ssl_cert_pkey_flush(&c->pkeys[i]);
 			return 0;
 		}
 	}
@@ -204,7 +210,6 @@ ssl_set_pkey(CERT *c, EVP_PKEY *pkey)
 	c->pkeys[i].privatekey = pkey;
 	c->key = &(c->pkeys[i]);
 
-	c->valid = 0;
 	return (1);
 }
 
@@ -273,7 +278,7 @@ SSL_use_PrivateKey(SSL *ssl, EVP_PKEY *pkey)
 		SSLerror(ssl, ERR_R_PASSED_NULL_PARAMETER);
 		return (0);
 	}
-	ret = ssl_set_pkey(ssl->cert, pkey);
+	ret = ssl_set_pkey(&ssl->cert, pkey);
 	return (ret);
 }
 
@@ -340,13 +345,14 @@ SSL_CTX_use_certificate(SSL_CTX *ctx, X509 *x)
 		SSLerrorx(ERR_R_PASSED_NULL_PARAMETER);
 		return (0);
 	}
-	return (ssl_set_cert(ctx->internal->cert, x));
+	return (ssl_set_cert(&ctx->internal->cert, x));
 }
 
 static int
-ssl_set_cert(CERT *c, X509 *x)
+ssl_set_cert(CERT **certp, X509 *x)
 {
 	EVP_PKEY *pkey;
+	CERT *c;
 	int i;
 
 	pkey = X509_get_pubkey(x);
@@ -362,6 +368,12 @@ ssl_set_cert(CERT *c, X509 *x)
 		return (0);
 	}
 
+	if (!ssl_cert_unshare(certp)) {
+		EVP_PKEY_free(pkey);
+		return (0);
+	}
+	c = *certp;
+
 	if (c->pkeys[i].privatekey != NULL) {
 		EVP_PKEY_copy_parameters(pkey, c->pkeys[i].privatekey);
 		ERR_clear_error();
@@ -394,9 +406,9 @@ ssl_set_cert(CERT *c, X509 *x)
 	X509_free(c->pkeys[i].x509);
 	CRYPTO_add(&x->references, 1, CRYPTO_LOCK_X509);
 	c->pkeys[i].x509 = x;
+	ssl_cert_pkey_flush(&c->pkeys[i]);
 	c->key = &(c->pkeys[i]);
 
-	c->valid = 0;
 	return (1);
 }
 
@@ -477,7 +489,7 @@ SSL_CTX_use_RSAPrivateKey(SSL_CTX *ctx, RSA *rsa)
 	RSA_up_ref(rsa);
 	EVP_PKEY_assign_RSA(pkey, rsa);
 
-	ret = ssl_set_pkey(ctx->internal->cert, pkey);
+	ret = ssl_set_pkey(&ctx->internal->cert, pkey);
 	EVP_PKEY_free(pkey);
 	return (ret);
 }
@@ -545,7 +557,7 @@ SSL_CTX_use_PrivateKey(SSL_CTX *ctx, EVP_PKEY *pkey)
 		SSLerrorx(ERR_R_PASSED_NULL_PARAMETER);
 		return (0);
 	}
-	return (ssl_set_pkey(ctx->internal->cert, pkey));
+	return (ssl_set_pkey(&ctx->internal->cert, pkey));
 }
 
 int
@@ -612,7 +624,7 @@ SSL_CTX_use_PrivateKey_ASN1(int type, SSL_CTX *ctx, const unsigned char *d,
  * sent to the peer in the Certificate message.
  */
 static int
-use_certificate_chain_bio(BIO *in, CERT *cert, pem_password_cb *passwd_cb,
+use_certificate_chain_bio(BIO *in, CERT **certp, pem_password_cb *passwd_cb,
     void *passwd_arg)
 {
 	X509 *ca, *x = NULL;
@@ -625,16 +637,16 @@ use_certificate_chain_bio(BIO *in, CERT *cert, pem_password_cb *passwd_cb,
 		goto err;
 	}
 
-	if (!ssl_set_cert(cert, x))
+	if (!ssl_set_cert(certp, x))
 		goto err;
 
-	if (!ssl_cert_set0_chain(cert, NULL))
+	if (!ssl_cert_set0_chain(*certp, NULL))
 		goto err;
 
 	/* Process any additional CA certificates. */
 	while ((ca = PEM_read_bio_X509(in, NULL, passwd_cb, passwd_arg)) !=
 	    NULL) {
-		if (!ssl_cert_add0_chain_cert(cert, ca)) {
+		if (!ssl_cert_add0_chain_cert(*certp, ca)) {
 			X509_free(ca);
 			goto err;
 		}
@@ -655,7 +667,7 @@ use_certificate_chain_bio(BIO *in, CERT *cert, pem_password_cb *passwd_cb,
 }
 
 int
-use_certificate_chain_file(const char *file, CERT *cert,
+use_certificate_chain_file(const char *file, CERT **certp,
     pem_password_cb *passwd_cb, void *passwd_arg)
 {
 	BIO *in;
@@ -672,7 +684,7 @@ use_certificate_chain_file(const char *file, CERT *cert,
 		goto end;
 	}
 
-	ret = use_certificate_chain_bio(in, cert, passwd_cb, passwd_arg);
+	ret = use_certificate_chain_bio(in, certp, passwd_cb, passwd_arg);
 
  end:
 	BIO_free(in);
@@ -682,7 +694,7 @@ use_certificate_chain_file(const char *file, CERT *cert,
 int
 SSL_CTX_use_certificate_chain_file(SSL_CTX *ctx, const char *file)
 {
-	return use_certificate_chain_file(file, ctx->internal->cert,
+	return use_certificate_chain_file(file, &ctx->internal->cert,
 	    ctx->default_passwd_callback,
 	    ctx->default_passwd_callback_userdata);
 }
@@ -690,7 +702,7 @@ SSL_CTX_use_certificate_chain_file(SSL_CTX *ctx, const char *file)
 int
 SSL_use_certificate_chain_file(SSL *ssl, const char *file)
 {
-	return use_certificate_chain_file(file, ssl->cert,
+	return use_certificate_chain_file(file, &ssl->cert,
 	    ssl->ctx->default_passwd_callback,
 	    ssl->ctx->default_passwd_callback_userdata);
 }
@@ -707,7 +719,7 @@ SSL_CTX_use_certificate_chain_mem(SSL_CTX *ctx, void *buf, int len)
 		goto end;
 	}
 
-	ret = use_certificate_chain_bio(in, ctx->internal->cert,
+	ret = use_certificate_chain_bio(in, &ctx->internal->cert,
 	    ctx->default_passwd_callback,
 	    ctx->default_passwd_callback_userdata);
 
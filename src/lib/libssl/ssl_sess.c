@@ -135,6 +135,11 @@
  * OTHERWISE.
  */
 
+#include <sys/mman.h>
+
+#include <pthread.h>
+#include <string.h>
+
 #include <openssl/lhash.h>
 #include <openssl/opensslconf.h>
 
@@ -144,8 +149,49 @@
 
 #include "ssl_locl.h"
 
-static void SSL_SESSION_list_remove(SSL_CTX *ctx, SSL_SESSION *s);
-static void SSL_SESSION_list_add(SSL_CTX *ctx, SSL_SESSION *s);
+/*
+ * A shard of the internal session cache. When the cache is sharded, each
+ * session is assigned to a shard based on its session ID, with each shard
+ * having its own lock, hash table and list of sessions.
+ */
+struct ssl_session_shard {
+	pthread_mutex_t lock;
+	struct lhash_st_SSL_SESSION *sessions;
+	struct ssl_session_st *head;
+	struct ssl_session_st *tail;
+};
+
+/*
+ * Maximum number of expired sessions that are removed from the session cache
+ * (or a shard of it) each time that a session is added to it.
+ */
+#define SSL_SESSION_CACHE_EXPIRE_MAX	8
+
+/*
+ * A slot of the shared session cache. Slots live in memory that is shared
+ * between processes and are updated without locks - a writer claims a slot by
+ * making its sequence number odd and releases it by making it even again,
+ * while readers retry if the sequence number is odd or changes while the
+ * slot is being copied.
+ */
+#define SSL_SESSION_SHM_SLOT_DER_LEN	2000
+#define SSL_SESSION_SHM_PROBE		4
+#define SSL_SESSION_SHM_RETRY		4
+
+struct ssl_session_shm_slot {
+	volatile unsigned int seq;
+	unsigned int id_len;
+	unsigned char id[SSL_MAX_SSL_SESSION_ID_LENGTH];
+	int64_t expire;
+	unsigned int der_len;
+	unsigned char der[SSL_SESSION_SHM_SLOT_DER_LEN];
+};
+
+static void ssl_session_shm_remove(SSL_CTX *ctx, SSL_SESSION *sess);
+static void SSL_SESSION_list_remove(SSL_SESSION **head, SSL_SESSION **tail,
+    SSL_SESSION *s);
+static void SSL_SESSION_list_add(SSL_SESSION **head, SSL_SESSION **tail,
+    SSL_SESSION *s);
 static int remove_session_lock(SSL_CTX *ctx, SSL_SESSION *c, int lck);
 
 /* aka SSL_get0_session; gets 0 objects, just returns a copy of the pointer */
@@ -169,7 +215,7 @@ SSL_get1_session(SSL *ssl)
 	CRYPTO_w_lock(CRYPTO_LOCK_SSL_SESSION);
 	sess = ssl->session;
 	if (sess)
-		sess->references++;
+		CRYPTO_add(&sess->references, 1, CRYPTO_LOCK_SSL_SESSION);
 	CRYPTO_w_unlock(CRYPTO_LOCK_SSL_SESSION);
 
 	return (sess);
@@ -198,12 +244,13 @@ SSL_SESSION_get_ex_data(const SSL_SESSION *s, int idx)
 uint32_t
 SSL_SESSION_get_max_early_data(const SSL_SESSION *s)
 {
-	return 0;
+	return s->max_early_data;
 }
 
 int
 SSL_SESSION_set_max_early_data(SSL_SESSION *s, uint32_t max_early_data)
 {
+	s->max_early_data = max_early_data;
 	return 1;
 }
 
@@ -443,12 +490,7 @@ ssl_session_from_cache(SSL *s, CBS *session_id)
 	data.session_id_length = CBS_len(session_id);
 	memcpy(data.session_id, CBS_data(session_id), CBS_len(session_id));
 
-	CRYPTO_r_lock(CRYPTO_LOCK_SSL_CTX);
-	sess = lh_SSL_SESSION_retrieve(s->session_ctx->internal->sessions, &data);
-	if (sess != NULL)
-		CRYPTO_add(&sess->references, 1, CRYPTO_LOCK_SSL_SESSION);
-	CRYPTO_r_unlock(CRYPTO_LOCK_SSL_CTX);
-
+	sess = ssl_session_cache_retrieve(s->session_ctx, &data, 1);
 	if (sess == NULL)
 		s->session_ctx->internal->stats.sess_miss++;
 
@@ -640,11 +682,115 @@ ssl_get_prev_session(SSL *s, CBS *session_id, CBS *ext_block, int *alert)
 	return 0;
 }
 
+static time_t
+ssl_session_expiry(const SSL_SESSION *s)
+{
+	return s->time + s->timeout;
+}
+
+static struct ssl_session_shard *
+ssl_session_shard(SSL_CTX *ctx, const SSL_SESSION *s)
+{
+	unsigned int i, h = 0;
+
+	/*
+	 * The hash table uses the first bytes of the session ID, hence mix in
+	 * all of it so that shards do not end up with correlated buckets.
+	 */
+	for (i = 0; i < s->session_id_length && i < sizeof(s->session_id); i++)
+		h = h * 31 + s->session_id[i];
+
+	return &ctx->internal->session_shards[h %
+	    ctx->internal->session_shards_num];
+}
+
+/* Unlink a session from a shard - the shard must be locked. */
+static void
+ssl_session_shard_unlink(struct ssl_session_shard *shard, SSL_SESSION *s)
+{
+	(void)lh_SSL_SESSION_delete(shard->sessions, s);
+	SSL_SESSION_list_remove(&shard->head, &shard->tail, s);
+}
+
+static void
+ssl_session_cache_release(SSL_CTX *ctx, SSL_SESSION *s)
+{
+	s->internal->not_resumable = 1;
+	if (ctx->internal->remove_session_cb != NULL)
+		ctx->internal->remove_session_cb(ctx, s);
+	SSL_SESSION_free(s);
+}
+
+static int
+ssl_session_shard_add(SSL_CTX *ctx, SSL_SESSION *c)
+{
+	struct ssl_session_shard *shard;
+	unsigned long cache_size;
+	SSL_SESSION *s;
+	time_t now;
+	int i;
+
+	shard = ssl_session_shard(ctx, c);
+
+	/* The cache holds one reference, see SSL_CTX_add_session(). */
+	CRYPTO_add(&c->references, 1, CRYPTO_LOCK_SSL_SESSION);
+
+	pthread_mutex_lock(&shard->lock);
+
+	if ((s = lh_SSL_SESSION_insert(shard->sessions, c)) != NULL) {
+		if (s == c) {
+			/* Already in the cache. */
+			pthread_mutex_unlock(&shard->lock);
+			SSL_SESSION_free(c);
+			return 0;
+		}
+		/* Replace a different session with the same session ID. */
+		SSL_SESSION_list_remove(&shard->head, &shard->tail, s);
+		SSL_SESSION_free(s);
+	}
+	SSL_SESSION_list_add(&shard->head, &shard->tail, c);
+
+	/*
+	 * Rather than periodically walking the entire cache, remove expired
+	 * sessions from the end of the shard's list as sessions are added.
+	 */
+	now = time(NULL);
+	for (i = 0; i < SSL_SESSION_CACHE_EXPIRE_MAX; i++) {
+		if ((s = shard->tail) == NULL || s == c)
+			break;
+		if (now <= ssl_session_expiry(s))
+			break;
+		ssl_session_shard_unlink(shard, s);
+		ssl_session_cache_release(ctx, s);
+	}
+
+	/* Each shard holds an equal part of the cache. */
+	if ((cache_size = SSL_CTX_sess_get_cache_size(ctx)) > 0) {
+		cache_size = (cache_size + ctx->internal->session_shards_num -
+		    1) / ctx->internal->session_shards_num;
+		while (lh_SSL_SESSION_num_items(shard->sessions) > cache_size) {
+			if ((s = shard->tail) == NULL || s == c)
+				break;
+			ssl_session_shard_unlink(shard, s);
+			ssl_session_cache_release(ctx, s);
+			ctx->internal->stats.sess_cache_full++;
+		}
+	}
+
+	pthread_mutex_unlock(&shard->lock);
+
+	return 1;
+}
+
 int
 SSL_CTX_add_session(SSL_CTX *ctx, SSL_SESSION *c)
 {
-	int ret = 0;
 	SSL_SESSION *s;
+	time_t now;
+	int i, ret = 0;
+
+	if (ctx->internal->session_shards != NULL)
+		return ssl_session_shard_add(ctx, c);
 
 	/*
 	 * Add just 1 reference count for the SSL_CTX's session cache
@@ -667,7 +813,8 @@ SSL_CTX_add_session(SSL_CTX *ctx, SSL_SESSION *c)
 	 */
 	if (s != NULL && s != c) {
 		/* We *are* in trouble ... */
-		SSL_SESSION_list_remove(ctx, s);
+		SSL_SESSION_list_remove(&ctx->internal->session_cache_head,
+		    &ctx->internal->session_cache_tail, s);
 		SSL_SESSION_free(s);
 		/*
 		 * ... so pretend the other session did not exist in cache
@@ -679,9 +826,10 @@ SSL_CTX_add_session(SSL_CTX *ctx, SSL_SESSION *c)
 		s = NULL;
 	}
 
-	/* Put at the head of the queue unless it is already in the cache */
+	/* Put on the queue unless it is already in the cache */
 	if (s == NULL)
-		SSL_SESSION_list_add(ctx, c);
+		SSL_SESSION_list_add(&ctx->internal->session_cache_head,
+		    &ctx->internal->session_cache_tail, c);
 
 	if (s != NULL) {
 		/*
@@ -699,6 +847,19 @@ SSL_CTX_add_session(SSL_CTX *ctx, SSL_SESSION *c)
 
 		ret = 1;
 
+		/*
+		 * The list is ordered by expiry time, hence expired sessions
+		 * can be removed from its end without a walk of the cache.
+		 */
+		now = time(NULL);
+		for (i = 0; i < SSL_SESSION_CACHE_EXPIRE_MAX; i++) {
+			if ((s = ctx->internal->session_cache_tail) == NULL ||
+			    s == c || now <= ssl_session_expiry(s))
+				break;
+			if (!remove_session_lock(ctx, s, 0))
+				break;
+		}
+
 		if (SSL_CTX_sess_get_cache_size(ctx) > 0) {
 			while (SSL_CTX_sess_number(ctx) >
 			    SSL_CTX_sess_get_cache_size(ctx)) {
@@ -717,22 +878,51 @@ SSL_CTX_add_session(SSL_CTX *ctx, SSL_SESSION *c)
 int
 SSL_CTX_remove_session(SSL_CTX *ctx, SSL_SESSION *c)
 {
+	if (c != NULL)
+		ssl_session_shm_remove(ctx, c);
+
 	return remove_session_lock(ctx, c, 1);
 }
 
+static int
+ssl_session_shard_remove(SSL_CTX *ctx, SSL_SESSION *c)
+{
+	struct ssl_session_shard *shard;
+	int ret = 0;
+
+	shard = ssl_session_shard(ctx, c);
+
+	pthread_mutex_lock(&shard->lock);
+	if (lh_SSL_SESSION_retrieve(shard->sessions, c) == c) {
+		ssl_session_shard_unlink(shard, c);
+		ret = 1;
+	}
+	pthread_mutex_unlock(&shard->lock);
+
+	if (ret)
+		ssl_session_cache_release(ctx, c);
+
+	return ret;
+}
+
 static int
 remove_session_lock(SSL_CTX *ctx, SSL_SESSION *c, int lck)
 {
 	SSL_SESSION *r;
 	int ret = 0;
 
+	if (c != NULL && c->session_id_length != 0 &&
+	    ctx->internal->session_shards != NULL)
+		return ssl_session_shard_remove(ctx, c);
+
 	if ((c != NULL) && (c->session_id_length != 0)) {
 		if (lck)
 			CRYPTO_w_lock(CRYPTO_LOCK_SSL_CTX);
 		if ((r = lh_SSL_SESSION_retrieve(ctx->internal->sessions, c)) == c) {
 			ret = 1;
 			r = lh_SSL_SESSION_delete(ctx->internal->sessions, c);
-			SSL_SESSION_list_remove(ctx, c);
+			SSL_SESSION_list_remove(&ctx->internal->session_cache_head,
+			    &ctx->internal->session_cache_tail, c);
 		}
 		if (lck)
 			CRYPTO_w_unlock(CRYPTO_LOCK_SSL_CTX);
@@ -773,6 +963,7 @@ SSL_SESSION_free(SSL_SESSION *ss)
 
 	free(ss->tlsext_hostname);
 	free(ss->tlsext_tick);
+	free(ss->alpn_selected);
 	free(ss->internal->tlsext_ecpointformatlist);
 	free(ss->internal->tlsext_supportedgroups);
 
@@ -986,55 +1177,55 @@ SSL_set_session_ticket_ext(SSL *s, void *ext_data, int ext_len)
 	return 0;
 }
 
-typedef struct timeout_param_st {
-	SSL_CTX *ctx;
-	long time;
-	struct lhash_st_SSL_SESSION *cache;
-} TIMEOUT_PARAM;
-
 static void
-timeout_doall_arg(SSL_SESSION *s, TIMEOUT_PARAM *p)
+ssl_session_shard_flush(SSL_CTX *ctx, struct ssl_session_shard *shard, long t)
 {
-	if ((p->time == 0) || (p->time > (s->time + s->timeout))) {
-		/* timeout */
-		/* The reason we don't call SSL_CTX_remove_session() is to
-		 * save on locking overhead */
-		(void)lh_SSL_SESSION_delete(p->cache, s);
-		SSL_SESSION_list_remove(p->ctx, s);
-		s->internal->not_resumable = 1;
-		if (p->ctx->internal->remove_session_cb != NULL)
-			p->ctx->internal->remove_session_cb(p->ctx, s);
-		SSL_SESSION_free(s);
-	}
-}
-
-static void
-timeout_LHASH_DOALL_ARG(void *arg1, void *arg2)
-{
-	SSL_SESSION *a = arg1;
-	TIMEOUT_PARAM *b = arg2;
+	SSL_SESSION *s;
 
-	timeout_doall_arg(a, b);
+	pthread_mutex_lock(&shard->lock);
+	while ((s = shard->tail) != NULL) {
+		if (t != 0 && t <= ssl_session_expiry(s))
+			break;
+		ssl_session_shard_unlink(shard, s);
+		ssl_session_cache_release(ctx, s);
+	}
+	pthread_mutex_unlock(&shard->lock);
 }
 
+/*
+ * Sessions are listed in order of expiry time, with the session that expires
+ * first at the tail. Flushing therefore only visits the expired sessions.
+ */
 /* XXX 2038 */
 void
 SSL_CTX_flush_sessions(SSL_CTX *s, long t)
 {
+	struct lhash_st_SSL_SESSION *cache;
+	SSL_SESSION *r;
 	unsigned long i;
-	TIMEOUT_PARAM tp;
 
-	tp.ctx = s;
-	tp.cache = s->internal->sessions;
-	if (tp.cache == NULL)
+	/* Each shard is flushed in turn, without blocking the others. */
+	if (s->internal->session_shards != NULL) {
+		for (i = 0; i < s->internal->session_shards_num; i++)
+			ssl_session_shard_flush(s,
+			    &s->internal->session_shards[i], t);
+		return;
+	}
+
+	if ((cache = s->internal->sessions) == NULL)
 		return;
-	tp.time = t;
 	CRYPTO_w_lock(CRYPTO_LOCK_SSL_CTX);
-	i = CHECKED_LHASH_OF(SSL_SESSION, tp.cache)->down_load;
-	CHECKED_LHASH_OF(SSL_SESSION, tp.cache)->down_load = 0;
-	lh_SSL_SESSION_doall_arg(tp.cache, timeout_LHASH_DOALL_ARG,
-	TIMEOUT_PARAM, &tp);
-	CHECKED_LHASH_OF(SSL_SESSION, tp.cache)->down_load = i;
+	i = CHECKED_LHASH_OF(SSL_SESSION, cache)->down_load;
+	CHECKED_LHASH_OF(SSL_SESSION, cache)->down_load = 0;
+	while ((r = s->internal->session_cache_tail) != NULL) {
+		if (t != 0 && t <= ssl_session_expiry(r))
+			break;
+		/* The reason we don't call SSL_CTX_remove_session() is to
+		 * save on locking overhead */
+		if (!remove_session_lock(s, r, 0))
+			break;
+	}
+	CHECKED_LHASH_OF(SSL_SESSION, cache)->down_load = i;
 	CRYPTO_w_unlock(CRYPTO_LOCK_SSL_CTX);
 }
 
@@ -1049,30 +1240,30 @@ ssl_clear_bad_session(SSL *s)
 		return (0);
 }
 
-/* locked by SSL_CTX in the calling function */
+/* locked by SSL_CTX (or the session cache shard) in the calling function */
 static void
-SSL_SESSION_list_remove(SSL_CTX *ctx, SSL_SESSION *s)
+SSL_SESSION_list_remove(SSL_SESSION **head, SSL_SESSION **tail, SSL_SESSION *s)
 {
 	if ((s->internal->next == NULL) || (s->internal->prev == NULL))
 		return;
 
-	if (s->internal->next == (SSL_SESSION *)&(ctx->internal->session_cache_tail)) {
+	if (s->internal->next == (SSL_SESSION *)tail) {
 		/* last element in list */
-		if (s->internal->prev == (SSL_SESSION *)&(ctx->internal->session_cache_head)) {
+		if (s->internal->prev == (SSL_SESSION *)head) {
 			/* only one element in list */
-			ctx->internal->session_cache_head = NULL;
-			ctx->internal->session_cache_tail = NULL;
+			*head = NULL;
+			*tail = NULL;
 		} else {
-			ctx->internal->session_cache_tail = s->internal->prev;
+			*tail = s->internal->prev;
 			s->internal->prev->internal->next =
-			    (SSL_SESSION *)&(ctx->internal->session_cache_tail);
+			    (SSL_SESSION *)tail;
 		}
 	} else {
-		if (s->internal->prev == (SSL_SESSION *)&(ctx->internal->session_cache_head)) {
+		if (s->internal->prev == (SSL_SESSION *)head) {
 			/* first element in list */
-			ctx->internal->session_cache_head = s->internal->next;
+			*head = s->internal->next;
 			s->internal->next->internal->prev =
-			    (SSL_SESSION *)&(ctx->internal->session_cache_head);
+			    (SSL_SESSION *)head;
 		} else {
 			/* middle of list */
 			s->internal->next->internal->prev = s->internal->prev;
@@ -1083,22 +1274,416 @@ SSL_SESSION_list_remove(SSL_CTX *ctx, SSL_SESSION *s)
 }
 
 static void
-SSL_SESSION_list_add(SSL_CTX *ctx, SSL_SESSION *s)
+SSL_SESSION_list_add(SSL_SESSION **head, SSL_SESSION **tail, SSL_SESSION *s)
 {
-	if ((s->internal->next != NULL) && (s->internal->prev != NULL))
-		SSL_SESSION_list_remove(ctx, s);
+	SSL_SESSION *next;
 
-	if (ctx->internal->session_cache_head == NULL) {
-		ctx->internal->session_cache_head = s;
-		ctx->internal->session_cache_tail = s;
-		s->internal->prev = (SSL_SESSION *)&(ctx->internal->session_cache_head);
-		s->internal->next = (SSL_SESSION *)&(ctx->internal->session_cache_tail);
-	} else {
-		s->internal->next = ctx->internal->session_cache_head;
+	if ((s->internal->next != NULL) && (s->internal->prev != NULL))
+		SSL_SESSION_list_remove(head, tail, s);
+
+	if (*head == NULL) {
+		*head = s;
+		*tail = s;
+		s->internal->prev = (SSL_SESSION *)head;
+		s->internal->next = (SSL_SESSION *)tail;
+	} else if (ssl_session_expiry(s) >= ssl_session_expiry(*head)) {
+		s->internal->next = *head;
 		s->internal->next->internal->prev = s;
-		s->internal->prev = (SSL_SESSION *)&(ctx->internal->session_cache_head);
-		ctx->internal->session_cache_head = s;
+		s->internal->prev = (SSL_SESSION *)head;
+		*head = s;
+	} else {
+		/*
+		 * Keep the list ordered by expiry time. New sessions normally
+		 * expire last so this walk is only needed for sessions with a
+		 * shorter timeout or an earlier time than those in the cache.
+		 */
+		next = (*head)->internal->next;
+		while (next != (SSL_SESSION *)tail &&
+		    ssl_session_expiry(s) < ssl_session_expiry(next))
+			next = next->internal->next;
+		s->internal->next = next;
+		if (next == (SSL_SESSION *)tail) {
+			s->internal->prev = *tail;
+			*tail = s;
+		} else {
+			s->internal->prev = next->internal->prev;
+			next->internal->prev = s;
+		}
+		s->internal->prev->internal->next = s;
+	}
+}
+
+/*
+ * Look up a session in the internal session cache, optionally taking a
+ * reference to it.
+ */
+SSL_SESSION *
+ssl_session_cache_retrieve(SSL_CTX *ctx, SSL_SESSION *key, int ref)
+{
+	struct ssl_session_shard *shard;
+	SSL_SESSION *sess;
+
+	if (ctx->internal->session_shards != NULL) {
+		shard = ssl_session_shard(ctx, key);
+		pthread_mutex_lock(&shard->lock);
+		sess = lh_SSL_SESSION_retrieve(shard->sessions, key);
+		if (sess != NULL && ref)
+			CRYPTO_add(&sess->references, 1,
+			    CRYPTO_LOCK_SSL_SESSION);
+		pthread_mutex_unlock(&shard->lock);
+		return sess;
+	}
+
+	CRYPTO_r_lock(CRYPTO_LOCK_SSL_CTX);
+	sess = lh_SSL_SESSION_retrieve(ctx->internal->sessions, key);
+	if (sess != NULL && ref)
+		CRYPTO_add(&sess->references, 1, CRYPTO_LOCK_SSL_SESSION);
+	CRYPTO_r_unlock(CRYPTO_LOCK_SSL_CTX);
+
+	return sess;
+}
+
+unsigned long
+ssl_session_cache_count(SSL_CTX *ctx)
+{
+	struct ssl_session_shard *shard;
+	unsigned long count = 0;
+	unsigned int i;
+
+	if (ctx->internal->session_shards == NULL)
+		return lh_SSL_SESSION_num_items(ctx->internal->sessions);
+
+	for (i = 0; i < ctx->internal->session_shards_num; i++) {
+		shard = &ctx->internal->session_shards[i];
+		pthread_mutex_lock(&shard->lock);
+		count += lh_SSL_SESSION_num_items(shard->sessions);
+		pthread_mutex_unlock(&shard->lock);
+	}
+
+	return count;
+}
+
+static void
+ssl_session_shards_free(struct ssl_session_shard *shards, unsigned int num)
+{
+	unsigned int i;
+
+	if (shards == NULL)
+		return;
+
+	for (i = 0; i < num; i++) {
+		lh_SSL_SESSION_free(shards[i].sessions);
+		pthread_mutex_destroy(&shards[i].lock);
+	}
+	free(shards);
+}
+
+void
+ssl_session_cache_free(SSL_CTX *ctx)
+{
+	ssl_session_shards_free(ctx->internal->session_shards,
+	    ctx->internal->session_shards_num);
+	ctx->internal->session_shards = NULL;
+	ctx->internal->session_shards_num = 0;
+}
+
+int
+SSL_CTX_set_session_cache_shards(SSL_CTX *ctx, unsigned int shards)
+{
+	struct ssl_session_shard *new_shards = NULL;
+	unsigned int i;
+
+	/* Sessions are not moved between shards, hence the cache must be empty. */
+	if (shards > SSL_SESSION_CACHE_MAX_SHARDS ||
+	    ssl_session_cache_count(ctx) > 0) {
+		SSLerrorx(ERR_R_SHOULD_NOT_HAVE_BEEN_CALLED);
+		return 0;
+	}
+
+	if (shards > 1) {
+		if ((new_shards = calloc(shards, sizeof(*new_shards))) == NULL) {
+			SSLerrorx(ERR_R_MALLOC_FAILURE);
+			return 0;
+		}
+		for (i = 0; i < shards; i++) {
+			if (pthread_mutex_init(&new_shards[i].lock, NULL) != 0) {
+				ssl_session_shards_free(new_shards, i);
+				SSLerrorx(ERR_R_INTERNAL_ERROR);
+				return 0;
+			}
+			if ((new_shards[i].sessions =
+			    ssl_session_lhash_new()) == NULL) {
+				ssl_session_shards_free(new_shards, i + 1);
+				SSLerrorx(ERR_R_MALLOC_FAILURE);
+				return 0;
+			}
+		}
+	}
+
+	ssl_session_cache_free(ctx);
+	if (new_shards != NULL) {
+		ctx->internal->session_shards = new_shards;
+		ctx->internal->session_shards_num = shards;
+	}
+
+	return 1;
+}
+
+unsigned int
+SSL_CTX_get_session_cache_shards(const SSL_CTX *ctx)
+{
+	if (ctx->internal->session_shards == NULL)
+		return 1;
+
+	return ctx->internal->session_shards_num;
+}
+
+static size_t
+ssl_session_shm_index(SSL_CTX *ctx, const unsigned char *id, size_t id_len)
+{
+	unsigned int h = 0;
+	size_t i;
+
+	for (i = 0; i < id_len; i++)
+		h = h * 31 + id[i];
+
+	return h % ctx->internal->session_shm_slots;
+}
+
+/*
+ * Copy the slot at the given index, if it holds a session with the given ID
+ * that has not expired. Returns the length of the encoded session, or 0.
+ */
+static size_t
+ssl_session_shm_read(SSL_CTX *ctx, size_t idx, const unsigned char *id,
+    size_t id_len, unsigned char *der, time_t now)
+{
+	struct ssl_session_shm_slot *slot;
+	unsigned int seq;
+	size_t der_len;
+	int i;
+
+	slot = &ctx->internal->session_shm[idx];
+
+	for (i = 0; i < SSL_SESSION_SHM_RETRY; i++) {
+		if (((seq = slot->seq) & 1) != 0)
+			continue;
+		__sync_synchronize();
+
+		der_len = 0;
+		if (slot->id_len == id_len &&
+		    memcmp(slot->id, id, id_len) == 0 &&
+		    slot->expire >= now &&
+		    (der_len = slot->der_len) <= SSL_SESSION_SHM_SLOT_DER_LEN)
+			memcpy(der, slot->der, der_len);
+
+		__sync_synchronize();
+		if (slot->seq == seq)
+			return der_len;
+	}
+
+	return 0;
+}
+
+/*
+ * Store an encoded session in the slot at the given index. If another process
+ * is writing to the slot the session is simply not stored.
+ */
+static void
+ssl_session_shm_write(SSL_CTX *ctx, size_t idx, const unsigned char *id,
+    size_t id_len, const unsigned char *der, size_t der_len, int64_t expire)
+{
+	struct ssl_session_shm_slot *slot;
+	unsigned int seq;
+
+	slot = &ctx->internal->session_shm[idx];
+
+	if (((seq = slot->seq) & 1) != 0)
+		return;
+	if (!__sync_bool_compare_and_swap(&slot->seq, seq, seq + 1))
+		return;
+	__sync_synchronize();
+
+	slot->id_len = id_len;
+	memcpy(slot->id, id, id_len);
+	slot->expire = expire;
+	slot->der_len = der_len;
+	if (der_len > 0)
+		memcpy(slot->der, der, der_len);
+
+	__sync_synchronize();
+	slot->seq = seq + 2;
+}
+
+static int
+ssl_session_shm_new_cb(SSL *s, SSL_SESSION *sess)
+{
+	SSL_CTX *ctx = s->session_ctx;
+	struct ssl_session_shm_slot *slot;
+	unsigned char *der = NULL;
+	size_t i, idx, best;
+	int64_t expire;
+	int der_len;
+
+	if (ctx->internal->session_shm == NULL)
+		return 0;
+	if (sess->session_id_length == 0 ||
+	    sess->session_id_length > SSL_MAX_SSL_SESSION_ID_LENGTH)
+		return 0;
+
+	if ((der_len = i2d_SSL_SESSION(sess, &der)) <= 0)
+		goto err;
+	if (der_len > SSL_SESSION_SHM_SLOT_DER_LEN)
+		goto err;
+
+	/*
+	 * Use the slot that already holds this session ID, otherwise the one
+	 * that expires first out of those probed.
+	 */
+	idx = best = ssl_session_shm_index(ctx, sess->session_id,
+	    sess->session_id_length);
+	for (i = 0; i < SSL_SESSION_SHM_PROBE; i++) {
+		slot = &ctx->internal->session_shm[idx];
+		if (slot->id_len == sess->session_id_length &&
+		    memcmp(slot->id, sess->session_id, slot->id_len) == 0) {
+			best = idx;
+			break;
+		}
+		if (slot->expire < ctx->internal->session_shm[best].expire)
+			best = idx;
+		idx = (idx + 1) % ctx->internal->session_shm_slots;
+	}
+
+	expire = (int64_t)sess->time + sess->timeout;
+	ssl_session_shm_write(ctx, best, sess->session_id,
+	    sess->session_id_length, der, der_len, expire);
+
+ err:
+	freezero(der, der_len > 0 ? der_len : 0);
+
+	/* The session was copied, no reference is retained. */
+	return 0;
+}
+
+static SSL_SESSION *
+ssl_session_shm_get_cb(SSL *s, const unsigned char *id, int id_len, int *copy)
+{
+	SSL_CTX *ctx = s->session_ctx;
+	unsigned char *der = NULL;
+	const unsigned char *p;
+	SSL_SESSION *sess = NULL;
+	size_t i, idx, der_len = 0;
+	time_t now;
+
+	if (ctx->internal->session_shm == NULL)
+		return NULL;
+	if (id_len <= 0 || id_len > SSL_MAX_SSL_SESSION_ID_LENGTH)
+		return NULL;
+
+	if ((der = malloc(SSL_SESSION_SHM_SLOT_DER_LEN)) == NULL)
+		return NULL;
+
+	now = time(NULL);
+	idx = ssl_session_shm_index(ctx, id, id_len);
+	for (i = 0; i < SSL_SESSION_SHM_PROBE; i++) {
+		if ((der_len = ssl_session_shm_read(ctx, idx, id, id_len, der,
+		    now)) > 0)
+			break;
+		idx = (idx + 1) % ctx->internal->session_shm_slots;
+	}
+	if (der_len == 0)
+		goto err;
+
+	p = der;
+	if ((sess = d2i_SSL_SESSION(NULL, &p, der_len)) == NULL)
+		goto err;
+
+	/* The caller takes ownership of our reference. */
+	*copy = 0;
+
+ err:
+	freezero(der, SSL_SESSION_SHM_SLOT_DER_LEN);
+
+	return sess;
+}
+
+static void
+ssl_session_shm_remove(SSL_CTX *ctx, SSL_SESSION *sess)
+{
+	struct ssl_session_shm_slot *slot;
+	size_t i, idx;
+
+	if (ctx->internal->session_shm == NULL)
+		return;
+	if (sess->session_id_length == 0 ||
+	    sess->session_id_length > SSL_MAX_SSL_SESSION_ID_LENGTH)
+		return;
+
+	idx = ssl_session_shm_index(ctx, sess->session_id,
+	    sess->session_id_length);
+	for (i = 0; i < SSL_SESSION_SHM_PROBE; i++) {
+		slot = &ctx->internal->session_shm[idx];
+		if (slot->id_len == sess->session_id_length &&
+		    memcmp(slot->id, sess->session_id, slot->id_len) == 0)
+			ssl_session_shm_write(ctx, idx, NULL, 0, NULL, 0, 0);
+		idx = (idx + 1) % ctx->internal->session_shm_slots;
+	}
+}
+
+void
+ssl_session_shm_free(SSL_CTX *ctx)
+{
+	if (ctx->internal->session_shm != NULL)
+		munmap(ctx->internal->session_shm,
+		    ctx->internal->session_shm_slots *
+		    sizeof(struct ssl_session_shm_slot));
+	ctx->internal->session_shm = NULL;
+	ctx->internal->session_shm_slots = 0;
+}
+
+int
+SSL_CTX_set_session_cache_shm(SSL_CTX *ctx, unsigned int slots)
+{
+	struct ssl_session_shm_slot *shm;
+
+	if (slots > SSL_SESSION_CACHE_MAX_SHM_SLOTS) {
+		SSLerrorx(ERR_R_SHOULD_NOT_HAVE_BEEN_CALLED);
+		return 0;
 	}
+
+	if (slots == 0) {
+		if (ctx->internal->new_session_cb == ssl_session_shm_new_cb)
+			ctx->internal->new_session_cb = NULL;
+		if (ctx->internal->get_session_cb == ssl_session_shm_get_cb)
+			ctx->internal->get_session_cb = NULL;
+		ssl_session_shm_free(ctx);
+		return 1;
+	}
+
+	/*
+	 * The mapping is inherited by processes forked after this point, which
+	 * then share the sessions stored in it.
+	 */
+	if ((shm = mmap(NULL, slots * sizeof(*shm), PROT_READ | PROT_WRITE,
+	    MAP_ANON | MAP_SHARED, -1, 0)) == MAP_FAILED) {
+		SSLerrorx(ERR_R_MALLOC_FAILURE);
+		return 0;
+	}
+
+	ssl_session_shm_free(ctx);
+	ctx->internal->session_shm = shm;
+	ctx->internal->session_shm_slots = slots;
+
+	ctx->internal->new_session_cb = ssl_session_shm_new_cb;
+	ctx->internal->get_session_cb = ssl_session_shm_get_cb;
+
+	return 1;
+}
+
+unsigned int
+SSL_CTX_get_session_cache_shm(const SSL_CTX *ctx)
+{
+	return ctx->internal->session_shm_slots;
 }
 
 void
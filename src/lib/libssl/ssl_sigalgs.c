@@ -300,6 +300,7 @@ ssl_sigalg_pkey_ok(SSL *s, const struct ssl_sigalg *sigalg, EVP_PKEY *pkey)
 const struct ssl_sigalg *
 ssl_sigalg_select(SSL *s, EVP_PKEY *pkey)
 {
+	const struct ssl_sigalg *sigalg;
 	CBS cbs;
 
 	if (!SSL_USE_SIGALGS(s))
@@ -313,12 +314,14 @@ ssl_sigalg_select(SSL *s, EVP_PKEY *pkey)
 	    S3I(s)->hs.sigalgs == NULL)
 		return ssl_sigalg_for_legacy(s, pkey);
 
+	if (ssl_nego_cache_get_sigalg(s, pkey, &sigalg))
+		return sigalg;
+
 	/*
 	 * If we get here, we have client or server sent sigalgs, use one.
 	 */
 	CBS_init(&cbs, S3I(s)->hs.sigalgs, S3I(s)->hs.sigalgs_len);
 	while (CBS_len(&cbs) > 0) {
-		const struct ssl_sigalg *sigalg;
 		uint16_t sigalg_value;
 
 		if (!CBS_get_u16(&cbs, &sigalg_value))
@@ -326,8 +329,10 @@ ssl_sigalg_select(SSL *s, EVP_PKEY *pkey)
 
 		if ((sigalg = ssl_sigalg_from_value(s, sigalg_value)) == NULL)
 			continue;
-		if (ssl_sigalg_pkey_ok(s, sigalg, pkey))
+		if (ssl_sigalg_pkey_ok(s, sigalg, pkey)) {
+			ssl_nego_cache_set_sigalg(s, pkey, sigalg);
 			return sigalg;
+		}
 	}
 
 	SSLerror(s, SSL_R_UNKNOWN_PKEY_TYPE);
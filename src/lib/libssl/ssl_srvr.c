@@ -678,8 +678,6 @@ ssl3_accept(SSL *s)
 
 		case SSL_ST_OK:
 			/* clean a few things up */
-			tls1_cleanup_key_block(s);
-
 			if (S3I(s)->handshake_transcript != NULL) {
 				SSLerror(s, ERR_R_INTERNAL_ERROR);
 				ret = -1;
@@ -692,6 +690,14 @@ ssl3_accept(SSL *s)
 			/* remove buffering on output */
 			ssl_free_wbio_buffer(s);
 
+			/* The key block is still needed for kernel TLS. */
+			if (!ssl_ktls_start(s)) {
+				SSLerror(s, ERR_R_INTERNAL_ERROR);
+				ret = -1;
+				goto end;
+			}
+			tls1_cleanup_key_block(s);
+
 			s->internal->init_num = 0;
 
 			/* Skipped if we just sent a HelloRequest. */
@@ -702,6 +708,7 @@ ssl3_accept(SSL *s)
 				ssl_update_cache(s, SSL_SESS_CACHE_SERVER);
 
 				s->ctx->internal->stats.sess_accept_good++;
+				ssl_stats_handshake_done(s);
 				/* s->server=1; */
 				s->internal->handshake_func = ssl3_accept;
 
@@ -742,6 +749,8 @@ ssl3_accept(SSL *s)
 				S3I(s)->hs.state = new_state;
 			}
 		}
+		if (S3I(s)->hs.state != state)
+			ssl_trace_state(s);
 		skip = 0;
 	}
  end:
@@ -1127,8 +1136,13 @@ ssl3_get_client_hello(SSL *s)
 
 	alg_k = S3I(s)->hs.cipher->algorithm_mkey;
 	if (!(SSL_USE_SIGALGS(s) || (alg_k & SSL_kGOST)) ||
-	    !(s->verify_mode & SSL_VERIFY_PEER))
+	    !(s->verify_mode & SSL_VERIFY_PEER)) {
 		tls1_transcript_free(s);
+	} else if (SSL_USE_SIGALGS(s)) {
+		/* A client CertificateVerify only needs digests. */
+		if (!tls1_transcript_digests_init(s))
+			goto err;
+	}
 
 	/*
 	 * We now have the following setup.
@@ -1502,6 +1516,7 @@ ssl3_send_server_kex_ecdhe(SSL *s, CBB *cbb)
 	int nid;
 
 	nid = tls1_get_shared_curve(s);
+	S3I(s)->hs.group = tls1_ec_nid2curve_id(nid);
 
 	if (nid == NID_X25519)
 		return ssl3_send_server_kex_ecdhe_ecx(s, nid, cbb);
@@ -1512,23 +1527,20 @@ ssl3_send_server_kex_ecdhe(SSL *s, CBB *cbb)
 int
 ssl3_send_server_key_exchange(SSL *s)
 {
-	CBB cbb, cbb_params, cbb_signature, server_kex;
+	CBB cbb, cbb_params, cbb_signature, server_kex, signed_data;
 	const struct ssl_sigalg *sigalg = NULL;
 	unsigned char *signature = NULL;
 	size_t signature_len = 0;
-	unsigned char *params = NULL;
-	size_t params_len;
+	unsigned char *data = NULL;
+	size_t data_len;
 	const EVP_MD *md = NULL;
 	unsigned long type;
-	EVP_MD_CTX md_ctx;
-	EVP_PKEY_CTX *pctx;
 	EVP_PKEY *pkey;
-	int al;
+	int al, ret;
 
 	memset(&cbb, 0, sizeof(cbb));
 	memset(&cbb_params, 0, sizeof(cbb_params));
-
-	EVP_MD_CTX_init(&md_ctx);
+	memset(&signed_data, 0, sizeof(signed_data));
 
 	if (S3I(s)->hs.state == SSL3_ST_SW_KEY_EXCH_A) {
 
@@ -1536,26 +1548,38 @@ ssl3_send_server_key_exchange(SSL *s)
 		    SSL3_MT_SERVER_KEY_EXCHANGE))
 			goto err;
 
-		if (!CBB_init(&cbb_params, 0))
-			goto err;
-
-		type = S3I(s)->hs.cipher->algorithm_mkey;
-		if (type & SSL_kDHE) {
-			if (ssl3_send_server_kex_dhe(s, &cbb_params) != 1)
+		/*
+		 * The parameters are kept if a private key operation is
+		 * pending, so that the same ephemeral key is signed and sent
+		 * when the handshake is resumed.
+		 */
+		if (S3I(s)->hs.tls12.kex_params == NULL) {
+			if (!CBB_init(&cbb_params, 0))
 				goto err;
-		} else if (type & SSL_kECDHE) {
-			if (ssl3_send_server_kex_ecdhe(s, &cbb_params) != 1)
+
+			type = S3I(s)->hs.cipher->algorithm_mkey;
+			if (type & SSL_kDHE) {
+				if (ssl3_send_server_kex_dhe(s,
+				    &cbb_params) != 1)
+					goto err;
+			} else if (type & SSL_kECDHE) {
+				if (ssl3_send_server_kex_ecdhe(s,
+				    &cbb_params) != 1)
+					goto err;
+			} else {
+				al = SSL_AD_HANDSHAKE_FAILURE;
+				SSLerror(s, SSL_R_UNKNOWN_KEY_EXCHANGE_TYPE);
+				goto fatal_err;
+			}
+
+			if (!CBB_finish(&cbb_params,
+			    &S3I(s)->hs.tls12.kex_params,
+			    &S3I(s)->hs.tls12.kex_params_len))
 				goto err;
-		} else {
-			al = SSL_AD_HANDSHAKE_FAILURE;
-			SSLerror(s, SSL_R_UNKNOWN_KEY_EXCHANGE_TYPE);
-			goto fatal_err;
 		}
 
-		if (!CBB_finish(&cbb_params, &params, &params_len))
-			goto err;
-
-		if (!CBB_add_bytes(&server_kex, params, params_len))
+		if (!CBB_add_bytes(&server_kex, S3I(s)->hs.tls12.kex_params,
+		    S3I(s)->hs.tls12.kex_params_len))
 			goto err;
 
 		/* Add signature unless anonymous. */
@@ -1576,44 +1600,30 @@ ssl3_send_server_key_exchange(SSL *s)
 				}
 			}
 
-			if (!EVP_DigestSignInit(&md_ctx, &pctx, md, NULL, pkey)) {
-				SSLerror(s, ERR_R_EVP_LIB);
+			if (!CBB_init(&signed_data, 0))
 				goto err;
-			}
-			if ((sigalg->flags & SIGALG_FLAG_RSA_PSS) &&
-			    (!EVP_PKEY_CTX_set_rsa_padding(pctx,
-			    RSA_PKCS1_PSS_PADDING) ||
-			    !EVP_PKEY_CTX_set_rsa_pss_saltlen(pctx, -1))) {
-				SSLerror(s, ERR_R_EVP_LIB);
+			if (!CBB_add_bytes(&signed_data, s->s3->client_random,
+			    SSL3_RANDOM_SIZE))
 				goto err;
-			}
-			if (!EVP_DigestSignUpdate(&md_ctx, s->s3->client_random,
-			    SSL3_RANDOM_SIZE)) {
-				SSLerror(s, ERR_R_EVP_LIB);
+			if (!CBB_add_bytes(&signed_data, s->s3->server_random,
+			    SSL3_RANDOM_SIZE))
 				goto err;
-			}
-			if (!EVP_DigestSignUpdate(&md_ctx, s->s3->server_random,
-			    SSL3_RANDOM_SIZE)) {
-				SSLerror(s, ERR_R_EVP_LIB);
+			if (!CBB_add_bytes(&signed_data,
+			    S3I(s)->hs.tls12.kex_params,
+			    S3I(s)->hs.tls12.kex_params_len))
 				goto err;
-			}
-			if (!EVP_DigestSignUpdate(&md_ctx, params, params_len)) {
-				SSLerror(s, ERR_R_EVP_LIB);
-				goto err;
-			}
-			if (!EVP_DigestSignFinal(&md_ctx, NULL, &signature_len) ||
-			    !signature_len) {
-				SSLerror(s, ERR_R_EVP_LIB);
-				goto err;
-			}
-			if ((signature = calloc(1, signature_len)) == NULL) {
-				SSLerror(s, ERR_R_MALLOC_FAILURE);
+			if (!CBB_finish(&signed_data, &data, &data_len))
 				goto err;
+
+			if ((ret = ssl_private_key_sign(s, pkey, sigalg, data,
+			    data_len, &signature, &signature_len)) == -1) {
+				/* Resumed when the application calls again. */
+				CBB_cleanup(&cbb);
+				free(data);
+				return (-1);
 			}
-			if (!EVP_DigestSignFinal(&md_ctx, signature, &signature_len)) {
-				SSLerror(s, ERR_R_EVP_LIB);
+			if (ret != 1)
 				goto err;
-			}
 
 			if (!CBB_add_u16_length_prefixed(&server_kex,
 			    &cbb_signature))
@@ -1626,11 +1636,14 @@ ssl3_send_server_key_exchange(SSL *s)
 		if (!ssl3_handshake_msg_finish(s, &cbb))
 			goto err;
 
+		free(S3I(s)->hs.tls12.kex_params);
+		S3I(s)->hs.tls12.kex_params = NULL;
+		S3I(s)->hs.tls12.kex_params_len = 0;
+
 		S3I(s)->hs.state = SSL3_ST_SW_KEY_EXCH_B;
 	}
 
-	EVP_MD_CTX_cleanup(&md_ctx);
-	free(params);
+	free(data);
 	free(signature);
 
 	return (ssl3_handshake_write(s));
@@ -1639,9 +1652,9 @@ ssl3_send_server_key_exchange(SSL *s)
 	ssl3_send_alert(s, SSL3_AL_FATAL, al);
  err:
 	CBB_cleanup(&cbb_params);
+	CBB_cleanup(&signed_data);
 	CBB_cleanup(&cbb);
-	EVP_MD_CTX_cleanup(&md_ctx);
-	free(params);
+	free(data);
 	free(signature);
 
 	return (-1);
@@ -2119,8 +2132,6 @@ ssl3_get_cert_verify(SSL *s)
 	X509 *peer = NULL;
 	EVP_MD_CTX mctx;
 	int al, ok, verify;
-	const unsigned char *hdata;
-	size_t hdatalen;
 	int type = 0;
 	int ret = 0;
 	long n;
@@ -2198,24 +2209,34 @@ ssl3_get_cert_verify(SSL *s)
 	S3I(s)->hs.peer_sigalg = sigalg;
 
 	if (SSL_USE_SIGALGS(s)) {
+		unsigned char digest[EVP_MAX_MD_SIZE];
+		size_t digest_len;
 		EVP_PKEY_CTX *pctx;
 
-		if (!tls1_transcript_data(s, &hdata, &hdatalen)) {
+		if (!tls1_transcript_digest(s, sigalg->md(), digest,
+		    sizeof(digest), &digest_len)) {
 			SSLerror(s, ERR_R_INTERNAL_ERROR);
 			al = SSL_AD_INTERNAL_ERROR;
 			goto fatal_err;
 		}
-		if (!EVP_DigestVerifyInit(&mctx, &pctx, sigalg->md(),
-		    NULL, pkey)) {
+		if ((pctx = EVP_PKEY_CTX_new(pkey, NULL)) == NULL) {
 			SSLerror(s, ERR_R_EVP_LIB);
 			al = SSL_AD_INTERNAL_ERROR;
 			goto fatal_err;
 		}
+		if (EVP_PKEY_verify_init(pctx) <= 0 ||
+		    EVP_PKEY_CTX_set_signature_md(pctx, sigalg->md()) <= 0) {
+			SSLerror(s, ERR_R_EVP_LIB);
+			al = SSL_AD_INTERNAL_ERROR;
+			EVP_PKEY_CTX_free(pctx);
+			goto fatal_err;
+		}
 		if ((sigalg->flags & SIGALG_FLAG_RSA_PSS) &&
 		    (!EVP_PKEY_CTX_set_rsa_padding(pctx,
 			RSA_PKCS1_PSS_PADDING) ||
 		    !EVP_PKEY_CTX_set_rsa_pss_saltlen(pctx, -1))) {
 			al = SSL_AD_INTERNAL_ERROR;
+			EVP_PKEY_CTX_free(pctx);
 			goto fatal_err;
 		}
 		if (sigalg->key_type == EVP_PKEY_GOSTR01 &&
@@ -2223,19 +2244,18 @@ ssl3_get_cert_verify(SSL *s)
 		    EVP_PKEY_CTRL_GOST_SIG_FORMAT, GOST_SIG_FORMAT_RS_LE,
 		    NULL) <= 0) {
 			al = SSL_AD_INTERNAL_ERROR;
+			EVP_PKEY_CTX_free(pctx);
 			goto fatal_err;
 		}
-		if (!EVP_DigestVerifyUpdate(&mctx, hdata, hdatalen)) {
-			SSLerror(s, ERR_R_EVP_LIB);
-			al = SSL_AD_INTERNAL_ERROR;
-			goto fatal_err;
-		}
-		if (EVP_DigestVerifyFinal(&mctx, CBS_data(&signature),
-		    CBS_len(&signature)) <= 0) {
+		if (EVP_PKEY_verify(pctx, CBS_data(&signature),
+		    CBS_len(&signature), digest, digest_len) <= 0) {
 			al = SSL_AD_DECRYPT_ERROR;
 			SSLerror(s, SSL_R_BAD_SIGNATURE);
+			EVP_PKEY_CTX_free(pctx);
 			goto fatal_err;
 		}
+
+		EVP_PKEY_CTX_free(pctx);
 	} else if (pkey->type == EVP_PKEY_RSA) {
 		verify = RSA_verify(NID_md5_sha1, S3I(s)->hs.tls12.cert_verify,
 		    MD5_DIGEST_LENGTH + SHA_DIGEST_LENGTH, CBS_data(&signature),
@@ -2265,6 +2285,8 @@ ssl3_get_cert_verify(SSL *s)
 	    pkey->type == NID_id_GostR3410_2001) {
 		unsigned char sigbuf[128];
 		unsigned int siglen = sizeof(sigbuf);
+		const unsigned char *hdata;
+		size_t hdatalen;
 		EVP_PKEY_CTX *pctx;
 		const EVP_MD *md;
 		int nid;
@@ -2518,25 +2540,11 @@ int
 ssl3_send_newsession_ticket(SSL *s)
 {
 	CBB cbb, session_ticket, ticket;
-	SSL_CTX *tctx = s->initial_ctx;
-	size_t enc_session_len, enc_session_max_len, hmac_len;
-	size_t session_len = 0;
-	unsigned char *enc_session = NULL, *session = NULL;
-	unsigned char iv[EVP_MAX_IV_LENGTH];
-	unsigned char key_name[16];
-	unsigned char *hmac;
-	unsigned int hlen;
-	EVP_CIPHER_CTX ctx;
-	HMAC_CTX hctx;
-	int len;
 
 	/*
 	 * New Session Ticket - RFC 5077, section 3.3.
 	 */
 
-	EVP_CIPHER_CTX_init(&ctx);
-	HMAC_CTX_init(&hctx);
-
 	memset(&cbb, 0, sizeof(cbb));
 
 	if (S3I(s)->hs.state == SSL3_ST_SW_SESSION_TICKET_A) {
@@ -2544,59 +2552,6 @@ ssl3_send_newsession_ticket(SSL *s)
 		    SSL3_MT_NEWSESSION_TICKET))
 			goto err;
 
-		if (!SSL_SESSION_ticket(s->session, &session, &session_len))
-			goto err;
-		if (session_len > 0xffff)
-			goto err;
-
-		/*
-		 * Initialize HMAC and cipher contexts. If callback is present
-		 * it does all the work, otherwise use generated values from
-		 * parent context.
-		 */
-		if (tctx->internal->tlsext_ticket_key_cb != NULL) {
-			if (tctx->internal->tlsext_ticket_key_cb(s,
-			    key_name, iv, &ctx, &hctx, 1) < 0) {
-				EVP_CIPHER_CTX_cleanup(&ctx);
-				goto err;
-			}
-		} else {
-			arc4random_buf(iv, 16);
-			EVP_EncryptInit_ex(&ctx, EVP_aes_128_cbc(), NULL,
-			    tctx->internal->tlsext_tick_aes_key, iv);
-			HMAC_Init_ex(&hctx, tctx->internal->tlsext_tick_hmac_key,
-			    16, EVP_sha256(), NULL);
-			memcpy(key_name, tctx->internal->tlsext_tick_key_name, 16);
-		}
-
-		/* Encrypt the session state. */
-		enc_session_max_len = session_len + EVP_MAX_BLOCK_LENGTH;
-		if ((enc_session = calloc(1, enc_session_max_len)) == NULL)
-			goto err;
-		enc_session_len = 0;
-		if (!EVP_EncryptUpdate(&ctx, enc_session, &len, session,
-		    session_len))
-			goto err;
-		enc_session_len += len;
-		if (!EVP_EncryptFinal_ex(&ctx, enc_session + enc_session_len,
-		    &len))
-			goto err;
-		enc_session_len += len;
-
-		if (enc_session_len > enc_session_max_len)
-			goto err;
-
-		/* Generate the HMAC. */
-		if (!HMAC_Update(&hctx, key_name, sizeof(key_name)))
-			goto err;
-		if (!HMAC_Update(&hctx, iv, EVP_CIPHER_CTX_iv_length(&ctx)))
-			goto err;
-		if (!HMAC_Update(&hctx, enc_session, enc_session_len))
-			goto err;
-
-		if ((hmac_len = HMAC_size(&hctx)) <= 0)
-			goto err;
-
 		/*
 		 * Ticket lifetime hint (advisory only):
 		 * We leave this unspecified for resumed session
@@ -2609,18 +2564,7 @@ ssl3_send_newsession_ticket(SSL *s)
 
 		if (!CBB_add_u16_length_prefixed(&session_ticket, &ticket))
 			goto err;
-		if (!CBB_add_bytes(&ticket, key_name, sizeof(key_name)))
-			goto err;
-		if (!CBB_add_bytes(&ticket, iv, EVP_CIPHER_CTX_iv_length(&ctx)))
-			goto err;
-		if (!CBB_add_bytes(&ticket, enc_session, enc_session_len))
-			goto err;
-		if (!CBB_add_space(&ticket, &hmac, hmac_len))
-			goto err;
-
-		if (!HMAC_Final(&hctx, hmac, &hlen))
-			goto err;
-		if (hlen != hmac_len)
+		if (!tls1_encrypt_ticket(s, s->session, &ticket))
 			goto err;
 
 		if (!ssl3_handshake_msg_finish(s, &cbb))
@@ -2629,20 +2573,11 @@ ssl3_send_newsession_ticket(SSL *s)
 		S3I(s)->hs.state = SSL3_ST_SW_SESSION_TICKET_B;
 	}
 
-	EVP_CIPHER_CTX_cleanup(&ctx);
-	HMAC_CTX_cleanup(&hctx);
-	freezero(session, session_len);
-	free(enc_session);
-
 	/* SSL3_ST_SW_SESSION_TICKET_B */
 	return (ssl3_handshake_write(s));
 
  err:
 	CBB_cleanup(&cbb);
-	EVP_CIPHER_CTX_cleanup(&ctx);
-	HMAC_CTX_cleanup(&hctx);
-	freezero(session, session_len);
-	free(enc_session);
 
 	return (-1);
 }
@@ -0,0 +1,331 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Handshake statistics.
+ *
+ * Every SSL_CTX counts the handshakes completed by its connections, by
+ * protocol version, cipher suite and group, along with the alerts that
+ * ended handshakes and the CPU time spent in them. The counters are only
+ * ever added to atomically, so that neither the connections updating them
+ * nor a reader taking a snapshot need a lock. With SSL_CTX_set_numa_nodes()
+ * each node counts in its own block, see ssl_node.c, and readers sum them.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <openssl/ssl.h>
+
+#include "ssl_locl.h"
+#include "tls13_internal.h"
+
+#define SSL_STATS_VERSIONS	6
+#define SSL_STATS_GROUPS	64
+#define SSL_STATS_ALERTS	256
+
+struct ssl_stats {
+	uint64_t handshakes;
+	uint64_t resumed;
+	uint64_t hello_retry_requests;
+	uint64_t ticket_decrypt_failures;
+	uint64_t cpu_nsec;
+
+	uint64_t versions[SSL_STATS_VERSIONS];
+	uint64_t groups[SSL_STATS_GROUPS];
+	uint64_t alerts_sent[SSL_STATS_ALERTS];
+	uint64_t alerts_received[SSL_STATS_ALERTS];
+
+	/* One counter for each entry of ssl3_ciphers. */
+	uint64_t ciphers[];
+};
+
+static void
+ssl_stats_add(uint64_t *counter, uint64_t n)
+{
+	__sync_fetch_and_add(counter, n);
+}
+
+static uint64_t
+ssl_stats_read(uint64_t *counter)
+{
+	return __sync_fetch_and_add(counter, 0);
+}
+
+struct ssl_stats *
+ssl_stats_new(void)
+{
+	return calloc(1, sizeof(struct ssl_stats) +
+	    ssl3_num_ciphers() * sizeof(uint64_t));
+}
+
+void
+ssl_stats_free(struct ssl_stats *stats)
+{
+	free(stats);
+}
+
+static int
+ssl_stats_version_index(unsigned int version)
+{
+	switch (version) {
+	case TLS1_VERSION:
+		return 0;
+	case TLS1_1_VERSION:
+		return 1;
+	case TLS1_2_VERSION:
+		return 2;
+	case TLS1_3_VERSION:
+		return 3;
+	case DTLS1_VERSION:
+		return 4;
+	case DTLS1_2_VERSION:
+		return 5;
+	}
+
+	return -1;
+}
+
+/*
+ * Groups are counted by their TLS identifier, with those beyond the ones
+ * that libssl knows about counted together under zero.
+ */
+static int
+ssl_stats_group_index(unsigned int group)
+{
+	if (group >= SSL_STATS_GROUPS)
+		return 0;
+
+	return group;
+}
+
+static int
+ssl_stats_cipher_index(const SSL_CIPHER *cipher)
+{
+	if (cipher < ssl3_ciphers ||
+	    cipher >= &ssl3_ciphers[ssl3_num_ciphers()])
+		return -1;
+
+	return cipher - ssl3_ciphers;
+}
+
+void
+ssl_stats_handshake_done(SSL *s)
+{
+	struct ssl_stats *stats = ssl_ctx_stats(s->ctx);
+	const SSL_CIPHER *cipher;
+	uint16_t group;
+	int idx;
+
+	if (stats == NULL)
+		return;
+
+	ssl_stats_add(&stats->handshakes, 1);
+	if (s->internal->hit)
+		ssl_stats_add(&stats->resumed, 1);
+
+	if ((idx = ssl_stats_version_index(s->version)) >= 0)
+		ssl_stats_add(&stats->versions[idx], 1);
+
+	if ((cipher = S3I(s)->hs.cipher) == NULL && s->session != NULL)
+		cipher = s->session->cipher;
+	if ((idx = ssl_stats_cipher_index(cipher)) >= 0)
+		ssl_stats_add(&stats->ciphers[idx], 1);
+
+	group = S3I(s)->hs.group;
+	if (S3I(s)->hs.tls13.key_share != NULL)
+		group = tls13_key_share_group(S3I(s)->hs.tls13.key_share);
+	if (group != 0)
+		ssl_stats_add(&stats->groups[ssl_stats_group_index(group)], 1);
+}
+
+void
+ssl_stats_hello_retry_request(SSL *s)
+{
+	struct ssl_stats *stats = ssl_ctx_stats(s->ctx);
+
+	if (stats != NULL)
+		ssl_stats_add(&stats->hello_retry_requests, 1);
+}
+
+/*
+ * Count a fatal alert that ends a handshake. Alerts on established
+ * connections and those that close them are not handshake failures.
+ */
+void
+ssl_stats_alert(SSL *s, int sent, uint8_t desc)
+{
+	struct ssl_stats *stats = ssl_ctx_stats(s->ctx);
+
+	if (stats == NULL)
+		return;
+	if (!SSL_in_init(s) && !SSL_in_before(s))
+		return;
+	if (desc == SSL_AD_CLOSE_NOTIFY || desc == SSL_AD_USER_CANCELLED)
+		return;
+
+	if (sent)
+		ssl_stats_add(&stats->alerts_sent[desc], 1);
+	else
+		ssl_stats_add(&stats->alerts_received[desc], 1);
+}
+
+void
+ssl_stats_ticket_decrypt_failure(SSL *s)
+{
+	struct ssl_stats *stats = ssl_ctx_stats(s->ctx);
+
+	if (stats != NULL)
+		ssl_stats_add(&stats->ticket_decrypt_failures, 1);
+}
+
+/*
+ * Run one step of a handshake, adding the CPU time of the calling thread
+ * that it took to the statistics of the SSL_CTX.
+ */
+int
+ssl_stats_handshake(SSL *s, int (*handshake_func)(SSL *))
+{
+	struct timespec start, end;
+	struct ssl_stats *stats;
+	int ret;
+
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start) == -1)
+		return handshake_func(s);
+
+	ret = handshake_func(s);
+
+	/* The SSL_CTX may have been switched during the handshake. */
+	if ((stats = ssl_ctx_stats(s->ctx)) == NULL)
+		return ret;
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end) == -1)
+		return ret;
+	timespecsub(&end, &start, &end);
+	if (end.tv_sec >= 0)
+		ssl_stats_add(&stats->cpu_nsec,
+		    (uint64_t)end.tv_sec * 1000000000 + end.tv_nsec);
+
+	return ret;
+}
+
+/*
+ * Add the counts of src to dst, used to keep the counts of a counter block
+ * that is about to be freed.
+ */
+void
+ssl_stats_merge(struct ssl_stats *dst, struct ssl_stats *src)
+{
+	uint64_t *d = (uint64_t *)dst, *s = (uint64_t *)src;
+	size_t i, n;
+
+	if (dst == NULL || src == NULL)
+		return;
+
+	n = sizeof(struct ssl_stats) / sizeof(uint64_t) + ssl3_num_ciphers();
+	for (i = 0; i < n; i++)
+		ssl_stats_add(&d[i], ssl_stats_read(&s[i]));
+}
+
+void
+SSL_CTX_get_handshake_stats(SSL_CTX *ctx, SSL_HANDSHAKE_STATS *hs_stats)
+{
+	struct ssl_stats *stats;
+	uint64_t cpu_nsec = 0;
+	unsigned int n;
+	size_t i;
+
+	memset(hs_stats, 0, sizeof(*hs_stats));
+
+	/* Sum the counters of the SSL_CTX and those of its node replicas. */
+	for (n = 0; n < ssl_ctx_stats_num(ctx); n++) {
+		if ((stats = ssl_ctx_stats_index(ctx, n)) == NULL)
+			continue;
+
+		hs_stats->handshakes += ssl_stats_read(&stats->handshakes);
+		hs_stats->resumed_handshakes += ssl_stats_read(&stats->resumed);
+		hs_stats->hello_retry_requests +=
+		    ssl_stats_read(&stats->hello_retry_requests);
+		hs_stats->ticket_decrypt_failures +=
+		    ssl_stats_read(&stats->ticket_decrypt_failures);
+		for (i = 0; i < SSL_STATS_ALERTS; i++) {
+			hs_stats->failures +=
+			    ssl_stats_read(&stats->alerts_sent[i]) +
+			    ssl_stats_read(&stats->alerts_received[i]);
+		}
+		cpu_nsec += ssl_stats_read(&stats->cpu_nsec);
+	}
+
+	hs_stats->full_handshakes = hs_stats->handshakes -
+	    hs_stats->resumed_handshakes;
+	hs_stats->cpu_time.tv_sec = cpu_nsec / 1000000000;
+	hs_stats->cpu_time.tv_nsec = cpu_nsec % 1000000000;
+}
+
+static uint64_t *
+ssl_stats_counter(struct ssl_stats *stats, int type, unsigned int value)
+{
+	const SSL_CIPHER *cipher;
+	int idx;
+
+	switch (type) {
+	case SSL_HANDSHAKE_STAT_VERSION:
+		if ((idx = ssl_stats_version_index(value)) < 0)
+			return NULL;
+		return &stats->versions[idx];
+	case SSL_HANDSHAKE_STAT_CIPHER:
+		if (value > 0xffff)
+			return NULL;
+		if ((cipher = ssl3_get_cipher_by_value(value)) == NULL)
+			return NULL;
+		if ((idx = ssl_stats_cipher_index(cipher)) < 0)
+			return NULL;
+		return &stats->ciphers[idx];
+	case SSL_HANDSHAKE_STAT_GROUP:
+		if (value >= SSL_STATS_GROUPS)
+			return NULL;
+		return &stats->groups[value];
+	case SSL_HANDSHAKE_STAT_ALERT_SENT:
+		if (value >= SSL_STATS_ALERTS)
+			return NULL;
+		return &stats->alerts_sent[value];
+	case SSL_HANDSHAKE_STAT_ALERT_RECEIVED:
+		if (value >= SSL_STATS_ALERTS)
+			return NULL;
+		return &stats->alerts_received[value];
+	}
+
+	return NULL;
+}
+
+uint64_t
+SSL_CTX_get_handshake_count(SSL_CTX *ctx, int type, unsigned int value)
+{
+	struct ssl_stats *stats;
+	uint64_t *counter, count = 0;
+	unsigned int n;
+
+	for (n = 0; n < ssl_ctx_stats_num(ctx); n++) {
+		if ((stats = ssl_ctx_stats_index(ctx, n)) == NULL)
+			continue;
+		if ((counter = ssl_stats_counter(stats, type, value)) == NULL)
+			return 0;
+		count += ssl_stats_read(counter);
+	}
+
+	return count;
+}
@@ -23,6 +23,7 @@
 #include <openssl/opensslconf.h>
 
 #include "bytestring.h"
+#include "dtls_locl.h"
 #include "ssl_locl.h"
 #include "ssl_sigalgs.h"
 #include "ssl_tlsext.h"
@@ -1382,6 +1383,88 @@ tlsext_srtp_client_parse(SSL *s, uint16_t msg_type, CBS *cbs, int *alert)
 
 #endif /* OPENSSL_NO_SRTP */
 
+/*
+ * DTLS 1.2 Connection ID - RFC 9146.
+ */
+int
+tlsext_cid_client_needs(SSL *s, uint16_t msg_type)
+{
+	return SSL_is_dtls(s) && s->internal->dtls_cid_enabled;
+}
+
+int
+tlsext_cid_client_build(SSL *s, uint16_t msg_type, CBB *cbb)
+{
+	CBB cid;
+
+	if (!CBB_add_u8_length_prefixed(cbb, &cid))
+		return 0;
+	if (!CBB_add_bytes(&cid, s->internal->dtls_cid,
+	    s->internal->dtls_cid_len))
+		return 0;
+
+	return CBB_flush(cbb);
+}
+
+int
+tlsext_cid_server_parse(SSL *s, uint16_t msg_type, CBS *cbs, int *alert)
+{
+	CBS cid;
+
+	if (!CBS_get_u8_length_prefixed(cbs, &cid)) {
+		*alert = SSL_AD_DECODE_ERROR;
+		return 0;
+	}
+
+	/* Connection IDs are only defined for DTLS 1.2. */
+	if (!SSL_is_dtls(s) || !s->internal->dtls_cid_enabled ||
+	    s->version != DTLS1_2_VERSION)
+		return 1;
+
+	if (!dtls1_cid_negotiated(s, &cid)) {
+		*alert = SSL_AD_INTERNAL_ERROR;
+		return 0;
+	}
+
+	return 1;
+}
+
+int
+tlsext_cid_server_needs(SSL *s, uint16_t msg_type)
+{
+	return SSL_is_dtls(s) && s->internal->dtls_cid_negotiated;
+}
+
+int
+tlsext_cid_server_build(SSL *s, uint16_t msg_type, CBB *cbb)
+{
+	return tlsext_cid_client_build(s, msg_type, cbb);
+}
+
+int
+tlsext_cid_client_parse(SSL *s, uint16_t msg_type, CBS *cbs, int *alert)
+{
+	CBS cid;
+
+	if (!CBS_get_u8_length_prefixed(cbs, &cid)) {
+		*alert = SSL_AD_DECODE_ERROR;
+		return 0;
+	}
+
+	if (!SSL_is_dtls(s) || !s->internal->dtls_cid_enabled ||
+	    s->version != DTLS1_2_VERSION) {
+		*alert = SSL_AD_UNSUPPORTED_EXTENSION;
+		return 0;
+	}
+
+	if (!dtls1_cid_negotiated(s, &cid)) {
+		*alert = SSL_AD_INTERNAL_ERROR;
+		return 0;
+	}
+
+	return 1;
+}
+
 /*
  * TLSv1.3 Key Share - RFC 8446 section 4.2.8.
  */
@@ -1665,6 +1748,25 @@ tlsext_cookie_server_parse(SSL *s, uint16_t msg_type, CBS *cbs, int *alert)
 	if (!CBS_get_u16_length_prefixed(cbs, &cookie))
 		goto err;
 
+	/*
+	 * A stateless HelloRetryRequest keeps the handshake state in the
+	 * cookie, which is opened once the ClientHello has been parsed.
+	 */
+	if ((s->internal->options & SSL_OP_STATELESS_HRR) != 0 &&
+	    S3I(s)->hs.negotiated_tls_version >= TLS1_3_VERSION) {
+		free(S3I(s)->hs.tls13.cookie);
+		S3I(s)->hs.tls13.cookie = NULL;
+		S3I(s)->hs.tls13.cookie_len = 0;
+		if (CBS_len(&cookie) == 0)
+			goto err;
+		if (!CBS_stow(&cookie, &S3I(s)->hs.tls13.cookie,
+		    &S3I(s)->hs.tls13.cookie_len)) {
+			*alert = SSL_AD_INTERNAL_ERROR;
+			return 0;
+		}
+		return 1;
+	}
+
 	if (CBS_len(&cookie) != S3I(s)->hs.tls13.cookie_len)
 		goto err;
 
@@ -1748,6 +1850,334 @@ tlsext_cookie_client_parse(SSL *s, uint16_t msg_type, CBS *cbs, int *alert)
 	return 0;
 }
 
+/*
+ * Early Data Indication - RFC 8446 section 4.2.10.
+ */
+int
+tlsext_early_data_client_needs(SSL *s, uint16_t msg_type)
+{
+	/* XXX - client side early data is not yet supported. */
+	return 0;
+}
+
+int
+tlsext_early_data_client_build(SSL *s, uint16_t msg_type, CBB *cbb)
+{
+	return 0;
+}
+
+int
+tlsext_early_data_server_parse(SSL *s, uint16_t msg_type, CBS *cbs,
+    int *alert)
+{
+	/* Early data must not be offered following a HelloRetryRequest. */
+	if (S3I(s)->hs.tls13.hrr) {
+		*alert = SSL_AD_ILLEGAL_PARAMETER;
+		return 0;
+	}
+
+	/* Whether or not it is accepted is determined once the PSK is known. */
+	S3I(s)->hs.tls13.early_data_status = SSL_EARLY_DATA_REJECTED;
+
+	return 1;
+}
+
+int
+tlsext_early_data_server_needs(SSL *s, uint16_t msg_type)
+{
+	if (msg_type == SSL_TLSEXT_MSG_EE)
+		return (S3I(s)->hs.tls13.early_data_status ==
+		    SSL_EARLY_DATA_ACCEPTED);
+	if (msg_type == SSL_TLSEXT_MSG_NST)
+		return (s->internal->max_early_data > 0);
+
+	return 0;
+}
+
+int
+tlsext_early_data_server_build(SSL *s, uint16_t msg_type, CBB *cbb)
+{
+	/* The extension is empty, other than in a NewSessionTicket. */
+	if (msg_type == SSL_TLSEXT_MSG_NST)
+		return CBB_add_u32(cbb, s->internal->max_early_data);
+
+	return 1;
+}
+
+int
+tlsext_early_data_client_parse(SSL *s, uint16_t msg_type, CBS *cbs,
+    int *alert)
+{
+	/* We never offer early data. */
+	*alert = SSL_AD_UNSUPPORTED_EXTENSION;
+	return 0;
+}
+
+/*
+ * PSK Key Exchange Modes - RFC 8446 section 4.2.9.
+ */
+int
+tlsext_psk_kex_modes_client_needs(SSL *s, uint16_t msg_type)
+{
+	/* XXX - client side resumption is not yet supported. */
+	return 0;
+}
+
+int
+tlsext_psk_kex_modes_client_build(SSL *s, uint16_t msg_type, CBB *cbb)
+{
+	return 0;
+}
+
+int
+tlsext_psk_kex_modes_server_parse(SSL *s, uint16_t msg_type, CBS *cbs,
+    int *alert)
+{
+	CBS ke_modes;
+	uint8_t ke_mode;
+
+	if (!CBS_get_u8_length_prefixed(cbs, &ke_modes))
+		goto err;
+	if (CBS_len(&ke_modes) == 0)
+		goto err;
+
+	while (CBS_len(&ke_modes) > 0) {
+		if (!CBS_get_u8(&ke_modes, &ke_mode))
+			goto err;
+		if (ke_mode == TLS13_PSK_DHE_KE)
+			S3I(s)->hs.tls13.psk_dhe_ke = 1;
+	}
+
+	return 1;
+
+ err:
+	*alert = SSL_AD_DECODE_ERROR;
+	return 0;
+}
+
+int
+tlsext_psk_kex_modes_server_needs(SSL *s, uint16_t msg_type)
+{
+	return 0;
+}
+
+int
+tlsext_psk_kex_modes_server_build(SSL *s, uint16_t msg_type, CBB *cbb)
+{
+	return 0;
+}
+
+int
+tlsext_psk_kex_modes_client_parse(SSL *s, uint16_t msg_type, CBS *cbs,
+    int *alert)
+{
+	/* A server must never send this extension. */
+	*alert = SSL_AD_UNSUPPORTED_EXTENSION;
+	return 0;
+}
+
+/*
+ * Certificate Compression - RFC 8879 section 3.
+ */
+int
+tlsext_certcomp_client_needs(SSL *s, uint16_t msg_type)
+{
+	if ((s->internal->options & SSL_OP_ENABLE_CERT_COMPRESSION) == 0)
+		return 0;
+	if (S3I(s)->hs.our_max_tls_version < TLS1_3_VERSION)
+		return 0;
+
+	return tls13_cert_comp_supported(TLS13_CERT_COMP_ZLIB);
+}
+
+int
+tlsext_certcomp_client_build(SSL *s, uint16_t msg_type, CBB *cbb)
+{
+	CBB algs;
+
+	if (!CBB_add_u8_length_prefixed(cbb, &algs))
+		return 0;
+	if (!tls13_cert_comp_build_algs(&algs))
+		return 0;
+	if (!CBB_flush(cbb))
+		return 0;
+
+	S3I(s)->hs.tls13.cert_comp_offered = 1;
+
+	return 1;
+}
+
+static int
+tlsext_certcomp_parse(SSL *s, CBS *cbs, uint16_t *selected, int *alert)
+{
+	CBS algs;
+	uint16_t alg;
+
+	*selected = 0;
+
+	if (!CBS_get_u8_length_prefixed(cbs, &algs))
+		goto err;
+	if (CBS_len(&algs) < 2 || CBS_len(&algs) % 2 != 0)
+		goto err;
+
+	while (CBS_len(&algs) > 0) {
+		if (!CBS_get_u16(&algs, &alg))
+			goto err;
+		if (*selected == 0 && tls13_cert_comp_supported(alg))
+			*selected = alg;
+	}
+
+	return 1;
+
+ err:
+	*alert = SSL_AD_DECODE_ERROR;
+	return 0;
+}
+
+int
+tlsext_certcomp_server_parse(SSL *s, uint16_t msg_type, CBS *cbs, int *alert)
+{
+	uint16_t alg;
+
+	if (!tlsext_certcomp_parse(s, cbs, &alg, alert))
+		return 0;
+
+	if ((s->internal->options & SSL_OP_ENABLE_CERT_COMPRESSION) != 0)
+		S3I(s)->hs.tls13.cert_comp_alg = alg;
+
+	return 1;
+}
+
+int
+tlsext_certcomp_server_needs(SSL *s, uint16_t msg_type)
+{
+	/* A compressed client certificate is never requested. */
+	return 0;
+}
+
+int
+tlsext_certcomp_server_build(SSL *s, uint16_t msg_type, CBB *cbb)
+{
+	return 0;
+}
+
+int
+tlsext_certcomp_client_parse(SSL *s, uint16_t msg_type, CBS *cbs, int *alert)
+{
+	uint16_t alg;
+
+	/* Our certificate is not compressed, so the list is only checked. */
+	return tlsext_certcomp_parse(s, cbs, &alg, alert);
+}
+
+/*
+ * Pre-Shared Key - RFC 8446 section 4.2.11.
+ */
+int
+tlsext_psk_client_needs(SSL *s, uint16_t msg_type)
+{
+	/* XXX - client side resumption is not yet supported. */
+	return 0;
+}
+
+int
+tlsext_psk_client_build(SSL *s, uint16_t msg_type, CBB *cbb)
+{
+	return 0;
+}
+
+int
+tlsext_psk_server_parse(SSL *s, uint16_t msg_type, CBS *cbs, int *alert)
+{
+	CBS identities, identity, binders, binder;
+	CBS first_identity, first_binder;
+	uint32_t obfuscated_age, first_age = 0;
+	size_t identities_count = 0, binders_count = 0;
+	size_t binders_len;
+
+	if (!CBS_get_u16_length_prefixed(cbs, &identities))
+		goto err;
+	while (CBS_len(&identities) > 0) {
+		if (!CBS_get_u16_length_prefixed(&identities, &identity))
+			goto err;
+		if (CBS_len(&identity) == 0)
+			goto err;
+		if (!CBS_get_u32(&identities, &obfuscated_age))
+			goto err;
+		if (identities_count++ == 0) {
+			CBS_dup(&identity, &first_identity);
+			first_age = obfuscated_age;
+		}
+	}
+
+	/*
+	 * This extension is last in the ClientHello, hence the binders list
+	 * (including its length prefix) is at the very end of the message.
+	 */
+	binders_len = CBS_len(cbs);
+
+	if (!CBS_get_u16_length_prefixed(cbs, &binders))
+		goto err;
+	while (CBS_len(&binders) > 0) {
+		if (!CBS_get_u8_length_prefixed(&binders, &binder))
+			goto err;
+		if (CBS_len(&binder) < 32)
+			goto err;
+		if (binders_count++ == 0)
+			CBS_dup(&binder, &first_binder);
+	}
+
+	if (identities_count == 0 || identities_count != binders_count) {
+		*alert = SSL_AD_ILLEGAL_PARAMETER;
+		return 0;
+	}
+
+	freezero(S3I(s)->hs.tls13.psk_identity,
+	    S3I(s)->hs.tls13.psk_identity_len);
+	S3I(s)->hs.tls13.psk_identity = NULL;
+	S3I(s)->hs.tls13.psk_identity_len = 0;
+
+	if (!CBS_stow(&first_identity, &S3I(s)->hs.tls13.psk_identity,
+	    &S3I(s)->hs.tls13.psk_identity_len)) {
+		*alert = SSL_AD_INTERNAL_ERROR;
+		return 0;
+	}
+	S3I(s)->hs.tls13.psk_obfuscated_age = first_age;
+	if (!CBS_write_bytes(&first_binder, S3I(s)->hs.tls13.psk_binder,
+	    sizeof(S3I(s)->hs.tls13.psk_binder),
+	    &S3I(s)->hs.tls13.psk_binder_len))
+		goto err;
+	S3I(s)->hs.tls13.psk_binders_len = binders_len;
+
+	return 1;
+
+ err:
+	*alert = SSL_AD_DECODE_ERROR;
+	return 0;
+}
+
+int
+tlsext_psk_server_needs(SSL *s, uint16_t msg_type)
+{
+	return (S3I(s)->hs.negotiated_tls_version >= TLS1_3_VERSION &&
+	    S3I(s)->hs.tls13.psk_selected);
+}
+
+int
+tlsext_psk_server_build(SSL *s, uint16_t msg_type, CBB *cbb)
+{
+	/* We only ever consider the first identity offered. */
+	return CBB_add_u16(cbb, 0);
+}
+
+int
+tlsext_psk_client_parse(SSL *s, uint16_t msg_type, CBS *cbs, int *alert)
+{
+	/* We never offer a pre-shared key. */
+	*alert = SSL_AD_UNSUPPORTED_EXTENSION;
+	return 0;
+}
+
 struct tls_extension_funcs {
 	int (*needs)(SSL *s, uint16_t msg_type);
 	int (*build)(SSL *s, uint16_t msg_type, CBB *cbb);
@@ -1934,8 +2364,80 @@ static const struct tls_extension tls_extensions[] = {
 			.build = tlsext_srtp_server_build,
 			.parse = tlsext_srtp_server_parse,
 		},
-	}
+	},
 #endif /* OPENSSL_NO_SRTP */
+	{
+		.type = TLSEXT_TYPE_connection_id,
+		.messages = SSL_TLSEXT_MSG_CH | SSL_TLSEXT_MSG_SH,
+		.client = {
+			.needs = tlsext_cid_client_needs,
+			.build = tlsext_cid_client_build,
+			.parse = tlsext_cid_client_parse,
+		},
+		.server = {
+			.needs = tlsext_cid_server_needs,
+			.build = tlsext_cid_server_build,
+			.parse = tlsext_cid_server_parse,
+		},
+	},
+	{
+		.type = TLSEXT_TYPE_early_data,
+		.messages = SSL_TLSEXT_MSG_CH | SSL_TLSEXT_MSG_EE |
+		    SSL_TLSEXT_MSG_NST,
+		.client = {
+			.needs = tlsext_early_data_client_needs,
+			.build = tlsext_early_data_client_build,
+			.parse = tlsext_early_data_client_parse,
+		},
+		.server = {
+			.needs = tlsext_early_data_server_needs,
+			.build = tlsext_early_data_server_build,
+			.parse = tlsext_early_data_server_parse,
+		},
+	},
+	{
+		.type = TLSEXT_TYPE_psk_key_exchange_modes,
+		.messages = SSL_TLSEXT_MSG_CH,
+		.client = {
+			.needs = tlsext_psk_kex_modes_client_needs,
+			.build = tlsext_psk_kex_modes_client_build,
+			.parse = tlsext_psk_kex_modes_client_parse,
+		},
+		.server = {
+			.needs = tlsext_psk_kex_modes_server_needs,
+			.build = tlsext_psk_kex_modes_server_build,
+			.parse = tlsext_psk_kex_modes_server_parse,
+		},
+	},
+	{
+		.type = TLSEXT_TYPE_compress_certificate,
+		.messages = SSL_TLSEXT_MSG_CH | SSL_TLSEXT_MSG_CR,
+		.client = {
+			.needs = tlsext_certcomp_client_needs,
+			.build = tlsext_certcomp_client_build,
+			.parse = tlsext_certcomp_client_parse,
+		},
+		.server = {
+			.needs = tlsext_certcomp_server_needs,
+			.build = tlsext_certcomp_server_build,
+			.parse = tlsext_certcomp_server_parse,
+		},
+	},
+	{
+		/* Must be last - RFC 8446 section 4.2.11. */
+		.type = TLSEXT_TYPE_pre_shared_key,
+		.messages = SSL_TLSEXT_MSG_CH | SSL_TLSEXT_MSG_SH,
+		.client = {
+			.needs = tlsext_psk_client_needs,
+			.build = tlsext_psk_client_build,
+			.parse = tlsext_psk_client_parse,
+		},
+		.server = {
+			.needs = tlsext_psk_server_needs,
+			.build = tlsext_psk_server_build,
+			.parse = tlsext_psk_server_parse,
+		},
+	},
 };
 
 #define N_TLS_EXTENSIONS (sizeof(tls_extensions) / sizeof(*tls_extensions))
@@ -2111,6 +2613,18 @@ tlsext_parse(SSL *s, int is_server, uint16_t msg_type, CBS *cbs, int *alert)
 			goto err;
 		S3I(s)->hs.extensions_seen |= (1 << idx);
 
+		/*
+		 * RFC 8446 section 4.2.11 - pre_shared_key must be the last
+		 * extension in the ClientHello.
+		 */
+		if (tls_version >= TLS1_3_VERSION && is_server &&
+		    msg_type == SSL_TLSEXT_MSG_CH &&
+		    type == TLSEXT_TYPE_pre_shared_key &&
+		    CBS_len(&extensions) != 0) {
+			alert_desc = SSL_AD_ILLEGAL_PARAMETER;
+			goto err;
+		}
+
 		ext = tlsext_funcs(tlsext, is_server);
 		if (!ext->parse(s, msg_type, &extension_data, &alert_desc))
 			goto err;
@@ -2136,6 +2650,10 @@ tlsext_server_reset_state(SSL *s)
 	S3I(s)->alpn_selected = NULL;
 	S3I(s)->alpn_selected_len = 0;
 	s->internal->srtp_profile = NULL;
+	S3I(s)->hs.tls13.psk_dhe_ke = 0;
+	S3I(s)->hs.tls13.cert_comp_alg = 0;
+	if (SSL_is_dtls(s))
+		dtls1_cid_reset(s);
 }
 
 int
@@ -2161,6 +2679,8 @@ tlsext_client_reset_state(SSL *s)
 	free(S3I(s)->alpn_selected);
 	S3I(s)->alpn_selected = NULL;
 	S3I(s)->alpn_selected_len = 0;
+	if (SSL_is_dtls(s))
+		dtls1_cid_reset(s);
 }
 
 int
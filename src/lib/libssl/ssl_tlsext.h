@@ -119,6 +119,40 @@ int tlsext_cookie_server_needs(SSL *s, uint16_t msg_type);
 int tlsext_cookie_server_build(SSL *s, uint16_t msg_type, CBB *cbb);
 int tlsext_cookie_server_parse(SSL *s, uint16_t msg_type, CBS *cbs, int *alert);
 
+int tlsext_early_data_client_needs(SSL *s, uint16_t msg_type);
+int tlsext_early_data_client_build(SSL *s, uint16_t msg_type, CBB *cbb);
+int tlsext_early_data_client_parse(SSL *s, uint16_t msg_type, CBS *cbs,
+    int *alert);
+int tlsext_early_data_server_needs(SSL *s, uint16_t msg_type);
+int tlsext_early_data_server_build(SSL *s, uint16_t msg_type, CBB *cbb);
+int tlsext_early_data_server_parse(SSL *s, uint16_t msg_type, CBS *cbs,
+    int *alert);
+
+int tlsext_psk_kex_modes_client_needs(SSL *s, uint16_t msg_type);
+int tlsext_psk_kex_modes_client_build(SSL *s, uint16_t msg_type, CBB *cbb);
+int tlsext_psk_kex_modes_client_parse(SSL *s, uint16_t msg_type, CBS *cbs,
+    int *alert);
+int tlsext_psk_kex_modes_server_needs(SSL *s, uint16_t msg_type);
+int tlsext_psk_kex_modes_server_build(SSL *s, uint16_t msg_type, CBB *cbb);
+int tlsext_psk_kex_modes_server_parse(SSL *s, uint16_t msg_type, CBS *cbs,
+    int *alert);
+
+int tlsext_certcomp_client_needs(SSL *s, uint16_t msg_type);
+int tlsext_certcomp_client_build(SSL *s, uint16_t msg_type, CBB *cbb);
+int tlsext_certcomp_client_parse(SSL *s, uint16_t msg_type, CBS *cbs,
+    int *alert);
+int tlsext_certcomp_server_needs(SSL *s, uint16_t msg_type);
+int tlsext_certcomp_server_build(SSL *s, uint16_t msg_type, CBB *cbb);
+int tlsext_certcomp_server_parse(SSL *s, uint16_t msg_type, CBS *cbs,
+    int *alert);
+
+int tlsext_psk_client_needs(SSL *s, uint16_t msg_type);
+int tlsext_psk_client_build(SSL *s, uint16_t msg_type, CBB *cbb);
+int tlsext_psk_client_parse(SSL *s, uint16_t msg_type, CBS *cbs, int *alert);
+int tlsext_psk_server_needs(SSL *s, uint16_t msg_type);
+int tlsext_psk_server_build(SSL *s, uint16_t msg_type, CBB *cbb);
+int tlsext_psk_server_parse(SSL *s, uint16_t msg_type, CBS *cbs, int *alert);
+
 #ifndef OPENSSL_NO_SRTP
 int tlsext_srtp_client_needs(SSL *s, uint16_t msg_type);
 int tlsext_srtp_client_build(SSL *s, uint16_t msg_type, CBB *cbb);
@@ -128,6 +162,13 @@ int tlsext_srtp_server_build(SSL *s, uint16_t msg_type, CBB *cbb);
 int tlsext_srtp_server_parse(SSL *s, uint16_t msg_type, CBS *cbs, int *alert);
 #endif
 
+int tlsext_cid_client_needs(SSL *s, uint16_t msg_type);
+int tlsext_cid_client_build(SSL *s, uint16_t msg_type, CBB *cbb);
+int tlsext_cid_client_parse(SSL *s, uint16_t msg_type, CBS *cbs, int *alert);
+int tlsext_cid_server_needs(SSL *s, uint16_t msg_type);
+int tlsext_cid_server_build(SSL *s, uint16_t msg_type, CBB *cbb);
+int tlsext_cid_server_parse(SSL *s, uint16_t msg_type, CBS *cbs, int *alert);
+
 int tlsext_client_build(SSL *s, uint16_t msg_type, CBB *cbb);
 int tlsext_client_parse(SSL *s, uint16_t msg_type, CBS *cbs, int *alert);
 
@@ -0,0 +1,102 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Handshake tracing.
+ *
+ * The TLSv1.2 and TLSv1.3 state machines report each change of the handshake
+ * state and each handshake message that is sent or received, which is passed
+ * on with a timestamp to the trace callback, if one is set. Where the
+ * platform has them, static probes are fired for the same events, which are
+ * no-ops unless a tracer attaches to them.
+ */
+
+#include <time.h>
+
+#include <openssl/ssl.h>
+
+#include "ssl_locl.h"
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define SSL_TRACE_PROBE(name, s, value, len) \
+	DTRACE_PROBE3(libssl, name, (s), (value), (len))
+#else
+#define SSL_TRACE_PROBE(name, s, value, len)
+#endif
+
+static void
+ssl_trace(SSL *s, int event, int value, size_t len)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	s->internal->handshake_trace_cb(s, event, value, len, &now,
+	    s->internal->handshake_trace_arg);
+}
+
+void
+ssl_trace_state(SSL *s)
+{
+	SSL_TRACE_PROBE(handshake__state, s, S3I(s)->hs.state, 0);
+
+	if (s->internal->handshake_trace_cb == NULL)
+		return;
+
+	ssl_trace(s, SSL_TRACE_STATE, S3I(s)->hs.state, 0);
+}
+
+/*
+ * A message is traced once it has been written out in full, or read in full
+ * and added to the transcript. The length includes the message header.
+ */
+void
+ssl_trace_message(SSL *s, int sent, const void *msg, size_t len)
+{
+	int msg_type;
+
+	if (len < 1)
+		return;
+	msg_type = *(const uint8_t *)msg;
+
+	if (sent)
+		SSL_TRACE_PROBE(handshake__sent, s, msg_type, len);
+	else
+		SSL_TRACE_PROBE(handshake__received, s, msg_type, len);
+
+	if (s->internal->handshake_trace_cb == NULL)
+		return;
+
+	ssl_trace(s, sent ? SSL_TRACE_MESSAGE_SENT :
+	    SSL_TRACE_MESSAGE_RECEIVED, msg_type, len);
+}
+
+void
+SSL_CTX_set_handshake_trace_callback(SSL_CTX *ctx,
+    ssl_handshake_trace_cb_fn cb, void *arg)
+{
+	ctx->internal->handshake_trace_cb = cb;
+	ctx->internal->handshake_trace_arg = arg;
+}
+
+void
+SSL_set_handshake_trace_callback(SSL *ssl, ssl_handshake_trace_cb_fn cb,
+    void *arg)
+{
+	ssl->internal->handshake_trace_cb = cb;
+	ssl->internal->handshake_trace_arg = arg;
+}
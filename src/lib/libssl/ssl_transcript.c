@@ -126,11 +126,24 @@ tls1_transcript_init(SSL *s)
 	return 1;
 }
 
+static void
+tls1_transcript_digests_free(SSL *s)
+{
+	size_t i;
+
+	for (i = 0; i < TLS1_TRANSCRIPT_DIGESTS; i++) {
+		EVP_MD_CTX_free(S3I(s)->handshake_digests[i]);
+		S3I(s)->handshake_digests[i] = NULL;
+	}
+}
+
 void
 tls1_transcript_free(SSL *s)
 {
 	BUF_MEM_free(S3I(s)->handshake_transcript);
 	S3I(s)->handshake_transcript = NULL;
+
+	tls1_transcript_digests_free(s);
 }
 
 void
@@ -145,6 +158,7 @@ tls1_transcript_reset(SSL *s)
 	 */
 	(void)BUF_MEM_grow_clean(S3I(s)->handshake_transcript, 0);
 
+	tls1_transcript_digests_free(s);
 	tls1_transcript_unfreeze(s);
 }
 
@@ -197,6 +211,24 @@ tls1_transcript_unfreeze(SSL *s)
 	s->s3->flags &= ~TLS1_FLAGS_FREEZE_TRANSCRIPT;
 }
 
+static int
+tls1_transcript_digests_update(SSL *s, const unsigned char *buf, size_t len)
+{
+	size_t i;
+
+	if (s->s3->flags & TLS1_FLAGS_FREEZE_TRANSCRIPT)
+		return 1;
+
+	for (i = 0; i < TLS1_TRANSCRIPT_DIGESTS; i++) {
+		if (S3I(s)->handshake_digests[i] == NULL)
+			continue;
+		if (!EVP_DigestUpdate(S3I(s)->handshake_digests[i], buf, len))
+			return 0;
+	}
+
+	return 1;
+}
+
 int
 tls1_transcript_record(SSL *s, const unsigned char *buf, size_t len)
 {
@@ -206,5 +238,118 @@ tls1_transcript_record(SSL *s, const unsigned char *buf, size_t len)
 	if (!tls1_transcript_append(s, buf, len))
 		return 0;
 
+	if (!tls1_transcript_digests_update(s, buf, len))
+		return 0;
+
+	return 1;
+}
+
+/*
+ * The digests used by the TLSv1.2 signature algorithms in ssl_sigalgs.c.
+ */
+static const EVP_MD *(*const tls1_transcript_digest_mds[])(void) = {
+	EVP_sha1,
+	EVP_sha256,
+	EVP_sha384,
+	EVP_sha512,
+};
+
+/*
+ * Replace the transcript with a digest of it for each TLSv1.2 signature
+ * algorithm. This is used once it is known that the transcript is only
+ * needed for a CertificateVerify, so that the handshake messages that
+ * follow (typically a certificate chain) do not have to be kept.
+ */
+int
+tls1_transcript_digests_init(SSL *s)
+{
+	const unsigned char *data;
+	EVP_MD_CTX *md_ctx;
+	size_t len, i;
+
+	if (!tls1_transcript_data(s, &data, &len))
+		return 0;
+
+	tls1_transcript_digests_free(s);
+
+	for (i = 0; i < TLS1_TRANSCRIPT_DIGESTS; i++) {
+		if ((md_ctx = EVP_MD_CTX_new()) == NULL) {
+			SSLerror(s, ERR_R_MALLOC_FAILURE);
+			goto err;
+		}
+		S3I(s)->handshake_digests[i] = md_ctx;
+		if (!EVP_DigestInit_ex(md_ctx, tls1_transcript_digest_mds[i](),
+		    NULL) || !EVP_DigestUpdate(md_ctx, data, len)) {
+			SSLerror(s, ERR_R_EVP_LIB);
+			goto err;
+		}
+	}
+
+	BUF_MEM_free(S3I(s)->handshake_transcript);
+	S3I(s)->handshake_transcript = NULL;
+
 	return 1;
+
+ err:
+	tls1_transcript_digests_free(s);
+
+	return 0;
+}
+
+/*
+ * Compute the digest of the transcript with the given hash, either from
+ * the transcript itself or from the matching digest.
+ */
+int
+tls1_transcript_digest(SSL *s, const EVP_MD *md, unsigned char *out,
+    size_t out_len, size_t *outlen)
+{
+	EVP_MD_CTX *md_ctx = NULL;
+	const unsigned char *data;
+	unsigned int mdlen;
+	size_t len, i;
+	int ret = 0;
+
+	if (EVP_MD_size(md) <= 0 || (size_t)EVP_MD_size(md) > out_len)
+		goto err;
+
+	if (tls1_transcript_data(s, &data, &len)) {
+		if (!EVP_Digest(data, len, out, &mdlen, md, NULL)) {
+			SSLerror(s, ERR_R_EVP_LIB);
+			goto err;
+		}
+		goto done;
+	}
+
+	for (i = 0; i < TLS1_TRANSCRIPT_DIGESTS; i++) {
+		if (S3I(s)->handshake_digests[i] == NULL)
+			continue;
+		if (EVP_MD_CTX_md(S3I(s)->handshake_digests[i]) == md)
+			break;
+	}
+	if (i == TLS1_TRANSCRIPT_DIGESTS) {
+		SSLerror(s, ERR_R_INTERNAL_ERROR);
+		goto err;
+	}
+
+	if ((md_ctx = EVP_MD_CTX_new()) == NULL) {
+		SSLerror(s, ERR_R_MALLOC_FAILURE);
+		goto err;
+	}
+	if (!EVP_MD_CTX_copy_ex(md_ctx, S3I(s)->handshake_digests[i]) ||
+	    !EVP_DigestFinal_ex(md_ctx, out, &mdlen)) {
+		SSLerror(s, ERR_R_EVP_LIB);
+		goto err;
+	}
+
+ done:
+	if (outlen != NULL)
+		*outlen = mdlen;
+
+	ret = 1;
+
+ err:
+	EVP_MD_CTX_free(md_ctx);
+
+	return ret;
 }
@@ -0,0 +1,176 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Write buffers in flight for zero-copy sends.
+ *
+ * A socket BIO set up with BIO_set_zerocopy() has the kernel send large
+ * writes straight from the buffer of the caller, which must then be left
+ * alone until the kernel has completed the send. Once a sealed record
+ * buffer has been written out in full, it is therefore retired rather than
+ * reused whenever zero-copy sends are outstanding on the socket, along with
+ * the number of sends issued so far. The record layer takes a fresh buffer
+ * from the pool of the SSL_CTX for its next record, and retired buffers go
+ * back to the pool once the socket reports their sends as completed.
+ */
+
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <openssl/bio.h>
+
+#include "ssl_locl.h"
+
+/* Longest wait for outstanding sends when the write BIO goes away. */
+#define SSL_ZEROCOPY_DRAIN_MS	1000
+
+struct ssl_zerocopy_buf {
+	uint8_t *buf;
+	size_t len;
+	uint32_t seq;
+};
+
+struct ssl_zerocopy {
+	struct ssl_zerocopy_buf *bufs;
+	size_t num;
+	size_t cap;
+};
+
+static BIO *
+ssl_zerocopy_bio(SSL *s)
+{
+	if (s->wbio == NULL)
+		return NULL;
+
+	return BIO_find_type(s->wbio, BIO_TYPE_SOCKET);
+}
+
+/*
+ * Release the retired buffers whose sends have all completed, returning
+ * the number of buffers that are still in flight.
+ */
+static size_t
+ssl_zerocopy_reap(SSL *s, BIO *bio)
+{
+	struct ssl_zerocopy *zc = s->internal->zerocopy;
+	uint32_t done;
+	size_t i;
+
+	if (zc == NULL || zc->num == 0)
+		return 0;
+
+	done = (uint32_t)BIO_get_zerocopy_done(bio);
+
+	for (i = 0; i < zc->num; ) {
+		if ((int32_t)(done - zc->bufs[i].seq) < 0) {
+			i++;
+			continue;
+		}
+		ssl_buffer_put(s->ctx, zc->bufs[i].buf, zc->bufs[i].len);
+		zc->bufs[i] = zc->bufs[--zc->num];
+	}
+
+	return zc->num;
+}
+
+/*
+ * Take over a write buffer that has just been written out in full, if the
+ * kernel may still be sending from it. Return 1 if the caller has to let go
+ * of the buffer, 0 if it may keep using it.
+ */
+int
+ssl_zerocopy_retire(SSL *s, uint8_t *buf, size_t len)
+{
+	struct ssl_zerocopy *zc;
+	struct ssl_zerocopy_buf *bufs;
+	uint32_t sent;
+	size_t cap;
+	BIO *bio;
+
+	if (buf == NULL || (bio = ssl_zerocopy_bio(s)) == NULL)
+		return 0;
+
+	sent = (uint32_t)BIO_get_zerocopy_sent(bio);
+	if (sent == 0 && s->internal->zerocopy == NULL)
+		return 0;
+
+	ssl_zerocopy_reap(s, bio);
+	if (sent == (uint32_t)BIO_get_zerocopy_done(bio))
+		return 0;
+
+	if ((zc = s->internal->zerocopy) == NULL) {
+		if ((zc = calloc(1, sizeof(*zc))) == NULL)
+			goto lost;
+		s->internal->zerocopy = zc;
+	}
+	if (zc->num == zc->cap) {
+		if ((cap = zc->cap * 2) == 0)
+			cap = 8;
+		if ((bufs = reallocarray(zc->bufs, cap, sizeof(*bufs))) == NULL)
+			goto lost;
+		zc->bufs = bufs;
+		zc->cap = cap;
+	}
+
+	zc->bufs[zc->num].buf = buf;
+	zc->bufs[zc->num].len = len;
+	zc->bufs[zc->num].seq = sent;
+	zc->num++;
+
+	return 1;
+
+ lost:
+	/*
+	 * The buffer cannot be tracked, so it is never reused or freed, as
+	 * the kernel may still be sending from it.
+	 */
+	return 1;
+}
+
+/*
+ * Wait, for a bounded time, for the sends from all retired buffers to
+ * complete before the write BIO is freed or replaced. Buffers that are
+ * still in flight after that are left allocated, as releasing them could
+ * put other data on the wire.
+ */
+void
+ssl_zerocopy_free(SSL *s)
+{
+	struct ssl_zerocopy *zc;
+	struct pollfd pfd;
+	BIO *bio;
+	int waited;
+
+	if ((zc = s->internal->zerocopy) == NULL)
+		return;
+
+	if ((bio = ssl_zerocopy_bio(s)) != NULL &&
+	    (pfd.fd = BIO_get_fd(bio, NULL)) != -1) {
+		/* Completions are reported as errors on the socket. */
+		pfd.events = 0;
+		for (waited = 0; ssl_zerocopy_reap(s, bio) > 0 &&
+		    waited < SSL_ZEROCOPY_DRAIN_MS; waited += 10) {
+			if (poll(&pfd, 1, 10) == -1)
+				break;
+		}
+	}
+
+	free(zc->bufs);
+	free(zc);
+	s->internal->zerocopy = NULL;
+}
@@ -121,9 +121,6 @@
 #include "ssl_sigalgs.h"
 #include "ssl_tlsext.h"
 
-static int tls_decrypt_ticket(SSL *s, CBS *ticket, int *alert,
-    SSL_SESSION **psess);
-
 int
 tls1_new(SSL *s)
 {
@@ -467,23 +464,31 @@ tls1_get_shared_curve(SSL *s)
 	size_t preflen, supplen, i, j;
 	const uint16_t *pref, *supp;
 	unsigned long server_pref;
+	int nid = NID_undef;
 
 	/* Cannot do anything on the client side. */
 	if (s->server == 0)
 		return (NID_undef);
 
+	if (ssl_nego_cache_get_group(s, &nid))
+		return (nid);
+
 	/* Return first preference shared curve. */
 	server_pref = (s->internal->options & SSL_OP_CIPHER_SERVER_PREFERENCE);
 	tls1_get_group_list(s, (server_pref == 0), &pref, &preflen);
 	tls1_get_group_list(s, (server_pref != 0), &supp, &supplen);
 
-	for (i = 0; i < preflen; i++) {
+	for (i = 0; i < preflen && nid == NID_undef; i++) {
 		for (j = 0; j < supplen; j++) {
-			if (pref[i] == supp[j])
-				return (tls1_ec_curve_id2nid(pref[i]));
+			if (pref[i] == supp[j]) {
+				nid = tls1_ec_curve_id2nid(pref[i]);
+				break;
+			}
 		}
 	}
-	return (NID_undef);
+	ssl_nego_cache_set_group(s, nid);
+
+	return (nid);
 }
 
 /* For an EC key set TLS ID and required compression based on parameters. */
@@ -635,6 +640,7 @@ ssl_check_clienthello_tlsext_late(SSL *s)
 	    s->ctx && s->ctx->internal->tlsext_status_cb) {
 		int r;
 		CERT_PKEY *certpkey;
+		int idx;
 		certpkey = ssl_get_server_send_pkey(s);
 		/* If no certificate can't return certificate status */
 		if (certpkey == NULL) {
@@ -644,7 +650,15 @@ ssl_check_clienthello_tlsext_late(SSL *s)
 		/* Set current certificate to one we will use so
 		 * SSL_get_certificate et al can pick it up.
 		 */
-		s->cert->key = certpkey;
+		if (s->cert->key != certpkey) {
+			idx = certpkey - s->cert->pkeys;
+			if (!ssl_cert_unshare(&s->cert)) {
+				ret = SSL_TLSEXT_ERR_ALERT_FATAL;
+				al = SSL_AD_INTERNAL_ERROR;
+				goto err;
+			}
+			s->cert->key = &s->cert->pkeys[idx];
+		}
 		r = s->ctx->internal->tlsext_status_cb(s,
 		    s->ctx->internal->tlsext_status_arg);
 		switch (r) {
@@ -823,12 +837,13 @@ tls1_process_ticket(SSL *s, CBS *ext_block, int *alert, SSL_SESSION **ret)
 		return TLS1_TICKET_NOT_DECRYPTED;
 	}
 
-	return tls_decrypt_ticket(s, &ext_data, alert, ret);
+	return tls1_decrypt_ticket(s, &ext_data, alert, ret);
 }
 
-/* tls_decrypt_ticket attempts to decrypt a session ticket.
+/* tls1_decrypt_ticket attempts to decrypt a session ticket.
  *
- *   ticket: a CBS containing the body of the session ticket extension.
+ *   ticket: a CBS containing the body of the session ticket extension, or
+ *       the identity from a TLSv1.3 pre_shared_key extension.
  *   psess: (output) on return, if a ticket was decrypted, then this is set to
  *       point to the resulting session.
  *
@@ -837,19 +852,18 @@ tls1_process_ticket(SSL *s, CBS *ext_block, int *alert, SSL_SESSION **ret)
  *    TLS1_TICKET_NOT_DECRYPTED: the ticket couldn't be decrypted.
  *    TLS1_TICKET_DECRYPTED: a ticket was decrypted and *psess was set.
  */
-static int
-tls_decrypt_ticket(SSL *s, CBS *ticket, int *alert, SSL_SESSION **psess)
+int
+tls1_decrypt_ticket(SSL *s, CBS *ticket, int *alert, SSL_SESSION **psess)
 {
 	CBS ticket_name, ticket_iv, ticket_encdata, ticket_hmac;
 	SSL_SESSION *sess = NULL;
 	unsigned char *sdec = NULL;
-	size_t sdec_len = 0;
-	const unsigned char *p;
+	size_t sdec_len = 0, plain_len;
 	unsigned char hmac[EVP_MAX_MD_SIZE];
 	HMAC_CTX *hctx = NULL;
 	EVP_CIPHER_CTX *cctx = NULL;
 	SSL_CTX *tctx = s->initial_ctx;
-	int slen, hlen;
+	int slen, hlen, rv;
 	int alert_desc = SSL_AD_INTERNAL_ERROR;
 	int ret = TLS1_TICKET_FATAL_ERROR;
 
@@ -858,6 +872,33 @@ tls_decrypt_ticket(SSL *s, CBS *ticket, int *alert, SSL_SESSION **psess)
 	if (!CBS_get_bytes(ticket, &ticket_name, 16))
 		goto derr;
 
+	/*
+	 * Without a callback the ticket was sealed by tls1_seal_ticket(),
+	 * so it is opened in one pass with the context's AEAD.
+	 */
+	if (tctx->internal->tlsext_ticket_key_cb == NULL) {
+		if (!CBS_mem_equal(&ticket_name,
+		    tctx->internal->tlsext_tick_key_name,
+		    sizeof(tctx->internal->tlsext_tick_key_name)))
+			goto derr;
+		if (!CBS_get_bytes(ticket, &ticket_iv, TLS1_TICKET_NONCE_LEN))
+			goto derr;
+		if (!CBS_get_bytes(ticket, &ticket_encdata, CBS_len(ticket)))
+			goto derr;
+		if ((sdec_len = CBS_len(&ticket_encdata)) == 0)
+			goto derr;
+		if ((sdec = calloc(1, sdec_len)) == NULL)
+			goto err;
+		if (!EVP_AEAD_CTX_open(ssl_ctx_ticket_aead_ctx(tctx),
+		    sdec, &plain_len, sdec_len, CBS_data(&ticket_iv),
+		    CBS_len(&ticket_iv), CBS_data(&ticket_encdata),
+		    CBS_len(&ticket_encdata), CBS_data(&ticket_name),
+		    CBS_len(&ticket_name)))
+			goto derr;
+		slen = plain_len;
+		goto decode;
+	}
+
 	/*
 	 * Initialize session ticket encryption and HMAC contexts.
 	 */
@@ -866,54 +907,34 @@ tls_decrypt_ticket(SSL *s, CBS *ticket, int *alert, SSL_SESSION **psess)
 	if ((hctx = HMAC_CTX_new()) == NULL)
 		goto err;
 
-	if (tctx->internal->tlsext_ticket_key_cb != NULL) {
-		int rv;
-
-		/*
-		 * The API guarantees EVP_MAX_IV_LENGTH bytes of space for
-		 * the iv to tlsext_ticket_key_cb().  Since the total space
-		 * required for a session cookie is never less than this,
-		 * this check isn't too strict.  The exact check comes later.
-		 */
-		if (CBS_len(ticket) < EVP_MAX_IV_LENGTH)
-			goto derr;
-
-		if ((rv = tctx->internal->tlsext_ticket_key_cb(s,
-		    (unsigned char *)CBS_data(&ticket_name),
-		    (unsigned char *)CBS_data(ticket), cctx, hctx, 0)) < 0)
-			goto err;
-		if (rv == 0)
-			goto derr;
-		if (rv == 2) {
-			/* Renew ticket. */
-			s->internal->tlsext_ticket_expected = 1;
-		}
+	/*
+	 * The API guarantees EVP_MAX_IV_LENGTH bytes of space for
+	 * the iv to tlsext_ticket_key_cb().  Since the total space
+	 * required for a session cookie is never less than this,
+	 * this check isn't too strict.  The exact check comes later.
+	 */
+	if (CBS_len(ticket) < EVP_MAX_IV_LENGTH)
+		goto derr;
 
-		/*
-		 * Now that the cipher context is initialised, we can extract
-		 * the IV since its length is known.
-		 */
-		if (!CBS_get_bytes(ticket, &ticket_iv,
-		    EVP_CIPHER_CTX_iv_length(cctx)))
-			goto derr;
-	} else {
-		/* Check that the key name matches. */
-		if (!CBS_mem_equal(&ticket_name,
-		    tctx->internal->tlsext_tick_key_name,
-		    sizeof(tctx->internal->tlsext_tick_key_name)))
-			goto derr;
-		if (!CBS_get_bytes(ticket, &ticket_iv,
-		    EVP_CIPHER_iv_length(EVP_aes_128_cbc())))
-			goto derr;
-		if (!EVP_DecryptInit_ex(cctx, EVP_aes_128_cbc(), NULL,
-		    tctx->internal->tlsext_tick_aes_key, CBS_data(&ticket_iv)))
-			goto err;
-		if (!HMAC_Init_ex(hctx, tctx->internal->tlsext_tick_hmac_key,
-		    sizeof(tctx->internal->tlsext_tick_hmac_key), EVP_sha256(),
-		    NULL))
-			goto err;
+	if ((rv = tctx->internal->tlsext_ticket_key_cb(s,
+	    (unsigned char *)CBS_data(&ticket_name),
+	    (unsigned char *)CBS_data(ticket), cctx, hctx, 0)) < 0)
+		goto err;
+	if (rv == 0)
+		goto derr;
+	if (rv == 2) {
+		/* Renew ticket. */
+		s->internal->tlsext_ticket_expected = 1;
 	}
 
+	/*
+	 * Now that the cipher context is initialised, we can extract
+	 * the IV since its length is known.
+	 */
+	if (!CBS_get_bytes(ticket, &ticket_iv,
+	    EVP_CIPHER_CTX_iv_length(cctx)))
+		goto derr;
+
 	/*
 	 * Attempt to process session ticket.
 	 */
@@ -960,12 +981,12 @@ tls_decrypt_ticket(SSL *s, CBS *ticket, int *alert, SSL_SESSION **psess)
 
 	slen += hlen;
 
+ decode:
 	/*
 	 * For session parse failures, indicate that we need to send a new
 	 * ticket.
 	 */
-	p = sdec;
-	if ((sess = d2i_SSL_SESSION(NULL, &p, slen)) == NULL)
+	if ((sess = SSL_SESSION_from_ticket(sdec, slen, tctx)) == NULL)
 		goto derr;
 	*psess = sess;
 	sess = NULL;
@@ -975,6 +996,7 @@ tls_decrypt_ticket(SSL *s, CBS *ticket, int *alert, SSL_SESSION **psess)
 
  derr:
 	ERR_clear_error();
+	ssl_stats_ticket_decrypt_failure(s);
 	s->internal->tlsext_ticket_expected = 1;
 	ret = TLS1_TICKET_NOT_DECRYPTED;
 	goto done;
@@ -992,3 +1014,156 @@ tls_decrypt_ticket(SSL *s, CBS *ticket, int *alert, SSL_SESSION **psess)
 
 	return ret;
 }
+
+int
+tls1_ticket_aead_init(SSL_CTX *ctx)
+{
+	unsigned char key[32];
+	int ret;
+
+	memcpy(key, ctx->internal->tlsext_tick_hmac_key, 16);
+	memcpy(key + 16, ctx->internal->tlsext_tick_aes_key, 16);
+
+	EVP_AEAD_CTX_cleanup(&ctx->internal->tlsext_tick_aead_ctx);
+	ret = EVP_AEAD_CTX_init(&ctx->internal->tlsext_tick_aead_ctx,
+	    EVP_aead_aes_256_gcm(), key, sizeof(key),
+	    EVP_AEAD_DEFAULT_TAG_LENGTH, NULL);
+
+	explicit_bzero(key, sizeof(key));
+
+	if (ret)
+		ret = ssl_ctx_nodes_ticket_aead_update(ctx);
+
+	return ret;
+}
+
+/*
+ * Seal a session with the AEAD of the initial context, into a ticket of the
+ * key name, a random nonce and the sealed session, with the key name as
+ * additional data.
+ */
+static int
+tls1_seal_ticket(SSL_CTX *tctx, const unsigned char *session,
+    size_t session_len, CBB *cbb)
+{
+	const EVP_AEAD_CTX *aead_ctx = ssl_ctx_ticket_aead_ctx(tctx);
+	unsigned char nonce[TLS1_TICKET_NONCE_LEN];
+	size_t enc_session_len, out_len;
+	unsigned char *enc_session;
+
+	arc4random_buf(nonce, sizeof(nonce));
+
+	enc_session_len = session_len + EVP_AEAD_max_overhead(aead_ctx->aead);
+
+	if (!CBB_add_bytes(cbb, tctx->internal->tlsext_tick_key_name,
+	    sizeof(tctx->internal->tlsext_tick_key_name)))
+		return 0;
+	if (!CBB_add_bytes(cbb, nonce, sizeof(nonce)))
+		return 0;
+	if (!CBB_add_space(cbb, &enc_session, enc_session_len))
+		return 0;
+	if (!EVP_AEAD_CTX_seal(aead_ctx, enc_session, &out_len,
+	    enc_session_len, nonce, sizeof(nonce), session, session_len,
+	    tctx->internal->tlsext_tick_key_name,
+	    sizeof(tctx->internal->tlsext_tick_key_name)))
+		return 0;
+
+	return out_len == enc_session_len;
+}
+
+/*
+ * tls1_encrypt_ticket encrypts the given session and adds the resulting
+ * ticket to cbb. The ticket keys are provided by tlsext_ticket_key_cb if
+ * one is set, for a ticket of the key name, IV, encrypted session and HMAC.
+ * Otherwise the session is sealed by tls1_seal_ticket().
+ */
+int
+tls1_encrypt_ticket(SSL *s, SSL_SESSION *sess, CBB *cbb)
+{
+	SSL_CTX *tctx = s->initial_ctx, *peer_ctx = NULL;
+	size_t enc_session_len, enc_session_max_len, hmac_len;
+	unsigned char *enc_session = NULL, *session = NULL;
+	size_t session_len = 0;
+	unsigned char iv[EVP_MAX_IV_LENGTH];
+	unsigned char key_name[16];
+	EVP_CIPHER_CTX *cctx = NULL;
+	HMAC_CTX *hctx = NULL;
+	unsigned char *hmac;
+	unsigned int hlen;
+	int len;
+	int ret = 0;
+
+	if ((s->internal->options & SSL_OP_TICKET_PEER_CERT_DIGEST) != 0)
+		peer_ctx = tctx;
+	if (!SSL_SESSION_ticket(sess, peer_ctx, &session, &session_len))
+		goto err;
+	if (session_len > 0xffff)
+		goto err;
+
+	if (tctx->internal->tlsext_ticket_key_cb == NULL) {
+		ret = tls1_seal_ticket(tctx, session, session_len, cbb);
+		goto err;
+	}
+
+	/* Initialize HMAC and cipher contexts, which the callback sets up. */
+	if ((cctx = EVP_CIPHER_CTX_new()) == NULL)
+		goto err;
+	if ((hctx = HMAC_CTX_new()) == NULL)
+		goto err;
+
+	if (tctx->internal->tlsext_ticket_key_cb(s, key_name, iv, cctx,
+	    hctx, 1) < 0)
+		goto err;
+
+	/* Encrypt the session state. */
+	enc_session_max_len = session_len + EVP_MAX_BLOCK_LENGTH;
+	if ((enc_session = calloc(1, enc_session_max_len)) == NULL)
+		goto err;
+	enc_session_len = 0;
+	if (!EVP_EncryptUpdate(cctx, enc_session, &len, session,
+	    session_len))
+		goto err;
+	enc_session_len += len;
+	if (!EVP_EncryptFinal_ex(cctx, enc_session + enc_session_len,
+	    &len))
+		goto err;
+	enc_session_len += len;
+
+	if (enc_session_len > enc_session_max_len)
+		goto err;
+
+	/* Generate the HMAC. */
+	if (!HMAC_Update(hctx, key_name, sizeof(key_name)))
+		goto err;
+	if (!HMAC_Update(hctx, iv, EVP_CIPHER_CTX_iv_length(cctx)))
+		goto err;
+	if (!HMAC_Update(hctx, enc_session, enc_session_len))
+		goto err;
+
+	if ((hmac_len = HMAC_size(hctx)) <= 0)
+		goto err;
+
+	if (!CBB_add_bytes(cbb, key_name, sizeof(key_name)))
+		goto err;
+	if (!CBB_add_bytes(cbb, iv, EVP_CIPHER_CTX_iv_length(cctx)))
+		goto err;
+	if (!CBB_add_bytes(cbb, enc_session, enc_session_len))
+		goto err;
+	if (!CBB_add_space(cbb, &hmac, hmac_len))
+		goto err;
+
+	if (!HMAC_Final(hctx, hmac, &hlen))
+		goto err;
+	if (hlen != hmac_len)
+		goto err;
+
+	ret = 1;
+
+ err:
+	EVP_CIPHER_CTX_free(cctx);
+	HMAC_CTX_free(hctx);
+	freezero(session, session_len);
+	free(enc_session);
+
+	return ret;
+}
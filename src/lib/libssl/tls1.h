@@ -261,9 +261,17 @@ extern "C" {
 /* ExtensionType value from RFC 7685. */
 #define TLSEXT_TYPE_padding	21
 
+/* ExtensionType value from RFC 8879. */
+#if defined(LIBRESSL_HAS_TLS1_3) || defined(LIBRESSL_INTERNAL)
+#define TLSEXT_TYPE_compress_certificate	27
+#endif
+
 /* ExtensionType value from RFC 4507. */
 #define TLSEXT_TYPE_session_ticket		35
 
+/* ExtensionType value from RFC 9146. */
+#define TLSEXT_TYPE_connection_id		54
+
 /* ExtensionType values from RFC 8446 section 4.2 */
 #if defined(LIBRESSL_HAS_TLS1_3) || defined(LIBRESSL_INTERNAL)
 #define TLSEXT_TYPE_pre_shared_key		41
@@ -24,6 +24,12 @@
 
 #define TLS12_RECORD_SEQ_NUM_LEN	8
 #define TLS12_AEAD_FIXED_NONCE_MAX_LEN	12
+#define TLS12_AEAD_NONCE_MAX_LEN \
+    (TLS12_AEAD_FIXED_NONCE_MAX_LEN + TLS12_RECORD_SEQ_NUM_LEN)
+
+/* Sequence number, type, version and length, or their RFC 9146 form. */
+#define TLS12_PSEUDO_HEADER_MAX_LEN \
+    (2 * TLS12_RECORD_SEQ_NUM_LEN + 7 + DTLS1_MAX_CID_LENGTH)
 
 struct tls12_record_protection {
 	uint16_t epoch;
@@ -42,11 +48,22 @@ struct tls12_record_protection {
 
 	EVP_CIPHER_CTX *cipher_ctx;
 	EVP_MD_CTX *hash_ctx;
+	EVP_MD_CTX *mac_ctx;	/* reused to compute the MAC of each record */
+
+	/* AES-CBC with HMAC-SHA256 in one pass, used to seal records. */
+	EVP_CIPHER_CTX *stitched_ctx;
 
 	int stream_mac;
 
 	uint8_t *mac_key;
 	size_t mac_key_len;
+
+	/* Records are protected by the kernel, see ssl_ktls.c. */
+	int ktls;
+
+	/* DTLS connection ID carried by protected records - RFC 9146. */
+	uint8_t cid[DTLS1_MAX_CID_LENGTH];
+	size_t cid_len;
 };
 
 static struct tls12_record_protection *
@@ -67,6 +84,8 @@ tls12_record_protection_clear(struct tls12_record_protection *rp)
 
 	EVP_CIPHER_CTX_free(rp->cipher_ctx);
 	EVP_MD_CTX_free(rp->hash_ctx);
+	EVP_MD_CTX_free(rp->mac_ctx);
+	EVP_CIPHER_CTX_free(rp->stitched_ctx);
 
 	freezero(rp->mac_key, rp->mac_key_len);
 
@@ -97,6 +116,12 @@ tls12_record_protection_unused(struct tls12_record_protection *rp)
 	    rp->hash_ctx == NULL && rp->mac_key == NULL;
 }
 
+static int
+tls12_record_protection_uses_cid(struct tls12_record_protection *rp)
+{
+	return tls12_record_protection_engaged(rp) && rp->cid_len > 0;
+}
+
 static int
 tls12_record_protection_eiv_len(struct tls12_record_protection *rp,
     size_t *out_eiv_len)
@@ -178,6 +203,16 @@ struct tls12_record_layer {
 	struct tls12_record_protection *read_current;
 	struct tls12_record_protection *write_current;
 	struct tls12_record_protection *write_previous;
+
+	/* Connection IDs for the next change of cipher state. */
+	uint8_t next_read_cid[DTLS1_MAX_CID_LENGTH];
+	size_t next_read_cid_len;
+	uint8_t next_write_cid[DTLS1_MAX_CID_LENGTH];
+	size_t next_write_cid_len;
+
+	/* Number of records opened and sealed. */
+	uint64_t num_records_read;
+	uint64_t num_records_written;
 };
 
 struct tls12_record_layer *
@@ -222,6 +257,14 @@ tls12_record_layer_alert(struct tls12_record_layer *rl, uint8_t *alert_desc)
 	*alert_desc = rl->alert_desc;
 }
 
+void
+tls12_record_layer_record_counts(struct tls12_record_layer *rl,
+    uint64_t *num_read, uint64_t *num_written)
+{
+	*num_read = rl->num_records_read;
+	*num_written = rl->num_records_written;
+}
+
 int
 tls12_record_layer_write_overhead(struct tls12_record_layer *rl,
     size_t *overhead)
@@ -230,6 +273,9 @@ tls12_record_layer_write_overhead(struct tls12_record_layer *rl,
 
 	*overhead = 0;
 
+	if (rl->write->ktls)
+		return 1;
+
 	if (rl->write->aead_ctx != NULL) {
 		*overhead = rl->write->aead_tag_len;
 	} else if (rl->write->cipher_ctx != NULL) {
@@ -246,6 +292,10 @@ tls12_record_layer_write_overhead(struct tls12_record_layer *rl,
 		*overhead = eiv_len + block_size + mac_len;
 	}
 
+	/* The connection ID and the inner content type. */
+	if (rl->dtls && tls12_record_protection_uses_cid(rl->write))
+		*overhead += rl->write->cid_len + 1;
+
 	return 1;
 }
 
@@ -334,6 +384,48 @@ tls12_record_layer_write_epoch_done(struct tls12_record_layer *rl, uint16_t epoc
 	rl->write_previous = NULL;
 }
 
+/*
+ * Set the connection IDs negotiated by a handshake, which are used once the
+ * cipher state next changes in each direction.  The read connection ID is
+ * ours, carried by the records that the peer sends.
+ */
+int
+tls12_record_layer_set_cids(struct tls12_record_layer *rl, CBS *read_cid,
+    CBS *write_cid)
+{
+	size_t read_len = 0, write_len = 0;
+
+	if (read_cid != NULL)
+		read_len = CBS_len(read_cid);
+	if (write_cid != NULL)
+		write_len = CBS_len(write_cid);
+	if (read_len > sizeof(rl->next_read_cid) ||
+	    write_len > sizeof(rl->next_write_cid))
+		return 0;
+
+	if (read_len > 0)
+		memcpy(rl->next_read_cid, CBS_data(read_cid), read_len);
+	rl->next_read_cid_len = read_len;
+	if (write_len > 0)
+		memcpy(rl->next_write_cid, CBS_data(write_cid), write_len);
+	rl->next_write_cid_len = write_len;
+
+	return 1;
+}
+
+/*
+ * Length of the connection ID in a DTLS record header with the tls12_cid
+ * content type, as needed to find the end of the header.
+ */
+size_t
+tls12_record_layer_read_cid_len(struct tls12_record_layer *rl)
+{
+	if (tls12_record_protection_uses_cid(rl->read))
+		return rl->read->cid_len;
+
+	return rl->next_read_cid_len;
+}
+
 void
 tls12_record_layer_clear_read_state(struct tls12_record_layer *rl)
 {
@@ -359,6 +451,33 @@ tls12_record_layer_read_cipher_hash(struct tls12_record_layer *rl,
 	*hash = rl->read->hash_ctx;
 }
 
+void
+tls12_record_layer_seq_num(struct tls12_record_layer *rl, int is_write,
+    CBS *seq_num)
+{
+	struct tls12_record_protection *rp = is_write ? rl->write : rl->read;
+
+	CBS_init(seq_num, rp->seq_num, sizeof(rp->seq_num));
+}
+
+/*
+ * Leave the protection of records in one direction to the kernel, which has
+ * been given the keys and sequence number of the current epoch. From here on
+ * records are passed on and accepted with their content in the clear.
+ */
+int
+tls12_record_layer_use_ktls(struct tls12_record_layer *rl, int is_write)
+{
+	struct tls12_record_protection *rp = is_write ? rl->write : rl->read;
+
+	if (rl->dtls || rp->aead_ctx == NULL)
+		return 0;
+
+	rp->ktls = 1;
+
+	return 1;
+}
+
 void
 tls12_record_layer_reflect_seq_num(struct tls12_record_layer *rl)
 {
@@ -468,11 +587,35 @@ tls12_record_layer_ccs_aead(struct tls12_record_layer *rl,
 	return 1;
 }
 
+/*
+ * Records sealed with AES-CBC and HMAC-SHA256 can use a cipher that computes
+ * the MAC as it encrypts. Its CBC state is separate from that of
+ * cipher_ctx, so it is only used when each record has an explicit IV.
+ */
+static const EVP_CIPHER *
+tls12_record_layer_stitched_cipher(struct tls12_record_layer *rl)
+{
+	if (rl->version == TLS1_VERSION)
+		return NULL;
+	if (EVP_MD_type(rl->mac_hash) != NID_sha256)
+		return NULL;
+
+	switch (EVP_CIPHER_nid(rl->cipher)) {
+	case NID_aes_128_cbc:
+		return EVP_aes_128_cbc_hmac_sha256();
+	case NID_aes_256_cbc:
+		return EVP_aes_256_cbc_hmac_sha256();
+	}
+
+	return NULL;
+}
+
 static int
 tls12_record_layer_ccs_cipher(struct tls12_record_layer *rl,
     struct tls12_record_protection *rp, int is_write, CBS *mac_key, CBS *key,
     CBS *iv)
 {
+	const EVP_CIPHER *stitched;
 	EVP_PKEY *mac_pkey = NULL;
 	int gost_param_nid;
 	int mac_type;
@@ -525,6 +668,19 @@ tls12_record_layer_ccs_cipher(struct tls12_record_layer *rl,
 	    mac_pkey) <= 0)
 		goto err;
 
+	if (is_write && (stitched = tls12_record_layer_stitched_cipher(rl)) !=
+	    NULL) {
+		if ((rp->stitched_ctx = EVP_CIPHER_CTX_new()) == NULL)
+			goto err;
+		if (!EVP_CipherInit_ex(rp->stitched_ctx, stitched, NULL,
+		    CBS_data(key), CBS_data(iv), 1))
+			goto err;
+		if (EVP_CIPHER_CTX_ctrl(rp->stitched_ctx,
+		    EVP_CTRL_AEAD_SET_MAC_KEY, CBS_len(mac_key),
+		    (void *)CBS_data(mac_key)) <= 0)
+			goto err;
+	}
+
 	/* More special handling for GOST... */
 	if (EVP_CIPHER_type(rl->cipher) == NID_gost89_cnt) {
 		gost_param_nid = NID_id_tc26_gost_28147_param_Z;
@@ -570,11 +726,20 @@ tls12_record_layer_change_read_cipher_state(struct tls12_record_layer *rl,
 	struct tls12_record_protection *read_new = NULL;
 	int ret = 0;
 
+	/* The keys in the kernel cannot be changed. */
+	if (rl->read->ktls)
+		goto err;
+
 	if ((read_new = tls12_record_protection_new()) == NULL)
 		goto err;
 
 	/* Read sequence number gets reset to zero. */
 
+	if (rl->dtls) {
+		memcpy(read_new->cid, rl->next_read_cid, rl->next_read_cid_len);
+		read_new->cid_len = rl->next_read_cid_len;
+	}
+
 	if (!tls12_record_layer_change_cipher_state(rl, read_new, 0,
 	    mac_key, key, iv))
 		goto err;
@@ -595,17 +760,25 @@ int
 tls12_record_layer_change_write_cipher_state(struct tls12_record_layer *rl,
     CBS *mac_key, CBS *key, CBS *iv)
 {
-	struct tls12_record_protection *write_new;
+	struct tls12_record_protection *write_new = NULL;
 	int ret = 0;
 
+	/* The keys in the kernel cannot be changed. */
+	if (rl->write->ktls)
+		goto err;
+
 	if ((write_new = tls12_record_protection_new()) == NULL)
 		goto err;
 
 	/* Write sequence number gets reset to zero. */
 
 	/* DTLS epoch is incremented and is permitted to wrap. */
-	if (rl->dtls)
+	if (rl->dtls) {
 		write_new->epoch = rl->write_current->epoch + 1;
+		memcpy(write_new->cid, rl->next_write_cid,
+		    rl->next_write_cid_len);
+		write_new->cid_len = rl->next_write_cid_len;
+	}
 
 	if (!tls12_record_layer_change_cipher_state(rl, write_new, 1,
 	    mac_key, key, iv))
@@ -646,20 +819,60 @@ tls12_record_layer_build_seq_num(struct tls12_record_layer *rl, CBB *cbb,
 	return CBB_add_bytes(cbb, CBS_data(&seq), CBS_len(&seq));
 }
 
+/*
+ * With a connection ID, RFC 9146 section 5 puts it in the pseudo-header and
+ * starts it with a placeholder sequence number, so that it cannot be mistaken
+ * for one without.
+ */
+static int
+tls12_record_layer_cid_pseudo_header(struct tls12_record_layer *rl,
+    struct tls12_record_protection *rp, uint16_t record_len, CBS *seq_num,
+    CBB *cbb)
+{
+	uint8_t *placeholder;
+
+	if (!CBB_add_space(cbb, &placeholder, TLS12_RECORD_SEQ_NUM_LEN))
+		return 0;
+	memset(placeholder, 0xff, TLS12_RECORD_SEQ_NUM_LEN);
+	if (!CBB_add_u8(cbb, DTLS1_RT_TLS12_CID))
+		return 0;
+	if (!CBB_add_u8(cbb, rp->cid_len))
+		return 0;
+	if (!CBB_add_u8(cbb, DTLS1_RT_TLS12_CID))
+		return 0;
+	if (!CBB_add_u16(cbb, rl->version))
+		return 0;
+	if (!CBB_add_bytes(cbb, CBS_data(seq_num), CBS_len(seq_num)))
+		return 0;
+	if (!CBB_add_bytes(cbb, rp->cid, rp->cid_len))
+		return 0;
+	if (!CBB_add_u16(cbb, record_len))
+		return 0;
+
+	return CBB_flush(cbb);
+}
+
 static int
 tls12_record_layer_pseudo_header(struct tls12_record_layer *rl,
-    uint8_t content_type, uint16_t record_len, CBS *seq_num, uint8_t **out,
+    struct tls12_record_protection *rp, uint8_t content_type,
+    uint16_t record_len, CBS *seq_num, uint8_t *out, size_t out_size,
     size_t *out_len)
 {
 	CBB cbb;
 
-	*out = NULL;
 	*out_len = 0;
 
 	/* Build the pseudo-header used for MAC/AEAD. */
-	if (!CBB_init(&cbb, 13))
+	if (!CBB_init_fixed(&cbb, out, out_size))
 		goto err;
 
+	if (rl->dtls && content_type == DTLS1_RT_TLS12_CID) {
+		if (!tls12_record_layer_cid_pseudo_header(rl, rp, record_len,
+		    seq_num, &cbb))
+			goto err;
+		goto done;
+	}
+
 	if (!CBB_add_bytes(&cbb, CBS_data(seq_num), CBS_len(seq_num)))
 		goto err;
 	if (!CBB_add_u8(&cbb, content_type))
@@ -669,7 +882,8 @@ tls12_record_layer_pseudo_header(struct tls12_record_layer *rl,
 	if (!CBB_add_u16(&cbb, record_len))
 		goto err;
 
-	if (!CBB_finish(&cbb, out, out_len))
+ done:
+	if (!CBB_finish(&cbb, NULL, out_len))
 		goto err;
 
 	return 1;
@@ -682,51 +896,48 @@ tls12_record_layer_pseudo_header(struct tls12_record_layer *rl,
 
 static int
 tls12_record_layer_mac(struct tls12_record_layer *rl, CBB *cbb,
-    EVP_MD_CTX *hash_ctx, int stream_mac, CBS *seq_num, uint8_t content_type,
+    struct tls12_record_protection *rp, CBS *seq_num, uint8_t content_type,
     const uint8_t *content, size_t content_len, size_t *out_len)
 {
-	EVP_MD_CTX *mac_ctx = NULL;
-	uint8_t *header = NULL;
-	size_t header_len = 0;
+	EVP_MD_CTX *mac_ctx;
+	uint8_t header[TLS12_PSEUDO_HEADER_MAX_LEN];
+	size_t header_len;
 	size_t mac_len;
 	uint8_t *mac;
-	int ret = 0;
 
-	if ((mac_ctx = EVP_MD_CTX_new()) == NULL)
-		goto err;
-	if (!EVP_MD_CTX_copy(mac_ctx, hash_ctx))
-		goto err;
+	if (rp->mac_ctx == NULL) {
+		if ((rp->mac_ctx = EVP_MD_CTX_new()) == NULL)
+			return 0;
+	}
+	mac_ctx = rp->mac_ctx;
+	if (!EVP_MD_CTX_copy_ex(mac_ctx, rp->hash_ctx))
+		return 0;
 
-	if (!tls12_record_layer_pseudo_header(rl, content_type, content_len,
-	    seq_num, &header, &header_len))
-		goto err;
+	if (!tls12_record_layer_pseudo_header(rl, rp, content_type,
+	    content_len, seq_num, header, sizeof(header), &header_len))
+		return 0;
 
 	if (EVP_DigestSignUpdate(mac_ctx, header, header_len) <= 0)
-		goto err;
+		return 0;
 	if (EVP_DigestSignUpdate(mac_ctx, content, content_len) <= 0)
-		goto err;
+		return 0;
 	if (EVP_DigestSignFinal(mac_ctx, NULL, &mac_len) <= 0)
-		goto err;
+		return 0;
 	if (!CBB_add_space(cbb, &mac, mac_len))
-		goto err;
+		return 0;
 	if (EVP_DigestSignFinal(mac_ctx, mac, &mac_len) <= 0)
-		goto err;
+		return 0;
 	if (mac_len == 0)
-		goto err;
+		return 0;
 
-	if (stream_mac) {
-		if (!EVP_MD_CTX_copy(hash_ctx, mac_ctx))
-			goto err;
+	if (rp->stream_mac) {
+		if (!EVP_MD_CTX_copy_ex(rp->hash_ctx, mac_ctx))
+			return 0;
 	}
 
 	*out_len = mac_len;
-	ret = 1;
-
- err:
-	EVP_MD_CTX_free(mac_ctx);
-	freezero(header, header_len);
 
-	return ret;
+	return 1;
 }
 
 static int
@@ -734,38 +945,32 @@ tls12_record_layer_read_mac_cbc(struct tls12_record_layer *rl, CBB *cbb,
     uint8_t content_type, CBS *seq_num, const uint8_t *content,
     size_t content_len, size_t mac_len, size_t padding_len)
 {
-	uint8_t *header = NULL;
-	size_t header_len = 0;
+	uint8_t header[TLS12_PSEUDO_HEADER_MAX_LEN];
+	size_t header_len;
 	uint8_t *mac = NULL;
 	size_t out_mac_len = 0;
-	int ret = 0;
 
 	/*
 	 * Must be constant time to avoid leaking details about CBC padding.
 	 */
 
 	if (!ssl3_cbc_record_digest_supported(rl->read->hash_ctx))
-		goto err;
+		return 0;
 
-	if (!tls12_record_layer_pseudo_header(rl, content_type, content_len,
-	    seq_num, &header, &header_len))
-		goto err;
+	if (!tls12_record_layer_pseudo_header(rl, rl->read, content_type,
+	    content_len, seq_num, header, sizeof(header), &header_len))
+		return 0;
 
 	if (!CBB_add_space(cbb, &mac, mac_len))
-		goto err;
+		return 0;
 	if (!ssl3_cbc_digest_record(rl->read->hash_ctx, mac, &out_mac_len, header,
 	    content, content_len + mac_len, content_len + mac_len + padding_len,
 	    rl->read->mac_key, rl->read->mac_key_len))
-		goto err;
+		return 0;
 	if (mac_len != out_mac_len)
-		goto err;
-
-	ret = 1;
-
- err:
-	freezero(header, header_len);
+		return 0;
 
-	return ret;
+	return 1;
 }
 
 static int
@@ -779,9 +984,8 @@ tls12_record_layer_read_mac(struct tls12_record_layer *rl, CBB *cbb,
 	if (EVP_CIPHER_CTX_mode(enc) == EVP_CIPH_CBC_MODE)
 		return 0;
 
-	return tls12_record_layer_mac(rl, cbb, rl->read->hash_ctx,
-	    rl->read->stream_mac, seq_num, content_type, content, content_len,
-	    &out_len);
+	return tls12_record_layer_mac(rl, cbb, rl->read, seq_num,
+	    content_type, content, content_len, &out_len);
 }
 
 static int
@@ -789,15 +993,14 @@ tls12_record_layer_write_mac(struct tls12_record_layer *rl, CBB *cbb,
     uint8_t content_type, CBS *seq_num, const uint8_t *content,
     size_t content_len, size_t *out_len)
 {
-	return tls12_record_layer_mac(rl, cbb, rl->write->hash_ctx,
-	    rl->write->stream_mac, seq_num, content_type, content, content_len,
-	    out_len);
+	return tls12_record_layer_mac(rl, cbb, rl->write, seq_num,
+	    content_type, content, content_len, out_len);
 }
 
 static int
 tls12_record_layer_aead_concat_nonce(struct tls12_record_layer *rl,
     struct tls12_record_protection *rp, CBS *seq_num,
-    uint8_t **out, size_t *out_len)
+    uint8_t *out, size_t out_size, size_t *out_len)
 {
 	CBB cbb;
 
@@ -805,7 +1008,7 @@ tls12_record_layer_aead_concat_nonce(struct tls12_record_layer *rl,
 		return 0;
 
 	/* Fixed nonce and variable nonce (sequence number) are concatenated. */
-	if (!CBB_init(&cbb, 16))
+	if (!CBB_init_fixed(&cbb, out, out_size))
 		goto err;
 	if (!CBB_add_bytes(&cbb, rp->aead_fixed_nonce,
 	    rp->aead_fixed_nonce_len))
@@ -813,7 +1016,7 @@ tls12_record_layer_aead_concat_nonce(struct tls12_record_layer *rl,
 	if (!CBB_add_bytes(&cbb, CBS_data(seq_num),
 	    rp->aead_variable_nonce_len))
 		goto err;
-	if (!CBB_finish(&cbb, out, out_len))
+	if (!CBB_finish(&cbb, NULL, out_len))
 		goto err;
 
 	return 1;
@@ -827,10 +1030,8 @@ tls12_record_layer_aead_concat_nonce(struct tls12_record_layer *rl,
 static int
 tls12_record_layer_aead_xored_nonce(struct tls12_record_layer *rl,
     struct tls12_record_protection *rp, CBS *seq_num,
-    uint8_t **out, size_t *out_len)
+    uint8_t *out, size_t out_size, size_t *out_len)
 {
-	uint8_t *nonce = NULL;
-	size_t nonce_len = 0;
 	uint8_t *pad;
 	CBB cbb;
 	int i;
@@ -844,7 +1045,7 @@ tls12_record_layer_aead_xored_nonce(struct tls12_record_layer *rl,
 	 * Variable nonce (sequence number) is right padded, before the fixed
 	 * nonce is XOR'd in.
 	 */
-	if (!CBB_init(&cbb, 16))
+	if (!CBB_init_fixed(&cbb, out, out_size))
 		goto err;
 	if (!CBB_add_space(&cbb, &pad,
 	    rp->aead_fixed_nonce_len - rp->aead_variable_nonce_len))
@@ -852,66 +1053,70 @@ tls12_record_layer_aead_xored_nonce(struct tls12_record_layer *rl,
 	if (!CBB_add_bytes(&cbb, CBS_data(seq_num),
 	    rp->aead_variable_nonce_len))
 		goto err;
-	if (!CBB_finish(&cbb, &nonce, &nonce_len))
+	if (!CBB_finish(&cbb, NULL, out_len))
 		goto err;
 
 	for (i = 0; i < rp->aead_fixed_nonce_len; i++)
-		nonce[i] ^= rp->aead_fixed_nonce[i];
-
-	*out = nonce;
-	*out_len = nonce_len;
+		out[i] ^= rp->aead_fixed_nonce[i];
 
 	return 1;
 
  err:
 	CBB_cleanup(&cbb);
-	freezero(nonce, nonce_len);
 
 	return 0;
 }
 
+static size_t
+tls12_record_layer_max_plain_len(struct tls12_record_layer *rl,
+    uint8_t content_type)
+{
+	/* With a connection ID the inner content type follows the content. */
+	if (rl->dtls && content_type == DTLS1_RT_TLS12_CID)
+		return SSL3_RT_MAX_PLAIN_LENGTH + 1;
+
+	return SSL3_RT_MAX_PLAIN_LENGTH;
+}
+
 static int
 tls12_record_layer_open_record_plaintext(struct tls12_record_layer *rl,
-    uint8_t content_type, CBS *fragment, uint8_t **out, size_t *out_len)
+    uint8_t content_type, CBS *fragment, CBS *out)
 {
 	if (tls12_record_protection_engaged(rl->read))
 		return 0;
 
-	/* XXX - decrypt/process in place for now. */
-	*out = (uint8_t *)CBS_data(fragment);
-	*out_len = CBS_len(fragment);
+	CBS_dup(fragment, out);
 
 	return 1;
 }
 
 static int
 tls12_record_layer_open_record_protected_aead(struct tls12_record_layer *rl,
-    uint8_t content_type, CBS *seq_num, CBS *fragment, uint8_t **out,
-    size_t *out_len)
+    uint8_t content_type, CBS *seq_num, CBS *fragment, CBS *out)
 {
 	struct tls12_record_protection *rp = rl->read;
-	uint8_t *header = NULL, *nonce = NULL;
-	size_t header_len = 0, nonce_len = 0;
+	uint8_t header[TLS12_PSEUDO_HEADER_MAX_LEN];
+	uint8_t nonce[TLS12_AEAD_NONCE_MAX_LEN];
+	size_t header_len, nonce_len = 0;
 	uint8_t *plain;
-	size_t plain_len;
+	size_t plain_len, out_len;
 	CBS var_nonce;
 	int ret = 0;
 
-	/* XXX - move to nonce allocated in record layer, matching TLSv1.3 */
 	if (rp->aead_xor_nonces) {
 		if (!tls12_record_layer_aead_xored_nonce(rl, rp,
-		    seq_num, &nonce, &nonce_len))
+		    seq_num, nonce, sizeof(nonce), &nonce_len))
 			goto err;
 	} else if (rp->aead_variable_nonce_in_record) {
 		if (!CBS_get_bytes(fragment, &var_nonce,
 		    rp->aead_variable_nonce_len))
 			goto err;
 		if (!tls12_record_layer_aead_concat_nonce(rl, rp,
-		    &var_nonce, &nonce, &nonce_len))
+		    &var_nonce, nonce, sizeof(nonce), &nonce_len))
 			goto err;
 	} else {
 		if (!tls12_record_layer_aead_concat_nonce(rl, rp,
-		    seq_num, &nonce, &nonce_len))
+		    seq_num, nonce, sizeof(nonce), &nonce_len))
 			goto err;
 	}
 
@@ -925,51 +1130,48 @@ tls12_record_layer_open_record_protected_aead(struct tls12_record_layer *rl,
 		goto err;
 	}
 
-	/* XXX - decrypt/process in place for now. */
 	plain = (uint8_t *)CBS_data(fragment);
 	plain_len = CBS_len(fragment) - rp->aead_tag_len;
 
-	if (!tls12_record_layer_pseudo_header(rl, content_type, plain_len,
-	    seq_num, &header, &header_len))
+	if (!tls12_record_layer_pseudo_header(rl, rp, content_type, plain_len,
+	    seq_num, header, sizeof(header), &header_len))
 		goto err;
 
-	if (!EVP_AEAD_CTX_open(rp->aead_ctx, plain, out_len, plain_len,
+	if (!EVP_AEAD_CTX_open(rp->aead_ctx, plain, &out_len, plain_len,
 	    nonce, nonce_len, CBS_data(fragment), CBS_len(fragment),
 	    header, header_len)) {
 		rl->alert_desc = SSL_AD_BAD_RECORD_MAC;
 		goto err;
 	}
 
-	if (*out_len > SSL3_RT_MAX_PLAIN_LENGTH) {
+	if (out_len > tls12_record_layer_max_plain_len(rl, content_type)) {
 		rl->alert_desc = SSL_AD_RECORD_OVERFLOW;
 		goto err;
 	}
 
-	if (*out_len != plain_len)
+	if (out_len != plain_len)
 		goto err;
 
-	*out = plain;
+	CBS_init(out, plain, out_len);
 
 	ret = 1;
 
  err:
-	freezero(header, header_len);
-	freezero(nonce, nonce_len);
+	explicit_bzero(nonce, sizeof(nonce));
 
 	return ret;
 }
 
 static int
 tls12_record_layer_open_record_protected_cipher(struct tls12_record_layer *rl,
-    uint8_t content_type, CBS *seq_num, CBS *fragment, uint8_t **out,
-    size_t *out_len)
+    uint8_t content_type, CBS *seq_num, CBS *fragment, CBS *out)
 {
 	EVP_CIPHER_CTX *enc = rl->read->cipher_ctx;
 	SSL3_RECORD_INTERNAL rrec;
 	size_t block_size, eiv_len;
-	uint8_t *mac = NULL;
+	uint8_t mac[EVP_MAX_MD_SIZE];
 	size_t mac_len = 0;
-	uint8_t *out_mac = NULL;
+	uint8_t out_mac[EVP_MAX_MD_SIZE];
 	size_t out_mac_len = 0;
 	uint8_t *plain;
 	size_t plain_len;
@@ -994,6 +1196,8 @@ tls12_record_layer_open_record_protected_cipher(struct tls12_record_layer *rl,
 	if (rl->read->hash_ctx != NULL) {
 		if (!tls12_record_protection_mac_len(rl->read, &mac_len))
 			goto err;
+		if (mac_len > sizeof(mac))
+			goto err;
 	}
 
 	/* CBC has at least one padding byte. */
@@ -1014,7 +1218,6 @@ tls12_record_layer_open_record_protected_cipher(struct tls12_record_layer *rl,
 		goto err;
 	}
 
-	/* XXX - decrypt/process in place for now. */
 	plain = (uint8_t *)CBS_data(fragment);
 	plain_len = CBS_len(fragment);
 
@@ -1032,10 +1235,7 @@ tls12_record_layer_open_record_protected_cipher(struct tls12_record_layer *rl,
 	if (block_size > 1)
 		ssl3_cbc_remove_padding(&rrec, eiv_len, mac_len);
 
-	if ((mac = calloc(1, mac_len)) == NULL)
-		goto err;
-
-	if (!CBB_init(&cbb_mac, EVP_MAX_MD_SIZE))
+	if (!CBB_init_fixed(&cbb_mac, out_mac, sizeof(out_mac)))
 		goto err;
 	if (EVP_CIPHER_CTX_mode(enc) == EVP_CIPH_CBC_MODE) {
 		ssl3_cbc_copy_mac(mac, &rrec, mac_len, rrec.length +
@@ -1052,7 +1252,7 @@ tls12_record_layer_open_record_protected_cipher(struct tls12_record_layer *rl,
 		    seq_num, rrec.input, rrec.length))
 			goto err;
 	}
-	if (!CBB_finish(&cbb_mac, &out_mac, &out_mac_len))
+	if (!CBB_finish(&cbb_mac, NULL, &out_mac_len))
 		goto err;
 	if (mac_len != out_mac_len)
 		goto err;
@@ -1066,29 +1266,63 @@ tls12_record_layer_open_record_protected_cipher(struct tls12_record_layer *rl,
 		rl->alert_desc = SSL_AD_BAD_RECORD_MAC;
 		goto err;
 	}
-	if (rrec.length > SSL3_RT_MAX_PLAIN_LENGTH) {
+	if (rrec.length > tls12_record_layer_max_plain_len(rl, content_type)) {
 		rl->alert_desc = SSL_AD_RECORD_OVERFLOW;
 		goto err;
 	}
 
-	*out = rrec.data;
-	*out_len = rrec.length;
+	CBS_init(out, rrec.data, rrec.length);
 
 	ret = 1;
 
  err:
 	CBB_cleanup(&cbb_mac);
-	freezero(mac, mac_len);
-	freezero(out_mac, out_mac_len);
+	explicit_bzero(mac, sizeof(mac));
+	explicit_bzero(out_mac, sizeof(out_mac));
 
 	return ret;
 }
 
+/*
+ * A record with a connection ID holds the content followed by its real
+ * content type and any zero padding - RFC 9146 section 4.
+ */
+static int
+tls12_record_layer_open_inner_plaintext(struct tls12_record_layer *rl,
+    uint8_t *content_type, CBS *plaintext)
+{
+	const uint8_t *out = CBS_data(plaintext);
+	size_t len = CBS_len(plaintext);
+
+	while (len > 0 && out[len - 1] == 0)
+		len--;
+	if (len == 0) {
+		rl->alert_desc = SSL_AD_UNEXPECTED_MESSAGE;
+		return 0;
+	}
+	*content_type = out[--len];
+	if (*content_type == DTLS1_RT_TLS12_CID) {
+		rl->alert_desc = SSL_AD_UNEXPECTED_MESSAGE;
+		return 0;
+	}
+	if (len > SSL3_RT_MAX_PLAIN_LENGTH) {
+		rl->alert_desc = SSL_AD_RECORD_OVERFLOW;
+		return 0;
+	}
+	CBS_init(plaintext, out, len);
+
+	return 1;
+}
+
+/*
+ * Records are decrypted, and their MAC and padding checked, in place in buf.
+ * The plaintext is returned as a view into it, valid until buf is reused.
+ */
 int
 tls12_record_layer_open_record(struct tls12_record_layer *rl, uint8_t *buf,
-    size_t buf_len, uint8_t **out, size_t *out_len)
+    size_t buf_len, uint8_t *out_content_type, CBS *out_plaintext)
 {
-	CBS cbs, fragment, seq_num;
+	CBS cbs, fragment, seq_num, cid;
 	uint16_t version;
 	uint8_t content_type;
 
@@ -1112,21 +1346,45 @@ tls12_record_layer_open_record(struct tls12_record_layer *rl, uint8_t *buf,
 		if (!CBS_write_bytes(&seq_num, rl->read->seq_num,
 		    sizeof(rl->read->seq_num), NULL))
 			return 0;
+
+		/*
+		 * Once a connection ID is in use the peer must send it, and
+		 * it must be ours.  Other records are silently discarded.
+		 */
+		if (tls12_record_protection_uses_cid(rl->read) !=
+		    (content_type == DTLS1_RT_TLS12_CID))
+			return 0;
+		if (content_type == DTLS1_RT_TLS12_CID) {
+			if (!CBS_get_bytes(&cbs, &cid, rl->read->cid_len))
+				return 0;
+			if (!CBS_mem_equal(&cid, rl->read->cid,
+			    rl->read->cid_len))
+				return 0;
+		}
 	}
 	if (!CBS_get_u16_length_prefixed(&cbs, &fragment))
 		return 0;
 
-	if (rl->read->aead_ctx != NULL) {
+	if (rl->read->ktls) {
+		/* The kernel has already opened this record. */
+		CBS_dup(&fragment, out_plaintext);
+	} else if (rl->read->aead_ctx != NULL) {
 		if (!tls12_record_layer_open_record_protected_aead(rl,
-		    content_type, &seq_num, &fragment, out, out_len))
+		    content_type, &seq_num, &fragment, out_plaintext))
 			return 0;
 	} else if (rl->read->cipher_ctx != NULL) {
 		if (!tls12_record_layer_open_record_protected_cipher(rl,
-		    content_type, &seq_num, &fragment, out, out_len))
+		    content_type, &seq_num, &fragment, out_plaintext))
 			return 0;
 	} else {
 		if (!tls12_record_layer_open_record_plaintext(rl,
-		    content_type, &fragment, out, out_len))
+		    content_type, &fragment, out_plaintext))
+			return 0;
+	}
+
+	if (rl->dtls && content_type == DTLS1_RT_TLS12_CID) {
+		if (!tls12_record_layer_open_inner_plaintext(rl, &content_type,
+		    out_plaintext))
 			return 0;
 	}
 
@@ -1135,6 +1393,9 @@ tls12_record_layer_open_record(struct tls12_record_layer *rl, uint8_t *buf,
 			return 0;
 	}
 
+	*out_content_type = content_type;
+	rl->num_records_read++;
+
 	return 1;
 }
 
@@ -1154,20 +1415,20 @@ tls12_record_layer_seal_record_protected_aead(struct tls12_record_layer *rl,
     size_t content_len, CBB *out)
 {
 	struct tls12_record_protection *rp = rl->write;
-	uint8_t *header = NULL, *nonce = NULL;
-	size_t header_len = 0, nonce_len = 0;
+	uint8_t header[TLS12_PSEUDO_HEADER_MAX_LEN];
+	uint8_t nonce[TLS12_AEAD_NONCE_MAX_LEN];
+	size_t header_len, nonce_len = 0;
 	size_t enc_record_len, out_len;
 	uint8_t *enc_data;
 	int ret = 0;
 
-	/* XXX - move to nonce allocated in record layer, matching TLSv1.3 */
 	if (rp->aead_xor_nonces) {
 		if (!tls12_record_layer_aead_xored_nonce(rl, rp,
-		    seq_num, &nonce, &nonce_len))
+		    seq_num, nonce, sizeof(nonce), &nonce_len))
 			goto err;
 	} else {
 		if (!tls12_record_layer_aead_concat_nonce(rl, rp,
-		    seq_num, &nonce, &nonce_len))
+		    seq_num, nonce, sizeof(nonce), &nonce_len))
 			goto err;
 	}
 
@@ -1179,8 +1440,8 @@ tls12_record_layer_seal_record_protected_aead(struct tls12_record_layer *rl,
 			goto err;
 	}
 
-	if (!tls12_record_layer_pseudo_header(rl, content_type, content_len,
-	    seq_num, &header, &header_len))
+	if (!tls12_record_layer_pseudo_header(rl, rp, content_type,
+	    content_len, seq_num, header, sizeof(header), &header_len))
 		goto err;
 
 	/* XXX EVP_AEAD_max_tag_len vs EVP_AEAD_CTX_tag_len. */
@@ -1200,12 +1461,58 @@ tls12_record_layer_seal_record_protected_aead(struct tls12_record_layer *rl,
 	ret = 1;
 
  err:
-	freezero(header, header_len);
-	freezero(nonce, nonce_len);
+	explicit_bzero(nonce, sizeof(nonce));
 
 	return ret;
 }
 
+/*
+ * Seal a record with the stitched cipher, which appends the MAC and padding
+ * to the payload and encrypts the record in place, without a second pass.
+ */
+static int
+tls12_record_layer_seal_record_stitched(struct tls12_record_layer *rl,
+    uint8_t content_type, CBS *seq_num, const uint8_t *content,
+    size_t content_len, CBB *out)
+{
+	EVP_CIPHER_CTX *enc = rl->write->stitched_ctx;
+	uint8_t header[TLS12_PSEUDO_HEADER_MAX_LEN];
+	size_t header_len;
+	size_t eiv_len, enc_len;
+	uint8_t *enc_data;
+	int overhead;
+
+	if (!tls12_record_protection_eiv_len(rl->write, &eiv_len))
+		return 0;
+	if (content_len > SSL3_RT_MAX_ENCRYPTED_LENGTH)
+		return 0;
+
+	/* The cipher takes the length of the explicit IV and content. */
+	if (!tls12_record_layer_pseudo_header(rl, rl->write, content_type,
+	    eiv_len + content_len, seq_num, header, sizeof(header),
+	    &header_len))
+		return 0;
+	if (header_len > INT_MAX)
+		return 0;
+	if ((overhead = EVP_CIPHER_CTX_ctrl(enc, EVP_CTRL_AEAD_TLS1_AAD,
+	    header_len, header)) <= 0)
+		return 0;
+
+	enc_len = eiv_len + content_len + overhead;
+	if (enc_len > SSL3_RT_MAX_ENCRYPTED_LENGTH)
+		return 0;
+
+	if (!CBB_add_space(out, &enc_data, enc_len))
+		return 0;
+	arc4random_buf(enc_data, eiv_len);
+	if (content_len > 0)
+		memcpy(enc_data + eiv_len, content, content_len);
+	if (!EVP_Cipher(enc, enc_data, enc_data, enc_len))
+		return 0;
+
+	return 1;
+}
+
 static int
 tls12_record_layer_seal_record_protected_cipher(struct tls12_record_layer *rl,
     uint8_t content_type, CBS *seq_num, const uint8_t *content,
@@ -1219,6 +1526,12 @@ tls12_record_layer_seal_record_protected_cipher(struct tls12_record_layer *rl,
 	int ret = 0;
 	CBB cbb;
 
+	/* Records with a connection ID have a different pseudo-header. */
+	if (rl->write->stitched_ctx != NULL &&
+	    content_type != DTLS1_RT_TLS12_CID)
+		return tls12_record_layer_seal_record_stitched(rl,
+		    content_type, seq_num, content, content_len, out);
+
 	if (!CBB_init(&cbb, SSL3_RT_MAX_PLAIN_LENGTH))
 		goto err;
 
@@ -1288,10 +1601,32 @@ tls12_record_layer_seal_record(struct tls12_record_layer *rl,
 {
 	uint8_t *seq_num_data = NULL;
 	size_t seq_num_len = 0;
+	uint8_t *inner = NULL;
+	size_t inner_len = 0;
 	CBB fragment, seq_num_cbb;
 	CBS seq_num;
+	int use_cid;
 	int ret = 0;
 
+	memset(&seq_num_cbb, 0, sizeof(seq_num_cbb));
+
+	/*
+	 * With a connection ID the record is sent as tls12_cid, with the
+	 * real content type following the content.  No padding is added.
+	 */
+	use_cid = rl->dtls && tls12_record_protection_uses_cid(rl->write);
+	if (use_cid) {
+		inner_len = content_len + 1;
+		if ((inner = malloc(inner_len)) == NULL)
+			goto err;
+		if (content_len > 0)
+			memcpy(inner, content, content_len);
+		inner[content_len] = content_type;
+		content = inner;
+		content_len = inner_len;
+		content_type = DTLS1_RT_TLS12_CID;
+	}
+
 	/*
 	 * Construct the effective sequence number - this is used in both
 	 * the DTLS header and for MAC calculations.
@@ -1313,10 +1648,18 @@ tls12_record_layer_seal_record(struct tls12_record_layer *rl,
 		if (!CBB_add_bytes(cbb, CBS_data(&seq_num), CBS_len(&seq_num)))
 			goto err;
 	}
+	if (use_cid) {
+		if (!CBB_add_bytes(cbb, rl->write->cid, rl->write->cid_len))
+			goto err;
+	}
 	if (!CBB_add_u16_length_prefixed(cbb, &fragment))
 		goto err;
 
-	if (rl->write->aead_ctx != NULL) {
+	if (rl->write->ktls) {
+		/* The kernel protects this record as it is sent. */
+		if (!CBB_add_bytes(&fragment, content, content_len))
+			goto err;
+	} else if (rl->write->aead_ctx != NULL) {
 		if (!tls12_record_layer_seal_record_protected_aead(rl,
 		    content_type, &seq_num, content, content_len, &fragment))
 			goto err;
@@ -1335,12 +1678,14 @@ tls12_record_layer_seal_record(struct tls12_record_layer *rl,
 
 	if (!tls12_record_layer_inc_seq_num(rl, rl->write->seq_num))
 		goto err;
+	rl->num_records_written++;
 
 	ret = 1;
 
  err:
 	CBB_cleanup(&seq_num_cbb);
 	free(seq_num_data);
+	freezero(inner, inner_len);
 
 	return ret;
 }
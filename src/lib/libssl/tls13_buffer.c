@@ -18,23 +18,48 @@
 #include "bytestring.h"
 #include "tls13_internal.h"
 
+/*
+ * A buffer that is given a get and a put callback allocates its data through
+ * them, which lets the data come from the size class pools of the SSL_CTX.
+ * Such a buffer may then be larger than its capacity, which is always the
+ * number of bytes that are wanted. The data remains owned by the buffer and
+ * goes back to the pool once the buffer is freed.
+ */
 struct tls13_buffer {
 	size_t capacity;
 	uint8_t *data;
+	size_t size;
 	size_t len;
 	size_t offset;
+
+	tls13_buf_get_cb buf_get;
+	tls13_buf_put_cb buf_put;
+	void *cb_arg;
 };
 
 static int tls13_buffer_resize(struct tls13_buffer *buf, size_t capacity);
 
 struct tls13_buffer *
 tls13_buffer_new(size_t init_size)
+{
+	return tls13_buffer_new_pool(init_size, NULL, NULL, NULL);
+}
+
+struct tls13_buffer *
+tls13_buffer_new_pool(size_t init_size, tls13_buf_get_cb buf_get,
+    tls13_buf_put_cb buf_put, void *cb_arg)
 {
 	struct tls13_buffer *buf = NULL;
 
 	if ((buf = calloc(1, sizeof(struct tls13_buffer))) == NULL)
 		goto err;
 
+	if (buf_get != NULL && buf_put != NULL) {
+		buf->buf_get = buf_get;
+		buf->buf_put = buf_put;
+		buf->cb_arg = cb_arg;
+	}
+
 	if (!tls13_buffer_resize(buf, init_size))
 		goto err;
 
@@ -46,13 +71,25 @@ tls13_buffer_new(size_t init_size)
 	return NULL;
 }
 
+static void
+tls13_buffer_data_free(struct tls13_buffer *buf)
+{
+	if (buf->buf_put != NULL)
+		buf->buf_put(buf->data, buf->size, buf->cb_arg);
+	else
+		freezero(buf->data, buf->size);
+
+	buf->data = NULL;
+	buf->size = 0;
+}
+
 void
 tls13_buffer_free(struct tls13_buffer *buf)
 {
 	if (buf == NULL)
 		return;
 
-	freezero(buf->data, buf->capacity);
+	tls13_buffer_data_free(buf);
 	freezero(buf, sizeof(struct tls13_buffer));
 }
 
@@ -60,14 +97,33 @@ static int
 tls13_buffer_resize(struct tls13_buffer *buf, size_t capacity)
 {
 	uint8_t *data;
+	size_t size;
 
 	if (buf->capacity == capacity)
 		return 1;
 
-	if ((data = recallocarray(buf->data, buf->capacity, capacity, 1)) == NULL)
-		return 0;
+	if (buf->buf_get == NULL) {
+		if ((data = recallocarray(buf->data, buf->size, capacity,
+		    1)) == NULL)
+			return 0;
+		buf->data = data;
+		buf->size = capacity;
+	} else if (capacity > buf->size) {
+		/* Move to a buffer from the next size class that fits. */
+		if ((data = buf->buf_get(capacity, &size, buf->cb_arg)) == NULL)
+			return 0;
+		if (size < capacity) {
+			buf->buf_put(data, size, buf->cb_arg);
+			return 0;
+		}
+		if (buf->capacity > 0)
+			memcpy(data, buf->data, buf->capacity);
+		tls13_buffer_data_free(buf);
+		buf->data = data;
+		buf->size = size;
+	} else if (capacity < buf->capacity)
+		explicit_bzero(&buf->data[capacity], buf->capacity - capacity);
 
-	buf->data = data;
 	buf->capacity = capacity;
 
 	return 1;
@@ -118,6 +174,10 @@ tls13_buffer_cbs(struct tls13_buffer *buf, CBS *cbs)
 	CBS_init(cbs, buf->data, buf->len);
 }
 
+/*
+ * Return the data that has been read into the buffer. This remains owned by
+ * the buffer and is valid until the buffer is freed.
+ */
 int
 tls13_buffer_finish(struct tls13_buffer *buf, uint8_t **out, size_t *out_len)
 {
@@ -127,9 +187,5 @@ tls13_buffer_finish(struct tls13_buffer *buf, uint8_t **out, size_t *out_len)
 	*out = buf->data;
 	*out_len = buf->len;
 
-	buf->capacity = 0;
-	buf->data = NULL;
-	buf->len = 0;
-
 	return 1;
 }
@@ -0,0 +1,325 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Certificate compression - RFC 8879.
+ *
+ * A server compresses its Certificate message with the first algorithm from
+ * the client's compress_certificate extension that is also available here.
+ * When the certificate has its own chain and the leaf carries no extensions
+ * the message is the same for every handshake, so its compressed form is
+ * built once and kept with the CERT_PKEY until ssl_cert_pkey_flush().
+ */
+
+#include <limits.h>
+#include <stdlib.h>
+
+#include <openssl/comp.h>
+#include <openssl/objects.h>
+
+#include "bytestring.h"
+#include "ssl_locl.h"
+#include "tls13_internal.h"
+
+struct tls13_cert_comp_alg {
+	uint16_t alg;
+	COMP_METHOD *(*method)(void);
+};
+
+static const struct tls13_cert_comp_alg tls13_cert_comp_algs[] = {
+	{
+		.alg = TLS13_CERT_COMP_ZLIB,
+		.method = COMP_zlib_oneshot,
+	},
+};
+
+#define N_TLS13_CERT_COMP_ALGS \
+    (sizeof(tls13_cert_comp_algs) / sizeof(tls13_cert_comp_algs[0]))
+
+/* Return the method for alg, or NULL if libcrypto was built without it. */
+static COMP_METHOD *
+tls13_cert_comp_method(uint16_t alg)
+{
+	COMP_METHOD *meth;
+	size_t i;
+
+	for (i = 0; i < N_TLS13_CERT_COMP_ALGS; i++) {
+		if (tls13_cert_comp_algs[i].alg != alg)
+			continue;
+		meth = tls13_cert_comp_algs[i].method();
+		if (meth == NULL || meth->type == NID_undef)
+			return NULL;
+		return meth;
+	}
+
+	return NULL;
+}
+
+int
+tls13_cert_comp_supported(uint16_t alg)
+{
+	return tls13_cert_comp_method(alg) != NULL;
+}
+
+int
+tls13_cert_comp_build_algs(CBB *cbb)
+{
+	size_t i;
+
+	for (i = 0; i < N_TLS13_CERT_COMP_ALGS; i++) {
+		if (!tls13_cert_comp_supported(tls13_cert_comp_algs[i].alg))
+			continue;
+		if (!CBB_add_u16(cbb, tls13_cert_comp_algs[i].alg))
+			return 0;
+	}
+
+	return CBB_flush(cbb);
+}
+
+static int
+tls13_cert_compress(uint16_t alg, const uint8_t *data, size_t data_len,
+    uint8_t **out, size_t *out_len)
+{
+	COMP_METHOD *meth;
+	COMP_CTX *cctx = NULL;
+	uint8_t *buf = NULL;
+	size_t buf_len;
+	int len;
+	int ret = 0;
+
+	*out = NULL;
+	*out_len = 0;
+
+	if ((meth = tls13_cert_comp_method(alg)) == NULL)
+		goto err;
+	if (data_len == 0 || data_len > 0xffffff)
+		goto err;
+
+	/* Enough for incompressible data, including the stream overhead. */
+	buf_len = data_len + data_len / 8 + 64;
+	if ((buf = malloc(buf_len)) == NULL)
+		goto err;
+
+	if ((cctx = COMP_CTX_new(meth)) == NULL)
+		goto err;
+	if ((len = COMP_compress_block(cctx, buf, buf_len, (uint8_t *)data,
+	    data_len)) <= 0)
+		goto err;
+
+	*out = buf;
+	*out_len = len;
+	buf = NULL;
+
+	ret = 1;
+
+ err:
+	COMP_CTX_free(cctx);
+	free(buf);
+
+	return ret;
+}
+
+static int
+tls13_cert_comp_add(CBB *cbb, uint16_t alg, size_t uncompressed_len,
+    const uint8_t *data, size_t data_len)
+{
+	CBB compressed;
+
+	if (!CBB_add_u16(cbb, alg))
+		return 0;
+	if (!CBB_add_u24(cbb, uncompressed_len))
+		return 0;
+	if (!CBB_add_u24_length_prefixed(cbb, &compressed))
+		return 0;
+	if (!CBB_add_bytes(&compressed, data, data_len))
+		return 0;
+
+	return CBB_flush(cbb);
+}
+
+/*
+ * Build the compressed form of the Certificate message for a CERT_PKEY with
+ * its own chain, with no certificate request context or leaf extensions.
+ */
+static int
+tls13_cert_comp_encode(CERT_PKEY *cpk, uint16_t alg, uint8_t **out,
+    size_t *out_len, size_t *uncompressed_len)
+{
+	CBB cbb, cert_request_context, cert_list, cert_exts;
+	CBS leaf, chain;
+	uint8_t *data = NULL;
+	size_t data_len;
+	int ret = 0;
+
+	if (!CBB_init(&cbb, 0))
+		goto err;
+
+	if (!ssl_cert_pkey_cert_list(cpk, 1, &leaf, &chain))
+		goto err;
+	if (!CBB_add_u8_length_prefixed(&cbb, &cert_request_context))
+		goto err;
+	if (!CBB_add_u24_length_prefixed(&cbb, &cert_list))
+		goto err;
+	if (!CBB_add_bytes(&cert_list, CBS_data(&leaf), CBS_len(&leaf)))
+		goto err;
+	if (!CBB_add_u16_length_prefixed(&cert_list, &cert_exts))
+		goto err;
+	if (!CBB_add_bytes(&cert_list, CBS_data(&chain), CBS_len(&chain)))
+		goto err;
+	if (!CBB_finish(&cbb, &data, &data_len))
+		goto err;
+
+	if (!tls13_cert_compress(alg, data, data_len, out, out_len))
+		goto err;
+	*uncompressed_len = data_len;
+
+	ret = 1;
+
+ err:
+	CBB_cleanup(&cbb);
+	free(data);
+
+	return ret;
+}
+
+/*
+ * Add the cached CompressedCertificate body of a CERT_PKEY, building it on
+ * first use. The CERT may be shared by connections in several threads.
+ */
+int
+tls13_cert_comp_add_cached(CERT_PKEY *cpk, uint16_t alg, CBB *cbb)
+{
+	uint8_t *data = NULL;
+	size_t len, uncompressed_len;
+	int ret = 0;
+
+	if (cpk->x509 == NULL || cpk->chain == NULL)
+		return 0;
+
+	CRYPTO_r_lock(CRYPTO_LOCK_SSL_CERT);
+	if (cpk->cert_comp != NULL && cpk->cert_comp_alg == alg) {
+		ret = tls13_cert_comp_add(cbb, alg,
+		    cpk->cert_comp_uncompressed_len, cpk->cert_comp,
+		    cpk->cert_comp_len);
+		CRYPTO_r_unlock(CRYPTO_LOCK_SSL_CERT);
+		return ret;
+	}
+	CRYPTO_r_unlock(CRYPTO_LOCK_SSL_CERT);
+
+	if (!tls13_cert_comp_encode(cpk, alg, &data, &len, &uncompressed_len))
+		return 0;
+
+	if (!tls13_cert_comp_add(cbb, alg, uncompressed_len, data, len)) {
+		free(data);
+		return 0;
+	}
+
+	/* Only the first algorithm used is kept. */
+	CRYPTO_w_lock(CRYPTO_LOCK_SSL_CERT);
+	if (cpk->cert_comp == NULL) {
+		cpk->cert_comp_alg = alg;
+		cpk->cert_comp = data;
+		cpk->cert_comp_len = len;
+		cpk->cert_comp_uncompressed_len = uncompressed_len;
+		data = NULL;
+	}
+	CRYPTO_w_unlock(CRYPTO_LOCK_SSL_CERT);
+
+	free(data);
+
+	return 1;
+}
+
+/* Add a CompressedCertificate body for the given Certificate message body. */
+int
+tls13_cert_comp_add_compressed(uint16_t alg, const uint8_t *cert,
+    size_t cert_len, CBB *cbb)
+{
+	uint8_t *data;
+	size_t len;
+	int ret;
+
+	if (!tls13_cert_compress(alg, cert, cert_len, &data, &len))
+		return 0;
+	ret = tls13_cert_comp_add(cbb, alg, cert_len, data, len);
+	free(data);
+
+	return ret;
+}
+
+/*
+ * Decompress a CompressedCertificate message, returning the Certificate
+ * message body that it holds.
+ */
+int
+tls13_cert_comp_expand(struct tls13_ctx *ctx, CBS *cbs, uint8_t **out,
+    size_t *out_len)
+{
+	COMP_METHOD *meth = NULL;
+	COMP_CTX *cctx = NULL;
+	uint32_t uncompressed_len;
+	uint8_t *buf = NULL;
+	CBS compressed;
+	uint16_t alg;
+	int len;
+	int ret = 0;
+
+	*out = NULL;
+	*out_len = 0;
+
+	if (!CBS_get_u16(cbs, &alg) ||
+	    !CBS_get_u24(cbs, &uncompressed_len) ||
+	    !CBS_get_u24_length_prefixed(cbs, &compressed) ||
+	    CBS_len(&compressed) == 0 || CBS_len(&compressed) > INT_MAX) {
+		ctx->alert = TLS13_ALERT_DECODE_ERROR;
+		goto err;
+	}
+
+	if (!ctx->hs->tls13.cert_comp_offered ||
+	    (meth = tls13_cert_comp_method(alg)) == NULL) {
+		ctx->alert = TLS13_ALERT_ILLEGAL_PARAMETER;
+		goto err;
+	}
+	if (uncompressed_len == 0 ||
+	    uncompressed_len > ctx->ssl->internal->max_cert_list) {
+		ctx->alert = TLS13_ALERT_BAD_CERTIFICATE;
+		goto err;
+	}
+
+	if ((buf = malloc(uncompressed_len)) == NULL)
+		goto err;
+	if ((cctx = COMP_CTX_new(meth)) == NULL)
+		goto err;
+	len = COMP_expand_block(cctx, buf, uncompressed_len,
+	    (uint8_t *)CBS_data(&compressed), CBS_len(&compressed));
+	if (len < 0 || (uint32_t)len != uncompressed_len) {
+		ctx->alert = TLS13_ALERT_BAD_CERTIFICATE;
+		goto err;
+	}
+
+	*out = buf;
+	*out_len = uncompressed_len;
+	buf = NULL;
+
+	ret = 1;
+
+ err:
+	COMP_CTX_free(cctx);
+	free(buf);
+
+	return ret;
+}
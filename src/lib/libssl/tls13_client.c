@@ -53,7 +53,8 @@ tls13_client_init(struct tls13_ctx *ctx)
 		return 0;
 	if ((ctx->hs->tls13.key_share = tls13_key_share_new(groups[0])) == NULL)
 		return 0;
-	if (!tls13_key_share_generate(ctx->hs->tls13.key_share))
+	if (!tls13_key_share_generate_pooled(ctx->hs->tls13.key_share,
+	    s->ctx->internal->key_share_pool))
 		return 0;
 
 	arc4random_buf(s->s3->client_random, SSL3_RANDOM_SIZE);
@@ -264,6 +265,7 @@ tls13_server_hello_process(struct tls13_ctx *ctx, CBS *cbs)
 	    sizeof(tls13_hello_retry_request_hash))) {
 		tlsext_msg_type = SSL_TLSEXT_MSG_HRR;
 		ctx->hs->tls13.hrr = 1;
+		ssl_stats_hello_retry_request(ctx->ssl);
 	}
 
 	if (!tlsext_client_parse(s, tlsext_msg_type, cbs, &alert_desc)) {
@@ -450,7 +452,8 @@ tls13_client_hello_retry_send(struct tls13_ctx *ctx, CBB *cbb)
 	if ((ctx->hs->tls13.key_share =
 	    tls13_key_share_new(ctx->hs->tls13.server_group)) == NULL)
 		return 0;
-	if (!tls13_key_share_generate(ctx->hs->tls13.key_share))
+	if (!tls13_key_share_generate_pooled(ctx->hs->tls13.key_share,
+	    ctx->ssl->ctx->internal->key_share_pool))
 		return 0;
 
 	if (!tls13_client_hello_build(ctx, cbb))
@@ -528,7 +531,9 @@ tls13_server_certificate_request_recv(struct tls13_ctx *ctx, CBS *cbs)
 	 * request... in that case we call the certificate handler after
 	 * switching state, to avoid advancing state.
 	 */
-	if (tls13_handshake_msg_type(ctx->hs_msg) == TLS13_MT_CERTIFICATE) {
+	if (tls13_handshake_msg_type(ctx->hs_msg) == TLS13_MT_CERTIFICATE ||
+	    tls13_handshake_msg_type(ctx->hs_msg) ==
+	    TLS13_MT_COMPRESSED_CERTIFICATE) {
 		ctx->handshake_stage.hs_type |= WITHOUT_CR;
 		return tls13_server_certificate_recv(ctx, cbs);
 	}
@@ -555,11 +560,13 @@ tls13_server_certificate_request_recv(struct tls13_ctx *ctx, CBS *cbs)
 int
 tls13_server_certificate_recv(struct tls13_ctx *ctx, CBS *cbs)
 {
-	CBS cert_request_context, cert_list, cert_data;
+	CBS cert_request_context, cert_list, cert_data, certificate;
 	struct stack_st_X509 *certs = NULL;
 	SSL *s = ctx->ssl;
 	X509 *cert = NULL;
 	EVP_PKEY *pkey;
+	uint8_t *data = NULL;
+	size_t data_len;
 	const uint8_t *p;
 	int cert_idx, alert_desc;
 	int ret = 0;
@@ -567,6 +574,15 @@ tls13_server_certificate_recv(struct tls13_ctx *ctx, CBS *cbs)
 	if ((certs = sk_X509_new_null()) == NULL)
 		goto err;
 
+	/* Parse the Certificate message held by a CompressedCertificate. */
+	if (tls13_handshake_msg_type(ctx->hs_msg) ==
+	    TLS13_MT_COMPRESSED_CERTIFICATE) {
+		if (!tls13_cert_comp_expand(ctx, cbs, &data, &data_len))
+			goto err;
+		CBS_init(&certificate, data, data_len);
+		cbs = &certificate;
+	}
+
 	if (!CBS_get_u8_length_prefixed(cbs, &cert_request_context))
 		goto err;
 	if (CBS_len(&cert_request_context) != 0)
@@ -595,6 +611,10 @@ tls13_server_certificate_recv(struct tls13_ctx *ctx, CBS *cbs)
 
 		cert = NULL;
 	}
+	if (data != NULL && CBS_len(cbs) != 0) {
+		ctx->alert = TLS13_ALERT_BAD_CERTIFICATE;
+		goto err;
+	}
 
 	/* A server must always provide a non-empty certificate list. */
 	if (sk_X509_num(certs) < 1) {
@@ -654,6 +674,7 @@ tls13_server_certificate_recv(struct tls13_ctx *ctx, CBS *cbs)
  err:
 	sk_X509_pop_free(certs, X509_free);
 	X509_free(cert);
+	free(data);
 
 	return ret;
 }
@@ -663,7 +684,8 @@ tls13_server_certificate_verify_recv(struct tls13_ctx *ctx, CBS *cbs)
 {
 	const struct ssl_sigalg *sigalg;
 	uint16_t signature_scheme;
-	uint8_t *sig_content = NULL;
+	uint8_t sig_content_buf[TLS13_CERT_VERIFY_CONTENT_MAX];
+	uint8_t *sig_content;
 	size_t sig_content_len;
 	EVP_MD_CTX *mdctx = NULL;
 	EVP_PKEY_CTX *pctx;
@@ -680,7 +702,7 @@ tls13_server_certificate_verify_recv(struct tls13_ctx *ctx, CBS *cbs)
 	if (!CBS_get_u16_length_prefixed(cbs, &signature))
 		goto err;
 
-	if (!CBB_init(&cbb, 0))
+	if (!CBB_init_fixed(&cbb, sig_content_buf, sizeof(sig_content_buf)))
 		goto err;
 	if (!CBB_add_bytes(&cbb, tls13_cert_verify_pad,
 	    sizeof(tls13_cert_verify_pad)))
@@ -735,7 +757,6 @@ tls13_server_certificate_verify_recv(struct tls13_ctx *ctx, CBS *cbs)
 		ctx->alert = TLS13_ALERT_DECODE_ERROR;
 	CBB_cleanup(&cbb);
 	EVP_MD_CTX_free(mdctx);
-	free(sig_content);
 
 	return ret;
 }
@@ -943,7 +964,8 @@ int
 tls13_client_certificate_verify_send(struct tls13_ctx *ctx, CBB *cbb)
 {
 	const struct ssl_sigalg *sigalg;
-	uint8_t *sig = NULL, *sig_content = NULL;
+	uint8_t sig_content_buf[TLS13_CERT_VERIFY_CONTENT_MAX];
+	uint8_t *sig = NULL, *sig_content;
 	size_t sig_len, sig_content_len;
 	EVP_MD_CTX *mdctx = NULL;
 	EVP_PKEY_CTX *pctx;
@@ -960,7 +982,8 @@ tls13_client_certificate_verify_send(struct tls13_ctx *ctx, CBB *cbb)
 		goto err;
 	pkey = cpk->privatekey;
 
-	if (!CBB_init(&sig_cbb, 0))
+	if (!CBB_init_fixed(&sig_cbb, sig_content_buf,
+	    sizeof(sig_content_buf)))
 		goto err;
 	if (!CBB_add_bytes(&sig_cbb, tls13_cert_verify_pad,
 	    sizeof(tls13_cert_verify_pad)))
@@ -1013,7 +1036,6 @@ tls13_client_certificate_verify_send(struct tls13_ctx *ctx, CBB *cbb)
 
 	CBB_cleanup(&sig_cbb);
 	EVP_MD_CTX_free(mdctx);
-	free(sig_content);
 	free(sig);
 
 	return ret;
@@ -1086,6 +1108,23 @@ int
 tls13_client_finished_sent(struct tls13_ctx *ctx)
 {
 	struct tls13_secrets *secrets = ctx->hs->tls13.secrets;
+	uint8_t transcript_hash[EVP_MAX_MD_SIZE];
+	struct tls13_secret context;
+	size_t transcript_hash_len;
+
+	/*
+	 * Derive the resumption master secret, now that the transcript
+	 * includes our finished message.
+	 */
+	if (!tls1_transcript_hash_value(ctx->ssl, transcript_hash,
+	    sizeof(transcript_hash), &transcript_hash_len))
+		return 0;
+
+	context.data = transcript_hash;
+	context.len = transcript_hash_len;
+
+	if (!tls13_derive_resumption_secret(secrets, &context))
+		return 0;
 
 	/*
 	 * Any records following the client finished message must be encrypted
@@ -248,6 +248,15 @@ const enum tls13_message_type handshakes[][TLS13_NUM_MESSAGE_TYPES] = {
 		CLIENT_FINISHED,
 		APPLICATION_DATA,
 	},
+	[NEGOTIATED | WITHOUT_HRR | WITH_PSK | WITH_0RTT] = {
+		CLIENT_HELLO,
+		SERVER_HELLO,
+		SERVER_ENCRYPTED_EXTENSIONS,
+		SERVER_FINISHED,
+		CLIENT_END_OF_EARLY_DATA,
+		CLIENT_FINISHED,
+		APPLICATION_DATA,
+	},
 };
 
 const size_t handshake_count = sizeof(handshakes) / sizeof(handshakes[0]);
@@ -293,6 +302,8 @@ tls13_handshake_message_name(uint8_t msg_type)
 		return "Finished";
 	case TLS13_MT_KEY_UPDATE:
 		return "KeyUpdate";
+	case TLS13_MT_COMPRESSED_CERTIFICATE:
+		return "CompressedCertificate";
 	}
 	return "Unknown";
 }
@@ -368,8 +379,15 @@ tls13_handshake_perform(struct tls13_ctx *ctx)
 			return TLS13_IO_FAILURE;
 
 		if (action->handshake_complete) {
+			if ((ret = tls13_record_layer_flush_flight(ctx->rl)) !=
+			    TLS13_IO_SUCCESS)
+				return ret;
 			ctx->handshake_completed = 1;
 			tls13_record_layer_handshake_completed(ctx->rl);
+			ssl_stats_handshake_done(ctx->ssl);
+			CBB_arena_cleanup(&ctx->hs_arena);
+			if (!ssl_ktls_start(ctx->ssl))
+				return TLS13_IO_FAILURE;
 
 			if (!tls13_handshake_set_legacy_state(ctx))
 				return TLS13_IO_FAILURE;
@@ -413,6 +431,21 @@ tls13_handshake_perform(struct tls13_ctx *ctx)
 	}
 }
 
+/*
+ * A server that is compressing its certificate sends a CompressedCertificate
+ * message in place of the Certificate message.
+ */
+static uint8_t
+tls13_handshake_send_type(struct tls13_ctx *ctx,
+    const struct tls13_handshake_action *action)
+{
+	if (action->handshake_type == TLS13_MT_CERTIFICATE &&
+	    ctx->mode == TLS13_HS_SERVER && ctx->hs->tls13.cert_comp_alg != 0)
+		return TLS13_MT_COMPRESSED_CERTIFICATE;
+
+	return action->handshake_type;
+}
+
 static int
 tls13_handshake_send_action(struct tls13_ctx *ctx,
     const struct tls13_handshake_action *action)
@@ -434,11 +467,17 @@ tls13_handshake_send_action(struct tls13_ctx *ctx,
 	if (ctx->hs_msg == NULL) {
 		if ((ctx->hs_msg = tls13_handshake_msg_new()) == NULL)
 			return TLS13_IO_FAILURE;
-		if (!tls13_handshake_msg_start(ctx->hs_msg, &cbb,
-		    action->handshake_type))
-			return TLS13_IO_FAILURE;
-		if (!action->send(ctx, &cbb))
+		if (!tls13_handshake_msg_start_arena(ctx->hs_msg, &cbb,
+		    tls13_handshake_send_type(ctx, action), &ctx->hs_arena))
 			return TLS13_IO_FAILURE;
+		if ((ret = action->send(ctx, &cbb)) <= 0) {
+			if (ret == 0)
+				return TLS13_IO_FAILURE;
+			/* The message is built again when we are called. */
+			tls13_handshake_msg_free(ctx->hs_msg);
+			ctx->hs_msg = NULL;
+			return ret;
+		}
 		if (!tls13_handshake_msg_finish(ctx->hs_msg))
 			return TLS13_IO_FAILURE;
 	}
@@ -477,6 +516,32 @@ tls13_handshake_send_action(struct tls13_ctx *ctx,
 	return TLS13_IO_SUCCESS;
 }
 
+static int
+tls13_handshake_recv_type_valid(struct tls13_ctx *ctx,
+    const struct tls13_handshake_action *action, uint8_t msg_type)
+{
+	if (msg_type == action->handshake_type)
+		return 1;
+
+	/*
+	 * In TLSv1.3 there is no way to know if you're going to receive a
+	 * certificate request message or not, hence we have to special case it
+	 * here. The receive handler also knows how to deal with this situation.
+	 */
+	if (action->handshake_type == TLS13_MT_CERTIFICATE_REQUEST &&
+	    msg_type == TLS13_MT_CERTIFICATE)
+		return 1;
+
+	/* Likewise for a compressed server certificate, if it was offered. */
+	if (msg_type == TLS13_MT_COMPRESSED_CERTIFICATE &&
+	    ctx->mode == TLS13_HS_CLIENT && ctx->hs->tls13.cert_comp_offered &&
+	    (action->handshake_type == TLS13_MT_CERTIFICATE ||
+	     action->handshake_type == TLS13_MT_CERTIFICATE_REQUEST))
+		return 1;
+
+	return 0;
+}
+
 static int
 tls13_handshake_recv_action(struct tls13_ctx *ctx,
     const struct tls13_handshake_action *action)
@@ -507,15 +572,8 @@ tls13_handshake_recv_action(struct tls13_ctx *ctx,
 	if (ctx->handshake_message_recv_cb != NULL)
 		ctx->handshake_message_recv_cb(ctx);
 
-	/*
-	 * In TLSv1.3 there is no way to know if you're going to receive a
-	 * certificate request message or not, hence we have to special case it
-	 * here. The receive handler also knows how to deal with this situation.
-	 */
 	msg_type = tls13_handshake_msg_type(ctx->hs_msg);
-	if (msg_type != action->handshake_type &&
-	    (msg_type != TLS13_MT_CERTIFICATE ||
-	     action->handshake_type != TLS13_MT_CERTIFICATE_REQUEST))
+	if (!tls13_handshake_recv_type_valid(ctx, action, msg_type))
 		return tls13_send_alert(ctx->rl, TLS13_ALERT_UNEXPECTED_MESSAGE);
 
 	if (!tls13_handshake_msg_content(ctx->hs_msg, &cbs))
@@ -691,7 +749,10 @@ tls13_handshake_set_legacy_state(struct tls13_ctx *ctx)
 	if (state == 0)
 		return 1;
 
-	ctx->hs->state = state;
+	if (ctx->hs->state != state) {
+		ctx->hs->state = state;
+		ssl_trace_state(ctx->ssl);
+	}
 
 	return 1;
 }
@@ -28,27 +28,39 @@ struct tls13_handshake_msg {
 	uint8_t *data;
 	size_t data_len;
 
+	/* Received data belongs to buf rather than to us. */
 	struct tls13_buffer *buf;
 	CBS cbs;
 	CBB cbb;
+
+	/* Non-NULL if data belongs to an arena rather than to us. */
+	CBB_ARENA *arena;
 };
 
 struct tls13_handshake_msg *
 tls13_handshake_msg_new()
 {
-	struct tls13_handshake_msg *msg = NULL;
-
-	if ((msg = calloc(1, sizeof(struct tls13_handshake_msg))) == NULL)
-		goto err;
-	if ((msg->buf = tls13_buffer_new(0)) == NULL)
-		goto err;
+	/* The buffer is only needed for receiving and is allocated then. */
+	return calloc(1, sizeof(struct tls13_handshake_msg));
+}
 
-	return msg;
+/*
+ * Messages are received into a buffer from the pools of the record layer,
+ * if one is given, which goes back there when the message is freed.
+ */
+static int
+tls13_handshake_msg_buffer(struct tls13_handshake_msg *msg,
+    struct tls13_record_layer *rl)
+{
+	if (msg->buf != NULL)
+		return 1;
 
- err:
-	tls13_handshake_msg_free(msg);
+	if (rl != NULL)
+		msg->buf = tls13_record_layer_buffer_new(rl, 0);
+	else
+		msg->buf = tls13_buffer_new(0);
 
-	return NULL;
+	return msg->buf != NULL;
 }
 
 void
@@ -57,11 +69,15 @@ tls13_handshake_msg_free(struct tls13_handshake_msg *msg)
 	if (msg == NULL)
 		return;
 
-	tls13_buffer_free(msg->buf);
-
 	CBB_cleanup(&msg->cbb);
 
-	freezero(msg->data, msg->data_len);
+	if (msg->arena != NULL) {
+		if (msg->data != NULL)
+			explicit_bzero(msg->data, msg->data_len);
+	} else if (msg->buf == NULL)
+		freezero(msg->data, msg->data_len);
+
+	tls13_buffer_free(msg->buf);
 	freezero(msg, sizeof(struct tls13_handshake_msg));
 }
 
@@ -74,6 +90,9 @@ tls13_handshake_msg_data(struct tls13_handshake_msg *msg, CBS *cbs)
 int
 tls13_handshake_msg_set_buffer(struct tls13_handshake_msg *msg, CBS *cbs)
 {
+	if (!tls13_handshake_msg_buffer(msg, NULL))
+		return 0;
+
 	return tls13_buffer_set_data(msg->buf, cbs);
 }
 
@@ -95,8 +114,26 @@ int
 tls13_handshake_msg_start(struct tls13_handshake_msg *msg, CBB *body,
     uint8_t msg_type)
 {
-	if (!CBB_init(&msg->cbb, TLS13_HANDSHAKE_MSG_INITIAL_LEN))
-		return 0;
+	return tls13_handshake_msg_start_arena(msg, body, msg_type, NULL);
+}
+
+/*
+ * Build the message in arena, if it is not NULL, rather than in a buffer of
+ * its own. The message data then remains valid until the arena is next used.
+ */
+int
+tls13_handshake_msg_start_arena(struct tls13_handshake_msg *msg, CBB *body,
+    uint8_t msg_type, CBB_ARENA *arena)
+{
+	if (arena != NULL) {
+		if (!CBB_init_arena(&msg->cbb, arena,
+		    TLS13_HANDSHAKE_MSG_INITIAL_LEN))
+			return 0;
+		msg->arena = arena;
+	} else {
+		if (!CBB_init(&msg->cbb, TLS13_HANDSHAKE_MSG_INITIAL_LEN))
+			return 0;
+	}
 	if (!CBB_add_u8(&msg->cbb, msg_type))
 		return 0;
 	if (!CBB_add_u24_length_prefixed(&msg->cbb, body))
@@ -136,6 +173,9 @@ tls13_handshake_msg_recv(struct tls13_handshake_msg *msg,
 	if (msg->data != NULL)
 		return TLS13_IO_FAILURE;
 
+	if (!tls13_handshake_msg_buffer(msg, rl))
+		return TLS13_IO_FAILURE;
+
 	if (msg->msg_type == 0) {
 		if ((ret = tls13_buffer_extend(msg->buf,
 		    TLS13_HANDSHAKE_MSG_HEADER_LEN,
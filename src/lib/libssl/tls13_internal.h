@@ -20,7 +20,10 @@
 #ifndef HEADER_TLS13_INTERNAL_H
 #define HEADER_TLS13_INTERNAL_H
 
+#include <sys/uio.h>
+
 #include <openssl/evp.h>
+#include <openssl/hmac.h>
 #include <openssl/ssl.h>
 
 #include "bytestring.h"
@@ -40,6 +43,8 @@ __BEGIN_HIDDEN_DECLS
 #define TLS13_IO_USE_LEGACY		-6
 #define TLS13_IO_RECORD_VERSION		-7
 #define TLS13_IO_RECORD_OVERFLOW	-8
+#define TLS13_IO_EARLY_DATA		-9 /* Early data is available to read. */
+#define TLS13_IO_WANT_PRIVATE_KEY	-10 /* Private key method is pending. */
 
 #define TLS13_ERR_VERIFY_FAILED		16
 #define TLS13_ERR_HRR_FAILED		17
@@ -79,12 +84,20 @@ __BEGIN_HIDDEN_DECLS
 #define TLS13_ALERT_CERTIFICATE_REQUIRED		116
 #define TLS13_ALERT_NO_APPLICATION_PROTOCOL		120
 
+/* PSK key exchange modes - RFC 8446 section 4.2.9. */
+#define TLS13_PSK_KE					0
+#define TLS13_PSK_DHE_KE				1
+
 #define TLS13_INFO_HANDSHAKE_STARTED			SSL_CB_HANDSHAKE_START
 #define TLS13_INFO_HANDSHAKE_COMPLETED			SSL_CB_HANDSHAKE_DONE
 #define TLS13_INFO_ACCEPT_LOOP				SSL_CB_ACCEPT_LOOP
 #define TLS13_INFO_CONNECT_LOOP				SSL_CB_CONNECT_LOOP
 
 typedef void (*tls13_alert_cb)(uint8_t _alert_desc, void *_cb_arg);
+typedef uint8_t *(*tls13_buf_get_cb)(size_t _len, size_t *_out_len,
+    void *_cb_arg);
+typedef void (*tls13_buf_put_cb)(uint8_t *_buf, size_t _len, void *_cb_arg);
+typedef int (*tls13_buf_retire_cb)(uint8_t *_buf, size_t _len, void *_cb_arg);
 typedef ssize_t (*tls13_phh_recv_cb)(void *_cb_arg, CBS *_cbs);
 typedef void (*tls13_phh_sent_cb)(void *_cb_arg);
 typedef ssize_t (*tls13_read_cb)(void *_buf, size_t _buflen, void *_cb_arg);
@@ -100,6 +113,8 @@ typedef int (*tls13_ocsp_status_cb)(void *_cb_arg);
 struct tls13_buffer;
 
 struct tls13_buffer *tls13_buffer_new(size_t init_size);
+struct tls13_buffer *tls13_buffer_new_pool(size_t init_size,
+    tls13_buf_get_cb buf_get, tls13_buf_put_cb buf_put, void *cb_arg);
 int tls13_buffer_set_data(struct tls13_buffer *buf, CBS *data);
 void tls13_buffer_free(struct tls13_buffer *buf);
 ssize_t tls13_buffer_extend(struct tls13_buffer *buf, size_t len,
@@ -124,7 +139,11 @@ struct tls13_secrets {
 	int early_done;
 	int handshake_done;
 	int schedule_done;
+	int resumption_done;
 	int insecure; /* Set by tests */
+	uint8_t *data; /* Storage for all of the secrets below. */
+	size_t data_len;
+	HMAC_CTX hmac_ctx; /* Keyed with the secret being expanded. */
 	struct tls13_secret zeros;
 	struct tls13_secret empty_hash;
 	struct tls13_secret extracted_early;
@@ -169,6 +188,10 @@ int tls13_derive_handshake_secrets(struct tls13_secrets *secrets,
     const uint8_t *ecdhe, size_t ecdhe_len, const struct tls13_secret *context);
 int tls13_derive_application_secrets(struct tls13_secrets *secrets,
     const struct tls13_secret *context);
+int tls13_derive_resumption_secret(struct tls13_secrets *secrets,
+    const struct tls13_secret *context);
+int tls13_derive_ticket_psk(struct tls13_secrets *secrets,
+    const uint8_t *nonce, size_t nonce_len, uint8_t *psk, size_t psk_len);
 int tls13_update_client_traffic_secret(struct tls13_secrets *secrets);
 int tls13_update_server_traffic_secret(struct tls13_secrets *secrets);
 
@@ -190,6 +213,19 @@ int tls13_key_share_peer_public(struct tls13_key_share *ks, uint16_t group,
 int tls13_key_share_derive(struct tls13_key_share *ks, uint8_t **shared_key,
     size_t *shared_key_len);
 
+#define TLS13_KEY_SHARE_POOL_MAX	256
+
+struct tls13_key_share_pool;
+
+struct tls13_key_share_pool *tls13_key_share_pool_new(void);
+void tls13_key_share_pool_free(struct tls13_key_share_pool *pool);
+int tls13_key_share_pool_set_size(struct tls13_key_share_pool *pool,
+    size_t size);
+size_t tls13_key_share_pool_size(struct tls13_key_share_pool *pool);
+int tls13_key_share_pool_fill(struct tls13_key_share_pool *pool);
+int tls13_key_share_generate_pooled(struct tls13_key_share *ks,
+    struct tls13_key_share_pool *pool);
+
 /*
  * Record Layer.
  */
@@ -202,11 +238,16 @@ struct tls13_record_layer_callbacks {
 	tls13_alert_cb alert_sent;
 	tls13_phh_recv_cb phh_recv;
 	tls13_phh_sent_cb phh_sent;
+	tls13_buf_get_cb buf_get;
+	tls13_buf_put_cb buf_put;
+	tls13_buf_retire_cb buf_retire;
 };
 
 struct tls13_record_layer *tls13_record_layer_new(
     const struct tls13_record_layer_callbacks *callbacks, void *cb_arg);
 void tls13_record_layer_free(struct tls13_record_layer *rl);
+struct tls13_buffer *tls13_record_layer_buffer_new(
+    struct tls13_record_layer *rl, size_t init_size);
 void tls13_record_layer_allow_ccs(struct tls13_record_layer *rl, int allow);
 void tls13_record_layer_allow_legacy_alerts(struct tls13_record_layer *rl, int allow);
 void tls13_record_layer_rbuf(struct tls13_record_layer *rl, CBS *cbs);
@@ -217,7 +258,26 @@ void tls13_record_layer_set_hash(struct tls13_record_layer *rl,
 void tls13_record_layer_set_legacy_version(struct tls13_record_layer *rl,
     uint16_t version);
 void tls13_record_layer_set_retry_after_phh(struct tls13_record_layer *rl, int retry);
+void tls13_record_layer_set_release_buffers(struct tls13_record_layer *rl,
+    int release);
+void tls13_record_layer_hibernate(struct tls13_record_layer *rl);
+void tls13_record_layer_set_dynamic_records(struct tls13_record_layer *rl,
+    int dynamic);
+void tls13_record_layer_set_coalesce_writes(struct tls13_record_layer *rl,
+    int coalesce);
+void tls13_record_layer_accept_early_data(struct tls13_record_layer *rl,
+    size_t max_early_data);
+void tls13_record_layer_skip_early_data(struct tls13_record_layer *rl,
+    size_t max_early_data);
+void tls13_record_layer_end_early_data(struct tls13_record_layer *rl);
 void tls13_record_layer_handshake_completed(struct tls13_record_layer *rl);
+int tls13_record_layer_ktls_seq_num(struct tls13_record_layer *rl,
+    int is_write, CBS *seq_num);
+void tls13_record_layer_use_ktls(struct tls13_record_layer *rl, int is_write);
+void tls13_record_layer_record_counts(struct tls13_record_layer *rl,
+    uint64_t *num_read, uint64_t *num_written);
+int tls13_record_layer_write_pending(struct tls13_record_layer *rl);
+ssize_t tls13_record_layer_flush_flight(struct tls13_record_layer *rl);
 int tls13_record_layer_set_read_traffic_key(struct tls13_record_layer *rl,
     struct tls13_secret *read_key);
 int tls13_record_layer_set_write_traffic_key(struct tls13_record_layer *rl,
@@ -231,12 +291,30 @@ ssize_t tls13_write_handshake_data(struct tls13_record_layer *rl, const uint8_t
 ssize_t tls13_pending_application_data(struct tls13_record_layer *rl);
 ssize_t tls13_peek_application_data(struct tls13_record_layer *rl, uint8_t *buf, size_t n);
 ssize_t tls13_read_application_data(struct tls13_record_layer *rl, uint8_t *buf, size_t n);
+ssize_t tls13_read_early_data(struct tls13_record_layer *rl, uint8_t *buf, size_t n);
 ssize_t tls13_write_application_data(struct tls13_record_layer *rl, const uint8_t *buf,
     size_t n);
 
+/* Maximum number of pieces that the content of a record is sealed from. */
+#define TLS13_RECORD_MAX_IOV	16
+
+ssize_t tls13_write_application_data_iov(struct tls13_record_layer *rl,
+    const struct iovec *iov, int iovcnt);
+ssize_t tls13_flush_application_data(struct tls13_record_layer *rl);
+
 ssize_t tls13_send_alert(struct tls13_record_layer *rl, uint8_t alert_desc);
 ssize_t tls13_send_dummy_ccs(struct tls13_record_layer *rl);
 
+/*
+ * Early data anti-replay - RFC 8446 section 8.
+ */
+struct tls13_anti_replay;
+
+struct tls13_anti_replay *tls13_anti_replay_new(time_t window);
+void tls13_anti_replay_free(struct tls13_anti_replay *ar);
+int tls13_anti_replay_check(struct tls13_anti_replay *ar, const uint8_t *id,
+    size_t id_len, time_t now);
+
 /*
  * Handshake Messages.
  */
@@ -250,6 +328,8 @@ uint8_t tls13_handshake_msg_type(struct tls13_handshake_msg *msg);
 int tls13_handshake_msg_content(struct tls13_handshake_msg *msg, CBS *cbs);
 int tls13_handshake_msg_start(struct tls13_handshake_msg *msg, CBB *body,
     uint8_t msg_type);
+int tls13_handshake_msg_start_arena(struct tls13_handshake_msg *msg,
+    CBB *body, uint8_t msg_type, CBB_ARENA *arena);
 int tls13_handshake_msg_finish(struct tls13_handshake_msg *msg);
 int tls13_handshake_msg_recv(struct tls13_handshake_msg *msg,
     struct tls13_record_layer *rl);
@@ -293,16 +373,40 @@ struct tls13_ctx {
 
 	struct tls13_record_layer *rl;
 	struct tls13_handshake_msg *hs_msg;
+	CBB_ARENA hs_arena;
+
+	/* Data read ahead from the wire, see tls13_legacy.c. */
+	uint8_t *wire_rbuf;
+	size_t wire_rbuf_len;
+	CBS wire_rbuf_cbs;
+
 	uint8_t key_update_request;
 	uint8_t alert;
+	uint32_t tickets_sent;
+	int read_early_data;
 	int phh_count;
 	time_t phh_last_seen;
+	uint64_t key_updates;
 
 	tls13_handshake_message_cb handshake_message_sent_cb;
 	tls13_handshake_message_cb handshake_message_recv_cb;
 	tls13_info_cb info_cb;
 	tls13_ocsp_status_cb ocsp_status_recv_cb;
 };
+
+/* Maximum ticket lifetime - RFC 8446 section 4.6.1. */
+#define TLS13_TICKET_LIFETIME_MAX (7 * 24 * 60 * 60)
+
+/*
+ * Maximum difference between the ticket age reported by the client and the
+ * age that we expect, in seconds, for early data to be accepted - see
+ * RFC 8446 section 8.3. Anti-replay state is kept long enough to cover
+ * twice this window.
+ */
+#ifndef TLS13_EARLY_DATA_AGE_WINDOW
+#define TLS13_EARLY_DATA_AGE_WINDOW 10
+#endif
+
 #ifndef TLS13_PHH_LIMIT_TIME
 #define TLS13_PHH_LIMIT_TIME 3600
 #endif
@@ -326,10 +430,18 @@ int tls13_legacy_connect(SSL *ssl);
 int tls13_legacy_return_code(SSL *ssl, ssize_t ret);
 ssize_t tls13_legacy_wire_read_cb(void *buf, size_t n, void *arg);
 ssize_t tls13_legacy_wire_write_cb(const void *buf, size_t n, void *arg);
+void tls13_legacy_wire_release(struct tls13_ctx *ctx);
+uint8_t *tls13_legacy_buf_get_cb(size_t len, size_t *out_len, void *arg);
+void tls13_legacy_buf_put_cb(uint8_t *buf, size_t len, void *arg);
+int tls13_legacy_buf_retire_cb(uint8_t *buf, size_t len, void *arg);
 int tls13_legacy_pending(const SSL *ssl);
 int tls13_legacy_read_bytes(SSL *ssl, int type, unsigned char *buf, int len,
     int peek);
+int tls13_legacy_read_early_data(SSL *ssl, void *buf, size_t len,
+    size_t *readbytes);
 int tls13_legacy_write_bytes(SSL *ssl, int type, const void *buf, int len);
+int tls13_legacy_writev(SSL *ssl, const struct iovec *iov, int iovcnt);
+int tls13_legacy_flush(SSL *ssl);
 int tls13_legacy_shutdown(SSL *ssl);
 int tls13_legacy_servername_process(struct tls13_ctx *ctx, uint8_t *alert);
 
@@ -359,8 +471,12 @@ int tls13_legacy_servername_process(struct tls13_ctx *ctx, uint8_t *alert);
 #define	TLS13_MT_CERTIFICATE_STATUS_RESERVED	22
 #define	TLS13_MT_SUPPLEMENTAL_DATA_RESERVED	23
 #define	TLS13_MT_KEY_UPDATE			24
+#define	TLS13_MT_COMPRESSED_CERTIFICATE		25
 #define	TLS13_MT_MESSAGE_HASH			254
 
+/* Certificate compression algorithms - RFC 8879 section 3. */
+#define	TLS13_CERT_COMP_ZLIB			1
+
 int tls13_handshake_msg_record(struct tls13_ctx *ctx);
 int tls13_handshake_perform(struct tls13_ctx *ctx);
 
@@ -406,6 +522,17 @@ int tls13_cert_add(struct tls13_ctx *ctx, CBB *cbb, X509 *cert,
     int(*build_extensions)(SSL *s, uint16_t msg_type, CBB *cbb));
 
 int tls13_synthetic_handshake_message(struct tls13_ctx *ctx);
+
+struct cert_pkey_st;
+
+int tls13_cert_comp_supported(uint16_t alg);
+int tls13_cert_comp_build_algs(CBB *cbb);
+int tls13_cert_comp_add_cached(struct cert_pkey_st *cpk, uint16_t alg,
+    CBB *cbb);
+int tls13_cert_comp_add_compressed(uint16_t alg, const uint8_t *cert,
+    size_t cert_len, CBB *cbb);
+int tls13_cert_comp_expand(struct tls13_ctx *ctx, CBS *cbs, uint8_t **out,
+    size_t *out_len);
 int tls13_clienthello_hash_init(struct tls13_ctx *ctx);
 void tls13_clienthello_hash_clear(struct ssl_handshake_tls13_st *hs);
 int tls13_clienthello_hash_update_bytes(struct tls13_ctx *ctx, void *data,
@@ -437,6 +564,9 @@ extern const uint8_t tls13_cert_verify_pad[64];
 extern const uint8_t tls13_cert_client_verify_context[];
 extern const uint8_t tls13_cert_server_verify_context[];
 
+/* Padding, context string, separator and transcript hash - RFC 8446 4.4.3. */
+#define TLS13_CERT_VERIFY_CONTENT_MAX	(64 + 33 + 1 + EVP_MAX_MD_SIZE)
+
 __END_HIDDEN_DECLS
 
 #endif
@@ -44,6 +44,33 @@ tls13_secret_cleanup(struct tls13_secret *secret)
 	secret->len = 0;
 }
 
+#define TLS13_SECRETS_NUM	16
+
+static struct tls13_secret *
+tls13_secrets_get(struct tls13_secrets *secrets, size_t i)
+{
+	struct tls13_secret *list[TLS13_SECRETS_NUM] = {
+		&secrets->zeros,
+		&secrets->empty_hash,
+		&secrets->extracted_early,
+		&secrets->binder_key,
+		&secrets->client_early_traffic,
+		&secrets->early_exporter_master,
+		&secrets->derived_early,
+		&secrets->extracted_handshake,
+		&secrets->client_handshake_traffic,
+		&secrets->server_handshake_traffic,
+		&secrets->derived_handshake,
+		&secrets->extracted_master,
+		&secrets->client_application_traffic,
+		&secrets->server_application_traffic,
+		&secrets->exporter_master,
+		&secrets->resumption_master,
+	};
+
+	return list[i];
+}
+
 /*
  * Allocate a set of secrets for a key schedule using
  * a size of hash_length from RFC 8446 section 7.1.
@@ -52,48 +79,30 @@ struct tls13_secrets *
 tls13_secrets_create(const EVP_MD *digest, int resumption)
 {
 	struct tls13_secrets *secrets = NULL;
+	struct tls13_secret *secret;
 	EVP_MD_CTX *mdctx = NULL;
 	unsigned int mdlen;
 	size_t hash_length;
+	size_t i;
 
 	hash_length = EVP_MD_size(digest);
 
 	if ((secrets = calloc(1, sizeof(struct tls13_secrets))) == NULL)
 		goto err;
+	HMAC_CTX_init(&secrets->hmac_ctx);
 
-	if (!tls13_secret_init(&secrets->zeros, hash_length))
-		goto err;
-	if (!tls13_secret_init(&secrets->empty_hash, hash_length))
-		goto err;
-
-	if (!tls13_secret_init(&secrets->extracted_early, hash_length))
-		goto err;
-	if (!tls13_secret_init(&secrets->binder_key, hash_length))
-		goto err;
-	if (!tls13_secret_init(&secrets->client_early_traffic, hash_length))
-		goto err;
-	if (!tls13_secret_init(&secrets->early_exporter_master, hash_length))
-		goto err;
-	if (!tls13_secret_init(&secrets->derived_early, hash_length))
-		goto err;
-	if (!tls13_secret_init(&secrets->extracted_handshake, hash_length))
-		goto err;
-	if (!tls13_secret_init(&secrets->client_handshake_traffic, hash_length))
-		goto err;
-	if (!tls13_secret_init(&secrets->server_handshake_traffic, hash_length))
-		goto err;
-	if (!tls13_secret_init(&secrets->derived_handshake, hash_length))
-		goto err;
-	if (!tls13_secret_init(&secrets->extracted_master, hash_length))
-		goto err;
-	if (!tls13_secret_init(&secrets->client_application_traffic, hash_length))
-		goto err;
-	if (!tls13_secret_init(&secrets->server_application_traffic, hash_length))
-		goto err;
-	if (!tls13_secret_init(&secrets->exporter_master, hash_length))
-		goto err;
-	if (!tls13_secret_init(&secrets->resumption_master, hash_length))
+	/*
+	 * All of the secrets live in a single allocation, which is made once
+	 * per handshake.
+	 */
+	secrets->data_len = TLS13_SECRETS_NUM * hash_length;
+	if ((secrets->data = calloc(TLS13_SECRETS_NUM, hash_length)) == NULL)
 		goto err;
+	for (i = 0; i < TLS13_SECRETS_NUM; i++) {
+		secret = tls13_secrets_get(secrets, i);
+		secret->data = &secrets->data[i * hash_length];
+		secret->len = hash_length;
+	}
 
 	/*
 	 * Calculate the hash of a zero-length string - this is needed during
@@ -133,23 +142,8 @@ tls13_secrets_destroy(struct tls13_secrets *secrets)
 		return;
 
 	/* you can never be too sure :) */
-	tls13_secret_cleanup(&secrets->zeros);
-	tls13_secret_cleanup(&secrets->empty_hash);
-
-	tls13_secret_cleanup(&secrets->extracted_early);
-	tls13_secret_cleanup(&secrets->binder_key);
-	tls13_secret_cleanup(&secrets->client_early_traffic);
-	tls13_secret_cleanup(&secrets->early_exporter_master);
-	tls13_secret_cleanup(&secrets->derived_early);
-	tls13_secret_cleanup(&secrets->extracted_handshake);
-	tls13_secret_cleanup(&secrets->client_handshake_traffic);
-	tls13_secret_cleanup(&secrets->server_handshake_traffic);
-	tls13_secret_cleanup(&secrets->derived_handshake);
-	tls13_secret_cleanup(&secrets->extracted_master);
-	tls13_secret_cleanup(&secrets->client_application_traffic);
-	tls13_secret_cleanup(&secrets->server_application_traffic);
-	tls13_secret_cleanup(&secrets->exporter_master);
-	tls13_secret_cleanup(&secrets->resumption_master);
+	freezero(secrets->data, secrets->data_len);
+	HMAC_CTX_cleanup(&secrets->hmac_ctx);
 
 	freezero(secrets, sizeof(struct tls13_secrets));
 }
@@ -163,24 +157,28 @@ tls13_hkdf_expand_label(struct tls13_secret *out, const EVP_MD *digest,
 	    strlen(label), context);
 }
 
-int
-tls13_hkdf_expand_label_with_length(struct tls13_secret *out,
-    const EVP_MD *digest, const struct tls13_secret *secret,
+/*
+ * Build the HkdfLabel from RFC 8446 section 7.1 in a buffer on the stack.
+ * Both the full label and the context are at most 255 bytes long.
+ */
+#define TLS13_HKDF_LABEL_MAX	(2 + 1 + 255 + 1 + 255)
+
+static const char tls13_hkdf_label_prefix[] = "tls13 ";
+
+static int
+tls13_hkdf_label(uint8_t *hkdf_label, size_t *hkdf_label_len, size_t out_len,
     const uint8_t *label, size_t label_len, const struct tls13_secret *context)
 {
-	const char tls13_plabel[] = "tls13 ";
-	uint8_t *hkdf_label;
-	size_t hkdf_label_len;
 	CBB cbb, child;
-	int ret;
 
-	if (!CBB_init(&cbb, 256))
+	if (!CBB_init_fixed(&cbb, hkdf_label, TLS13_HKDF_LABEL_MAX))
 		return 0;
-	if (!CBB_add_u16(&cbb, out->len))
+	if (!CBB_add_u16(&cbb, out_len))
 		goto err;
 	if (!CBB_add_u8_length_prefixed(&cbb, &child))
 		goto err;
-	if (!CBB_add_bytes(&child, tls13_plabel, strlen(tls13_plabel)))
+	if (!CBB_add_bytes(&child, tls13_hkdf_label_prefix,
+	    sizeof(tls13_hkdf_label_prefix) - 1))
 		goto err;
 	if (!CBB_add_bytes(&child, label, label_len))
 		goto err;
@@ -188,17 +186,104 @@ tls13_hkdf_expand_label_with_length(struct tls13_secret *out,
 		goto err;
 	if (!CBB_add_bytes(&child, context->data, context->len))
 		goto err;
-	if (!CBB_finish(&cbb, &hkdf_label, &hkdf_label_len))
+	if (!CBB_finish(&cbb, NULL, hkdf_label_len))
 		goto err;
 
-	ret = HKDF_expand(out->data, out->len, digest, secret->data,
-	    secret->len, hkdf_label, hkdf_label_len);
+	return 1;
 
-	free(hkdf_label);
-	return(ret);
  err:
 	CBB_cleanup(&cbb);
-	return(0);
+
+	return 0;
+}
+
+int
+tls13_hkdf_expand_label_with_length(struct tls13_secret *out,
+    const EVP_MD *digest, const struct tls13_secret *secret,
+    const uint8_t *label, size_t label_len, const struct tls13_secret *context)
+{
+	uint8_t hkdf_label[TLS13_HKDF_LABEL_MAX];
+	size_t hkdf_label_len;
+
+	if (!tls13_hkdf_label(hkdf_label, &hkdf_label_len, out->len, label,
+	    label_len, context))
+		return 0;
+
+	return HKDF_expand(out->data, out->len, digest, secret->data,
+	    secret->len, hkdf_label, hkdf_label_len);
+}
+
+/*
+ * Key the HMAC of the key schedule with a secret, so that the pads of the
+ * key are hashed once for all of the secrets expanded from it.
+ */
+static int
+tls13_secrets_hmac_init(struct tls13_secrets *secrets,
+    const struct tls13_secret *secret)
+{
+	return HMAC_Init_ex(&secrets->hmac_ctx, secret->data, secret->len,
+	    secrets->digest, NULL);
+}
+
+/* Drop the state of the last key, as RFC 8446 recommends for the secret. */
+static void
+tls13_secrets_hmac_clear(struct tls13_secrets *secrets)
+{
+	if (secrets->insecure)
+		return;
+
+	/* Rekeying with zeros avoids freeing and allocating the digests. */
+	(void)tls13_secrets_hmac_init(secrets, &secrets->zeros);
+}
+
+/*
+ * HKDF-Expand-Label from RFC 8446 section 7.1, using the secret that the
+ * HMAC of the key schedule has been keyed with.
+ */
+static int
+tls13_secrets_expand_label(struct tls13_secrets *secrets,
+    struct tls13_secret *out, const char *label,
+    const struct tls13_secret *context)
+{
+	HMAC_CTX *hmac = &secrets->hmac_ctx;
+	uint8_t hkdf_label[TLS13_HKDF_LABEL_MAX];
+	uint8_t previous[EVP_MAX_MD_SIZE];
+	unsigned int previous_len = 0;
+	size_t hkdf_label_len, done, n;
+	uint8_t counter;
+	int ret = 0;
+
+	if (!tls13_hkdf_label(hkdf_label, &hkdf_label_len, out->len,
+	    label, strlen(label), context))
+		return 0;
+
+	/* See RFC 5869 section 2.3. */
+	if (out->len > 255 * (size_t)EVP_MD_size(secrets->digest))
+		return 0;
+
+	for (done = 0, counter = 1; done < out->len; done += n, counter++) {
+		if (!HMAC_Init_ex(hmac, NULL, 0, NULL, NULL))
+			goto err;
+		if (!HMAC_Update(hmac, previous, previous_len))
+			goto err;
+		if (!HMAC_Update(hmac, hkdf_label, hkdf_label_len))
+			goto err;
+		if (!HMAC_Update(hmac, &counter, 1))
+			goto err;
+		if (!HMAC_Final(hmac, previous, &previous_len))
+			goto err;
+
+		if ((n = out->len - done) > previous_len)
+			n = previous_len;
+		memcpy(&out->data[done], previous, n);
+	}
+
+	ret = 1;
+
+ err:
+	explicit_bzero(previous, sizeof(previous));
+
+	return ret;
 }
 
 int
@@ -232,29 +317,28 @@ tls13_derive_early_secrets(struct tls13_secrets *secrets,
 
 	if (secrets->extracted_early.len != secrets->zeros.len)
 		return 0;
+	if (!tls13_secrets_hmac_init(secrets, &secrets->extracted_early))
+		return 0;
 
-	if (!tls13_derive_secret(&secrets->binder_key, secrets->digest,
-	    &secrets->extracted_early,
+	if (!tls13_secrets_expand_label(secrets, &secrets->binder_key,
 	    secrets->resumption ? "res binder" : "ext binder",
 	    &secrets->empty_hash))
 		return 0;
-	if (!tls13_derive_secret(&secrets->client_early_traffic,
-	    secrets->digest, &secrets->extracted_early, "c e traffic",
-	    context))
+	if (!tls13_secrets_expand_label(secrets,
+	    &secrets->client_early_traffic, "c e traffic", context))
 		return 0;
-	if (!tls13_derive_secret(&secrets->early_exporter_master,
-	    secrets->digest, &secrets->extracted_early, "e exp master",
-	    context))
+	if (!tls13_secrets_expand_label(secrets,
+	    &secrets->early_exporter_master, "e exp master", context))
 		return 0;
-	if (!tls13_derive_secret(&secrets->derived_early,
-	    secrets->digest, &secrets->extracted_early, "derived",
-	    &secrets->empty_hash))
+	if (!tls13_secrets_expand_label(secrets,
+	    &secrets->derived_early, "derived", &secrets->empty_hash))
 		return 0;
 
 	/* RFC 8446 recommends */
 	if (!secrets->insecure)
 		explicit_bzero(secrets->extracted_early.data,
 		    secrets->extracted_early.len);
+	tls13_secrets_hmac_clear(secrets);
 	secrets->early_done = 1;
 	return 1;
 }
@@ -276,29 +360,29 @@ tls13_derive_handshake_secrets(struct tls13_secrets *secrets,
 
 	if (secrets->extracted_handshake.len != secrets->zeros.len)
 		return 0;
+	if (!tls13_secrets_hmac_init(secrets, &secrets->extracted_handshake))
+		return 0;
 
 	/* XXX */
 	if (!secrets->insecure)
 		explicit_bzero(secrets->derived_early.data,
 		    secrets->derived_early.len);
 
-	if (!tls13_derive_secret(&secrets->client_handshake_traffic,
-	    secrets->digest, &secrets->extracted_handshake, "c hs traffic",
-	    context))
+	if (!tls13_secrets_expand_label(secrets,
+	    &secrets->client_handshake_traffic, "c hs traffic", context))
 		return 0;
-	if (!tls13_derive_secret(&secrets->server_handshake_traffic,
-	    secrets->digest, &secrets->extracted_handshake, "s hs traffic",
-	    context))
+	if (!tls13_secrets_expand_label(secrets,
+	    &secrets->server_handshake_traffic, "s hs traffic", context))
 		return 0;
-	if (!tls13_derive_secret(&secrets->derived_handshake,
-	    secrets->digest, &secrets->extracted_handshake, "derived",
-	    &secrets->empty_hash))
+	if (!tls13_secrets_expand_label(secrets,
+	    &secrets->derived_handshake, "derived", &secrets->empty_hash))
 		return 0;
 
 	/* RFC 8446 recommends */
 	if (!secrets->insecure)
 		explicit_bzero(secrets->extracted_handshake.data,
 		    secrets->extracted_handshake.len);
+	tls13_secrets_hmac_clear(secrets);
 
 	secrets->handshake_done = 1;
 
@@ -321,39 +405,84 @@ tls13_derive_application_secrets(struct tls13_secrets *secrets,
 
 	if (secrets->extracted_master.len != secrets->zeros.len)
 		return 0;
+	if (!tls13_secrets_hmac_init(secrets, &secrets->extracted_master))
+		return 0;
 
 	/* XXX */
 	if (!secrets->insecure)
 		explicit_bzero(secrets->derived_handshake.data,
 		    secrets->derived_handshake.len);
 
-	if (!tls13_derive_secret(&secrets->client_application_traffic,
-	    secrets->digest, &secrets->extracted_master, "c ap traffic",
-	    context))
+	if (!tls13_secrets_expand_label(secrets,
+	    &secrets->client_application_traffic, "c ap traffic", context))
 		return 0;
-	if (!tls13_derive_secret(&secrets->server_application_traffic,
-	    secrets->digest, &secrets->extracted_master, "s ap traffic",
-	    context))
+	if (!tls13_secrets_expand_label(secrets,
+	    &secrets->server_application_traffic, "s ap traffic", context))
+		return 0;
+	if (!tls13_secrets_expand_label(secrets,
+	    &secrets->exporter_master, "exp master", context))
+		return 0;
+
+	secrets->schedule_done = 1;
+
+	return 1;
+}
+
+/*
+ * The resumption master secret covers the transcript up to and including
+ * the client finished message, hence it is derived separately from the
+ * application traffic secrets.
+ */
+int
+tls13_derive_resumption_secret(struct tls13_secrets *secrets,
+    const struct tls13_secret *context)
+{
+	if (!secrets->init_done || !secrets->early_done ||
+	    !secrets->handshake_done || !secrets->schedule_done ||
+	    secrets->resumption_done)
 		return 0;
-	if (!tls13_derive_secret(&secrets->exporter_master,
-	    secrets->digest, &secrets->extracted_master, "exp master",
-	    context))
+
+	if (!tls13_secrets_hmac_init(secrets, &secrets->extracted_master))
 		return 0;
-	if (!tls13_derive_secret(&secrets->resumption_master,
-	    secrets->digest, &secrets->extracted_master, "res master",
-	    context))
+	if (!tls13_secrets_expand_label(secrets,
+	    &secrets->resumption_master, "res master", context))
 		return 0;
 
 	/* RFC 8446 recommends */
 	if (!secrets->insecure)
 		explicit_bzero(secrets->extracted_master.data,
 		    secrets->extracted_master.len);
+	tls13_secrets_hmac_clear(secrets);
 
-	secrets->schedule_done = 1;
+	secrets->resumption_done = 1;
 
 	return 1;
 }
 
+/*
+ * Derive the pre-shared key for a ticket issued with the given nonce,
+ * from RFC 8446 section 4.6.1.
+ */
+int
+tls13_derive_ticket_psk(struct tls13_secrets *secrets,
+    const uint8_t *nonce, size_t nonce_len, uint8_t *psk, size_t psk_len)
+{
+	struct tls13_secret context = { .data = (uint8_t *)nonce,
+	    .len = nonce_len };
+	struct tls13_secret out = { .data = psk, .len = psk_len };
+
+	if (!secrets->resumption_done)
+		return 0;
+	if (psk_len != secrets->resumption_master.len)
+		return 0;
+
+	if (!tls13_secrets_hmac_init(secrets, &secrets->resumption_master))
+		return 0;
+
+	return tls13_secrets_expand_label(secrets, &out, "resumption",
+	    &context);
+}
+
 int
 tls13_update_client_traffic_secret(struct tls13_secrets *secrets)
 {
@@ -363,9 +492,12 @@ tls13_update_client_traffic_secret(struct tls13_secrets *secrets)
 	    !secrets->handshake_done || !secrets->schedule_done)
 		return 0;
 
-	return tls13_hkdf_expand_label(&secrets->client_application_traffic,
-	    secrets->digest, &secrets->client_application_traffic,
-	    "traffic upd", &context);
+	if (!tls13_secrets_hmac_init(secrets,
+	    &secrets->client_application_traffic))
+		return 0;
+
+	return tls13_secrets_expand_label(secrets,
+	    &secrets->client_application_traffic, "traffic upd", &context);
 }
 
 int
@@ -377,7 +509,10 @@ tls13_update_server_traffic_secret(struct tls13_secrets *secrets)
 	    !secrets->handshake_done || !secrets->schedule_done)
 		return 0;
 
-	return tls13_hkdf_expand_label(&secrets->server_application_traffic,
-	    secrets->digest, &secrets->server_application_traffic,
-	    "traffic upd", &context);
+	if (!tls13_secrets_hmac_init(secrets,
+	    &secrets->server_application_traffic))
+		return 0;
+
+	return tls13_secrets_expand_label(secrets,
+	    &secrets->server_application_traffic, "traffic upd", &context);
 }
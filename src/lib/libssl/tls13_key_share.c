@@ -15,7 +15,9 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <pthread.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 #include <openssl/curve25519.h>
 
@@ -166,6 +168,324 @@ tls13_key_share_generate(struct tls13_key_share *ks)
 	return tls13_key_share_generate_ecdhe_ecp(ks);
 }
 
+/*
+ * Pool of pregenerated key shares.
+ *
+ * An SSL_CTX may keep generated, unused key shares for each group that its
+ * handshakes ask for, which takes key generation out of the handshake. A
+ * group is added the first time a handshake asks for it. The pool is
+ * refilled by a background thread and by SSL_CTX_fill_key_share_pool(),
+ * which idle application threads may call. A pooled key share is handed
+ * out once and handshakes generate their own when the pool is empty. In a
+ * forked child the pool is emptied and disabled, so that parent and child
+ * never use the same key.
+ */
+#define TLS13_KEY_SHARE_POOL_GROUPS	8
+
+struct tls13_key_share_queue {
+	uint16_t group_id;
+	struct tls13_key_share *keys[TLS13_KEY_SHARE_POOL_MAX];
+	size_t num;
+};
+
+struct tls13_key_share_pool {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t thread;
+	int running;
+	int stop;
+	pid_t pid;
+	size_t size;
+	struct tls13_key_share_queue queues[TLS13_KEY_SHARE_POOL_GROUPS];
+	size_t num_queues;
+};
+
+struct tls13_key_share_pool *
+tls13_key_share_pool_new(void)
+{
+	struct tls13_key_share_pool *pool;
+
+	if ((pool = calloc(1, sizeof(*pool))) == NULL)
+		return NULL;
+	if (pthread_mutex_init(&pool->lock, NULL) != 0) {
+		free(pool);
+		return NULL;
+	}
+	if (pthread_cond_init(&pool->cond, NULL) != 0) {
+		pthread_mutex_destroy(&pool->lock);
+		free(pool);
+		return NULL;
+	}
+	pool->pid = getpid();
+
+	return pool;
+}
+
+/* Called with the lock held. */
+static void
+tls13_key_share_pool_trim(struct tls13_key_share_pool *pool, size_t size)
+{
+	struct tls13_key_share_queue *q;
+	size_t i;
+
+	for (i = 0; i < pool->num_queues; i++) {
+		q = &pool->queues[i];
+		while (q->num > size) {
+			tls13_key_share_free(q->keys[--q->num]);
+			q->keys[q->num] = NULL;
+		}
+	}
+}
+
+/*
+ * The background thread does not exist in a forked child, and the keys are
+ * shared with the parent. Called with the lock held.
+ */
+static void
+tls13_key_share_pool_fork_check(struct tls13_key_share_pool *pool)
+{
+	if (pool->pid == getpid())
+		return;
+
+	tls13_key_share_pool_trim(pool, 0);
+	pool->size = 0;
+	pool->running = 0;
+	pool->stop = 0;
+	pool->pid = getpid();
+}
+
+/*
+ * Add one key share to the first group that is not full. The lock is held
+ * on entry and on return, but not while the key is generated. Returns 1 if
+ * a key share was added, 0 if all groups are full and -1 on failure.
+ */
+static int
+tls13_key_share_pool_refill_one(struct tls13_key_share_pool *pool)
+{
+	struct tls13_key_share_queue *q = NULL;
+	struct tls13_key_share *ks;
+	size_t i;
+
+	for (i = 0; i < pool->num_queues; i++) {
+		if (pool->queues[i].num < pool->size) {
+			q = &pool->queues[i];
+			break;
+		}
+	}
+	if (q == NULL)
+		return 0;
+
+	/* Queues are never removed, so q remains valid. */
+	pthread_mutex_unlock(&pool->lock);
+	if ((ks = tls13_key_share_new(q->group_id)) != NULL &&
+	    !tls13_key_share_generate(ks)) {
+		tls13_key_share_free(ks);
+		ks = NULL;
+	}
+	pthread_mutex_lock(&pool->lock);
+
+	if (ks == NULL)
+		return -1;
+
+	if (q->num >= pool->size) {
+		tls13_key_share_free(ks);
+		return 1;
+	}
+	q->keys[q->num++] = ks;
+
+	return 1;
+}
+
+static void *
+tls13_key_share_pool_thread(void *arg)
+{
+	struct tls13_key_share_pool *pool = arg;
+
+	pthread_mutex_lock(&pool->lock);
+	while (!pool->stop) {
+		/* Sleep when full, or after a failure, until a key is taken. */
+		if (tls13_key_share_pool_refill_one(pool) <= 0)
+			pthread_cond_wait(&pool->cond, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+static void
+tls13_key_share_pool_stop(struct tls13_key_share_pool *pool)
+{
+	pthread_t thread;
+	int running;
+
+	pthread_mutex_lock(&pool->lock);
+	tls13_key_share_pool_fork_check(pool);
+	running = pool->running;
+	thread = pool->thread;
+	pool->stop = 1;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	if (running)
+		pthread_join(thread, NULL);
+
+	pthread_mutex_lock(&pool->lock);
+	pool->running = 0;
+	pool->stop = 0;
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void
+tls13_key_share_pool_free(struct tls13_key_share_pool *pool)
+{
+	if (pool == NULL)
+		return;
+
+	tls13_key_share_pool_stop(pool);
+	tls13_key_share_pool_trim(pool, 0);
+
+	pthread_cond_destroy(&pool->cond);
+	pthread_mutex_destroy(&pool->lock);
+	freezero(pool, sizeof(*pool));
+}
+
+/*
+ * Keep up to size key shares for each group. A size of zero empties the
+ * pool and stops the background thread.
+ */
+int
+tls13_key_share_pool_set_size(struct tls13_key_share_pool *pool, size_t size)
+{
+	int ret = 0;
+
+	if (size > TLS13_KEY_SHARE_POOL_MAX)
+		return 0;
+
+	if (size == 0) {
+		tls13_key_share_pool_stop(pool);
+		pthread_mutex_lock(&pool->lock);
+		tls13_key_share_pool_trim(pool, 0);
+		pool->size = 0;
+		pthread_mutex_unlock(&pool->lock);
+		return 1;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	tls13_key_share_pool_fork_check(pool);
+	tls13_key_share_pool_trim(pool, size);
+	pool->size = size;
+	if (!pool->running) {
+		if (pthread_create(&pool->thread, NULL,
+		    tls13_key_share_pool_thread, pool) != 0)
+			goto err;
+		pool->running = 1;
+	}
+	pthread_cond_broadcast(&pool->cond);
+
+	ret = 1;
+
+ err:
+	pthread_mutex_unlock(&pool->lock);
+
+	return ret;
+}
+
+size_t
+tls13_key_share_pool_size(struct tls13_key_share_pool *pool)
+{
+	size_t size;
+
+	pthread_mutex_lock(&pool->lock);
+	tls13_key_share_pool_fork_check(pool);
+	size = pool->size;
+	pthread_mutex_unlock(&pool->lock);
+
+	return size;
+}
+
+/* Fill the pool from the calling thread. */
+int
+tls13_key_share_pool_fill(struct tls13_key_share_pool *pool)
+{
+	int ret;
+
+	pthread_mutex_lock(&pool->lock);
+	tls13_key_share_pool_fork_check(pool);
+	while ((ret = tls13_key_share_pool_refill_one(pool)) > 0)
+		continue;
+	pthread_mutex_unlock(&pool->lock);
+
+	return ret == 0;
+}
+
+static struct tls13_key_share *
+tls13_key_share_pool_take(struct tls13_key_share_pool *pool, uint16_t group_id)
+{
+	struct tls13_key_share_queue *q = NULL;
+	struct tls13_key_share *ks = NULL;
+	size_t i;
+
+	pthread_mutex_lock(&pool->lock);
+	tls13_key_share_pool_fork_check(pool);
+
+	if (pool->size == 0)
+		goto done;
+
+	for (i = 0; i < pool->num_queues; i++) {
+		if (pool->queues[i].group_id == group_id) {
+			q = &pool->queues[i];
+			break;
+		}
+	}
+	if (q == NULL) {
+		if (pool->num_queues >= TLS13_KEY_SHARE_POOL_GROUPS)
+			goto done;
+		q = &pool->queues[pool->num_queues++];
+		q->group_id = group_id;
+	}
+
+	if (q->num > 0) {
+		ks = q->keys[--q->num];
+		q->keys[q->num] = NULL;
+	}
+
+	/* Wake the background thread to refill or fill the new group. */
+	pthread_cond_signal(&pool->cond);
+
+ done:
+	pthread_mutex_unlock(&pool->lock);
+
+	return ks;
+}
+
+/*
+ * Generate the key share, taking the key from the pool if it has one for
+ * the group.
+ */
+int
+tls13_key_share_generate_pooled(struct tls13_key_share *ks,
+    struct tls13_key_share_pool *pool)
+{
+	struct tls13_key_share *pooled;
+
+	if (pool == NULL || ks->ecdhe != NULL || ks->x25519_public != NULL ||
+	    ks->x25519_private != NULL)
+		return tls13_key_share_generate(ks);
+
+	if ((pooled = tls13_key_share_pool_take(pool, ks->group_id)) == NULL)
+		return tls13_key_share_generate(ks);
+
+	ks->ecdhe = pooled->ecdhe;
+	ks->x25519_public = pooled->x25519_public;
+	ks->x25519_private = pooled->x25519_private;
+	pooled->ecdhe = NULL;
+	pooled->x25519_public = NULL;
+	pooled->x25519_private = NULL;
+	tls13_key_share_free(pooled);
+
+	return 1;
+}
+
 static int
 tls13_key_share_public_ecdhe_ecp(struct tls13_key_share *ks, CBB *cbb)
 {
@@ -16,9 +16,89 @@
  */
 
 #include <limits.h>
+#include <unistd.h>
 
 #include "ssl_locl.h"
 #include "tls13_internal.h"
+#include "tls13_record.h"
+
+/*
+ * A socket or file descriptor BIO that has nothing stacked on it, no
+ * callback and no kernel TLS is read and written directly, rather than
+ * through the BIO layer. Return its descriptor, or -1 if the BIO has to be
+ * used. The retry flags and the byte counts of the BIO are maintained in
+ * the same way as by the BIO.
+ */
+static int
+tls13_legacy_wire_fd(BIO *bio, int ktls_flag)
+{
+	if (bio->callback != NULL || bio->next_bio != NULL || !bio->init)
+		return -1;
+	if (BIO_method_type(bio) != BIO_TYPE_SOCKET &&
+	    BIO_method_type(bio) != BIO_TYPE_FD)
+		return -1;
+	if (BIO_test_flags(bio, ktls_flag))
+		return -1;
+
+	return bio->num;
+}
+
+static int
+tls13_legacy_wire_should_retry(BIO *bio, int n)
+{
+	if (BIO_method_type(bio) == BIO_TYPE_SOCKET)
+		return BIO_sock_should_retry(n);
+
+	return BIO_fd_should_retry(n);
+}
+
+static int
+tls13_legacy_wire_bio_read(BIO *bio, uint8_t *buf, size_t len)
+{
+	ssize_t n;
+	int fd;
+
+	if (len > INT_MAX)
+		len = INT_MAX;
+
+	if ((fd = tls13_legacy_wire_fd(bio, BIO_FLAGS_KTLS_RX)) == -1)
+		return BIO_read(bio, buf, len);
+
+	n = read(fd, buf, len);
+	BIO_clear_retry_flags(bio);
+	if (n <= 0) {
+		if (tls13_legacy_wire_should_retry(bio, n))
+			BIO_set_retry_read(bio);
+		return n;
+	}
+	bio->num_read += n;
+
+	return n;
+}
+
+static int
+tls13_legacy_wire_bio_write(BIO *bio, const uint8_t *buf, size_t len)
+{
+	ssize_t n;
+	int fd;
+
+	if (len > INT_MAX)
+		len = INT_MAX;
+
+	if ((fd = tls13_legacy_wire_fd(bio, BIO_FLAGS_KTLS_TX)) == -1)
+		return BIO_write(bio, buf, len);
+
+	n = write(fd, buf, len);
+	BIO_clear_retry_flags(bio);
+	if (n <= 0) {
+		if (tls13_legacy_wire_should_retry(bio, n))
+			BIO_set_retry_write(bio);
+		return n;
+	}
+	bio->num_write += n;
+
+	return n;
+}
 
 static ssize_t
 tls13_legacy_wire_read(SSL *ssl, uint8_t *buf, size_t len)
@@ -33,7 +113,7 @@ tls13_legacy_wire_read(SSL *ssl, uint8_t *buf, size_t len)
 	ssl->internal->rwstate = SSL_READING;
 	errno = 0;
 
-	if ((n = BIO_read(ssl->rbio, buf, len)) <= 0) {
+	if ((n = tls13_legacy_wire_bio_read(ssl->rbio, buf, len)) <= 0) {
 		if (BIO_should_read(ssl->rbio))
 			return TLS13_IO_WANT_POLLIN;
 		if (n == 0)
@@ -51,11 +131,71 @@ tls13_legacy_wire_read(SSL *ssl, uint8_t *buf, size_t len)
 	return n;
 }
 
+/*
+ * With read ahead enabled, once the handshake has completed, as much as a
+ * whole record is read from the wire at a time, so that the record header
+ * and the rest of the record are usually read together. Data is not read
+ * ahead during the handshake, since it would be lost should the connection
+ * switch to the legacy stack.
+ */
+static ssize_t
+tls13_legacy_wire_read_ahead(struct tls13_ctx *ctx, uint8_t *buf, size_t len)
+{
+	SSL *ssl = ctx->ssl;
+	ssize_t n;
+
+	if (CBS_len(&ctx->wire_rbuf_cbs) == 0) {
+		if (ctx->wire_rbuf == NULL) {
+			if ((ctx->wire_rbuf = ssl_buffer_get(ssl->ctx,
+			    TLS13_RECORD_MAX_LEN, &ctx->wire_rbuf_len)) == NULL)
+				return TLS13_IO_FAILURE;
+		}
+		if ((n = tls13_legacy_wire_read(ssl, ctx->wire_rbuf,
+		    ctx->wire_rbuf_len)) <= 0)
+			return n;
+		CBS_init(&ctx->wire_rbuf_cbs, ctx->wire_rbuf, n);
+	}
+
+	if (len > CBS_len(&ctx->wire_rbuf_cbs))
+		len = CBS_len(&ctx->wire_rbuf_cbs);
+	if (!CBS_write_bytes(&ctx->wire_rbuf_cbs, buf, len, NULL))
+		return TLS13_IO_FAILURE;
+	if (!CBS_skip(&ctx->wire_rbuf_cbs, len))
+		return TLS13_IO_FAILURE;
+
+	ssl->internal->rwstate = SSL_NOTHING;
+
+	if (CBS_len(&ctx->wire_rbuf_cbs) == 0 &&
+	    (ssl->internal->mode & SSL_MODE_RELEASE_BUFFERS) != 0)
+		tls13_legacy_wire_release(ctx);
+
+	return len;
+}
+
+/*
+ * Release the read ahead buffer, unless it holds data.
+ */
+void
+tls13_legacy_wire_release(struct tls13_ctx *ctx)
+{
+	if (CBS_len(&ctx->wire_rbuf_cbs) != 0)
+		return;
+
+	ssl_buffer_put(ctx->ssl != NULL ? ctx->ssl->ctx : NULL,
+	    ctx->wire_rbuf, ctx->wire_rbuf_len);
+	ctx->wire_rbuf = NULL;
+	ctx->wire_rbuf_len = 0;
+}
+
 ssize_t
 tls13_legacy_wire_read_cb(void *buf, size_t n, void *arg)
 {
 	struct tls13_ctx *ctx = arg;
 
+	if (CBS_len(&ctx->wire_rbuf_cbs) > 0 || (ctx->handshake_completed &&
+	    ctx->ssl->internal->read_ahead))
+		return tls13_legacy_wire_read_ahead(ctx, buf, n);
+
 	return tls13_legacy_wire_read(ctx->ssl, buf, n);
 }
 
@@ -72,7 +212,7 @@ tls13_legacy_wire_write(SSL *ssl, const uint8_t *buf, size_t len)
 	ssl->internal->rwstate = SSL_WRITING;
 	errno = 0;
 
-	if ((n = BIO_write(ssl->wbio, buf, len)) <= 0) {
+	if ((n = tls13_legacy_wire_bio_write(ssl->wbio, buf, len)) <= 0) {
 		if (BIO_should_write(ssl->wbio))
 			return TLS13_IO_WANT_POLLOUT;
 
@@ -96,6 +236,34 @@ tls13_legacy_wire_write_cb(const void *buf, size_t n, void *arg)
 	return tls13_legacy_wire_write(ctx->ssl, buf, n);
 }
 
+uint8_t *
+tls13_legacy_buf_get_cb(size_t len, size_t *out_len, void *arg)
+{
+	struct tls13_ctx *ctx = arg;
+
+	return ssl_buffer_get(ctx->ssl != NULL ? ctx->ssl->ctx : NULL, len,
+	    out_len);
+}
+
+void
+tls13_legacy_buf_put_cb(uint8_t *buf, size_t len, void *arg)
+{
+	struct tls13_ctx *ctx = arg;
+
+	ssl_buffer_put(ctx->ssl != NULL ? ctx->ssl->ctx : NULL, buf, len);
+}
+
+int
+tls13_legacy_buf_retire_cb(uint8_t *buf, size_t len, void *arg)
+{
+	struct tls13_ctx *ctx = arg;
+
+	if (ctx->ssl == NULL)
+		return 0;
+
+	return ssl_zerocopy_retire(ctx->ssl, buf, len);
+}
+
 static void
 tls13_legacy_error(SSL *ssl)
 {
@@ -174,6 +342,10 @@ tls13_legacy_return_code(SSL *ssl, ssize_t ret)
 	case TLS13_IO_WANT_RETRY:
 		SSLerror(ssl, ERR_R_INTERNAL_ERROR);
 		return -1;
+
+	case TLS13_IO_WANT_PRIVATE_KEY:
+		ssl->internal->rwstate = SSL_PRIVATE_KEY_OPERATION;
+		return -1;
 	}
 
 	SSLerror(ssl, ERR_R_INTERNAL_ERROR);
@@ -210,6 +382,8 @@ tls13_legacy_read_bytes(SSL *ssl, int type, unsigned char *buf, int len, int pee
 
 	tls13_record_layer_set_retry_after_phh(ctx->rl,
 	    (ctx->ssl->internal->mode & SSL_MODE_AUTO_RETRY) != 0);
+	tls13_record_layer_set_release_buffers(ctx->rl,
+	    (ctx->ssl->internal->mode & SSL_MODE_RELEASE_BUFFERS) != 0);
 
 	if (type != SSL3_RT_APPLICATION_DATA) {
 		SSLerror(ssl, ERR_R_SHOULD_NOT_HAVE_BEEN_CALLED);
@@ -242,6 +416,13 @@ tls13_legacy_write_bytes(SSL *ssl, int type, const void *vbuf, int len)
 		return tls13_legacy_return_code(ssl, TLS13_IO_WANT_POLLOUT);
 	}
 
+	tls13_record_layer_set_release_buffers(ctx->rl,
+	    (ctx->ssl->internal->mode & SSL_MODE_RELEASE_BUFFERS) != 0);
+	tls13_record_layer_set_dynamic_records(ctx->rl,
+	    (ctx->ssl->internal->mode & SSL_MODE_DYNAMIC_RECORDS) != 0);
+	tls13_record_layer_set_coalesce_writes(ctx->rl,
+	    (ctx->ssl->internal->mode & SSL_MODE_COALESCE_WRITES) != 0);
+
 	if (type != SSL3_RT_APPLICATION_DATA) {
 		SSLerror(ssl, ERR_R_SHOULD_NOT_HAVE_BEEN_CALLED);
 		return -1;
@@ -285,6 +466,83 @@ tls13_legacy_write_bytes(SSL *ssl, int type, const void *vbuf, int len)
 	}
 }
 
+int
+tls13_legacy_writev(SSL *ssl, const struct iovec *iov, int iovcnt)
+{
+	struct tls13_ctx *ctx = ssl->internal->tls13;
+	struct iovec content[TLS13_RECORD_MAX_IOV];
+	size_t avail, n, off = 0, sent = 0;
+	ssize_t ret;
+	int cnt, i = 0, j;
+
+	if (ctx == NULL || !ctx->handshake_completed) {
+		if ((ret = ssl->internal->handshake_func(ssl)) <= 0)
+			return ret;
+		return tls13_legacy_return_code(ssl, TLS13_IO_WANT_POLLOUT);
+	}
+
+	tls13_record_layer_set_release_buffers(ctx->rl,
+	    (ctx->ssl->internal->mode & SSL_MODE_RELEASE_BUFFERS) != 0);
+	tls13_record_layer_set_dynamic_records(ctx->rl,
+	    (ctx->ssl->internal->mode & SSL_MODE_DYNAMIC_RECORDS) != 0);
+	tls13_record_layer_set_coalesce_writes(ctx->rl,
+	    (ctx->ssl->internal->mode & SSL_MODE_COALESCE_WRITES) != 0);
+
+	/*
+	 * Write records until the vector has been consumed or a write would
+	 * block, in which case the number of bytes written so far is returned.
+	 */
+	for (;;) {
+		while (i < iovcnt && iov[i].iov_len == off) {
+			i++;
+			off = 0;
+		}
+		if (i == iovcnt)
+			return sent;
+
+		cnt = 0;
+		for (j = i; j < iovcnt && cnt < TLS13_RECORD_MAX_IOV; j++) {
+			content[cnt].iov_base = (uint8_t *)iov[j].iov_base +
+			    (j == i ? off : 0);
+			content[cnt].iov_len = iov[j].iov_len - (j == i ? off : 0);
+			cnt++;
+		}
+
+		if ((ret = tls13_write_application_data_iov(ctx->rl, content,
+		    cnt)) <= 0) {
+			if (sent > 0)
+				return sent;
+			return tls13_legacy_return_code(ssl, ret);
+		}
+		sent += ret;
+
+		for (n = ret; n > 0 && i < iovcnt; ) {
+			if (n < (avail = iov[i].iov_len - off)) {
+				off += n;
+				break;
+			}
+			n -= avail;
+			i++;
+			off = 0;
+		}
+	}
+}
+
+int
+tls13_legacy_flush(SSL *ssl)
+{
+	struct tls13_ctx *ctx = ssl->internal->tls13;
+	ssize_t ret;
+
+	if (ctx == NULL || !ctx->handshake_completed)
+		return 1;
+
+	if ((ret = tls13_flush_application_data(ctx->rl)) != TLS13_IO_SUCCESS)
+		return tls13_legacy_return_code(ssl, ret);
+
+	return 1;
+}
+
 static int
 tls13_use_legacy_stack(struct tls13_ctx *ctx)
 {
@@ -379,35 +637,101 @@ tls13_use_legacy_server(struct tls13_ctx *ctx)
 	return 1;
 }
 
+static struct tls13_ctx *
+tls13_legacy_server_ctx(SSL *ssl)
+{
+	struct tls13_ctx *ctx;
+
+	if ((ctx = ssl->internal->tls13) != NULL)
+		return ctx;
+
+	if ((ctx = tls13_ctx_new(TLS13_HS_SERVER)) == NULL) {
+		SSLerror(ssl, ERR_R_INTERNAL_ERROR); /* XXX */
+		return NULL;
+	}
+	ssl->internal->tls13 = ctx;
+	ctx->ssl = ssl;
+	ctx->hs = &S3I(ssl)->hs;
+
+	if (!tls13_server_init(ctx)) {
+		if (ERR_peek_error() == 0)
+			SSLerror(ssl, ERR_R_INTERNAL_ERROR); /* XXX */
+		return NULL;
+	}
+
+	return ctx;
+}
+
 int
 tls13_legacy_accept(SSL *ssl)
 {
-	struct tls13_ctx *ctx = ssl->internal->tls13;
-	int ret;
+	struct tls13_ctx *ctx;
+	uint8_t buf[512];
+	ssize_t ret;
 
-	if (ctx == NULL) {
-		if ((ctx = tls13_ctx_new(TLS13_HS_SERVER)) == NULL) {
-			SSLerror(ssl, ERR_R_INTERNAL_ERROR); /* XXX */
-			return -1;
-		}
-		ssl->internal->tls13 = ctx;
-		ctx->ssl = ssl;
-		ctx->hs = &S3I(ssl)->hs;
+	if ((ctx = tls13_legacy_server_ctx(ssl)) == NULL)
+		return -1;
 
-		if (!tls13_server_init(ctx)) {
-			if (ERR_peek_error() == 0)
-				SSLerror(ssl, ERR_R_INTERNAL_ERROR); /* XXX */
-			return -1;
-		}
+	ERR_clear_error();
+
+	/*
+	 * Early data that was accepted but is not being read via
+	 * SSL_read_early_data() is discarded.
+	 */
+	while ((ret = tls13_server_accept(ctx)) == TLS13_IO_EARLY_DATA) {
+		if ((ret = tls13_read_early_data(ctx->rl, buf,
+		    sizeof(buf))) <= 0)
+			break;
 	}
+	explicit_bzero(buf, sizeof(buf));
+
+	if (ret == TLS13_IO_USE_LEGACY)
+		return ssl->method->ssl_accept(ssl);
+
+	return tls13_legacy_return_code(ssl, ret);
+}
+
+int
+tls13_legacy_read_early_data(SSL *ssl, void *buf, size_t len,
+    size_t *readbytes)
+{
+	struct tls13_ctx *ctx;
+	ssize_t ret;
+
+	*readbytes = 0;
+
+	if ((ctx = tls13_legacy_server_ctx(ssl)) == NULL)
+		return SSL_READ_EARLY_DATA_ERROR;
+
+	if (ctx->handshake_completed)
+		return SSL_READ_EARLY_DATA_FINISH;
 
 	ERR_clear_error();
 
+	if (len > INT_MAX)
+		len = INT_MAX;
+
+	ctx->read_early_data = 1;
+
+	/*
+	 * If we switched to the legacy server there can be no early data -
+	 * the handshake is completed via SSL_accept() or SSL_do_handshake().
+	 */
 	ret = tls13_server_accept(ctx);
 	if (ret == TLS13_IO_USE_LEGACY)
-		return ssl->method->ssl_accept(ssl);
+		return SSL_READ_EARLY_DATA_FINISH;
+	if (ret == TLS13_IO_EARLY_DATA) {
+		if ((ret = tls13_read_early_data(ctx->rl, buf, len)) > 0) {
+			*readbytes = ret;
+			return SSL_READ_EARLY_DATA_SUCCESS;
+		}
+	}
+	if (ret == TLS13_IO_SUCCESS)
+		return SSL_READ_EARLY_DATA_FINISH;
 
-	return tls13_legacy_return_code(ssl, ret);
+	(void)tls13_legacy_return_code(ssl, ret);
+
+	return SSL_READ_EARLY_DATA_ERROR;
 }
 
 int
@@ -470,6 +794,10 @@ tls13_legacy_shutdown(SSL *ssl)
 	if (!ctx->close_notify_sent) {
 		/* Enqueue and send close notify. */
 		if (!(ssl->internal->shutdown & SSL_SENT_SHUTDOWN)) {
+			/* Coalesced application data precedes close notify. */
+			if ((ret = tls13_flush_application_data(ctx->rl)) !=
+			    TLS13_IO_SUCCESS)
+				return tls13_legacy_return_code(ssl, ret);
 			ssl->internal->shutdown |= SSL_SENT_SHUTDOWN;
 			if ((ret = tls13_send_alert(ctx->rl,
 			    TLS13_ALERT_CLOSE_NOTIFY)) < 0)
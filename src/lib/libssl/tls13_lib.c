@@ -19,6 +19,7 @@
 #include <stddef.h>
 
 #include <openssl/evp.h>
+#include <openssl/hmac.h>
 
 #include "ssl_locl.h"
 #include "ssl_tlsext.h"
@@ -125,6 +126,7 @@ tls13_alert_received_cb(uint8_t alert_desc, void *arg)
 
 	/* All other alerts are treated as fatal in TLSv1.3. */
 	S3I(ctx->ssl)->fatal_alert = alert_desc;
+	ssl_stats_alert(ctx->ssl, 0, alert_desc);
 
 	SSLerror(ctx->ssl, SSL_AD_REASON_OFFSET + alert_desc);
 	ERR_asprintf_error_data("SSL alert number %d", alert_desc);
@@ -147,6 +149,7 @@ tls13_alert_sent_cb(uint8_t alert_desc, void *arg)
 	}
 
 	/* All other alerts are treated as fatal in TLSv1.3. */
+	ssl_stats_alert(ctx->ssl, 1, alert_desc);
 	if (ctx->error.code == 0)
 		SSLerror(ctx->ssl, SSL_AD_REASON_OFFSET + alert_desc);
 }
@@ -158,10 +161,12 @@ tls13_legacy_handshake_message_recv_cb(void *arg)
 	SSL *s = ctx->ssl;
 	CBS cbs;
 
+	tls13_handshake_msg_data(ctx->hs_msg, &cbs);
+	ssl_trace_message(s, 0, CBS_data(&cbs), CBS_len(&cbs));
+
 	if (s->internal->msg_callback == NULL)
 		return;
 
-	tls13_handshake_msg_data(ctx->hs_msg, &cbs);
 	s->internal->msg_callback(0, TLS1_3_VERSION, SSL3_RT_HANDSHAKE,
 	    CBS_data(&cbs), CBS_len(&cbs), s, s->internal->msg_callback_arg);
 }
@@ -173,10 +178,12 @@ tls13_legacy_handshake_message_sent_cb(void *arg)
 	SSL *s = ctx->ssl;
 	CBS cbs;
 
+	tls13_handshake_msg_data(ctx->hs_msg, &cbs);
+	ssl_trace_message(s, 1, CBS_data(&cbs), CBS_len(&cbs));
+
 	if (s->internal->msg_callback == NULL)
 		return;
 
-	tls13_handshake_msg_data(ctx->hs_msg, &cbs);
 	s->internal->msg_callback(1, TLS1_3_VERSION, SSL3_RT_HANDSHAKE,
 	    CBS_data(&cbs), CBS_len(&cbs), s, s->internal->msg_callback_arg);
 }
@@ -294,6 +301,7 @@ tls13_key_update_recv(struct tls13_ctx *ctx, CBS *cbs)
 
 	if (!tls13_phh_update_peer_traffic_secret(ctx))
 		goto err;
+	ctx->key_updates++;
 
 	if (key_update_request == 0)
 		return TLS13_IO_SUCCESS;
@@ -331,6 +339,7 @@ tls13_phh_done_cb(void *cb_arg)
 	if (ctx->key_update_request) {
 		tls13_phh_update_local_traffic_secret(ctx);
 		ctx->key_update_request = 0;
+		ctx->key_updates++;
 	}
 }
 
@@ -385,6 +394,9 @@ static const struct tls13_record_layer_callbacks rl_callbacks = {
 	.alert_sent = tls13_alert_sent_cb,
 	.phh_recv = tls13_phh_received_cb,
 	.phh_sent = tls13_phh_done_cb,
+	.buf_get = tls13_legacy_buf_get_cb,
+	.buf_put = tls13_legacy_buf_put_cb,
+	.buf_retire = tls13_legacy_buf_retire_cb,
 };
 
 struct tls13_ctx *
@@ -424,6 +436,9 @@ tls13_ctx_free(struct tls13_ctx *ctx)
 	tls13_error_clear(&ctx->error);
 	tls13_record_layer_free(ctx->rl);
 	tls13_handshake_msg_free(ctx->hs_msg);
+	CBB_arena_cleanup(&ctx->hs_arena);
+	CBS_init(&ctx->wire_rbuf_cbs, NULL, 0);
+	tls13_legacy_wire_release(ctx);
 
 	freezero(ctx, sizeof(struct tls13_ctx));
 }
@@ -648,3 +663,120 @@ tls13_exporter(struct tls13_ctx *ctx, const uint8_t *label, size_t label_len,
 
 	return ret;
 }
+
+/*
+ * Early data anti-replay - RFC 8446 section 8.
+ *
+ * The PSK binder of each ClientHello for which early data is accepted is
+ * recorded in one of a pair of Bloom filters. The filters are rotated every
+ * window seconds, with new entries being added to the current filter, hence
+ * an entry is remembered for at least window seconds. Provided that the
+ * window covers the period over which a ClientHello would pass the ticket
+ * age check, replays are detected. A false positive results in early data
+ * being rejected, which is always safe.
+ */
+#define TLS13_ANTI_REPLAY_FILTER_BITS	(1 << 17)
+#define TLS13_ANTI_REPLAY_HASHES	4
+
+struct tls13_anti_replay {
+	uint8_t key[32];
+	time_t window;
+	time_t epoch;
+	int current;
+	uint8_t filters[2][TLS13_ANTI_REPLAY_FILTER_BITS / 8];
+};
+
+struct tls13_anti_replay *
+tls13_anti_replay_new(time_t window)
+{
+	struct tls13_anti_replay *ar;
+
+	if ((ar = calloc(1, sizeof(*ar))) == NULL)
+		return NULL;
+
+	arc4random_buf(ar->key, sizeof(ar->key));
+	ar->window = window;
+
+	return ar;
+}
+
+void
+tls13_anti_replay_free(struct tls13_anti_replay *ar)
+{
+	freezero(ar, sizeof(*ar));
+}
+
+static void
+tls13_anti_replay_rotate(struct tls13_anti_replay *ar, time_t now)
+{
+	/* If the clock goes backwards we retain entries for longer. */
+	if (now - ar->epoch < ar->window)
+		return;
+
+	if (now - ar->epoch >= 2 * ar->window) {
+		memset(ar->filters, 0, sizeof(ar->filters));
+	} else {
+		ar->current ^= 1;
+		memset(ar->filters[ar->current], 0,
+		    sizeof(ar->filters[ar->current]));
+	}
+
+	ar->epoch = now;
+}
+
+static int
+tls13_anti_replay_filter_test(const uint8_t *filter, const uint32_t *bits)
+{
+	size_t i;
+
+	for (i = 0; i < TLS13_ANTI_REPLAY_HASHES; i++) {
+		if ((filter[bits[i] / 8] & (1 << (bits[i] % 8))) == 0)
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Check whether the given identifier has been seen within the anti-replay
+ * window, recording it if not. Returns 1 if the identifier is fresh, 0 if it
+ * may have been seen previously (or on error).
+ */
+int
+tls13_anti_replay_check(struct tls13_anti_replay *ar, const uint8_t *id,
+    size_t id_len, time_t now)
+{
+	uint8_t digest[EVP_MAX_MD_SIZE];
+	uint32_t bits[TLS13_ANTI_REPLAY_HASHES];
+	unsigned int digest_len;
+	uint8_t *filter;
+	size_t i;
+	CBS cbs;
+
+	tls13_anti_replay_rotate(ar, now);
+
+	/*
+	 * Key the hash so that the filter positions cannot be predicted,
+	 * since the identifier is at least partially controlled by the peer.
+	 */
+	if (HMAC(EVP_sha256(), ar->key, sizeof(ar->key), id, id_len,
+	    digest, &digest_len) == NULL)
+		return 0;
+
+	CBS_init(&cbs, digest, digest_len);
+	for (i = 0; i < TLS13_ANTI_REPLAY_HASHES; i++) {
+		if (!CBS_get_u32(&cbs, &bits[i]))
+			return 0;
+		bits[i] %= TLS13_ANTI_REPLAY_FILTER_BITS;
+	}
+
+	if (tls13_anti_replay_filter_test(ar->filters[0], bits) ||
+	    tls13_anti_replay_filter_test(ar->filters[1], bits))
+		return 0;
+
+	filter = ar->filters[ar->current];
+	for (i = 0; i < TLS13_ANTI_REPLAY_HASHES; i++)
+		filter[bits[i] / 8] |= 1 << (bits[i] % 8);
+
+	return 1;
+}
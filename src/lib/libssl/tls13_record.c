@@ -26,17 +26,31 @@ struct tls13_record {
 	size_t data_len;
 	CBS cbs;
 
+	/* Received data belongs to buf, other data belongs to us. */
 	struct tls13_buffer *buf;
+	int data_owned;
 };
 
 struct tls13_record *
 tls13_record_new(void)
+{
+	return tls13_record_new_pool(NULL, NULL, NULL);
+}
+
+/*
+ * Create a record that is received into a buffer allocated through the
+ * given callbacks.
+ */
+struct tls13_record *
+tls13_record_new_pool(tls13_buf_get_cb buf_get, tls13_buf_put_cb buf_put,
+    void *cb_arg)
 {
 	struct tls13_record *rec = NULL;
 
 	if ((rec = calloc(1, sizeof(struct tls13_record))) == NULL)
 		goto err;
-	if ((rec->buf = tls13_buffer_new(TLS13_RECORD_MAX_LEN)) == NULL)
+	if ((rec->buf = tls13_buffer_new_pool(TLS13_RECORD_MAX_LEN, buf_get,
+	    buf_put, cb_arg)) == NULL)
 		goto err;
 
 	return rec;
@@ -53,9 +67,10 @@ tls13_record_free(struct tls13_record *rec)
 	if (rec == NULL)
 		return;
 
+	if (rec->data_owned)
+		freezero(rec->data, rec->data_len);
 	tls13_buffer_free(rec->buf);
 
-	freezero(rec->data, rec->data_len);
 	freezero(rec, sizeof(struct tls13_record));
 }
 
@@ -109,9 +124,11 @@ tls13_record_set_data(struct tls13_record *rec, uint8_t *data, size_t data_len)
 	if (data_len > TLS13_RECORD_MAX_LEN)
 		return 0;
 
-	freezero(rec->data, rec->data_len);
+	if (rec->data_owned)
+		freezero(rec->data, rec->data_len);
 	rec->data = data;
 	rec->data_len = data_len;
+	rec->data_owned = 1;
 	CBS_init(&rec->cbs, rec->data, rec->data_len);
 
 	return 1;
@@ -40,6 +40,26 @@ __BEGIN_HIDDEN_DECLS
 #define TLS13_RECORD_MAX_LEN \
 	(TLS13_RECORD_HEADER_LEN + TLS13_RECORD_MAX_CIPHERTEXT_LEN)
 
+/* Content type and AEAD tag overhead, accounted for when skipping early data. */
+#define TLS13_RECORD_EARLY_DATA_OVERHEAD (1 + EVP_AEAD_MAX_TAG_LENGTH)
+
+/*
+ * Dynamic record sizing. Application data is initially sent in records that
+ * fit within a single TCP segment (a 1460-byte MSS, less TCP options and the
+ * record overhead), with the record size doubling for each ramp length of
+ * data written, until full sized records are in use. Sizing starts over once
+ * no application data has been written for the idle period.
+ */
+#define TLS13_RECORD_DYNAMIC_PLAINTEXT_LEN	1369
+#define TLS13_RECORD_DYNAMIC_RAMP_LEN		(32 * 1024)
+#define TLS13_RECORD_DYNAMIC_IDLE_SECS		1
+
+/*
+ * Number of full sized application data records that a single large write
+ * may seal before they are written out together.
+ */
+#define TLS13_RECORD_MAX_BATCH			4
+
 /*
  * TLSv1.3 Per-Record Nonces and Sequence Numbers - RFC 8446 section 5.3.
  */
@@ -48,6 +68,8 @@ __BEGIN_HIDDEN_DECLS
 struct tls13_record;
 
 struct tls13_record *tls13_record_new(void);
+struct tls13_record *tls13_record_new_pool(tls13_buf_get_cb _buf_get,
+    tls13_buf_put_cb _buf_put, void *_cb_arg);
 void tls13_record_free(struct tls13_record *_rec);
 uint16_t tls13_record_version(struct tls13_record *_rec);
 uint8_t tls13_record_content_type(struct tls13_record *_rec);
@@ -15,13 +15,19 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <time.h>
+
 #include "tls13_internal.h"
 #include "tls13_record.h"
 
 static ssize_t tls13_record_layer_write_chunk(struct tls13_record_layer *rl,
     uint8_t content_type, const uint8_t *buf, size_t n);
 static ssize_t tls13_record_layer_write_record(struct tls13_record_layer *rl,
-    uint8_t content_type, const uint8_t *content, size_t content_len);
+    uint8_t content_type, const struct iovec *content, int content_cnt,
+    size_t content_len);
 
 struct tls13_record_protection {
 	EVP_AEAD_CTX aead_ctx;
@@ -69,6 +75,17 @@ struct tls13_record_layer {
 	int phh;
 	int phh_retry;
 
+	/*
+	 * Early data (RFC 8446, section 4.2.10). When early data has been
+	 * accepted, application data may be read prior to the handshake
+	 * completing. When early data has been rejected, records that cannot
+	 * be processed are discarded. In both cases the amount of early data
+	 * is bounded by early_data_remaining.
+	 */
+	int early_data_accept;
+	int early_data_skip;
+	size_t early_data_remaining;
+
 	/*
 	 * Read and/or write channels are closed due to an alert being
 	 * sent or received. In the case of an error alert both channels
@@ -80,11 +97,35 @@ struct tls13_record_layer {
 
 	struct tls13_record *rrec;
 
-	struct tls13_record *wrec;
+	/*
+	 * Buffer containing a sealed record that is pending write. This is
+	 * allocated on first use and reused for all subsequent records, unless
+	 * buffers are released once a record has been written. A large write
+	 * may seal a batch of records into it, each record being sealed at
+	 * wbuf_rec, the end of those already sealed.
+	 */
+	uint8_t *wbuf;
+	size_t wbuf_len;
+	size_t wbuf_rec;
+	CBS wbuf_cbs;
 	uint8_t wrec_content_type;
 	size_t wrec_appdata_len;
 	size_t wrec_content_len;
 
+	/*
+	 * Until the handshake completes, sealed handshake and change cipher
+	 * spec records are collected here rather than written one at a time.
+	 * The flight is written out as a whole before a record is read, before
+	 * any other record is written and once the handshake completes. Once
+	 * a write of the flight has started, it must complete before more
+	 * records are collected.
+	 */
+	uint8_t *flight;
+	size_t flight_len;
+	size_t flight_cap;
+	CBS flight_cbs;
+	int flight_flush;
+
 	/* Alert to be sent on return from current read handler. */
 	uint8_t alert;
 
@@ -99,28 +140,122 @@ struct tls13_record_layer {
 	uint8_t *phh_data;
 	size_t phh_len;
 
+	/* Release buffers when they are no longer in use. */
+	int release_buffers;
+
+	/*
+	 * Dynamic record sizing - the number of bytes of application data
+	 * written since sizing started over and the time of the last write.
+	 */
+	int dynamic_records;
+	size_t dynamic_len;
+	time_t dynamic_last;
+
+	/*
+	 * Application data from small writes is coalesced into a buffer, which
+	 * is sealed into a single record once it fills or is flushed. Once a
+	 * flush has started, it must complete before more data is accepted.
+	 */
+	int coalesce_writes;
+	int wcoal_flush;
+	uint8_t *wcoal;
+	size_t wcoal_len;
+
 	/* Buffer containing plaintext from opened records. */
 	uint8_t rbuf_content_type;
 	uint8_t *rbuf;
 	size_t rbuf_len;
 	CBS rbuf_cbs;
 
+	/*
+	 * Buffer of the caller of read, which an application data record is
+	 * opened straight into if it can hold the whole inner plaintext. The
+	 * content of such a record is then referenced by rbuf_cbs, with rbuf
+	 * left unset, until read returns.
+	 */
+	uint8_t *rdirect;
+	size_t rdirect_len;
+
 	/* Record protection. */
 	const EVP_MD *hash;
 	const EVP_AEAD *aead;
 	struct tls13_record_protection *read;
 	struct tls13_record_protection *write;
 
+	/*
+	 * Records are protected by the kernel once the handshake has completed,
+	 * see ssl_ktls.c - they are then read and written in the clear.
+	 */
+	int read_ktls;
+	int write_ktls;
+
+	/* Number of records opened and sealed. */
+	uint64_t num_records_read;
+	uint64_t num_records_written;
+
 	/* Callbacks. */
 	struct tls13_record_layer_callbacks cb;
 	void *cb_arg;
 };
 
+static uint8_t *
+tls13_record_layer_buf_get(struct tls13_record_layer *rl, size_t len,
+    size_t *out_len)
+{
+	uint8_t *buf;
+
+	if (rl->cb.buf_get != NULL)
+		return rl->cb.buf_get(len, out_len, rl->cb_arg);
+
+	*out_len = 0;
+	if ((buf = calloc(1, len)) != NULL)
+		*out_len = len;
+
+	return buf;
+}
+
+static void
+tls13_record_layer_buf_put(struct tls13_record_layer *rl, uint8_t *buf,
+    size_t len)
+{
+	if (rl->cb.buf_put != NULL) {
+		rl->cb.buf_put(buf, len, rl->cb_arg);
+		return;
+	}
+
+	freezero(buf, len);
+}
+
+/*
+ * Create a buffer that takes its memory from the same place as the buffers
+ * of the record layer.
+ */
+struct tls13_buffer *
+tls13_record_layer_buffer_new(struct tls13_record_layer *rl, size_t init_size)
+{
+	return tls13_buffer_new_pool(init_size, rl->cb.buf_get, rl->cb.buf_put,
+	    rl->cb_arg);
+}
+
+/*
+ * Hand over a buffer that has been written out in full, if the transport
+ * may still be reading from it. Return 1 if the buffer has been taken.
+ */
+static int
+tls13_record_layer_buf_retire(struct tls13_record_layer *rl, uint8_t *buf,
+    size_t len)
+{
+	if (rl->cb.buf_retire == NULL || buf == NULL)
+		return 0;
+
+	return rl->cb.buf_retire(buf, len, rl->cb_arg);
+}
+
 static void
 tls13_record_layer_rbuf_free(struct tls13_record_layer *rl)
 {
 	CBS_init(&rl->rbuf_cbs, NULL, 0);
-	freezero(rl->rbuf, rl->rbuf_len);
+	tls13_record_layer_buf_put(rl, rl->rbuf, rl->rbuf_len);
 	rl->rbuf = NULL;
 	rl->rbuf_len = 0;
 	rl->rbuf_content_type = 0;
@@ -134,10 +269,163 @@ tls13_record_layer_rrec_free(struct tls13_record_layer *rl)
 }
 
 static void
-tls13_record_layer_wrec_free(struct tls13_record_layer *rl)
+tls13_record_layer_wbuf_free(struct tls13_record_layer *rl)
+{
+	CBS_init(&rl->wbuf_cbs, NULL, 0);
+	tls13_record_layer_buf_put(rl, rl->wbuf, rl->wbuf_len);
+	rl->wbuf = NULL;
+	rl->wbuf_len = 0;
+	rl->wbuf_rec = 0;
+}
+
+static int
+tls13_record_layer_wbuf_cbb(struct tls13_record_layer *rl, CBB *cbb)
+{
+	/* Only records of a batch may be pending. */
+	if (CBS_len(&rl->wbuf_cbs) != rl->wbuf_rec)
+		return 0;
+
+	if (rl->wbuf == NULL) {
+		if ((rl->wbuf = tls13_record_layer_buf_get(rl,
+		    TLS13_RECORD_MAX_LEN, &rl->wbuf_len)) == NULL)
+			return 0;
+	}
+	if (rl->wbuf_len - rl->wbuf_rec < TLS13_RECORD_MAX_LEN)
+		return 0;
+
+	return CBB_init_fixed(cbb, &rl->wbuf[rl->wbuf_rec],
+	    TLS13_RECORD_MAX_LEN);
+}
+
+/*
+ * Make room in the write buffer for a batch of full sized records.
+ */
+static int
+tls13_record_layer_wbuf_batch(struct tls13_record_layer *rl)
 {
-	tls13_record_free(rl->wrec);
-	rl->wrec = NULL;
+	size_t len = TLS13_RECORD_MAX_BATCH * TLS13_RECORD_MAX_LEN;
+
+	if (CBS_len(&rl->wbuf_cbs) != 0)
+		return 0;
+
+	if (rl->wbuf != NULL && rl->wbuf_len >= len)
+		return 1;
+
+	tls13_record_layer_wbuf_free(rl);
+
+	if ((rl->wbuf = tls13_record_layer_buf_get(rl, len,
+	    &rl->wbuf_len)) == NULL)
+		return 0;
+
+	return 1;
+}
+
+static ssize_t
+tls13_record_layer_wbuf_send(struct tls13_record_layer *rl)
+{
+	ssize_t ret;
+
+	while (CBS_len(&rl->wbuf_cbs) > 0) {
+		if ((ret = rl->cb.wire_write(CBS_data(&rl->wbuf_cbs),
+		    CBS_len(&rl->wbuf_cbs), rl->cb_arg)) <= 0)
+			return ret;
+
+		if (!CBS_skip(&rl->wbuf_cbs, ret))
+			return TLS13_IO_FAILURE;
+	}
+	rl->wbuf_rec = 0;
+
+	if (tls13_record_layer_buf_retire(rl, rl->wbuf, rl->wbuf_len)) {
+		CBS_init(&rl->wbuf_cbs, NULL, 0);
+		rl->wbuf = NULL;
+		rl->wbuf_len = 0;
+	} else if (rl->release_buffers)
+		tls13_record_layer_wbuf_free(rl);
+
+	return TLS13_IO_SUCCESS;
+}
+
+static int
+tls13_record_layer_flight_record(struct tls13_record_layer *rl,
+    uint8_t content_type)
+{
+	if (rl->handshake_completed)
+		return 0;
+
+	return content_type == SSL3_RT_HANDSHAKE ||
+	    content_type == SSL3_RT_CHANGE_CIPHER_SPEC;
+}
+
+/*
+ * Move the sealed record from the write buffer to the end of the flight.
+ */
+static int
+tls13_record_layer_flight_add(struct tls13_record_layer *rl)
+{
+	size_t len, cap;
+	uint8_t *flight;
+
+	if (rl->flight_flush)
+		return 0;
+
+	len = CBS_len(&rl->wbuf_cbs);
+	if (len > rl->flight_cap - rl->flight_len) {
+		if ((cap = rl->flight_cap * 2) < rl->flight_len + len)
+			cap = rl->flight_len + len;
+		if (cap < TLS13_RECORD_MAX_LEN)
+			cap = TLS13_RECORD_MAX_LEN;
+		if ((flight = recallocarray(rl->flight, rl->flight_cap, cap,
+		    1)) == NULL)
+			return 0;
+		rl->flight = flight;
+		rl->flight_cap = cap;
+	}
+
+	memcpy(&rl->flight[rl->flight_len], CBS_data(&rl->wbuf_cbs), len);
+	rl->flight_len += len;
+
+	CBS_init(&rl->wbuf_cbs, NULL, 0);
+	if (rl->release_buffers)
+		tls13_record_layer_wbuf_free(rl);
+
+	return 1;
+}
+
+ssize_t
+tls13_record_layer_flush_flight(struct tls13_record_layer *rl)
+{
+	ssize_t ret;
+
+	if (rl->flight_len == 0)
+		return TLS13_IO_SUCCESS;
+
+	if (!rl->flight_flush) {
+		CBS_init(&rl->flight_cbs, rl->flight, rl->flight_len);
+		rl->flight_flush = 1;
+	}
+
+	while (CBS_len(&rl->flight_cbs) > 0) {
+		if ((ret = rl->cb.wire_write(CBS_data(&rl->flight_cbs),
+		    CBS_len(&rl->flight_cbs), rl->cb_arg)) <= 0)
+			return ret;
+
+		if (!CBS_skip(&rl->flight_cbs, ret))
+			return TLS13_IO_FAILURE;
+	}
+
+	rl->flight_flush = 0;
+	rl->flight_len = 0;
+
+	if (tls13_record_layer_buf_retire(rl, rl->flight, rl->flight_cap)) {
+		rl->flight = NULL;
+		rl->flight_cap = 0;
+	} else if (rl->release_buffers) {
+		freezero(rl->flight, rl->flight_cap);
+		rl->flight = NULL;
+		rl->flight_cap = 0;
+	}
+
+	return TLS13_IO_SUCCESS;
 }
 
 struct tls13_record_layer *
@@ -173,7 +461,10 @@ tls13_record_layer_free(struct tls13_record_layer *rl)
 		return;
 
 	tls13_record_layer_rrec_free(rl);
-	tls13_record_layer_wrec_free(rl);
+	tls13_record_layer_wbuf_free(rl);
+	freezero(rl->flight, rl->flight_cap);
+
+	freezero(rl->wcoal, TLS13_RECORD_MAX_PLAINTEXT_LEN);
 
 	freezero(rl->alert_data, rl->alert_len);
 	freezero(rl->phh_data, rl->phh_len);
@@ -272,12 +563,132 @@ tls13_record_layer_handshake_completed(struct tls13_record_layer *rl)
 	rl->handshake_completed = 1;
 }
 
+void
+tls13_record_layer_accept_early_data(struct tls13_record_layer *rl,
+    size_t max_early_data)
+{
+	rl->early_data_accept = 1;
+	rl->early_data_skip = 0;
+	rl->early_data_remaining = max_early_data;
+}
+
+void
+tls13_record_layer_skip_early_data(struct tls13_record_layer *rl,
+    size_t max_early_data)
+{
+	rl->early_data_accept = 0;
+	rl->early_data_skip = 1;
+	rl->early_data_remaining = max_early_data;
+}
+
+void
+tls13_record_layer_end_early_data(struct tls13_record_layer *rl)
+{
+	rl->early_data_accept = 0;
+	rl->early_data_skip = 0;
+	rl->early_data_remaining = 0;
+}
+
 void
 tls13_record_layer_set_retry_after_phh(struct tls13_record_layer *rl, int retry)
 {
 	rl->phh_retry = retry;
 }
 
+void
+tls13_record_layer_set_release_buffers(struct tls13_record_layer *rl,
+    int release)
+{
+	rl->release_buffers = release;
+
+	if (rl->release_buffers && CBS_len(&rl->wbuf_cbs) == 0)
+		tls13_record_layer_wbuf_free(rl);
+}
+
+/*
+ * Release the buffers that hold no data, for a connection that is going to
+ * be idle. They are allocated again when next needed.
+ */
+void
+tls13_record_layer_hibernate(struct tls13_record_layer *rl)
+{
+	if (CBS_len(&rl->rbuf_cbs) == 0)
+		tls13_record_layer_rbuf_free(rl);
+	if (CBS_len(&rl->wbuf_cbs) == 0)
+		tls13_record_layer_wbuf_free(rl);
+
+	if (rl->flight_len == 0) {
+		freezero(rl->flight, rl->flight_cap);
+		rl->flight = NULL;
+		rl->flight_cap = 0;
+	}
+	if (rl->wcoal_len == 0) {
+		freezero(rl->wcoal, TLS13_RECORD_MAX_PLAINTEXT_LEN);
+		rl->wcoal = NULL;
+	}
+}
+
+void
+tls13_record_layer_set_dynamic_records(struct tls13_record_layer *rl,
+    int dynamic)
+{
+	rl->dynamic_records = dynamic;
+}
+
+void
+tls13_record_layer_set_coalesce_writes(struct tls13_record_layer *rl,
+    int coalesce)
+{
+	rl->coalesce_writes = coalesce;
+}
+
+/*
+ * Provide the sequence number of the current traffic key in one direction,
+ * as long as the records that follow may be left to the kernel. No record
+ * may be partially read, or sealed and not yet fully sent.
+ */
+int
+tls13_record_layer_ktls_seq_num(struct tls13_record_layer *rl, int is_write,
+    CBS *seq_num)
+{
+	struct tls13_record_protection *rp = is_write ? rl->write : rl->read;
+
+	if (!rl->handshake_completed || rl->aead == NULL)
+		return 0;
+	if (is_write && (CBS_len(&rl->wbuf_cbs) > 0 || rl->flight_len > 0))
+		return 0;
+	if (!is_write && rl->rrec != NULL)
+		return 0;
+
+	CBS_init(seq_num, rp->seq_num, sizeof(rp->seq_num));
+
+	return 1;
+}
+
+void
+tls13_record_layer_use_ktls(struct tls13_record_layer *rl, int is_write)
+{
+	if (is_write)
+		rl->write_ktls = 1;
+	else
+		rl->read_ktls = 1;
+}
+
+void
+tls13_record_layer_record_counts(struct tls13_record_layer *rl,
+    uint64_t *num_read, uint64_t *num_written)
+{
+	*num_read = rl->num_records_read;
+	*num_written = rl->num_records_written;
+}
+
+int
+tls13_record_layer_write_pending(struct tls13_record_layer *rl)
+{
+	return CBS_len(&rl->wbuf_cbs) > 0 || rl->wcoal_len > 0 ||
+	    rl->flight_len > 0;
+}
+
 static ssize_t
 tls13_record_layer_process_alert(struct tls13_record_layer *rl)
 {
@@ -340,11 +751,15 @@ tls13_record_layer_process_alert(struct tls13_record_layer *rl)
 static ssize_t
 tls13_record_layer_send_alert(struct tls13_record_layer *rl)
 {
+	struct iovec iov;
 	ssize_t ret;
 
+	iov.iov_base = rl->alert_data;
+	iov.iov_len = rl->alert_len;
+
 	/* This has to fit into a single record, per RFC 8446 section 5.1. */
 	if ((ret = tls13_record_layer_write_record(rl, SSL3_RT_ALERT,
-	    rl->alert_data, rl->alert_len)) != rl->alert_len) {
+	    &iov, 1, rl->alert_len)) != rl->alert_len) {
 		if (ret == TLS13_IO_EOF)
 			ret = TLS13_IO_ALERT;
 		return ret;
@@ -499,6 +914,10 @@ int
 tls13_record_layer_set_read_traffic_key(struct tls13_record_layer *rl,
     struct tls13_secret *read_key)
 {
+	/* The keys in the kernel cannot be updated. */
+	if (rl->read_ktls)
+		return 0;
+
 	return tls13_record_layer_set_traffic_key(rl->aead, rl->hash,
 	    rl->read, read_key);
 }
@@ -507,22 +926,19 @@ int
 tls13_record_layer_set_write_traffic_key(struct tls13_record_layer *rl,
     struct tls13_secret *write_key)
 {
+	/* The keys in the kernel cannot be updated. */
+	if (rl->write_ktls)
+		return 0;
+
 	return tls13_record_layer_set_traffic_key(rl->aead, rl->hash,
 	    rl->write, write_key);
 }
 
 static int
-tls13_record_layer_open_record_plaintext(struct tls13_record_layer *rl)
+tls13_record_layer_open_record_clear(struct tls13_record_layer *rl)
 {
 	CBS cbs;
 
-	if (rl->aead != NULL)
-		return 0;
-
-	/*
-	 * We're still operating in plaintext mode, so just copy the
-	 * content from the record to the plaintext buffer.
-	 */
 	if (!tls13_record_content(rl->rrec, &cbs))
 		return 0;
 
@@ -533,16 +949,31 @@ tls13_record_layer_open_record_plaintext(struct tls13_record_layer *rl)
 
 	tls13_record_layer_rbuf_free(rl);
 
-	if (!CBS_stow(&cbs, &rl->rbuf, &rl->rbuf_len))
+	if ((rl->rbuf = tls13_record_layer_buf_get(rl, CBS_len(&cbs),
+	    &rl->rbuf_len)) == NULL)
 		return 0;
+	memcpy(rl->rbuf, CBS_data(&cbs), CBS_len(&cbs));
 
 	rl->rbuf_content_type = tls13_record_content_type(rl->rrec);
 
-	CBS_init(&rl->rbuf_cbs, rl->rbuf, rl->rbuf_len);
+	CBS_init(&rl->rbuf_cbs, rl->rbuf, CBS_len(&cbs));
 
 	return 1;
 }
 
+static int
+tls13_record_layer_open_record_plaintext(struct tls13_record_layer *rl)
+{
+	if (rl->aead != NULL)
+		return 0;
+
+	/*
+	 * We're still operating in plaintext mode, so just copy the
+	 * content from the record to the plaintext buffer.
+	 */
+	return tls13_record_layer_open_record_clear(rl);
+}
+
 static int
 tls13_record_layer_open_record_protected(struct tls13_record_layer *rl)
 {
@@ -551,7 +982,8 @@ tls13_record_layer_open_record_protected(struct tls13_record_layer *rl)
 	uint8_t *content = NULL;
 	size_t content_len = 0;
 	uint8_t content_type;
-	size_t out_len;
+	size_t max_out_len, out_len;
+	uint8_t *out = NULL;
 
 	if (rl->aead == NULL)
 		goto err;
@@ -561,16 +993,25 @@ tls13_record_layer_open_record_protected(struct tls13_record_layer *rl)
 	if (!tls13_record_content(rl->rrec, &enc_record))
 		goto err;
 
-	if ((content = calloc(1, CBS_len(&enc_record))) == NULL)
-		goto err;
-	content_len = CBS_len(&enc_record);
+	if (rl->rdirect != NULL && CBS_len(&enc_record) >
+	    EVP_AEAD_max_overhead(rl->aead) && rl->rdirect_len >=
+	    CBS_len(&enc_record) - EVP_AEAD_max_overhead(rl->aead)) {
+		out = rl->rdirect;
+		max_out_len = rl->rdirect_len;
+	} else {
+		if ((content = tls13_record_layer_buf_get(rl,
+		    CBS_len(&enc_record), &content_len)) == NULL)
+			goto err;
+		out = content;
+		max_out_len = CBS_len(&enc_record);
+	}
 
 	if (!tls13_record_layer_update_nonce(&rl->read->nonce, &rl->read->iv,
 	    rl->read->seq_num))
 		goto err;
 
 	if (!EVP_AEAD_CTX_open(&rl->read->aead_ctx,
-	    content, &out_len, content_len,
+	    out, &out_len, max_out_len,
 	    rl->read->nonce.data, rl->read->nonce.len,
 	    CBS_data(&enc_record), CBS_len(&enc_record),
 	    CBS_data(&header), CBS_len(&header)))
@@ -591,7 +1032,7 @@ tls13_record_layer_open_record_protected(struct tls13_record_layer *rl)
 	 */
 	/* XXX - CBS from end? CBS_get_end_u8()? */
 	inner_len = out_len - 1;
-	while (inner_len >= 0 && content[inner_len] == 0)
+	while (inner_len >= 0 && out[inner_len] == 0)
 		inner_len--;
 	if (inner_len < 0) {
 		/* Unexpected message per RFC 8446 section 5.4. */
@@ -602,20 +1043,44 @@ tls13_record_layer_open_record_protected(struct tls13_record_layer *rl)
 		rl->alert = TLS13_ALERT_RECORD_OVERFLOW;
 		goto err;
 	}
-	content_type = content[inner_len];
+	content_type = out[inner_len];
 
 	tls13_record_layer_rbuf_free(rl);
 
+	if (out == rl->rdirect) {
+		/* Do not leave the content type and padding behind. */
+		explicit_bzero(&out[inner_len], out_len - inner_len);
+
+		if (content_type == SSL3_RT_APPLICATION_DATA) {
+			rl->rbuf_content_type = content_type;
+			CBS_init(&rl->rbuf_cbs, out, inner_len);
+			return 1;
+		}
+
+		/*
+		 * Anything else is processed by the record layer, so it
+		 * must not remain in the caller's buffer.
+		 */
+		if ((content = tls13_record_layer_buf_get(rl,
+		    inner_len > 0 ? inner_len : 1, &content_len)) == NULL)
+			goto err;
+		memcpy(content, out, inner_len);
+		explicit_bzero(out, inner_len);
+	}
+
 	rl->rbuf_content_type = content_type;
 	rl->rbuf = content;
-	rl->rbuf_len = inner_len;
+	rl->rbuf_len = content_len;
 
-	CBS_init(&rl->rbuf_cbs, rl->rbuf, rl->rbuf_len);
+	CBS_init(&rl->rbuf_cbs, rl->rbuf, inner_len);
 
 	return 1;
 
  err:
-	freezero(content, content_len);
+	if (out != NULL && out == rl->rdirect)
+		explicit_bzero(out, CBS_len(&enc_record) -
+		    EVP_AEAD_max_overhead(rl->aead));
+	tls13_record_layer_buf_put(rl, content, content_len);
 
 	return 0;
 }
@@ -626,6 +1091,10 @@ tls13_record_layer_open_record(struct tls13_record_layer *rl)
 	if (rl->handshake_completed && rl->aead == NULL)
 		return 0;
 
+	/* The kernel has already opened the record. */
+	if (rl->read_ktls)
+		return tls13_record_layer_open_record_clear(rl);
+
 	if (rl->aead == NULL)
 		return tls13_record_layer_open_record_plaintext(rl);
 
@@ -633,28 +1102,17 @@ tls13_record_layer_open_record(struct tls13_record_layer *rl)
 }
 
 static int
-tls13_record_layer_seal_record_plaintext(struct tls13_record_layer *rl,
-    uint8_t content_type, const uint8_t *content, size_t content_len)
+tls13_record_layer_seal_record_clear(struct tls13_record_layer *rl,
+    uint8_t content_type, const struct iovec *content, int content_cnt,
+    size_t content_len)
 {
-	uint8_t *data = NULL;
-	size_t data_len = 0;
+	size_t data_len, len;
 	CBB cbb, body;
+	int i;
 
-	/*
-	 * Allow dummy CCS messages to be sent in plaintext even when
-	 * record protection has been engaged, as long as the handshake
-	 * has not yet completed.
-	 */
-	if (rl->handshake_completed)
-		return 0;
-	if (rl->aead != NULL && content_type != SSL3_RT_CHANGE_CIPHER_SPEC)
-		return 0;
+	memset(&cbb, 0, sizeof(cbb));
 
-	/*
-	 * We're still operating in plaintext mode, so just copy the
-	 * content into the record.
-	 */
-	if (!CBB_init(&cbb, TLS13_RECORD_HEADER_LEN + content_len))
+	if (!tls13_record_layer_wbuf_cbb(rl, &cbb))
 		goto err;
 
 	if (!CBB_add_u8(&cbb, content_type))
@@ -663,14 +1121,19 @@ tls13_record_layer_seal_record_plaintext(struct tls13_record_layer *rl,
 		goto err;
 	if (!CBB_add_u16_length_prefixed(&cbb, &body))
 		goto err;
-	if (!CBB_add_bytes(&body, content, content_len))
+	for (i = 0, len = 0; i < content_cnt; i++) {
+		if (!CBB_add_bytes(&body, content[i].iov_base,
+		    content[i].iov_len))
+			goto err;
+		len += content[i].iov_len;
+	}
+	if (len != content_len)
 		goto err;
 
-	if (!CBB_finish(&cbb, &data, &data_len))
+	if (!CBB_finish(&cbb, NULL, &data_len))
 		goto err;
 
-	if (!tls13_record_set_data(rl->wrec, data, data_len))
-		goto err;
+	CBS_init(&rl->wbuf_cbs, rl->wbuf, rl->wbuf_rec + data_len);
 
 	rl->wrec_content_len = content_len;
 	rl->wrec_content_type = content_type;
@@ -679,39 +1142,54 @@ tls13_record_layer_seal_record_plaintext(struct tls13_record_layer *rl,
 
  err:
 	CBB_cleanup(&cbb);
-	freezero(data, data_len);
 
 	return 0;
 }
 
+static int
+tls13_record_layer_seal_record_plaintext(struct tls13_record_layer *rl,
+    uint8_t content_type, const struct iovec *content, int content_cnt,
+    size_t content_len)
+{
+	/*
+	 * Allow dummy CCS messages to be sent in plaintext even when
+	 * record protection has been engaged, as long as the handshake
+	 * has not yet completed.
+	 */
+	if (rl->handshake_completed)
+		return 0;
+	if (rl->aead != NULL && content_type != SSL3_RT_CHANGE_CIPHER_SPEC)
+		return 0;
+
+	/*
+	 * We're still operating in plaintext mode, so just copy the
+	 * content into the record.
+	 */
+	return tls13_record_layer_seal_record_clear(rl, content_type,
+	    content, content_cnt, content_len);
+}
+
 static int
 tls13_record_layer_seal_record_protected(struct tls13_record_layer *rl,
-    uint8_t content_type, const uint8_t *content, size_t content_len)
+    uint8_t content_type, const struct iovec *content, int content_cnt,
+    size_t content_len)
 {
-	uint8_t *data = NULL, *header = NULL, *inner = NULL;
-	size_t data_len = 0, header_len = 0, inner_len = 0;
+	struct iovec header, inner[TLS13_RECORD_MAX_IOV + 1];
 	uint8_t *enc_record;
-	size_t enc_record_len;
-	ssize_t ret = 0;
+	size_t data_len, enc_record_len, inner_len;
 	size_t out_len;
 	CBB cbb;
+	int i;
 
 	if (rl->aead == NULL)
 		return 0;
+	if (content_cnt < 0 || content_cnt > TLS13_RECORD_MAX_IOV)
+		return 0;
 
 	memset(&cbb, 0, sizeof(cbb));
 
-	/* Build inner plaintext. */
-	if (!CBB_init(&cbb, content_len + 1))
-		goto err;
-	if (!CBB_add_bytes(&cbb, content, content_len))
-		goto err;
-	if (!CBB_add_u8(&cbb, content_type))
-		goto err;
 	/* XXX - padding? */
-	if (!CBB_finish(&cbb, &inner, &inner_len))
-		goto err;
-
+	inner_len = content_len + 1;
 	if (inner_len > TLS13_RECORD_MAX_INNER_PLAINTEXT_LEN)
 		goto err;
 
@@ -720,8 +1198,11 @@ tls13_record_layer_seal_record_protected(struct tls13_record_layer *rl,
 	if (enc_record_len > TLS13_RECORD_MAX_CIPHERTEXT_LEN)
 		goto err;
 
-	/* Build the record header. */
-	if (!CBB_init(&cbb, TLS13_RECORD_HEADER_LEN))
+	/*
+	 * Build the record header directly in the write buffer and encrypt
+	 * the inner plaintext into the space that follows it.
+	 */
+	if (!tls13_record_layer_wbuf_cbb(rl, &cbb))
 		goto err;
 	if (!CBB_add_u8(&cbb, SSL3_RT_APPLICATION_DATA))
 		goto err;
@@ -729,32 +1210,31 @@ tls13_record_layer_seal_record_protected(struct tls13_record_layer *rl,
 		goto err;
 	if (!CBB_add_u16(&cbb, enc_record_len))
 		goto err;
-	if (!CBB_finish(&cbb, &header, &header_len))
-		goto err;
-
-	/* Build the actual record. */
-	if (!CBB_init(&cbb, TLS13_RECORD_HEADER_LEN + enc_record_len))
-		goto err;
-	if (!CBB_add_bytes(&cbb, header, header_len))
-		goto err;
 	if (!CBB_add_space(&cbb, &enc_record, enc_record_len))
 		goto err;
-	if (!CBB_finish(&cbb, &data, &data_len))
+	if (!CBB_finish(&cbb, NULL, &data_len))
 		goto err;
 
+	header.iov_base = &rl->wbuf[rl->wbuf_rec];
+	header.iov_len = TLS13_RECORD_HEADER_LEN;
+
 	if (!tls13_record_layer_update_nonce(&rl->write->nonce,
 	    &rl->write->iv, rl->write->seq_num))
 		goto err;
 
 	/*
-	 * XXX - consider a EVP_AEAD_CTX_seal_iov() that takes an iovec...
-	 * this would avoid a copy since the inner would be passed as two
-	 * separate pieces.
+	 * The inner plaintext is the content followed by the content type,
+	 * which are passed as separate pieces to avoid a copy.
 	 */
-	if (!EVP_AEAD_CTX_seal(&rl->write->aead_ctx,
+	for (i = 0; i < content_cnt; i++)
+		inner[i] = content[i];
+	inner[i].iov_base = &content_type;
+	inner[i].iov_len = sizeof(content_type);
+
+	if (!EVP_AEAD_CTX_seal_iov(&rl->write->aead_ctx,
 	    enc_record, &out_len, enc_record_len,
 	    rl->write->nonce.data, rl->write->nonce.len,
-	    inner, inner_len, header, header_len))
+	    inner, content_cnt + 1, &header, 1))
 		goto err;
 
 	if (out_len != enc_record_len)
@@ -763,45 +1243,61 @@ tls13_record_layer_seal_record_protected(struct tls13_record_layer *rl,
 	if (!tls13_record_layer_inc_seq_num(rl->write->seq_num))
 		goto err;
 
-	if (!tls13_record_set_data(rl->wrec, data, data_len))
-		goto err;
+	CBS_init(&rl->wbuf_cbs, rl->wbuf, rl->wbuf_rec + data_len);
 
 	rl->wrec_content_len = content_len;
 	rl->wrec_content_type = content_type;
 
-	data = NULL;
-	data_len = 0;
-
-	ret = 1;
+	return 1;
 
  err:
 	CBB_cleanup(&cbb);
 
-	freezero(data, data_len);
-	freezero(header, header_len);
-	freezero(inner, inner_len);
-
-	return ret;
+	return 0;
 }
 
 static int
 tls13_record_layer_seal_record(struct tls13_record_layer *rl,
-    uint8_t content_type, const uint8_t *content, size_t content_len)
+    uint8_t content_type, const struct iovec *content, int content_cnt,
+    size_t content_len)
 {
 	if (rl->handshake_completed && rl->aead == NULL)
 		return 0;
 
-	tls13_record_layer_wrec_free(rl);
-
-	if ((rl->wrec = tls13_record_new()) == NULL)
-		return 0;
+	/* The kernel protects the record as it is sent. */
+	if (rl->write_ktls)
+		return tls13_record_layer_seal_record_clear(rl, content_type,
+		    content, content_cnt, content_len);
 
 	if (rl->aead == NULL || content_type == SSL3_RT_CHANGE_CIPHER_SPEC)
 		return tls13_record_layer_seal_record_plaintext(rl,
-		    content_type, content, content_len);
+		    content_type, content, content_cnt, content_len);
 
 	return tls13_record_layer_seal_record_protected(rl, content_type,
-	    content, content_len);
+	    content, content_cnt, content_len);
+}
+
+static ssize_t
+tls13_record_layer_skip_record(struct tls13_record_layer *rl)
+{
+	size_t content_len;
+	CBS cbs;
+
+	if (!tls13_record_content(rl->rrec, &cbs))
+		return TLS13_IO_FAILURE;
+
+	/* Do not count the inner content type or the AEAD tag. */
+	content_len = CBS_len(&cbs);
+	if (content_len > TLS13_RECORD_EARLY_DATA_OVERHEAD)
+		content_len -= TLS13_RECORD_EARLY_DATA_OVERHEAD;
+
+	if (content_len > rl->early_data_remaining)
+		return tls13_send_alert(rl, TLS13_ALERT_UNEXPECTED_MESSAGE);
+	rl->early_data_remaining -= content_len;
+
+	tls13_record_layer_rrec_free(rl);
+
+	return TLS13_IO_WANT_RETRY;
 }
 
 static ssize_t
@@ -811,8 +1307,13 @@ tls13_record_layer_read_record(struct tls13_record_layer *rl)
 	ssize_t ret;
 	CBS cbs;
 
+	/* The peer may be waiting for the rest of our flight. */
+	if ((ret = tls13_record_layer_flush_flight(rl)) != TLS13_IO_SUCCESS)
+		return ret;
+
 	if (rl->rrec == NULL) {
-		if ((rl->rrec = tls13_record_new()) == NULL)
+		if ((rl->rrec = tls13_record_new_pool(rl->cb.buf_get,
+		    rl->cb.buf_put, rl->cb_arg)) == NULL)
 			goto err;
 	}
 
@@ -862,13 +1363,32 @@ tls13_record_layer_read_record(struct tls13_record_layer *rl)
 	/*
 	 * Once record protection is engaged, we should only receive
 	 * protected application data messages (aside from the
-	 * dummy ChangeCipherSpec messages, handled above).
+	 * dummy ChangeCipherSpec messages, handled above). Records opened by
+	 * the kernel carry their real content type instead.
 	 */
-	if (rl->aead != NULL && content_type != SSL3_RT_APPLICATION_DATA)
+	if (rl->aead != NULL && !rl->read_ktls &&
+	    content_type != SSL3_RT_APPLICATION_DATA)
 		return tls13_send_alert(rl, TLS13_ALERT_UNEXPECTED_MESSAGE);
 
-	if (!tls13_record_layer_open_record(rl))
+	/*
+	 * If early data was rejected, the client may continue to send it
+	 * until it sees our response - it is either sent in the clear
+	 * content type of application data when no keys are in place
+	 * (following a HelloRetryRequest), or it fails to decrypt with the
+	 * handshake traffic key. Such records must be discarded, see
+	 * RFC 8446 section 4.2.10.
+	 */
+	if (rl->early_data_skip && rl->aead == NULL &&
+	    content_type == SSL3_RT_APPLICATION_DATA)
+		return tls13_record_layer_skip_record(rl);
+
+	if (!tls13_record_layer_open_record(rl)) {
+		if (rl->early_data_skip && rl->aead != NULL && rl->alert == 0)
+			return tls13_record_layer_skip_record(rl);
 		goto err;
+	}
+	rl->early_data_skip = 0;
+	rl->num_records_read++;
 
 	tls13_record_layer_rrec_free(rl);
 
@@ -890,8 +1410,15 @@ tls13_record_layer_read_record(struct tls13_record_layer *rl)
 		break;
 
 	case SSL3_RT_APPLICATION_DATA:
-		if (!rl->handshake_completed)
-			return tls13_send_alert(rl, TLS13_ALERT_UNEXPECTED_MESSAGE);
+		if (!rl->handshake_completed) {
+			if (!rl->early_data_accept)
+				return tls13_send_alert(rl,
+				    TLS13_ALERT_UNEXPECTED_MESSAGE);
+			if (CBS_len(&rl->rbuf_cbs) > rl->early_data_remaining)
+				return tls13_send_alert(rl,
+				    TLS13_ALERT_UNEXPECTED_MESSAGE);
+			rl->early_data_remaining -= CBS_len(&rl->rbuf_cbs);
+		}
 		break;
 
 	default:
@@ -961,7 +1488,27 @@ tls13_record_layer_read_internal(struct tls13_record_layer *rl,
 
 	/* If necessary, pull up the next record. */
 	if (CBS_len(&rl->rbuf_cbs) == 0) {
-		if ((ret = tls13_record_layer_read_record(rl)) <= 0)
+		/*
+		 * Application data may be opened straight into the caller's
+		 * buffer, saving a copy, if the record fits.
+		 */
+		if (content_type == SSL3_RT_APPLICATION_DATA && !peek &&
+		    !rl->phh && rl->handshake_completed) {
+			rl->rdirect = buf;
+			rl->rdirect_len = n;
+		}
+		ret = tls13_record_layer_read_record(rl);
+		rl->rdirect = NULL;
+		rl->rdirect_len = 0;
+
+		if (CBS_len(&rl->rbuf_cbs) > 0 && rl->rbuf == NULL) {
+			n = CBS_len(&rl->rbuf_cbs);
+			tls13_record_layer_rbuf_free(rl);
+			if (ret <= 0)
+				return ret;
+			return n;
+		}
+		if (ret <= 0)
 			return ret;
 
 		/*
@@ -992,6 +1539,13 @@ tls13_record_layer_read_internal(struct tls13_record_layer *rl,
 			if (rl->handshake_completed)
 				return tls13_record_layer_recv_phh(rl);
 		}
+		/*
+		 * Early data may be received while we are waiting for the
+		 * EndOfEarlyData message - let the caller consume it.
+		 */
+		if (rl->rbuf_content_type == SSL3_RT_APPLICATION_DATA &&
+		    content_type == SSL3_RT_HANDSHAKE && rl->early_data_accept)
+			return TLS13_IO_EARLY_DATA;
 		return tls13_send_alert(rl, TLS13_ALERT_UNEXPECTED_MESSAGE);
 	}
 
@@ -1049,13 +1603,21 @@ tls13_record_layer_read(struct tls13_record_layer *rl, uint8_t content_type,
 
 static ssize_t
 tls13_record_layer_write_record(struct tls13_record_layer *rl,
-    uint8_t content_type, const uint8_t *content, size_t content_len)
+    uint8_t content_type, const struct iovec *content, int content_cnt,
+    size_t content_len)
 {
 	ssize_t ret;
 
 	if (rl->write_closed)
 		return TLS13_IO_EOF;
 
+	/* Other records must not overtake those of the flight. */
+	if (rl->flight_flush || (rl->flight_len > 0 &&
+	    !tls13_record_layer_flight_record(rl, content_type))) {
+		if ((ret = tls13_record_layer_flush_flight(rl)) <= 0)
+			return ret;
+	}
+
 	/*
 	 * If we pushed out application data while handling other messages,
 	 * we need to return content length on the next call.
@@ -1068,11 +1630,9 @@ tls13_record_layer_write_record(struct tls13_record_layer *rl,
 	}
 
 	/* See if there is an existing record and attempt to push it out... */
-	if (rl->wrec != NULL) {
-		if ((ret = tls13_record_send(rl->wrec, rl->cb.wire_write,
-		    rl->cb_arg)) <= 0)
+	if (CBS_len(&rl->wbuf_cbs) > 0) {
+		if ((ret = tls13_record_layer_wbuf_send(rl)) <= 0)
 			return ret;
-		tls13_record_layer_wrec_free(rl);
 
 		if (rl->wrec_content_type == content_type) {
 			ret = rl->wrec_content_len;
@@ -1093,13 +1653,25 @@ tls13_record_layer_write_record(struct tls13_record_layer *rl,
 	if (content_len > TLS13_RECORD_MAX_PLAINTEXT_LEN)
 		goto err;
 
-	if (!tls13_record_layer_seal_record(rl, content_type, content, content_len))
+	if (!tls13_record_layer_seal_record(rl, content_type, content,
+	    content_cnt, content_len))
 		goto err;
+	rl->num_records_written++;
 
-	if ((ret = tls13_record_send(rl->wrec, rl->cb.wire_write, rl->cb_arg)) <= 0)
-		return ret;
+	/* Full sized records are in use after four doublings. */
+	if (content_type == SSL3_RT_APPLICATION_DATA &&
+	    rl->dynamic_len < 4 * TLS13_RECORD_DYNAMIC_RAMP_LEN)
+		rl->dynamic_len += content_len;
 
-	tls13_record_layer_wrec_free(rl);
+	if (CBS_len(&rl->wbuf_cbs) > 0 &&
+	    tls13_record_layer_flight_record(rl, content_type)) {
+		if (!tls13_record_layer_flight_add(rl))
+			goto err;
+		return content_len;
+	}
+
+	if ((ret = tls13_record_layer_wbuf_send(rl)) <= 0)
+		return ret;
 
 	return content_len;
 
@@ -1107,14 +1679,253 @@ tls13_record_layer_write_record(struct tls13_record_layer *rl,
 	return TLS13_IO_FAILURE;
 }
 
+/*
+ * Return the amount of content that a record of the given type is to carry.
+ * With dynamic record sizing, application data uses small records that grow
+ * as data is written, starting small again after the connection was idle.
+ */
+static size_t
+tls13_record_layer_write_len(struct tls13_record_layer *rl,
+    uint8_t content_type)
+{
+	size_t len, ramp;
+	time_t now;
+
+	if (content_type != SSL3_RT_APPLICATION_DATA || !rl->dynamic_records)
+		return TLS13_RECORD_MAX_PLAINTEXT_LEN;
+
+	now = time(NULL);
+	if (now - rl->dynamic_last > TLS13_RECORD_DYNAMIC_IDLE_SECS)
+		rl->dynamic_len = 0;
+	rl->dynamic_last = now;
+
+	len = TLS13_RECORD_DYNAMIC_PLAINTEXT_LEN;
+	for (ramp = TLS13_RECORD_DYNAMIC_RAMP_LEN; ramp <= rl->dynamic_len;
+	    ramp += TLS13_RECORD_DYNAMIC_RAMP_LEN) {
+		if ((len *= 2) >= TLS13_RECORD_MAX_PLAINTEXT_LEN)
+			return TLS13_RECORD_MAX_PLAINTEXT_LEN;
+	}
+
+	return len;
+}
+
 static ssize_t
 tls13_record_layer_write_chunk(struct tls13_record_layer *rl,
     uint8_t content_type, const uint8_t *buf, size_t n)
 {
-	if (n > TLS13_RECORD_MAX_PLAINTEXT_LEN)
-		n = TLS13_RECORD_MAX_PLAINTEXT_LEN;
+	struct iovec iov;
+	size_t max;
 
-	return tls13_record_layer_write_record(rl, content_type, buf, n);
+	if (n > (max = tls13_record_layer_write_len(rl, content_type)))
+		n = max;
+
+	iov.iov_base = (uint8_t *)buf;
+	iov.iov_len = n;
+
+	return tls13_record_layer_write_record(rl, content_type, &iov, 1, n);
+}
+
+/*
+ * Gather up to max bytes from the given vector, after skipping the first
+ * skip bytes, into the pieces of the content of a single record.
+ */
+static size_t
+tls13_record_layer_gather(const struct iovec *iov, int iovcnt, size_t skip,
+    size_t max, struct iovec *content, int *content_cnt)
+{
+	size_t len, n = 0;
+	int i, cnt = 0;
+
+	for (i = 0; i < iovcnt && cnt < TLS13_RECORD_MAX_IOV; i++) {
+		if (n == max)
+			break;
+		if ((len = iov[i].iov_len) <= skip) {
+			skip -= len;
+			continue;
+		}
+		len -= skip;
+		if (len > max - n)
+			len = max - n;
+		content[cnt].iov_base = (uint8_t *)iov[i].iov_base + skip;
+		content[cnt].iov_len = len;
+		skip = 0;
+		cnt++;
+		n += len;
+	}
+
+	*content_cnt = cnt;
+
+	return n;
+}
+
+/*
+ * Gather as much as will fit into a single record from the given vector and
+ * pass the pieces through to the seal, without coalescing them first.
+ */
+static ssize_t
+tls13_record_layer_write_chunk_iov(struct tls13_record_layer *rl,
+    uint8_t content_type, const struct iovec *iov, int iovcnt)
+{
+	struct iovec content[TLS13_RECORD_MAX_IOV];
+	size_t max, n;
+	int cnt;
+
+	max = tls13_record_layer_write_len(rl, content_type);
+	n = tls13_record_layer_gather(iov, iovcnt, 0, max, content, &cnt);
+
+	return tls13_record_layer_write_record(rl, content_type, content, cnt,
+	    n);
+}
+
+/*
+ * Seal a batch of full sized application data records from the given vector
+ * into the write buffer and write them out together, which saves a write
+ * for all but the first record. As with a single record, the content length
+ * of the batch is returned once it has been written out in full.
+ */
+static ssize_t
+tls13_record_layer_write_batch(struct tls13_record_layer *rl,
+    const struct iovec *iov, int iovcnt, size_t n)
+{
+	struct iovec content[TLS13_RECORD_MAX_IOV];
+	size_t len, total = 0;
+	ssize_t ret;
+	int cnt, i;
+
+	if (!tls13_record_layer_wbuf_batch(rl))
+		goto err;
+
+	for (i = 0; i < TLS13_RECORD_MAX_BATCH && total < n; i++) {
+		if ((len = tls13_record_layer_gather(iov, iovcnt, total,
+		    TLS13_RECORD_MAX_PLAINTEXT_LEN, content, &cnt)) == 0)
+			break;
+		if (!tls13_record_layer_seal_record(rl,
+		    SSL3_RT_APPLICATION_DATA, content, cnt, len))
+			goto err;
+		rl->wbuf_rec = CBS_len(&rl->wbuf_cbs);
+		rl->num_records_written++;
+		total += len;
+	}
+
+	rl->wrec_content_type = SSL3_RT_APPLICATION_DATA;
+	rl->wrec_content_len = total;
+
+	if ((ret = tls13_record_layer_wbuf_send(rl)) <= 0)
+		return ret;
+
+	return total;
+
+ err:
+	return TLS13_IO_FAILURE;
+}
+
+static ssize_t
+tls13_record_layer_flush(struct tls13_record_layer *rl)
+{
+	struct iovec iov;
+	ssize_t ret;
+
+	if (rl->wcoal_len == 0)
+		return TLS13_IO_SUCCESS;
+
+	rl->wcoal_flush = 1;
+
+	iov.iov_base = rl->wcoal;
+	iov.iov_len = rl->wcoal_len;
+
+	if ((ret = tls13_record_layer_write_record(rl, SSL3_RT_APPLICATION_DATA,
+	    &iov, 1, rl->wcoal_len)) <= 0)
+		return ret;
+	if (ret != rl->wcoal_len)
+		return TLS13_IO_FAILURE;
+
+	rl->wcoal_flush = 0;
+	rl->wcoal_len = 0;
+
+	if (rl->release_buffers) {
+		freezero(rl->wcoal, TLS13_RECORD_MAX_PLAINTEXT_LEN);
+		rl->wcoal = NULL;
+	}
+
+	return TLS13_IO_SUCCESS;
+}
+
+/*
+ * Write application data, coalescing small writes into a single record when
+ * enabled. Data that is coalesced is reported as written, although it is only
+ * sent once a record has been filled or the record layer is flushed.
+ */
+static ssize_t
+tls13_record_layer_write_appdata(struct tls13_record_layer *rl,
+    const struct iovec *iov, int iovcnt)
+{
+	size_t len, max, n = 0;
+	ssize_t ret;
+	int i;
+
+	max = tls13_record_layer_write_len(rl, SSL3_RT_APPLICATION_DATA);
+
+	/* Complete a flush that is in progress or of a filled record. */
+	if (rl->wcoal_flush || rl->wcoal_len >= max) {
+		if ((ret = tls13_record_layer_flush(rl)) != TLS13_IO_SUCCESS)
+			return ret;
+	}
+
+	/*
+	 * If a record is already pending, this is a retry of an earlier
+	 * write, which must be completed the same way. Otherwise writes
+	 * that fill a record by themselves do not need coalescing.
+	 */
+	for (i = 0; i < iovcnt; i++)
+		n += iov[i].iov_len;
+	if (CBS_len(&rl->wbuf_cbs) > 0 || rl->wrec_appdata_len != 0 ||
+	    (rl->wcoal_len == 0 && n >= max) || !rl->coalesce_writes) {
+		if ((ret = tls13_record_layer_flush(rl)) != TLS13_IO_SUCCESS)
+			return ret;
+
+		/*
+		 * Data for more than one full sized record is sealed as a
+		 * batch, unless a record is pending or other records are
+		 * to go first.
+		 */
+		if (max == TLS13_RECORD_MAX_PLAINTEXT_LEN &&
+		    n > TLS13_RECORD_MAX_PLAINTEXT_LEN &&
+		    CBS_len(&rl->wbuf_cbs) == 0 && rl->wrec_appdata_len == 0 &&
+		    rl->flight_len == 0 && !rl->flight_flush &&
+		    !rl->write_closed)
+			return tls13_record_layer_write_batch(rl, iov, iovcnt,
+			    n);
+
+		return tls13_record_layer_write_chunk_iov(rl,
+		    SSL3_RT_APPLICATION_DATA, iov, iovcnt);
+	}
+
+	if (rl->wcoal == NULL) {
+		if ((rl->wcoal = malloc(TLS13_RECORD_MAX_PLAINTEXT_LEN)) == NULL)
+			return TLS13_IO_FAILURE;
+	}
+
+	n = 0;
+	for (i = 0; i < iovcnt && rl->wcoal_len < max; i++) {
+		if ((len = iov[i].iov_len) > max - rl->wcoal_len)
+			len = max - rl->wcoal_len;
+		memcpy(&rl->wcoal[rl->wcoal_len], iov[i].iov_base, len);
+		rl->wcoal_len += len;
+		n += len;
+	}
+
+	/*
+	 * Push out a filled record - the data has already been accepted, so
+	 * only errors that leave the connection unusable are returned.
+	 */
+	if (rl->wcoal_len >= max) {
+		ret = tls13_record_layer_flush(rl);
+		if (ret == TLS13_IO_EOF || ret == TLS13_IO_ALERT ||
+		    ret == TLS13_IO_FAILURE)
+			return ret;
+	}
+
+	return n;
 }
 
 static ssize_t
@@ -1136,6 +1947,29 @@ tls13_record_layer_write(struct tls13_record_layer *rl, uint8_t content_type,
 	return ret;
 }
 
+static ssize_t
+tls13_record_layer_writev(struct tls13_record_layer *rl, uint8_t content_type,
+    const struct iovec *iov, int iovcnt)
+{
+	ssize_t ret;
+
+	do {
+		ret = tls13_record_layer_send_pending(rl);
+	} while (ret == TLS13_IO_WANT_RETRY);
+	if (ret != TLS13_IO_SUCCESS)
+		return ret;
+
+	do {
+		if (content_type == SSL3_RT_APPLICATION_DATA)
+			ret = tls13_record_layer_write_appdata(rl, iov, iovcnt);
+		else
+			ret = tls13_record_layer_write_chunk_iov(rl,
+			    content_type, iov, iovcnt);
+	} while (ret == TLS13_IO_WANT_RETRY);
+
+	return ret;
+}
+
 static const uint8_t tls13_dummy_ccs[] = { 0x01 };
 
 ssize_t
@@ -1180,18 +2014,47 @@ tls13_pending_application_data(struct tls13_record_layer *rl)
 ssize_t
 tls13_peek_application_data(struct tls13_record_layer *rl, uint8_t *buf, size_t n)
 {
+	ssize_t ret;
+
 	if (!rl->handshake_completed)
 		return TLS13_IO_FAILURE;
 
+	/* The peer may be waiting on coalesced data before it responds. */
+	if (!rl->write_closed) {
+		if ((ret = tls13_flush_application_data(rl)) != TLS13_IO_SUCCESS)
+			return ret;
+	}
+
 	return tls13_record_layer_peek(rl, SSL3_RT_APPLICATION_DATA, buf, n);
 }
 
 ssize_t
 tls13_read_application_data(struct tls13_record_layer *rl, uint8_t *buf, size_t n)
 {
+	ssize_t ret;
+
 	if (!rl->handshake_completed)
 		return TLS13_IO_FAILURE;
 
+	/* The peer may be waiting on coalesced data before it responds. */
+	if (!rl->write_closed) {
+		if ((ret = tls13_flush_application_data(rl)) != TLS13_IO_SUCCESS)
+			return ret;
+	}
+
+	return tls13_record_layer_read(rl, SSL3_RT_APPLICATION_DATA, buf, n);
+}
+
+ssize_t
+tls13_read_early_data(struct tls13_record_layer *rl, uint8_t *buf, size_t n)
+{
+	if (rl->handshake_completed || !rl->early_data_accept)
+		return TLS13_IO_FAILURE;
+
+	/* Only early data that has already been received may be read. */
+	if (tls13_record_layer_pending(rl, SSL3_RT_APPLICATION_DATA) == 0)
+		return TLS13_IO_FAILURE;
+
 	return tls13_record_layer_read(rl, SSL3_RT_APPLICATION_DATA, buf, n);
 }
 
@@ -1199,10 +2062,47 @@ ssize_t
 tls13_write_application_data(struct tls13_record_layer *rl, const uint8_t *buf,
     size_t n)
 {
+	struct iovec iov;
+
 	if (!rl->handshake_completed)
 		return TLS13_IO_FAILURE;
 
-	return tls13_record_layer_write(rl, SSL3_RT_APPLICATION_DATA, buf, n);
+	iov.iov_base = (uint8_t *)buf;
+	iov.iov_len = n;
+
+	return tls13_record_layer_writev(rl, SSL3_RT_APPLICATION_DATA, &iov, 1);
+}
+
+ssize_t
+tls13_write_application_data_iov(struct tls13_record_layer *rl,
+    const struct iovec *iov, int iovcnt)
+{
+	if (!rl->handshake_completed)
+		return TLS13_IO_FAILURE;
+
+	return tls13_record_layer_writev(rl, SSL3_RT_APPLICATION_DATA, iov,
+	    iovcnt);
+}
+
+ssize_t
+tls13_flush_application_data(struct tls13_record_layer *rl)
+{
+	ssize_t ret;
+
+	if (rl->wcoal_len == 0)
+		return TLS13_IO_SUCCESS;
+
+	do {
+		ret = tls13_record_layer_send_pending(rl);
+	} while (ret == TLS13_IO_WANT_RETRY);
+	if (ret != TLS13_IO_SUCCESS)
+		return ret;
+
+	do {
+		ret = tls13_record_layer_flush(rl);
+	} while (ret == TLS13_IO_WANT_RETRY);
+
+	return ret;
 }
 
 ssize_t
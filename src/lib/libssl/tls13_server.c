@@ -24,6 +24,8 @@
 #include "tls13_handshake.h"
 #include "tls13_internal.h"
 
+static int tls13_server_hello_build(struct tls13_ctx *ctx, CBB *cbb, int hrr);
+
 int
 tls13_server_init(struct tls13_ctx *ctx)
 {
@@ -44,6 +46,14 @@ tls13_server_init(struct tls13_ctx *ctx)
 
 	tls13_record_layer_set_legacy_version(ctx->rl, TLS1_VERSION);
 
+	/*
+	 * A client in middlebox compatibility mode sends a change cipher spec
+	 * before its second ClientHello, which may be the first message seen
+	 * following a stateless HelloRetryRequest.
+	 */
+	if (s->internal->options & SSL_OP_STATELESS_HRR)
+		tls13_record_layer_allow_ccs(ctx->rl, 1);
+
 	if (!tls1_transcript_init(s))
 		return 0;
 
@@ -118,6 +128,14 @@ tls13_client_hello_required_extensions(struct tls13_ctx *ctx)
 			return 0;
 	}
 
+	/*
+	 * If we got pre_shared_key, then psk_key_exchange_modes must also
+	 * be present.
+	 */
+	if (tlsext_extension_seen(s, TLSEXT_TYPE_pre_shared_key) &&
+	    !tlsext_extension_seen(s, TLSEXT_TYPE_psk_key_exchange_modes))
+		return 0;
+
 	/*
 	 * supported_groups and key_share must either both be present or
 	 * both be absent.
@@ -136,6 +154,533 @@ tls13_client_hello_required_extensions(struct tls13_ctx *ctx)
 
 static const uint8_t tls13_compression_null_only[] = { 0 };
 
+/*
+ * Compute the hash of the handshake transcript, less the given number of
+ * trailing bytes. This is used prior to the transcript hash being set up,
+ * in order to verify PSK binders against a truncated ClientHello.
+ */
+static int
+tls13_server_transcript_digest(struct tls13_ctx *ctx, const EVP_MD *md,
+    size_t truncate_len, uint8_t *out, size_t *out_len)
+{
+	const unsigned char *data;
+	unsigned int mdlen;
+	size_t len;
+
+	if (!tls1_transcript_data(ctx->ssl, &data, &len))
+		return 0;
+	if (truncate_len > len)
+		return 0;
+	if (!EVP_Digest(data, len - truncate_len, out, &mdlen, md, NULL))
+		return 0;
+
+	*out_len = mdlen;
+
+	return 1;
+}
+
+static int
+tls13_server_psk_binder_verify(struct tls13_ctx *ctx,
+    struct tls13_secrets *secrets)
+{
+	struct tls13_secret context = { .data = "", .len = 0 };
+	struct tls13_secret finished_key;
+	uint8_t transcript_hash[EVP_MAX_MD_SIZE];
+	size_t transcript_hash_len;
+	uint8_t binder[EVP_MAX_MD_SIZE];
+	uint8_t key[EVP_MAX_MD_SIZE];
+	unsigned int binder_len;
+	CBS cbs;
+
+	finished_key.data = key;
+	finished_key.len = EVP_MD_size(secrets->digest);
+
+	if (!tls13_hkdf_expand_label(&finished_key, secrets->digest,
+	    &secrets->binder_key, "finished", &context))
+		return 0;
+
+	if (!tls13_server_transcript_digest(ctx, secrets->digest,
+	    ctx->hs->tls13.psk_binders_len, transcript_hash,
+	    &transcript_hash_len))
+		return 0;
+
+	if (HMAC(secrets->digest, finished_key.data, finished_key.len,
+	    transcript_hash, transcript_hash_len, binder, &binder_len) == NULL)
+		return 0;
+
+	explicit_bzero(key, sizeof(key));
+
+	CBS_init(&cbs, ctx->hs->tls13.psk_binder,
+	    ctx->hs->tls13.psk_binder_len);
+
+	return CBS_mem_equal(&cbs, binder, binder_len);
+}
+
+/*
+ * Determine if the session recovered from a ticket can be resumed in this
+ * handshake. Returns -1 on fatal error, 0 if the session cannot be used and
+ * 1 if it can.
+ */
+static int
+tls13_server_psk_session_usable(struct tls13_ctx *ctx, SSL_SESSION *sess)
+{
+	const EVP_MD *md;
+	uint32_t ticket_age;
+	SSL *s = ctx->ssl;
+
+	if (sess->ssl_version != TLS1_3_VERSION)
+		return 0;
+
+	if (sess->sid_ctx_length != s->sid_ctx_length ||
+	    timingsafe_memcmp(sess->sid_ctx, s->sid_ctx,
+	    sess->sid_ctx_length) != 0)
+		return 0;
+
+	/* See ssl_get_prev_session(). */
+	if ((s->verify_mode & SSL_VERIFY_PEER) && s->sid_ctx_length == 0) {
+		SSLerror(s, SSL_R_SESSION_ID_CONTEXT_UNINITIALIZED);
+		return -1;
+	}
+
+	if (sess->cipher == NULL) {
+		if ((sess->cipher = ssl3_get_cipher_by_id(
+		    sess->cipher_id)) == NULL)
+			return 0;
+	}
+
+	/*
+	 * The ticket may be used with any cipher suite that has the same
+	 * hash - RFC 8446 section 4.2.11.
+	 */
+	if ((md = tls13_cipher_hash(sess->cipher)) == NULL)
+		return 0;
+	if (md != tls13_cipher_hash(ctx->hs->cipher))
+		return 0;
+	if (sess->master_key_length != EVP_MD_size(md))
+		return 0;
+
+	if (sess->timeout < (time(NULL) - sess->time)) {
+		s->session_ctx->internal->stats.sess_timeout++;
+		return 0;
+	}
+
+	/* Reject tickets that the client believes to have expired. */
+	ticket_age = ctx->hs->tls13.psk_obfuscated_age -
+	    sess->tlsext_tick_age_add;
+	if (ticket_age / 1000 > sess->timeout)
+		return 0;
+
+	return 1;
+}
+
+/*
+ * Attempt to resume a session using the pre-shared key offered by the
+ * client. Only tickets that we issued and psk_dhe_ke are supported - if the
+ * ticket cannot be used we simply fall back to a full handshake.
+ */
+static int
+tls13_client_hello_process_psk(struct tls13_ctx *ctx)
+{
+	struct tls13_secrets *secrets = NULL;
+	uint8_t transcript_hash[EVP_MAX_MD_SIZE];
+	struct tls13_secret context;
+	SSL_SESSION *sess = NULL;
+	int alert_desc = TLS13_ALERT_INTERNAL_ERROR;
+	SSL *s = ctx->ssl;
+	CBS ticket;
+	int ret = 0;
+
+	ctx->hs->tls13.psk_selected = 0;
+
+	if (!tlsext_extension_seen(s, TLSEXT_TYPE_pre_shared_key))
+		return 1;
+	if (!ctx->hs->tls13.psk_dhe_ke || ctx->hs->tls13.key_share == NULL)
+		return 1;
+	if (SSL_get_options(s) & SSL_OP_NO_TICKET)
+		return 1;
+
+	CBS_init(&ticket, ctx->hs->tls13.psk_identity,
+	    ctx->hs->tls13.psk_identity_len);
+
+	ret = tls1_decrypt_ticket(s, &ticket, &alert_desc, &sess);
+
+	/*
+	 * In TLSv1.3 tickets are issued via a NewSessionTicket message,
+	 * rather than being signalled by a session_ticket extension.
+	 */
+	s->internal->tlsext_ticket_expected = 0;
+
+	switch (ret) {
+	case TLS1_TICKET_DECRYPTED:
+		break;
+	case TLS1_TICKET_NOT_DECRYPTED:
+		return 1;
+	default:
+		ctx->alert = alert_desc;
+		return 0;
+	}
+
+	ret = 0;
+
+	switch (tls13_server_psk_session_usable(ctx, sess)) {
+	case 1:
+		break;
+	case 0:
+		ret = 1;
+		goto err;
+	default:
+		goto err;
+	}
+
+	if ((secrets = tls13_secrets_create(tls13_cipher_hash(sess->cipher),
+	    1)) == NULL)
+		goto err;
+
+	if (!tls13_server_transcript_digest(ctx, secrets->digest, 0,
+	    transcript_hash, &context.len))
+		goto err;
+	context.data = transcript_hash;
+
+	if (!tls13_derive_early_secrets(secrets, sess->master_key,
+	    sess->master_key_length, &context))
+		goto err;
+
+	if (!tls13_server_psk_binder_verify(ctx, secrets)) {
+		ctx->alert = TLS13_ALERT_DECRYPT_ERROR;
+		goto err;
+	}
+
+	tls13_secrets_destroy(ctx->hs->tls13.secrets);
+	ctx->hs->tls13.secrets = secrets;
+	secrets = NULL;
+
+	s->session_ctx->internal->stats.sess_hit++;
+
+	SSL_SESSION_free(s->session);
+	s->session = sess;
+	sess = NULL;
+
+	s->verify_result = s->session->verify_result;
+	s->internal->hit = 1;
+
+	ctx->hs->tls13.psk_selected = 1;
+
+	ret = 1;
+
+ err:
+	tls13_secrets_destroy(secrets);
+	SSL_SESSION_free(sess);
+
+	return ret;
+}
+
+/*
+ * Determine if the early data offered by the client can be accepted - see
+ * RFC 8446 sections 4.2.10 and 8.
+ */
+static int
+tls13_server_early_data_acceptable(struct tls13_ctx *ctx)
+{
+	struct tls13_anti_replay *ar;
+	SSL *s = ctx->ssl;
+	SSL_SESSION *sess = s->session;
+	int64_t ticket_age, expected_age;
+	time_t now;
+	int fresh;
+
+	/* The application must be prepared to read early data. */
+	if (!ctx->read_early_data)
+		return 0;
+
+	if (!ctx->hs->tls13.psk_selected)
+		return 0;
+	if (s->internal->max_early_data == 0 || sess->max_early_data == 0)
+		return 0;
+
+	/* The ticket must have been issued with the same parameters. */
+	if (sess->cipher == NULL || sess->cipher->id != ctx->hs->cipher->id)
+		return 0;
+	if (sess->alpn_selected_len != S3I(s)->alpn_selected_len)
+		return 0;
+	if (sess->alpn_selected_len > 0 && memcmp(sess->alpn_selected,
+	    S3I(s)->alpn_selected, sess->alpn_selected_len) != 0)
+		return 0;
+
+	/*
+	 * The age of the ticket, as reported by the client, must be close to
+	 * the time since we issued it - this limits the period over which a
+	 * ClientHello can be replayed.
+	 */
+	now = time(NULL);
+	if (now < sess->time)
+		return 0;
+	ticket_age = (uint32_t)(ctx->hs->tls13.psk_obfuscated_age -
+	    sess->tlsext_tick_age_add);
+	expected_age = (int64_t)(now - sess->time) * 1000;
+	if (ticket_age > expected_age + TLS13_EARLY_DATA_AGE_WINDOW * 1000 ||
+	    ticket_age < expected_age - TLS13_EARLY_DATA_AGE_WINDOW * 1000)
+		return 0;
+
+	/*
+	 * Within that period, reject any ClientHello that we have already
+	 * seen. The anti-replay state is shared by all connections that use
+	 * the same session context.
+	 */
+	CRYPTO_w_lock(CRYPTO_LOCK_SSL_CTX);
+	if ((ar = s->session_ctx->internal->anti_replay) == NULL) {
+		ar = tls13_anti_replay_new(2 * TLS13_EARLY_DATA_AGE_WINDOW + 1);
+		s->session_ctx->internal->anti_replay = ar;
+	}
+	fresh = ar != NULL && tls13_anti_replay_check(ar,
+	    ctx->hs->tls13.psk_binder, ctx->hs->tls13.psk_binder_len, now);
+	CRYPTO_w_unlock(CRYPTO_LOCK_SSL_CTX);
+
+	return fresh;
+}
+
+/*
+ * Decide whether to accept or reject early data offered by the client. If it
+ * is rejected, the early data records are skipped, up to the amount that the
+ * client could legitimately have sent.
+ */
+static void
+tls13_client_hello_process_early_data(struct tls13_ctx *ctx)
+{
+	size_t max_early_data;
+	SSL *s = ctx->ssl;
+
+	if (ctx->hs->tls13.early_data_status != SSL_EARLY_DATA_REJECTED)
+		return;
+
+	/* Early data cannot be accepted if a HelloRetryRequest is needed. */
+	if (ctx->hs->tls13.key_share != NULL &&
+	    tls13_server_early_data_acceptable(ctx)) {
+		ctx->hs->tls13.early_data_status = SSL_EARLY_DATA_ACCEPTED;
+		tls13_record_layer_accept_early_data(ctx->rl,
+		    s->session->max_early_data);
+		return;
+	}
+
+	max_early_data = SSL3_RT_MAX_PLAIN_LENGTH;
+	if (s->internal->max_early_data > max_early_data)
+		max_early_data = s->internal->max_early_data;
+	if (s->session->max_early_data > max_early_data)
+		max_early_data = s->session->max_early_data;
+
+	tls13_record_layer_skip_early_data(ctx->rl, max_early_data);
+}
+
+static int
+tls13_server_stateless_hrr(struct tls13_ctx *ctx)
+{
+	return (ctx->ssl->internal->options & SSL_OP_STATELESS_HRR) != 0;
+}
+
+/*
+ * A stateless HelloRetryRequest cookie holds the time it was issued, the
+ * selected cipher suite and group and the hash of the first ClientHello,
+ * sealed with a key held by the SSL_CTX and prefixed with the nonce.
+ */
+#define TLS13_HRR_COOKIE_NONCE_LEN	12
+#define TLS13_HRR_COOKIE_LIFETIME	60
+
+static int
+tls13_server_hrr_cookie_seal(struct tls13_ctx *ctx)
+{
+	const EVP_AEAD_CTX *aead_ctx;
+	uint8_t hash[EVP_MAX_MD_SIZE];
+	const EVP_MD *md;
+	uint8_t *plain = NULL, *cookie = NULL;
+	size_t plain_len = 0, cookie_len, hash_len, out_len;
+	CBB cbb, ch_hash;
+	SSL *s = ctx->ssl;
+	int ret = 0;
+
+	aead_ctx = ssl_ctx_cookie_aead_ctx(s->ctx);
+
+	memset(&cbb, 0, sizeof(cbb));
+
+	if ((md = tls13_cipher_hash(ctx->hs->cipher)) == NULL)
+		goto err;
+	if (!tls13_server_transcript_digest(ctx, md, 0, hash, &hash_len))
+		goto err;
+
+	if (!CBB_init(&cbb, 0))
+		goto err;
+	if (!CBB_add_u32(&cbb, (uint32_t)time(NULL)))
+		goto err;
+	if (!CBB_add_u16(&cbb, SSL_CIPHER_get_value(ctx->hs->cipher)))
+		goto err;
+	if (!CBB_add_u16(&cbb, ctx->hs->tls13.server_group))
+		goto err;
+	if (!CBB_add_u8_length_prefixed(&cbb, &ch_hash))
+		goto err;
+	if (!CBB_add_bytes(&ch_hash, hash, hash_len))
+		goto err;
+	if (!CBB_finish(&cbb, &plain, &plain_len))
+		goto err;
+
+	cookie_len = TLS13_HRR_COOKIE_NONCE_LEN + plain_len +
+	    EVP_AEAD_max_overhead(aead_ctx->aead);
+	if ((cookie = malloc(cookie_len)) == NULL)
+		goto err;
+	arc4random_buf(cookie, TLS13_HRR_COOKIE_NONCE_LEN);
+
+	if (!EVP_AEAD_CTX_seal(aead_ctx, cookie + TLS13_HRR_COOKIE_NONCE_LEN,
+	    &out_len, cookie_len - TLS13_HRR_COOKIE_NONCE_LEN, cookie,
+	    TLS13_HRR_COOKIE_NONCE_LEN, plain, plain_len, NULL, 0))
+		goto err;
+
+	free(ctx->hs->tls13.cookie);
+	ctx->hs->tls13.cookie = cookie;
+	ctx->hs->tls13.cookie_len = TLS13_HRR_COOKIE_NONCE_LEN + out_len;
+	cookie = NULL;
+
+	ret = 1;
+
+ err:
+	CBB_cleanup(&cbb);
+	freezero(plain, plain_len);
+	free(cookie);
+	explicit_bzero(hash, sizeof(hash));
+
+	return ret;
+}
+
+static int
+tls13_server_hrr_cookie_open(struct tls13_ctx *ctx, uint16_t *cipher,
+    uint16_t *group, uint8_t *hash, size_t hash_size, size_t *hash_len)
+{
+	const EVP_AEAD_CTX *aead_ctx;
+	uint8_t *plain = NULL;
+	size_t plain_len = 0;
+	uint32_t issued, now;
+	CBS cbs, ch_hash;
+	SSL *s = ctx->ssl;
+	int ret = 0;
+
+	aead_ctx = ssl_ctx_cookie_aead_ctx(s->ctx);
+
+	if (ctx->hs->tls13.cookie_len <= TLS13_HRR_COOKIE_NONCE_LEN)
+		goto err;
+	plain_len = ctx->hs->tls13.cookie_len - TLS13_HRR_COOKIE_NONCE_LEN;
+	if ((plain = malloc(plain_len)) == NULL) {
+		ctx->alert = TLS13_ALERT_INTERNAL_ERROR;
+		goto err;
+	}
+
+	if (!EVP_AEAD_CTX_open(aead_ctx, plain, &plain_len, plain_len,
+	    ctx->hs->tls13.cookie, TLS13_HRR_COOKIE_NONCE_LEN,
+	    ctx->hs->tls13.cookie + TLS13_HRR_COOKIE_NONCE_LEN,
+	    ctx->hs->tls13.cookie_len - TLS13_HRR_COOKIE_NONCE_LEN, NULL, 0))
+		goto err;
+
+	CBS_init(&cbs, plain, plain_len);
+	if (!CBS_get_u32(&cbs, &issued))
+		goto err;
+	if (!CBS_get_u16(&cbs, cipher))
+		goto err;
+	if (!CBS_get_u16(&cbs, group))
+		goto err;
+	if (!CBS_get_u8_length_prefixed(&cbs, &ch_hash))
+		goto err;
+	if (CBS_len(&cbs) != 0)
+		goto err;
+	if (!CBS_write_bytes(&ch_hash, hash, hash_size, hash_len))
+		goto err;
+
+	now = (uint32_t)time(NULL);
+	if (now - issued > TLS13_HRR_COOKIE_LIFETIME)
+		goto err;
+
+	ret = 1;
+
+ err:
+	freezero(plain, plain_len);
+
+	return ret;
+}
+
+/*
+ * Recreate the transcript of a stateless HelloRetryRequest from its cookie:
+ * the synthetic message that replaces the first ClientHello, the
+ * HelloRetryRequest itself and this ClientHello - RFC 8446 section 4.4.1.
+ */
+static int
+tls13_client_hello_restore_hrr(struct tls13_ctx *ctx)
+{
+	struct tls13_handshake_msg *hm = NULL;
+	uint8_t hash[EVP_MAX_MD_SIZE];
+	uint16_t cipher, group;
+	size_t hash_len;
+	CBB cbb;
+	CBS cbs;
+	SSL *s = ctx->ssl;
+	int ret = 0;
+
+	if (!tls13_server_hrr_cookie_open(ctx, &cipher, &group, hash,
+	    sizeof(hash), &hash_len)) {
+		if (ctx->alert == 0)
+			ctx->alert = TLS13_ALERT_ILLEGAL_PARAMETER;
+		goto err;
+	}
+
+	/* The second ClientHello must be acceptable without another retry. */
+	if (cipher != SSL_CIPHER_get_value(ctx->hs->cipher) ||
+	    ctx->hs->tls13.key_share == NULL ||
+	    tls13_key_share_group(ctx->hs->tls13.key_share) != group ||
+	    ctx->hs->tls13.early_data_status != SSL_EARLY_DATA_NOT_SENT) {
+		ctx->alert = TLS13_ALERT_ILLEGAL_PARAMETER;
+		goto err;
+	}
+
+	tls1_transcript_reset(s);
+	tls1_transcript_hash_free(s);
+
+	if ((hm = tls13_handshake_msg_new()) == NULL)
+		goto err;
+	if (!tls13_handshake_msg_start(hm, &cbb, TLS13_MT_MESSAGE_HASH))
+		goto err;
+	if (!CBB_add_bytes(&cbb, hash, hash_len))
+		goto err;
+	if (!tls13_handshake_msg_finish(hm))
+		goto err;
+	tls13_handshake_msg_data(hm, &cbs);
+	if (!tls1_transcript_record(s, CBS_data(&cbs), CBS_len(&cbs)))
+		goto err;
+	tls13_handshake_msg_free(hm);
+
+	/* The HelloRetryRequest is rebuilt as it was sent, with the cookie. */
+	ctx->hs->tls13.server_group = group;
+	if ((hm = tls13_handshake_msg_new()) == NULL)
+		goto err;
+	if (!tls13_handshake_msg_start(hm, &cbb, TLS13_MT_SERVER_HELLO))
+		goto err;
+	if (!tls13_server_hello_build(ctx, &cbb, 1))
+		goto err;
+	if (!tls13_handshake_msg_finish(hm))
+		goto err;
+	tls13_handshake_msg_data(hm, &cbs);
+	if (!tls1_transcript_record(s, CBS_data(&cbs), CBS_len(&cbs)))
+		goto err;
+	ctx->hs->tls13.server_group = 0;
+
+	if (!tls13_handshake_msg_record(ctx))
+		goto err;
+
+	ctx->hs->tls13.hrr_restored = 1;
+
+	ret = 1;
+
+ err:
+	if (!ret && ctx->alert == 0)
+		ctx->alert = TLS13_ALERT_INTERNAL_ERROR;
+	tls13_handshake_msg_free(hm);
+	explicit_bzero(hash, sizeof(hash));
+
+	return ret;
+}
+
 static int
 tls13_client_hello_process(struct tls13_ctx *ctx, CBS *cbs)
 {
@@ -200,8 +745,14 @@ tls13_client_hello_process(struct tls13_ctx *ctx, CBS *cbs)
 		goto err;
 	}
 
-	/* Finalize first ClientHello hash, or validate against it */
-	if (!ctx->hs->tls13.hrr) {
+	/*
+	 * Finalize first ClientHello hash, or validate against it. Following a
+	 * stateless HelloRetryRequest the first ClientHello is not known.
+	 */
+	if (tls13_server_stateless_hrr(ctx) &&
+	    (ctx->hs->tls13.hrr || ctx->hs->tls13.cookie != NULL)) {
+		tls13_clienthello_hash_clear(&ctx->hs->tls13);
+	} else if (!ctx->hs->tls13.hrr) {
 		if (!tls13_clienthello_hash_finalize(ctx)) {
 			ctx->alert = TLS13_ALERT_INTERNAL_ERROR;
 			goto err;
@@ -254,6 +805,24 @@ tls13_client_hello_process(struct tls13_ctx *ctx, CBS *cbs)
 	}
 	ctx->hs->cipher = cipher;
 
+	/* The PSK binder covers the transcript restored from the cookie. */
+	if (tls13_server_stateless_hrr(ctx) &&
+	    (ctx->hs->tls13.hrr || ctx->hs->tls13.cookie != NULL)) {
+		if (ctx->hs->tls13.cookie == NULL) {
+			ctx->alert = TLS13_ALERT_MISSING_EXTENSION;
+			goto err;
+		}
+		if (!tls13_client_hello_restore_hrr(ctx))
+			goto err;
+	}
+
+	/* This may replace the current session with a resumed one. */
+	if (!tls13_client_hello_process_psk(ctx)) {
+		if (ctx->alert == 0)
+			ctx->alert = TLS13_ALERT_INTERNAL_ERROR;
+		goto err;
+	}
+
 	sk_SSL_CIPHER_free(s->session->ciphers);
 	s->session->ciphers = ciphers;
 	ciphers = NULL;
@@ -285,6 +854,8 @@ tls13_client_hello_recv(struct tls13_ctx *ctx, CBS *cbs)
 	if (s->method->version < TLS1_3_VERSION)
 		return 1;
 
+	tls13_client_hello_process_early_data(ctx);
+
 	/*
 	 * If a matching key share was provided, we do not need to send a
 	 * HelloRetryRequest.
@@ -370,9 +941,12 @@ tls13_server_engage_record_protection(struct tls13_ctx *ctx)
 	if ((ctx->hash = tls13_cipher_hash(ctx->hs->cipher)) == NULL)
 		goto err;
 
-	if ((secrets = tls13_secrets_create(ctx->hash, 0)) == NULL)
-		goto err;
-	ctx->hs->tls13.secrets = secrets;
+	/* If resuming, the secrets were set up when the PSK was verified. */
+	if ((secrets = ctx->hs->tls13.secrets) == NULL) {
+		if ((secrets = tls13_secrets_create(ctx->hash, 0)) == NULL)
+			goto err;
+		ctx->hs->tls13.secrets = secrets;
+	}
 
 	/* XXX - pass in hash. */
 	if (!tls1_transcript_hash_init(s))
@@ -384,9 +958,11 @@ tls13_server_engage_record_protection(struct tls13_ctx *ctx)
 	context.len = hash_len;
 
 	/* Early secrets. */
-	if (!tls13_derive_early_secrets(secrets, secrets->zeros.data,
-	    secrets->zeros.len, &context))
-		goto err;
+	if (!secrets->early_done) {
+		if (!tls13_derive_early_secrets(secrets, secrets->zeros.data,
+		    secrets->zeros.len, &context))
+			goto err;
+	}
 
 	/* Handshake secrets. */
 	if (!tls13_derive_handshake_secrets(ctx->hs->tls13.secrets, shared_key,
@@ -396,16 +972,30 @@ tls13_server_engage_record_protection(struct tls13_ctx *ctx)
 	tls13_record_layer_set_aead(ctx->rl, ctx->aead);
 	tls13_record_layer_set_hash(ctx->rl, ctx->hash);
 
-	if (!tls13_record_layer_set_read_traffic_key(ctx->rl,
-	    &secrets->client_handshake_traffic))
-		goto err;
+	/*
+	 * If early data was accepted, it is read with the early traffic key
+	 * until the client sends its EndOfEarlyData message.
+	 */
+	if (ctx->hs->tls13.early_data_status == SSL_EARLY_DATA_ACCEPTED) {
+		if (!tls13_record_layer_set_read_traffic_key(ctx->rl,
+		    &secrets->client_early_traffic))
+			goto err;
+	} else {
+		if (!tls13_record_layer_set_read_traffic_key(ctx->rl,
+		    &secrets->client_handshake_traffic))
+			goto err;
+	}
 	if (!tls13_record_layer_set_write_traffic_key(ctx->rl,
 	    &secrets->server_handshake_traffic))
 		goto err;
 
 	ctx->handshake_stage.hs_type |= NEGOTIATED;
-	if (!(SSL_get_verify_mode(s) & SSL_VERIFY_PEER))
+	if (ctx->hs->tls13.psk_selected)
+		ctx->handshake_stage.hs_type |= WITH_PSK;
+	else if (!(SSL_get_verify_mode(s) & SSL_VERIFY_PEER))
 		ctx->handshake_stage.hs_type |= WITHOUT_CR;
+	if (ctx->hs->tls13.early_data_status == SSL_EARLY_DATA_ACCEPTED)
+		ctx->handshake_stage.hs_type |= WITH_0RTT;
 
 	ret = 1;
 
@@ -420,9 +1010,7 @@ tls13_server_hello_retry_request_send(struct tls13_ctx *ctx, CBB *cbb)
 	int nid;
 
 	ctx->hs->tls13.hrr = 1;
-
-	if (!tls13_synthetic_handshake_message(ctx))
-		return 0;
+	ssl_stats_hello_retry_request(ctx->ssl);
 
 	if (ctx->hs->tls13.key_share != NULL)
 		return 0;
@@ -431,6 +1019,14 @@ tls13_server_hello_retry_request_send(struct tls13_ctx *ctx, CBB *cbb)
 	if ((ctx->hs->tls13.server_group = tls1_ec_nid2curve_id(nid)) == 0)
 		return 0;
 
+	if (tls13_server_stateless_hrr(ctx)) {
+		if (!tls13_server_hrr_cookie_seal(ctx))
+			return 0;
+	}
+
+	if (!tls13_synthetic_handshake_message(ctx))
+		return 0;
+
 	if (!tls13_server_hello_build(ctx, cbb, 1))
 		return 0;
 
@@ -448,6 +1044,19 @@ tls13_server_hello_retry_request_sent(struct tls13_ctx *ctx)
 	if (ctx->hs->tls13.legacy_session_id_len > 0)
 		ctx->send_dummy_ccs_after = 1;
 
+	/*
+	 * Everything needed to continue is in the cookie, which the client
+	 * must return - the second ClientHello may even reach another SSL.
+	 */
+	if (tls13_server_stateless_hrr(ctx)) {
+		tls1_transcript_reset(ctx->ssl);
+		tls1_transcript_hash_free(ctx->ssl);
+		tls13_clienthello_hash_clear(&ctx->hs->tls13);
+		free(ctx->hs->tls13.cookie);
+		ctx->hs->tls13.cookie = NULL;
+		ctx->hs->tls13.cookie_len = 0;
+	}
+
 	return 1;
 }
 
@@ -486,7 +1095,8 @@ tls13_server_hello_send(struct tls13_ctx *ctx, CBB *cbb)
 {
 	if (ctx->hs->tls13.key_share == NULL)
 		return 0;
-	if (!tls13_key_share_generate(ctx->hs->tls13.key_share))
+	if (!tls13_key_share_generate_pooled(ctx->hs->tls13.key_share,
+	    ctx->ssl->ctx->internal->key_share_pool))
 		return 0;
 	if (!tls13_servername_process(ctx))
 		return 0;
@@ -508,6 +1118,7 @@ tls13_server_hello_sent(struct tls13_ctx *ctx)
 	 * See RFC 8446 Appendix D.4.
 	 */
 	if ((ctx->handshake_stage.hs_type & WITHOUT_HRR) &&
+	    !ctx->hs->tls13.hrr_restored &&
 	    ctx->hs->tls13.legacy_session_id_len > 0)
 		ctx->send_dummy_ccs_after = 1;
 
@@ -611,32 +1222,18 @@ tls13_server_select_certificate(struct tls13_ctx *ctx, CERT_PKEY **out_cpk,
 	return 1;
 }
 
-int
-tls13_server_certificate_send(struct tls13_ctx *ctx, CBB *cbb)
+static int
+tls13_server_certificate_build(struct tls13_ctx *ctx, CERT_PKEY *cpk,
+    CBB *cbb)
 {
 	SSL *s = ctx->ssl;
 	CBB cert_request_context, cert_list;
-	const struct ssl_sigalg *sigalg;
 	X509_STORE_CTX *xsc = NULL;
 	STACK_OF(X509) *chain;
-	CERT_PKEY *cpk;
+	CBS leaf_cbs, chain_cbs;
 	X509 *cert;
 	int i, ret = 0;
 
-	if (!tls13_server_select_certificate(ctx, &cpk, &sigalg))
-		goto err;
-
-	if (cpk == NULL) {
-		/* A server must always provide a certificate. */
-		ctx->alert = TLS13_ALERT_HANDSHAKE_FAILURE;
-		tls13_set_errorx(ctx, TLS13_ERR_NO_CERTIFICATE, 0,
-		    "no server certificate", NULL);
-		goto err;
-	}
-
-	ctx->hs->tls13.cpk = cpk;
-	ctx->hs->our_sigalg = sigalg;
-
 	if ((chain = cpk->chain) == NULL)
 		chain = s->ctx->extra_certs;
 
@@ -657,6 +1254,24 @@ tls13_server_certificate_send(struct tls13_ctx *ctx, CBB *cbb)
 	if (!CBB_add_u24_length_prefixed(cbb, &cert_list))
 		goto err;
 
+	/*
+	 * A certificate with its own chain has a prebuilt encoding, only the
+	 * extensions of the leaf are built for each handshake.
+	 */
+	if (cpk->chain != NULL) {
+		if (!ssl_cert_pkey_cert_list(cpk, 1, &leaf_cbs, &chain_cbs))
+			goto err;
+		if (!CBB_add_bytes(&cert_list, CBS_data(&leaf_cbs),
+		    CBS_len(&leaf_cbs)))
+			goto err;
+		if (!tlsext_server_build(s, SSL_TLSEXT_MSG_CT, &cert_list))
+			goto err;
+		if (!CBB_add_bytes(&cert_list, CBS_data(&chain_cbs),
+		    CBS_len(&chain_cbs)))
+			goto err;
+		goto done;
+	}
+
 	if (!tls13_cert_add(ctx, &cert_list, cpk->x509, tlsext_server_build))
 		goto err;
 
@@ -680,6 +1295,7 @@ tls13_server_certificate_send(struct tls13_ctx *ctx, CBB *cbb)
 			goto err;
 	}
 
+ done:
 	if (!CBB_flush(cbb))
 		goto err;
 
@@ -691,17 +1307,107 @@ tls13_server_certificate_send(struct tls13_ctx *ctx, CBB *cbb)
 	return ret;
 }
 
+/*
+ * Build a CompressedCertificate message. Without leaf extensions the message
+ * for a certificate with its own chain is the same for every handshake and
+ * the compressed form is kept with the certificate.
+ */
+static int
+tls13_server_certificate_compress(struct tls13_ctx *ctx, CERT_PKEY *cpk,
+    uint16_t alg, CBB *cbb)
+{
+	SSL *s = ctx->ssl;
+	CBB cert, cert_exts;
+	uint8_t *data = NULL;
+	size_t data_len;
+	int no_exts;
+	int ret = 0;
+
+	memset(&cert, 0, sizeof(cert));
+	memset(&cert_exts, 0, sizeof(cert_exts));
+
+	if (cpk->chain != NULL) {
+		if (!CBB_init(&cert_exts, 0))
+			goto err;
+		if (!tlsext_server_build(s, SSL_TLSEXT_MSG_CT, &cert_exts))
+			goto err;
+		no_exts = (CBB_len(&cert_exts) == 2);
+		CBB_cleanup(&cert_exts);
+		if (no_exts)
+			return tls13_cert_comp_add_cached(cpk, alg, cbb);
+	}
+
+	if (!CBB_init(&cert, 0))
+		goto err;
+	if (!tls13_server_certificate_build(ctx, cpk, &cert))
+		goto err;
+	if (!CBB_finish(&cert, &data, &data_len))
+		goto err;
+	if (!tls13_cert_comp_add_compressed(alg, data, data_len, cbb))
+		goto err;
+
+	ret = 1;
+
+ err:
+	CBB_cleanup(&cert);
+	CBB_cleanup(&cert_exts);
+	free(data);
+
+	return ret;
+}
+
+int
+tls13_server_certificate_send(struct tls13_ctx *ctx, CBB *cbb)
+{
+	const struct ssl_sigalg *sigalg;
+	SSL *s = ctx->ssl;
+	CERT_PKEY *cpk;
+	int idx;
+
+	if (!tls13_server_select_certificate(ctx, &cpk, &sigalg))
+		return 0;
+
+	if (cpk == NULL) {
+		/* A server must always provide a certificate. */
+		ctx->alert = TLS13_ALERT_HANDSHAKE_FAILURE;
+		tls13_set_errorx(ctx, TLS13_ERR_NO_CERTIFICATE, 0,
+		    "no server certificate", NULL);
+		return 0;
+	}
+
+	/*
+	 * Make the selected certificate the current one, so that the status
+	 * callback staples the OCSP response for the certificate being sent.
+	 */
+	if (s->cert->key != cpk) {
+		idx = cpk - s->cert->pkeys;
+		if (!ssl_cert_unshare(&s->cert))
+			return 0;
+		cpk = &s->cert->pkeys[idx];
+		s->cert->key = cpk;
+	}
+
+	ctx->hs->tls13.cpk = cpk;
+	ctx->hs->our_sigalg = sigalg;
+
+	if (ctx->hs->tls13.cert_comp_alg != 0)
+		return tls13_server_certificate_compress(ctx, cpk,
+		    ctx->hs->tls13.cert_comp_alg, cbb);
+
+	return tls13_server_certificate_build(ctx, cpk, cbb);
+}
+
 int
 tls13_server_certificate_verify_send(struct tls13_ctx *ctx, CBB *cbb)
 {
 	const struct ssl_sigalg *sigalg;
-	uint8_t *sig = NULL, *sig_content = NULL;
+	uint8_t sig_content_buf[TLS13_CERT_VERIFY_CONTENT_MAX];
+	uint8_t *sig = NULL, *sig_content;
 	size_t sig_len, sig_content_len;
-	EVP_MD_CTX *mdctx = NULL;
-	EVP_PKEY_CTX *pctx;
 	EVP_PKEY *pkey;
 	const CERT_PKEY *cpk;
 	CBB sig_cbb;
+	int sign_ret;
 	int ret = 0;
 
 	memset(&sig_cbb, 0, sizeof(sig_cbb));
@@ -712,7 +1418,8 @@ tls13_server_certificate_verify_send(struct tls13_ctx *ctx, CBB *cbb)
 		goto err;
 	pkey = cpk->privatekey;
 
-	if (!CBB_init(&sig_cbb, 0))
+	if (!CBB_init_fixed(&sig_cbb, sig_content_buf,
+	    sizeof(sig_content_buf)))
 		goto err;
 	if (!CBB_add_bytes(&sig_cbb, tls13_cert_verify_pad,
 	    sizeof(tls13_cert_verify_pad)))
@@ -728,23 +1435,14 @@ tls13_server_certificate_verify_send(struct tls13_ctx *ctx, CBB *cbb)
 	if (!CBB_finish(&sig_cbb, &sig_content, &sig_content_len))
 		goto err;
 
-	if ((mdctx = EVP_MD_CTX_new()) == NULL)
+	sign_ret = ssl_private_key_sign(ctx->ssl, pkey, sigalg, sig_content,
+	    sig_content_len, &sig, &sig_len);
+	if (sign_ret == -1) {
+		/* Return to the application until the signature is done. */
+		ret = TLS13_IO_WANT_PRIVATE_KEY;
 		goto err;
-	if (!EVP_DigestSignInit(mdctx, &pctx, sigalg->md(), NULL, pkey))
-		goto err;
-	if (sigalg->flags & SIGALG_FLAG_RSA_PSS) {
-		if (!EVP_PKEY_CTX_set_rsa_padding(pctx, RSA_PKCS1_PSS_PADDING))
-			goto err;
-		if (!EVP_PKEY_CTX_set_rsa_pss_saltlen(pctx, -1))
-			goto err;
 	}
-	if (!EVP_DigestSignUpdate(mdctx, sig_content, sig_content_len))
-		goto err;
-	if (EVP_DigestSignFinal(mdctx, NULL, &sig_len) <= 0)
-		goto err;
-	if ((sig = calloc(1, sig_len)) == NULL)
-		goto err;
-	if (EVP_DigestSignFinal(mdctx, sig, &sig_len) <= 0)
+	if (sign_ret != 1)
 		goto err;
 
 	if (!CBB_add_u16(cbb, sigalg->value))
@@ -764,8 +1462,6 @@ tls13_server_certificate_verify_send(struct tls13_ctx *ctx, CBB *cbb)
 		ctx->alert = TLS13_ALERT_INTERNAL_ERROR;
 
 	CBB_cleanup(&sig_cbb);
-	EVP_MD_CTX_free(mdctx);
-	free(sig_content);
 	free(sig);
 
 	return ret;
@@ -953,7 +1649,8 @@ tls13_client_certificate_verify_recv(struct tls13_ctx *ctx, CBS *cbs)
 {
 	const struct ssl_sigalg *sigalg;
 	uint16_t signature_scheme;
-	uint8_t *sig_content = NULL;
+	uint8_t sig_content_buf[TLS13_CERT_VERIFY_CONTENT_MAX];
+	uint8_t *sig_content;
 	size_t sig_content_len;
 	EVP_MD_CTX *mdctx = NULL;
 	EVP_PKEY_CTX *pctx;
@@ -970,7 +1667,7 @@ tls13_client_certificate_verify_recv(struct tls13_ctx *ctx, CBS *cbs)
 	if (!CBS_get_u16_length_prefixed(cbs, &signature))
 		goto err;
 
-	if (!CBB_init(&cbb, 0))
+	if (!CBB_init_fixed(&cbb, sig_content_buf, sizeof(sig_content_buf)))
 		goto err;
 	if (!CBB_add_bytes(&cbb, tls13_cert_verify_pad,
 	    sizeof(tls13_cert_verify_pad)))
@@ -1026,7 +1723,6 @@ tls13_client_certificate_verify_recv(struct tls13_ctx *ctx, CBS *cbs)
 
 	CBB_cleanup(&cbb);
 	EVP_MD_CTX_free(mdctx);
-	free(sig_content);
 
 	return ret;
 }
@@ -1034,7 +1730,115 @@ tls13_client_certificate_verify_recv(struct tls13_ctx *ctx, CBS *cbs)
 int
 tls13_client_end_of_early_data_recv(struct tls13_ctx *ctx, CBS *cbs)
 {
-	return 0;
+	struct tls13_secrets *secrets = ctx->hs->tls13.secrets;
+
+	if (CBS_len(cbs) != 0) {
+		ctx->alert = TLS13_ALERT_DECODE_ERROR;
+		return 0;
+	}
+
+	/* Switch from the early traffic key to the handshake traffic key. */
+	tls13_record_layer_end_early_data(ctx->rl);
+
+	return tls13_record_layer_set_read_traffic_key(ctx->rl,
+	    &secrets->client_handshake_traffic);
+}
+
+static int
+tls13_server_new_session_ticket_send(struct tls13_ctx *ctx)
+{
+	struct tls13_secrets *secrets = ctx->hs->tls13.secrets;
+	struct tls13_handshake_msg *hs_msg = NULL;
+	CBB cbb, nonce, ticket;
+	uint8_t ticket_nonce[4];
+	uint32_t lifetime;
+	SSL *s = ctx->ssl;
+	int ret = 0;
+	CBS cbs;
+
+	memset(&cbb, 0, sizeof(cbb));
+
+	/*
+	 * The nonce only needs to be unique across tickets issued on this
+	 * connection - RFC 8446 section 4.6.1.
+	 */
+	ticket_nonce[0] = (ctx->tickets_sent >> 24) & 0xff;
+	ticket_nonce[1] = (ctx->tickets_sent >> 16) & 0xff;
+	ticket_nonce[2] = (ctx->tickets_sent >> 8) & 0xff;
+	ticket_nonce[3] = ctx->tickets_sent & 0xff;
+
+	/*
+	 * The session now carries the resumption PSK in place of a master
+	 * secret, along with the ticket age obfuscation value.
+	 */
+	if (!tls13_derive_ticket_psk(secrets, ticket_nonce,
+	    sizeof(ticket_nonce), s->session->master_key,
+	    secrets->resumption_master.len))
+		goto err;
+	s->session->master_key_length = secrets->resumption_master.len;
+	s->session->tlsext_tick_age_add = arc4random();
+
+	/*
+	 * The ticket age is measured from the time that it was issued. Early
+	 * data may only be accepted on resumption if the ticket permits it
+	 * and the same ALPN protocol is negotiated.
+	 */
+	s->session->time = time(NULL);
+	s->session->max_early_data = s->internal->max_early_data;
+	free(s->session->alpn_selected);
+	s->session->alpn_selected = NULL;
+	s->session->alpn_selected_len = 0;
+	if (S3I(s)->alpn_selected != NULL) {
+		CBS_init(&cbs, S3I(s)->alpn_selected,
+		    S3I(s)->alpn_selected_len);
+		if (!CBS_stow(&cbs, &s->session->alpn_selected,
+		    &s->session->alpn_selected_len))
+			goto err;
+	}
+
+	lifetime = TLS13_TICKET_LIFETIME_MAX;
+	if (s->session->timeout >= 0 &&
+	    s->session->timeout < TLS13_TICKET_LIFETIME_MAX)
+		lifetime = s->session->timeout;
+
+	if ((hs_msg = tls13_handshake_msg_new()) == NULL)
+		goto err;
+	if (!tls13_handshake_msg_start(hs_msg, &cbb,
+	    TLS13_MT_NEW_SESSION_TICKET))
+		goto err;
+	if (!CBB_add_u32(&cbb, lifetime))
+		goto err;
+	if (!CBB_add_u32(&cbb, s->session->tlsext_tick_age_add))
+		goto err;
+	if (!CBB_add_u8_length_prefixed(&cbb, &nonce))
+		goto err;
+	if (!CBB_add_bytes(&nonce, ticket_nonce, sizeof(ticket_nonce)))
+		goto err;
+	if (!CBB_add_u16_length_prefixed(&cbb, &ticket))
+		goto err;
+	if (!tls1_encrypt_ticket(s, s->session, &ticket))
+		goto err;
+	if (!tlsext_server_build(s, SSL_TLSEXT_MSG_NST, &cbb))
+		goto err;
+	if (!tls13_handshake_msg_finish(hs_msg))
+		goto err;
+
+	/*
+	 * Queue the ticket as a post-handshake message - if it cannot be
+	 * written immediately, it is sent ahead of the next read or write.
+	 */
+	tls13_handshake_msg_data(hs_msg, &cbs);
+	if (tls13_record_layer_phh(ctx->rl, &cbs) == TLS13_IO_FAILURE)
+		goto err;
+
+	ctx->tickets_sent++;
+
+	ret = 1;
+
+ err:
+	tls13_handshake_msg_free(hs_msg);
+
+	return ret;
 }
 
 int
@@ -1043,6 +1847,8 @@ tls13_client_finished_recv(struct tls13_ctx *ctx, CBS *cbs)
 	struct tls13_secrets *secrets = ctx->hs->tls13.secrets;
 	struct tls13_secret context = { .data = "", .len = 0 };
 	struct tls13_secret finished_key;
+	uint8_t transcript_hash[EVP_MAX_MD_SIZE];
+	size_t transcript_hash_len;
 	uint8_t *verify_data = NULL;
 	size_t verify_data_len;
 	uint8_t key[EVP_MAX_MD_SIZE];
@@ -1100,6 +1906,30 @@ tls13_client_finished_recv(struct tls13_ctx *ctx, CBS *cbs)
 
 	tls13_record_layer_allow_ccs(ctx->rl, 0);
 
+	/*
+	 * Derive the resumption master secret from the transcript up to and
+	 * including the client finished message.
+	 */
+	if (!tls1_transcript_hash_value(ctx->ssl, transcript_hash,
+	    sizeof(transcript_hash), &transcript_hash_len))
+		goto err;
+	context.data = transcript_hash;
+	context.len = transcript_hash_len;
+
+	if (!tls13_derive_resumption_secret(secrets, &context))
+		goto err;
+
+	/*
+	 * Only issue a ticket if the client is able to use it to resume
+	 * with psk_dhe_ke.
+	 */
+	if (ctx->hs->tls13.psk_dhe_ke &&
+	    !(SSL_get_options(ctx->ssl) & SSL_OP_NO_TICKET) &&
+	    !SSI(ctx->ssl)->not_resumable) {
+		if (!tls13_server_new_session_ticket_send(ctx))
+			goto err;
+	}
+
 	ret = 1;
 
  err:
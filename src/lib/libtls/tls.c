@@ -16,6 +16,7 @@
  */
 
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 #include <errno.h>
 #include <limits.h>
@@ -226,6 +227,7 @@ tls_sni_ctx_free(struct tls_sni_ctx *sni_ctx)
 	if (sni_ctx == NULL)
 		return;
 
+	tls_config_free(sni_ctx->config);
 	SSL_CTX_free(sni_ctx->ssl_ctx);
 	X509_free(sni_ctx->ssl_cert);
 
@@ -256,6 +258,9 @@ tls_configure(struct tls *ctx, struct tls_config *config)
 	if (config == NULL)
 		config = tls_config_default;
 
+	if ((ctx->flags & TLS_SERVER) != 0)
+		return (tls_configure_server(ctx, config));
+
 	pthread_mutex_lock(&config->mutex);
 	config->refcount++;
 	pthread_mutex_unlock(&config->mutex);
@@ -265,9 +270,6 @@ tls_configure(struct tls *ctx, struct tls_config *config)
 	ctx->config = config;
 	ctx->keypair = config->keypair;
 
-	if ((ctx->flags & TLS_SERVER) != 0)
-		return (tls_configure_server(ctx));
-
 	return (0);
 }
 
@@ -432,6 +434,7 @@ int
 tls_configure_ssl_keypair(struct tls *ctx, SSL_CTX *ssl_ctx,
     struct tls_keypair *keypair, int required)
 {
+	struct tls_parsed_keypair *parsed = NULL;
 	EVP_PKEY *pkey = NULL;
 
 	if (!required &&
@@ -439,6 +442,23 @@ tls_configure_ssl_keypair(struct tls *ctx, SSL_CTX *ssl_ctx,
 	    keypair->key_mem == NULL)
 		return(0);
 
+	/*
+	 * A complete keypair is decoded once, no matter how many SSL
+	 * contexts or configurations it is used in. The fake private key
+	 * and the public key hash are specific to a keypair, so the keypair
+	 * is decoded each time when they are used.
+	 */
+	if (keypair->cert_mem != NULL && keypair->key_mem != NULL &&
+	    !ctx->config->use_fake_private_key &&
+	    !ctx->config->skip_private_key_check) {
+		if ((parsed = tls_keypair_cache_get(keypair,
+		    &ctx->error)) == NULL)
+			goto err;
+		if (tls_keypair_cache_use(ctx, ssl_ctx, parsed) == -1)
+			goto err;
+		goto check;
+	}
+
 	if (keypair->cert_mem != NULL) {
 		if (keypair->cert_len > INT_MAX) {
 			tls_set_errorx(ctx, "certificate too long");
@@ -465,15 +485,19 @@ tls_configure_ssl_keypair(struct tls *ctx, SSL_CTX *ssl_ctx,
 		pkey = NULL;
 	}
 
+ check:
 	if (!ctx->config->skip_private_key_check &&
 	    SSL_CTX_check_private_key(ssl_ctx) != 1) {
 		tls_set_errorx(ctx, "private/public key mismatch");
 		goto err;
 	}
 
+	tls_keypair_cache_put(parsed);
+
 	return (0);
 
  err:
+	tls_keypair_cache_put(parsed);
 	EVP_PKEY_free(pkey);
 
 	return (-1);
@@ -490,6 +514,10 @@ tls_configure_ssl(struct tls *ctx, SSL_CTX *ssl_ctx)
 	SSL_CTX_set_options(ssl_ctx, SSL_OP_NO_SSLv2);
 	SSL_CTX_set_options(ssl_ctx, SSL_OP_NO_SSLv3);
 
+	SSL_CTX_clear_options(ssl_ctx, SSL_OP_ENABLE_KTLS);
+	if (ctx->config->ktls)
+		SSL_CTX_set_options(ssl_ctx, SSL_OP_ENABLE_KTLS);
+
 	SSL_CTX_clear_options(ssl_ctx, SSL_OP_NO_TLSv1);
 	SSL_CTX_clear_options(ssl_ctx, SSL_OP_NO_TLSv1_1);
 	SSL_CTX_clear_options(ssl_ctx, SSL_OP_NO_TLSv1_2);
@@ -538,8 +566,19 @@ tls_configure_ssl(struct tls *ctx, SSL_CTX *ssl_ctx)
 static int
 tls_ssl_cert_verify_cb(X509_STORE_CTX *x509_ctx, void *arg)
 {
-	struct tls *ctx = arg;
+	struct tls *ctx;
 	int x509_err;
+	SSL *ssl;
+
+	/*
+	 * The SSL context may be shared by the configurations of a server,
+	 * so use the context of the connection rather than arg.
+	 */
+	if ((ssl = X509_STORE_CTX_get_ex_data(x509_ctx,
+	    SSL_get_ex_data_X509_STORE_CTX_idx())) == NULL)
+		return (0);
+	if ((ctx = SSL_get_app_data(ssl)) == NULL)
+		return (0);
 
 	if (ctx->config->verify_cert == 0)
 		return (1);
@@ -562,20 +601,11 @@ tls_ssl_cert_verify_cb(X509_STORE_CTX *x509_ctx, void *arg)
 int
 tls_configure_ssl_verify(struct tls *ctx, SSL_CTX *ssl_ctx, int verify)
 {
-	size_t ca_len = ctx->config->ca_len;
-	char *ca_mem = ctx->config->ca_mem;
-	char *crl_mem = ctx->config->crl_mem;
-	size_t crl_len = ctx->config->crl_len;
-	char *ca_free = NULL;
-	STACK_OF(X509_INFO) *xis = NULL;
 	X509_STORE *store;
-	X509_INFO *xi;
-	BIO *bio = NULL;
 	int rv = -1;
-	int i;
 
 	SSL_CTX_set_verify(ssl_ctx, verify, NULL);
-	SSL_CTX_set_cert_verify_callback(ssl_ctx, tls_ssl_cert_verify_cb, ctx);
+	SSL_CTX_set_cert_verify_callback(ssl_ctx, tls_ssl_cert_verify_cb, NULL);
 
 	if (ctx->config->verify_depth >= 0)
 		SSL_CTX_set_verify_depth(ssl_ctx, ctx->config->verify_depth);
@@ -583,66 +613,37 @@ tls_configure_ssl_verify(struct tls *ctx, SSL_CTX *ssl_ctx, int verify)
 	if (ctx->config->verify_cert == 0)
 		goto done;
 
-	/* If no CA has been specified, attempt to load the default. */
-	if (ctx->config->ca_mem == NULL && ctx->config->ca_path == NULL) {
-		if (tls_config_load_file(&ctx->error, "CA", tls_default_ca_cert_file(),
-		    &ca_mem, &ca_len) != 0)
+	/*
+	 * CAs from memory, or from the default CA file, are parsed once into
+	 * a store that is shared by every context using the same CAs.
+	 */
+	if (ctx->config->ca_mem != NULL || ctx->config->ca_path == NULL) {
+		if ((store = tls_ca_cache_get(ctx->config,
+		    &ctx->error)) == NULL)
 			goto err;
-		ca_free = ca_mem;
+		SSL_CTX_set_cert_store(ssl_ctx, store);
+		goto done;
 	}
 
-	if (ca_mem != NULL) {
-		if (ca_len > INT_MAX) {
-			tls_set_errorx(ctx, "ca too long");
-			goto err;
-		}
-		if (SSL_CTX_load_verify_mem(ssl_ctx, ca_mem, ca_len) != 1) {
-			tls_set_errorx(ctx, "ssl verify memory setup failure");
-			goto err;
-		}
-	} else if (SSL_CTX_load_verify_locations(ssl_ctx, NULL,
+	if (SSL_CTX_load_verify_locations(ssl_ctx, NULL,
 	    ctx->config->ca_path) != 1) {
 		tls_set_errorx(ctx, "ssl verify locations failure");
 		goto err;
 	}
 
-	if (crl_mem != NULL) {
-		if (crl_len > INT_MAX) {
-			tls_set_errorx(ctx, "crl too long");
-			goto err;
-		}
-		if ((bio = BIO_new_mem_buf(crl_mem, crl_len)) == NULL) {
-			tls_set_errorx(ctx, "failed to create buffer");
-			goto err;
-		}
-		if ((xis = PEM_X509_INFO_read_bio(bio, NULL, tls_password_cb,
-		    NULL)) == NULL) {
-			tls_set_errorx(ctx, "failed to parse crl");
-			goto err;
-		}
-		store = SSL_CTX_get_cert_store(ssl_ctx);
-		for (i = 0; i < sk_X509_INFO_num(xis); i++) {
-			xi = sk_X509_INFO_value(xis, i);
-			if (xi->crl == NULL)
-				continue;
-			if (!X509_STORE_add_crl(store, xi->crl)) {
-				tls_set_error(ctx, "failed to add crl");
-				goto err;
-			}
-			xi->crl = NULL;
-		}
-		X509_VERIFY_PARAM_set_flags(store->param,
-		    X509_V_FLAG_CRL_CHECK | X509_V_FLAG_CRL_CHECK_ALL);
+	store = SSL_CTX_get_cert_store(ssl_ctx);
+	if (tls_ca_store_add_crls(&ctx->error, store, ctx->config->crl_mem,
+	    ctx->config->crl_len) == -1)
+		goto err;
+	if (!X509_STORE_enable_verify_cache(store, TLS_VERIFY_CACHE_SIZE)) {
+		tls_set_errorx(ctx, "failed to enable verify cache");
+		goto err;
 	}
 
  done:
 	rv = 0;
 
  err:
-	sk_X509_INFO_pop_free(xis, X509_INFO_free);
-	BIO_free(bio);
-	free(ca_free);
-
 	return (rv);
 }
 
@@ -660,8 +661,6 @@ tls_free(struct tls *ctx)
 void
 tls_reset(struct tls *ctx)
 {
-	struct tls_sni_ctx *sni, *nsni;
-
 	tls_config_free(ctx->config);
 	ctx->config = NULL;
 
@@ -680,6 +679,7 @@ tls_reset(struct tls *ctx)
 
 	free(ctx->servername);
 	ctx->servername = NULL;
+	ctx->port = 0;
 
 	free(ctx->error.msg);
 	ctx->error.msg = NULL;
@@ -691,15 +691,19 @@ tls_reset(struct tls *ctx)
 	tls_ocsp_free(ctx->ocsp);
 	ctx->ocsp = NULL;
 
-	for (sni = ctx->sni_ctx; sni != NULL; sni = nsni) {
-		nsni = sni->next;
-		tls_sni_ctx_free(sni);
-	}
-	ctx->sni_ctx = NULL;
+	tls_server_ssl_free(ctx->server_ssl);
+	ctx->server_ssl = NULL;
 
 	ctx->read_cb = NULL;
 	ctx->write_cb = NULL;
 	ctx->cb_arg = NULL;
+
+	free(ctx->sendfile_buf);
+	ctx->sendfile_buf = NULL;
+
+	free(ctx->metrics);
+	ctx->metrics = NULL;
+	ctx->metrics_records_written = 0;
 }
 
 int
@@ -769,6 +773,11 @@ tls_handshake(struct tls *ctx)
 		goto out;
 	}
 
+	if (ctx->config->metrics && ctx->metrics == NULL) {
+		if (tls_metrics_handshake_start(ctx) == -1)
+			goto out;
+	}
+
 	if ((ctx->flags & TLS_CLIENT) != 0)
 		rv = tls_handshake_client(ctx);
 	else if ((ctx->flags & TLS_SERVER_CONN) != 0)
@@ -782,6 +791,8 @@ tls_handshake(struct tls *ctx)
 		if (ctx->ocsp == NULL)
 			ctx->ocsp = tls_ocsp_setup_from_peer(ctx);
 	}
+	if (ctx->metrics != NULL)
+		tls_metrics_handshake(ctx, rv);
  out:
 	/* Prevent callers from performing incorrect error handling */
 	errno = 0;
@@ -814,6 +825,63 @@ tls_read(struct tls *ctx, void *buf, size_t buflen)
 	rv = (ssize_t)tls_ssl_error(ctx, ctx->ssl_conn, ssl_ret, "read");
 
  out:
+	if (rv > 0 && ctx->metrics != NULL)
+		ctx->metrics->bytes_read += rv;
+
+	/* Prevent callers from performing incorrect error handling */
+	errno = 0;
+	return (rv);
+}
+
+ssize_t
+tls_read_early_data(struct tls *ctx, void *buf, size_t buflen)
+{
+	size_t readbytes;
+	ssize_t rv = -1;
+
+	tls_error_clear(&ctx->error);
+
+	if ((ctx->flags & TLS_SERVER_CONN) == 0) {
+		tls_set_errorx(ctx, "not a server connection context");
+		goto out;
+	}
+
+	/* Early data can only be read before the handshake completes. */
+	if ((ctx->state & TLS_HANDSHAKE_COMPLETE) != 0) {
+		rv = 0;
+		goto out;
+	}
+
+	if (buflen > INT_MAX) {
+		tls_set_errorx(ctx, "buflen too long");
+		goto out;
+	}
+
+	ctx->state |= TLS_SSL_NEEDS_SHUTDOWN;
+
+	ERR_clear_error();
+	switch (SSL_read_early_data(ctx->ssl_conn, buf, buflen, &readbytes)) {
+	case SSL_READ_EARLY_DATA_SUCCESS:
+		rv = (ssize_t)readbytes;
+		break;
+	case SSL_READ_EARLY_DATA_FINISH:
+		rv = 0;
+		break;
+	default:
+		rv = (ssize_t)tls_ssl_error(ctx, ctx->ssl_conn, -1,
+		    "read early data");
+		/* Zero indicates that there is no more early data. */
+		if (rv == 0) {
+			tls_set_errorx(ctx, "read early data failed");
+			rv = -1;
+		}
+		break;
+	}
+
+ out:
+	if (rv > 0 && ctx->metrics != NULL)
+		ctx->metrics->bytes_read += rv;
+
 	/* Prevent callers from performing incorrect error handling */
 	errno = 0;
 	return (rv);
@@ -845,11 +913,243 @@ tls_write(struct tls *ctx, const void *buf, size_t buflen)
 	rv = (ssize_t)tls_ssl_error(ctx, ctx->ssl_conn, ssl_ret, "write");
 
  out:
+	if (rv > 0 && ctx->metrics != NULL)
+		ctx->metrics->bytes_written += rv;
+
+	/* Prevent callers from performing incorrect error handling */
+	errno = 0;
+	return (rv);
+}
+
+static ssize_t
+tls_iov_len(struct tls *ctx, const struct iovec *iov, int iovcnt)
+{
+	size_t len = 0;
+	int i;
+
+	if (iovcnt < 0 || iovcnt > IOV_MAX) {
+		tls_set_errorx(ctx, "invalid iovec count");
+		return -1;
+	}
+	for (i = 0; i < iovcnt; i++) {
+		if (iov[i].iov_len > INT_MAX - len) {
+			tls_set_errorx(ctx, "iovec too long");
+			return -1;
+		}
+		len += iov[i].iov_len;
+	}
+
+	return (ssize_t)len;
+}
+
+ssize_t
+tls_readv(struct tls *ctx, const struct iovec *iov, int iovcnt)
+{
+	ssize_t rv = -1;
+	size_t off = 0, total = 0;
+	int i = 0;
+	int ssl_ret;
+
+	tls_error_clear(&ctx->error);
+
+	if ((ctx->state & TLS_HANDSHAKE_COMPLETE) == 0) {
+		if ((rv = tls_handshake(ctx)) != 0)
+			goto out;
+	}
+
+	if ((rv = tls_iov_len(ctx, iov, iovcnt)) <= 0)
+		goto out;
+
+	/*
+	 * Fill the vector from the data that is available, only blocking or
+	 * failing if nothing has been read at all.
+	 */
+	while (i < iovcnt) {
+		if (iov[i].iov_len == off) {
+			i++;
+			off = 0;
+			continue;
+		}
+		if (total > 0 && SSL_pending(ctx->ssl_conn) == 0)
+			break;
+
+		ERR_clear_error();
+		if ((ssl_ret = SSL_read(ctx->ssl_conn,
+		    (char *)iov[i].iov_base + off, iov[i].iov_len - off)) <= 0) {
+			if (total > 0)
+				break;
+			rv = (ssize_t)tls_ssl_error(ctx, ctx->ssl_conn, ssl_ret,
+			    "read");
+			goto out;
+		}
+		off += ssl_ret;
+		total += ssl_ret;
+	}
+	rv = (ssize_t)total;
+
+ out:
+	if (rv > 0 && ctx->metrics != NULL)
+		ctx->metrics->bytes_read += rv;
+
+	/* Prevent callers from performing incorrect error handling */
+	errno = 0;
+	return (rv);
+}
+
+ssize_t
+tls_writev(struct tls *ctx, const struct iovec *iov, int iovcnt)
+{
+	ssize_t rv = -1;
+	int ssl_ret;
+
+	tls_error_clear(&ctx->error);
+
+	if ((ctx->state & TLS_HANDSHAKE_COMPLETE) == 0) {
+		if ((rv = tls_handshake(ctx)) != 0)
+			goto out;
+	}
+
+	if ((rv = tls_iov_len(ctx, iov, iovcnt)) <= 0)
+		goto out;
+
+	ERR_clear_error();
+	if ((ssl_ret = SSL_writev(ctx->ssl_conn, iov, iovcnt)) > 0) {
+		rv = (ssize_t)ssl_ret;
+		goto out;
+	}
+	rv = (ssize_t)tls_ssl_error(ctx, ctx->ssl_conn, ssl_ret, "write");
+
+ out:
+	if (rv > 0 && ctx->metrics != NULL)
+		ctx->metrics->bytes_written += rv;
+
+	/* Prevent callers from performing incorrect error handling */
+	errno = 0;
+	return (rv);
+}
+
+ssize_t
+tls_sendfile(struct tls *ctx, int fd, off_t offset, size_t len)
+{
+	ssize_t n, rv = -1;
+	int ssl_ret;
+
+	tls_error_clear(&ctx->error);
+
+	if ((ctx->state & TLS_HANDSHAKE_COMPLETE) == 0) {
+		if ((rv = tls_handshake(ctx)) != 0)
+			goto out;
+	}
+
+	if (len == 0) {
+		rv = 0;
+		goto out;
+	}
+
+	/* If the kernel seals the records, the file need not be read in. */
+	if (BIO_get_ktls_send(SSL_get_wbio(ctx->ssl_conn))) {
+		ERR_clear_error();
+		if ((rv = SSL_sendfile(ctx->ssl_conn, fd, offset, len, 0)) >= 0)
+			goto out;
+		rv = (ssize_t)tls_ssl_error(ctx, ctx->ssl_conn, -1, "sendfile");
+		goto out;
+	}
+
+	/*
+	 * Otherwise send at most one record's worth through a buffer that is
+	 * kept with the context.  A retry after TLS_WANT_POLLOUT reads the
+	 * same data again, as SSL_write() expects.
+	 */
+	if (ctx->sendfile_buf == NULL) {
+		if ((ctx->sendfile_buf = malloc(TLS_SENDFILE_BUF_LEN)) == NULL) {
+			tls_set_errorx(ctx, "out of memory");
+			goto out;
+		}
+	}
+	if (len > TLS_SENDFILE_BUF_LEN)
+		len = TLS_SENDFILE_BUF_LEN;
+	if ((n = pread(fd, ctx->sendfile_buf, len, offset)) == -1) {
+		tls_set_error(ctx, "pread");
+		goto out;
+	}
+	if (n == 0) {
+		rv = 0;
+		goto out;
+	}
+
+	ERR_clear_error();
+	if ((ssl_ret = SSL_write(ctx->ssl_conn, ctx->sendfile_buf, n)) > 0) {
+		rv = (ssize_t)ssl_ret;
+		goto out;
+	}
+	rv = (ssize_t)tls_ssl_error(ctx, ctx->ssl_conn, ssl_ret, "write");
+
+ out:
+	if (rv > 0 && ctx->metrics != NULL)
+		ctx->metrics->bytes_written += rv;
+
 	/* Prevent callers from performing incorrect error handling */
 	errno = 0;
 	return (rv);
 }
 
+/*
+ * With read ahead, the socket is read through a buffer BIO, so that a read
+ * returns as many records as are available rather than a record header and
+ * then its body. The kernel cannot take over a socket whose data has already
+ * been read ahead, so read ahead is not used with kernel TLS.
+ */
+int
+tls_set_fds(struct tls *ctx, int fd_read, int fd_write)
+{
+	BIO *rbio = NULL, *wbio = NULL, *bbio = NULL;
+
+	if (!ctx->config->read_ahead || ctx->config->ktls) {
+		if (SSL_set_rfd(ctx->ssl_conn, fd_read) != 1 ||
+		    SSL_set_wfd(ctx->ssl_conn, fd_write) != 1)
+			return (-1);
+		return (0);
+	}
+
+	if ((rbio = BIO_new_socket(fd_read, BIO_NOCLOSE)) == NULL)
+		goto err;
+	if ((wbio = BIO_new_socket(fd_write, BIO_NOCLOSE)) == NULL)
+		goto err;
+	if ((bbio = BIO_new(BIO_f_buffer())) == NULL)
+		goto err;
+	if (BIO_set_read_buffer_size(bbio, TLS_READ_AHEAD_BUF_LEN) != 1)
+		goto err;
+
+	SSL_set_bio(ctx->ssl_conn, BIO_push(bbio, rbio), wbio);
+
+	return (0);
+
+ err:
+	BIO_free(bbio);
+	BIO_free(rbio);
+	BIO_free(wbio);
+
+	return (-1);
+}
+
+ssize_t
+tls_pending(struct tls *ctx)
+{
+	size_t buffered;
+	int pending;
+
+	if ((ctx->state & TLS_HANDSHAKE_COMPLETE) == 0 || ctx->ssl_conn == NULL)
+		return (0);
+
+	if ((pending = SSL_pending(ctx->ssl_conn)) < 0)
+		pending = 0;
+
+	/* Include records that have been read ahead but not yet opened. */
+	buffered = BIO_ctrl_pending(SSL_get_rbio(ctx->ssl_conn));
+
+	return ((ssize_t)pending + (ssize_t)buffered);
+}
+
 int
 tls_close(struct tls *ctx)
 {
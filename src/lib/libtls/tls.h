@@ -26,6 +26,7 @@ extern "C" {
 
 #include <stddef.h>
 #include <stdint.h>
+#include <time.h>
 
 #define TLS_API	20200120
 
@@ -74,6 +75,25 @@ extern "C" {
 
 struct tls;
 struct tls_config;
+struct iovec;
+struct addrinfo;
+
+/*
+ * Connection metrics, see tls_conn_metrics(3). The times are those of the
+ * CLOCK_MONOTONIC clock.
+ */
+struct tls_metrics {
+	struct timespec handshake_start;
+	struct timespec handshake_finish;
+	unsigned int handshake_round_trips;
+	struct timespec private_key_time;
+	uint64_t bytes_read;
+	uint64_t bytes_written;
+	uint64_t records_read;
+	uint64_t records_written;
+	uint64_t renegotiations;
+	uint64_t key_updates;
+};
 
 typedef ssize_t (*tls_read_cb)(struct tls *_ctx, void *_buf, size_t _buflen,
     void *_cb_arg);
@@ -134,10 +154,16 @@ int tls_config_set_ocsp_staple_file(struct tls_config *_config,
     const char *_staple_file);
 int tls_config_set_protocols(struct tls_config *_config, uint32_t _protocols);
 int tls_config_set_session_fd(struct tls_config *_config, int _session_fd);
+int tls_config_set_session_cache_size(struct tls_config *_config,
+    size_t _size);
 int tls_config_set_verify_depth(struct tls_config *_config, int _verify_depth);
 
 void tls_config_prefer_ciphers_client(struct tls_config *_config);
 void tls_config_prefer_ciphers_server(struct tls_config *_config);
+void tls_config_enable_ktls(struct tls_config *_config);
+void tls_config_enable_read_ahead(struct tls_config *_config);
+void tls_config_enable_metrics(struct tls_config *_config);
+void tls_config_enable_tcp_fastopen(struct tls_config *_config);
 
 void tls_config_insecure_noverifycert(struct tls_config *_config);
 void tls_config_insecure_noverifyname(struct tls_config *_config);
@@ -145,6 +171,7 @@ void tls_config_insecure_noverifytime(struct tls_config *_config);
 void tls_config_verify(struct tls_config *_config);
 
 void tls_config_ocsp_require_stapling(struct tls_config *_config);
+void tls_config_ocsp_refresh_staples(struct tls_config *_config);
 void tls_config_verify_client(struct tls_config *_config);
 void tls_config_verify_client_optional(struct tls_config *_config);
 
@@ -154,6 +181,8 @@ int tls_config_parse_protocols(uint32_t *_protocols, const char *_protostr);
 int tls_config_set_session_id(struct tls_config *_config,
     const unsigned char *_session_id, size_t _len);
 int tls_config_set_session_lifetime(struct tls_config *_config, int _lifetime);
+int tls_config_set_max_early_data(struct tls_config *_config,
+    uint32_t _max_early_data);
 int tls_config_add_ticket_key(struct tls_config *_config, uint32_t _keyrev,
     unsigned char *_key, size_t _keylen);
 
@@ -169,6 +198,8 @@ int tls_accept_socket(struct tls *_ctx, struct tls **_cctx, int _socket);
 int tls_accept_cbs(struct tls *_ctx, struct tls **_cctx,
     tls_read_cb _read_cb, tls_write_cb _write_cb, void *_cb_arg);
 int tls_connect(struct tls *_ctx, const char *_host, const char *_port);
+int tls_connect_addrinfo(struct tls *_ctx, const struct addrinfo *_ai,
+    const char *_servername);
 int tls_connect_fds(struct tls *_ctx, int _fd_read, int _fd_write,
     const char *_servername);
 int tls_connect_servername(struct tls *_ctx, const char *_host,
@@ -178,7 +209,12 @@ int tls_connect_cbs(struct tls *_ctx, tls_read_cb _read_cb,
     tls_write_cb _write_cb, void *_cb_arg, const char *_servername);
 int tls_handshake(struct tls *_ctx);
 ssize_t tls_read(struct tls *_ctx, void *_buf, size_t _buflen);
+ssize_t tls_read_early_data(struct tls *_ctx, void *_buf, size_t _buflen);
 ssize_t tls_write(struct tls *_ctx, const void *_buf, size_t _buflen);
+ssize_t tls_readv(struct tls *_ctx, const struct iovec *_iov, int _iovcnt);
+ssize_t tls_writev(struct tls *_ctx, const struct iovec *_iov, int _iovcnt);
+ssize_t tls_sendfile(struct tls *_ctx, int _fd, off_t _offset, size_t _len);
+ssize_t tls_pending(struct tls *_ctx);
 int tls_close(struct tls *_ctx);
 
 int tls_peer_cert_provided(struct tls *_ctx);
@@ -194,6 +230,7 @@ const uint8_t *tls_peer_cert_chain_pem(struct tls *_ctx, size_t *_len);
 const char *tls_conn_alpn_selected(struct tls *_ctx);
 const char *tls_conn_cipher(struct tls *_ctx);
 int tls_conn_cipher_strength(struct tls *_ctx);
+int tls_conn_metrics(struct tls *_ctx, struct tls_metrics *_metrics);
 const char *tls_conn_servername(struct tls *_ctx);
 int tls_conn_session_resumed(struct tls *_ctx);
 const char *tls_conn_version(struct tls *_ctx);
@@ -0,0 +1,258 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * CA store cache.
+ *
+ * The CA certificates and CRLs of a configuration are parsed into a single
+ * X509_STORE, which every SSL context set up from a configuration with the
+ * same CA and CRL contents shares, across all configurations in the
+ * process. Nothing is added to a store once it has been built. An entry is
+ * found by a digest of the PEM encoded CAs and CRLs and is referenced by
+ * the configurations that use it, each SSL context holding a reference to
+ * the X509_STORE itself.
+ */
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/pem.h>
+#include <openssl/sha.h>
+#include <openssl/x509.h>
+
+#include <tls.h>
+#include "tls_internal.h"
+
+#define TLS_CA_CACHE_BUCKETS	16
+
+struct tls_ca_store {
+	struct tls_ca_store *next;
+	int refcount;
+
+	unsigned char digest[SHA256_DIGEST_LENGTH];
+
+	X509_STORE *store;
+};
+
+static pthread_mutex_t tls_ca_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct tls_ca_store *tls_ca_cache[TLS_CA_CACHE_BUCKETS];
+
+static void
+tls_ca_cache_digest(const char *ca_mem, size_t ca_len, const char *crl_mem,
+    size_t crl_len, unsigned char *digest)
+{
+	SHA256_CTX sha;
+
+	SHA256_Init(&sha);
+	SHA256_Update(&sha, &ca_len, sizeof(ca_len));
+	SHA256_Update(&sha, ca_mem, ca_len);
+	SHA256_Update(&sha, &crl_len, sizeof(crl_len));
+	if (crl_mem != NULL)
+		SHA256_Update(&sha, crl_mem, crl_len);
+	SHA256_Final(digest, &sha);
+}
+
+/*
+ * Add the CRLs in crl_mem to a store and turn on CRL checking for the
+ * whole chain.
+ */
+int
+tls_ca_store_add_crls(struct tls_error *error, X509_STORE *store,
+    const char *crl_mem, size_t crl_len)
+{
+	STACK_OF(X509_INFO) *xis = NULL;
+	X509_INFO *xi;
+	BIO *bio = NULL;
+	int rv = -1;
+	int i;
+
+	if (crl_mem == NULL)
+		return (0);
+
+	if (crl_len > INT_MAX) {
+		tls_error_setx(error, "crl too long");
+		goto err;
+	}
+	if ((bio = BIO_new_mem_buf(crl_mem, crl_len)) == NULL) {
+		tls_error_setx(error, "failed to create buffer");
+		goto err;
+	}
+	if ((xis = PEM_X509_INFO_read_bio(bio, NULL, tls_password_cb,
+	    NULL)) == NULL) {
+		tls_error_setx(error, "failed to parse crl");
+		goto err;
+	}
+	for (i = 0; i < sk_X509_INFO_num(xis); i++) {
+		xi = sk_X509_INFO_value(xis, i);
+		if (xi->crl == NULL)
+			continue;
+		if (!X509_STORE_add_crl(store, xi->crl)) {
+			tls_error_set(error, "failed to add crl");
+			goto err;
+		}
+		xi->crl = NULL;
+	}
+	X509_VERIFY_PARAM_set_flags(store->param,
+	    X509_V_FLAG_CRL_CHECK | X509_V_FLAG_CRL_CHECK_ALL);
+
+	rv = 0;
+
+ err:
+	sk_X509_INFO_pop_free(xis, X509_INFO_free);
+	BIO_free(bio);
+
+	return (rv);
+}
+
+/*
+ * Build a store in the same way as SSL_CTX_load_verify_mem() and
+ * tls_configure_ssl_verify() do for a single SSL context.
+ */
+static X509_STORE *
+tls_ca_store_new(struct tls_error *error, char *ca_mem, size_t ca_len,
+    const char *crl_mem, size_t crl_len)
+{
+	X509_STORE *store;
+
+	if (ca_len > INT_MAX) {
+		tls_error_setx(error, "ca too long");
+		return (NULL);
+	}
+	if ((store = X509_STORE_new()) == NULL) {
+		tls_error_setx(error, "out of memory");
+		return (NULL);
+	}
+	if (X509_STORE_load_mem(store, ca_mem, ca_len) != 1) {
+		tls_error_setx(error, "ssl verify memory setup failure");
+		goto err;
+	}
+	if (tls_ca_store_add_crls(error, store, crl_mem, crl_len) == -1)
+		goto err;
+	if (!X509_STORE_enable_verify_cache(store, TLS_VERIFY_CACHE_SIZE)) {
+		tls_error_setx(error, "failed to enable verify cache");
+		goto err;
+	}
+
+	return (store);
+
+ err:
+	X509_STORE_free(store);
+
+	return (NULL);
+}
+
+/*
+ * Return the store for the CAs in memory, or the default CA file if no CAs
+ * have been configured, with a reference for the caller.
+ */
+X509_STORE *
+tls_ca_cache_get(struct tls_config *config, struct tls_error *error)
+{
+	struct tls_ca_store *entry = NULL;
+	unsigned char digest[SHA256_DIGEST_LENGTH];
+	struct tls_ca_store **bucket;
+	X509_STORE *store = NULL;
+	char *ca_mem = config->ca_mem;
+	size_t ca_len = config->ca_len;
+	char *ca_free = NULL;
+
+	/*
+	 * Parsing is done with the mutex held, so that threads configuring
+	 * the same CAs do not parse them more than once.
+	 */
+	pthread_mutex_lock(&tls_ca_cache_mutex);
+
+	if ((entry = config->ca_store) != NULL)
+		goto done;
+
+	if (ca_mem == NULL) {
+		if (tls_config_load_file(error, "CA",
+		    tls_default_ca_cert_file(), &ca_mem, &ca_len) != 0)
+			goto err;
+		ca_free = ca_mem;
+	}
+
+	tls_ca_cache_digest(ca_mem, ca_len, config->crl_mem, config->crl_len,
+	    digest);
+	bucket = &tls_ca_cache[digest[0] % TLS_CA_CACHE_BUCKETS];
+	for (entry = *bucket; entry != NULL; entry = entry->next) {
+		if (memcmp(entry->digest, digest, sizeof(digest)) == 0)
+			break;
+	}
+	if (entry == NULL) {
+		if ((entry = calloc(1, sizeof(*entry))) == NULL) {
+			tls_error_setx(error, "out of memory");
+			goto err;
+		}
+		if ((entry->store = tls_ca_store_new(error, ca_mem, ca_len,
+		    config->crl_mem, config->crl_len)) == NULL) {
+			free(entry);
+			goto err;
+		}
+		memcpy(entry->digest, digest, sizeof(digest));
+		entry->next = *bucket;
+		*bucket = entry;
+	}
+
+	entry->refcount++;
+	config->ca_store = entry;
+
+ done:
+	if (X509_STORE_up_ref(entry->store))
+		store = entry->store;
+	else
+		tls_error_setx(error, "failed to reference CA store");
+
+ err:
+	pthread_mutex_unlock(&tls_ca_cache_mutex);
+	free(ca_free);
+
+	return (store);
+}
+
+/*
+ * Drop the store of a configuration, once its CAs or CRLs change.
+ */
+void
+tls_ca_cache_release(struct tls_config *config)
+{
+	struct tls_ca_store *entry, **pp;
+
+	pthread_mutex_lock(&tls_ca_cache_mutex);
+	if ((entry = config->ca_store) == NULL) {
+		pthread_mutex_unlock(&tls_ca_cache_mutex);
+		return;
+	}
+	config->ca_store = NULL;
+	if (--entry->refcount > 0) {
+		pthread_mutex_unlock(&tls_ca_cache_mutex);
+		return;
+	}
+	pp = &tls_ca_cache[entry->digest[0] % TLS_CA_CACHE_BUCKETS];
+	for (; *pp != NULL; pp = &(*pp)->next) {
+		if (*pp == entry) {
+			*pp = entry->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&tls_ca_cache_mutex);
+
+	X509_STORE_free(entry->store);
+	free(entry);
+}
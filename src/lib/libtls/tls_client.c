@@ -21,9 +21,13 @@
 
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 
+#include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <netdb.h>
+#include <poll.h>
 #include <stdlib.h>
 #include <unistd.h>
 
@@ -55,14 +59,213 @@ tls_connect(struct tls *ctx, const char *host, const char *port)
 	return tls_connect_servername(ctx, host, port, NULL);
 }
 
+/*
+ * Delay between starting connection attempts to successive addresses,
+ * in milliseconds (RFC 8305, section 5).
+ */
+#define TLS_CONNECT_ATTEMPT_DELAY	250
+
+/*
+ * Order the addresses so that the address families alternate, starting
+ * with the family of the first address (RFC 8305, section 4).
+ */
+static const struct addrinfo **
+tls_connect_order(const struct addrinfo *res0, size_t *count)
+{
+	const struct addrinfo **ai, *res, *first, *other;
+	size_t i, n = 0;
+	int family;
+
+	for (res = res0; res != NULL; res = res->ai_next)
+		n++;
+	if ((ai = calloc(n, sizeof(*ai))) == NULL)
+		return NULL;
+
+	family = res0->ai_family;
+	first = other = res0;
+	for (i = 0; i < n; i++) {
+		while (first != NULL && first->ai_family != family)
+			first = first->ai_next;
+		while (other != NULL && other->ai_family == family)
+			other = other->ai_next;
+		if (first != NULL && (i % 2 == 0 || other == NULL)) {
+			ai[i] = first;
+			first = first->ai_next;
+		} else {
+			ai[i] = other;
+			other = other->ai_next;
+		}
+	}
+
+	*count = n;
+	return ai;
+}
+
+static int
+tls_connect_start(struct tls *ctx, const struct addrinfo *res, int *fd)
+{
+	int flags, s;
+
+	*fd = -1;
+
+	if ((s = socket(res->ai_family, res->ai_socktype,
+	    res->ai_protocol)) == -1) {
+		tls_set_error(ctx, "socket");
+		return -1;
+	}
+	if ((flags = fcntl(s, F_GETFL)) == -1 ||
+	    fcntl(s, F_SETFL, flags | O_NONBLOCK) == -1) {
+		tls_set_error(ctx, "fcntl");
+		goto err;
+	}
+#ifdef TCP_FASTOPEN_CONNECT
+	if (ctx->config->tcp_fastopen) {
+		int on = 1;
+
+		/*
+		 * Best effort, the ClientHello rides in the SYN.  As the
+		 * connection is only made by the first write, the first
+		 * address always wins.
+		 */
+		(void)setsockopt(s, IPPROTO_TCP, TCP_FASTOPEN_CONNECT,
+		    &on, sizeof(on));
+	}
+#endif
+	if (connect(s, res->ai_addr, res->ai_addrlen) == 0) {
+		*fd = s;
+		return 1;
+	}
+	if (errno != EINPROGRESS) {
+		tls_set_error(ctx, "connect");
+		goto err;
+	}
+
+	*fd = s;
+	return 0;
+
+ err:
+	close(s);
+	return -1;
+}
+
+/*
+ * Connect to the first address that answers, using non-blocking connects
+ * that are started TLS_CONNECT_ATTEMPT_DELAY apart without waiting for
+ * the earlier ones to fail, so that a dead route does not cost a full
+ * TCP timeout.
+ */
+static int
+tls_connect_happy(struct tls *ctx, const struct addrinfo *res0)
+{
+	const struct addrinfo **ai = NULL;
+	struct pollfd *pfd = NULL;
+	size_t i, n, next = 0, npfd = 0;
+	socklen_t len;
+	int error, flags, ret, s = -1;
+
+	if ((ai = tls_connect_order(res0, &n)) == NULL ||
+	    (pfd = calloc(n, sizeof(*pfd))) == NULL) {
+		tls_set_errorx(ctx, "out of memory");
+		goto err;
+	}
+
+	while (s == -1) {
+		if (next < n) {
+			if ((ret = tls_connect_start(ctx, ai[next++], &s)) == 1)
+				break;
+			/* A failed attempt moves on to the next at once. */
+			if (ret == -1)
+				continue;
+			pfd[npfd].fd = s;
+			pfd[npfd].events = POLLOUT;
+			npfd++;
+			s = -1;
+		}
+		if (npfd == 0)
+			goto err;
+
+		ret = poll(pfd, npfd, next < n ?
+		    TLS_CONNECT_ATTEMPT_DELAY : INFTIM);
+		if (ret == -1) {
+			if (errno == EINTR)
+				continue;
+			tls_set_error(ctx, "poll");
+			goto err;
+		}
+
+		for (i = 0; i < npfd && s == -1;) {
+			if (pfd[i].revents == 0) {
+				i++;
+				continue;
+			}
+			len = sizeof(error);
+			if (getsockopt(pfd[i].fd, SOL_SOCKET, SO_ERROR,
+			    &error, &len) == -1)
+				error = errno;
+			if (error == 0) {
+				s = pfd[i].fd;
+			} else {
+				errno = error;
+				tls_set_error(ctx, "connect");
+				close(pfd[i].fd);
+			}
+			pfd[i] = pfd[--npfd];
+		}
+	}
+
+	/* Hand the caller a blocking socket, as connect(2) would. */
+	if ((flags = fcntl(s, F_GETFL)) == -1 ||
+	    fcntl(s, F_SETFL, flags & ~O_NONBLOCK) == -1) {
+		tls_set_error(ctx, "fcntl");
+		close(s);
+		s = -1;
+	}
+
+ err:
+	for (i = 0; i < npfd; i++)
+		close(pfd[i].fd);
+	free(pfd);
+	free(ai);
+
+	return s;
+}
+
+int
+tls_connect_addrinfo(struct tls *ctx, const struct addrinfo *res0,
+    const char *servername)
+{
+	int s;
+
+	if ((ctx->flags & TLS_CLIENT) == 0) {
+		tls_set_errorx(ctx, "not a client context");
+		return -1;
+	}
+	if (res0 == NULL) {
+		tls_set_errorx(ctx, "no address to connect to");
+		return -1;
+	}
+
+	if ((s = tls_connect_happy(ctx, res0)) == -1)
+		return -1;
+
+	if (tls_connect_socket(ctx, s, servername) != 0) {
+		close(s);
+		return -1;
+	}
+
+	ctx->socket = s;
+
+	return 0;
+}
+
 int
 tls_connect_servername(struct tls *ctx, const char *host, const char *port,
     const char *servername)
 {
-	struct addrinfo hints, *res, *res0;
+	struct addrinfo hints, *res0;
 	const char *h = NULL, *p = NULL;
 	char *hs = NULL, *ps = NULL;
-	int rv = -1, s = -1, ret;
+	int rv = -1, s, ret;
 
 	if ((ctx->flags & TLS_CLIENT) == 0) {
 		tls_set_errorx(ctx, "not a client context");
@@ -122,39 +325,11 @@ tls_connect_servername(struct tls *ctx, const char *host, const char *port,
 		}
 	}
 
-	/* It was resolved somehow; now try connecting to what we got */
-	s = -1;
-	for (res = res0; res; res = res->ai_next) {
-		s = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
-		if (s == -1) {
-			tls_set_error(ctx, "socket");
-			continue;
-		}
-		if (connect(s, res->ai_addr, res->ai_addrlen) == -1) {
-			tls_set_error(ctx, "connect");
-			close(s);
-			s = -1;
-			continue;
-		}
-
-		break;  /* Connected. */
-	}
-	freeaddrinfo(res0);
-
-	if (s == -1)
-		goto err;
-
 	if (servername == NULL)
 		servername = h;
 
-	if (tls_connect_socket(ctx, s, servername) != 0) {
-		close(s);
-		goto err;
-	}
-
-	ctx->socket = s;
-
-	rv = 0;
+	rv = tls_connect_addrinfo(ctx, res0, servername);
+	freeaddrinfo(res0);
 
  err:
 	free(hs);
@@ -275,8 +450,70 @@ tls_client_write_session(struct tls *ctx)
 	return (rv);
 }
 
+/*
+ * Sessions in the session cache are keyed by the server name and the port
+ * that is connected to, where the latter is known.
+ */
+static int
+tls_client_peer_port(int fd)
+{
+	struct sockaddr_storage ss;
+	socklen_t len = sizeof(ss);
+
+	if (getpeername(fd, (struct sockaddr *)&ss, &len) == -1)
+		return 0;
+	if (ss.ss_family == AF_INET)
+		return ntohs(((struct sockaddr_in *)&ss)->sin_port);
+	if (ss.ss_family == AF_INET6)
+		return ntohs(((struct sockaddr_in6 *)&ss)->sin6_port);
+
+	return 0;
+}
+
+static int
+tls_client_new_session_cb(SSL *ssl, SSL_SESSION *session)
+{
+	struct tls *ctx;
+
+	if ((ctx = SSL_get_app_data(ssl)) == NULL ||
+	    ctx->servername == NULL)
+		return 0;
+
+	tls_session_cache_put(ctx->config->session_cache, ctx->servername,
+	    ctx->port, session);
+
+	return 1;
+}
+
+static int
+tls_client_cached_session(struct tls *ctx)
+{
+	SSL_SESSION *ss;
+	int rv = -1;
+
+	SSL_CTX_set_session_cache_mode(ctx->ssl_ctx,
+	    SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+	SSL_CTX_sess_set_new_cb(ctx->ssl_ctx, tls_client_new_session_cb);
+
+	if ((ss = tls_session_cache_get(ctx->config->session_cache,
+	    ctx->servername, ctx->port)) == NULL)
+		return 0;
+
+	if (SSL_set_session(ctx->ssl_conn, ss) != 1) {
+		tls_set_errorx(ctx, "failed to set session");
+		goto err;
+	}
+
+	rv = 0;
+
+ err:
+	SSL_SESSION_free(ss);
+
+	return rv;
+}
+
 static int
-tls_connect_common(struct tls *ctx, const char *servername)
+tls_connect_common(struct tls *ctx, const char *servername, int port)
 {
 	union tls_addr addrbuf;
 	size_t servername_len;
@@ -287,6 +524,8 @@ tls_connect_common(struct tls *ctx, const char *servername)
 		goto err;
 	}
 
+	ctx->port = port;
+
 	if (servername != NULL) {
 		if ((ctx->servername = strdup(servername)) == NULL) {
 			tls_set_errorx(ctx, "out of memory");
@@ -354,6 +593,11 @@ tls_connect_common(struct tls *ctx, const char *servername)
 		SSL_clear_options(ctx->ssl_conn, SSL_OP_NO_TICKET);
 		if (tls_client_read_session(ctx) == -1)
 			goto err;
+	} else if (ctx->config->session_cache != NULL &&
+	    ctx->servername != NULL) {
+		SSL_clear_options(ctx->ssl_conn, SSL_OP_NO_TICKET);
+		if (tls_client_cached_session(ctx) == -1)
+			goto err;
 	}
 
 	if (SSL_set_tlsext_status_type(ctx->ssl_conn, TLSEXT_STATUSTYPE_ocsp) != 1) {
@@ -399,11 +643,11 @@ tls_connect_fds(struct tls *ctx, int fd_read, int fd_write,
 		goto err;
 	}
 
-	if (tls_connect_common(ctx, servername) != 0)
+	if (tls_connect_common(ctx, servername,
+	    tls_client_peer_port(fd_read)) != 0)
 		goto err;
 
-	if (SSL_set_rfd(ctx->ssl_conn, fd_read) != 1 ||
-	    SSL_set_wfd(ctx->ssl_conn, fd_write) != 1) {
+	if (tls_set_fds(ctx, fd_read, fd_write) != 0) {
 		tls_set_errorx(ctx, "ssl file descriptor failure");
 		goto err;
 	}
@@ -419,7 +663,7 @@ tls_connect_cbs(struct tls *ctx, tls_read_cb read_cb,
 {
 	int rv = -1;
 
-	if (tls_connect_common(ctx, servername) != 0)
+	if (tls_connect_common(ctx, servername, 0) != 0)
 		goto err;
 
 	if (tls_set_cbs(ctx, read_cb, write_cb, cb_arg) != 0)
@@ -165,11 +165,17 @@ tls_config_free(struct tls_config *config)
 	if (refcount > 0)
 		return;
 
+	/* The refresh thread uses the keypairs until it has stopped. */
+	tls_ocsp_refresh_free(config->ocsp_refresh);
+
 	for (kp = config->keypair; kp != NULL; kp = nkp) {
 		nkp = kp->next;
 		tls_keypair_free(kp);
 	}
 
+	tls_ca_cache_release(config);
+	tls_session_cache_free(config->session_cache);
+
 	free(config->error.msg);
 
 	free(config->alpn);
@@ -434,6 +440,7 @@ tls_config_add_keypair_ocsp_file(struct tls_config *config,
 int
 tls_config_set_ca_file(struct tls_config *config, const char *ca_file)
 {
+	tls_ca_cache_release(config);
 	return tls_config_load_file(&config->error, "CA", ca_file,
 	    &config->ca_mem, &config->ca_len);
 }
@@ -441,12 +448,14 @@ tls_config_set_ca_file(struct tls_config *config, const char *ca_file)
 int
 tls_config_set_ca_path(struct tls_config *config, const char *ca_path)
 {
+	tls_ca_cache_release(config);
 	return tls_set_string(&config->ca_path, ca_path);
 }
 
 int
 tls_config_set_ca_mem(struct tls_config *config, const uint8_t *ca, size_t len)
 {
+	tls_ca_cache_release(config);
 	return tls_set_mem(&config->ca_mem, &config->ca_len, ca, len);
 }
 
@@ -502,6 +511,7 @@ tls_config_set_ciphers(struct tls_config *config, const char *ciphers)
 int
 tls_config_set_crl_file(struct tls_config *config, const char *crl_file)
 {
+	tls_ca_cache_release(config);
 	return tls_config_load_file(&config->error, "CRL", crl_file,
 	    &config->crl_mem, &config->crl_len);
 }
@@ -510,6 +520,7 @@ int
 tls_config_set_crl_mem(struct tls_config *config, const uint8_t *crl,
     size_t len)
 {
+	tls_ca_cache_release(config);
 	return tls_set_mem(&config->crl_mem, &config->crl_len, crl, len);
 }
 
@@ -737,6 +748,22 @@ tls_config_set_session_fd(struct tls_config *config, int session_fd)
 	return (0);
 }
 
+int
+tls_config_set_session_cache_size(struct tls_config *config, size_t size)
+{
+	struct tls_session_cache *cache = NULL;
+
+	if (size > 0 && (cache = tls_session_cache_new(size)) == NULL) {
+		tls_config_set_errorx(config, "out of memory");
+		return (-1);
+	}
+
+	tls_session_cache_free(config->session_cache);
+	config->session_cache = cache;
+
+	return (0);
+}
+
 int
 tls_config_set_verify_depth(struct tls_config *config, int verify_depth)
 {
@@ -757,6 +784,30 @@ tls_config_prefer_ciphers_server(struct tls_config *config)
 	config->ciphers_server = 1;
 }
 
+void
+tls_config_enable_ktls(struct tls_config *config)
+{
+	config->ktls = 1;
+}
+
+void
+tls_config_enable_read_ahead(struct tls_config *config)
+{
+	config->read_ahead = 1;
+}
+
+void
+tls_config_enable_metrics(struct tls_config *config)
+{
+	config->metrics = 1;
+}
+
+void
+tls_config_enable_tcp_fastopen(struct tls_config *config)
+{
+	config->tcp_fastopen = 1;
+}
+
 void
 tls_config_insecure_noverifycert(struct tls_config *config)
 {
@@ -789,6 +840,12 @@ tls_config_ocsp_require_stapling(struct tls_config *config)
 	config->ocsp_require_stapling = 1;
 }
 
+void
+tls_config_ocsp_refresh_staples(struct tls_config *config)
+{
+	config->ocsp_refresh_staples = 1;
+}
+
 void
 tls_config_verify_client(struct tls_config *config)
 {
@@ -859,7 +916,15 @@ tls_config_set_session_lifetime(struct tls_config *config, int lifetime)
 }
 
 int
-tls_config_add_ticket_key(struct tls_config *config, uint32_t keyrev,
+tls_config_set_max_early_data(struct tls_config *config,
+    uint32_t max_early_data)
+{
+	config->max_early_data = max_early_data;
+	return (0);
+}
+
+static int
+tls_config_ticket_key_add(struct tls_config *config, uint32_t keyrev,
     unsigned char *key, size_t keylen)
 {
 	struct tls_ticket_key newkey;
@@ -898,12 +963,31 @@ tls_config_add_ticket_key(struct tls_config *config, uint32_t keyrev,
 	memmove(&config->ticket_keys[1], &config->ticket_keys[0],
 	    sizeof(config->ticket_keys) - sizeof(config->ticket_keys[0]));
 	config->ticket_keys[0] = newkey;
+	explicit_bzero(&newkey, sizeof(newkey));
 
 	config->ticket_autorekey = 0;
 
 	return (0);
 }
 
+/*
+ * The ticket keys may be added to while servers that use the config are
+ * handshaking in other threads, so they are protected by its mutex.
+ */
+int
+tls_config_add_ticket_key(struct tls_config *config, uint32_t keyrev,
+    unsigned char *key, size_t keylen)
+{
+	int rv;
+
+	pthread_mutex_lock(&config->mutex);
+	rv = tls_config_ticket_key_add(config, keyrev, key, keylen);
+	pthread_mutex_unlock(&config->mutex);
+
+	return (rv);
+}
+
+/* Must be called with the config mutex held. */
 int
 tls_config_ticket_autorekey(struct tls_config *config)
 {
@@ -911,8 +995,10 @@ tls_config_ticket_autorekey(struct tls_config *config)
 	int rv;
 
 	arc4random_buf(key, sizeof(key));
-	rv = tls_config_add_ticket_key(config, config->ticket_keyrev++, key,
+	rv = tls_config_ticket_key_add(config, config->ticket_keyrev++, key,
 	    sizeof(key));
 	config->ticket_autorekey = 1;
+	explicit_bzero(key, sizeof(key));
+
 	return (rv);
 }
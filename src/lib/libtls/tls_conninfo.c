@@ -136,6 +136,13 @@ tls_get_peer_cert_times(struct tls *ctx, time_t *notbefore,
 static int
 tls_get_peer_cert_info(struct tls *ctx)
 {
+	free(ctx->conninfo->hash);
+	free(ctx->conninfo->subject);
+	free(ctx->conninfo->issuer);
+	ctx->conninfo->hash = NULL;
+	ctx->conninfo->subject = NULL;
+	ctx->conninfo->issuer = NULL;
+
 	if (ctx->ssl_peer_cert == NULL)
 		return (0);
 
@@ -217,61 +224,92 @@ tls_conninfo_cert_pem(struct tls *ctx)
 }
 
 static int
-tls_conninfo_session(struct tls *ctx)
-{
-	ctx->conninfo->session_resumed = SSL_session_reused(ctx->ssl_conn);
-
-	return 0;
-}
-
-int
-tls_conninfo_populate(struct tls *ctx)
+tls_conninfo_conn(struct tls *ctx)
 {
 	const char *tmp;
 
-	tls_conninfo_free(ctx->conninfo);
-
-	if ((ctx->conninfo = calloc(1, sizeof(struct tls_conninfo))) == NULL) {
-		tls_set_errorx(ctx, "out of memory");
-		goto err;
-	}
-
-	if (tls_conninfo_alpn_proto(ctx) == -1)
-		goto err;
+	free(ctx->conninfo->cipher);
+	free(ctx->conninfo->servername);
+	free(ctx->conninfo->version);
+	ctx->conninfo->cipher = NULL;
+	ctx->conninfo->servername = NULL;
+	ctx->conninfo->version = NULL;
 
 	if ((tmp = SSL_get_cipher(ctx->ssl_conn)) == NULL)
-		goto err;
+		return (-1);
 	if ((ctx->conninfo->cipher = strdup(tmp)) == NULL)
-		goto err;
+		return (-1);
 	ctx->conninfo->cipher_strength = SSL_get_cipher_bits(ctx->ssl_conn, NULL);
 
 	if (ctx->servername != NULL) {
 		if ((ctx->conninfo->servername =
 		    strdup(ctx->servername)) == NULL)
-			goto err;
+			return (-1);
 	}
 
 	if ((tmp = SSL_get_version(ctx->ssl_conn)) == NULL)
-		goto err;
+		return (-1);
 	if ((ctx->conninfo->version = strdup(tmp)) == NULL)
-		goto err;
+		return (-1);
 
-	if (tls_get_peer_cert_info(ctx) == -1)
-		goto err;
+	return (0);
+}
 
-	if (tls_conninfo_cert_pem(ctx) == -1)
-		goto err;
+/*
+ * Only the connection information that is cheap to gather is filled in
+ * once the handshake has completed - the rest is left to
+ * tls_conninfo_get(), since most connections never ask for it.
+ */
+int
+tls_conninfo_populate(struct tls *ctx)
+{
+	tls_conninfo_free(ctx->conninfo);
 
-	if (tls_conninfo_session(ctx) == -1)
-		goto err;
+	if ((ctx->conninfo = calloc(1, sizeof(struct tls_conninfo))) == NULL) {
+		tls_set_errorx(ctx, "out of memory");
+		return (-1);
+	}
+
+	ctx->conninfo->session_resumed = SSL_session_reused(ctx->ssl_conn);
 
 	return (0);
+}
 
- err:
-	tls_conninfo_free(ctx->conninfo);
-	ctx->conninfo = NULL;
+/*
+ * Return the connection information with the given TLS_CONNINFO_* group
+ * filled in, or NULL if the handshake has not completed or the group could
+ * not be gathered.
+ */
+struct tls_conninfo *
+tls_conninfo_get(struct tls *ctx, int field)
+{
+	int rv = -1;
 
-	return (-1);
+	if (ctx->conninfo == NULL)
+		return (NULL);
+	if ((ctx->conninfo->fields & field) == field)
+		return (ctx->conninfo);
+
+	switch (field) {
+	case TLS_CONNINFO_ALPN:
+		rv = tls_conninfo_alpn_proto(ctx);
+		break;
+	case TLS_CONNINFO_CONN:
+		rv = tls_conninfo_conn(ctx);
+		break;
+	case TLS_CONNINFO_PEER_CERT:
+		rv = tls_get_peer_cert_info(ctx);
+		break;
+	case TLS_CONNINFO_PEER_CHAIN:
+		rv = tls_conninfo_cert_pem(ctx);
+		break;
+	}
+	if (rv == -1)
+		return (NULL);
+
+	ctx->conninfo->fields |= field;
+
+	return (ctx->conninfo);
 }
 
 void
@@ -297,33 +335,41 @@ tls_conninfo_free(struct tls_conninfo *conninfo)
 const char *
 tls_conn_alpn_selected(struct tls *ctx)
 {
-	if (ctx->conninfo == NULL)
+	struct tls_conninfo *conninfo;
+
+	if ((conninfo = tls_conninfo_get(ctx, TLS_CONNINFO_ALPN)) == NULL)
 		return (NULL);
-	return (ctx->conninfo->alpn);
+	return (conninfo->alpn);
 }
 
 const char *
 tls_conn_cipher(struct tls *ctx)
 {
-	if (ctx->conninfo == NULL)
+	struct tls_conninfo *conninfo;
+
+	if ((conninfo = tls_conninfo_get(ctx, TLS_CONNINFO_CONN)) == NULL)
 		return (NULL);
-	return (ctx->conninfo->cipher);
+	return (conninfo->cipher);
 }
 
 int
 tls_conn_cipher_strength(struct tls *ctx)
 {
-	if (ctx->conninfo == NULL)
+	struct tls_conninfo *conninfo;
+
+	if ((conninfo = tls_conninfo_get(ctx, TLS_CONNINFO_CONN)) == NULL)
 		return (0);
-	return (ctx->conninfo->cipher_strength);
+	return (conninfo->cipher_strength);
 }
 
 const char *
 tls_conn_servername(struct tls *ctx)
 {
-	if (ctx->conninfo == NULL)
+	struct tls_conninfo *conninfo;
+
+	if ((conninfo = tls_conninfo_get(ctx, TLS_CONNINFO_CONN)) == NULL)
 		return (NULL);
-	return (ctx->conninfo->servername);
+	return (conninfo->servername);
 }
 
 int
@@ -337,7 +383,9 @@ tls_conn_session_resumed(struct tls *ctx)
 const char *
 tls_conn_version(struct tls *ctx)
 {
-	if (ctx->conninfo == NULL)
+	struct tls_conninfo *conninfo;
+
+	if ((conninfo = tls_conninfo_get(ctx, TLS_CONNINFO_CONN)) == NULL)
 		return (NULL);
-	return (ctx->conninfo->version);
+	return (conninfo->version);
 }
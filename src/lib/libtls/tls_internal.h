@@ -24,6 +24,7 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 
+#include <openssl/sha.h>
 #include <openssl/ssl.h>
 
 __BEGIN_HIDDEN_DECLS
@@ -50,6 +51,22 @@ struct tls_error {
 	int tls;
 };
 
+struct tls_ca_store;
+struct tls_ocsp_refresh;
+struct tls_parsed_keypair;
+struct tls_session_cache;
+
+/*
+ * An OCSP staple, shared by its keypair and the handshakes that are sending
+ * it, so that it can be replaced while the keypair is in use.
+ */
+struct tls_ocsp_staple {
+	int refcount;
+
+	unsigned char *data;
+	size_t len;
+};
+
 struct tls_keypair {
 	struct tls_keypair *next;
 
@@ -57,14 +74,25 @@ struct tls_keypair {
 	size_t cert_len;
 	char *key_mem;
 	size_t key_len;
-	char *ocsp_staple;
-	size_t ocsp_staple_len;
+	struct tls_ocsp_staple *ocsp_staple;
 	char *pubkey_hash;
+
+	struct tls_parsed_keypair *parsed;
 };
 
 #define TLS_MIN_SESSION_TIMEOUT (4)
 #define TLS_MAX_SESSION_TIMEOUT (24 * 60 * 60)
 
+#define TLS_SENDFILE_BUF_LEN			16384
+#define TLS_READ_AHEAD_BUF_LEN			32768
+
+/* Verified chains, including OCSP responders, kept per context. */
+#define TLS_VERIFY_CACHE_SIZE			64
+
+/* Allowed age and clock skew for OCSP responses. */
+#define TLS_OCSP_MAXAGE_SEC			(14 * 24 * 60 * 60)
+#define TLS_OCSP_JITTER_SEC			60
+
 #define TLS_NUM_TICKETS				4
 #define TLS_TICKET_NAME_SIZE			16
 #define TLS_TICKET_AES_SIZE			32
@@ -93,15 +121,24 @@ struct tls_config {
 	int ciphers_server;
 	char *crl_mem;
 	size_t crl_len;
+	struct tls_ca_store *ca_store;
 	int dheparams;
 	int *ecdhecurves;
 	size_t ecdhecurves_len;
 	struct tls_keypair *keypair;
+	int ktls;
+	uint32_t max_early_data;
 	int ocsp_require_stapling;
+	int ocsp_refresh_staples;
+	struct tls_ocsp_refresh *ocsp_refresh;
 	uint32_t protocols;
+	int read_ahead;
+	int metrics;
 	unsigned char session_id[TLS_MAX_SESSION_ID_LENGTH];
 	int session_fd;
 	int session_lifetime;
+	struct tls_session_cache *session_cache;
+	int tcp_fastopen;
 	struct tls_ticket_key ticket_keys[TLS_NUM_TICKETS];
 	uint32_t ticket_keyrev;
 	int ticket_autorekey;
@@ -114,7 +151,18 @@ struct tls_config {
 	int use_fake_private_key;
 };
 
+#define TLS_CONNINFO_ALPN	(1 << 0)
+#define TLS_CONNINFO_CONN	(1 << 1)
+#define TLS_CONNINFO_PEER_CERT	(1 << 2)
+#define TLS_CONNINFO_PEER_CHAIN	(1 << 3)
+
+/*
+ * Connection information is only gathered when it is first asked for -
+ * fields records which of the TLS_CONNINFO_* groups have been filled in.
+ */
 struct tls_conninfo {
+	int fields;
+
 	char *alpn;
 	char *cipher;
 	int cipher_strength;
@@ -166,12 +214,30 @@ struct tls_ocsp {
 struct tls_sni_ctx {
 	struct tls_sni_ctx *next;
 
+	struct tls_config *config;
 	struct tls_keypair *keypair;
+	struct tls_keypair *alt_keypair;
+	int alt_pkey_type;
+	unsigned char digest[SHA256_DIGEST_LENGTH];
 
 	SSL_CTX *ssl_ctx;
 	X509 *ssl_cert;
 };
 
+/*
+ * The SSL contexts of a configured server, which are shared with the
+ * connections that it accepts. A server that is configured again keeps
+ * the contexts of any keypair and settings that are unchanged, while the
+ * connections already accepted continue with the contexts they started with.
+ */
+struct tls_server_ssl {
+	int refcount;
+
+	struct tls_sni_ctx *keypair_ctx;
+	struct tls_sni_ctx *sni_ctx;
+	struct tls_sni_index *sni_index;
+};
+
 struct tls {
 	struct tls_config *config;
 	struct tls_keypair *keypair;
@@ -182,12 +248,14 @@ struct tls {
 	uint32_t state;
 
 	char *servername;
+	int port;
 	int socket;
 
 	SSL *ssl_conn;
 	SSL_CTX *ssl_ctx;
 
-	struct tls_sni_ctx *sni_ctx;
+	struct tls_server_ssl *server_ssl;
+	struct tls_sni_ctx *keypair_ctx;
 
 	X509 *ssl_peer_cert;
 	STACK_OF(X509) *ssl_peer_chain;
@@ -196,9 +264,14 @@ struct tls {
 
 	struct tls_ocsp *ocsp;
 
+	struct tls_metrics *metrics;
+	uint64_t metrics_records_written;
+
 	tls_read_cb read_cb;
 	tls_write_cb write_cb;
 	void *cb_arg;
+
+	unsigned char *sendfile_buf;
 };
 
 int tls_set_mem(char **_dest, size_t *_destlen, const void *_src,
@@ -223,17 +296,52 @@ int tls_keypair_set_ocsp_staple_mem(struct tls_keypair *_keypair,
 int tls_keypair_load_cert(struct tls_keypair *_keypair,
     struct tls_error *_error, X509 **_cert);
 
+struct tls_ocsp_staple *tls_ocsp_staple_new(unsigned char *_data,
+    size_t _len);
+void tls_ocsp_staple_free(struct tls_ocsp_staple *_staple);
+struct tls_ocsp_staple *tls_keypair_ocsp_staple(struct tls_keypair *_keypair);
+void tls_keypair_set_ocsp_staple(struct tls_keypair *_keypair,
+    struct tls_ocsp_staple *_staple);
+
+struct tls_parsed_keypair *tls_keypair_cache_get(struct tls_keypair *_keypair,
+    struct tls_error *_error);
+void tls_keypair_cache_put(struct tls_parsed_keypair *_parsed);
+void tls_keypair_cache_release(struct tls_keypair *_keypair);
+int tls_keypair_cache_use(struct tls *_ctx, SSL_CTX *_ssl_ctx,
+    struct tls_parsed_keypair *_parsed);
+
+X509_STORE *tls_ca_cache_get(struct tls_config *_config,
+    struct tls_error *_error);
+void tls_ca_cache_release(struct tls_config *_config);
+
+struct tls_session_cache *tls_session_cache_new(size_t _size);
+void tls_session_cache_free(struct tls_session_cache *_cache);
+SSL_SESSION *tls_session_cache_get(struct tls_session_cache *_cache,
+    const char *_servername, int _port);
+void tls_session_cache_put(struct tls_session_cache *_cache,
+    const char *_servername, int _port, SSL_SESSION *_session);
+int tls_ca_store_add_crls(struct tls_error *_error, X509_STORE *_store,
+    const char *_crl_mem, size_t _crl_len);
+
 struct tls_sni_ctx *tls_sni_ctx_new(void);
 void tls_sni_ctx_free(struct tls_sni_ctx *sni_ctx);
 
+struct tls_sni_index;
+struct tls_sni_index *tls_sni_index_build(struct tls *ctx,
+    struct tls_sni_ctx *sni_ctx);
+struct tls_sni_ctx *tls_sni_index_lookup(struct tls_sni_index *index,
+    const char *name);
+void tls_sni_index_free(struct tls_sni_index *index);
+
 struct tls_config *tls_config_new_internal(void);
 
 struct tls *tls_new(void);
 struct tls *tls_server_conn(struct tls *ctx);
+void tls_server_ssl_free(struct tls_server_ssl *server_ssl);
 
 int tls_check_name(struct tls *ctx, X509 *cert, const char *servername,
     int *match);
-int tls_configure_server(struct tls *ctx);
+int tls_configure_server(struct tls *ctx, struct tls_config *config);
 
 int tls_configure_ssl(struct tls *ctx, SSL_CTX *ssl_ctx);
 int tls_configure_ssl_keypair(struct tls *ctx, SSL_CTX *ssl_ctx,
@@ -248,6 +356,7 @@ int tls_config_load_file(struct tls_error *error, const char *filetype,
 int tls_config_ticket_autorekey(struct tls_config *config);
 int tls_host_port(const char *hostport, char **host, char **port);
 
+int tls_set_fds(struct tls *ctx, int fd_read, int fd_write);
 int tls_set_cbs(struct tls *ctx,
     tls_read_cb read_cb, tls_write_cb write_cb, void *cb_arg);
 
@@ -277,13 +386,23 @@ int tls_set_ssl_errorx(struct tls *ctx, const char *fmt, ...)
 int tls_ssl_error(struct tls *ctx, SSL *ssl_conn, int ssl_ret,
     const char *prefix);
 
+int tls_metrics_handshake_start(struct tls *ctx);
+void tls_metrics_handshake(struct tls *ctx, int rv);
 int tls_conninfo_populate(struct tls *ctx);
+struct tls_conninfo *tls_conninfo_get(struct tls *ctx, int field);
 void tls_conninfo_free(struct tls_conninfo *conninfo);
 
 int tls_ocsp_verify_cb(SSL *ssl, void *arg);
 int tls_ocsp_stapling_cb(SSL *ssl, void *arg);
 void tls_ocsp_free(struct tls_ocsp *ctx);
 struct tls_ocsp *tls_ocsp_setup_from_peer(struct tls *ctx);
+int tls_ocsp_asn1_parse_time(ASN1_GENERALIZEDTIME *_gt, time_t *_gt_time);
+
+int tls_ocsp_refresh_start(struct tls_config *_config,
+    struct tls_error *_error);
+void tls_ocsp_refresh_free(struct tls_ocsp_refresh *_refresh);
+time_t tls_ocsp_refresh_time(time_t _now, time_t _this_update,
+    time_t _next_update);
 int tls_hex_string(const unsigned char *_in, size_t _inlen, char **_out,
     size_t *_outlen);
 int tls_cert_hash(X509 *_cert, char **_hash);
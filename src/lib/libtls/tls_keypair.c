@@ -23,6 +23,9 @@
 
 #include "tls_internal.h"
 
+/* Protects the staple of each keypair and the staple reference counts. */
+static pthread_mutex_t tls_ocsp_staple_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 struct tls_keypair *
 tls_keypair_new(void)
 {
@@ -59,6 +62,8 @@ tls_keypair_pubkey_hash(struct tls_keypair *keypair, struct tls_error *error)
 void
 tls_keypair_clear_key(struct tls_keypair *keypair)
 {
+	tls_keypair_cache_release(keypair);
+
 	freezero(keypair->key_mem, keypair->key_len);
 	keypair->key_mem = NULL;
 	keypair->key_len = 0;
@@ -68,6 +73,7 @@ int
 tls_keypair_set_cert_file(struct tls_keypair *keypair, struct tls_error *error,
     const char *cert_file)
 {
+	tls_keypair_cache_release(keypair);
 	if (tls_config_load_file(error, "certificate", cert_file,
 	    &keypair->cert_mem, &keypair->cert_len) == -1)
 		return -1;
@@ -78,6 +84,7 @@ int
 tls_keypair_set_cert_mem(struct tls_keypair *keypair, struct tls_error *error,
     const uint8_t *cert, size_t len)
 {
+	tls_keypair_cache_release(keypair);
 	if (tls_set_mem(&keypair->cert_mem, &keypair->cert_len, cert, len) == -1)
 		return -1;
 	return tls_keypair_pubkey_hash(keypair, error);
@@ -100,20 +107,122 @@ tls_keypair_set_key_mem(struct tls_keypair *keypair, struct tls_error *error,
 	return tls_set_mem(&keypair->key_mem, &keypair->key_len, key, len);
 }
 
+/*
+ * A staple takes ownership of data, which is freed with the staple once the
+ * keypair and every handshake using it have dropped their references.
+ */
+struct tls_ocsp_staple *
+tls_ocsp_staple_new(unsigned char *data, size_t len)
+{
+	struct tls_ocsp_staple *staple;
+
+	if ((staple = calloc(1, sizeof(*staple))) == NULL)
+		return NULL;
+
+	staple->refcount = 1;
+	staple->data = data;
+	staple->len = len;
+
+	return staple;
+}
+
+void
+tls_ocsp_staple_free(struct tls_ocsp_staple *staple)
+{
+	int refcount;
+
+	if (staple == NULL)
+		return;
+
+	pthread_mutex_lock(&tls_ocsp_staple_mutex);
+	refcount = --staple->refcount;
+	pthread_mutex_unlock(&tls_ocsp_staple_mutex);
+
+	if (refcount > 0)
+		return;
+
+	free(staple->data);
+	free(staple);
+}
+
+/*
+ * Return the current staple of a keypair with a reference for the caller,
+ * or NULL if it has none.
+ */
+struct tls_ocsp_staple *
+tls_keypair_ocsp_staple(struct tls_keypair *keypair)
+{
+	struct tls_ocsp_staple *staple;
+
+	pthread_mutex_lock(&tls_ocsp_staple_mutex);
+	if ((staple = keypair->ocsp_staple) != NULL)
+		staple->refcount++;
+	pthread_mutex_unlock(&tls_ocsp_staple_mutex);
+
+	return staple;
+}
+
+/*
+ * Replace the staple of a keypair, taking over the caller's reference to
+ * the new one. Handshakes that hold the old one continue to send it.
+ */
+void
+tls_keypair_set_ocsp_staple(struct tls_keypair *keypair,
+    struct tls_ocsp_staple *staple)
+{
+	struct tls_ocsp_staple *old;
+
+	pthread_mutex_lock(&tls_ocsp_staple_mutex);
+	old = keypair->ocsp_staple;
+	keypair->ocsp_staple = staple;
+	pthread_mutex_unlock(&tls_ocsp_staple_mutex);
+
+	tls_ocsp_staple_free(old);
+}
+
 int
 tls_keypair_set_ocsp_staple_file(struct tls_keypair *keypair,
     struct tls_error *error, const char *ocsp_file)
 {
-	return tls_config_load_file(error, "ocsp", ocsp_file,
-	    &keypair->ocsp_staple, &keypair->ocsp_staple_len);
+	struct tls_ocsp_staple *staple;
+	char *buf = NULL;
+	size_t len = 0;
+
+	if (tls_config_load_file(error, "ocsp", ocsp_file, &buf, &len) == -1)
+		return -1;
+	if ((staple = tls_ocsp_staple_new((unsigned char *)buf,
+	    len)) == NULL) {
+		tls_error_setx(error, "out of memory");
+		free(buf);
+		return -1;
+	}
+	tls_keypair_set_ocsp_staple(keypair, staple);
+
+	return 0;
 }
 
 int
 tls_keypair_set_ocsp_staple_mem(struct tls_keypair *keypair,
     struct tls_error *error, const uint8_t *staple, size_t len)
 {
-	return tls_set_mem(&keypair->ocsp_staple, &keypair->ocsp_staple_len,
-	    staple, len);
+	struct tls_ocsp_staple *ocsp_staple = NULL;
+	unsigned char *buf;
+
+	if (staple != NULL && len > 0) {
+		if ((buf = malloc(len)) == NULL) {
+			tls_error_setx(error, "out of memory");
+			return -1;
+		}
+		memcpy(buf, staple, len);
+		if ((ocsp_staple = tls_ocsp_staple_new(buf, len)) == NULL) {
+			tls_error_setx(error, "out of memory");
+			free(buf);
+			return -1;
+		}
+	}
+	tls_keypair_set_ocsp_staple(keypair, ocsp_staple);
+
+	return 0;
 }
 
 void
@@ -125,7 +234,7 @@ tls_keypair_free(struct tls_keypair *keypair)
 	tls_keypair_clear_key(keypair);
 
 	free(keypair->cert_mem);
-	free(keypair->ocsp_staple);
+	tls_ocsp_staple_free(keypair->ocsp_staple);
 	free(keypair->pubkey_hash);
 
 	free(keypair);
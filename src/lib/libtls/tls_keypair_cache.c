@@ -0,0 +1,253 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Parsed keypair cache.
+ *
+ * The certificate chain and private key of a keypair are decoded once and
+ * shared by every SSL context that is set up from a keypair with the same
+ * contents, across all configurations in the process. An entry is found
+ * by a digest of the PEM encoded certificate and key, and is referenced
+ * by the keypairs that use it - it is freed once the last of these has
+ * been freed or has had its certificate or key replaced or cleared.
+ */
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/sha.h>
+
+#include <tls.h>
+#include "tls_internal.h"
+
+#define TLS_KEYPAIR_CACHE_BUCKETS	64
+
+struct tls_parsed_keypair {
+	struct tls_parsed_keypair *next;
+	int refcount;
+
+	unsigned char digest[SHA256_DIGEST_LENGTH];
+
+	X509 *cert;
+	STACK_OF(X509) *chain;
+	EVP_PKEY *pkey;
+};
+
+static pthread_mutex_t tls_keypair_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct tls_parsed_keypair *tls_keypair_cache[TLS_KEYPAIR_CACHE_BUCKETS];
+
+static void
+tls_keypair_cache_digest(struct tls_keypair *keypair, unsigned char *digest)
+{
+	SHA256_CTX sha;
+
+	SHA256_Init(&sha);
+	SHA256_Update(&sha, &keypair->cert_len, sizeof(keypair->cert_len));
+	SHA256_Update(&sha, keypair->cert_mem, keypair->cert_len);
+	SHA256_Update(&sha, &keypair->key_len, sizeof(keypair->key_len));
+	SHA256_Update(&sha, keypair->key_mem, keypair->key_len);
+	SHA256_Final(digest, &sha);
+}
+
+static void
+tls_parsed_keypair_free(struct tls_parsed_keypair *parsed)
+{
+	X509_free(parsed->cert);
+	sk_X509_pop_free(parsed->chain, X509_free);
+	EVP_PKEY_free(parsed->pkey);
+	free(parsed);
+}
+
+/*
+ * Decode a keypair in the same way as SSL_CTX_use_certificate_chain_mem()
+ * and tls_keypair_to_pkey() do.
+ */
+static struct tls_parsed_keypair *
+tls_parsed_keypair_new(struct tls_keypair *keypair, struct tls_error *error)
+{
+	struct tls_parsed_keypair *parsed;
+	BIO *bio = NULL;
+	unsigned long err;
+	X509 *ca;
+
+	if (keypair->cert_len > INT_MAX || keypair->key_len > INT_MAX) {
+		tls_error_setx(error, "keypair too long");
+		return (NULL);
+	}
+
+	if ((parsed = calloc(1, sizeof(*parsed))) == NULL) {
+		tls_error_setx(error, "out of memory");
+		return (NULL);
+	}
+
+	if ((bio = BIO_new_mem_buf(keypair->cert_mem,
+	    keypair->cert_len)) == NULL) {
+		tls_error_setx(error, "failed to create buffer");
+		goto err;
+	}
+	if ((parsed->cert = PEM_read_bio_X509_AUX(bio, NULL, tls_password_cb,
+	    NULL)) == NULL) {
+		tls_error_setx(error, "failed to load certificate");
+		goto err;
+	}
+	while ((ca = PEM_read_bio_X509(bio, NULL, tls_password_cb,
+	    NULL)) != NULL) {
+		if ((parsed->chain == NULL &&
+		    (parsed->chain = sk_X509_new_null()) == NULL) ||
+		    sk_X509_push(parsed->chain, ca) == 0) {
+			X509_free(ca);
+			tls_error_setx(error, "out of memory");
+			goto err;
+		}
+	}
+	err = ERR_peek_last_error();
+	if (ERR_GET_LIB(err) != ERR_LIB_PEM ||
+	    ERR_GET_REASON(err) != PEM_R_NO_START_LINE) {
+		tls_error_setx(error, "failed to load certificate");
+		goto err;
+	}
+	ERR_clear_error();
+	BIO_free(bio);
+
+	if ((bio = BIO_new_mem_buf(keypair->key_mem,
+	    keypair->key_len)) == NULL) {
+		tls_error_setx(error, "failed to create buffer");
+		goto err;
+	}
+	if ((parsed->pkey = PEM_read_bio_PrivateKey(bio, NULL,
+	    tls_password_cb, NULL)) == NULL) {
+		tls_error_setx(error, "failed to read private key");
+		goto err;
+	}
+	BIO_free(bio);
+
+	return (parsed);
+
+ err:
+	BIO_free(bio);
+	tls_parsed_keypair_free(parsed);
+
+	return (NULL);
+}
+
+/*
+ * Return the parsed form of a keypair that has both a certificate and a
+ * key, with a reference for the caller.
+ */
+struct tls_parsed_keypair *
+tls_keypair_cache_get(struct tls_keypair *keypair, struct tls_error *error)
+{
+	struct tls_parsed_keypair *parsed = NULL;
+	unsigned char digest[SHA256_DIGEST_LENGTH];
+	struct tls_parsed_keypair **bucket;
+
+	/*
+	 * Decoding is done with the mutex held, so that threads configuring
+	 * the same keypair do not decode it more than once.
+	 */
+	pthread_mutex_lock(&tls_keypair_cache_mutex);
+
+	if ((parsed = keypair->parsed) != NULL)
+		goto done;
+
+	tls_keypair_cache_digest(keypair, digest);
+	bucket = &tls_keypair_cache[digest[0] % TLS_KEYPAIR_CACHE_BUCKETS];
+	for (parsed = *bucket; parsed != NULL; parsed = parsed->next) {
+		if (memcmp(parsed->digest, digest, sizeof(digest)) == 0)
+			break;
+	}
+	if (parsed == NULL) {
+		if ((parsed = tls_parsed_keypair_new(keypair, error)) == NULL)
+			goto err;
+		memcpy(parsed->digest, digest, sizeof(digest));
+		parsed->next = *bucket;
+		*bucket = parsed;
+	}
+
+	parsed->refcount++;
+	keypair->parsed = parsed;
+
+ done:
+	parsed->refcount++;
+
+ err:
+	pthread_mutex_unlock(&tls_keypair_cache_mutex);
+
+	return (parsed);
+}
+
+void
+tls_keypair_cache_put(struct tls_parsed_keypair *parsed)
+{
+	struct tls_parsed_keypair **pp;
+
+	if (parsed == NULL)
+		return;
+
+	pthread_mutex_lock(&tls_keypair_cache_mutex);
+	if (--parsed->refcount > 0) {
+		pthread_mutex_unlock(&tls_keypair_cache_mutex);
+		return;
+	}
+	pp = &tls_keypair_cache[parsed->digest[0] % TLS_KEYPAIR_CACHE_BUCKETS];
+	for (; *pp != NULL; pp = &(*pp)->next) {
+		if (*pp == parsed) {
+			*pp = parsed->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&tls_keypair_cache_mutex);
+
+	tls_parsed_keypair_free(parsed);
+}
+
+/*
+ * Drop the parsed form of a keypair, once its certificate or key changes.
+ */
+void
+tls_keypair_cache_release(struct tls_keypair *keypair)
+{
+	struct tls_parsed_keypair *parsed;
+
+	pthread_mutex_lock(&tls_keypair_cache_mutex);
+	parsed = keypair->parsed;
+	keypair->parsed = NULL;
+	pthread_mutex_unlock(&tls_keypair_cache_mutex);
+
+	tls_keypair_cache_put(parsed);
+}
+
+int
+tls_keypair_cache_use(struct tls *ctx, SSL_CTX *ssl_ctx,
+    struct tls_parsed_keypair *parsed)
+{
+	if (SSL_CTX_use_certificate(ssl_ctx, parsed->cert) != 1 ||
+	    SSL_CTX_set1_chain(ssl_ctx, parsed->chain) != 1) {
+		tls_set_errorx(ctx, "failed to load certificate");
+		return (-1);
+	}
+	if (SSL_CTX_use_PrivateKey(ssl_ctx, parsed->pkey) != 1) {
+		tls_set_errorx(ctx, "failed to load private key");
+		return (-1);
+	}
+
+	return (0);
+}
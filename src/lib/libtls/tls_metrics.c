@@ -0,0 +1,81 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <openssl/ssl.h>
+
+#include <tls.h>
+#include "tls_internal.h"
+
+int
+tls_metrics_handshake_start(struct tls *ctx)
+{
+	if ((ctx->metrics = calloc(1, sizeof(*ctx->metrics))) == NULL) {
+		tls_set_errorx(ctx, "out of memory");
+		return (-1);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &ctx->metrics->handshake_start);
+
+	return (0);
+}
+
+/*
+ * Account for a handshake step that returned rv. A round trip is counted
+ * each time the handshake has to wait for the peer after sending at least
+ * one new record, which is when a flight has been sent and its response
+ * has not yet arrived.
+ */
+void
+tls_metrics_handshake(struct tls *ctx, int rv)
+{
+	uint64_t records_read, records_written;
+
+	if (rv == TLS_WANT_POLLIN) {
+		SSL_get_record_counts(ctx->ssl_conn, &records_read,
+		    &records_written);
+		if (records_written > ctx->metrics_records_written) {
+			ctx->metrics_records_written = records_written;
+			ctx->metrics->handshake_round_trips++;
+		}
+	}
+	if (rv == 0)
+		clock_gettime(CLOCK_MONOTONIC, &ctx->metrics->handshake_finish);
+}
+
+int
+tls_conn_metrics(struct tls *ctx, struct tls_metrics *metrics)
+{
+	if (ctx->metrics == NULL) {
+		tls_set_errorx(ctx, "metrics are not enabled");
+		return (-1);
+	}
+
+	*metrics = *ctx->metrics;
+	if (ctx->ssl_conn != NULL) {
+		SSL_get_record_counts(ctx->ssl_conn, &metrics->records_read,
+		    &metrics->records_written);
+		metrics->renegotiations = SSL_num_renegotiations(ctx->ssl_conn);
+		metrics->key_updates = SSL_num_key_updates(ctx->ssl_conn);
+		SSL_get_private_key_time(ctx->ssl_conn,
+		    &metrics->private_key_time);
+	}
+
+	return (0);
+}
@@ -21,6 +21,8 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 
+#include <limits.h>
+
 #include <openssl/err.h>
 #include <openssl/ocsp.h>
 #include <openssl/x509.h>
@@ -28,9 +30,6 @@
 #include <tls.h>
 #include "tls_internal.h"
 
-#define MAXAGE_SEC (14*24*60*60)
-#define JITTER_SEC (60)
-
 /*
  * State for request.
  */
@@ -54,8 +53,8 @@ tls_ocsp_free(struct tls_ocsp *ocsp)
 	free(ocsp);
 }
 
-static int
-tls_ocsp_asn1_parse_time(struct tls *ctx, ASN1_GENERALIZEDTIME *gt, time_t *gt_time)
+int
+tls_ocsp_asn1_parse_time(ASN1_GENERALIZEDTIME *gt, time_t *gt_time)
 {
 	struct tm tm;
 
@@ -97,19 +96,19 @@ tls_ocsp_fill_info(struct tls *ctx, int response_status, int cert_status,
 	}
 	info->revocation_time = info->this_update = info->next_update = -1;
 	if (revtime != NULL &&
-	    tls_ocsp_asn1_parse_time(ctx, revtime, &info->revocation_time) != 0) {
+	    tls_ocsp_asn1_parse_time(revtime, &info->revocation_time) != 0) {
 		tls_set_error(ctx,
 		    "unable to parse revocation time in OCSP reply");
 		goto err;
 	}
 	if (thisupd != NULL &&
-	    tls_ocsp_asn1_parse_time(ctx, thisupd, &info->this_update) != 0) {
+	    tls_ocsp_asn1_parse_time(thisupd, &info->this_update) != 0) {
 		tls_set_error(ctx,
 		    "unable to parse this update time in OCSP reply");
 		goto err;
 	}
 	if (nextupd != NULL &&
-	    tls_ocsp_asn1_parse_time(ctx, nextupd, &info->next_update) != 0) {
+	    tls_ocsp_asn1_parse_time(nextupd, &info->next_update) != 0) {
 		tls_set_error(ctx,
 		    "unable to parse next update time in OCSP reply");
 		goto err;
@@ -243,8 +242,8 @@ tls_ocsp_verify_response(struct tls *ctx, OCSP_RESPONSE *resp)
 		goto err;
 	}
 
-	if (OCSP_check_validity(thisupd, nextupd, JITTER_SEC,
-	    MAXAGE_SEC) != 1) {
+	if (OCSP_check_validity(thisupd, nextupd, TLS_OCSP_JITTER_SEC,
+	    TLS_OCSP_MAXAGE_SEC) != 1) {
 		tls_set_errorx(ctx,
 		    "ocsp verify failed: ocsp response not current");
 		goto err;
@@ -327,35 +326,58 @@ tls_ocsp_verify_cb(SSL *ssl, void *arg)
 }
 
 
-/* Staple the OCSP information in ctx->ocsp to the server handshake. */
+/* Staple the OCSP response of the keypair to the server handshake. */
 int
 tls_ocsp_stapling_cb(SSL *ssl, void *arg)
 {
 	int ret = SSL_TLSEXT_ERR_ALERT_FATAL;
+	struct tls_ocsp_staple *staple = NULL;
 	unsigned char *ocsp_staple = NULL;
+	struct tls_keypair *keypair;
+	struct tls_sni_ctx *kp_ctx;
+	EVP_PKEY *pkey;
+	X509 *cert;
 	struct tls *ctx;
 
 	if ((ctx = SSL_get_app_data(ssl)) == NULL)
 		goto err;
 
-	if (ctx->keypair == NULL || ctx->keypair->ocsp_staple == NULL ||
-	    ctx->keypair->ocsp_staple_len == 0)
+	/* Staple the response for the certificate that is being sent. */
+	keypair = ctx->keypair;
+	if ((kp_ctx = ctx->keypair_ctx) != NULL &&
+	    kp_ctx->alt_keypair != NULL &&
+	    (cert = SSL_get_certificate(ssl)) != NULL &&
+	    (pkey = X509_get0_pubkey(cert)) != NULL &&
+	    EVP_PKEY_id(pkey) == kp_ctx->alt_pkey_type)
+		keypair = kp_ctx->alt_keypair;
+
+	/*
+	 * Hold a reference, so that the staple can be replaced by another
+	 * thread in the meantime.
+	 */
+	if (keypair == NULL ||
+	    (staple = tls_keypair_ocsp_staple(keypair)) == NULL)
 		return SSL_TLSEXT_ERR_NOACK;
+	if (staple->len == 0 || staple->len > INT_MAX) {
+		tls_ocsp_staple_free(staple);
+		return SSL_TLSEXT_ERR_NOACK;
+	}
 
-	if ((ocsp_staple = malloc(ctx->keypair->ocsp_staple_len)) == NULL)
+	/* libssl takes ownership of the response, so it gets a copy. */
+	if ((ocsp_staple = malloc(staple->len)) == NULL)
 		goto err;
 
-	memcpy(ocsp_staple, ctx->keypair->ocsp_staple,
-	    ctx->keypair->ocsp_staple_len);
+	memcpy(ocsp_staple, staple->data, staple->len);
 
 	if (SSL_set_tlsext_status_ocsp_resp(ctx->ssl_conn, ocsp_staple,
-	    ctx->keypair->ocsp_staple_len) != 1)
+	    staple->len) != 1)
 		goto err;
 
 	ret = SSL_TLSEXT_ERR_OK;
  err:
 	if (ret != SSL_TLSEXT_ERR_OK)
 		free(ocsp_staple);
+	tls_ocsp_staple_free(staple);
 
 	return ret;
 }
@@ -0,0 +1,541 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * OCSP staple refresh.
+ *
+ * A configuration with tls_config_ocsp_refresh_staples() gets a thread, once
+ * a server is first configured with it, that keeps the OCSP staples of its
+ * keypairs current. For each keypair whose certificate names an http OCSP
+ * responder and whose chain includes the issuer, the thread requests a
+ * response, verifies it in the same way as ocspcheck(8) does and makes it
+ * the staple of the keypair. A staple is fetched again halfway between its
+ * thisUpdate and nextUpdate times. A failed fetch is retried with a growing
+ * delay, while the previous staple remains in use. The thread is stopped
+ * when the configuration is freed.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <openssl/err.h>
+#include <openssl/ocsp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+
+#include <tls.h>
+#include "tls_internal.h"
+
+/* Time allowed for connecting to a responder and for its response. */
+#define TLS_OCSP_REFRESH_TIMEOUT	10
+
+/* Bounds of the delay between fetches, in seconds. */
+#define TLS_OCSP_REFRESH_MIN		60
+#define TLS_OCSP_REFRESH_MAX		(24 * 60 * 60)
+#define TLS_OCSP_RETRY_MAX		(60 * 60)
+
+struct tls_ocsp_refresh_entry {
+	struct tls_keypair *keypair;
+
+	X509 *cert;
+	X509 *issuer;
+	STACK_OF(X509) *chain;
+
+	char *host;
+	char *port;
+	char *path;
+
+	time_t refresh;
+	time_t retry;
+};
+
+struct tls_ocsp_refresh {
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int running;
+	int stop;
+
+	X509_STORE *store;
+
+	struct tls_ocsp_refresh_entry *entries;
+	size_t num_entries;
+};
+
+static void
+tls_ocsp_refresh_entry_clear(struct tls_ocsp_refresh_entry *entry)
+{
+	X509_free(entry->cert);
+	X509_free(entry->issuer);
+	sk_X509_pop_free(entry->chain, X509_free);
+	free(entry->host);
+	free(entry->port);
+	free(entry->path);
+
+	memset(entry, 0, sizeof(*entry));
+}
+
+/*
+ * Set up the refresh of a keypair's staple. Returns 1 if the keypair can
+ * be refreshed, 0 if it cannot and -1 on failure.
+ */
+static int
+tls_ocsp_refresh_entry_init(struct tls_ocsp_refresh_entry *entry,
+    struct tls_keypair *keypair, struct tls_error *error)
+{
+	STACK_OF(OPENSSL_STRING) *urls = NULL;
+	BIO *bio = NULL;
+	X509 *cert;
+	int use_ssl;
+	int rv = -1;
+
+	entry->keypair = keypair;
+
+	if (keypair->cert_mem == NULL) {
+		rv = 0;
+		goto err;
+	}
+
+	if ((bio = BIO_new_mem_buf(keypair->cert_mem,
+	    keypair->cert_len)) == NULL) {
+		tls_error_setx(error, "out of memory");
+		goto err;
+	}
+	if ((entry->chain = sk_X509_new_null()) == NULL) {
+		tls_error_setx(error, "out of memory");
+		goto err;
+	}
+	while ((cert = PEM_read_bio_X509(bio, NULL, tls_password_cb,
+	    NULL)) != NULL) {
+		if (!sk_X509_push(entry->chain, cert)) {
+			X509_free(cert);
+			tls_error_setx(error, "out of memory");
+			goto err;
+		}
+	}
+	ERR_clear_error();
+
+	/* A response can only be requested with the issuer's certificate. */
+	rv = 0;
+	if (sk_X509_num(entry->chain) < 2)
+		goto err;
+	entry->cert = sk_X509_value(entry->chain, 0);
+	X509_up_ref(entry->cert);
+	if ((entry->issuer = X509_find_by_subject(entry->chain,
+	    X509_get_issuer_name(entry->cert))) == NULL)
+		goto err;
+	X509_up_ref(entry->issuer);
+
+	if ((urls = X509_get1_ocsp(entry->cert)) == NULL ||
+	    sk_OPENSSL_STRING_num(urls) <= 0)
+		goto err;
+	if (!OCSP_parse_url(sk_OPENSSL_STRING_value(urls, 0), &entry->host,
+	    &entry->port, &entry->path, &use_ssl)) {
+		ERR_clear_error();
+		goto err;
+	}
+	if (use_ssl)
+		goto err;
+
+	rv = 1;
+
+ err:
+	if (rv != 1)
+		tls_ocsp_refresh_entry_clear(entry);
+	X509_email_free(urls);
+	BIO_free(bio);
+
+	return (rv);
+}
+
+/*
+ * Return when a staple should be fetched again: halfway through its
+ * validity, but not so soon that a responder handing out an old response
+ * is asked again and again.
+ */
+time_t
+tls_ocsp_refresh_time(time_t now, time_t this_update, time_t next_update)
+{
+	time_t refresh = now + TLS_OCSP_REFRESH_MAX;
+
+	if (next_update != -1 && next_update > this_update)
+		refresh = this_update + (next_update - this_update) / 2;
+
+	if (refresh < now + TLS_OCSP_REFRESH_MIN)
+		refresh = now + TLS_OCSP_REFRESH_MIN;
+	if (refresh > now + TLS_OCSP_REFRESH_MAX)
+		refresh = now + TLS_OCSP_REFRESH_MAX;
+
+	return (refresh);
+}
+
+static int
+tls_ocsp_refresh_connect(struct tls_ocsp_refresh_entry *entry,
+    time_t deadline)
+{
+	struct addrinfo hints, *res0 = NULL, *res;
+	struct pollfd pfd;
+	socklen_t len;
+	time_t timeout;
+	int fd = -1;
+	int err;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(entry->host, entry->port, &hints, &res0) != 0)
+		return (-1);
+
+	for (res = res0; res != NULL; res = res->ai_next) {
+		if ((fd = socket(res->ai_family, res->ai_socktype,
+		    res->ai_protocol)) == -1)
+			continue;
+		if (fcntl(fd, F_SETFL, O_NONBLOCK) == -1)
+			goto next;
+		if (connect(fd, res->ai_addr, res->ai_addrlen) == 0)
+			break;
+		if (errno != EINPROGRESS)
+			goto next;
+
+		if ((timeout = deadline - time(NULL)) <= 0)
+			goto next;
+		pfd.fd = fd;
+		pfd.events = POLLOUT;
+		if (poll(&pfd, 1, timeout * 1000) != 1)
+			goto next;
+		len = sizeof(err);
+		if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == -1 ||
+		    err != 0)
+			goto next;
+		break;
+
+ next:
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(res0);
+
+	return (fd);
+}
+
+/*
+ * Send an OCSP request to the responder of a keypair over a non-blocking
+ * socket, so that the thread does not wait for more than
+ * TLS_OCSP_REFRESH_TIMEOUT seconds.
+ */
+static OCSP_RESPONSE *
+tls_ocsp_refresh_fetch(struct tls_ocsp_refresh_entry *entry,
+    OCSP_REQUEST *req)
+{
+	OCSP_RESPONSE *resp = NULL;
+	OCSP_REQ_CTX *rctx = NULL;
+	BIO *bio = NULL;
+	struct pollfd pfd;
+	time_t deadline, timeout;
+	int fd, rv;
+
+	deadline = time(NULL) + TLS_OCSP_REFRESH_TIMEOUT;
+
+	if ((fd = tls_ocsp_refresh_connect(entry, deadline)) == -1)
+		goto err;
+	if ((bio = BIO_new_socket(fd, BIO_CLOSE)) == NULL) {
+		close(fd);
+		goto err;
+	}
+	if ((rctx = OCSP_sendreq_new(bio, entry->path, NULL, -1)) == NULL)
+		goto err;
+	if (!OCSP_REQ_CTX_add1_header(rctx, "Host", entry->host))
+		goto err;
+	if (!OCSP_REQ_CTX_set1_req(rctx, req))
+		goto err;
+
+	while ((rv = OCSP_sendreq_nbio(&resp, rctx)) == -1) {
+		if (!BIO_should_retry(bio))
+			goto err;
+		if ((timeout = deadline - time(NULL)) <= 0)
+			goto err;
+		pfd.fd = fd;
+		pfd.events = BIO_should_read(bio) ? POLLIN : POLLOUT;
+		if (poll(&pfd, 1, timeout * 1000) == -1 && errno != EINTR)
+			goto err;
+	}
+	if (rv != 1)
+		resp = NULL;
+
+ err:
+	OCSP_REQ_CTX_free(rctx);
+	BIO_free(bio);
+	ERR_clear_error();
+
+	return (resp);
+}
+
+/*
+ * Check a response in the same way as ocspcheck(8): it must be signed by
+ * the issuer or a responder that it delegated to, not say that the
+ * certificate is revoked and be current. Returns the time at which to
+ * fetch the next one, or -1.
+ */
+static time_t
+tls_ocsp_refresh_verify(struct tls_ocsp_refresh *refresh,
+    struct tls_ocsp_refresh_entry *entry, OCSP_RESPONSE *resp,
+    OCSP_CERTID *cid)
+{
+	ASN1_GENERALIZEDTIME *revtime = NULL, *thisupd = NULL, *nextupd = NULL;
+	OCSP_BASICRESP *br = NULL;
+	int cert_status, crl_reason;
+	time_t this_update, next_update = -1;
+	time_t next = -1;
+
+	if (OCSP_response_status(resp) != OCSP_RESPONSE_STATUS_SUCCESSFUL)
+		goto err;
+	if ((br = OCSP_response_get1_basic(resp)) == NULL)
+		goto err;
+	if (OCSP_basic_verify(br, entry->chain, refresh->store,
+	    OCSP_TRUSTOTHER) != 1)
+		goto err;
+	if (OCSP_resp_find_status(br, cid, &cert_status, &crl_reason,
+	    &revtime, &thisupd, &nextupd) != 1)
+		goto err;
+	if (cert_status == V_OCSP_CERTSTATUS_REVOKED || revtime != NULL)
+		goto err;
+	if (OCSP_check_validity(thisupd, nextupd, TLS_OCSP_JITTER_SEC,
+	    TLS_OCSP_MAXAGE_SEC) != 1)
+		goto err;
+	if (tls_ocsp_asn1_parse_time(thisupd, &this_update) == -1)
+		goto err;
+	if (nextupd != NULL &&
+	    tls_ocsp_asn1_parse_time(nextupd, &next_update) == -1)
+		goto err;
+
+	next = tls_ocsp_refresh_time(time(NULL), this_update, next_update);
+
+ err:
+	OCSP_BASICRESP_free(br);
+	ERR_clear_error();
+
+	return (next);
+}
+
+static void
+tls_ocsp_refresh_keypair(struct tls_ocsp_refresh *refresh,
+    struct tls_ocsp_refresh_entry *entry)
+{
+	struct tls_ocsp_staple *staple = NULL;
+	OCSP_CERTID *cid = NULL, *req_cid = NULL;
+	OCSP_RESPONSE *resp = NULL;
+	OCSP_REQUEST *req = NULL;
+	unsigned char *der = NULL;
+	time_t next;
+	int len;
+
+	if ((cid = OCSP_cert_to_id(NULL, entry->cert, entry->issuer)) == NULL)
+		goto err;
+	if ((req = OCSP_REQUEST_new()) == NULL)
+		goto err;
+	if ((req_cid = OCSP_CERTID_dup(cid)) == NULL)
+		goto err;
+	if (OCSP_request_add0_id(req, req_cid) == NULL) {
+		OCSP_CERTID_free(req_cid);
+		goto err;
+	}
+
+	if ((resp = tls_ocsp_refresh_fetch(entry, req)) == NULL)
+		goto err;
+	if ((next = tls_ocsp_refresh_verify(refresh, entry, resp, cid)) == -1)
+		goto err;
+
+	if ((len = i2d_OCSP_RESPONSE(resp, &der)) <= 0)
+		goto err;
+	if ((staple = tls_ocsp_staple_new(der, len)) == NULL) {
+		free(der);
+		goto err;
+	}
+	tls_keypair_set_ocsp_staple(entry->keypair, staple);
+
+	entry->refresh = next;
+	entry->retry = 0;
+
+	goto done;
+
+ err:
+	if (entry->retry == 0)
+		entry->retry = TLS_OCSP_REFRESH_MIN;
+	else if ((entry->retry *= 2) > TLS_OCSP_RETRY_MAX)
+		entry->retry = TLS_OCSP_RETRY_MAX;
+	entry->refresh = time(NULL) + entry->retry;
+
+ done:
+	OCSP_RESPONSE_free(resp);
+	OCSP_REQUEST_free(req);
+	OCSP_CERTID_free(cid);
+	ERR_clear_error();
+}
+
+static void *
+tls_ocsp_refresh_thread(void *arg)
+{
+	struct tls_ocsp_refresh *refresh = arg;
+	struct tls_ocsp_refresh_entry *entry;
+	struct timespec ts;
+	time_t next;
+	size_t i;
+
+	pthread_mutex_lock(&refresh->mutex);
+	while (!refresh->stop) {
+		next = time(NULL) + TLS_OCSP_REFRESH_MAX;
+		for (i = 0; i < refresh->num_entries && !refresh->stop; i++) {
+			entry = &refresh->entries[i];
+
+			/* Only this thread uses the entries. */
+			if (entry->refresh <= time(NULL)) {
+				pthread_mutex_unlock(&refresh->mutex);
+				tls_ocsp_refresh_keypair(refresh, entry);
+				pthread_mutex_lock(&refresh->mutex);
+			}
+			if (entry->refresh < next)
+				next = entry->refresh;
+		}
+		if (refresh->stop)
+			break;
+
+		ts.tv_sec = next;
+		ts.tv_nsec = 0;
+		pthread_cond_timedwait(&refresh->cond, &refresh->mutex, &ts);
+	}
+	pthread_mutex_unlock(&refresh->mutex);
+
+	return (NULL);
+}
+
+/*
+ * Start refreshing the staples of a configuration's keypairs, unless that
+ * has already been done by an earlier server configured with it.
+ */
+int
+tls_ocsp_refresh_start(struct tls_config *config, struct tls_error *error)
+{
+	struct tls_ocsp_refresh *refresh = NULL;
+	struct tls_keypair *kp;
+	size_t num_keypairs = 0;
+	int rv = -1;
+	int ret;
+
+	pthread_mutex_lock(&config->mutex);
+
+	if (config->ocsp_refresh != NULL) {
+		rv = 0;
+		goto err;
+	}
+
+	if ((refresh = calloc(1, sizeof(*refresh))) == NULL) {
+		tls_error_setx(error, "out of memory");
+		goto err;
+	}
+	if ((refresh->store = tls_ca_cache_get(config, error)) == NULL)
+		goto err;
+
+	for (kp = config->keypair; kp != NULL; kp = kp->next)
+		num_keypairs++;
+	if ((refresh->entries = calloc(num_keypairs,
+	    sizeof(*refresh->entries))) == NULL) {
+		tls_error_setx(error, "out of memory");
+		goto err;
+	}
+	for (kp = config->keypair; kp != NULL; kp = kp->next) {
+		if ((ret = tls_ocsp_refresh_entry_init(
+		    &refresh->entries[refresh->num_entries], kp, error)) == -1)
+			goto err;
+		if (ret == 1)
+			refresh->num_entries++;
+	}
+
+	if (refresh->num_entries > 0) {
+		if (pthread_mutex_init(&refresh->mutex, NULL) != 0) {
+			tls_error_setx(error, "failed to create mutex");
+			goto err;
+		}
+		if (pthread_cond_init(&refresh->cond, NULL) != 0) {
+			pthread_mutex_destroy(&refresh->mutex);
+			tls_error_setx(error, "failed to create condition");
+			goto err;
+		}
+		if ((errno = pthread_create(&refresh->thread, NULL,
+		    tls_ocsp_refresh_thread, refresh)) != 0) {
+			pthread_cond_destroy(&refresh->cond);
+			pthread_mutex_destroy(&refresh->mutex);
+			tls_error_set(error, "failed to start OCSP refresh");
+			goto err;
+		}
+		refresh->running = 1;
+	}
+
+	config->ocsp_refresh = refresh;
+	refresh = NULL;
+
+	rv = 0;
+
+ err:
+	pthread_mutex_unlock(&config->mutex);
+	tls_ocsp_refresh_free(refresh);
+
+	return (rv);
+}
+
+/*
+ * Stop the thread, which may have to finish a fetch first, and free the
+ * refresh state. The keypairs must still exist.
+ */
+void
+tls_ocsp_refresh_free(struct tls_ocsp_refresh *refresh)
+{
+	size_t i;
+
+	if (refresh == NULL)
+		return;
+
+	if (refresh->running) {
+		pthread_mutex_lock(&refresh->mutex);
+		refresh->stop = 1;
+		pthread_cond_signal(&refresh->cond);
+		pthread_mutex_unlock(&refresh->mutex);
+
+		pthread_join(refresh->thread, NULL);
+
+		pthread_cond_destroy(&refresh->cond);
+		pthread_mutex_destroy(&refresh->mutex);
+	}
+
+	if (refresh->entries != NULL) {
+		for (i = 0; i < refresh->num_entries; i++)
+			tls_ocsp_refresh_entry_clear(&refresh->entries[i]);
+		free(refresh->entries);
+	}
+	X509_STORE_free(refresh->store);
+
+	free(refresh);
+}
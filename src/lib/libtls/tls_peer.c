@@ -26,24 +26,30 @@
 const char *
 tls_peer_cert_hash(struct tls *ctx)
 {
-	if (ctx->conninfo == NULL)
+	struct tls_conninfo *conninfo;
+
+	if ((conninfo = tls_conninfo_get(ctx, TLS_CONNINFO_PEER_CERT)) == NULL)
 		return (NULL);
-	return (ctx->conninfo->hash);
+	return (conninfo->hash);
 }
 const char *
 tls_peer_cert_issuer(struct tls *ctx)
 {
-	if (ctx->conninfo == NULL)
+	struct tls_conninfo *conninfo;
+
+	if ((conninfo = tls_conninfo_get(ctx, TLS_CONNINFO_PEER_CERT)) == NULL)
 		return (NULL);
-	return (ctx->conninfo->issuer);
+	return (conninfo->issuer);
 }
 
 const char *
 tls_peer_cert_subject(struct tls *ctx)
 {
-	if (ctx->conninfo == NULL)
+	struct tls_conninfo *conninfo;
+
+	if ((conninfo = tls_conninfo_get(ctx, TLS_CONNINFO_PEER_CERT)) == NULL)
 		return (NULL);
-	return (ctx->conninfo->subject);
+	return (conninfo->subject);
 }
 
 int
@@ -69,31 +75,37 @@ tls_peer_cert_contains_name(struct tls *ctx, const char *name)
 time_t
 tls_peer_cert_notbefore(struct tls *ctx)
 {
+	struct tls_conninfo *conninfo;
+
 	if (ctx->ssl_peer_cert == NULL)
 		return (-1);
-	if (ctx->conninfo == NULL)
+	if ((conninfo = tls_conninfo_get(ctx, TLS_CONNINFO_PEER_CERT)) == NULL)
 		return (-1);
-	return (ctx->conninfo->notbefore);
+	return (conninfo->notbefore);
 }
 
 time_t
 tls_peer_cert_notafter(struct tls *ctx)
 {
+	struct tls_conninfo *conninfo;
+
 	if (ctx->ssl_peer_cert == NULL)
 		return (-1);
-	if (ctx->conninfo == NULL)
+	if ((conninfo = tls_conninfo_get(ctx, TLS_CONNINFO_PEER_CERT)) == NULL)
 		return (-1);
-	return (ctx->conninfo->notafter);
+	return (conninfo->notafter);
 }
 
 const uint8_t *
 tls_peer_cert_chain_pem(struct tls *ctx, size_t *size)
 {
+	struct tls_conninfo *conninfo;
+
 	if (ctx->ssl_peer_cert == NULL)
 		return (NULL);
-	if (ctx->conninfo == NULL)
+	if ((conninfo = tls_conninfo_get(ctx, TLS_CONNINFO_PEER_CHAIN)) == NULL)
 		return (NULL);
-	*size = ctx->conninfo->peer_cert_len;
-	return (ctx->conninfo->peer_cert);
+	*size = conninfo->peer_cert_len;
+	return (conninfo->peer_cert);
 }
 
@@ -21,11 +21,15 @@
 
 #include <openssl/ec.h>
 #include <openssl/err.h>
+#include <openssl/sha.h>
 #include <openssl/ssl.h>
 
 #include <tls.h>
 #include "tls_internal.h"
 
+/* Protects the configuration of server contexts and tls_server_ssl. */
+static pthread_mutex_t tls_server_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 struct tls *
 tls_server(void)
 {
@@ -52,24 +56,67 @@ tls_server_conn(struct tls *ctx)
 
 	conn_ctx->flags |= TLS_SERVER_CONN;
 
+	/* The configuration and contexts are replaced together. */
+	pthread_mutex_lock(&tls_server_mutex);
+	if (ctx->server_ssl == NULL) {
+		pthread_mutex_unlock(&tls_server_mutex);
+		tls_free(conn_ctx);
+		return (NULL);
+	}
+
 	pthread_mutex_lock(&ctx->config->mutex);
 	ctx->config->refcount++;
 	pthread_mutex_unlock(&ctx->config->mutex);
 
+	tls_config_free(conn_ctx->config);
 	conn_ctx->config = ctx->config;
-	conn_ctx->keypair = ctx->config->keypair;
+	conn_ctx->keypair = ctx->server_ssl->keypair_ctx->keypair;
+	conn_ctx->keypair_ctx = ctx->server_ssl->keypair_ctx;
+
+	ctx->server_ssl->refcount++;
+	conn_ctx->server_ssl = ctx->server_ssl;
+	pthread_mutex_unlock(&tls_server_mutex);
 
 	return (conn_ctx);
 }
 
+void
+tls_server_ssl_free(struct tls_server_ssl *server_ssl)
+{
+	struct tls_sni_ctx *sni, *nsni;
+	int refcount;
+
+	if (server_ssl == NULL)
+		return;
+
+	pthread_mutex_lock(&tls_server_mutex);
+	refcount = --server_ssl->refcount;
+	pthread_mutex_unlock(&tls_server_mutex);
+
+	if (refcount > 0)
+		return;
+
+	tls_sni_ctx_free(server_ssl->keypair_ctx);
+	for (sni = server_ssl->sni_ctx; sni != NULL; sni = nsni) {
+		nsni = sni->next;
+		tls_sni_ctx_free(sni);
+	}
+	tls_sni_index_free(server_ssl->sni_index);
+
+	free(server_ssl);
+}
+
 static int
 tls_server_alpn_cb(SSL *ssl, const unsigned char **out, unsigned char *outlen,
     const unsigned char *in, unsigned int inlen, void *arg)
 {
-	struct tls *ctx = arg;
+	struct tls *conn_ctx;
+
+	if ((conn_ctx = SSL_get_app_data(ssl)) == NULL)
+		return (SSL_TLSEXT_ERR_NOACK);
 
 	if (SSL_select_next_proto((unsigned char**)out, outlen,
-	    ctx->config->alpn, ctx->config->alpn_len, in, inlen) ==
+	    conn_ctx->config->alpn, conn_ctx->config->alpn_len, in, inlen) ==
 	    OPENSSL_NPN_NEGOTIATED)
 		return (SSL_TLSEXT_ERR_OK);
 
@@ -79,12 +126,10 @@ tls_server_alpn_cb(SSL *ssl, const unsigned char **out, unsigned char *outlen,
 static int
 tls_servername_cb(SSL *ssl, int *al, void *arg)
 {
-	struct tls *ctx = (struct tls *)arg;
 	struct tls_sni_ctx *sni_ctx;
 	union tls_addr addrbuf;
 	struct tls *conn_ctx;
 	const char *name;
-	int match;
 
 	if ((conn_ctx = SSL_get_app_data(ssl)) == NULL)
 		goto err;
@@ -114,15 +159,12 @@ tls_servername_cb(SSL *ssl, int *al, void *arg)
 		goto err;
 
 	/* Find appropriate SSL context for requested servername. */
-	for (sni_ctx = ctx->sni_ctx; sni_ctx != NULL; sni_ctx = sni_ctx->next) {
-		if (tls_check_name(ctx, sni_ctx->ssl_cert, name,
-		    &match) == -1)
-			goto err;
-		if (match) {
-			conn_ctx->keypair = sni_ctx->keypair;
-			SSL_set_SSL_CTX(conn_ctx->ssl_conn, sni_ctx->ssl_ctx);
-			return (SSL_TLSEXT_ERR_OK);
-		}
+	if ((sni_ctx = tls_sni_index_lookup(conn_ctx->server_ssl->sni_index,
+	    name)) != NULL) {
+		conn_ctx->keypair = sni_ctx->keypair;
+		conn_ctx->keypair_ctx = sni_ctx;
+		SSL_set_SSL_CTX(conn_ctx->ssl_conn, sni_ctx->ssl_ctx);
+		return (SSL_TLSEXT_ERR_OK);
 	}
 
 	/* No match, use the existing context/certificate. */
@@ -137,81 +179,102 @@ tls_servername_cb(SSL *ssl, int *al, void *arg)
 	return (SSL_TLSEXT_ERR_ALERT_FATAL);
 }
 
-static struct tls_ticket_key *
-tls_server_ticket_key(struct tls_config *config, unsigned char *keyname)
+/*
+ * Copy the ticket key with the given name, or the current key if keyname is
+ * NULL. The keys may be rotated by another thread, so the config mutex is
+ * only held while they are looked at, rather than while the key is in use.
+ */
+static int
+tls_server_ticket_key(struct tls_config *config, unsigned char *keyname,
+    struct tls_ticket_key *key, int *primary)
 {
-	struct tls_ticket_key *key = NULL;
+	struct tls_ticket_key *tk;
 	time_t now;
-	int i;
+	int i, rv = -1;
 
 	now = time(NULL);
+
+	pthread_mutex_lock(&config->mutex);
 	if (config->ticket_autorekey == 1) {
 		if (now - 3 * (config->session_lifetime / 4) >
 		    config->ticket_keys[0].time) {
 			if (tls_config_ticket_autorekey(config) == -1)
-				return (NULL);
+				goto err;
 		}
 	}
 	for (i = 0; i < TLS_NUM_TICKETS; i++) {
-		struct tls_ticket_key *tk = &config->ticket_keys[i];
+		tk = &config->ticket_keys[i];
 		if (now - config->session_lifetime > tk->time)
 			continue;
 		if (keyname == NULL || timingsafe_memcmp(keyname,
 		    tk->key_name, sizeof(tk->key_name)) == 0) {
-			key = tk;
+			*key = *tk;
+			*primary = (i == 0);
+			rv = 0;
 			break;
 		}
 	}
-	return (key);
+
+ err:
+	pthread_mutex_unlock(&config->mutex);
+
+	return (rv);
 }
 
 static int
 tls_server_ticket_cb(SSL *ssl, unsigned char *keyname, unsigned char *iv,
     EVP_CIPHER_CTX *ctx, HMAC_CTX *hctx, int mode)
 {
-	struct tls_ticket_key *key;
+	struct tls_ticket_key key;
 	struct tls *tls_ctx;
+	int primary;
+	int rv;
 
 	if ((tls_ctx = SSL_get_app_data(ssl)) == NULL)
 		return (-1);
 
 	if (mode == 1) {
 		/* create new session */
-		key = tls_server_ticket_key(tls_ctx->config, NULL);
-		if (key == NULL) {
+		if (tls_server_ticket_key(tls_ctx->config, NULL, &key,
+		    &primary) == -1) {
 			tls_set_errorx(tls_ctx, "no valid ticket key found");
 			return (-1);
 		}
 
-		memcpy(keyname, key->key_name, sizeof(key->key_name));
+		memcpy(keyname, key.key_name, sizeof(key.key_name));
 		arc4random_buf(iv, EVP_MAX_IV_LENGTH);
 		EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), NULL,
-		    key->aes_key, iv);
-		HMAC_Init_ex(hctx, key->hmac_key, sizeof(key->hmac_key),
+		    key.aes_key, iv);
+		HMAC_Init_ex(hctx, key.hmac_key, sizeof(key.hmac_key),
 		    EVP_sha256(), NULL);
-		return (0);
+		rv = 0;
 	} else {
 		/* get key by name */
-		key = tls_server_ticket_key(tls_ctx->config, keyname);
-		if (key == NULL)
+		if (tls_server_ticket_key(tls_ctx->config, keyname, &key,
+		    &primary) == -1)
 			return (0);
 
 		EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), NULL,
-		    key->aes_key, iv);
-		HMAC_Init_ex(hctx, key->hmac_key, sizeof(key->hmac_key),
+		    key.aes_key, iv);
+		HMAC_Init_ex(hctx, key.hmac_key, sizeof(key.hmac_key),
 		    EVP_sha256(), NULL);
 
 		/* time to renew the ticket? is it the primary key? */
-		if (key != &tls_ctx->config->ticket_keys[0])
-			return (2);
-		return (1);
+		rv = primary ? 1 : 2;
 	}
+
+	explicit_bzero(&key, sizeof(key));
+
+	return (rv);
 }
 
 static int
 tls_configure_server_ssl(struct tls *ctx, SSL_CTX **ssl_ctx,
-    struct tls_keypair *keypair)
+    struct tls_keypair *keypair, struct tls_keypair *alt_keypair,
+    int alt_pkey_type)
 {
+	struct tls_keypair *first, *second;
+
 	SSL_CTX_free(*ssl_ctx);
 
 	if ((*ssl_ctx = SSL_CTX_new(SSLv23_server_method())) == NULL) {
@@ -221,20 +284,35 @@ tls_configure_server_ssl(struct tls *ctx, SSL_CTX **ssl_ctx,
 
 	SSL_CTX_set_options(*ssl_ctx, SSL_OP_NO_CLIENT_RENEGOTIATION);
 
+	/*
+	 * The callbacks find the connection from the SSL, since the
+	 * SSL_CTX may be kept when the server is configured again.
+	 */
 	if (SSL_CTX_set_tlsext_servername_callback(*ssl_ctx,
 	    tls_servername_cb) != 1) {
 		tls_set_error(ctx, "failed to set servername callback");
 		goto err;
 	}
-	if (SSL_CTX_set_tlsext_servername_arg(*ssl_ctx, ctx) != 1) {
-		tls_set_error(ctx, "failed to set servername callback arg");
-		goto err;
-	}
 
 	if (tls_configure_ssl(ctx, *ssl_ctx) != 0)
 		goto err;
-	if (tls_configure_ssl_keypair(ctx, *ssl_ctx, keypair, 1) != 0)
+	/*
+	 * The key loaded last is the current one, which libssl only switches
+	 * away from when the other one is chosen - so load the ECDSA key of a
+	 * pair last, as most clients support it.
+	 */
+	first = keypair;
+	second = alt_keypair;
+	if (alt_keypair != NULL && alt_pkey_type != EVP_PKEY_EC) {
+		first = alt_keypair;
+		second = keypair;
+	}
+	if (tls_configure_ssl_keypair(ctx, *ssl_ctx, first, 1) != 0)
 		goto err;
+	if (second != NULL) {
+		if (tls_configure_ssl_keypair(ctx, *ssl_ctx, second, 1) != 0)
+			goto err;
+	}
 	if (ctx->config->verify_client != 0) {
 		int verify = SSL_VERIFY_PEER;
 		if (ctx->config->verify_client == 1)
@@ -245,7 +323,7 @@ tls_configure_server_ssl(struct tls *ctx, SSL_CTX **ssl_ctx,
 
 	if (ctx->config->alpn != NULL)
 		SSL_CTX_set_alpn_select_cb(*ssl_ctx, tls_server_alpn_cb,
-		    ctx);
+		    NULL);
 
 	if (ctx->config->dheparams == -1)
 		SSL_CTX_set_dh_auto(*ssl_ctx, 1);
@@ -281,6 +359,16 @@ tls_configure_server_ssl(struct tls *ctx, SSL_CTX **ssl_ctx,
 		}
 	}
 
+	/* Early data may only be accepted on resumption. */
+	if (ctx->config->session_lifetime > 0 &&
+	    ctx->config->max_early_data > 0) {
+		if (SSL_CTX_set_max_early_data(*ssl_ctx,
+		    ctx->config->max_early_data) != 1) {
+			tls_set_errorx(ctx, "failed to set max early data");
+			goto err;
+		}
+	}
+
 	if (SSL_CTX_set_session_id_context(*ssl_ctx, ctx->config->session_id,
 	    sizeof(ctx->config->session_id)) != 1) {
 		tls_set_error(ctx, "failed to set session id context");
@@ -296,50 +384,352 @@ tls_configure_server_ssl(struct tls *ctx, SSL_CTX **ssl_ctx,
 	return (-1);
 }
 
+static void
+tls_server_digest_mem(SHA256_CTX *sha, const void *mem, size_t len)
+{
+	uint8_t present = (mem != NULL);
+
+	SHA256_Update(sha, &present, sizeof(present));
+	SHA256_Update(sha, &len, sizeof(len));
+	if (mem != NULL)
+		SHA256_Update(sha, mem, len);
+}
+
+static void
+tls_server_digest_str(SHA256_CTX *sha, const char *str)
+{
+	tls_server_digest_mem(sha, str, str != NULL ? strlen(str) : 0);
+}
+
+static void
+tls_server_digest_keypair(SHA256_CTX *sha, struct tls_keypair *kp)
+{
+	uint8_t present = (kp != NULL);
+
+	SHA256_Update(sha, &present, sizeof(present));
+	if (kp == NULL)
+		return;
+
+	tls_server_digest_mem(sha, kp->cert_mem, kp->cert_len);
+	tls_server_digest_mem(sha, kp->key_mem, kp->key_len);
+	tls_server_digest_str(sha, kp->pubkey_hash);
+}
+
+/*
+ * Compute a digest of the keypairs and of the settings that are used to
+ * set up their SSL context, so that an unchanged context can be kept. The
+ * OCSP staple is not part of the SSL context, since it is read from the
+ * keypair of the connection as each handshake needs it.
+ */
+static void
+tls_server_digest(struct tls_config *config, struct tls_keypair *kp,
+    struct tls_keypair *alt_kp, unsigned char *digest)
+{
+	SHA256_CTX sha;
+
+	SHA256_Init(&sha);
+
+	tls_server_digest_keypair(&sha, kp);
+	tls_server_digest_keypair(&sha, alt_kp);
+
+	tls_server_digest_mem(&sha, config->alpn, config->alpn_len);
+	tls_server_digest_str(&sha, config->ca_path);
+	tls_server_digest_mem(&sha, config->ca_mem, config->ca_len);
+	tls_server_digest_str(&sha, config->ciphers);
+	tls_server_digest_mem(&sha, config->crl_mem, config->crl_len);
+	tls_server_digest_mem(&sha, config->ecdhecurves,
+	    config->ecdhecurves_len * sizeof(*config->ecdhecurves));
+	SHA256_Update(&sha, &config->ciphers_server,
+	    sizeof(config->ciphers_server));
+	SHA256_Update(&sha, &config->dheparams, sizeof(config->dheparams));
+	SHA256_Update(&sha, &config->ktls, sizeof(config->ktls));
+	SHA256_Update(&sha, &config->max_early_data,
+	    sizeof(config->max_early_data));
+	SHA256_Update(&sha, &config->protocols, sizeof(config->protocols));
+	SHA256_Update(&sha, config->session_id, sizeof(config->session_id));
+	SHA256_Update(&sha, &config->session_lifetime,
+	    sizeof(config->session_lifetime));
+	SHA256_Update(&sha, &config->verify_cert, sizeof(config->verify_cert));
+	SHA256_Update(&sha, &config->verify_client,
+	    sizeof(config->verify_client));
+	SHA256_Update(&sha, &config->verify_depth,
+	    sizeof(config->verify_depth));
+	SHA256_Update(&sha, &config->verify_time, sizeof(config->verify_time));
+	SHA256_Update(&sha, &config->skip_private_key_check,
+	    sizeof(config->skip_private_key_check));
+	SHA256_Update(&sha, &config->use_fake_private_key,
+	    sizeof(config->use_fake_private_key));
+
+	SHA256_Final(digest, &sha);
+}
+
+static ASN1_OCTET_STRING *
+tls_server_cert_altnames(X509 *cert)
+{
+	int idx;
+
+	if ((idx = X509_get_ext_by_NID(cert, NID_subject_alt_name, -1)) < 0)
+		return (NULL);
+
+	return (X509_EXTENSION_get_data(X509_get_ext(cert, idx)));
+}
+
+/*
+ * Find whether the keypair following kp is its alternate - one with the
+ * same names and a key of the other type, RSA or ECDSA. A pair is served
+ * from one SSL context, with libssl choosing between the keys based on
+ * the signature algorithms and cipher suites that the client offers.
+ */
 static int
-tls_configure_server_sni(struct tls *ctx)
+tls_server_keypair_alt(struct tls *ctx, struct tls_keypair *kp,
+    struct tls_keypair **alt_kp, int *alt_pkey_type)
 {
-	struct tls_sni_ctx **sni_ctx;
-	struct tls_keypair *kp;
+	ASN1_OCTET_STRING *altnames, *alt_altnames;
+	X509 *cert = NULL, *alt_cert = NULL;
+	EVP_PKEY *pkey, *alt_pkey;
+	int rv = -1;
 
-	if (ctx->config->keypair->next == NULL)
+	*alt_kp = NULL;
+	*alt_pkey_type = EVP_PKEY_NONE;
+
+	if (kp->next == NULL || kp->cert_mem == NULL ||
+	    kp->next->cert_mem == NULL)
 		return (0);
 
-	/* Set up additional SSL contexts for SNI. */
-	sni_ctx = &ctx->sni_ctx;
-	for (kp = ctx->config->keypair->next; kp != NULL; kp = kp->next) {
-		if ((*sni_ctx = tls_sni_ctx_new()) == NULL) {
-			tls_set_errorx(ctx, "out of memory");
-			goto err;
+	if (tls_keypair_load_cert(kp, &ctx->error, &cert) == -1)
+		goto err;
+	if (tls_keypair_load_cert(kp->next, &ctx->error, &alt_cert) == -1)
+		goto err;
+
+	if ((pkey = X509_get0_pubkey(cert)) == NULL ||
+	    (alt_pkey = X509_get0_pubkey(alt_cert)) == NULL)
+		goto done;
+	if (!(EVP_PKEY_id(pkey) == EVP_PKEY_RSA &&
+	    EVP_PKEY_id(alt_pkey) == EVP_PKEY_EC) &&
+	    !(EVP_PKEY_id(pkey) == EVP_PKEY_EC &&
+	    EVP_PKEY_id(alt_pkey) == EVP_PKEY_RSA))
+		goto done;
+
+	/*
+	 * The names are the subjectAltNames, or the subject if there are
+	 * none - see tls_check_name().
+	 */
+	altnames = tls_server_cert_altnames(cert);
+	alt_altnames = tls_server_cert_altnames(alt_cert);
+	if ((altnames == NULL) != (alt_altnames == NULL))
+		goto done;
+	if (altnames != NULL && ASN1_STRING_cmp(altnames, alt_altnames) != 0)
+		goto done;
+	if (altnames == NULL && X509_NAME_cmp(X509_get_subject_name(cert),
+	    X509_get_subject_name(alt_cert)) != 0)
+		goto done;
+
+	*alt_kp = kp->next;
+	*alt_pkey_type = EVP_PKEY_id(alt_pkey);
+
+ done:
+	rv = 0;
+
+ err:
+	X509_free(cert);
+	X509_free(alt_cert);
+
+	return (rv);
+}
+
+static struct tls_sni_ctx *
+tls_server_ssl_find(struct tls_server_ssl *server_ssl,
+    const unsigned char *digest)
+{
+	struct tls_sni_ctx *sni_ctx;
+
+	if (server_ssl == NULL)
+		return (NULL);
+
+	sni_ctx = server_ssl->keypair_ctx;
+	if (memcmp(sni_ctx->digest, digest, sizeof(sni_ctx->digest)) == 0)
+		return (sni_ctx);
+	for (sni_ctx = server_ssl->sni_ctx; sni_ctx != NULL;
+	    sni_ctx = sni_ctx->next) {
+		if (memcmp(sni_ctx->digest, digest,
+		    sizeof(sni_ctx->digest)) == 0)
+			return (sni_ctx);
+	}
+
+	return (NULL);
+}
+
+/*
+ * Set up the SSL context for a keypair, keeping the context that the
+ * previous configuration has for it if that is unchanged. A kept context
+ * also keeps the configuration that it was loaded from, while the keypair
+ * (and with it the OCSP staple) comes from the new configuration.
+ */
+static struct tls_sni_ctx *
+tls_server_keypair_ctx(struct tls *ctx, struct tls_server_ssl *prev_ssl,
+    struct tls_keypair *kp, struct tls_keypair *alt_kp, int alt_pkey_type,
+    int sni)
+{
+	struct tls_sni_ctx *sni_ctx, *prev;
+
+	if ((sni_ctx = tls_sni_ctx_new()) == NULL) {
+		tls_set_errorx(ctx, "out of memory");
+		goto err;
+	}
+	tls_server_digest(ctx->config, kp, alt_kp, sni_ctx->digest);
+	sni_ctx->alt_pkey_type = alt_pkey_type;
+
+	if ((prev = tls_server_ssl_find(prev_ssl, sni_ctx->digest)) != NULL) {
+		pthread_mutex_lock(&prev->config->mutex);
+		prev->config->refcount++;
+		pthread_mutex_unlock(&prev->config->mutex);
+
+		sni_ctx->config = prev->config;
+		sni_ctx->keypair = kp;
+		sni_ctx->alt_keypair = alt_kp;
+
+		SSL_CTX_up_ref(prev->ssl_ctx);
+		sni_ctx->ssl_ctx = prev->ssl_ctx;
+		if (prev->ssl_cert != NULL) {
+			X509_up_ref(prev->ssl_cert);
+			sni_ctx->ssl_cert = prev->ssl_cert;
 		}
-		(*sni_ctx)->keypair = kp;
-		if (tls_configure_server_ssl(ctx, &(*sni_ctx)->ssl_ctx, kp) == -1)
+	} else {
+		pthread_mutex_lock(&ctx->config->mutex);
+		ctx->config->refcount++;
+		pthread_mutex_unlock(&ctx->config->mutex);
+
+		sni_ctx->config = ctx->config;
+		sni_ctx->keypair = kp;
+		sni_ctx->alt_keypair = alt_kp;
+
+		if (tls_configure_server_ssl(ctx, &sni_ctx->ssl_ctx, kp,
+		    alt_kp, alt_pkey_type) == -1)
+			goto err;
+	}
+
+	if (sni && sni_ctx->ssl_cert == NULL) {
+		if (tls_keypair_load_cert(sni_ctx->keypair, &ctx->error,
+		    &sni_ctx->ssl_cert) == -1)
+			goto err;
+	}
+
+	return (sni_ctx);
+
+ err:
+	tls_sni_ctx_free(sni_ctx);
+
+	return (NULL);
+}
+
+static struct tls_server_ssl *
+tls_server_ssl_new(struct tls *ctx, struct tls_server_ssl *prev_ssl)
+{
+	struct tls_server_ssl *server_ssl;
+	struct tls_sni_ctx **sni_ctx;
+	struct tls_keypair *kp, *alt_kp;
+	int alt_pkey_type;
+
+	if ((server_ssl = calloc(1, sizeof(*server_ssl))) == NULL) {
+		tls_set_errorx(ctx, "out of memory");
+		return (NULL);
+	}
+	server_ssl->refcount = 1;
+
+	kp = ctx->config->keypair;
+	if (tls_server_keypair_alt(ctx, kp, &alt_kp, &alt_pkey_type) == -1)
+		goto err;
+	if ((server_ssl->keypair_ctx = tls_server_keypair_ctx(ctx, prev_ssl,
+	    kp, alt_kp, alt_pkey_type, 0)) == NULL)
+		goto err;
+	if (alt_kp != NULL)
+		kp = alt_kp;
+
+	/* Set up additional SSL contexts for SNI. */
+	sni_ctx = &server_ssl->sni_ctx;
+	for (kp = kp->next; kp != NULL; kp = kp->next) {
+		if (tls_server_keypair_alt(ctx, kp, &alt_kp,
+		    &alt_pkey_type) == -1)
 			goto err;
-		if (tls_keypair_load_cert(kp, &ctx->error,
-		    &(*sni_ctx)->ssl_cert) == -1)
+		if ((*sni_ctx = tls_server_keypair_ctx(ctx, prev_ssl, kp,
+		    alt_kp, alt_pkey_type, 1)) == NULL)
 			goto err;
 		sni_ctx = &(*sni_ctx)->next;
+		if (alt_kp != NULL)
+			kp = alt_kp;
 	}
 
-	return (0);
+	if (server_ssl->sni_ctx != NULL) {
+		if ((server_ssl->sni_index = tls_sni_index_build(ctx,
+		    server_ssl->sni_ctx)) == NULL)
+			goto err;
+	}
+
+	return (server_ssl);
 
  err:
-	return (-1);
+	tls_server_ssl_free(server_ssl);
+
+	return (NULL);
 }
 
+/*
+ * Configure a server, replacing any previous configuration only once the
+ * new one has been set up - on failure the previous one remains in use.
+ * The contexts are set up with a separate struct tls, so that connections
+ * accepted in the meantime see the previous configuration.
+ */
 int
-tls_configure_server(struct tls *ctx)
+tls_configure_server(struct tls *ctx, struct tls_config *config)
 {
-	if (tls_configure_server_ssl(ctx, &ctx->ssl_ctx,
-	    ctx->config->keypair) == -1)
+	struct tls_server_ssl *server_ssl, *prev_ssl;
+	struct tls_config *prev_config;
+	struct tls_error error;
+	struct tls *build;
+	int rv = -1;
+
+	if ((build = tls_new()) == NULL) {
+		tls_set_errorx(ctx, "out of memory");
+		return (-1);
+	}
+
+	pthread_mutex_lock(&config->mutex);
+	config->refcount++;
+	pthread_mutex_unlock(&config->mutex);
+
+	tls_config_free(build->config);
+	build->config = config;
+	build->keypair = config->keypair;
+
+	if (config->ocsp_refresh_staples &&
+	    tls_ocsp_refresh_start(config, &ctx->error) == -1)
 		goto err;
-	if (tls_configure_server_sni(ctx) == -1)
+
+	if ((server_ssl = tls_server_ssl_new(build,
+	    ctx->server_ssl)) == NULL) {
+		error = ctx->error;
+		ctx->error = build->error;
+		build->error = error;
 		goto err;
+	}
 
-	return (0);
+	pthread_mutex_lock(&tls_server_mutex);
+	prev_config = ctx->config;
+	prev_ssl = ctx->server_ssl;
+	ctx->config = build->config;
+	ctx->keypair = build->keypair;
+	ctx->server_ssl = server_ssl;
+	pthread_mutex_unlock(&tls_server_mutex);
+
+	build->config = prev_config;
+	tls_server_ssl_free(prev_ssl);
+
+	rv = 0;
 
  err:
-	return (-1);
+	tls_free(build);
+
+	return (rv);
 }
 
 static struct tls *
@@ -357,7 +747,8 @@ tls_accept_common(struct tls *ctx)
 		goto err;
 	}
 
-	if ((conn_ctx->ssl_conn = SSL_new(ctx->ssl_ctx)) == NULL) {
+	if ((conn_ctx->ssl_conn =
+	    SSL_new(conn_ctx->server_ssl->keypair_ctx->ssl_ctx)) == NULL) {
 		tls_set_errorx(ctx, "ssl failure");
 		goto err;
 	}
@@ -389,8 +780,7 @@ tls_accept_fds(struct tls *ctx, struct tls **cctx, int fd_read, int fd_write)
 	if ((conn_ctx = tls_accept_common(ctx)) == NULL)
 		goto err;
 
-	if (SSL_set_rfd(conn_ctx->ssl_conn, fd_read) != 1 ||
-	    SSL_set_wfd(conn_ctx->ssl_conn, fd_write) != 1) {
+	if (tls_set_fds(conn_ctx, fd_read, fd_write) != 0) {
 		tls_set_errorx(ctx, "ssl file descriptor failure");
 		goto err;
 	}
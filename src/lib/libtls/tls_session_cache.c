@@ -0,0 +1,246 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Client session cache.
+ *
+ * A configuration may hold a bounded number of client sessions, one for
+ * each server name and port that it has connected to, which are shared by
+ * all the client contexts that use the configuration. Sessions are stored
+ * from the new session callback of the SSL context and are offered again
+ * on the next connection to the same server. When the cache is full the
+ * least recently used session is dropped.
+ */
+
+#include <sys/queue.h>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <openssl/ssl.h>
+
+#include <tls.h>
+#include "tls_internal.h"
+
+struct tls_session_entry {
+	TAILQ_ENTRY(tls_session_entry) lru;
+	struct tls_session_entry *next;
+
+	char *servername;
+	int port;
+	uint32_t hash;
+
+	SSL_SESSION *session;
+};
+
+struct tls_session_cache {
+	pthread_mutex_t mutex;
+
+	TAILQ_HEAD(tls_session_lru, tls_session_entry) lru;
+	struct tls_session_entry **buckets;
+	size_t size;
+	size_t count;
+};
+
+static uint32_t
+tls_session_cache_hash(const char *servername, int port)
+{
+	uint32_t hash = 2166136261U;
+
+	/* FNV-1a over the name and the port. */
+	for (; *servername != '\0'; servername++)
+		hash = (hash ^ (unsigned char)*servername) * 16777619U;
+	hash = (hash ^ (port & 0xff)) * 16777619U;
+	hash = (hash ^ ((port >> 8) & 0xff)) * 16777619U;
+
+	return (hash);
+}
+
+static struct tls_session_entry **
+tls_session_cache_find(struct tls_session_cache *cache, const char *servername,
+    int port, uint32_t hash)
+{
+	struct tls_session_entry **ep;
+
+	for (ep = &cache->buckets[hash % cache->size]; *ep != NULL;
+	    ep = &(*ep)->next) {
+		if ((*ep)->hash == hash && (*ep)->port == port &&
+		    strcmp((*ep)->servername, servername) == 0)
+			break;
+	}
+
+	return (ep);
+}
+
+static void
+tls_session_entry_free(struct tls_session_entry *entry)
+{
+	SSL_SESSION_free(entry->session);
+	free(entry->servername);
+	free(entry);
+}
+
+/* Unlink an entry, given the bucket pointer that references it. */
+static void
+tls_session_cache_remove(struct tls_session_cache *cache,
+    struct tls_session_entry **ep)
+{
+	struct tls_session_entry *entry = *ep;
+
+	*ep = entry->next;
+	TAILQ_REMOVE(&cache->lru, entry, lru);
+	cache->count--;
+
+	tls_session_entry_free(entry);
+}
+
+struct tls_session_cache *
+tls_session_cache_new(size_t size)
+{
+	struct tls_session_cache *cache;
+
+	if ((cache = calloc(1, sizeof(*cache))) == NULL)
+		return (NULL);
+	if ((cache->buckets = calloc(size, sizeof(*cache->buckets))) == NULL)
+		goto err;
+	if (pthread_mutex_init(&cache->mutex, NULL) != 0)
+		goto err;
+
+	TAILQ_INIT(&cache->lru);
+	cache->size = size;
+
+	return (cache);
+
+ err:
+	free(cache->buckets);
+	free(cache);
+
+	return (NULL);
+}
+
+void
+tls_session_cache_free(struct tls_session_cache *cache)
+{
+	struct tls_session_entry *entry;
+
+	if (cache == NULL)
+		return;
+
+	while ((entry = TAILQ_FIRST(&cache->lru)) != NULL) {
+		TAILQ_REMOVE(&cache->lru, entry, lru);
+		tls_session_entry_free(entry);
+	}
+
+	pthread_mutex_destroy(&cache->mutex);
+	free(cache->buckets);
+	free(cache);
+}
+
+/*
+ * Return the session last stored for a server, with a reference for the
+ * caller, or NULL if there is none.
+ */
+SSL_SESSION *
+tls_session_cache_get(struct tls_session_cache *cache, const char *servername,
+    int port)
+{
+	struct tls_session_entry **ep;
+	SSL_SESSION *session = NULL;
+	uint32_t hash;
+
+	hash = tls_session_cache_hash(servername, port);
+
+	pthread_mutex_lock(&cache->mutex);
+
+	ep = tls_session_cache_find(cache, servername, port, hash);
+	if (*ep == NULL)
+		goto done;
+
+	/* Drop sessions that the server will no longer resume. */
+	if (SSL_SESSION_get_time((*ep)->session) +
+	    SSL_SESSION_get_timeout((*ep)->session) < time(NULL)) {
+		tls_session_cache_remove(cache, ep);
+		goto done;
+	}
+
+	TAILQ_REMOVE(&cache->lru, *ep, lru);
+	TAILQ_INSERT_HEAD(&cache->lru, *ep, lru);
+
+	session = (*ep)->session;
+	SSL_SESSION_up_ref(session);
+
+ done:
+	pthread_mutex_unlock(&cache->mutex);
+
+	return (session);
+}
+
+/*
+ * Store a session for a server, replacing any that it had before. The
+ * reference to the session passes to the cache, even on failure.
+ */
+void
+tls_session_cache_put(struct tls_session_cache *cache, const char *servername,
+    int port, SSL_SESSION *session)
+{
+	struct tls_session_entry **ep, *entry;
+	uint32_t hash;
+
+	hash = tls_session_cache_hash(servername, port);
+
+	pthread_mutex_lock(&cache->mutex);
+
+	ep = tls_session_cache_find(cache, servername, port, hash);
+	if ((entry = *ep) != NULL) {
+		SSL_SESSION_free(entry->session);
+		entry->session = session;
+		TAILQ_REMOVE(&cache->lru, entry, lru);
+		TAILQ_INSERT_HEAD(&cache->lru, entry, lru);
+		goto done;
+	}
+
+	if ((entry = calloc(1, sizeof(*entry))) == NULL ||
+	    (entry->servername = strdup(servername)) == NULL) {
+		free(entry);
+		SSL_SESSION_free(session);
+		goto done;
+	}
+	entry->port = port;
+	entry->hash = hash;
+	entry->session = session;
+
+	if (cache->count == cache->size) {
+		struct tls_session_entry *last;
+
+		last = TAILQ_LAST(&cache->lru, tls_session_lru);
+		tls_session_cache_remove(cache, tls_session_cache_find(cache,
+		    last->servername, last->port, last->hash));
+	}
+
+	/* The bucket may have changed if the oldest entry shared it. */
+	ep = &cache->buckets[hash % cache->size];
+	entry->next = *ep;
+	*ep = entry;
+	TAILQ_INSERT_HEAD(&cache->lru, entry, lru);
+	cache->count++;
+
+ done:
+	pthread_mutex_unlock(&cache->mutex);
+}
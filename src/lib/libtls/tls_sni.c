@@ -0,0 +1,344 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Server name index.
+ *
+ * The names of the SNI certificates are hashed when the server is
+ * configured, so that a servername is found without decoding every
+ * certificate.  A name is held as is, and a valid wildcard name is also
+ * held by its domain, including the leading dot.  Matching follows
+ * tls_check_name(), where the first certificate with a matching name wins.
+ */
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/x509v3.h>
+
+#include <tls.h>
+#include "tls_internal.h"
+
+#define TLS_SNI_INDEX_MIN_BUCKETS	16
+
+struct tls_sni_name {
+	struct tls_sni_name *next;
+	struct tls_sni_ctx *sni_ctx;
+	size_t order;
+	int wildcard;
+	char *name;
+};
+
+struct tls_sni_index {
+	struct tls_sni_name **buckets;
+	size_t num_buckets;
+	size_t num_names;
+};
+
+static uint32_t
+tls_sni_hash(const char *name, int wildcard)
+{
+	uint32_t hash = 2166136261U;
+
+	hash = (hash ^ (wildcard != 0)) * 16777619U;
+	while (*name != '\0')
+		hash = (hash ^ tolower((unsigned char)*name++)) * 16777619U;
+
+	return hash;
+}
+
+static struct tls_sni_name *
+tls_sni_index_find(struct tls_sni_index *index, const char *name,
+    int wildcard)
+{
+	struct tls_sni_name *sn;
+	uint32_t hash;
+
+	hash = tls_sni_hash(name, wildcard);
+	sn = index->buckets[hash & (index->num_buckets - 1)];
+	for (; sn != NULL; sn = sn->next) {
+		if (sn->wildcard == wildcard && strcasecmp(sn->name, name) == 0)
+			return sn;
+	}
+
+	return NULL;
+}
+
+static int
+tls_sni_index_grow(struct tls_sni_index *index)
+{
+	struct tls_sni_name **buckets, *sn, *nsn;
+	size_t num_buckets, i;
+	uint32_t hash;
+
+	num_buckets = index->num_buckets * 2;
+	if ((buckets = calloc(num_buckets, sizeof(*buckets))) == NULL)
+		return 0;
+
+	for (i = 0; i < index->num_buckets; i++) {
+		for (sn = index->buckets[i]; sn != NULL; sn = nsn) {
+			nsn = sn->next;
+			hash = tls_sni_hash(sn->name, sn->wildcard);
+			sn->next = buckets[hash & (num_buckets - 1)];
+			buckets[hash & (num_buckets - 1)] = sn;
+		}
+	}
+
+	free(index->buckets);
+	index->buckets = buckets;
+	index->num_buckets = num_buckets;
+
+	return 1;
+}
+
+static int
+tls_sni_index_add(struct tls_sni_index *index, const char *name,
+    int wildcard, struct tls_sni_ctx *sni_ctx, size_t order)
+{
+	struct tls_sni_name *sn;
+	uint32_t hash;
+
+	/* An earlier certificate with the same name takes precedence. */
+	if (tls_sni_index_find(index, name, wildcard) != NULL)
+		return 1;
+
+	if (index->num_names >= index->num_buckets) {
+		if (!tls_sni_index_grow(index))
+			return 0;
+	}
+
+	if ((sn = calloc(1, sizeof(*sn))) == NULL)
+		return 0;
+	if ((sn->name = strdup(name)) == NULL) {
+		free(sn);
+		return 0;
+	}
+	sn->sni_ctx = sni_ctx;
+	sn->order = order;
+	sn->wildcard = wildcard;
+
+	hash = tls_sni_hash(name, wildcard);
+	sn->next = index->buckets[hash & (index->num_buckets - 1)];
+	index->buckets[hash & (index->num_buckets - 1)] = sn;
+	index->num_names++;
+
+	return 1;
+}
+
+/*
+ * Return the domain that a wildcard name matches, or NULL if it is not a
+ * valid wildcard - see tls_match_name().
+ */
+static const char *
+tls_sni_wildcard_domain(const char *name)
+{
+	const char *domain, *next_dot;
+
+	if (name[0] != '*')
+		return NULL;
+
+	domain = &name[1];
+	if (domain[0] != '.' || domain[1] == '.')
+		return NULL;
+	if ((next_dot = strchr(&domain[1], '.')) == NULL)
+		return NULL;
+	if (next_dot[1] == '.')
+		return NULL;
+
+	return domain;
+}
+
+static int
+tls_sni_index_add_name(struct tls *ctx, struct tls_sni_index *index,
+    const char *name, struct tls_sni_ctx *sni_ctx, size_t order)
+{
+	const char *domain;
+
+	if (!tls_sni_index_add(index, name, 0, sni_ctx, order))
+		goto err;
+	if ((domain = tls_sni_wildcard_domain(name)) != NULL) {
+		if (!tls_sni_index_add(index, domain, 1, sni_ctx, order))
+			goto err;
+	}
+
+	return 0;
+
+ err:
+	tls_set_errorx(ctx, "out of memory");
+	return -1;
+}
+
+/*
+ * Add the names of a certificate, which are its DNS subjectAltNames or
+ * its common name if it has no subjectAltName - see tls_check_name().
+ */
+static int
+tls_sni_index_add_cert(struct tls *ctx, struct tls_sni_index *index,
+    struct tls_sni_ctx *sni_ctx, size_t order)
+{
+	STACK_OF(GENERAL_NAME) *altname_stack = NULL;
+	X509_NAME *subject_name;
+	GENERAL_NAME *altname;
+	char *common_name = NULL;
+	int common_name_len;
+	int alt_exists = 0;
+	unsigned char *data;
+	int count, i, len;
+	int rv = -1;
+
+	altname_stack = X509_get_ext_d2i(sni_ctx->ssl_cert,
+	    NID_subject_alt_name, NULL, NULL);
+
+	count = sk_GENERAL_NAME_num(altname_stack);
+	for (i = 0; i < count; i++) {
+		altname = sk_GENERAL_NAME_value(altname_stack, i);
+
+		if (altname->type == GEN_DNS || altname->type == GEN_IPADD)
+			alt_exists = 1;
+		if (altname->type != GEN_DNS)
+			continue;
+		if (ASN1_STRING_type(altname->d.dNSName) != V_ASN1_IA5STRING)
+			continue;
+
+		data = ASN1_STRING_data(altname->d.dNSName);
+		len = ASN1_STRING_length(altname->d.dNSName);
+		if (len < 0 || (size_t)len != strlen(data)) {
+			tls_set_errorx(ctx, "error in SNI certificate: "
+			    "NUL byte in subjectAltName");
+			goto err;
+		}
+		if (strcmp(data, " ") == 0) {
+			tls_set_errorx(ctx, "error in SNI certificate: "
+			    "a dNSName of \" \" must not be used");
+			goto err;
+		}
+
+		if (tls_sni_index_add_name(ctx, index, (const char *)data,
+		    sni_ctx, order) == -1)
+			goto err;
+	}
+
+	/* See RFC 6125 section 6.4.4. */
+	if (alt_exists)
+		goto done;
+
+	if ((subject_name = X509_get_subject_name(sni_ctx->ssl_cert)) == NULL)
+		goto done;
+	common_name_len = X509_NAME_get_text_by_NID(subject_name,
+	    NID_commonName, NULL, 0);
+	if (common_name_len < 0)
+		goto done;
+	if ((common_name = calloc(common_name_len + 1, 1)) == NULL) {
+		tls_set_errorx(ctx, "out of memory");
+		goto err;
+	}
+	X509_NAME_get_text_by_NID(subject_name, NID_commonName, common_name,
+	    common_name_len + 1);
+	if ((size_t)common_name_len != strlen(common_name)) {
+		tls_set_errorx(ctx, "error in SNI certificate: "
+		    "NUL byte in Common Name field");
+		goto err;
+	}
+
+	if (tls_sni_index_add_name(ctx, index, common_name, sni_ctx,
+	    order) == -1)
+		goto err;
+
+ done:
+	rv = 0;
+
+ err:
+	sk_GENERAL_NAME_pop_free(altname_stack, GENERAL_NAME_free);
+	free(common_name);
+
+	return rv;
+}
+
+struct tls_sni_index *
+tls_sni_index_build(struct tls *ctx, struct tls_sni_ctx *sni_ctx)
+{
+	struct tls_sni_index *index;
+	size_t order = 0;
+
+	if ((index = calloc(1, sizeof(*index))) == NULL)
+		goto nomem;
+	index->num_buckets = TLS_SNI_INDEX_MIN_BUCKETS;
+	if ((index->buckets = calloc(index->num_buckets,
+	    sizeof(*index->buckets))) == NULL)
+		goto nomem;
+
+	for (; sni_ctx != NULL; sni_ctx = sni_ctx->next) {
+		if (tls_sni_index_add_cert(ctx, index, sni_ctx, order++) == -1)
+			goto err;
+	}
+
+	return (index);
+
+ nomem:
+	tls_set_errorx(ctx, "out of memory");
+ err:
+	tls_sni_index_free(index);
+
+	return (NULL);
+}
+
+struct tls_sni_ctx *
+tls_sni_index_lookup(struct tls_sni_index *index, const char *name)
+{
+	struct tls_sni_name *exact, *wildcard = NULL;
+	const char *domain;
+
+	if (index == NULL)
+		return NULL;
+
+	exact = tls_sni_index_find(index, name, 0);
+
+	/* No wildcard match against a name without host or domain parts. */
+	domain = strchr(name, '.');
+	if (name[0] != '.' && domain != NULL && domain[1] != '\0')
+		wildcard = tls_sni_index_find(index, domain, 1);
+
+	if (exact != NULL &&
+	    (wildcard == NULL || exact->order < wildcard->order))
+		return exact->sni_ctx;
+	if (wildcard != NULL)
+		return wildcard->sni_ctx;
+
+	return NULL;
+}
+
+void
+tls_sni_index_free(struct tls_sni_index *index)
+{
+	struct tls_sni_name *sn, *nsn;
+	size_t i;
+
+	if (index == NULL)
+		return;
+
+	for (i = 0; i < index->num_buckets && index->buckets != NULL; i++) {
+		for (sn = index->buckets[i]; sn != NULL; sn = nsn) {
+			nsn = sn->next;
+			free(sn->name);
+			free(sn);
+		}
+	}
+	free(index->buckets);
+	free(index);
+}
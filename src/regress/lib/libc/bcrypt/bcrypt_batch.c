@@ -0,0 +1,85 @@
+/*	$OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Check bcrypt_checkpass_batch(3) against bcrypt_checkpass(3).
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <pwd.h>
+#include <stdio.h>
+#include <string.h>
+
+#define NHASH	11
+
+/* From the OpenBSD bcrypt test vectors. */
+static const char *vector_pass = "U*U";
+static const char *vector_hash =
+    "$2a$05$CCCCCCCCCCCCCCCCCCCCC.E5YPO9kmyuRGyh0XouQYb4YMJKvyOeW";
+
+int
+main(void)
+{
+	char passwords[NHASH][16], hashes[NHASH][_PASSWORD_LEN];
+	const char *pass[NHASH], *hash[NHASH];
+	int errors[NHASH];
+	int i, expected, failed = 0;
+
+	/*
+	 * Mix costs so that groups are cut short, and include a wrong
+	 * password and a malformed hash.
+	 */
+	for (i = 0; i < NHASH; i++) {
+		snprintf(passwords[i], sizeof(passwords[i]), "password%d", i);
+		if (bcrypt_newhash(passwords[i], i == 5 ? 5 : 4, hashes[i],
+		    sizeof(hashes[i])) != 0)
+			err(1, "bcrypt_newhash");
+		pass[i] = passwords[i];
+		hash[i] = hashes[i];
+	}
+	passwords[3][0] = 'X';
+	strlcpy(hashes[7], "$2b$04$short", sizeof(hashes[7]));
+	pass[NHASH - 1] = vector_pass;
+	hash[NHASH - 1] = vector_hash;
+
+	if (bcrypt_checkpass_batch(pass, hash, errors, NHASH) != -1)
+		errx(1, "bcrypt_checkpass_batch succeeded with a bad password");
+	if (errno != EACCES)
+		errx(1, "errno is %d, want %d", errno, EACCES);
+
+	for (i = 0; i < NHASH; i++) {
+		expected = 0;
+		if (bcrypt_checkpass(pass[i], hash[i]) != 0)
+			expected = errno;
+		if (errors[i] != expected) {
+			fprintf(stderr, "FAIL: hash %d: got %d, want %d\n",
+			    i, errors[i], expected);
+			failed = 1;
+		}
+	}
+
+	passwords[3][0] = 'p';
+	strlcpy(hashes[7], hashes[6], sizeof(hashes[7]));
+	pass[7] = pass[6];
+	if (bcrypt_checkpass_batch(pass, hash, errors, NHASH) != 0) {
+		fprintf(stderr, "FAIL: bcrypt_checkpass_batch failed\n");
+		failed = 1;
+	}
+
+	return failed;
+}
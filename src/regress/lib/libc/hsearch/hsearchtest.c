@@ -58,9 +58,10 @@ testfail(const char *file, unsigned long line, const char *expression)
 int
 main(int argc, char *argv[])
 {
+	struct hsearch_data tab1, tab2;
 	ENTRY e, *ep, *ep2;
 	int created_ok;
-	char ch[2];
+	char ch[2], buf[16];
 	int i;
 
 	created_ok = hcreate(16);
@@ -118,5 +119,42 @@ main(int argc, char *argv[])
 
 	hdestroy();
 
+	/* Two reentrant tables, grown well past their initial size. */
+	memset(&tab1, 0, sizeof(tab1));
+	memset(&tab2, 0, sizeof(tab2));
+	TEST(hcreate_r(1, &tab1));
+	TEST(hcreate_r(1, &tab2));
+	for (i = 0; i < 10000; i++) {
+		snprintf(buf, sizeof(buf), "%d", i);
+		e.key = strdup(buf);
+		TEST(e.key != NULL);
+		e.data = (void *)(long)i;
+		TEST(hsearch_r(e, ENTER, &ep, &tab1));
+		TEST(ep != NULL && (long)ep->data == i);
+		if (i == 0)
+			ep2 = ep;
+		if (i % 2 == 0) {
+			e.key = strdup(buf);
+			TEST(e.key != NULL);
+			e.data = (void *)(long)-i;
+			TEST(hsearch_r(e, ENTER, &ep, &tab2));
+		}
+	}
+	/* Entries do not move when the table grows. */
+	TEST(strcmp(ep2->key, "0") == 0 && (long)ep2->data == 0);
+	e.key = buf;
+	for (i = 0; i < 10000; i++) {
+		snprintf(buf, sizeof(buf), "%d", i);
+		TEST(hsearch_r(e, FIND, &ep, &tab1));
+		TEST(ep != NULL && (long)ep->data == i);
+		if (i % 2 == 0) {
+			TEST(hsearch_r(e, FIND, &ep, &tab2));
+			TEST(ep != NULL && (long)ep->data == -i);
+		} else
+			TEST(!hsearch_r(e, FIND, &ep, &tab2) && ep == NULL);
+	}
+	hdestroy_r(&tab1);
+	hdestroy_r(&tab2);
+
 	exit(0);
 }
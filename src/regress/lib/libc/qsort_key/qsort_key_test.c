@@ -0,0 +1,144 @@
+/*	$OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Check qsort_r(3) and qsort_key(3) against mergesort(3).
+ */
+
+#include <sys/types.h>
+
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct elem {
+	uint32_t hi;
+	uint32_t lo;
+	char name[8];
+};
+
+static int
+cmp_elem(const void *v1, const void *v2)
+{
+	const struct elem *e1 = v1, *e2 = v2;
+
+	if (e1->hi != e2->hi)
+		return e1->hi < e2->hi ? -1 : 1;
+	if (e1->lo != e2->lo)
+		return e1->lo < e2->lo ? -1 : 1;
+	return strcmp(e1->name, e2->name);
+}
+
+static int
+cmp_elem_r(const void *v1, const void *v2, void *arg)
+{
+	int *reverse = arg;
+
+	return *reverse ? cmp_elem(v2, v1) : cmp_elem(v1, v2);
+}
+
+/* The key is hi in big endian, then the top byte of lo. */
+static void
+key_elem(const void *v, u_char *key)
+{
+	const struct elem *e = v;
+
+	key[0] = e->hi >> 24;
+	key[1] = e->hi >> 16;
+	key[2] = e->hi >> 8;
+	key[3] = e->hi;
+	key[4] = e->lo >> 24;
+}
+
+static void
+fill(struct elem *x, size_t n, uint32_t range)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		x[i].hi = arc4random_uniform(range);
+		x[i].lo = arc4random();
+		snprintf(x[i].name, sizeof(x[i].name), "%u",
+		    arc4random_uniform(100));
+	}
+}
+
+static int
+check(const char *name, struct elem *got, struct elem *want, size_t n)
+{
+	if (memcmp(got, want, n * sizeof(*got)) != 0) {
+		warnx("%s: wrong order for %zu elements", name, n);
+		return 1;
+	}
+	return 0;
+}
+
+int
+main(void)
+{
+	static const size_t sizes[] = { 0, 1, 2, 7, 63, 64, 65, 1000, 50000 };
+	static const uint32_t ranges[] = { 1, 3, 256, UINT32_MAX };
+	struct elem *x, *y, *z;
+	size_t i, j, n;
+	int reverse, failures = 0;
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		n = sizes[i];
+		if ((x = calloc(n + 1, sizeof(*x))) == NULL ||
+		    (y = calloc(n + 1, sizeof(*y))) == NULL ||
+		    (z = calloc(n + 1, sizeof(*z))) == NULL)
+			err(1, NULL);
+
+		for (j = 0; j < sizeof(ranges) / sizeof(ranges[0]); j++) {
+			fill(x, n, ranges[j]);
+			memcpy(z, x, n * sizeof(*x));
+			if (mergesort(z, n, sizeof(*z), cmp_elem) != 0)
+				err(1, "mergesort");
+
+			memcpy(y, x, n * sizeof(*x));
+			reverse = 0;
+			qsort_r(y, n, sizeof(*y), cmp_elem_r, &reverse);
+			failures += check("qsort_r", y, z, n);
+
+			memcpy(y, x, n * sizeof(*x));
+			if (qsort_key(y, n, sizeof(*y), 5, key_elem,
+			    cmp_elem) != 0)
+				err(1, "qsort_key");
+			failures += check("qsort_key", y, z, n);
+
+			/* Sort descending, then check against z backwards. */
+			reverse = 1;
+			qsort_r(y, n, sizeof(*y), cmp_elem_r, &reverse);
+			for (n = 0; n < sizes[i] / 2; n++) {
+				struct elem t = z[n];
+
+				z[n] = z[sizes[i] - 1 - n];
+				z[sizes[i] - 1 - n] = t;
+			}
+			n = sizes[i];
+			failures += check("qsort_r reversed", y, z, n);
+		}
+
+		free(x);
+		free(y);
+		free(z);
+	}
+
+	return failures != 0;
+}
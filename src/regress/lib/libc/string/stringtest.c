@@ -0,0 +1,182 @@
+/*	$OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Check strlen(), strchr(), memchr() and memcmp() against byte at a time
+ * loops, over all alignments and short lengths, and at the end of a page
+ * that is followed by an unmapped one.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAXOFF	16
+#define MAXLEN	80
+
+static size_t
+ref_strlen(const char *s)
+{
+	size_t n = 0;
+
+	while (s[n] != '\0')
+		n++;
+	return n;
+}
+
+static char *
+ref_strchr(const char *s, int c)
+{
+	for (;; s++) {
+		if (*s == (char)c)
+			return (char *)s;
+		if (*s == '\0')
+			return NULL;
+	}
+}
+
+static void *
+ref_memchr(const void *s, int c, size_t n)
+{
+	const unsigned char *p = s;
+
+	for (; n > 0; n--, p++) {
+		if (*p == (unsigned char)c)
+			return (void *)p;
+	}
+	return NULL;
+}
+
+static int
+ref_memcmp(const void *s1, const void *s2, size_t n)
+{
+	const unsigned char *p1 = s1, *p2 = s2;
+
+	for (; n > 0; n--, p1++, p2++) {
+		if (*p1 != *p2)
+			return *p1 - *p2;
+	}
+	return 0;
+}
+
+static int
+sign(int v)
+{
+	return (v > 0) - (v < 0);
+}
+
+static int
+check(char *s, size_t len, char *other)
+{
+	char *p;
+	int failures = 0;
+	int c;
+
+	if (strlen(s) != ref_strlen(s)) {
+		fprintf(stderr, "strlen: length %zu at %p\n", len, s);
+		failures++;
+	}
+
+	for (c = 0; c < 256; c += 51) {
+		if (strchr(s, c) != ref_strchr(s, c)) {
+			fprintf(stderr, "strchr: 0x%x, length %zu at %p\n",
+			    c, len, s);
+			failures++;
+		}
+		if (memchr(s, c, len) != ref_memchr(s, c, len)) {
+			fprintf(stderr, "memchr: 0x%x, length %zu at %p\n",
+			    c, len, s);
+			failures++;
+		}
+	}
+	if (len > 0 && strchr(s, s[len - 1]) != ref_strchr(s, s[len - 1])) {
+		fprintf(stderr, "strchr: last byte, length %zu at %p\n",
+		    len, s);
+		failures++;
+	}
+	if (len > 0 &&
+	    memchr(s, s[len - 1], len) != ref_memchr(s, s[len - 1], len)) {
+		fprintf(stderr, "memchr: last byte, length %zu at %p\n",
+		    len, s);
+		failures++;
+	}
+
+	if (other != NULL) {
+		memcpy(other, s, len);
+		if (memcmp(s, other, len) != 0) {
+			fprintf(stderr, "memcmp: equal, length %zu at %p\n",
+			    len, s);
+			failures++;
+		}
+		for (p = other; p < other + len; p += 7) {
+			(*p)++;
+			if (sign(memcmp(s, other, len)) !=
+			    sign(ref_memcmp(s, other, len)) ||
+			    sign(memcmp(other, s, len)) !=
+			    sign(ref_memcmp(other, s, len))) {
+				fprintf(stderr, "memcmp: differ at %zu, "
+				    "length %zu at %p\n", p - other, len, s);
+				failures++;
+			}
+			(*p)--;
+		}
+	}
+
+	return failures;
+}
+
+int
+main(void)
+{
+	char buf[MAXOFF + MAXLEN + 1], other[MAXOFF + MAXLEN];
+	size_t off, off2, len, pagesize, i;
+	char *page;
+	int failures = 0;
+
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = 0x80 + (i * 37) % 127;
+
+	for (off = 0; off < MAXOFF; off++) {
+		for (len = 0; len < MAXLEN; len++) {
+			char saved = buf[off + len];
+
+			buf[off + len] = '\0';
+			off2 = (off + len) % MAXOFF;
+			failures += check(buf + off, len, other + off2);
+			buf[off + len] = saved;
+		}
+	}
+
+	/* Strings ending right before an unmapped page. */
+	pagesize = getpagesize();
+	if ((page = mmap(NULL, 2 * pagesize, PROT_READ | PROT_WRITE,
+	    MAP_PRIVATE | MAP_ANON, -1, 0)) == MAP_FAILED)
+		err(1, "mmap");
+	if (mprotect(page + pagesize, pagesize, PROT_NONE) == -1)
+		err(1, "mprotect");
+	memset(page, 'a', pagesize);
+	page[pagesize - 1] = '\0';
+	for (len = 0; len < MAXLEN; len++)
+		failures += check(page + pagesize - 1 - len, len, NULL);
+
+	return failures != 0;
+}
@@ -16,53 +16,189 @@
  */
 
 #include <assert.h>
+#include <err.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 #define ASSERT_EQ(a, b) assert((a) == (b))
 
 enum {
-	N = 8
+	N = 8,
+	MAXN = 40,
+	MAXOFF = 8,
+	TIMING_LEN = 16384,
+	TIMING_ROUNDS = 20000,
 };
 
-static unsigned char bufone[N], buftwo[N];
+static unsigned char bufone[MAXOFF + MAXN], buftwo[MAXOFF + MAXN];
 
 void
-check()
+check(const unsigned char *one, const unsigned char *two, size_t n)
 {
-	int cmp = memcmp(bufone, buftwo, N);
+	int cmp = memcmp(one, two, n);
 
 	/* Check for reflexivity. */
-	ASSERT_EQ(0, timingsafe_bcmp(bufone, bufone, N));
-	ASSERT_EQ(0, timingsafe_bcmp(buftwo, buftwo, N));
-	ASSERT_EQ(0, timingsafe_memcmp(bufone, bufone, N));
-	ASSERT_EQ(0, timingsafe_memcmp(buftwo, buftwo, N));
+	ASSERT_EQ(0, timingsafe_bcmp(one, one, n));
+	ASSERT_EQ(0, timingsafe_bcmp(two, two, n));
+	ASSERT_EQ(0, timingsafe_memcmp(one, one, n));
+	ASSERT_EQ(0, timingsafe_memcmp(two, two, n));
 
 	/* Check that timingsafe_bcmp returns 0 iff memcmp returns 0. */
-	ASSERT_EQ(cmp == 0, timingsafe_bcmp(bufone, buftwo, N) == 0);
+	ASSERT_EQ(cmp == 0, timingsafe_bcmp(one, two, n) == 0);
 
 	/* Check that timingsafe_memcmp returns cmp... */
-	ASSERT_EQ(cmp < 0, timingsafe_memcmp(bufone, buftwo, N) < 0);
+	ASSERT_EQ(cmp < 0, timingsafe_memcmp(one, two, n) < 0);
+	ASSERT_EQ(cmp > 0, timingsafe_memcmp(one, two, n) > 0);
 
 	/* ... or -cmp if the argument order is swapped. */
-	ASSERT_EQ(-cmp < 0, timingsafe_memcmp(buftwo, bufone, N) < 0);
+	ASSERT_EQ(-cmp < 0, timingsafe_memcmp(two, one, n) < 0);
+	ASSERT_EQ(-cmp > 0, timingsafe_memcmp(two, one, n) > 0);
 }
 
+/*
+ * Check every length and alignment around the word sized steps of the
+ * implementations, with buffers that differ in each single position.
+ */
+void
+check_lengths(void)
+{
+	size_t n, off1, off2, j;
+	unsigned char *one, *two;
+
+	for (n = 0; n <= MAXN; n++) {
+		for (off1 = 0; off1 < MAXOFF; off1++) {
+			for (off2 = 0; off2 < MAXOFF; off2++) {
+				one = bufone + off1;
+				two = buftwo + off2;
+				arc4random_buf(one, n);
+				memcpy(two, one, n);
+				check(one, two, n);
+				for (j = 0; j < n; j++) {
+					two[j] = arc4random();
+					check(one, two, n);
+					two[j] = one[j];
+				}
+			}
+		}
+	}
+}
+
+static uint64_t
+nsecs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int
+cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ * Welch's t-test between the time taken to compare equal buffers and
+ * buffers that differ in the first byte, in randomly interleaved rounds.
+ * Rounds slower than the 90th percentile are dropped, since interrupts
+ * and preemption would otherwise swamp the result. A comparison that
+ * stops at the first difference gives a t value in the hundreds; a
+ * constant time one stays in the noise.
+ */
+static double
+timing_t(int (*cmp)(const void *, const void *, size_t))
+{
+	static unsigned char a[TIMING_LEN], b[TIMING_LEN];
+	static double times[TIMING_ROUNDS], sorted[TIMING_ROUNDS];
+	static int classes[TIMING_ROUNDS];
+	double mean[2] = { 0, 0 }, m2[2] = { 0, 0 }, d, t, crop;
+	uint64_t start;
+	size_t count[2] = { 0, 0 };
+	volatile int sink;
+	int i, class;
+
+	arc4random_buf(a, sizeof(a));
+	memcpy(b, a, sizeof(b));
+
+	for (i = 0; i < TIMING_ROUNDS; i++) {
+		classes[i] = arc4random_uniform(2);
+		b[0] = classes[i] ? ~a[0] : a[0];
+
+		start = nsecs();
+		sink = cmp(a, b, sizeof(a));
+		times[i] = nsecs() - start;
+		(void)sink;
+	}
+
+	memcpy(sorted, times, sizeof(sorted));
+	qsort(sorted, TIMING_ROUNDS, sizeof(sorted[0]), cmp_double);
+	crop = sorted[TIMING_ROUNDS * 9 / 10];
+
+	/* Skip the first rounds, taken while the caches warm up. */
+	for (i = TIMING_ROUNDS / 10; i < TIMING_ROUNDS; i++) {
+		if ((t = times[i]) > crop)
+			continue;
+		class = classes[i];
+		count[class]++;
+		d = t - mean[class];
+		mean[class] += d / count[class];
+		m2[class] += d * (t - mean[class]);
+	}
+
+	return (mean[0] - mean[1]) / sqrt(m2[0] / (count[0] - 1) / count[0] +
+	    m2[1] / (count[1] - 1) / count[1]);
+}
+
+/*
+ * Only fail on an obvious leak, as found in a loop that exits early;
+ * the measurements are too noisy on a busy machine for a tighter bound.
+ */
 int
-main()
+check_timing(void)
+{
+	double t;
+	int failed = 0;
+
+	if ((t = timing_t(timingsafe_bcmp)) > 50 || t < -50) {
+		fprintf(stderr, "timingsafe_bcmp: t = %.1f\n", t);
+		failed = 1;
+	}
+	if ((t = timing_t(timingsafe_memcmp)) > 50 || t < -50) {
+		fprintf(stderr, "timingsafe_memcmp: t = %.1f\n", t);
+		failed = 1;
+	}
+
+	return (failed);
+}
+
+int
+main(int argc, char *argv[])
 {
 	int i, j;
 
+	if (argc == 2 && strcmp(argv[1], "-t") == 0)
+		return (check_timing());
+
 	for (i = 0; i < 10000; i++) {
 		arc4random_buf(bufone, N);
 		arc4random_buf(buftwo, N);
 
-		check();
+		check(bufone, buftwo, N);
 		for (j = 0; j < N; j++) {
 			buftwo[j] = bufone[j];
-			check();
+			check(bufone, buftwo, N);
 		}
 	}
 
+	check_lengths();
+
 	return (0);
 }
@@ -48,6 +48,9 @@
  * ====================================================================
  */
 
+#include <sys/types.h>
+#include <sys/uio.h>
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -131,6 +134,24 @@ aead_from_name(const EVP_AEAD **aead, const char *name)
 		*aead = EVP_aead_aes_256_gcm();
 #else
 		fprintf(stderr, "No AES support.\n");
+#endif
+	} else if (strcmp(name, "aes-128-gcm-siv") == 0) {
+#ifndef OPENSSL_NO_AES
+		*aead = EVP_aead_aes_128_gcm_siv();
+#else
+		fprintf(stderr, "No AES support.\n");
+#endif
+	} else if (strcmp(name, "aes-256-gcm-siv") == 0) {
+#ifndef OPENSSL_NO_AES
+		*aead = EVP_aead_aes_256_gcm_siv();
+#else
+		fprintf(stderr, "No AES support.\n");
+#endif
+	} else if (strcmp(name, "aes-128-ccm") == 0) {
+#ifndef OPENSSL_NO_AES
+		*aead = EVP_aead_aes_128_ccm();
+#else
+		fprintf(stderr, "No AES support.\n");
 #endif
 	} else if (strcmp(name, "chacha20-poly1305") == 0) {
 #if !defined(OPENSSL_NO_CHACHA) && !defined(OPENSSL_NO_POLY1305)
@@ -155,11 +176,92 @@ aead_from_name(const EVP_AEAD **aead, const char *name)
 	return 1;
 }
 
+/*
+ * Split the buffer into three fragments, at the given offset and half way
+ * through the remainder (clamped to the length of the buffer).
+ */
+static void
+split_iov(struct iovec iov[3], unsigned char *buf, size_t len, size_t split)
+{
+	size_t first, second;
+
+	first = split < len ? split : len;
+	second = (len - first) / 2;
+
+	iov[0].iov_base = buf;
+	iov[0].iov_len = first;
+	iov[1].iov_base = buf + first;
+	iov[1].iov_len = second;
+	iov[2].iov_base = buf + first + second;
+	iov[2].iov_len = len - first - second;
+}
+
+static int
+run_iov_test_case(EVP_AEAD_CTX *ctx, unsigned char bufs[NUM_TYPES][BUF_MAX],
+    const unsigned int lengths[NUM_TYPES], unsigned int line_no)
+{
+	unsigned char out[BUF_MAX + EVP_AEAD_MAX_TAG_LENGTH], out2[BUF_MAX];
+	unsigned char ct[BUF_MAX + EVP_AEAD_MAX_TAG_LENGTH];
+	struct iovec in_iov[3], ad_iov[3];
+	size_t out_len, out_len2;
+	size_t ct_len, split;
+
+	memcpy(ct, bufs[CT], lengths[CT]);
+	memcpy(ct + lengths[CT], bufs[TAG], lengths[TAG]);
+	ct_len = lengths[CT] + lengths[TAG];
+
+	for (split = 0; split <= ct_len; split++) {
+		split_iov(in_iov, bufs[IN], lengths[IN], split);
+		split_iov(ad_iov, bufs[AD], lengths[AD], split);
+
+		if (!EVP_AEAD_CTX_seal_iov(ctx, out, &out_len, sizeof(out),
+		    bufs[NONCE], lengths[NONCE], in_iov, 3, ad_iov, 3)) {
+			fprintf(stderr, "Failed to run AEAD (iov, split %zu) "
+			    "on line %u\n", split, line_no);
+			return 0;
+		}
+
+		if (out_len != ct_len || memcmp(out, ct, ct_len) != 0) {
+			fprintf(stderr, "Bad output (iov, split %zu) on line "
+			    "%u\n", split, line_no);
+			return 0;
+		}
+
+		split_iov(in_iov, ct, ct_len, split);
+
+		if (!EVP_AEAD_CTX_open_iov(ctx, out2, &out_len2, lengths[IN],
+		    bufs[NONCE], lengths[NONCE], in_iov, 3, ad_iov, 3)) {
+			fprintf(stderr, "Failed to decrypt (iov, split %zu) "
+			    "on line %u\n", split, line_no);
+			return 0;
+		}
+
+		if (out_len2 != lengths[IN] ||
+		    memcmp(out2, bufs[IN], out_len2) != 0) {
+			fprintf(stderr, "Plaintext mismatch (iov, split %zu) "
+			    "on line %u\n", split, line_no);
+			return 0;
+		}
+
+		/* Corrupt the last byte of the tag. */
+		ct[ct_len - 1] ^= 0x80;
+		if (EVP_AEAD_CTX_open_iov(ctx, out2, &out_len2, lengths[IN],
+		    bufs[NONCE], lengths[NONCE], in_iov, 3, ad_iov, 3)) {
+			fprintf(stderr, "Decrypted bad data (iov, split %zu) "
+			    "on line %u\n", split, line_no);
+			return 0;
+		}
+		ct[ct_len - 1] ^= 0x80;
+	}
+
+	return 1;
+}
+
 static int
 run_test_case(const EVP_AEAD* aead, unsigned char bufs[NUM_TYPES][BUF_MAX],
     const unsigned int lengths[NUM_TYPES], unsigned int line_no)
 {
-	EVP_AEAD_CTX ctx;
+	EVP_AEAD_CTX ctx, copy;
 	unsigned char out[BUF_MAX + EVP_AEAD_MAX_TAG_LENGTH], out2[BUF_MAX];
 	size_t out_len, out_len2;
 
@@ -215,7 +317,20 @@ run_test_case(const EVP_AEAD* aead, unsigned char bufs[NUM_TYPES][BUF_MAX],
 		return 0;
 	}
 
+	/*
+	 * The copy must not depend on the original, which is cleaned up
+	 * (and cleared) before the copy is used.
+	 */
+	if (!EVP_AEAD_CTX_copy(&copy, &ctx)) {
+		fprintf(stderr, "Failed to copy AEAD on line %u\n", line_no);
+		return 0;
+	}
 	EVP_AEAD_CTX_cleanup(&ctx);
+
+	if (!run_iov_test_case(&copy, bufs, lengths, line_no))
+		return 0;
+
+	EVP_AEAD_CTX_cleanup(&copy);
 	return 1;
 }
 
@@ -0,0 +1,242 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/aes.h>
+#include <openssl/evp.h>
+
+#define MAX_BLOCKS	33
+
+/* FIPS 197, Appendix C. */
+static const unsigned char fips197_plaintext[AES_BLOCK_SIZE] = {
+	0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+	0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff,
+};
+
+static const struct aes_kat {
+	int bits;
+	unsigned char ciphertext[AES_BLOCK_SIZE];
+} aes_kats[] = {
+	{
+		.bits = 128,
+		.ciphertext = {
+			0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+			0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a,
+		},
+	},
+	{
+		.bits = 192,
+		.ciphertext = {
+			0xdd, 0xa9, 0x7c, 0xa4, 0x86, 0x4c, 0xdf, 0xe0,
+			0x6e, 0xaf, 0x70, 0xa0, 0xec, 0x0d, 0x71, 0x91,
+		},
+	},
+	{
+		.bits = 256,
+		.ciphertext = {
+			0x8e, 0xa2, 0xb7, 0xca, 0x51, 0x67, 0x45, 0xbf,
+			0xea, 0xfc, 0x49, 0x90, 0x4b, 0x49, 0x60, 0x89,
+		},
+	},
+};
+
+#define N_AES_KATS (sizeof(aes_kats) / sizeof(aes_kats[0]))
+
+static unsigned char key[32];
+static unsigned char in[MAX_BLOCKS * AES_BLOCK_SIZE];
+static unsigned char out[MAX_BLOCKS * AES_BLOCK_SIZE];
+static unsigned char want[MAX_BLOCKS * AES_BLOCK_SIZE];
+
+static int
+aes_kat_test(const struct aes_kat *kat)
+{
+	AES_KEY aes_key;
+	unsigned char block[AES_BLOCK_SIZE];
+
+	if (AES_set_encrypt_key(key, kat->bits, &aes_key) != 0) {
+		fprintf(stderr, "FAIL: AES-%d encrypt key setup\n", kat->bits);
+		return 0;
+	}
+	AES_encrypt(fips197_plaintext, block, &aes_key);
+	if (memcmp(block, kat->ciphertext, sizeof(block)) != 0) {
+		fprintf(stderr, "FAIL: AES-%d encryption\n", kat->bits);
+		return 0;
+	}
+
+	if (AES_set_decrypt_key(key, kat->bits, &aes_key) != 0) {
+		fprintf(stderr, "FAIL: AES-%d decrypt key setup\n", kat->bits);
+		return 0;
+	}
+	AES_decrypt(kat->ciphertext, block, &aes_key);
+	if (memcmp(block, fips197_plaintext, sizeof(block)) != 0) {
+		fprintf(stderr, "FAIL: AES-%d decryption\n", kat->bits);
+		return 0;
+	}
+
+	return 1;
+}
+
+static const EVP_CIPHER *
+aes_ecb_cipher(int bits)
+{
+	if (bits == 128)
+		return EVP_aes_128_ecb();
+	if (bits == 192)
+		return EVP_aes_192_ecb();
+	return EVP_aes_256_ecb();
+}
+
+/*
+ * Check the modes that may process several blocks at once against the
+ * single block functions.
+ */
+static int
+aes_blocks_test(int bits, size_t blocks)
+{
+	EVP_CIPHER_CTX *ctx = NULL;
+	AES_KEY enc_key, dec_key;
+	unsigned char iv[AES_BLOCK_SIZE], ctr[AES_BLOCK_SIZE];
+	unsigned char ecount[AES_BLOCK_SIZE];
+	unsigned int num;
+	size_t i, j, len;
+	int enc, outl;
+	int failed = 1;
+
+	len = blocks * AES_BLOCK_SIZE;
+
+	if (AES_set_encrypt_key(key, bits, &enc_key) != 0 ||
+	    AES_set_decrypt_key(key, bits, &dec_key) != 0) {
+		fprintf(stderr, "FAIL: AES-%d key setup\n", bits);
+		goto done;
+	}
+
+	/* ECB, through EVP. */
+	if ((ctx = EVP_CIPHER_CTX_new()) == NULL) {
+		fprintf(stderr, "FAIL: EVP_CIPHER_CTX_new\n");
+		goto done;
+	}
+	for (enc = 0; enc <= 1; enc++) {
+		for (i = 0; i < len; i += AES_BLOCK_SIZE) {
+			if (enc)
+				AES_encrypt(in + i, want + i, &enc_key);
+			else
+				AES_decrypt(in + i, want + i, &dec_key);
+		}
+		if (!EVP_CipherInit_ex(ctx, aes_ecb_cipher(bits), NULL, key,
+		    NULL, enc) || !EVP_CIPHER_CTX_set_padding(ctx, 0) ||
+		    !EVP_CipherUpdate(ctx, out, &outl, in, len) ||
+		    (size_t)outl != len) {
+			fprintf(stderr, "FAIL: AES-%d ECB %zu blocks\n", bits,
+			    blocks);
+			goto done;
+		}
+		if (memcmp(out, want, len) != 0) {
+			fprintf(stderr, "FAIL: AES-%d ECB %s, %zu blocks\n",
+			    bits, enc ? "encryption" : "decryption", blocks);
+			goto done;
+		}
+	}
+
+	/* CBC decryption, in place. */
+	memset(iv, 0xa5, sizeof(iv));
+	for (i = 0; i < len; i += AES_BLOCK_SIZE) {
+		AES_decrypt(in + i, want + i, &dec_key);
+		for (j = 0; j < AES_BLOCK_SIZE; j++) {
+			want[i + j] ^= i == 0 ? iv[j] :
+			    in[i + j - AES_BLOCK_SIZE];
+		}
+	}
+	memcpy(out, in, len);
+	AES_cbc_encrypt(out, out, len, &dec_key, iv, AES_DECRYPT);
+	if (memcmp(out, want, len) != 0) {
+		fprintf(stderr, "FAIL: AES-%d CBC decryption, %zu blocks\n",
+		    bits, blocks);
+		goto done;
+	}
+	if (blocks > 0 &&
+	    memcmp(iv, in + len - AES_BLOCK_SIZE, sizeof(iv)) != 0) {
+		fprintf(stderr, "FAIL: AES-%d CBC decryption IV, %zu blocks\n",
+		    bits, blocks);
+		goto done;
+	}
+
+	/* CTR, with the low 32 bits of the counter about to wrap. */
+	memset(ctr, 0xff, sizeof(ctr));
+	ctr[0] = 0;
+	ctr[AES_BLOCK_SIZE - 1] = 0xfd;
+	memcpy(iv, ctr, sizeof(iv));
+	for (i = 0; i < len; i += AES_BLOCK_SIZE) {
+		AES_encrypt(ctr, want + i, &enc_key);
+		for (j = 0; j < AES_BLOCK_SIZE; j++)
+			want[i + j] ^= in[i + j];
+		for (j = AES_BLOCK_SIZE; j > 0; j--) {
+			if (++ctr[j - 1] != 0)
+				break;
+		}
+	}
+	num = 0;
+	AES_ctr128_encrypt(in, out, len, &enc_key, iv, ecount, &num);
+	if (memcmp(out, want, len) != 0) {
+		fprintf(stderr, "FAIL: AES-%d CTR, %zu blocks\n", bits,
+		    blocks);
+		goto done;
+	}
+	if (memcmp(iv, ctr, sizeof(iv)) != 0) {
+		fprintf(stderr, "FAIL: AES-%d CTR counter, %zu blocks\n", bits,
+		    blocks);
+		goto done;
+	}
+
+	failed = 0;
+
+ done:
+	EVP_CIPHER_CTX_free(ctx);
+
+	return !failed;
+}
+
+int
+main(int argc, char **argv)
+{
+	size_t i, blocks;
+	int bits;
+	int failed = 1;
+
+	for (i = 0; i < sizeof(key); i++)
+		key[i] = i;
+	for (i = 0; i < N_AES_KATS; i++) {
+		if (!aes_kat_test(&aes_kats[i]))
+			goto done;
+	}
+
+	arc4random_buf(key, sizeof(key));
+	arc4random_buf(in, sizeof(in));
+	for (bits = 128; bits <= 256; bits += 64) {
+		for (blocks = 0; blocks <= MAX_BLOCKS; blocks++) {
+			if (!aes_blocks_test(bits, blocks))
+				goto done;
+		}
+	}
+
+	failed = 0;
+
+ done:
+	return failed;
+}
@@ -0,0 +1,820 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Microbenchmarks for libcrypto primitives.
+ *
+ * Each benchmark is run in batches of operations that are long enough to
+ * time accurately, and the fastest of several batches is reported, in
+ * nanoseconds and, where the CPU has a cycle counter that can be read from
+ * userland, in cycles per operation and per byte. Every result is tagged
+ * with the implementation that libcrypto chose for the primitive, so that
+ * a run with some CPU features disabled measures the other implementations.
+ *
+ * The results are one line per benchmark, which a later run can be
+ * compared against with -c.
+ */
+
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <openssl/bn.h>
+#include <openssl/chacha.h>
+#include <openssl/crypto.h>
+#include <openssl/curve25519.h>
+#include <openssl/ec.h>
+#include <openssl/ecdh.h>
+#include <openssl/ecdsa.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/obj_mac.h>
+#include <openssl/poly1305.h>
+#include <openssl/rsa.h>
+#include <openssl/sha.h>
+
+#define BENCH_MAX_RESULTS	1024
+#define BENCH_IMPL_LEN		32
+
+struct bench_state {
+	size_t size;
+	unsigned char *in;
+	unsigned char *out;
+	unsigned char key[32];
+	unsigned char nonce[24];
+	unsigned char digest[SHA256_DIGEST_LENGTH];
+
+	const EVP_AEAD *aead;
+	EVP_AEAD_CTX aead_ctx;
+	int aead_init;
+
+	const EVP_CIPHER *cipher;
+	EVP_CIPHER_CTX *cipher_ctx;
+
+	HMAC_CTX *hmac_ctx;
+
+	BN_CTX *bn_ctx;
+	BN_MONT_CTX *mont;
+	BIGNUM *a, *b, *m, *p, *r;
+
+	RSA *rsa;
+	EC_KEY *ec_key;
+	EC_KEY *ec_peer;
+	unsigned char sig[512];
+	unsigned int sig_len;
+
+	uint8_t x25519_private[X25519_KEY_LENGTH];
+	uint8_t x25519_public[X25519_KEY_LENGTH];
+};
+
+struct bench {
+	const char *name;
+	const char *impl;
+	int sized;
+	int (*setup)(struct bench_state *);
+	int (*op)(struct bench_state *);
+};
+
+struct bench_result {
+	char name[64];
+	char impl[BENCH_IMPL_LEN];
+	size_t size;
+	double ns;
+};
+
+static const size_t bench_sizes[] = {
+	16, 64, 256, 1024, 4096, 16384, 65536, 262144, 1048576,
+};
+#define N_BENCH_SIZES (sizeof(bench_sizes) / sizeof(bench_sizes[0]))
+
+static uint64_t bench_batch_ns = 20000000;
+static int bench_rounds = 5;
+
+static uint64_t
+bench_cycles(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	return __builtin_ia32_rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static int
+bench_have_cycles(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+/*
+ * Find the implementation of a primitive in the string returned by
+ * OPENSSL_cpu_features_string().
+ */
+static void
+bench_impl(const char *key, char *impl, size_t impl_len)
+{
+	const char *features, *s;
+	size_t key_len, len;
+
+	strlcpy(impl, "-", impl_len);
+	if (key == NULL)
+		return;
+
+	features = OPENSSL_cpu_features_string();
+	key_len = strlen(key);
+	for (s = features; s != NULL; s = strchr(s, ' ')) {
+		if (*s == ' ')
+			s++;
+		if (strncmp(s, key, key_len) != 0 || s[key_len] != '=')
+			continue;
+		s += key_len + 1;
+		if ((len = strcspn(s, " ")) >= impl_len)
+			len = impl_len - 1;
+		memcpy(impl, s, len);
+		impl[len] = '\0';
+		return;
+	}
+}
+
+static int
+bench_setup_aead(struct bench_state *st)
+{
+	if (!EVP_AEAD_CTX_init(&st->aead_ctx, st->aead, st->key,
+	    EVP_AEAD_key_length(st->aead), EVP_AEAD_DEFAULT_TAG_LENGTH, NULL))
+		return 0;
+	st->aead_init = 1;
+
+	return 1;
+}
+
+static int
+bench_setup_aes_128_gcm(struct bench_state *st)
+{
+	st->aead = EVP_aead_aes_128_gcm();
+	return bench_setup_aead(st);
+}
+
+static int
+bench_setup_aes_256_gcm(struct bench_state *st)
+{
+	st->aead = EVP_aead_aes_256_gcm();
+	return bench_setup_aead(st);
+}
+
+static int
+bench_setup_chacha20_poly1305(struct bench_state *st)
+{
+	st->aead = EVP_aead_chacha20_poly1305();
+	return bench_setup_aead(st);
+}
+
+static int
+bench_op_aead_seal(struct bench_state *st)
+{
+	size_t out_len;
+
+	return EVP_AEAD_CTX_seal(&st->aead_ctx, st->out, &out_len,
+	    st->size + EVP_AEAD_max_overhead(st->aead), st->nonce,
+	    EVP_AEAD_nonce_length(st->aead), st->in, st->size, NULL, 0);
+}
+
+static int
+bench_op_aead_init(struct bench_state *st)
+{
+	EVP_AEAD_CTX ctx;
+
+	if (!EVP_AEAD_CTX_init(&ctx, st->aead, st->key,
+	    EVP_AEAD_key_length(st->aead), EVP_AEAD_DEFAULT_TAG_LENGTH, NULL))
+		return 0;
+	EVP_AEAD_CTX_cleanup(&ctx);
+
+	return 1;
+}
+
+static int
+bench_setup_aes_128_gcm_key(struct bench_state *st)
+{
+	st->aead = EVP_aead_aes_128_gcm();
+	return 1;
+}
+
+static int
+bench_setup_chacha20_poly1305_key(struct bench_state *st)
+{
+	st->aead = EVP_aead_chacha20_poly1305();
+	return 1;
+}
+
+static int
+bench_setup_cipher(struct bench_state *st)
+{
+	if ((st->cipher_ctx = EVP_CIPHER_CTX_new()) == NULL)
+		return 0;
+
+	return EVP_EncryptInit_ex(st->cipher_ctx, st->cipher, NULL, st->key,
+	    st->nonce);
+}
+
+static int
+bench_setup_aes_128_cbc(struct bench_state *st)
+{
+	st->cipher = EVP_aes_128_cbc();
+	return bench_setup_cipher(st);
+}
+
+static int
+bench_setup_aes_128_ctr(struct bench_state *st)
+{
+	st->cipher = EVP_aes_128_ctr();
+	return bench_setup_cipher(st);
+}
+
+static int
+bench_setup_camellia_128_ecb(struct bench_state *st)
+{
+	st->cipher = EVP_camellia_128_ecb();
+	return bench_setup_cipher(st);
+}
+
+static int
+bench_op_cipher(struct bench_state *st)
+{
+	int out_len;
+
+	return EVP_EncryptUpdate(st->cipher_ctx, st->out, &out_len, st->in,
+	    st->size);
+}
+
+static int
+bench_op_cipher_key(struct bench_state *st)
+{
+	return EVP_EncryptInit_ex(st->cipher_ctx, NULL, NULL, st->key,
+	    st->nonce);
+}
+
+static int
+bench_op_chacha20(struct bench_state *st)
+{
+	CRYPTO_chacha_20(st->out, st->in, st->size, st->key, st->nonce, 0);
+	return 1;
+}
+
+static int
+bench_op_poly1305(struct bench_state *st)
+{
+	poly1305_context ctx;
+
+	CRYPTO_poly1305_init(&ctx, st->key);
+	CRYPTO_poly1305_update(&ctx, st->in, st->size);
+	CRYPTO_poly1305_finish(&ctx, st->out);
+
+	return 1;
+}
+
+static int
+bench_op_sha1(struct bench_state *st)
+{
+	return SHA1(st->in, st->size, st->out) != NULL;
+}
+
+static int
+bench_op_sha256(struct bench_state *st)
+{
+	return SHA256(st->in, st->size, st->out) != NULL;
+}
+
+static int
+bench_op_sha512(struct bench_state *st)
+{
+	return SHA512(st->in, st->size, st->out) != NULL;
+}
+
+static int
+bench_setup_hmac(struct bench_state *st)
+{
+	if ((st->hmac_ctx = HMAC_CTX_new()) == NULL)
+		return 0;
+
+	return HMAC_Init_ex(st->hmac_ctx, st->key, sizeof(st->key),
+	    EVP_sha256(), NULL);
+}
+
+static int
+bench_op_hmac(struct bench_state *st)
+{
+	unsigned int out_len;
+
+	if (!HMAC_Init_ex(st->hmac_ctx, NULL, 0, NULL, NULL))
+		return 0;
+	if (!HMAC_Update(st->hmac_ctx, st->in, st->size))
+		return 0;
+
+	return HMAC_Final(st->hmac_ctx, st->out, &out_len);
+}
+
+static int
+bench_op_hmac_key(struct bench_state *st)
+{
+	return HMAC_Init_ex(st->hmac_ctx, st->key, sizeof(st->key),
+	    EVP_sha256(), NULL);
+}
+
+static int
+bench_setup_bn(struct bench_state *st, int bits)
+{
+	if ((st->bn_ctx = BN_CTX_new()) == NULL)
+		return 0;
+	if ((st->a = BN_new()) == NULL || (st->b = BN_new()) == NULL ||
+	    (st->m = BN_new()) == NULL || (st->p = BN_new()) == NULL ||
+	    (st->r = BN_new()) == NULL)
+		return 0;
+	if (!BN_rand(st->m, bits, 1, 1))
+		return 0;
+	if (!BN_rand_range(st->a, st->m) || !BN_rand_range(st->b, st->m) ||
+	    !BN_rand_range(st->p, st->m))
+		return 0;
+	if ((st->mont = BN_MONT_CTX_new()) == NULL)
+		return 0;
+
+	return BN_MONT_CTX_set(st->mont, st->m, st->bn_ctx);
+}
+
+static int
+bench_setup_bn_1024(struct bench_state *st)
+{
+	return bench_setup_bn(st, 1024);
+}
+
+static int
+bench_setup_bn_2048(struct bench_state *st)
+{
+	return bench_setup_bn(st, 2048);
+}
+
+static int
+bench_op_bn_mul(struct bench_state *st)
+{
+	return BN_mul(st->r, st->a, st->b, st->bn_ctx);
+}
+
+static int
+bench_op_bn_mod_mul(struct bench_state *st)
+{
+	return BN_mod_mul_montgomery(st->r, st->a, st->b, st->mont,
+	    st->bn_ctx);
+}
+
+static int
+bench_op_bn_mod_exp(struct bench_state *st)
+{
+	return BN_mod_exp_mont_consttime(st->r, st->a, st->p, st->m,
+	    st->bn_ctx, st->mont);
+}
+
+static int
+bench_setup_rsa(struct bench_state *st)
+{
+	BIGNUM *e;
+	int ret = 0;
+
+	if ((e = BN_new()) == NULL)
+		return 0;
+	if (!BN_set_word(e, RSA_F4))
+		goto err;
+	if ((st->rsa = RSA_new()) == NULL)
+		goto err;
+	if (!RSA_generate_key_ex(st->rsa, 2048, e, NULL))
+		goto err;
+	if (!RSA_sign(NID_sha256, st->digest, sizeof(st->digest), st->sig,
+	    &st->sig_len, st->rsa))
+		goto err;
+
+	ret = 1;
+
+ err:
+	BN_free(e);
+
+	return ret;
+}
+
+static int
+bench_op_rsa_sign(struct bench_state *st)
+{
+	return RSA_sign(NID_sha256, st->digest, sizeof(st->digest), st->sig,
+	    &st->sig_len, st->rsa);
+}
+
+static int
+bench_op_rsa_verify(struct bench_state *st)
+{
+	return RSA_verify(NID_sha256, st->digest, sizeof(st->digest), st->sig,
+	    st->sig_len, st->rsa);
+}
+
+static int
+bench_setup_p256(struct bench_state *st)
+{
+	if ((st->ec_key = EC_KEY_new_by_curve_name(
+	    NID_X9_62_prime256v1)) == NULL)
+		return 0;
+	if ((st->ec_peer = EC_KEY_new_by_curve_name(
+	    NID_X9_62_prime256v1)) == NULL)
+		return 0;
+	if (!EC_KEY_generate_key(st->ec_key) ||
+	    !EC_KEY_generate_key(st->ec_peer))
+		return 0;
+
+	return ECDSA_sign(0, st->digest, sizeof(st->digest), st->sig,
+	    &st->sig_len, st->ec_key);
+}
+
+static int
+bench_op_ecdsa_sign(struct bench_state *st)
+{
+	return ECDSA_sign(0, st->digest, sizeof(st->digest), st->sig,
+	    &st->sig_len, st->ec_key);
+}
+
+static int
+bench_op_ecdsa_verify(struct bench_state *st)
+{
+	return ECDSA_verify(0, st->digest, sizeof(st->digest), st->sig,
+	    st->sig_len, st->ec_key) == 1;
+}
+
+static int
+bench_op_ecdh(struct bench_state *st)
+{
+	return ECDH_compute_key(st->out, 32,
+	    EC_KEY_get0_public_key(st->ec_peer), st->ec_key, NULL) > 0;
+}
+
+static int
+bench_setup_x25519(struct bench_state *st)
+{
+	X25519_keypair(st->x25519_public, st->x25519_private);
+	return 1;
+}
+
+static int
+bench_op_x25519_keypair(struct bench_state *st)
+{
+	X25519_keypair(st->x25519_public, st->x25519_private);
+	return 1;
+}
+
+static int
+bench_op_x25519(struct bench_state *st)
+{
+	return X25519(st->out, st->x25519_private, st->x25519_public);
+}
+
+static const struct bench benches[] = {
+	{ "aes-128-gcm", "gcm", 1, bench_setup_aes_128_gcm,
+	    bench_op_aead_seal },
+	{ "aes-256-gcm", "gcm", 1, bench_setup_aes_256_gcm,
+	    bench_op_aead_seal },
+	{ "chacha20-poly1305", "chacha20", 1, bench_setup_chacha20_poly1305,
+	    bench_op_aead_seal },
+	{ "aes-128-cbc", "aes", 1, bench_setup_aes_128_cbc, bench_op_cipher },
+	{ "aes-128-ctr", "aes", 1, bench_setup_aes_128_ctr, bench_op_cipher },
+	{ "camellia-128-ecb", "camellia", 1, bench_setup_camellia_128_ecb,
+	    bench_op_cipher },
+	{ "chacha20", "chacha20", 1, NULL, bench_op_chacha20 },
+	{ "poly1305", "poly1305", 1, NULL, bench_op_poly1305 },
+	{ "sha1", "sha1", 1, NULL, bench_op_sha1 },
+	{ "sha256", "sha256", 1, NULL, bench_op_sha256 },
+	{ "sha512", "sha512", 1, NULL, bench_op_sha512 },
+	{ "hmac-sha256", "sha256", 1, bench_setup_hmac, bench_op_hmac },
+
+	{ "aes-128-cbc-key", "aes", 0, bench_setup_aes_128_cbc,
+	    bench_op_cipher_key },
+	{ "aes-128-gcm-key", "gcm", 0, bench_setup_aes_128_gcm_key,
+	    bench_op_aead_init },
+	{ "chacha20-poly1305-key", "chacha20", 0,
+	    bench_setup_chacha20_poly1305_key, bench_op_aead_init },
+	{ "hmac-sha256-key", "sha256", 0, bench_setup_hmac,
+	    bench_op_hmac_key },
+
+	{ "bn-mul-1024", "bn", 0, bench_setup_bn_1024, bench_op_bn_mul },
+	{ "bn-mod-mul-2048", "bn", 0, bench_setup_bn_2048,
+	    bench_op_bn_mod_mul },
+	{ "bn-mod-exp-2048", "bn", 0, bench_setup_bn_2048,
+	    bench_op_bn_mod_exp },
+	{ "rsa-2048-sign", "bn", 0, bench_setup_rsa, bench_op_rsa_sign },
+	{ "rsa-2048-verify", "bn", 0, bench_setup_rsa, bench_op_rsa_verify },
+	{ "ecdsa-p256-sign", NULL, 0, bench_setup_p256, bench_op_ecdsa_sign },
+	{ "ecdsa-p256-verify", NULL, 0, bench_setup_p256,
+	    bench_op_ecdsa_verify },
+	{ "ecdh-p256", NULL, 0, bench_setup_p256, bench_op_ecdh },
+	{ "x25519-keypair", "x25519", 0, NULL, bench_op_x25519_keypair },
+	{ "x25519", "x25519", 0, bench_setup_x25519, bench_op_x25519 },
+};
+#define N_BENCHES (sizeof(benches) / sizeof(benches[0]))
+
+static void
+bench_state_free(struct bench_state *st)
+{
+	if (st->aead_init)
+		EVP_AEAD_CTX_cleanup(&st->aead_ctx);
+	EVP_CIPHER_CTX_free(st->cipher_ctx);
+	HMAC_CTX_free(st->hmac_ctx);
+	BN_MONT_CTX_free(st->mont);
+	BN_free(st->a);
+	BN_free(st->b);
+	BN_free(st->m);
+	BN_free(st->p);
+	BN_free(st->r);
+	BN_CTX_free(st->bn_ctx);
+	RSA_free(st->rsa);
+	EC_KEY_free(st->ec_key);
+	EC_KEY_free(st->ec_peer);
+	free(st->in);
+	free(st->out);
+	memset(st, 0, sizeof(*st));
+}
+
+static int
+bench_batch(const struct bench *b, struct bench_state *st, uint64_t iters,
+    uint64_t *ns, uint64_t *cycles)
+{
+	struct timespec start, end;
+	uint64_t c, i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	c = bench_cycles();
+	for (i = 0; i < iters; i++) {
+		if (!b->op(st))
+			return 0;
+	}
+	*cycles = bench_cycles() - c;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	*ns = (uint64_t)(end.tv_sec - start.tv_sec) * 1000000000ULL +
+	    end.tv_nsec - start.tv_nsec;
+
+	return 1;
+}
+
+/*
+ * Find a number of operations that takes at least bench_batch_ns and
+ * return the fastest of bench_rounds batches of that many.
+ */
+static int
+bench_measure(const struct bench *b, struct bench_state *st, double *ns_op,
+    double *cycles_op)
+{
+	uint64_t iters = 1, ns, cycles, next;
+	int i;
+
+	for (;;) {
+		if (!bench_batch(b, st, iters, &ns, &cycles))
+			return 0;
+		if (ns >= bench_batch_ns)
+			break;
+		next = iters * 16;
+		if (ns > 0 && iters * bench_batch_ns / ns + 1 < next)
+			next = iters * bench_batch_ns / ns + 1;
+		iters = next;
+	}
+
+	*ns_op = (double)ns / iters;
+	*cycles_op = (double)cycles / iters;
+	for (i = 1; i < bench_rounds; i++) {
+		if (!bench_batch(b, st, iters, &ns, &cycles))
+			return 0;
+		if ((double)ns / iters < *ns_op) {
+			*ns_op = (double)ns / iters;
+			*cycles_op = (double)cycles / iters;
+		}
+	}
+
+	return 1;
+}
+
+static void
+bench_print(FILE *fp, const char *name, const char *impl, size_t size,
+    double ns_op, double cycles_op)
+{
+	fprintf(fp, "%s\t%s\t%zu\t%.1f", name, impl, size, ns_op);
+	if (!bench_have_cycles())
+		fprintf(fp, "\t-\t-\n");
+	else if (size == 0)
+		fprintf(fp, "\t%.0f\t-\n", cycles_op);
+	else
+		fprintf(fp, "\t%.0f\t%.2f\n", cycles_op, cycles_op / size);
+}
+
+static int
+bench_run(const struct bench *b, FILE *fp)
+{
+	struct bench_state st;
+	char impl[BENCH_IMPL_LEN];
+	double ns_op, cycles_op;
+	size_t i, nsizes = 1;
+	int failed = 1;
+
+	memset(&st, 0, sizeof(st));
+	bench_impl(b->impl, impl, sizeof(impl));
+
+	if (b->sized)
+		nsizes = N_BENCH_SIZES;
+	for (i = 0; i < nsizes; i++) {
+		st.size = b->sized ? bench_sizes[i] : 0;
+		if ((st.in = calloc(1, st.size + 64)) == NULL ||
+		    (st.out = calloc(1, st.size + 512)) == NULL)
+			goto err;
+		arc4random_buf(st.key, sizeof(st.key));
+		arc4random_buf(st.nonce, sizeof(st.nonce));
+		arc4random_buf(st.digest, sizeof(st.digest));
+		if (b->setup != NULL && !b->setup(&st))
+			goto err;
+		if (!bench_measure(b, &st, &ns_op, &cycles_op))
+			goto err;
+		bench_print(fp, b->name, impl, st.size, ns_op, cycles_op);
+		fflush(fp);
+		bench_state_free(&st);
+	}
+
+	failed = 0;
+
+ err:
+	if (failed)
+		fprintf(stderr, "FAIL: %s\n", b->name);
+	bench_state_free(&st);
+
+	return failed;
+}
+
+static int
+bench_read(const char *file, struct bench_result *results, size_t *n)
+{
+	char line[256];
+	FILE *fp;
+
+	*n = 0;
+	if ((fp = fopen(file, "r")) == NULL) {
+		warn("%s", file);
+		return 0;
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+		if (*n >= BENCH_MAX_RESULTS) {
+			warnx("%s: too many results", file);
+			break;
+		}
+		if (sscanf(line, "%63s %31s %zu %lf", results[*n].name,
+		    results[*n].impl, &results[*n].size,
+		    &results[*n].ns) != 4) {
+			warnx("%s: bad line: %s", file, line);
+			continue;
+		}
+		(*n)++;
+	}
+	fclose(fp);
+
+	return 1;
+}
+
+/*
+ * Compare a run against a baseline and report every result that is more
+ * than threshold percent slower. Results that are only in one of the two
+ * are ignored.
+ */
+static int
+bench_compare(const char *baseline_file, const char *current_file,
+    double threshold)
+{
+	struct bench_result *baseline, *current, *b, *c;
+	size_t nbaseline, ncurrent, i, j;
+	int regressions = 0;
+
+	if ((baseline = calloc(BENCH_MAX_RESULTS, sizeof(*baseline))) == NULL ||
+	    (current = calloc(BENCH_MAX_RESULTS, sizeof(*current))) == NULL)
+		err(1, NULL);
+	if (!bench_read(baseline_file, baseline, &nbaseline) ||
+	    !bench_read(current_file, current, &ncurrent))
+		exit(1);
+
+	for (i = 0; i < ncurrent; i++) {
+		c = &current[i];
+		for (j = 0; j < nbaseline; j++) {
+			b = &baseline[j];
+			if (strcmp(b->name, c->name) == 0 &&
+			    strcmp(b->impl, c->impl) == 0 &&
+			    b->size == c->size)
+				break;
+		}
+		if (j == nbaseline || b->ns <= 0)
+			continue;
+		if (c->ns > b->ns * (1 + threshold / 100)) {
+			printf("REGRESSION %s %s %zu: %.1f ns -> %.1f ns "
+			    "(+%.1f%%)\n", c->name, c->impl, c->size, b->ns,
+			    c->ns, (c->ns / b->ns - 1) * 100);
+			regressions++;
+		}
+	}
+
+	free(baseline);
+	free(current);
+
+	return regressions != 0;
+}
+
+static void __dead
+usage(void)
+{
+	fprintf(stderr, "usage: bench [-lq] [-d features] [-t name]\n"
+	    "       bench -c baseline current [-T percent]\n");
+	exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *compare = NULL, *disable = NULL, *test = NULL;
+	double threshold = 10;
+	const char *errstr;
+	int ch, list = 0, failed = 0;
+	size_t i;
+
+	while ((ch = getopt(argc, argv, "c:d:lqT:t:")) != -1) {
+		switch (ch) {
+		case 'c':
+			compare = optarg;
+			break;
+		case 'd':
+			disable = optarg;
+			break;
+		case 'l':
+			list = 1;
+			break;
+		case 'q':
+			bench_batch_ns = 1000000;
+			bench_rounds = 1;
+			break;
+		case 'T':
+			threshold = strtonum(optarg, 0, 1000, &errstr);
+			if (errstr != NULL)
+				errx(1, "threshold is %s: %s", errstr, optarg);
+			break;
+		case 't':
+			test = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (compare != NULL) {
+		if (argc != 1)
+			usage();
+		return bench_compare(compare, argv[0], threshold);
+	}
+	if (argc != 0)
+		usage();
+
+	if (list) {
+		for (i = 0; i < N_BENCHES; i++)
+			printf("%s\n", benches[i].name);
+		return 0;
+	}
+
+	if (disable != NULL && !OPENSSL_cpu_features_disable(disable))
+		errx(1, "unknown CPU feature in %s", disable);
+
+	printf("# %s\n", OPENSSL_cpu_features_string());
+	printf("# name\timpl\tsize\tns/op\tcycles/op\tcycles/byte\n");
+	for (i = 0; i < N_BENCHES; i++) {
+		if (test != NULL && strcmp(test, benches[i].name) != 0)
+			continue;
+		failed |= bench_run(&benches[i], stdout);
+	}
+
+	return failed;
+}
@@ -16,10 +16,18 @@
  */
 
 #include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 
+#include <err.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <netinet/in.h>
 
@@ -143,6 +151,613 @@ do_bio_get_port_tests(void)
 	return failed;
 }
 
+static int mem_seg_freed;
+
+static void
+mem_seg_free_cb(void *data, size_t len, void *arg)
+{
+	mem_seg_freed++;
+	if (len != strlen(arg) || memcmp(data, arg, len) != 0)
+		mem_seg_freed = -1000;
+}
+
+static int
+do_bio_mem_seg_tests(void)
+{
+	static char seg1[] = "zero copy ", seg2[] = "segments\n";
+	unsigned char big[10000], out[10000 + 100];
+	struct iovec iov[4];
+	char buf[64];
+	BIO *bio;
+	size_t i;
+	int failed = 1;
+	int n;
+
+	for (i = 0; i < sizeof(big); i++)
+		big[i] = i * 7;
+
+	if ((bio = BIO_new(BIO_s_mem_seg())) == NULL)
+		errx(1, "BIO_new");
+
+	if (BIO_puts(bio, "hello ") != 6 || BIO_puts(bio, "world\n") != 6) {
+		fprintf(stderr, "FAIL: BIO_puts\n");
+		goto err;
+	}
+	if (!BIO_mem_seg_append(bio, seg1, strlen(seg1), mem_seg_free_cb,
+	    seg1) ||
+	    !BIO_mem_seg_append(bio, seg2, strlen(seg2), mem_seg_free_cb,
+	    seg2)) {
+		fprintf(stderr, "FAIL: BIO_mem_seg_append\n");
+		goto err;
+	}
+	if (BIO_pending(bio) != 31) {
+		fprintf(stderr, "FAIL: %d bytes pending, want 31\n",
+		    (int)BIO_pending(bio));
+		goto err;
+	}
+
+	/* The appended buffers must be visible in place. */
+	if ((n = BIO_mem_seg_peek(bio, iov, 4)) != 3) {
+		fprintf(stderr, "FAIL: peek returned %d segments, want 3\n", n);
+		goto err;
+	}
+	if (iov[1].iov_base != seg1 || iov[1].iov_len != strlen(seg1) ||
+	    iov[2].iov_base != seg2 || iov[2].iov_len != strlen(seg2) ||
+	    iov[0].iov_len != 12 || memcmp(iov[0].iov_base, "hello world\n",
+	    12) != 0) {
+		fprintf(stderr, "FAIL: peek returned the wrong segments\n");
+		goto err;
+	}
+
+	if (BIO_gets(bio, buf, sizeof(buf)) != 12 ||
+	    strcmp(buf, "hello world\n") != 0) {
+		fprintf(stderr, "FAIL: BIO_gets returned \"%s\"\n", buf);
+		goto err;
+	}
+	if (!BIO_mem_seg_consume(bio, 5) || mem_seg_freed != 0) {
+		fprintf(stderr, "FAIL: BIO_mem_seg_consume\n");
+		goto err;
+	}
+	if (BIO_mem_seg_consume(bio, 100)) {
+		fprintf(stderr, "FAIL: consumed more than is pending\n");
+		goto err;
+	}
+	/* A line that spans two segments. */
+	if (BIO_gets(bio, buf, sizeof(buf)) != 14 ||
+	    strcmp(buf, "copy segments\n") != 0 || mem_seg_freed != 2) {
+		fprintf(stderr, "FAIL: BIO_gets returned \"%s\", %d buffers "
+		    "freed\n", buf, mem_seg_freed);
+		goto err;
+	}
+
+	if (BIO_read(bio, buf, sizeof(buf)) != -1 ||
+	    !BIO_should_retry(bio)) {
+		fprintf(stderr, "FAIL: read from an empty BIO should retry\n");
+		goto err;
+	}
+
+	/* Writes larger than a segment, mixed with appended buffers. */
+	if (BIO_write(bio, big, 5000) != 5000 ||
+	    !BIO_mem_seg_append(bio, seg1, strlen(seg1), mem_seg_free_cb,
+	    seg1) ||
+	    BIO_write(bio, big + 5000, 5000) != 5000) {
+		fprintf(stderr, "FAIL: large writes\n");
+		goto err;
+	}
+	if (BIO_read(bio, out, 4000) != 4000 ||
+	    BIO_read(bio, out + 4000, 1010) != 1010 ||
+	    BIO_read(bio, out + 5010, sizeof(out) - 5010) != 5000) {
+		fprintf(stderr, "FAIL: large reads\n");
+		goto err;
+	}
+	if (memcmp(out, big, 5000) != 0 ||
+	    memcmp(out + 5000, seg1, 10) != 0 ||
+	    memcmp(out + 5010, big + 5000, 5000) != 0 ||
+	    mem_seg_freed != 3) {
+		fprintf(stderr, "FAIL: large reads returned the wrong data\n");
+		goto err;
+	}
+
+	/* Buffers that were not read are handed back when the BIO goes. */
+	if (!BIO_mem_seg_append(bio, seg2, strlen(seg2), mem_seg_free_cb,
+	    seg2)) {
+		fprintf(stderr, "FAIL: BIO_mem_seg_append\n");
+		goto err;
+	}
+	BIO_free(bio);
+	bio = NULL;
+	if (mem_seg_freed != 4) {
+		fprintf(stderr, "FAIL: %d buffers freed, want 4\n",
+		    mem_seg_freed);
+		goto err;
+	}
+
+	failed = 0;
+
+ err:
+	BIO_free(bio);
+
+	return failed;
+}
+
+/*
+ * Push data through a small pair so that the ring wraps, using both the
+ * copying and the non-copying interfaces.
+ */
+static int
+do_bio_pair_tests(void)
+{
+	unsigned char in[1000], out[1000];
+	BIO *bio1, *bio2;
+	char *p;
+	size_t i, done = 0, got = 0;
+	int failed = 1;
+	int n;
+
+	for (i = 0; i < sizeof(in); i++)
+		in[i] = i * 13;
+
+	if (!BIO_new_bio_pair(&bio1, 64, &bio2, 64))
+		errx(1, "BIO_new_bio_pair");
+
+	while (got < sizeof(out)) {
+		if (done < sizeof(in)) {
+			if ((done / 50) % 2 == 0) {
+				n = BIO_write(bio1, in + done,
+				    sizeof(in) - done < 50 ?
+				    sizeof(in) - done : 50);
+			} else {
+				n = BIO_nwrite0(bio1, &p);
+				if (n > 0) {
+					if ((size_t)n > sizeof(in) - done)
+						n = sizeof(in) - done;
+					memcpy(p, in + done, n);
+					n = BIO_nwrite(bio1, &p, n);
+				}
+			}
+			if (n > 0)
+				done += n;
+			else if (!BIO_should_retry(bio1)) {
+				fprintf(stderr, "FAIL: BIO pair write\n");
+				goto err;
+			}
+		}
+		if (BIO_ctrl_pending(bio2) !=
+		    BIO_ctrl_wpending(bio1) ||
+		    BIO_ctrl_pending(bio2) != done - got) {
+			fprintf(stderr, "FAIL: BIO pair has %zu bytes pending, "
+			    "want %zu\n", BIO_ctrl_pending(bio2), done - got);
+			goto err;
+		}
+		if ((got / 30) % 2 == 0)
+			n = BIO_read(bio2, out + got, 30);
+		else {
+			n = BIO_nread0(bio2, &p);
+			if (n > 0) {
+				memcpy(out + got, p, n);
+				n = BIO_nread(bio2, &p, n);
+			}
+		}
+		if (n > 0)
+			got += n;
+		else if (!BIO_should_retry(bio2)) {
+			fprintf(stderr, "FAIL: BIO pair read\n");
+			goto err;
+		}
+	}
+	if (memcmp(in, out, sizeof(in)) != 0) {
+		fprintf(stderr, "FAIL: BIO pair returned the wrong data\n");
+		goto err;
+	}
+
+	if (BIO_shutdown_wr(bio1) != 1 || BIO_read(bio2, out, 1) != 0 ||
+	    BIO_should_retry(bio2)) {
+		fprintf(stderr, "FAIL: BIO pair after shutdown\n");
+		goto err;
+	}
+
+	failed = 0;
+
+ err:
+	BIO_free(bio1);
+	BIO_free(bio2);
+
+	return failed;
+}
+
+#define BIO_PAIR_THREAD_BYTES	(4 * 1024 * 1024)
+
+static void *
+bio_pair_writer(void *arg)
+{
+	BIO *bio = arg;
+	unsigned char buf[700];
+	size_t done = 0, i, n;
+	int ret;
+
+	while (done < BIO_PAIR_THREAD_BYTES) {
+		n = BIO_PAIR_THREAD_BYTES - done;
+		if (n > sizeof(buf))
+			n = sizeof(buf);
+		for (i = 0; i < n; i++)
+			buf[i] = (done + i) % 251;
+		if ((ret = BIO_write(bio, buf, n)) > 0)
+			done += ret;
+		else if (!BIO_should_retry(bio))
+			return "write failed";
+		else
+			sched_yield();
+	}
+	BIO_shutdown_wr(bio);
+
+	return NULL;
+}
+
+/*
+ * The two BIOs of a pair may be used by two threads without a lock. Stream
+ * data from one thread to the other and check every byte.
+ */
+static int
+do_bio_pair_thread_tests(void)
+{
+	pthread_t writer;
+	BIO *bio1, *bio2;
+	void *werr;
+	char *p;
+	size_t got = 0;
+	int failed = 0;
+	int i, n;
+
+	if (!BIO_new_bio_pair(&bio1, 4096, &bio2, 4096))
+		errx(1, "BIO_new_bio_pair");
+	if (pthread_create(&writer, NULL, bio_pair_writer, bio1) != 0)
+		errx(1, "pthread_create");
+
+	for (;;) {
+		if ((n = BIO_nread0(bio2, &p)) > 0) {
+			for (i = 0; i < n; i++) {
+				if ((unsigned char)p[i] != (got + i) % 251)
+					failed = 1;
+			}
+			if (BIO_nread(bio2, &p, n) != n)
+				failed = 1;
+			got += n;
+		} else if (n == 0)
+			break;
+		else
+			sched_yield();
+	}
+
+	if (pthread_join(writer, &werr) != 0)
+		errx(1, "pthread_join");
+	if (werr != NULL) {
+		fprintf(stderr, "FAIL: BIO pair thread: %s\n", (char *)werr);
+		failed = 1;
+	}
+	if (got != BIO_PAIR_THREAD_BYTES) {
+		fprintf(stderr, "FAIL: BIO pair thread read %zu bytes\n", got);
+		failed = 1;
+	} else if (failed)
+		fprintf(stderr, "FAIL: BIO pair thread read the wrong data\n");
+
+	BIO_free(bio1);
+	BIO_free(bio2);
+
+	return failed;
+}
+
+/*
+ * Queue datagrams on a batching datagram BIO, packing writes up to the MTU,
+ * and read them back one at a time from another batching BIO.
+ */
+static int
+do_bio_dgram_batch_tests(void)
+{
+	struct sockaddr sa;
+	unsigned char buf[100], out[200];
+	BIO *wbio = NULL, *rbio = NULL;
+	int sv[2];
+	int failed = 1;
+	int i, n;
+
+	if (socketpair(AF_UNIX, SOCK_DGRAM, 0, sv) == -1)
+		err(1, "socketpair");
+	if (fcntl(sv[1], F_SETFL, O_NONBLOCK) == -1)
+		err(1, "fcntl");
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_family = AF_UNIX;
+
+	if ((wbio = BIO_new_dgram(sv[0], BIO_CLOSE)) == NULL ||
+	    (rbio = BIO_new_dgram(sv[1], BIO_CLOSE)) == NULL)
+		errx(1, "BIO_new_dgram");
+	(void)BIO_ctrl_set_connected(wbio, 1, &sa);
+	(void)BIO_ctrl_set_connected(rbio, 1, &sa);
+
+	if (!BIO_dgram_set_batch(wbio, 4)) {
+		fprintf(stderr, "SKIP: datagram batching not supported\n");
+		failed = 0;
+		goto err;
+	}
+	if (!BIO_dgram_set_batch(rbio, 4)) {
+		fprintf(stderr, "FAIL: BIO_dgram_set_batch\n");
+		goto err;
+	}
+	(void)BIO_dgram_set_pack(wbio, 1);
+	(void)BIO_ctrl(wbio, BIO_CTRL_DGRAM_SET_MTU, 100, NULL);
+
+	/* Three writes share a datagram, the fourth starts another. */
+	for (i = 0; i < 4; i++) {
+		memset(buf, 'a' + i, 30);
+		if (BIO_write(wbio, buf, 30) != 30) {
+			fprintf(stderr, "FAIL: BIO_write\n");
+			goto err;
+		}
+	}
+	if (BIO_wpending(wbio) != 30) {
+		fprintf(stderr, "FAIL: %d bytes being packed, want 30\n",
+		    (int)BIO_wpending(wbio));
+		goto err;
+	}
+
+	/* Nothing is sent before the flush. */
+	if (BIO_read(rbio, out, sizeof(out)) > 0 || !BIO_should_retry(rbio)) {
+		fprintf(stderr, "FAIL: datagram sent before BIO_flush\n");
+		goto err;
+	}
+	if (BIO_flush(wbio) != 1) {
+		fprintf(stderr, "FAIL: BIO_flush\n");
+		goto err;
+	}
+
+	if ((n = BIO_read(rbio, out, sizeof(out))) != 90) {
+		fprintf(stderr, "FAIL: read %d bytes, want 90\n", n);
+		goto err;
+	}
+	for (i = 0; i < 90; i++) {
+		if (out[i] != 'a' + i / 30) {
+			fprintf(stderr, "FAIL: packed datagram is wrong\n");
+			goto err;
+		}
+	}
+	if (BIO_pending(rbio) != 30) {
+		fprintf(stderr, "FAIL: next datagram has %d bytes, want 30\n",
+		    (int)BIO_pending(rbio));
+		goto err;
+	}
+	if ((n = BIO_read(rbio, out, sizeof(out))) != 30 || out[0] != 'd') {
+		fprintf(stderr, "FAIL: second datagram is wrong\n");
+		goto err;
+	}
+	if (BIO_read(rbio, out, sizeof(out)) > 0 || !BIO_should_retry(rbio)) {
+		fprintf(stderr, "FAIL: read a third datagram\n");
+		goto err;
+	}
+
+	/* Without packing each write is a datagram of its own. */
+	(void)BIO_dgram_set_pack(wbio, 0);
+	for (i = 0; i < 6; i++) {
+		buf[0] = i;
+		if (BIO_write(wbio, buf, 1 + i) != 1 + i) {
+			fprintf(stderr, "FAIL: BIO_write\n");
+			goto err;
+		}
+	}
+	if (BIO_flush(wbio) != 1) {
+		fprintf(stderr, "FAIL: BIO_flush\n");
+		goto err;
+	}
+	for (i = 0; i < 6; i++) {
+		if (BIO_read(rbio, out, sizeof(out)) != 1 + i || out[0] != i) {
+			fprintf(stderr, "FAIL: datagram %d is wrong\n", i);
+			goto err;
+		}
+	}
+
+	failed = 0;
+
+ err:
+	BIO_free(wbio);
+	BIO_free(rbio);
+
+	return failed;
+}
+
+static int
+read_fully(int fd, unsigned char *buf, size_t len)
+{
+	ssize_t n;
+	size_t off = 0;
+
+	while (off < len) {
+		if ((n = read(fd, buf + off, len - off)) <= 0)
+			return 0;
+		off += n;
+	}
+
+	return 1;
+}
+
+static int
+do_bio_buffer_tests(void)
+{
+	unsigned char *buf = NULL, *out = NULL;
+	BIO *bio = NULL, *sbio;
+	size_t len = 20000;
+	int sv[2];
+	int failed = 1;
+	int i;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1)
+		err(1, "socketpair");
+	if (fcntl(sv[1], F_SETFL, O_NONBLOCK) == -1)
+		err(1, "fcntl");
+
+	if ((buf = malloc(len)) == NULL || (out = malloc(len + 100)) == NULL)
+		err(1, NULL);
+	if ((bio = BIO_new(BIO_f_buffer())) == NULL)
+		errx(1, "BIO_new");
+	if ((sbio = BIO_new_socket(sv[0], BIO_CLOSE)) == NULL)
+		errx(1, "BIO_new_socket");
+	BIO_push(bio, sbio);
+
+	/* A small write stays in the buffer. */
+	memset(buf, 'a', 100);
+	if (BIO_write(bio, buf, 100) != 100) {
+		fprintf(stderr, "FAIL: BIO_write\n");
+		goto err;
+	}
+	if (BIO_wpending(bio) != 100) {
+		fprintf(stderr, "FAIL: %d bytes buffered, want 100\n",
+		    (int)BIO_wpending(bio));
+		goto err;
+	}
+
+	/* A large write is sent along with the buffered data. */
+	memset(buf, 'b', len);
+	if (BIO_write(bio, buf, len) != (int)len) {
+		fprintf(stderr, "FAIL: BIO_write\n");
+		goto err;
+	}
+	if (BIO_wpending(bio) != 0) {
+		fprintf(stderr, "FAIL: %d bytes left buffered\n",
+		    (int)BIO_wpending(bio));
+		goto err;
+	}
+	if (!read_fully(sv[1], out, len + 100)) {
+		fprintf(stderr, "FAIL: short read\n");
+		goto err;
+	}
+	for (i = 0; i < (int)len + 100; i++) {
+		if (out[i] != (i < 100 ? 'a' : 'b')) {
+			fprintf(stderr, "FAIL: wrong data at %d\n", i);
+			goto err;
+		}
+	}
+
+	/* The output buffer grows to hold a write larger than it. */
+	memset(buf, 'c', 10000);
+	if (BIO_write(bio, buf, 10000) != 10000) {
+		fprintf(stderr, "FAIL: BIO_write\n");
+		goto err;
+	}
+	if (BIO_wpending(bio) != 10000) {
+		fprintf(stderr, "FAIL: %d bytes buffered, want 10000\n",
+		    (int)BIO_wpending(bio));
+		goto err;
+	}
+	if (BIO_flush(bio) != 1) {
+		fprintf(stderr, "FAIL: BIO_flush\n");
+		goto err;
+	}
+	if (!read_fully(sv[1], out, 10000) || out[0] != 'c' ||
+	    out[9999] != 'c') {
+		fprintf(stderr, "FAIL: flushed data is wrong\n");
+		goto err;
+	}
+
+	failed = 0;
+
+ err:
+	BIO_free_all(bio);
+	close(sv[1]);
+	free(buf);
+	free(out);
+
+	return failed;
+}
+
+static int
+do_bio_zerocopy_tests(void)
+{
+	struct sockaddr_in sin;
+	socklen_t sin_len = sizeof(sin);
+	unsigned char *buf = NULL, *out = NULL;
+	BIO *bio = NULL;
+	size_t len = 65536;
+	int lfd, cfd, sfd;
+	int failed = 1;
+	int i;
+
+	if ((lfd = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+		err(1, "socket");
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(lfd, (struct sockaddr *)&sin, sizeof(sin)) == -1)
+		err(1, "bind");
+	if (listen(lfd, 1) == -1)
+		err(1, "listen");
+	if (getsockname(lfd, (struct sockaddr *)&sin, &sin_len) == -1)
+		err(1, "getsockname");
+	if ((cfd = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+		err(1, "socket");
+	if (connect(cfd, (struct sockaddr *)&sin, sizeof(sin)) == -1)
+		err(1, "connect");
+	if ((sfd = accept(lfd, NULL, NULL)) == -1)
+		err(1, "accept");
+	close(lfd);
+
+	if ((buf = malloc(len)) == NULL || (out = malloc(len)) == NULL)
+		err(1, NULL);
+	if ((bio = BIO_new_socket(cfd, BIO_CLOSE)) == NULL)
+		errx(1, "BIO_new_socket");
+
+	if (BIO_set_zerocopy(bio, 16384) != 1) {
+		fprintf(stderr, "SKIP: zero-copy sends not supported\n");
+		failed = 0;
+		goto err;
+	}
+
+	/* Small writes are copied. */
+	if (BIO_write(bio, "hello", 5) != 5) {
+		fprintf(stderr, "FAIL: BIO_write\n");
+		goto err;
+	}
+	if (BIO_get_zerocopy_sent(bio) != 0) {
+		fprintf(stderr, "FAIL: small write sent without a copy\n");
+		goto err;
+	}
+	if (!read_fully(sfd, out, 5) || memcmp(out, "hello", 5) != 0) {
+		fprintf(stderr, "FAIL: small write is wrong\n");
+		goto err;
+	}
+
+	for (i = 0; i < (int)len; i++)
+		buf[i] = i * 7;
+	if (BIO_write(bio, buf, len) != (int)len) {
+		fprintf(stderr, "FAIL: BIO_write\n");
+		goto err;
+	}
+	if (BIO_get_zerocopy_sent(bio) != 1) {
+		fprintf(stderr, "FAIL: %ld zero-copy sends, want 1\n",
+		    BIO_get_zerocopy_sent(bio));
+		goto err;
+	}
+	if (!read_fully(sfd, out, len) || memcmp(out, buf, len) != 0) {
+		fprintf(stderr, "FAIL: zero-copy write is wrong\n");
+		goto err;
+	}
+
+	/* Once the data has been read, the send completes. */
+	for (i = 0; i < 100 && BIO_get_zerocopy_done(bio) != 1; i++)
+		usleep(10000);
+	if (BIO_get_zerocopy_done(bio) != 1) {
+		fprintf(stderr, "FAIL: zero-copy send did not complete\n");
+		goto err;
+	}
+
+	failed = 0;
+
+ err:
+	BIO_free(bio);
+	close(sfd);
+	free(buf);
+	free(out);
+
+	return failed;
+}
+
 int
 main(int argc, char **argv)
 {
@@ -150,6 +765,12 @@ main(int argc, char **argv)
 
 	ret |= do_bio_get_host_ip_tests();
 	ret |= do_bio_get_port_tests();
+	ret |= do_bio_mem_seg_tests();
+	ret |= do_bio_pair_tests();
+	ret |= do_bio_pair_thread_tests();
+	ret |= do_bio_dgram_batch_tests();
+	ret |= do_bio_buffer_tests();
+	ret |= do_bio_zerocopy_tests();
 
 	return (ret);
 }
@@ -117,6 +117,7 @@ int test_mod_exp(BIO *bp, BN_CTX *ctx);
 int test_mod_exp_mont_consttime(BIO *bp, BN_CTX *ctx);
 int test_mod_exp_mont5(BIO *bp, BN_CTX *ctx);
 int test_mod_exp_sizes(BIO *bp, BN_CTX *ctx);
+int test_mod_inverse(BIO *bp, BN_CTX *ctx);
 int test_exp(BIO *bp, BN_CTX *ctx);
 int test_gf2m_add(BIO *bp);
 int test_gf2m_mod(BIO *bp);
@@ -309,6 +310,11 @@ main(int argc, char *argv[])
 		goto err;
 	(void)BIO_flush(out);
 
+	message(out, "BN_mod_inverse (constant time)");
+	if (!test_mod_inverse(out, ctx))
+		goto err;
+	(void)BIO_flush(out);
+
 #ifndef OPENSSL_NO_EC2M
 	message(out, "BN_GF2m_add");
 	if (!test_gf2m_add(out))
@@ -2460,3 +2466,74 @@ err:
 	BN_CTX_end(ctx);
 	return rc;
 }
+
+/*
+ * Compare the constant time inverse with the plain one for odd and even
+ * moduli of many sizes, and check that it fails without an inverse.
+ */
+int
+test_mod_inverse(BIO *bp, BN_CTX *ctx)
+{
+	BIGNUM *a, *n, *r, *r2;
+	int size, i, rc = 0;
+
+	BN_CTX_start(ctx);
+	CHECK_GOTO(a = BN_CTX_get(ctx));
+	CHECK_GOTO(n = BN_CTX_get(ctx));
+	CHECK_GOTO(r = BN_CTX_get(ctx));
+	CHECK_GOTO(r2 = BN_CTX_get(ctx));
+
+	for (size = 2; size < 2100; size += size < 160 ? 1 : 97) {
+		for (i = 0; i < 4; i++) {
+			CHECK_GOTO(BN_rand(n, size, 0, i < 3));
+			CHECK_GOTO(BN_rand(a, size + 8, -1, 0));
+			if (BN_is_one(n))
+				continue;
+			a->neg = rand_neg();
+
+			BN_set_flags(n, BN_FLG_CONSTTIME);
+			if (BN_mod_inverse(r, a, n, ctx) == NULL) {
+				ERR_clear_error();
+				n->flags &= ~BN_FLG_CONSTTIME;
+				if (BN_mod_inverse(r2, a, n, ctx) != NULL) {
+					printf("No constant time inverse "
+					    "at size %d\n", size);
+					goto err;
+				}
+				ERR_clear_error();
+				continue;
+			}
+			n->flags &= ~BN_FLG_CONSTTIME;
+			CHECK_GOTO(BN_mod_inverse(r2, a, n, ctx));
+
+			if (BN_cmp(r, r2) != 0) {
+				char *r_str = NULL;
+				char *r2_str = NULL;
+				CHECK_GOTO(r_str = BN_bn2hex(r));
+				CHECK_GOTO(r2_str = BN_bn2hex(r2));
+
+				printf("Incorrect inverse at size %d: "
+				    "%s vs %s\n", size, r_str, r2_str);
+				free(r_str);
+				free(r2_str);
+				goto err;
+			}
+		}
+	}
+
+	/* 6 has no inverse modulo 9. */
+	CHECK_GOTO(BN_set_word(a, 6));
+	CHECK_GOTO(BN_set_word(n, 9));
+	BN_set_flags(n, BN_FLG_CONSTTIME);
+	if (BN_mod_inverse(r, a, n, ctx) != NULL) {
+		printf("Inverse of 6 modulo 9 found\n");
+		goto err;
+	}
+	ERR_clear_error();
+
+	rc = 1;
+
+err:
+	BN_CTX_end(ctx);
+	return rc;
+}
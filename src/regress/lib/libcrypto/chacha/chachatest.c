@@ -456,6 +456,66 @@ crypto_xchacha_20_test(void)
 	return (failed);
 }
 
+/*
+ * Compare multi-block output against output produced a block at a time, with
+ * counters on either side of the low 32 bits wrapping.
+ */
+static int
+crypto_chacha_20_multiblock_test(void)
+{
+	static const uint64_t counters[] = {
+		0, 1, 0xfffffff0ULL, 0xfffffffdULL, 0x1fffffff9ULL,
+	};
+	static const size_t lens[] = { 255, 256, 511, 1024, 4159 };
+	unsigned char key[32], iv[8], cb[8];
+	unsigned char *in, *out, *want;
+	ChaCha_ctx ctx;
+	size_t i, j, k, len;
+	int failed = 0;
+
+	for (i = 0; i < sizeof(key); i++)
+		key[i] = i;
+	for (i = 0; i < sizeof(iv); i++)
+		iv[i] = 0xa0 + i;
+
+	for (i = 0; i < sizeof(counters) / sizeof(counters[0]); i++) {
+		for (j = 0; j < sizeof(lens) / sizeof(lens[0]); j++) {
+			len = lens[j];
+			if ((in = malloc(len)) == NULL)
+				errx(1, "malloc in");
+			if ((out = malloc(len)) == NULL)
+				errx(1, "malloc out");
+			if ((want = malloc(len)) == NULL)
+				errx(1, "malloc want");
+			for (k = 0; k < len; k++)
+				in[k] = k * 7;
+
+			for (k = 0; k < sizeof(cb); k++)
+				cb[k] = counters[i] >> (k * 8);
+			ChaCha_set_key(&ctx, key, 256);
+			ChaCha_set_iv(&ctx, iv, cb);
+			for (k = 0; k < len; k += 64)
+				ChaCha(&ctx, want + k, in + k,
+				    len - k < 64 ? len - k : 64);
+
+			CRYPTO_chacha_20(out, in, len, key, iv, counters[i]);
+
+			if (memcmp(out, want, len) != 0) {
+				printf("ChaCha multi-block failed for counter "
+				    "%llx, length %zu\n",
+				    (unsigned long long)counters[i], len);
+				failed = 1;
+			}
+
+			free(in);
+			free(out);
+			free(want);
+		}
+	}
+
+	return failed;
+}
+
 int
 main(int argc, char **argv)
 {
@@ -505,5 +565,8 @@ main(int argc, char **argv)
 	if (crypto_xchacha_20_test() != 0)
 		failed = 1;
 
+	if (crypto_chacha_20_multiblock_test() != 0)
+		failed = 1;
+
 	return failed;
 }
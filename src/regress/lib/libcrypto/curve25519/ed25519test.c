@@ -0,0 +1,333 @@
+/*	$OpenBSD$	*/
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Ed25519 is only compiled with -DED25519, which libcrypto is not, so this
+ * test builds curve25519.c itself and declares the functions it needs.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void ED25519_keypair(uint8_t out_public_key[32], uint8_t out_private_key[64]);
+int ED25519_sign(uint8_t *out_sig, const uint8_t *message, size_t message_len,
+    const uint8_t private_key[64]);
+int ED25519_verify(const uint8_t *message, size_t message_len,
+    const uint8_t signature[64], const uint8_t public_key[32]);
+int ED25519_verify_batch(const uint8_t *const *messages,
+    const size_t *message_lens, const uint8_t *const *signatures,
+    const uint8_t *const *public_keys, size_t n, int *out_valid);
+
+/*
+ * Enough signatures for a batch of the maximum size of 256 and a second,
+ * smaller one.
+ */
+#define N_SIGS		300
+#define MAX_MSG_LEN	64
+
+static uint8_t messages[N_SIGS][MAX_MSG_LEN];
+static size_t message_lens[N_SIGS];
+static uint8_t signatures[N_SIGS][64];
+static uint8_t public_keys[N_SIGS][32];
+
+static const uint8_t *messagep[N_SIGS];
+static const uint8_t *signaturep[N_SIGS];
+static const uint8_t *public_keyp[N_SIGS];
+
+static int valid[N_SIGS];
+
+static int
+ed25519_test(void)
+{
+	/* Taken from https://tools.ietf.org/html/rfc8032#section-7.1 */
+	static const uint8_t kPrivateKey[64] = {
+		0xc5, 0xaa, 0x8d, 0xf4, 0x3f, 0x9f, 0x83, 0x7b,
+		0xed, 0xb7, 0x44, 0x2f, 0x31, 0xdc, 0xb7, 0xb1,
+		0x66, 0xd3, 0x85, 0x35, 0x07, 0x6f, 0x09, 0x4b,
+		0x85, 0xce, 0x3a, 0x2e, 0x0b, 0x44, 0x58, 0xf7,
+		0xfc, 0x51, 0xcd, 0x8e, 0x62, 0x18, 0xa1, 0xa3,
+		0x8d, 0xa4, 0x7e, 0xd0, 0x02, 0x30, 0xf0, 0x58,
+		0x08, 0x16, 0xed, 0x13, 0xba, 0x33, 0x03, 0xac,
+		0x5d, 0xeb, 0x91, 0x15, 0x48, 0x90, 0x80, 0x25,
+	};
+	static const uint8_t kMessage[2] = {
+		0xaf, 0x82,
+	};
+	static const uint8_t kSignature[64] = {
+		0x62, 0x91, 0xd6, 0x57, 0xde, 0xec, 0x24, 0x02,
+		0x48, 0x27, 0xe6, 0x9c, 0x3a, 0xbe, 0x01, 0xa3,
+		0x0c, 0xe5, 0x48, 0xa2, 0x84, 0x74, 0x3a, 0x44,
+		0x5e, 0x36, 0x80, 0xd7, 0xdb, 0x5a, 0xc3, 0xac,
+		0x18, 0xff, 0x9b, 0x53, 0x8d, 0x16, 0xf2, 0x90,
+		0xae, 0x67, 0xf7, 0x60, 0x98, 0x4d, 0xc6, 0x59,
+		0x4a, 0x7c, 0x15, 0xe9, 0x71, 0x6e, 0xd2, 0x8d,
+		0xc0, 0x27, 0xbe, 0xce, 0xea, 0x1e, 0xc4, 0x0a,
+	};
+
+	uint8_t signature[64];
+
+	if (!ED25519_sign(signature, kMessage, sizeof(kMessage),
+	    kPrivateKey)) {
+		fprintf(stderr, "ED25519_sign failed.\n");
+		return 0;
+	}
+	if (memcmp(kSignature, signature, sizeof(signature)) != 0) {
+		fprintf(stderr, "ED25519_sign test failed.\n");
+		return 0;
+	}
+	if (!ED25519_verify(kMessage, sizeof(kMessage), kSignature,
+	    &kPrivateKey[32])) {
+		fprintf(stderr, "ED25519_verify test failed.\n");
+		return 0;
+	}
+
+	return 1;
+}
+
+static void
+make_signatures(void)
+{
+	uint8_t private_key[64];
+	size_t i;
+
+	for (i = 0; i < N_SIGS; i++) {
+		message_lens[i] = arc4random_uniform(MAX_MSG_LEN + 1);
+		arc4random_buf(messages[i], message_lens[i]);
+		ED25519_keypair(public_keys[i], private_key);
+		if (!ED25519_sign(signatures[i], messages[i], message_lens[i],
+		    private_key)) {
+			fprintf(stderr, "ED25519_sign failed.\n");
+			exit(1);
+		}
+
+		messagep[i] = messages[i];
+		signaturep[i] = signatures[i];
+		public_keyp[i] = public_keys[i];
+	}
+}
+
+/*
+ * Check the result of ED25519_verify_batch, with and without out_valid,
+ * against verifying the first n signatures one at a time.
+ */
+static int
+ed25519_batch_check(size_t n, const char *name)
+{
+	size_t i;
+	int want = 1;
+	int ret;
+
+	for (i = 0; i < n; i++)
+		want &= ED25519_verify(messages[i], message_lens[i],
+		    signatures[i], public_keys[i]);
+
+	ret = ED25519_verify_batch(messagep, message_lens, signaturep,
+	    public_keyp, n, NULL);
+	if (ret != want) {
+		fprintf(stderr, "ED25519_verify_batch %s: n = %zu, got %d, "
+		    "want %d\n", name, n, ret, want);
+		return 0;
+	}
+
+	for (i = 0; i < n; i++)
+		valid[i] = -1;
+	ret = ED25519_verify_batch(messagep, message_lens, signaturep,
+	    public_keyp, n, valid);
+	if (ret != want) {
+		fprintf(stderr, "ED25519_verify_batch %s with out_valid: "
+		    "n = %zu, got %d, want %d\n", name, n, ret, want);
+		return 0;
+	}
+	for (i = 0; i < n; i++) {
+		if (valid[i] != ED25519_verify(messages[i], message_lens[i],
+		    signatures[i], public_keys[i])) {
+			fprintf(stderr, "ED25519_verify_batch %s: n = %zu, "
+			    "out_valid[%zu] = %d disagrees with "
+			    "ED25519_verify\n", name, n, i, valid[i]);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int
+ed25519_batch_valid_test(void)
+{
+	/* Around the minimum batch size of 16 and the maximum of 256. */
+	static const size_t sizes[] = {
+		0, 1, 15, 16, 17, 64, 255, 256, 257, N_SIGS,
+	};
+	size_t i, j;
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		if (!ed25519_batch_check(sizes[i], "valid"))
+			return 0;
+		for (j = 0; j < sizes[i]; j++) {
+			if (valid[j] != 1) {
+				fprintf(stderr, "ED25519_verify_batch rejected "
+				    "valid signature %zu.\n", j);
+				return 0;
+			}
+		}
+	}
+
+	return 1;
+}
+
+enum corruption {
+	CORRUPT_R,
+	CORRUPT_S,
+	CORRUPT_MESSAGE,
+	CORRUPT_PUBLIC_KEY,
+	N_CORRUPTIONS,
+};
+
+static void
+corrupt(size_t i, enum corruption how)
+{
+	switch (how) {
+	case CORRUPT_R:
+		signatures[i][3] ^= 0x10;
+		break;
+	case CORRUPT_S:
+		signatures[i][32] ^= 0x01;
+		break;
+	case CORRUPT_MESSAGE:
+		if (message_lens[i] == 0) {
+			message_lens[i] = 1;
+			messages[i][0] = 0;
+			break;
+		}
+		messages[i][message_lens[i] - 1] ^= 0x80;
+		break;
+	case CORRUPT_PUBLIC_KEY:
+		/* Use the key of another signature. */
+		memcpy(public_keys[i], public_keys[(i + 1) % N_SIGS], 32);
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * A single invalid signature anywhere in a batch must make the batch fail
+ * and be the only one that is reported as invalid.
+ */
+static int
+ed25519_batch_one_invalid(size_t n, size_t bad, enum corruption how)
+{
+	uint8_t saved_message[MAX_MSG_LEN], saved_signature[64];
+	uint8_t saved_public_key[32];
+	size_t saved_message_len;
+	size_t i;
+	int failed = 1;
+
+	memcpy(saved_message, messages[bad], MAX_MSG_LEN);
+	saved_message_len = message_lens[bad];
+	memcpy(saved_signature, signatures[bad], 64);
+	memcpy(saved_public_key, public_keys[bad], 32);
+
+	corrupt(bad, how);
+
+	if (ED25519_verify_batch(messagep, message_lens, signaturep,
+	    public_keyp, n, NULL) != 0) {
+		fprintf(stderr, "ED25519_verify_batch accepted an invalid "
+		    "signature: n = %zu, i = %zu, corruption %d\n",
+		    n, bad, how);
+		goto err;
+	}
+	if (ED25519_verify_batch(messagep, message_lens, signaturep,
+	    public_keyp, n, valid) != 0) {
+		fprintf(stderr, "ED25519_verify_batch with out_valid accepted "
+		    "an invalid signature: n = %zu, i = %zu, corruption %d\n",
+		    n, bad, how);
+		goto err;
+	}
+	for (i = 0; i < n; i++) {
+		if (valid[i] != (i != bad)) {
+			fprintf(stderr, "ED25519_verify_batch: n = %zu, "
+			    "i = %zu, corruption %d, out_valid[%zu] = %d\n",
+			    n, bad, how, i, valid[i]);
+			goto err;
+		}
+	}
+
+	failed = 0;
+
+ err:
+	memcpy(messages[bad], saved_message, MAX_MSG_LEN);
+	message_lens[bad] = saved_message_len;
+	memcpy(signatures[bad], saved_signature, 64);
+	memcpy(public_keys[bad], saved_public_key, 32);
+
+	return !failed;
+}
+
+static int
+ed25519_batch_one_invalid_test(void)
+{
+	static const size_t sizes[] = { 16, 64, 256, N_SIGS };
+	size_t i, n;
+	int how;
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		n = sizes[i];
+		for (how = 0; how < N_CORRUPTIONS; how++) {
+			if (!ed25519_batch_one_invalid(n, 0, how) ||
+			    !ed25519_batch_one_invalid(n, n / 2, how) ||
+			    !ed25519_batch_one_invalid(n, n - 1, how))
+				return 0;
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * With invalid signatures spread over several batches, batch verification
+ * must agree with verifying one at a time.
+ */
+static int
+ed25519_batch_agree_test(void)
+{
+	size_t i;
+
+	for (i = 0; i < N_SIGS; i++) {
+		if (arc4random_uniform(10) == 0)
+			corrupt(i, arc4random_uniform(N_CORRUPTIONS));
+	}
+
+	return ed25519_batch_check(N_SIGS, "mixed");
+}
+
+int
+main(int argc, char **argv)
+{
+	make_signatures();
+
+	if (!ed25519_test() ||
+	    !ed25519_batch_valid_test() ||
+	    !ed25519_batch_one_invalid_test() ||
+	    !ed25519_batch_agree_test())
+		return 1;
+
+	printf("PASS\n");
+	return 0;
+}
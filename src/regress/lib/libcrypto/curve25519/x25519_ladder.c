@@ -0,0 +1,358 @@
+/*	$OpenBSD$	*/
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Compare each X25519 implementation in libcrypto that can run on this
+ * machine, and the one that X25519 picks, against a straightforward BIGNUM
+ * version of the RFC 7748 ladder.
+ */
+
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/bn.h>
+#include <openssl/crypto.h>
+#include <openssl/curve25519.h>
+
+#include "curve25519_internal.h"
+
+#ifdef X25519_ADX
+#include "x86_arch.h"
+#endif
+
+#define N_RANDOM	256
+
+static BIGNUM *p, *a24;
+static BN_CTX *ctx;
+
+static void
+le_to_bn(BIGNUM *bn, const uint8_t in[32])
+{
+	uint8_t be[32];
+	int i;
+
+	for (i = 0; i < 32; i++)
+		be[i] = in[31 - i];
+	if (BN_bin2bn(be, sizeof(be), bn) == NULL)
+		errx(1, "BN_bin2bn");
+}
+
+static void
+bn_to_le(uint8_t out[32], const BIGNUM *bn)
+{
+	uint8_t be[32];
+	int i, len;
+
+	if ((len = BN_num_bytes(bn)) > 32)
+		errx(1, "BN_num_bytes");
+	memset(be, 0, sizeof(be));
+	BN_bn2bin(bn, &be[32 - len]);
+	for (i = 0; i < 32; i++)
+		out[i] = be[31 - i];
+}
+
+static void
+mod_add(BIGNUM *r, const BIGNUM *a, const BIGNUM *b)
+{
+	if (!BN_mod_add(r, a, b, p, ctx))
+		errx(1, "BN_mod_add");
+}
+
+static void
+mod_sub(BIGNUM *r, const BIGNUM *a, const BIGNUM *b)
+{
+	if (!BN_mod_sub(r, a, b, p, ctx))
+		errx(1, "BN_mod_sub");
+}
+
+static void
+mod_mul(BIGNUM *r, const BIGNUM *a, const BIGNUM *b)
+{
+	if (!BN_mod_mul(r, a, b, p, ctx))
+		errx(1, "BN_mod_mul");
+}
+
+static void
+cswap(BIGNUM **a, BIGNUM **b, int swap)
+{
+	BIGNUM *t;
+
+	if (swap) {
+		t = *a;
+		*a = *b;
+		*b = t;
+	}
+}
+
+/* The ladder of RFC 7748, section 5, in plain modular arithmetic. */
+static void
+x25519_reference(uint8_t out[32], const uint8_t scalar[32],
+    const uint8_t point[32])
+{
+	BIGNUM *x1, *x2, *z2, *x3, *z3;
+	BIGNUM *a, *aa, *b, *bb, *e, *c, *d, *da, *cb, *t;
+	uint8_t k[32], u[32];
+	int bit, swap = 0;
+	int i;
+
+	memcpy(k, scalar, 32);
+	k[0] &= 248;
+	k[31] &= 127;
+	k[31] |= 64;
+	memcpy(u, point, 32);
+	u[31] &= 127;
+
+	BN_CTX_start(ctx);
+	if ((x1 = BN_CTX_get(ctx)) == NULL || (x2 = BN_CTX_get(ctx)) == NULL ||
+	    (z2 = BN_CTX_get(ctx)) == NULL || (x3 = BN_CTX_get(ctx)) == NULL ||
+	    (z3 = BN_CTX_get(ctx)) == NULL || (a = BN_CTX_get(ctx)) == NULL ||
+	    (aa = BN_CTX_get(ctx)) == NULL || (b = BN_CTX_get(ctx)) == NULL ||
+	    (bb = BN_CTX_get(ctx)) == NULL || (e = BN_CTX_get(ctx)) == NULL ||
+	    (c = BN_CTX_get(ctx)) == NULL || (d = BN_CTX_get(ctx)) == NULL ||
+	    (da = BN_CTX_get(ctx)) == NULL || (cb = BN_CTX_get(ctx)) == NULL ||
+	    (t = BN_CTX_get(ctx)) == NULL)
+		errx(1, "BN_CTX_get");
+
+	/* Non-canonical values of u are reduced. */
+	le_to_bn(x1, u);
+	if (!BN_nnmod(x1, x1, p, ctx))
+		errx(1, "BN_nnmod");
+	if (!BN_one(x2) || !BN_one(z3))
+		errx(1, "BN_one");
+	if (BN_copy(x3, x1) == NULL)
+		errx(1, "BN_copy");
+	BN_zero(z2);
+
+	for (i = 254; i >= 0; i--) {
+		bit = (k[i / 8] >> (i % 8)) & 1;
+		swap ^= bit;
+		cswap(&x2, &x3, swap);
+		cswap(&z2, &z3, swap);
+		swap = bit;
+
+		mod_add(a, x2, z2);
+		mod_mul(aa, a, a);
+		mod_sub(b, x2, z2);
+		mod_mul(bb, b, b);
+		mod_sub(e, aa, bb);
+		mod_add(c, x3, z3);
+		mod_sub(d, x3, z3);
+		mod_mul(da, d, a);
+		mod_mul(cb, c, b);
+		mod_add(t, da, cb);
+		mod_mul(x3, t, t);
+		mod_sub(t, da, cb);
+		mod_mul(t, t, t);
+		mod_mul(z3, x1, t);
+		mod_mul(x2, aa, bb);
+		mod_mul(t, a24, e);
+		mod_add(t, aa, t);
+		mod_mul(z2, e, t);
+	}
+	cswap(&x2, &x3, swap);
+	cswap(&z2, &z3, swap);
+
+	/* x2 * z2^(p - 2), which is 0 if z2 is. */
+	if (BN_copy(e, p) == NULL || !BN_sub_word(e, 2))
+		errx(1, "BN_sub_word");
+	if (!BN_one(t))
+		errx(1, "BN_one");
+	for (i = BN_num_bits(e) - 1; i >= 0; i--) {
+		mod_mul(t, t, t);
+		if (BN_is_bit_set(e, i))
+			mod_mul(t, t, z2);
+	}
+	mod_mul(x2, x2, t);
+	bn_to_le(out, x2);
+
+	BN_CTX_end(ctx);
+}
+
+static const uint8_t kBasePoint[32] = { 9 };
+
+static void
+print_hex(const char *name, const uint8_t *buf, size_t len)
+{
+	size_t i;
+
+	fprintf(stderr, "%s: ", name);
+	for (i = 0; i < len; i++)
+		fprintf(stderr, "%02x", buf[i]);
+	fprintf(stderr, "\n");
+}
+
+static int
+x25519_compare(const char *name, const uint8_t scalar[32],
+    const uint8_t point[32], const uint8_t want[32], const uint8_t got[32])
+{
+	if (memcmp(want, got, 32) == 0)
+		return 1;
+
+	fprintf(stderr, "FAIL: %s differs from the reference\n", name);
+	print_hex("scalar", scalar, 32);
+	print_hex("point", point, 32);
+	print_hex("want", want, 32);
+	print_hex("got", got, 32);
+
+	return 0;
+}
+
+static int
+x25519_ladder_check(const uint8_t scalar[32], const uint8_t point[32])
+{
+	uint8_t want[32], got[32];
+
+	x25519_reference(want, scalar, point);
+
+	x25519_scalar_mult_generic(got, scalar, point);
+	if (!x25519_compare("x25519_scalar_mult_generic", scalar, point,
+	    want, got))
+		return 0;
+
+#ifdef X25519_ADX
+	if ((OPENSSL_cpu_caps() & CPUCAP_MASK_ADX) != 0) {
+		x25519_scalar_mult_adx(got, scalar, point);
+		if (!x25519_compare("x25519_scalar_mult_adx", scalar, point,
+		    want, got))
+			return 0;
+	}
+#endif
+
+	x25519_scalar_mult(got, scalar, point);
+	if (!x25519_compare("x25519_scalar_mult", scalar, point, want, got))
+		return 0;
+
+	return 1;
+}
+
+static int
+x25519_public_check(const uint8_t scalar[32])
+{
+	uint8_t want[32], got[32];
+
+	x25519_reference(want, scalar, kBasePoint);
+	x25519_public_from_private(got, scalar);
+
+	return x25519_compare("x25519_public_from_private", scalar,
+	    kBasePoint, want, got);
+}
+
+/*
+ * Points in the top corner of the field and above it, whose encoding is
+ * not canonical.
+ */
+static void
+edge_point(uint8_t point[32], int i)
+{
+	uint8_t p_le[32];
+
+	bn_to_le(p_le, p);
+
+	switch (i) {
+	case 0:
+		/* 0 */
+		memset(point, 0, 32);
+		break;
+	case 1:
+		/* 1 */
+		memset(point, 0, 32);
+		point[0] = 1;
+		break;
+	case 2:
+		/* p - 1 */
+		memcpy(point, p_le, 32);
+		point[0] -= 1;
+		break;
+	case 3:
+		/* p, which is 0 */
+		memcpy(point, p_le, 32);
+		break;
+	case 4:
+		/* p + 1, which is 1 */
+		memcpy(point, p_le, 32);
+		point[0] += 1;
+		break;
+	case 5:
+		/* 2^255 - 1, which is 18 */
+		memset(point, 0xff, 32);
+		point[31] = 0x7f;
+		break;
+	case 6:
+		/* All bits set, including the top one that is ignored. */
+		memset(point, 0xff, 32);
+		break;
+	default:
+		/* The base point with the top bit set. */
+		memcpy(point, kBasePoint, 32);
+		point[31] |= 0x80;
+		break;
+	}
+}
+
+#define N_EDGE_POINTS	8
+
+int
+main(int argc, char **argv)
+{
+	uint8_t scalar[32], point[32];
+	int i;
+
+	if ((ctx = BN_CTX_new()) == NULL)
+		errx(1, "BN_CTX_new");
+	if ((p = BN_new()) == NULL || (a24 = BN_new()) == NULL)
+		errx(1, "BN_new");
+	/* p = 2^255 - 19 */
+	if (!BN_set_bit(p, 255) || !BN_sub_word(p, 19))
+		errx(1, "BN_set_bit");
+	if (!BN_set_word(a24, 121665))
+		errx(1, "BN_set_word");
+
+	for (i = 0; i < N_EDGE_POINTS; i++) {
+		arc4random_buf(scalar, sizeof(scalar));
+		edge_point(point, i);
+		if (!x25519_ladder_check(scalar, point))
+			return 1;
+	}
+
+	/* The scalars with the fewest and the most bits after clamping. */
+	memset(scalar, 0, sizeof(scalar));
+	if (!x25519_ladder_check(scalar, kBasePoint) ||
+	    !x25519_public_check(scalar))
+		return 1;
+	memset(scalar, 0xff, sizeof(scalar));
+	if (!x25519_ladder_check(scalar, kBasePoint) ||
+	    !x25519_public_check(scalar))
+		return 1;
+
+	for (i = 0; i < N_RANDOM; i++) {
+		arc4random_buf(scalar, sizeof(scalar));
+		arc4random_buf(point, sizeof(point));
+		if (!x25519_ladder_check(scalar, point) ||
+		    !x25519_public_check(scalar))
+			return 1;
+	}
+
+	BN_free(p);
+	BN_free(a24);
+	BN_CTX_free(ctx);
+
+	printf("PASS\n");
+	return 0;
+}
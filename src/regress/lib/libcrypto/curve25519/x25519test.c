@@ -128,11 +128,75 @@ x25519_small_order_test(void)
 	return 1;
 }
 
+#define BATCH_MAX 19
+
+static int
+x25519_batch_test(void)
+{
+	static const uint8_t kSmallOrderPoint[32] = {
+		0xe0, 0xeb, 0x7a, 0x7c, 0x3b, 0x41, 0xb8, 0xae,
+		0x16, 0x56, 0xe3, 0xfa, 0xf1, 0x9f, 0xc4, 0x6a,
+		0xda, 0x09, 0x8d, 0xeb, 0x9c, 0x32, 0xb1, 0xfd,
+		0x86, 0x62, 0x05, 0x16, 0x5f, 0x49, 0xb8, 0x00,
+	};
+	uint8_t scalar[BATCH_MAX][32], point[BATCH_MAX][32];
+	uint8_t out[BATCH_MAX][32], expected[32];
+	uint8_t *outp[BATCH_MAX];
+	const uint8_t *scalarp[BATCH_MAX], *pointp[BATCH_MAX];
+	int valid[BATCH_MAX];
+	size_t i, j, n;
+
+	for (i = 0; i < BATCH_MAX; i++) {
+		for (j = 0; j < 32; j++) {
+			scalar[i][j] = (uint8_t)(i * 37 + j * 11 + 1);
+			point[i][j] = (uint8_t)(i * 53 + j * 7 + 9);
+		}
+		outp[i] = out[i];
+		scalarp[i] = scalar[i];
+		pointp[i] = point[i];
+	}
+
+	for (n = 0; n <= BATCH_MAX; n++) {
+		memset(out, 0, sizeof(out));
+		if (!X25519_batch(outp, scalarp, pointp, n, valid)) {
+			fprintf(stderr, "X25519_batch failed for n = %zu\n", n);
+			return 0;
+		}
+		for (i = 0; i < n; i++) {
+			X25519(expected, scalar[i], point[i]);
+			if (valid[i] != 1 ||
+			    memcmp(expected, out[i], sizeof(expected)) != 0) {
+				fprintf(stderr, "X25519_batch mismatch for "
+				    "n = %zu, i = %zu\n", n, i);
+				return 0;
+			}
+		}
+	}
+
+	/* A small-order point in the middle must only fail its own lane. */
+	memcpy(point[5], kSmallOrderPoint, sizeof(kSmallOrderPoint));
+	if (X25519_batch(outp, scalarp, pointp, 9, valid)) {
+		fprintf(stderr, "X25519_batch returned success with a "
+		    "small-order input.\n");
+		return 0;
+	}
+	for (i = 0; i < 9; i++) {
+		if (valid[i] != (i != 5)) {
+			fprintf(stderr, "X25519_batch wrong validity for "
+			    "i = %zu\n", i);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
 int
 main(int argc, char **argv) {
 	if (!x25519_test() ||
 	    !x25519_iterated_test() ||
-	    !x25519_small_order_test())
+	    !x25519_small_order_test() ||
+	    !x25519_batch_test())
 		return 1;
 
 	printf("PASS\n");
@@ -90,6 +90,83 @@ static int cb(int p, int n, BN_GENCB *arg)
 	return 1;
 }
 
+/* The ffdhe2048 prime of RFC 7919, with generator 2. */
+static const char ffdhe2048_p[] =
+	"FFFFFFFFFFFFFFFFADF85458A2BB4A9AAFDC5620273D3CF1D8B9C583CE2D3695"
+	"A9E13641146433FBCC939DCE249B3EF97D2FE363630C75D8F681B202AEC4617A"
+	"D3DF1ED5D5FD65612433F51F5F066ED0856365553DED1AF3B557135E7F57C935"
+	"984F0C70E0E68B77E2A689DAF3EFE8721DF158A136ADE73530ACCA4F483A797A"
+	"BC0AB182B324FB61D108A94BB2C8E3FBB96ADAB760D7F4681D4F42A3DE394DF4"
+	"AE56EDE76372BB190B07A7C8EE0A6D709E02FCE1CDF7E2ECC03404CD28342F61"
+	"9172FE9CE98583FF8E4F1232EEF28183C3FE3B1B4C6FAD733BB5FCBC2EC22005"
+	"C58EF1837D1683B2C6F34A26C1B2EFFA886B423861285C97FFFFFFFFFFFFFFFF";
+
+/*
+ * Keys in a named group are computed with a table of powers of the
+ * generator; they must match a plain exponentiation.
+ */
+static int named_group_test(void)
+{
+	DH *a = NULL, *b = NULL;
+	BIGNUM *p = NULL, *t = NULL;
+	BN_CTX *ctx = NULL;
+	unsigned char *abuf = NULL, *bbuf = NULL;
+	int alen, blen, i, ret = 1;
+
+	if ((ctx = BN_CTX_new()) == NULL || (t = BN_new()) == NULL)
+		goto err;
+	if (!BN_hex2bn(&p, ffdhe2048_p))
+		goto err;
+	if ((a = DH_new()) == NULL || (b = DH_new()) == NULL)
+		goto err;
+	if ((a->p = BN_dup(p)) == NULL || (b->p = BN_dup(p)) == NULL)
+		goto err;
+	if ((a->g = BN_new()) == NULL || !BN_set_word(a->g, 2))
+		goto err;
+	if ((b->g = BN_dup(a->g)) == NULL)
+		goto err;
+
+	for (i = 0; i < 4; i++) {
+		BN_free(a->priv_key);
+		BN_free(a->pub_key);
+		a->priv_key = a->pub_key = NULL;
+		/* Also try a short exponent. */
+		a->length = i == 0 ? 160 : 0;
+		if (!DH_generate_key(a))
+			goto err;
+		if (!BN_mod_exp(t, a->g, a->priv_key, a->p, ctx))
+			goto err;
+		if (BN_cmp(t, a->pub_key) != 0) {
+			fprintf(stderr, "ffdhe2048 public key is wrong\n");
+			goto err;
+		}
+	}
+	if (!DH_generate_key(b))
+		goto err;
+
+	abuf = malloc(DH_size(a));
+	bbuf = malloc(DH_size(b));
+	if (abuf == NULL || bbuf == NULL)
+		goto err;
+	alen = DH_compute_key(abuf, b->pub_key, a);
+	blen = DH_compute_key(bbuf, a->pub_key, b);
+	if (alen < 4 || alen != blen || memcmp(abuf, bbuf, alen) != 0) {
+		fprintf(stderr, "ffdhe2048 shared keys differ\n");
+		goto err;
+	}
+
+	ret = 0;
+err:
+	free(abuf);
+	free(bbuf);
+	DH_free(a);
+	DH_free(b);
+	BN_free(p);
+	BN_free(t);
+	BN_CTX_free(ctx);
+	return ret;
+}
+
 int main(int argc, char *argv[])
 {
 	BN_GENCB _cb;
@@ -149,6 +226,9 @@ int main(int argc, char *argv[])
 		ret=1;
 	} else
 		ret=0;
+
+	if (named_group_test() != 0)
+		ret=1;
 err:
 	ERR_print_errors_fp(stderr);
 
@@ -0,0 +1,788 @@
+/*	$OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Some named curves have an EC_METHOD of their own. Check those against
+ * known answers and against a group with the same parameters that uses the
+ * generic Montgomery method.
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <openssl/bn.h>
+#include <openssl/ec.h>
+#include <openssl/ecdh.h>
+#include <openssl/ecdsa.h>
+#include <openssl/objects.h>
+#include <openssl/sha.h>
+
+#define N_RANDOM_SCALARS 64
+
+static const int curves[] = {
+	NID_secp384r1,
+	NID_secp256k1,
+};
+
+static const size_t N_CURVES = sizeof(curves) / sizeof(curves[0]);
+
+/* k * G = (x, y) */
+struct mul_test {
+	int nid;
+	const char *k;
+	const char *x;
+	const char *y;
+};
+
+static const struct mul_test mul_tests[] = {
+	{
+		.nid = NID_secp384r1,
+		.k = "1",
+		.x = "AA87CA22BE8B05378EB1C71EF320AD746E1D3B628BA79B98"
+		    "59F741E082542A385502F25DBF55296C3A545E3872760AB7",
+		.y = "3617DE4A96262C6F5D9E98BF9292DC29F8F41DBD289A147C"
+		    "E9DA3113B5F0B8C00A60B1CE1D7E819D7A431D7C90EA0E5F",
+	},
+	{
+		.nid = NID_secp384r1,
+		.k = "2",
+		.x = "08D999057BA3D2D969260045C55B97F089025959A6F434D6"
+		    "51D207D19FB96E9E4FE0E86EBE0E64F85B96A9C75295DF61",
+		.y = "8E80F1FA5B1B3CEDB7BFE8DFFD6DBA74B275D875BC6CC43E"
+		    "904E505F256AB4255FFD43E94D39E22D61501E700A940E80",
+	},
+	{
+		.nid = NID_secp384r1,
+		.k = "3",
+		.x = "077A41D4606FFA1464793C7E5FDC7D98CB9D3910202DCD06"
+		    "BEA4F240D3566DA6B408BBAE5026580D02D7E5C70500C831",
+		.y = "C995F7CA0B0C42837D0BBE9602A9FC998520B41C85115AA5"
+		    "F7684C0EDC111EACC24ABD6BE4B5D298B65F28600A2F1DF1",
+	},
+	{
+		/* n - 1 */
+		.nid = NID_secp384r1,
+		.k = "FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF"
+		    "C7634D81F4372DDF581A0DB248B0A77AECEC196ACCC52972",
+		.x = "AA87CA22BE8B05378EB1C71EF320AD746E1D3B628BA79B98"
+		    "59F741E082542A385502F25DBF55296C3A545E3872760AB7",
+		.y = "C9E821B569D9D390A26167406D6D23D6070BE242D765EB83"
+		    "1625CEEC4A0F473EF59F4E30E2817E6285BCE2846F15F1A0",
+	},
+	{
+		/* 2^384 - 1, which needs to be reduced. */
+		.nid = NID_secp384r1,
+		.k = "FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF"
+		    "FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF",
+		.x = "8E32381850A570E53D52786A71E833A22CF810C0C2D8F841"
+		    "4ED61004D6A8AE364A3AC516938F22508FCE11B165B6BF3B",
+		.y = "D262873A4C3CF596BC850E06F232D7EE92DBE041E3A5FA88"
+		    "B5AA8BEB0D30D55BEB832BD2BE40E2FBD58B6A6D63971EFD",
+	},
+	{
+		.nid = NID_secp256k1,
+		.k = "1",
+		.x = "79BE667EF9DCBBAC55A06295CE870B07"
+		    "029BFCDB2DCE28D959F2815B16F81798",
+		.y = "483ADA7726A3C4655DA4FBFC0E1108A8"
+		    "FD17B448A68554199C47D08FFB10D4B8",
+	},
+	{
+		.nid = NID_secp256k1,
+		.k = "2",
+		.x = "C6047F9441ED7D6D3045406E95C07CD8"
+		    "5C778E4B8CEF3CA7ABAC09B95C709EE5",
+		.y = "1AE168FEA63DC339A3C58419466CEAEE"
+		    "F7F632653266D0E1236431A950CFE52A",
+	},
+	{
+		.nid = NID_secp256k1,
+		.k = "3",
+		.x = "F9308A019258C31049344F85F89D5229"
+		    "B531C845836F99B08601F113BCE036F9",
+		.y = "388F7B0F632DE8140FE337E62A37F356"
+		    "6500A99934C2231B6CB9FD7584B8E672",
+	},
+	{
+		/* n - 1 */
+		.nid = NID_secp256k1,
+		.k = "FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFE"
+		    "BAAEDCE6AF48A03BBFD25E8CD0364140",
+		.x = "79BE667EF9DCBBAC55A06295CE870B07"
+		    "029BFCDB2DCE28D959F2815B16F81798",
+		.y = "B7C52588D95C3B9AA25B0403F1EEF757"
+		    "02E84BB7597AABE663B82F6F04EF2777",
+	},
+	{
+		/* lambda, for which k * G = (beta * x, y) */
+		.nid = NID_secp256k1,
+		.k = "5363AD4CC05C30E0A5261C028812645A"
+		    "122E22EA20816678DF02967C1B23BD72",
+		.x = "BCACE2E99DA01887AB0102B696902325"
+		    "872844067F15E98DA7BBA04400B88FCB",
+		.y = "483ADA7726A3C4655DA4FBFC0E1108A8"
+		    "FD17B448A68554199C47D08FFB10D4B8",
+	},
+	{
+		.nid = NID_secp256k1,
+		.k = "AA5E28D6A97A2479A65527F7290311A3"
+		    "624D4CC0FA1578598EE3C2613BF99522",
+		.x = "34F9460F0E4F08393D192B3C5133A6BA"
+		    "099AA0AD9FD54EBCCFACDFA239FF49C6",
+		.y = "0B71EA9BD730FD8923F6D25A7A91E7DD"
+		    "7728A960686CB5A901BB419E0F2CA232",
+	},
+	{
+		/* 2^256 - 1, which needs to be reduced. */
+		.nid = NID_secp256k1,
+		.k = "FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF"
+		    "FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF",
+		.x = "9166C289B9F905E55F9E3DF9F69D7F35"
+		    "6B4A22095F894F4715714AA4B56606AF",
+		.y = "F181EB966BE4ACB5CFF9E16B66D809BE"
+		    "94E214F06C93FD091099AF98499255E7",
+	},
+};
+
+static const size_t N_MUL_TESTS = sizeof(mul_tests) / sizeof(mul_tests[0]);
+
+struct ecdh_test {
+	int nid;
+	const char *priv;
+	const char *peer_x;
+	const char *peer_y;
+	const char *shared;
+};
+
+static const struct ecdh_test ecdh_tests[] = {
+	{
+		/* RFC 5903, section 8.2. */
+		.nid = NID_secp384r1,
+		.priv = "099F3C7034D4A2C699884D73A375A67F7624EF7C6B3C0F16"
+		    "0647B67414DCE655E35B538041E649EE3FAEF896783AB194",
+		.peer_x = "E558DBEF53EECDE3D3FCCFC1AEA08A89A987475D12FD950D"
+		    "83CFA41732BC509D0D1AC43A0336DEF96FDA41D0774A3571",
+		.peer_y = "DCFBEC7AACF3196472169E838430367F66EEBE3C6E70C416"
+		    "DD5F0C68759DD1FFF83FA40142209DFF5EAAD96DB9E6386C",
+		.shared = "11187331C279962D93D604243FD592CB9D0A926F422E4718"
+		    "7521287E7156C5C4D603135569B9E9D09CF5D4A270F59746",
+	},
+	{
+		/* The other side of the RFC 5903 exchange. */
+		.nid = NID_secp384r1,
+		.priv = "41CB0779B4BDB85D47846725FBEC3C9430FAB46CC8DC5060"
+		    "855CC9BDA0AA2942E0308312916B8ED2960E4BD55A7448FC",
+		.peer_x = "667842D7D180AC2CDE6F74F37551F55755C7645C20EF73E3"
+		    "1634FE72B4C55EE6DE3AC808ACB4BDB4C88732AEE95F41AA",
+		.peer_y = "9482ED1FC0EEB9CAFC4984625CCFC23F65032149E0E144AD"
+		    "A024181535A0F38EEB9FCFF3C2C947DAE69B4C634573A81C",
+		.shared = "11187331C279962D93D604243FD592CB9D0A926F422E4718"
+		    "7521287E7156C5C4D603135569B9E9D09CF5D4A270F59746",
+	},
+	{
+		.nid = NID_secp256k1,
+		.priv = "AA5E28D6A97A2479A65527F7290311A3"
+		    "624D4CC0FA1578598EE3C2613BF99522",
+		.peer_x = "3AEB89217B27AD0E9DD6B0CE77692A96"
+		    "FB2E752251759698C5F14CADC203953C",
+		.peer_y = "F5276054E5CC3656C83385A5F6B76298"
+		    "69C5F916EB269B6BF05AD031B494C9B0",
+		.shared = "CEC8A7B52F669A933170346ECA9B5D64"
+		    "1533FF0FC546D91B93D656E5140D5219",
+	},
+};
+
+static const size_t N_ECDH_TESTS = sizeof(ecdh_tests) / sizeof(ecdh_tests[0]);
+
+struct ecdsa_test {
+	int nid;
+	const char *pub_x;
+	const char *pub_y;
+	const char *msg;
+	unsigned char *(*digest)(const unsigned char *, size_t,
+	    unsigned char *);
+	size_t digest_len;
+	const char *r;
+	const char *s;
+};
+
+static const struct ecdsa_test ecdsa_tests[] = {
+	{
+		/* RFC 6979, appendix A.2.6, with SHA-384. */
+		.nid = NID_secp384r1,
+		.pub_x = "EC3A4E415B4E19A4568618029F427FA5DA9A8BC4AE92E02E"
+		    "06AAE5286B300C64DEF8F0EA9055866064A254515480BC13",
+		.pub_y = "8015D9B72D7D57244EA8EF9AC0C621896708A59367F9DFB9"
+		    "F54CA84B3F1C9DB1288B231C3AE0D4FE7344FD2533264720",
+		.msg = "sample",
+		.digest = SHA384,
+		.digest_len = SHA384_DIGEST_LENGTH,
+		.r = "94EDBB92A5ECB8AAD4736E56C691916B3F88140666CE9FA7"
+		    "3D64C4EA95AD133C81A648152E44ACF96E36DD1E80FABE46",
+		.s = "99EF4AEB15F178CEA1FE40DB2603138F130E740A19624526"
+		    "203B6351D0A3A94FA329C145786E679E7B82C71A38628AC8",
+	},
+	{
+		.nid = NID_secp384r1,
+		.pub_x = "EC3A4E415B4E19A4568618029F427FA5DA9A8BC4AE92E02E"
+		    "06AAE5286B300C64DEF8F0EA9055866064A254515480BC13",
+		.pub_y = "8015D9B72D7D57244EA8EF9AC0C621896708A59367F9DFB9"
+		    "F54CA84B3F1C9DB1288B231C3AE0D4FE7344FD2533264720",
+		.msg = "test",
+		.digest = SHA384,
+		.digest_len = SHA384_DIGEST_LENGTH,
+		.r = "8203B63D3C853E8D77227FB377BCF7B7B772E97892A80F36"
+		    "AB775D509D7A5FEB0542A7F0812998DA8F1DD3CA3CF023DB",
+		.s = "DDD0760448D42D8A43AF45AF836FCE4DE8BE06B485E9B61B"
+		    "827C2F13173923E06A739F040649A667BF3B828246BAA5A5",
+	},
+	{
+		/*
+		 * RFC 6979 nonces with SHA-256, and s in the lower half of
+		 * the order, as in the usual secp256k1 signing vectors.
+		 */
+		.nid = NID_secp256k1,
+		.pub_x = "79BE667EF9DCBBAC55A06295CE870B07"
+		    "029BFCDB2DCE28D959F2815B16F81798",
+		.pub_y = "483ADA7726A3C4655DA4FBFC0E1108A8"
+		    "FD17B448A68554199C47D08FFB10D4B8",
+		.msg = "Satoshi Nakamoto",
+		.digest = SHA256,
+		.digest_len = SHA256_DIGEST_LENGTH,
+		.r = "934B1EA10A4B3C1757E2B0C017D0B614"
+		    "3CE3C9A7E6A4A49860D7A6AB210EE3D8",
+		.s = "2442CE9D2B916064108014783E923EC3"
+		    "6B49743E2FFA1C4496F01A512AAFD9E5",
+	},
+	{
+		.nid = NID_secp256k1,
+		.pub_x = "79BE667EF9DCBBAC55A06295CE870B07"
+		    "029BFCDB2DCE28D959F2815B16F81798",
+		.pub_y = "B7C52588D95C3B9AA25B0403F1EEF757"
+		    "02E84BB7597AABE663B82F6F04EF2777",
+		.msg = "Satoshi Nakamoto",
+		.digest = SHA256,
+		.digest_len = SHA256_DIGEST_LENGTH,
+		.r = "FD567D121DB66E382991534ADA77A6BD"
+		    "3106F0A1098C231E47993447CD6AF2D0",
+		.s = "6B39CD0EB1BC8603E159EF5C20A5C8AD"
+		    "685A45B06CE9BEBED3F153D10D93BED5",
+	},
+	{
+		.nid = NID_secp256k1,
+		.pub_x = "92DF7B245B81AA637AB4E867C8D51100"
+		    "8F79161A97D64F2AC709600352F7ACBC",
+		.pub_y = "E9BFDF1B13FA0CB1DE4521E5386CDE3A"
+		    "1CD26C5AB584989D07BBED58A5419F62",
+		.msg = "Alan Turing",
+		.digest = SHA256,
+		.digest_len = SHA256_DIGEST_LENGTH,
+		.r = "7063AE83E7F62BBB171798131B4A0564"
+		    "B956930092B33B07B395615D9EC7E15C",
+		.s = "58DFCC1E00A35E1572F366FFE34BA0FC"
+		    "47DB1E7189759B9FB233C5B05AB388EA",
+	},
+};
+
+static const size_t N_ECDSA_TESTS =
+    sizeof(ecdsa_tests) / sizeof(ecdsa_tests[0]);
+
+static BIGNUM *
+hex_to_bn(const char *hex)
+{
+	BIGNUM *bn = NULL;
+
+	if (BN_hex2bn(&bn, hex) == 0)
+		errx(1, "BN_hex2bn(%s)", hex);
+
+	return bn;
+}
+
+static int
+check_affine(const char *name, const EC_GROUP *group, const EC_POINT *point,
+    const BIGNUM *want_x, const BIGNUM *want_y, BN_CTX *ctx)
+{
+	BIGNUM *x, *y;
+	int failed = 1;
+
+	if ((x = BN_new()) == NULL || (y = BN_new()) == NULL)
+		errx(1, "BN_new");
+	if (!EC_POINT_get_affine_coordinates(group, point, x, y, ctx)) {
+		fprintf(stderr, "FAIL: %s: no affine coordinates\n", name);
+		goto err;
+	}
+	if (BN_cmp(x, want_x) != 0 || BN_cmp(y, want_y) != 0) {
+		fprintf(stderr, "FAIL: %s: point mismatch\n", name);
+		goto err;
+	}
+
+	failed = 0;
+
+ err:
+	BN_free(x);
+	BN_free(y);
+
+	return failed;
+}
+
+/*
+ * Multiply both the generator, which uses the tables of the curve, and the
+ * generator as an arbitrary point, which does not.
+ */
+static int
+mul_kat_test(const struct mul_test *mt)
+{
+	EC_GROUP *group;
+	EC_POINT *point;
+	BIGNUM *k, *x, *y;
+	BN_CTX *ctx;
+	int failed = 0;
+
+	if ((ctx = BN_CTX_new()) == NULL)
+		errx(1, "BN_CTX_new");
+	if ((group = EC_GROUP_new_by_curve_name(mt->nid)) == NULL)
+		errx(1, "EC_GROUP_new_by_curve_name(%s)", OBJ_nid2sn(mt->nid));
+	if ((point = EC_POINT_new(group)) == NULL)
+		errx(1, "EC_POINT_new");
+	k = hex_to_bn(mt->k);
+	x = hex_to_bn(mt->x);
+	y = hex_to_bn(mt->y);
+
+	if (!EC_POINT_mul(group, point, k, NULL, NULL, ctx))
+		errx(1, "EC_POINT_mul");
+	failed |= check_affine(OBJ_nid2sn(mt->nid), group, point, x, y, ctx);
+
+	if (!EC_POINT_mul(group, point, NULL, EC_GROUP_get0_generator(group),
+	    k, ctx))
+		errx(1, "EC_POINT_mul");
+	failed |= check_affine(OBJ_nid2sn(mt->nid), group, point, x, y, ctx);
+
+	if (failed)
+		fprintf(stderr, "FAIL: %s: k = %s\n", OBJ_nid2sn(mt->nid),
+		    mt->k);
+
+	BN_free(k);
+	BN_free(x);
+	BN_free(y);
+	EC_POINT_free(point);
+	EC_GROUP_free(group);
+	BN_CTX_free(ctx);
+
+	return failed;
+}
+
+static int
+ecdh_kat_test(const struct ecdh_test *et)
+{
+	EC_KEY *key;
+	const EC_GROUP *group;
+	EC_POINT *peer;
+	BIGNUM *priv, *x, *y, *want, *got = NULL;
+	unsigned char out[128];
+	int len, want_len;
+	int failed = 1;
+
+	if ((key = EC_KEY_new_by_curve_name(et->nid)) == NULL)
+		errx(1, "EC_KEY_new_by_curve_name(%s)", OBJ_nid2sn(et->nid));
+	group = EC_KEY_get0_group(key);
+	if ((peer = EC_POINT_new(group)) == NULL)
+		errx(1, "EC_POINT_new");
+	priv = hex_to_bn(et->priv);
+	x = hex_to_bn(et->peer_x);
+	y = hex_to_bn(et->peer_y);
+	want = hex_to_bn(et->shared);
+
+	if (!EC_KEY_set_private_key(key, priv))
+		errx(1, "EC_KEY_set_private_key");
+	if (!EC_POINT_set_affine_coordinates(group, peer, x, y, NULL))
+		errx(1, "EC_POINT_set_affine_coordinates");
+
+	want_len = (EC_GROUP_get_degree(group) + 7) / 8;
+	if ((len = ECDH_compute_key(out, sizeof(out), peer, key,
+	    NULL)) != want_len) {
+		fprintf(stderr, "FAIL: %s: ECDH_compute_key returned %d, "
+		    "want %d\n", OBJ_nid2sn(et->nid), len, want_len);
+		goto err;
+	}
+	if ((got = BN_bin2bn(out, len, NULL)) == NULL)
+		errx(1, "BN_bin2bn");
+	if (BN_cmp(got, want) != 0) {
+		fprintf(stderr, "FAIL: %s: ECDH shared secret mismatch\n",
+		    OBJ_nid2sn(et->nid));
+		goto err;
+	}
+
+	failed = 0;
+
+ err:
+	BN_free(priv);
+	BN_free(x);
+	BN_free(y);
+	BN_free(want);
+	BN_free(got);
+	EC_POINT_free(peer);
+	EC_KEY_free(key);
+
+	return failed;
+}
+
+static int
+ecdsa_kat_test(const struct ecdsa_test *et)
+{
+	EC_KEY *key;
+	ECDSA_SIG *sig;
+	BIGNUM *x, *y, *r, *s;
+	unsigned char digest[64];
+	int failed = 1;
+
+	if ((key = EC_KEY_new_by_curve_name(et->nid)) == NULL)
+		errx(1, "EC_KEY_new_by_curve_name(%s)", OBJ_nid2sn(et->nid));
+	if ((sig = ECDSA_SIG_new()) == NULL)
+		errx(1, "ECDSA_SIG_new");
+	x = hex_to_bn(et->pub_x);
+	y = hex_to_bn(et->pub_y);
+	r = hex_to_bn(et->r);
+	s = hex_to_bn(et->s);
+
+	if (!EC_KEY_set_public_key_affine_coordinates(key, x, y))
+		errx(1, "EC_KEY_set_public_key_affine_coordinates");
+	if (!ECDSA_SIG_set0(sig, r, s))
+		errx(1, "ECDSA_SIG_set0");
+
+	et->digest((const unsigned char *)et->msg, strlen(et->msg), digest);
+
+	if (ECDSA_do_verify(digest, et->digest_len, sig, key) != 1) {
+		fprintf(stderr, "FAIL: %s: signature of \"%s\" does not "
+		    "verify\n", OBJ_nid2sn(et->nid), et->msg);
+		goto err;
+	}
+
+	digest[0] ^= 1;
+	if (ECDSA_do_verify(digest, et->digest_len, sig, key) != 0) {
+		fprintf(stderr, "FAIL: %s: signature of \"%s\" verifies for "
+		    "a different digest\n", OBJ_nid2sn(et->nid), et->msg);
+		goto err;
+	}
+
+	failed = 0;
+
+ err:
+	BN_free(x);
+	BN_free(y);
+	ECDSA_SIG_free(sig);
+	EC_KEY_free(key);
+
+	return failed;
+}
+
+/*
+ * Build a group over the same curve as the named group, with the generic
+ * Montgomery method and the given generator.
+ */
+static EC_GROUP *
+generic_group(const EC_GROUP *named, const EC_POINT *named_generator,
+    BN_CTX *ctx)
+{
+	EC_GROUP *group;
+	EC_POINT *generator;
+	BIGNUM *p, *a, *b, *x, *y, *order, *cofactor;
+
+	BN_CTX_start(ctx);
+	if ((p = BN_CTX_get(ctx)) == NULL || (a = BN_CTX_get(ctx)) == NULL ||
+	    (b = BN_CTX_get(ctx)) == NULL || (x = BN_CTX_get(ctx)) == NULL ||
+	    (y = BN_CTX_get(ctx)) == NULL ||
+	    (order = BN_CTX_get(ctx)) == NULL ||
+	    (cofactor = BN_CTX_get(ctx)) == NULL)
+		errx(1, "BN_CTX_get");
+
+	if (!EC_GROUP_get_curve(named, p, a, b, ctx))
+		errx(1, "EC_GROUP_get_curve");
+	if (!EC_GROUP_get_order(named, order, ctx))
+		errx(1, "EC_GROUP_get_order");
+	if (!EC_GROUP_get_cofactor(named, cofactor, ctx))
+		errx(1, "EC_GROUP_get_cofactor");
+	if (!EC_POINT_get_affine_coordinates(named, named_generator, x, y,
+	    ctx))
+		errx(1, "EC_POINT_get_affine_coordinates");
+
+	if ((group = EC_GROUP_new(EC_GFp_mont_method())) == NULL)
+		errx(1, "EC_GROUP_new");
+	if (!EC_GROUP_set_curve(group, p, a, b, ctx))
+		errx(1, "EC_GROUP_set_curve");
+	if ((generator = EC_POINT_new(group)) == NULL)
+		errx(1, "EC_POINT_new");
+	if (!EC_POINT_set_affine_coordinates(group, generator, x, y, ctx))
+		errx(1, "EC_POINT_set_affine_coordinates");
+	if (!EC_GROUP_set_generator(group, generator, order, cofactor))
+		errx(1, "EC_GROUP_set_generator");
+
+	EC_POINT_free(generator);
+	BN_CTX_end(ctx);
+
+	return group;
+}
+
+/* Copy a point of one group into another group over the same curve. */
+static void
+point_transfer(const EC_GROUP *from_group, const EC_POINT *from,
+    const EC_GROUP *to_group, EC_POINT *to, BN_CTX *ctx)
+{
+	BIGNUM *x, *y;
+
+	if (EC_POINT_is_at_infinity(from_group, from)) {
+		if (!EC_POINT_set_to_infinity(to_group, to))
+			errx(1, "EC_POINT_set_to_infinity");
+		return;
+	}
+
+	BN_CTX_start(ctx);
+	if ((x = BN_CTX_get(ctx)) == NULL || (y = BN_CTX_get(ctx)) == NULL)
+		errx(1, "BN_CTX_get");
+	if (!EC_POINT_get_affine_coordinates(from_group, from, x, y, ctx))
+		errx(1, "EC_POINT_get_affine_coordinates");
+	if (!EC_POINT_set_affine_coordinates(to_group, to, x, y, ctx))
+		errx(1, "EC_POINT_set_affine_coordinates");
+	BN_CTX_end(ctx);
+}
+
+static int
+points_equal(const EC_GROUP *group1, const EC_POINT *p1,
+    const EC_GROUP *group2, const EC_POINT *p2, BN_CTX *ctx)
+{
+	BIGNUM *x1, *y1, *x2, *y2;
+	int inf1, inf2;
+	int equal;
+
+	inf1 = EC_POINT_is_at_infinity(group1, p1);
+	inf2 = EC_POINT_is_at_infinity(group2, p2);
+	if (inf1 || inf2)
+		return inf1 && inf2;
+
+	BN_CTX_start(ctx);
+	if ((x1 = BN_CTX_get(ctx)) == NULL || (y1 = BN_CTX_get(ctx)) == NULL ||
+	    (x2 = BN_CTX_get(ctx)) == NULL || (y2 = BN_CTX_get(ctx)) == NULL)
+		errx(1, "BN_CTX_get");
+	if (!EC_POINT_get_affine_coordinates(group1, p1, x1, y1, ctx) ||
+	    !EC_POINT_get_affine_coordinates(group2, p2, x2, y2, ctx))
+		errx(1, "EC_POINT_get_affine_coordinates");
+	equal = BN_cmp(x1, x2) == 0 && BN_cmp(y1, y2) == 0;
+	BN_CTX_end(ctx);
+
+	return equal;
+}
+
+static void
+next_scalar(BIGNUM *k, const BIGNUM *order, int i)
+{
+	switch (i) {
+	case 0:
+		BN_zero(k);
+		break;
+	case 1:
+		if (!BN_one(k))
+			errx(1, "BN_one");
+		break;
+	case 2:
+		/* -1 */
+		if (!BN_one(k))
+			errx(1, "BN_one");
+		BN_set_negative(k, 1);
+		break;
+	case 3:
+		if (!BN_sub(k, order, BN_value_one()))
+			errx(1, "BN_sub");
+		break;
+	case 4:
+		if (BN_copy(k, order) == NULL)
+			errx(1, "BN_copy");
+		break;
+	case 5:
+		if (!BN_add(k, order, BN_value_one()))
+			errx(1, "BN_add");
+		break;
+	case 6:
+		/* Twice the size of the order. */
+		if (!BN_rand(k, 2 * BN_num_bits(order), 0, 0))
+			errx(1, "BN_rand");
+		break;
+	default:
+		if (!BN_rand_range(k, order))
+			errx(1, "BN_rand_range");
+		break;
+	}
+}
+
+/*
+ * Compute k1 * G, k2 * P and k1 * G + k2 * P with the named group and with
+ * the generic group, for edge case and random scalars.
+ */
+static int
+generic_cmp(const EC_GROUP *named, const EC_GROUP *generic, BN_CTX *ctx)
+{
+	EC_POINT *named_p, *named_r, *generic_p, *generic_r;
+	BIGNUM *order, *k1, *k2;
+	const char *op = "";
+	int i;
+	int failed = 1;
+
+	if ((named_p = EC_POINT_new(named)) == NULL ||
+	    (named_r = EC_POINT_new(named)) == NULL ||
+	    (generic_p = EC_POINT_new(generic)) == NULL ||
+	    (generic_r = EC_POINT_new(generic)) == NULL)
+		errx(1, "EC_POINT_new");
+	if ((order = BN_new()) == NULL || (k1 = BN_new()) == NULL ||
+	    (k2 = BN_new()) == NULL)
+		errx(1, "BN_new");
+	if (!EC_GROUP_get_order(named, order, ctx))
+		errx(1, "EC_GROUP_get_order");
+
+	for (i = 0; i < N_RANDOM_SCALARS + 7; i++) {
+		next_scalar(k1, order, i);
+		if (!BN_rand_range(k2, order))
+			errx(1, "BN_rand_range");
+
+		/* A random point P, computed with the generic group. */
+		if (!EC_POINT_mul(generic, generic_p, k2, NULL, NULL, ctx))
+			errx(1, "EC_POINT_mul");
+		point_transfer(generic, generic_p, named, named_p, ctx);
+
+		op = "k * G";
+		if (!EC_POINT_mul(named, named_r, k1, NULL, NULL, ctx) ||
+		    !EC_POINT_mul(generic, generic_r, k1, NULL, NULL, ctx))
+			errx(1, "EC_POINT_mul");
+		if (!points_equal(named, named_r, generic, generic_r, ctx))
+			goto fail;
+
+		op = "k * P";
+		if (!EC_POINT_mul(named, named_r, NULL, named_p, k1, ctx) ||
+		    !EC_POINT_mul(generic, generic_r, NULL, generic_p, k1, ctx))
+			errx(1, "EC_POINT_mul");
+		if (!points_equal(named, named_r, generic, generic_r, ctx))
+			goto fail;
+
+		op = "k1 * G + k2 * P";
+		if (!EC_POINT_mul(named, named_r, k1, named_p, k2, ctx) ||
+		    !EC_POINT_mul(generic, generic_r, k1, generic_p, k2, ctx))
+			errx(1, "EC_POINT_mul");
+		if (!points_equal(named, named_r, generic, generic_r, ctx))
+			goto fail;
+
+		/* P = -G, so that k * G + k * P is the point at infinity. */
+		op = "k * G - k * G";
+		if (!EC_POINT_copy(named_p, EC_GROUP_get0_generator(named)))
+			errx(1, "EC_POINT_copy");
+		if (!EC_POINT_invert(named, named_p, ctx))
+			errx(1, "EC_POINT_invert");
+		if (!EC_POINT_mul(named, named_r, k1, named_p, k1, ctx))
+			errx(1, "EC_POINT_mul");
+		if (!EC_POINT_is_at_infinity(named, named_r))
+			goto fail;
+	}
+
+	failed = 0;
+
+ fail:
+	if (failed) {
+		fprintf(stderr, "FAIL: %s: %s differs from the generic method "
+		    "for k = ", OBJ_nid2sn(EC_GROUP_get_curve_name(named)), op);
+		BN_print_fp(stderr, k1);
+		fprintf(stderr, "\n");
+	}
+
+	BN_free(order);
+	BN_free(k1);
+	BN_free(k2);
+	EC_POINT_free(named_p);
+	EC_POINT_free(named_r);
+	EC_POINT_free(generic_p);
+	EC_POINT_free(generic_r);
+
+	return failed;
+}
+
+static int
+generic_cmp_test(int nid)
+{
+	EC_GROUP *named, *generic = NULL;
+	EC_POINT *generator = NULL;
+	BIGNUM *order = NULL, *cofactor = NULL, *k = NULL;
+	BN_CTX *ctx;
+	int failed = 0;
+
+	if ((ctx = BN_CTX_new()) == NULL)
+		errx(1, "BN_CTX_new");
+	if ((named = EC_GROUP_new_by_curve_name(nid)) == NULL)
+		errx(1, "EC_GROUP_new_by_curve_name(%s)", OBJ_nid2sn(nid));
+
+	generic = generic_group(named, EC_GROUP_get0_generator(named), ctx);
+	failed |= generic_cmp(named, generic, ctx);
+	EC_GROUP_free(generic);
+
+	/*
+	 * With a generator other than the standard one, the dedicated method
+	 * has no tables and multiplies it like any other point.
+	 */
+	if ((generator = EC_POINT_new(named)) == NULL)
+		errx(1, "EC_POINT_new");
+	if ((order = BN_new()) == NULL || (cofactor = BN_new()) == NULL ||
+	    (k = BN_new()) == NULL)
+		errx(1, "BN_new");
+	if (!EC_GROUP_get_order(named, order, ctx))
+		errx(1, "EC_GROUP_get_order");
+	if (!EC_GROUP_get_cofactor(named, cofactor, ctx))
+		errx(1, "EC_GROUP_get_cofactor");
+	if (!BN_rand_range(k, order))
+		errx(1, "BN_rand_range");
+	if (BN_is_zero(k) && !BN_one(k))
+		errx(1, "BN_one");
+	if (!EC_POINT_mul(named, generator, k, NULL, NULL, ctx))
+		errx(1, "EC_POINT_mul");
+	if (!EC_GROUP_set_generator(named, generator, order, cofactor))
+		errx(1, "EC_GROUP_set_generator");
+
+	generic = generic_group(named, generator, ctx);
+	failed |= generic_cmp(named, generic, ctx);
+
+	BN_free(order);
+	BN_free(cofactor);
+	BN_free(k);
+	EC_POINT_free(generator);
+	EC_GROUP_free(generic);
+	EC_GROUP_free(named);
+	BN_CTX_free(ctx);
+
+	return failed;
+}
+
+int
+main(int argc, char **argv)
+{
+	size_t i;
+	int failed = 0;
+
+	for (i = 0; i < N_MUL_TESTS; i++)
+		failed |= mul_kat_test(&mul_tests[i]);
+	for (i = 0; i < N_ECDH_TESTS; i++)
+		failed |= ecdh_kat_test(&ecdh_tests[i]);
+	for (i = 0; i < N_ECDSA_TESTS; i++)
+		failed |= ecdsa_kat_test(&ecdsa_tests[i]);
+	for (i = 0; i < N_CURVES; i++)
+		failed |= generic_cmp_test(curves[i]);
+
+	return failed;
+}
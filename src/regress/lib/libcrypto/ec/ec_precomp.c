@@ -0,0 +1,201 @@
+/*	$OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <openssl/bn.h>
+#include <openssl/ec.h>
+#include <openssl/ecdsa.h>
+#include <openssl/objects.h>
+
+#define N_RANDOM_SCALARS 32
+
+static const int curves[] = {
+	NID_X9_62_prime256v1,
+	NID_secp384r1,
+	NID_secp521r1,
+	NID_secp256k1,
+	NID_brainpoolP256r1,
+	NID_brainpoolP384r1,
+	NID_secp160r1,
+};
+
+static const size_t N_CURVES = sizeof(curves) / sizeof(curves[0]);
+
+/*
+ * Multiplications of the generator use the comb of the curve, those of
+ * an arbitrary point do not. Both must give the same result.
+ */
+static int
+generator_mul_test(int nid)
+{
+	EC_GROUP *group;
+	const EC_POINT *generator;
+	EC_POINT *r1 = NULL, *r2 = NULL;
+	BIGNUM *order = NULL, *k = NULL;
+	BN_CTX *ctx;
+	int i;
+	int failed = 1;
+
+	if ((ctx = BN_CTX_new()) == NULL)
+		errx(1, "BN_CTX_new");
+	if ((group = EC_GROUP_new_by_curve_name(nid)) == NULL)
+		errx(1, "EC_GROUP_new_by_curve_name(%s)", OBJ_nid2sn(nid));
+	if ((generator = EC_GROUP_get0_generator(group)) == NULL)
+		errx(1, "EC_GROUP_get0_generator");
+	if ((r1 = EC_POINT_new(group)) == NULL ||
+	    (r2 = EC_POINT_new(group)) == NULL)
+		errx(1, "EC_POINT_new");
+	if ((order = BN_new()) == NULL || (k = BN_new()) == NULL)
+		errx(1, "BN_new");
+	if (!EC_GROUP_get_order(group, order, ctx))
+		errx(1, "EC_GROUP_get_order");
+
+	for (i = 0; i < N_RANDOM_SCALARS + 6; i++) {
+		switch (i) {
+		case 0:
+			BN_zero(k);
+			break;
+		case 1:
+			if (!BN_one(k))
+				errx(1, "BN_one");
+			break;
+		case 2:
+			if (!BN_set_word(k, 2))
+				errx(1, "BN_set_word");
+			break;
+		case 3:
+			if (!BN_sub(k, order, BN_value_one()))
+				errx(1, "BN_sub");
+			break;
+		case 4:
+			if (BN_copy(k, order) == NULL)
+				errx(1, "BN_copy");
+			break;
+		case 5:
+			if (!BN_add(k, order, BN_value_one()))
+				errx(1, "BN_add");
+			break;
+		default:
+			if (!BN_rand_range(k, order))
+				errx(1, "BN_rand_range");
+			break;
+		}
+
+		if (!EC_POINT_mul(group, r1, k, NULL, NULL, ctx))
+			errx(1, "EC_POINT_mul generator");
+		if (!EC_POINT_mul(group, r2, NULL, generator, k, ctx))
+			errx(1, "EC_POINT_mul point");
+		if (EC_POINT_cmp(group, r1, r2, ctx) != 0) {
+			fprintf(stderr, "FAIL: %s: multiples of the generator "
+			    "differ for scalar %d\n", OBJ_nid2sn(nid), i);
+			goto err;
+		}
+	}
+
+	failed = 0;
+
+ err:
+	EC_POINT_free(r1);
+	EC_POINT_free(r2);
+	EC_GROUP_free(group);
+	BN_free(order);
+	BN_free(k);
+	BN_CTX_free(ctx);
+
+	return failed;
+}
+
+/*
+ * Verification keeps multiples of the public key with the key. They must
+ * not be used once the public key has changed.
+ */
+static int
+verify_key_change_test(int nid)
+{
+	EC_KEY *key = NULL, *other = NULL;
+	ECDSA_SIG *sig = NULL, *other_sig = NULL;
+	unsigned char digest[32];
+	EC_POINT *pub;
+	int i;
+	int failed = 1;
+
+	memset(digest, 0x5a, sizeof(digest));
+
+	if ((key = EC_KEY_new_by_curve_name(nid)) == NULL ||
+	    (other = EC_KEY_new_by_curve_name(nid)) == NULL)
+		errx(1, "EC_KEY_new_by_curve_name");
+	if (!EC_KEY_generate_key(key) || !EC_KEY_generate_key(other))
+		errx(1, "EC_KEY_generate_key");
+	if ((sig = ECDSA_do_sign(digest, sizeof(digest), key)) == NULL ||
+	    (other_sig = ECDSA_do_sign(digest, sizeof(digest), other)) == NULL)
+		errx(1, "ECDSA_do_sign");
+
+	for (i = 0; i < 3; i++) {
+		if (ECDSA_do_verify(digest, sizeof(digest), sig, key) != 1) {
+			fprintf(stderr, "FAIL: %s: signature does not verify\n",
+			    OBJ_nid2sn(nid));
+			goto err;
+		}
+	}
+	if (ECDSA_do_verify(digest, sizeof(digest), other_sig, key) != 0) {
+		fprintf(stderr, "FAIL: %s: signature of another key "
+		    "verifies\n", OBJ_nid2sn(nid));
+		goto err;
+	}
+
+	/* Replace the public key in place, behind the back of the key. */
+	pub = (EC_POINT *)EC_KEY_get0_public_key(key);
+	if (!EC_POINT_copy(pub, EC_KEY_get0_public_key(other)))
+		errx(1, "EC_POINT_copy");
+	if (ECDSA_do_verify(digest, sizeof(digest), sig, key) != 0) {
+		fprintf(stderr, "FAIL: %s: signature verifies with a changed "
+		    "public key\n", OBJ_nid2sn(nid));
+		goto err;
+	}
+	if (ECDSA_do_verify(digest, sizeof(digest), other_sig, key) != 1) {
+		fprintf(stderr, "FAIL: %s: signature does not verify with a "
+		    "changed public key\n", OBJ_nid2sn(nid));
+		goto err;
+	}
+
+	failed = 0;
+
+ err:
+	ECDSA_SIG_free(sig);
+	ECDSA_SIG_free(other_sig);
+	EC_KEY_free(key);
+	EC_KEY_free(other);
+
+	return failed;
+}
+
+int
+main(int argc, char **argv)
+{
+	size_t i;
+	int failed = 0;
+
+	for (i = 0; i < N_CURVES; i++) {
+		failed |= generator_mul_test(curves[i]);
+		failed |= verify_key_change_test(curves[i]);
+	}
+
+	return failed;
+}
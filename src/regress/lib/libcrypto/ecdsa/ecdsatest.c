@@ -86,6 +86,7 @@
 /* declaration of the test functions */
 int x9_62_test_internal(BIO *out, int nid, const char *r, const char *s);
 int test_builtin(BIO *);
+int test_batch(BIO *);
 
 /* some tests from the X9.62 draft */
 int
@@ -373,6 +374,92 @@ test_builtin(BIO *out)
 	return ret;
 }
 
+#define BATCH_SIZE 24
+
+/* verify signatures over several curves with ECDSA_verify_batch() */
+int
+test_batch(BIO *out)
+{
+	const int nids[] = {
+		NID_X9_62_prime256v1, NID_secp384r1, NID_secp521r1,
+	};
+	EC_KEY		*keys[3] = { NULL, NULL, NULL };
+	EC_KEY		*eckeys[BATCH_SIZE];
+	ECDSA_SIG	*sigs[BATCH_SIZE];
+	unsigned char	digests[BATCH_SIZE][20];
+	const unsigned char	*dgsts[BATCH_SIZE];
+	int		dgst_lens[BATCH_SIZE], results[BATCH_SIZE];
+	int		i, ret = 0;
+
+	memset(sigs, 0, sizeof(sigs));
+
+	BIO_printf(out, "\ntesting ECDSA_verify_batch(): ");
+
+	for (i = 0; i < 3; i++) {
+		if ((keys[i] = EC_KEY_new_by_curve_name(nids[i])) == NULL)
+			goto batch_err;
+		if (!EC_KEY_generate_key(keys[i]))
+			goto batch_err;
+	}
+	for (i = 0; i < BATCH_SIZE; i++) {
+		arc4random_buf(digests[i], sizeof(digests[i]));
+		dgsts[i] = digests[i];
+		dgst_lens[i] = sizeof(digests[i]);
+		eckeys[i] = keys[i % 3];
+		if ((sigs[i] = ECDSA_do_sign(dgsts[i], dgst_lens[i],
+		    eckeys[i])) == NULL)
+			goto batch_err;
+	}
+
+	if (ECDSA_verify_batch(BATCH_SIZE, dgsts, dgst_lens,
+	    (const ECDSA_SIG *const *)sigs, eckeys, results) != 1) {
+		BIO_printf(out, " failed\n");
+		goto batch_err;
+	}
+	for (i = 0; i < BATCH_SIZE; i++) {
+		if (results[i] != 1) {
+			BIO_printf(out, " failed\n");
+			goto batch_err;
+		}
+	}
+	BIO_printf(out, ".");
+	(void)BIO_flush(out);
+
+	/* a wrong digest, a wrong key and an out of range signature */
+	digests[4][0] ^= 1;
+	eckeys[5] = keys[0];
+	BN_zero(sigs[6]->s);
+
+	if (ECDSA_verify_batch(BATCH_SIZE, dgsts, dgst_lens,
+	    (const ECDSA_SIG *const *)sigs, eckeys, results) != 0) {
+		BIO_printf(out, " failed\n");
+		goto batch_err;
+	}
+	for (i = 0; i < BATCH_SIZE; i++) {
+		if (results[i] != ECDSA_do_verify(dgsts[i], dgst_lens[i],
+		    sigs[i], eckeys[i])) {
+			BIO_printf(out, " failed\n");
+			goto batch_err;
+		}
+	}
+	if (results[4] != 0 || results[5] != 0 || results[6] != 0) {
+		BIO_printf(out, " failed\n");
+		goto batch_err;
+	}
+	BIO_printf(out, ".");
+	BIO_printf(out, " ok\n");
+	ERR_clear_error();
+
+	ret = 1;
+ batch_err:
+	for (i = 0; i < BATCH_SIZE; i++)
+		ECDSA_SIG_free(sigs[i]);
+	for (i = 0; i < 3; i++)
+		EC_KEY_free(keys[i]);
+
+	return ret;
+}
+
 int
 main(void)
 {
@@ -386,6 +473,8 @@ main(void)
 	/* the tests */
 	if (!test_builtin(out))
 		goto err;
+	if (!test_batch(out))
+		goto err;
 
 	ret = 0;
  err:
@@ -49,9 +49,13 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <openssl/opensslconf.h>
+#ifndef OPENSSL_NO_CAMELLIA
+#include <openssl/camellia.h>
+#endif
 #include <openssl/evp.h>
 #ifndef OPENSSL_NO_ENGINE
 #include <openssl/engine.h>
@@ -255,6 +259,185 @@ test_cipher(const char *cipher, const unsigned char *key, int kn,
 	return 1;
 }
 
+#define SECTORS	9
+
+static void
+test_sectors(const EVP_CIPHER *c, size_t sector_len)
+{
+	EVP_CIPHER_CTX ctx;
+	unsigned char key[64], tweaks[SECTORS * 16];
+	unsigned char in[SECTORS * 512], out[SECTORS * 512], ref[SECTORS * 512];
+	size_t i;
+	int outl;
+
+	printf("Testing sectors %s, %zu bytes\n", EVP_CIPHER_name(c),
+	    sector_len);
+
+	arc4random_buf(key, sizeof(key));
+	arc4random_buf(in, sizeof(in));
+	/* Consecutive little endian sector numbers, as for disk encryption. */
+	memset(tweaks, 0, sizeof(tweaks));
+	for (i = 0; i < SECTORS; i++) {
+		tweaks[i * 16] = (1000 + i) & 0xff;
+		tweaks[i * 16 + 1] = (1000 + i) >> 8;
+	}
+
+	EVP_CIPHER_CTX_init(&ctx);
+	if (!EVP_EncryptInit_ex(&ctx, c, NULL, key, NULL)) {
+		fprintf(stderr, "EncryptInit failed\n");
+		test1_exit(10);
+	}
+	for (i = 0; i < SECTORS; i++) {
+		if (!EVP_EncryptInit_ex(&ctx, NULL, NULL, NULL,
+		    &tweaks[i * 16]) ||
+		    !EVP_EncryptUpdate(&ctx, &ref[i * sector_len], &outl,
+		    &in[i * sector_len], sector_len)) {
+			fprintf(stderr, "Encrypt failed\n");
+			test1_exit(6);
+		}
+	}
+
+	if (!EVP_EncryptInit_ex(&ctx, c, NULL, key, NULL) ||
+	    !EVP_CipherSectors(&ctx, out, in, sector_len, SECTORS, tweaks)) {
+		fprintf(stderr, "EVP_CipherSectors encrypt failed\n");
+		test1_exit(6);
+	}
+	if (memcmp(out, ref, SECTORS * sector_len)) {
+		fprintf(stderr, "Ciphertext mismatch\n");
+		test1_exit(9);
+	}
+
+	if (!EVP_DecryptInit_ex(&ctx, c, NULL, key, NULL) ||
+	    !EVP_CipherSectors(&ctx, out, out, sector_len, SECTORS, tweaks)) {
+		fprintf(stderr, "EVP_CipherSectors decrypt failed\n");
+		test1_exit(6);
+	}
+	if (memcmp(out, in, SECTORS * sector_len)) {
+		fprintf(stderr, "Plaintext mismatch\n");
+		test1_exit(9);
+	}
+
+	if (EVP_CipherSectors(&ctx, out, in, 15, SECTORS, tweaks)) {
+		fprintf(stderr, "EVP_CipherSectors accepted a short sector\n");
+		test1_exit(6);
+	}
+	if (!EVP_EncryptInit_ex(&ctx, EVP_aes_128_cbc(), NULL, key, key) ||
+	    EVP_CipherSectors(&ctx, out, in, sector_len, SECTORS, tweaks)) {
+		fprintf(stderr, "EVP_CipherSectors accepted CBC\n");
+		test1_exit(6);
+	}
+	ERR_clear_error();
+
+	EVP_CIPHER_CTX_cleanup(&ctx);
+
+	printf("\n");
+}
+
+#ifndef OPENSSL_NO_CAMELLIA
+/* Enough for the 32 and 16 block paths and a tail. */
+#define BLOCKS	71
+
+/*
+ * Check that a multi block call agrees with one block at a time, which
+ * takes a different path on CPUs with a vector implementation.
+ */
+static void
+test_blocks(const EVP_CIPHER *c)
+{
+	EVP_CIPHER_CTX ctx;
+	unsigned char key[32], iv[16];
+	unsigned char in[BLOCKS * 16], out[BLOCKS * 16], ref[BLOCKS * 16];
+	size_t i;
+	int enc, outl;
+
+	printf("Testing blocks %s\n", EVP_CIPHER_name(c));
+
+	arc4random_buf(key, sizeof(key));
+	arc4random_buf(iv, sizeof(iv));
+	arc4random_buf(in, sizeof(in));
+
+	EVP_CIPHER_CTX_init(&ctx);
+	for (enc = 0; enc <= 1; enc++) {
+		if (!EVP_CipherInit_ex(&ctx, c, NULL, key, iv, enc) ||
+		    !EVP_CIPHER_CTX_set_padding(&ctx, 0)) {
+			fprintf(stderr, "CipherInit failed\n");
+			test1_exit(10);
+		}
+		for (i = 0; i < BLOCKS; i++) {
+			if (!EVP_CipherUpdate(&ctx, &ref[i * 16], &outl,
+			    &in[i * 16], 16) || outl != 16) {
+				fprintf(stderr, "Cipher failed\n");
+				test1_exit(6);
+			}
+		}
+
+		memcpy(out, in, sizeof(out));
+		if (!EVP_CipherInit_ex(&ctx, NULL, NULL, NULL, iv, enc) ||
+		    !EVP_CipherUpdate(&ctx, out, &outl, out, sizeof(out)) ||
+		    outl != sizeof(out)) {
+			fprintf(stderr, "Cipher failed\n");
+			test1_exit(6);
+		}
+		if (memcmp(out, ref, sizeof(out))) {
+			fprintf(stderr, "%s mismatch\n",
+			    enc ? "Ciphertext" : "Plaintext");
+			test1_exit(9);
+		}
+	}
+	EVP_CIPHER_CTX_cleanup(&ctx);
+
+	printf("\n");
+}
+
+static void
+test_camellia_ctr(int bits)
+{
+	CAMELLIA_KEY ks;
+	unsigned char key[32], iv[16], ctr[16], ecount[16], ks_block[16];
+	unsigned char in[BLOCKS * 16 + 5], out[sizeof(in)], ref[sizeof(in)];
+	unsigned int num;
+	size_t i;
+	int j;
+
+	printf("Testing Camellia_ctr128_encrypt, %d bits\n", bits);
+
+	arc4random_buf(key, sizeof(key));
+	arc4random_buf(iv, sizeof(iv));
+	arc4random_buf(in, sizeof(in));
+	/* Make the low 32 bits of the counter wrap partway through. */
+	memset(&iv[12], 0xff, 4);
+	iv[15] = 0xf0;
+
+	if (Camellia_set_key(key, bits, &ks) != 0) {
+		fprintf(stderr, "Camellia_set_key failed\n");
+		test1_exit(10);
+	}
+
+	/* The counter is incremented as a 128 bit big endian number. */
+	memcpy(ctr, iv, sizeof(ctr));
+	for (i = 0; i < sizeof(in); i++) {
+		if (i % 16 == 0) {
+			Camellia_encrypt(ctr, ks_block, &ks);
+			for (j = 15; j >= 0 && ++ctr[j] == 0; j--)
+				;
+		}
+		ref[i] = in[i] ^ ks_block[i % 16];
+	}
+
+	memcpy(ctr, iv, sizeof(ctr));
+	num = 0;
+	Camellia_ctr128_encrypt(in, out, 3, &ks, ctr, ecount, &num);
+	Camellia_ctr128_encrypt(in + 3, out + 3, sizeof(in) - 3, &ks, ctr,
+	    ecount, &num);
+	if (memcmp(out, ref, sizeof(out))) {
+		fprintf(stderr, "Ciphertext mismatch\n");
+		test1_exit(9);
+	}
+
+	printf("\n");
+}
+#endif
+
 static int
 test_digest(const char *digest, const unsigned char *plaintext, int pn,
     const unsigned char *ciphertext, unsigned int cn)
@@ -431,6 +614,21 @@ main(int argc, char **argv)
 	}
 	fclose(f);
 
+	test_sectors(EVP_aes_128_xts(), 512);
+	test_sectors(EVP_aes_128_xts(), 100);
+	test_sectors(EVP_aes_256_xts(), 512);
+	test_sectors(EVP_aes_256_xts(), 16);
+
+#ifndef OPENSSL_NO_CAMELLIA
+	test_blocks(EVP_camellia_128_ecb());
+	test_blocks(EVP_camellia_256_ecb());
+	test_blocks(EVP_camellia_128_cbc());
+	test_blocks(EVP_camellia_192_cbc());
+	test_blocks(EVP_camellia_256_cbc());
+	test_camellia_ctr(128);
+	test_camellia_ctr(256);
+#endif
+
 #ifndef OPENSSL_NO_ENGINE
 	ENGINE_cleanup();
 #endif
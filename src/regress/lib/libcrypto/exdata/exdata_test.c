@@ -0,0 +1,179 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <openssl/crypto.h>
+#include <openssl/rsa.h>
+
+#define N_THREADS	4
+#define N_OBJECTS	10000
+#define N_INDEXES	32
+
+static long new_calls, dup_calls, free_calls;
+
+static void
+ex_new(void *parent, void *ptr, CRYPTO_EX_DATA *ad, int idx, long argl,
+    void *argp)
+{
+	__sync_fetch_and_add(&new_calls, 1);
+	CRYPTO_set_ex_data(ad, idx, (void *)argl);
+}
+
+static int
+ex_dup(CRYPTO_EX_DATA *to, CRYPTO_EX_DATA *from, void *from_d, int idx,
+    long argl, void *argp)
+{
+	__sync_fetch_and_add(&dup_calls, 1);
+	return 1;
+}
+
+static void
+ex_free(void *parent, void *ptr, CRYPTO_EX_DATA *ad, int idx, long argl,
+    void *argp)
+{
+	__sync_fetch_and_add(&free_calls, 1);
+
+	/* Objects created before the index was added have no data for it. */
+	if (ptr != NULL && ptr != (void *)argl)
+		fprintf(stderr, "FAIL: index %d has %p, want %p\n", idx, ptr,
+		    (void *)argl);
+}
+
+static int
+exdata_basic_test(void)
+{
+	RSA *rsa = NULL;
+	int idx, failed = 1;
+
+	if ((idx = RSA_get_ex_new_index(0x1234, NULL, ex_new, ex_dup,
+	    ex_free)) < 0) {
+		fprintf(stderr, "FAIL: RSA_get_ex_new_index\n");
+		goto done;
+	}
+	new_calls = free_calls = 0;
+	if ((rsa = RSA_new()) == NULL) {
+		fprintf(stderr, "FAIL: RSA_new\n");
+		goto done;
+	}
+	if (new_calls != 1) {
+		fprintf(stderr, "FAIL: %ld new calls, want 1\n", new_calls);
+		goto done;
+	}
+	if (RSA_get_ex_data(rsa, idx) != (void *)0x1234) {
+		fprintf(stderr, "FAIL: ex_data not set by new callback\n");
+		goto done;
+	}
+	if (!RSA_set_ex_data(rsa, idx, (void *)0x1234)) {
+		fprintf(stderr, "FAIL: RSA_set_ex_data\n");
+		goto done;
+	}
+	RSA_free(rsa);
+	rsa = NULL;
+	if (free_calls != 1) {
+		fprintf(stderr, "FAIL: %ld free calls, want 1\n", free_calls);
+		goto done;
+	}
+
+	failed = 0;
+
+ done:
+	RSA_free(rsa);
+
+	return failed;
+}
+
+static void *
+exdata_churn(void *arg)
+{
+	RSA *rsa;
+	long *failures = arg;
+	int i;
+
+	for (i = 0; i < N_OBJECTS; i++) {
+		if ((rsa = RSA_new()) == NULL) {
+			(*failures)++;
+			break;
+		}
+		RSA_free(rsa);
+	}
+
+	return NULL;
+}
+
+/*
+ * Create and free objects in several threads while indexes are being
+ * added to their class; every object must see the same methods when it is
+ * freed as when it was created, or later ones.
+ */
+static int
+exdata_thread_test(void)
+{
+	pthread_t threads[N_THREADS];
+	long failures[N_THREADS];
+	int i, n, failed = 1;
+
+	new_calls = free_calls = 0;
+	memset(failures, 0, sizeof(failures));
+
+	for (n = 0; n < N_THREADS; n++) {
+		if (pthread_create(&threads[n], NULL, exdata_churn,
+		    &failures[n]) != 0) {
+			fprintf(stderr, "FAIL: pthread_create\n");
+			break;
+		}
+	}
+	for (i = 0; i < N_INDEXES; i++) {
+		if (RSA_get_ex_new_index(i, NULL, ex_new, NULL,
+		    ex_free) < 0) {
+			fprintf(stderr, "FAIL: RSA_get_ex_new_index\n");
+			failures[0]++;
+		}
+	}
+	for (i = 0; i < n; i++)
+		pthread_join(threads[i], NULL);
+
+	if (n != N_THREADS)
+		goto done;
+	for (i = 0; i < N_THREADS; i++) {
+		if (failures[i] != 0)
+			goto done;
+	}
+	if (free_calls < new_calls) {
+		fprintf(stderr, "FAIL: %ld new calls, but %ld free calls\n",
+		    new_calls, free_calls);
+		goto done;
+	}
+
+	failed = 0;
+
+ done:
+	return failed;
+}
+
+int
+main(int argc, char **argv)
+{
+	int failed = 0;
+
+	failed |= exdata_basic_test();
+	failed |= exdata_thread_test();
+
+	return failed;
+}
@@ -72,6 +72,10 @@ int BN_mod_exp_mont_ct(BIGNUM *r, const BIGNUM *a, const BIGNUM *p,
     const BIGNUM *m, BN_CTX *ctx, BN_MONT_CTX *m_ctx);
 int BN_mod_exp_mont_nonct(BIGNUM *r, const BIGNUM *a, const BIGNUM *p,
     const BIGNUM *m, BN_CTX *ctx, BN_MONT_CTX *m_ctx);
+int BN_mod_exp_mont_consttime_x2(BIGNUM *rr1, const BIGNUM *a1,
+    const BIGNUM *p1, const BIGNUM *m1, BN_MONT_CTX *in_mont1, BIGNUM *rr2,
+    const BIGNUM *a2, const BIGNUM *p2, const BIGNUM *m2,
+    BN_MONT_CTX *in_mont2, BN_CTX *ctx);
 
 #define NUM_BITS	(BN_BITS*2)
 
@@ -202,6 +206,139 @@ static int test_exp_mod_zero(void)
 	return ret;
 }
 
+/*
+ * Pick a base for test_mod_exp_x2(): a random one below m in most cases,
+ * but also 0, 1, m - 1 and one larger than m.
+ */
+static int x2_base(BIGNUM *a, const BIGNUM *m, int i)
+{
+	switch (i % 8) {
+	case 0:
+		BN_zero(a);
+		return 1;
+	case 1:
+		return BN_one(a);
+	case 2:
+		return BN_sub(a, m, BN_value_one());
+	case 3:
+		return BN_rand(a, 2 * BN_num_bits(m), 0, 0);
+	default:
+		return BN_rand_range(a, m);
+	}
+}
+
+/* Pick an exponent of up to the size of m, including 0 and 1. */
+static int x2_exponent(BIGNUM *p, const BIGNUM *m, int i)
+{
+	switch (i % 5) {
+	case 0:
+		BN_zero(p);
+		return 1;
+	case 1:
+		return BN_one(p);
+	case 2:
+		return BN_rand(p, BN_num_bits(m) / 2, 0, 0);
+	default:
+		return BN_rand(p, BN_num_bits(m), 0, 0);
+	}
+}
+
+/*
+ * test_mod_exp_x2 checks BN_mod_exp_mont_consttime_x2 against
+ * BN_mod_exp_simple and BN_mod_exp_mont_consttime. The moduli of 1024, 1536
+ * and 2048 bits take the AVX-512 IFMA code on CPUs that have it, the others
+ * and pairs of moduli of different sizes always take the generic one. It
+ * returns zero on success.
+ */
+static int test_mod_exp_x2(void)
+{
+	static const int bits[][2] = {
+		{ 1024, 1024 },
+		{ 1000, 1024 },
+		{ 1536, 1536 },
+		{ 2048, 2048 },
+		{ 1985, 2048 },
+		{ 512, 512 },
+		{ 1088, 1088 },
+		{ 1024, 2048 },
+	};
+	BIGNUM *a[2], *p[2], *m[2], *r[2], *r_simple, *r_const;
+	BN_CTX *ctx;
+	size_t i;
+	int j, k;
+	int ret = 1;
+
+	if ((ctx = BN_CTX_new()) == NULL)
+		return 1;
+	BN_CTX_start(ctx);
+	for (k = 0; k < 2; k++) {
+		if ((a[k] = BN_CTX_get(ctx)) == NULL ||
+		    (p[k] = BN_CTX_get(ctx)) == NULL ||
+		    (m[k] = BN_CTX_get(ctx)) == NULL ||
+		    (r[k] = BN_CTX_get(ctx)) == NULL)
+			goto err;
+	}
+	if ((r_simple = BN_CTX_get(ctx)) == NULL ||
+	    (r_const = BN_CTX_get(ctx)) == NULL)
+		goto err;
+
+	for (i = 0; i < sizeof(bits) / sizeof(bits[0]); i++) {
+		for (j = 0; j < 40; j++) {
+			for (k = 0; k < 2; k++) {
+				/* An odd modulus with the top bit set. */
+				if (!BN_rand(m[k], bits[i][k], 0, 1))
+					goto err;
+				if (!x2_base(a[k], m[k], j + k))
+					goto err;
+				if (!x2_exponent(p[k], m[k], j + 3 * k))
+					goto err;
+			}
+
+			if (!BN_mod_exp_mont_consttime_x2(r[0], a[0], p[0],
+			    m[0], NULL, r[1], a[1], p[1], m[1], NULL, ctx))
+				goto err;
+
+			for (k = 0; k < 2; k++) {
+				if (!BN_mod_exp_simple(r_simple, a[k], p[k],
+				    m[k], ctx))
+					goto err;
+				if (!BN_mod_exp_mont_consttime(r_const, a[k],
+				    p[k], m[k], ctx, NULL))
+					goto err;
+				if (BN_cmp(r[k], r_simple) == 0 &&
+				    BN_cmp(r[k], r_const) == 0)
+					continue;
+
+				fprintf(stderr, "BN_mod_exp_mont_consttime_x2 "
+				    "failed for result %d of %d and %d bit "
+				    "moduli:\n", k, bits[i][0], bits[i][1]);
+				fprintf(stderr, "a = ");
+				BN_print_fp(stderr, a[k]);
+				fprintf(stderr, "\np = ");
+				BN_print_fp(stderr, p[k]);
+				fprintf(stderr, "\nm = ");
+				BN_print_fp(stderr, m[k]);
+				fprintf(stderr, "\nr = ");
+				BN_print_fp(stderr, r[k]);
+				fprintf(stderr, "\nsimple = ");
+				BN_print_fp(stderr, r_simple);
+				fprintf(stderr, "\nconsttime = ");
+				BN_print_fp(stderr, r_const);
+				fprintf(stderr, "\n");
+				goto err;
+			}
+		}
+	}
+
+	ret = 0;
+
+ err:
+	BN_CTX_end(ctx);
+	BN_CTX_free(ctx);
+
+	return ret;
+}
+
 int main(int argc, char *argv[])
 {
 	BIGNUM *r_mont, *r_mont_const, *r_recp, *r_simple;
@@ -343,6 +480,9 @@ int main(int argc, char *argv[])
 	if (test_exp_mod_zero() != 0)
 		goto err;
 
+	if (test_mod_exp_x2() != 0)
+		goto err;
+
 	printf("done\n");
 
 	return (0);
@@ -61,6 +61,7 @@
 #include <stdlib.h>
 
 #include <openssl/hmac.h>
+#include <openssl/objects.h>
 #ifndef OPENSSL_NO_MD5
 #include <openssl/md5.h>
 #endif
@@ -133,6 +134,8 @@ static struct test_st {
 #endif
 
 static char *pt(unsigned char *md, unsigned int len);
+static int precomputed_test(void);
+static int batch_test(void);
 
 int
 main(int argc, char *argv[])
@@ -309,12 +312,141 @@ main(int argc, char *argv[])
 	} else {
 		printf("test 6 ok\n");
 	}
+
+	err += precomputed_test();
+	err += batch_test();
 end:
 	HMAC_CTX_cleanup(&ctx);
 	exit(err);
 	return(0);
 }
 
+/*
+ * HMAC_precomputed_mac() must agree with HMAC(), both for the digests that
+ * use their hash context directly and for the others, and for keys longer
+ * than a block.
+ */
+static int
+precomputed_test(void)
+{
+	const EVP_MD *mds[] = {
+#ifndef OPENSSL_NO_MD5
+		EVP_md5(),
+#endif
+		EVP_sha1(),
+		EVP_sha224(),
+		EVP_sha256(),
+		EVP_sha384(),
+		EVP_sha512(),
+#ifndef OPENSSL_NO_RIPEMD
+		EVP_ripemd160(),
+#endif
+	};
+	HMAC_PRECOMPUTED *state;
+	unsigned char key[200], data[300];
+	unsigned char buf[EVP_MAX_MD_SIZE], want[EVP_MAX_MD_SIZE];
+	unsigned int len, want_len;
+	size_t i, key_len, data_len;
+	int err = 0;
+
+	for (i = 0; i < sizeof(key); i++)
+		key[i] = i * 7;
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = i * 13;
+
+	for (i = 0; i < sizeof(mds) / sizeof(mds[0]); i++) {
+		for (key_len = 0; key_len < sizeof(key); key_len += 33) {
+			if ((state = HMAC_precomputed_new(mds[i], key,
+			    key_len)) == NULL) {
+				printf("HMAC_precomputed_new failed (test 7)\n");
+				return 1;
+			}
+			for (data_len = 0; data_len < sizeof(data);
+			    data_len += 47) {
+				HMAC(mds[i], key, key_len, data, data_len,
+				    want, &want_len);
+				if (!HMAC_precomputed_mac(state, data, data_len,
+				    buf, &len) || len != want_len ||
+				    memcmp(buf, want, len) != 0) {
+					printf("HMAC_precomputed_mac differs "
+					    "for %s, key %zu, data %zu "
+					    "(test 7)\n",
+					    OBJ_nid2sn(EVP_MD_type(mds[i])),
+					    key_len, data_len);
+					err++;
+				}
+			}
+			HMAC_precomputed_free(state);
+		}
+	}
+
+	if (err == 0)
+		printf("test 7 ok\n");
+
+	return err;
+}
+
+/*
+ * HMAC_batch() must agree with HMAC() for each message, with keys and
+ * messages of different lengths in the same batch.
+ */
+static int
+batch_test(void)
+{
+	const EVP_MD *mds[] = {
+		EVP_sha1(),
+		EVP_sha256(),
+		EVP_sha512(),
+	};
+	enum { count = 50 };
+	unsigned char key[200], data[300];
+	unsigned char out[count][EVP_MAX_MD_SIZE], want[EVP_MAX_MD_SIZE];
+	const void *keys[count];
+	const unsigned char *msgs[count];
+	unsigned char *mds_out[count];
+	int key_lens[count];
+	size_t lens[count];
+	unsigned int want_len;
+	size_t i, j;
+	int err = 0;
+
+	for (i = 0; i < sizeof(key); i++)
+		key[i] = i * 7;
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = i * 13;
+
+	for (j = 0; j < count; j++) {
+		keys[j] = key + j;
+		key_lens[j] = (j * 29) % (sizeof(key) - count);
+		msgs[j] = data + j;
+		lens[j] = (j * 47) % (sizeof(data) - count);
+		mds_out[j] = out[j];
+	}
+
+	for (i = 0; i < sizeof(mds) / sizeof(mds[0]); i++) {
+		if (!HMAC_batch(mds[i], keys, key_lens, msgs, lens, mds_out,
+		    count)) {
+			printf("HMAC_batch failed (test 8)\n");
+			return 1;
+		}
+		for (j = 0; j < count; j++) {
+			HMAC(mds[i], keys[j], key_lens[j], msgs[j], lens[j],
+			    want, &want_len);
+			if (memcmp(out[j], want, want_len) != 0) {
+				printf("HMAC_batch differs for %s, message %zu "
+				    "(test 8)\n", OBJ_nid2sn(EVP_MD_type(mds[i])),
+				    j);
+				err++;
+			}
+		}
+	}
+
+	if (err == 0)
+		printf("test 8 ok\n");
+
+	return err;
+}
+
 #ifndef OPENSSL_NO_MD5
 static char *
 pt(unsigned char *md, unsigned int len)
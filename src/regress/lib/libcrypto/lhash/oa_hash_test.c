@@ -0,0 +1,173 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/lhash.h>
+
+#include "oa_hash.h"
+
+#define N_ITEMS	50000
+
+typedef struct {
+	int key;
+	int value;
+	int seen;
+} ITEM;
+DECLARE_OA_HASH_OF(ITEM);
+
+static OA_HASH_OF(ITEM) *table;
+static ITEM items[N_ITEMS], dups[N_ITEMS];
+
+static unsigned long
+item_hash(const ITEM *item)
+{
+	/* A poor hash, to get long probe sequences. */
+	return item->key / 4;
+}
+static IMPLEMENT_LHASH_HASH_FN(item, ITEM)
+
+static int
+item_cmp(const ITEM *a, const ITEM *b)
+{
+	return a->key - b->key;
+}
+static IMPLEMENT_LHASH_COMP_FN(item, ITEM)
+
+static void
+item_doall(ITEM *item)
+{
+	item->seen++;
+
+	/* Deleting items while walking the table must be safe. */
+	if (item->key % 3 == 0) {
+		if (OA_HASH_DELETE(ITEM, table, item) != item)
+			fprintf(stderr, "FAIL: delete of %d while walking\n",
+			    item->key);
+	}
+}
+static IMPLEMENT_LHASH_DOALL_FN(item, ITEM)
+
+static int
+item_check(int i, const ITEM *want)
+{
+	ITEM key, *item;
+
+	key.key = i;
+	if ((item = OA_HASH_RETRIEVE(ITEM, table, &key)) != want) {
+		fprintf(stderr, "FAIL: item %d is %p, want %p\n", i, item,
+		    want);
+		return 0;
+	}
+	return 1;
+}
+
+int
+main(int argc, char **argv)
+{
+	ITEM *item;
+	int i, failed = 1;
+
+	if ((table = OA_HASH_NEW(ITEM, item)) == NULL) {
+		fprintf(stderr, "FAIL: OA_HASH_NEW\n");
+		goto done;
+	}
+
+	for (i = 0; i < N_ITEMS; i++) {
+		items[i].key = dups[i].key = i;
+		items[i].value = i;
+		dups[i].value = -i;
+		if (OA_HASH_INSERT(ITEM, table, &items[i]) != NULL ||
+		    OA_HASH_ERROR(ITEM, table)) {
+			fprintf(stderr, "FAIL: insert of %d\n", i);
+			goto done;
+		}
+		/* Every item stays reachable while the table grows. */
+		if (!item_check(i / 2, &items[i / 2]) ||
+		    !item_check(i, &items[i]))
+			goto done;
+	}
+	if (OA_HASH_NUM_ITEMS(ITEM, table) != N_ITEMS) {
+		fprintf(stderr, "FAIL: %zu items, want %d\n",
+		    OA_HASH_NUM_ITEMS(ITEM, table), N_ITEMS);
+		goto done;
+	}
+	if (!item_check(N_ITEMS, NULL))
+		goto done;
+
+	/* Replace the odd items, then delete the items divisible by five. */
+	for (i = 1; i < N_ITEMS; i += 2) {
+		item = OA_HASH_INSERT(ITEM, table, &dups[i]);
+		if (item != &items[i]) {
+			fprintf(stderr, "FAIL: replace of %d returned %p\n", i,
+			    item);
+			goto done;
+		}
+	}
+	for (i = 0; i < N_ITEMS; i += 5) {
+		item = (i % 2 == 0) ? &items[i] : &dups[i];
+		if (OA_HASH_DELETE(ITEM, table, item) != item) {
+			fprintf(stderr, "FAIL: delete of %d\n", i);
+			goto done;
+		}
+		if (OA_HASH_DELETE(ITEM, table, item) != NULL) {
+			fprintf(stderr, "FAIL: second delete of %d\n", i);
+			goto done;
+		}
+	}
+	for (i = 0; i < N_ITEMS; i++) {
+		if (i % 5 == 0)
+			item = NULL;
+		else
+			item = (i % 2 == 0) ? &items[i] : &dups[i];
+		if (!item_check(i, item))
+			goto done;
+	}
+
+	/* Grow again after many deletions, then walk the table. */
+	for (i = 0; i < N_ITEMS; i += 5) {
+		if (OA_HASH_INSERT(ITEM, table, &items[i]) != NULL) {
+			fprintf(stderr, "FAIL: reinsert of %d\n", i);
+			goto done;
+		}
+	}
+	OA_HASH_DOALL(ITEM, table, LHASH_DOALL_FN(item));
+	for (i = 0; i < N_ITEMS; i++) {
+		item = (i % 2 == 0 || i % 5 == 0) ? &items[i] : &dups[i];
+		if (item->seen != 1) {
+			fprintf(stderr, "FAIL: item %d seen %d times\n", i,
+			    item->seen);
+			goto done;
+		}
+		if (!item_check(i, i % 3 == 0 ? NULL : item))
+			goto done;
+	}
+	if (OA_HASH_NUM_ITEMS(ITEM, table) != N_ITEMS - (N_ITEMS + 2) / 3) {
+		fprintf(stderr, "FAIL: %zu items after walk\n",
+		    OA_HASH_NUM_ITEMS(ITEM, table));
+		goto done;
+	}
+
+	failed = 0;
+
+ done:
+	OA_HASH_FREE(ITEM, table);
+
+	return failed;
+}
@@ -185,6 +185,79 @@ test_p5_pbkdf2(unsigned int n, const char *digestname, const testdata *test,
 	free(out);
 }
 
+/*
+ * Derive the keys of the test cases with 4096 iterations in one batch, each
+ * of them twice, so that there are enough passwords for all lanes. The
+ * shortest of these keys is 16 bytes long and keys of different lengths share
+ * their prefix, so only the first 16 bytes are compared.
+ */
+#define BATCH_ITER	4096
+#define BATCH_KEYLEN	16
+#define BATCH_MAX	16
+
+static void
+test_p5_pbkdf2_batch(const char *digestname, const char **results)
+{
+	const EVP_MD *digest;
+	const testdata *test;
+	const char *pass[BATCH_MAX];
+	const unsigned char *salt[BATCH_MAX];
+	unsigned char key[BATCH_MAX][BATCH_KEYLEN], *out[BATCH_MAX];
+	unsigned char expected[BATCH_MAX][BATCH_KEYLEN];
+	int passlen[BATCH_MAX], saltlen[BATCH_MAX];
+	size_t count = 0, n;
+	int i;
+
+	digest = EVP_get_digestbyname(digestname);
+	if (digest == NULL) {
+		fprintf(stderr, "unknown digest %s\n", digestname);
+		exit(5);
+	}
+
+	for (i = 0; i < 2; i++) {
+		for (n = 0, test = test_cases; test->pass != NULL;
+		    n++, test++) {
+			if (test->iter != BATCH_ITER)
+				continue;
+			if (count >= BATCH_MAX) {
+				fprintf(stderr, "too many test cases\n");
+				exit(5);
+			}
+			if (convert(expected[count],
+			    (const unsigned char *)results[n],
+			    BATCH_KEYLEN) != 0) {
+				fprintf(stderr, "invalid hex string %s\n",
+				    results[n]);
+				exit(5);
+			}
+			pass[count] = test->pass;
+			passlen[count] = test->passlen;
+			salt[count] = (const unsigned char *)test->salt;
+			saltlen[count] = test->saltlen;
+			out[count] = key[count];
+			count++;
+		}
+	}
+
+	if (!PKCS5_PBKDF2_HMAC_batch(pass, passlen, salt, saltlen, BATCH_ITER,
+	    digest, BATCH_KEYLEN, out, count)) {
+		fprintf(stderr, "PKCS5_PBKDF2_HMAC_batch(%s) failure\n",
+		    digestname);
+		exit(3);
+	}
+	for (n = 0; n < count; n++) {
+		if (memcmp(expected[n], key[n], BATCH_KEYLEN) != 0) {
+			fprintf(stderr, "Wrong result for "
+			    "PKCS5_PBKDF2_HMAC_batch(%s) key %zu\n",
+			    digestname, n);
+			hexdump(stderr, "expected: ", expected[n],
+			    BATCH_KEYLEN);
+			hexdump(stderr, "result:   ", key[n], BATCH_KEYLEN);
+			exit(2);
+		}
+	}
+}
+
 int
 main(int argc,char **argv)
 {
@@ -203,6 +276,10 @@ main(int argc,char **argv)
 		test_p5_pbkdf2(n, "sha512", test, sha512_results[n]);
 	}
 
+	test_p5_pbkdf2_batch("sha1", sha1_results);
+	test_p5_pbkdf2_batch("sha256", sha256_results);
+	test_p5_pbkdf2_batch("sha512", sha512_results);
+
 #ifndef OPENSSL_NO_ENGINE
 	ENGINE_cleanup();
 #endif
@@ -106,11 +106,15 @@ poly1305_power_on_self_test(void)
 		0xd2, 0x87, 0xf9, 0x7c, 0x44, 0x62, 0x3d, 0x39
 	};
 
+	static const size_t long_lens[] = { 256, 1000, 4099 };
+
 	poly1305_context ctx;
 	poly1305_context total_ctx;
 	unsigned char all_key[32];
 	unsigned char all_msg[256];
+	unsigned char long_msg[4099];
 	unsigned char mac[16];
+	unsigned char long_mac[16];
 	size_t i, j;
 	int result = 1;
 
@@ -154,6 +158,18 @@ poly1305_power_on_self_test(void)
 	CRYPTO_poly1305_finish(&total_ctx, mac);
 	result &= poly1305_verify(total_mac, mac);
 
+	/* check long messages against updates of a byte at a time */
+	for (i = 0; i < sizeof(long_msg); i++)
+		long_msg[i] = i * 3;
+	for (i = 0; i < sizeof(long_lens) / sizeof(long_lens[0]); i++) {
+		CRYPTO_poly1305(mac, long_msg, long_lens[i], nacl_key);
+		CRYPTO_poly1305_init(&ctx, nacl_key);
+		for (j = 0; j < long_lens[i]; j++)
+			CRYPTO_poly1305_update(&ctx, &long_msg[j], 1);
+		CRYPTO_poly1305_finish(&ctx, long_mac);
+		result &= poly1305_verify(long_mac, mac);
+	}
+
 	return result;
 }
 
@@ -11,6 +11,7 @@
 /* test vectors from p1ovect1.txt */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <openssl/crypto.h>
@@ -213,6 +214,182 @@ static int pad_unknown(void)
     return (0);
 }
 
+/*
+ * Private key operations on keys whose primes have 1024, 1536 and 2048 bits
+ * go through BN_mod_exp_mont_consttime_x2, which uses AVX-512 IFMA where the
+ * CPU has it.  Check the CRT results against the same key without the CRT
+ * parameters, which only uses the portable exponentiation with d.  The CRT
+ * key has no public exponent, so that a wrong result is not hidden by the
+ * check against e and the retry with d in RSA_eay_mod_exp.
+ */
+static int crt_x2_one(int bits)
+{
+    RSA *key = NULL, *crt = NULL, *nocrt = NULL;
+    BIGNUM *e = NULL;
+    unsigned char in[512], crt_out[512], nocrt_out[512], back[512];
+    int len, i;
+    int ret = 1;
+
+    if ((key = RSA_new()) == NULL || (crt = RSA_new()) == NULL ||
+        (nocrt = RSA_new()) == NULL || (e = BN_new()) == NULL)
+        goto err;
+    if (!BN_set_word(e, RSA_F4))
+        goto err;
+    if (!RSA_generate_key_ex(key, bits, e, NULL)) {
+        printf("%d bit key generation failed!\n", bits);
+        goto err;
+    }
+    if ((crt->n = BN_dup(key->n)) == NULL ||
+        (crt->d = BN_dup(key->d)) == NULL ||
+        (crt->p = BN_dup(key->p)) == NULL ||
+        (crt->q = BN_dup(key->q)) == NULL ||
+        (crt->dmp1 = BN_dup(key->dmp1)) == NULL ||
+        (crt->dmq1 = BN_dup(key->dmq1)) == NULL ||
+        (crt->iqmp = BN_dup(key->iqmp)) == NULL)
+        goto err;
+    /* Blinding needs e. */
+    crt->flags |= RSA_FLAG_NO_BLINDING;
+    if ((nocrt->n = BN_dup(key->n)) == NULL ||
+        (nocrt->e = BN_dup(key->e)) == NULL ||
+        (nocrt->d = BN_dup(key->d)) == NULL)
+        goto err;
+
+    len = RSA_size(key);
+    for (i = 0; i < 16; i++) {
+        arc4random_buf(in, len);
+        /* Keep the input below n; also try the smallest ones. */
+        in[0] = 0;
+        if (i < 2) {
+            memset(in, 0, len);
+            in[len - 1] = i;
+        }
+
+        if (RSA_private_encrypt(len, in, crt_out, crt,
+                                RSA_NO_PADDING) != len ||
+            RSA_private_encrypt(len, in, nocrt_out, nocrt,
+                                RSA_NO_PADDING) != len) {
+            printf("%d bit RSA_private_encrypt failed!\n", bits);
+            goto err;
+        }
+        if (memcmp(crt_out, nocrt_out, len) != 0) {
+            printf("%d bit CRT and non-CRT results differ!\n", bits);
+            goto err;
+        }
+        if (RSA_public_decrypt(len, crt_out, back, key,
+                               RSA_NO_PADDING) != len ||
+            memcmp(back, in, len) != 0) {
+            printf("%d bit CRT result does not verify!\n", bits);
+            goto err;
+        }
+    }
+    printf("%d bit CRT private key operations ok\n", bits);
+    ret = 0;
+
+ err:
+    RSA_free(key);
+    RSA_free(crt);
+    RSA_free(nocrt);
+    BN_free(e);
+    return ret;
+}
+
+static int crt_x2(void)
+{
+    if (crt_x2_one(2048) != 0 || crt_x2_one(3072) != 0 ||
+        crt_x2_one(4096) != 0)
+        return 1;
+    return 0;
+}
+
+static int keygen_threads(void)
+{
+    RSA *key = NULL;
+    BIGNUM *e = NULL;
+    int ret = 1;
+
+    if ((key = RSA_new()) == NULL || (e = BN_new()) == NULL)
+        goto err;
+    if (!BN_set_word(e, RSA_F4))
+        goto err;
+    if (!RSA_generate_key_threads(key, 1024, e, 4, NULL)) {
+        printf("Threaded key generation failed!\n");
+        goto err;
+    }
+    if (BN_num_bits(key->n) != 1024 || RSA_check_key(key) != 1) {
+        printf("Threaded key generation gave a bad key!\n");
+        goto err;
+    }
+    printf("Threaded key generation ok\n");
+    ret = 0;
+
+ err:
+    RSA_free(key);
+    BN_free(e);
+    return ret;
+}
+
+static int executor_calls;
+
+static int run_now(void (*task)(void *), void *task_arg, void *arg)
+{
+    executor_calls++;
+    task(task_arg);
+    return 1;
+}
+
+static int keygen_pool_one(const char *what)
+{
+    RSA *key = NULL;
+    BIGNUM *e = NULL;
+    int ret = 1;
+
+    if ((key = RSA_new()) == NULL || (e = BN_new()) == NULL)
+        goto err;
+    if (!BN_set_word(e, RSA_F4))
+        goto err;
+    if (!RSA_generate_key_ex(key, 1024, e, NULL)) {
+        printf("Key generation with %s failed!\n", what);
+        goto err;
+    }
+    if (BN_num_bits(key->n) != 1024 || RSA_check_key(key) != 1) {
+        printf("Key generation with %s gave a bad key!\n", what);
+        goto err;
+    }
+    printf("Key generation with %s ok\n", what);
+    ret = 0;
+
+ err:
+    RSA_free(key);
+    BN_free(e);
+    return ret;
+}
+
+static int keygen_pool(void)
+{
+    int ret = 1;
+
+    if (!CRYPTO_set_thread_pool(4)) {
+        printf("CRYPTO_set_thread_pool failed!\n");
+        return 1;
+    }
+    if (keygen_pool_one("a thread pool") != 0)
+        goto err;
+
+    CRYPTO_set_thread_executor(run_now, NULL, 2);
+    if (keygen_pool_one("an executor") != 0)
+        goto err;
+    if (executor_calls == 0) {
+        printf("Key generation did not use the executor!\n");
+        goto err;
+    }
+    ret = 0;
+
+ err:
+    CRYPTO_set_thread_executor(NULL, NULL, 0);
+    CRYPTO_set_thread_pool(0);
+    return ret;
+}
+
 int main(int argc, char *argv[])
 {
     int err = 0;
@@ -322,6 +499,13 @@ int main(int argc, char *argv[])
         RSA_free(key);
     }
 
+    if (crt_x2() != 0)
+        err = 1;
+    if (keygen_threads() != 0)
+        err = 1;
+    if (keygen_pool() != 0)
+        err = 1;
+
     return err;
 }
 #endif
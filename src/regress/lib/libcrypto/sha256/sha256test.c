@@ -61,6 +61,50 @@ unsigned char addenum_3[SHA224_DIGEST_LENGTH] = {
 	0x4e, 0xe7, 0xad, 0x67,
 };
 
+#define MULTI_MAX	17
+
+static int
+multi_test(void)
+{
+	unsigned char buf[MULTI_MAX * 97];
+	unsigned char md[MULTI_MAX][SHA256_DIGEST_LENGTH];
+	unsigned char want[SHA256_DIGEST_LENGTH];
+	const unsigned char *in[MULTI_MAX];
+	unsigned char *out[MULTI_MAX];
+	size_t len[MULTI_MAX];
+	size_t count, i;
+	int start;
+
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = i * 7 + 1;
+
+	/*
+	 * Use lengths either side of the padding boundaries, so that
+	 * messages finish at different times in different lanes.
+	 */
+	for (start = 0; start < 64; start++) {
+		for (count = 1; count <= MULTI_MAX; count++) {
+			for (i = 0; i < count; i++) {
+				len[i] = (start + i * 53) % 200;
+				in[i] = buf + i * 97 % (sizeof(buf) - 200);
+				out[i] = md[i];
+			}
+			SHA256_multi(in, len, out, count);
+			for (i = 0; i < count; i++) {
+				SHA256(in[i], len[i], want);
+				if (memcmp(md[i], want, sizeof(want)) != 0) {
+					fprintf(stderr, "\nSHA256_multi failed "
+					    "for message %zu of %zu, length "
+					    "%zu.\n", i + 1, count, len[i]);
+					return 1;
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
 int
 main(int argc, char **argv) {
 	unsigned char md[SHA256_DIGEST_LENGTH];
@@ -113,6 +157,13 @@ main(int argc, char **argv) {
 
 	fprintf(stdout, " passed.\n"); fflush(stdout);
 
+	fprintf(stdout, "Testing SHA256_multi ");
+	fflush(stdout);
+	if (multi_test() != 0)
+		return 1;
+	fprintf(stdout, " passed.\n");
+	fflush(stdout);
+
 	fprintf(stdout, "Testing SHA-224 ");
 
 	EVP_Digest ("abc",3,md,NULL,EVP_sha224(),NULL);
@@ -17,6 +17,7 @@
 
 #include <err.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <openssl/evp.h>
@@ -50,6 +51,16 @@ const uint8_t sm3_expected[SM3_TESTS][32] = {
 	},
 };
 
+/* One million repetitions of "a". */
+#define SM3_LONG_LEN 1000000
+
+const uint8_t sm3_long_expected[32] = {
+	0xc8, 0xaa, 0xf8, 0x94, 0x29, 0x55, 0x40, 0x29,
+	0xe2, 0x31, 0x94, 0x1a, 0x2a, 0xcc, 0x0a, 0xd6,
+	0x1f, 0xf2, 0xa5, 0xac, 0xd8, 0xfa, 0xdd, 0x25,
+	0x84, 0x7a, 0x3a, 0x73, 0x2b, 0x3b, 0x02, 0xc3,
+};
+
 /* Tweaked version of libssl/key_schedule/key_schedule.c. */
 static void
 hexdump(const uint8_t *buf, size_t len)
@@ -68,6 +79,8 @@ main(int argc, char *argv[])
 {
 	EVP_MD_CTX *ctx;
 	uint8_t digest[32];
+	uint8_t *buf;
+	size_t len, off;
 	int i;
 	int numerrors = 0;
 
@@ -93,6 +106,40 @@ main(int argc, char *argv[])
 			fprintf(stderr, "SM3 test %d ok\n", i);
 	}
 
+	if ((buf = malloc(SM3_LONG_LEN)) == NULL)
+		err(1, NULL);
+	memset(buf, 'a', SM3_LONG_LEN);
+
+	/*
+	 * Hash the long input in one update, which covers the multi block
+	 * path, and in uneven pieces that leave a partial block in between.
+	 */
+	for (i = 0; i < 2; i++) {
+		if (!EVP_DigestInit(ctx, EVP_sm3()))
+			errx(1, "EVP_DigestInit() failed");
+		for (off = 0; off < SM3_LONG_LEN; off += len) {
+			len = (i == 0) ? SM3_LONG_LEN : 1000 + off % 37;
+			if (len > SM3_LONG_LEN - off)
+				len = SM3_LONG_LEN - off;
+			if (!EVP_DigestUpdate(ctx, buf + off, len))
+				errx(1, "EVP_DigestUpdate() failed");
+		}
+		if (!EVP_DigestFinal(ctx, digest, NULL))
+			errx(1, "EVP_DigestFinal() failed");
+
+		if (memcmp(digest, sm3_long_expected, sizeof(digest)) != 0) {
+			fprintf(stderr, "long test %d failed\n", i);
+			fprintf(stderr, "Produced:\n");
+			hexdump(digest, sizeof(digest));
+			fprintf(stderr, "Expected:\n");
+			hexdump(sm3_long_expected, sizeof(sm3_long_expected));
+			numerrors++;
+		} else
+			fprintf(stderr, "SM3 long test %d ok\n", i);
+	}
+
+	free(buf);
+
 	EVP_MD_CTX_free(ctx);
 
 	return (numerrors > 0) ? 1 : 0;
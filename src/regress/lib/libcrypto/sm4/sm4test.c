@@ -17,8 +17,10 @@
 
 #include <err.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include <openssl/evp.h>
 #include <openssl/sm4.h>
 
 static void
@@ -34,10 +36,160 @@ hexdump(FILE *fp, const char *title, const uint8_t *buf, size_t len)
 		fprintf(fp, "\n");
 }
 
+/* Enough for the 16 and 8 block paths and a tail. */
+#define BLOCKS	39
+
+/*
+ * Check that a multi block call agrees with one block at a time, which
+ * takes a different path on CPUs with a vector implementation.
+ */
+static int
+sm4_blocks_test(const EVP_CIPHER *c)
+{
+	EVP_CIPHER_CTX *ctx;
+	uint8_t key[SM4_BLOCK_SIZE], iv[SM4_BLOCK_SIZE];
+	uint8_t in[BLOCKS * SM4_BLOCK_SIZE], out[sizeof(in)], ref[sizeof(in)];
+	size_t i;
+	int enc, outl;
+	int failed = 1;
+
+	arc4random_buf(key, sizeof(key));
+	arc4random_buf(iv, sizeof(iv));
+	arc4random_buf(in, sizeof(in));
+
+	if ((ctx = EVP_CIPHER_CTX_new()) == NULL)
+		err(1, NULL);
+
+	for (enc = 0; enc <= 1; enc++) {
+		if (!EVP_CipherInit_ex(ctx, c, NULL, key, iv, enc) ||
+		    !EVP_CIPHER_CTX_set_padding(ctx, 0))
+			errx(1, "EVP_CipherInit_ex() failed");
+		for (i = 0; i < BLOCKS; i++) {
+			if (!EVP_CipherUpdate(ctx, &ref[i * SM4_BLOCK_SIZE],
+			    &outl, &in[i * SM4_BLOCK_SIZE], SM4_BLOCK_SIZE) ||
+			    outl != SM4_BLOCK_SIZE)
+				errx(1, "EVP_CipherUpdate() failed");
+		}
+
+		memcpy(out, in, sizeof(out));
+		if (!EVP_CipherInit_ex(ctx, NULL, NULL, NULL, iv, enc))
+			errx(1, "EVP_CipherInit_ex() failed");
+		if (!EVP_CipherUpdate(ctx, out, &outl, out, sizeof(out)) ||
+		    outl != sizeof(out))
+			errx(1, "EVP_CipherUpdate() failed");
+
+		if (memcmp(out, ref, sizeof(out)) != 0) {
+			fprintf(stderr, "FAIL: %s multi block %s mismatch\n",
+			    EVP_CIPHER_name(c), enc ? "encryption" : "decryption");
+			goto failed;
+		}
+	}
+
+	failed = 0;
+
+ failed:
+	EVP_CIPHER_CTX_free(ctx);
+
+	return failed;
+}
+
+/* This test vector comes from Appendix A.1 of RFC 8998. */
+static int
+sm4_gcm_test(void)
+{
+	EVP_AEAD_CTX ctx;
+	uint8_t out[64 + 16], pt[64];
+	size_t out_len;
+	int failed = 1;
+
+	static const uint8_t key[16] = {
+		0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef,
+		0xfe, 0xdc, 0xba, 0x98, 0x76, 0x54, 0x32, 0x10
+	};
+
+	static const uint8_t nonce[12] = {
+		0x00, 0x00, 0x12, 0x34, 0x56, 0x78, 0x00, 0x00,
+		0x00, 0x00, 0xab, 0xcd
+	};
+
+	static const uint8_t ad[20] = {
+		0xfe, 0xed, 0xfa, 0xce, 0xde, 0xad, 0xbe, 0xef,
+		0xfe, 0xed, 0xfa, 0xce, 0xde, 0xad, 0xbe, 0xef,
+		0xab, 0xad, 0xda, 0xd2
+	};
+
+	static const uint8_t input[64] = {
+		0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+		0xbb, 0xbb, 0xbb, 0xbb, 0xbb, 0xbb, 0xbb, 0xbb,
+		0xcc, 0xcc, 0xcc, 0xcc, 0xcc, 0xcc, 0xcc, 0xcc,
+		0xdd, 0xdd, 0xdd, 0xdd, 0xdd, 0xdd, 0xdd, 0xdd,
+		0xee, 0xee, 0xee, 0xee, 0xee, 0xee, 0xee, 0xee,
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+		0xee, 0xee, 0xee, 0xee, 0xee, 0xee, 0xee, 0xee,
+		0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa
+	};
+
+	/* Ciphertext followed by the tag. */
+	static const uint8_t expected[64 + 16] = {
+		0x17, 0xf3, 0x99, 0xf0, 0x8c, 0x67, 0xd5, 0xee,
+		0x19, 0xd0, 0xdc, 0x99, 0x69, 0xc4, 0xbb, 0x7d,
+		0x5f, 0xd4, 0x6f, 0xd3, 0x75, 0x64, 0x89, 0x06,
+		0x91, 0x57, 0xb2, 0x82, 0xbb, 0x20, 0x07, 0x35,
+		0xd8, 0x27, 0x10, 0xca, 0x5c, 0x22, 0xf0, 0xcc,
+		0xfa, 0x7c, 0xbf, 0x93, 0xd4, 0x96, 0xac, 0x15,
+		0xa5, 0x68, 0x34, 0xcb, 0xcf, 0x98, 0xc3, 0x97,
+		0xb4, 0x02, 0x4a, 0x26, 0x91, 0x23, 0x3b, 0x8d,
+		0x83, 0xde, 0x35, 0x41, 0xe4, 0xc2, 0xb5, 0x81,
+		0x77, 0xe0, 0x65, 0xa9, 0xbf, 0x7b, 0x62, 0xec
+	};
+
+	if (!EVP_AEAD_CTX_init(&ctx, EVP_aead_sm4_gcm(), key, sizeof(key),
+	    EVP_AEAD_DEFAULT_TAG_LENGTH, NULL))
+		errx(1, "EVP_AEAD_CTX_init() failed");
+
+	if (!EVP_AEAD_CTX_seal(&ctx, out, &out_len, sizeof(out), nonce,
+	    sizeof(nonce), input, sizeof(input), ad, sizeof(ad))) {
+		fprintf(stderr, "FAIL: EVP_AEAD_CTX_seal() failed\n");
+		goto failed;
+	}
+	if (out_len != sizeof(expected) ||
+	    memcmp(out, expected, sizeof(expected)) != 0) {
+		fprintf(stderr, "FAIL: SM4-GCM seal mismatch\n");
+		hexdump(stderr, "Got", out, out_len);
+		hexdump(stderr, "Expected", expected, sizeof(expected));
+		goto failed;
+	}
+
+	if (!EVP_AEAD_CTX_open(&ctx, pt, &out_len, sizeof(pt), nonce,
+	    sizeof(nonce), out, sizeof(out), ad, sizeof(ad))) {
+		fprintf(stderr, "FAIL: EVP_AEAD_CTX_open() failed\n");
+		goto failed;
+	}
+	if (out_len != sizeof(input) || memcmp(pt, input, sizeof(input)) != 0) {
+		fprintf(stderr, "FAIL: SM4-GCM open mismatch\n");
+		goto failed;
+	}
+
+	out[sizeof(out) - 1] ^= 1;
+	if (EVP_AEAD_CTX_open(&ctx, pt, &out_len, sizeof(pt), nonce,
+	    sizeof(nonce), out, sizeof(out), ad, sizeof(ad))) {
+		fprintf(stderr, "FAIL: SM4-GCM open with a bad tag succeeded\n");
+		goto failed;
+	}
+
+	failed = 0;
+
+ failed:
+	EVP_AEAD_CTX_cleanup(&ctx);
+
+	return failed;
+}
+
 int
 main(int argc, char *argv[])
 {
 	int i;
+	int failed = 0;
 	SM4_KEY key;
 	uint8_t block[SM4_BLOCK_SIZE];
 
@@ -104,5 +256,10 @@ main(int argc, char *argv[])
 		return 1;
 	}
 
-	return 0;
+	failed |= sm4_blocks_test(EVP_sm4_ecb());
+	failed |= sm4_blocks_test(EVP_sm4_cbc());
+	failed |= sm4_blocks_test(EVP_sm4_ctr());
+	failed |= sm4_gcm_test();
+
+	return failed;
 }
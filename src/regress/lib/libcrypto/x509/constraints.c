@@ -15,6 +15,8 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <arpa/inet.h>
+
 #include <err.h>
 #include <string.h>
 
@@ -468,6 +470,131 @@ test_constraints1(void)
 	return failure;
 }
 
+static const char nc_conf[] =
+    "permitted;DNS:openbsd.org,"
+    "permitted;DNS:.libressl.org,"
+    "excluded;DNS:bad.openbsd.org,"
+    "permitted;IP:192.168.0.0/255.255.0.0,"
+    "excluded;IP:192.168.1.0/255.255.255.0";
+
+struct nc_cache_test {
+	int type;
+	const char *name;
+	int want;
+};
+
+static const struct nc_cache_test nc_cache_tests[] = {
+	{ GEN_DNS, "www.openbsd.org", X509_V_OK },
+	{ GEN_DNS, "WWW.OpenBSD.ORG", X509_V_OK },
+	{ GEN_DNS, "openbsd.org", X509_V_OK },
+	{ GEN_DNS, "bad.openbsd.org", X509_V_ERR_EXCLUDED_VIOLATION },
+	{ GEN_DNS, "www.bad.openbsd.org", X509_V_ERR_EXCLUDED_VIOLATION },
+	{ GEN_DNS, "foo.libressl.org", X509_V_OK },
+	{ GEN_DNS, "libressl.org", X509_V_ERR_PERMITTED_VIOLATION },
+	{ GEN_DNS, "example.com", X509_V_ERR_PERMITTED_VIOLATION },
+	{ GEN_IPADD, "192.168.2.1", X509_V_OK },
+	{ GEN_IPADD, "192.168.1.5", X509_V_ERR_EXCLUDED_VIOLATION },
+	{ GEN_IPADD, "10.0.0.1", X509_V_ERR_PERMITTED_VIOLATION },
+};
+
+#define N_NC_CACHE_TESTS \
+	(sizeof(nc_cache_tests) / sizeof(nc_cache_tests[0]))
+
+/*
+ * Check that compiled name constraints give the same result as matching
+ * each extracted constraint in turn.
+ */
+static int
+test_constraints_cache(void)
+{
+	struct x509_constraints_names *names = NULL;
+	struct x509_constraints_names *permitted = NULL;
+	struct x509_constraints_names *excluded = NULL;
+	const struct x509_constraints_cache *nc;
+	struct x509_constraints_name *name;
+	X509_EXTENSION *ext = NULL;
+	X509 *cert = NULL;
+	int error, legacy_error, failure = 1;
+	size_t i;
+
+	if ((cert = X509_new()) == NULL)
+		errx(1, "X509_new");
+	if ((ext = X509V3_EXT_conf_nid(NULL, NULL, NID_name_constraints,
+	    (char *)nc_conf)) == NULL)
+		errx(1, "X509V3_EXT_conf_nid");
+	if (!X509_add_ext(cert, ext, -1))
+		errx(1, "X509_add_ext");
+	X509_check_purpose(cert, -1, 0);
+	if (cert->nc == NULL) {
+		FAIL("name constraints not decoded\n");
+		goto done;
+	}
+
+	if ((permitted = x509_constraints_names_new(16)) == NULL ||
+	    (excluded = x509_constraints_names_new(16)) == NULL)
+		errx(1, "x509_constraints_names_new");
+	if (!x509_constraints_extract_constraints(cert, permitted, excluded,
+	    &error)) {
+		FAIL("failed to extract constraints: %d\n", error);
+		goto done;
+	}
+	if ((nc = x509_constraints_cache_get(cert, &error)) == NULL) {
+		FAIL("failed to compile constraints: %d\n", error);
+		goto done;
+	}
+	if (x509_constraints_cache_get(cert, &error) != nc) {
+		FAIL("compiled constraints not kept\n");
+		goto done;
+	}
+
+	for (i = 0; i < N_NC_CACHE_TESTS; i++) {
+		if ((names = x509_constraints_names_new(1)) == NULL ||
+		    (name = x509_constraints_name_new()) == NULL)
+			errx(1, "out of memory");
+		name->type = nc_cache_tests[i].type;
+		if (name->type == GEN_DNS) {
+			if ((name->name = strdup(nc_cache_tests[i].name)) ==
+			    NULL)
+				errx(1, "strdup");
+		} else {
+			name->af = AF_INET;
+			if (inet_pton(AF_INET, nc_cache_tests[i].name,
+			    name->address) != 1)
+				errx(1, "inet_pton");
+		}
+		if (!x509_constraints_names_add(names, name))
+			errx(1, "x509_constraints_names_add");
+
+		error = legacy_error = X509_V_OK;
+		x509_constraints_check_cache(names, nc, &error);
+		x509_constraints_check(names, permitted, excluded,
+		    &legacy_error);
+		if (error != nc_cache_tests[i].want) {
+			FAIL("'%s' got %d, want %d\n", nc_cache_tests[i].name,
+			    error, nc_cache_tests[i].want);
+			goto done;
+		}
+		if (error != legacy_error) {
+			FAIL("'%s' got %d, uncompiled got %d\n",
+			    nc_cache_tests[i].name, error, legacy_error);
+			goto done;
+		}
+		x509_constraints_names_free(names);
+		names = NULL;
+	}
+
+	failure = 0;
+
+ done:
+	x509_constraints_names_free(names);
+	x509_constraints_names_free(permitted);
+	x509_constraints_names_free(excluded);
+	X509_EXTENSION_free(ext);
+	X509_free(cert);
+
+	return failure;
+}
+
 int
 main(int argc, char **argv)
 {
@@ -483,6 +610,7 @@ main(int argc, char **argv)
 	failed |= test_invalid_domain_constraints();
 	failed |= test_invalid_uri();
 	failed |= test_constraints1();
+	failed |= test_constraints_cache();
 
 	return (failed);
 }
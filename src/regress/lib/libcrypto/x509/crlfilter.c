@@ -0,0 +1,289 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <openssl/bio.h>
+#include <openssl/x509.h>
+#include <openssl/x509v3.h>
+
+#include "x509_crl_filter.h"
+
+#define N_REVOKED	1000
+#define N_GOOD		5000
+
+static long
+revoked_serial(int i)
+{
+	return 2 * i + 1;
+}
+
+static long
+good_serial(int i)
+{
+	return 2 * i + 2;
+}
+
+static X509_NAME *
+make_name(const char *cn)
+{
+	X509_NAME *name;
+
+	if ((name = X509_NAME_new()) == NULL)
+		errx(1, "X509_NAME_new");
+	if (!X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+	    (const unsigned char *)cn, -1, -1, 0))
+		errx(1, "X509_NAME_add_entry_by_txt");
+
+	return name;
+}
+
+static X509_CRL *
+make_crl(X509_NAME *issuer, time_t now)
+{
+	unsigned char *der = NULL;
+	const unsigned char *p;
+	X509_REVOKED *rev;
+	X509_CRL *crl, *ret;
+	ASN1_TIME *tm;
+	int der_len, i;
+
+	if ((crl = X509_CRL_new()) == NULL)
+		errx(1, "X509_CRL_new");
+	if (!X509_CRL_set_version(crl, 1))
+		errx(1, "X509_CRL_set_version");
+	if (!X509_CRL_set_issuer_name(crl, issuer))
+		errx(1, "X509_CRL_set_issuer_name");
+	if ((tm = ASN1_TIME_set(NULL, now)) == NULL)
+		errx(1, "ASN1_TIME_set");
+	if (!X509_CRL_set_lastUpdate(crl, tm))
+		errx(1, "X509_CRL_set_lastUpdate");
+	if (ASN1_TIME_set(tm, now + 86400) == NULL)
+		errx(1, "ASN1_TIME_set");
+	if (!X509_CRL_set_nextUpdate(crl, tm))
+		errx(1, "X509_CRL_set_nextUpdate");
+
+	for (i = 0; i < N_REVOKED; i++) {
+		if ((rev = X509_REVOKED_new()) == NULL)
+			errx(1, "X509_REVOKED_new");
+		if (!ASN1_INTEGER_set(rev->serialNumber, revoked_serial(i)))
+			errx(1, "ASN1_INTEGER_set");
+		if (!X509_REVOKED_set_revocationDate(rev, tm))
+			errx(1, "X509_REVOKED_set_revocationDate");
+		if (!X509_CRL_add0_revoked(crl, rev))
+			errx(1, "X509_CRL_add0_revoked");
+	}
+	ASN1_TIME_free(tm);
+
+	/* Decode it again, as the filter expects a parsed CRL. */
+	if ((der_len = i2d_X509_CRL(crl, &der)) <= 0)
+		errx(1, "i2d_X509_CRL");
+	p = der;
+	if ((ret = d2i_X509_CRL(NULL, &p, der_len)) == NULL)
+		errx(1, "d2i_X509_CRL");
+	X509_CRL_free(crl);
+	free(der);
+
+	return ret;
+}
+
+static X509 *
+make_cert(X509_NAME *issuer, long serial)
+{
+	X509 *x;
+
+	if ((x = X509_new()) == NULL)
+		errx(1, "X509_new");
+	if (!X509_set_issuer_name(x, issuer))
+		errx(1, "X509_set_issuer_name");
+	if (!ASN1_INTEGER_set(X509_get_serialNumber(x), serial))
+		errx(1, "ASN1_INTEGER_set");
+
+	return x;
+}
+
+static void
+write_filter(const char *file, STACK_OF(X509_CRL) *crls,
+    STACK_OF(X509) *certs, int truncate)
+{
+	BIO *bio;
+	char *data;
+	long len;
+	FILE *fp;
+
+	if ((bio = BIO_new(BIO_s_mem())) == NULL)
+		errx(1, "BIO_new");
+	if (!X509_CRL_filter_write(bio, crls, certs))
+		errx(1, "X509_CRL_filter_write");
+	len = BIO_get_mem_data(bio, &data);
+	if (truncate)
+		len--;
+	if ((fp = fopen(file, "w")) == NULL)
+		err(1, "%s", file);
+	if (fwrite(data, len, 1, fp) != 1)
+		err(1, "fwrite");
+	if (fclose(fp) != 0)
+		err(1, "fclose");
+	BIO_free(bio);
+}
+
+static int
+check_lookup(struct x509_crl_filter *filter, X509_NAME *issuer, long serial,
+    time_t now, int want)
+{
+	X509 *x;
+	int got;
+
+	x = make_cert(issuer, serial);
+	got = x509_crl_filter_lookup(filter, x, now);
+	X509_free(x);
+
+	if (got != want) {
+		fprintf(stderr, "FAIL: serial %ld: got %d, want %d\n", serial,
+		    got, want);
+		return 1;
+	}
+
+	return 0;
+}
+
+static int
+crl_filter_test(void)
+{
+	char file[] = "/tmp/crlfilter.XXXXXXXXXX";
+	struct x509_crl_filter *filter = NULL;
+	STACK_OF(X509_CRL) *crls;
+	STACK_OF(X509) *certs;
+	X509_NAME *issuer, *other;
+	X509_STORE *store = NULL;
+	X509 *x;
+	time_t now;
+	int fd, i, unknown;
+	int failed = 1;
+
+	now = time(NULL);
+	issuer = make_name("CRL Filter Test CA");
+	other = make_name("Other Test CA");
+
+	if ((crls = sk_X509_CRL_new_null()) == NULL)
+		errx(1, "sk_X509_CRL_new_null");
+	if (!sk_X509_CRL_push(crls, make_crl(issuer, now)))
+		errx(1, "sk_X509_CRL_push");
+	if ((certs = sk_X509_new_null()) == NULL)
+		errx(1, "sk_X509_new_null");
+	for (i = 0; i < N_GOOD; i++) {
+		if (!sk_X509_push(certs, make_cert(issuer, good_serial(i))))
+			errx(1, "sk_X509_push");
+	}
+	/* A revoked certificate among them must not matter. */
+	if (!sk_X509_push(certs, make_cert(issuer, revoked_serial(0))))
+		errx(1, "sk_X509_push");
+
+	if ((fd = mkstemp(file)) == -1)
+		err(1, "mkstemp");
+	close(fd);
+
+	/* Built with the unrevoked certificates, the filter is exact. */
+	write_filter(file, crls, certs, 0);
+	if ((filter = x509_crl_filter_load(file)) == NULL) {
+		fprintf(stderr, "FAIL: x509_crl_filter_load\n");
+		goto done;
+	}
+	for (i = 0; i < N_REVOKED; i++) {
+		if (check_lookup(filter, issuer, revoked_serial(i), now,
+		    X509_CRL_FILTER_REVOKED))
+			goto done;
+	}
+	for (i = 0; i < N_GOOD; i++) {
+		if (check_lookup(filter, issuer, good_serial(i), now,
+		    X509_CRL_FILTER_GOOD))
+			goto done;
+	}
+	if (check_lookup(filter, other, revoked_serial(0), now,
+	    X509_CRL_FILTER_UNKNOWN))
+		goto done;
+	if (check_lookup(filter, issuer, revoked_serial(0), now + 2 * 86400,
+	    X509_CRL_FILTER_UNKNOWN))
+		goto done;
+	x509_crl_filter_free(filter);
+	filter = NULL;
+
+	/* Without them, it only proves certificates unrevoked. */
+	write_filter(file, crls, NULL, 0);
+	if ((filter = x509_crl_filter_load(file)) == NULL) {
+		fprintf(stderr, "FAIL: x509_crl_filter_load\n");
+		goto done;
+	}
+	for (i = 0; i < N_REVOKED; i++) {
+		if (check_lookup(filter, issuer, revoked_serial(i), now,
+		    X509_CRL_FILTER_UNKNOWN))
+			goto done;
+	}
+	unknown = 0;
+	for (i = 0; i < N_GOOD; i++) {
+		x = make_cert(issuer, good_serial(i));
+		if (x509_crl_filter_lookup(filter, x, now) !=
+		    X509_CRL_FILTER_GOOD)
+			unknown++;
+		X509_free(x);
+	}
+	if (unknown > N_GOOD / 50) {
+		fprintf(stderr, "FAIL: %d of %d unrevoked serials undecided\n",
+		    unknown, N_GOOD);
+		goto done;
+	}
+
+	if ((store = X509_STORE_new()) == NULL)
+		errx(1, "X509_STORE_new");
+	if (!X509_STORE_load_crl_filter(store, file)) {
+		fprintf(stderr, "FAIL: X509_STORE_load_crl_filter\n");
+		goto done;
+	}
+
+	write_filter(file, crls, certs, 1);
+	if (X509_STORE_load_crl_filter(store, file)) {
+		fprintf(stderr, "FAIL: loaded a truncated filter\n");
+		goto done;
+	}
+
+	failed = 0;
+
+ done:
+	unlink(file);
+	x509_crl_filter_free(filter);
+	X509_STORE_free(store);
+	sk_X509_CRL_pop_free(crls, X509_CRL_free);
+	sk_X509_pop_free(certs, X509_free);
+	X509_NAME_free(issuer);
+	X509_NAME_free(other);
+
+	return failed;
+}
+
+int
+main(int argc, char **argv)
+{
+	int failed = 0;
+
+	failed |= crl_filter_test();
+
+	return failed;
+}
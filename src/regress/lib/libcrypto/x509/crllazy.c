@@ -0,0 +1,316 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/ec.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/objects.h>
+#include <openssl/x509.h>
+#include <openssl/x509v3.h>
+
+#define N_REVOKED	1000
+
+/* Serials are added out of order, every third one with a reason. */
+static long
+test_serial(int i)
+{
+	return (i * 7919L) % 100003L + 1;
+}
+
+static void
+add_revoked(X509_CRL *crl, long serial, int with_reason, time_t now)
+{
+	ASN1_ENUMERATED *reason;
+	X509_REVOKED *rev;
+	ASN1_TIME *tm;
+
+	if ((rev = X509_REVOKED_new()) == NULL)
+		errx(1, "X509_REVOKED_new");
+	if (!ASN1_INTEGER_set(rev->serialNumber, serial))
+		errx(1, "ASN1_INTEGER_set");
+	if ((tm = ASN1_TIME_set(NULL, now)) == NULL)
+		errx(1, "ASN1_TIME_set");
+	if (!X509_REVOKED_set_revocationDate(rev, tm))
+		errx(1, "X509_REVOKED_set_revocationDate");
+	ASN1_TIME_free(tm);
+	if (with_reason) {
+		if ((reason = ASN1_ENUMERATED_new()) == NULL)
+			errx(1, "ASN1_ENUMERATED_new");
+		if (!ASN1_ENUMERATED_set(reason, CRL_REASON_KEY_COMPROMISE))
+			errx(1, "ASN1_ENUMERATED_set");
+		if (!X509_REVOKED_add1_ext_i2d(rev, NID_crl_reason, reason, 0,
+		    0))
+			errx(1, "X509_REVOKED_add1_ext_i2d");
+		ASN1_ENUMERATED_free(reason);
+	}
+	if (!X509_CRL_add0_revoked(crl, rev))
+		errx(1, "X509_CRL_add0_revoked");
+}
+
+static EVP_PKEY *
+make_key(void)
+{
+	EVP_PKEY *pkey;
+	EC_KEY *ec;
+
+	if ((ec = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1)) == NULL)
+		errx(1, "EC_KEY_new_by_curve_name");
+	if (!EC_KEY_generate_key(ec))
+		errx(1, "EC_KEY_generate_key");
+	if ((pkey = EVP_PKEY_new()) == NULL)
+		errx(1, "EVP_PKEY_new");
+	if (!EVP_PKEY_assign_EC_KEY(pkey, ec))
+		errx(1, "EVP_PKEY_assign_EC_KEY");
+
+	return pkey;
+}
+
+static unsigned char *
+make_crl(EVP_PKEY *pkey, int *der_len)
+{
+	unsigned char *der = NULL;
+	X509_NAME *name;
+	X509_CRL *crl;
+	ASN1_TIME *tm;
+	time_t now;
+	int i;
+
+	now = time(NULL);
+	if ((crl = X509_CRL_new()) == NULL)
+		errx(1, "X509_CRL_new");
+	if (!X509_CRL_set_version(crl, 1))
+		errx(1, "X509_CRL_set_version");
+	if ((name = X509_NAME_new()) == NULL)
+		errx(1, "X509_NAME_new");
+	if (!X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+	    (const unsigned char *)"Lazy CRL Test CA", -1, -1, 0))
+		errx(1, "X509_NAME_add_entry_by_txt");
+	if (!X509_CRL_set_issuer_name(crl, name))
+		errx(1, "X509_CRL_set_issuer_name");
+	X509_NAME_free(name);
+	if ((tm = ASN1_TIME_set(NULL, now)) == NULL)
+		errx(1, "ASN1_TIME_set");
+	if (!X509_CRL_set_lastUpdate(crl, tm))
+		errx(1, "X509_CRL_set_lastUpdate");
+	ASN1_TIME_free(tm);
+
+	for (i = 0; i < N_REVOKED; i++)
+		add_revoked(crl, test_serial(i), i % 3 == 0, now);
+
+	if (!X509_CRL_sign(crl, pkey, EVP_sha256()))
+		errx(1, "X509_CRL_sign");
+	if ((*der_len = i2d_X509_CRL(crl, &der)) <= 0)
+		errx(1, "i2d_X509_CRL");
+	X509_CRL_free(crl);
+
+	return der;
+}
+
+static int
+check_serial(X509_CRL *crl, long serial, int want, int want_reason)
+{
+	ASN1_INTEGER *aserial;
+	X509_REVOKED *rev = NULL;
+	int ret;
+
+	if ((aserial = ASN1_INTEGER_new()) == NULL)
+		errx(1, "ASN1_INTEGER_new");
+	if (!ASN1_INTEGER_set(aserial, serial))
+		errx(1, "ASN1_INTEGER_set");
+	ret = X509_CRL_get0_by_serial(crl, &rev, aserial);
+	ASN1_INTEGER_free(aserial);
+
+	if (ret != want) {
+		fprintf(stderr, "FAIL: serial %ld: got %d, want %d\n", serial,
+		    ret, want);
+		return 1;
+	}
+	if (ret == 1 && rev->reason != want_reason) {
+		fprintf(stderr, "FAIL: serial %ld: got reason %d, want %d\n",
+		    serial, rev->reason, want_reason);
+		return 1;
+	}
+
+	return 0;
+}
+
+static int
+crl_lazy_test(void)
+{
+	unsigned char *der, *der2 = NULL;
+	const unsigned char *p;
+	X509_CRL *crl = NULL;
+	EVP_PKEY *pkey;
+	int der_len, der2_len, i;
+	int failed = 1;
+
+	pkey = make_key();
+	der = make_crl(pkey, &der_len);
+
+	p = der;
+	if ((crl = d2i_X509_CRL_lazy(NULL, &p, der_len)) == NULL) {
+		fprintf(stderr, "FAIL: d2i_X509_CRL_lazy\n");
+		goto done;
+	}
+	if (p != der + der_len) {
+		fprintf(stderr, "FAIL: d2i_X509_CRL_lazy consumed %ld of %d\n",
+		    (long)(p - der), der_len);
+		goto done;
+	}
+	if (sk_X509_REVOKED_num(X509_CRL_get_REVOKED(crl)) > 0) {
+		fprintf(stderr, "FAIL: revoked entries decoded eagerly\n");
+		goto done;
+	}
+	if (X509_CRL_verify(crl, pkey) != 1) {
+		fprintf(stderr, "FAIL: lazy CRL signature does not verify\n");
+		goto done;
+	}
+	if ((der2_len = i2d_X509_CRL(crl, &der2)) != der_len ||
+	    memcmp(der, der2, der_len) != 0) {
+		fprintf(stderr, "FAIL: lazy CRL does not encode as decoded\n");
+		goto done;
+	}
+
+	for (i = 0; i < N_REVOKED; i++) {
+		if (check_serial(crl, test_serial(i), 1, i % 3 == 0 ?
+		    CRL_REASON_KEY_COMPROMISE : CRL_REASON_NONE))
+			goto done;
+	}
+	/* Look up again, now served from the decoded entries. */
+	if (check_serial(crl, test_serial(0), 1, CRL_REASON_KEY_COMPROMISE))
+		goto done;
+	if (check_serial(crl, 0, 0, 0))
+		goto done;
+	if (check_serial(crl, 100004, 0, 0))
+		goto done;
+	if (check_serial(crl, -1, 0, 0))
+		goto done;
+
+	failed = 0;
+
+ done:
+	X509_CRL_free(crl);
+	EVP_PKEY_free(pkey);
+	free(der);
+	free(der2);
+
+	return failed;
+}
+
+static X509_CRL *
+store_crl(X509_STORE *store)
+{
+	STACK_OF(X509_OBJECT) *objs;
+	X509_OBJECT *obj;
+
+	objs = X509_STORE_get0_objects(store);
+	if (sk_X509_OBJECT_num(objs) != 1)
+		return NULL;
+	obj = sk_X509_OBJECT_value(objs, 0);
+
+	return X509_OBJECT_get0_X509_CRL(obj);
+}
+
+static int
+crl_replace_test(int indexed)
+{
+	unsigned char *der1, *der2;
+	const unsigned char *p;
+	X509_CRL *crl1 = NULL, *crl2 = NULL;
+	EVP_PKEY *pkey1, *pkey2;
+	X509_STORE *store;
+	int der1_len, der2_len;
+	int failed = 1;
+
+	pkey1 = make_key();
+	pkey2 = make_key();
+	der1 = make_crl(pkey1, &der1_len);
+	der2 = make_crl(pkey2, &der2_len);
+
+	p = der1;
+	if ((crl1 = d2i_X509_CRL_lazy(NULL, &p, der1_len)) == NULL)
+		errx(1, "d2i_X509_CRL_lazy");
+	p = der2;
+	if ((crl2 = d2i_X509_CRL_lazy(NULL, &p, der2_len)) == NULL)
+		errx(1, "d2i_X509_CRL_lazy");
+
+	if ((store = X509_STORE_new()) == NULL)
+		errx(1, "X509_STORE_new");
+	if (indexed && !X509_STORE_enable_index(store))
+		errx(1, "X509_STORE_enable_index");
+
+	if (!X509_STORE_add_crl(store, crl1))
+		errx(1, "X509_STORE_add_crl");
+	if (X509_STORE_replace_crl(store, crl1, crl2) != 1) {
+		fprintf(stderr, "FAIL: replace_crl (index %d)\n", indexed);
+		goto done;
+	}
+	if (store_crl(store) != crl2) {
+		fprintf(stderr, "FAIL: CRL not replaced (index %d)\n", indexed);
+		goto done;
+	}
+
+	/* The old CRL is no longer in the store. */
+	ERR_clear_error();
+	if (X509_STORE_replace_crl(store, crl1, crl2) != 0 ||
+	    ERR_GET_REASON(ERR_peek_error()) != X509_R_CRL_NOT_FOUND) {
+		fprintf(stderr, "FAIL: replaced a missing CRL (index %d)\n",
+		    indexed);
+		goto done;
+	}
+	/* Neither may the new one be added twice. */
+	if (X509_STORE_replace_crl(store, crl2, crl2) != 0 ||
+	    store_crl(store) != crl2) {
+		fprintf(stderr, "FAIL: replaced a CRL by itself (index %d)\n",
+		    indexed);
+		goto done;
+	}
+	ERR_clear_error();
+
+	if (check_serial(store_crl(store), test_serial(1), 1, CRL_REASON_NONE))
+		goto done;
+
+	failed = 0;
+
+ done:
+	X509_STORE_free(store);
+	X509_CRL_free(crl1);
+	X509_CRL_free(crl2);
+	EVP_PKEY_free(pkey1);
+	EVP_PKEY_free(pkey2);
+	free(der1);
+	free(der2);
+
+	return failed;
+}
+
+int
+main(int argc, char **argv)
+{
+	int failed = 0;
+
+	failed |= crl_lazy_test();
+	failed |= crl_replace_test(0);
+	failed |= crl_replace_test(1);
+
+	return failed;
+}
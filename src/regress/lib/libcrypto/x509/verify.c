@@ -17,7 +17,10 @@
  */
 
 #include <err.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <openssl/bio.h>
 #include <openssl/err.h>
@@ -26,9 +29,13 @@
 #include <openssl/x509v3.h>
 #include <openssl/x509_verify.h>
 
+#include "x509_chain_cache.h"
+#include "x509_issuer_cache.h"
+
 #define MODE_MODERN_VFY	0
 #define MODE_LEGACY_VFY 1
 #define MODE_VERIFY	2
+#define MODE_VERIFY_FIRST 3
 
 static int verbose = 1;
 
@@ -165,7 +172,8 @@ struct verify_cert_test {
 };
 
 static void
-verify_cert_new(const char *roots_file, const char *bundle_file, int *chains)
+verify_cert_new(const char *roots_file, const char *bundle_file, int *chains,
+    int mode)
 {
 	STACK_OF(X509) *roots = NULL, *bundle = NULL;
 	X509_STORE_CTX *xsc = NULL;
@@ -195,6 +203,9 @@ verify_cert_new(const char *roots_file, const char *bundle_file, int *chains)
 		errx(1, "failed to create ctx");
 	if (!x509_verify_ctx_set_intermediates(ctx, bundle))
 		errx(1, "failed to set intermediates");
+	if (mode == MODE_VERIFY_FIRST &&
+	    !x509_verify_ctx_set_max_chains(ctx, 1))
+		errx(1, "failed to set max chains");
 
 	if ((*chains = x509_verify(ctx, leaf, NULL)) == 0) {
 		fprintf(stderr, "failed to verify at %lu: %s\n",
@@ -407,11 +418,11 @@ verify_cert_test(const char *certs_path, int mode)
 			errx(1, "asprintf");
 
 		fprintf(stderr, "== Test %zu (%s)\n", i, vct->id);
-		if (mode == MODE_VERIFY)
-			verify_cert_new(roots_file, bundle_file, &chains);
+		if (mode == MODE_VERIFY || mode == MODE_VERIFY_FIRST)
+			verify_cert_new(roots_file, bundle_file, &chains, mode);
 		else
 			verify_cert(roots_file, bundle_file, &chains, mode);
-		if ((mode == 2 && chains == vct->want_chains) ||
+		if ((mode == MODE_VERIFY && chains == vct->want_chains) ||
 		    (chains == 0 && vct->want_chains == 0) ||
 		    (chains == 1 && vct->want_chains > 0)) {
 			fprintf(stderr, "INFO: Succeeded with %d chains%s\n",
@@ -433,6 +444,478 @@ verify_cert_test(const char *certs_path, int mode)
 	return failed;
 }
 
+static int
+issuer_cache_test(void)
+{
+	struct x509_issuer_cache_stats stats;
+	unsigned char parent_md[EVP_MAX_MD_SIZE], child_md[EVP_MAX_MD_SIZE];
+	int failed = 0;
+	int i;
+
+	/* The modern verifier runs should have found earlier results. */
+	x509_issuer_cache_stats(&stats);
+	fprintf(stderr, "INFO: issuer cache %llu hits, %llu misses, "
+	    "%zu entries\n", (unsigned long long)stats.hits,
+	    (unsigned long long)stats.misses, stats.entries);
+	if (stats.hits == 0 || stats.misses == 0 || stats.entries == 0) {
+		fprintf(stderr, "FAIL: issuer cache was not used\n");
+		failed |= 1;
+	}
+
+	arc4random_buf(parent_md, sizeof(parent_md));
+	arc4random_buf(child_md, sizeof(child_md));
+	if (x509_issuer_cache_find(parent_md, child_md) != -1) {
+		fprintf(stderr, "FAIL: found an entry that was not added\n");
+		failed |= 1;
+	}
+	x509_issuer_cache_add(parent_md, child_md, 0);
+	x509_issuer_cache_add(parent_md, child_md, 1);
+	if (x509_issuer_cache_find(parent_md, child_md) != 0) {
+		fprintf(stderr, "FAIL: cached result was not kept\n");
+		failed |= 1;
+	}
+
+	x509_issuer_cache_set_max(X509_ISSUER_CACHE_SHARDS);
+	for (i = 0; i < 1000; i++) {
+		arc4random_buf(parent_md, sizeof(parent_md));
+		x509_issuer_cache_add(parent_md, child_md, 1);
+		if (x509_issuer_cache_find(parent_md, child_md) != 1) {
+			fprintf(stderr, "FAIL: added entry was not found\n");
+			failed |= 1;
+			break;
+		}
+	}
+	x509_issuer_cache_stats(&stats);
+	if (stats.entries > X509_ISSUER_CACHE_SHARDS) {
+		fprintf(stderr, "FAIL: issuer cache holds %zu entries\n",
+		    stats.entries);
+		failed |= 1;
+	}
+
+	x509_issuer_cache_set_max(0);
+	if (x509_issuer_cache_find(parent_md, child_md) != -1) {
+		fprintf(stderr, "FAIL: disabled issuer cache found entry\n");
+		failed |= 1;
+	}
+	x509_issuer_cache_set_max(X509_ISSUER_CACHE_MAX);
+
+	return failed;
+}
+
+static int
+store_index_test(const char *certs_path)
+{
+	STACK_OF(X509) *roots = NULL, *certs = NULL;
+	X509_STORE_CTX *xsc = NULL;
+	X509_STORE *store = NULL;
+	char *roots_file = NULL;
+	X509 *root, *issuer = NULL;
+	int failed = 1;
+	int i;
+
+	if (asprintf(&roots_file, "%s/1a/roots.pem", certs_path) == -1)
+		errx(1, "asprintf");
+	if (!certs_from_file(roots_file, &roots))
+		errx(1, "failed to load roots from '%s'", roots_file);
+	if (sk_X509_num(roots) < 1)
+		errx(1, "not enough roots");
+	root = sk_X509_value(roots, 0);
+
+	if ((store = X509_STORE_new()) == NULL)
+		errx(1, "X509_STORE_new");
+	if (!X509_STORE_enable_index(store)) {
+		fprintf(stderr, "FAIL: failed to enable store index\n");
+		goto done;
+	}
+	for (i = 0; i < sk_X509_num(roots); i++) {
+		if (!X509_STORE_add_cert(store, sk_X509_value(roots, i))) {
+			fprintf(stderr, "FAIL: failed to add root %d\n", i);
+			goto done;
+		}
+	}
+	if (X509_STORE_add_cert(store, root)) {
+		fprintf(stderr, "FAIL: added duplicate root\n");
+		goto done;
+	}
+	ERR_clear_error();
+
+	if ((xsc = X509_STORE_CTX_new()) == NULL)
+		errx(1, "X509_STORE_CTX_new");
+	if (!X509_STORE_CTX_init(xsc, store, root, NULL))
+		errx(1, "failed to init store context");
+
+	if ((certs = X509_STORE_get1_certs(xsc,
+	    X509_get_subject_name(root))) == NULL) {
+		fprintf(stderr, "FAIL: root not found by subject\n");
+		goto done;
+	}
+	for (i = 0; i < sk_X509_num(certs); i++) {
+		if (X509_cmp(sk_X509_value(certs, i), root) == 0)
+			break;
+	}
+	if (i == sk_X509_num(certs)) {
+		fprintf(stderr, "FAIL: wrong certificates found by subject\n");
+		goto done;
+	}
+	if (X509_STORE_CTX_get1_issuer(&issuer, xsc, root) != 1 ||
+	    X509_cmp(issuer, root) != 0) {
+		fprintf(stderr, "FAIL: root is not its own issuer\n");
+		goto done;
+	}
+
+	failed = 0;
+
+ done:
+	sk_X509_pop_free(certs, X509_free);
+	sk_X509_pop_free(roots, X509_free);
+	X509_STORE_CTX_free(xsc);
+	X509_STORE_free(store);
+	X509_free(issuer);
+	free(roots_file);
+
+	return failed;
+}
+
+static void
+put32(unsigned char *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+/* Write certs in the format of "openssl certhash -o". */
+static void
+write_index(int fd, STACK_OF(X509) *certs, size_t truncate)
+{
+	unsigned char *buf = NULL, *der, *p;
+	size_t len, off;
+	uint32_t i, n;
+	int der_len;
+
+	n = sk_X509_num(certs);
+	off = 16 + 16 * n;
+	len = off;
+	for (i = 0; i < n; i++)
+		len += i2d_X509(sk_X509_value(certs, i), NULL);
+	if ((buf = calloc(1, len)) == NULL)
+		err(1, NULL);
+
+	memcpy(buf, "CERTINDX", 8);
+	put32(buf + 8, 1);
+	put32(buf + 12, n);
+	/* The index must be sorted by hash. */
+	for (i = 0; i < n; i++) {
+		X509 *x = sk_X509_value(certs, i);
+		uint32_t j, h = X509_subject_name_hash(x);
+
+		for (j = i; j > 0; j--) {
+			if (X509_subject_name_hash(sk_X509_value(certs,
+			    j - 1)) <= h)
+				break;
+			sk_X509_set(certs, j, sk_X509_value(certs, j - 1));
+		}
+		sk_X509_set(certs, j, x);
+	}
+	for (i = 0; i < n; i++) {
+		X509 *x = sk_X509_value(certs, i);
+
+		p = buf + 16 + 16 * i;
+		der = buf + off;
+		if ((der_len = i2d_X509(x, &der)) <= 0)
+			errx(1, "i2d_X509");
+		put32(p, X509_subject_name_hash(x));
+		put32(p + 4, X509_LU_X509);
+		put32(p + 8, off);
+		put32(p + 12, der_len);
+		off += der_len;
+	}
+
+	if (truncate != 0)
+		len = truncate;
+	if (ftruncate(fd, 0) == -1 || lseek(fd, 0, SEEK_SET) == -1 ||
+	    write(fd, buf, len) != (ssize_t)len)
+		err(1, "write");
+	free(buf);
+}
+
+static int
+index_lookup_test(const char *certs_path)
+{
+	STACK_OF(X509) *roots = NULL, *bundle = NULL;
+	char *roots_file, *bundle_file;
+	char index_file[] = "/tmp/verify-index.XXXXXXXXXX";
+	X509_STORE_CTX *xsc = NULL;
+	X509_STORE *store = NULL;
+	X509_LOOKUP *lookup;
+	X509 *leaf = NULL;
+	int failed = 1;
+	int fd;
+
+	if (asprintf(&roots_file, "%s/1a/roots.pem", certs_path) == -1)
+		errx(1, "asprintf");
+	if (asprintf(&bundle_file, "%s/1a/bundle.pem", certs_path) == -1)
+		errx(1, "asprintf");
+	if (!certs_from_file(roots_file, &roots))
+		errx(1, "failed to load roots from '%s'", roots_file);
+	if (!certs_from_file(bundle_file, &bundle))
+		errx(1, "failed to load bundle from '%s'", bundle_file);
+	if (sk_X509_num(bundle) < 1)
+		errx(1, "not enough certs in bundle");
+	leaf = sk_X509_shift(bundle);
+
+	if ((fd = mkstemp(index_file)) == -1)
+		err(1, "mkstemp");
+
+	if ((store = X509_STORE_new()) == NULL)
+		errx(1, "X509_STORE_new");
+	if ((lookup = X509_STORE_add_lookup(store,
+	    X509_LOOKUP_index())) == NULL)
+		errx(1, "X509_STORE_add_lookup");
+
+	write_index(fd, roots, 20);
+	if (X509_LOOKUP_load_index(lookup, index_file)) {
+		fprintf(stderr, "FAIL: loaded truncated index\n");
+		goto done;
+	}
+	ERR_clear_error();
+
+	write_index(fd, roots, 0);
+	if (!X509_LOOKUP_load_index(lookup, index_file)) {
+		fprintf(stderr, "FAIL: failed to load index\n");
+		goto done;
+	}
+	if (sk_X509_OBJECT_num(X509_STORE_get0_objects(store)) != 0) {
+		fprintf(stderr, "FAIL: index decoded eagerly\n");
+		goto done;
+	}
+
+	if ((xsc = X509_STORE_CTX_new()) == NULL)
+		errx(1, "X509_STORE_CTX_new");
+	if (!X509_STORE_CTX_init(xsc, store, leaf, bundle))
+		errx(1, "failed to init store context");
+	/*
+	 * The modern verifier only considers roots already in the store,
+	 * while the legacy one asks the lookup methods.
+	 */
+	X509_VERIFY_PARAM_set_flags(xsc->param, X509_V_FLAG_LEGACY_VERIFY);
+	if (X509_verify_cert(xsc) != 1) {
+		fprintf(stderr, "FAIL: failed to verify with index: %s\n",
+		    X509_verify_cert_error_string(
+		    X509_STORE_CTX_get_error(xsc)));
+		goto done;
+	}
+
+	failed = 0;
+
+ done:
+	unlink(index_file);
+	close(fd);
+	sk_X509_pop_free(roots, X509_free);
+	sk_X509_pop_free(bundle, X509_free);
+	X509_STORE_CTX_free(xsc);
+	X509_STORE_free(store);
+	X509_free(leaf);
+	free(roots_file);
+	free(bundle_file);
+
+	return failed;
+}
+
+static int
+verify_cache_verify(X509_STORE *store, X509 *leaf, STACK_OF(X509) *bundle)
+{
+	X509_STORE_CTX *xsc;
+	int ret;
+
+	if ((xsc = X509_STORE_CTX_new()) == NULL)
+		errx(1, "X509_STORE_CTX_new");
+	if (!X509_STORE_CTX_init(xsc, store, leaf, bundle))
+		errx(1, "failed to init store context");
+	if ((ret = X509_verify_cert(xsc)) != 1)
+		fprintf(stderr, "verify failed: %s\n",
+		    X509_verify_cert_error_string(
+		    X509_STORE_CTX_get_error(xsc)));
+	else if (sk_X509_num(X509_STORE_CTX_get0_chain(xsc)) < 2) {
+		fprintf(stderr, "verify returned a short chain\n");
+		ret = 0;
+	}
+	X509_STORE_CTX_free(xsc);
+
+	return ret == 1;
+}
+
+static int
+verify_cache_test(const char *certs_path)
+{
+	STACK_OF(X509) *roots = NULL, *other_roots = NULL, *bundle = NULL;
+	char *roots_file, *other_roots_file, *bundle_file;
+	X509_STORE *store = NULL;
+	X509 *leaf = NULL;
+	int failed = 1;
+	int added, i;
+
+	if (asprintf(&roots_file, "%s/1a/roots.pem", certs_path) == -1)
+		errx(1, "asprintf");
+	if (asprintf(&other_roots_file, "%s/2a/roots.pem", certs_path) == -1)
+		errx(1, "asprintf");
+	if (asprintf(&bundle_file, "%s/1a/bundle.pem", certs_path) == -1)
+		errx(1, "asprintf");
+	if (!certs_from_file(roots_file, &roots))
+		errx(1, "failed to load roots from '%s'", roots_file);
+	if (!certs_from_file(other_roots_file, &other_roots))
+		errx(1, "failed to load roots from '%s'", other_roots_file);
+	if (!certs_from_file(bundle_file, &bundle))
+		errx(1, "failed to load bundle from '%s'", bundle_file);
+	if (sk_X509_num(bundle) < 1)
+		errx(1, "not enough certs in bundle");
+	leaf = sk_X509_shift(bundle);
+
+	if ((store = X509_STORE_new()) == NULL)
+		errx(1, "X509_STORE_new");
+	for (i = 0; i < sk_X509_num(roots); i++) {
+		if (!X509_STORE_add_cert(store, sk_X509_value(roots, i)))
+			errx(1, "failed to add root %d", i);
+	}
+	if (!X509_STORE_enable_verify_cache(store, 16)) {
+		fprintf(stderr, "FAIL: failed to enable verify cache\n");
+		goto done;
+	}
+
+	if (!verify_cache_verify(store, leaf, bundle)) {
+		fprintf(stderr, "FAIL: first verification failed\n");
+		goto done;
+	}
+	if (store->verify_cache->hits != 0 ||
+	    store->verify_cache->count != 1) {
+		fprintf(stderr, "FAIL: verification not cached\n");
+		goto done;
+	}
+	if (!verify_cache_verify(store, leaf, bundle)) {
+		fprintf(stderr, "FAIL: cached verification failed\n");
+		goto done;
+	}
+	if (store->verify_cache->hits != 1) {
+		fprintf(stderr, "FAIL: cached verification not used\n");
+		goto done;
+	}
+
+	/* Changing the store must drop the cached result. */
+	for (i = 0, added = 0; i < sk_X509_num(other_roots); i++) {
+		if (X509_STORE_add_cert(store, sk_X509_value(other_roots, i)))
+			added++;
+	}
+	ERR_clear_error();
+	if (added == 0)
+		errx(1, "failed to add other roots");
+	if (store->verify_cache->count != 0) {
+		fprintf(stderr, "FAIL: cache not invalidated\n");
+		goto done;
+	}
+	if (!verify_cache_verify(store, leaf, bundle)) {
+		fprintf(stderr, "FAIL: verification after add failed\n");
+		goto done;
+	}
+	if (store->verify_cache->hits != 1) {
+		fprintf(stderr, "FAIL: stale cached verification used\n");
+		goto done;
+	}
+
+	failed = 0;
+
+ done:
+	sk_X509_pop_free(roots, X509_free);
+	sk_X509_pop_free(other_roots, X509_free);
+	sk_X509_pop_free(bundle, X509_free);
+	X509_STORE_free(store);
+	X509_free(leaf);
+	free(roots_file);
+	free(other_roots_file);
+	free(bundle_file);
+
+	return failed;
+}
+
+/*
+ * A context reused with X509_STORE_CTX_reinit() keeps its parameters
+ * allocated, but must not carry them over to the next verification.
+ */
+static int
+reinit_test(const char *certs_path)
+{
+	STACK_OF(X509) *roots = NULL, *bundle = NULL;
+	char *roots_file, *bundle_file;
+	X509_STORE_CTX *xsc = NULL;
+	X509_VERIFY_PARAM *param;
+	X509_STORE *store = NULL;
+	X509 *leaf = NULL;
+	int failed = 1;
+	int i;
+
+	if (asprintf(&roots_file, "%s/1a/roots.pem", certs_path) == -1)
+		errx(1, "asprintf");
+	if (asprintf(&bundle_file, "%s/1a/bundle.pem", certs_path) == -1)
+		errx(1, "asprintf");
+	if (!certs_from_file(roots_file, &roots))
+		errx(1, "failed to load roots from '%s'", roots_file);
+	if (!certs_from_file(bundle_file, &bundle))
+		errx(1, "failed to load bundle from '%s'", bundle_file);
+	if (sk_X509_num(bundle) < 1)
+		errx(1, "not enough certs in bundle");
+	leaf = sk_X509_shift(bundle);
+
+	if ((store = X509_STORE_new()) == NULL)
+		errx(1, "X509_STORE_new");
+	for (i = 0; i < sk_X509_num(roots); i++) {
+		if (!X509_STORE_add_cert(store, sk_X509_value(roots, i)))
+			errx(1, "failed to add root %d", i);
+	}
+
+	if ((xsc = X509_STORE_CTX_new()) == NULL)
+		errx(1, "X509_STORE_CTX_new");
+	if (!X509_STORE_CTX_reinit(xsc, store, leaf, bundle))
+		errx(1, "failed to reinit store context");
+	param = X509_STORE_CTX_get0_param(xsc);
+	if (!X509_VERIFY_PARAM_set1_host(param, "mismatch.invalid", 0))
+		errx(1, "X509_VERIFY_PARAM_set1_host");
+	if (X509_verify_cert(xsc) == 1) {
+		fprintf(stderr, "FAIL: verified with mismatched host\n");
+		goto done;
+	}
+	X509_STORE_CTX_reset(xsc);
+	if (X509_STORE_CTX_get0_chain(xsc) != NULL) {
+		fprintf(stderr, "FAIL: chain kept after reset\n");
+		goto done;
+	}
+
+	if (!X509_STORE_CTX_reinit(xsc, store, leaf, bundle))
+		errx(1, "failed to reinit store context");
+	if (X509_STORE_CTX_get0_param(xsc) != param) {
+		fprintf(stderr, "FAIL: parameters not reused\n");
+		goto done;
+	}
+	if (X509_verify_cert(xsc) != 1) {
+		fprintf(stderr, "FAIL: failed to verify after reinit: %s\n",
+		    X509_verify_cert_error_string(
+		    X509_STORE_CTX_get_error(xsc)));
+		goto done;
+	}
+
+	failed = 0;
+
+ done:
+	sk_X509_pop_free(roots, X509_free);
+	sk_X509_pop_free(bundle, X509_free);
+	X509_STORE_CTX_free(xsc);
+	X509_STORE_free(store);
+	X509_free(leaf);
+	free(roots_file);
+	free(bundle_file);
+
+	return failed;
+}
+
 int
 main(int argc, char **argv)
 {
@@ -449,6 +932,18 @@ main(int argc, char **argv)
 	failed |= verify_cert_test(argv[1], MODE_MODERN_VFY);
 	fprintf(stderr, "\n\nTesting x509_verify\n");
 	failed |= verify_cert_test(argv[1], MODE_VERIFY);
+	fprintf(stderr, "\n\nTesting x509_verify with a single chain\n");
+	failed |= verify_cert_test(argv[1], MODE_VERIFY_FIRST);
+	fprintf(stderr, "\n\nTesting x509_issuer_cache\n");
+	failed |= issuer_cache_test();
+	fprintf(stderr, "\n\nTesting X509_STORE index\n");
+	failed |= store_index_test(argv[1]);
+	fprintf(stderr, "\n\nTesting X509_LOOKUP_index\n");
+	failed |= index_lookup_test(argv[1]);
+	fprintf(stderr, "\n\nTesting X509_STORE verify cache\n");
+	failed |= verify_cache_test(argv[1]);
+	fprintf(stderr, "\n\nTesting X509_STORE_CTX_reinit\n");
+	failed |= reinit_test(argv[1]);
 
 	return (failed);
 }
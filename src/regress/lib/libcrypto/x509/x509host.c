@@ -0,0 +1,169 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/x509.h>
+#include <openssl/x509v3.h>
+
+static const char *san_names[] = {
+	"www.Example.COM",
+	"*.example.net",
+	"f*.example.org",
+	"*o.example.org",
+	"*.com",
+	"xn--bcher-kva.example",
+	NULL,
+};
+
+struct host_test {
+	const char *host;
+	unsigned int flags;
+	int want;
+	const char *peername;
+};
+
+static const struct host_test san_tests[] = {
+	{ "www.example.com", 0, 1, "www.Example.COM" },
+	{ "WWW.EXAMPLE.COM", 0, 1, "www.Example.COM" },
+	{ "example.com", 0, 0, NULL },
+	{ "a.example.net", 0, 1, "*.example.net" },
+	{ "A-1.Example.Net", 0, 1, "*.example.net" },
+	{ "a.b.example.net", 0, 0, NULL },
+	{ "a.b.example.net", X509_CHECK_FLAG_MULTI_LABEL_WILDCARDS, 1,
+	    "*.example.net" },
+	{ "example.net", 0, 0, NULL },
+	{ "a_b.example.net", 0, 0, NULL },
+	{ "a.example.net", X509_CHECK_FLAG_NO_WILDCARDS, 0, NULL },
+	{ "foo.example.org", 0, 1, "f*.example.org" },
+	{ "foo.example.org", X509_CHECK_FLAG_NO_PARTIAL_WILDCARDS, 0, NULL },
+	{ "bo.example.org", 0, 1, "*o.example.org" },
+	{ "xn--fo.example.org", 0, 0, NULL },
+	{ "x.com", 0, 0, NULL },
+	{ "xn--bcher-kva.example", 0, 1, "xn--bcher-kva.example" },
+	{ ".example.net", 0, 1, "*.example.net" },
+	{ "cn.example.com", 0, 0, NULL },
+	{ "cn.example.com", X509_CHECK_FLAG_ALWAYS_CHECK_SUBJECT, 1,
+	    "cn.example.com" },
+	{ "cn.example.com", X509_CHECK_FLAG_ALWAYS_CHECK_SUBJECT |
+	    X509_CHECK_FLAG_NEVER_CHECK_SUBJECT, 0, NULL },
+};
+
+#define N_SAN_TESTS (sizeof(san_tests) / sizeof(san_tests[0]))
+
+static const struct host_test cn_tests[] = {
+	{ "cn.example.com", 0, 1, "cn.example.com" },
+	{ "CN.example.com", 0, 1, "cn.example.com" },
+	{ "cn.example.com", X509_CHECK_FLAG_NEVER_CHECK_SUBJECT, 0, NULL },
+	{ "www.example.com", 0, 0, NULL },
+};
+
+#define N_CN_TESTS (sizeof(cn_tests) / sizeof(cn_tests[0]))
+
+static X509 *
+make_cert(const char **names)
+{
+	GENERAL_NAMES *gens;
+	GENERAL_NAME *gen;
+	ASN1_IA5STRING *ia5;
+	X509_NAME *subject;
+	X509 *x;
+	int i;
+
+	if ((x = X509_new()) == NULL)
+		errx(1, "X509_new");
+	subject = X509_get_subject_name(x);
+	if (!X509_NAME_add_entry_by_txt(subject, "CN", MBSTRING_ASC,
+	    (const unsigned char *)"cn.example.com", -1, -1, 0))
+		errx(1, "X509_NAME_add_entry_by_txt");
+
+	if (names == NULL)
+		return x;
+
+	if ((gens = GENERAL_NAMES_new()) == NULL)
+		errx(1, "GENERAL_NAMES_new");
+	for (i = 0; names[i] != NULL; i++) {
+		if ((gen = GENERAL_NAME_new()) == NULL)
+			errx(1, "GENERAL_NAME_new");
+		if ((ia5 = ASN1_IA5STRING_new()) == NULL)
+			errx(1, "ASN1_IA5STRING_new");
+		if (!ASN1_STRING_set(ia5, names[i], -1))
+			errx(1, "ASN1_STRING_set");
+		GENERAL_NAME_set0_value(gen, GEN_DNS, ia5);
+		if (!sk_GENERAL_NAME_push(gens, gen))
+			errx(1, "sk_GENERAL_NAME_push");
+	}
+	if (!X509_add1_ext_i2d(x, NID_subject_alt_name, gens, 0, 0))
+		errx(1, "X509_add1_ext_i2d");
+	GENERAL_NAMES_free(gens);
+
+	return x;
+}
+
+static int
+run_host_tests(X509 *x, const struct host_test *tests, size_t ntests)
+{
+	const struct host_test *ht;
+	char *peername;
+	size_t i;
+	int pass, ret, failed = 0;
+
+	/* The second pass is answered from the compiled names. */
+	for (pass = 0; pass < 2; pass++) {
+		for (i = 0; i < ntests; i++) {
+			ht = &tests[i];
+			peername = NULL;
+			ret = X509_check_host(x, ht->host, 0, ht->flags,
+			    &peername);
+			if (ret != ht->want) {
+				fprintf(stderr, "FAIL: %s (flags %x): got %d, "
+				    "want %d\n", ht->host, ht->flags, ret,
+				    ht->want);
+				failed = 1;
+			} else if (ret == 1 &&
+			    strcmp(peername, ht->peername) != 0) {
+				fprintf(stderr, "FAIL: %s (flags %x): got "
+				    "peername %s, want %s\n", ht->host,
+				    ht->flags, peername, ht->peername);
+				failed = 1;
+			}
+			free(peername);
+		}
+	}
+
+	return failed;
+}
+
+int
+main(int argc, char **argv)
+{
+	X509 *x;
+	int failed = 0;
+
+	x = make_cert(san_names);
+	failed |= run_host_tests(x, san_tests, N_SAN_TESTS);
+	X509_free(x);
+
+	x = make_cert(NULL);
+	failed |= run_host_tests(x, cn_tests, N_CN_TESTS);
+	X509_free(x);
+
+	return failed;
+}
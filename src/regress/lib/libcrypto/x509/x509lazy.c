@@ -0,0 +1,303 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/ec.h>
+#include <openssl/evp.h>
+#include <openssl/objects.h>
+#include <openssl/x509.h>
+#include <openssl/x509v3.h>
+
+/* DER of the subjectKeyIdentifier OID, 2.5.29.14. */
+static const unsigned char skid_oid[] = { 0x06, 0x03, 0x55, 0x1d, 0x0e };
+
+static EVP_PKEY *
+make_key(void)
+{
+	EVP_PKEY *pkey;
+	EC_KEY *ec;
+
+	if ((ec = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1)) == NULL)
+		errx(1, "EC_KEY_new_by_curve_name");
+	if (!EC_KEY_generate_key(ec))
+		errx(1, "EC_KEY_generate_key");
+	if ((pkey = EVP_PKEY_new()) == NULL)
+		errx(1, "EVP_PKEY_new");
+	if (!EVP_PKEY_assign_EC_KEY(pkey, ec))
+		errx(1, "EVP_PKEY_assign_EC_KEY");
+
+	return pkey;
+}
+
+static void
+add_ext(X509 *x, int nid, const char *value)
+{
+	X509_EXTENSION *ext;
+	X509V3_CTX ctx;
+
+	X509V3_set_ctx(&ctx, x, x, NULL, NULL, 0);
+	if ((ext = X509V3_EXT_conf_nid(NULL, &ctx, nid, (char *)value)) == NULL)
+		errx(1, "X509V3_EXT_conf_nid");
+	if (!X509_add_ext(x, ext, -1))
+		errx(1, "X509_add_ext");
+	X509_EXTENSION_free(ext);
+}
+
+static unsigned char *
+make_cert(EVP_PKEY *pkey, int with_extensions, int *der_len)
+{
+	unsigned char *der = NULL;
+	X509_NAME *name;
+	X509 *x;
+
+	if ((x = X509_new()) == NULL)
+		errx(1, "X509_new");
+	if (!X509_set_version(x, with_extensions ? 2 : 0))
+		errx(1, "X509_set_version");
+	if (!ASN1_INTEGER_set(X509_get_serialNumber(x), 1))
+		errx(1, "ASN1_INTEGER_set");
+	if ((name = X509_NAME_new()) == NULL)
+		errx(1, "X509_NAME_new");
+	if (!X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+	    (const unsigned char *)"Lazy Certificate Test CA", -1, -1, 0))
+		errx(1, "X509_NAME_add_entry_by_txt");
+	if (!X509_set_subject_name(x, name))
+		errx(1, "X509_set_subject_name");
+	if (!X509_set_issuer_name(x, name))
+		errx(1, "X509_set_issuer_name");
+	X509_NAME_free(name);
+	if (X509_gmtime_adj(X509_get_notBefore(x), 0) == NULL)
+		errx(1, "X509_gmtime_adj");
+	if (X509_gmtime_adj(X509_get_notAfter(x), 3600) == NULL)
+		errx(1, "X509_gmtime_adj");
+	if (!X509_set_pubkey(x, pkey))
+		errx(1, "X509_set_pubkey");
+
+	if (with_extensions) {
+		add_ext(x, NID_basic_constraints, "critical,CA:TRUE");
+		add_ext(x, NID_subject_key_identifier, "hash");
+		add_ext(x, NID_subject_alt_name, "DNS:lazy.example.com");
+	}
+
+	if (!X509_sign(x, pkey, EVP_sha256()))
+		errx(1, "X509_sign");
+	if ((*der_len = i2d_X509(x, &der)) <= 0)
+		errx(1, "i2d_X509");
+	X509_free(x);
+
+	return der;
+}
+
+static int
+x509_lazy_test(void)
+{
+	unsigned char *der, *der2 = NULL;
+	const unsigned char *p;
+	GENERAL_NAMES *gens = NULL;
+	GENERAL_NAME *gen;
+	X509 *x = NULL;
+	EVP_PKEY *pkey;
+	int der_len, der2_len;
+	int failed = 1;
+
+	pkey = make_key();
+	der = make_cert(pkey, 1, &der_len);
+
+	p = der;
+	if ((x = d2i_X509_lazy(NULL, &p, der_len)) == NULL) {
+		fprintf(stderr, "FAIL: d2i_X509_lazy\n");
+		goto done;
+	}
+	if (p != der + der_len) {
+		fprintf(stderr, "FAIL: d2i_X509_lazy consumed %ld of %d\n",
+		    (long)(p - der), der_len);
+		goto done;
+	}
+	if (x->lazy == NULL || x->cert_info->extensions != NULL) {
+		fprintf(stderr, "FAIL: extensions decoded eagerly\n");
+		goto done;
+	}
+	if (X509_verify(x, pkey) != 1) {
+		fprintf(stderr, "FAIL: lazy certificate does not verify\n");
+		goto done;
+	}
+	if ((der2_len = i2d_X509(x, &der2)) != der_len ||
+	    memcmp(der, der2, der_len) != 0) {
+		fprintf(stderr, "FAIL: lazy certificate does not encode as "
+		    "decoded\n");
+		goto done;
+	}
+
+	if (X509_get_ext_count(x) != 3) {
+		fprintf(stderr, "FAIL: got %d extensions, want 3\n",
+		    X509_get_ext_count(x));
+		goto done;
+	}
+	if (X509_check_ca(x) != 1) {
+		fprintf(stderr, "FAIL: lazy certificate is not a CA\n");
+		goto done;
+	}
+	if ((gens = X509_get_ext_d2i(x, NID_subject_alt_name, NULL,
+	    NULL)) == NULL || sk_GENERAL_NAME_num(gens) != 1) {
+		fprintf(stderr, "FAIL: subjectAltName not found\n");
+		goto done;
+	}
+	gen = sk_GENERAL_NAME_value(gens, 0);
+	if (gen->type != GEN_DNS || ASN1_STRING_length(gen->d.dNSName) != 16 ||
+	    memcmp(ASN1_STRING_data(gen->d.dNSName), "lazy.example.com",
+	    16) != 0) {
+		fprintf(stderr, "FAIL: wrong subjectAltName\n");
+		goto done;
+	}
+
+	failed = 0;
+
+ done:
+	GENERAL_NAMES_free(gens);
+	X509_free(x);
+	EVP_PKEY_free(pkey);
+	free(der);
+	free(der2);
+
+	return failed;
+}
+
+/* Re-signing a lazy certificate must keep its extensions. */
+static int
+x509_lazy_sign_test(void)
+{
+	unsigned char *der, *der2 = NULL;
+	const unsigned char *p;
+	X509 *x = NULL, *x2 = NULL;
+	EVP_PKEY *pkey;
+	int der_len, der2_len;
+	int failed = 1;
+
+	pkey = make_key();
+	der = make_cert(pkey, 1, &der_len);
+
+	p = der;
+	if ((x = d2i_X509_lazy(NULL, &p, der_len)) == NULL) {
+		fprintf(stderr, "FAIL: d2i_X509_lazy\n");
+		goto done;
+	}
+	if (!ASN1_INTEGER_set(X509_get_serialNumber(x), 2))
+		errx(1, "ASN1_INTEGER_set");
+	if (!X509_sign(x, pkey, EVP_sha256())) {
+		fprintf(stderr, "FAIL: X509_sign\n");
+		goto done;
+	}
+	if ((der2_len = i2d_X509(x, &der2)) <= 0)
+		errx(1, "i2d_X509");
+	p = der2;
+	if ((x2 = d2i_X509(NULL, &p, der2_len)) == NULL) {
+		fprintf(stderr, "FAIL: d2i_X509 of re-signed certificate\n");
+		goto done;
+	}
+	if (X509_get_ext_count(x2) != 3) {
+		fprintf(stderr, "FAIL: re-signed certificate has %d "
+		    "extensions, want 3\n", X509_get_ext_count(x2));
+		goto done;
+	}
+	if (ASN1_INTEGER_get(X509_get_serialNumber(x2)) != 2) {
+		fprintf(stderr, "FAIL: re-signed certificate has wrong "
+		    "serial\n");
+		goto done;
+	}
+
+	failed = 0;
+
+ done:
+	X509_free(x);
+	X509_free(x2);
+	EVP_PKEY_free(pkey);
+	free(der);
+	free(der2);
+
+	return failed;
+}
+
+static int
+x509_lazy_fallback_test(void)
+{
+	unsigned char *der;
+	const unsigned char *p;
+	X509 *x = NULL;
+	EVP_PKEY *pkey;
+	int der_len, i;
+	int failed = 1;
+
+	pkey = make_key();
+
+	/* Without extensions there is nothing to defer. */
+	der = make_cert(pkey, 0, &der_len);
+	p = der;
+	if ((x = d2i_X509_lazy(NULL, &p, der_len)) == NULL) {
+		fprintf(stderr, "FAIL: d2i_X509_lazy without extensions\n");
+		goto done;
+	}
+	if (x->lazy != NULL || X509_get_ext_count(x) != 0) {
+		fprintf(stderr, "FAIL: certificate without extensions\n");
+		goto done;
+	}
+	X509_free(x);
+	x = NULL;
+	free(der);
+
+	/* A malformed extension must be rejected up front, as by d2i_X509. */
+	der = make_cert(pkey, 1, &der_len);
+	for (i = 0; i + (int)sizeof(skid_oid) < der_len; i++) {
+		if (memcmp(der + i, skid_oid, sizeof(skid_oid)) == 0)
+			break;
+	}
+	if (i + (int)sizeof(skid_oid) >= der_len ||
+	    der[i + sizeof(skid_oid)] != V_ASN1_OCTET_STRING)
+		errx(1, "subjectKeyIdentifier not found");
+	der[i + sizeof(skid_oid)] = V_ASN1_UTF8STRING;
+
+	p = der;
+	if ((x = d2i_X509_lazy(NULL, &p, der_len)) != NULL) {
+		fprintf(stderr, "FAIL: d2i_X509_lazy accepted a malformed "
+		    "extension\n");
+		goto done;
+	}
+
+	failed = 0;
+
+ done:
+	X509_free(x);
+	EVP_PKEY_free(pkey);
+	free(der);
+
+	return failed;
+}
+
+int
+main(int argc, char **argv)
+{
+	int failed = 0;
+
+	failed |= x509_lazy_test();
+	failed |= x509_lazy_sign_test();
+	failed |= x509_lazy_fallback_test();
+
+	return failed;
+}
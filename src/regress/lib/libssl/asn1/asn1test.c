@@ -371,8 +371,9 @@ session_cmp(SSL_SESSION *s1, SSL_SESSION *s2)
 static int
 do_ssl_asn1_test(int test_no, struct ssl_asn1_test *sat)
 {
-	SSL_SESSION *sp = NULL;
-	unsigned char *ap, *asn1 = NULL;
+	SSL_SESSION *sp = NULL, *csp = NULL;
+	unsigned char *ap, *asn1 = NULL, *compact = NULL;
+	size_t clen, compact_len;
 	const unsigned char *pp;
 	int i, len, rv = 1;
 
@@ -440,12 +441,43 @@ do_ssl_asn1_test(int test_no, struct ssl_asn1_test *sat)
 		goto failed;
 	}
 
+	/* The compact encoding must be smaller and decode to the same. */
+	if (!SSL_SESSION_to_compact(&sat->session, &compact, &compact_len)) {
+		fprintf(stderr, "FAIL: test %i - compact encoding failed\n",
+		    test_no);
+		goto failed;
+	}
+	if (compact_len >= (size_t)len) {
+		fprintf(stderr, "FAIL: test %i - compact encoding is %zu "
+		    "bytes, ASN1 is %i\n", test_no, compact_len, len);
+		goto failed;
+	}
+	for (clen = 0; clen < compact_len; clen++) {
+		if ((csp = SSL_SESSION_from_compact(compact, clen)) != NULL) {
+			fprintf(stderr, "FAIL: test %i - truncated compact "
+			    "encoding decoded\n", test_no);
+			goto failed;
+		}
+	}
+	if ((csp = SSL_SESSION_from_compact(compact, compact_len)) == NULL) {
+		fprintf(stderr, "FAIL: test %i - compact decoding failed\n",
+		    test_no);
+		goto failed;
+	}
+	if (session_cmp(csp, &sat->session) != 0) {
+		fprintf(stderr, "FAIL: test %i - compact decoding differs\n",
+		    test_no);
+		goto failed;
+	}
+
 	rv = 0;
 
  failed:
 	ERR_print_errors_fp(stderr);
 	SSL_SESSION_free(sp);
+	SSL_SESSION_free(csp);
 	free(asn1);
+	free(compact);
 
 	return (rv);
 }
@@ -0,0 +1,586 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Handshake benchmark.
+ *
+ * The client and the server run in this process on one core, connected by
+ * memory BIOs, so that a handshake is only the work done by libssl and
+ * libcrypto. Each call to SSL_connect() or SSL_accept() produces the next
+ * flight of the handshake and is timed as a phase of its own, along with
+ * the allocations it makes, when libcrypto counts them.
+ */
+
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <openssl/bio.h>
+#include <openssl/bn.h>
+#include <openssl/crypto.h>
+#include <openssl/ec.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/obj_mac.h>
+#include <openssl/rsa.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+#define BENCH_MAX_PHASES	16
+
+enum bench_mode {
+	BENCH_FULL,
+	BENCH_RESUMED,
+	BENCH_HRR,
+};
+
+struct bench_key {
+	const char *name;
+	int type;
+	EVP_PKEY *pkey;
+	X509 *cert;
+};
+
+/*
+ * There is no key type for Ed25519 certificates in libssl, so only RSA and
+ * ECDSA keys are benchmarked.
+ */
+static struct bench_key bench_keys[] = {
+	{ "rsa-2048", EVP_PKEY_RSA },
+	{ "p-256", EVP_PKEY_EC },
+};
+#define N_BENCH_KEYS (sizeof(bench_keys) / sizeof(bench_keys[0]))
+
+static const char *bench_groups[] = {
+	"X25519", "P-256", "P-384",
+};
+#define N_BENCH_GROUPS (sizeof(bench_groups) / sizeof(bench_groups[0]))
+
+struct bench_phase {
+	const char *name;
+	uint64_t ns;
+	uint64_t allocations;
+};
+
+struct bench_result {
+	struct bench_phase phases[BENCH_MAX_PHASES];
+	int nphases;
+	int server_hellos;
+};
+
+static int bench_accounting;
+static int bench_handshakes = 200;
+
+static uint64_t
+bench_now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static uint64_t
+bench_allocations(void)
+{
+	CRYPTO_MEM_COUNTS counts;
+	uint64_t allocations = 0;
+	int i;
+
+	if (!bench_accounting)
+		return 0;
+
+	for (i = 0; i < CRYPTO_MEM_SUBSYSTEMS; i++) {
+		if (CRYPTO_mem_get_counts(i, &counts))
+			allocations += counts.allocations;
+	}
+
+	return allocations;
+}
+
+static int
+bench_key_generate(struct bench_key *key)
+{
+	X509_NAME *name;
+	EC_KEY *ec_key = NULL;
+	RSA *rsa = NULL;
+	BIGNUM *e = NULL;
+	int ret = 0;
+
+	if ((key->pkey = EVP_PKEY_new()) == NULL)
+		goto err;
+
+	switch (key->type) {
+	case EVP_PKEY_RSA:
+		if ((e = BN_new()) == NULL || !BN_set_word(e, RSA_F4))
+			goto err;
+		if ((rsa = RSA_new()) == NULL)
+			goto err;
+		if (!RSA_generate_key_ex(rsa, 2048, e, NULL))
+			goto err;
+		if (!EVP_PKEY_assign_RSA(key->pkey, rsa))
+			goto err;
+		rsa = NULL;
+		break;
+	case EVP_PKEY_EC:
+		if ((ec_key = EC_KEY_new_by_curve_name(
+		    NID_X9_62_prime256v1)) == NULL)
+			goto err;
+		EC_KEY_set_asn1_flag(ec_key, OPENSSL_EC_NAMED_CURVE);
+		if (!EC_KEY_generate_key(ec_key))
+			goto err;
+		if (!EVP_PKEY_assign_EC_KEY(key->pkey, ec_key))
+			goto err;
+		ec_key = NULL;
+		break;
+	default:
+		goto err;
+	}
+
+	if ((key->cert = X509_new()) == NULL)
+		goto err;
+	if (!X509_set_version(key->cert, 2))
+		goto err;
+	if (!ASN1_INTEGER_set(X509_get_serialNumber(key->cert), 1))
+		goto err;
+	if (X509_gmtime_adj(X509_get_notBefore(key->cert), 0) == NULL)
+		goto err;
+	if (X509_gmtime_adj(X509_get_notAfter(key->cert), 86400) == NULL)
+		goto err;
+	if ((name = X509_get_subject_name(key->cert)) == NULL)
+		goto err;
+	if (!X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+	    (const unsigned char *)"handshake bench", -1, -1, 0))
+		goto err;
+	if (!X509_set_issuer_name(key->cert, name))
+		goto err;
+	if (!X509_set_pubkey(key->cert, key->pkey))
+		goto err;
+	if (!X509_sign(key->cert, key->pkey, EVP_sha256()))
+		goto err;
+
+	ret = 1;
+
+ err:
+	BN_free(e);
+	RSA_free(rsa);
+	EC_KEY_free(ec_key);
+
+	return ret;
+}
+
+static void
+bench_key_free(struct bench_key *key)
+{
+	EVP_PKEY_free(key->pkey);
+	X509_free(key->cert);
+	key->pkey = NULL;
+	key->cert = NULL;
+}
+
+static SSL_CTX *
+ssl_ctx_new(uint16_t version, const char *groups, struct bench_key *key)
+{
+	SSL_CTX *ctx;
+
+	if ((ctx = SSL_CTX_new(TLS_method())) == NULL) {
+		fprintf(stderr, "SSL_CTX_new failed\n");
+		goto err;
+	}
+	if (!SSL_CTX_set_min_proto_version(ctx, version) ||
+	    !SSL_CTX_set_max_proto_version(ctx, version)) {
+		fprintf(stderr, "failed to set protocol version\n");
+		goto err;
+	}
+	if (!SSL_CTX_set1_groups_list(ctx, groups)) {
+		fprintf(stderr, "failed to set groups to %s\n", groups);
+		goto err;
+	}
+
+	if (key != NULL) {
+		if (!SSL_CTX_use_certificate(ctx, key->cert)) {
+			fprintf(stderr, "use_certificate failed\n");
+			goto err;
+		}
+		if (!SSL_CTX_use_PrivateKey(ctx, key->pkey)) {
+			fprintf(stderr, "use_PrivateKey failed\n");
+			goto err;
+		}
+	}
+
+	return ctx;
+
+ err:
+	ERR_print_errors_fp(stderr);
+	SSL_CTX_free(ctx);
+	return NULL;
+}
+
+/* Connect client and server via a pair of "nonblocking" memory BIOs. */
+static int
+connect_peers(SSL *client_ssl, SSL *server_ssl)
+{
+	BIO *client_wbio = NULL, *server_wbio = NULL;
+	int ret = 0;
+
+	if ((client_wbio = BIO_new(BIO_s_mem())) == NULL)
+		goto err;
+	if ((server_wbio = BIO_new(BIO_s_mem())) == NULL)
+		goto err;
+	if (BIO_set_mem_eof_return(client_wbio, -1) <= 0)
+		goto err;
+	if (BIO_set_mem_eof_return(server_wbio, -1) <= 0)
+		goto err;
+
+	/* Avoid double free. SSL_set_bio() takes ownership of the BIOs. */
+	BIO_up_ref(client_wbio);
+	BIO_up_ref(server_wbio);
+
+	SSL_set_bio(client_ssl, server_wbio, client_wbio);
+	SSL_set_bio(server_ssl, client_wbio, server_wbio);
+	client_wbio = NULL;
+	server_wbio = NULL;
+
+	ret = 1;
+
+ err:
+	BIO_free(client_wbio);
+	BIO_free(server_wbio);
+
+	return ret;
+}
+
+static struct bench_phase *
+bench_phase(struct bench_result *result, const char *name)
+{
+	struct bench_phase *phase;
+
+	if (result->nphases >= BENCH_MAX_PHASES)
+		return NULL;
+
+	phase = &result->phases[result->nphases++];
+	phase->name = name;
+	phase->ns = bench_now();
+	phase->allocations = bench_allocations();
+
+	return phase;
+}
+
+static void
+bench_phase_end(struct bench_phase *phase)
+{
+	phase->ns = bench_now() - phase->ns;
+	phase->allocations = bench_allocations() - phase->allocations;
+}
+
+/* Run one flight of the handshake as a phase of its own. */
+static int
+bench_step(SSL *ssl, int *ret, int (*func)(SSL *), const char *name,
+    struct bench_result *result)
+{
+	struct bench_phase *phase;
+	int ssl_err = 0;
+
+	if (*ret == 1)
+		return 1;
+
+	if ((phase = bench_phase(result, name)) == NULL) {
+		fprintf(stderr, "FAIL: too many handshake flights\n");
+		return 0;
+	}
+	do {
+		if ((*ret = func(ssl)) <= 0)
+			ssl_err = SSL_get_error(ssl, *ret);
+	} while (*ret <= 0 && ssl_err == SSL_ERROR_WANT_WRITE);
+	bench_phase_end(phase);
+
+	if (*ret <= 0 && ssl_err != SSL_ERROR_WANT_READ) {
+		fprintf(stderr, "FAIL: %s failed\n", name);
+		ERR_print_errors_fp(stderr);
+		return 0;
+	}
+
+	return 1;
+}
+
+static void
+bench_trace_cb(const SSL *ssl, int event, int value, size_t len,
+    const struct timespec *ts, void *arg)
+{
+	struct bench_result *result = arg;
+
+	if (event == SSL_TRACE_MESSAGE_RECEIVED &&
+	    value == SSL3_MT_SERVER_HELLO)
+		result->server_hellos++;
+}
+
+static const char *bench_phase_names[] = {
+	"client 1", "server 1", "client 2", "server 2",
+	"client 3", "server 3", "client 4", "server 4",
+};
+#define N_BENCH_PHASE_NAMES \
+    (sizeof(bench_phase_names) / sizeof(bench_phase_names[0]))
+
+static int
+bench_handshake(SSL_CTX *client_ctx, SSL_CTX *server_ctx,
+    SSL_SESSION *session, SSL_SESSION **out_session,
+    struct bench_result *result)
+{
+	SSL *client_ssl = NULL, *server_ssl = NULL;
+	struct bench_phase *phase;
+	int client_ret = 0, server_ret = 0;
+	size_t flight = 0;
+	int failed = 1;
+
+	memset(result, 0, sizeof(*result));
+
+	phase = bench_phase(result, "setup");
+	if ((client_ssl = SSL_new(client_ctx)) == NULL)
+		goto failure;
+	if ((server_ssl = SSL_new(server_ctx)) == NULL)
+		goto failure;
+	if (!connect_peers(client_ssl, server_ssl))
+		goto failure;
+	if (session != NULL && !SSL_set_session(client_ssl, session))
+		goto failure;
+	bench_phase_end(phase);
+
+	SSL_set_handshake_trace_callback(client_ssl, bench_trace_cb, result);
+
+	while (client_ret <= 0 || server_ret <= 0) {
+		if (flight + 2 > N_BENCH_PHASE_NAMES) {
+			fprintf(stderr, "FAIL: handshake did not complete\n");
+			goto failure;
+		}
+		if (!bench_step(client_ssl, &client_ret, SSL_connect,
+		    bench_phase_names[flight++], result))
+			goto failure;
+		if (!bench_step(server_ssl, &server_ret, SSL_accept,
+		    bench_phase_names[flight++], result))
+			goto failure;
+	}
+
+	if (session != NULL && !SSL_session_reused(client_ssl)) {
+		fprintf(stderr, "FAIL: session was not resumed\n");
+		goto failure;
+	}
+	if (out_session != NULL &&
+	    (*out_session = SSL_get1_session(client_ssl)) == NULL)
+		goto failure;
+
+	phase = bench_phase(result, "free");
+	SSL_free(client_ssl);
+	SSL_free(server_ssl);
+	client_ssl = NULL;
+	server_ssl = NULL;
+	bench_phase_end(phase);
+
+	failed = 0;
+
+ failure:
+	SSL_free(client_ssl);
+	SSL_free(server_ssl);
+
+	return failed;
+}
+
+static void
+bench_print_phase(const char *name, double ns, double allocations)
+{
+	printf("\t%-10s %10.1f us", name, ns / 1000);
+	if (bench_accounting)
+		printf(" %8.1f allocations\n", allocations);
+	else
+		printf("        - allocations\n");
+}
+
+static int
+bench_run(uint16_t version, struct bench_key *key, const char *group,
+    enum bench_mode mode)
+{
+	SSL_CTX *client_ctx = NULL, *server_ctx = NULL;
+	SSL_SESSION *session = NULL;
+	struct bench_result result, total;
+	const char *client_groups = group;
+	char *hrr_groups = NULL;
+	uint64_t ns = 0, server_ns = 0, allocations = 0;
+	const char *mode_name = "unknown", *version_name;
+	int i, j, failed = 1;
+
+	version_name = version == TLS1_3_VERSION ? "TLSv1.3" : "TLSv1.2";
+
+	switch (mode) {
+	case BENCH_FULL:
+		mode_name = "full";
+		break;
+	case BENCH_RESUMED:
+		mode_name = "resumed";
+		break;
+	case BENCH_HRR:
+		/*
+		 * The client only sends a key share for its first group, so
+		 * preferring another group than the only one that the server
+		 * accepts makes the server ask for a new ClientHello.
+		 */
+		mode_name = "hrr";
+		if (asprintf(&hrr_groups, "%s:%s", strcmp(group,
+		    bench_groups[0]) == 0 ? bench_groups[1] : bench_groups[0],
+		    group) == -1)
+			goto failure;
+		client_groups = hrr_groups;
+		break;
+	default:
+		goto failure;
+	}
+
+	if ((client_ctx = ssl_ctx_new(version, client_groups, NULL)) == NULL)
+		goto failure;
+	if ((server_ctx = ssl_ctx_new(version, group, key)) == NULL)
+		goto failure;
+
+	if (mode == BENCH_RESUMED) {
+		if (bench_handshake(client_ctx, server_ctx, NULL, &session,
+		    &result))
+			goto failure;
+	}
+
+	memset(&total, 0, sizeof(total));
+	for (i = 0; i < bench_handshakes; i++) {
+		if (bench_handshake(client_ctx, server_ctx, session, NULL,
+		    &result))
+			goto failure;
+		if (mode == BENCH_HRR && result.server_hellos != 2) {
+			fprintf(stderr, "FAIL: no HelloRetryRequest\n");
+			goto failure;
+		}
+		if (i > 0 && result.nphases != total.nphases) {
+			fprintf(stderr, "FAIL: handshake flights changed\n");
+			goto failure;
+		}
+		total.nphases = result.nphases;
+		for (j = 0; j < result.nphases; j++) {
+			total.phases[j].name = result.phases[j].name;
+			total.phases[j].ns += result.phases[j].ns;
+			total.phases[j].allocations +=
+			    result.phases[j].allocations;
+		}
+	}
+
+	for (j = 0; j < total.nphases; j++) {
+		ns += total.phases[j].ns;
+		allocations += total.phases[j].allocations;
+		if (strncmp(total.phases[j].name, "server", 6) == 0)
+			server_ns += total.phases[j].ns;
+	}
+	if (ns == 0 || server_ns == 0)
+		goto failure;
+
+	printf("%s %s %s %s: %.1f handshakes/s, %.1f server handshakes/s\n",
+	    version_name, key->name, group, mode_name,
+	    1e9 * bench_handshakes / ns, 1e9 * bench_handshakes / server_ns);
+	for (j = 0; j < total.nphases; j++) {
+		bench_print_phase(total.phases[j].name,
+		    (double)total.phases[j].ns / bench_handshakes,
+		    (double)total.phases[j].allocations / bench_handshakes);
+	}
+	bench_print_phase("total", (double)ns / bench_handshakes,
+	    (double)allocations / bench_handshakes);
+
+	failed = 0;
+
+ failure:
+	if (failed)
+		fprintf(stderr, "FAIL: %s %s %s %s\n", version_name,
+		    key->name, group, mode_name);
+	SSL_SESSION_free(session);
+	SSL_CTX_free(client_ctx);
+	SSL_CTX_free(server_ctx);
+	free(hrr_groups);
+
+	return failed;
+}
+
+static void __dead
+usage(void)
+{
+	fprintf(stderr, "usage: handshake_bench [-q] [-n handshakes]\n");
+	exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *errstr;
+	size_t i, j;
+	int ch, failed = 0;
+
+	while ((ch = getopt(argc, argv, "n:q")) != -1) {
+		switch (ch) {
+		case 'n':
+			bench_handshakes = strtonum(optarg, 1, 1000000,
+			    &errstr);
+			if (errstr != NULL)
+				errx(1, "handshakes is %s: %s", errstr,
+				    optarg);
+			break;
+		case 'q':
+			bench_handshakes = 2;
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc != 0)
+		usage();
+
+	bench_accounting = CRYPTO_mem_accounting(1);
+
+	for (i = 0; i < N_BENCH_KEYS; i++) {
+		if (!bench_key_generate(&bench_keys[i])) {
+			ERR_print_errors_fp(stderr);
+			errx(1, "failed to generate %s key",
+			    bench_keys[i].name);
+		}
+	}
+
+	for (i = 0; i < N_BENCH_KEYS; i++) {
+		for (j = 0; j < N_BENCH_GROUPS; j++) {
+			failed |= bench_run(TLS1_2_VERSION, &bench_keys[i],
+			    bench_groups[j], BENCH_FULL);
+			failed |= bench_run(TLS1_2_VERSION, &bench_keys[i],
+			    bench_groups[j], BENCH_RESUMED);
+			failed |= bench_run(TLS1_3_VERSION, &bench_keys[i],
+			    bench_groups[j], BENCH_FULL);
+			failed |= bench_run(TLS1_3_VERSION, &bench_keys[i],
+			    bench_groups[j], BENCH_HRR);
+		}
+	}
+
+	for (i = 0; i < N_BENCH_KEYS; i++)
+		bench_key_free(&bench_keys[i]);
+
+	CRYPTO_mem_accounting(0);
+
+	return failed;
+}
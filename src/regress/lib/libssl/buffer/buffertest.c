@@ -97,6 +97,114 @@ struct extend_test extend_tests[] = {
 
 #define N_EXTEND_TESTS (sizeof(extend_tests) / sizeof(extend_tests[0]))
 
+struct pool_state {
+	int gets;
+	int puts;
+	size_t outstanding;
+};
+
+static uint8_t *
+pool_get_cb(size_t len, size_t *out_len, void *cb_arg)
+{
+	struct pool_state *ps = cb_arg;
+	uint8_t *buf;
+
+	/* Hand out buffers in size classes, like the SSL_CTX pool. */
+	*out_len = len <= 8 ? 8 : 64;
+	if (len > *out_len)
+		*out_len = len;
+	if ((buf = calloc(1, *out_len)) == NULL)
+		err(1, NULL);
+
+	ps->gets++;
+	ps->outstanding += *out_len;
+
+	return buf;
+}
+
+static void
+pool_put_cb(uint8_t *buf, size_t len, void *cb_arg)
+{
+	struct pool_state *ps = cb_arg;
+
+	if (buf == NULL)
+		return;
+
+	ps->puts++;
+	ps->outstanding -= len;
+
+	free(buf);
+}
+
+static int
+pool_test(void)
+{
+	struct tls13_buffer *buf;
+	struct pool_state ps;
+	struct read_state rs;
+	uint8_t *data;
+	size_t data_len;
+	CBS cbs;
+
+	memset(&ps, 0, sizeof(ps));
+
+	rs.buf = testdata;
+	rs.len = sizeof(testdata);
+	rs.offset = 0;
+
+	if ((buf = tls13_buffer_new_pool(0, pool_get_cb, pool_put_cb,
+	    &ps)) == NULL)
+		errx(1, "tls13_buffer_new_pool");
+	if (ps.gets != 0) {
+		fprintf(stderr, "FAIL: empty pooled buffer allocated\n");
+		return 1;
+	}
+
+	/* Growing within a size class does not take another buffer. */
+	if (tls13_buffer_extend(buf, 4, read_cb, &rs) != 4)
+		errx(1, "tls13_buffer_extend");
+	if (tls13_buffer_extend(buf, 8, read_cb, &rs) != 8)
+		errx(1, "tls13_buffer_extend");
+	if (ps.gets != 1) {
+		fprintf(stderr, "FAIL: got %d buffers, want 1\n", ps.gets);
+		return 1;
+	}
+
+	/* Growing past it moves the data to a buffer of the next class. */
+	if (tls13_buffer_extend(buf, 16, read_cb, &rs) != 16)
+		errx(1, "tls13_buffer_extend");
+	if (ps.gets != 2 || ps.puts != 1) {
+		fprintf(stderr, "FAIL: got %d and put %d buffers, "
+		    "want 2 and 1\n", ps.gets, ps.puts);
+		return 1;
+	}
+
+	tls13_buffer_cbs(buf, &cbs);
+	if (!CBS_mem_equal(&cbs, testdata, sizeof(testdata))) {
+		fprintf(stderr, "FAIL: pooled buffer mismatch\n");
+		return 1;
+	}
+	if (!tls13_buffer_finish(buf, &data, &data_len)) {
+		fprintf(stderr, "FAIL: failed to finish\n");
+		return 1;
+	}
+	if (data_len != sizeof(testdata) ||
+	    memcmp(data, testdata, data_len) != 0) {
+		fprintf(stderr, "FAIL: pooled data mismatch\n");
+		return 1;
+	}
+
+	tls13_buffer_free(buf);
+
+	if (ps.outstanding != 0) {
+		fprintf(stderr, "FAIL: %zu bytes not returned to the pool\n",
+		    ps.outstanding);
+		return 1;
+	}
+
+	return 0;
+}
+
 int
 main(int argc, char **argv)
 {
@@ -139,8 +247,6 @@ main(int argc, char **argv)
 		return 1;
 	}
 
-	tls13_buffer_free(buf);
-
 	if (data_len != sizeof(testdata)) {
 		fprintf(stderr, "FAIL: got data length %zu, want %zu\n",
 		    data_len, sizeof(testdata));
@@ -150,7 +256,8 @@ main(int argc, char **argv)
 		fprintf(stderr, "FAIL: data mismatch\n");
 		return 1;
 	}
-	free(data);
 
-	return 0;
+	tls13_buffer_free(buf);
+
+	return pool_test();
 }
@@ -63,10 +63,14 @@ test_skip(void)
 static int
 test_get_u(void)
 {
-	static const uint8_t kData[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+	static const uint8_t kData[] = {
+		1, 2, 3, 4, 5, 6, 7, 8, 9, 10,
+		11, 12, 13, 14, 15, 16, 17, 18,
+	};
 	uint8_t u8;
 	uint16_t u16;
 	uint32_t u32;
+	uint64_t u64;
 	CBS data;
 
 	CBS_init(&data, kData, sizeof(kData));
@@ -79,6 +83,8 @@ test_get_u(void)
 	CHECK(u32 == 0x40506);
 	CHECK(CBS_get_u32(&data, &u32));
 	CHECK(u32 == 0x708090a);
+	CHECK(CBS_get_u64(&data, &u64));
+	CHECK(u64 == 0x0b0c0d0e0f101112ULL);
 	CHECK(!CBS_get_u8(&data, &u8));
 
 	return 1;
@@ -268,7 +274,10 @@ test_get_optional_asn1_bool(void)
 static int
 test_cbb_basic(void)
 {
-	static const uint8_t kExpected[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12};
+	static const uint8_t kExpected[] = {
+		1, 2, 3, 4, 5, 6, 7, 8, 9, 10,
+		11, 12, 13, 14, 15, 16, 17, 18, 19, 20,
+	};
 	uint8_t *buf = NULL;
 	size_t buf_len;
 	int ret = 0;
@@ -283,7 +292,8 @@ test_cbb_basic(void)
 	CHECK_GOTO(CBB_add_u16(&cbb, 0x203));
 	CHECK_GOTO(CBB_add_u24(&cbb, 0x40506));
 	CHECK_GOTO(CBB_add_u32(&cbb, 0x708090a));
-	CHECK_GOTO(CBB_add_bytes(&cbb, (const uint8_t*) "\x0b\x0c", 2));
+	CHECK_GOTO(CBB_add_u64(&cbb, 0x0b0c0d0e0f101112ULL));
+	CHECK_GOTO(CBB_add_bytes(&cbb, (const uint8_t*) "\x13\x14", 2));
 	CHECK_GOTO(CBB_finish(&cbb, &buf, &buf_len));
 
 	ret = (buf_len == sizeof(kExpected)
@@ -365,6 +375,59 @@ err:
 	return ret;
 }
 
+static int
+test_cbb_arena(void)
+{
+	static const uint8_t kExpected[] = {0x01, 0x00, 0x02, 0x03};
+	CBB_ARENA arena;
+	CBB cbb, child;
+	uint8_t *out_buf, *first_buf;
+	size_t out_size, i;
+	int ret = 0;
+
+	memset(&arena, 0, sizeof(arena));
+
+	CHECK(CBB_init_arena(&cbb, &arena, 0));
+	CHECK_GOTO(CBB_add_u8(&cbb, 1));
+	CHECK_GOTO(CBB_add_u8_length_prefixed(&cbb, &child));
+	CHECK_GOTO(CBB_add_u8(&child, 2));
+	CHECK_GOTO(CBB_finish(&cbb, &out_buf, &out_size));
+	CHECK_GOTO(out_size == 3 && out_buf[0] == 1 && out_buf[1] == 1 &&
+	    out_buf[2] == 2);
+	first_buf = out_buf;
+
+	/* The buffer is reused, without an allocation if it is large enough. */
+	CHECK_GOTO(CBB_init_arena(&cbb, &arena, 0));
+	CHECK_GOTO(CBB_add_u8(&cbb, 1));
+	CHECK_GOTO(CBB_add_u8(&cbb, 0));
+	CHECK_GOTO(CBB_add_u16(&cbb, 0x0203));
+	CHECK_GOTO(CBB_finish(&cbb, &out_buf, &out_size));
+	CHECK_GOTO(out_buf == first_buf);
+	CHECK_GOTO(out_size == sizeof(kExpected) &&
+	    memcmp(out_buf, kExpected, sizeof(kExpected)) == 0);
+
+	/* It grows when needed and keeps its larger size. */
+	CHECK_GOTO(CBB_init_arena(&cbb, &arena, 0));
+	for (i = 0; i < 1000; i++)
+		CHECK_GOTO(CBB_add_u8(&cbb, i & 0xff));
+	CHECK_GOTO(CBB_finish(&cbb, &out_buf, &out_size));
+	CHECK_GOTO(out_size == 1000 && out_buf[999] == (999 & 0xff));
+	first_buf = out_buf;
+
+	CHECK_GOTO(CBB_init_arena(&cbb, &arena, 0));
+	for (i = 0; i < 1000; i++)
+		CHECK_GOTO(CBB_add_u8(&cbb, 0));
+	CBB_cleanup(&cbb);
+	CHECK_GOTO(arena.base.buf == first_buf);
+
+	ret = 1;
+
+ err:
+	CBB_arena_cleanup(&arena);
+
+	return ret;
+}
+
 static int
 test_cbb_finish_child(void)
 {
@@ -898,6 +961,7 @@ main(void)
 	failed |= !test_cbb_basic();
 	failed |= !test_cbb_add_space();
 	failed |= !test_cbb_fixed();
+	failed |= !test_cbb_arena();
 	failed |= !test_cbb_finish_child();
 	failed |= !test_cbb_discard_child();
 	failed |= !test_cbb_misuse();
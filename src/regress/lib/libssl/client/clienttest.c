@@ -725,6 +725,192 @@ client_hello_test(int testno, const struct client_hello_test *cht)
 	return (ret);
 }
 
+static const uint8_t alpn_protos[] = {
+	0x02, 'h', '2',
+	0x08, 'h', 't', 't', 'p', '/', '1', '.', '1',
+};
+
+static int
+client_hello_parse_check(const uint8_t *buf, size_t len)
+{
+	SSL_CLIENT_HELLO ch;
+	const char *servername = "www.example.com";
+	size_t i;
+
+	if (SSL_client_hello_parse(buf, len, &ch) != 1) {
+		fprintf(stderr, "FAIL: failed to parse ClientHello\n");
+		return 0;
+	}
+	if (ch.legacy_version != TLS1_2_VERSION) {
+		fprintf(stderr, "FAIL: got legacy version %04x\n",
+		    ch.legacy_version);
+		return 0;
+	}
+	if (ch.version != TLS1_3_VERSION) {
+		fprintf(stderr, "FAIL: got version %04x\n", ch.version);
+		return 0;
+	}
+	if (ch.servername_len != strlen(servername) ||
+	    memcmp(ch.servername, servername, ch.servername_len) != 0) {
+		fprintf(stderr, "FAIL: got wrong server name\n");
+		return 0;
+	}
+	if (ch.alpn_len != sizeof(alpn_protos) ||
+	    memcmp(ch.alpn, alpn_protos, ch.alpn_len) != 0) {
+		fprintf(stderr, "FAIL: got wrong ALPN protocols\n");
+		return 0;
+	}
+	if (ch.num_key_share_groups != 1 || ch.key_share_groups[0] != 0x001d) {
+		fprintf(stderr, "FAIL: got wrong key share groups\n");
+		return 0;
+	}
+	if (ch.cipher_suites_len < 2 || ch.cipher_suites[0] != 0x13) {
+		fprintf(stderr, "FAIL: got wrong cipher suites\n");
+		return 0;
+	}
+	if (ch.supported_groups_len != 8) {
+		fprintf(stderr, "FAIL: got wrong supported groups\n");
+		return 0;
+	}
+	if (ch.random < buf || ch.random + SSL3_RANDOM_SIZE > buf + len ||
+	    ch.extensions + ch.extensions_len != buf + len) {
+		fprintf(stderr, "FAIL: results do not point into the input\n");
+		return 0;
+	}
+
+	for (i = 0; i < len; i++) {
+		if (SSL_client_hello_parse(buf, i, &ch) != -1) {
+			fprintf(stderr, "FAIL: parsed truncated ClientHello "
+			    "of length %zu\n", i);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int
+client_hello_parse_test(void)
+{
+	BIO *rbio = NULL, *wbio = NULL;
+	SSL_CTX *ssl_ctx = NULL;
+	SSL *ssl = NULL;
+	SSL_CLIENT_HELLO ch;
+	uint8_t *buf = NULL;
+	char *wbuf, rbuf[1];
+	size_t record_len;
+	int ret = 1;
+	long len;
+
+	fprintf(stderr, "Test - SSL_client_hello_parse\n");
+
+	if ((rbio = BIO_new_mem_buf(rbuf, sizeof(rbuf))) == NULL) {
+		fprintf(stderr, "Failed to setup rbio\n");
+		goto failure;
+	}
+	if ((wbio = BIO_new(BIO_s_mem())) == NULL) {
+		fprintf(stderr, "Failed to setup wbio\n");
+		goto failure;
+	}
+	if ((ssl_ctx = SSL_CTX_new(TLS_client_method())) == NULL) {
+		fprintf(stderr, "SSL_CTX_new() returned NULL\n");
+		goto failure;
+	}
+	if ((ssl = SSL_new(ssl_ctx)) == NULL) {
+		fprintf(stderr, "SSL_new() returned NULL\n");
+		goto failure;
+	}
+	if (!SSL_set_tlsext_host_name(ssl, "www.example.com")) {
+		fprintf(stderr, "Failed to set server name\n");
+		goto failure;
+	}
+	if (SSL_set_alpn_protos(ssl, alpn_protos, sizeof(alpn_protos)) != 0) {
+		fprintf(stderr, "Failed to set ALPN protocols\n");
+		goto failure;
+	}
+
+	rbio->references = 2;
+	wbio->references = 2;
+
+	SSL_set_bio(ssl, rbio, wbio);
+
+	if (SSL_connect(ssl) != 0) {
+		fprintf(stderr, "SSL_connect() returned non-zero\n");
+		goto failure;
+	}
+
+	if ((len = BIO_get_mem_data(wbio, &wbuf)) <= SSL3_RT_HEADER_LENGTH) {
+		fprintf(stderr, "FAIL: no ClientHello written\n");
+		goto failure;
+	}
+	record_len = (uint8_t)wbuf[3] << 8 | (uint8_t)wbuf[4];
+	if (record_len > (size_t)len - SSL3_RT_HEADER_LENGTH) {
+		fprintf(stderr, "FAIL: short ClientHello record\n");
+		goto failure;
+	}
+	len = SSL3_RT_HEADER_LENGTH + record_len;
+	if ((buf = malloc(len)) == NULL)
+		err(1, NULL);
+	memcpy(buf, wbuf, len);
+
+	/* As a record and as a handshake message. */
+	if (!client_hello_parse_check(buf, len))
+		goto failure;
+	if (!client_hello_parse_check(buf + SSL3_RT_HEADER_LENGTH,
+	    len - SSL3_RT_HEADER_LENGTH))
+		goto failure;
+
+	/* A record that does not hold all of the ClientHello. */
+	record_len = len - SSL3_RT_HEADER_LENGTH - 1;
+	buf[3] = record_len >> 8;
+	buf[4] = record_len & 0xff;
+	if (SSL_client_hello_parse(buf, len - 1, &ch) != 0) {
+		fprintf(stderr, "FAIL: parsed fragmented ClientHello\n");
+		goto failure;
+	}
+	record_len++;
+	buf[3] = record_len >> 8;
+	buf[4] = record_len & 0xff;
+
+	/* Not a ClientHello. */
+	buf[SSL3_RT_HEADER_LENGTH] = SSL3_MT_SERVER_HELLO;
+	if (SSL_client_hello_parse(buf, len, &ch) != 0) {
+		fprintf(stderr, "FAIL: parsed ServerHello\n");
+		goto failure;
+	}
+
+	/* The fixed TLSv1.3 ClientHello, which has no server name. */
+	if (SSL_client_hello_parse(client_hello_tls13,
+	    sizeof(client_hello_tls13), &ch) != 1) {
+		fprintf(stderr, "FAIL: failed to parse TLSv1.3 ClientHello\n");
+		goto failure;
+	}
+	if (ch.servername != NULL || ch.alpn != NULL ||
+	    ch.version != TLS1_3_VERSION ||
+	    ch.cipher_suites_len != sizeof(cipher_list_tls13_aes)) {
+		fprintf(stderr, "FAIL: wrong TLSv1.3 ClientHello fields\n");
+		goto failure;
+	}
+
+	ret = 0;
+
+ failure:
+	SSL_CTX_free(ssl_ctx);
+	SSL_free(ssl);
+
+	if (rbio != NULL)
+		rbio->references = 1;
+	if (wbio != NULL)
+		wbio->references = 1;
+
+	BIO_free(rbio);
+	BIO_free(wbio);
+
+	free(buf);
+
+	return (ret);
+}
+
 int
 main(int argc, char **argv)
 {
@@ -736,5 +922,7 @@ main(int argc, char **argv)
 	for (i = 0; i < N_CLIENT_HELLO_TESTS; i++)
 		failed |= client_hello_test(i, &client_hello_tests[i]);
 
+	failed |= client_hello_parse_test();
+
 	return (failed);
 }
@@ -755,6 +755,8 @@ struct dtls_test {
 	struct dtls_delay server_delays[MAX_PACKET_DELAYS];
 	uint8_t client_drops[MAX_PACKET_DROPS];
 	uint8_t server_drops[MAX_PACKET_DROPS];
+	const char *client_cid;
+	const char *server_cid;
 };
 
 static const struct dtls_test dtls_tests[] = {
@@ -910,6 +912,43 @@ static const struct dtls_test dtls_tests[] = {
 		.server_delays = { { 5, 3 } },
 		.shutdown_after_accept = 1,
 	},
+	{
+		.desc = "DTLS with connection IDs",
+		.ssl_options = 0,
+		.client_cid = "client",
+		.server_cid = "server connection id",
+	},
+	{
+		.desc = "DTLS with server connection ID only",
+		.ssl_options = 0,
+		.client_cid = "",
+		.server_cid = "server",
+	},
+	{
+		.desc = "DTLS with client connection ID only",
+		.ssl_options = 0,
+		.client_cid = "client",
+		.server_cid = "",
+	},
+	{
+		.desc = "DTLS with connection IDs offered by client only",
+		.ssl_options = 0,
+		.client_cid = "client",
+	},
+	{
+		.desc = "DTLS with connection IDs, low MTU and cookies",
+		.mtu = 256,
+		.ssl_options = SSL_OP_COOKIE_EXCHANGE,
+		.client_cid = "client",
+		.server_cid = "server",
+	},
+	{
+		.desc = "DTLS with connection IDs and dropped server response",
+		.ssl_options = 0,
+		.server_drops = { 1 },
+		.client_cid = "client",
+		.server_cid = "server",
+	},
 };
 
 #define N_DTLS_TESTS (sizeof(dtls_tests) / sizeof(*dtls_tests))
@@ -949,6 +988,46 @@ dtlstest_packet_monkey(SSL *ssl, const struct dtls_delay delays[],
 	SSL_set_bio(ssl, bio, bio);
 }
 
+static int
+dtls_set_cid(SSL *ssl, const char *cid)
+{
+	if (cid == NULL)
+		return 1;
+
+	if (!SSL_set1_dtls_cid(ssl, (const unsigned char *)cid,
+	    strlen(cid))) {
+		fprintf(stderr, "FAIL: failed to set connection ID\n");
+		return 0;
+	}
+
+	return 1;
+}
+
+static int
+dtls_check_cid(SSL *ssl, const char *cid, int negotiated, const char *name)
+{
+	const unsigned char *peer_cid;
+	size_t peer_cid_len;
+
+	if (SSL_get0_dtls_peer_cid(ssl, &peer_cid, &peer_cid_len) !=
+	    negotiated) {
+		fprintf(stderr, "FAIL: %s connection ID %snegotiated\n", name,
+		    negotiated ? "not " : "");
+		return 0;
+	}
+	if (!negotiated)
+		return 1;
+
+	if (peer_cid_len != strlen(cid) ||
+	    memcmp(peer_cid, cid, peer_cid_len) != 0) {
+		fprintf(stderr, "FAIL: %s has wrong peer connection ID\n",
+		    name);
+		return 0;
+	}
+
+	return 1;
+}
+
 static int
 dtlstest(const struct dtls_test *dt)
 {
@@ -958,6 +1037,7 @@ dtlstest(const struct dtls_test *dt)
 	struct pollfd pfd[2];
 	int client_sock = -1;
 	int server_sock = -1;
+	int cid_negotiated;
 	int failed = 1;
 
 	fprintf(stderr, "\n== Testing %s... ==\n", dt->desc);
@@ -976,6 +1056,11 @@ dtlstest(const struct dtls_test *dt)
 	tls12_record_layer_set_initial_epoch(server->internal->rl,
 	    dt->initial_epoch);
 
+	if (!dtls_set_cid(client, dt->client_cid))
+		goto failure;
+	if (!dtls_set_cid(server, dt->server_cid))
+		goto failure;
+
 	if (dt->client_bbio_off)
 		SSL_set_info_callback(client, dtls_info_callback);
 	if (dt->server_bbio_off)
@@ -1005,6 +1090,12 @@ dtlstest(const struct dtls_test *dt)
 		goto failure;
 	}
 
+	cid_negotiated = dt->client_cid != NULL && dt->server_cid != NULL;
+	if (!dtls_check_cid(client, dt->server_cid, cid_negotiated, "client"))
+		goto failure;
+	if (!dtls_check_cid(server, dt->client_cid, cid_negotiated, "server"))
+		goto failure;
+
 	if (dt->write_after_accept || dt->shutdown_after_accept)
 		goto done;
 
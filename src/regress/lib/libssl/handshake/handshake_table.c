@@ -90,6 +90,7 @@ static struct child stateinfo[][TLS13_NUM_MESSAGE_TYPES] = {
 	[CLIENT_HELLO] = {
 		{SERVER_HELLO_RETRY_REQUEST, DEFAULT, 0, 0},
 		{SERVER_HELLO, WITHOUT_HRR, 0, 0},
+		{SERVER_HELLO, WITHOUT_HRR | WITH_0RTT, 0, 0},
 	},
 	[SERVER_HELLO_RETRY_REQUEST] = {
 		{CLIENT_HELLO_RETRY, DEFAULT, 0, 0},
@@ -101,8 +102,8 @@ static struct child stateinfo[][TLS13_NUM_MESSAGE_TYPES] = {
 		{SERVER_ENCRYPTED_EXTENSIONS, DEFAULT, 0, 0},
 	},
 	[SERVER_ENCRYPTED_EXTENSIONS] = {
-		{SERVER_CERTIFICATE_REQUEST, DEFAULT, 0, 0},
-		{SERVER_CERTIFICATE, WITHOUT_CR, 0, 0},
+		{SERVER_CERTIFICATE_REQUEST, DEFAULT, 0, WITH_0RTT},
+		{SERVER_CERTIFICATE, WITHOUT_CR, 0, WITH_0RTT},
 		{SERVER_FINISHED, WITH_PSK, 0, 0},
 	},
 	[SERVER_CERTIFICATE_REQUEST] = {
@@ -115,8 +116,12 @@ static struct child stateinfo[][TLS13_NUM_MESSAGE_TYPES] = {
 		{SERVER_FINISHED, DEFAULT, 0, 0},
 	},
 	[SERVER_FINISHED] = {
-		{CLIENT_FINISHED, DEFAULT, WITHOUT_CR | WITH_PSK, 0},
+		{CLIENT_FINISHED, DEFAULT, WITHOUT_CR | WITH_PSK, WITH_0RTT},
 		{CLIENT_CERTIFICATE, DEFAULT, 0, WITHOUT_CR | WITH_PSK},
+		{CLIENT_END_OF_EARLY_DATA, DEFAULT, WITH_0RTT, 0},
+	},
+	[CLIENT_END_OF_EARLY_DATA] = {
+		{CLIENT_FINISHED, DEFAULT, 0, 0},
 	},
 	[CLIENT_CERTIFICATE] = {
 		{CLIENT_FINISHED, DEFAULT, 0, 0},
@@ -197,6 +197,8 @@ main (int argc, char **argv)
 	if (tls13_derive_application_secrets(secrets,
 	    &chello_hash))
 		FAIL("derive_application_secrets worked when it shouldn't\n");
+	if (tls13_derive_resumption_secret(secrets, &chello_hash))
+		FAIL("derive_resumption_secret worked when it shouldn't\n");
 
 	if (!tls13_derive_early_secrets(secrets,
 	    secrets->zeros.data, secrets->zeros.len, &chello_hash))
@@ -217,6 +219,11 @@ main (int argc, char **argv)
 		FAIL("derive_application_secrets worked when it "
 		    "shouldn't(2)\n");
 
+	if (!tls13_derive_resumption_secret(secrets, &csfhello_hash))
+		FAIL("derive_resumption_secret failed\n");
+	if (tls13_derive_resumption_secret(secrets, &csfhello_hash))
+		FAIL("derive_resumption_secret worked when it shouldn't(2)\n");
+
 	fprintf(stderr, "extracted_early:\n");
 	compare_data(secrets->extracted_early.data, 32,
 	    expected_extracted_early, 32);
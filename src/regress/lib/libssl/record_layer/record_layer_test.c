@@ -294,6 +294,333 @@ test_seq_num_tls13(void)
 	return failed;
 }
 
+static const size_t cbc_sha256_content_lens[] = {
+	0, 1, 15, 16, 17, 31, 32, 33, 47, 48, 49, 1000, 1023, 1024, 1025,
+	4096, 16383, 16384,
+};
+
+#define N_CBC_SHA256_CONTENT_LENS \
+    (sizeof(cbc_sha256_content_lens) / sizeof(cbc_sha256_content_lens[0]))
+
+/*
+ * Records sealed with AES-CBC and HMAC-SHA256 may use the stitched cipher,
+ * but are always opened with the separate cipher and MAC. Check that each
+ * record opened is the one that was sealed.
+ */
+static int
+do_cbc_sha256_test_tls12(const EVP_CIPHER *cipher, uint16_t version)
+{
+	struct tls12_record_layer *wrl = NULL, *rrl = NULL;
+	uint8_t mac_key[SHA256_DIGEST_LENGTH], key[32], iv[16];
+	uint8_t content[SSL3_RT_MAX_PLAIN_LENGTH];
+	CBS mac_key_cbs, key_cbs, iv_cbs;
+	uint8_t *record = NULL;
+	size_t record_len, i;
+	CBS out;
+	uint8_t content_type;
+	int failed = 1;
+	CBB cbb;
+
+	memset(&cbb, 0, sizeof(cbb));
+
+	arc4random_buf(mac_key, sizeof(mac_key));
+	arc4random_buf(key, sizeof(key));
+	arc4random_buf(iv, sizeof(iv));
+	arc4random_buf(content, sizeof(content));
+
+	if ((wrl = tls12_record_layer_new()) == NULL)
+		errx(1, "tls12_record_layer_new");
+	if ((rrl = tls12_record_layer_new()) == NULL)
+		errx(1, "tls12_record_layer_new");
+
+	tls12_record_layer_set_version(wrl, version);
+	tls12_record_layer_set_version(rrl, version);
+	tls12_record_layer_set_cipher_hash(wrl, cipher, EVP_sha256(),
+	    EVP_sha256());
+	tls12_record_layer_set_cipher_hash(rrl, cipher, EVP_sha256(),
+	    EVP_sha256());
+
+	CBS_init(&mac_key_cbs, mac_key, sizeof(mac_key));
+	CBS_init(&key_cbs, key, EVP_CIPHER_key_length(cipher));
+	CBS_init(&iv_cbs, iv, sizeof(iv));
+	if (!tls12_record_layer_change_write_cipher_state(wrl, &mac_key_cbs,
+	    &key_cbs, &iv_cbs)) {
+		fprintf(stderr, "FAIL: change write cipher state\n");
+		goto failure;
+	}
+	if (!tls12_record_layer_change_read_cipher_state(rrl, &mac_key_cbs,
+	    &key_cbs, &iv_cbs)) {
+		fprintf(stderr, "FAIL: change read cipher state\n");
+		goto failure;
+	}
+
+	for (i = 0; i < N_CBC_SHA256_CONTENT_LENS; i++) {
+		if (!CBB_init(&cbb, 0))
+			errx(1, "CBB_init");
+		if (!tls12_record_layer_seal_record(wrl,
+		    SSL3_RT_APPLICATION_DATA, content,
+		    cbc_sha256_content_lens[i], &cbb)) {
+			fprintf(stderr, "FAIL: seal record of %zu bytes\n",
+			    cbc_sha256_content_lens[i]);
+			goto failure;
+		}
+		if (!CBB_finish(&cbb, &record, &record_len))
+			errx(1, "CBB_finish");
+
+		if (!tls12_record_layer_open_record(rrl, record, record_len,
+		    &content_type, &out)) {
+			fprintf(stderr, "FAIL: open record of %zu bytes\n",
+			    cbc_sha256_content_lens[i]);
+			goto failure;
+		}
+		if (content_type != SSL3_RT_APPLICATION_DATA) {
+			fprintf(stderr, "FAIL: got content type %u, want %u\n",
+			    content_type, SSL3_RT_APPLICATION_DATA);
+			goto failure;
+		}
+		if (!CBS_mem_equal(&out, content,
+		    cbc_sha256_content_lens[i])) {
+			fprintf(stderr, "FAIL: record of %zu bytes opened "
+			    "to %zu bytes\n", cbc_sha256_content_lens[i],
+			    CBS_len(&out));
+			goto failure;
+		}
+
+		free(record);
+		record = NULL;
+	}
+
+	failed = 0;
+
+ failure:
+	CBB_cleanup(&cbb);
+	tls12_record_layer_free(wrl);
+	tls12_record_layer_free(rrl);
+	free(record);
+
+	return failed;
+}
+
+static int
+test_cbc_sha256_tls12(void)
+{
+	int failed = 0;
+
+	fprintf(stderr, "Running TLSv1.2 AES-CBC-SHA256 record tests...\n");
+	failed |= do_cbc_sha256_test_tls12(EVP_aes_128_cbc(), TLS1_2_VERSION);
+	failed |= do_cbc_sha256_test_tls12(EVP_aes_256_cbc(), TLS1_2_VERSION);
+
+	fprintf(stderr, "Running DTLSv1.2 AES-CBC-SHA256 record tests...\n");
+	failed |= do_cbc_sha256_test_tls12(EVP_aes_128_cbc(), DTLS1_2_VERSION);
+	failed |= do_cbc_sha256_test_tls12(EVP_aes_256_cbc(), DTLS1_2_VERSION);
+
+	return failed;
+}
+
+/*
+ * Application data records are opened straight into the buffer passed to
+ * read when they fit, otherwise into a buffer held by the record layer.
+ * The received record itself is always read into a pooled buffer of
+ * TLS13_RECORD_MAX_LEN bytes, which is counted separately.
+ */
+struct read_tls13_wire {
+	uint8_t buf[2 * TLS13_RECORD_MAX_LEN];
+	size_t len;
+	size_t off;
+	int buf_gets;
+	int record_gets;
+};
+
+static ssize_t
+read_tls13_wire_read(void *buf, size_t n, void *arg)
+{
+	struct read_tls13_wire *wire = arg;
+
+	if (wire->off == wire->len)
+		return TLS13_IO_WANT_POLLIN;
+	if (n > wire->len - wire->off)
+		n = wire->len - wire->off;
+	memcpy(buf, &wire->buf[wire->off], n);
+	wire->off += n;
+
+	return n;
+}
+
+static ssize_t
+read_tls13_wire_write(const void *buf, size_t n, void *arg)
+{
+	struct read_tls13_wire *wire = arg;
+
+	if (n > sizeof(wire->buf) - wire->len)
+		return TLS13_IO_FAILURE;
+	memcpy(&wire->buf[wire->len], buf, n);
+	wire->len += n;
+
+	return n;
+}
+
+static uint8_t *
+read_tls13_buf_get(size_t len, size_t *out_len, void *arg)
+{
+	struct read_tls13_wire *wire = arg;
+	uint8_t *buf;
+
+	if (len == TLS13_RECORD_MAX_LEN)
+		wire->record_gets++;
+	else
+		wire->buf_gets++;
+
+	*out_len = 0;
+	if ((buf = calloc(1, len)) != NULL)
+		*out_len = len;
+
+	return buf;
+}
+
+static void
+read_tls13_buf_put(uint8_t *buf, size_t len, void *arg)
+{
+	freezero(buf, len);
+}
+
+static void
+read_tls13_alert(uint8_t alert_desc, void *arg)
+{
+}
+
+struct read_tls13_test {
+	size_t content_len;
+	size_t read_len;
+	int direct;
+};
+
+static const struct read_tls13_test read_tls13_tests[] = {
+	{ .content_len = 1, .read_len = 2, .direct = 1 },
+	{ .content_len = 1, .read_len = 1, .direct = 0 },
+	{ .content_len = 1000, .read_len = 1001, .direct = 1 },
+	{ .content_len = 1000, .read_len = 1000, .direct = 0 },
+	{ .content_len = 1000, .read_len = 100, .direct = 0 },
+	{ .content_len = 16384, .read_len = 16384, .direct = 0 },
+	{ .content_len = 16384, .read_len = 16385, .direct = 1 },
+	{ .content_len = 16384, .read_len = 32768, .direct = 1 },
+};
+
+#define N_READ_TLS13_TESTS \
+    (sizeof(read_tls13_tests) / sizeof(read_tls13_tests[0]))
+
+static int
+do_read_test_tls13(size_t test_no, const struct read_tls13_test *rt)
+{
+	struct tls13_record_layer *wrl = NULL, *rrl = NULL;
+	struct tls13_record_layer_callbacks cb = {
+		.wire_read = read_tls13_wire_read,
+		.wire_write = read_tls13_wire_write,
+		.alert_recv = read_tls13_alert,
+		.alert_sent = read_tls13_alert,
+		.buf_get = read_tls13_buf_get,
+		.buf_put = read_tls13_buf_put,
+	};
+	struct read_tls13_wire wire;
+	uint8_t content[TLS13_RECORD_MAX_PLAINTEXT_LEN];
+	uint8_t out[2 * TLS13_RECORD_MAX_PLAINTEXT_LEN];
+	uint8_t secret[SHA256_DIGEST_LENGTH];
+	struct tls13_secret traffic_key;
+	size_t out_len;
+	int failed = 1;
+	ssize_t ret;
+
+	memset(&wire, 0, sizeof(wire));
+	memset(out, 0, sizeof(out));
+
+	arc4random_buf(secret, sizeof(secret));
+	arc4random_buf(content, sizeof(content));
+	traffic_key.data = secret;
+	traffic_key.len = sizeof(secret);
+
+	if ((wrl = tls13_record_layer_new(&cb, &wire)) == NULL)
+		errx(1, "tls13_record_layer_new");
+	if ((rrl = tls13_record_layer_new(&cb, &wire)) == NULL)
+		errx(1, "tls13_record_layer_new");
+
+	tls13_record_layer_set_aead(wrl, EVP_aead_aes_128_gcm());
+	tls13_record_layer_set_aead(rrl, EVP_aead_aes_128_gcm());
+	tls13_record_layer_set_hash(wrl, EVP_sha256());
+	tls13_record_layer_set_hash(rrl, EVP_sha256());
+	if (!tls13_record_layer_set_write_traffic_key(wrl, &traffic_key))
+		errx(1, "tls13_record_layer_set_write_traffic_key");
+	if (!tls13_record_layer_set_read_traffic_key(rrl, &traffic_key))
+		errx(1, "tls13_record_layer_set_read_traffic_key");
+	tls13_record_layer_handshake_completed(wrl);
+	tls13_record_layer_handshake_completed(rrl);
+
+	if ((ret = tls13_write_application_data(wrl, content,
+	    rt->content_len)) != (ssize_t)rt->content_len) {
+		fprintf(stderr, "FAIL: Test %zu - write returned %zd\n",
+		    test_no, ret);
+		goto failure;
+	}
+
+	wire.buf_gets = 0;
+	wire.record_gets = 0;
+	for (out_len = 0; out_len < rt->content_len; out_len += ret) {
+		if ((ret = tls13_read_application_data(rrl, &out[out_len],
+		    rt->read_len)) <= 0) {
+			fprintf(stderr, "FAIL: Test %zu - read returned %zd\n",
+			    test_no, ret);
+			goto failure;
+		}
+	}
+	if (out_len != rt->content_len ||
+	    memcmp(out, content, out_len) != 0) {
+		fprintf(stderr, "FAIL: Test %zu - read content differs\n",
+		    test_no);
+		goto failure;
+	}
+	if (wire.record_gets != 1) {
+		fprintf(stderr, "FAIL: Test %zu - got %d record buffers, "
+		    "want 1\n", test_no, wire.record_gets);
+		goto failure;
+	}
+	if (rt->direct && wire.buf_gets != 0) {
+		fprintf(stderr, "FAIL: Test %zu - record not opened into the "
+		    "read buffer\n", test_no);
+		goto failure;
+	}
+	if (!rt->direct && wire.buf_gets != 1) {
+		fprintf(stderr, "FAIL: Test %zu - got %d buffers, want 1\n",
+		    test_no, wire.buf_gets);
+		goto failure;
+	}
+	if (rt->direct && rt->read_len > rt->content_len &&
+	    out[rt->content_len] != 0) {
+		fprintf(stderr, "FAIL: Test %zu - content type left in the "
+		    "read buffer\n", test_no);
+		goto failure;
+	}
+
+	failed = 0;
+
+ failure:
+	tls13_record_layer_free(wrl);
+	tls13_record_layer_free(rrl);
+
+	return failed;
+}
+
+static int
+test_read_tls13(void)
+{
+	int failed = 0;
+	size_t i;
+
+	fprintf(stderr, "Running TLSv1.3 record read tests...\n");
+
+	for (i = 0; i < N_READ_TLS13_TESTS; i++)
+		failed |= do_read_test_tls13(i, &read_tls13_tests[i]);
+
+	return failed;
+}
+
 int
 main(int argc, char **argv)
 {
@@ -301,6 +628,8 @@ main(int argc, char **argv)
 
 	failed |= test_seq_num_tls12();
 	failed |= test_seq_num_tls13();
+	failed |= test_cbc_sha256_tls12();
+	failed |= test_read_tls13();
 
 	return failed;
 }
@@ -3513,6 +3513,487 @@ done:
 	return (failure);
 }
 
+static int
+test_tlsext_cookie_server_stateless(void)
+{
+	unsigned char *data = NULL;
+	SSL_CTX *ssl_ctx = NULL;
+	SSL *ssl = NULL;
+	int failure = 0;
+	size_t dlen;
+	int alert;
+	CBB cbb, cookie_cbb;
+	CBS cbs;
+
+	CBB_init(&cbb, 0);
+
+	if ((ssl_ctx = SSL_CTX_new(TLS_server_method())) == NULL)
+		errx(1, "failed to create SSL_CTX");
+	if ((ssl = SSL_new(ssl_ctx)) == NULL)
+		errx(1, "failed to create SSL");
+
+	if (!CBB_add_u16_length_prefixed(&cbb, &cookie_cbb))
+		errx(1, "failed to build cookie");
+	if (!CBB_add_bytes(&cookie_cbb, cookie, strlen(cookie)))
+		errx(1, "failed to build cookie");
+	if (!CBB_finish(&cbb, &data, &dlen))
+		errx(1, "failed to finish CBB");
+
+	S3I(ssl)->hs.negotiated_tls_version = TLS1_3_VERSION;
+
+	/* Without state, a cookie is only accepted when stateless. */
+	CBS_init(&cbs, data, dlen);
+	if (tlsext_cookie_server_parse(ssl, SSL_TLSEXT_MSG_CH, &cbs, &alert)) {
+		FAIL("server should not have parsed unknown cookie\n");
+		failure = 1;
+		goto done;
+	}
+
+	SSL_set_options(ssl, SSL_OP_STATELESS_HRR);
+
+	CBS_init(&cbs, data, dlen);
+	if (!tlsext_cookie_server_parse(ssl, SSL_TLSEXT_MSG_CH, &cbs, &alert)) {
+		FAIL("failed to parse client cookie\n");
+		failure = 1;
+		goto done;
+	}
+	if (CBS_len(&cbs) != 0) {
+		FAIL("extension data remaining\n");
+		failure = 1;
+		goto done;
+	}
+
+	if (S3I(ssl)->hs.tls13.cookie_len != strlen(cookie) ||
+	    memcmp(cookie, S3I(ssl)->hs.tls13.cookie,
+	    S3I(ssl)->hs.tls13.cookie_len) != 0) {
+		FAIL("parsed client cookie does not match sent cookie\n");
+		failure = 1;
+		goto done;
+	}
+
+done:
+	CBB_cleanup(&cbb);
+	SSL_CTX_free(ssl_ctx);
+	SSL_free(ssl);
+	free(data);
+
+	return (failure);
+}
+
+const uint8_t tlsext_early_data_nst[] = {
+	0x00, 0x00, 0x40, 0x00,
+};
+
+static int
+test_tlsext_early_data_server(void)
+{
+	unsigned char *data = NULL;
+	SSL_CTX *ssl_ctx = NULL;
+	SSL *ssl = NULL;
+	int failure = 1;
+	size_t dlen;
+	int alert;
+	CBB cbb;
+	CBS cbs;
+
+	CBB_init(&cbb, 0);
+
+	if ((ssl_ctx = SSL_CTX_new(TLS_server_method())) == NULL)
+		errx(1, "failed to create SSL_CTX");
+	if ((ssl = SSL_new(ssl_ctx)) == NULL)
+		errx(1, "failed to create SSL");
+
+	if (tlsext_early_data_server_needs(ssl, SSL_TLSEXT_MSG_EE)) {
+		FAIL("server should not need early_data in EE\n");
+		goto done;
+	}
+	if (tlsext_early_data_server_needs(ssl, SSL_TLSEXT_MSG_NST)) {
+		FAIL("server should not need early_data in NST\n");
+		goto done;
+	}
+
+	/* Early data is rejected until a decision has been made. */
+	CBS_init(&cbs, NULL, 0);
+	if (!tlsext_early_data_server_parse(ssl, SSL_TLSEXT_MSG_CH, &cbs,
+	    &alert)) {
+		FAIL("failed to parse early_data\n");
+		goto done;
+	}
+	if (SSL_get_early_data_status(ssl) != SSL_EARLY_DATA_REJECTED) {
+		FAIL("early data should be rejected\n");
+		goto done;
+	}
+	if (tlsext_early_data_server_needs(ssl, SSL_TLSEXT_MSG_EE)) {
+		FAIL("server should not need early_data in EE\n");
+		goto done;
+	}
+
+	S3I(ssl)->hs.tls13.early_data_status = SSL_EARLY_DATA_ACCEPTED;
+	if (!tlsext_early_data_server_needs(ssl, SSL_TLSEXT_MSG_EE)) {
+		FAIL("server should need early_data in EE\n");
+		goto done;
+	}
+	if (!tlsext_early_data_server_build(ssl, SSL_TLSEXT_MSG_EE, &cbb)) {
+		FAIL("server failed to build early_data\n");
+		goto done;
+	}
+	if (!CBB_finish(&cbb, &data, &dlen))
+		errx(1, "failed to finish CBB");
+	if (dlen != 0) {
+		FAIL("got EE early_data with length %zu, want 0\n", dlen);
+		goto done;
+	}
+	free(data);
+	data = NULL;
+
+	/* The limit is advertised in a NewSessionTicket. */
+	if (!SSL_set_max_early_data(ssl, 16384))
+		errx(1, "failed to set max early data");
+	if (!tlsext_early_data_server_needs(ssl, SSL_TLSEXT_MSG_NST)) {
+		FAIL("server should need early_data in NST\n");
+		goto done;
+	}
+	CBB_init(&cbb, 0);
+	if (!tlsext_early_data_server_build(ssl, SSL_TLSEXT_MSG_NST, &cbb)) {
+		FAIL("server failed to build early_data\n");
+		goto done;
+	}
+	if (!CBB_finish(&cbb, &data, &dlen))
+		errx(1, "failed to finish CBB");
+	if (dlen != sizeof(tlsext_early_data_nst)) {
+		FAIL("got NST early_data with length %zu, want length %zu\n",
+		    dlen, sizeof(tlsext_early_data_nst));
+		goto done;
+	}
+	if (memcmp(data, tlsext_early_data_nst, dlen) != 0) {
+		FAIL("NST early_data differs:\n");
+		compare_data(data, dlen, tlsext_early_data_nst,
+		    sizeof(tlsext_early_data_nst));
+		goto done;
+	}
+
+	/* Early data must not be offered after a HelloRetryRequest. */
+	S3I(ssl)->hs.tls13.hrr = 1;
+	CBS_init(&cbs, NULL, 0);
+	if (tlsext_early_data_server_parse(ssl, SSL_TLSEXT_MSG_CH, &cbs,
+	    &alert)) {
+		FAIL("parsed early_data following HRR\n");
+		goto done;
+	}
+
+	failure = 0;
+
+ done:
+	CBB_cleanup(&cbb);
+	SSL_CTX_free(ssl_ctx);
+	SSL_free(ssl);
+	free(data);
+
+	return (failure);
+}
+
+const uint8_t tlsext_psk_kex_modes_dhe[] = {
+	0x01, 0x01,
+};
+
+const uint8_t tlsext_psk_kex_modes_psk_only[] = {
+	0x01, 0x00,
+};
+
+const uint8_t tlsext_psk_kex_modes_empty[] = {
+	0x00,
+};
+
+static int
+test_tlsext_psk_kex_modes_server(void)
+{
+	SSL_CTX *ssl_ctx = NULL;
+	SSL *ssl = NULL;
+	int failure = 1;
+	int alert;
+	CBS cbs;
+
+	if ((ssl_ctx = SSL_CTX_new(TLS_server_method())) == NULL)
+		errx(1, "failed to create SSL_CTX");
+	if ((ssl = SSL_new(ssl_ctx)) == NULL)
+		errx(1, "failed to create SSL");
+
+	if (tlsext_psk_kex_modes_server_needs(ssl, SSL_TLSEXT_MSG_SH)) {
+		FAIL("server should never need psk_key_exchange_modes\n");
+		goto done;
+	}
+
+	CBS_init(&cbs, tlsext_psk_kex_modes_psk_only,
+	    sizeof(tlsext_psk_kex_modes_psk_only));
+	if (!tlsext_psk_kex_modes_server_parse(ssl, SSL_TLSEXT_MSG_CH, &cbs,
+	    &alert)) {
+		FAIL("failed to parse psk_ke only mode\n");
+		goto done;
+	}
+	if (S3I(ssl)->hs.tls13.psk_dhe_ke) {
+		FAIL("psk_dhe_ke should not be set for psk_ke only\n");
+		goto done;
+	}
+
+	CBS_init(&cbs, tlsext_psk_kex_modes_dhe,
+	    sizeof(tlsext_psk_kex_modes_dhe));
+	if (!tlsext_psk_kex_modes_server_parse(ssl, SSL_TLSEXT_MSG_CH, &cbs,
+	    &alert)) {
+		FAIL("failed to parse psk_dhe_ke mode\n");
+		goto done;
+	}
+	if (CBS_len(&cbs) != 0) {
+		FAIL("extension data remaining\n");
+		goto done;
+	}
+	if (!S3I(ssl)->hs.tls13.psk_dhe_ke) {
+		FAIL("psk_dhe_ke should be set\n");
+		goto done;
+	}
+
+	CBS_init(&cbs, tlsext_psk_kex_modes_empty,
+	    sizeof(tlsext_psk_kex_modes_empty));
+	if (tlsext_psk_kex_modes_server_parse(ssl, SSL_TLSEXT_MSG_CH, &cbs,
+	    &alert)) {
+		FAIL("parsed empty psk_key_exchange_modes\n");
+		goto done;
+	}
+
+	failure = 0;
+
+ done:
+	SSL_CTX_free(ssl_ctx);
+	SSL_free(ssl);
+
+	return (failure);
+}
+
+const uint8_t tlsext_certcomp_zlib[] = {
+	0x04, 0x00, 0x02, 0x00, 0x01,
+};
+
+const uint8_t tlsext_certcomp_unknown[] = {
+	0x04, 0x00, 0x02, 0x00, 0x03,
+};
+
+const uint8_t tlsext_certcomp_odd[] = {
+	0x03, 0x00, 0x02, 0x00,
+};
+
+const uint8_t tlsext_certcomp_empty[] = {
+	0x00,
+};
+
+static int
+test_tlsext_certcomp_server(void)
+{
+	SSL_CTX *ssl_ctx = NULL;
+	SSL *ssl = NULL;
+	uint16_t alg;
+	int failure = 1;
+	int alert;
+	CBS cbs;
+
+	if ((ssl_ctx = SSL_CTX_new(TLS_server_method())) == NULL)
+		errx(1, "failed to create SSL_CTX");
+	if ((ssl = SSL_new(ssl_ctx)) == NULL)
+		errx(1, "failed to create SSL");
+
+	if (tlsext_certcomp_server_needs(ssl, SSL_TLSEXT_MSG_CR)) {
+		FAIL("server should never need compress_certificate\n");
+		goto done;
+	}
+
+	/* Without the option the extension is parsed and ignored. */
+	CBS_init(&cbs, tlsext_certcomp_zlib, sizeof(tlsext_certcomp_zlib));
+	if (!tlsext_certcomp_server_parse(ssl, SSL_TLSEXT_MSG_CH, &cbs,
+	    &alert)) {
+		FAIL("failed to parse compress_certificate\n");
+		goto done;
+	}
+	if (S3I(ssl)->hs.tls13.cert_comp_alg != 0) {
+		FAIL("compression selected without option\n");
+		goto done;
+	}
+
+	SSL_set_options(ssl, SSL_OP_ENABLE_CERT_COMPRESSION);
+
+	CBS_init(&cbs, tlsext_certcomp_zlib, sizeof(tlsext_certcomp_zlib));
+	if (!tlsext_certcomp_server_parse(ssl, SSL_TLSEXT_MSG_CH, &cbs,
+	    &alert)) {
+		FAIL("failed to parse compress_certificate\n");
+		goto done;
+	}
+	if (CBS_len(&cbs) != 0) {
+		FAIL("extension data remaining\n");
+		goto done;
+	}
+	alg = tls13_cert_comp_supported(TLS13_CERT_COMP_ZLIB) ?
+	    TLS13_CERT_COMP_ZLIB : 0;
+	if (S3I(ssl)->hs.tls13.cert_comp_alg != alg) {
+		FAIL("got algorithm %d, want %d\n",
+		    S3I(ssl)->hs.tls13.cert_comp_alg, alg);
+		goto done;
+	}
+
+	S3I(ssl)->hs.tls13.cert_comp_alg = 0;
+	CBS_init(&cbs, tlsext_certcomp_unknown,
+	    sizeof(tlsext_certcomp_unknown));
+	if (!tlsext_certcomp_server_parse(ssl, SSL_TLSEXT_MSG_CH, &cbs,
+	    &alert)) {
+		FAIL("failed to parse compress_certificate\n");
+		goto done;
+	}
+	if (S3I(ssl)->hs.tls13.cert_comp_alg != 0) {
+		FAIL("selected an unknown algorithm\n");
+		goto done;
+	}
+
+	CBS_init(&cbs, tlsext_certcomp_odd, sizeof(tlsext_certcomp_odd));
+	if (tlsext_certcomp_server_parse(ssl, SSL_TLSEXT_MSG_CH, &cbs,
+	    &alert)) {
+		FAIL("parsed odd length compress_certificate\n");
+		goto done;
+	}
+
+	CBS_init(&cbs, tlsext_certcomp_empty, sizeof(tlsext_certcomp_empty));
+	if (tlsext_certcomp_server_parse(ssl, SSL_TLSEXT_MSG_CH, &cbs,
+	    &alert)) {
+		FAIL("parsed empty compress_certificate\n");
+		goto done;
+	}
+
+	failure = 0;
+
+ done:
+	SSL_CTX_free(ssl_ctx);
+	SSL_free(ssl);
+
+	return (failure);
+}
+
+const uint8_t tlsext_psk_identity[] = {
+	0x01, 0x02, 0x03, 0x04,
+};
+
+const uint8_t tlsext_psk_single[] = {
+	/* Identities. */
+	0x00, 0x0a,
+	0x00, 0x04, 0x01, 0x02, 0x03, 0x04,
+	0x11, 0x22, 0x33, 0x44,
+	/* Binders. */
+	0x00, 0x21,
+	0x20,
+	0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+	0xa8, 0xa9, 0xaa, 0xab, 0xac, 0xad, 0xae, 0xaf,
+	0xb0, 0xb1, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7,
+	0xb8, 0xb9, 0xba, 0xbb, 0xbc, 0xbd, 0xbe, 0xbf,
+};
+
+const uint8_t tlsext_psk_no_binders[] = {
+	0x00, 0x0a,
+	0x00, 0x04, 0x01, 0x02, 0x03, 0x04,
+	0x11, 0x22, 0x33, 0x44,
+	0x00, 0x00,
+};
+
+const uint8_t tlsext_psk_server[] = {
+	0x00, 0x00,
+};
+
+static int
+test_tlsext_psk_server(void)
+{
+	unsigned char *data = NULL;
+	SSL_CTX *ssl_ctx = NULL;
+	SSL *ssl = NULL;
+	int failure = 1;
+	size_t dlen;
+	int alert;
+	CBB cbb;
+	CBS cbs;
+
+	CBB_init(&cbb, 0);
+
+	if ((ssl_ctx = SSL_CTX_new(TLS_server_method())) == NULL)
+		errx(1, "failed to create SSL_CTX");
+	if ((ssl = SSL_new(ssl_ctx)) == NULL)
+		errx(1, "failed to create SSL");
+
+	CBS_init(&cbs, tlsext_psk_no_binders, sizeof(tlsext_psk_no_binders));
+	if (tlsext_psk_server_parse(ssl, SSL_TLSEXT_MSG_CH, &cbs, &alert)) {
+		FAIL("parsed pre_shared_key without binders\n");
+		goto done;
+	}
+
+	CBS_init(&cbs, tlsext_psk_single, sizeof(tlsext_psk_single));
+	if (!tlsext_psk_server_parse(ssl, SSL_TLSEXT_MSG_CH, &cbs, &alert)) {
+		FAIL("failed to parse pre_shared_key\n");
+		goto done;
+	}
+	if (CBS_len(&cbs) != 0) {
+		FAIL("extension data remaining\n");
+		goto done;
+	}
+	if (S3I(ssl)->hs.tls13.psk_identity_len != sizeof(tlsext_psk_identity) ||
+	    memcmp(S3I(ssl)->hs.tls13.psk_identity, tlsext_psk_identity,
+	    sizeof(tlsext_psk_identity)) != 0) {
+		FAIL("parsed identity does not match\n");
+		goto done;
+	}
+	if (S3I(ssl)->hs.tls13.psk_obfuscated_age != 0x11223344) {
+		FAIL("got obfuscated age 0x%x, want 0x11223344\n",
+		    S3I(ssl)->hs.tls13.psk_obfuscated_age);
+		goto done;
+	}
+	if (S3I(ssl)->hs.tls13.psk_binder_len != 32 ||
+	    memcmp(S3I(ssl)->hs.tls13.psk_binder, &tlsext_psk_single[15],
+	    32) != 0) {
+		FAIL("parsed binder does not match\n");
+		goto done;
+	}
+	if (S3I(ssl)->hs.tls13.psk_binders_len != 35) {
+		FAIL("got binders length %zu, want 35\n",
+		    S3I(ssl)->hs.tls13.psk_binders_len);
+		goto done;
+	}
+
+	S3I(ssl)->hs.negotiated_tls_version = TLS1_3_VERSION;
+	if (tlsext_psk_server_needs(ssl, SSL_TLSEXT_MSG_SH)) {
+		FAIL("server should not need pre_shared_key\n");
+		goto done;
+	}
+
+	S3I(ssl)->hs.tls13.psk_selected = 1;
+	if (!tlsext_psk_server_needs(ssl, SSL_TLSEXT_MSG_SH)) {
+		FAIL("server should need pre_shared_key\n");
+		goto done;
+	}
+	if (!tlsext_psk_server_build(ssl, SSL_TLSEXT_MSG_SH, &cbb)) {
+		FAIL("server failed to build pre_shared_key\n");
+		goto done;
+	}
+	if (!CBB_finish(&cbb, &data, &dlen))
+		errx(1, "failed to finish CBB");
+	if (dlen != sizeof(tlsext_psk_server) ||
+	    memcmp(data, tlsext_psk_server, dlen) != 0) {
+		FAIL("server pre_shared_key differs:\n");
+		compare_data(data, dlen, tlsext_psk_server,
+		    sizeof(tlsext_psk_server));
+		goto done;
+	}
+
+	failure = 0;
+
+ done:
+	CBB_cleanup(&cbb);
+	SSL_CTX_free(ssl_ctx);
+	SSL_free(ssl);
+	free(data);
+
+	return (failure);
+}
+
 unsigned char *valid_hostnames[] = {
 	"openbsd.org",
 	"op3nbsd.org",
@@ -3632,6 +4113,13 @@ main(int argc, char **argv)
 
 	failed |= test_tlsext_cookie_client();
 	failed |= test_tlsext_cookie_server();
+	failed |= test_tlsext_cookie_server_stateless();
+
+	failed |= test_tlsext_early_data_server();
+
+	failed |= test_tlsext_psk_kex_modes_server();
+	failed |= test_tlsext_certcomp_server();
+	failed |= test_tlsext_psk_server();
 
 #ifndef OPENSSL_NO_SRTP
 	failed |= test_tlsext_srtp_client();
@@ -0,0 +1,156 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+
+#include "ssl_locl.h"
+
+static X509 *
+load_cert(const char *name)
+{
+	X509 *x = NULL;
+	char *file;
+	FILE *fp;
+
+	if (asprintf(&file, "%s/%s", CERTSDIR, name) == -1)
+		return NULL;
+	if ((fp = fopen(file, "r")) != NULL) {
+		x = PEM_read_X509(fp, NULL, NULL, NULL);
+		fclose(fp);
+	}
+	free(file);
+
+	return x;
+}
+
+static int
+test_cert_share(void)
+{
+	SSL_CTX *ctx = NULL, *ctx2 = NULL;
+	SSL *ssl = NULL, *ssl2 = NULL;
+	X509 *server = NULL, *client = NULL;
+	int failed = 1;
+
+	if ((server = load_cert("server.pem")) == NULL) {
+		fprintf(stderr, "FAIL: failed to load server certificate\n");
+		goto err;
+	}
+	if ((client = load_cert("client.pem")) == NULL) {
+		fprintf(stderr, "FAIL: failed to load client certificate\n");
+		goto err;
+	}
+
+	if ((ctx = SSL_CTX_new(TLS_method())) == NULL)
+		goto err;
+	if (!SSL_CTX_use_certificate(ctx, server)) {
+		fprintf(stderr, "FAIL: SSL_CTX_use_certificate() failed\n");
+		goto err;
+	}
+
+	if ((ssl = SSL_new(ctx)) == NULL)
+		goto err;
+	if (ssl->cert != ctx->internal->cert) {
+		fprintf(stderr, "FAIL: SSL_new() copied the CERT\n");
+		goto err;
+	}
+
+	/* Changing the context must leave the connection as it was. */
+	if (!SSL_CTX_use_certificate(ctx, client)) {
+		fprintf(stderr, "FAIL: SSL_CTX_use_certificate() failed\n");
+		goto err;
+	}
+	if (ssl->cert == ctx->internal->cert) {
+		fprintf(stderr, "FAIL: CERT still shared after change\n");
+		goto err;
+	}
+	if (SSL_get_certificate(ssl) != server) {
+		fprintf(stderr, "FAIL: connection certificate changed\n");
+		goto err;
+	}
+	if (SSL_CTX_get0_certificate(ctx) != client) {
+		fprintf(stderr, "FAIL: context certificate not changed\n");
+		goto err;
+	}
+	if (ssl->cert->references != 1 ||
+	    ctx->internal->cert->references != 1) {
+		fprintf(stderr, "FAIL: bad CERT references\n");
+		goto err;
+	}
+
+	/* And changing a connection must leave the context as it was. */
+	if ((ssl2 = SSL_new(ctx)) == NULL)
+		goto err;
+	if (ssl2->cert != ctx->internal->cert) {
+		fprintf(stderr, "FAIL: SSL_new() copied the CERT\n");
+		goto err;
+	}
+	if (!SSL_use_certificate(ssl2, server)) {
+		fprintf(stderr, "FAIL: SSL_use_certificate() failed\n");
+		goto err;
+	}
+	if (ssl2->cert == ctx->internal->cert) {
+		fprintf(stderr, "FAIL: CERT still shared after change\n");
+		goto err;
+	}
+	if (SSL_get_certificate(ssl2) != server) {
+		fprintf(stderr, "FAIL: connection certificate not changed\n");
+		goto err;
+	}
+	if (SSL_CTX_get0_certificate(ctx) != client) {
+		fprintf(stderr, "FAIL: context certificate changed\n");
+		goto err;
+	}
+
+	/* Switching context shares the CERT of the new one. */
+	if ((ctx2 = SSL_CTX_new(TLS_method())) == NULL)
+		goto err;
+	if (SSL_set_SSL_CTX(ssl, ctx2) != ctx2)
+		goto err;
+	if (ssl->cert != ctx2->internal->cert) {
+		fprintf(stderr, "FAIL: SSL_set_SSL_CTX() copied the CERT\n");
+		goto err;
+	}
+
+	failed = 0;
+
+ err:
+	SSL_free(ssl);
+	SSL_free(ssl2);
+	SSL_CTX_free(ctx);
+	SSL_CTX_free(ctx2);
+	X509_free(server);
+	X509_free(client);
+
+	return failed;
+}
+
+int
+main(int argc, char **argv)
+{
+	int failed = 0;
+
+	failed |= test_cert_share();
+
+	if (failed == 0)
+		printf("PASS %s\n", __FILE__);
+
+	return failed;
+}
@@ -0,0 +1,387 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/bio.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+char *server_cert;
+char *server_key;
+
+static SSL_CTX *
+ssl_ctx_new(uint16_t min_version, uint16_t max_version, int server)
+{
+	SSL_CTX *ctx;
+
+	if ((ctx = SSL_CTX_new(TLS_method())) == NULL) {
+		fprintf(stderr, "SSL_CTX_new failed\n");
+		goto err;
+	}
+	if (!SSL_CTX_set_min_proto_version(ctx, min_version) ||
+	    !SSL_CTX_set_max_proto_version(ctx, max_version)) {
+		fprintf(stderr, "failed to set protocol version\n");
+		goto err;
+	}
+
+	if (server) {
+		if (!SSL_CTX_use_certificate_file(ctx, server_cert,
+		    SSL_FILETYPE_PEM)) {
+			fprintf(stderr, "use_certificate_file failed\n");
+			goto err;
+		}
+		if (!SSL_CTX_use_PrivateKey_file(ctx, server_key,
+		    SSL_FILETYPE_PEM)) {
+			fprintf(stderr, "use_PrivateKey_file failed\n");
+			goto err;
+		}
+	}
+
+	return ctx;
+
+ err:
+	SSL_CTX_free(ctx);
+	return NULL;
+}
+
+/* Connect client and server via a pair of "nonblocking" memory BIOs. */
+static int
+connect_peers(SSL *client_ssl, SSL *server_ssl)
+{
+	BIO *client_wbio = NULL, *server_wbio = NULL;
+	int ret = 0;
+
+	if ((client_wbio = BIO_new(BIO_s_mem())) == NULL)
+		goto err;
+	if ((server_wbio = BIO_new(BIO_s_mem())) == NULL)
+		goto err;
+	if (BIO_set_mem_eof_return(client_wbio, -1) <= 0)
+		goto err;
+	if (BIO_set_mem_eof_return(server_wbio, -1) <= 0)
+		goto err;
+
+	/* Avoid double free. SSL_set_bio() takes ownership of the BIOs. */
+	BIO_up_ref(client_wbio);
+	BIO_up_ref(server_wbio);
+
+	SSL_set_bio(client_ssl, server_wbio, client_wbio);
+	SSL_set_bio(server_ssl, client_wbio, server_wbio);
+	client_wbio = NULL;
+	server_wbio = NULL;
+
+	ret = 1;
+
+ err:
+	BIO_free(client_wbio);
+	BIO_free(server_wbio);
+
+	return ret;
+}
+
+static int
+push_data_to_peer(SSL *ssl, int *ret, int (*func)(SSL *), const char *func_name,
+    int quiet)
+{
+	int ssl_err = 0;
+
+	if (*ret == 1)
+		return 1;
+
+	do {
+		if ((*ret = func(ssl)) <= 0)
+			ssl_err = SSL_get_error(ssl, *ret);
+	} while (*ret <= 0 && ssl_err == SSL_ERROR_WANT_WRITE);
+
+	if (*ret <= 0 && ssl_err != SSL_ERROR_WANT_READ) {
+		if (!quiet) {
+			fprintf(stderr, "FAIL: %s failed\n", func_name);
+			ERR_print_errors_fp(stderr);
+		}
+		return 0;
+	}
+
+	return 1;
+}
+
+static int
+handshake(SSL *client_ssl, SSL *server_ssl, int quiet)
+{
+	int loops = 0, client_ret = 0, server_ret = 0;
+
+	while (loops++ < 10 && (client_ret <= 0 || server_ret <= 0)) {
+		if (!push_data_to_peer(client_ssl, &client_ret, SSL_connect,
+		    "SSL_connect", quiet))
+			return 0;
+
+		if (!push_data_to_peer(server_ssl, &server_ret, SSL_accept,
+		    "SSL_accept", quiet))
+			return 0;
+	}
+
+	if (client_ret != 1 || server_ret != 1) {
+		if (!quiet)
+			fprintf(stderr, "FAIL: handshake did not complete\n");
+		return 0;
+	}
+
+	return 1;
+}
+
+static int
+check_count(const char *name, uint64_t got, uint64_t want)
+{
+	if (got != want) {
+		fprintf(stderr, "FAIL: %s is %llu, want %llu\n", name,
+		    (unsigned long long)got, (unsigned long long)want);
+		return 0;
+	}
+
+	return 1;
+}
+
+static int
+check_stats(SSL_CTX *ctx, uint64_t handshakes, uint64_t failures)
+{
+	SSL_HANDSHAKE_STATS stats;
+
+	SSL_CTX_get_handshake_stats(ctx, &stats);
+
+	if (!check_count("handshakes", stats.handshakes, handshakes))
+		return 0;
+	if (!check_count("full handshakes", stats.full_handshakes,
+	    handshakes))
+		return 0;
+	if (!check_count("resumed handshakes", stats.resumed_handshakes, 0))
+		return 0;
+	if (!check_count("failures", stats.failures, failures))
+		return 0;
+	if (!check_count("HelloRetryRequests", stats.hello_retry_requests, 0))
+		return 0;
+	if (handshakes > 0 &&
+	    stats.cpu_time.tv_sec == 0 && stats.cpu_time.tv_nsec == 0) {
+		fprintf(stderr, "FAIL: no handshake CPU time\n");
+		return 0;
+	}
+
+	return 1;
+}
+
+static int
+handshake_stats_test(uint16_t version)
+{
+	SSL_CTX *client_ctx = NULL, *server_ctx = NULL;
+	SSL *client_ssl = NULL, *server_ssl = NULL;
+	uint16_t cipher_value;
+	int failed = 1;
+
+	if ((client_ctx = ssl_ctx_new(version, version, 0)) == NULL)
+		goto failure;
+	if ((server_ctx = ssl_ctx_new(version, version, 1)) == NULL)
+		goto failure;
+
+	if (!check_stats(server_ctx, 0, 0))
+		goto failure;
+
+	if ((client_ssl = SSL_new(client_ctx)) == NULL)
+		goto failure;
+	if ((server_ssl = SSL_new(server_ctx)) == NULL)
+		goto failure;
+	if (!connect_peers(client_ssl, server_ssl))
+		goto failure;
+	if (!handshake(client_ssl, server_ssl, 0))
+		goto failure;
+
+	if (!check_stats(client_ctx, 1, 0))
+		goto failure;
+	if (!check_stats(server_ctx, 1, 0))
+		goto failure;
+
+	if (!check_count("version handshakes",
+	    SSL_CTX_get_handshake_count(server_ctx,
+	    SSL_HANDSHAKE_STAT_VERSION, version), 1))
+		goto failure;
+	cipher_value = SSL_CIPHER_get_value(SSL_get_current_cipher(server_ssl));
+	if (!check_count("cipher handshakes",
+	    SSL_CTX_get_handshake_count(server_ctx,
+	    SSL_HANDSHAKE_STAT_CIPHER, cipher_value), 1))
+		goto failure;
+
+	/* X25519 is the preferred group of both peers. */
+	if (!check_count("client X25519 handshakes",
+	    SSL_CTX_get_handshake_count(client_ctx,
+	    SSL_HANDSHAKE_STAT_GROUP, 29), 1))
+		goto failure;
+	if (!check_count("server X25519 handshakes",
+	    SSL_CTX_get_handshake_count(server_ctx,
+	    SSL_HANDSHAKE_STAT_GROUP, 29), 1))
+		goto failure;
+
+	failed = 0;
+
+ failure:
+	SSL_free(client_ssl);
+	SSL_free(server_ssl);
+	SSL_CTX_free(client_ctx);
+	SSL_CTX_free(server_ctx);
+
+	return failed;
+}
+
+/* A server that only speaks TLSv1.3 rejects a TLSv1.2 client. */
+static int
+handshake_stats_failure_test(void)
+{
+	SSL_CTX *client_ctx = NULL, *server_ctx = NULL;
+	SSL *client_ssl = NULL, *server_ssl = NULL;
+	int failed = 1;
+
+	if ((client_ctx = ssl_ctx_new(TLS1_2_VERSION, TLS1_2_VERSION,
+	    0)) == NULL)
+		goto failure;
+	if ((server_ctx = ssl_ctx_new(TLS1_3_VERSION, TLS1_3_VERSION,
+	    1)) == NULL)
+		goto failure;
+
+	if ((client_ssl = SSL_new(client_ctx)) == NULL)
+		goto failure;
+	if ((server_ssl = SSL_new(server_ctx)) == NULL)
+		goto failure;
+	if (!connect_peers(client_ssl, server_ssl))
+		goto failure;
+	if (handshake(client_ssl, server_ssl, 1)) {
+		fprintf(stderr, "FAIL: handshake succeeded\n");
+		goto failure;
+	}
+	ERR_clear_error();
+
+	if (!check_stats(server_ctx, 0, 1))
+		goto failure;
+	if (!check_count("protocol_version alerts sent",
+	    SSL_CTX_get_handshake_count(server_ctx,
+	    SSL_HANDSHAKE_STAT_ALERT_SENT, SSL_AD_PROTOCOL_VERSION), 1))
+		goto failure;
+
+	failed = 0;
+
+ failure:
+	SSL_free(client_ssl);
+	SSL_free(server_ssl);
+	SSL_CTX_free(client_ctx);
+	SSL_CTX_free(server_ctx);
+
+	return failed;
+}
+
+/*
+ * With node replicas, handshakes on different nodes are counted apart and
+ * summed by the readers, and the counts survive the replicas.
+ */
+static int
+handshake_stats_numa_test(void)
+{
+	SSL_CTX *client_ctx = NULL, *server_ctx = NULL;
+	SSL *client_ssl = NULL, *server_ssl = NULL;
+	unsigned int node;
+	int failed = 1;
+
+	if ((client_ctx = ssl_ctx_new(TLS1_3_VERSION, TLS1_3_VERSION,
+	    0)) == NULL)
+		goto failure;
+	if ((server_ctx = ssl_ctx_new(TLS1_3_VERSION, TLS1_3_VERSION,
+	    1)) == NULL)
+		goto failure;
+
+	if (!SSL_CTX_set_numa_nodes(server_ctx, 4))
+		goto failure;
+	if (SSL_CTX_get_numa_nodes(server_ctx) != 4) {
+		fprintf(stderr, "FAIL: SSL_CTX_get_numa_nodes\n");
+		goto failure;
+	}
+
+	for (node = 0; node < 4; node += 2) {
+		if (!SSL_set_thread_numa_node(node))
+			goto failure;
+		if (SSL_get_thread_numa_node() != node) {
+			fprintf(stderr, "FAIL: SSL_get_thread_numa_node\n");
+			goto failure;
+		}
+
+		SSL_free(client_ssl);
+		SSL_free(server_ssl);
+		if ((client_ssl = SSL_new(client_ctx)) == NULL)
+			goto failure;
+		if ((server_ssl = SSL_new(server_ctx)) == NULL)
+			goto failure;
+		if (!connect_peers(client_ssl, server_ssl))
+			goto failure;
+		if (!handshake(client_ssl, server_ssl, 0))
+			goto failure;
+	}
+
+	if (!check_stats(server_ctx, 2, 0))
+		goto failure;
+	if (!check_count("version handshakes",
+	    SSL_CTX_get_handshake_count(server_ctx,
+	    SSL_HANDSHAKE_STAT_VERSION, TLS1_3_VERSION), 2))
+		goto failure;
+
+	if (!SSL_CTX_set_numa_nodes(server_ctx, 1))
+		goto failure;
+	if (!check_stats(server_ctx, 2, 0))
+		goto failure;
+
+	failed = 0;
+
+ failure:
+	SSL_set_thread_numa_node(0);
+	SSL_free(client_ssl);
+	SSL_free(server_ssl);
+	SSL_CTX_free(client_ctx);
+	SSL_CTX_free(server_ctx);
+
+	return failed;
+}
+
+int
+main(int argc, char **argv)
+{
+	int failed = 0;
+
+	if (asprintf(&server_cert, "%s/server.pem", CERTSDIR) == -1) {
+		fprintf(stderr, "asprintf server_cert failed\n");
+		failed = 1;
+		goto err;
+	}
+	server_key = server_cert;
+
+	failed |= handshake_stats_test(TLS1_2_VERSION);
+	failed |= handshake_stats_test(TLS1_3_VERSION);
+	failed |= handshake_stats_failure_test();
+	failed |= handshake_stats_numa_test();
+
+	if (failed == 0)
+		printf("PASS %s\n", __FILE__);
+
+ err:
+	free(server_cert);
+
+	return failed;
+}
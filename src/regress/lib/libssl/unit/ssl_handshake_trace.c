@@ -0,0 +1,286 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/time.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/bio.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+char *server_cert;
+char *server_key;
+
+static SSL_CTX *
+ssl_ctx_new(uint16_t version, int server)
+{
+	SSL_CTX *ctx;
+
+	if ((ctx = SSL_CTX_new(TLS_method())) == NULL) {
+		fprintf(stderr, "SSL_CTX_new failed\n");
+		goto err;
+	}
+	if (!SSL_CTX_set_min_proto_version(ctx, version) ||
+	    !SSL_CTX_set_max_proto_version(ctx, version)) {
+		fprintf(stderr, "failed to set protocol version\n");
+		goto err;
+	}
+
+	if (server) {
+		if (!SSL_CTX_use_certificate_file(ctx, server_cert,
+		    SSL_FILETYPE_PEM)) {
+			fprintf(stderr, "use_certificate_file failed\n");
+			goto err;
+		}
+		if (!SSL_CTX_use_PrivateKey_file(ctx, server_key,
+		    SSL_FILETYPE_PEM)) {
+			fprintf(stderr, "use_PrivateKey_file failed\n");
+			goto err;
+		}
+	}
+
+	return ctx;
+
+ err:
+	SSL_CTX_free(ctx);
+	return NULL;
+}
+
+/* Connect client and server via a pair of "nonblocking" memory BIOs. */
+static int
+connect_peers(SSL *client_ssl, SSL *server_ssl)
+{
+	BIO *client_wbio = NULL, *server_wbio = NULL;
+	int ret = 0;
+
+	if ((client_wbio = BIO_new(BIO_s_mem())) == NULL)
+		goto err;
+	if ((server_wbio = BIO_new(BIO_s_mem())) == NULL)
+		goto err;
+	if (BIO_set_mem_eof_return(client_wbio, -1) <= 0)
+		goto err;
+	if (BIO_set_mem_eof_return(server_wbio, -1) <= 0)
+		goto err;
+
+	/* Avoid double free. SSL_set_bio() takes ownership of the BIOs. */
+	BIO_up_ref(client_wbio);
+	BIO_up_ref(server_wbio);
+
+	SSL_set_bio(client_ssl, server_wbio, client_wbio);
+	SSL_set_bio(server_ssl, client_wbio, server_wbio);
+	client_wbio = NULL;
+	server_wbio = NULL;
+
+	ret = 1;
+
+ err:
+	BIO_free(client_wbio);
+	BIO_free(server_wbio);
+
+	return ret;
+}
+
+static int
+push_data_to_peer(SSL *ssl, int *ret, int (*func)(SSL *), const char *func_name)
+{
+	int ssl_err = 0;
+
+	if (*ret == 1)
+		return 1;
+
+	do {
+		if ((*ret = func(ssl)) <= 0)
+			ssl_err = SSL_get_error(ssl, *ret);
+	} while (*ret <= 0 && ssl_err == SSL_ERROR_WANT_WRITE);
+
+	if (*ret <= 0 && ssl_err != SSL_ERROR_WANT_READ) {
+		fprintf(stderr, "FAIL: %s failed\n", func_name);
+		ERR_print_errors_fp(stderr);
+		return 0;
+	}
+
+	return 1;
+}
+
+static int
+handshake(SSL *client_ssl, SSL *server_ssl)
+{
+	int loops = 0, client_ret = 0, server_ret = 0;
+
+	while (loops++ < 10 && (client_ret <= 0 || server_ret <= 0)) {
+		if (!push_data_to_peer(client_ssl, &client_ret, SSL_connect,
+		    "SSL_connect"))
+			return 0;
+
+		if (!push_data_to_peer(server_ssl, &server_ret, SSL_accept,
+		    "SSL_accept"))
+			return 0;
+	}
+
+	if (client_ret != 1 || server_ret != 1) {
+		fprintf(stderr, "FAIL: handshake did not complete\n");
+		return 0;
+	}
+
+	return 1;
+}
+
+struct trace {
+	int events;
+	int states;
+	int sent;
+	int received;
+	int first_message;
+	int first_sent;
+	int out_of_order;
+	struct timespec last;
+};
+
+static void
+trace_cb(const SSL *ssl, int event, int value, size_t len,
+    const struct timespec *ts, void *arg)
+{
+	struct trace *trace = arg;
+
+	if (trace->events++ > 0 && timespeccmp(ts, &trace->last, <))
+		trace->out_of_order = 1;
+	trace->last = *ts;
+
+	switch (event) {
+	case SSL_TRACE_STATE:
+		trace->states++;
+		break;
+	case SSL_TRACE_MESSAGE_SENT:
+	case SSL_TRACE_MESSAGE_RECEIVED:
+		if (trace->sent + trace->received == 0) {
+			trace->first_message = value;
+			trace->first_sent = event == SSL_TRACE_MESSAGE_SENT;
+		}
+		if (len < 4)
+			trace->out_of_order = 1;
+		if (event == SSL_TRACE_MESSAGE_SENT)
+			trace->sent++;
+		else
+			trace->received++;
+		break;
+	default:
+		trace->out_of_order = 1;
+		break;
+	}
+}
+
+static int
+check_trace(const char *name, struct trace *trace, int first_sent)
+{
+	if (trace->out_of_order) {
+		fprintf(stderr, "FAIL: %s trace has a bad event\n", name);
+		return 0;
+	}
+	if (trace->states == 0 || trace->sent == 0 || trace->received == 0) {
+		fprintf(stderr, "FAIL: %s trace has %d states, %d messages "
+		    "sent and %d received\n", name, trace->states,
+		    trace->sent, trace->received);
+		return 0;
+	}
+	if (trace->first_message != SSL3_MT_CLIENT_HELLO ||
+	    trace->first_sent != first_sent) {
+		fprintf(stderr, "FAIL: %s trace does not start with a "
+		    "ClientHello\n", name);
+		return 0;
+	}
+
+	return 1;
+}
+
+static int
+handshake_trace_test(uint16_t version)
+{
+	SSL_CTX *client_ctx = NULL, *server_ctx = NULL;
+	SSL *client_ssl = NULL, *server_ssl = NULL;
+	struct trace client_trace, server_trace;
+	int failed = 1;
+
+	memset(&client_trace, 0, sizeof(client_trace));
+	memset(&server_trace, 0, sizeof(server_trace));
+
+	if ((client_ctx = ssl_ctx_new(version, 0)) == NULL)
+		goto failure;
+	if ((server_ctx = ssl_ctx_new(version, 1)) == NULL)
+		goto failure;
+
+	SSL_CTX_set_handshake_trace_callback(server_ctx, trace_cb,
+	    &server_trace);
+
+	if ((client_ssl = SSL_new(client_ctx)) == NULL)
+		goto failure;
+	if ((server_ssl = SSL_new(server_ctx)) == NULL)
+		goto failure;
+	SSL_set_handshake_trace_callback(client_ssl, trace_cb, &client_trace);
+
+	if (!connect_peers(client_ssl, server_ssl))
+		goto failure;
+	if (!handshake(client_ssl, server_ssl))
+		goto failure;
+
+	if (!check_trace("client", &client_trace, 1))
+		goto failure;
+	if (!check_trace("server", &server_trace, 0))
+		goto failure;
+	if (client_trace.sent != server_trace.received) {
+		fprintf(stderr, "FAIL: client sent %d messages, server "
+		    "received %d\n", client_trace.sent, server_trace.received);
+		goto failure;
+	}
+
+	failed = 0;
+
+ failure:
+	SSL_free(client_ssl);
+	SSL_free(server_ssl);
+	SSL_CTX_free(client_ctx);
+	SSL_CTX_free(server_ctx);
+
+	return failed;
+}
+
+int
+main(int argc, char **argv)
+{
+	int failed = 0;
+
+	if (asprintf(&server_cert, "%s/server.pem", CERTSDIR) == -1) {
+		fprintf(stderr, "asprintf server_cert failed\n");
+		failed = 1;
+		goto err;
+	}
+	server_key = server_cert;
+
+	failed |= handshake_trace_test(TLS1_2_VERSION);
+	failed |= handshake_trace_test(TLS1_3_VERSION);
+
+	if (failed == 0)
+		printf("PASS %s\n", __FILE__);
+
+ err:
+	free(server_cert);
+
+	return failed;
+}
@@ -0,0 +1,270 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/bio.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+char *server_cert;
+char *server_key;
+
+static SSL_CTX *
+ssl_ctx_new(uint16_t version, int server)
+{
+	SSL_CTX *ctx;
+
+	if ((ctx = SSL_CTX_new(TLS_method())) == NULL) {
+		fprintf(stderr, "SSL_CTX_new failed\n");
+		goto err;
+	}
+	if (!SSL_CTX_set_min_proto_version(ctx, version) ||
+	    !SSL_CTX_set_max_proto_version(ctx, version)) {
+		fprintf(stderr, "failed to set protocol version\n");
+		goto err;
+	}
+
+	if (server) {
+		if (!SSL_CTX_use_certificate_file(ctx, server_cert,
+		    SSL_FILETYPE_PEM)) {
+			fprintf(stderr, "use_certificate_file failed\n");
+			goto err;
+		}
+		if (!SSL_CTX_use_PrivateKey_file(ctx, server_key,
+		    SSL_FILETYPE_PEM)) {
+			fprintf(stderr, "use_PrivateKey_file failed\n");
+			goto err;
+		}
+	}
+
+	return ctx;
+
+ err:
+	SSL_CTX_free(ctx);
+	return NULL;
+}
+
+/* Connect client and server via a pair of "nonblocking" memory BIOs. */
+static int
+connect_peers(SSL *client_ssl, SSL *server_ssl)
+{
+	BIO *client_wbio = NULL, *server_wbio = NULL;
+	int ret = 0;
+
+	if ((client_wbio = BIO_new(BIO_s_mem())) == NULL)
+		goto err;
+	if ((server_wbio = BIO_new(BIO_s_mem())) == NULL)
+		goto err;
+	if (BIO_set_mem_eof_return(client_wbio, -1) <= 0)
+		goto err;
+	if (BIO_set_mem_eof_return(server_wbio, -1) <= 0)
+		goto err;
+
+	/* Avoid double free. SSL_set_bio() takes ownership of the BIOs. */
+	BIO_up_ref(client_wbio);
+	BIO_up_ref(server_wbio);
+
+	SSL_set_bio(client_ssl, server_wbio, client_wbio);
+	SSL_set_bio(server_ssl, client_wbio, server_wbio);
+	client_wbio = NULL;
+	server_wbio = NULL;
+
+	ret = 1;
+
+ err:
+	BIO_free(client_wbio);
+	BIO_free(server_wbio);
+
+	return ret;
+}
+
+static int
+push_data_to_peer(SSL *ssl, int *ret, int (*func)(SSL *), const char *func_name)
+{
+	int ssl_err = 0;
+
+	if (*ret == 1)
+		return 1;
+
+	do {
+		if ((*ret = func(ssl)) <= 0)
+			ssl_err = SSL_get_error(ssl, *ret);
+	} while (*ret <= 0 && ssl_err == SSL_ERROR_WANT_WRITE);
+
+	if (*ret <= 0 && ssl_err != SSL_ERROR_WANT_READ) {
+		fprintf(stderr, "FAIL: %s failed\n", func_name);
+		ERR_print_errors_fp(stderr);
+		return 0;
+	}
+
+	return 1;
+}
+
+static int
+handshake(SSL *client_ssl, SSL *server_ssl)
+{
+	int loops = 0, client_ret = 0, server_ret = 0;
+
+	while (loops++ < 10 && (client_ret <= 0 || server_ret <= 0)) {
+		if (!push_data_to_peer(client_ssl, &client_ret, SSL_connect,
+		    "SSL_connect"))
+			return 0;
+
+		if (!push_data_to_peer(server_ssl, &server_ret, SSL_accept,
+		    "SSL_accept"))
+			return 0;
+	}
+
+	if (client_ret != 1 || server_ret != 1) {
+		fprintf(stderr, "FAIL: handshake did not complete\n");
+		return 0;
+	}
+
+	return 1;
+}
+
+/* Send data from one peer to the other, reading it there. */
+static int
+transfer(SSL *from, SSL *to, size_t len)
+{
+	uint8_t buf[4096], out[4096];
+	int ret;
+
+	arc4random_buf(buf, len);
+
+	if ((ret = SSL_write(from, buf, len)) != (int)len) {
+		fprintf(stderr, "FAIL: SSL_write returned %d\n", ret);
+		return 0;
+	}
+	if ((ret = SSL_read(to, out, sizeof(out))) != (int)len) {
+		fprintf(stderr, "FAIL: SSL_read returned %d\n", ret);
+		return 0;
+	}
+	if (memcmp(buf, out, len) != 0) {
+		fprintf(stderr, "FAIL: read data differs\n");
+		return 0;
+	}
+
+	return 1;
+}
+
+static int
+hibernate_test(uint16_t version)
+{
+	SSL_CTX *client_ctx = NULL, *server_ctx = NULL;
+	SSL *client_ssl = NULL, *server_ssl = NULL;
+	X509 *peer = NULL;
+	int failed = 1;
+
+	if ((client_ctx = ssl_ctx_new(version, 0)) == NULL)
+		goto failure;
+	if ((server_ctx = ssl_ctx_new(version, 1)) == NULL)
+		goto failure;
+
+	if ((client_ssl = SSL_new(client_ctx)) == NULL)
+		goto failure;
+	if ((server_ssl = SSL_new(server_ctx)) == NULL)
+		goto failure;
+	if (!connect_peers(client_ssl, server_ssl))
+		goto failure;
+
+	if (SSL_hibernate(client_ssl)) {
+		fprintf(stderr, "FAIL: hibernated before the handshake\n");
+		goto failure;
+	}
+	ERR_clear_error();
+
+	if (!handshake(client_ssl, server_ssl))
+		goto failure;
+
+	if (!SSL_hibernate(client_ssl) || !SSL_hibernate(server_ssl)) {
+		fprintf(stderr, "FAIL: SSL_hibernate failed\n");
+		goto failure;
+	}
+
+	/* The sessions, which may be resumed, are left as they were. */
+	if ((peer = SSL_get_peer_certificate(client_ssl)) == NULL) {
+		fprintf(stderr, "FAIL: no peer certificate\n");
+		goto failure;
+	}
+	if (SSL_get_peer_cert_chain(client_ssl) == NULL) {
+		fprintf(stderr, "FAIL: peer chain was freed\n");
+		goto failure;
+	}
+	if (SSL_get_client_ciphers(server_ssl) == NULL) {
+		fprintf(stderr, "FAIL: client ciphers were freed\n");
+		goto failure;
+	}
+
+	if (!transfer(client_ssl, server_ssl, 100))
+		goto failure;
+	if (!transfer(server_ssl, client_ssl, 4096))
+		goto failure;
+
+	if (!SSL_hibernate(client_ssl) || !SSL_hibernate(server_ssl)) {
+		fprintf(stderr, "FAIL: SSL_hibernate failed\n");
+		goto failure;
+	}
+	if (!SSL_hibernate(client_ssl)) {
+		fprintf(stderr, "FAIL: SSL_hibernate failed again\n");
+		goto failure;
+	}
+
+	if (!transfer(server_ssl, client_ssl, 1))
+		goto failure;
+	if (!transfer(client_ssl, server_ssl, 4096))
+		goto failure;
+
+	failed = 0;
+
+ failure:
+	X509_free(peer);
+	SSL_free(client_ssl);
+	SSL_free(server_ssl);
+	SSL_CTX_free(client_ctx);
+	SSL_CTX_free(server_ctx);
+
+	return failed;
+}
+
+int
+main(int argc, char **argv)
+{
+	int failed = 0;
+
+	if (asprintf(&server_cert, "%s/server.pem", CERTSDIR) == -1) {
+		fprintf(stderr, "asprintf server_cert failed\n");
+		failed = 1;
+		goto err;
+	}
+	server_key = server_cert;
+
+	failed |= hibernate_test(TLS1_2_VERSION);
+	failed |= hibernate_test(TLS1_3_VERSION);
+
+	if (failed == 0)
+		printf("PASS %s\n", __FILE__);
+
+ err:
+	free(server_cert);
+
+	return failed;
+}
@@ -0,0 +1,299 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/bio.h>
+#include <openssl/ec.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+char *server_cert;
+char *server_key;
+
+static SSL_CTX *
+ssl_ctx_new(uint16_t version, int server)
+{
+	SSL_CTX *ctx;
+
+	if ((ctx = SSL_CTX_new(TLS_method())) == NULL) {
+		fprintf(stderr, "SSL_CTX_new failed\n");
+		goto err;
+	}
+	if (!SSL_CTX_set_min_proto_version(ctx, version) ||
+	    !SSL_CTX_set_max_proto_version(ctx, version)) {
+		fprintf(stderr, "failed to set protocol version\n");
+		goto err;
+	}
+	if (!SSL_CTX_set1_groups_list(ctx, "P-256")) {
+		fprintf(stderr, "failed to set groups\n");
+		goto err;
+	}
+
+	if (server) {
+		if (!SSL_CTX_use_certificate_file(ctx, server_cert,
+		    SSL_FILETYPE_PEM)) {
+			fprintf(stderr, "use_certificate_file failed\n");
+			goto err;
+		}
+		if (!SSL_CTX_use_PrivateKey_file(ctx, server_key,
+		    SSL_FILETYPE_PEM)) {
+			fprintf(stderr, "use_PrivateKey_file failed\n");
+			goto err;
+		}
+	}
+
+	return ctx;
+
+ err:
+	SSL_CTX_free(ctx);
+	return NULL;
+}
+
+/* Connect client and server via a pair of "nonblocking" memory BIOs. */
+static int
+connect_peers(SSL *client_ssl, SSL *server_ssl)
+{
+	BIO *client_wbio = NULL, *server_wbio = NULL;
+	int ret = 0;
+
+	if ((client_wbio = BIO_new(BIO_s_mem())) == NULL)
+		goto err;
+	if ((server_wbio = BIO_new(BIO_s_mem())) == NULL)
+		goto err;
+	if (BIO_set_mem_eof_return(client_wbio, -1) <= 0)
+		goto err;
+	if (BIO_set_mem_eof_return(server_wbio, -1) <= 0)
+		goto err;
+
+	/* Avoid double free. SSL_set_bio() takes ownership of the BIOs. */
+	BIO_up_ref(client_wbio);
+	BIO_up_ref(server_wbio);
+
+	SSL_set_bio(client_ssl, server_wbio, client_wbio);
+	SSL_set_bio(server_ssl, client_wbio, server_wbio);
+	client_wbio = NULL;
+	server_wbio = NULL;
+
+	ret = 1;
+
+ err:
+	BIO_free(client_wbio);
+	BIO_free(server_wbio);
+
+	return ret;
+}
+
+static int
+push_data_to_peer(SSL *ssl, int *ret, int (*func)(SSL *), const char *func_name)
+{
+	int ssl_err = 0;
+
+	if (*ret == 1)
+		return 1;
+
+	do {
+		if ((*ret = func(ssl)) <= 0)
+			ssl_err = SSL_get_error(ssl, *ret);
+	} while (*ret <= 0 && ssl_err == SSL_ERROR_WANT_WRITE);
+
+	if (*ret <= 0 && ssl_err != SSL_ERROR_WANT_READ) {
+		fprintf(stderr, "FAIL: %s failed\n", func_name);
+		ERR_print_errors_fp(stderr);
+		return 0;
+	}
+
+	return 1;
+}
+
+static int
+handshake(SSL *client_ssl, SSL *server_ssl)
+{
+	int loops = 0, client_ret = 0, server_ret = 0;
+
+	while (loops++ < 10 && (client_ret <= 0 || server_ret <= 0)) {
+		if (!push_data_to_peer(client_ssl, &client_ret, SSL_connect,
+		    "SSL_connect"))
+			return 0;
+
+		if (!push_data_to_peer(server_ssl, &server_ret, SSL_accept,
+		    "SSL_accept"))
+			return 0;
+	}
+
+	if (client_ret != 1 || server_ret != 1) {
+		fprintf(stderr, "FAIL: handshake did not complete\n");
+		return 0;
+	}
+
+	return 1;
+}
+
+#define N_HANDSHAKES	8
+
+/* Run a handshake and return the encoded ephemeral key of the server. */
+static int
+handshake_server_key(SSL_CTX *client_ctx, SSL_CTX *server_ctx,
+    uint8_t **out, size_t *out_len)
+{
+	SSL *client_ssl = NULL, *server_ssl = NULL;
+	EVP_PKEY *pkey = NULL;
+	EC_KEY *ec_key;
+	uint8_t *data = NULL;
+	int len;
+	int ret = 0;
+
+	if ((client_ssl = SSL_new(client_ctx)) == NULL)
+		goto failure;
+	if ((server_ssl = SSL_new(server_ctx)) == NULL)
+		goto failure;
+	if (!connect_peers(client_ssl, server_ssl))
+		goto failure;
+	if (!handshake(client_ssl, server_ssl))
+		goto failure;
+
+	if (!SSL_get_server_tmp_key(client_ssl, &pkey)) {
+		fprintf(stderr, "FAIL: no server key\n");
+		goto failure;
+	}
+	if ((ec_key = EVP_PKEY_get0_EC_KEY(pkey)) == NULL) {
+		fprintf(stderr, "FAIL: server key is not an EC key\n");
+		goto failure;
+	}
+	if ((len = i2o_ECPublicKey(ec_key, &data)) <= 0) {
+		fprintf(stderr, "FAIL: i2o_ECPublicKey\n");
+		goto failure;
+	}
+
+	*out = data;
+	*out_len = len;
+	data = NULL;
+
+	ret = 1;
+
+ failure:
+	free(data);
+	EVP_PKEY_free(pkey);
+	SSL_free(client_ssl);
+	SSL_free(server_ssl);
+
+	return ret;
+}
+
+static int
+key_share_pool_test(void)
+{
+	SSL_CTX *client_ctx = NULL, *server_ctx = NULL;
+	uint8_t *keys[N_HANDSHAKES + 1] = { 0 };
+	size_t key_lens[N_HANDSHAKES + 1] = { 0 };
+	int i, j;
+	int failed = 1;
+
+	if ((client_ctx = ssl_ctx_new(TLS1_3_VERSION, 0)) == NULL)
+		goto failure;
+	if ((server_ctx = ssl_ctx_new(TLS1_3_VERSION, 1)) == NULL)
+		goto failure;
+
+	if (SSL_CTX_get_key_share_pool_size(server_ctx) != 0) {
+		fprintf(stderr, "FAIL: pool enabled by default\n");
+		goto failure;
+	}
+	if (SSL_CTX_set_key_share_pool_size(server_ctx, 100000)) {
+		fprintf(stderr, "FAIL: set an oversized pool\n");
+		goto failure;
+	}
+	if (!SSL_CTX_set_key_share_pool_size(client_ctx, 4) ||
+	    !SSL_CTX_set_key_share_pool_size(server_ctx, 4)) {
+		fprintf(stderr, "FAIL: SSL_CTX_set_key_share_pool_size\n");
+		goto failure;
+	}
+	if (SSL_CTX_get_key_share_pool_size(server_ctx) != 4) {
+		fprintf(stderr, "FAIL: wrong pool size\n");
+		goto failure;
+	}
+
+	/*
+	 * The first handshake adds the group, after which the pool is
+	 * filled. Later handshakes drain it faster than it is refilled.
+	 */
+	for (i = 0; i < N_HANDSHAKES; i++) {
+		if (!handshake_server_key(client_ctx, server_ctx, &keys[i],
+		    &key_lens[i]))
+			goto failure;
+		if (i == 0 && (!SSL_CTX_fill_key_share_pool(client_ctx) ||
+		    !SSL_CTX_fill_key_share_pool(server_ctx))) {
+			fprintf(stderr, "FAIL: SSL_CTX_fill_key_share_pool\n");
+			goto failure;
+		}
+	}
+
+	/* Without the pool, keys are generated during the handshake. */
+	if (!SSL_CTX_set_key_share_pool_size(server_ctx, 0)) {
+		fprintf(stderr, "FAIL: SSL_CTX_set_key_share_pool_size\n");
+		goto failure;
+	}
+	if (!handshake_server_key(client_ctx, server_ctx, &keys[i],
+	    &key_lens[i]))
+		goto failure;
+
+	for (i = 0; i <= N_HANDSHAKES; i++) {
+		for (j = 0; j < i; j++) {
+			if (key_lens[i] == key_lens[j] &&
+			    memcmp(keys[i], keys[j], key_lens[i]) == 0) {
+				fprintf(stderr, "FAIL: key %d reused as %d\n",
+				    j, i);
+				goto failure;
+			}
+		}
+	}
+
+	failed = 0;
+
+ failure:
+	for (i = 0; i <= N_HANDSHAKES; i++)
+		free(keys[i]);
+	SSL_CTX_free(client_ctx);
+	SSL_CTX_free(server_ctx);
+
+	return failed;
+}
+
+int
+main(int argc, char **argv)
+{
+	int failed = 0;
+
+	if (asprintf(&server_cert, "%s/server.pem", CERTSDIR) == -1) {
+		fprintf(stderr, "asprintf server_cert failed\n");
+		failed = 1;
+		goto err;
+	}
+	server_key = server_cert;
+
+	failed |= key_share_pool_test();
+
+	if (failed == 0)
+		printf("PASS %s\n", __FILE__);
+
+ err:
+	free(server_cert);
+
+	return failed;
+}
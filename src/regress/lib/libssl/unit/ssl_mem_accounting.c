@@ -0,0 +1,346 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/bio.h>
+#include <openssl/crypto.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+char *server_cert;
+char *server_key;
+
+static SSL_CTX *
+ssl_ctx_new(uint16_t min_version, uint16_t max_version, int server)
+{
+	SSL_CTX *ctx;
+
+	if ((ctx = SSL_CTX_new(TLS_method())) == NULL) {
+		fprintf(stderr, "SSL_CTX_new failed\n");
+		goto err;
+	}
+	if (!SSL_CTX_set_min_proto_version(ctx, min_version) ||
+	    !SSL_CTX_set_max_proto_version(ctx, max_version)) {
+		fprintf(stderr, "failed to set protocol version\n");
+		goto err;
+	}
+
+	if (server) {
+		if (!SSL_CTX_use_certificate_file(ctx, server_cert,
+		    SSL_FILETYPE_PEM)) {
+			fprintf(stderr, "use_certificate_file failed\n");
+			goto err;
+		}
+		if (!SSL_CTX_use_PrivateKey_file(ctx, server_key,
+		    SSL_FILETYPE_PEM)) {
+			fprintf(stderr, "use_PrivateKey_file failed\n");
+			goto err;
+		}
+	}
+
+	return ctx;
+
+ err:
+	SSL_CTX_free(ctx);
+	return NULL;
+}
+
+/* Connect client and server via a pair of "nonblocking" memory BIOs. */
+static int
+connect_peers(SSL *client_ssl, SSL *server_ssl)
+{
+	BIO *client_wbio = NULL, *server_wbio = NULL;
+	int ret = 0;
+
+	if ((client_wbio = BIO_new(BIO_s_mem())) == NULL)
+		goto err;
+	if ((server_wbio = BIO_new(BIO_s_mem())) == NULL)
+		goto err;
+	if (BIO_set_mem_eof_return(client_wbio, -1) <= 0)
+		goto err;
+	if (BIO_set_mem_eof_return(server_wbio, -1) <= 0)
+		goto err;
+
+	/* Avoid double free. SSL_set_bio() takes ownership of the BIOs. */
+	BIO_up_ref(client_wbio);
+	BIO_up_ref(server_wbio);
+
+	SSL_set_bio(client_ssl, server_wbio, client_wbio);
+	SSL_set_bio(server_ssl, client_wbio, server_wbio);
+	client_wbio = NULL;
+	server_wbio = NULL;
+
+	ret = 1;
+
+ err:
+	BIO_free(client_wbio);
+	BIO_free(server_wbio);
+
+	return ret;
+}
+
+static int
+push_data_to_peer(SSL *ssl, int *ret, int (*func)(SSL *), const char *func_name,
+    int quiet)
+{
+	int ssl_err = 0;
+
+	if (*ret == 1)
+		return 1;
+
+	do {
+		if ((*ret = func(ssl)) <= 0)
+			ssl_err = SSL_get_error(ssl, *ret);
+	} while (*ret <= 0 && ssl_err == SSL_ERROR_WANT_WRITE);
+
+	if (*ret <= 0 && ssl_err != SSL_ERROR_WANT_READ) {
+		if (!quiet) {
+			fprintf(stderr, "FAIL: %s failed\n", func_name);
+			ERR_print_errors_fp(stderr);
+		}
+		return 0;
+	}
+
+	return 1;
+}
+
+static int
+handshake(SSL *client_ssl, SSL *server_ssl, int quiet)
+{
+	int loops = 0, client_ret = 0, server_ret = 0;
+
+	while (loops++ < 10 && (client_ret <= 0 || server_ret <= 0)) {
+		if (!push_data_to_peer(client_ssl, &client_ret, SSL_connect,
+		    "SSL_connect", quiet))
+			return 0;
+
+		if (!push_data_to_peer(server_ssl, &server_ret, SSL_accept,
+		    "SSL_accept", quiet))
+			return 0;
+	}
+
+	if (client_ret != 1 || server_ret != 1) {
+		if (!quiet)
+			fprintf(stderr, "FAIL: handshake did not complete\n");
+		return 0;
+	}
+
+	return 1;
+}
+
+static void
+mem_snapshot(CRYPTO_MEM_COUNTS *counts)
+{
+	int i;
+
+	for (i = 0; i < CRYPTO_MEM_SUBSYSTEMS; i++)
+		CRYPTO_mem_get_counts(i, &counts[i]);
+}
+
+static void
+mem_print(const char *what, const CRYPTO_MEM_COUNTS *start,
+    const CRYPTO_MEM_COUNTS *end, uint64_t n)
+{
+	int i;
+
+	printf("allocations per %s:", what);
+	for (i = 0; i < CRYPTO_MEM_SUBSYSTEMS; i++) {
+		printf(" %s %.2f", CRYPTO_mem_subsystem_name(i),
+		    (double)(end[i].allocations - start[i].allocations) / n);
+	}
+	printf("\n");
+}
+
+struct mem_file_test {
+	const char *file;
+	int subsystem;
+};
+
+static const struct mem_file_test mem_file_tests[] = {
+	{ "/usr/src/lib/libcrypto/asn1/tasn_dec.c", CRYPTO_MEM_ASN1 },
+	{ "/usr/src/lib/libcrypto/x509/x509_vfy.c", CRYPTO_MEM_X509 },
+	{ "/usr/src/lib/libcrypto/bn/bn_lib.c", CRYPTO_MEM_BN },
+	{ "/usr/src/lib/libcrypto/evp/digest.c", CRYPTO_MEM_EVP },
+	{ "/usr/src/lib/libcrypto/cryptlib.c", CRYPTO_MEM_OTHER },
+	{ "/usr/src/lib/libssl/tls13_record_layer.c", CRYPTO_MEM_SSL_RECORD },
+	{ "/usr/src/lib/libssl/tls13_client.c", CRYPTO_MEM_SSL_HANDSHAKE },
+	{ "/usr/src/lib/libssl/ssl_lib.c", CRYPTO_MEM_SSL },
+	{ "ssl_pkt.c", CRYPTO_MEM_SSL_RECORD },
+	{ "bn_lib.c", CRYPTO_MEM_OTHER },
+	{ NULL, CRYPTO_MEM_OTHER },
+};
+
+#define N_MEM_FILE_TESTS \
+    (sizeof(mem_file_tests) / sizeof(mem_file_tests[0]))
+
+/* Allocations are counted against the subsystem of the file making them. */
+static int
+mem_file_test(void)
+{
+	CRYPTO_MEM_COUNTS start[CRYPTO_MEM_SUBSYSTEMS];
+	CRYPTO_MEM_COUNTS end[CRYPTO_MEM_SUBSYSTEMS];
+	const struct mem_file_test *mft;
+	size_t i;
+	int j;
+
+	for (i = 0; i < N_MEM_FILE_TESTS; i++) {
+		mft = &mem_file_tests[i];
+
+		mem_snapshot(start);
+		CRYPTO_mem_count_alloc(mft->file, 100);
+		CRYPTO_mem_count_free(mft->file);
+		mem_snapshot(end);
+
+		for (j = 0; j < CRYPTO_MEM_SUBSYSTEMS; j++) {
+			uint64_t allocs, bytes, frees;
+
+			allocs = end[j].allocations - start[j].allocations;
+			bytes = end[j].bytes - start[j].bytes;
+			frees = end[j].frees - start[j].frees;
+			if (j != mft->subsystem) {
+				if (allocs != 0 || bytes != 0 || frees != 0) {
+					fprintf(stderr, "FAIL: %s counted "
+					    "against %s\n", mft->file,
+					    CRYPTO_mem_subsystem_name(j));
+					return 1;
+				}
+				continue;
+			}
+			if (allocs != 1 || bytes != 100 || frees != 1) {
+				fprintf(stderr, "FAIL: %s counted %llu "
+				    "allocations, %llu bytes and %llu frees "
+				    "against %s\n", mft->file,
+				    (unsigned long long)allocs,
+				    (unsigned long long)bytes,
+				    (unsigned long long)frees,
+				    CRYPTO_mem_subsystem_name(j));
+				return 1;
+			}
+		}
+	}
+
+	if (CRYPTO_mem_get_counts(CRYPTO_MEM_SUBSYSTEMS, &start[0])) {
+		fprintf(stderr, "FAIL: got counts for an unknown subsystem\n");
+		return 1;
+	}
+	if (CRYPTO_mem_subsystem_name(-1) != NULL) {
+		fprintf(stderr, "FAIL: got a name for an unknown subsystem\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * With a library built with CRYPTO_MEM_ACCOUNTING, a handshake allocates
+ * in libssl's handshake code and the records written after it are counted
+ * against the record layer, if they allocate at all.
+ */
+static int
+mem_handshake_test(uint16_t version, int accounting)
+{
+	CRYPTO_MEM_COUNTS start[CRYPTO_MEM_SUBSYSTEMS];
+	CRYPTO_MEM_COUNTS mid[CRYPTO_MEM_SUBSYSTEMS];
+	CRYPTO_MEM_COUNTS end[CRYPTO_MEM_SUBSYSTEMS];
+	SSL_CTX *client_ctx = NULL, *server_ctx = NULL;
+	SSL *client_ssl = NULL, *server_ssl = NULL;
+	uint8_t buf[1024];
+	int i, failed = 1;
+
+	memset(buf, 'A', sizeof(buf));
+
+	if ((client_ctx = ssl_ctx_new(version, version, 0)) == NULL)
+		goto failure;
+	if ((server_ctx = ssl_ctx_new(version, version, 1)) == NULL)
+		goto failure;
+	if ((client_ssl = SSL_new(client_ctx)) == NULL)
+		goto failure;
+	if ((server_ssl = SSL_new(server_ctx)) == NULL)
+		goto failure;
+	if (!connect_peers(client_ssl, server_ssl))
+		goto failure;
+
+	mem_snapshot(start);
+	if (!handshake(client_ssl, server_ssl, 0))
+		goto failure;
+	mem_snapshot(mid);
+
+	for (i = 0; i < 16; i++) {
+		if (SSL_write(client_ssl, buf, sizeof(buf)) != sizeof(buf)) {
+			fprintf(stderr, "FAIL: SSL_write failed\n");
+			goto failure;
+		}
+		if (SSL_read(server_ssl, buf, sizeof(buf)) != sizeof(buf)) {
+			fprintf(stderr, "FAIL: SSL_read failed\n");
+			goto failure;
+		}
+	}
+	mem_snapshot(end);
+
+	if (accounting) {
+		if (mid[CRYPTO_MEM_SSL_HANDSHAKE].allocations ==
+		    start[CRYPTO_MEM_SSL_HANDSHAKE].allocations) {
+			fprintf(stderr, "FAIL: no handshake allocations\n");
+			goto failure;
+		}
+		mem_print("handshake", start, mid, 1);
+		mem_print("record", mid, end, 16);
+	}
+
+	failed = 0;
+
+ failure:
+	SSL_free(client_ssl);
+	SSL_free(server_ssl);
+	SSL_CTX_free(client_ctx);
+	SSL_CTX_free(server_ctx);
+
+	return failed;
+}
+
+int
+main(int argc, char **argv)
+{
+	int accounting, failed = 0;
+
+	if (asprintf(&server_cert, "%s/server.pem", CERTSDIR) == -1) {
+		fprintf(stderr, "asprintf server_cert failed\n");
+		failed = 1;
+		goto err;
+	}
+	server_key = server_cert;
+
+	accounting = CRYPTO_mem_accounting(1);
+
+	failed |= mem_file_test();
+	failed |= mem_handshake_test(TLS1_2_VERSION, accounting);
+	failed |= mem_handshake_test(TLS1_3_VERSION, accounting);
+
+	CRYPTO_mem_accounting(0);
+
+	if (failed == 0)
+		printf("PASS %s\n", __FILE__);
+
+ err:
+	free(server_cert);
+
+	return failed;
+}
@@ -121,8 +121,12 @@ do_keypair_tests(void)
 		goto done;
 	if (compare_mem("key", key, key_len, kp->key_mem, kp->cert_len) == -1)
 		goto done;
+	if (kp->ocsp_staple == NULL) {
+		fprintf(stderr, "FAIL: no ocsp staple\n");
+		goto done;
+	}
 	if (compare_mem("ocsp staple", ocsp_staple, ocsp_staple_len,
-	    kp->ocsp_staple, kp->ocsp_staple_len) == -1)
+	    kp->ocsp_staple->data, kp->ocsp_staple->len) == -1)
 		goto done;
 	if (strcmp(kp->pubkey_hash, PUBKEY_HASH) != 0) {
 		fprintf(stderr, "FAIL: got pubkey hash '%s', want '%s'",
@@ -156,8 +160,12 @@ do_keypair_tests(void)
 		goto done;
 	if (compare_mem("key", key, key_len, kp->key_mem, kp->cert_len) == -1)
 		goto done;
+	if (kp->ocsp_staple == NULL) {
+		fprintf(stderr, "FAIL: no ocsp staple\n");
+		goto done;
+	}
 	if (compare_mem("ocsp staple", ocsp_staple, ocsp_staple_len,
-	    kp->ocsp_staple, kp->ocsp_staple_len) == -1)
+	    kp->ocsp_staple->data, kp->ocsp_staple->len) == -1)
 		goto done;
 	if (strcmp(kp->pubkey_hash, PUBKEY_HASH) != 0) {
 		fprintf(stderr, "FAIL: got pubkey hash '%s', want '%s'",
@@ -190,6 +198,88 @@ do_keypair_tests(void)
 	return (failed);
 }
 
+static struct tls_keypair *
+keypair_from_mem(const uint8_t *cert, size_t cert_len, const uint8_t *key,
+    size_t key_len)
+{
+	struct tls_keypair *kp;
+	struct tls_error err;
+
+	if ((kp = tls_keypair_new()) == NULL)
+		errx(1, "failed to create keypair");
+	if (tls_keypair_set_cert_mem(kp, &err, cert, cert_len) == -1)
+		errx(1, "failed to load cert: %s", err.msg);
+	if (tls_keypair_set_key_mem(kp, &err, key, key_len) == -1)
+		errx(1, "failed to load key: %s", err.msg);
+
+	return (kp);
+}
+
+static int
+do_keypair_cache_tests(void)
+{
+	struct tls_parsed_keypair *parsed1 = NULL, *parsed2 = NULL;
+	struct tls_keypair *kp1 = NULL, *kp2 = NULL;
+	size_t cert_len, key_len;
+	const uint8_t *cert, *key;
+	struct tls_error err;
+	int failed = 1;
+
+	load_file(cert_file, &cert, &cert_len);
+	load_file(key_file, &key, &key_len);
+
+	kp1 = keypair_from_mem(cert, cert_len, key, key_len);
+	kp2 = keypair_from_mem(cert, cert_len, key, key_len);
+
+	if ((parsed1 = tls_keypair_cache_get(kp1, &err)) == NULL) {
+		fprintf(stderr, "FAIL: failed to parse keypair: %s\n", err.msg);
+		goto done;
+	}
+	if ((parsed2 = tls_keypair_cache_get(kp2, &err)) == NULL) {
+		fprintf(stderr, "FAIL: failed to parse keypair: %s\n", err.msg);
+		goto done;
+	}
+	if (parsed1 != parsed2) {
+		fprintf(stderr, "FAIL: identical keypairs parsed twice\n");
+		goto done;
+	}
+	if (kp1->parsed != parsed1 || kp2->parsed != parsed2) {
+		fprintf(stderr, "FAIL: parsed keypair not kept\n");
+		goto done;
+	}
+	tls_keypair_cache_put(parsed1);
+	tls_keypair_cache_put(parsed2);
+	parsed1 = parsed2 = NULL;
+
+	tls_keypair_clear_key(kp1);
+	if (kp1->parsed != NULL) {
+		fprintf(stderr, "FAIL: parsed keypair kept after clearing key\n");
+		goto done;
+	}
+	if (tls_keypair_set_key_mem(kp1, &err, key, key_len) == -1) {
+		fprintf(stderr, "FAIL: failed to load key: %s\n", err.msg);
+		goto done;
+	}
+	if ((parsed1 = tls_keypair_cache_get(kp1, &err)) == NULL) {
+		fprintf(stderr, "FAIL: failed to parse keypair: %s\n", err.msg);
+		goto done;
+	}
+	if (parsed1 != kp2->parsed) {
+		fprintf(stderr, "FAIL: identical keypairs parsed twice\n");
+		goto done;
+	}
+
+	failed = 0;
+
+ done:
+	tls_keypair_cache_put(parsed1);
+	tls_keypair_cache_put(parsed2);
+	tls_keypair_free(kp1);
+	tls_keypair_free(kp2);
+
+	return (failed);
+}
+
 int
 main(int argc, char **argv)
 {
@@ -206,6 +296,7 @@ main(int argc, char **argv)
 	key_file = argv[3];
 
 	failure |= do_keypair_tests();
+	failure |= do_keypair_cache_tests();
 
 	return (failure);
 }
@@ -0,0 +1,581 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Test the OCSP staple refresh of a server configuration against an OCSP
+ * responder that runs in a thread of the test.
+ */
+
+#include <sys/socket.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <err.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <openssl/ec.h>
+#include <openssl/ocsp.h>
+#include <openssl/pem.h>
+#include <openssl/x509v3.h>
+
+#include <tls.h>
+
+#include "tls_internal.h"
+
+enum responder_mode {
+	RESPONDER_GOOD,
+	RESPONDER_REVOKED,
+	RESPONDER_WRONG_SIGNER,
+};
+
+struct responder {
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	int fd;
+	int stop;
+	int requests;
+
+	enum responder_mode mode;
+	X509 *ca;
+	EVP_PKEY *ca_key;
+	X509 *other;
+	EVP_PKEY *other_key;
+};
+
+static EVP_PKEY *
+key_new(void)
+{
+	EVP_PKEY *pkey;
+	EC_KEY *eckey;
+
+	if ((eckey = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1)) == NULL)
+		errx(1, "EC_KEY_new_by_curve_name");
+	EC_KEY_set_asn1_flag(eckey, OPENSSL_EC_NAMED_CURVE);
+	if (!EC_KEY_generate_key(eckey))
+		errx(1, "EC_KEY_generate_key");
+	if ((pkey = EVP_PKEY_new()) == NULL)
+		errx(1, "EVP_PKEY_new");
+	if (!EVP_PKEY_assign_EC_KEY(pkey, eckey))
+		errx(1, "EVP_PKEY_assign_EC_KEY");
+
+	return pkey;
+}
+
+static void
+cert_add_ext(X509 *cert, int nid, const char *value)
+{
+	X509_EXTENSION *ext;
+
+	if ((ext = X509V3_EXT_conf_nid(NULL, NULL, nid, (char *)value)) == NULL)
+		errx(1, "X509V3_EXT_conf_nid");
+	if (!X509_add_ext(cert, ext, -1))
+		errx(1, "X509_add_ext");
+	X509_EXTENSION_free(ext);
+}
+
+/* Make an unsigned certificate, which is a CA if issuer is NULL. */
+static X509 *
+cert_new(const char *cn, long serial, EVP_PKEY *pkey, X509 *issuer)
+{
+	X509_NAME *name;
+	X509 *cert;
+
+	if ((cert = X509_new()) == NULL)
+		errx(1, "X509_new");
+	if (!X509_set_version(cert, 2))
+		errx(1, "X509_set_version");
+	if (!ASN1_INTEGER_set(X509_get_serialNumber(cert), serial))
+		errx(1, "ASN1_INTEGER_set");
+	if (X509_gmtime_adj(X509_get_notBefore(cert), -60 * 60) == NULL ||
+	    X509_gmtime_adj(X509_get_notAfter(cert), 24 * 60 * 60) == NULL)
+		errx(1, "X509_gmtime_adj");
+	if ((name = X509_NAME_new()) == NULL)
+		errx(1, "X509_NAME_new");
+	if (!X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+	    (const unsigned char *)cn, -1, -1, 0))
+		errx(1, "X509_NAME_add_entry_by_txt");
+	if (!X509_set_subject_name(cert, name))
+		errx(1, "X509_set_subject_name");
+	if (!X509_set_issuer_name(cert, issuer != NULL ?
+	    X509_get_subject_name(issuer) : name))
+		errx(1, "X509_set_issuer_name");
+	X509_NAME_free(name);
+	if (!X509_set_pubkey(cert, pkey))
+		errx(1, "X509_set_pubkey");
+
+	if (issuer == NULL)
+		cert_add_ext(cert, NID_basic_constraints, "critical,CA:TRUE");
+
+	return cert;
+}
+
+static void
+cert_sign(X509 *cert, EVP_PKEY *pkey)
+{
+	if (!X509_sign(cert, pkey, EVP_sha256()))
+		errx(1, "X509_sign");
+}
+
+static uint8_t *
+pem_cat(X509 *cert1, X509 *cert2, EVP_PKEY *pkey, size_t *len)
+{
+	BIO *bio;
+	uint8_t *buf;
+	char *data;
+	long n;
+
+	if ((bio = BIO_new(BIO_s_mem())) == NULL)
+		errx(1, "BIO_new");
+	if (cert1 != NULL && !PEM_write_bio_X509(bio, cert1))
+		errx(1, "PEM_write_bio_X509");
+	if (cert2 != NULL && !PEM_write_bio_X509(bio, cert2))
+		errx(1, "PEM_write_bio_X509");
+	if (pkey != NULL && !PEM_write_bio_PrivateKey(bio, pkey, NULL, NULL, 0,
+	    NULL, NULL))
+		errx(1, "PEM_write_bio_PrivateKey");
+	if ((n = BIO_get_mem_data(bio, &data)) <= 0)
+		errx(1, "BIO_get_mem_data");
+	if ((buf = malloc(n)) == NULL)
+		err(1, NULL);
+	memcpy(buf, data, n);
+	*len = n;
+	BIO_free(bio);
+
+	return buf;
+}
+
+static OCSP_REQUEST *
+responder_read_request(int fd)
+{
+	OCSP_REQUEST *req;
+	const unsigned char *p;
+	char buf[4096], *body, *cl;
+	size_t len = 0;
+	ssize_t n;
+	long content_length;
+
+	for (;;) {
+		if (len >= sizeof(buf) - 1)
+			return NULL;
+		if ((n = read(fd, buf + len, sizeof(buf) - 1 - len)) <= 0)
+			return NULL;
+		len += n;
+		buf[len] = '\0';
+
+		if ((body = strstr(buf, "\r\n\r\n")) == NULL)
+			continue;
+		body += 4;
+		if ((cl = strcasestr(buf, "Content-Length:")) == NULL ||
+		    cl > body)
+			return NULL;
+		content_length = strtol(cl + 15, NULL, 10);
+		if (content_length <= 0 ||
+		    content_length > (long)(sizeof(buf) - 1 - (body - buf)))
+			return NULL;
+		if (len - (body - buf) >= (size_t)content_length)
+			break;
+	}
+
+	p = (const unsigned char *)body;
+	req = d2i_OCSP_REQUEST(NULL, &p, content_length);
+
+	return req;
+}
+
+static void
+responder_reply(struct responder *rs, int fd, OCSP_REQUEST *req)
+{
+	OCSP_BASICRESP *bs;
+	OCSP_RESPONSE *resp;
+	OCSP_ONEREQ *one;
+	ASN1_TIME *now, *next, *revoked = NULL;
+	unsigned char *der = NULL;
+	char hdr[256];
+	int status = V_OCSP_CERTSTATUS_GOOD;
+	int len, hdr_len;
+
+	if ((one = OCSP_request_onereq_get0(req, 0)) == NULL)
+		errx(1, "OCSP_request_onereq_get0");
+	if ((bs = OCSP_BASICRESP_new()) == NULL)
+		errx(1, "OCSP_BASICRESP_new");
+	if ((now = X509_gmtime_adj(NULL, 0)) == NULL ||
+	    (next = X509_gmtime_adj(NULL, 60 * 60)) == NULL)
+		errx(1, "X509_gmtime_adj");
+	if (rs->mode == RESPONDER_REVOKED) {
+		status = V_OCSP_CERTSTATUS_REVOKED;
+		if ((revoked = X509_gmtime_adj(NULL, -60)) == NULL)
+			errx(1, "X509_gmtime_adj");
+	}
+	if (OCSP_basic_add1_status(bs, OCSP_onereq_get0_id(one), status,
+	    OCSP_REVOKED_STATUS_KEYCOMPROMISE, revoked, now, next) == NULL)
+		errx(1, "OCSP_basic_add1_status");
+
+	if (rs->mode == RESPONDER_WRONG_SIGNER) {
+		if (!OCSP_basic_sign(bs, rs->other, rs->other_key, EVP_sha256(),
+		    NULL, 0))
+			errx(1, "OCSP_basic_sign");
+	} else {
+		if (!OCSP_basic_sign(bs, rs->ca, rs->ca_key, EVP_sha256(),
+		    NULL, 0))
+			errx(1, "OCSP_basic_sign");
+	}
+
+	if ((resp = OCSP_response_create(OCSP_RESPONSE_STATUS_SUCCESSFUL,
+	    bs)) == NULL)
+		errx(1, "OCSP_response_create");
+	if ((len = i2d_OCSP_RESPONSE(resp, &der)) <= 0)
+		errx(1, "i2d_OCSP_RESPONSE");
+
+	hdr_len = snprintf(hdr, sizeof(hdr), "HTTP/1.0 200 OK\r\n"
+	    "Content-Type: application/ocsp-response\r\n"
+	    "Content-Length: %d\r\n\r\n", len);
+	if (hdr_len < 0 || (size_t)hdr_len >= sizeof(hdr))
+		errx(1, "snprintf");
+	if (write(fd, hdr, hdr_len) != hdr_len || write(fd, der, len) != len)
+		warn("responder write");
+
+	free(der);
+	ASN1_TIME_free(now);
+	ASN1_TIME_free(next);
+	ASN1_TIME_free(revoked);
+	OCSP_RESPONSE_free(resp);
+	OCSP_BASICRESP_free(bs);
+}
+
+static void *
+responder_thread(void *arg)
+{
+	struct responder *rs = arg;
+	OCSP_REQUEST *req;
+	struct pollfd pfd;
+	int fd, stop;
+
+	for (;;) {
+		pthread_mutex_lock(&rs->mutex);
+		stop = rs->stop;
+		pthread_mutex_unlock(&rs->mutex);
+		if (stop)
+			break;
+
+		pfd.fd = rs->fd;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, 100) != 1)
+			continue;
+		if ((fd = accept(rs->fd, NULL, NULL)) == -1)
+			continue;
+
+		if ((req = responder_read_request(fd)) != NULL) {
+			responder_reply(rs, fd, req);
+			OCSP_REQUEST_free(req);
+		}
+		close(fd);
+
+		pthread_mutex_lock(&rs->mutex);
+		rs->requests++;
+		pthread_mutex_unlock(&rs->mutex);
+	}
+
+	return NULL;
+}
+
+static int
+responder_requests(struct responder *rs)
+{
+	int requests;
+
+	pthread_mutex_lock(&rs->mutex);
+	requests = rs->requests;
+	pthread_mutex_unlock(&rs->mutex);
+
+	return requests;
+}
+
+static int
+test_refresh_time(void)
+{
+	static const struct {
+		time_t now, this_update, next_update, want;
+	} tests[] = {
+		/* Halfway through the validity period. */
+		{ 1000000, 1000000, 1000000 + 7200, 1000000 + 3600 },
+		{ 1000000, 1000000 - 3600, 1000000 + 3600, 1000000 + 60 },
+		{ 1000000, 1000000 - 600, 1000000 + 7200, 1000000 + 3300 },
+		/* Never sooner than a minute from now. */
+		{ 1000000, 1000000, 1000000 + 60, 1000000 + 60 },
+		{ 1000000, 1000000 - 7200, 1000000 - 3600, 1000000 + 60 },
+		/* Never later than a day from now. */
+		{ 1000000, 1000000, 1000000 + 7 * 86400, 1000000 + 86400 },
+		/* No nextUpdate, or a broken one. */
+		{ 1000000, 1000000, -1, 1000000 + 86400 },
+		{ 1000000, 1000000, 1000000 - 1, 1000000 + 86400 },
+	};
+	size_t i;
+	time_t got;
+	int failed = 0;
+
+	for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+		got = tls_ocsp_refresh_time(tests[i].now, tests[i].this_update,
+		    tests[i].next_update);
+		if (got != tests[i].want) {
+			fprintf(stderr, "FAIL: refresh time %zu: got %lld, "
+			    "want %lld\n", i, (long long)got,
+			    (long long)tests[i].want);
+			failed = 1;
+		}
+	}
+
+	return failed;
+}
+
+static int
+do_handshake(struct tls *client, struct tls *server_cctx)
+{
+	int client_done = 0, server_done = 0;
+	int i, rv;
+
+	for (i = 0; i < 100 && (client_done == 0 || server_done == 0); i++) {
+		if (client_done == 0) {
+			rv = tls_handshake(client);
+			if (rv == 0)
+				client_done = 1;
+			else if (rv != TLS_WANT_POLLIN && rv != TLS_WANT_POLLOUT)
+				errx(1, "client handshake failed: %s",
+				    tls_error(client));
+		}
+		if (server_done == 0) {
+			rv = tls_handshake(server_cctx);
+			if (rv == 0)
+				server_done = 1;
+			else if (rv != TLS_WANT_POLLIN && rv != TLS_WANT_POLLOUT)
+				errx(1, "server handshake failed: %s",
+				    tls_error(server_cctx));
+		}
+	}
+
+	return client_done && server_done;
+}
+
+/* Check that a client that requires stapling accepts the staple. */
+static int
+test_stapled_handshake(struct tls *server, const uint8_t *ca_pem,
+    size_t ca_len)
+{
+	struct tls_config *client_cfg;
+	struct tls *client, *server_cctx;
+	int failed = 1;
+	int sv[2];
+
+	if ((client = tls_client()) == NULL)
+		errx(1, "tls_client");
+	if ((client_cfg = tls_config_new()) == NULL)
+		errx(1, "tls_config_new");
+	if (tls_config_set_ca_mem(client_cfg, ca_pem, ca_len) == -1)
+		errx(1, "tls_config_set_ca_mem: %s",
+		    tls_config_error(client_cfg));
+	tls_config_ocsp_require_stapling(client_cfg);
+	if (tls_configure(client, client_cfg) == -1)
+		errx(1, "tls_configure: %s", tls_error(client));
+
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, PF_UNSPEC,
+	    sv) == -1)
+		err(1, "socketpair");
+	if (tls_accept_socket(server, &server_cctx, sv[0]) == -1)
+		errx(1, "tls_accept_socket: %s", tls_error(server));
+	if (tls_connect_socket(client, sv[1], "localhost") == -1)
+		errx(1, "tls_connect_socket: %s", tls_error(client));
+
+	if (!do_handshake(client, server_cctx)) {
+		fprintf(stderr, "FAIL: handshake did not complete\n");
+		goto done;
+	}
+	if (tls_peer_ocsp_response_status(client) !=
+	    TLS_OCSP_RESPONSE_SUCCESSFUL) {
+		fprintf(stderr, "FAIL: stapled response status is %d\n",
+		    tls_peer_ocsp_response_status(client));
+		goto done;
+	}
+	if (tls_peer_ocsp_cert_status(client) != TLS_OCSP_CERT_GOOD) {
+		fprintf(stderr, "FAIL: stapled certificate status is %d\n",
+		    tls_peer_ocsp_cert_status(client));
+		goto done;
+	}
+
+	failed = 0;
+
+ done:
+	tls_free(server_cctx);
+	tls_free(client);
+	tls_config_free(client_cfg);
+	close(sv[0]);
+	close(sv[1]);
+
+	return failed;
+}
+
+static int
+test_refresh(enum responder_mode mode)
+{
+	struct responder rs;
+	struct sockaddr_in sin;
+	socklen_t sin_len;
+	struct tls_config *cfg;
+	struct tls_ocsp_staple *staple;
+	struct tls *server;
+	EVP_PKEY *leaf_key;
+	X509 *leaf;
+	uint8_t *cert_pem, *key_pem, *ca_pem;
+	size_t cert_len, key_len, ca_len;
+	char aia[64];
+	int failed = 1;
+	int i;
+
+	memset(&rs, 0, sizeof(rs));
+	rs.mode = mode;
+	if (pthread_mutex_init(&rs.mutex, NULL) != 0)
+		errx(1, "pthread_mutex_init");
+
+	if ((rs.fd = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+		err(1, "socket");
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(rs.fd, (struct sockaddr *)&sin, sizeof(sin)) == -1)
+		err(1, "bind");
+	if (listen(rs.fd, 5) == -1)
+		err(1, "listen");
+	sin_len = sizeof(sin);
+	if (getsockname(rs.fd, (struct sockaddr *)&sin, &sin_len) == -1)
+		err(1, "getsockname");
+
+	rs.ca_key = key_new();
+	rs.ca = cert_new("OCSP test CA", 1, rs.ca_key, NULL);
+	cert_sign(rs.ca, rs.ca_key);
+	rs.other_key = key_new();
+	rs.other = cert_new("OCSP test CA", 1, rs.other_key, NULL);
+	cert_sign(rs.other, rs.other_key);
+
+	leaf_key = key_new();
+	leaf = cert_new("localhost", 2, leaf_key, rs.ca);
+	cert_add_ext(leaf, NID_subject_alt_name, "DNS:localhost");
+	snprintf(aia, sizeof(aia), "OCSP;URI:http://127.0.0.1:%d/",
+	    ntohs(sin.sin_port));
+	cert_add_ext(leaf, NID_info_access, aia);
+	cert_sign(leaf, rs.ca_key);
+
+	cert_pem = pem_cat(leaf, rs.ca, NULL, &cert_len);
+	key_pem = pem_cat(NULL, NULL, leaf_key, &key_len);
+	ca_pem = pem_cat(rs.ca, NULL, NULL, &ca_len);
+
+	if (pthread_create(&rs.thread, NULL, responder_thread, &rs) != 0)
+		errx(1, "pthread_create");
+
+	if ((server = tls_server()) == NULL)
+		errx(1, "tls_server");
+	if ((cfg = tls_config_new()) == NULL)
+		errx(1, "tls_config_new");
+	if (tls_config_set_keypair_mem(cfg, cert_pem, cert_len, key_pem,
+	    key_len) == -1)
+		errx(1, "tls_config_set_keypair_mem: %s", tls_config_error(cfg));
+	if (tls_config_set_ca_mem(cfg, ca_pem, ca_len) == -1)
+		errx(1, "tls_config_set_ca_mem: %s", tls_config_error(cfg));
+	tls_config_ocsp_refresh_staples(cfg);
+	if (tls_configure(server, cfg) == -1)
+		errx(1, "tls_configure: %s", tls_error(server));
+
+	if (cfg->ocsp_refresh == NULL) {
+		fprintf(stderr, "FAIL: refresh was not started\n");
+		goto done;
+	}
+
+	/* Wait for the responder to have answered the first request. */
+	for (i = 0; i < 100 && responder_requests(&rs) == 0; i++)
+		usleep(100000);
+	if (responder_requests(&rs) == 0) {
+		fprintf(stderr, "FAIL: no OCSP request was made\n");
+		goto done;
+	}
+
+	/* Stop the refresh, so that it has dealt with the response. */
+	tls_ocsp_refresh_free(cfg->ocsp_refresh);
+	cfg->ocsp_refresh = NULL;
+
+	staple = tls_keypair_ocsp_staple(cfg->keypair);
+	if (mode == RESPONDER_GOOD) {
+		if (staple == NULL) {
+			fprintf(stderr, "FAIL: good response was not "
+			    "stapled\n");
+			goto done;
+		}
+		tls_ocsp_staple_free(staple);
+		if (test_stapled_handshake(server, ca_pem, ca_len) != 0)
+			goto done;
+	} else if (staple != NULL) {
+		fprintf(stderr, "FAIL: %s response was stapled\n",
+		    mode == RESPONDER_REVOKED ? "revoked" : "forged");
+		tls_ocsp_staple_free(staple);
+		goto done;
+	}
+
+	failed = 0;
+
+ done:
+	tls_free(server);
+	tls_config_free(cfg);
+
+	pthread_mutex_lock(&rs.mutex);
+	rs.stop = 1;
+	pthread_mutex_unlock(&rs.mutex);
+	pthread_join(rs.thread, NULL);
+	pthread_mutex_destroy(&rs.mutex);
+	close(rs.fd);
+
+	free(cert_pem);
+	free(key_pem);
+	free(ca_pem);
+	X509_free(leaf);
+	EVP_PKEY_free(leaf_key);
+	X509_free(rs.ca);
+	EVP_PKEY_free(rs.ca_key);
+	X509_free(rs.other);
+	EVP_PKEY_free(rs.other_key);
+
+	return failed;
+}
+
+int
+main(int argc, char **argv)
+{
+	int failed = 0;
+
+	failed |= test_refresh_time();
+	failed |= test_refresh(RESPONDER_GOOD);
+	failed |= test_refresh(RESPONDER_REVOKED);
+	failed |= test_refresh(RESPONDER_WRONG_SIGNER);
+
+	if (!failed)
+		printf("PASS\n");
+
+	return failed;
+}
@@ -193,6 +193,96 @@ do_client_server_close(char *desc, struct tls *client, struct tls *server_cctx)
 	return (0);
 }
 
+static int
+do_client_server_pending(char *desc, struct tls *client,
+    struct tls *server_cctx)
+{
+	const char msg[] = "pending data";
+	char buf[sizeof(msg)];
+	ssize_t ret;
+	int i;
+
+	i = 0;
+	do {
+		ret = tls_write(client, msg, sizeof(msg));
+	} while (i++ < 100 &&
+	    (ret == TLS_WANT_POLLIN || ret == TLS_WANT_POLLOUT));
+	if (ret != sizeof(msg)) {
+		printf("FAIL: %s client write failed: %s\n", desc,
+		    tls_error(client));
+		return (1);
+	}
+
+	i = 0;
+	do {
+		ret = tls_read(server_cctx, buf, 1);
+	} while (i++ < 100 &&
+	    (ret == TLS_WANT_POLLIN || ret == TLS_WANT_POLLOUT));
+	if (ret != 1) {
+		printf("FAIL: %s server read failed: %s\n", desc,
+		    tls_error(server_cctx));
+		return (1);
+	}
+
+	if ((ret = tls_pending(server_cctx)) != sizeof(msg) - 1) {
+		printf("FAIL: %s got %zd pending bytes, want %zu\n", desc,
+		    ret, sizeof(msg) - 1);
+		return (1);
+	}
+	if ((ret = tls_read(server_cctx, &buf[1], sizeof(buf) - 1)) !=
+	    sizeof(msg) - 1) {
+		printf("FAIL: %s server read of pending data failed: %s\n",
+		    desc, tls_error(server_cctx));
+		return (1);
+	}
+	if (memcmp(buf, msg, sizeof(msg)) != 0) {
+		printf("FAIL: %s server read wrong data\n", desc);
+		return (1);
+	}
+	if ((ret = tls_pending(server_cctx)) != 0) {
+		printf("FAIL: %s got %zd pending bytes, want 0\n", desc, ret);
+		return (1);
+	}
+
+	return (0);
+}
+
+static int
+do_client_server_metrics(char *desc, struct tls *client,
+    struct tls *server_cctx)
+{
+	struct tls_metrics cm, sm;
+
+	/* Only connections that have metrics enabled are checked. */
+	if (tls_conn_metrics(client, &cm) == -1 ||
+	    tls_conn_metrics(server_cctx, &sm) == -1)
+		return (0);
+
+	if (cm.bytes_written != sizeof("pending data") ||
+	    sm.bytes_read != sizeof("pending data")) {
+		printf("FAIL: %s got %llu bytes written and %llu bytes read, "
+		    "want %zu\n", desc, (unsigned long long)cm.bytes_written,
+		    (unsigned long long)sm.bytes_read, sizeof("pending data"));
+		return (1);
+	}
+	if (cm.records_written == 0 || sm.records_read == 0) {
+		printf("FAIL: %s no records were counted\n", desc);
+		return (1);
+	}
+	if (cm.handshake_round_trips == 0 || sm.handshake_round_trips == 0) {
+		printf("FAIL: %s no handshake round trips were counted\n",
+		    desc);
+		return (1);
+	}
+	if (cm.handshake_finish.tv_sec == 0 &&
+	    cm.handshake_finish.tv_nsec == 0) {
+		printf("FAIL: %s handshake finish time not set\n", desc);
+		return (1);
+	}
+
+	return (0);
+}
+
 static int
 do_client_server_test(char *desc, struct tls *client, struct tls *server_cctx)
 {
@@ -201,6 +291,11 @@ do_client_server_test(char *desc, struct tls *client, struct tls *server_cctx)
 
 	printf("INFO: %s TLS handshake completed successfully\n", desc);
 
+	if (do_client_server_pending(desc, client, server_cctx) != 0)
+		return (1);
+	if (do_client_server_metrics(desc, client, server_cctx) != 0)
+		return (1);
+
 	/* XXX - Do some reads and writes... */
 
 	if (do_client_server_close(desc, client, server_cctx) != 0)
@@ -387,6 +482,20 @@ do_tls_tests(void)
 
 	failure |= test_tls_fds(client, server);
 
+	tls_reset(client);
+	if (tls_configure(client, client_cfg) == -1)
+		errx(1, "failed to configure client: %s", tls_error(client));
+	tls_reset(server);
+	if (tls_configure(server, server_cfg) == -1)
+		errx(1, "failed to configure server: %s", tls_error(server));
+
+	failure |= test_tls_socket(client, server);
+
+	tls_config_enable_read_ahead(client_cfg);
+	tls_config_enable_read_ahead(server_cfg);
+	tls_config_enable_metrics(client_cfg);
+	tls_config_enable_metrics(server_cfg);
+
 	tls_reset(client);
 	if (tls_configure(client, client_cfg) == -1)
 		errx(1, "failed to configure client: %s", tls_error(client));
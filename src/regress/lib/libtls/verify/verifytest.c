@@ -15,6 +15,8 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <arpa/inet.h>
+
 #include <err.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -22,8 +24,7 @@
 #include <openssl/x509v3.h>
 #include <tls.h>
 
-extern int tls_check_name(struct tls *ctx, X509 *cert, const char *name,
-    int *match);
+#include "tls_internal.h"
 
 struct alt_name {
 	const char name[128];
@@ -457,6 +458,65 @@ cert_add_alt_names(X509 *cert, struct verify_test *vt)
 	sk_GENERAL_NAME_pop_free(alt_name_stack, GENERAL_NAME_free);
 }
 
+/*
+ * Check that a server with the certificate as its only SNI certificate
+ * matches the same names as tls_check_name().
+ */
+static int
+do_sni_test(int test_no, struct verify_test *vt, X509 *cert)
+{
+	struct tls_sni_index *index = NULL;
+	struct tls_sni_ctx *sni_ctx;
+	union tls_addr addrbuf;
+	struct tls *tls;
+	int failed = 1;
+	int match;
+
+	/* A servername is never an IP literal. */
+	if (inet_pton(AF_INET, vt->name, &addrbuf) == 1 ||
+	    inet_pton(AF_INET6, vt->name, &addrbuf) == 1)
+		return (0);
+
+	if ((tls = tls_server()) == NULL)
+		errx(1, "failed to malloc tls_server");
+	if ((sni_ctx = tls_sni_ctx_new()) == NULL)
+		errx(1, "failed to malloc tls_sni_ctx");
+	if (X509_up_ref(cert) == 0)
+		errx(1, "failed to reference X509");
+	sni_ctx->ssl_cert = cert;
+
+	if ((index = tls_sni_index_build(tls, sni_ctx)) == NULL) {
+		if (vt->want_return != -1) {
+			fprintf(stderr, "FAIL: test %i failed to index "
+			    "names: %s\n", test_no, tls_error(tls));
+			goto done;
+		}
+		failed = 0;
+		goto done;
+	}
+	if (vt->want_return == -1) {
+		fprintf(stderr, "FAIL: test %i indexed names of an invalid "
+		    "certificate\n", test_no);
+		goto done;
+	}
+
+	match = tls_sni_index_lookup(index, vt->name) == sni_ctx;
+	if (match != vt->want_match) {
+		fprintf(stderr, "FAIL: test %i failed to look up name '%s'\n",
+		    test_no, vt->name);
+		goto done;
+	}
+
+	failed = 0;
+
+ done:
+	tls_sni_index_free(index);
+	tls_sni_ctx_free(sni_ctx);
+	tls_free(tls);
+
+	return (failed);
+}
+
 static int
 do_verify_test(int test_no, struct verify_test *vt)
 {
@@ -500,7 +560,7 @@ do_verify_test(int test_no, struct verify_test *vt)
 		goto done;
 	}
 
-	failed = 0;
+	failed = do_sni_test(test_no, vt, cert);
 
  done:
 	X509_free(cert);
@@ -67,6 +67,8 @@
 #define POLL_NETIN	2
 #define POLL_STDOUT	3
 #define BUFSIZE		16384
+#define BUFSIZE_MAX	(64 * 1024 * 1024)
+#define TLS_RECORD_SIZE	16384
 
 #define TLS_NOVERIFY	(1 << 1)
 #define TLS_NONAME	(1 << 2)
@@ -74,6 +76,7 @@
 #define TLS_MUSTSTAPLE	(1 << 4)
 
 /* Command Line Options */
+size_t	Bflag = BUFSIZE;			/* Relay buffer size */
 int	dflag;					/* detached, no stdin */
 int	Fflag;					/* fdpass sock to stdout */
 unsigned int iflag;				/* Interval Flag */
@@ -142,7 +145,7 @@ void	report_sock(const char *, const struct sockaddr *, socklen_t, char *);
 void	report_tls(struct tls *tls_ctx, char * host);
 void	usage(int);
 ssize_t drainbuf(int, unsigned char *, size_t *, struct tls *);
-ssize_t fillbuf(int, unsigned char *, size_t *, struct tls *);
+ssize_t fillbuf(int, unsigned char *, size_t *, size_t, struct tls *);
 void	tls_setup_client(struct tls *, int, char *);
 struct tls *tls_setup_server(struct tls *, int, char *);
 
@@ -174,7 +177,7 @@ main(int argc, char *argv[])
 	signal(SIGPIPE, SIG_IGN);
 
 	while ((ch = getopt(argc, argv,
-	    "46C:cDde:FH:hI:i:K:klM:m:NnO:o:P:p:R:rSs:T:tUuV:vW:w:X:x:Z:z"))
+	    "46B:C:cDde:FH:hI:i:K:klM:m:NnO:o:P:p:R:rSs:T:tUuV:vW:w:X:x:Z:z"))
 	    != -1) {
 		switch (ch) {
 		case '4':
@@ -186,6 +189,11 @@ main(int argc, char *argv[])
 		case 'U':
 			family = AF_UNIX;
 			break;
+		case 'B':
+			Bflag = strtonum(optarg, 1, BUFSIZE_MAX, &errstr);
+			if (errstr != NULL)
+				errx(1, "buffer size %s: %s", errstr, optarg);
+			break;
 		case 'X':
 			if (strcasecmp(optarg, "connect") == 0)
 				socksv = -1; /* HTTP proxy CONNECT */
@@ -1122,13 +1130,16 @@ readwrite(int net_fd, struct tls *tls_ctx)
 	struct pollfd pfd[4];
 	int stdin_fd = STDIN_FILENO;
 	int stdout_fd = STDOUT_FILENO;
-	unsigned char netinbuf[BUFSIZE];
+	unsigned char *netinbuf, *stdinbuf;
 	size_t netinbufpos = 0;
-	unsigned char stdinbuf[BUFSIZE];
 	size_t stdinbufpos = 0;
-	int n, num_fds;
+	int n, num_fds, coalesce = 0;
 	ssize_t ret;
 
+	if ((netinbuf = malloc(Bflag)) == NULL ||
+	    (stdinbuf = malloc(Bflag)) == NULL)
+		err(1, NULL);
+
 	/* don't read from stdin if requested */
 	if (dflag)
 		stdin_fd = -1;
@@ -1153,14 +1164,14 @@ readwrite(int net_fd, struct tls *tls_ctx)
 		/* both inputs are gone, buffers are empty, we are done */
 		if (pfd[POLL_STDIN].fd == -1 && pfd[POLL_NETIN].fd == -1 &&
 		    stdinbufpos == 0 && netinbufpos == 0)
-			return;
+			break;
 		/* both outputs are gone, we can't continue */
 		if (pfd[POLL_NETOUT].fd == -1 && pfd[POLL_STDOUT].fd == -1)
-			return;
+			break;
 		/* listen and net in gone, queues empty, done */
 		if (lflag && pfd[POLL_NETIN].fd == -1 &&
 		    stdinbufpos == 0 && netinbufpos == 0)
-			return;
+			break;
 
 		/* help says -i is for "wait between lines sent". We read and
 		 * write arbitrary amounts of data, and we don't want to start
@@ -1169,15 +1180,23 @@ readwrite(int net_fd, struct tls *tls_ctx)
 			sleep(iflag);
 
 		/* poll */
-		num_fds = poll(pfd, 4, timeout);
+		num_fds = poll(pfd, 4, coalesce ? 0 : timeout);
 
 		/* treat poll errors */
 		if (num_fds == -1)
 			err(1, "polling error");
 
 		/* timeout happened */
-		if (num_fds == 0)
-			return;
+		if (num_fds == 0 && !coalesce)
+			break;
+
+		/* no more input straight away, send what we have */
+		if (coalesce) {
+			coalesce = 0;
+			if (!(pfd[POLL_STDIN].revents & POLLIN) &&
+			    stdinbufpos > 0)
+				pfd[POLL_NETOUT].events = POLLOUT;
+		}
 
 		/* treat socket error conditions */
 		for (n = 0; n < 4; n++) {
@@ -1215,20 +1234,29 @@ readwrite(int net_fd, struct tls *tls_ctx)
 		}
 
 		/* try to read from stdin */
-		if (pfd[POLL_STDIN].revents & POLLIN && stdinbufpos < BUFSIZE) {
+		if (pfd[POLL_STDIN].revents & POLLIN && stdinbufpos < Bflag) {
 			ret = fillbuf(pfd[POLL_STDIN].fd, stdinbuf,
-			    &stdinbufpos, NULL);
+			    &stdinbufpos, Bflag, NULL);
 			if (ret == TLS_WANT_POLLIN)
 				pfd[POLL_STDIN].events = POLLIN;
 			else if (ret == TLS_WANT_POLLOUT)
 				pfd[POLL_STDIN].events = POLLOUT;
 			else if (ret == 0 || ret == -1)
 				pfd[POLL_STDIN].fd = -1;
-			/* read something - poll net out */
-			if (stdinbufpos > 0)
+			/*
+			 * read something - poll net out, but with TLS first
+			 * gather up to a full record while more input is
+			 * immediately available
+			 */
+			if (tls_ctx != NULL && pfd[POLL_STDIN].fd != -1 &&
+			    stdinbufpos > 0 && stdinbufpos < TLS_RECORD_SIZE &&
+			    stdinbufpos < Bflag &&
+			    pfd[POLL_NETOUT].events == 0)
+				coalesce = 1;
+			else if (stdinbufpos > 0)
 				pfd[POLL_NETOUT].events = POLLOUT;
 			/* filled buffer - remove self from polling */
-			if (stdinbufpos == BUFSIZE)
+			if (stdinbufpos == Bflag)
 				pfd[POLL_STDIN].events = 0;
 		}
 		/* try to write to network */
@@ -1245,13 +1273,13 @@ readwrite(int net_fd, struct tls *tls_ctx)
 			if (stdinbufpos == 0)
 				pfd[POLL_NETOUT].events = 0;
 			/* buffer no longer full - poll stdin again */
-			if (stdinbufpos < BUFSIZE)
+			if (stdinbufpos < Bflag)
 				pfd[POLL_STDIN].events = POLLIN;
 		}
 		/* try to read from network */
-		if (pfd[POLL_NETIN].revents & POLLIN && netinbufpos < BUFSIZE) {
+		if (pfd[POLL_NETIN].revents & POLLIN && netinbufpos < Bflag) {
 			ret = fillbuf(pfd[POLL_NETIN].fd, netinbuf,
-			    &netinbufpos, tls_ctx);
+			    &netinbufpos, Bflag, tls_ctx);
 			if (ret == TLS_WANT_POLLIN)
 				pfd[POLL_NETIN].events = POLLIN;
 			else if (ret == TLS_WANT_POLLOUT)
@@ -1273,7 +1301,7 @@ readwrite(int net_fd, struct tls *tls_ctx)
 			if (netinbufpos > 0)
 				pfd[POLL_STDOUT].events = POLLOUT;
 			/* filled buffer - remove self from polling */
-			if (netinbufpos == BUFSIZE)
+			if (netinbufpos == Bflag)
 				pfd[POLL_NETIN].events = 0;
 			/* handle telnet */
 			if (tflag)
@@ -1294,7 +1322,7 @@ readwrite(int net_fd, struct tls *tls_ctx)
 			if (netinbufpos == 0)
 				pfd[POLL_STDOUT].events = 0;
 			/* buffer no longer full - poll net in again */
-			if (netinbufpos < BUFSIZE)
+			if (netinbufpos < Bflag)
 				pfd[POLL_NETIN].events = POLLIN;
 		}
 
@@ -1309,6 +1337,9 @@ readwrite(int net_fd, struct tls *tls_ctx)
 			pfd[POLL_STDOUT].fd = -1;
 		}
 	}
+
+	free(netinbuf);
+	free(stdinbuf);
 }
 
 ssize_t
@@ -1338,9 +1369,10 @@ drainbuf(int fd, unsigned char *buf, size_t *bufpos, struct tls *tls)
 }
 
 ssize_t
-fillbuf(int fd, unsigned char *buf, size_t *bufpos, struct tls *tls)
+fillbuf(int fd, unsigned char *buf, size_t *bufpos, size_t bufsize,
+    struct tls *tls)
 {
-	size_t num = BUFSIZE - *bufpos;
+	size_t num = bufsize - *bufpos;
 	ssize_t n;
 
 	if (tls) {
@@ -1798,6 +1830,7 @@ help(void)
 	fprintf(stderr, "\tCommand Summary:\n\
 	\t-4		Use IPv4\n\
 	\t-6		Use IPv6\n\
+	\t-B size	Relay buffer size\n\
 	\t-C certfile	Public key file\n\
 	\t-c		Use TLS\n\
 	\t-D		Enable the debug socket option\n\
@@ -1843,15 +1876,13 @@ void
 usage(int ret)
 {
 	fprintf(stderr,
-	    "usage: nc [-46cDdFhklNnrStUuvz] [-C certfile] [-e name] "
-	    "[-H hash] [-I length]\n"
-	    "\t  [-i interval] [-K keyfile] [-M ttl] [-m minttl] [-O length]\n"
-	    "\t  [-o staplefile] [-P proxy_username] [-p source_port] "
-	    "[-R CAfile]\n"
-	    "\t  [-s sourceaddr] [-T keyword] [-V rtable] [-W recvlimit] "
-	    "[-w timeout]\n"
-	    "\t  [-X proxy_protocol] [-x proxy_address[:port]] "
-	    "[-Z peercertfile]\n"
+	    "usage: nc [-46cDdFhklNnrStUuvz] [-B size] [-C certfile] "
+	    "[-e name]\n"
+	    "\t  [-H hash] [-I length] [-i interval] [-K keyfile] [-M ttl]\n"
+	    "\t  [-m minttl] [-O length] [-o staplefile] [-P proxy_username]\n"
+	    "\t  [-p source_port] [-R CAfile] [-s sourceaddr] [-T keyword]\n"
+	    "\t  [-V rtable] [-W recvlimit] [-w timeout] [-X proxy_protocol]\n"
+	    "\t  [-x proxy_address[:port]] [-Z peercertfile]\n"
 	    "\t  [destination] [port]\n");
 	if (ret)
 		exit(1);
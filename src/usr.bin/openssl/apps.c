@@ -1430,28 +1430,14 @@ rand_serial(BIGNUM *b, ASN1_INTEGER *ai)
 	return ret;
 }
 
-CA_DB *
-load_index(char *dbfile, DB_ATTR *db_attr)
+static CA_DB *
+index_new(const char *dbfile, DB_ATTR *db_attr)
 {
 	CA_DB *retdb = NULL;
-	TXT_DB *tmpdb = NULL;
-	BIO *in = BIO_new(BIO_s_file());
 	CONF *dbattr_conf = NULL;
 	char attrpath[PATH_MAX];
 	long errorline = -1;
 
-	if (in == NULL) {
-		ERR_print_errors(bio_err);
-		goto err;
-	}
-	if (BIO_read_filename(in, dbfile) <= 0) {
-		perror(dbfile);
-		BIO_printf(bio_err, "unable to open '%s'\n", dbfile);
-		goto err;
-	}
-	if ((tmpdb = TXT_DB_read(in, DB_NUMBER)) == NULL)
-		goto err;
-
 	if (snprintf(attrpath, sizeof attrpath, "%s.attr", dbfile)
 	    >= sizeof attrpath) {
 		BIO_printf(bio_err, "attr filename too long\n");
@@ -1474,8 +1460,8 @@ load_index(char *dbfile, DB_ATTR *db_attr)
 		fprintf(stderr, "Out of memory\n");
 		goto err;
 	}
-	retdb->db = tmpdb;
-	tmpdb = NULL;
+	retdb->db = NULL;
+	retdb->index = NULL;
 	if (db_attr)
 		retdb->attributes = *db_attr;
 	else {
@@ -1491,6 +1477,71 @@ load_index(char *dbfile, DB_ATTR *db_attr)
 
  err:
 	NCONF_free(dbattr_conf);
+	return retdb;
+}
+
+CA_DB *
+load_index(char *dbfile, DB_ATTR *db_attr)
+{
+	CA_DB *retdb = NULL;
+	TXT_DB *tmpdb = NULL;
+	BIO *in = BIO_new(BIO_s_file());
+
+	if (in == NULL) {
+		ERR_print_errors(bio_err);
+		goto err;
+	}
+	if (BIO_read_filename(in, dbfile) <= 0) {
+		perror(dbfile);
+		BIO_printf(bio_err, "unable to open '%s'\n", dbfile);
+		goto err;
+	}
+	if ((tmpdb = TXT_DB_read(in, DB_NUMBER)) == NULL)
+		goto err;
+
+	if ((retdb = index_new(dbfile, db_attr)) == NULL)
+		goto err;
+	retdb->db = tmpdb;
+	tmpdb = NULL;
+
+ err:
+	TXT_DB_free(tmpdb);
+	BIO_free_all(in);
+	return retdb;
+}
+
+/*
+ * Open a database with the indexed backend. Rather than being loaded,
+ * existing entries are looked up through the persistent index, and the
+ * in-memory TXT_DB only holds the entries added by this run, which
+ * append_index() then adds to the end of the database.
+ */
+CA_DB *
+open_index(char *dbfile, DB_ATTR *db_attr)
+{
+	CA_DB *retdb = NULL;
+	TXT_DB *tmpdb = NULL;
+	struct ca_index *idx = NULL;
+	BIO *in;
+
+	if ((in = BIO_new_mem_buf("", 0)) == NULL) {
+		ERR_print_errors(bio_err);
+		goto err;
+	}
+	if ((tmpdb = TXT_DB_read(in, DB_NUMBER)) == NULL)
+		goto err;
+	if ((idx = ca_index_open(dbfile)) == NULL)
+		goto err;
+
+	if ((retdb = index_new(dbfile, db_attr)) == NULL)
+		goto err;
+	retdb->db = tmpdb;
+	retdb->index = idx;
+	tmpdb = NULL;
+	idx = NULL;
+
+ err:
+	ca_index_free(idx);
 	TXT_DB_free(tmpdb);
 	BIO_free_all(in);
 	return retdb;
@@ -1516,6 +1567,20 @@ index_index(CA_DB *db)
 	return 1;
 }
 
+/*
+ * Look up an entry by serial number or by subject, returning 0 only if
+ * the database could not be read.
+ */
+int
+index_get(CA_DB *db, int field, OPENSSL_STRING *value, OPENSSL_STRING **rrow)
+{
+	if ((*rrow = TXT_DB_get_by_index(db->db, field, value)) != NULL ||
+	    db->index == NULL)
+		return 1;
+
+	return ca_index_lookup(db->index, field, value[field], rrow) != -1;
+}
+
 int
 save_index(const char *file, const char *suffix, CA_DB *db)
 {
@@ -1661,10 +1726,45 @@ rotate_index(const char *dbfile, const char *new_suffix, const char *old_suffix)
 	return 0;
 }
 
+int
+append_index(const char *dbfile, CA_DB *db)
+{
+	char attrpath[PATH_MAX];
+	BIO *out;
+
+	if (!ca_index_append(db->index, db->db))
+		return 0;
+
+	if (snprintf(attrpath, sizeof attrpath, "%s.attr",
+	    dbfile) >= sizeof attrpath) {
+		BIO_printf(bio_err, "file name too long\n");
+		return 0;
+	}
+	if (access(attrpath, F_OK) == 0 || errno != ENOENT)
+		return 1;
+
+	if ((out = BIO_new(BIO_s_file())) == NULL) {
+		ERR_print_errors(bio_err);
+		return 0;
+	}
+	if (BIO_write_filename(out, attrpath) <= 0) {
+		perror(attrpath);
+		BIO_printf(bio_err, "unable to open '%s'\n", attrpath);
+		BIO_free(out);
+		return 0;
+	}
+	BIO_printf(out, "unique_subject = %s\n",
+	    db->attributes.unique_subject ? "yes" : "no");
+	BIO_free(out);
+
+	return 1;
+}
+
 void
 free_index(CA_DB *db)
 {
 	if (db) {
+		ca_index_free(db->index);
 		TXT_DB_free(db->db);
 		free(db);
 	}
@@ -214,6 +214,7 @@ typedef struct db_attr_st {
 typedef struct ca_db_st {
 	DB_ATTR attributes;
 	TXT_DB *db;
+	struct ca_index *index;	/* persistent index, NULL for a text db */
 } CA_DB;
 
 BIGNUM *load_serial(char *serialfile, int create, ASN1_INTEGER **retai);
@@ -222,11 +223,21 @@ int save_serial(char *serialfile, char *suffix, BIGNUM *serial,
 int rotate_serial(char *serialfile, char *new_suffix, char *old_suffix);
 int rand_serial(BIGNUM *b, ASN1_INTEGER *ai);
 CA_DB *load_index(char *dbfile, DB_ATTR *dbattr);
+CA_DB *open_index(char *dbfile, DB_ATTR *dbattr);
 int index_index(CA_DB *db);
+int index_get(CA_DB *db, int field, OPENSSL_STRING *value,
+    OPENSSL_STRING **rrow);
 int save_index(const char *dbfile, const char *suffix, CA_DB *db);
 int rotate_index(const char *dbfile, const char *new_suffix,
     const char *old_suffix);
+int append_index(const char *dbfile, CA_DB *db);
 void free_index(CA_DB *db);
+
+struct ca_index *ca_index_open(const char *dbfile);
+int ca_index_lookup(struct ca_index *idx, int field, const char *key,
+    char ***rrow);
+int ca_index_append(struct ca_index *idx, TXT_DB *db);
+void ca_index_free(struct ca_index *idx);
 #define index_name_cmp_noconst(a, b) \
 	index_name_cmp((const OPENSSL_CSTRING *)CHECKED_PTR_OF(OPENSSL_STRING, a), \
 	(const OPENSSL_CSTRING *)CHECKED_PTR_OF(OPENSSL_STRING, b))
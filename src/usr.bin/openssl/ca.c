@@ -111,6 +111,7 @@
 #define ENV_UNIQUE_SUBJECT	"unique_subject"
 
 #define ENV_DATABASE		"database"
+#define ENV_DATABASE_BACKEND	"database_backend"
 
 /* Additional revocation information types */
 
@@ -684,9 +685,10 @@ ca_main(int argc, char **argv)
 	STACK_OF(X509) *cert_sk = NULL;
 	char *tofree = NULL;
 	DB_ATTR db_attr;
+	int db_indexed = 0;
 
 	if (single_execution) {
-		if (pledge("stdio cpath wpath rpath tty", NULL) == -1) {
+		if (pledge("stdio cpath wpath rpath flock tty", NULL) == -1) {
 			perror("pledge");
 			exit(1);
 		}
@@ -789,6 +791,15 @@ ca_main(int argc, char **argv)
 		db_attr.unique_subject = parse_yesno(p, 1);
 	} else
 		ERR_clear_error();
+	p = NCONF_get_string(conf, ca_config.section, ENV_DATABASE_BACKEND);
+	if (p == NULL)
+		ERR_clear_error();
+	else if (strcmp(p, "indexed") == 0)
+		db_indexed = 1;
+	else if (strcmp(p, "text") != 0) {
+		BIO_printf(bio_err, "unknown database backend %s\n", p);
+		goto err;
+	}
 
 	in = BIO_new(BIO_s_file());
 	out = BIO_new(BIO_s_file());
@@ -806,7 +817,10 @@ ca_main(int argc, char **argv)
 			lookup_fail(ca_config.section, ENV_DATABASE);
 			goto err;
 		}
-		db = load_index(dbfile, &db_attr);
+		if (db_indexed)
+			db = open_index(dbfile, &db_attr);
+		else
+			db = load_index(dbfile, &db_attr);
 		if (db == NULL)
 			goto err;
 
@@ -930,7 +944,15 @@ ca_main(int argc, char **argv)
 		lookup_fail(ca_config.section, ENV_DATABASE);
 		goto err;
 	}
-	db = load_index(dbfile, &db_attr);
+	/*
+	 * Only issuing certificates can do without the whole database,
+	 * everything else loads it and writes it back as a text file.
+	 */
+	if (db_indexed && !ca_config.doupdatedb && !ca_config.gencrl &&
+	    !ca_config.dorevoke)
+		db = open_index(dbfile, &db_attr);
+	else
+		db = load_index(dbfile, &db_attr);
 	if (db == NULL)
 		goto err;
 
@@ -1310,7 +1332,8 @@ ca_main(int argc, char **argv)
 			if (!save_serial(serialfile, "new", serial, NULL))
 				goto err;
 
-			if (!save_index(dbfile, "new", db))
+			if (db->index == NULL &&
+			    !save_index(dbfile, "new", db))
 				goto err;
 		}
 		if (ca_config.verbose)
@@ -1360,7 +1383,10 @@ ca_main(int argc, char **argv)
 			if (!rotate_serial(serialfile, "new", "old"))
 				goto err;
 
-			if (!rotate_index(dbfile, "new", "old"))
+			if (db->index != NULL) {
+				if (!append_index(dbfile, db))
+					goto err;
+			} else if (!rotate_index(dbfile, "new", "old"))
 				goto err;
 
 			BIO_printf(bio_err, "Data Base Updated\n");
@@ -1959,7 +1985,8 @@ again2:
 	if (db->attributes.unique_subject) {
 		OPENSSL_STRING *crow = row;
 
-		rrow = TXT_DB_get_by_index(db->db, DB_name, crow);
+		if (!index_get(db, DB_name, crow, &rrow))
+			goto err;
 		if (rrow != NULL) {
 			BIO_printf(bio_err,
 			    "ERROR:There is already a certificate for %s\n",
@@ -1967,7 +1994,8 @@ again2:
 		}
 	}
 	if (rrow == NULL) {
-		rrow = TXT_DB_get_by_index(db->db, DB_serial, row);
+		if (!index_get(db, DB_serial, row, &rrow))
+			goto err;
 		if (rrow != NULL) {
 			BIO_printf(bio_err,
 			    "ERROR:Serial number %s has already been issued,\n",
@@ -2550,7 +2578,10 @@ get_certificate_status(const char *serial, CA_DB *db)
 	ok = 1;
 
 	/* Search for the certificate */
-	rrow = TXT_DB_get_by_index(db->db, DB_serial, row);
+	if (!index_get(db, DB_serial, row, &rrow)) {
+		ok = -1;
+		goto err;
+	}
 	if (rrow == NULL) {
 		BIO_printf(bio_err, "Serial %s not present in db.\n",
 		    row[DB_serial]);
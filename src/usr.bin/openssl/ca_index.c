@@ -0,0 +1,694 @@
+/* $OpenBSD$ */
+/*
+ * Copyright (c) 2026 The LibreSSL Project
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Persistent index for the ca database.
+ *
+ * With the indexed backend the database file is used as an append-only
+ * log: newly issued certificates are appended to it, rather than the whole
+ * file being rewritten. A hash table in "<database>.idx" maps the serial
+ * number of every entry, and the subject of every valid entry, to the
+ * offset of its line in the database, so that a lookup only reads a few
+ * slots of the table and the candidate lines.
+ *
+ * The table records the device, inode, size and modification time of the
+ * database it describes. If these no longer match, for instance because a
+ * revocation or -updatedb has rewritten the database, the table is rebuilt
+ * with a single pass over the database.
+ */
+
+#include <sys/types.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "apps.h"
+
+#include <openssl/bio.h>
+#include <openssl/err.h>
+#include <openssl/txt_db.h>
+
+#define CA_INDEX_MAGIC		"CAIDX001"
+#define CA_INDEX_MIN_SLOTS	1024
+#define CA_INDEX_WINDOW		16
+#define CA_INDEX_LINE		1024
+
+#define CA_INDEX_KEY_SERIAL	0
+#define CA_INDEX_KEY_NAME	1
+
+struct ca_index_header {
+	char		magic[8];
+	uint64_t	dbdev;
+	uint64_t	dbino;
+	uint64_t	dbsize;
+	int64_t		dbmtime;
+	int64_t		dbmtime_nsec;
+	uint64_t	nslots;
+	uint64_t	nused;
+};
+
+struct ca_index_slot {
+	uint64_t	hash;
+	uint64_t	offset;		/* offset of the line plus one, 0 if free */
+};
+
+struct ca_index {
+	char			 path[PATH_MAX];
+	int			 dbfd;
+	int			 fd;
+	struct ca_index_header	 hdr;
+	char			**row;	/* row returned by the last lookup */
+};
+
+static uint64_t
+ca_index_hash(int kind, const char *key)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+
+	/* Serial numbers compare equal regardless of leading zeroes. */
+	if (kind == CA_INDEX_KEY_SERIAL) {
+		while (*key == '0')
+			key++;
+	}
+	for (; *key != '\0'; key++) {
+		h ^= (unsigned char)*key;
+		h *= 0x100000001b3ULL;
+	}
+
+	return ((h & ~1ULL) | kind);
+}
+
+static int
+ca_index_match(int kind, char **row, const char *key)
+{
+	const char *s;
+
+	if (kind == CA_INDEX_KEY_NAME)
+		return (row[DB_type][0] == DB_TYPE_VAL &&
+		    strcmp(row[DB_name], key) == 0);
+
+	for (s = row[DB_serial]; *s == '0'; s++)
+		;
+	while (*key == '0')
+		key++;
+	return (strcmp(s, key) == 0);
+}
+
+/*
+ * Split a database line into its fields, the same way as TXT_DB_read()
+ * does, into a single allocation that can be released with free().
+ */
+static char **
+ca_index_parse(const char *line, size_t len)
+{
+	const char *f, *end = line + len;
+	size_t add;
+	char **pp, *p;
+	int esc = 0, n = 0;
+
+	add = (DB_NUMBER + 1) * sizeof(char *);
+	if ((pp = malloc(add + len + 1)) == NULL)
+		return (NULL);
+	p = (char *)pp + add;
+	pp[n++] = p;
+	for (f = line; f < end;) {
+		if (*f == '\t') {
+			if (esc)
+				p--;
+			else {
+				*p++ = '\0';
+				f++;
+				if (n >= DB_NUMBER)
+					break;
+				pp[n++] = p;
+				continue;
+			}
+		}
+		esc = (*f == '\\');
+		*p++ = *f++;
+	}
+	*p = '\0';
+	if (n != DB_NUMBER || f != end) {
+		free(pp);
+		return (NULL);
+	}
+	pp[n] = NULL;
+
+	return (pp);
+}
+
+static char **
+ca_index_read_row(struct ca_index *idx, uint64_t offset)
+{
+	char *buf = NULL, *nbuf, *nl = NULL, **row = NULL;
+	size_t len = 0, size = 0;
+	ssize_t n;
+
+	while (nl == NULL) {
+		if (len == size) {
+			if ((nbuf = realloc(buf, size + CA_INDEX_LINE)) ==
+			    NULL) {
+				BIO_printf(bio_err, "out of memory\n");
+				goto err;
+			}
+			buf = nbuf;
+			size += CA_INDEX_LINE;
+		}
+		if ((n = pread(idx->dbfd, buf + len, size - len,
+		    offset + len)) == -1) {
+			BIO_printf(bio_err, "database read: %s\n",
+			    strerror(errno));
+			goto err;
+		}
+		if (n == 0) {
+			BIO_printf(bio_err, "database index is corrupt\n");
+			goto err;
+		}
+		nl = memchr(buf + len, '\n', n);
+		len += n;
+	}
+	if ((row = ca_index_parse(buf, nl - buf)) == NULL)
+		BIO_printf(bio_err, "database index is corrupt\n");
+
+ err:
+	free(buf);
+
+	return (row);
+}
+
+static int
+ca_index_read_slots(struct ca_index *idx, struct ca_index_slot *slots,
+    uint64_t i, uint64_t n)
+{
+	size_t len = n * sizeof(*slots);
+	ssize_t r;
+
+	r = pread(idx->fd, slots, len, sizeof(idx->hdr) + i * sizeof(*slots));
+	if (r == -1) {
+		BIO_printf(bio_err, "%s: %s\n", idx->path, strerror(errno));
+		return (0);
+	}
+	if ((size_t)r != len) {
+		BIO_printf(bio_err, "%s: short read\n", idx->path);
+		return (0);
+	}
+
+	return (1);
+}
+
+static int
+ca_index_write_all(int fd, const void *buf, size_t len, off_t offset)
+{
+	const char *p = buf;
+	ssize_t n;
+
+	while (len > 0) {
+		if (offset == -1)
+			n = write(fd, p, len);
+		else
+			n = pwrite(fd, p, len, offset);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			return (0);
+		}
+		p += n;
+		len -= n;
+		if (offset != -1)
+			offset += n;
+	}
+
+	return (1);
+}
+
+static void
+ca_index_slot_insert(struct ca_index_slot *slots, uint64_t nslots,
+    uint64_t hash, uint64_t offset)
+{
+	uint64_t i, mask = nslots - 1;
+
+	for (i = hash & mask; slots[i].offset != 0; i = (i + 1) & mask)
+		;
+	slots[i].hash = hash;
+	slots[i].offset = offset + 1;
+}
+
+/*
+ * Spread the used slots of a table over a table twice the size.
+ */
+static struct ca_index_slot *
+ca_index_slot_grow(struct ca_index_slot *slots, uint64_t *nslots)
+{
+	struct ca_index_slot *nslot;
+	uint64_t i, n = *nslots * 2;
+
+	if ((nslot = calloc(n, sizeof(*nslot))) == NULL)
+		return (NULL);
+	for (i = 0; i < *nslots; i++) {
+		if (slots[i].offset != 0)
+			ca_index_slot_insert(nslot, n, slots[i].hash,
+			    slots[i].offset - 1);
+	}
+	free(slots);
+	*nslots = n;
+
+	return (nslot);
+}
+
+static void
+ca_index_set_db(struct ca_index_header *hdr, const struct stat *sb)
+{
+	hdr->dbdev = sb->st_dev;
+	hdr->dbino = sb->st_ino;
+	hdr->dbsize = sb->st_size;
+	hdr->dbmtime = sb->st_mtim.tv_sec;
+	hdr->dbmtime_nsec = sb->st_mtim.tv_nsec;
+}
+
+/*
+ * Replace the table on disk with a new one.
+ */
+static int
+ca_index_store(struct ca_index *idx, struct ca_index_slot *slots,
+    uint64_t nslots, uint64_t nused, const struct stat *sb)
+{
+	struct ca_index_header hdr;
+	char tmp[PATH_MAX];
+	int fd;
+
+	if (snprintf(tmp, sizeof(tmp), "%s.XXXXXXXXXX", idx->path) >=
+	    sizeof(tmp)) {
+		BIO_printf(bio_err, "file name too long\n");
+		return (0);
+	}
+	if ((fd = mkstemp(tmp)) == -1) {
+		BIO_printf(bio_err, "%s: %s\n", tmp, strerror(errno));
+		return (0);
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, CA_INDEX_MAGIC, sizeof(hdr.magic));
+	ca_index_set_db(&hdr, sb);
+	hdr.nslots = nslots;
+	hdr.nused = nused;
+
+	/* The table must be on disk before it replaces the old one. */
+	if (!ca_index_write_all(fd, &hdr, sizeof(hdr), -1) ||
+	    !ca_index_write_all(fd, slots, nslots * sizeof(*slots), -1) ||
+	    fsync(fd) == -1 || rename(tmp, idx->path) == -1) {
+		BIO_printf(bio_err, "%s: %s\n", tmp, strerror(errno));
+		close(fd);
+		unlink(tmp);
+		return (0);
+	}
+
+	if (idx->fd != -1)
+		close(idx->fd);
+	idx->fd = fd;
+	idx->hdr = hdr;
+
+	return (1);
+}
+
+static int
+ca_index_rebuild(struct ca_index *idx, const struct stat *sb)
+{
+	struct ca_index_slot *slots = NULL, *nslot;
+	uint64_t nslots = CA_INDEX_MIN_SLOTS, nused = 0;
+	char *line = NULL, **row;
+	size_t linesize = 0;
+	off_t offset = 0;
+	ssize_t len;
+	long ln = 0;
+	FILE *fp = NULL;
+	int fd, ret = 0;
+
+	if ((fd = dup(idx->dbfd)) == -1 || (fp = fdopen(fd, "r")) == NULL) {
+		BIO_printf(bio_err, "database: %s\n", strerror(errno));
+		if (fd != -1)
+			close(fd);
+		goto err;
+	}
+	if (fseeko(fp, 0, SEEK_SET) == -1) {
+		BIO_printf(bio_err, "database: %s\n", strerror(errno));
+		goto err;
+	}
+	if ((slots = calloc(nslots, sizeof(*slots))) == NULL)
+		goto nomem;
+
+	while ((len = getline(&line, &linesize, fp)) != -1) {
+		ln++;
+		if (line[len - 1] != '\n') {
+			BIO_printf(bio_err,
+			    "database does not end with a newline\n");
+			goto err;
+		}
+		if (line[0] == '#') {
+			offset += len;
+			continue;
+		}
+		if ((row = ca_index_parse(line, len - 1)) == NULL) {
+			BIO_printf(bio_err,
+			    "wrong number of fields on line %ld\n", ln);
+			goto err;
+		}
+		if ((nused + 2) * 2 > nslots) {
+			if ((nslot = ca_index_slot_grow(slots, &nslots)) ==
+			    NULL) {
+				free(row);
+				goto nomem;
+			}
+			slots = nslot;
+		}
+		ca_index_slot_insert(slots, nslots,
+		    ca_index_hash(CA_INDEX_KEY_SERIAL, row[DB_serial]), offset);
+		nused++;
+		if (row[DB_type][0] == DB_TYPE_VAL) {
+			ca_index_slot_insert(slots, nslots,
+			    ca_index_hash(CA_INDEX_KEY_NAME, row[DB_name]),
+			    offset);
+			nused++;
+		}
+		free(row);
+		offset += len;
+	}
+	if (ferror(fp)) {
+		BIO_printf(bio_err, "database: %s\n", strerror(errno));
+		goto err;
+	}
+
+	ret = ca_index_store(idx, slots, nslots, nused, sb);
+	goto err;
+
+ nomem:
+	BIO_printf(bio_err, "out of memory\n");
+ err:
+	if (fp != NULL)
+		fclose(fp);
+	free(line);
+	free(slots);
+
+	return (ret);
+}
+
+static int
+ca_index_grow(struct ca_index *idx, uint64_t need, const struct stat *sb)
+{
+	struct ca_index_slot *slots, *nslot;
+	uint64_t nslots = idx->hdr.nslots;
+	int ret;
+
+	if ((slots = calloc(nslots, sizeof(*slots))) == NULL) {
+		BIO_printf(bio_err, "out of memory\n");
+		return (0);
+	}
+	if (!ca_index_read_slots(idx, slots, 0, nslots)) {
+		free(slots);
+		return (0);
+	}
+	while (need * 2 > nslots) {
+		if ((nslot = ca_index_slot_grow(slots, &nslots)) == NULL) {
+			BIO_printf(bio_err, "out of memory\n");
+			free(slots);
+			return (0);
+		}
+		slots = nslot;
+	}
+	ret = ca_index_store(idx, slots, nslots, idx->hdr.nused, sb);
+	free(slots);
+
+	return (ret);
+}
+
+static int
+ca_index_valid(struct ca_index *idx, const struct stat *sb)
+{
+	struct ca_index_header *hdr = &idx->hdr;
+	struct stat isb;
+
+	if (pread(idx->fd, hdr, sizeof(*hdr), 0) != sizeof(*hdr) ||
+	    fstat(idx->fd, &isb) == -1)
+		return (0);
+	if (memcmp(hdr->magic, CA_INDEX_MAGIC, sizeof(hdr->magic)) != 0)
+		return (0);
+	if (hdr->nslots < CA_INDEX_MIN_SLOTS ||
+	    (hdr->nslots & (hdr->nslots - 1)) != 0 ||
+	    hdr->nslots > (UINT64_MAX - sizeof(*hdr)) /
+	    sizeof(struct ca_index_slot) ||
+	    isb.st_size != sizeof(*hdr) +
+	    hdr->nslots * sizeof(struct ca_index_slot) ||
+	    hdr->nused >= hdr->nslots)
+		return (0);
+
+	return (hdr->dbdev == (uint64_t)sb->st_dev &&
+	    hdr->dbino == (uint64_t)sb->st_ino &&
+	    hdr->dbsize == (uint64_t)sb->st_size &&
+	    hdr->dbmtime == sb->st_mtim.tv_sec &&
+	    hdr->dbmtime_nsec == sb->st_mtim.tv_nsec);
+}
+
+/*
+ * Open the index of a database, building it if it is missing or out of
+ * date. The database stays locked until the index is freed.
+ */
+struct ca_index *
+ca_index_open(const char *dbfile)
+{
+	struct ca_index *idx;
+	struct stat sb;
+
+	if ((idx = calloc(1, sizeof(*idx))) == NULL) {
+		BIO_printf(bio_err, "out of memory\n");
+		return (NULL);
+	}
+	idx->dbfd = -1;
+	idx->fd = -1;
+
+	if (snprintf(idx->path, sizeof(idx->path), "%s.idx", dbfile) >=
+	    sizeof(idx->path)) {
+		BIO_printf(bio_err, "file name too long\n");
+		goto err;
+	}
+	if ((idx->dbfd = open(dbfile, O_RDWR | O_APPEND)) == -1) {
+		perror(dbfile);
+		BIO_printf(bio_err, "unable to open '%s'\n", dbfile);
+		goto err;
+	}
+	if (flock(idx->dbfd, LOCK_EX) == -1 || fstat(idx->dbfd, &sb) == -1) {
+		perror(dbfile);
+		goto err;
+	}
+
+	if ((idx->fd = open(idx->path, O_RDWR)) == -1 && errno != ENOENT) {
+		perror(idx->path);
+		goto err;
+	}
+	if (idx->fd == -1 || !ca_index_valid(idx, &sb)) {
+		if (!ca_index_rebuild(idx, &sb))
+			goto err;
+	}
+
+	return (idx);
+
+ err:
+	ca_index_free(idx);
+
+	return (NULL);
+}
+
+void
+ca_index_free(struct ca_index *idx)
+{
+	if (idx == NULL)
+		return;
+
+	if (idx->fd != -1)
+		close(idx->fd);
+	if (idx->dbfd != -1)
+		close(idx->dbfd);
+	free(idx->row);
+	free(idx);
+}
+
+/*
+ * Look up the entry with the given serial number, or the valid entry with
+ * the given subject. The row returned stays valid until the next lookup.
+ */
+int
+ca_index_lookup(struct ca_index *idx, int field, const char *key,
+    char ***rrow)
+{
+	struct ca_index_slot win[CA_INDEX_WINDOW];
+	uint64_t hash, i, j, n, probed = 0;
+	char **row;
+	int kind;
+
+	*rrow = NULL;
+
+	kind = (field == DB_name) ? CA_INDEX_KEY_NAME : CA_INDEX_KEY_SERIAL;
+	hash = ca_index_hash(kind, key);
+
+	i = hash & (idx->hdr.nslots - 1);
+	while (probed < idx->hdr.nslots) {
+		n = idx->hdr.nslots - i;
+		if (n > CA_INDEX_WINDOW)
+			n = CA_INDEX_WINDOW;
+		if (!ca_index_read_slots(idx, win, i, n))
+			return (-1);
+		for (j = 0; j < n; j++, probed++) {
+			if (win[j].offset == 0)
+				return (0);
+			if (win[j].hash != hash)
+				continue;
+			if ((row = ca_index_read_row(idx,
+			    win[j].offset - 1)) == NULL)
+				return (-1);
+			if (ca_index_match(kind, row, key)) {
+				free(idx->row);
+				idx->row = row;
+				*rrow = row;
+				return (1);
+			}
+			free(row);
+		}
+		i = (i + n) & (idx->hdr.nslots - 1);
+	}
+
+	return (0);
+}
+
+static int
+ca_index_insert(struct ca_index *idx, uint64_t hash, uint64_t offset)
+{
+	struct ca_index_slot win[CA_INDEX_WINDOW];
+	uint64_t i, j, n;
+
+	i = hash & (idx->hdr.nslots - 1);
+	for (;;) {
+		n = idx->hdr.nslots - i;
+		if (n > CA_INDEX_WINDOW)
+			n = CA_INDEX_WINDOW;
+		if (!ca_index_read_slots(idx, win, i, n))
+			return (0);
+		for (j = 0; j < n; j++) {
+			if (win[j].offset != 0)
+				continue;
+			win[j].hash = hash;
+			win[j].offset = offset + 1;
+			if (!ca_index_write_all(idx->fd, &win[j],
+			    sizeof(win[j]), sizeof(idx->hdr) +
+			    (i + j) * sizeof(win[j]))) {
+				BIO_printf(bio_err, "%s: %s\n", idx->path,
+				    strerror(errno));
+				return (0);
+			}
+			idx->hdr.nused++;
+			return (1);
+		}
+		i = (i + n) & (idx->hdr.nslots - 1);
+	}
+}
+
+/*
+ * Append the rows of db to the database and add them to the index.
+ */
+int
+ca_index_append(struct ca_index *idx, TXT_DB *db)
+{
+	uint64_t offset;
+	struct stat sb;
+	char *data, *p, *end, **pp;
+	BIO *mem;
+	long len;
+	int i, n, ret = 0;
+
+	if ((n = sk_OPENSSL_PSTRING_num(db->data)) <= 0)
+		return (1);
+
+	if ((mem = BIO_new(BIO_s_mem())) == NULL) {
+		ERR_print_errors(bio_err);
+		return (0);
+	}
+	if (TXT_DB_write(mem, db) <= 0) {
+		BIO_printf(bio_err, "unable to write database\n");
+		goto err;
+	}
+	len = BIO_get_mem_data(mem, &data);
+
+	if (fstat(idx->dbfd, &sb) == -1) {
+		BIO_printf(bio_err, "database: %s\n", strerror(errno));
+		goto err;
+	}
+	if (idx->hdr.nused + 2 * n > idx->hdr.nslots / 2 &&
+	    !ca_index_grow(idx, idx->hdr.nused + 2 * n, &sb))
+		goto err;
+
+	/*
+	 * The new rows are on disk before the index refers to them, and the
+	 * slots are on disk before the header says that the index matches
+	 * the database. An interrupted append leaves an index that no longer
+	 * matches, and that is rebuilt the next time it is opened.
+	 */
+	if (!ca_index_write_all(idx->dbfd, data, len, -1) ||
+	    fsync(idx->dbfd) == -1) {
+		BIO_printf(bio_err, "database: %s\n", strerror(errno));
+		goto err;
+	}
+
+	offset = sb.st_size;
+	p = data;
+	end = data + len;
+	for (i = 0; i < n && p < end; i++) {
+		pp = sk_OPENSSL_PSTRING_value(db->data, i);
+		if (!ca_index_insert(idx,
+		    ca_index_hash(CA_INDEX_KEY_SERIAL, pp[DB_serial]), offset))
+			goto err;
+		if (pp[DB_type][0] == DB_TYPE_VAL &&
+		    !ca_index_insert(idx,
+		    ca_index_hash(CA_INDEX_KEY_NAME, pp[DB_name]), offset))
+			goto err;
+		if ((p = memchr(p, '\n', end - p)) == NULL)
+			break;
+		p++;
+		offset = sb.st_size + (p - data);
+	}
+
+	if (fstat(idx->dbfd, &sb) == -1 || fsync(idx->fd) == -1) {
+		BIO_printf(bio_err, "%s: %s\n", idx->path, strerror(errno));
+		goto err;
+	}
+	ca_index_set_db(&idx->hdr, &sb);
+	if (!ca_index_write_all(idx->fd, &idx->hdr, sizeof(idx->hdr), 0)) {
+		BIO_printf(bio_err, "%s: %s\n", idx->path, strerror(errno));
+		goto err;
+	}
+
+	ret = 1;
+
+ err:
+	BIO_free(mem);
+
+	return (ret);
+}
@@ -21,6 +21,7 @@
 #include <dirent.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
@@ -32,18 +33,55 @@
 
 #include "apps.h"
 
+/*
+ * With -i, the results of parsing each PEM file in a directory are kept
+ * in a manifest in that directory. A file is only parsed again when its
+ * inode, modification time or size no longer match the manifest. Each
+ * line holds the inode, modification time and size of a file, then the
+ * type (c for a certificate, r for a CRL or - for neither), name hash
+ * and SHA-256 fingerprint of an object read from it, then its name.
+ */
+#define CERTHASH_MANIFEST		".certhash"
+#define CERTHASH_MANIFEST_VERSION	"certhash manifest 1"
+#define CERTHASH_FINGERPRINT_LEN	32
+
+#define CERTHASH_MAX_PARALLEL		256
+
 static struct {
 	int dryrun;
+	int incremental;
+	char *outfile;
+	int parallel;
 	int verbose;
 } certhash_config;
 
 static const struct option certhash_options[] = {
+	{
+		.name = "i",
+		.desc = "Only parse files that changed since the last run",
+		.type = OPTION_FLAG,
+		.opt.flag = &certhash_config.incremental,
+	},
 	{
 		.name = "n",
 		.desc = "Perform a dry-run - do not make any changes",
 		.type = OPTION_FLAG,
 		.opt.flag = &certhash_config.dryrun,
 	},
+	{
+		.name = "o",
+		.argname = "file",
+		.desc = "Write an indexed trust store to file instead of links",
+		.type = OPTION_ARG,
+		.opt.arg = &certhash_config.outfile,
+	},
+	{
+		.name = "parallel",
+		.argname = "n",
+		.desc = "Parse files with up to n threads",
+		.type = OPTION_ARG_INT,
+		.opt.value = &certhash_config.parallel,
+	},
 	{
 		.name = "v",
 		.desc = "Verbose",
@@ -59,6 +97,8 @@ struct hashinfo {
 	unsigned long hash;
 	unsigned int index;
 	unsigned char fingerprint[EVP_MAX_MD_SIZE];
+	unsigned char *der;
+	int der_len;
 	int is_crl;
 	int is_dup;
 	int exists;
@@ -67,6 +107,27 @@ struct hashinfo {
 	struct hashinfo *next;
 };
 
+/* A file to be parsed, possibly by one of the -parallel threads. */
+struct certhash_job {
+	char *filename;
+	struct stat sb;
+	int have_sb;
+	int cached;
+	int status;
+	struct hashinfo *objs;
+};
+
+struct manifest_entry {
+	char *filename;
+	unsigned long long ino;
+	long long mtime;
+	long mtime_nsec;
+	long long size;
+	char type;
+	unsigned long hash;
+	unsigned char fingerprint[EVP_MAX_MD_SIZE];
+};
+
 static struct hashinfo *
 hashinfo(const char *filename, unsigned long hash, unsigned char *fingerprint)
 {
@@ -95,6 +156,7 @@ hashinfo_free(struct hashinfo *hi)
 
 	free(hi->filename);
 	free(hi->target);
+	free(hi->der);
 	free(hi);
 }
 
@@ -310,6 +372,7 @@ certhash_cert(BIO *bio, const char *filename)
 
 	hash = X509_subject_name_hash(cert);
 
+	memset(fingerprint, 0, sizeof(fingerprint));
 	digest = EVP_sha256();
 	if (X509_digest(cert, digest, fingerprint, &len) != 1) {
 		fprintf(stderr, "out of memory\n");
@@ -339,6 +402,7 @@ certhash_crl(BIO *bio, const char *filename)
 
 	hash = X509_NAME_hash(X509_CRL_get_issuer(crl));
 
+	memset(fingerprint, 0, sizeof(fingerprint));
 	digest = EVP_sha256();
 	if (X509_CRL_digest(crl, digest, fingerprint, &len) != 1) {
 		fprintf(stderr, "out of memory\n");
@@ -366,7 +430,8 @@ certhash_addlink(struct hashinfo **links, struct hashinfo *hi)
 
 	link->reference = hi;
 	link->changed = 1;
-	*links = hashinfo_chain(*links, link);
+	link->next = *links;
+	*links = link;
 	hi->reference = link;
 
 	return (0);
@@ -376,23 +441,48 @@ certhash_addlink(struct hashinfo **links, struct hashinfo *hi)
 	return (-1);
 }
 
+static int
+certhash_link_compare(const void *a, const void *b)
+{
+	struct hashinfo *la = *(struct hashinfo **)a;
+	struct hashinfo *lb = *(struct hashinfo **)b;
+
+	if (la->is_crl != lb->is_crl)
+		return la->is_crl - lb->is_crl;
+	if (la->hash != lb->hash)
+		return la->hash < lb->hash ? -1 : 1;
+	if (la->index != lb->index)
+		return la->index < lb->index ? -1 : 1;
+	return 0;
+}
+
 static void
-certhash_findlink(struct hashinfo *links, struct hashinfo *hi)
+certhash_findlink(struct hashinfo **list, size_t len, struct hashinfo *hi)
 {
-	struct hashinfo *link;
+	struct hashinfo **found, *link;
+	size_t i;
 
-	for (link = links; link != NULL; link = link->next) {
-		if (link->is_crl == hi->is_crl &&
-		    link->hash == hi->hash &&
-		    link->index == hi->index &&
-		    link->reference == NULL) {
-			link->reference = hi;
-			if (link->target == NULL ||
-			    strcmp(link->target, hi->filename) != 0)
-				link->changed = 1;
-			hi->reference = link;
+	if (len == 0)
+		return;
+	if ((found = bsearch(&hi, list, len, sizeof(*list),
+	    certhash_link_compare)) == NULL)
+		return;
+
+	/* Start from the first of any links with the same name. */
+	for (i = found - list; i > 0; i--) {
+		if (certhash_link_compare(&list[i - 1], &hi) != 0)
 			break;
-		}
+	}
+	for (; i < len && certhash_link_compare(&list[i], &hi) == 0; i++) {
+		link = list[i];
+		if (link->reference != NULL)
+			continue;
+		link->reference = hi;
+		if (link->target == NULL ||
+		    strcmp(link->target, hi->filename) != 0)
+			link->changed = 1;
+		hi->reference = link;
+		break;
 	}
 }
 
@@ -430,7 +520,8 @@ static int
 certhash_merge(struct hashinfo **links, struct hashinfo **certs,
     struct hashinfo **crls)
 {
-	struct hashinfo *cert, *crl;
+	struct hashinfo *cert, *crl, *link, **list;
+	size_t i, len;
 
 	/* Pass 1 - sort and index entries. */
 	if (hashinfo_chain_sort(certs) == -1)
@@ -440,17 +531,24 @@ certhash_merge(struct hashinfo **links, struct hashinfo **certs,
 	certhash_index(*certs, "certificate");
 	certhash_index(*crls, "CRL");
 
-	/* Pass 2 - map to existing links. */
+	/* Pass 2 - map to existing links, looked up by name. */
+	len = hashinfo_chain_length(*links);
+	if ((list = reallocarray(NULL, len + 1, sizeof(*list))) == NULL)
+		return (-1);
+	for (link = *links, i = 0; link != NULL; link = link->next, i++)
+		list[i] = link;
+	qsort(list, len, sizeof(*list), certhash_link_compare);
 	for (cert = *certs; cert != NULL; cert = cert->next) {
 		if (cert->is_dup == 1)
 			continue;
-		certhash_findlink(*links, cert);
+		certhash_findlink(list, len, cert);
 	}
 	for (crl = *crls; crl != NULL; crl = crl->next) {
 		if (crl->is_dup == 1)
 			continue;
-		certhash_findlink(*links, crl);
+		certhash_findlink(list, len, crl);
 	}
+	free(list);
 
 	/* Pass 3 - determine missing links. */
 	for (cert = *certs; cert != NULL; cert = cert->next) {
@@ -497,25 +595,22 @@ certhash_link(struct dirent *dep, struct hashinfo **links)
 		return (-1);
 	}
 	hi->exists = 1;
-	*links = hashinfo_chain(*links, hi);
+	hi->next = *links;
+	*links = hi;
 
 	return (0);
 }
 
 static int
-certhash_file(struct dirent *dep, struct hashinfo **certs,
-    struct hashinfo **crls)
+certhash_file(struct certhash_job *job)
 {
 	struct hashinfo *hi = NULL;
-	int has_cert, has_crl;
 	int ret = -1;
 	BIO *bio = NULL;
 	FILE *f;
 
-	has_cert = has_crl = 0;
-
-	if ((f = fopen(dep->d_name, "r")) == NULL) {
-		fprintf(stderr, "failed to fopen %s\n", dep->d_name);
+	if ((f = fopen(job->filename, "r")) == NULL) {
+		fprintf(stderr, "failed to fopen %s\n", job->filename);
 		goto err;
 	}
 	if ((bio = BIO_new_fp(f, BIO_CLOSE)) == NULL) {
@@ -524,25 +619,19 @@ certhash_file(struct dirent *dep, struct hashinfo **certs,
 		goto err;
 	}
 
-	if ((hi = certhash_cert(bio, dep->d_name)) != NULL) {
-		has_cert = 1;
-		*certs = hashinfo_chain(*certs, hi);
-	}
+	if ((hi = certhash_cert(bio, job->filename)) != NULL)
+		job->objs = hashinfo_chain(job->objs, hi);
 
 	if (BIO_reset(bio) != 0) {
 		fprintf(stderr, "BIO_reset failed\n");
 		goto err;
 	}
 
-	if ((hi = certhash_crl(bio, dep->d_name)) != NULL) {
-		has_crl = hi->is_crl = 1;
-		*crls = hashinfo_chain(*crls, hi);
+	if ((hi = certhash_crl(bio, job->filename)) != NULL) {
+		hi->is_crl = 1;
+		job->objs = hashinfo_chain(job->objs, hi);
 	}
 
-	if (!has_cert && !has_crl)
-		fprintf(stderr, "PEM file %s does not contain a certificate "
-		    "or CRL, ignoring...\n", dep->d_name);
-
 	ret = 0;
 
  err:
@@ -551,10 +640,382 @@ certhash_file(struct dirent *dep, struct hashinfo **certs,
 	return (ret);
 }
 
+static pthread_mutex_t certhash_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct certhash_job *certhash_jobs;
+static size_t certhash_njobs, certhash_next;
+static int (*certhash_parse)(struct certhash_job *);
+
+static void *
+certhash_worker(void *arg)
+{
+	struct certhash_job *job;
+
+	for (;;) {
+		pthread_mutex_lock(&certhash_mutex);
+		job = NULL;
+		if (certhash_next < certhash_njobs)
+			job = &certhash_jobs[certhash_next++];
+		pthread_mutex_unlock(&certhash_mutex);
+		if (job == NULL)
+			break;
+		if (!job->cached)
+			job->status = certhash_parse(job);
+	}
+
+	return (NULL);
+}
+
+/*
+ * Parse the files that are not already known, with up to -parallel
+ * threads.
+ */
+static void
+certhash_run(struct certhash_job *jobs, size_t njobs,
+    int (*parse)(struct certhash_job *))
+{
+	pthread_t threads[CERTHASH_MAX_PARALLEL];
+	int i, nthreads, started = 0;
+
+	certhash_jobs = jobs;
+	certhash_njobs = njobs;
+	certhash_next = 0;
+	certhash_parse = parse;
+
+	nthreads = certhash_config.parallel;
+	if ((size_t)nthreads > njobs)
+		nthreads = njobs;
+	for (i = 0; nthreads > 1 && i < nthreads; i++) {
+		if (pthread_create(&threads[i], NULL, certhash_worker,
+		    NULL) != 0)
+			break;
+		started++;
+	}
+	if (started == 0)
+		certhash_worker(NULL);
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+
+	certhash_jobs = NULL;
+}
+
+static int
+certhash_job_add(struct certhash_job **jobs, size_t *njobs, size_t *maxjobs,
+    char *filename)
+{
+	struct certhash_job *job;
+	void *p;
+
+	if (*njobs == *maxjobs) {
+		if ((p = reallocarray(*jobs, *maxjobs + 1024,
+		    sizeof(**jobs))) == NULL) {
+			fprintf(stderr, "out of memory\n");
+			free(filename);
+			return (-1);
+		}
+		*jobs = p;
+		*maxjobs += 1024;
+	}
+	job = &(*jobs)[(*njobs)++];
+	memset(job, 0, sizeof(*job));
+	job->filename = filename;
+
+	return (0);
+}
+
+static void
+certhash_jobs_free(struct certhash_job *jobs, size_t njobs)
+{
+	size_t i;
+
+	for (i = 0; i < njobs; i++) {
+		free(jobs[i].filename);
+		hashinfo_chain_free(jobs[i].objs);
+	}
+	free(jobs);
+}
+
+static void
+manifest_free(struct manifest_entry *entries, size_t count)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++)
+		free(entries[i].filename);
+	free(entries);
+}
+
+static int
+manifest_compare(const void *a, const void *b)
+{
+	const struct manifest_entry *ma = a, *mb = b;
+
+	return strcmp(ma->filename, mb->filename);
+}
+
+static int
+manifest_fingerprint(const char *s, unsigned char *fingerprint)
+{
+	unsigned int v;
+	int i;
+
+	memset(fingerprint, 0, EVP_MAX_MD_SIZE);
+	if (strcmp(s, "-") == 0)
+		return (1);
+	if (strlen(s) != CERTHASH_FINGERPRINT_LEN * 2)
+		return (0);
+	for (i = 0; i < CERTHASH_FINGERPRINT_LEN; i++) {
+		if (sscanf(&s[i * 2], "%2x", &v) != 1)
+			return (0);
+		fingerprint[i] = v;
+	}
+	return (1);
+}
+
+/*
+ * Load the manifest of the current directory. A missing, outdated or
+ * damaged manifest is not an error, all files are then parsed again.
+ */
+static int
+manifest_load(struct manifest_entry **entries, size_t *count)
+{
+	struct manifest_entry *me;
+	char *line = NULL, fp[CERTHASH_FINGERPRINT_LEN * 2 + 2];
+	size_t linesize = 0, max = 0;
+	ssize_t linelen;
+	FILE *f;
+	void *p;
+	int n;
+
+	*entries = NULL;
+	*count = 0;
+
+	if ((f = fopen(CERTHASH_MANIFEST, "r")) == NULL) {
+		if (errno == ENOENT)
+			return (0);
+		fprintf(stderr, "failed to open %s: %s\n", CERTHASH_MANIFEST,
+		    strerror(errno));
+		return (-1);
+	}
+	if ((linelen = getline(&line, &linesize, f)) == -1 ||
+	    strcmp(line, CERTHASH_MANIFEST_VERSION "\n") != 0)
+		goto bad;
+
+	while ((linelen = getline(&line, &linesize, f)) != -1) {
+		if (linelen == 0 || line[linelen - 1] != '\n')
+			goto bad;
+		line[linelen - 1] = '\0';
+		if (*count == max) {
+			if ((p = reallocarray(*entries, max + 1024,
+			    sizeof(**entries))) == NULL) {
+				fprintf(stderr, "out of memory\n");
+				goto err;
+			}
+			*entries = p;
+			max += 1024;
+		}
+		me = &(*entries)[*count];
+		memset(me, 0, sizeof(*me));
+		if (sscanf(line, "%llu %lld %ld %lld %c %lx %65s %n",
+		    &me->ino, &me->mtime, &me->mtime_nsec, &me->size,
+		    &me->type, &me->hash, fp, &n) != 7 || line[n] == '\0')
+			goto bad;
+		if (me->type != 'c' && me->type != 'r' && me->type != '-')
+			goto bad;
+		if (!manifest_fingerprint(fp, me->fingerprint))
+			goto bad;
+		if ((me->filename = strdup(&line[n])) == NULL) {
+			fprintf(stderr, "out of memory\n");
+			goto err;
+		}
+		(*count)++;
+	}
+	if (ferror(f)) {
+		fprintf(stderr, "failed to read %s\n", CERTHASH_MANIFEST);
+		goto err;
+	}
+	free(line);
+	fclose(f);
+
+	qsort(*entries, *count, sizeof(**entries), manifest_compare);
+
+	return (0);
+
+ bad:
+	fprintf(stderr, "WARNING: ignoring invalid %s\n", CERTHASH_MANIFEST);
+	free(line);
+	fclose(f);
+	manifest_free(*entries, *count);
+	*entries = NULL;
+	*count = 0;
+
+	return (0);
+
+ err:
+	free(line);
+	fclose(f);
+	manifest_free(*entries, *count);
+	*entries = NULL;
+	*count = 0;
+
+	return (-1);
+}
+
+/*
+ * Take the objects for a file from the manifest, if it has not changed
+ * since the manifest was written.
+ */
+static int
+manifest_lookup(struct manifest_entry *entries, size_t count,
+    struct certhash_job *job)
+{
+	struct manifest_entry key, *me;
+	struct hashinfo *hi;
+	size_t i, first, last;
+
+	if (!job->have_sb || count == 0)
+		return (0);
+
+	key.filename = job->filename;
+	if ((me = bsearch(&key, entries, count, sizeof(*entries),
+	    manifest_compare)) == NULL)
+		return (0);
+	for (first = me - entries; first > 0; first--) {
+		if (strcmp(entries[first - 1].filename, job->filename) != 0)
+			break;
+	}
+	for (last = me - entries + 1; last < count; last++) {
+		if (strcmp(entries[last].filename, job->filename) != 0)
+			break;
+	}
+
+	for (i = first; i < last; i++) {
+		me = &entries[i];
+		if (me->ino != (unsigned long long)job->sb.st_ino ||
+		    me->mtime != (long long)job->sb.st_mtim.tv_sec ||
+		    me->mtime_nsec != job->sb.st_mtim.tv_nsec ||
+		    me->size != (long long)job->sb.st_size)
+			return (0);
+	}
+
+	for (i = first; i < last; i++) {
+		me = &entries[i];
+		if (me->type == '-')
+			continue;
+		if ((hi = hashinfo(job->filename, me->hash,
+		    me->fingerprint)) == NULL) {
+			fprintf(stderr, "out of memory\n");
+			return (-1);
+		}
+		hi->is_crl = (me->type == 'r');
+		job->objs = hashinfo_chain(job->objs, hi);
+	}
+	job->cached = 1;
+
+	return (0);
+}
+
+static int
+manifest_write_entry(FILE *f, struct certhash_job *job, struct hashinfo *hi)
+{
+	int i;
+
+	if (fprintf(f, "%llu %lld %ld %lld %c %08lx ",
+	    (unsigned long long)job->sb.st_ino,
+	    (long long)job->sb.st_mtim.tv_sec, job->sb.st_mtim.tv_nsec,
+	    (long long)job->sb.st_size,
+	    hi == NULL ? '-' : (hi->is_crl ? 'r' : 'c'),
+	    hi == NULL ? 0 : hi->hash) < 0)
+		return (-1);
+	if (hi == NULL) {
+		if (fputc('-', f) == EOF)
+			return (-1);
+	} else {
+		for (i = 0; i < CERTHASH_FINGERPRINT_LEN; i++) {
+			if (fprintf(f, "%02x", hi->fingerprint[i]) < 0)
+				return (-1);
+		}
+	}
+	if (fprintf(f, " %s\n", job->filename) < 0)
+		return (-1);
+
+	return (0);
+}
+
+/*
+ * Replace the manifest of the current directory with the objects found
+ * in each of the files that could be read.
+ */
+static int
+manifest_write(struct certhash_job *jobs, size_t njobs)
+{
+	char tmpfile[] = CERTHASH_MANIFEST ".XXXXXXXXXX";
+	struct certhash_job *job;
+	struct hashinfo *hi;
+	FILE *f = NULL;
+	size_t i;
+	int fd;
+
+	if ((fd = mkstemp(tmpfile)) == -1) {
+		fprintf(stderr, "failed to create %s: %s\n", tmpfile,
+		    strerror(errno));
+		return (-1);
+	}
+	if (fchmod(fd, 0644) == -1 || (f = fdopen(fd, "w")) == NULL) {
+		fprintf(stderr, "failed to open %s: %s\n", tmpfile,
+		    strerror(errno));
+		close(fd);
+		goto err;
+	}
+
+	if (fprintf(f, "%s\n", CERTHASH_MANIFEST_VERSION) < 0)
+		goto werr;
+	for (i = 0; i < njobs; i++) {
+		job = &jobs[i];
+		if (job->status != 0 || !job->have_sb ||
+		    strchr(job->filename, '\n') != NULL)
+			continue;
+		if (job->objs == NULL) {
+			if (manifest_write_entry(f, job, NULL) == -1)
+				goto werr;
+			continue;
+		}
+		for (hi = job->objs; hi != NULL; hi = hi->next) {
+			if (manifest_write_entry(f, job, hi) == -1)
+				goto werr;
+		}
+	}
+	if (fclose(f) != 0) {
+		f = NULL;
+		goto werr;
+	}
+	f = NULL;
+	if (rename(tmpfile, CERTHASH_MANIFEST) == -1) {
+		fprintf(stderr, "failed to rename %s to %s: %s\n", tmpfile,
+		    CERTHASH_MANIFEST, strerror(errno));
+		goto err;
+	}
+
+	return (0);
+
+ werr:
+	fprintf(stderr, "failed to write %s: %s\n", tmpfile, strerror(errno));
+ err:
+	if (f != NULL)
+		fclose(f);
+	unlink(tmpfile);
+
+	return (-1);
+}
+
 static int
 certhash_directory(const char *path)
 {
 	struct hashinfo *links = NULL, *certs = NULL, *crls = NULL, *link;
+	struct hashinfo *hi, *next;
+	struct manifest_entry *manifest = NULL;
+	struct certhash_job *jobs = NULL, *job;
+	size_t i, njobs = 0, maxjobs = 0, nmanifest = 0, cached = 0;
+	char *filename;
 	int ret = 0;
 	struct dirent *dep;
 	DIR *dip = NULL;
@@ -567,18 +1028,70 @@ certhash_directory(const char *path)
 	if (certhash_config.verbose)
 		fprintf(stdout, "scanning directory %s\n", path);
 
-	/* Create lists of existing hash links, certs and CRLs. */
+	/* Create lists of existing hash links and of PEM files. */
 	while ((dep = readdir(dip)) != NULL) {
 		if (filename_is_hash(dep->d_name)) {
 			if (certhash_link(dep, &links) == -1)
 				goto err;
 		}
 		if (filename_is_pem(dep->d_name)) {
-			if (certhash_file(dep, &certs, &crls) == -1)
+			if ((filename = strdup(dep->d_name)) == NULL) {
+				fprintf(stderr, "out of memory\n");
+				goto err;
+			}
+			if (certhash_job_add(&jobs, &njobs, &maxjobs,
+			    filename) == -1)
 				goto err;
 		}
 	}
 
+	if (certhash_config.incremental) {
+		if (manifest_load(&manifest, &nmanifest) == -1)
+			goto err;
+	}
+	for (i = 0; i < njobs; i++) {
+		job = &jobs[i];
+		if (stat(job->filename, &job->sb) == 0)
+			job->have_sb = 1;
+		if (manifest_lookup(manifest, nmanifest, job) == -1)
+			goto err;
+		if (job->cached)
+			cached++;
+	}
+	if (certhash_config.incremental && certhash_config.verbose)
+		fprintf(stdout, "parsing %zu of %zu files\n", njobs - cached,
+		    njobs);
+
+	certhash_run(jobs, njobs, certhash_file);
+
+	for (i = 0; i < njobs; i++) {
+		if (jobs[i].status == -1)
+			goto err;
+	}
+	if (certhash_config.incremental && !certhash_config.dryrun) {
+		if (manifest_write(jobs, njobs) == -1)
+			goto err;
+	}
+
+	/* Create lists of certs and CRLs. */
+	for (i = 0; i < njobs; i++) {
+		job = &jobs[i];
+		if (job->objs == NULL)
+			fprintf(stderr, "PEM file %s does not contain a "
+			    "certificate or CRL, ignoring...\n", job->filename);
+		for (hi = job->objs; hi != NULL; hi = next) {
+			next = hi->next;
+			if (hi->is_crl) {
+				hi->next = crls;
+				crls = hi;
+			} else {
+				hi->next = certs;
+				certs = hi;
+			}
+		}
+		job->objs = NULL;
+	}
+
 	if (certhash_merge(&links, &certs, &crls) == -1) {
 		fprintf(stderr, "certhash merge failed\n");
 		goto err;
@@ -629,16 +1142,342 @@ certhash_directory(const char *path)
 	hashinfo_chain_free(certs);
 	hashinfo_chain_free(crls);
 	hashinfo_chain_free(links);
+	certhash_jobs_free(jobs, njobs);
+	manifest_free(manifest, nmanifest);
 
 	if (dip != NULL)
 		closedir(dip);
 	return (ret);
 }
 
+/*
+ * Indexed trust store, as read by X509_LOOKUP_index(3).  All integers
+ * are 32 bit big endian: a header of magic, version and entry count,
+ * then one entry of name hash, type, offset and length per object,
+ * sorted by name hash, then the DER encoded objects.
+ */
+#define CERTHASH_INDEX_MAGIC		"CERTINDX"
+#define CERTHASH_INDEX_VERSION		1
+#define CERTHASH_INDEX_HEADER_LEN	16
+#define CERTHASH_INDEX_ENTRY_LEN	16
+
+static struct hashinfo *
+certhash_index_object(X509 *cert, X509_CRL *crl, const char *filename)
+{
+	unsigned char fingerprint[EVP_MAX_MD_SIZE];
+	struct hashinfo *hi = NULL;
+	unsigned char *der = NULL;
+	unsigned long hash;
+	unsigned int len;
+	int der_len;
+
+	if (cert != NULL) {
+		hash = X509_subject_name_hash(cert);
+		if (X509_digest(cert, EVP_sha256(), fingerprint, &len) != 1)
+			goto err;
+		der_len = i2d_X509(cert, &der);
+	} else {
+		hash = X509_NAME_hash(X509_CRL_get_issuer(crl));
+		if (X509_CRL_digest(crl, EVP_sha256(), fingerprint,
+		    &len) != 1)
+			goto err;
+		der_len = i2d_X509_CRL(crl, &der);
+	}
+	if (der_len <= 0)
+		goto err;
+
+	if ((hi = hashinfo(filename, hash, fingerprint)) == NULL)
+		goto err;
+	hi->der = der;
+	hi->der_len = der_len;
+	hi->is_crl = (crl != NULL);
+
+	return (hi);
+
+ err:
+	fprintf(stderr, "failed to encode object from %s\n", filename);
+	free(der);
+
+	return (NULL);
+}
+
+static int
+certhash_index_file(const char *filename, struct hashinfo **objs);
+
+static int
+certhash_index_job(struct certhash_job *job)
+{
+	return certhash_index_file(job->filename, &job->objs);
+}
+
+static int
+certhash_index_file(const char *filename, struct hashinfo **objs)
+{
+	STACK_OF(X509_INFO) *xis = NULL;
+	struct hashinfo *hi;
+	X509_INFO *xi;
+	BIO *bio = NULL;
+	int i, count = 0;
+	int ret = -1;
+
+	if ((bio = BIO_new_file(filename, "r")) == NULL) {
+		fprintf(stderr, "failed to open %s\n", filename);
+		goto err;
+	}
+	if ((xis = PEM_X509_INFO_read_bio(bio, NULL, NULL, NULL)) == NULL) {
+		fprintf(stderr, "failed to read PEM file %s\n", filename);
+		goto err;
+	}
+
+	for (i = 0; i < sk_X509_INFO_num(xis); i++) {
+		xi = sk_X509_INFO_value(xis, i);
+		if (xi->x509 != NULL) {
+			if ((hi = certhash_index_object(xi->x509, NULL,
+			    filename)) == NULL)
+				goto err;
+			/* Sorted before writing, so prepend. */
+			hi->next = *objs;
+			*objs = hi;
+			count++;
+		}
+		if (xi->crl != NULL) {
+			if ((hi = certhash_index_object(NULL, xi->crl,
+			    filename)) == NULL)
+				goto err;
+			hi->next = *objs;
+			*objs = hi;
+			count++;
+		}
+	}
+
+	if (count == 0)
+		fprintf(stderr, "PEM file %s does not contain a certificate "
+		    "or CRL, ignoring...\n", filename);
+	else if (certhash_config.verbose)
+		fprintf(stdout, "read %d objects from %s\n", count, filename);
+
+	ret = 0;
+
+ err:
+	sk_X509_INFO_pop_free(xis, X509_INFO_free);
+	BIO_free(bio);
+
+	return (ret);
+}
+
+static int
+certhash_index_path(const char *path, struct certhash_job **jobs,
+    size_t *njobs, size_t *maxjobs)
+{
+	struct dirent *dep;
+	struct stat sb;
+	DIR *dip = NULL;
+	char *filename;
+	int ret = -1;
+
+	if (stat(path, &sb) == -1) {
+		fprintf(stderr, "failed to stat %s: %s\n", path,
+		    strerror(errno));
+		return (-1);
+	}
+	if (!S_ISDIR(sb.st_mode)) {
+		if ((filename = strdup(path)) == NULL) {
+			fprintf(stderr, "out of memory\n");
+			return (-1);
+		}
+		return certhash_job_add(jobs, njobs, maxjobs, filename);
+	}
+
+	if ((dip = opendir(path)) == NULL) {
+		fprintf(stderr, "failed to open directory %s\n", path);
+		return (-1);
+	}
+	if (certhash_config.verbose)
+		fprintf(stdout, "scanning directory %s\n", path);
+
+	while ((dep = readdir(dip)) != NULL) {
+		if (!filename_is_pem(dep->d_name))
+			continue;
+		if (asprintf(&filename, "%s/%s", path, dep->d_name) == -1) {
+			fprintf(stderr, "out of memory\n");
+			goto err;
+		}
+		if (certhash_job_add(jobs, njobs, maxjobs, filename) == -1)
+			goto err;
+	}
+
+	ret = 0;
+
+ err:
+	closedir(dip);
+
+	return (ret);
+}
+
+static void
+certhash_put32(unsigned char *p, unsigned long v)
+{
+	p[0] = (v >> 24) & 0xff;
+	p[1] = (v >> 16) & 0xff;
+	p[2] = (v >> 8) & 0xff;
+	p[3] = v & 0xff;
+}
+
+static int
+certhash_index_write(struct hashinfo **objs)
+{
+	unsigned char header[CERTHASH_INDEX_HEADER_LEN];
+	unsigned char entry[CERTHASH_INDEX_ENTRY_LEN];
+	struct hashinfo *hi, *prev;
+	unsigned long count = 0, offset;
+	char *tmpfile = NULL;
+	FILE *f = NULL;
+	int fd = -1;
+	int ret = -1;
+
+	if (hashinfo_chain_sort(objs) == -1) {
+		fprintf(stderr, "failed to sort objects\n");
+		goto err;
+	}
+
+	/* Duplicates sort next to each other. */
+	for (hi = *objs, prev = NULL; hi != NULL; prev = hi, hi = hi->next) {
+		if (prev != NULL && prev->hash == hi->hash &&
+		    prev->is_crl == hi->is_crl &&
+		    memcmp(prev->fingerprint, hi->fingerprint,
+		    sizeof(hi->fingerprint)) == 0) {
+			fprintf(stderr, "WARNING: duplicate %s in %s "
+			    "(using %s), ignoring...\n",
+			    hi->is_crl ? "CRL" : "certificate", hi->filename,
+			    prev->filename);
+			hi->is_dup = 1;
+			continue;
+		}
+		count++;
+	}
+
+	if (certhash_config.verbose)
+		fprintf(stdout, "%s %lu objects to %s\n",
+		    (certhash_config.dryrun ? "would write" : "writing"),
+		    count, certhash_config.outfile);
+	if (certhash_config.dryrun)
+		return (0);
+
+	if (asprintf(&tmpfile, "%s.XXXXXXXXXX",
+	    certhash_config.outfile) == -1) {
+		fprintf(stderr, "out of memory\n");
+		goto err;
+	}
+	if ((fd = mkstemp(tmpfile)) == -1) {
+		fprintf(stderr, "failed to create %s: %s\n", tmpfile,
+		    strerror(errno));
+		goto err;
+	}
+	if (fchmod(fd, 0644) == -1 || (f = fdopen(fd, "w")) == NULL) {
+		fprintf(stderr, "failed to open %s: %s\n", tmpfile,
+		    strerror(errno));
+		goto err;
+	}
+	fd = -1;
+
+	memcpy(header, CERTHASH_INDEX_MAGIC, 8);
+	certhash_put32(&header[8], CERTHASH_INDEX_VERSION);
+	certhash_put32(&header[12], count);
+	if (fwrite(header, sizeof(header), 1, f) != 1)
+		goto werr;
+
+	offset = CERTHASH_INDEX_HEADER_LEN + count * CERTHASH_INDEX_ENTRY_LEN;
+	for (hi = *objs; hi != NULL; hi = hi->next) {
+		if (hi->is_dup)
+			continue;
+		if (offset > 0xffffffffUL - hi->der_len) {
+			fprintf(stderr, "index file too large\n");
+			goto err;
+		}
+		certhash_put32(&entry[0], hi->hash);
+		certhash_put32(&entry[4], hi->is_crl ? X509_LU_CRL :
+		    X509_LU_X509);
+		certhash_put32(&entry[8], offset);
+		certhash_put32(&entry[12], hi->der_len);
+		if (fwrite(entry, sizeof(entry), 1, f) != 1)
+			goto werr;
+		offset += hi->der_len;
+	}
+	for (hi = *objs; hi != NULL; hi = hi->next) {
+		if (hi->is_dup)
+			continue;
+		if (fwrite(hi->der, hi->der_len, 1, f) != 1)
+			goto werr;
+	}
+
+	if (fclose(f) != 0) {
+		f = NULL;
+		goto werr;
+	}
+	f = NULL;
+	if (rename(tmpfile, certhash_config.outfile) == -1) {
+		fprintf(stderr, "failed to rename %s to %s: %s\n", tmpfile,
+		    certhash_config.outfile, strerror(errno));
+		goto err;
+	}
+	free(tmpfile);
+
+	return (0);
+
+ werr:
+	fprintf(stderr, "failed to write %s: %s\n", tmpfile, strerror(errno));
+ err:
+	if (f != NULL)
+		fclose(f);
+	if (fd != -1)
+		close(fd);
+	if (tmpfile != NULL) {
+		unlink(tmpfile);
+		free(tmpfile);
+	}
+
+	return (ret);
+}
+
+static int
+certhash_build_index(int argc, char **argv)
+{
+	struct hashinfo *objs = NULL, *hi, *next;
+	struct certhash_job *jobs = NULL;
+	size_t j, njobs = 0, maxjobs = 0;
+	int i, ret = 0;
+
+	for (i = 0; i < argc; i++) {
+		if (certhash_index_path(argv[i], &jobs, &njobs,
+		    &maxjobs) == -1)
+			ret = 1;
+	}
+	if (ret == 0)
+		certhash_run(jobs, njobs, certhash_index_job);
+	for (j = 0; ret == 0 && j < njobs; j++) {
+		if (jobs[j].status == -1)
+			ret = 1;
+		for (hi = jobs[j].objs; hi != NULL; hi = next) {
+			next = hi->next;
+			hi->next = objs;
+			objs = hi;
+		}
+		jobs[j].objs = NULL;
+	}
+	if (ret == 0 && certhash_index_write(&objs) == -1)
+		ret = 1;
+
+	hashinfo_chain_free(objs);
+	certhash_jobs_free(jobs, njobs);
+
+	return (ret);
+}
+
 static void
 certhash_usage(void)
 {
-	fprintf(stderr, "usage: certhash [-nv] dir ...\n");
+	fprintf(stderr, "usage: certhash [-inv] [-o file] [-parallel n] "
+	    "dir ...\n");
 	options_usage(certhash_options);
 }
 
@@ -661,6 +1500,15 @@ certhash_main(int argc, char **argv)
                 certhash_usage();
                 return (1);
         }
+	if (certhash_config.parallel < 0 ||
+	    certhash_config.parallel > CERTHASH_MAX_PARALLEL) {
+		fprintf(stderr, "-parallel must be between 1 and %d\n",
+		    CERTHASH_MAX_PARALLEL);
+		return (1);
+	}
+
+	if (certhash_config.outfile != NULL)
+		return certhash_build_index(argc - argsused, argv + argsused);
 
 	if ((cwdfd = open(".", O_RDONLY)) == -1) {
 		perror("failed to open current directory");
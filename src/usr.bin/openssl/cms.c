@@ -709,7 +709,9 @@ cms_main(int argc, char **argv)
 		in = BIO_new_fp(stdin, BIO_NOCLOSE);
 
 	if (operation & SMIME_IP) {
-		if (informat == FORMAT_SMIME)
+		if (informat == FORMAT_SMIME && (flags & CMS_STREAM))
+			cms = SMIME_read_CMS_stream(in, &indata);
+		else if (informat == FORMAT_SMIME)
 			cms = SMIME_read_CMS(in, &indata);
 		else if (informat == FORMAT_PEM)
 			cms = PEM_read_bio_CMS(in, NULL, NULL, NULL);
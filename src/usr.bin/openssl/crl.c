@@ -56,9 +56,13 @@
  * [including the GNU Public Licence.]
  */
 
+#include <sys/stat.h>
+
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "apps.h"
 
@@ -72,6 +76,8 @@ static struct {
 	char *cafile;
 	char *capath;
 	int crlnumber;
+	char *filtercerts;
+	char *filterout;
 	int fingerprint;
 	int hash;
 	int hash_old;
@@ -109,6 +115,20 @@ static const struct option crl_options[] = {
 		.type = OPTION_FLAG_ORD,
 		.opt.flag = &crl_config.crlnumber,
 	},
+	{
+		.name = "filtercerts",
+		.argname = "file",
+		.desc = "Unrevoked certificates to build the CRL filter from",
+		.type = OPTION_ARG,
+		.opt.arg = &crl_config.filtercerts,
+	},
+	{
+		.name = "filterout",
+		.argname = "file",
+		.desc = "Write a revocation filter for all CRLs in the input",
+		.type = OPTION_ARG,
+		.opt.arg = &crl_config.filterout,
+	},
 	{
 		.name = "fingerprint",
 		.desc = "Print the CRL fingerprint",
@@ -205,14 +225,17 @@ static void
 crl_usage(void)
 {
 	fprintf(stderr,
-	    "usage: crl [-CAfile file] [-CApath dir] [-fingerprint] [-hash]\n"
-	    "    [-in file] [-inform DER | PEM] [-issuer] [-lastupdate]\n"
-	    "    [-nextupdate] [-noout] [-out file] [-outform DER | PEM]\n"
-	    "    [-text]\n\n");
+	    "usage: crl [-CAfile file] [-CApath dir] [-filtercerts file]\n"
+	    "    [-filterout file] [-fingerprint] [-hash] [-in file]\n"
+	    "    [-inform DER | PEM] [-issuer] [-lastupdate] [-nextupdate]\n"
+	    "    [-noout] [-out file] [-outform DER | PEM] [-text]\n\n");
 	options_usage(crl_options);
 }
 
 static X509_CRL *load_crl(char *file, int format);
+static X509_STORE *crl_store(void);
+static int crl_verify(X509_STORE *store, X509_CRL *x);
+static int crl_write_filter(X509_STORE *store);
 static BIO *bio_out = NULL;
 
 int
@@ -223,10 +246,6 @@ crl_main(int argc, char **argv)
 	int ret = 1, i;
 	BIO *out = NULL;
 	X509_STORE *store = NULL;
-	X509_STORE_CTX ctx;
-	X509_LOOKUP *lookup = NULL;
-	X509_OBJECT xobj;
-	EVP_PKEY *pkey;
 	const EVP_MD *digest;
 	char *digest_name = NULL;
 
@@ -275,51 +294,22 @@ crl_main(int argc, char **argv)
 		}
 	}
 
+	if (crl_config.verify) {
+		if ((store = crl_store()) == NULL)
+			goto end;
+	}
+
+	if (crl_config.filterout != NULL) {
+		ret = crl_write_filter(store);
+		goto end;
+	}
+
 	x = load_crl(crl_config.infile, crl_config.informat);
 	if (x == NULL)
 		goto end;
 
 	if (crl_config.verify) {
-		store = X509_STORE_new();
-		lookup = X509_STORE_add_lookup(store, X509_LOOKUP_file());
-		if (lookup == NULL)
-			goto end;
-		if (!X509_LOOKUP_load_file(lookup, crl_config.cafile,
-		    X509_FILETYPE_PEM))
-			X509_LOOKUP_load_file(lookup, NULL,
-			    X509_FILETYPE_DEFAULT);
-
-		lookup = X509_STORE_add_lookup(store, X509_LOOKUP_hash_dir());
-		if (lookup == NULL)
-			goto end;
-		if (!X509_LOOKUP_add_dir(lookup, crl_config.capath,
-		    X509_FILETYPE_PEM))
-			X509_LOOKUP_add_dir(lookup, NULL,
-			    X509_FILETYPE_DEFAULT);
-		ERR_clear_error();
-
-		if (!X509_STORE_CTX_init(&ctx, store, NULL, NULL)) {
-			BIO_printf(bio_err,
-			    "Error initialising X509 store\n");
-			goto end;
-		}
-		i = X509_STORE_get_by_subject(&ctx, X509_LU_X509,
-		    X509_CRL_get_issuer(x), &xobj);
-		if (i <= 0) {
-			BIO_printf(bio_err,
-			    "Error getting CRL issuer certificate\n");
-			goto end;
-		}
-		pkey = X509_get_pubkey(xobj.data.x509);
-		X509_OBJECT_free_contents(&xobj);
-		if (!pkey) {
-			BIO_printf(bio_err,
-			    "Error getting CRL issuer public key\n");
-			goto end;
-		}
-		i = X509_CRL_verify(x, pkey);
-		EVP_PKEY_free(pkey);
-		if (i < 0)
+		if ((i = crl_verify(store, x)) < 0)
 			goto end;
 		if (i == 0)
 			BIO_printf(bio_err, "verify failure\n");
@@ -429,10 +419,170 @@ crl_main(int argc, char **argv)
 	BIO_free_all(bio_out);
 	bio_out = NULL;
 	X509_CRL_free(x);
-	if (store) {
-		X509_STORE_CTX_cleanup(&ctx);
-		X509_STORE_free(store);
+	X509_STORE_free(store);
+
+	return (ret);
+}
+
+static X509_STORE *
+crl_store(void)
+{
+	X509_STORE *store;
+	X509_LOOKUP *lookup;
+
+	if ((store = X509_STORE_new()) == NULL)
+		return (NULL);
+
+	lookup = X509_STORE_add_lookup(store, X509_LOOKUP_file());
+	if (lookup == NULL)
+		goto err;
+	if (!X509_LOOKUP_load_file(lookup, crl_config.cafile,
+	    X509_FILETYPE_PEM))
+		X509_LOOKUP_load_file(lookup, NULL, X509_FILETYPE_DEFAULT);
+
+	lookup = X509_STORE_add_lookup(store, X509_LOOKUP_hash_dir());
+	if (lookup == NULL)
+		goto err;
+	if (!X509_LOOKUP_add_dir(lookup, crl_config.capath,
+	    X509_FILETYPE_PEM))
+		X509_LOOKUP_add_dir(lookup, NULL, X509_FILETYPE_DEFAULT);
+	ERR_clear_error();
+
+	return (store);
+
+ err:
+	X509_STORE_free(store);
+	return (NULL);
+}
+
+/* Return 1 if the signature on x is good, 0 if not and -1 on error. */
+static int
+crl_verify(X509_STORE *store, X509_CRL *x)
+{
+	X509_STORE_CTX ctx;
+	X509_OBJECT xobj;
+	EVP_PKEY *pkey;
+	int i, ret = -1;
+
+	if (!X509_STORE_CTX_init(&ctx, store, NULL, NULL)) {
+		BIO_printf(bio_err, "Error initialising X509 store\n");
+		return (-1);
+	}
+	i = X509_STORE_get_by_subject(&ctx, X509_LU_X509,
+	    X509_CRL_get_issuer(x), &xobj);
+	if (i <= 0) {
+		BIO_printf(bio_err, "Error getting CRL issuer certificate\n");
+		goto end;
+	}
+	pkey = X509_get_pubkey(xobj.data.x509);
+	X509_OBJECT_free_contents(&xobj);
+	if (!pkey) {
+		BIO_printf(bio_err, "Error getting CRL issuer public key\n");
+		goto end;
+	}
+	ret = X509_CRL_verify(x, pkey);
+	EVP_PKEY_free(pkey);
+
+ end:
+	X509_STORE_CTX_cleanup(&ctx);
+
+	return (ret);
+}
+
+/*
+ * Write a revocation filter for every CRL in the input.  The file is
+ * replaced atomically, since verifiers may have the old one mapped.
+ */
+static int
+crl_write_filter(X509_STORE *store)
+{
+	STACK_OF(X509_CRL) *crls = NULL;
+	STACK_OF(X509) *certs = NULL;
+	X509_CRL *x = NULL;
+	BIO *out = NULL;
+	char *tmpfile = NULL;
+	int fd = -1, i, ret = 1;
+
+	if (crl_config.informat == FORMAT_PEM) {
+		crls = load_crls(bio_err, crl_config.infile,
+		    crl_config.informat, NULL, "CRLs");
+		if (crls == NULL)
+			goto end;
+	} else {
+		if ((x = load_crl(crl_config.infile,
+		    crl_config.informat)) == NULL)
+			goto end;
+		if ((crls = sk_X509_CRL_new_null()) == NULL ||
+		    !sk_X509_CRL_push(crls, x)) {
+			BIO_printf(bio_err, "out of memory\n");
+			X509_CRL_free(x);
+			goto end;
+		}
+	}
+
+	if (store != NULL) {
+		for (i = 0; i < sk_X509_CRL_num(crls); i++) {
+			x = sk_X509_CRL_value(crls, i);
+			if (crl_verify(store, x) != 1) {
+				print_name(bio_err, "verify failure: issuer=",
+				    X509_CRL_get_issuer(x), 0);
+				goto end;
+			}
+		}
+	}
+
+	if (crl_config.filtercerts != NULL) {
+		certs = load_certs(bio_err, crl_config.filtercerts,
+		    FORMAT_PEM, NULL, "certificates");
+		if (certs == NULL)
+			goto end;
+	}
+
+	if (asprintf(&tmpfile, "%s.XXXXXXXXXX", crl_config.filterout) == -1) {
+		tmpfile = NULL;
+		BIO_printf(bio_err, "out of memory\n");
+		goto end;
+	}
+	if ((fd = mkstemp(tmpfile)) == -1) {
+		BIO_printf(bio_err, "failed to create %s: %s\n", tmpfile,
+		    strerror(errno));
+		goto end;
+	}
+	if (fchmod(fd, 0644) == -1 ||
+	    (out = BIO_new_fd(fd, BIO_CLOSE)) == NULL) {
+		BIO_printf(bio_err, "failed to open %s: %s\n", tmpfile,
+		    strerror(errno));
+		goto end;
+	}
+	fd = -1;
+
+	if (!X509_CRL_filter_write(out, crls, certs)) {
+		BIO_printf(bio_err, "unable to write CRL filter\n");
+		ERR_print_errors(bio_err);
+		goto end;
+	}
+	BIO_free(out);
+	out = NULL;
+	if (rename(tmpfile, crl_config.filterout) == -1) {
+		BIO_printf(bio_err, "failed to rename %s to %s: %s\n",
+		    tmpfile, crl_config.filterout, strerror(errno));
+		goto end;
+	}
+	free(tmpfile);
+	tmpfile = NULL;
+
+	ret = 0;
+
+ end:
+	BIO_free(out);
+	if (fd != -1)
+		close(fd);
+	if (tmpfile != NULL) {
+		unlink(tmpfile);
+		free(tmpfile);
 	}
+	sk_X509_CRL_pop_free(crls, X509_CRL_free);
+	sk_X509_pop_free(certs, X509_free);
 
 	return (ret);
 }
@@ -56,9 +56,13 @@
  * [including the GNU Public Licence.]
  */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "apps.h"
 
@@ -71,12 +75,26 @@
 #include <openssl/x509.h>
 
 #define BUFSIZE	1024*8
+#define READSIZE	(1024*1024)
+#define MAX_PARALLEL	256
 
 int
 do_fp(BIO * out, unsigned char *buf, BIO * bp, int sep, int binout,
     EVP_PKEY * key, unsigned char *sigin, int siglen,
     const char *sig_name, const char *md_name,
     const char *file, BIO * bmd);
+static int
+do_final(BIO * out, unsigned char *buf, EVP_MD_CTX * ctx, int sep,
+    int binout, EVP_PKEY * key, unsigned char *sigin, int siglen,
+    const char *sig_name, const char *md_name, const char *file);
+
+/* A file digested by one of the -parallel threads. */
+struct dgst_job {
+	const char *file;
+	EVP_MD_CTX *ctx;
+	int status;
+	int error;
+};
 
 static struct {
 	int argsused;
@@ -91,6 +109,7 @@ static struct {
 	const EVP_MD *md;
 	int out_bin;
 	char *outfile;
+	int parallel;
 	char *passargin;
 	int separator;
 	char *sigfile;
@@ -233,6 +252,13 @@ static const struct option dgst_options[] = {
 		.type = OPTION_ARG,
 		.opt.arg = &dgst_config.outfile,
 	},
+	{
+		.name = "parallel",
+		.argname = "n",
+		.desc = "Digest up to n files at the same time",
+		.type = OPTION_ARG_INT,
+		.opt.value = &dgst_config.parallel,
+	},
 	{
 		.name = "passin",
 		.argname = "arg",
@@ -311,14 +337,177 @@ list_md_fn(const EVP_MD * m, const char *from, const char *to, void *arg)
 	    mname, mname);
 }
 
+/*
+ * Digest the data read from fd, calling EVP_DigestUpdate() directly on
+ * large reads rather than going through the BIO chain in BUFSIZE
+ * pieces.
+ */
+static int
+dgst_fd(EVP_MD_CTX *ctx, int fd, int *error)
+{
+	unsigned char *buf;
+	ssize_t n;
+	int ret = 0;
+
+	*error = 0;
+	if ((buf = malloc(READSIZE)) == NULL) {
+		*error = errno;
+		return 0;
+	}
+	for (;;) {
+		if ((n = read(fd, buf, READSIZE)) == -1) {
+			if (errno == EINTR)
+				continue;
+			*error = errno;
+			goto end;
+		}
+		if (n == 0)
+			break;
+		if (!EVP_DigestUpdate(ctx, buf, n))
+			goto end;
+	}
+	ret = 1;
+
+ end:
+	freezero(buf, READSIZE);
+
+	return ret;
+}
+
+/*
+ * Returns 1 if the file was digested, 0 on a read or digest error and
+ * -1 if it could not be opened, with errno in error.
+ */
+static int
+dgst_file(EVP_MD_CTX *ctx, const char *file, int *error)
+{
+	int fd, ret;
+
+	if ((fd = open(file, O_RDONLY)) == -1) {
+		*error = errno;
+		return -1;
+	}
+	ret = dgst_fd(ctx, fd, error);
+	close(fd);
+
+	return ret;
+}
+
+static pthread_mutex_t dgst_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct dgst_job *dgst_jobs;
+static int dgst_njobs, dgst_next;
+
+static void *
+dgst_worker(void *arg)
+{
+	struct dgst_job *job;
+
+	for (;;) {
+		pthread_mutex_lock(&dgst_mutex);
+		job = dgst_next < dgst_njobs ? &dgst_jobs[dgst_next++] : NULL;
+		pthread_mutex_unlock(&dgst_mutex);
+		if (job == NULL)
+			break;
+		job->status = dgst_file(job->ctx, job->file, &job->error);
+	}
+
+	return NULL;
+}
+
+/*
+ * Digest the files with up to nthreads threads, each with its own copy
+ * of the initialised context in mctx, then output the results in the
+ * order the files were given.
+ */
+static int
+dgst_parallel(BIO *out, unsigned char *buf, EVP_MD_CTX *mctx, int nthreads,
+    EVP_PKEY *sigkey, unsigned char *sigbuf, int siglen,
+    const char *sig_name, const char *md_name, int argc, char **argv)
+{
+	pthread_t *threads = NULL;
+	struct dgst_job *job;
+	int i, r, started = 0, err = 1;
+
+	if ((dgst_jobs = calloc(argc, sizeof(*dgst_jobs))) == NULL ||
+	    (threads = calloc(nthreads, sizeof(*threads))) == NULL) {
+		BIO_printf(bio_err, "out of memory\n");
+		goto end;
+	}
+	for (i = 0; i < argc; i++) {
+		job = &dgst_jobs[i];
+		job->file = argv[i];
+		if ((job->ctx = EVP_MD_CTX_new()) == NULL ||
+		    !EVP_MD_CTX_copy_ex(job->ctx, mctx)) {
+			BIO_printf(bio_err, "Error copying context\n");
+			ERR_print_errors(bio_err);
+			goto end;
+		}
+	}
+	dgst_njobs = argc;
+	dgst_next = 0;
+
+	if (nthreads > argc)
+		nthreads = argc;
+	for (i = 0; i < nthreads; i++) {
+		if ((errno = pthread_create(&threads[i], NULL, dgst_worker,
+		    NULL)) != 0) {
+			BIO_printf(bio_err, "pthread_create: %s\n",
+			    strerror(errno));
+			break;
+		}
+		started++;
+	}
+	/* If no thread could be started, do the work here. */
+	if (started == 0)
+		dgst_worker(NULL);
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+
+	err = 0;
+	for (i = 0; i < argc; i++) {
+		job = &dgst_jobs[i];
+		if (job->status == -1) {
+			errno = job->error;
+			perror(job->file);
+			err++;
+			continue;
+		}
+		if (job->status == 0) {
+			BIO_printf(bio_err, "Read Error in %s\n", job->file);
+			if (job->error != 0)
+				BIO_printf(bio_err, "%s\n",
+				    strerror(job->error));
+			ERR_print_errors(bio_err);
+			r = 1;
+		} else
+			r = do_final(out, buf, job->ctx, dgst_config.separator,
+			    dgst_config.out_bin, sigkey, sigbuf, siglen,
+			    sig_name, md_name, job->file);
+		if (r)
+			err = r;
+	}
+
+ end:
+	if (dgst_jobs != NULL) {
+		for (i = 0; i < argc; i++)
+			EVP_MD_CTX_free(dgst_jobs[i].ctx);
+	}
+	free(dgst_jobs);
+	dgst_jobs = NULL;
+	free(threads);
+
+	return err;
+}
+
 static void
 dgst_usage(void)
 {
 	fprintf(stderr, "usage: dgst [-cdr] [-binary] [-digest] [-hex]");
 	fprintf(stderr, " [-hmac key] [-keyform fmt]\n");
 	fprintf(stderr, "    [-mac algorithm] [-macopt nm:v] [-out file]");
-	fprintf(stderr, " [-passin arg]\n");
-	fprintf(stderr, "    [-prverify file] [-sign file]");
+	fprintf(stderr, " [-parallel n]\n");
+	fprintf(stderr, "    [-passin arg]");
+	fprintf(stderr, " [-prverify file] [-sign file]");
 	fprintf(stderr, " [-signature file]\n");
 	fprintf(stderr, "    [-sigopt nm:v] [-verify file] [file ...]\n\n");
 	options_usage(dgst_options);
@@ -334,6 +523,7 @@ dgst_main(int argc, char **argv)
 	BIO *in = NULL, *inp;
 	BIO *bmd = NULL;
 	BIO *out = NULL;
+	EVP_MD_CTX *mctx;
 #define PROG_NAME_SIZE  39
 	char pname[PROG_NAME_SIZE + 1];
 	EVP_PKEY *sigkey = NULL;
@@ -370,6 +560,17 @@ dgst_main(int argc, char **argv)
 	argc -= dgst_config.argsused;
 	argv += dgst_config.argsused;
 
+	if (dgst_config.parallel < 0 ||
+	    dgst_config.parallel > MAX_PARALLEL) {
+		BIO_printf(bio_err, "-parallel must be between 1 and %d\n",
+		    MAX_PARALLEL);
+		goto end;
+	}
+	if (dgst_config.parallel > 0 && dgst_config.debug) {
+		BIO_printf(bio_err, "-parallel cannot be used with -d\n");
+		goto end;
+	}
+
 	if (dgst_config.do_verify && !dgst_config.sigfile) {
 		BIO_printf(bio_err,
 		    "No signature to verify: use the -signature option\n");
@@ -546,16 +747,25 @@ dgst_main(int argc, char **argv)
 	}
 	inp = BIO_push(bmd, in);
 
-	if (dgst_config.md == NULL) {
-		EVP_MD_CTX *tctx;
-		BIO_get_md_ctx(bmd, &tctx);
-		dgst_config.md = EVP_MD_CTX_md(tctx);
-	}
-	if (argc == 0) {
+	BIO_get_md_ctx(bmd, &mctx);
+	if (dgst_config.md == NULL)
+		dgst_config.md = EVP_MD_CTX_md(mctx);
+	if (argc == 0 && dgst_config.debug) {
 		BIO_set_fp(in, stdin, BIO_NOCLOSE);
 		err = do_fp(out, buf, inp, dgst_config.separator,
 		    dgst_config.out_bin, sigkey, sigbuf, siglen, NULL, NULL,
 		    "stdin", bmd);
+	} else if (argc == 0) {
+		int error;
+
+		if (!dgst_fd(mctx, STDIN_FILENO, &error)) {
+			BIO_printf(bio_err, "Read Error in stdin\n");
+			ERR_print_errors(bio_err);
+			goto end;
+		}
+		err = do_final(out, buf, mctx, dgst_config.separator,
+		    dgst_config.out_bin, sigkey, sigbuf, siglen, NULL, NULL,
+		    "stdin");
 	} else {
 		const char *md_name = NULL, *sig_name = NULL;
 		if (!dgst_config.out_bin) {
@@ -568,17 +778,41 @@ dgst_main(int argc, char **argv)
 			}
 			md_name = EVP_MD_name(dgst_config.md);
 		}
+		if (dgst_config.parallel > 1) {
+			err = dgst_parallel(out, buf, mctx,
+			    dgst_config.parallel, sigkey, sigbuf, siglen,
+			    sig_name, md_name, argc, argv);
+			goto end;
+		}
 		err = 0;
 		for (i = 0; i < argc; i++) {
-			int r;
-			if (BIO_read_filename(in, argv[i]) <= 0) {
+			int error, r;
+
+			if (dgst_config.debug) {
+				if (BIO_read_filename(in, argv[i]) <= 0) {
+					perror(argv[i]);
+					err++;
+					continue;
+				}
+				r = do_fp(out, buf, inp, dgst_config.separator,
+				    dgst_config.out_bin, sigkey, sigbuf, siglen,
+				    sig_name, md_name, argv[i], bmd);
+			} else if ((r = dgst_file(mctx, argv[i],
+			    &error)) == -1) {
+				errno = error;
 				perror(argv[i]);
 				err++;
 				continue;
+			} else if (r == 0) {
+				BIO_printf(bio_err, "Read Error in %s\n",
+				    argv[i]);
+				ERR_print_errors(bio_err);
+				r = 1;
 			} else {
-				r = do_fp(out, buf, inp, dgst_config.separator,
-				    dgst_config.out_bin, sigkey, sigbuf, siglen,
-				    sig_name, md_name, argv[i], bmd);
+				r = do_final(out, buf, mctx,
+				    dgst_config.separator, dgst_config.out_bin,
+				    sigkey, sigbuf, siglen, sig_name, md_name,
+				    argv[i]);
 			}
 			if (r)
 				err = r;
@@ -606,7 +840,7 @@ do_fp(BIO * out, unsigned char *buf, BIO * bp, int sep, int binout,
     const char *sig_name, const char *md_name,
     const char *file, BIO * bmd)
 {
-	size_t len;
+	EVP_MD_CTX *ctx;
 	int i;
 
 	for (;;) {
@@ -619,9 +853,22 @@ do_fp(BIO * out, unsigned char *buf, BIO * bp, int sep, int binout,
 		if (i == 0)
 			break;
 	}
+	BIO_get_md_ctx(bp, &ctx);
+
+	return do_final(out, buf, ctx, sep, binout, key, sigin, siglen,
+	    sig_name, md_name, file);
+}
+
+static int
+do_final(BIO * out, unsigned char *buf, EVP_MD_CTX * ctx, int sep,
+    int binout, EVP_PKEY * key, unsigned char *sigin, int siglen,
+    const char *sig_name, const char *md_name, const char *file)
+{
+	size_t len;
+	unsigned int mdlen;
+	int i;
+
 	if (sigin) {
-		EVP_MD_CTX *ctx;
-		BIO_get_md_ctx(bp, &ctx);
 		i = EVP_DigestVerifyFinal(ctx, sigin, (unsigned int) siglen);
 		if (i > 0)
 			BIO_printf(out, "Verified OK\n");
@@ -636,8 +883,6 @@ do_fp(BIO * out, unsigned char *buf, BIO * bp, int sep, int binout,
 		return 0;
 	}
 	if (key) {
-		EVP_MD_CTX *ctx;
-		BIO_get_md_ctx(bp, &ctx);
 		len = BUFSIZE;
 		if (!EVP_DigestSignFinal(ctx, buf, &len)) {
 			BIO_printf(bio_err, "Error Signing Data\n");
@@ -645,11 +890,11 @@ do_fp(BIO * out, unsigned char *buf, BIO * bp, int sep, int binout,
 			return 1;
 		}
 	} else {
-		len = BIO_gets(bp, (char *) buf, BUFSIZE);
-		if ((int) len < 0) {
+		if (!EVP_DigestFinal_ex(ctx, buf, &mdlen)) {
 			ERR_print_errors(bio_err);
 			return 1;
 		}
+		len = mdlen;
 	}
 
 	if (binout)
@@ -56,6 +56,8 @@
  * [including the GNU Public Licence.]
  */
 
+#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -74,6 +76,9 @@ int set_hex(char *in, unsigned char *out, int size);
 
 #define SIZE	(512)
 #define BSIZE	(8*1024)
+#define READSIZE	(1024*1024)
+#define CTR_CHUNK	(1024*1024)
+#define MAX_PARALLEL	256
 
 static struct {
 	int base64;
@@ -96,6 +101,7 @@ static struct {
 	int nosalt;
 	int olb64;
 	char *outf;
+	int parallel;
 	char *passarg;
 	int pbkdf2;
 	int printkey;
@@ -254,6 +260,13 @@ static const struct option enc_options[] = {
 		.opt.value = &enc_config.printkey,
 		.value = 1,
 	},
+	{
+		.name = "parallel",
+		.argname = "n",
+		.desc = "Process a CTR mode cipher with up to n threads",
+		.type = OPTION_ARG_INT,
+		.opt.value = &enc_config.parallel,
+	},
 	{
 		.name = "pass",
 		.argname = "source",
@@ -313,7 +326,8 @@ enc_usage(void)
 	    "    [-in file] [-iter iterations] [-iv IV] [-K key] "
             "[-k password]\n"
 	    "    [-kfile file] [-md digest] [-none] [-nopad] [-nosalt]\n"
-	    "    [-out file] [-pass source] [-pbkdf2] [-S salt] [-salt]\n\n");
+	    "    [-out file] [-parallel n] [-pass source] [-pbkdf2] "
+	    "[-S salt] [-salt]\n\n");
 	options_usage(enc_options);
 	fprintf(stderr, "\n");
 
@@ -322,6 +336,189 @@ enc_usage(void)
 	fprintf(stderr, "\n");
 }
 
+/*
+ * Run the cipher directly on large buffers, rather than through the
+ * cipher BIO, which processes its input in small blocks.
+ */
+static int
+enc_direct(EVP_CIPHER_CTX *ctx, BIO *rbio, BIO *wbio, int bsize)
+{
+	unsigned char *ibuf = NULL, *obuf = NULL;
+	int inl, outl, ret = 1;
+
+	if ((ibuf = malloc(bsize)) == NULL ||
+	    (obuf = malloc(bsize + EVP_MAX_BLOCK_LENGTH)) == NULL) {
+		BIO_printf(bio_err, "out of memory\n");
+		goto end;
+	}
+	for (;;) {
+		inl = BIO_read(rbio, ibuf, bsize);
+		if (inl <= 0)
+			break;
+		if (!EVP_CipherUpdate(ctx, obuf, &outl, ibuf, inl)) {
+			BIO_printf(bio_err, "%s failed\n",
+			    EVP_CIPHER_CTX_encrypting(ctx) ?
+			    "encryption" : "decryption");
+			goto end;
+		}
+		if (outl > 0 && BIO_write(wbio, obuf, outl) != outl) {
+			BIO_printf(bio_err, "error writing output file\n");
+			goto end;
+		}
+	}
+	if (!EVP_CipherFinal_ex(ctx, obuf, &outl)) {
+		BIO_printf(bio_err, "bad decrypt\n");
+		goto end;
+	}
+	if ((outl > 0 && BIO_write(wbio, obuf, outl) != outl) ||
+	    !BIO_flush(wbio)) {
+		BIO_printf(bio_err, "error writing output file\n");
+		goto end;
+	}
+	ret = 0;
+
+ end:
+	freezero(ibuf, bsize);
+	freezero(obuf, bsize + EVP_MAX_BLOCK_LENGTH);
+
+	return ret;
+}
+
+/* A part of the input processed by one of the -parallel threads. */
+struct enc_chunk {
+	const EVP_CIPHER *cipher;
+	const unsigned char *key;
+	unsigned char iv[EVP_MAX_IV_LENGTH];
+	const unsigned char *in;
+	unsigned char *out;
+	int len;
+	int ok;
+};
+
+/* Advance a big endian 128 bit counter by the given number of blocks. */
+static void
+enc_ctr_add(unsigned char *ctr, uint64_t blocks)
+{
+	unsigned int c;
+	int i;
+
+	for (i = 15; i >= 0 && blocks != 0; i--) {
+		c = ctr[i] + (blocks & 0xff);
+		ctr[i] = c & 0xff;
+		blocks = (blocks >> 8) + (c >> 8);
+	}
+}
+
+static void *
+enc_ctr_worker(void *arg)
+{
+	struct enc_chunk *chunk = arg;
+	EVP_CIPHER_CTX *ctx;
+	int outl;
+
+	if ((ctx = EVP_CIPHER_CTX_new()) == NULL)
+		return NULL;
+	chunk->ok = EVP_EncryptInit_ex(ctx, chunk->cipher, NULL, chunk->key,
+	    chunk->iv) && EVP_EncryptUpdate(ctx, chunk->out, &outl, chunk->in,
+	    chunk->len) && outl == chunk->len;
+	EVP_CIPHER_CTX_free(ctx);
+
+	return NULL;
+}
+
+/*
+ * In counter mode the keystream for any block only depends on its
+ * position, so the input is processed in chunks of up to nthreads at a
+ * time, each starting from the counter value for its offset.
+ */
+static int
+enc_ctr_parallel(const EVP_CIPHER *cipher, const unsigned char *key,
+    const unsigned char *iv, BIO *rbio, BIO *wbio, int nthreads)
+{
+	struct enc_chunk *chunks = NULL;
+	pthread_t *threads = NULL;
+	unsigned char *ibuf = NULL, *obuf = NULL;
+	size_t window, n;
+	uint64_t offset = 0;
+	int i, nchunks, r, ret = 1;
+	int *started = NULL;
+
+	window = (size_t)nthreads * CTR_CHUNK;
+	if ((chunks = calloc(nthreads, sizeof(*chunks))) == NULL ||
+	    (threads = calloc(nthreads, sizeof(*threads))) == NULL ||
+	    (started = calloc(nthreads, sizeof(*started))) == NULL ||
+	    (ibuf = malloc(window)) == NULL ||
+	    (obuf = malloc(window)) == NULL) {
+		BIO_printf(bio_err, "out of memory\n");
+		goto end;
+	}
+
+	for (;;) {
+		for (n = 0; n < window; n += r) {
+			if ((r = BIO_read(rbio, ibuf + n, window - n)) <= 0)
+				break;
+		}
+		if (n == 0)
+			break;
+
+		nchunks = (n + CTR_CHUNK - 1) / CTR_CHUNK;
+		for (i = 0; i < nchunks; i++) {
+			chunks[i].cipher = cipher;
+			chunks[i].key = key;
+			memcpy(chunks[i].iv, iv, EVP_CIPHER_iv_length(cipher));
+			enc_ctr_add(chunks[i].iv,
+			    (offset + (uint64_t)i * CTR_CHUNK) / 16);
+			chunks[i].in = ibuf + (size_t)i * CTR_CHUNK;
+			chunks[i].out = obuf + (size_t)i * CTR_CHUNK;
+			chunks[i].len = CTR_CHUNK;
+			if ((size_t)(i + 1) * CTR_CHUNK > n)
+				chunks[i].len = n - (size_t)i * CTR_CHUNK;
+			chunks[i].ok = 0;
+			started[i] = i > 0 && pthread_create(&threads[i], NULL,
+			    enc_ctr_worker, &chunks[i]) == 0;
+		}
+		/* The first chunk, and any that did not get a thread. */
+		for (i = 0; i < nchunks; i++) {
+			if (!started[i])
+				enc_ctr_worker(&chunks[i]);
+		}
+		for (i = 0; i < nchunks; i++) {
+			if (started[i])
+				pthread_join(threads[i], NULL);
+		}
+		for (i = 0; i < nchunks; i++) {
+			if (!chunks[i].ok) {
+				BIO_printf(bio_err, "%s failed\n",
+				    EVP_CIPHER_name(cipher));
+				ERR_print_errors(bio_err);
+				goto end;
+			}
+		}
+
+		if (BIO_write(wbio, obuf, n) != (int)n) {
+			BIO_printf(bio_err, "error writing output file\n");
+			goto end;
+		}
+		offset += n;
+		if (n < window)
+			break;
+	}
+	if (!BIO_flush(wbio)) {
+		BIO_printf(bio_err, "error writing output file\n");
+		goto end;
+	}
+	ret = 0;
+
+ end:
+	freezero(ibuf, window);
+	freezero(obuf, window);
+	free(chunks);
+	free(threads);
+	free(started);
+
+	return ret;
+}
+
 int
 enc_main(int argc, char **argv)
 {
@@ -425,6 +622,21 @@ enc_main(int argc, char **argv)
 		dgst = EVP_sha256();
 	}
 
+	if (enc_config.parallel < 0 ||
+	    enc_config.parallel > MAX_PARALLEL) {
+		BIO_printf(bio_err, "-parallel must be between 1 and %d\n",
+		    MAX_PARALLEL);
+		goto end;
+	}
+	if (enc_config.parallel > 1 && (enc_config.cipher == NULL ||
+	    EVP_CIPHER_mode(enc_config.cipher) != EVP_CIPH_CTR_MODE ||
+	    EVP_CIPHER_iv_length(enc_config.cipher) != 16 ||
+	    enc_config.debug)) {
+		BIO_printf(bio_err,
+		    "-parallel requires a CTR mode cipher and no -debug\n");
+		goto end;
+	}
+
 	if (enc_config.bufsize != NULL) {
 		char *p = enc_config.bufsize;
 		unsigned long n;
@@ -727,6 +939,17 @@ enc_main(int argc, char **argv)
 			}
 		}
 	}
+	if (enc_config.parallel > 1) {
+		ret = enc_ctr_parallel(enc_config.cipher, key, iv, rbio, wbio,
+		    enc_config.parallel);
+		goto done;
+	}
+	if (benc != NULL && !enc_config.debug) {
+		ret = enc_direct(ctx, rbio, wbio,
+		    enc_config.bufsize != NULL ? bsize : READSIZE);
+		goto done;
+	}
+
 	/* Only encrypt/decrypt as we write the file */
 	if (benc != NULL)
 		wbio = BIO_push(benc, wbio);
@@ -745,7 +968,8 @@ enc_main(int argc, char **argv)
 		goto end;
 	}
 	ret = 0;
-	if (enc_config.verbose) {
+ done:
+	if (ret == 0 && enc_config.verbose) {
 		BIO_printf(bio_err, "bytes read   :%8ld\n", BIO_number_read(in));
 		BIO_printf(bio_err, "bytes written:%8ld\n", BIO_number_written(out));
 	}
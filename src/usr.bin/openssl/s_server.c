@@ -149,8 +149,12 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 
+#include <netinet/in.h>
+
 #include <assert.h>
 #include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <limits.h>
@@ -193,6 +197,7 @@ static int ssl_servername_cb(SSL *s, int *ad, void *arg);
 static int cert_status_cb(SSL * s, void *arg);
 static int alpn_cb(SSL *s, const unsigned char **out, unsigned char *outlen,
     const unsigned char *in, unsigned int inlen, void *arg);
+static int sv_workers(int nworkers);
 /* static int load_CA(SSL_CTX *ctx, char *file);*/
 
 #define BUFSIZZ	16*1024
@@ -292,6 +297,7 @@ static struct {
 	int tlsextdebug;
 	int tlsextstatus;
 	X509_VERIFY_PARAM *vpm;
+	int workers;
 	int www;
 } s_server_config;
 
@@ -985,6 +991,14 @@ static const struct option s_server_options[] = {
 		.type = OPTION_FLAG,
 		.opt.flag = &verify_return_error,
 	},
+	{
+		.name = "workers",
+		.argname = "number",
+		.desc = "Serve a static page from number threads, each with its"
+			" own listening socket",
+		.type = OPTION_ARG_INT,
+		.opt.value = &s_server_config.workers,
+	},
 	{
 		.name = "WWW",
 		.desc = "Respond to a 'GET /<path> HTTP/1.0' with file ./<path>",
@@ -1055,7 +1069,7 @@ sv_usage(void)
 	    "    [-status_verbose] [-timeout] [-tls1] [-tls1_1]\n"
 	    "    [-tls1_2] [-tls1_3] [-tlsextdebug] [-use_srtp profiles]\n"
 	    "    [-Verify depth] [-verify depth] [-verify_return_error]\n"
-	    "    [-WWW] [-www]\n");
+	    "    [-workers number] [-WWW] [-www]\n");
 	fprintf(stderr, "\n");
 	options_usage(s_server_options);
 	fprintf(stderr, "\n");
@@ -1115,6 +1129,16 @@ s_server_main(int argc, char *argv[])
 		goto end;
 	}
 
+	if (s_server_config.workers < 0 || s_server_config.workers > 256) {
+		BIO_printf(bio_err, "-workers must be between 1 and 256\n");
+		goto end;
+	}
+	if (s_server_config.workers > 0 &&
+	    s_server_config.socket_type != SOCK_STREAM) {
+		BIO_printf(bio_err, "-workers cannot be used with DTLS\n");
+		goto end;
+	}
+
 	if (!app_passwd(bio_err, s_server_config.passarg,
 	    s_server_config.dpassarg, &pass, &dpass)) {
 		BIO_printf(bio_err, "Error getting password\n");
@@ -1461,6 +1485,11 @@ s_server_main(int argc, char *argv[])
 			SSL_CTX_set_client_CA_list(ctx2,
 			    SSL_load_client_CA_file(s_server_config.CAfile));
 	}
+	if (s_server_config.workers > 0) {
+		ret = sv_workers(s_server_config.workers);
+		goto end;
+	}
+
 	BIO_printf(bio_s_out, "ACCEPT\n");
 	(void) BIO_flush(bio_s_out);
 	if (s_server_config.www)
@@ -2464,3 +2493,289 @@ alpn_cb(SSL *s, const unsigned char **out, unsigned char *outlen,
 
 	return (SSL_TLSEXT_ERR_OK);
 }
+
+/*
+ * Worker mode: each thread has its own SO_REUSEPORT listener and serves a
+ * static page to many non-blocking connections at once, with all threads
+ * sharing the one SSL_CTX.
+ */
+#define WORKER_MAX_CONNS	1024
+#define WORKER_REQUEST_MAX	4096
+
+enum sv_conn_state {
+	SV_HANDSHAKE,
+	SV_READ,
+	SV_WRITE,
+	SV_SHUTDOWN,
+};
+
+struct sv_conn {
+	int fd;
+	SSL *ssl;
+	enum sv_conn_state state;
+	short events;
+	size_t req_len;
+	char req[WORKER_REQUEST_MAX];
+};
+
+struct sv_worker {
+	pthread_t tid;
+	int id;
+	int sock;
+	struct sv_conn *conns;
+	struct pollfd *pfd;
+	int *pconn;
+};
+
+static const char sv_worker_page[] =
+    "HTTP/1.0 200 ok\r\n"
+    "Content-type: text/plain\r\n"
+    "Content-length: 3\r\n"
+    "\r\n"
+    "ok\n";
+
+static int
+sv_worker_listen(int port)
+{
+	struct sockaddr_in sin;
+	int s, on = 1;
+
+	if ((s = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK,
+	    IPPROTO_TCP)) == -1) {
+		perror("socket");
+		return (-1);
+	}
+	if (setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) == -1 ||
+	    setsockopt(s, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) == -1) {
+		perror("setsockopt");
+		goto err;
+	}
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons((unsigned short)port);
+	sin.sin_addr.s_addr = INADDR_ANY;
+	if (bind(s, (struct sockaddr *)&sin, sizeof(sin)) == -1) {
+		perror("bind");
+		goto err;
+	}
+	if (listen(s, 1024) == -1) {
+		perror("listen");
+		goto err;
+	}
+	return (s);
+
+ err:
+	close(s);
+	return (-1);
+}
+
+static void
+sv_conn_close(struct sv_conn *c)
+{
+	SSL_free(c->ssl);
+	c->ssl = NULL;
+	close(c->fd);
+	c->fd = -1;
+	ERR_clear_error();
+}
+
+static int
+sv_conn_want(struct sv_conn *c, int ret)
+{
+	switch (SSL_get_error(c->ssl, ret)) {
+	case SSL_ERROR_WANT_READ:
+		c->events = POLLIN;
+		return (1);
+	case SSL_ERROR_WANT_WRITE:
+		c->events = POLLOUT;
+		return (1);
+	}
+	return (0);
+}
+
+/*
+ * Advance a connection as far as it will go without blocking. Returns 0
+ * once the connection has been closed.
+ */
+static int
+sv_conn_run(struct sv_conn *c)
+{
+	int n;
+
+	switch (c->state) {
+	case SV_HANDSHAKE:
+		if ((n = SSL_accept(c->ssl)) != 1) {
+			if (sv_conn_want(c, n))
+				return (1);
+			goto close;
+		}
+		c->state = SV_READ;
+		/* FALLTHROUGH */
+	case SV_READ:
+		/* Read until the end of the request headers. */
+		for (;;) {
+			if (c->req_len == sizeof(c->req) - 1)
+				goto close;
+			n = SSL_read(c->ssl, c->req + c->req_len,
+			    sizeof(c->req) - 1 - c->req_len);
+			if (n <= 0) {
+				if (sv_conn_want(c, n))
+					return (1);
+				goto close;
+			}
+			c->req_len += n;
+			c->req[c->req_len] = '\0';
+			if (strstr(c->req, "\r\n\r\n") != NULL ||
+			    strstr(c->req, "\n\n") != NULL)
+				break;
+		}
+		c->state = SV_WRITE;
+		/* FALLTHROUGH */
+	case SV_WRITE:
+		if ((n = SSL_write(c->ssl, sv_worker_page,
+		    sizeof(sv_worker_page) - 1)) <= 0) {
+			if (sv_conn_want(c, n))
+				return (1);
+			goto close;
+		}
+		c->state = SV_SHUTDOWN;
+		/* FALLTHROUGH */
+	case SV_SHUTDOWN:
+		if ((n = SSL_shutdown(c->ssl)) < 0 && sv_conn_want(c, n))
+			return (1);
+		break;
+	}
+
+ close:
+	sv_conn_close(c);
+	return (0);
+}
+
+static void
+sv_worker_accept(struct sv_worker *w, int *slots, int *nfree)
+{
+	struct sv_conn *c;
+	int fd;
+
+	while (*nfree > 0) {
+		if ((fd = accept4(w->sock, NULL, NULL, SOCK_NONBLOCK)) == -1) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK &&
+			    errno != ECONNABORTED && errno != EINTR)
+				perror("accept");
+			return;
+		}
+		c = &w->conns[slots[--*nfree]];
+		memset(c, 0, sizeof(*c));
+		c->fd = fd;
+		if ((c->ssl = SSL_new(ctx)) == NULL ||
+		    !SSL_set_fd(c->ssl, fd)) {
+			sv_conn_close(c);
+			*nfree += 1;
+			continue;
+		}
+		SSL_set_accept_state(c->ssl);
+		c->state = SV_HANDSHAKE;
+		c->events = POLLIN;
+	}
+}
+
+static void *
+sv_worker_main(void *arg)
+{
+	struct sv_worker *w = arg;
+	int slots[WORKER_MAX_CONNS];
+	int i, n, npfd, nfree;
+
+	for (i = 0; i < WORKER_MAX_CONNS; i++) {
+		w->conns[i].fd = -1;
+		slots[i] = WORKER_MAX_CONNS - 1 - i;
+	}
+	nfree = WORKER_MAX_CONNS;
+
+	for (;;) {
+		/* Stop accepting while every connection slot is in use. */
+		w->pfd[0].fd = nfree > 0 ? w->sock : -1;
+		w->pfd[0].events = POLLIN;
+		npfd = 1;
+		for (i = 0; i < WORKER_MAX_CONNS; i++) {
+			if (w->conns[i].fd == -1)
+				continue;
+			w->pfd[npfd].fd = w->conns[i].fd;
+			w->pfd[npfd].events = w->conns[i].events;
+			w->pconn[npfd++] = i;
+		}
+
+		if ((n = poll(w->pfd, npfd, INFTIM)) == -1) {
+			if (errno == EINTR)
+				continue;
+			perror("poll");
+			return (NULL);
+		}
+		for (i = 1; i < npfd; i++) {
+			if (w->pfd[i].revents == 0)
+				continue;
+			if (!sv_conn_run(&w->conns[w->pconn[i]]))
+				slots[nfree++] = w->pconn[i];
+		}
+		if (w->pfd[0].revents & POLLIN)
+			sv_worker_accept(w, slots, &nfree);
+	}
+}
+
+static int
+sv_workers(int nworkers)
+{
+	struct sv_worker *workers;
+	int i, ret = 1;
+
+	if ((workers = calloc(nworkers, sizeof(*workers))) == NULL) {
+		BIO_printf(bio_err, "out of memory\n");
+		return (1);
+	}
+	for (i = 0; i < nworkers; i++) {
+		workers[i].id = i;
+		if ((workers[i].sock = sv_worker_listen(
+		    s_server_config.port)) == -1)
+			goto err;
+		if ((workers[i].conns = calloc(WORKER_MAX_CONNS,
+		    sizeof(*workers[i].conns))) == NULL ||
+		    (workers[i].pfd = calloc(WORKER_MAX_CONNS + 1,
+		    sizeof(*workers[i].pfd))) == NULL ||
+		    (workers[i].pconn = calloc(WORKER_MAX_CONNS + 1,
+		    sizeof(*workers[i].pconn))) == NULL) {
+			BIO_printf(bio_err, "out of memory\n");
+			i++;
+			goto err;
+		}
+	}
+
+	BIO_printf(bio_s_out, "ACCEPT with %d workers\n", nworkers);
+	(void) BIO_flush(bio_s_out);
+
+	for (i = 0; i < nworkers; i++) {
+		if ((errno = pthread_create(&workers[i].tid, NULL,
+		    sv_worker_main, &workers[i])) != 0) {
+			/* Workers that are already running cannot be stopped. */
+			BIO_printf(bio_err, "pthread_create: %s\n",
+			    strerror(errno));
+			exit(1);
+		}
+	}
+	/* Workers only return on a fatal error. */
+	for (i = 0; i < nworkers; i++)
+		pthread_join(workers[i].tid, NULL);
+	ret = 0;
+	i = nworkers;
+
+ err:
+	while (i-- > 0) {
+		if (workers[i].sock != -1)
+			close(workers[i].sock);
+		free(workers[i].conns);
+		free(workers[i].pfd);
+		free(workers[i].pconn);
+	}
+	free(workers);
+
+	return (ret);
+}
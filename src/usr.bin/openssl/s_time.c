@@ -63,11 +63,17 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/time.h>
 
+#include <errno.h>
+#include <math.h>
+#include <netdb.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <limits.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <poll.h>
 
@@ -87,11 +93,16 @@
 #define MYBUFSIZ 1024*8
 
 #define SECONDS	30
+
+#define LOADGEN_CONCURRENCY	100
+#define LOADGEN_MAX_CONCURRENCY	10000
+
 extern int verify_depth;
 
 static void s_time_usage(void);
 static int run_test(SSL *);
 static int benchmark(int);
+static int loadgen(int);
 static void print_tally_mark(SSL *);
 
 static SSL_CTX *tm_ctx = NULL;
@@ -99,23 +110,34 @@ static const SSL_METHOD *s_time_meth = NULL;
 static long bytes_read = 0;
 
 struct {
+	char *alpn;
 	int bugs;
 	char *CAfile;
 	char *CApath;
 	char *certfile;
 	char *cipher;
+	int concurrency;
 	char *host;
 	char *keyfile;
 	time_t maxtime;
 	int nbio;
 	int no_shutdown;
 	int perform;
+	int rate;
 	int verify;
 	int verify_depth;
 	char *www_path;
 } s_time_config;
 
 static const struct option s_time_options[] = {
+	{
+		.name = "alpn",
+		.argname = "protocols",
+		.desc = "Set the advertised protocols for the ALPN extension"
+			" (comma-separated list)",
+		.type = OPTION_ARG,
+		.opt.arg = &s_time_config.alpn,
+	},
 	{
 		.name = "bugs",
 		.desc = "Enable workarounds for known SSL/TLS bugs",
@@ -150,6 +172,13 @@ static const struct option s_time_options[] = {
 		.type = OPTION_ARG,
 		.opt.arg = &s_time_config.cipher,
 	},
+	{
+		.name = "concurrency",
+		.argname = "number",
+		.desc = "Keep up to number non-blocking connections in flight",
+		.type = OPTION_ARG_INT,
+		.opt.value = &s_time_config.concurrency,
+	},
 	{
 		.name = "connect",
 		.argname = "host:port",
@@ -184,6 +213,13 @@ static const struct option s_time_options[] = {
 		.type = OPTION_FLAG,
 		.opt.flag = &s_time_config.no_shutdown,
 	},
+	{
+		.name = "rate",
+		.argname = "number",
+		.desc = "Start number connections per second (open loop)",
+		.type = OPTION_ARG_INT,
+		.opt.value = &s_time_config.rate,
+	},
 	{
 		.name = "reuse",
 		.desc = "Reuse the same session ID for each connection",
@@ -220,9 +256,10 @@ s_time_usage(void)
 {
 	fprintf(stderr,
 	    "usage: s_time "
-	    "[-bugs] [-CAfile file] [-CApath directory] [-cert file]\n"
-	    "    [-cipher cipherlist] [-connect host:port] [-key keyfile]\n"
-	    "    [-nbio] [-new] [-no_shutdown] [-reuse] [-time seconds]\n"
+	    "[-alpn protocols] [-bugs] [-CAfile file] [-CApath directory]\n"
+	    "    [-cert file] [-cipher cipherlist] [-concurrency number]\n"
+	    "    [-connect host:port] [-key keyfile] [-nbio] [-new]\n"
+	    "    [-no_shutdown] [-rate number] [-reuse] [-time seconds]\n"
 	    "    [-verify depth] [-www page]\n\n");
 	options_usage(s_time_options);
 }
@@ -272,6 +309,19 @@ s_time_main(int argc, char **argv)
 		goto end;
 	}
 
+	if (s_time_config.concurrency < 0 ||
+	    s_time_config.concurrency > LOADGEN_MAX_CONCURRENCY) {
+		BIO_printf(bio_err, "-concurrency must be between 1 and %d\n",
+		    LOADGEN_MAX_CONCURRENCY);
+		goto end;
+	}
+	if (s_time_config.rate < 0) {
+		BIO_printf(bio_err, "-rate must be positive\n");
+		goto end;
+	}
+	if (s_time_config.rate > 0 && s_time_config.concurrency == 0)
+		s_time_config.concurrency = LOADGEN_CONCURRENCY;
+
 	if ((tm_ctx = SSL_CTX_new(s_time_meth)) == NULL)
 		return (1);
 
@@ -288,6 +338,19 @@ s_time_main(int argc, char **argv)
 		}
 	}
 
+	if (s_time_config.alpn != NULL) {
+		unsigned short alpn_len;
+		unsigned char *alpn;
+
+		alpn = next_protos_parse(&alpn_len, s_time_config.alpn);
+		if (alpn == NULL) {
+			BIO_printf(bio_err, "Error parsing -alpn argument\n");
+			goto end;
+		}
+		SSL_CTX_set_alpn_protos(tm_ctx, alpn, alpn_len);
+		free(alpn);
+	}
+
 	SSL_CTX_set_verify(tm_ctx, s_time_config.verify, NULL);
 
 	if (!set_cert_stuff(tm_ctx, s_time_config.certfile,
@@ -305,6 +368,27 @@ s_time_main(int argc, char **argv)
 		/* goto end; */
 	}
 
+	if (s_time_config.concurrency > 0) {
+		if (s_time_config.rate > 0)
+			printf("Starting %d connections per second, at most %d "
+			    "concurrently, for %lld seconds\n",
+			    s_time_config.rate, s_time_config.concurrency,
+			    (long long)s_time_config.maxtime);
+		else
+			printf("Running %d concurrent connections for %lld "
+			    "seconds\n", s_time_config.concurrency,
+			    (long long)s_time_config.maxtime);
+		if ((s_time_config.perform & 1) && loadgen(0))
+			goto end;
+		if (s_time_config.perform & 2) {
+			printf("\n\nNow timing with session id reuse.\n");
+			if (loadgen(1))
+				goto end;
+		}
+		ret = 0;
+		goto end;
+	}
+
 	/* Loop and time how long it takes to make connections */
 	if (s_time_config.perform & 1) {
 		printf("Collecting connection statistics for %lld seconds\n",
@@ -467,3 +551,492 @@ benchmark(int reuse_session)
 	SSL_free(scon);
 	return ret;
 }
+
+/*
+ * Load generator: keep up to -concurrency non-blocking connections in
+ * flight, either as many as possible or started at a fixed -rate, and
+ * record the time taken by each phase of every connection.
+ */
+enum lg_state {
+	LG_CONNECT,
+	LG_HANDSHAKE,
+	LG_WRITE,
+	LG_READ,
+};
+
+#define LG_ERR_CONNECT		0
+#define LG_ERR_HANDSHAKE	1
+#define LG_ERR_VERIFY		2
+#define LG_ERR_WRITE		3
+#define LG_ERR_READ		4
+#define LG_ERR_NUM		5
+
+static const char *lg_error_names[LG_ERR_NUM] = {
+	"connect", "handshake", "verify", "write", "read",
+};
+
+#define LG_PHASE_CONNECT	0
+#define LG_PHASE_HANDSHAKE	1
+#define LG_PHASE_TTFB		2
+#define LG_PHASE_TOTAL		3
+#define LG_PHASE_NUM		4
+
+static const char *lg_phase_names[LG_PHASE_NUM] = {
+	"connect", "handshake", "first byte", "total",
+};
+
+struct lg_samples {
+	uint32_t *usec;
+	size_t len;
+	size_t size;
+};
+
+struct lg_conn {
+	int fd;
+	SSL *ssl;
+	enum lg_state state;
+	short events;
+	int got_data;
+	int resumed;
+	int alpn;
+	struct timespec start;
+	struct timespec connected;
+	struct timespec handshaken;
+	struct timespec first_byte;
+};
+
+struct lg_stats {
+	struct lg_samples phase[LG_PHASE_NUM];
+	long errors[LG_ERR_NUM];
+	long completed;
+	long resumed;
+	long alpn;
+	long skipped;
+	long unfinished;
+	long bytes;
+	int nomem;
+};
+
+static SSL_SESSION *lg_session = NULL;
+static char lg_request[MYBUFSIZ];
+static int lg_request_len;
+
+static uint32_t
+lg_usec(const struct timespec *from, const struct timespec *to)
+{
+	struct timespec d;
+	long long usec;
+
+	timespecsub(to, from, &d);
+	usec = (long long)d.tv_sec * 1000000 + d.tv_nsec / 1000;
+	if (usec < 0)
+		return 0;
+	if (usec > UINT32_MAX)
+		return UINT32_MAX;
+	return usec;
+}
+
+static void
+lg_sample(struct lg_stats *st, int phase, const struct timespec *from,
+    const struct timespec *to)
+{
+	struct lg_samples *s = &st->phase[phase];
+	uint32_t *p;
+	size_t size;
+
+	if (s->len == s->size) {
+		size = s->size == 0 ? 1024 : s->size * 2;
+		if ((p = reallocarray(s->usec, size, sizeof(*p))) == NULL) {
+			st->nomem = 1;
+			return;
+		}
+		s->usec = p;
+		s->size = size;
+	}
+	s->usec[s->len++] = lg_usec(from, to);
+}
+
+static void
+lg_conn_close(struct lg_conn *c, int clean)
+{
+	if (c->ssl != NULL) {
+		if (clean && !s_time_config.no_shutdown)
+			SSL_shutdown(c->ssl);
+		else
+			SSL_set_shutdown(c->ssl, SSL_SENT_SHUTDOWN |
+			    SSL_RECEIVED_SHUTDOWN);
+		SSL_free(c->ssl);
+		c->ssl = NULL;
+	}
+	if (c->fd != -1)
+		close(c->fd);
+	c->fd = -1;
+}
+
+static void
+lg_conn_fail(struct lg_conn *c, struct lg_stats *st, int error)
+{
+	st->errors[error]++;
+	ERR_clear_error();
+	lg_conn_close(c, 0);
+}
+
+static void
+lg_conn_done(struct lg_conn *c, struct lg_stats *st, int reuse_session)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	lg_sample(st, LG_PHASE_CONNECT, &c->start, &c->connected);
+	lg_sample(st, LG_PHASE_HANDSHAKE, &c->connected, &c->handshaken);
+	if (c->got_data)
+		lg_sample(st, LG_PHASE_TTFB, &c->handshaken, &c->first_byte);
+	lg_sample(st, LG_PHASE_TOTAL, &c->start, &now);
+	st->completed++;
+	st->resumed += c->resumed;
+	st->alpn += c->alpn;
+
+	/* Any TLSv1.3 tickets have been received by now. */
+	if (reuse_session && lg_session == NULL)
+		lg_session = SSL_get1_session(c->ssl);
+
+	lg_conn_close(c, 1);
+}
+
+static int
+lg_conn_start(struct lg_conn *c, struct lg_stats *st, struct addrinfo *ai)
+{
+	memset(c, 0, sizeof(*c));
+	c->fd = -1;
+	clock_gettime(CLOCK_MONOTONIC, &c->start);
+
+	if ((c->fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK,
+	    ai->ai_protocol)) == -1) {
+		lg_conn_fail(c, st, LG_ERR_CONNECT);
+		return 0;
+	}
+	if (connect(c->fd, ai->ai_addr, ai->ai_addrlen) == -1 &&
+	    errno != EINPROGRESS) {
+		lg_conn_fail(c, st, LG_ERR_CONNECT);
+		return 0;
+	}
+	c->state = LG_CONNECT;
+	c->events = POLLOUT;
+	return 1;
+}
+
+static int
+lg_want(struct lg_conn *c, int ret)
+{
+	switch (SSL_get_error(c->ssl, ret)) {
+	case SSL_ERROR_WANT_READ:
+		c->events = POLLIN;
+		return 1;
+	case SSL_ERROR_WANT_WRITE:
+		c->events = POLLOUT;
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Advance a connection as far as it will go without blocking. Returns 0
+ * once the connection is finished, successfully or not.
+ */
+static int
+lg_conn_run(struct lg_conn *c, struct lg_stats *st, int reuse_session)
+{
+	char buf[1024 * 8];
+	const unsigned char *alpn;
+	unsigned int alpn_len;
+	socklen_t len;
+	int error, n;
+
+	switch (c->state) {
+	case LG_CONNECT:
+		len = sizeof(error);
+		if (getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &error,
+		    &len) == -1 || error != 0) {
+			lg_conn_fail(c, st, LG_ERR_CONNECT);
+			return 0;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &c->connected);
+		if ((c->ssl = SSL_new(tm_ctx)) == NULL ||
+		    !SSL_set_fd(c->ssl, c->fd) ||
+		    (lg_session != NULL && !SSL_set_session(c->ssl,
+		    lg_session))) {
+			lg_conn_fail(c, st, LG_ERR_HANDSHAKE);
+			return 0;
+		}
+		SSL_set_connect_state(c->ssl);
+		c->state = LG_HANDSHAKE;
+		/* FALLTHROUGH */
+	case LG_HANDSHAKE:
+		if ((n = SSL_connect(c->ssl)) != 1) {
+			if (lg_want(c, n))
+				return 1;
+			lg_conn_fail(c, st,
+			    SSL_get_verify_result(c->ssl) != X509_V_OK ?
+			    LG_ERR_VERIFY : LG_ERR_HANDSHAKE);
+			return 0;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &c->handshaken);
+		c->resumed = SSL_session_reused(c->ssl);
+		SSL_get0_alpn_selected(c->ssl, &alpn, &alpn_len);
+		c->alpn = alpn_len > 0;
+		if (s_time_config.www_path == NULL) {
+			lg_conn_done(c, st, reuse_session);
+			return 0;
+		}
+		c->state = LG_WRITE;
+		/* FALLTHROUGH */
+	case LG_WRITE:
+		if ((n = SSL_write(c->ssl, lg_request, lg_request_len)) <= 0) {
+			if (lg_want(c, n))
+				return 1;
+			lg_conn_fail(c, st, LG_ERR_WRITE);
+			return 0;
+		}
+		c->state = LG_READ;
+		/* FALLTHROUGH */
+	case LG_READ:
+		while ((n = SSL_read(c->ssl, buf, sizeof(buf))) > 0) {
+			if (!c->got_data) {
+				clock_gettime(CLOCK_MONOTONIC, &c->first_byte);
+				c->got_data = 1;
+			}
+			st->bytes += n;
+		}
+		if (lg_want(c, n))
+			return 1;
+		/* The server closes the connection once the page is sent. */
+		error = SSL_get_error(c->ssl, n);
+		if (c->got_data && (error == SSL_ERROR_ZERO_RETURN ||
+		    (error == SSL_ERROR_SYSCALL && n == 0))) {
+			lg_conn_done(c, st, reuse_session);
+			return 0;
+		}
+		lg_conn_fail(c, st, LG_ERR_READ);
+		return 0;
+	}
+	return 0;
+}
+
+static int
+lg_cmp(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static double
+lg_percentile(const struct lg_samples *s, double q)
+{
+	size_t i;
+
+	if (s->len == 0)
+		return 0.0;
+	i = (size_t)ceil(q * s->len);
+	if (i > 0)
+		i--;
+	return s->usec[i] / 1000.0;
+}
+
+static void
+lg_report(struct lg_stats *st, double elapsed)
+{
+	struct lg_samples *s;
+	long errors = 0;
+	int i;
+
+	printf("\n%ld connections in %.2fs; %.2f connections/sec, "
+	    "bytes read %ld\n", st->completed, elapsed,
+	    elapsed > 0 ? st->completed / elapsed : 0.0, st->bytes);
+	printf("%ld resumed, %ld with ALPN, %ld unfinished",
+	    st->resumed, st->alpn, st->unfinished);
+	if (st->skipped > 0)
+		printf(", %ld arrivals skipped at the concurrency limit",
+		    st->skipped);
+	printf("\n");
+
+	printf("errors:");
+	for (i = 0; i < LG_ERR_NUM; i++) {
+		printf(" %s %ld", lg_error_names[i], st->errors[i]);
+		errors += st->errors[i];
+	}
+	printf(" (total %ld)\n", errors);
+	if (st->nomem)
+		printf("out of memory, some samples were not recorded\n");
+
+	printf("\n%-12s %10s %10s %10s %10s %10s %10s\n", "phase (ms)",
+	    "samples", "p50", "p90", "p99", "p99.9", "max");
+	for (i = 0; i < LG_PHASE_NUM; i++) {
+		s = &st->phase[i];
+		if (s->len == 0)
+			continue;
+		qsort(s->usec, s->len, sizeof(*s->usec), lg_cmp);
+		printf("%-12s %10zu %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+		    lg_phase_names[i], s->len, lg_percentile(s, 0.50),
+		    lg_percentile(s, 0.90), lg_percentile(s, 0.99),
+		    lg_percentile(s, 0.999), s->usec[s->len - 1] / 1000.0);
+	}
+}
+
+static int
+loadgen(int reuse_session)
+{
+	struct addrinfo hints, *ai = NULL;
+	struct lg_conn *conns = NULL;
+	struct pollfd *pfd = NULL;
+	int *slots = NULL, *pconn = NULL;
+	struct lg_stats st;
+	struct timespec start, deadline, next, interval, now, wait;
+	char *hostport = NULL, *host, *port = PORT_STR;
+	int concurrency, nfree, npfd, i, n, timeout;
+	int ret = 1;
+
+	memset(&st, 0, sizeof(st));
+	concurrency = s_time_config.concurrency;
+
+	if ((hostport = strdup(s_time_config.host)) == NULL) {
+		BIO_printf(bio_err, "out of memory\n");
+		goto end;
+	}
+	if (!extract_host_port(hostport, &host, NULL, &port))
+		goto end;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if ((n = getaddrinfo(host, port, &hints, &ai)) != 0) {
+		BIO_printf(bio_err, "getaddrinfo: %s\n", gai_strerror(n));
+		ai = NULL;
+		goto end;
+	}
+
+	if (s_time_config.www_path != NULL) {
+		lg_request_len = snprintf(lg_request, sizeof(lg_request),
+		    "GET %s HTTP/1.0\r\n\r\n", s_time_config.www_path);
+		if (lg_request_len < 0 ||
+		    lg_request_len >= (int)sizeof(lg_request)) {
+			BIO_printf(bio_err, "URL too long\n");
+			goto end;
+		}
+	}
+
+	if ((conns = calloc(concurrency, sizeof(*conns))) == NULL ||
+	    (pfd = calloc(concurrency, sizeof(*pfd))) == NULL ||
+	    (pconn = calloc(concurrency, sizeof(*pconn))) == NULL ||
+	    (slots = calloc(concurrency, sizeof(*slots))) == NULL) {
+		BIO_printf(bio_err, "out of memory\n");
+		goto end;
+	}
+	for (i = 0; i < concurrency; i++) {
+		conns[i].fd = -1;
+		slots[i] = concurrency - 1 - i;
+	}
+	nfree = concurrency;
+
+	interval.tv_sec = 0;
+	interval.tv_nsec = 0;
+	if (s_time_config.rate > 0) {
+		interval.tv_sec = 1 / s_time_config.rate;
+		interval.tv_nsec = 1000000000L / s_time_config.rate % 1000000000L;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	deadline = start;
+	deadline.tv_sec += s_time_config.maxtime;
+	next = start;
+
+	for (;;) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (timespeccmp(&now, &deadline, >=))
+			break;
+
+		/*
+		 * Open loop arrivals are started on schedule whether or not
+		 * earlier connections have finished; otherwise every free
+		 * slot is refilled straight away.
+		 */
+		if (s_time_config.rate > 0) {
+			while (timespeccmp(&now, &next, >=)) {
+				timespecadd(&next, &interval, &next);
+				if (nfree == 0) {
+					st.skipped++;
+					continue;
+				}
+				i = slots[--nfree];
+				if (!lg_conn_start(&conns[i], &st, ai))
+					slots[nfree++] = i;
+			}
+		} else {
+			for (n = nfree; n > 0; n--) {
+				i = slots[--nfree];
+				if (!lg_conn_start(&conns[i], &st, ai))
+					slots[nfree++] = i;
+			}
+		}
+
+		npfd = 0;
+		for (i = 0; i < concurrency; i++) {
+			if (conns[i].fd == -1)
+				continue;
+			pfd[npfd].fd = conns[i].fd;
+			pfd[npfd].events = conns[i].events;
+			pfd[npfd].revents = 0;
+			pconn[npfd++] = i;
+		}
+
+		if (s_time_config.rate > 0 && timespeccmp(&next, &deadline, <))
+			timespecsub(&next, &now, &wait);
+		else
+			timespecsub(&deadline, &now, &wait);
+		timeout = wait.tv_sec * 1000 + (wait.tv_nsec + 999999) / 1000000;
+
+		if ((n = poll(pfd, npfd, timeout)) == -1) {
+			if (errno == EINTR)
+				continue;
+			perror("poll");
+			goto end;
+		}
+		for (i = 0; i < npfd && n > 0; i++) {
+			if (pfd[i].revents == 0)
+				continue;
+			n--;
+			if (!lg_conn_run(&conns[pconn[i]], &st, reuse_session))
+				slots[nfree++] = pconn[i];
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	timespecsub(&now, &start, &wait);
+
+	for (i = 0; i < concurrency; i++) {
+		if (conns[i].fd == -1)
+			continue;
+		st.unfinished++;
+		lg_conn_close(&conns[i], 0);
+	}
+
+	lg_report(&st, wait.tv_sec + wait.tv_nsec / 1e9);
+	ret = 0;
+
+ end:
+	if (slots != NULL) {
+		for (i = 0; i < concurrency; i++)
+			lg_conn_close(&conns[i], 0);
+	}
+	for (i = 0; i < LG_PHASE_NUM; i++)
+		free(st.phase[i].usec);
+	SSL_SESSION_free(lg_session);
+	lg_session = NULL;
+	if (ai != NULL)
+		freeaddrinfo(ai);
+	free(hostport);
+	free(conns);
+	free(pfd);
+	free(pconn);
+	free(slots);
+
+	return ret;
+}
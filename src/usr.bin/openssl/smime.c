@@ -481,7 +481,9 @@ smime_main(int argc, char **argv)
 		in = BIO_new_fp(stdin, BIO_NOCLOSE);
 
 	if (operation & SMIME_IP) {
-		if (informat == FORMAT_SMIME)
+		if (informat == FORMAT_SMIME && indef)
+			p7 = SMIME_read_PKCS7_stream(in, &indata);
+		else if (informat == FORMAT_SMIME)
 			p7 = SMIME_read_PKCS7(in, &indata);
 		else if (informat == FORMAT_PEM)
 			p7 = PEM_read_bio_PKCS7(in, NULL, NULL, NULL);
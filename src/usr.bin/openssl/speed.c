@@ -79,12 +79,16 @@
 #define ECDSA_SECONDS   10
 #define ECDH_SECONDS    10
 
+#include <errno.h>
 #include <math.h>
+#include <pthread.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <limits.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "apps.h"
@@ -134,6 +138,7 @@
 #include <openssl/rc4.h>
 #endif
 #include <openssl/rsa.h>
+#include <openssl/ssl.h>
 #ifndef OPENSSL_NO_RIPEMD
 #include <openssl/ripemd.h>
 #endif
@@ -148,11 +153,18 @@
 #include "./testrsa.h"
 
 #define BUFSIZE	(1024*8+64)
-int run = 0;
+volatile sig_atomic_t run = 0;
 
 static int mr = 0;
 static int usertime = 1;
 
+#define OUTPUT_TEXT	0
+#define OUTPUT_JSON	1
+#define OUTPUT_CSV	2
+
+static int output = OUTPUT_TEXT;
+static int speed_allocs;
+
 static double Time_F(int s);
 static void print_message(const char *s, long num, int length);
 static void
@@ -224,6 +236,569 @@ KDF1_SHA1(const void *in, size_t inlen, void *out, size_t * outlen)
 #endif				/* OPENSSL_NO_SHA */
 }
 
+/*
+ * Threaded mode: every thread runs the same operation against a shared key
+ * until the alarm fires, timing each operation into a log-linear latency
+ * histogram with LAT_SUB buckets per power of two nanoseconds.
+ */
+#define LAT_SUB_BITS	4
+#define LAT_SUB		(1 << LAT_SUB_BITS)
+#define LAT_BUCKETS	((64 - LAT_SUB_BITS + 1) * LAT_SUB)
+
+/* Per thread buffer, large enough for a maximum size TLS record. */
+#define THREAD_BUFSIZE	(16 * 1024 + 64)
+
+#define TLS_RECORD_MAX	(16 * 1024)
+#define TLS_BIO_SIZE	(2 * TLS_RECORD_MAX)
+
+typedef void *(*speed_kdf)(const void *, size_t, void *, size_t *);
+
+struct speed_thread;
+
+struct speed_test {
+	char name[64];
+	int size;
+	int seconds;
+	int (*op)(const struct speed_test *, struct speed_thread *);
+	int (*thread_init)(const struct speed_test *, struct speed_thread *);
+	void (*thread_free)(struct speed_thread *);
+
+	EVP_AEAD_CTX aead_ctx;
+	size_t nonce_len;
+	RSA *rsa;
+	EC_KEY *ecdh_a, *ecdh_b;
+	size_t ecdh_outlen;
+	speed_kdf kdf;
+	SSL_CTX *client_ctx, *server_ctx;
+};
+
+struct speed_thread {
+	pthread_t tid;
+	const struct speed_test *test;
+	unsigned char *buf;
+	SSL *client, *server;
+	uint64_t ops;
+	int failed;
+	uint64_t hist[LAT_BUCKETS];
+};
+
+static int tls_record_sizes[] = {
+	1, 16, 64, 256, 1024, 4096, 8192, TLS_RECORD_MAX,
+};
+#define TLS_SIZE_NUM	(sizeof(tls_record_sizes) / sizeof(tls_record_sizes[0]))
+
+static const char *tls_record_ciphers[] = {
+	TLS1_3_TXT_AES_128_GCM_SHA256,
+	TLS1_3_TXT_AES_256_GCM_SHA384,
+	TLS1_3_TXT_CHACHA20_POLY1305_SHA256,
+	TLS1_TXT_ECDHE_RSA_WITH_AES_128_GCM_SHA256,
+	TLS1_TXT_ECDHE_RSA_WITH_AES_256_GCM_SHA384,
+	TLS1_TXT_ECDHE_RSA_WITH_CHACHA20_POLY1305,
+};
+#define TLS_CIPHER_NUM	(sizeof(tls_record_ciphers) / sizeof(tls_record_ciphers[0]))
+
+static int speed_results;
+
+static int
+lat_bucket(uint64_t ns)
+{
+	int e;
+
+	if (ns < LAT_SUB)
+		return (ns);
+	e = 63 - __builtin_clzll(ns);
+	return ((e - LAT_SUB_BITS + 1) * LAT_SUB +
+	    ((ns >> (e - LAT_SUB_BITS)) & (LAT_SUB - 1)));
+}
+
+/* Return the midpoint of a bucket, in microseconds. */
+static double
+lat_value(int idx)
+{
+	int g;
+
+	if (idx < LAT_SUB)
+		return (idx / 1000.0);
+	g = idx / LAT_SUB;
+	return ((((uint64_t)(LAT_SUB + idx % LAT_SUB) << (g - 1)) +
+	    ((1ULL << (g - 1)) >> 1)) / 1000.0);
+}
+
+static double
+lat_percentile(const uint64_t *hist, uint64_t total, double q)
+{
+	uint64_t want, sum = 0;
+	int i;
+
+	if (total == 0)
+		return (0.0);
+	if ((want = (uint64_t)ceil(total * q)) == 0)
+		want = 1;
+	for (i = 0; i < LAT_BUCKETS; i++) {
+		if ((sum += hist[i]) >= want)
+			return (lat_value(i));
+	}
+	return (lat_value(LAT_BUCKETS - 1));
+}
+
+static int
+speed_op_aead(const struct speed_test *t, struct speed_thread *th)
+{
+	static const unsigned char nonce[32] = {0};
+	size_t buf_len;
+
+	return (EVP_AEAD_CTX_seal(&t->aead_ctx, th->buf, &buf_len,
+	    THREAD_BUFSIZE, nonce, t->nonce_len, th->buf, t->size, NULL, 0));
+}
+
+static int
+speed_op_rsa_sign(const struct speed_test *t, struct speed_thread *th)
+{
+	unsigned int sig_len;
+
+	return (RSA_sign(NID_md5_sha1, th->buf, 36, th->buf + THREAD_BUFSIZE,
+	    &sig_len, t->rsa));
+}
+
+static int
+speed_op_ecdh(const struct speed_test *t, struct speed_thread *th)
+{
+	return (ECDH_compute_key(th->buf, t->ecdh_outlen,
+	    EC_KEY_get0_public_key(t->ecdh_b), t->ecdh_a, t->kdf) > 0);
+}
+
+/*
+ * Write one record from the client and read it back on the server, so
+ * that each operation covers sealing, framing and opening a record.
+ */
+static int
+speed_op_tls_record(const struct speed_test *t, struct speed_thread *th)
+{
+	int n, off;
+
+	if (SSL_write(th->client, th->buf, t->size) != t->size)
+		return (0);
+	for (off = 0; off < t->size; off += n) {
+		if ((n = SSL_read(th->server, th->buf + THREAD_BUFSIZE,
+		    t->size - off)) <= 0)
+			return (0);
+	}
+	return (1);
+}
+
+static int
+speed_tls_handshake_want(SSL *ssl, int ret)
+{
+	if (ret == 1)
+		return (1);
+	switch (SSL_get_error(ssl, ret)) {
+	case SSL_ERROR_WANT_READ:
+	case SSL_ERROR_WANT_WRITE:
+		return (1);
+	}
+	return (0);
+}
+
+/* Connect a client and a server over a BIO pair. */
+static int
+speed_tls_thread_init(const struct speed_test *t, struct speed_thread *th)
+{
+	BIO *client_bio, *server_bio;
+	int i, cret, sret;
+
+	if ((th->client = SSL_new(t->client_ctx)) == NULL ||
+	    (th->server = SSL_new(t->server_ctx)) == NULL)
+		return (0);
+	if (!BIO_new_bio_pair(&client_bio, TLS_BIO_SIZE, &server_bio,
+	    TLS_BIO_SIZE))
+		return (0);
+	SSL_set_bio(th->client, client_bio, client_bio);
+	SSL_set_bio(th->server, server_bio, server_bio);
+	SSL_set_connect_state(th->client);
+	SSL_set_accept_state(th->server);
+
+	for (i = 0; i < 32; i++) {
+		cret = SSL_do_handshake(th->client);
+		sret = SSL_do_handshake(th->server);
+		if (cret == 1 && sret == 1)
+			return (1);
+		if (!speed_tls_handshake_want(th->client, cret) ||
+		    !speed_tls_handshake_want(th->server, sret))
+			return (0);
+	}
+	return (0);
+}
+
+static void
+speed_tls_thread_free(struct speed_thread *th)
+{
+	SSL_free(th->client);
+	SSL_free(th->server);
+}
+
+static void *
+speed_thread_main(void *arg)
+{
+	struct speed_thread *th = arg;
+	struct timespec start, now;
+	uint64_t ns;
+
+	while (run) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (!th->test->op(th->test, th)) {
+			th->failed = 1;
+			break;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		ns = (uint64_t)(now.tv_sec - start.tv_sec) * 1000000000ULL +
+		    now.tv_nsec - start.tv_nsec;
+		th->hist[lat_bucket(ns)]++;
+		th->ops++;
+	}
+	return (NULL);
+}
+
+static void
+speed_report(const struct speed_test *t, int nthreads, uint64_t ops,
+    double secs, const uint64_t *hist)
+{
+	double rate, p50, p99, p999;
+
+	rate = secs > 0 ? ops / secs : 0.0;
+	p50 = lat_percentile(hist, ops, 0.50);
+	p99 = lat_percentile(hist, ops, 0.99);
+	p999 = lat_percentile(hist, ops, 0.999);
+
+	switch (output) {
+	case OUTPUT_JSON:
+		printf("%s\n  {\"test\": \"%s\", \"size\": %d, \"threads\": %d, "
+		    "\"ops\": %llu, \"seconds\": %.3f, \"ops_per_sec\": %.1f, "
+		    "\"p50_us\": %.3f, \"p99_us\": %.3f, \"p999_us\": %.3f}",
+		    speed_results ? "," : "[", t->name, t->size, nthreads,
+		    (unsigned long long)ops, secs, rate, p50, p99, p999);
+		break;
+	case OUTPUT_CSV:
+		if (speed_results == 0)
+			printf("test,size,threads,ops,seconds,ops_per_sec,"
+			    "p50_us,p99_us,p999_us\n");
+		printf("%s,%d,%d,%llu,%.3f,%.1f,%.3f,%.3f,%.3f\n",
+		    t->name, t->size, nthreads, (unsigned long long)ops, secs,
+		    rate, p50, p99, p999);
+		break;
+	default:
+		printf("%-20s %5d %3d threads %10llu ops in %6.2fs "
+		    "%12.1f ops/s  p50 %9.2fus  p99 %9.2fus  p99.9 %9.2fus\n",
+		    t->name, t->size, nthreads, (unsigned long long)ops, secs,
+		    rate, p50, p99, p999);
+		break;
+	}
+	fflush(stdout);
+	speed_results++;
+}
+
+static void
+speed_mem_snapshot(CRYPTO_MEM_COUNTS *counts)
+{
+	int i;
+
+	for (i = 0; i < CRYPTO_MEM_SUBSYSTEMS; i++)
+		CRYPTO_mem_get_counts(i, &counts[i]);
+}
+
+/*
+ * Print the allocations made between two snapshots, by subsystem, divided
+ * by the number of operations or connections they were made for.
+ */
+static void
+speed_mem_report(const char *what, const CRYPTO_MEM_COUNTS *start,
+    const CRYPTO_MEM_COUNTS *end, uint64_t n)
+{
+	uint64_t allocs, bytes;
+	int i, none = 1;
+
+	if (!speed_allocs || output != OUTPUT_TEXT || n == 0)
+		return;
+
+	printf("  allocations per %s:", what);
+	for (i = 0; i < CRYPTO_MEM_SUBSYSTEMS; i++) {
+		allocs = end[i].allocations - start[i].allocations;
+		bytes = end[i].bytes - start[i].bytes;
+		if (allocs == 0)
+			continue;
+		printf(" %s %.2f (%.0f bytes)", CRYPTO_mem_subsystem_name(i),
+		    (double)allocs / n, (double)bytes / n);
+		none = 0;
+	}
+	printf("%s\n", none ? " none" : "");
+	fflush(stdout);
+}
+
+static void
+speed_report_end(void)
+{
+	if (output == OUTPUT_JSON)
+		printf("%s]\n", speed_results ? "\n" : "[");
+}
+
+static int
+speed_run_threads(const struct speed_test *t, int nthreads)
+{
+	CRYPTO_MEM_COUNTS mem_setup[CRYPTO_MEM_SUBSYSTEMS];
+	CRYPTO_MEM_COUNTS mem_start[CRYPTO_MEM_SUBSYSTEMS];
+	CRYPTO_MEM_COUNTS mem_end[CRYPTO_MEM_SUBSYSTEMS];
+	struct speed_thread *th;
+	struct timespec start, end;
+	uint64_t *hist, ops = 0;
+	double secs;
+	int i, n, failed = 0, ret = -1;
+
+	if ((th = calloc(nthreads, sizeof(*th))) == NULL ||
+	    (hist = calloc(LAT_BUCKETS, sizeof(*hist))) == NULL) {
+		free(th);
+		BIO_printf(bio_err, "out of memory\n");
+		return (-1);
+	}
+	speed_mem_snapshot(mem_setup);
+	for (i = 0; i < nthreads; i++) {
+		th[i].test = t;
+		if ((th[i].buf = calloc(2, THREAD_BUFSIZE)) == NULL) {
+			BIO_printf(bio_err, "out of memory\n");
+			goto err;
+		}
+		if (t->thread_init != NULL && !t->thread_init(t, &th[i])) {
+			BIO_printf(bio_err, "%s setup failure\n", t->name);
+			ERR_print_errors(bio_err);
+			goto err;
+		}
+	}
+
+	BIO_printf(bio_err, "Doing %s on %d size blocks with %d threads "
+	    "for %ds\n", t->name, t->size, nthreads, t->seconds);
+	(void) BIO_flush(bio_err);
+
+	speed_mem_snapshot(mem_start);
+	run = 1;
+	alarm(t->seconds);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (n = 0; n < nthreads; n++) {
+		if ((errno = pthread_create(&th[n].tid, NULL,
+		    speed_thread_main, &th[n])) != 0) {
+			BIO_printf(bio_err, "pthread_create: %s\n",
+			    strerror(errno));
+			run = 0;
+			alarm(0);
+			break;
+		}
+	}
+	for (i = 0; i < n; i++)
+		pthread_join(th[i].tid, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	speed_mem_snapshot(mem_end);
+	if (n != nthreads)
+		goto err;
+
+	for (i = 0; i < nthreads; i++) {
+		ops += th[i].ops;
+		failed |= th[i].failed;
+		for (n = 0; n < LAT_BUCKETS; n++)
+			hist[n] += th[i].hist[n];
+	}
+	if (failed) {
+		alarm(0);
+		BIO_printf(bio_err, "%s failure\n", t->name);
+		ERR_print_errors(bio_err);
+		goto err;
+	}
+	secs = (end.tv_sec - start.tv_sec) +
+	    (end.tv_nsec - start.tv_nsec) / 1e9;
+	speed_report(t, nthreads, ops, secs, hist);
+	if (t->thread_init != NULL)
+		speed_mem_report("connection", mem_setup, mem_start, nthreads);
+	speed_mem_report("op", mem_start, mem_end, ops);
+	ret = 0;
+
+ err:
+	for (i = 0; i < nthreads; i++) {
+		if (t->thread_free != NULL)
+			t->thread_free(&th[i]);
+		free(th[i].buf);
+	}
+	free(th);
+	free(hist);
+
+	return (ret);
+}
+
+static int
+speed_threads_aead(const char *name, const EVP_AEAD *aead,
+    const unsigned char *key, int nthreads)
+{
+	struct speed_test t;
+	int j, ret = 0;
+
+	memset(&t, 0, sizeof(t));
+	if (!EVP_AEAD_CTX_init(&t.aead_ctx, aead, key,
+	    EVP_AEAD_key_length(aead), EVP_AEAD_DEFAULT_TAG_LENGTH, NULL)) {
+		BIO_printf(bio_err, "%s setup failure\n", name);
+		return (-1);
+	}
+	strlcpy(t.name, name, sizeof(t.name));
+	t.seconds = SECONDS;
+	t.op = speed_op_aead;
+	t.nonce_len = EVP_AEAD_nonce_length(aead);
+	for (j = 0; j < SIZE_NUM && ret == 0; j++) {
+		t.size = lengths[j];
+		ret = speed_run_threads(&t, nthreads);
+	}
+	EVP_AEAD_CTX_cleanup(&t.aead_ctx);
+
+	return (ret);
+}
+
+static int
+speed_threads_rsa(RSA *rsa, int bits, int nthreads)
+{
+	struct speed_test t;
+
+	memset(&t, 0, sizeof(t));
+	strlcpy(t.name, "rsa sign", sizeof(t.name));
+	t.size = bits;
+	t.seconds = RSA_SECONDS;
+	t.op = speed_op_rsa_sign;
+	t.rsa = rsa;
+
+	return (speed_run_threads(&t, nthreads));
+}
+
+static int
+speed_threads_ecdh(EC_KEY *a, EC_KEY *b, const char *curve, int bits,
+    int nthreads)
+{
+	struct speed_test t;
+	int field_size;
+
+	if (!EC_KEY_generate_key(a) || !EC_KEY_generate_key(b)) {
+		BIO_printf(bio_err, "ECDH key generation failure.\n");
+		return (-1);
+	}
+	memset(&t, 0, sizeof(t));
+	snprintf(t.name, sizeof(t.name), "ecdh %s", curve);
+	t.size = bits;
+	t.seconds = ECDH_SECONDS;
+	t.op = speed_op_ecdh;
+	t.ecdh_a = a;
+	t.ecdh_b = b;
+	/* Same secret size and KDF choice as the single threaded test. */
+	field_size = EC_GROUP_get_degree(EC_KEY_get0_group(a));
+	if (field_size <= 24 * 8) {
+		t.ecdh_outlen = KDF1_SHA1_len;
+		t.kdf = KDF1_SHA1;
+	} else
+		t.ecdh_outlen = (field_size + 7) / 8;
+
+	return (speed_run_threads(&t, nthreads));
+}
+
+static X509 *
+speed_tls_cert(EVP_PKEY *pkey)
+{
+	X509_NAME *name;
+	X509 *cert;
+
+	if ((cert = X509_new()) == NULL)
+		return (NULL);
+	if (!X509_set_version(cert, 2) ||
+	    !ASN1_INTEGER_set(X509_get_serialNumber(cert), 1) ||
+	    X509_gmtime_adj(X509_get_notBefore(cert), 0) == NULL ||
+	    X509_gmtime_adj(X509_get_notAfter(cert), 86400) == NULL ||
+	    (name = X509_get_subject_name(cert)) == NULL ||
+	    !X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+	    (const unsigned char *)"speed", -1, -1, 0) ||
+	    !X509_set_issuer_name(cert, name) ||
+	    !X509_set_pubkey(cert, pkey) ||
+	    !X509_sign(cert, pkey, EVP_sha256())) {
+		X509_free(cert);
+		return (NULL);
+	}
+	return (cert);
+}
+
+static int
+speed_tls_ctx_init(SSL_CTX *ctx, uint16_t version, const char *cipher)
+{
+	if (!SSL_CTX_set_min_proto_version(ctx, version) ||
+	    !SSL_CTX_set_max_proto_version(ctx, version))
+		return (0);
+	if (version == TLS1_3_VERSION)
+		return (SSL_CTX_set_ciphersuites(ctx, cipher));
+	return (SSL_CTX_set_cipher_list(ctx, cipher));
+}
+
+/*
+ * Benchmark the TLS record layer for a cipher suite, with record_size
+ * bytes per record or over the whole range of record sizes if it is zero.
+ */
+static int
+speed_threads_tls(RSA *rsa, const char *cipher, int record_size,
+    int nthreads)
+{
+	struct speed_test t;
+	EVP_PKEY *pkey = NULL;
+	X509 *cert = NULL;
+	uint16_t version;
+	size_t j;
+	int ret = -1;
+
+	memset(&t, 0, sizeof(t));
+	version = TLS1_2_VERSION;
+	if (strncmp(cipher, "AEAD-", 5) == 0 || strncmp(cipher, "TLS_", 4) == 0)
+		version = TLS1_3_VERSION;
+
+	if ((pkey = EVP_PKEY_new()) == NULL ||
+	    !EVP_PKEY_set1_RSA(pkey, rsa) ||
+	    (cert = speed_tls_cert(pkey)) == NULL)
+		goto setup_err;
+	if ((t.client_ctx = SSL_CTX_new(TLS_method())) == NULL ||
+	    (t.server_ctx = SSL_CTX_new(TLS_method())) == NULL)
+		goto setup_err;
+	if (!speed_tls_ctx_init(t.client_ctx, version, cipher) ||
+	    !speed_tls_ctx_init(t.server_ctx, version, cipher))
+		goto setup_err;
+	if (!SSL_CTX_use_certificate(t.server_ctx, cert) ||
+	    !SSL_CTX_use_PrivateKey(t.server_ctx, pkey))
+		goto setup_err;
+
+	snprintf(t.name, sizeof(t.name), "tls %s", cipher);
+	t.seconds = SECONDS;
+	t.op = speed_op_tls_record;
+	t.thread_init = speed_tls_thread_init;
+	t.thread_free = speed_tls_thread_free;
+
+	if (record_size != 0) {
+		t.size = record_size;
+		ret = speed_run_threads(&t, nthreads);
+		goto done;
+	}
+	ret = 0;
+	for (j = 0; j < TLS_SIZE_NUM && ret == 0; j++) {
+		t.size = tls_record_sizes[j];
+		ret = speed_run_threads(&t, nthreads);
+	}
+	goto done;
+
+ setup_err:
+	BIO_printf(bio_err, "%s setup failure\n", cipher);
+	ERR_print_errors(bio_err);
+
+ done:
+	SSL_CTX_free(t.client_ctx);
+	SSL_CTX_free(t.server_ctx);
+	X509_free(cert);
+	EVP_PKEY_free(pkey);
+
+	return (ret);
+}
+
 int
 speed_main(int argc, char **argv)
 {
@@ -467,6 +1042,10 @@ speed_main(int argc, char **argv)
 	const EVP_MD *evp_md = NULL;
 	int decrypt = 0;
 	int multi = 0;
+	int threads = 0;
+	int tls_record = 0;
+	int record_size = 0;
+	const char *tls_cipher = NULL;
 	const char *errstr = NULL;
 
 	if (single_execution) {
@@ -559,6 +1138,63 @@ speed_main(int argc, char **argv)
 			j--;	/* Otherwise, -multi gets confused with an
 				 * algorithm. */
 		}
+		else if ((argc > 0) && (strcmp(*argv, "-threads") == 0)) {
+			argc--;
+			argv++;
+			if (argc == 0) {
+				BIO_printf(bio_err, "no thread count given\n");
+				goto end;
+			}
+			threads = strtonum(argv[0], 1, 1024, &errstr);
+			if (errstr) {
+				BIO_printf(bio_err, "bad thread count: %s", errstr);
+				goto end;
+			}
+			j--;	/* Otherwise, -threads gets confused with an
+				 * algorithm. */
+		}
+		else if ((argc > 0) && (strcmp(*argv, "-record-size") == 0)) {
+			argc--;
+			argv++;
+			if (argc == 0) {
+				BIO_printf(bio_err, "no record size given\n");
+				goto end;
+			}
+			record_size = strtonum(argv[0], 1, TLS_RECORD_MAX,
+			    &errstr);
+			if (errstr) {
+				BIO_printf(bio_err, "bad record size: %s", errstr);
+				goto end;
+			}
+			j--;	/* Otherwise, -record-size gets confused with an
+				 * algorithm. */
+		}
+		else if ((argc > 0) && (strcmp(*argv, "-tls-cipher") == 0)) {
+			argc--;
+			argv++;
+			if (argc == 0) {
+				BIO_printf(bio_err, "no cipher given\n");
+				goto end;
+			}
+			tls_cipher = *argv;
+			j--;	/* Otherwise, -tls-cipher gets confused with an
+				 * algorithm. */
+		}
+		else if (argc > 0 && !strcmp(*argv, "-allocs")) {
+			if (!CRYPTO_mem_accounting(1))
+				BIO_printf(bio_err, "allocations are only "
+				    "counted for calls to OPENSSL_malloc()\n");
+			speed_allocs = 1;
+			j--;
+		}
+		else if (argc > 0 && !strcmp(*argv, "-json")) {
+			output = OUTPUT_JSON;
+			j--;
+		}
+		else if (argc > 0 && !strcmp(*argv, "-csv")) {
+			output = OUTPUT_CSV;
+			j--;
+		}
 		else if (argc > 0 && !strcmp(*argv, "-mr")) {
 			mr = 1;
 			j--;	/* Otherwise, -mr gets confused with an
@@ -814,7 +1450,9 @@ speed_main(int argc, char **argv)
 		else if (strcmp(*argv, "ecdh") == 0) {
 			for (i = 0; i < EC_NUM; i++)
 				ecdh_doit[i] = 1;
-		} else
+		} else if (strcmp(*argv, "tls-record") == 0)
+			tls_record = 1;
+		else
 		{
 			BIO_printf(bio_err, "Error: bad option or value\n");
 			BIO_printf(bio_err, "\n");
@@ -888,6 +1526,7 @@ speed_main(int argc, char **argv)
 			BIO_printf(bio_err, "ecdhp160  ecdhp192  ecdhp224  ecdhp256  ecdhp384  ecdhp521\n");
 			BIO_printf(bio_err, "ecdhk163  ecdhk233  ecdhk283  ecdhk409  ecdhk571\n");
 			BIO_printf(bio_err, "ecdhb163  ecdhb233  ecdhb283  ecdhb409  ecdhb571  ecdh\n");
+			BIO_printf(bio_err, "tls-record\n");
 
 #ifndef OPENSSL_NO_IDEA
 			BIO_printf(bio_err, "idea     ");
@@ -917,11 +1556,17 @@ speed_main(int argc, char **argv)
 
 			BIO_printf(bio_err, "\n");
 			BIO_printf(bio_err, "Available options:\n");
+			BIO_printf(bio_err, "-allocs         count allocations by subsystem (implies -threads 1).\n");
 			BIO_printf(bio_err, "-elapsed        measure time in real time instead of CPU user time.\n");
 			BIO_printf(bio_err, "-evp e          use EVP e.\n");
 			BIO_printf(bio_err, "-decrypt        time decryption instead of encryption (only EVP).\n");
 			BIO_printf(bio_err, "-mr             produce machine readable output.\n");
 			BIO_printf(bio_err, "-multi n        run n benchmarks in parallel.\n");
+			BIO_printf(bio_err, "-threads n      run each benchmark in n threads, with latency percentiles.\n");
+			BIO_printf(bio_err, "-json           produce JSON output (implies -threads 1).\n");
+			BIO_printf(bio_err, "-csv            produce CSV output (implies -threads 1).\n");
+			BIO_printf(bio_err, "-record-size n  use n byte records for tls-record.\n");
+			BIO_printf(bio_err, "-tls-cipher c   use cipher suite c for tls-record.\n");
 			goto end;
 		}
 		argc--;
@@ -929,6 +1574,14 @@ speed_main(int argc, char **argv)
 		j++;
 	}
 
+	if ((output != OUTPUT_TEXT || tls_record || speed_allocs) &&
+	    threads == 0)
+		threads = 1;
+	if (multi && threads) {
+		BIO_printf(bio_err, "-multi cannot be used with -threads\n");
+		goto end;
+	}
+
 	if (multi && do_multi(multi))
 		goto show_res;
 
@@ -1003,6 +1656,65 @@ speed_main(int argc, char **argv)
 #define COUNT(d) (count)
 	signal(SIGALRM, sig_done);
 
+	if (threads) {
+#ifndef OPENSSL_NO_AES
+		if (doit[D_AES_128_GCM] && speed_threads_aead(
+		    names[D_AES_128_GCM], EVP_aead_aes_128_gcm(), key32,
+		    threads) == -1)
+			goto end;
+		if (doit[D_AES_256_GCM] && speed_threads_aead(
+		    names[D_AES_256_GCM], EVP_aead_aes_256_gcm(), key32,
+		    threads) == -1)
+			goto end;
+#endif
+#if !defined(OPENSSL_NO_CHACHA) && !defined(OPENSSL_NO_POLY1305)
+		if (doit[D_CHACHA20_POLY1305] && speed_threads_aead(
+		    names[D_CHACHA20_POLY1305], EVP_aead_chacha20_poly1305(),
+		    key32, threads) == -1)
+			goto end;
+#endif
+		for (j = 0; j < RSA_NUM; j++) {
+			if (rsa_doit[j] && speed_threads_rsa(rsa_key[j],
+			    rsa_bits[j], threads) == -1)
+				goto end;
+		}
+		for (j = 0; j < EC_NUM; j++) {
+			if (!ecdh_doit[j])
+				continue;
+			ecdh_a[j] = EC_KEY_new_by_curve_name(test_curves[j]);
+			ecdh_b[j] = EC_KEY_new_by_curve_name(test_curves[j]);
+			if (ecdh_a[j] == NULL || ecdh_b[j] == NULL) {
+				BIO_printf(bio_err, "ECDH failure.\n");
+				goto end;
+			}
+			if (speed_threads_ecdh(ecdh_a[j], ecdh_b[j],
+			    test_curves_names[j], test_curves_bits[j],
+			    threads) == -1)
+				goto end;
+		}
+		if (tls_record && tls_cipher != NULL) {
+			if (speed_threads_tls(rsa_key[R_RSA_2048], tls_cipher,
+			    record_size, threads) == -1)
+				goto end;
+		} else if (tls_record) {
+			for (i = 0; i < TLS_CIPHER_NUM; i++) {
+				if (speed_threads_tls(rsa_key[R_RSA_2048],
+				    tls_record_ciphers[i], record_size,
+				    threads) == -1)
+					goto end;
+			}
+		}
+		if (speed_results == 0) {
+			BIO_printf(bio_err, "-threads supports aes-128-gcm, "
+			    "aes-256-gcm, chacha20-poly1305, rsa, ecdh and "
+			    "tls-record\n");
+			goto end;
+		}
+		speed_report_end();
+		mret = 0;
+		goto end;
+	}
+
 #ifndef OPENSSL_NO_MD4
 	if (doit[D_MD4]) {
 		for (j = 0; j < SIZE_NUM; j++) {
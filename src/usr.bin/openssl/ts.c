@@ -96,11 +96,13 @@ static int reply_command(CONF * conf, char *section,
     char *queryfile, char *passin, char *inkey,
     char *signer, char *chain, const char *policy,
     char *in, int token_in, char *out, int token_out,
-    int text);
+    int text, int batch);
 static TS_RESP *read_PKCS7(BIO * in_bio);
 static TS_RESP *create_response(CONF * conf, const char *section,
     char *queryfile, char *passin, char *inkey,
-    char *signer, char *chain, const char *policy);
+    char *signer, char *chain, const char *policy, int batch);
+static TS_RESP *create_batch_response(TS_RESP_CTX * resp_ctx,
+    BIO * query_bio, int batch);
 static ASN1_INTEGER *serial_cb(TS_RESP_CTX * ctx, void *data);
 static ASN1_INTEGER *next_serial(const char *serialfile);
 static int save_ts_serial(const char *serialfile, ASN1_INTEGER * serial);
@@ -148,6 +150,9 @@ ts_main(int argc, char **argv)
 	int token_in = 0;
 	/* Output is ContentInfo instead of TimeStampResp. */
 	int token_out = 0;
+	/* Number of copies of the query to answer in one batch. */
+	int batch = 0;
+	const char *errstr;
 
 	if (single_execution) {
 		if (pledge("stdio cpath wpath rpath tty", NULL) == -1) {
@@ -207,6 +212,12 @@ ts_main(int argc, char **argv)
 			if (argc-- < 1)
 				goto usage;
 			queryfile = *++argv;
+		} else if (strcmp(*argv, "-batch") == 0) {
+			if (argc-- < 1)
+				goto usage;
+			batch = strtonum(*++argv, 1, 1000000, &errstr);
+			if (errstr != NULL)
+				goto usage;
 		} else if (strcmp(*argv, "-passin") == 0) {
 			if (argc-- < 1)
 				goto usage;
@@ -279,14 +290,14 @@ ts_main(int argc, char **argv)
 				goto usage;
 		} else {
 			/* 'in' and 'queryfile' are exclusive. */
-			ret = !(queryfile == NULL);
+			ret = !(queryfile == NULL && batch == 0);
 			if (ret)
 				goto usage;
 		}
 
 		ret = !reply_command(conf, section, queryfile,
 		    password, inkey, signer, chain, policy,
-		    in, token_in, out, token_out, text);
+		    in, token_in, out, token_out, text, batch);
 		break;
 	case CMD_VERIFY:
 		ret = !(((queryfile && !data && !digest) ||
@@ -310,7 +321,7 @@ ts_main(int argc, char **argv)
 	    "[-in request.tsq] [-out request.tsq] [-text]\n");
 	BIO_printf(bio_err, "or\n"
 	    "ts -reply [-config configfile] [-section tsa_section] "
-	    "[-queryfile request.tsq] [-passin password] "
+	    "[-queryfile request.tsq] [-batch num] [-passin password] "
 	    "[-signer tsa_cert.pem] [-inkey private_key.pem] "
 	    "[-chain certs_file.pem] [-policy object_id] "
 	    "[-in response.tsr] [-token_in] "
@@ -617,7 +628,7 @@ create_nonce(int bits)
 static int
 reply_command(CONF * conf, char *section, char *queryfile,
     char *passin, char *inkey, char *signer, char *chain, const char *policy,
-    char *in, int token_in, char *out, int token_out, int text)
+    char *in, int token_in, char *out, int token_out, int text, int batch)
 {
 	int ret = 0;
 	TS_RESP *response = NULL;
@@ -644,7 +655,7 @@ reply_command(CONF * conf, char *section, char *queryfile,
 	} else {
 		response = create_response(conf, section, queryfile,
 		    passin, inkey, signer, chain,
-		    policy);
+		    policy, batch);
 		if (response)
 			BIO_printf(bio_err, "Response has been generated.\n");
 		else
@@ -742,7 +753,7 @@ read_PKCS7(BIO * in_bio)
 static TS_RESP *
 create_response(CONF * conf, const char *section,
     char *queryfile, char *passin, char *inkey,
-    char *signer, char *chain, const char *policy)
+    char *signer, char *chain, const char *policy, int batch)
 {
 	int ret = 0;
 	TS_RESP *response = NULL;
@@ -809,7 +820,11 @@ create_response(CONF * conf, const char *section,
 		goto end;
 
 	/* Creating the response. */
-	if (!(response = TS_RESP_create_response(resp_ctx, query_bio)))
+	if (batch > 0)
+		response = create_batch_response(resp_ctx, query_bio, batch);
+	else
+		response = TS_RESP_create_response(resp_ctx, query_bio);
+	if (response == NULL)
 		goto end;
 
 	ret = 1;
@@ -824,6 +839,63 @@ create_response(CONF * conf, const char *section,
 	return response;
 }
 
+/*
+ * Answers batch copies of the query with a single signature and returns the
+ * first response, reporting how long it took.
+ */
+static TS_RESP *
+create_batch_response(TS_RESP_CTX * resp_ctx, BIO * query_bio, int batch)
+{
+	TS_REQ *query = NULL;
+	TS_RESP *response = NULL;
+	TS_RESP **responses = NULL;
+	BIO **query_bios = NULL;
+	unsigned char *der = NULL;
+	double elapsed;
+	int der_len, i;
+
+	if (!(query = d2i_TS_REQ_bio(query_bio, NULL)))
+		goto end;
+	if ((der_len = i2d_TS_REQ(query, &der)) <= 0)
+		goto end;
+
+	if ((query_bios = calloc(batch, sizeof(*query_bios))) == NULL ||
+	    (responses = calloc(batch, sizeof(*responses))) == NULL)
+		goto end;
+	for (i = 0; i < batch; i++) {
+		if (!(query_bios[i] = BIO_new_mem_buf(der, der_len)))
+			goto end;
+	}
+
+	app_timer_real(0);
+	if (!TS_RESP_create_batch_response(resp_ctx, query_bios, batch,
+	    responses))
+		goto end;
+	elapsed = app_timer_real(1);
+
+	BIO_printf(bio_err, "%d responses in %.3fs, %.0f responses/s\n",
+	    batch, elapsed, elapsed > 0 ? batch / elapsed : 0);
+
+	response = responses[0];
+	responses[0] = NULL;
+
+ end:
+	if (responses != NULL) {
+		for (i = 0; i < batch; i++)
+			TS_RESP_free(responses[i]);
+	}
+	free(responses);
+	if (query_bios != NULL) {
+		for (i = 0; i < batch; i++)
+			BIO_free(query_bios[i]);
+	}
+	free(query_bios);
+	free(der);
+	TS_REQ_free(query);
+
+	return response;
+}
+
 static ASN1_INTEGER *
 serial_cb(TS_RESP_CTX * ctx, void *data)
 {
@@ -56,9 +56,12 @@
  * [including the GNU Public Licence.]
  */
 
+#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "apps.h"
 
@@ -68,15 +71,52 @@
 #include <openssl/x509.h>
 #include <openssl/x509v3.h>
 
+#define MAX_JOBS	256
+#define MAX_VERIFY_ERR	256
+
+/* Where the output about one certificate goes. */
+struct verify_output {
+	BIO *out;
+	BIO *err;
+};
+
+/* A certificate verified by one of the -jobs threads. */
+struct verify_job {
+	char *file;
+	struct verify_output output;
+	int result;
+	int verify_err;
+	int done;
+};
+
+/* What the -jobs threads share, and only read from. */
+struct verify_shared {
+	X509_STORE *store;
+	STACK_OF(X509) *uchain;
+	STACK_OF(X509) *tchain;
+	STACK_OF(X509_CRL) *crls;
+};
+
+struct verify_stats {
+	long total;
+	long ok;
+	long failed;
+	long unreadable;
+	long errors[MAX_VERIFY_ERR];
+};
+
 static int cb(int ok, X509_STORE_CTX *ctx);
 static int check(X509_STORE *ctx, char *file, STACK_OF(X509) *uchain,
-    STACK_OF(X509) *tchain, STACK_OF(X509_CRL) *crls);
+    STACK_OF(X509) *tchain, STACK_OF(X509_CRL) *crls,
+    struct verify_output *output, int *verify_errp);
 static int vflags = 0;
 
 static struct {
 	char *CAfile;
 	char *CApath;
 	char *crlfile;
+	int jobs;
+	char *statsfile;
 	char *trustfile;
 	char *untfile;
 	int verbose;
@@ -121,6 +161,20 @@ static const struct option verify_options[] = {
 		.type = OPTION_ARG,
 		.opt.arg = &verify_config.crlfile,
 	},
+	{
+		.name = "jobs",
+		.argname = "n",
+		.desc = "Verify the certificates with n threads",
+		.type = OPTION_ARG_INT,
+		.opt.value = &verify_config.jobs,
+	},
+	{
+		.name = "stats",
+		.argname = "file",
+		.desc = "Write summary statistics as JSON to file",
+		.type = OPTION_ARG,
+		.opt.arg = &verify_config.statsfile,
+	},
 	{
 		.name = "trusted",
 		.argname = "file",
@@ -240,9 +294,9 @@ verify_usage(void)
 	    "    [-CRLfile file] [-crl_check] [-crl_check_all]\n"
 	    "    [-explicit_policy] [-extended_crl]\n"
 	    "    [-ignore_critical] [-inhibit_any] [-inhibit_map]\n"
-	    "    [-issuer_checks] [-policy_check] [-purpose purpose]\n"
-	    "    [-trusted file] [-untrusted file] [-verbose]\n"
-	    "    [-x509_strict] [certificates]\n\n");
+	    "    [-issuer_checks] [-jobs n] [-policy_check]\n"
+	    "    [-purpose purpose] [-stats file] [-trusted file]\n"
+	    "    [-untrusted file] [-verbose] [-x509_strict] [certificates]\n\n");
 
 	options_usage(verify_options);
 
@@ -257,6 +311,184 @@ verify_usage(void)
 	}
 }
 
+static void
+verify_count(struct verify_stats *stats, int result, int verify_err)
+{
+	stats->total++;
+	if (result == 1)
+		stats->ok++;
+	else if (verify_err == -1)
+		stats->unreadable++;
+	else {
+		stats->failed++;
+		if (verify_err >= 0 && verify_err < MAX_VERIFY_ERR)
+			stats->errors[verify_err]++;
+	}
+}
+
+static void
+json_string(FILE *fp, const char *s)
+{
+	fputc('"', fp);
+	for (; *s != '\0'; s++) {
+		if (*s == '"' || *s == '\\')
+			fprintf(fp, "\\%c", *s);
+		else if ((unsigned char)*s < 0x20)
+			fprintf(fp, "\\u%04x", (unsigned char)*s);
+		else
+			fputc(*s, fp);
+	}
+	fputc('"', fp);
+}
+
+static void
+verify_stats_print(FILE *fp, const struct verify_stats *stats, int jobs,
+    double elapsed)
+{
+	const char *sep = "";
+	int i;
+
+	fprintf(fp, "{\n");
+	fprintf(fp, "  \"total\": %ld,\n", stats->total);
+	fprintf(fp, "  \"ok\": %ld,\n", stats->ok);
+	fprintf(fp, "  \"failed\": %ld,\n", stats->failed);
+	fprintf(fp, "  \"unreadable\": %ld,\n", stats->unreadable);
+	fprintf(fp, "  \"jobs\": %d,\n", jobs);
+	fprintf(fp, "  \"seconds\": %.3f,\n", elapsed);
+	fprintf(fp, "  \"errors\": [");
+	for (i = 0; i < MAX_VERIFY_ERR; i++) {
+		if (stats->errors[i] == 0)
+			continue;
+		fprintf(fp, "%s\n    { \"code\": %d, \"reason\": ", sep, i);
+		json_string(fp, X509_verify_cert_error_string(i));
+		fprintf(fp, ", \"count\": %ld }", stats->errors[i]);
+		sep = ",";
+	}
+	fprintf(fp, "%s]\n}\n", *sep != '\0' ? "\n  " : "");
+}
+
+static pthread_mutex_t verify_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t verify_cond = PTHREAD_COND_INITIALIZER;
+static struct verify_job *verify_jobs;
+static int verify_njobs, verify_next;
+
+static void *
+verify_worker(void *arg)
+{
+	struct verify_shared *vs = arg;
+	struct verify_job *job;
+
+	for (;;) {
+		pthread_mutex_lock(&verify_mutex);
+		job = verify_next < verify_njobs ?
+		    &verify_jobs[verify_next++] : NULL;
+		pthread_mutex_unlock(&verify_mutex);
+		if (job == NULL)
+			break;
+
+		job->output.out = BIO_new(BIO_s_mem());
+		job->output.err = BIO_new(BIO_s_mem());
+		if (job->output.out == NULL || job->output.err == NULL) {
+			job->result = 0;
+			job->verify_err = -1;
+			fprintf(stderr, "%s: out of memory\n", job->file);
+		} else
+			job->result = check(vs->store, job->file, vs->uchain,
+			    vs->tchain, vs->crls, &job->output,
+			    &job->verify_err);
+
+		pthread_mutex_lock(&verify_mutex);
+		job->done = 1;
+		pthread_cond_signal(&verify_cond);
+		pthread_mutex_unlock(&verify_mutex);
+	}
+
+	return NULL;
+}
+
+static void
+verify_flush(BIO *bio, FILE *fp)
+{
+	char *data;
+	long len;
+
+	if (bio == NULL)
+		return;
+	if ((len = BIO_get_mem_data(bio, &data)) > 0)
+		fwrite(data, 1, len, fp);
+}
+
+/*
+ * Verify the certificates with up to njobs threads, all sharing the same
+ * store, chains and CRLs, which are only read from. The output for each
+ * certificate is collected by the thread that verifies it and written
+ * out in the order the certificates were given, as soon as all those
+ * before it are done.
+ */
+static int
+verify_parallel(struct verify_shared *vs, int njobs, char **files,
+    int nfiles, struct verify_stats *stats)
+{
+	pthread_t *threads = NULL;
+	struct verify_job *job;
+	int i, started = 0, ret = -1;
+
+	if ((verify_jobs = calloc(nfiles, sizeof(*verify_jobs))) == NULL ||
+	    (threads = calloc(njobs, sizeof(*threads))) == NULL) {
+		BIO_printf(bio_err, "out of memory\n");
+		goto end;
+	}
+	for (i = 0; i < nfiles; i++)
+		verify_jobs[i].file = files[i];
+	verify_njobs = nfiles;
+	verify_next = 0;
+
+	if (njobs > nfiles)
+		njobs = nfiles;
+	for (i = 0; i < njobs; i++) {
+		if ((errno = pthread_create(&threads[i], NULL, verify_worker,
+		    vs)) != 0) {
+			BIO_printf(bio_err, "pthread_create: %s\n",
+			    strerror(errno));
+			break;
+		}
+		started++;
+	}
+	/* If no thread could be started, do the work here. */
+	if (started == 0)
+		verify_worker(vs);
+
+	ret = 0;
+	for (i = 0; i < nfiles; i++) {
+		job = &verify_jobs[i];
+
+		pthread_mutex_lock(&verify_mutex);
+		while (!job->done)
+			pthread_cond_wait(&verify_cond, &verify_mutex);
+		pthread_mutex_unlock(&verify_mutex);
+
+		verify_flush(job->output.err, stderr);
+		verify_flush(job->output.out, stdout);
+		BIO_free(job->output.out);
+		BIO_free(job->output.err);
+		job->output.out = job->output.err = NULL;
+
+		verify_count(stats, job->result, job->verify_err);
+		if (job->result != 1)
+			ret = -1;
+	}
+
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+
+ end:
+	free(threads);
+	free(verify_jobs);
+	verify_jobs = NULL;
+
+	return ret;
+}
+
 int
 verify_main(int argc, char **argv)
 {
@@ -264,18 +496,25 @@ verify_main(int argc, char **argv)
 	STACK_OF(X509_CRL) *crls = NULL;
 	X509_STORE *cert_ctx = NULL;
 	X509_LOOKUP *lookup = NULL;
+	struct verify_output output;
+	struct verify_shared vs;
+	struct verify_stats stats;
+	struct timespec start, now;
+	FILE *statsfp = NULL;
 	char **cert_files = NULL;
-	int argsused;
+	int argsused, i, verify_err;
 	int ret = 1;
 
 	if (single_execution) {
-		if (pledge("stdio rpath", NULL) == -1) {
+		if (pledge("stdio cpath wpath rpath", NULL) == -1) {
 			perror("pledge");
 			exit(1);
 		}
 	}
 
 	memset(&verify_config, 0, sizeof(verify_config));
+	memset(&output, 0, sizeof(output));
+	memset(&stats, 0, sizeof(stats));
 
 	if (options_parse(argc, argv, verify_options, NULL, &argsused) != 0) {
 		verify_usage();
@@ -285,10 +524,38 @@ verify_main(int argc, char **argv)
 	if (argsused < argc)
 		cert_files = &argv[argsused];
 
+	if (verify_config.jobs < 0 || verify_config.jobs > MAX_JOBS) {
+		BIO_printf(bio_err, "-jobs must be between 1 and %d\n",
+		    MAX_JOBS);
+		goto end;
+	}
+	if (verify_config.jobs > 1 && cert_files == NULL) {
+		BIO_printf(bio_err, "-jobs needs certificate files\n");
+		goto end;
+	}
+
+	if (verify_config.statsfile != NULL) {
+		if (strcmp(verify_config.statsfile, "-") == 0)
+			statsfp = stdout;
+		else if ((statsfp = fopen(verify_config.statsfile, "w")) ==
+		    NULL) {
+			perror(verify_config.statsfile);
+			goto end;
+		}
+	}
+
+	if (single_execution) {
+		if (pledge("stdio rpath", NULL) == -1) {
+			perror("pledge");
+			exit(1);
+		}
+	}
+
 	cert_ctx = X509_STORE_new();
 	if (cert_ctx == NULL)
 		goto end;
 	X509_STORE_set_verify_cb(cert_ctx, cb);
+	X509_STORE_set_flags(cert_ctx, vflags);
 
 	if (verify_config.vpm)
 		X509_STORE_set1_param(cert_ctx, verify_config.vpm);
@@ -341,19 +608,51 @@ verify_main(int argc, char **argv)
 		if (!crls)
 			goto end;
 	}
+	if ((output.out = BIO_new_fp(stdout, BIO_NOCLOSE)) == NULL) {
+		ERR_print_errors(bio_err);
+		goto end;
+	}
+	output.err = bio_err;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
 	ret = 0;
 	if (cert_files == NULL) {
-		if (1 != check(cert_ctx, NULL, untrusted, trusted, crls))
+		i = check(cert_ctx, NULL, untrusted, trusted, crls, &output,
+		    &verify_err);
+		verify_count(&stats, i, verify_err);
+		if (i != 1)
 			ret = -1;
+	} else if (verify_config.jobs > 1) {
+		vs.store = cert_ctx;
+		vs.uchain = untrusted;
+		vs.tchain = trusted;
+		vs.crls = crls;
+		ret = verify_parallel(&vs, verify_config.jobs, cert_files,
+		    argc - argsused, &stats);
 	} else {
 		do {
-			if (1 != check(cert_ctx, *cert_files++, untrusted,
-			    trusted, crls))
+			i = check(cert_ctx, *cert_files++, untrusted,
+			    trusted, crls, &output, &verify_err);
+			verify_count(&stats, i, verify_err);
+			if (i != 1)
 				ret = -1;
 		} while (*cert_files != NULL);
 	}
 
+	if (statsfp != NULL) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		(void)BIO_flush(output.out);
+		verify_stats_print(statsfp, &stats,
+		    verify_config.jobs > 1 ? verify_config.jobs : 1,
+		    (now.tv_sec - start.tv_sec) +
+		    (now.tv_nsec - start.tv_nsec) / 1e9);
+	}
+
  end:
+	if (statsfp != NULL && statsfp != stdout)
+		fclose(statsfp);
+	BIO_free(output.out);
 	if (verify_config.vpm)
 		X509_VERIFY_PARAM_free(verify_config.vpm);
 	if (cert_ctx != NULL)
@@ -365,9 +664,15 @@ verify_main(int argc, char **argv)
 	return (ret < 0 ? 2 : ret);
 }
 
+/*
+ * Verify one certificate, writing the results to output. The verification
+ * error is returned in verify_errp, or -1 if the certificate could not be
+ * loaded.
+ */
 static int
 check(X509_STORE *ctx, char *file, STACK_OF(X509) *uchain,
-    STACK_OF(X509) *tchain, STACK_OF(X509_CRL) *crls)
+    STACK_OF(X509) *tchain, STACK_OF(X509_CRL) *crls,
+    struct verify_output *output, int *verify_errp)
 {
 	X509 *x = NULL;
 	X509_STORE_CTX *csc = NULL;
@@ -375,34 +680,39 @@ check(X509_STORE *ctx, char *file, STACK_OF(X509) *uchain,
 	int verify_err;
 	int i = 0, ret = 0;
 
-	x = load_cert(bio_err, file, FORMAT_PEM, NULL, "certificate file");
+	*verify_errp = -1;
+
+	x = load_cert(output->err, file, FORMAT_PEM, NULL, "certificate file");
 	if (x == NULL)
 		goto end;
 
+	*verify_errp = X509_V_ERR_UNSPECIFIED;
 	if ((csc = X509_STORE_CTX_new()) == NULL)
 		goto end;
-	X509_STORE_set_flags(ctx, vflags);
 	if (!X509_STORE_CTX_init(csc, ctx, x, uchain))
 		goto end;
 	if (tchain)
 		X509_STORE_CTX_trusted_stack(csc, tchain);
 	if (crls)
 		X509_STORE_CTX_set0_crls(csc, crls);
+	X509_STORE_CTX_set_app_data(csc, output);
 
 	i = X509_verify_cert(csc);
 	verify_err = X509_STORE_CTX_get_error(csc);
+	*verify_errp = verify_err;
 
 	if (i > 0 && verify_err == X509_V_OK) {
-		fprintf(stdout, "%s: OK\n", certfile);
+		BIO_printf(output->out, "%s: OK\n", certfile);
 		ret = 1;
 	} else {
-		fprintf(stdout, "%s: verification failed: %d (%s)\n", certfile,
-		    verify_err, X509_verify_cert_error_string(verify_err));
+		BIO_printf(output->out, "%s: verification failed: %d (%s)\n",
+		    certfile, verify_err,
+		    X509_verify_cert_error_string(verify_err));
 	}
 
  end:
 	if (i <= 0)
-		ERR_print_errors(bio_err);
+		ERR_print_errors(output->err);
 	X509_free(x);
 	X509_STORE_CTX_free(csc);
 
@@ -414,22 +724,29 @@ cb(int ok, X509_STORE_CTX *ctx)
 {
 	int cert_error = X509_STORE_CTX_get_error(ctx);
 	X509 *current_cert = X509_STORE_CTX_get_current_cert(ctx);
+	struct verify_output *output;
+	X509_STORE_CTX *parent;
+
+	/* A CRL path is verified with a context of its own. */
+	if ((output = X509_STORE_CTX_get_app_data(ctx)) == NULL &&
+	    (parent = X509_STORE_CTX_get0_parent_ctx(ctx)) != NULL)
+		output = X509_STORE_CTX_get_app_data(parent);
 
 	if (!ok) {
 		if (current_cert) {
-			X509_NAME_print_ex_fp(stdout,
+			X509_NAME_print_ex(output->out,
 			    X509_get_subject_name(current_cert),
 			    0, XN_FLAG_ONELINE);
-			printf("\n");
+			BIO_printf(output->out, "\n");
 		}
-		printf("%serror %d at %d depth lookup:%s\n",
+		BIO_printf(output->out, "%serror %d at %d depth lookup:%s\n",
 		    X509_STORE_CTX_get0_parent_ctx(ctx) ? "[CRL path]" : "",
 		    cert_error,
 		    X509_STORE_CTX_get_error_depth(ctx),
 		    X509_verify_cert_error_string(cert_error));
 		switch (cert_error) {
 		case X509_V_ERR_NO_EXPLICIT_POLICY:
-			policies_print(NULL, ctx);
+			policies_print(output->err, ctx);
 		case X509_V_ERR_CERT_HAS_EXPIRED:
 
 			/*
@@ -455,7 +772,7 @@ cb(int ok, X509_STORE_CTX *ctx)
 
 	}
 	if (cert_error == X509_V_OK && ok == 2)
-		policies_print(NULL, ctx);
+		policies_print(output->err, ctx);
 	if (!verify_config.verbose)
 		ERR_clear_error();
 	return (ok);
@@ -137,6 +137,7 @@
 
 static struct {
 	int cflags;
+	int cpu;
 	int date;
 	int dir;
 	int options;
@@ -148,6 +149,7 @@ static int
 version_all_opts(void)
 {
 	version_config.cflags = 1;
+	version_config.cpu = 1;
 	version_config.date = 1;
 	version_config.dir= 1;
 	version_config.options = 1;
@@ -170,6 +172,12 @@ static const struct option version_options[] = {
 		.type = OPTION_FLAG,
 		.opt.flag = &version_config.date,
 	},
+	{
+		.name = "c",
+		.desc = "CPU features and the implementations using them",
+		.type = OPTION_FLAG,
+		.opt.flag = &version_config.cpu,
+	},
 	{
 		.name = "d",
 		.desc = "OPENSSLDIR value",
@@ -206,7 +214,7 @@ static const struct option version_options[] = {
 static void
 version_usage(void)
 {
-	fprintf(stderr, "usage: version [-abdfopv]\n");
+	fprintf(stderr, "usage: version [-abcdfopv]\n");
 	options_usage(version_options);
 }
 
@@ -264,6 +272,8 @@ version_main(int argc, char **argv)
 		printf("%s\n", SSLeay_version(SSLEAY_CFLAGS));
 	if (version_config.dir)
 		printf("%s\n", SSLeay_version(SSLEAY_DIR));
+	if (version_config.cpu)
+		printf("%s\n", OPENSSL_cpu_features_string());
 
 	return (0);
 }
@@ -35,6 +35,8 @@
 #include "http.h"
 #include <tls.h>
 
+#define HTTP_BODY_MAX	(1024 * 1024)
+
 /*
  * A buffer for transferring HTTP/S data.
  */
@@ -327,8 +329,14 @@ err:
 	return NULL;
 }
 
-struct httpxfer *
-http_open(const struct http *http, const void *p, size_t psz)
+/*
+ * Send a request for path.
+ * An HTTP/1.1 request leaves the connection open after the reply,
+ * unless the server asks for it to be closed.
+ */
+static struct httpxfer *
+http_send(const struct http *http, const char *path, const char *version,
+    const void *p, size_t psz)
 {
 	char		*req;
 	int		 c;
@@ -336,18 +344,18 @@ http_open(const struct http *http, const void *p, size_t psz)
 
 	if (p == NULL) {
 		c = asprintf(&req,
-		    "GET %s HTTP/1.0\r\n"
+		    "GET %s HTTP/%s\r\n"
 		    "Host: %s\r\n"
 		    "\r\n",
-		    http->path, http->host);
+		    path, version, http->host);
 	} else {
 		c = asprintf(&req,
-		    "POST %s HTTP/1.0\r\n"
+		    "POST %s HTTP/%s\r\n"
 		    "Host: %s\r\n"
 		    "Content-Type: application/ocsp-request\r\n"
 		    "Content-Length: %zu\r\n"
 		    "\r\n",
-		    http->path, http->host, psz);
+		    path, version, http->host, psz);
 	}
 	if (c == -1) {
 		warn("asprintf");
@@ -368,6 +376,12 @@ http_open(const struct http *http, const void *p, size_t psz)
 	return trans;
 }
 
+struct httpxfer *
+http_open(const struct http *http, const void *p, size_t psz)
+{
+	return http_send(http, http->path, "1.0", p, psz);
+}
+
 void
 http_close(struct httpxfer *x)
 {
@@ -433,6 +447,167 @@ http_body_read(const struct http *http, struct httpxfer *trans, size_t *sz)
 	return trans->bbuf;
 }
 
+/*
+ * Append the next read from the wire to the body buffer.
+ * Returns the number of bytes read, 0 at EOF or -1 on failure.
+ */
+static ssize_t
+http_body_fill(const struct http *http, struct httpxfer *trans)
+{
+	char		 buf[BUFSIZ];
+	ssize_t		 ssz;
+	void		*pp;
+
+	if ((ssz = http->reader(buf, sizeof(buf), http)) <= 0)
+		return ssz;
+	if (trans->bbufsz + ssz > HTTP_BODY_MAX) {
+		warnx("%s: body too large", http->src.ip);
+		return -1;
+	}
+	pp = realloc(trans->bbuf, trans->bbufsz + ssz);
+	if (pp == NULL) {
+		warn("realloc");
+		return -1;
+	}
+	trans->bbuf = pp;
+	memcpy(trans->bbuf + trans->bbufsz, buf, ssz);
+	trans->bbufsz += ssz;
+	return ssz;
+}
+
+/*
+ * Read a body of exactly len bytes, leaving the connection positioned
+ * at the start of the next reply.
+ */
+static char *
+http_body_read_len(const struct http *http, struct httpxfer *trans,
+    size_t len, size_t *sz)
+{
+	ssize_t		 ssz;
+
+	trans->bodyok = -1;
+
+	while (trans->bbufsz < len) {
+		if ((ssz = http_body_fill(http, trans)) < 0)
+			return NULL;
+		if (ssz == 0) {
+			warnx("%s: partial transfer", http->src.ip);
+			return NULL;
+		}
+	}
+	if (trans->bbufsz != len) {
+		warnx("%s: unexpected data after body", http->src.ip);
+		return NULL;
+	}
+
+	trans->bodyok = 1;
+	*sz = trans->bbufsz;
+	return trans->bbuf;
+}
+
+/*
+ * Make sure that the body buffer holds a CRLF terminated line starting
+ * at pos, returning a pointer to its CRLF.
+ */
+static char *
+http_body_line(const struct http *http, struct httpxfer *trans, size_t pos)
+{
+	char		*ep;
+	ssize_t		 ssz;
+
+	while ((ep = memmem(trans->bbuf + pos, trans->bbufsz - pos,
+	    "\r\n", 2)) == NULL) {
+		if ((ssz = http_body_fill(http, trans)) < 0)
+			return NULL;
+		if (ssz == 0) {
+			warnx("%s: partial transfer", http->src.ip);
+			return NULL;
+		}
+	}
+	return ep;
+}
+
+/*
+ * Read and decode a body sent with the chunked transfer coding.
+ */
+static char *
+http_body_read_chunked(const struct http *http, struct httpxfer *trans,
+    size_t *sz)
+{
+	char		*ep, *cp, *line, *out = NULL;
+	size_t		 pos = 0, outsz = 0;
+	unsigned long	 len;
+	ssize_t		 ssz;
+	void		*pp;
+
+	trans->bodyok = -1;
+
+	if ((out = malloc(1)) == NULL) {
+		warn("malloc");
+		return NULL;
+	}
+
+	for (;;) {
+		if ((ep = http_body_line(http, trans, pos)) == NULL)
+			goto err;
+		line = trans->bbuf + pos;
+		len = strtoul(line, &cp, 16);
+		if (cp == line || (*cp != '\r' && *cp != ';') ||
+		    len > HTTP_BODY_MAX - outsz) {
+			warnx("%s: bad chunk size", http->src.ip);
+			goto err;
+		}
+		pos = ep + 2 - trans->bbuf;
+		if (len == 0)
+			break;
+
+		while (trans->bbufsz - pos < len + 2) {
+			if ((ssz = http_body_fill(http, trans)) < 0)
+				goto err;
+			if (ssz == 0) {
+				warnx("%s: partial transfer", http->src.ip);
+				goto err;
+			}
+		}
+		if (memcmp(trans->bbuf + pos + len, "\r\n", 2) != 0) {
+			warnx("%s: bad chunk", http->src.ip);
+			goto err;
+		}
+		if ((pp = realloc(out, outsz + len)) == NULL) {
+			warn("realloc");
+			goto err;
+		}
+		out = pp;
+		memcpy(out + outsz, trans->bbuf + pos, len);
+		outsz += len;
+		pos += len + 2;
+	}
+
+	/* Skip any trailer fields, up to the terminating empty line. */
+	do {
+		if ((ep = http_body_line(http, trans, pos)) == NULL)
+			goto err;
+		line = trans->bbuf + pos;
+		pos = ep + 2 - trans->bbuf;
+	} while (ep != line);
+
+	if (pos != trans->bbufsz) {
+		warnx("%s: unexpected data after body", http->src.ip);
+		goto err;
+	}
+
+	free(trans->bbuf);
+	trans->bbuf = out;
+	trans->bbufsz = outsz;
+	trans->bodyok = 1;
+	*sz = trans->bbufsz;
+	return trans->bbuf;
+
+ err:
+	free(out);
+	return NULL;
+}
+
 struct httphead *
 http_head_get(const char *v, struct httphead *h, size_t hsz)
 {
@@ -607,8 +782,12 @@ http_head_read(const struct http *http, struct httpxfer *trans, size_t *sz)
 	 */
 
 	do {
-		/* If less than sizeof(buf), at EOF. */
-		if ((ssz = http_read(buf, sizeof(buf), http)) < 0)
+		/*
+		 * Read only what is available, so that we do not block
+		 * waiting for data past the headers on a connection that
+		 * is kept open.
+		 */
+		if ((ssz = http->reader(buf, sizeof(buf), http)) < 0)
 			return NULL;
 		else if (ssz == 0)
 			break;
@@ -622,7 +801,7 @@ http_head_read(const struct http *http, struct httpxfer *trans, size_t *sz)
 		trans->hbufsz += ssz;
 		/* Search for end of headers marker. */
 		ep = memmem(trans->hbuf, trans->hbufsz, "\r\n\r\n", 4);
-	} while (ep == NULL && ssz == sizeof(buf));
+	} while (ep == NULL);
 
 	if (ep == NULL) {
 		warnx("%s: partial transfer", http->src.ip);
@@ -731,6 +910,102 @@ http_get(const struct source *addrs, size_t addrsz, const char *domain,
 	return g;
 }
 
+/*
+ * Send a POST for path on an open connection with HTTP/1.1 and read
+ * the reply, so that the connection can be used for further requests.
+ * If the server does not keep the connection open, it is disconnected
+ * and keepalive is not set in the result.
+ * Unlike with http_get(), the connection is not part of the result and
+ * must be freed separately with http_free().
+ */
+struct httpget *
+http_request(struct http *http, const char *path, const void *post,
+    size_t postsz)
+{
+	struct httpxfer	*x;
+	struct httpget	*g;
+	struct httphead	*head;
+	size_t		 i, headsz, bodsz, headrsz, clen = 0;
+	const char	*errstr;
+	int		 code, keepalive, chunked = 0, haveclen = 0;
+	char		*bod, *headr;
+
+	if (http->fd == -1)
+		return NULL;
+
+	if ((x = http_send(http, path, "1.1", post, postsz)) == NULL)
+		goto err;
+	if ((headr = http_head_read(http, x, &headrsz)) == NULL)
+		goto err;
+	if ((head = http_head_parse(http, x, &headsz)) == NULL)
+		goto err;
+	if ((code = http_head_status(http, head, headsz)) < 0)
+		goto err;
+
+	keepalive = strncmp(head[0].val, "HTTP/1.1 ", 9) == 0;
+	for (i = 1; i < headsz; i++) {
+		if (strcasecmp(head[i].key, "Connection") == 0) {
+			if (strcasecmp(head[i].val, "close") == 0)
+				keepalive = 0;
+			else if (strcasecmp(head[i].val, "keep-alive") == 0)
+				keepalive = 1;
+		} else if (strcasecmp(head[i].key, "Content-Length") == 0) {
+			clen = strtonum(head[i].val, 0, HTTP_BODY_MAX,
+			    &errstr);
+			if (errstr != NULL) {
+				warnx("%s: content length %s", http->src.ip,
+				    errstr);
+				goto err;
+			}
+			haveclen = 1;
+		} else if (strcasecmp(head[i].key,
+		    "Transfer-Encoding") == 0) {
+			if (strcasecmp(head[i].val, "chunked") != 0) {
+				warnx("%s: unsupported transfer encoding %s",
+				    http->src.ip, head[i].val);
+				goto err;
+			}
+			chunked = 1;
+		}
+	}
+
+	if (chunked)
+		bod = http_body_read_chunked(http, x, &bodsz);
+	else if (haveclen)
+		bod = http_body_read_len(http, x, clen, &bodsz);
+	else {
+		/* The body ends when the server closes the connection. */
+		keepalive = 0;
+		bod = http_body_read(http, x, &bodsz);
+	}
+	if (bod == NULL)
+		goto err;
+
+	if (!keepalive)
+		http_disconnect(http);
+
+	if ((g = calloc(1, sizeof(struct httpget))) == NULL) {
+		warn("calloc");
+		goto err;
+	}
+
+	g->headpart = headr;
+	g->headpartsz = headrsz;
+	g->bodypart = bod;
+	g->bodypartsz = bodsz;
+	g->head = head;
+	g->headsz = headsz;
+	g->code = code;
+	g->keepalive = keepalive;
+	g->xfer = x;
+	return g;
+
+ err:
+	http_close(x);
+	http_disconnect(http);
+	return NULL;
+}
+
 #if 0
 int
 main(void)
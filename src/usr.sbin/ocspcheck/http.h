@@ -59,6 +59,7 @@ struct	httpget {
 	size_t		 headpartsz; /* size of headpart */
 	char		*bodypart; /* body buffer */
 	size_t		 bodypartsz; /* size of bodypart */
+	int		 keepalive; /* http_request() connection is open */
 };
 
 int		 http_init(void);
@@ -68,6 +69,8 @@ struct httpget	*http_get(const struct source *, size_t,
 			const char *, short, const char *,
 			const void *, size_t);
 void		 http_get_free(struct httpget *);
+struct httpget	*http_request(struct http *, const char *,
+			const void *, size_t);
 
 /* Allocation and release. */
 struct http	*http_alloc(const struct source *, size_t,
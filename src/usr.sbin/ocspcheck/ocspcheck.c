@@ -20,9 +20,12 @@
 #include <netinet/in.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 
 #include <err.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <libgen.h>
 #include <limits.h>
 #include <netdb.h>
 #include <poll.h>
@@ -41,6 +44,7 @@
 #define MAXAGE_SEC (14*24*60*60)
 #define JITTER_SEC (60)
 #define OCSP_MAX_RESPONSE_SIZE (20480)
+#define MAX_JOBS (256)
 
 typedef struct ocsp_request {
 	STACK_OF(X509) *fullchain;
@@ -64,6 +68,27 @@ struct addr {
 	char	 ip[INET6_ADDRSTRLEN];
 };
 
+/*
+ * In batch mode, requests are grouped by the OCSP url of their
+ * certificate, and each responder is only looked up in the DNS once.
+ */
+struct responder {
+	char		*url;
+	char		*host;
+	char		*path;
+	short		 port;
+	struct addr	 addrs[MAX_SERVERS_DNS];
+	struct source	 sources[MAX_SERVERS_DNS];
+	size_t		 nsources;
+};
+
+struct batch_entry {
+	char			*certfile;
+	char			*staplefile;
+	ocsp_request		*request;
+	struct responder	*responder;
+};
+
 static ssize_t
 host_dns(const char *s, struct addr vec[MAX_SERVERS_DNS])
 {
@@ -307,7 +332,7 @@ issuer_from_chain(STACK_OF(X509) *fullchain)
 }
 
 static ocsp_request *
-ocsp_request_new_from_cert(const char *cadir, char *file, int nonce)
+ocsp_request_new_from_cert(char *file, int nonce)
 {
 	X509 *cert;
 	int count = 0;
@@ -326,11 +351,6 @@ ocsp_request_new_from_cert(const char *cadir, char *file, int nonce)
 		goto err;
 
 	request->fullchain = read_fullchain(file, &count);
-	if (cadir == NULL) {
-		/* Drop rpath from pledge, we don't need to read anymore */
-		if (pledge("stdio inet dns", NULL) == -1)
-			err(1, "pledge");
-	}
 	if (request->fullchain == NULL) {
 		warnx("Unable to read cert chain from file %s", file);
 		goto err;
@@ -535,24 +555,427 @@ validate_response(char *buf, size_t size, ocsp_request *request,
 	return ret;
 }
 
+/*
+ * Write a staple by replacing the file, so that a server loading it
+ * never sees a partially written response.
+ */
+static int
+write_staple(const char *file, const char *staple, size_t staplesz)
+{
+	char *tmp;
+	size_t written = 0;
+	ssize_t w;
+	int fd;
+
+	if (asprintf(&tmp, "%s.XXXXXXXXXX", file) == -1) {
+		warn("asprintf");
+		return 0;
+	}
+	if ((fd = mkstemp(tmp)) == -1) {
+		warn("Unable to create temporary file %s", tmp);
+		free(tmp);
+		return 0;
+	}
+	while (written < staplesz) {
+		w = write(fd, staple + written, staplesz - written);
+		if (w == -1) {
+			if (errno != EINTR && errno != EAGAIN) {
+				warn("Write of OCSP response to %s failed",
+				    tmp);
+				goto err;
+			}
+		} else
+			written += w;
+	}
+	if (fchmod(fd, S_IWUSR|S_IRUSR|S_IRGRP|S_IROTH) == -1) {
+		warn("fchmod %s", tmp);
+		goto err;
+	}
+	if (close(fd) == -1) {
+		fd = -1;
+		warn("Write of OCSP response to %s failed", tmp);
+		goto err;
+	}
+	fd = -1;
+	if (rename(tmp, file) == -1) {
+		warn("Unable to rename %s to %s", tmp, file);
+		goto err;
+	}
+	free(tmp);
+	return 1;
+
+ err:
+	if (fd != -1)
+		close(fd);
+	unlink(tmp);
+	free(tmp);
+	return 0;
+}
+
+/*
+ * Read a batch file, with a certificate chain file and the staple file
+ * to write for it on each line.
+ */
+static struct batch_entry *
+read_batch(const char *file, size_t *count)
+{
+	struct batch_entry *entries = NULL, *e;
+	char *line = NULL, *cp, *certfile, *staplefile;
+	size_t linesize = 0, lineno = 0, n = 0, max = 0;
+	ssize_t linelen;
+	FILE *fp;
+	void *p;
+
+	if (strcmp(file, "-") == 0)
+		fp = stdin;
+	else if ((fp = fopen(file, "r")) == NULL)
+		err(1, "Unable to open batch file %s", file);
+
+	while ((linelen = getline(&line, &linesize, fp)) != -1) {
+		lineno++;
+		if ((cp = strchr(line, '#')) != NULL)
+			*cp = '\0';
+		cp = line;
+		if ((certfile = strsep(&cp, " \t\n")) == NULL ||
+		    *certfile == '\0')
+			continue;
+		while (cp != NULL && (*cp == ' ' || *cp == '\t'))
+			cp++;
+		if ((staplefile = strsep(&cp, " \t\n")) == NULL ||
+		    *staplefile == '\0')
+			errx(1, "%s:%zu: missing staple file", file, lineno);
+		while (cp != NULL && (*cp == ' ' || *cp == '\t' ||
+		    *cp == '\n'))
+			cp++;
+		if (cp != NULL && *cp != '\0')
+			errx(1, "%s:%zu: trailing garbage", file, lineno);
+
+		if (n == max) {
+			if ((p = reallocarray(entries, max + 64,
+			    sizeof(*entries))) == NULL)
+				err(1, NULL);
+			entries = p;
+			max += 64;
+		}
+		e = &entries[n++];
+		memset(e, 0, sizeof(*e));
+		if ((e->certfile = strdup(certfile)) == NULL ||
+		    (e->staplefile = strdup(staplefile)) == NULL)
+			err(1, NULL);
+	}
+	if (ferror(fp))
+		err(1, "Unable to read batch file %s", file);
+	free(line);
+	if (fp != stdin)
+		fclose(fp);
+
+	*count = n;
+	return entries;
+}
+
+static int
+batch_entry_cmp(const void *a, const void *b)
+{
+	const struct batch_entry *ea = a, *eb = b;
+
+	/* Entries with no request sort last. */
+	if (ea->request == NULL || eb->request == NULL)
+		return (ea->request == NULL) - (eb->request == NULL);
+	return strcmp(ea->request->url, eb->request->url);
+}
+
+static struct responder *
+responder_new(const char *url)
+{
+	struct responder *r;
+	ssize_t rescount;
+	size_t i;
+
+	if ((r = calloc(1, sizeof(*r))) == NULL)
+		err(1, NULL);
+	if ((r->url = strdup(url)) == NULL)
+		err(1, NULL);
+	if ((r->host = url2host(url, &r->port, &r->path)) == NULL) {
+		warnx("Invalid OCSP url %s", url);
+		return r;
+	}
+
+	vspew("Using %s to host %s, port %d, path %s\n",
+	    r->port == 443 ? "https" : "http", r->host, r->port, r->path);
+
+	if ((rescount = host_dns(r->host, r->addrs)) <= 0) {
+		warnx("Unable to resolve %s", r->host);
+		return r;
+	}
+	for (i = 0; i < rescount; i++) {
+		r->sources[i].ip = r->addrs[i].ip;
+		r->sources[i].family = r->addrs[i].family;
+	}
+	r->nsources = rescount;
+
+	return r;
+}
+
+static int
+batch_check(struct batch_entry *e, struct httpget *hget, X509_STORE *store)
+{
+	struct responder *r = e->responder;
+
+	if (hget == NULL) {
+		warnx("No OCSP response from %s for %s", r->host,
+		    e->certfile);
+		return 0;
+	}
+	if (hget->code != 200) {
+		warnx("http reply code %d from %s for %s", hget->code,
+		    r->host, e->certfile);
+		return 0;
+	}
+	if (hget->bodypartsz <= 0) {
+		warnx("No body in reply from %s for %s", r->host,
+		    e->certfile);
+		return 0;
+	}
+	if (!validate_response(hget->bodypart, hget->bodypartsz,
+	    e->request, store, r->host, e->certfile))
+		return 0;
+	if (!write_staple(e->staplefile, hget->bodypart, hget->bodypartsz))
+		return 0;
+
+	vspew("Wrote OCSP response for %s to %s\n", e->certfile,
+	    e->staplefile);
+	return 1;
+}
+
+/*
+ * Fetch the staples for a run of entries, keeping the connection to
+ * each responder open for as long as the server allows it.
+ */
+static int
+batch_run(struct batch_entry *entries, size_t count, X509_STORE *store)
+{
+	struct responder *cur = NULL;
+	struct http *conn = NULL;
+	struct httpget *hget;
+	struct batch_entry *e;
+	size_t i;
+	int failed = 0, reused;
+
+	for (i = 0; i < count; i++) {
+		e = &entries[i];
+		if (e->request == NULL)
+			continue;
+		if (e->responder != cur) {
+			http_free(conn);
+			conn = NULL;
+			cur = e->responder;
+		}
+		if (cur->nsources == 0) {
+			failed++;
+			continue;
+		}
+
+		hget = NULL;
+		reused = conn != NULL;
+		for (;;) {
+			if (conn == NULL && (conn = http_alloc(cur->sources,
+			    cur->nsources, cur->host, cur->port,
+			    cur->path)) == NULL)
+				break;
+			hget = http_request(conn, cur->path,
+			    e->request->data, e->request->size);
+			if (hget != NULL)
+				break;
+			http_free(conn);
+			conn = NULL;
+			/*
+			 * The server may have closed an idle connection
+			 * after our last request, so try once more on a
+			 * new one.
+			 */
+			if (!reused)
+				break;
+			reused = 0;
+		}
+		if (hget != NULL && !hget->keepalive) {
+			http_free(conn);
+			conn = NULL;
+		}
+
+		if (!batch_check(e, hget, store))
+			failed++;
+		http_get_free(hget);
+	}
+	http_free(conn);
+
+	return failed;
+}
+
+static int
+batch_unveil(struct batch_entry *entries, size_t count, const char *cafile,
+    const char *cadir)
+{
+	char **dirs = NULL, *dir, *copy;
+	size_t i, j, ndirs = 0;
+	void *p;
+
+	if (cafile != NULL) {
+		if (unveil(cafile, "r") == -1)
+			err(1, "unveil %s", cafile);
+	}
+	if (cadir != NULL) {
+		if (unveil(cadir, "r") == -1)
+			err(1, "unveil %s", cadir);
+	}
+
+	/* Staples are replaced with a new file in the same directory. */
+	for (i = 0; i < count; i++) {
+		if ((copy = strdup(entries[i].staplefile)) == NULL)
+			err(1, NULL);
+		if ((dir = dirname(copy)) == NULL)
+			err(1, "dirname %s", entries[i].staplefile);
+		for (j = 0; j < ndirs; j++) {
+			if (strcmp(dirs[j], dir) == 0)
+				break;
+		}
+		if (j == ndirs) {
+			if ((p = reallocarray(dirs, ndirs + 1,
+			    sizeof(*dirs))) == NULL)
+				err(1, NULL);
+			dirs = p;
+			if ((dirs[ndirs++] = strdup(dir)) == NULL)
+				err(1, NULL);
+			if (unveil(dir, "rwc") == -1)
+				err(1, "unveil %s", dir);
+		}
+		free(copy);
+	}
+	for (j = 0; j < ndirs; j++)
+		free(dirs[j]);
+	free(dirs);
+
+	if (unveil(NULL, NULL) == -1)
+		err(1, "unveil");
+
+	return 0;
+}
+
+/*
+ * Fetch and save the staples for all of the certificates listed in a
+ * batch file, with up to jobs processes each working through a part
+ * of the list.
+ */
+static int
+batch(const char *batchfile, const char *cafile, const char *cadir,
+    int nonce, int jobs)
+{
+	struct batch_entry *entries, *e;
+	struct responder *r = NULL;
+	X509_STORE *castore;
+	size_t i, count, lo, hi;
+	int j, status, failed = 0;
+	pid_t pid;
+
+	if (pledge("stdio inet rpath wpath cpath fattr dns proc unveil",
+	    NULL) == -1)
+		err(1, "pledge");
+
+	entries = read_batch(batchfile, &count);
+	if (count == 0)
+		errx(1, "No certificates in batch file %s", batchfile);
+
+	if ((castore = read_cacerts(cafile, cadir)) == NULL)
+		exit(1);
+
+	for (i = 0; i < count; i++) {
+		e = &entries[i];
+		if ((e->request = ocsp_request_new_from_cert(e->certfile,
+		    nonce)) == NULL) {
+			failed++;
+			continue;
+		}
+		dspew("Built an %zu byte ocsp request for %s\n",
+		    e->request->size, e->certfile);
+	}
+
+	/* Group the requests by responder. */
+	qsort(entries, count, sizeof(*entries), batch_entry_cmp);
+	for (i = 0; i < count; i++) {
+		e = &entries[i];
+		if (e->request == NULL)
+			break;
+		if (r == NULL || strcmp(r->url, e->request->url) != 0)
+			r = responder_new(e->request->url);
+		e->responder = r;
+	}
+
+	batch_unveil(entries, count, cafile, cadir);
+
+	if (cadir == NULL) {
+		if (pledge("stdio inet wpath cpath fattr proc", NULL) == -1)
+			err(1, "pledge");
+	} else {
+		if (pledge("stdio inet rpath wpath cpath fattr proc", NULL) == -1)
+			err(1, "pledge");
+	}
+
+	OPENSSL_add_all_algorithms_noconf();
+
+	if ((size_t)jobs > count)
+		jobs = count;
+	if (jobs == 1)
+		return batch_run(entries, count, castore) > 0 || failed > 0;
+
+	for (j = 0; j < jobs; j++) {
+		lo = count * j / jobs;
+		hi = count * (j + 1) / jobs;
+		switch (pid = fork()) {
+		case -1:
+			err(1, "fork");
+		case 0:
+			if (cadir == NULL) {
+				if (pledge("stdio inet wpath cpath fattr",
+				    NULL) == -1)
+					err(1, "pledge");
+			} else {
+				if (pledge("stdio inet rpath wpath cpath fattr",
+				    NULL) == -1)
+					err(1, "pledge");
+			}
+			exit(batch_run(entries + lo, hi - lo, castore) > 0);
+		default:
+			break;
+		}
+	}
+	while (wait(&status) != -1) {
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			failed++;
+	}
+	if (errno != ECHILD)
+		err(1, "wait");
+
+	return failed > 0;
+}
+
 static void
 usage(void)
 {
 	fprintf(stderr,
 	    "usage: ocspcheck [-Nv] [-C CAfile] [-i staplefile] "
-	    "[-o staplefile] file\n");
+	    "[-o staplefile] file\n"
+	    "       ocspcheck [-Nv] [-C CAfile] [-j jobs] -b batchfile\n");
 	exit(1);
 }
 
 int
 main(int argc, char **argv)
 {
-	const char *cafile = NULL, *cadir = NULL;
+	const char *cafile = NULL, *cadir = NULL, *batchfile = NULL, *errstr;
 	char *host = NULL, *path = NULL, *certfile = NULL, *outfile = NULL,
 	    *instaple = NULL, *infile = NULL;
 	struct addr addrs[MAX_SERVERS_DNS] = {{0}};
 	struct source sources[MAX_SERVERS_DNS];
-	int i, ch, staplefd = -1, infd = -1, nonce = 1;
+	int i, ch, staplefd = -1, infd = -1, nonce = 1, jobs = 1;
 	ocsp_request *request = NULL;
 	size_t rescount, httphsz = 0, instaplesz = 0;
 	struct httphead	*httph = NULL;
@@ -561,11 +984,20 @@ main(int argc, char **argv)
 	ssize_t written, w;
 	short port;
 
-	while ((ch = getopt(argc, argv, "C:i:No:v")) != -1) {
+	while ((ch = getopt(argc, argv, "b:C:i:j:No:v")) != -1) {
 		switch (ch) {
+		case 'b':
+			batchfile = optarg;
+			break;
 		case 'C':
 			cafile = optarg;
 			break;
+		case 'j':
+			jobs = strtonum(optarg, 1, MAX_JOBS, &errstr);
+			if (errstr != NULL)
+				errx(1, "number of jobs is %s: %s", errstr,
+				    optarg);
+			break;
 		case 'N':
 			nonce = 0;
 			break;
@@ -585,7 +1017,10 @@ main(int argc, char **argv)
 	argc -= optind;
 	argv += optind;
 
-	if (argc != 1 || (certfile = argv[0]) == NULL)
+	if (batchfile != NULL) {
+		if (argc != 0 || infile != NULL || outfile != NULL)
+			usage();
+	} else if (argc != 1 || (certfile = argv[0]) == NULL)
 		usage();
 
 	if (outfile != NULL) {
@@ -615,6 +1050,9 @@ main(int argc, char **argv)
 			cadir = X509_get_default_cert_dir();
 	}
 
+	if (batchfile != NULL)
+		exit(batch(batchfile, cafile, cadir, nonce, jobs));
+
 	if (cafile != NULL) {
 		if (unveil(cafile, "r") == -1)
 			err(1, "unveil %s", cafile);
@@ -636,9 +1074,13 @@ main(int argc, char **argv)
 	 */
 	if ((castore = read_cacerts(cafile, cadir)) == NULL)
 		exit(1);
-	if ((request = ocsp_request_new_from_cert(cadir, certfile, nonce))
-	    == NULL)
+	if ((request = ocsp_request_new_from_cert(certfile, nonce)) == NULL)
 		exit(1);
+	if (cadir == NULL) {
+		/* Drop rpath from pledge, we don't need to read anymore */
+		if (pledge("stdio inet dns", NULL) == -1)
+			err(1, "pledge");
+	}
 
 	dspew("Built an %zu byte ocsp request\n", request->size);
 